@@ -14,11 +14,16 @@
  * limitations under the License.
  */
 
-#include <functional>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "CallbackUtils.h"
 
 struct {
+    JavaVM* vm;
 #ifdef ANDROID
     jclass handlerClass;
     jmethodID post;
@@ -27,74 +32,126 @@ struct {
     jmethodID execute;
 } gCallbackUtils;
 
-JniCallback* JniCallback::make(filament::Engine* engine,
-        JNIEnv* env, jobject handler, jobject callback) {
-    void* that = engine->streamAlloc(sizeof(JniCallback), alignof(JniCallback));
-    return new (that) JniCallback(env, handler, callback);
-}
+namespace {
 
-JniCallback::JniCallback(JNIEnv* env, jobject handler, jobject callback)
-        : mEnv(env)
-        , mHandler(env->NewGlobalRef(handler))
-        , mCallback(env->NewGlobalRef(callback)) {
-}
+using ReleaseFunction = void(*)(JNIEnv* env, void* user);
+
+class ReleaseThread {
+public:
+    static ReleaseThread& get() {
+        // never destroyed, the thread is a daemon that lives as long as the process
+        static ReleaseThread* const sThread = new ReleaseThread();
+        return *sThread;
+    }
+
+    void post(ReleaseFunction release, void* user) {
+        std::lock_guard<std::mutex> lock(mLock);
+        mPending.emplace_back(release, user);
+        mCondition.notify_one();
+    }
+
+private:
+    ReleaseThread() : mThread(&ReleaseThread::loop, this) {
+        mThread.detach();
+    }
 
-JniCallback::~JniCallback() {
-    if (mHandler && mCallback) {
+    void loop() {
+        JavaVMAttachArgs args = { JNI_VERSION_1_6, (char*) "FilamentRelease", nullptr };
+        JNIEnv* env;
 #ifdef ANDROID
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.handlerClass)) {
-            mEnv->CallBooleanMethod(mHandler, gCallbackUtils.post, mCallback);
+        gCallbackUtils.vm->AttachCurrentThreadAsDaemon(&env, &args);
+#else
+        gCallbackUtils.vm->AttachCurrentThreadAsDaemon(reinterpret_cast<void**>(&env), &args);
+#endif
+        std::vector<std::pair<ReleaseFunction, void*>> releasing;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mLock);
+                mCondition.wait(lock, [this]() { return !mPending.empty(); });
+                std::swap(releasing, mPending);
+            }
+            for (auto const& item : releasing) {
+                item.first(env, item.second);
+            }
+            releasing.clear();
+        }
+    }
+
+    std::mutex mLock;
+    std::condition_variable mCondition;
+    std::vector<std::pair<ReleaseFunction, void*>> mPending;
+    std::thread mThread;
+};
+
+void postJavaCallback(JNIEnv* env, jobject handler, jobject callback) {
+    if (handler && callback) {
+#ifdef ANDROID
+        if (env->IsInstanceOf(handler, gCallbackUtils.handlerClass)) {
+            env->CallBooleanMethod(handler, gCallbackUtils.post, callback);
         }
 #endif
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.executorClass)) {
-            mEnv->CallVoidMethod(mHandler, gCallbackUtils.execute, mCallback);
+        if (env->IsInstanceOf(handler, gCallbackUtils.executorClass)) {
+            env->CallVoidMethod(handler, gCallbackUtils.execute, callback);
         }
     }
-    mEnv->DeleteGlobalRef(mHandler);
-    mEnv->DeleteGlobalRef(mCallback);
+    // the references are null when the caller didn't ask for a callback
+    if (handler) {
+        env->DeleteGlobalRef(handler);
+    }
+    if (callback) {
+        env->DeleteGlobalRef(callback);
+    }
+}
+
+} // anonymous namespace
+
+JniCallback* JniCallback::make(JNIEnv* env, jobject handler, jobject callback) {
+    return new JniCallback(env, handler, callback);
+}
+
+JniCallback::JniCallback(JNIEnv* env, jobject handler, jobject callback)
+        : mHandler(handler ? env->NewGlobalRef(handler) : nullptr)
+        , mCallback(callback ? env->NewGlobalRef(callback) : nullptr) {
 }
 
 void JniCallback::invoke(void*, size_t, void* user) {
+    ReleaseThread::get().post(&JniCallback::release, user);
+}
+
+void JniCallback::release(JNIEnv* env, void* user) {
     JniCallback* data = reinterpret_cast<JniCallback*>(user);
+    postJavaCallback(env, data->mHandler, data->mCallback);
     delete data;
 }
 
-JniBufferCallback* JniBufferCallback::make(filament::Engine* engine,
-        JNIEnv* env, jobject handler, jobject callback, AutoBuffer&& buffer) {
-    void* that = engine->streamAlloc(sizeof(JniBufferCallback), alignof(JniBufferCallback));
-    return new (that) JniBufferCallback(env, handler, callback, std::move(buffer));
+JniBufferCallback* JniBufferCallback::make(JNIEnv* env, jobject handler, jobject callback,
+        AutoBuffer&& buffer) {
+    // this outlives the driver's call to invoke(), so it can't be allocated in the command stream
+    return new JniBufferCallback(env, handler, callback, std::move(buffer));
 }
 
 JniBufferCallback::JniBufferCallback(JNIEnv* env, jobject handler, jobject callback,
         AutoBuffer&& buffer)
-        : mEnv(env)
-        , mHandler(env->NewGlobalRef(handler))
-        , mCallback(env->NewGlobalRef(callback))
-        , mBuffer(std::move(buffer)){
+        : mHandler(handler ? env->NewGlobalRef(handler) : nullptr)
+        , mCallback(callback ? env->NewGlobalRef(callback) : nullptr)
+        , mBuffer(std::move(buffer)) {
 }
 
-JniBufferCallback::~JniBufferCallback() {
-    if (mHandler && mCallback) {
-#ifdef ANDROID
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.handlerClass)) {
-            mEnv->CallBooleanMethod(mHandler, gCallbackUtils.post, mCallback);
-        }
-#endif
-        if (mEnv->IsInstanceOf(mHandler, gCallbackUtils.executorClass)) {
-            mEnv->CallVoidMethod(mHandler, gCallbackUtils.execute, mCallback);
-        }
-    }
-    mEnv->DeleteGlobalRef(mHandler);
-    mEnv->DeleteGlobalRef(mCallback);
+void JniBufferCallback::invoke(void*, size_t, void* user) {
+    ReleaseThread::get().post(&JniBufferCallback::release, user);
 }
 
-void JniBufferCallback::invoke(void*, size_t, void* user) {
+void JniBufferCallback::release(JNIEnv* env, void* user) {
     JniBufferCallback* data = reinterpret_cast<JniBufferCallback*>(user);
-    // don't call delete here, because we don't own the storage
-    data->~JniBufferCallback();
+    postJavaCallback(env, data->mHandler, data->mCallback);
+    // the buffer is released by this thread rather than the one that created it
+    data->mBuffer.setEnvironment(env);
+    delete data;
 }
 
 void registerCallbackUtils(JNIEnv *env) {
+    env->GetJavaVM(&gCallbackUtils.vm);
+
 #ifdef ANDROID
     gCallbackUtils.handlerClass = env->FindClass("android/os/Handler");
     gCallbackUtils.handlerClass = (jclass) env->NewGlobalRef(gCallbackUtils.handlerClass);
@@ -23,32 +23,35 @@
 
 #include <filament/Engine.h>
 
+/*
+ * The callbacks of the BufferDescriptors are invoked by the driver thread, which isn't attached to
+ * the JVM. They hand the callback over to a dedicated thread, attached once, which posts the Java
+ * callback (if any) on its handler and releases the Java objects, possibly many at a time.
+ */
+
 struct JniCallback {
-    static JniCallback* make(filament::Engine* engine,
-            JNIEnv* env, jobject handler, jobject callback);
+    static JniCallback* make(JNIEnv* env, jobject handler, jobject callback);
 
     static void invoke(void* buffer, size_t n, void* user);
 
 private:
     JniCallback(JNIEnv* env, jobject handler, jobject callback);
-    ~JniCallback();
+    static void release(JNIEnv* env, void* user);
 
-    JNIEnv* mEnv;
     jobject mHandler;
     jobject mCallback;
 };
 
 struct JniBufferCallback {
-    static JniBufferCallback* make(filament::Engine* engine,
-            JNIEnv* env, jobject handler, jobject callback, AutoBuffer&& buffer);
+    static JniBufferCallback* make(JNIEnv* env, jobject handler, jobject callback,
+            AutoBuffer&& buffer);
 
     static void invoke(void* buffer, size_t n, void* user);
 
 private:
     JniBufferCallback(JNIEnv* env, jobject handler, jobject callback, AutoBuffer&& buffer);
-    ~JniBufferCallback();
+    static void release(JNIEnv* env, void* user);
 
-    JNIEnv* mEnv;
     jobject mHandler;
     jobject mCallback;
     AutoBuffer mBuffer;
@@ -52,6 +52,11 @@ public:
         return count << mShift;
     }
 
+    // the environment of the thread releasing the buffer, if it's not the one that created it
+    void setEnvironment(JNIEnv* env) noexcept {
+        mEnv = env;
+    }
+
 private:
     void* mUserData = nullptr;
     size_t mSize = 0;
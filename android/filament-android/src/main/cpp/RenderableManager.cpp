@@ -234,6 +234,21 @@ Java_com_google_android_filament_RenderableManager_nSetLayerMask(JNIEnv*, jclass
     rm->setLayerMask((RenderableManager::Instance) i, (uint8_t) select, (uint8_t) value);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_RenderableManager_nSetLayerMasks(JNIEnv* env, jclass,
+        jlong nativeRenderableManager, jintArray instances_, jint count, jint select,
+        jbyteArray values_) {
+    RenderableManager *rm = (RenderableManager *) nativeRenderableManager;
+    jint *instances = env->GetIntArrayElements(instances_, NULL);
+    jbyte *values = env->GetByteArrayElements(values_, NULL);
+    for (jint i = 0; i < count; i++) {
+        rm->setLayerMask((RenderableManager::Instance) instances[i], (uint8_t) select,
+                (uint8_t) values[i]);
+    }
+    env->ReleaseByteArrayElements(values_, values, JNI_ABORT);
+    env->ReleaseIntArrayElements(instances_, instances, JNI_ABORT);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_RenderableManager_nSetPriority(JNIEnv*, jclass,
         jlong nativeRenderableManager, jint i, jint priority) {
@@ -29,10 +29,21 @@ using namespace driver;
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_android_filament_Renderer_nBeginFrame(JNIEnv *, jclass, jlong nativeRenderer,
-        jlong nativeSwapChain) {
+        jlong nativeSwapChain, jlong frameTimeNanos) {
     Renderer *renderer = (Renderer *) nativeRenderer;
     SwapChain *swapChain = (SwapChain *) nativeSwapChain;
-    return (jboolean) renderer->beginFrame(swapChain);
+    return (jboolean) renderer->beginFrame(swapChain, (uint64_t) frameTimeNanos);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_Renderer_nSetDisplayInfo(JNIEnv *, jclass, jlong nativeRenderer,
+        jfloat refreshRate, jlong presentationDeadlineNanos, jlong vsyncOffsetNanos) {
+    Renderer *renderer = (Renderer *) nativeRenderer;
+    Renderer::DisplayInfo info;
+    info.refreshRate = refreshRate;
+    info.presentationDeadlineNanos = (uint64_t) presentationDeadlineNanos;
+    info.vsyncOffsetNanos = (uint64_t) vsyncOffsetNanos;
+    renderer->setDisplayInfo(info);
 }
 
 extern "C" JNIEXPORT void JNICALL
@@ -71,7 +82,7 @@ Java_com_google_android_filament_Renderer_nReadPixels(JNIEnv *env, jclass,
     }
 
     void *buffer = nioBuffer.getData();
-    auto *callback = JniBufferCallback::make(engine, env, handler, runnable, std::move(nioBuffer));
+    auto *callback = JniBufferCallback::make(env, handler, runnable, std::move(nioBuffer));
 
     PixelBufferDescriptor desc(buffer, sizeInBytes, (driver::PixelDataFormat) format,
             (driver::PixelDataType) type, (uint8_t) alignment, (uint32_t) left, (uint32_t) top,
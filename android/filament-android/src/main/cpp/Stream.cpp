@@ -143,7 +143,7 @@ Java_com_google_android_filament_Stream_nReadPixels(JNIEnv *env, jclass,
     }
 
     void *buffer = nioBuffer.getData();
-    auto *callback = JniBufferCallback::make(engine, env, handler, runnable, std::move(nioBuffer));
+    auto *callback = JniBufferCallback::make(env, handler, runnable, std::move(nioBuffer));
 
     PixelBufferDescriptor desc(buffer, sizeInBytes, (driver::PixelDataFormat) format,
             (driver::PixelDataType) type, (uint8_t) alignment, (uint32_t) left, (uint32_t) top,
@@ -154,3 +154,9 @@ Java_com_google_android_filament_Stream_nReadPixels(JNIEnv *env, jclass,
 
     return 0;
 }
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_google_android_filament_Stream_nGetTimestamp(JNIEnv*, jclass, jlong nativeStream) {
+    Stream* stream = (Stream*) nativeStream;
+    return stream->getTimestamp();
+}
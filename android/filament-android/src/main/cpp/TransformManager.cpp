@@ -20,10 +20,14 @@
 #include <utils/Entity.h>
 #include <filament/TransformManager.h>
 
+#include "NioUtils.h"
+
 using namespace utils;
 using namespace filament;
 
 static_assert(sizeof(jint) == sizeof(Entity), "jint and Entity are not compatible!!");
+static_assert(sizeof(jint) == sizeof(TransformManager::Instance),
+        "jint and TransformManager::Instance are not compatible!!");
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_google_android_filament_TransformManager_nHasComponent(JNIEnv *env, jclass type,
@@ -86,6 +90,25 @@ Java_com_google_android_filament_TransformManager_nSetTransform(JNIEnv *env, jcl
     env->ReleaseFloatArrayElements(localTransform_, localTransform, JNI_ABORT);
 }
 
+extern "C" JNIEXPORT jint JNICALL
+Java_com_google_android_filament_TransformManager_nSetTransforms(JNIEnv *env, jclass type,
+        jlong nativeTransformManager, jintArray instances_, jint count, jobject localTransforms,
+        jint remaining) {
+    TransformManager *tm = (TransformManager *) nativeTransformManager;
+    AutoBuffer nioBuffer(env, localTransforms, count * 16);
+    void* data = nioBuffer.getData();
+    size_t sizeInBytes = nioBuffer.getSize();
+    if (sizeInBytes > (remaining << nioBuffer.getShift())) {
+        // BufferOverflowException
+        return -1;
+    }
+    jint *instances = env->GetIntArrayElements(instances_, NULL);
+    tm->setTransforms(reinterpret_cast<const TransformManager::Instance *>(instances),
+            static_cast<const math::mat4f *>(data), (size_t) count);
+    env->ReleaseIntArrayElements(instances_, instances, JNI_ABORT);
+    return 0;
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_TransformManager_nGetTransform(JNIEnv *env, jclass type,
         jlong nativeTransformManager, jint i, jfloatArray outLocalTransform_) {
@@ -101,7 +101,7 @@ Java_com_google_android_filament_VertexBuffer_nSetBufferAt(JNIEnv *env, jclass t
         return -1;
     }
 
-    auto* callback = JniBufferCallback::make(engine, env, handler, runnable, std::move(nioBuffer));
+    auto* callback = JniBufferCallback::make(env, handler, runnable, std::move(nioBuffer));
 
     BufferDescriptor desc(data, sizeInBytes, &JniBufferCallback::invoke, callback);
 
@@ -123,7 +123,8 @@ extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetDynamicResolutionOptions(JNIEnv *env, jclass,
         jlong nativeView, jboolean enabled, jboolean homogeneousScaling,
         jfloat targetFrameTimeMilli, jfloat headRoomRatio, jfloat scaleRate,
-        jfloat minScale, jfloat maxScale, jint history) {
+        jfloat minScale, jfloat maxScale, jint history,
+        jfloat proportionalGain, jfloat derivativeGain, jfloat hysteresis, jfloat gpuUtilization) {
     View* view = (View*) nativeView;
     View::DynamicResolutionOptions options;
     options.enabled = enabled;
@@ -134,6 +135,10 @@ Java_com_google_android_filament_View_nSetDynamicResolutionOptions(JNIEnv *env,
     options.minScale = math::float2{ minScale };
     options.maxScale = math::float2{ maxScale };
     options.history = (uint8_t)history;
+    options.proportionalGain = proportionalGain;
+    options.derivativeGain = derivativeGain;
+    options.hysteresis = hysteresis;
+    options.gpuUtilization = gpuUtilization;
     return view->setDynamicResolutionOptions(options);
 }
 
@@ -144,6 +149,13 @@ Java_com_google_android_filament_View_nSetDynamicLightingOptions(JNIEnv *env,
     view->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_google_android_filament_View_nSetFroxelCount(JNIEnv *env,
+        jclass, jlong nativeView, jint froxelCount) {
+    View* view = (View*) nativeView;
+    view->setFroxelCount((uint32_t) froxelCount);
+}
+
 extern "C" JNIEXPORT void JNICALL
 Java_com_google_android_filament_View_nSetDepthPrepass(JNIEnv *env,
         jclass, jlong nativeView, jint value) {
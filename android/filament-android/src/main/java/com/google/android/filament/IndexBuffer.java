@@ -107,6 +107,9 @@ public class IndexBuffer {
     }
 
     /**
+     * A direct buffer is used in place, it must not be modified until the callback runs. The
+     * content of other buffers can be copied by the VM.
+     *
      * Valid handler types:
      * - Android: Handler, Executor
      * - Other: Executor
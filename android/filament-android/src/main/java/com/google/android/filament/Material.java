@@ -90,7 +90,8 @@ public class Material {
             MAT4,
             SAMPLER_2D,
             SAMPLER_CUBEMAP,
-            SAMPLER_EXTERNAL
+            SAMPLER_EXTERNAL,
+            SAMPLER_2D_ARRAY
         }
 
         public enum Precision {
@@ -236,6 +236,22 @@ public class RenderableManager {
         nSetLayerMask(mNativeObject, i, select, value);
     }
 
+    /**
+     * Changes the bits selected by select in the layer masks of several renderables in a single
+     * call, each to its own value.
+     *
+     * @param instances Instances of the renderables
+     * @param select Bits of the layer masks to change
+     * @param values New value of the selected bits, one per instance
+     */
+    public void setLayerMasks(@NonNull @EntityInstance int[] instances,
+            @IntRange(from = 0, to = 255) int select, @NonNull byte[] values) {
+        if (values.length < instances.length) {
+            throw new ArrayIndexOutOfBoundsException("values must have one entry per instance");
+        }
+        nSetLayerMasks(mNativeObject, instances, instances.length, select, values);
+    }
+
     public void setPriority(@EntityInstance int i, @IntRange(from = 0, to = 7) int priority) {
         nSetPriority(mNativeObject, i, priority);
     }
@@ -348,6 +364,7 @@ public class RenderableManager {
     private static native int nSetBonesAsQuaternions(long nativeObject, int i, Buffer quaternions, int remaining, int boneCount, int offset);
     private static native void nSetAxisAlignedBoundingBox(long nativeRenderableManager, int i, float cx, float cy, float cz, float ex, float ey, float ez);
     private static native void nSetLayerMask(long nativeRenderableManager, int i, int select, int value);
+    private static native void nSetLayerMasks(long nativeRenderableManager, int[] instances, int count, int select, byte[] values);
     private static native void nSetPriority(long nativeRenderableManager, int i, int priority);
     private static native void nSetCastShadows(long nativeRenderableManager, int i, boolean enabled);
     private static native void nSetReceiveShadows(long nativeRenderableManager, int i, boolean enabled);
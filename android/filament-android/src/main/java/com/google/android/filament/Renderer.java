@@ -27,6 +27,20 @@ public class Renderer {
     private final Engine mEngine;
     private long mNativeObject;
 
+    /**
+     * The display the frames are presented on, typically from {@link android.view.Display}.
+     *
+     * @see #setDisplayInfo(DisplayInfo)
+     */
+    public static class DisplayInfo {
+        /** Display.getRefreshRate() */
+        public float refreshRate = 60.0f;
+        /** Display.getPresentationDeadlineNanos() */
+        public long presentationDeadlineNanos = 0;
+        /** Display.getAppVsyncOffsetNanos() */
+        public long vsyncOffsetNanos = 0;
+    }
+
 
     Renderer(@NonNull Engine engine, long nativeRenderer) {
         mEngine = engine;
@@ -39,7 +53,28 @@ public class Renderer {
     }
 
     public boolean beginFrame(@NonNull SwapChain swapChain) {
-        return nBeginFrame(getNativeObject(), swapChain.getNativeObject());
+        return nBeginFrame(getNativeObject(), swapChain.getNativeObject(), 0);
+    }
+
+    /**
+     * Sets-up a frame started at a vsync, so that it's presented at a steady cadence, typically
+     * from a {@link android.view.Choreographer.FrameCallback}.
+     *
+     * @param frameTimeNanos The time of the vsync, as given to Choreographer.FrameCallback
+     * @return false if the frame must be skipped, true if it can be drawn
+     * @see #setDisplayInfo(DisplayInfo)
+     */
+    public boolean beginFrame(@NonNull SwapChain swapChain, long frameTimeNanos) {
+        return nBeginFrame(getNativeObject(), swapChain.getNativeObject(), frameTimeNanos);
+    }
+
+    /**
+     * Describes the display, for the pacing of the frames started with
+     * {@link #beginFrame(SwapChain, long)}.
+     */
+    public void setDisplayInfo(@NonNull DisplayInfo info) {
+        nSetDisplayInfo(getNativeObject(), info.refreshRate,
+                info.presentationDeadlineNanos, info.vsyncOffsetNanos);
     }
 
     public void endFrame() {
@@ -85,7 +120,8 @@ public class Renderer {
         mNativeObject = 0;
     }
 
-    private static native boolean nBeginFrame(long nativeRenderer, long nativeSwapChain);
+    private static native boolean nBeginFrame(long nativeRenderer, long nativeSwapChain, long frameTimeNanos);
+    private static native void nSetDisplayInfo(long nativeRenderer, float refreshRate, long presentationDeadlineNanos, long vsyncOffsetNanos);
     private static native void nEndFrame(long nativeRenderer);
     private static native void nRender(long nativeRenderer, long nativeView);
     private static native int nReadPixels(long nativeRenderer, long nativeEngine,
@@ -128,6 +128,14 @@ public class Stream {
         }
     }
 
+    /**
+     * Returns the timestamp, in nanoseconds, of the frame of a native stream that was latched
+     * last, or 0 if unknown. This doesn't wait for the engine.
+     */
+    public long getTimestamp() {
+        return nGetTimestamp(getNativeObject());
+    }
+
     long getNativeObject() {
         if (mNativeObject == 0) {
             throw new IllegalStateException("Calling method on destroyed Stream");
@@ -155,4 +163,5 @@ public class Stream {
             Object handler, Runnable callback);
 
     private static native boolean nIsNative(long nativeStream);
+    private static native long nGetTimestamp(long nativeStream);
 }
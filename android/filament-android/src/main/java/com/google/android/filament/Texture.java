@@ -37,7 +37,8 @@ public class Texture {
     public enum Sampler {
         SAMPLER_2D,
         SAMPLER_CUBEMAP,
-        SAMPLER_EXTERNAL
+        SAMPLER_EXTERNAL,
+        SAMPLER_2D_ARRAY
     }
 
     public enum InternalFormat {
@@ -132,10 +133,12 @@ public class Texture {
         INT,
         HALF,
         FLOAT,
-        COMPRESSED
+        COMPRESSED,
+        UINT_5_9_9_9_REV
     }
 
     public static class PixelBufferDescriptor {
+        // a direct buffer is used in place, it must not be modified until the callback runs
         public Buffer storage;
 
         public Type type;
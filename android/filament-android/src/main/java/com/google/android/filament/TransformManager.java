@@ -20,6 +20,9 @@ import android.support.annotation.NonNull;
 import android.support.annotation.Nullable;
 import android.support.annotation.Size;
 
+import java.nio.Buffer;
+import java.nio.BufferOverflowException;
+
 public class TransformManager {
     private long mNativeObject;
 
@@ -59,6 +62,24 @@ public class TransformManager {
         nSetTransform(mNativeObject, i, localTransform);
     }
 
+    /**
+     * Sets the local transforms of several transform components in a single call, e.g. every
+     * frame of an animation. The world transforms are updated once for all of them.
+     *
+     * @param instances Instances of the transform components to set
+     * @param localTransforms A FloatBuffer containing one transform (16 floats, column-major)
+     *                        per instance, in the same order. A direct buffer is not copied.
+     * @see #openLocalTransformTransaction()
+     */
+    public void setTransforms(@NonNull @EntityInstance int[] instances,
+            @NonNull Buffer localTransforms) {
+        int result = nSetTransforms(mNativeObject, instances, instances.length,
+                localTransforms, localTransforms.remaining());
+        if (result < 0) {
+            throw new BufferOverflowException();
+        }
+    }
+
     @NonNull
     @Size(min = 16)
     public float[] getTransform(@EntityInstance int i, @Nullable @Size(min = 16) float[] outLocalTransform) {
@@ -99,6 +120,7 @@ public class TransformManager {
     private static native void nDestroy(long nativeTransformManager, int entity);
     private static native void nSetParent(long nativeTransformManager, int i, int newParent);
     private static native void nSetTransform(long nativeTransformManager, int i, float[] localTransform);
+    private static native int nSetTransforms(long nativeTransformManager, int[] instances, int count, Buffer localTransforms, int remaining);
     private static native void nGetTransform(long nativeTransformManager, int i, float[] outLocalTransform);
     private static native void nGetWorldTransform(long nativeTransformManager, int i, float[] outWorldTransform);
     private static native void nOpenLocalTransformTransaction(long nativeTransformManager);
@@ -67,6 +67,7 @@ public class VertexBuffer {
         HALF2,
         HALF3,
         HALF4,
+        INT_2_10_10_10_REV,
     }
 
     public static class Builder {
@@ -151,6 +152,9 @@ public class VertexBuffer {
     }
 
     /**
+     * A direct buffer is used in place, it must not be modified until the callback runs. The
+     * content of other buffers can be copied by the VM.
+     *
      * Valid handler types:
      * - Android: Handler, Executor
      * - Other: Executor
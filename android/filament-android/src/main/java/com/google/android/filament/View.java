@@ -41,11 +41,16 @@ public class View {
         public float minScale = 0.5f;
         public float maxScale = 1.0f;
         public int history = 9;
+        public float proportionalGain = 0.0f;
+        public float derivativeGain = 0.0f;
+        public float hysteresis = 0.05f;
+        public float gpuUtilization = 0.0f;
     };
 
     public enum AntiAliasing {
         NONE,
-        FXAA
+        FXAA,
+        TEMPORAL
     }
 
     public enum DepthPrepass {
@@ -158,7 +163,11 @@ public class View {
                 options.scaleRate,
                 options.minScale,
                 options.maxScale,
-                options.history);
+                options.history,
+                options.proportionalGain,
+                options.derivativeGain,
+                options.hysteresis,
+                options.gpuUtilization);
     }
 
     @NonNull
@@ -183,6 +192,10 @@ public class View {
         nSetDynamicLightingOptions(getNativeObject(), zLightNear, zLightFar);
     }
 
+    public void setFroxelCount(int froxelCount) {
+        nSetFroxelCount(getNativeObject(), froxelCount);
+    }
+
     long getNativeObject() {
         if (mNativeObject == 0) {
             throw new IllegalStateException("Calling method on destroyed View");
@@ -219,7 +232,9 @@ public class View {
     private static native void nSetDynamicResolutionOptions(long nativeView,
             boolean enabled, boolean homogeneousScaling,
             float targetFrameTimeMilli, float headRoomRatio, float scaleRate,
-            float minScale, float maxScale, int history);
+            float minScale, float maxScale, int history,
+            float proportionalGain, float derivativeGain, float hysteresis, float gpuUtilization);
     private static native void nSetDynamicLightingOptions(long nativeView, float zLightNear, float zLightFar);
+    private static native void nSetFroxelCount(long nativeView, int froxelCount);
     private static native void nSetDepthPrepass(long nativeView, int value);
 }
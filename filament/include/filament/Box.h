@@ -20,6 +20,7 @@
 #include <utils/compiler.h>
 
 #include <math/mat4.h>
+#include <math/mat4x3.h>
 #include <math/vec3.h>
 
 namespace filament {
@@ -56,6 +57,7 @@ public:
     }
 
     friend Box rigidTransform(Box const& box, const math::mat4f& m) noexcept;
+    friend Box rigidTransform(Box const& box, const math::mat4x3f& m) noexcept;
     friend Box rigidTransform(Box const& box, const math::mat3f& m) noexcept;
 };
 
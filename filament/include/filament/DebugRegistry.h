@@ -31,6 +31,14 @@
 
 namespace filament {
 
+/**
+ * A registry of named properties of the Engine, it's obtained with Engine::getDebugRegistry().
+ *
+ * Tunables are settings of the Engine, which can only be changed in debug builds. Counters are
+ * statistics the Engine updates every frame, e.g. "d.renderpass.draw_commands", they're always
+ * read-only. Their names and types don't change between frames, so they can be enumerated once
+ * and then read every frame with getCounters().
+ */
 class UTILS_PUBLIC DebugRegistry : public FilamentAPI {
 public:
 
@@ -38,13 +46,39 @@ public:
         BOOL, INT, FLOAT, FLOAT2, FLOAT3, FLOAT4
     };
 
+    enum Kind {
+        TUNABLE,    //!< a setting of the Engine, writable in debug builds
+        COUNTER     //!< a statistic of the last frame, read-only
+    };
+
     struct Property {
         const char* name;
         Type type;
+        Kind kind;
+    };
+
+    //! Value of a counter, the components its type doesn't have are 0
+    struct CounterValue {
+        const char* name;
+        Type type;
+        math::float4 value;
     };
 
     std::pair<Property const*, size_t> getProperties() const noexcept;
 
+    /**
+     * Reads the current value of all the counters, in the order of getProperties().
+     *
+     * Counters are reset by Renderer::beginFrame() and complete after Renderer::endFrame(), this
+     * should be called in between frames, from the thread that renders them.
+     *
+     * @param values    array of at least \p count CounterValue, filled with the first \p count
+     *                  counters. Can be nullptr if count is 0.
+     * @param count     size of the \p values array.
+     * @return          the number of counters, which can be more than \p count.
+     */
+    size_t getCounters(CounterValue* values, size_t count) const noexcept;
+
     bool hasProperty(const char* name) const noexcept;
 
     void* getPropertyAddress(const char* name) noexcept;
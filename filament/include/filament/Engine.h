@@ -21,16 +21,25 @@
 #include <filament/Fence.h>
 #include <filament/SwapChain.h>
 
+#include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/ExternalContext.h>
 
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
 
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 
 class Camera;
 class DebugRegistry;
 class Fence;
+class IblPrefilter;
 class IndexBuffer;
 class IndirectLight;
 class Material;
@@ -116,6 +125,17 @@ class TransformManager;
  * calls to an Engine instance methods.
  * If multi-threading is needed, synchronization must be external.
  *
+ * The exception is the creation of the resources an asset loader typically needs, which
+ * can happen on any thread, concurrently with the thread that created the Engine:
+ * Texture, VertexBuffer and IndexBuffer (including setting their content with setImage(),
+ * setImageWithMips(), generateMipmaps(), setBufferAt() and setBuffer()) and MaterialInstance
+ * (Material::createInstance()). Each thread records its commands separately, they're handed
+ * over to the render thread at the next Engine::flush() or Renderer::beginFrame() on the Engine's
+ * thread, which is when the objects created become usable there. Using them in a
+ * RenderableManager::Builder or destroying them also picks them up. Other objects, including
+ * renderables, must still be created on the Engine's thread, and a given object must not be
+ * used by two threads at the same time.
+ *
  * Multi-threading
  * ===============
  *
@@ -145,6 +165,194 @@ public:
     using ExternalContext = driver::ExternalContext;
     using Backend = driver::Backend;
 
+    /**
+     * Sizes of the command buffer, which holds the commands recorded on the main thread until
+     * the render thread executes them. When the command buffer is full, the main thread waits
+     * for the render thread.
+     *
+     * Sizes of the per-frame memory used by the Renderers as well.
+     */
+    struct Config {
+        /**
+         * Size of the command buffer in bytes. It must be at least twice as large as
+         * minCommandBufferSize, larger buffers let the main thread run further ahead of the
+         * render thread.
+         */
+        size_t commandBufferSize = 3 * 1024 * 1024;
+
+        /**
+         * Space in bytes that's guaranteed to be available for the commands of a frame (or
+         * between two calls to Renderer::endFrame() and such).
+         */
+        size_t minCommandBufferSize = 1 * 1024 * 1024;
+
+        /**
+         * Size in bytes up to which the command buffer grows, between frames, when the commands
+         * in flight come close to fill it. 0 (default) means the command buffer never grows.
+         */
+        size_t maxCommandBufferSize = 0;
+
+        /**
+         * Size in bytes of the arena that holds the temporary data of the passes of a view,
+         * such as the froxelization (about 5 MiB) and the scratch space for sorting the draw
+         * commands. When it's too small for sorting, a slower sort is used.
+         */
+        size_t perRenderPassArenaSize = 7 * 1024 * 1024;
+
+        /**
+         * Size in bytes of the arena used to sort the color pass' draw commands, which are
+         * generated while the shadow maps are rendered.
+         */
+        size_t colorPassArenaSize = 2 * 1024 * 1024;
+
+        /**
+         * Initial size in bytes of the buffers that hold the draw commands of a pass. They grow
+         * when a pass needs more, see Renderer::getCommandsHighWatermark().
+         */
+        size_t perFrameCommandsSize = 1 * 1024 * 1024;
+
+        /**
+         * Size in bytes of the scratch memory of each of the Engine's worker threads, which
+         * the jobs use for their temporary data during a frame. It's freed at the end of each
+         * frame, by Renderer::endFrame().
+         */
+        size_t perThreadScratchSize = 128 * 1024;
+
+        /**
+         * Time in microseconds Renderer::endFrame() can spend freeing the components of
+         * destroyed entities. The components that don't fit in this budget are freed during
+         * the next frames.
+         */
+        uint32_t gcTimeBudget = 1000;
+
+        /**
+         * Maximum number of components of destroyed entities each component manager frees
+         * per frame. 0 disables freeing them.
+         */
+        uint32_t gcMaxComponentsPerFrame = 4096;
+
+        /**
+         * Time in microseconds Renderer::endFrame() can spend destroying the objects given to
+         * Engine::destroyDeferred(). The others are destroyed during the next frames.
+         */
+        uint32_t deferredDestructionTimeBudget = 1000;
+
+        /**
+         * When true, the uniforms of all the instances of a Material are stored in a single
+         * uniform buffer, each instance at an aligned offset. Switching between instances of
+         * the same Material only rebinds a range of that buffer, and all the parameters changed
+         * during a frame are uploaded at once. This helps with many instances that only differ
+         * by a few parameters, at the cost of re-uploading the instances' uniforms whenever
+         * the buffer grows.
+         */
+        bool sharedMaterialInstanceUniforms = false;
+
+        /**
+         * GPU memory budget in bytes of the streaming textures (see Texture::Builder::streaming()).
+         * Their finest levels are evicted, least recently used first, to stay within this budget.
+         * 0 means no limit.
+         */
+        size_t textureStreamingBudget = 0;
+
+        /**
+         * Size in bytes of each of the pools allocateStagingBuffer() allocates from, which is
+         * the largest payload it can allocate. The pools are only allocated when first used.
+         */
+        size_t stagingPoolSize = 2 * 1024 * 1024;
+
+        /**
+         * OpenGL only. When true, a second context sharing the Engine's is created, and large
+         * texture uploads are done by a background thread using it, instead of competing with
+         * the rendering on the render thread. Uploaded levels become visible at the next frame.
+         * This is ignored on platforms that can't create the second context.
+         */
+        bool backgroundUploads = false;
+
+        /**
+         * Size in bytes above which the pool of intermediate render targets (e.g. for msaa or
+         * post-processing) frees its least recently used targets. The targets in use during a
+         * frame are never freed, so this can be exceeded temporarily.
+         */
+        size_t renderTargetPoolBudget = 128 * 1024 * 1024;
+
+        /**
+         * Size in bytes above which the programs of the materials not used for the longest time
+         * are destroyed, after each frame. A program is created again when it's needed, which
+         * can cause a hitch. Programs used during the last frame are never destroyed, so this
+         * can be exceeded. The size of a program is estimated from the size of its shaders, the
+         * driver's memory is usually a multiple of it. 0 (default) never destroys programs.
+         */
+        size_t programCacheBudget = 0;
+
+        /**
+         * Path of a file the driver commands are written to, from the creation of the Engine to
+         * the end of its captureFrameCount-th frame, or nullptr to capture nothing. The
+         * capture can be replayed without the Engine by the filament_replay tool, e.g. to compare
+         * backends or drivers on exactly the same frames.
+         *
+         * This is only available when filament is built with FILAMENT_ENABLE_COMMAND_CAPTURE,
+         * otherwise it is ignored. The path is only used during Engine::create().
+         */
+        const char* captureFile = nullptr;
+
+        /**
+         * Number of frames written to captureFile.
+         */
+        uint32_t captureFrameCount = 100;
+
+        /**
+         * TCP port of the local host the counters of the DebugRegistry are streamed to after
+         * each frame, as a line of JSON per frame, or 0 to stream nothing. A desktop viewer can
+         * connect to it, e.g. through "adb forward tcp:<port> tcp:<port>" on Android.
+         *
+         * This is only available when filament is built with FILAMENT_ENABLE_STATS_SERVER,
+         * otherwise it is ignored.
+         */
+        uint16_t statsPort = 0;
+
+        /**
+         * JobSystem the Engine runs its jobs on instead of creating its own, so that several
+         * Engines (e.g. one per GPU) share one pool of worker threads sized to the machine. It
+         * must outlive the Engine, and have an adoptable thread for each of the threads the
+         * Engines sharing it are created on. When several Engines are created on the same
+         * thread, they must be destroyed in the reverse order.
+         *
+         * When a JobSystem is shared, its owner resets its scratch memory (see
+         * JobSystem::resetScratch()) once no job uses it anymore, rather than the Engines at the
+         * end of each frame. jobSystemThreadCount and jobSystemThreadAffinity are then ignored.
+         */
+        utils::JobSystem* jobSystem = nullptr;
+
+        /**
+         * Number of worker threads of the Engine's JobSystem, 0 (default) picks a number based
+         * on the CPU.
+         */
+        uint32_t jobSystemThreadCount = 0;
+
+        /**
+         * Mask of the CPUs the worker threads of the Engine's JobSystem can run on, 0 (default)
+         * doesn't restrict them. Only supported on Linux and Android.
+         */
+        uint32_t jobSystemThreadAffinity = 0;
+
+        /**
+         * Mask of the CPUs the driver thread can run on. 0 (default) picks the upper CPUs on
+         * CPUs with 6 cores or more, or the big cores with preferBigCores. Only supported on
+         * Linux and Android.
+         */
+        uint32_t driverThreadAffinity = 0;
+
+        /**
+         * On CPUs with cores of different speeds (e.g. big.LITTLE), keeps the frame's critical
+         * path on the fastest cores: unless their affinity is given, the driver thread and the
+         * workers of the Engine's JobSystem run on the big cores, with one worker less than big
+         * cores by default since the Engine's thread runs jobs too. Background work
+         * (JobSystem::LOW_PRIORITY jobs, such as decoding assets) runs on the other cores. This
+         * has no effect on other CPUs.
+         */
+        bool preferBigCores = false;
+    };
+
     /**
      * Creates an instance of Engine
      *
@@ -166,6 +374,9 @@ public:
      *                          Setting this parameter will force filament to use the OpenGL
      *                          implementation (instead of Vulkaan for instance).
      *
+     *  @param config           The sizes of the command buffer and of the per-frame memory,
+     *                          see Config. If not provided (or nullptr is used), the defaults
+     *                          are used.
      *
      * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
      *
@@ -180,7 +391,64 @@ public:
      * This method is thread-safe.
      */
     static Engine* create(Backend backend = Backend::DEFAULT,
-            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr);
+            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr,
+            Config const* config = nullptr);
+
+    /**
+     * Called by createAsync() once the GPU driver is initialized.
+     *
+     * @param token Identifies the Engine, to pass to getEngine().
+     * @param user  The user pointer given to createAsync().
+     */
+    using CreateCallback = void(*)(void* token, void* user);
+
+    /**
+     * Creates an instance of Engine asynchronously.
+     *
+     * The initialization of the GPU driver, which is the longest part of the creation of the
+     * Engine, happens on filament's render thread while the application carries on, e.g. loading
+     * its assets. createAsync() returns right away. \p callback is called once the driver is
+     * initialized, from another thread than the one that called createAsync(). getEngine()
+     * must then be called, on the thread that called createAsync(), to finish the creation and
+     * get the Engine.
+     *
+     * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+     * #include <filament/Engine.h>
+     * using namespace filament;
+     *
+     * Engine::createAsync([](void* token, void* user) {
+     *     // e.g. post token to the main thread's event loop
+     * }, nullptr);
+     *
+     * // ... later, on the same thread, with the token given to the callback
+     * Engine* engine = Engine::getEngine(token);
+     * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+     *
+     * @param callback  Called once the driver is initialized, or failed to.
+     * @param user      A pointer given to the callback.
+     *
+     * The other parameters are the same as create()'s.
+     *
+     * @see create(), getEngine()
+     */
+    static void createAsync(CreateCallback callback, void* user,
+            Backend backend = Backend::DEFAULT,
+            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr,
+            Config const* config = nullptr);
+
+    /**
+     * Finishes the creation of an Engine started by createAsync().
+     *
+     * This must be called on the thread that called createAsync(). It can be called before the
+     * callback, in which case it waits for the driver to be initialized.
+     *
+     * @param token The token given to createAsync()'s callback.
+     *
+     * @return A pointer to the newly created Engine, or nullptr if the Engine couldn't be created.
+     *
+     * @see createAsync()
+     */
+    static Engine* getEngine(void* token);
 
     /**
      * Destroy the Engine instance and all associated resources.
@@ -229,6 +497,27 @@ public:
      */
     SwapChain* createSwapChain(void* nativeWindow, uint64_t flags = 0) noexcept;
 
+    /**
+     * Creates a headless SwapChain, which isn't tied to a window and whose frames are never
+     * presented, for offscreen rendering (e.g. on a server without a display). The frames are
+     * retrieved with Renderer.readPixels(), which doesn't stall the rendering. Several frames
+     * are in flight, instead of being skipped Renderer.beginFrame() waits for the oldest one when
+     * the GPU is behind, so a render loop is only limited by the GPU.
+     *
+     * Pbuffers are used by the OpenGL backends on Linux and Android, the Vulkan backend renders
+     * into images of its own. Other platforms don't support headless swap chains.
+     *
+     * @param width  Width of the SwapChain in pixels.
+     * @param height Height of the SwapChain in pixels.
+     * @param flags  One or more configuration flags as defined in `SwapChain`, only
+     *               SwapChain::CONFIG_TRANSPARENT is relevant.
+     *
+     * @return A pointer to the newly created SwapChain or nullptr if it couldn't be created.
+     *
+     * @see Renderer.beginFrame(), Renderer.readPixels()
+     */
+    SwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags = 0) noexcept;
+
     /**
      * Creates a renderer associated to this engine.
      *
@@ -269,9 +558,26 @@ public:
      */
     Fence* createFence(Fence::Type type = Fence::Type::SOFT) noexcept;
 
+    /**
+     * Creates a Fence which calls \p callback once it signals, so that the completion of the
+     * work issued before it can be chained without blocking in Fence::wait().
+     *
+     * The state of the Fence is polled without blocking only from Engine::flush() and at the
+     * end of Renderer::endFrame(), and the callback runs there, on the main filament thread.
+     * The flushes filament issues internally while rendering never call it.
+     *
+     * @param type      Type of Fence to create
+     * @param callback  Function called when the Fence signals, see Fence::Callback
+     * @param user      Pointer passed to \p callback
+     *
+     * @return A pointer to the newly created Fence or nullptr if it couldn't be created.
+     */
+    Fence* createFence(Fence::Type type, Fence::Callback callback, void* user = nullptr) noexcept;
+
     void destroy(const VertexBuffer* p);        //!< Destroys an VertexBuffer object.
     void destroy(const Fence* p);               //!< Destroys a Fence object.
     void destroy(const IndexBuffer* p);         //!< Destroys an IndexBuffer object.
+    void destroy(const IblPrefilter* p);        //!< Destroys an IblPrefilter object.
     void destroy(const IndirectLight* p);       //!< Destroys an IndirectLight object.
 
     /**
@@ -293,6 +599,34 @@ public:
     void destroy(const View* p);                //!< Destroys a View object.
     void destroy(utils::Entity e);              //!< Destroys all filament-known components from this entity
 
+    /**
+     * Destroys several objects at once, which is cheaper than destroying them one by one.
+     * @param p     array of \p count objects, which can contain nullptr
+     * @param count number of objects in \p p
+     */
+    void destroy(const VertexBuffer* const* p, size_t count);
+    void destroy(const IndexBuffer* const* p, size_t count);       //!< \see destroy()
+    void destroy(const MaterialInstance* const* p, size_t count);  //!< \see destroy()
+    void destroy(const Texture* const* p, size_t count);           //!< \see destroy()
+
+    /**
+     * Queues an object for destruction. The queued objects are destroyed in order by the
+     * following calls to Renderer::endFrame(), within Config::deferredDestructionTimeBudget,
+     * which spreads the cost of tearing down a large scene over several frames.
+     *
+     * The object must not be used anymore, nor be destroyed again. A Material can be queued
+     * after its MaterialInstances, destroying it immediately destroys all the queued objects
+     * first.
+     */
+    void destroyDeferred(const VertexBuffer* p);
+    void destroyDeferred(const IndexBuffer* p);         //!< \see destroyDeferred()
+    void destroyDeferred(const Material* p);            //!< \see destroyDeferred()
+    void destroyDeferred(const MaterialInstance* p);    //!< \see destroyDeferred()
+    void destroyDeferred(const Texture* p);             //!< \see destroyDeferred()
+
+    //! Returns the number of objects queued by destroyDeferred() not destroyed yet.
+    size_t getDeferredDestructionCount() const noexcept;
+
     /**
      * Returns the default Material.
      *
@@ -316,6 +650,141 @@ public:
      */
     void* streamAlloc(size_t size, size_t alignment = alignof(double)) noexcept;
 
+    /**
+     * Allocates the payload of an upload (e.g. VertexBuffer::setBufferAt(),
+     * Texture::setImage()) from the Engine's staging pools. Each frame allocates from a new
+     * pool, which is recycled once the driver has consumed all the uploads using it. Compared
+     * to a malloc'ed payload, this saves the allocation and the destroy callback on the main
+     * thread.
+     *
+     * @param size  size to allocate in bytes, at most Config::stagingPoolSize
+     * @return      a BufferDescriptor owning the memory, to fill and pass to the upload. Its
+     *              buffer is nullptr if no pool has room, e.g. when the driver is several
+     *              frames behind.
+     *
+     * @note This must be called from the thread the Engine was created on. The memory is
+     *       released when the descriptor is destroyed, it must not be given another callback.
+     */
+    driver::BufferDescriptor allocateStagingBuffer(size_t size) noexcept;
+
+    /**
+     * Kicks the render thread, which starts executing the commands recorded so far, without
+     * waiting for them. This also makes the objects created by other threads since the last
+     * flush usable on the Engine's thread, see "Thread safety" above.
+     */
+    void flush();
+
+    /**
+     * Creates the programs of the given variants for all the materials of this Engine, see
+     * Material::compile(). A Fence created after this call signals once the programs have
+     * been handed to the driver.
+     *
+     * @param variants a Material::VariantSet, all the variants by default
+     */
+    void compileMaterials(uint32_t variants = 0xFFFFFFFF) noexcept;
+
+    using BlobCache = driver::BlobCache;
+
+    /**
+     * Sets a cache for the compiled programs, so they don't need to be compiled again the next
+     * time the application starts. This is disabled by default, the application is responsible
+     * for storing the cache (e.g. on disk). See driver::BlobCache for the requirements on
+     * the callbacks, which are called on the driver thread.
+     *
+     * The OpenGL backend stores each program binary when it's linked. The Vulkan backend seeds
+     * its pipeline cache when this is called, the pipelines created before are kept, and stores
+     * it when the Engine is destroyed.
+     *
+     * The OpenGL programs created before this call are not cached, so this should be called
+     * right after creating the Engine. The cache is ignored if the backend doesn't support it.
+     *
+     * @param cache the insert and retrieve callbacks, and their user pointer
+     */
+    void setBlobCache(BlobCache const& cache) noexcept;
+
+    //! Usage of the command buffer since the Engine was created, see getCommandBufferStats()
+    struct CommandBufferStats {
+        size_t capacity;            //!< current size of the command buffer in bytes
+        size_t highWatermark;       //!< most bytes ever used by the commands in flight
+        uint32_t blockCount;        //!< number of times the main thread waited for space
+        uint64_t blockedTimeNs;     //!< total time the main thread waited, in nanoseconds
+        uint32_t growCount;         //!< number of times the command buffer grew
+    };
+
+    /**
+     * Returns the usage of the command buffer, which helps choosing the sizes in Config. A
+     * high watermark close to the capacity, or time spent blocked, means the main thread
+     * is often waiting for the render thread.
+     */
+    CommandBufferStats getCommandBufferStats() const noexcept;
+
+    //! Number of calls to, and time spent in, a driver command during a frame
+    struct DriverCommandStats {
+        const char* name;           //!< driver command, e.g. "draw" or "updateUniformBuffer"
+        uint32_t count;             //!< number of times the command was executed
+        uint64_t timeNs;            //!< total time spent executing it, in nanoseconds
+    };
+
+    /**
+     * Returns the time the render thread spent in each type of driver command, during the
+     * last frame it completed (i.e. up to and including Renderer::endFrame()).
+     *
+     * This is only available when filament is built with FILAMENT_ENABLE_COMMAND_TIMING, which
+     * adds some overhead to each command. Otherwise this always returns 0.
+     *
+     * @param stats     array of at least \p count DriverCommandStats, filled with the commands
+     *                  executed during the frame, in no particular order. Can be nullptr if
+     *                  \p count is 0.
+     * @param count     size of the \p stats array
+     * @return          the number of types of commands executed during the frame, which can be
+     *                  larger than \p count
+     */
+    size_t getDriverCommandStats(DriverCommandStats* stats, size_t count) const noexcept;
+
+    /**
+     * Memory used by the Engine and the objects it created, in bytes, see getMemoryStats().
+     *
+     * The GPU sizes are computed from the dimensions and formats of the resources, they're the
+     * same for all backends and don't include the driver's own overhead (alignment, mipmaps it
+     * allocates, etc.). Compressed textures are not accounted for.
+     */
+    struct MemoryStats {
+        // CPU memory
+        size_t perRenderPassArena;          //!< arena for the passes' temporary data
+        size_t perRenderPassArenaHighWatermark; //!< most of it used at once, debug builds only
+        size_t commandBuffer;               //!< command buffer of the driver commands
+        size_t drawCommands;                //!< renderers' draw commands and color pass arenas
+        size_t jobScratch;                  //!< worker threads' scratch memory
+        size_t componentManagers;           //!< renderable, transform, light & camera components
+        size_t froxelizers;                 //!< views' froxelization data
+        size_t materials;                   //!< material packages, used to create the programs
+        uint32_t materialCount;             //!< number of materials
+        uint32_t materialInstanceCount;     //!< number of material instances
+        uint32_t programCount;              //!< number of programs created by all materials
+        size_t programs;                    //!< shaders of the programs, see programCacheBudget
+        uint32_t programEvictions;          //!< programs destroyed by programCacheBudget so far
+
+        // GPU memory
+        size_t textures;                    //!< Textures created by the application
+        size_t vertexBuffers;               //!< VertexBuffers
+        size_t indexBuffers;                //!< IndexBuffers
+        size_t renderTargets;               //!< intermediate render targets, e.g. for msaa
+        size_t shadowMaps;                  //!< views' shadow maps
+        size_t froxelBuffers;               //!< views' froxel and light record buffers
+
+        // Render target pool, counted since the Engine was created
+        uint32_t renderTargetHits;          //!< render targets reused from the pool
+        uint32_t renderTargetMisses;        //!< render targets created
+        uint32_t renderTargetEvictions;     //!< render targets freed before they aged out
+    };
+
+    /**
+     * Returns the memory currently used by each subsystem of the Engine, which helps budgeting
+     * memory per feature. This must be called from the main thread, and walks all the objects
+     * so it shouldn't be called every frame.
+     */
+    MemoryStats getMemoryStats() const noexcept;
+
 
     /**
      * helper for creating an Entity and Camera component in one call
@@ -337,6 +806,15 @@ public:
 
     DebugRegistry& getDebugRegistry() noexcept;
 
+    /**
+     * Returns the JobSystem used by this Engine, e.g. to run work next to the Engine's own
+     * jobs without starting more threads. Its worker threads are busy at every frame, work that
+     * doesn't need to finish within the frame should use JobSystem::LOW_PRIORITY.
+     *
+     * @attention Jobs can only be waited on from the thread the Engine was created on.
+     */
+    utils::JobSystem& getJobSystem() noexcept;
+
 protected:
     //! \privatesection
     Engine() noexcept = default;
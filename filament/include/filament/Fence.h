@@ -72,6 +72,16 @@ public:
         DONT_FLUSH      //!< The command stream is not flushed
     };
 
+    /**
+     * Callback of a Fence created with Engine::createFence(Type, Callback, void*).
+     *
+     * It is called once on the main filament thread, from Engine::flush() or at the end of
+     * Renderer::endFrame() (never in the middle of a frame), after the Fence has signaled
+     * (\p status is FenceStatus::CONDITION_SATISFIED) or failed (FenceStatus::ERROR). The
+     * Fence can be destroyed from the callback. It is not called if the Fence is destroyed before.
+     */
+    using Callback = void(*)(Fence* fence, FenceStatus status, void* user);
+
     /**
      * Client-side wait on the Fence.
      *
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//! \file
+
+#ifndef TNT_FILAMENT_IBL_PREFILTER_H
+#define TNT_FILAMENT_IBL_PREFILTER_H
+
+#include <filament/FilamentAPI.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace details {
+class FIblPrefilter;
+} // namespace details
+
+class Engine;
+class Texture;
+
+/**
+ * IblPrefilter generates the reflections and the irradiance of an IndirectLight on the GPU,
+ * from an environment that can change at runtime (e.g. time of day, or a captured environment).
+ *
+ * It produces the same results as the **cmgen** tool: the reflections cubemap's mipmap chain,
+ * prefiltered with GGX importance sampling for increasing roughnesses, and the irradiance as
+ * 3 bands of pre-scaled Spherical Harmonics.
+ *
+ * The work is spread over multiple frames by update(), within a budget set with
+ * Builder::sampleBudget().
+ *
+ * ~~~~~~~~~~~{.cpp}
+ *  filament::IblPrefilter* prefilter = filament::IblPrefilter::Builder()
+ *              .environment(cubemap)
+ *              .build(*engine);
+ *
+ *  // once per frame
+ *  if (prefilter->update(*engine)) {
+ *      filament::IndirectLight* ibl = filament::IndirectLight::Builder()
+ *              .reflections(prefilter->getReflections())
+ *              .irradiance(3, prefilter->getIrradiance())
+ *              .build(*engine);
+ *  }
+ * ~~~~~~~~~~~
+ *
+ * @see IndirectLight
+ */
+class UTILS_PUBLIC IblPrefilter : public FilamentAPI {
+    struct BuilderDetails;
+
+public:
+    //! Use Builder to construct an IblPrefilter object instance
+    class Builder : public BuilderBase<BuilderDetails> {
+        friend struct BuilderDetails;
+    public:
+        Builder() noexcept;
+        Builder(Builder const& rhs) noexcept;
+        Builder(Builder&& rhs) noexcept;
+        ~Builder() noexcept;
+        Builder& operator=(Builder const& rhs) noexcept;
+        Builder& operator=(Builder&& rhs) noexcept;
+
+        /**
+         * Sets the environment to prefilter.
+         *
+         * @param texture A cubemap, or a 2D texture holding an equirectangular image.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& environment(Texture const* texture) noexcept;
+
+        /**
+         * Sets the size of the faces of the reflections cubemap. Must be a power of two,
+         * 256 by default.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& size(uint32_t size) noexcept;
+
+        /**
+         * Sets the number of samples per texel of the first levels of the reflections, it is
+         * doubled for each of the following levels, like cmgen's --ibl-samples. 1024 by default.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& sampleCount(uint16_t count) noexcept;
+
+        /**
+         * Sets how many texel samples update() may take per call, i.e. the number of texels
+         * drawn times their number of samples. At least one cubemap face is drawn per call.
+         * 32 million by default.
+         *
+         * @return This Builder, for chaining calls.
+         */
+        Builder& sampleBudget(size_t budget) noexcept;
+
+        /**
+         * Creates the IblPrefilter object and returns a pointer to it.
+         *
+         * @param engine Reference to the filament::Engine to associate this IblPrefilter with.
+         *
+         * @return pointer to the newly created object, or nullptr if the environment is invalid.
+         */
+        IblPrefilter* build(Engine& engine);
+
+    private:
+        friend class details::FIblPrefilter;
+    };
+
+    /**
+     * Draws the next part of the prefiltering. This must be called once per frame, between
+     * Renderer::beginFrame() and Renderer::endFrame().
+     *
+     * @return true once the reflections and the irradiance are ready.
+     */
+    bool update(Engine& engine) noexcept;
+
+    /**
+     * Starts over, e.g. after the environment's content changed. The reflections are
+     * updated progressively, level by level.
+     */
+    void restart() noexcept;
+
+    //! Returns whether the reflections and the irradiance are ready.
+    bool isReady() const noexcept;
+
+    //! Returns the reflections cubemap, to set with IndirectLight::Builder::reflections().
+    Texture const* getReflections() const noexcept;
+
+    /**
+     * Returns the 9 spherical harmonics coefficients of the irradiance, to set with
+     * IndirectLight::Builder::irradiance(). Only valid when isReady() is true.
+     */
+    math::float3 const* getIrradiance() const noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_IBL_PREFILTER_H
@@ -39,6 +39,7 @@ class UTILS_PUBLIC IndexBuffer : public FilamentAPI {
 
 public:
     using BufferDescriptor = driver::BufferDescriptor;
+    using Usage = driver::Usage;
 
     enum class IndexType : uint8_t {
         USHORT = uint8_t(driver::ElementType::USHORT),
@@ -58,6 +59,12 @@ public:
         Builder& indexCount(uint32_t indexCount) noexcept;
         Builder& bufferType(IndexType indexType) noexcept;
 
+        /**
+         * Specifies how often the buffer is updated (default: Usage::STATIC).
+         * @see VertexBuffer::Builder::usage()
+         */
+        Builder& usage(Usage usage) noexcept;
+
         /**
          * Creates the IndexBuffer object and returns a pointer to it.
          *
@@ -83,7 +83,9 @@ class FIndirectLight;
  * ===========
  *
  * The reflections on object surfaces (specular component) is calculated from a specially
- * filtered cubemap pyramid generated by the **cmgen** tool.
+ * filtered cubemap pyramid generated by the **cmgen** tool. The cubemap can be stored as
+ * `RGBM`, or linearly in an HDR format, such as the `RGB9_E5` KTX files written by
+ * `cmgen --format=ktx`, which are half the size of `RGBA16F`.
  *
  *
  * @see Scene, Light, Texture, Skybox
@@ -108,15 +110,16 @@ public:
          *
          * @param cubemap   A mip-mapped cubemap generated by **cmgen**. Each cubemap level
          *                  encodes a the irradiance for a roughness level.
-         *                  The cubemap *must be* a 256x256 cubemap in `RGBM` format.
+         *                  The cubemap *must be* a 256x256 cubemap.
          *
          * @return This Builder, for chaining calls.
          *
          * @attention
          * \p cubemap *must* be of dimension 256x256
          *
-         * @attention
-         * \p cubemap *must* be encoded in `RGBM` format
+         * @note
+         * \p cubemap is decoded as `RGBM` when its format is Texture::InternalFormat::RGBM,
+         * otherwise its values are linear (e.g. `RGB9_E5`, `R11F_G11F_B10F` or `RGBA16F`).
          *
          */
         Builder& reflections(Texture const* cubemap) noexcept;
@@ -178,7 +178,10 @@ public:
      * Control the quality / performance of the shadow map associated to this light
      */
     struct ShadowOptions {
-        /** size of the shadow map in texels. Must be a power-of-two. */
+        /** size of the shadow map in texels. Must be a power-of-two. For spot lights, this is
+         * the largest size of the light's tile in the shadow atlas (at most 1024), the tile is
+         * smaller when the light is small on screen.
+         */
         uint32_t mapSize = 1024;
 
         /** constant bias in world units (e.g. meters) by which shadow are moved away from the
@@ -238,7 +241,10 @@ public:
          * @return This Builder, for chaining calls.
          *
          * @warning
-         * - Only a Type.DIRECTIONAL or Type.SUN light can cast shadows
+         * - Only Type.DIRECTIONAL, Type.SUN, Type.SPOT and Type.FOCUSED_SPOT lights can cast
+         *   shadows, point lights can't.
+         * - At most 8 spot lights cast shadows in a View, those that are the largest on screen.
+         *   Spot lights don't use the normal bias.
          */
         Builder& castShadows(bool enable) noexcept;
 
@@ -25,6 +25,7 @@
 #include <filament/Texture.h>
 #include <filament/TextureSampler.h>
 
+#include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/DriverEnums.h>
 
 #include <utils/compiler.h>
@@ -66,6 +67,17 @@ public:
 
     using ShaderModel = filament::driver::ShaderModel;
 
+    /**
+     * A set of variants of the material's programs: bit i is set for the variant i, whose
+     * bits are the features of the program (see compile()).
+     */
+    using VariantSet = uint64_t;
+
+    //! All the variants, including those the material doesn't use
+    static constexpr VariantSet ALL_VARIANTS = ~VariantSet(0);
+
+    using CompileCallback = void(*)(Material const* material, void* user);
+
     struct ParameterInfo {
         const char* name;
         bool isSampler;
@@ -91,6 +103,23 @@ public:
         // The RAM must stay valid until build() is called.
         Builder& package(const void* payload, size_t size);
 
+        using Callback = driver::BufferDescriptor::Callback;
+
+        /**
+         * Specifies a package that the Material references instead of copying, e.g. a
+         * memory-mapped file. Shaders are only decoded from the package the first time they're
+         * needed.
+         *
+         * @param payload   Pointer to the package. The memory must stay valid until callback is
+         *                  called.
+         * @param size      Size of the package in bytes.
+         * @param callback  Called with payload, size and user once the package is not used
+         *                  anymore, i.e. when the Material is destroyed, or by build() if it
+         *                  fails. It is called on the main filament thread.
+         * @param user      An opaque pointer passed to callback.
+         */
+        Builder& package(const void* payload, size_t size, Callback callback, void* user = nullptr);
+
         /**
          * Creates the Material object and returns a pointer to it.
          *
@@ -148,6 +177,34 @@ public:
 
     MaterialInstance* getDefaultInstance() noexcept;
     MaterialInstance const* getDefaultInstance() const noexcept;
+
+    /**
+     * Creates the programs of the given variants now, rather than when they're first drawn,
+     * which stalls that frame. Variants the material doesn't have (e.g. the lighting variants
+     * of an unlit material, or those filtered out when it was built) are skipped, as well as
+     * the programs that already exist. The variant bits are:
+     *
+     *     0x01  directional lighting
+     *     0x02  dynamic lighting (point and spot lights)
+     *     0x04  shadow receiver
+     *     0x08  skinning
+     *     0x10  instancing
+     *
+     * Calling this with a few variants at a time spreads the work across frames.
+     *
+     * @param variants  the variants to create, e.g. getUsedVariants() from a previous run
+     * @param callback  optional, called on the driver thread once the programs have been
+     *                  handed to the driver, which may still be compiling them in the background
+     * @param user      passed to the callback
+     */
+    void compile(VariantSet variants = ALL_VARIANTS,
+            CompileCallback callback = nullptr, void* user = nullptr) noexcept;
+
+    /**
+     * Returns the variants of this material that were rendered since it was created, so an
+     * application can compile() exactly those the next time.
+     */
+    VariantSet getUsedVariants() const noexcept;
 };
 
 } // namespace filament
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_POTENTIALLYVISIBLESET_H
+#define TNT_FILAMENT_POTENTIALLYVISIBLESET_H
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * A precomputed potentially visible set (PVS).
+ *
+ * The space is divided in a grid of cells, and for each cell the set stores which objects can
+ * be seen from it as a bitset, so hidden objects can be culled without any work at runtime. The
+ * objects are identified by their index in the set, see View::setPotentiallyVisibleSet() which
+ * associates them to renderables.
+ *
+ * PotentiallyVisibleSet doesn't own nor copy its data, which is laid out so that it can be
+ * used directly from a memory mapped file:
+ *
+ *   Header
+ *   uint32_t bits[cellCount][(objectCount + 31) / 32]
+ *
+ * The cells are stored x first, then y, then z. All values are little-endian and the data must
+ * be 4 bytes aligned. A set is usually computed offline, see filaloader::PvsBaker.
+ */
+class UTILS_PUBLIC PotentiallyVisibleSet {
+public:
+    static constexpr uint32_t MAGIC = 0x31535650;   // 'PVS1'
+    static constexpr uint32_t NO_CELL = 0xFFFFFFFF;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t objectCount;
+        uint32_t cellCount[3];      // resolution of the grid
+        float min[3];               // world-space bounds of the grid
+        float max[3];
+    };
+
+    // size in bytes of a set with the given object and cell counts
+    static size_t getSize(size_t objectCount, size_t cellCount) noexcept;
+
+    PotentiallyVisibleSet() noexcept = default;
+
+    // Uses the set stored in data, which must outlive this object. If the data isn't a valid
+    // set, isValid() returns false and nothing is culled.
+    PotentiallyVisibleSet(void const* data, size_t size) noexcept;
+
+    bool isValid() const noexcept { return mHeader != nullptr; }
+
+    size_t getObjectCount() const noexcept { return isValid() ? mHeader->objectCount : 0; }
+    size_t getCellCount() const noexcept;
+
+    // returns the cell containing a world-space position, or NO_CELL if it's outside the grid
+    uint32_t getCellAt(math::float3 const& position) const noexcept;
+
+    // returns whether an object can be seen from a cell
+    bool isVisible(uint32_t cell, size_t object) const noexcept {
+        return (getCellBits(cell)[object / 32] >> (object % 32)) & 1u;
+    }
+
+    // returns the visibility bitset of a cell, (objectCount + 31) / 32 words
+    uint32_t const* getCellBits(uint32_t cell) const noexcept {
+        return mBits + cell * mWordsPerCell;
+    }
+
+private:
+    Header const* mHeader = nullptr;
+    uint32_t const* mBits = nullptr;
+    size_t mWordsPerCell = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_POTENTIALLYVISIBLESET_H
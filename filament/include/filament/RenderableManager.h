@@ -74,6 +74,21 @@ public:
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
         Builder& geometry(size_t index, PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
         Builder& material(size_t index, MaterialInstance const* materialInstance) noexcept;
+
+        // Levels of detail. Level 0 is the most detailed and is the one set by geometry(), each
+        // other level has the same number of primitives, with the same materials and blend orders.
+        // The level is picked each frame from the size of the bounding box on screen.
+        // levelCount() must be called before lodGeometry().
+        Builder& levelCount(uint8_t count) noexcept; // 1 by default, 4 max
+        // A level without geometry uses the geometry of the previous level.
+        Builder& lodGeometry(uint8_t level, size_t index, PrimitiveType type,
+                VertexBuffer* vertices, IndexBuffer* indices, size_t offset, size_t count) noexcept;
+        // Positive values keep the detailed levels longer, each unit doubles the distance.
+        Builder& lodBias(float bias) noexcept; // 0 by default
+        // Added to the bias when picking the level drawn in the shadow maps, negative values
+        // draw less detailed levels in the shadows than on screen.
+        Builder& shadowLodBias(float bias) noexcept; // 0 by default
+
         // The axis aligned bounding box of the Renderable. Mandatory unless culling is disabled.
         Builder& boundingBox(const Box& axisAlignedBoundingBox) noexcept;
         Builder& layerMask(uint8_t select, uint8_t values) noexcept;
@@ -82,7 +97,21 @@ public:
         Builder& culling(bool enable) noexcept; // true by default
         Builder& castShadows(bool enable) noexcept; // false by default
         Builder& receiveShadows(bool enable) noexcept; // true by default
-        Builder& skinning(size_t boneCount) noexcept; // 0 by default, 255 max
+        // Occluders hide what's behind their bounding box when occlusion culling is enabled on
+        // a View, so their geometry must fill it (e.g. a building).
+        Builder& occluder(bool enable) noexcept; // false by default
+        // Whether this renderable can be culled when it's too small on screen, see
+        // View::setSmallFeatureCulling(). Disable it for objects that must never disappear.
+        Builder& smallFeatureCulling(bool enable) noexcept; // true by default
+        // Static shadow casters never move, their shadows are cached by Views that enable
+        // View::setStaticShadowCachingEnabled(). Only meaningful with castShadows(true).
+        Builder& staticShadowCaster(bool enable) noexcept; // false by default
+        // The blended primitives of this renderable (e.g. particles or smoke) are drawn at a lower
+        // resolution on Views that enable View::setBlendingDownsampling().
+        Builder& lowResolutionBlending(bool enable) noexcept; // false by default
+        // Renderables whose VertexBuffers all enable VertexBuffer::Builder::cpuSkinning() are
+        // skinned on the CPU, otherwise by the vertex shader of each pass.
+        Builder& skinning(size_t boneCount) noexcept; // 0 by default, 512 max
         Builder& skinning(size_t boneCount, Bone const* transforms) noexcept;
         Builder& skinning(size_t boneCount, math::mat4f const* transforms) noexcept;
 
@@ -109,6 +138,20 @@ public:
          */
         Result build(Engine& engine, utils::Entity entity);
 
+        /**
+         * Adds the same Renderable component to several entities. This is much faster than
+         * calling build() for each entity, as the components' data is allocated all at once.
+         *
+         * @param engine Reference to the filament::Engine to associate these Renderables with.
+         * @param entities Array of the \p count entities to add the Renderable component to.
+         * @param count Number of entities in \p entities.
+         * @return Success if the components were created successfully, Error otherwise, in
+         *         which case none of them is created.
+         *
+         * @see build(Engine&, utils::Entity)
+         */
+        Result build(Engine& engine, utils::Entity const* entities, size_t count);
+
     private:
         friend class details::FEngine;
         friend class details::FRenderPrimitive;
@@ -136,6 +179,12 @@ public:
     void setReceiveShadows(Instance instance, bool enable) noexcept;
     bool isShadowCaster(Instance instance) const noexcept;
     bool isShadowReceiver(Instance instance) const noexcept;
+    void setOccluder(Instance instance, bool enable) noexcept;
+    bool isOccluder(Instance instance) const noexcept;
+    void setStaticShadowCaster(Instance instance, bool enable) noexcept;
+    bool isStaticShadowCaster(Instance instance) const noexcept;
+    void setLowResolutionBlending(Instance instance, bool enable) noexcept;
+    bool isLowResolutionBlending(Instance instance) const noexcept;
 
     void setBones(Instance instance, Bone const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
     void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount = 1, size_t offset = 0) noexcept;
@@ -144,24 +193,36 @@ public:
     // getters...
     const Box& getAxisAlignedBoundingBox(Instance instance) const noexcept;
 
-    // number of render primitives in this renderable
+    // number of render primitives in this renderable (per level of detail)
     size_t getPrimitiveCount(Instance instance) const noexcept;
 
-    // set/change the material of a given render primitive
+    // number of levels of detail of this renderable
+    size_t getLevelCount(Instance instance) const noexcept;
+
+    // see Builder::lodBias()
+    void setLodBias(Instance instance, float bias) noexcept;
+    float getLodBias(Instance instance) const noexcept;
+
+    // see Builder::shadowLodBias()
+    void setShadowLodBias(Instance instance, float bias) noexcept;
+    float getShadowLodBias(Instance instance) const noexcept;
+
+    // set/change the material of a given render primitive, in all levels of detail
     void setMaterialInstanceAt(Instance instance,
             size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept;
     MaterialInstance* getMaterialInstanceAt(Instance instance, size_t primitiveIndex) const noexcept;
 
-    // set/change the geometry (vertex/index buffers) of a given primitive
+    // set/change the geometry (vertex/index buffers) of a given primitive of level 0
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
             size_t offset, size_t count) noexcept;
 
-    // set/change the offset/count in the currently set index buffer of a given primitive
+    // set/change the offset/count in the currently set index buffer of a given primitive of level 0
     void setGeometryAt(Instance instance, size_t primitiveIndex,
             PrimitiveType type, size_t offset, size_t count) noexcept;
 
-    // set the blend order of the given primitive, only the first 15 bits are used
+    // set the blend order of the given primitive in all levels of detail, only the first 15 bits
+    // are used
     void setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept;
 
     AttributeBitset getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept;
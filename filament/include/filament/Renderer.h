@@ -23,6 +23,7 @@
 
 #include <utils/compiler.h>
 
+#include <stddef.h>
 #include <stdint.h>
 
 namespace filament {
@@ -64,6 +65,136 @@ class PixelBufferDescriptor;
  */
 class UTILS_PUBLIC Renderer : public FilamentAPI {
 public:
+    /**
+     * GPU time spent in each pass of a frame.
+     *
+     * @see getFrameStats()
+     */
+    struct FrameStats {
+        //! id of the measured frame, 0 if no frame was measured yet
+        uint32_t frameId = 0;
+        //! time spent rendering the shadow maps, in milliseconds
+        float shadowPass = 0;
+        //! time spent in the color pass, including the depth pre-pass, in milliseconds
+        float colorPass = 0;
+        //! time spent in the post-processing stages, in milliseconds
+        float postProcess = 0;
+    };
+
+    /**
+     * CPU time spent in each stage of a frame, in milliseconds, summed over all the views
+     * rendered during the frame.
+     *
+     * The stages are timed on the thread that waits for them, culling for instance includes
+     * the jobs it runs in parallel. Froxelization runs concurrently with the other stages.
+     * These timings are process-wide, and only meaningful with a single Engine rendering.
+     *
+     * @see getCpuFrameStats()
+     */
+    struct CpuFrameStats {
+        //! id of the measured frame, 0 if no frame was measured yet
+        uint32_t frameId = 0;
+        //! updating the world transforms and bounds of the scene
+        float scenePrepare = 0;
+        //! culling the renderables, lights and shadow casters
+        float culling = 0;
+        //! sorting the renderables by visibility
+        float partition = 0;
+        //! generating the draw commands of all the passes
+        float commandGeneration = 0;
+        //! sorting the draw commands of all the passes
+        float commandSort = 0;
+        //! turning the draw commands into driver commands
+        float driverCommands = 0;
+        //! assigning the lights to froxels
+        float froxelization = 0;
+    };
+
+    /**
+     * CPU performance counters of a stage of the frame, per frame, averaged over the frames of
+     * CpuCounterStats.
+     */
+    struct CpuStageCounters {
+        //! instructions retired
+        float instructions = 0;
+        //! instructions retired per CPU cycle
+        float ipc = 0;
+        //! cache misses
+        float cacheMisses = 0;
+        //! cache misses per cache reference
+        float cacheMissRate = 0;
+        //! branch misses
+        float branchMisses = 0;
+        //! branch misses per branch instruction
+        float branchMissRate = 0;
+    };
+
+    /**
+     * CPU performance counters of the same stages as CpuFrameStats, averaged over the last
+     * frames.
+     *
+     * The counters of a stage are those of the thread that runs it, which includes the share of
+     * its parallel jobs this thread runs while it waits, but not the jobs run by other threads.
+     * Like CpuFrameStats, they're process-wide.
+     *
+     * @see setCpuCountersEnabled(), getCpuCounterStats()
+     */
+    struct CpuCounterStats {
+        //! number of frames the counters are averaged over, 0 if nothing was counted
+        uint32_t frameCount = 0;
+        CpuStageCounters scenePrepare;
+        CpuStageCounters culling;
+        CpuStageCounters partition;
+        CpuStageCounters commandGeneration;
+        CpuStageCounters commandSort;
+        CpuStageCounters driverCommands;
+        CpuStageCounters froxelization;
+    };
+
+    /**
+     * Overall timings and draw counts of the last frame, cheap enough to be read every frame,
+     * e.g. to plot them over time.
+     *
+     * @see getFrameSummary()
+     */
+    struct FrameSummary {
+        //! id of the frame, 0 if no frame was ended yet
+        uint32_t frameId = 0;
+        //! time between the beginning of this frame and the previous one, in milliseconds
+        float frameInterval = 0;
+        //! time spent by the calling thread between beginFrame() and endFrame(), in milliseconds
+        float cpuFrameTime = 0;
+        //! GPU time of the last measured frame, in milliseconds, see getFrameStats()
+        float gpuFrameTime = 0;
+        //! draw calls issued by the render passes
+        uint32_t drawCount = 0;
+        //! uniform bindings and material instance switches issued by the render passes
+        uint32_t stateChangeCount = 0;
+        //! state changes skipped because the state was already set
+        uint32_t redundantStateChangeCount = 0;
+        //! refresh periods between the vsync that started the frame and its presentation, 0 if
+        //! the frame wasn't started at a vsync, see beginFrame(SwapChain*, uint64_t)
+        uint32_t vsyncInterval = 0;
+    };
+
+    /**
+     * The display the frames are presented on, used to pace the frames started at a vsync.
+     *
+     * On Android, the values come from android.view.Display.
+     *
+     * @see setDisplayInfo(), beginFrame(SwapChain*, uint64_t)
+     */
+    struct DisplayInfo {
+        //! refresh rate of the display, in Hz (Display.getRefreshRate())
+        float refreshRate = 60.0f;
+        //! how long before a vsync a frame must be submitted to be presented at that vsync, in
+        //! nanoseconds (Display.getPresentationDeadlineNanos())
+        uint64_t presentationDeadlineNanos = 0;
+        //! how long after the display's vsync the application's vsync happens, in nanoseconds
+        //! (Display.getAppVsyncOffsetNanos())
+        uint64_t vsyncOffsetNanos = 0;
+    };
+
      /**
       * Get the Engine that created this Renderer.
       *
@@ -136,6 +267,22 @@ public:
      */
     void render(View const* view);
 
+    /**
+     * Render several Views into this renderer's window, in order.
+     *
+     * This is equivalent to calling render() for each view, which is the typical use of
+     * several views of the same Scene (e.g. split-screen, or a mini-map). The preparation of a
+     * Scene and the per-renderable uniforms are computed once and shared by all the views
+     * that render it, unless the Scene changes in between.
+     *
+     * @param views An array of pointers to the views to render, they're rendered in this order.
+     * @param count Number of views in the array.
+     *
+     * @see
+     * render()
+     */
+    void render(View const* const* views, size_t count);
+
     /**
      * Read-back the content of the SwapChain associated with this Renderer.
      *
@@ -179,16 +326,20 @@ public:
      *  O------------+-------+
      *
      *
-     * Typically readPixels() will be called after render() and before endFrame().
+     * Typically readPixels() will be called after render() and before endFrame(). This is how
+     * the frames of a headless SwapChain are retrieved.
      *
      * After issuing this method, the callback associated with `buffer` will be invoked on the
      * main thread, indicating that the read-back has completed. Typically, this will happen
      * after multiple calls to beginFrame(), render(), endFrame().
      *
-     * It is also possible to use a Fence to wait for the read-back.
+     * The read-back doesn't stall the GPU, several of them can be in flight at the same time.
+     * `buffer` must not be accessed until its callback is invoked; a Fence only tells that
+     * the GPU has finished rendering, the pixels may not have been copied to `buffer` yet.
      *
      * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * readPixels() is intended for debugging and testing. It can impact performance because
+     * it prevents the driver from discarding the content of the render target.
      *
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -225,6 +376,41 @@ public:
      */
     bool beginFrame(SwapChain* swapChain);
 
+    /**
+     * Set-up a frame started at a vsync, e.g. in the callback of Android's Choreographer.
+     *
+     * In addition to what beginFrame(SwapChain*) does, the frame is given a presentation time:
+     * the first vsync it's expected to be rendered by, given the time the last frames took on
+     * the CPU and the GPU. This keeps the frames presented at a steady cadence, with as little
+     * latency as possible, rather than alternating between one and two refresh periods when
+     * they're close to the deadline.
+     *
+     * The presentation time is set with EGL_ANDROID_presentation_time or
+     * VK_GOOGLE_display_timing, it is ignored on platforms that support neither.
+     *
+     * @param swapChain A pointer to the SwapChain instance to use.
+     * @param vsyncSteadyClockTimeNano The time of the vsync that started the frame, in
+     *                                 nanoseconds, on the std::chrono::steady_clock timebase
+     *                                 (which on Android is the timebase of
+     *                                 Choreographer.FrameCallback's frameTimeNanos). 0 if
+     *                                 unknown, which is the same as beginFrame(SwapChain*).
+     *
+     * @return
+     *      *false* the current frame must be skipped,
+     *      *true* the current frame can be drawn.
+     *
+     * @see beginFrame(SwapChain*), setDisplayInfo()
+     */
+    bool beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano);
+
+    /**
+     * Describes the display, for the pacing of the frames started at a vsync. By default, the
+     * display is assumed to refresh at 60 Hz.
+     *
+     * @see DisplayInfo, beginFrame(SwapChain*, uint64_t)
+     */
+    void setDisplayInfo(DisplayInfo const& info) noexcept;
+
     /**
      * Finishes the current frame and schedules it for display.
      *
@@ -237,6 +423,66 @@ public:
      * beginFrame()
      */
     void endFrame();
+
+    /**
+     * Returns the GPU time spent in each pass of a recent frame.
+     *
+     * The GPU times are read back a few frames after they're measured so that this never waits
+     * for the GPU, they're the sum over all the views rendered during that frame. Frames whose
+     * timings are not available in time are skipped.
+     *
+     * @return The stats of the last measured frame. frameId is 0 if the backend doesn't support
+     *         timer queries.
+     */
+    FrameStats getFrameStats() const noexcept;
+
+    /**
+     * Returns the CPU time spent in each stage of the last frame ended by endFrame().
+     *
+     * Combined with Backend::NOOP this measures the CPU side of the engine without a GPU.
+     *
+     * @return The stats of the last frame.
+     */
+    CpuFrameStats getCpuFrameStats() const noexcept;
+
+    /**
+     * Enables or disables counting the CPU performance counters (instructions, cycles, cache
+     * and branch misses) of the stages of the frame. This is disabled by default.
+     *
+     * The counters only exist on Linux and Android, where they might also be restricted by the
+     * system (see /proc/sys/kernel/perf_event_paranoid). Reading them costs two system calls
+     * per stage and per view.
+     *
+     * @param enabled true to count the events of the next frames.
+     *
+     * @see getCpuCounterStats()
+     */
+    void setCpuCountersEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns the CPU performance counters of the stages of the last frames, see
+     * setCpuCountersEnabled(). They're also published in the engine's DebugRegistry as
+     * d.renderer.counters.<stage> = { IPC, cache miss rate, branch miss rate }.
+     *
+     * @return The counters averaged over the last frames, frameCount is 0 if they're disabled
+     *         or not supported.
+     */
+    CpuCounterStats getCpuCounterStats() const noexcept;
+
+    /**
+     * Returns the most memory in bytes used so far by the draw commands of a single pass.
+     *
+     * The buffers holding the draw commands grow as needed, Engine::Config::perFrameCommandsSize
+     * can be set to this value to allocate them upfront instead.
+     */
+    size_t getCommandsHighWatermark() const noexcept;
+
+    /**
+     * Returns the timings and draw counts of the last frame ended by endFrame().
+     *
+     * @return The summary of the last frame.
+     */
+    FrameSummary getFrameSummary() const noexcept;
 };
 
 } // namespace filament
@@ -19,6 +19,7 @@
 #ifndef TNT_FILAMENT_SCENE_H
 #define TNT_FILAMENT_SCENE_H
 
+#include <filament/Box.h>
 #include <filament/FilamentAPI.h>
 
 #include <utils/compiler.h>
@@ -114,6 +115,78 @@ public:
      * @return The total number of Light objects in the Scene.
      */
     size_t getLightCount() const noexcept;
+
+    /**
+     * Identifies a group of entities of a Scene.
+     * @see createGroup()
+     */
+    using GroupId = uint32_t;
+
+    /**
+     * Creates a group of entities, typically a region of the world that's streamed in and out,
+     * or shown and hidden, as a whole. Showing or hiding a group costs the same regardless of
+     * how many entities it has, unlike adding or removing each of them.
+     *
+     * @param bounds World-space bounding box of the group, for the application's own use
+     *               (e.g. to decide which groups to stream), see getGroupBounds().
+     *
+     * @return The identifier of the new group, which is visible and empty.
+     */
+    GroupId createGroup(Box const& bounds = {}) noexcept;
+
+    /**
+     * Destroys a group, its entities are removed from the Scene (but not destroyed).
+     *
+     * @param group Group to destroy, ignored if it doesn't exist.
+     */
+    void removeGroup(GroupId group) noexcept;
+
+    /**
+     * Adds entities to a group, they're part of the Scene while the group is visible.
+     *
+     * @param group     Group to add the entities to.
+     * @param entities  Entities to add, ignored if they don't have a Renderable or Light
+     *                  component.
+     * @param count     Number of entities.
+     *
+     * \attention
+     *  A given Entity object can only be added once to a Scene, either directly with addEntity()
+     *  or to a single group.
+     */
+    void addToGroup(GroupId group, utils::Entity const* entities, size_t count);
+
+    /**
+     * Adds an Entity to a group.
+     * @see addToGroup(GroupId, utils::Entity const*, size_t)
+     */
+    void addToGroup(GroupId group, utils::Entity entity) {
+        addToGroup(group, &entity, 1);
+    }
+
+    /**
+     * Shows or hides all the entities of a group. Hidden entities are skipped entirely, as if
+     * they weren't part of the Scene.
+     *
+     * @param group     Group to show or hide.
+     * @param visible   Whether the group's entities are part of the Scene. Groups are created
+     *                  visible.
+     */
+    void setGroupVisible(GroupId group, bool visible) noexcept;
+
+    /**
+     * Returns whether a group is visible.
+     */
+    bool isGroupVisible(GroupId group) const noexcept;
+
+    /**
+     * Returns the number of entities of a group.
+     */
+    size_t getGroupEntityCount(GroupId group) const noexcept;
+
+    /**
+     * Returns the bounding box given to createGroup(), empty if the group doesn't exist.
+     */
+    Box getGroupBounds(GroupId group) const noexcept;
 };
 
 } // namespace filament
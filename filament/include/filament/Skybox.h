@@ -37,7 +37,8 @@ class Texture;
 /**
  * Skybox
  *
- * When added to a Scene, the Skybox fills all untouched pixels.
+ * When added to a Scene, the Skybox fills all untouched pixels. It is drawn after all the
+ * opaque renderables, so that only the pixels they didn't cover are shaded.
  *
  * Creation and destruction
  * ========================
@@ -98,6 +99,21 @@ public:
          */
         Builder& showSun(bool show) noexcept;
 
+        /**
+         * Indicates whether the skybox can be drawn at a lower resolution, which is a good
+         * trade-off for blurry or low frequency environments. The skybox is then drawn along
+         * with the low resolution blended primitives, on the Views that enable
+         * View::setBlendingDownsampling(), and at full resolution on the others.
+         * The default value is false.
+         *
+         * @param enable True if the skybox can be drawn at a lower resolution
+         *
+         * @return This Builder, for chaining calls.
+         *
+         * @see View::setBlendingDownsampling
+         */
+        Builder& lowResolution(bool enable) noexcept;
+
         /**
          * Creates the Skybox object and returns a pointer to it.
          *
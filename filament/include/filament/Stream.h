@@ -169,13 +169,22 @@ public:
      * main thread, indicating that the read-back has completed. Typically, this will happen
      * after multiple calls to beginFrame(), render(), endFrame().
      *
-     * It is also possible to use a Fence to wait for the read-back.
-     *
-     * @remark
-     * readPixels() is intended for debugging and testing. It will impact performance significantly.
+     * The read-back doesn't stall the GPU, several of them can be in flight at the same time.
+     * `buffer` must not be accessed until its callback is invoked; a Fence only tells that
+     * the GPU is done, the pixels may not have been copied to `buffer` yet.
      */
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer) noexcept;
+
+    /**
+     * Returns the timestamp, in nanoseconds, of the frame of a native stream that was latched
+     * last. Streams are latched at the beginning of each frame, by the engine, so this is
+     * typically the frame being sampled by the frame just submitted.
+     *
+     * This doesn't wait for the engine. It returns 0 if the timestamp is unknown, which is
+     * always the case for copy streams.
+     */
+    int64_t getTimestamp() const noexcept;
 };
 
 } // namespace filament
@@ -138,12 +138,40 @@ namespace filament {
  *  SwapChain* swapChain = engine->createSwapChain(nativeWindow);
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  *
+ * Headless
+ * --------
+ *
+ * A SwapChain can also be created without a native window, to render offscreen (e.g. on a server
+ * without a display). Its frames are never presented, they're retrieved with
+ * Renderer::readPixels():
+ *
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ * SwapChain* swapChain = engine->createSwapChain(1024, 768);
+ * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
+ *
  * @see Engine
  */
 class UTILS_PUBLIC SwapChain : public FilamentAPI {
 public:
     static const uint64_t CONFIG_TRANSPARENT = driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
 
+    /**
+     * Frames are presented at the next vertical blank but replace the frames still waiting to be
+     * presented, instead of queuing behind them. This lowers the latency without tearing, at the
+     * cost of frames that are rendered but never displayed. When the platform can't do this, the
+     * swap chain falls back to the default behavior.
+     * Only supported by the Vulkan backend (mailbox present mode).
+     */
+    static const uint64_t CONFIG_LOW_LATENCY = driver::SWAP_CHAIN_CONFIG_LOW_LATENCY;
+
+    /**
+     * Frames are presented as soon as they're rendered, without waiting for the vertical blank,
+     * which gives the lowest latency but may tear. Takes precedence over CONFIG_LOW_LATENCY.
+     * Only supported by the Vulkan backend (immediate present mode).
+     */
+    static const uint64_t CONFIG_NO_VSYNC = driver::SWAP_CHAIN_CONFIG_NO_VSYNC;
+
+    // nullptr for a headless swap chain
     void* getNativeWindow() const noexcept;
 };
 
@@ -79,6 +79,20 @@ public:
     using FaceOffsets = driver::FaceOffsets;                        //!< Cube map faces offsets
     using Usage = driver::TextureUsage;                             //!< Usage affects texel layout
 
+    /**
+     * Called by the Engine when a level of a streaming texture becomes resident, the callback
+     * must (re)specify the content of that level with setImage(). It is always called from the
+     * thread that calls Renderer::endFrame().
+     * @see Builder::streaming()
+     */
+    using StreamingLoader = void(*)(Engine& engine, Texture* texture, size_t level, void* user);
+
+    //! Filter used to compute the levels in setImageWithMips()
+    enum class MipmapFilter : uint8_t {
+        BOX,        //!< 2x2 average, fastest
+        KAISER      //!< Kaiser-windowed sinc, sharper
+    };
+
     static bool isTextureFormatSupported(Engine& engine, InternalFormat format) noexcept;
 
     static size_t computeTextureDataSize(Texture::Format format, Texture::Type type,
@@ -111,7 +125,7 @@ public:
 
         /**
          * Specifies the depth in texels of the texture. Doesn't need to be a power-of-two.
-         * This creates a 3D textures.
+         * For driver::SamplerType::SAMPLER_2D_ARRAY textures, this is the number of layers.
          * @param depth Depth of the texture in texels (default: 1).
          * @return This Builder, for chaining calls.
          */
@@ -128,8 +142,9 @@ public:
 
         /**
          * Specifies whether this texture is a cubemap
-         * @param target either driver::SamplerType::SAMPLER_2D or
-         *                      driver::SamplerType::SAMPLER_CUBEMAP
+         * @param target either driver::SamplerType::SAMPLER_2D,
+         *                      driver::SamplerType::SAMPLER_CUBEMAP or
+         *                      driver::SamplerType::SAMPLER_2D_ARRAY
          * @return This Builder, for chaining calls.
          * @see Sampler
          */
@@ -159,6 +174,24 @@ public:
          */
         Builder& usage(Usage usage) noexcept;
 
+        /**
+         * Makes this texture a streaming texture: all its levels are declared, but only the
+         * coarsest ones (64 texels or less) are resident at first. Every frame, the Renderer
+         * records the finest level each streaming texture needs, based on the screen-space size
+         * of the renderables using it, and the Engine calls \p loader for each level that
+         * becomes resident. When Engine::Config::textureStreamingBudget is exceeded, the least
+         * recently used textures are evicted back to their coarse levels.
+         *
+         * Only driver::SamplerType::SAMPLER_2D, uncompressed textures with more than one level
+         * are streamed, and only with the OpenGL backend; otherwise all the levels are resident
+         * and \p loader is called for each of them once, when the texture is built.
+         *
+         * @param loader Callback uploading a level with setImage().
+         * @param user   Opaque pointer passed to \p loader.
+         * @return This Builder, for chaining calls.
+         */
+        Builder& streaming(StreamingLoader loader, void* user = nullptr) noexcept;
+
         /**
          * Creates the Texture object and returns a pointer to it.
          *
@@ -198,7 +231,8 @@ public:
     /**
      * Returns the depth of a 3D texture level
      * @param level texture level.
-     * @return Depth in texel of the specified \p level, clamped to 1.
+     * @return Depth in texel of the specified \p level, clamped to 1. For
+     * driver::SamplerType::SAMPLER_2D_ARRAY textures, this is the number of layers at all levels.
      * @attention If this texture is using driver::SamplerType::SAMPLER_EXTERNAL, the dimension
      * of the texture are unknown and this method always returns whatever was set on the Builder.
      */
@@ -212,6 +246,13 @@ public:
      */
     size_t getLevels() const noexcept;
 
+    /**
+     * Returns the finest resident level of a streaming texture.
+     * @return the finest level that can currently be sampled, 0 for non-streaming textures.
+     * @see Builder::streaming()
+     */
+    size_t getResidentLevel() const noexcept;
+
     /**
      * Return this texture Sampler as set by Builder::sampler().
      * @return this texture Sampler as set by Builder::sampler()
@@ -276,6 +317,34 @@ public:
             uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             PixelBufferDescriptor&& buffer) const noexcept;
 
+    /**
+     * Updates a sub-region of some layers of a 2D array texture for a level.
+     *
+     * @param engine    Engine this texture is associated to.
+     * @param level     Level to set the image for.
+     * @param xoffset   Left offset of the sub-region to update.
+     * @param yoffset   Bottom offset of the sub-region to update.
+     * @param zoffset   First layer to update.
+     * @param width     Width of the sub-region to update.
+     * @param height    Height of the sub-region to update.
+     * @param depth     Number of layers to update.
+     * @param buffer    Client-side buffer containing the images to set, one layer after the
+     *                  other.
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention \p level must be less than getLevels().
+     * @attention \p zoffset + \p depth must be at most getDepth().
+     * @attention \p buffer's driver::PixelDataFormat must match that of getFormat().
+     * @attention This Texture instance must use driver::SamplerType::SAMPLER_2D_ARRAY or it has
+     *            no effect
+     *
+     * @see Builder::sampler(), Builder::depth()
+     */
+    void setImage(Engine& engine, size_t level,
+            uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+            uint32_t width, uint32_t height, uint32_t depth,
+            PixelBufferDescriptor&& buffer) const noexcept;
+
     /**
      * Specify all six images of a cube map level.
      *
@@ -345,6 +414,27 @@ public:
      * @attention This Texture instance must NOT use driver::SamplerType::SAMPLER_CUBEMAP or it has no effect
      */
     void generateMipmaps(Engine& engine) const noexcept;
+
+    /**
+     * Specifies the base level of a 2D texture and computes all the other levels on the CPU,
+     * using the Engine's JobSystem. This works with formats glGenerateMipmap() can't filter
+     * (e.g. RGBM) and filters sRGB textures in linear space.
+     *
+     * @param engine    Engine this texture is associated to.
+     * @param buffer    Client-side buffer containing the base level, it must use the
+     *                  driver::PixelDataType::UBYTE type, no offsets and no padding.
+     * @param filter    Filter used to compute the levels.
+     *
+     * @attention \p engine must be the instance passed to Builder::build()
+     * @attention This must be called from the thread the Engine was created on.
+     * @attention This Texture instance must use driver::SamplerType::SAMPLER_2D or it has no effect
+     *
+     * @note
+     * Buffers this method can't filter are uploaded with setImage() and the levels are
+     * generated with generateMipmaps().
+     */
+    void setImageWithMips(Engine& engine, PixelBufferDescriptor&& buffer,
+            MipmapFilter filter = MipmapFilter::BOX) const noexcept;
 };
 
 } // namespace filament
@@ -124,6 +124,23 @@ public:
      */
     void setTransform(Instance ci, const math::mat4f& localTransform) noexcept;
 
+    /**
+     * Sets the local transforms of several transform components at once, e.g. every frame of an
+     * animation. The world transforms are updated once for all of them, as if the calls to
+     * setTransform() were made during a local transform transaction.
+     *
+     * @param instances         Array of count instances of the transform components to set.
+     * @param localTransforms   Array of count local transforms, in the same order as instances.
+     * @param count             Number of transforms to set.
+     *
+     * @note If a local transform transaction is already open, it is left open, and the world
+     *       transforms are only updated by commitLocalTransformTransaction().
+     *
+     * @see setTransform(), openLocalTransformTransaction()
+     */
+    void setTransforms(Instance const* instances, math::mat4f const* localTransforms,
+            size_t count) noexcept;
+
     /**
      * Returns the local transform of a transform component.
      * @param ci The instance of the transform component to query the local transform from.
@@ -161,6 +178,12 @@ public:
      * Commits the currently open local transform transaction. When this returns, calls
      * to getWorldTransform() will return the proper value.
      *
+     * Only the transforms set during the transaction, and their descendants, are updated. Each
+     * level of the hierarchy is processed in parallel.
+     *
+     * @attention Instances are invalidated when the hierarchy changed during the transaction,
+     *            since components are reordered from the root to the leaves.
+     *
      * @attention failing to call this method when done updating the local transform will cause
      *            a lot of rendering problems. The system never closes the transaction
      *            automatically.
@@ -39,6 +39,8 @@ class UTILS_PUBLIC VertexBuffer : public FilamentAPI {
 public:
     using AttributeType = driver::ElementType;
     using BufferDescriptor = driver::BufferDescriptor;
+    using BufferRange = driver::BufferRange;
+    using Usage = driver::Usage;
 
     class Builder : public BuilderBase<BuilderDetails> {
         friend struct BuilderDetails;
@@ -63,6 +65,33 @@ public:
         // no-op if attribute is an invalid enum
         Builder& normalized(VertexAttribute attribute) noexcept;
 
+        /**
+         * Specifies how often the buffers are updated (default: Usage::STATIC). The buffers of
+         * a Usage::DYNAMIC VertexBuffer can be updated every frame without waiting for the
+         * draws still reading them, at the cost of more GPU memory.
+         */
+        Builder& usage(Usage usage) noexcept;
+
+        /**
+         * Declares the buffer holding the attributes the depth and shadow passes need, e.g. the
+         * positions (and the bones of skinned meshes) stored apart from the other attributes.
+         * These passes then only fetch the attributes of this buffer. Masked materials run their
+         * whole vertex shader in these passes, their primitives fetch all the attributes unless
+         * this buffer holds all the ones they require. The buffer must hold the positions.
+         */
+        Builder& depthBuffer(uint8_t bufferIndex) noexcept;
+
+        /**
+         * Skinned renderables whose primitives all use such VertexBuffers are skinned on the CPU,
+         * once each time their bones change, into vertex buffers of their own. All the passes
+         * then draw them without the skinning variant. This keeps a copy of the buffers in
+         * memory. The positions must be FLOAT3, FLOAT4 or HALF4, the tangents (if any) unit
+         * quaternions stored as FLOAT4 or normalized SHORT4, and the bone indices and weights
+         * must be declared. Once a renderable uses it, the buffers must only be updated on the
+         * engine's thread. Disabled by default.
+         */
+        Builder& cpuSkinning(bool enable) noexcept;
+
         /**
          * Creates the VertexBuffer object and returns a pointer to it.
          *
@@ -96,6 +125,19 @@ public:
             BufferDescriptor&& buffer,
             uint32_t byteOffset = 0,
             uint32_t byteSize = 0);
+
+    /**
+     * Updates several ranges of a buffer at once.
+     *
+     * @param engine        Engine this VertexBuffer is associated to.
+     * @param bufferIndex   Index of the buffer to update, noop if bufferIndex >= bufferCount.
+     * @param buffer        Client-side buffer holding the content of all the ranges, back to back.
+     * @param ranges        Ranges of the buffer to update, copied by this call.
+     * @param count         Number of ranges.
+     */
+    void setBufferRangesAt(Engine& engine, uint8_t bufferIndex,
+            BufferDescriptor&& buffer,
+            BufferRange const* ranges, size_t count);
 };
 
 } // namespace filament
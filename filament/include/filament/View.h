@@ -27,6 +27,7 @@
 #include <filament/driver/DriverEnums.h>
 
 #include <utils/compiler.h>
+#include <utils/Entity.h>
 
 #include <math/vec2.h>
 #include <math/vec3.h>
@@ -34,8 +35,11 @@
 namespace filament {
 
 class Camera;
+class Engine;
 class MaterialInstance;
+class PotentiallyVisibleSet;
 class Scene;
+class Texture;
 
 /**
  * A View encompasses all the state needed for rendering a Scene.
@@ -87,11 +91,22 @@ public:
      * history:   History size. higher values, tend to filter more (clamped to 30)
      * minScale:  the minimum scale in X and Y this View should use
      * maxScale:  the maximum scale in X and Y this View should use
+     * proportionalGain, derivativeGain: the scale is driven by a PID controller, whose
+     *            integral gain is given by scaleRate. These default to 0, higher values
+     *            react faster to changes of the workload but may oscillate.
+     * hysteresis: frame times within this ratio of the target are considered on target,
+     *            which avoids changing the scale because of the noise of the measurements.
+     * gpuUtilization: power saving mode, when not 0 the resolution is also lowered until the
+     *            GPU is busy at most this ratio of the time between frames, even when the
+     *            target frame rate is reached. 0.7 leaves the GPU idle 30% of the time.
+     *
+     * When one axis reaches its minimum or maximum scale, the other axis takes the rest of the
+     * scaling, within its own limits.
      *
      * \note
      * Dynamic resolution is only supported on platforms where the time to render
-     * a frame can be measured accurately. Dynamic resolution is currently only
-     * supported on Android.
+     * a frame can be measured accurately, that is when the backend supports GPU timer
+     * queries, or fences.
      */
     struct DynamicResolutionOptions {
         DynamicResolutionOptions() = default;
@@ -110,23 +125,112 @@ public:
         float scaleRate = 0.125f;                       //!< rate at which the scale will change
         float targetFrameTimeMilli = 1000.0f / 60.0f;   //!< desired frame time, or budget.
         float headRoomRatio = 0.0f;                     //!< additional headroom for the GPU
-        float reserved[5] = { 0.0f };                   //!< reserved fields, must be zero
+        float proportionalGain = 0.0f;                  //!< PID controller's proportional gain
+        float derivativeGain = 0.0f;                    //!< PID controller's derivative gain
+        float hysteresis = 0.05f;                       //!< relative frame time error ignored
+        float gpuUtilization = 0.0f;                    //!< power saving GPU target, 0 disables
+        float reserved[1] = { 0.0f };                   //!< reserved fields, must be zero
         uint8_t history = 9;                            //!< history size
         bool enabled = false;                           //!< enable or disable dynamic resolution
         bool homogeneousScaling = false;                //!< set to true to force homogeneous scaling
     };
 
+    /**
+     * Options for the shadow maps of this View.
+     *
+     * With dynamic resolution, the size of all the shadow maps (see
+     * LightManager::ShadowOptions::mapSize) is scaled by a power of two between minScale and
+     * maxScale, driven by the frame time the same way as DynamicResolutionOptions: the shadow
+     * maps get smaller when frames take longer than DynamicResolutionOptions::targetFrameTimeMilli
+     * (minus its headroom) and larger again when there is time left. This trades shadow quality
+     * for frame time, and works whether or not the View's dynamic resolution is enabled.
+     *
+     * \note
+     * Like dynamic resolution, this is only supported on platforms where the time to render
+     * a frame can be measured accurately.
+     *
+     * The filtering selects the kernel used by the materials to sample the shadow maps, the
+     * cheaper kernels trade soft and stable shadow edges for fragment shading time. All the
+     * materials receiving shadows in this View use it, no shader needs to be compiled when it
+     * changes. It is clamped to the most expensive kernel compiled in the materials, PCF_MEDIUM
+     * for the mobile OpenGL targets.
+     */
+    struct ShadowOptions {
+        /**
+         * Kernels used to sample the shadow maps, from the cheapest to the most expensive.
+         */
+        enum class Filtering : uint8_t {
+            HARD,           //!< a single hardware 2x2 PCF tap, hard edges
+            PCF_LOW,        //!< 4 taps, 3x3 texels
+            PCF_MEDIUM,     //!< 9 taps, 5x5 texels
+            PCF_HIGH        //!< 16 taps, 7x7 texels
+        };
+
+        float minScale = 0.25f;             //!< minimum scale of the shadow maps' size
+        float maxScale = 1.0f;              //!< maximum scale of the shadow maps' size
+        bool dynamicResolution = false;     //!< scale the shadow maps with the frame time
+        Filtering filtering = Filtering::PCF_LOW;   //!< shadow maps sampling kernel
+    };
+
+    /**
+     * Color grading of this View, applied by the post-processing tone mapping before the
+     * tone mapping operator.
+     *
+     * The grading and the tone mapping operator are baked into a lookup table whenever these
+     * options change, so the cost of post-processing doesn't depend on them.
+     */
+    struct ColorGradingOptions {
+        float exposure = 0.0f;      //!< in EV, on top of the camera's exposure
+        float contrast = 1.0f;      //!< in log space around middle gray, 1 means no change
+        float saturation = 1.0f;    //!< 0 is grayscale, 1 means no change
+        float temperature = 0.0f;   //!< white balance, from -1 (cooler) to 1 (warmer)
+        float tint = 0.0f;          //!< white balance, from -1 (greener) to 1 (more magenta)
+    };
+
+    /**
+     * Options for the culling of the point and spot lights that barely contribute to the image.
+     *
+     * The contribution of a light is estimated as the size of its sphere of influence on the
+     * screen (as a fraction of the viewport's height) times its exposed intensity at that
+     * radius, which is 1 or more for a light that visibly lights its surroundings. Lights whose
+     * contribution is below minContribution are not assigned to any froxel, and their intensity
+     * fades out when it goes from fadeContribution down to minContribution, so they don't pop.
+     */
+    struct LightCullingOptions {
+        float minContribution = 0.0f;     //!< 0 disables the culling
+        float fadeContribution = 0.0f;    //!< no fading when not above minContribution
+    };
+
     enum class DepthPrepass : int8_t {
         DEFAULT = -1,
         DISABLED,
         ENABLED,
     };
 
+    /**
+     * Order of the opaque draw calls of the color pass, for the renderables that aren't drawn in
+     * the depth pre-pass (the others are always sorted by material, their depth is already
+     * resolved).
+     *
+     * Fill-bound scenes benefit from a strict front-to-back order, which rejects the most hidden
+     * fragments with the early depth test. Scenes bound by the CPU or the driver benefit from
+     * sorting by material, which minimizes the program and material instance switches. The
+     * debug counters "d.renderpass.program_changes" and "d.renderpass.material_instance_changes"
+     * give the switches of each frame, to pick the order from measured data.
+     */
+    enum class RenderOrder : uint8_t {
+        HYBRID,         //!< by coarse depth buckets (log2 of the distance), then by material
+        FRONT_TO_BACK,  //!< by distance to the camera, then by material
+        STATE_FIRST,    //!< by material only
+    };
+
     /**
      * Sets whether this view is rendered with or without a depth pre-pass.
      *
      * By default, the system picks the most appropriate strategy, this method lets the
-     * application override that strategy.
+     * application override that strategy. The default strategy estimates the overdraw of the
+     * opaque renderables each frame, from their projected bounds, and only draws the largest
+     * ones in the depth pre-pass when the overdraw is high.
      *
      * When the depth pre-pass is enabled, the renderer will first draw all objects in the
      * depth buffer from front to back, and then draw the objects again but sorted to minimize
@@ -141,6 +245,20 @@ public:
      */
     void setDepthPrepass(DepthPrepass prepass) noexcept;
 
+    /**
+     * Sets the order of the opaque draw calls of the color pass.
+     *
+     * @param order     RenderOrder::HYBRID by default.
+     *
+     * @see RenderOrder
+     */
+    void setRenderOrder(RenderOrder order) noexcept;
+
+    /**
+     * Returns the order of the opaque draw calls set by setRenderOrder().
+     */
+    RenderOrder getRenderOrder() const noexcept;
+
     /**
      * Sets the View's name. Only useful for debugging.
      * @param name Pointer to the View's name. The string is copied.
@@ -212,6 +330,41 @@ public:
         return const_cast<View*>(this)->getCamera();
     }
 
+    /**
+     * Renders this View in stereo: both eyes are drawn at once, into the two first layers of
+     * a 2D array texture, using the multiview capability of the backend.
+     *
+     * The scene is culled and its rendering commands are generated only once for both eyes,
+     * against a frustum that contains the frustums of the two cameras. This frustum assumes
+     * the eyes look in parallel directions, as in head-mounted displays.
+     *
+     * A stereo View isn't post-processed nor multi-sampled, it's rendered in linear space
+     * directly into the texture. Its Camera, set with setCamera(), is ignored. Materials built
+     * without the stereo variant aren't rendered.
+     *
+     * @param left      Camera of the left eye, rendered into layer 0 of \p target.
+     * @param right     Camera of the right eye, rendered into layer 1 of \p target.
+     *                  Both cameras must use a perspective projection and the same exposure.
+     * @param target    A Texture::Sampler::SAMPLER_2D_ARRAY with at least 2 layers and the
+     *                  COLOR_ATTACHMENT usage, its size must match the Viewport.
+     *                  nullptr (or a null camera) makes this View mono again.
+     *
+     * The View doesn't take ownership of the Cameras and the Texture, they must outlive it or
+     * be dissociated first.
+     *
+     * @see isStereoSupported()
+     */
+    void setStereo(Camera* left, Camera* right, Texture* target) noexcept;
+
+    //! Returns whether this View is rendered in stereo, see setStereo().
+    bool isStereo() const noexcept;
+
+    /**
+     * Returns whether the backend of \p engine can render stereo Views. When it can't, the
+     * Renderer skips them.
+     */
+    static bool isStereoSupported(Engine& engine) noexcept;
+
     /**
      * Set this View Viewport.
      *
@@ -290,6 +443,78 @@ public:
      */
     void setShadowsEnabled(bool enabled) noexcept;
 
+    /**
+     * Sets the number of cascades of the directional light's shadow map, between 1 and 4.
+     * 1 by default.
+     *
+     * Each cascade covers a slice of the view frustum, up to the light's shadowFar distance, with
+     * its own shadow map, which gives better shadows close to the camera. All the cascades are
+     * stored in a single texture: each has the size set by LightManager::ShadowOptions::mapSize,
+     * so the texture is twice as large with 2 cascades and four times as large with 3 or 4.
+     * Lowering mapSize trades some of that quality back for memory.
+     *
+     * @param count number of shadow cascades, clamped to [1, 4].
+     *
+     * @see LightManager::ShadowOptions
+     */
+    void setShadowCascades(uint8_t count) noexcept;
+
+    /**
+     * Returns the number of cascades of the directional light's shadow map.
+     */
+    uint8_t getShadowCascades() const noexcept;
+
+    /**
+     * Enable or disable caching of the static shadow casters. Disabled by default.
+     *
+     * When enabled, the directional light's shadow map is split in two: the static shadow
+     * casters, created with RenderableManager::Builder::staticShadowCaster(), are rendered once
+     * in a second texture, which is copied into the shadow map each frame before the other
+     * casters are rendered. The static casters are rendered again only when the light, the
+     * camera, the visible layers or a static caster changes (e.g. moves), so this benefits
+     * mostly scenes seen from a still camera, at the cost of the memory of the second texture.
+     *
+     * @param enabled true enables static shadow caching, false disables it.
+     */
+    void setStaticShadowCachingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether caching of the static shadow casters is enabled.
+     */
+    bool isStaticShadowCachingEnabled() const noexcept;
+
+    /**
+     * Sets the shadow map options of this View, i.e. whether and within which bounds the size
+     * of the shadow maps follows the frame time, and how the shadow maps are filtered.
+     *
+     * @param options The shadow options to use on this view
+     *
+     * @see ShadowOptions, setDynamicResolutionOptions()
+     */
+    void setShadowOptions(ShadowOptions const& options) noexcept;
+
+    /**
+     * Returns the shadow options associated with this view.
+     * @return value set by setShadowOptions().
+     */
+    ShadowOptions getShadowOptions() const noexcept;
+
+    /**
+     * Sets the options of the culling of the point and spot lights whose contribution to the
+     * image is too small to be worth shading. Disabled by default.
+     *
+     * @param options The light culling options to use on this view
+     *
+     * @see LightCullingOptions
+     */
+    void setLightCullingOptions(LightCullingOptions const& options) noexcept;
+
+    /**
+     * Returns the light culling options associated with this view.
+     * @return value set by setLightCullingOptions().
+     */
+    LightCullingOptions getLightCullingOptions() const noexcept;
+
     /**
      * Specifies which buffers can be discarded before rendering.
      *
@@ -326,13 +551,20 @@ public:
 
     enum AntiAliasing : uint8_t {
         NONE = 0,
-        FXAA = 1
+        FXAA = 1,
+        /**
+         * Temporal anti-aliasing, the color pass is jittered and resolved with the previous
+         * frames. With the dynamic resolution, it also reconstructs the full resolution instead
+         * of upscaling. Moving objects aren't reprojected and may ghost a little. Ignored when
+         * multi-sampling or rendering in stereo, where no anti-aliasing is done.
+         */
+        TEMPORAL = 2
     };
 
     /**
      * Enables or disables in the post-processing stage. Enabled by default.
      *
-     * @param type FXAA for enabling, NONE for disabling anti-aliasing.
+     * @param type FXAA or TEMPORAL for enabling, NONE for disabling anti-aliasing.
      */
     void setAntiAliasing(AntiAliasing type) noexcept;
 
@@ -343,6 +575,19 @@ public:
      */
     AntiAliasing getAntiAliasing() const noexcept;
 
+    /**
+     * Sets the color grading of this View, applied when post-processing is enabled.
+     *
+     * @param options The color grading options to use on this view
+     */
+    void setColorGradingOptions(ColorGradingOptions const& options) noexcept;
+
+    /**
+     * Returns the color grading options associated with this view.
+     * @return value set by setColorGradingOptions().
+     */
+    ColorGradingOptions getColorGradingOptions() const noexcept;
+
     /**
      * Sets the dynamic resolution options for this view. Dynamic resolution options
      * controls whether dynamic resolution is enabled, and if it is, how it behaves.
@@ -357,6 +602,12 @@ public:
      */
     DynamicResolutionOptions getDynamicResolutionOptions() const noexcept;
 
+    /**
+     * Returns the scale factors the dynamic resolution applied to this view in the last frame.
+     * @return The scale factors in x and y, 1 when dynamic resolution is disabled.
+     */
+    math::float2 getDynamicResolutionScale() const noexcept;
+
     /**
      * Sets options relative to dynamic lighting for this view.
      *
@@ -379,6 +630,20 @@ public:
      */
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
 
+    /**
+     * Sets the number of froxels the lights are assigned to. The visible part of the frustum
+     * between zLightNear and zLightFar is divided in froxels, and the shaders go through the
+     * lights of the froxel of each fragment. More froxels make for shorter lists of lights,
+     * but cost more to compute and upload.
+     *
+     * @param froxelCount Number of froxels, between 1024 and 8192, or 0 to let the view
+     *                    choose it from the number of visible lights and how much they
+     *                    overlap (default).
+     *
+     * @see setDynamicLightingOptions()
+     */
+    void setFroxelCount(uint32_t froxelCount) noexcept;
+
     /**
      * Enable or disable post processing. Enabled by default.
      *
@@ -395,6 +660,132 @@ public:
      */
     void setPostProcessingEnabled(bool enabled) noexcept;
 
+    /**
+     * Enable or disable occlusion culling. Disabled by default.
+     *
+     * When enabled, renderables entirely hidden behind occluders are culled. Occluders are the
+     * renderables created with RenderableManager::Builder::occluder(), their bounding box is
+     * rasterized in a small depth buffer on the CPU, so their geometry must fill it.
+     * Occlusion culling has no effect when culling is disabled.
+     *
+     * @param enabled true enables occlusion culling, false disables it.
+     */
+    void setOcclusionCullingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether occlusion culling is enabled.
+     */
+    bool isOcclusionCullingEnabled() const noexcept;
+
+    /**
+     * Returns the number of renderables rejected by occlusion culling during the last frame.
+     */
+    size_t getOcclusionCulledCount() const noexcept;
+
+    /**
+     * Sets the potentially visible set used to cull the renderables. None by default.
+     *
+     * Each frame, the renderables the set says can't be seen from the culling camera's cell are
+     * culled, before the other culling methods. Renderables that aren't in the set, or created
+     * with RenderableManager::Builder::culling(false), are not affected, nor is anything when
+     * the camera is outside of the set's grid. Shadows are not affected.
+     * PVS culling has no effect when culling is disabled.
+     *
+     * @param pvs       the set, which must outlive its use by this View, or nullptr to disable
+     *                  PVS culling.
+     * @param entities  the renderable of each object of the set, entities[i] is the object i.
+     *                  This array is copied.
+     * @param count     number of entities, at most pvs->getObjectCount().
+     */
+    void setPotentiallyVisibleSet(PotentiallyVisibleSet const* pvs,
+            utils::Entity const* entities, size_t count) noexcept;
+
+    /**
+     * Returns the number of renderables rejected by the potentially visible set during the last
+     * frame.
+     */
+    size_t getPvsCulledCount() const noexcept;
+
+    /**
+     * Sets the size under which renderables are culled, in pixels. 0 by default (disabled).
+     *
+     * Renderables whose bounding box is smaller than this size on screen are not drawn, unless
+     * they were created with RenderableManager::Builder::smallFeatureCulling(false). This doesn't
+     * affect shadows. Small feature culling has no effect when culling is disabled.
+     *
+     * @param minSizeInPixels size (diameter) in pixels under which renderables are culled.
+     */
+    void setSmallFeatureCulling(float minSizeInPixels) noexcept;
+
+    /**
+     * Returns the size under which renderables are culled, in pixels.
+     */
+    float getSmallFeatureCulling() const noexcept;
+
+    /**
+     * Sets the maximum number of primitives drawn by the color pass. 0 by default (unlimited).
+     *
+     * When the visible renderables have more primitives than this, the least important ones are
+     * not drawn: the ones with the highest RenderableManager::Builder::priority() first, and for
+     * the same priority the smallest on screen first. This keeps the cost of a frame bounded on
+     * slow devices. Renderables created with RenderableManager::Builder::culling(false) are
+     * always drawn, and shadows are not affected. The draw budget has no effect when culling is
+     * disabled.
+     *
+     * @param maxPrimitiveCount maximum number of primitives drawn, or 0 to disable the budget.
+     */
+    void setDrawBudget(uint32_t maxPrimitiveCount) noexcept;
+
+    /**
+     * Returns the maximum number of primitives drawn by the color pass, 0 if unlimited.
+     */
+    uint32_t getDrawBudget() const noexcept;
+
+    /**
+     * Returns the number of visible renderables not drawn because of the draw budget during the
+     * last frame.
+     */
+    size_t getDrawBudgetCulledCount() const noexcept;
+
+    /**
+     * Sets how much the blended primitives of the renderables created with
+     * RenderableManager::Builder::lowResolutionBlending(true) are downsampled. 1 by default
+     * (disabled).
+     *
+     * These primitives, typically particles or smoke, are drawn into a target 2 or 4 times
+     * smaller in each dimension, depth tested against a downsampled copy of the depth buffer.
+     * The result is upsampled with a depth-aware filter and composited before tone mapping,
+     * which divides their fill cost by up to 16. The skyboxes created with
+     * Skybox::Builder::lowResolution(true) are drawn in the same pass.
+     *
+     * This requires the post-processing pass and has no effect with MSAA.
+     *
+     * @param factor 1 (disabled), 2 or 4. Other values are rounded down to one of these.
+     */
+    void setBlendingDownsampling(uint8_t factor) noexcept;
+
+    /**
+     * Returns the downsampling factor set by setBlendingDownsampling().
+     */
+    uint8_t getBlendingDownsampling() const noexcept;
+
+    /**
+     * Enable or disable caching of the rendering commands. Disabled by default.
+     *
+     * When enabled, the sorted rendering commands of a frame are kept and reused by the next
+     * frames, as long as the camera, the Scene and its renderables and transforms don't change.
+     * Any such change causes all the commands to be regenerated. This benefits mostly static
+     * scenes, at the cost of the memory needed to keep the commands.
+     *
+     * @param enabled true enables command caching, false disables it.
+     */
+    void setCommandCachingEnabled(bool enabled) noexcept;
+
+    /**
+     * Returns whether caching of the rendering commands is enabled.
+     */
+    bool isCommandCachingEnabled() const noexcept;
+
 
     // for debugging...
 
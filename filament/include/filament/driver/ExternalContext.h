@@ -61,6 +61,12 @@ public:
     virtual void terminate() noexcept = 0;
 
     virtual SwapChain* createSwapChain(void* nativeWindow, uint64_t& flags) noexcept = 0;
+
+    // Creates a swap chain that isn't tied to a window, e.g. a pbuffer, to render offscreen when
+    // there is no display. Returns nullptr if the platform can't do it.
+    virtual SwapChain* createSwapChainHeadless(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept { return nullptr; }
+
     virtual void destroySwapChain(SwapChain* swapChain) noexcept = 0;
 
     // Called to make the OpenGL context active on the calling thread.
@@ -70,6 +76,10 @@ public:
     // swap draw buffers (i.e. for double-buffered rendering).
     virtual void commit(SwapChain* swapChain) noexcept = 0;
 
+    // Called before commit() with the time at which the frame should be presented, on the
+    // CLOCK_MONOTONIC timebase (0 to present it as soon as possible).
+    virtual void setPresentationTime(int64_t presentationTimeInNanosecond) noexcept { }
+
     virtual bool canCreateFence() noexcept { return false; }
     virtual Fence* createFence() noexcept = 0;
     virtual void destroyFence(Fence* fence) noexcept = 0;
@@ -85,7 +95,10 @@ public:
 
     // detach destroys the texture associated to the stream
     virtual void detach(Stream* stream) noexcept = 0;
-    virtual void updateTexImage(Stream* stream) noexcept = 0;
+
+    // latches the stream's latest frame, and returns its timestamp in nanoseconds (or leaves it
+    // unchanged if the platform can't tell)
+    virtual void updateTexImage(Stream* stream, int64_t* timestamp) noexcept = 0;
 
     // external texture storage
     virtual ExternalTexture* createExternalTextureStorage() noexcept = 0;
@@ -95,6 +108,21 @@ public:
             uint32_t w, uint32_t h, TextureFormat format) noexcept = 0;
 
     virtual void destroyExternalTextureStorage(ExternalTexture* ets) noexcept = 0;
+
+    // Asks createDriver() to also create an "upload context", sharing its objects with the main
+    // context, which the driver makes current on a background thread dedicated to uploads.
+    void setUploadContextEnabled(bool enabled) noexcept { mUploadContextEnabled = enabled; }
+
+    // Whether createDriver() created the upload context.
+    virtual bool hasUploadContext() const noexcept { return false; }
+
+    // Called on the upload thread to make the upload context active on it, and to release it
+    // before the thread exits (which always happens before terminate()).
+    virtual bool makeUploadContextCurrent() noexcept { return false; }
+    virtual void releaseUploadContext() noexcept { }
+
+protected:
+    bool mUploadContextEnabled = false;
 };
 
 class UTILS_PUBLIC ContextManagerVk : public ExternalContext {
@@ -21,6 +21,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <utility>
+
 #include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/DriverEnums.h>
 
@@ -50,6 +52,15 @@ public:
               stride(0), format(format), type(type), alignment(1) {
     }
 
+    // takes over the memory of a BufferDescriptor, e.g. from Engine::allocateStagingBuffer()
+    PixelBufferDescriptor(BufferDescriptor&& buffer,
+            PixelDataFormat format, PixelDataType type, uint8_t alignment = 1,
+            uint32_t left = 0, uint32_t top = 0, uint32_t stride = 0) noexcept
+            : BufferDescriptor(std::move(buffer)),
+              left(left), top(top), stride(stride),
+              format(format), type(type), alignment(alignment) {
+    }
+
     PixelBufferDescriptor(void const* buffer, size_t size,
             driver::CompressedPixelDataType format, uint32_t imageSize,
             Callback callback, void* user = nullptr) noexcept
@@ -108,6 +119,10 @@ public:
             case PixelDataType::FLOAT:
                 bpp *= 4;
                 break;
+            case PixelDataType::UINT_5_9_9_9_REV:
+                // the 3 components are packed in 4 bytes
+                bpp = 4;
+                break;
         }
 
         size_t bpr = bpp * stride;
@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/BoundingVolumeHierarchy.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Systrace.h>
+
+#include <math/fast.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <limits>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+namespace details {
+
+namespace {
+
+// culling results of a node against all planes
+enum class Intersection {
+    OUTSIDE,
+    INTERSECTS,
+    INSIDE
+};
+
+struct Bounds {
+    float3 lo{ std::numeric_limits<float>::max() };
+    float3 hi{ std::numeric_limits<float>::lowest() };
+
+    void add(float3 const& center, float3 const& halfExtent) noexcept {
+        lo = min(lo, center - halfExtent);
+        hi = max(hi, center + halfExtent);
+    }
+    float3 getCenter() const noexcept { return (hi + lo) * 0.5f; }
+    float3 getHalfExtent() const noexcept { return (hi - lo) * 0.5f; }
+};
+
+inline Intersection intersects(float4 const* UTILS_RESTRICT planes,
+        float3 const& center, float3 const& extent) noexcept {
+    Intersection result = Intersection::INSIDE;
+    for (size_t j = 0; j < 6; j++) {
+        // same as Culler, distance of the closest point of the box to the plane
+        const float c = planes[j].x * center.x + planes[j].y * center.y +
+                        planes[j].z * center.z + planes[j].w;
+        const float e = std::abs(planes[j].x) * extent.x + std::abs(planes[j].y) * extent.y +
+                        std::abs(planes[j].z) * extent.z;
+        if (!fast::signbit(c - e)) {
+            return Intersection::OUTSIDE;
+        }
+        if (!fast::signbit(c + e)) {
+            result = Intersection::INTERSECTS;
+        }
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+void BoundingVolumeHierarchy::build(float3 const* centers, float3 const* extents, size_t count) {
+    SYSTRACE_CALL();
+
+    clear();
+    if (!count) {
+        return;
+    }
+
+    mBoxes.resize(count);
+    for (size_t i = 0; i < count; i++) {
+        mBoxes[i] = uint32_t(i);
+    }
+
+    // a binary tree with leaves of at least LEAF_SIZE / 2 boxes
+    mNodes.reserve(2 * ((count * 2) / LEAF_SIZE + 1));
+    buildRecursive(centers, extents, 0, uint32_t(count));
+}
+
+uint32_t BoundingVolumeHierarchy::buildRecursive(float3 const* centers, float3 const* extents,
+        uint32_t first, uint32_t count) {
+    const uint32_t index = uint32_t(mNodes.size());
+    mNodes.push_back({});
+
+    uint32_t* const boxes = mBoxes.data() + first;
+    if (count <= LEAF_SIZE) {
+        Bounds bounds;
+        for (uint32_t i = 0; i < count; i++) {
+            bounds.add(centers[boxes[i]], extents[boxes[i]]);
+        }
+        mNodes[index] = { bounds.getCenter(), first, bounds.getHalfExtent(), count };
+        return index;
+    }
+
+    // split at the median of the boxes' centers, along the largest axis
+    Bounds centroids;
+    for (uint32_t i = 0; i < count; i++) {
+        centroids.add(centers[boxes[i]], float3{ 0 });
+    }
+    const float3 size = centroids.hi - centroids.lo;
+    const size_t axis = (size.x >= size.y && size.x >= size.z) ? 0 : (size.y >= size.z ? 1 : 2);
+    const uint32_t half = count / 2;
+    std::nth_element(boxes, boxes + half, boxes + count,
+            [centers, axis](uint32_t lhs, uint32_t rhs) {
+                return centers[lhs][axis] < centers[rhs][axis];
+            });
+
+    const uint32_t left = buildRecursive(centers, extents, first, half);
+    const uint32_t right = buildRecursive(centers, extents, first + half, count - half);
+
+    Bounds bounds;
+    bounds.add(mNodes[left].center, mNodes[left].halfExtent);
+    bounds.add(mNodes[right].center, mNodes[right].halfExtent);
+    mNodes[index] = { bounds.getCenter(), right, bounds.getHalfExtent(), 0 };
+    return index;
+}
+
+void BoundingVolumeHierarchy::refit(float3 const* centers, float3 const* extents) noexcept {
+    SYSTRACE_CALL();
+
+    // children are always stored after their parent
+    Node* const nodes = mNodes.data();
+    uint32_t const* const boxes = mBoxes.data();
+    for (size_t i = mNodes.size(); i-- > 0;) {
+        Node& node = nodes[i];
+        Bounds bounds;
+        if (node.count) {
+            for (uint32_t j = node.first, e = node.first + node.count; j < e; j++) {
+                bounds.add(centers[boxes[j]], extents[boxes[j]]);
+            }
+        } else {
+            bounds.add(nodes[i + 1].center, nodes[i + 1].halfExtent);
+            bounds.add(nodes[node.first].center, nodes[node.first].halfExtent);
+        }
+        node.center = bounds.getCenter();
+        node.halfExtent = bounds.getHalfExtent();
+    }
+}
+
+void BoundingVolumeHierarchy::clear() noexcept {
+    mNodes.clear();
+    mBoxes.clear();
+}
+
+void BoundingVolumeHierarchy::cull(JobSystem& js, Frustum const& frustum,
+        float3 const* centers, float3 const* extents, uint32_t const* rows,
+        Culler::result_type* results, size_t bit) const noexcept {
+    SYSTRACE_CALL();
+
+    if (empty()) {
+        return;
+    }
+
+    float4 const* const planes = frustum.getNormalizedPlanes();
+    const Culler::result_type mask = Culler::result_type(1u << bit);
+
+    // Descend the top of the hierarchy breadth-first until we have enough subtrees to
+    // keep all threads busy, each subtree is then culled by a job.
+    constexpr size_t SUBTREE_COUNT = 32;
+    uint32_t subtrees[SUBTREE_COUNT * 2];
+    size_t head = 0;
+    size_t tail = 0;
+    subtrees[tail++] = 0;
+    while (head != tail && tail - head < SUBTREE_COUNT) {
+        const uint32_t index = subtrees[head++];
+        Node const& node = mNodes[index];
+        switch (intersects(planes, node.center, node.halfExtent)) {
+            case Intersection::OUTSIDE:
+                break;
+            case Intersection::INSIDE:
+                setVisible(index, rows, results, mask);
+                break;
+            case Intersection::INTERSECTS:
+                if (node.count) {
+                    cullRecursive(index, planes, centers, extents, rows, results, mask);
+                } else {
+                    if (tail + 2 > SUBTREE_COUNT * 2) {
+                        // make room at the end of the queue
+                        std::copy(subtrees + head, subtrees + tail, subtrees);
+                        tail -= head;
+                        head = 0;
+                    }
+                    subtrees[tail++] = index + 1;
+                    subtrees[tail++] = node.first;
+                }
+                break;
+        }
+    }
+
+    if (head == tail) {
+        return;
+    }
+
+    uint32_t const* const pending = subtrees + head;
+    auto work = [this, pending, planes, centers, extents, rows, results, mask]
+            (uint32_t start, uint32_t count) {
+        for (uint32_t i = start, e = start + count; i < e; i++) {
+            cullRecursive(pending[i], planes, centers, extents, rows, results, mask);
+        }
+    };
+
+    auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(tail - head),
+            std::cref(work), jobs::CountSplitter<1, 8>());
+    js.setName(job, "BoundingVolumeHierarchy::cull");
+    js.run(job);
+    js.waitAndRelease(job);
+}
+
+void BoundingVolumeHierarchy::cullRecursive(uint32_t index, float4 const* planes,
+        float3 const* centers, float3 const* extents, uint32_t const* rows,
+        Culler::result_type* results, Culler::result_type mask) const noexcept {
+    Node const& node = mNodes[index];
+    switch (intersects(planes, node.center, node.halfExtent)) {
+        case Intersection::OUTSIDE:
+            return;
+        case Intersection::INSIDE:
+            setVisible(index, rows, results, mask);
+            return;
+        case Intersection::INTERSECTS:
+            break;
+    }
+
+    if (node.count) {
+        // partially visible leaf: test each box
+        uint32_t const* const boxes = mBoxes.data();
+        for (uint32_t j = node.first, e = node.first + node.count; j < e; j++) {
+            const uint32_t row = rows[boxes[j]];
+            if (intersects(planes, centers[row], extents[row]) != Intersection::OUTSIDE) {
+                results[row] |= mask;
+            }
+        }
+        return;
+    }
+
+    cullRecursive(index + 1, planes, centers, extents, rows, results, mask);
+    cullRecursive(node.first, planes, centers, extents, rows, results, mask);
+}
+
+void BoundingVolumeHierarchy::setVisible(uint32_t index, uint32_t const* rows,
+        Culler::result_type* results, Culler::result_type mask) const noexcept {
+    // the boxes of a subtree are contiguous, they start at its leftmost leaf and end at its
+    // rightmost leaf
+    uint32_t leftmost = index;
+    while (!mNodes[leftmost].count) {
+        leftmost = leftmost + 1;
+    }
+    uint32_t rightmost = index;
+    while (!mNodes[rightmost].count) {
+        rightmost = mNodes[rightmost].first;
+    }
+    uint32_t const* const boxes = mBoxes.data();
+    for (uint32_t j = mNodes[leftmost].first,
+            e = mNodes[rightmost].first + mNodes[rightmost].count; j < e; j++) {
+        results[rows[boxes[j]]] |= mask;
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -25,6 +25,12 @@ Box rigidTransform(Box const& UTILS_RESTRICT box, const math::mat4f& UTILS_RESTR
     return { u * box.center + m[3].xyz, abs(u) * box.halfExtent };
 }
 
+Box rigidTransform(Box const& UTILS_RESTRICT box, const math::mat4x3f& UTILS_RESTRICT m) noexcept {
+    // the extent is transformed by |u|, column by column
+    const float3 e = box.halfExtent;
+    return { m * box.center, abs(m[0]) * e.x + abs(m[1]) * e.y + abs(m[2]) * e.z };
+}
+
 Box rigidTransform(Box const& UTILS_RESTRICT box, const math::mat3f& UTILS_RESTRICT u) noexcept {
     return { u * box.center, abs(u) * box.halfExtent };
 }
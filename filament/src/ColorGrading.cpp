@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ColorGrading.h"
+
+#include "driver/DriverApi.h"
+
+#include <utils/Systrace.h>
+
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <stdlib.h>
+
+namespace filament {
+namespace details {
+
+using namespace driver;
+using namespace math;
+
+// the rows of the linear Rec.709 to LMS matrix, and of its inverse
+static constexpr float3 LINEAR_TO_LMS[3] = {
+        { 3.90405e-1f, 5.49941e-1f, 8.92632e-3f },
+        { 7.08416e-2f, 9.63172e-1f, 1.35775e-3f },
+        { 2.31082e-2f, 1.28021e-1f, 9.36245e-1f }
+};
+static constexpr float3 LMS_TO_LINEAR[3] = {
+        {  2.85847e+0f, -1.62879e+0f, -2.48910e-2f },
+        { -2.10182e-1f,  1.15820e+0f,  3.24281e-4f },
+        { -4.18120e-2f, -1.18169e-1f,  1.06867e+0f }
+};
+
+static inline float3 transform(float3 const* rows, float3 v) noexcept {
+    return { dot(rows[0], v), dot(rows[1], v), dot(rows[2], v) };
+}
+
+static float3 whiteBalanceScale(float temperature, float tint) noexcept {
+    // The white point the temperature and tint move D65 to, along the CIE standard
+    // illuminant locus, the scale of each LMS component maps that white point to D65.
+    const float t1 = temperature * 10.0f / 6.0f;
+    const float t2 = tint * 10.0f / 6.0f;
+    const float x = 0.31271f - t1 * (t1 < 0.0f ? 0.1f : 0.05f);
+    const float y = 2.87f * x - 3.0f * x * x - 0.27509507f + t2 * 0.05f;
+
+    // xyY (with Y = 1) to LMS
+    const float3 XYZ{ x / y, 1.0f, (1.0f - x - y) / y };
+    const float3 lms{
+            dot(float3{  0.7328f, 0.4296f, -0.1624f }, XYZ),
+            dot(float3{ -0.7036f, 1.6975f,  0.0061f }, XYZ),
+            dot(float3{  0.0030f, 0.0136f,  0.9834f }, XYZ) };
+
+    const float3 D65{ 0.949237f, 1.03542f, 1.08728f };
+    return D65 / lms;
+}
+
+static inline float3 tonemapACES(float3 x) noexcept {
+    // Narkowicz 2015, "ACES Filmic Tone Mapping Curve", see Tonemap_ACES() in tone_mapping.fs
+    constexpr float a = 2.51f;
+    constexpr float b = 0.03f;
+    constexpr float c = 2.43f;
+    constexpr float d = 0.59f;
+    constexpr float e = 0.14f;
+    return (x * (a * x + b)) / (x * (c * x + d) + e);
+}
+
+static inline float OECF_sRGB(float linear) noexcept {
+    // IEC 61966-2-1:1999, see OECF_sRGB() in conversion_functions.fs
+    return linear <= 0.0031308f ?
+            linear * 12.92f : (std::pow(linear, 1.0f / 2.4f) * 1.055f) - 0.055f;
+}
+
+void ColorGrading::terminate(DriverApi& driver) noexcept {
+    if (mLut) {
+        driver.destroyTexture(mLut);
+    }
+}
+
+void ColorGrading::prepare(DriverApi& driver) noexcept {
+    if (!mDirty) {
+        return;
+    }
+    mDirty = false;
+
+    constexpr size_t width = LUT_SIZE * LUT_SIZE;
+    constexpr size_t height = LUT_SIZE;
+    if (!mLut) {
+        mLut = driver.createTexture(SamplerType::SAMPLER_2D, 1, TextureFormat::RGBA16F, 1,
+                width, height, 1, TextureUsage::DEFAULT);
+    }
+
+    const size_t size = width * height * sizeof(half4);
+    half4* const lut = (half4*)malloc(size);
+    generate(lut, mOptions);
+    driver.load2DImage(mLut, 0, 0, 0, width, height,
+            PixelBufferDescriptor(lut, size, PixelDataFormat::RGBA, PixelDataType::HALF,
+                    [](void* buffer, size_t, void*) { free(buffer); }));
+}
+
+void ColorGrading::generate(half4* UTILS_RESTRICT lut,
+        View::ColorGradingOptions const& options) noexcept {
+    SYSTRACE_CALL();
+
+    const float exposure = std::exp2(options.exposure);
+    const float contrast = options.contrast;
+    const float saturation = options.saturation;
+    const float3 whiteBalance = whiteBalanceScale(
+            clamp(options.temperature, -1.0f, 1.0f), clamp(options.tint, -1.0f, 1.0f));
+    constexpr float middleGray = 0.18f;
+
+    // the linear HDR value of each of the LUT's entries along an axis
+    float values[LUT_SIZE];
+    for (size_t i = 0; i < LUT_SIZE; i++) {
+        const float t = float(i) / (LUT_SIZE - 1);
+        values[i] = std::exp2(LUT_LOG2_MIN + t * (LUT_LOG2_MAX - LUT_LOG2_MIN));
+    }
+
+    for (size_t g = 0; g < LUT_SIZE; g++) {
+        for (size_t b = 0; b < LUT_SIZE; b++) {
+            for (size_t r = 0; r < LUT_SIZE; r++) {
+                float3 c{ values[r], values[g], values[b] };
+
+                c *= exposure;
+
+                c = transform(LINEAR_TO_LMS, c);
+                c *= whiteBalance;
+                c = transform(LMS_TO_LINEAR, c);
+                c = max(c, float3{ 0.0f });
+
+                c = middleGray * pow(c / middleGray, contrast);
+
+                const float luminance = dot(c, float3{ 0.2126f, 0.7152f, 0.0722f });
+                c = max(luminance + (c - luminance) * saturation, float3{ 0.0f });
+
+                c = saturate(tonemapACES(c));
+                c = float3{ OECF_sRGB(c.r), OECF_sRGB(c.g), OECF_sRGB(c.b) };
+
+                // row g, r-th texel of the b-th slice
+                *lut++ = half4{ c, 1.0f };
+            }
+        }
+    }
+}
+
+} // namespace details
+} // namespace filament
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CpuStageTimings.h"
+
+#include <utils/ThreadLocal.h>
+
+namespace filament {
+
+using namespace utils;
+
+constexpr size_t CpuStageTimings::STAGE_COUNT;
+constexpr size_t CpuStageTimings::COUNTER_COUNT;
+
+std::atomic<uint64_t> CpuStageTimings::sStages[CpuStageTimings::STAGE_COUNT] = {};
+std::atomic<uint64_t> CpuStageTimings::sCounters[STAGE_COUNT][COUNTER_COUNT] = {};
+std::atomic<bool> CpuStageTimings::sCountersEnabled = { false };
+
+UTILS_NOINLINE
+bool CpuStageTimings::readCounters(Profiler::Counters* counters) noexcept {
+    Profiler& profiler = Profiler::getForCurrentThread();
+    if (UTILS_UNLIKELY(!profiler.isValid())) {
+        return false;
+    }
+    // the counters of a thread are never stopped once they're started
+    static UTILS_DECLARE_TLS(bool) sStarted(false);
+    bool& started = sStarted;
+    if (UTILS_UNLIKELY(!started)) {
+        profiler.start();
+        started = true;
+    }
+    profiler.readCounters(counters);
+    return true;
+}
+
+UTILS_NOINLINE
+void CpuStageTimings::addCounters(Stage stage, Profiler::Counters const& start) noexcept {
+    Profiler::Counters end;
+    Profiler::getForCurrentThread().readCounters(&end);
+    const Profiler::Counters c = end - start;
+    std::atomic<uint64_t>* const counters = sCounters[stage];
+    counters[INSTRUCTIONS].fetch_add(c.getInstructions(), std::memory_order_relaxed);
+    counters[CYCLES].fetch_add(c.getCpuCycles(), std::memory_order_relaxed);
+    counters[CACHE_REFERENCES].fetch_add(c.getL1DReferences(), std::memory_order_relaxed);
+    counters[CACHE_MISSES].fetch_add(c.getL1DMisses(), std::memory_order_relaxed);
+    counters[BRANCHES].fetch_add(c.getBranchInstructions(), std::memory_order_relaxed);
+    counters[BRANCH_MISSES].fetch_add(c.getBranchMisses(), std::memory_order_relaxed);
+}
+
+void CpuStageTimings::endFrame(uint64_t ns[STAGE_COUNT], Counters counters[STAGE_COUNT]) noexcept {
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        ns[i] = sStages[i].exchange(0, std::memory_order_relaxed);
+        std::atomic<uint64_t>* const c = sCounters[i];
+        counters[i].instructions = c[INSTRUCTIONS].exchange(0, std::memory_order_relaxed);
+        counters[i].cycles = c[CYCLES].exchange(0, std::memory_order_relaxed);
+        counters[i].cacheReferences = c[CACHE_REFERENCES].exchange(0, std::memory_order_relaxed);
+        counters[i].cacheMisses = c[CACHE_MISSES].exchange(0, std::memory_order_relaxed);
+        counters[i].branches = c[BRANCHES].exchange(0, std::memory_order_relaxed);
+        counters[i].branchMisses = c[BRANCH_MISSES].exchange(0, std::memory_order_relaxed);
+    }
+}
+
+} // namespace filament
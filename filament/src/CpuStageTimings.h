@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_CPUSTAGETIMINGS_H
+#define TNT_FILAMENT_CPUSTAGETIMINGS_H
+
+#include <utils/compiler.h>
+#include <utils/Profiler.h>
+
+#include <atomic>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Wall-clock time spent in the CPU stages of a frame, summed over all the views and passes of
+ * the frame. The stages are timed where they wait for their jobs, e.g. culling includes the
+ * parallel jobs it runs.
+ *
+ * The timings are process-wide because some stages (e.g. RenderPass::generateAndSortCommands)
+ * don't know their engine, they are only meaningful with a single engine rendering.
+ *
+ * Optionally (see setCountersEnabled()), the stages also count the events of the CPU's
+ * performance counters of the thread they run on, which includes the parallel jobs that thread
+ * runs while it waits, but not the jobs run by the other threads.
+ */
+class CpuStageTimings {
+public:
+    enum Stage : uint8_t {
+        SCENE_PREPARE,
+        CULLING,
+        PARTITION,
+        COMMAND_GENERATION,
+        COMMAND_SORT,
+        DRIVER_COMMANDS,
+        FROXELIZATION,
+    };
+
+    static constexpr size_t STAGE_COUNT = FROXELIZATION + 1;
+
+    using clock = std::chrono::steady_clock;
+
+    // the events counted in a stage, all zero when the counters are disabled or unsupported
+    struct Counters {
+        uint64_t instructions = 0;
+        uint64_t cycles = 0;
+        uint64_t cacheReferences = 0;
+        uint64_t cacheMisses = 0;
+        uint64_t branches = 0;
+        uint64_t branchMisses = 0;
+    };
+
+    // adds the time between its construction and its destruction to a stage
+    class Scope {
+    public:
+        explicit Scope(Stage stage) noexcept
+                : mStage(stage),
+                  mCounting(sCountersEnabled.load(std::memory_order_relaxed)) {
+            if (UTILS_UNLIKELY(mCounting)) {
+                mCounting = readCounters(&mCounters);
+            }
+            mStart = clock::now();
+        }
+        ~Scope() noexcept {
+            const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - mStart).count();
+            sStages[mStage].fetch_add(uint64_t(ns), std::memory_order_relaxed);
+            if (UTILS_UNLIKELY(mCounting)) {
+                addCounters(mStage, mCounters);
+            }
+        }
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+    private:
+        Stage mStage;
+        bool mCounting;
+        clock::time_point mStart;
+        utils::Profiler::Counters mCounters;
+    };
+
+    // Counting the events costs two system calls per stage, and only works where perf counters
+    // are available, i.e. on Linux and Android.
+    static void setCountersEnabled(bool enabled) noexcept {
+        sCountersEnabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    static bool isCountersEnabled() noexcept {
+        return sCountersEnabled.load(std::memory_order_relaxed);
+    }
+
+    // Moves the times (in nanoseconds) and the counters accumulated since the last call into
+    // ns and counters, and resets them.
+    static void endFrame(uint64_t ns[STAGE_COUNT], Counters counters[STAGE_COUNT]) noexcept;
+
+private:
+    enum Counter : uint8_t {
+        INSTRUCTIONS,
+        CYCLES,
+        CACHE_REFERENCES,
+        CACHE_MISSES,
+        BRANCHES,
+        BRANCH_MISSES,
+    };
+
+    static constexpr size_t COUNTER_COUNT = BRANCH_MISSES + 1;
+
+    // returns false if the calling thread has no counters
+    static bool readCounters(utils::Profiler::Counters* counters) noexcept;
+    static void addCounters(Stage stage, utils::Profiler::Counters const& start) noexcept;
+
+    static std::atomic<uint64_t> sStages[STAGE_COUNT];
+    static std::atomic<uint64_t> sCounters[STAGE_COUNT][COUNTER_COUNT];
+    static std::atomic<bool> sCountersEnabled;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_CPUSTAGETIMINGS_H
@@ -18,11 +18,31 @@
 
 #include <math/fast.h>
 
+#include <cmath>
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#   include <emmintrin.h>
+#   if defined(__GNUC__)
+#       include <immintrin.h>
+        // the AVX kernel is compiled for AVX, and only used if the CPU supports it
+#       define CULLER_HAS_AVX_KERNEL 1
+#   endif
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
 using namespace math;
 
 namespace filament {
 namespace details {
 
+// the SIMD kernels load the boxes' centers and extents as a packed array of floats
+static_assert(sizeof(float3) == 3 * sizeof(float), "float3 must be packed");
+
 void Culler::intersects(
         result_type* UTILS_RESTRICT results,
         Frustum const& UTILS_RESTRICT frustum,
@@ -54,19 +74,33 @@ void Culler::intersects(
     }
 }
 
-void Culler::intersects(
-        result_type* UTILS_RESTRICT results,
+// ------------------------------------------------------------------------------------------------
+// Box culling kernels
+//
+// They all compute the plane distances with the same operations, in the same order, as the
+// scalar kernel, and test their sign bit, so they return the same results (they don't use FMA,
+// which the compiler might use for the scalar kernel on some architectures).
+// ------------------------------------------------------------------------------------------------
+
+using BoxKernel = void(*)(Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit);
+
+static void intersectsScalar(
+        Culler::result_type* UTILS_RESTRICT results,
         Frustum const& UTILS_RESTRICT frustum,
         math::float3 const* UTILS_RESTRICT center,
         math::float3 const* UTILS_RESTRICT extent,
         size_t count, size_t bit) noexcept {
+    using result_type = Culler::result_type;
 
-    math::float4 const * UTILS_RESTRICT const planes = frustum.mPlanes;
+    math::float4 const * UTILS_RESTRICT const planes = frustum.getNormalizedPlanes();
 
     // we use a vectorize width of 8 because, on ARMv8 it allows the compiler to write eight
     // 8-bits results in one go. Without this it has to do 4 separate byte writes, which
     // ends-up being slower.
-    count = round(count); // capacity guaranteed to be multiple of 8
+    count = Culler::round(count); // capacity guaranteed to be multiple of 8
     #pragma clang loop vectorize_width(8)
     for (size_t i = 0; i < count; i++) {
         int visible = ~0;
@@ -88,6 +122,234 @@ void Culler::intersects(
     }
 }
 
+#if defined(__SSE2__)
+
+// a byte set to 1 for each of the 4 bits of the index
+static constexpr uint32_t sExpandBits4[16] = {
+        0x00000000, 0x00000001, 0x00000100, 0x00000101,
+        0x00010000, 0x00010001, 0x00010100, 0x00010101,
+        0x01000000, 0x01000001, 0x01000100, 0x01000101,
+        0x01010000, 0x01010001, 0x01010100, 0x01010101,
+};
+
+#define SHUFFLE(i0, i1, i2, i3) _MM_SHUFFLE(i3, i2, i1, i0)
+
+// transposes 4 packed float3 (12 floats) into their x, y and z components
+static inline void loadFloat3x4(float const* p, __m128& x, __m128& y, __m128& z) noexcept {
+    const __m128 a = _mm_loadu_ps(p + 0);   // x0 y0 z0 x1
+    const __m128 b = _mm_loadu_ps(p + 4);   // y1 z1 x2 y2
+    const __m128 c = _mm_loadu_ps(p + 8);   // z2 x3 y3 z3
+    x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, SHUFFLE(2, 2, 1, 1)), SHUFFLE(0, 3, 0, 2));
+    y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, SHUFFLE(1, 1, 0, 0)),
+                       _mm_shuffle_ps(b, c, SHUFFLE(3, 3, 2, 2)), SHUFFLE(0, 2, 0, 2));
+    z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, SHUFFLE(2, 2, 1, 1)),
+                       _mm_shuffle_ps(c, c, SHUFFLE(0, 0, 3, 3)), SHUFFLE(0, 2, 0, 2));
+}
+
+static void intersectsSSE2(
+        Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    float4 const* const planes = frustum.getNormalizedPlanes();
+    __m128 px[6], py[6], pz[6], ax[6], ay[6], az[6], pw[6];
+    for (size_t j = 0; j < 6; j++) {
+        px[j] = _mm_set1_ps(planes[j].x);
+        py[j] = _mm_set1_ps(planes[j].y);
+        pz[j] = _mm_set1_ps(planes[j].z);
+        pw[j] = _mm_set1_ps(planes[j].w);
+        ax[j] = _mm_set1_ps(std::abs(planes[j].x));
+        ay[j] = _mm_set1_ps(std::abs(planes[j].y));
+        az[j] = _mm_set1_ps(std::abs(planes[j].z));
+    }
+
+    count = Culler::round(count);
+    for (size_t i = 0; i < count; i += 4) {
+        __m128 cx, cy, cz, ex, ey, ez;
+        loadFloat3x4(&center[i].x, cx, cy, cz);
+        loadFloat3x4(&extent[i].x, ex, ey, ez);
+        __m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m128 dot = _mm_mul_ps(px[j], cx);
+            dot = _mm_sub_ps(dot, _mm_mul_ps(ax[j], ex));
+            dot = _mm_add_ps(dot, _mm_mul_ps(py[j], cy));
+            dot = _mm_sub_ps(dot, _mm_mul_ps(ay[j], ey));
+            dot = _mm_add_ps(dot, _mm_mul_ps(pz[j], cz));
+            dot = _mm_sub_ps(dot, _mm_mul_ps(az[j], ez));
+            dot = _mm_add_ps(dot, pw[j]);
+            visible = _mm_and_ps(visible, dot);
+        }
+        // the sign bits of the 4 boxes, expanded to 4 bytes
+        uint32_t r;
+        memcpy(&r, results + i, sizeof(r));
+        r |= sExpandBits4[_mm_movemask_ps(visible)] << bit;
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+#endif // __SSE2__
+
+#if defined(CULLER_HAS_AVX_KERNEL)
+
+// the 8 boxes are transposed as two halves of 4, which is cheaper than AVX lane crossing
+__attribute__((target("avx")))
+static inline void loadFloat3x8(float const* p, __m256& x, __m256& y, __m256& z) noexcept {
+    __m128 x0, y0, z0, x1, y1, z1;
+    loadFloat3x4(p, x0, y0, z0);
+    loadFloat3x4(p + 12, x1, y1, z1);
+    x = _mm256_insertf128_ps(_mm256_castps128_ps256(x0), x1, 1);
+    y = _mm256_insertf128_ps(_mm256_castps128_ps256(y0), y1, 1);
+    z = _mm256_insertf128_ps(_mm256_castps128_ps256(z0), z1, 1);
+}
+
+__attribute__((target("avx")))
+static void intersectsAVX(
+        Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    float4 const* const planes = frustum.getNormalizedPlanes();
+
+    count = Culler::round(count);
+    for (size_t i = 0; i < count; i += 8) {
+        __m256 cx, cy, cz, ex, ey, ez;
+        loadFloat3x8(&center[i].x, cx, cy, cz);
+        loadFloat3x8(&extent[i].x, ex, ey, ez);
+        __m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (size_t j = 0; j < 6; j++) {
+            __m256 dot = _mm256_mul_ps(_mm256_set1_ps(planes[j].x), cx);
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].x)), ex));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(planes[j].y), cy));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].y)), ey));
+            dot = _mm256_add_ps(dot, _mm256_mul_ps(_mm256_set1_ps(planes[j].z), cz));
+            dot = _mm256_sub_ps(dot, _mm256_mul_ps(_mm256_set1_ps(std::abs(planes[j].z)), ez));
+            dot = _mm256_add_ps(dot, _mm256_set1_ps(planes[j].w));
+            visible = _mm256_and_ps(visible, dot);
+        }
+        // the sign bits of the 8 boxes, expanded to 8 bytes
+        const uint32_t mask = uint32_t(_mm256_movemask_ps(visible));
+        uint64_t r;
+        memcpy(&r, results + i, sizeof(r));
+        r |= (uint64_t(sExpandBits4[mask & 0xF]) |
+              uint64_t(sExpandBits4[mask >> 4u]) << 32u) << bit;
+        memcpy(results + i, &r, sizeof(r));
+    }
+}
+
+#endif // CULLER_HAS_AVX_KERNEL
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+
+static void intersectsNEON(
+        Culler::result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        float3 const* UTILS_RESTRICT center, float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    float4 const* const planes = frustum.getNormalizedPlanes();
+
+    // the sign bits of 4 boxes, as 0 or 1 in each lane
+    auto visible4 = [planes](float const* c, float const* e) -> uint32x4_t {
+        // vld3q deinterleaves the x, y and z of 4 packed float3
+        const float32x4x3_t cv = vld3q_f32(c);
+        const float32x4x3_t ev = vld3q_f32(e);
+        uint32x4_t visible = vdupq_n_u32(~0u);
+        for (size_t j = 0; j < 6; j++) {
+            float32x4_t dot = vmulq_n_f32(cv.val[0], planes[j].x);
+            dot = vsubq_f32(dot, vmulq_n_f32(ev.val[0], std::abs(planes[j].x)));
+            dot = vaddq_f32(dot, vmulq_n_f32(cv.val[1], planes[j].y));
+            dot = vsubq_f32(dot, vmulq_n_f32(ev.val[1], std::abs(planes[j].y)));
+            dot = vaddq_f32(dot, vmulq_n_f32(cv.val[2], planes[j].z));
+            dot = vsubq_f32(dot, vmulq_n_f32(ev.val[2], std::abs(planes[j].z)));
+            dot = vaddq_f32(dot, vdupq_n_f32(planes[j].w));
+            visible = vandq_u32(visible, vreinterpretq_u32_f32(dot));
+        }
+        return vshrq_n_u32(visible, 31);
+    };
+
+    const int8x8_t shift = vdup_n_s8(int8_t(bit));
+    count = Culler::round(count);
+    for (size_t i = 0; i < count; i += 8) {
+        const uint32x4_t lo = visible4(&center[i].x, &extent[i].x);
+        const uint32x4_t hi = visible4(&center[i + 4].x, &extent[i + 4].x);
+        const uint8x8_t r = vmovn_u16(vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+        vst1_u8(results + i, vorr_u8(vld1_u8(results + i), vshl_u8(r, shift)));
+    }
+}
+
+#endif
+
+static BoxKernel getBoxKernel(Culler::Test::Kernel kernel) noexcept {
+    using Kernel = Culler::Test::Kernel;
+    switch (kernel) {
+#if defined(__SSE2__)
+        case Kernel::SSE2:
+            return intersectsSSE2;
+#endif
+#if defined(CULLER_HAS_AVX_KERNEL)
+        case Kernel::AVX:
+            return intersectsAVX;
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+        case Kernel::NEON:
+            return intersectsNEON;
+#endif
+        default:
+            return intersectsScalar;
+    }
+}
+
+static Culler::Test::Kernel selectBoxKernel() noexcept {
+    using Kernel = Culler::Test::Kernel;
+#if defined(CULLER_HAS_AVX_KERNEL)
+    if (__builtin_cpu_supports("avx")) {
+        return Kernel::AVX;
+    }
+#endif
+#if defined(__SSE2__)
+    return Kernel::SSE2;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    return Kernel::NEON;
+#else
+    return Kernel::SCALAR;
+#endif
+}
+
+void Culler::intersects(
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+    // picked once, thread-safely
+    static const BoxKernel kernel = getBoxKernel(selectBoxKernel());
+    kernel(results, frustum, center, extent, count, bit);
+}
+
+void Culler::largerThan(
+        result_type* UTILS_RESTRICT results,
+        math::float4 const& w, float scale, float minSize,
+        math::float3 const* UTILS_RESTRICT center,
+        math::float3 const* UTILS_RESTRICT extent,
+        size_t count, size_t bit) noexcept {
+
+    // compare diameters rather than radii
+    const float diameterScale = 2.0f * scale;
+
+    count = round(count); // capacity guaranteed to be multiple of 8
+    #pragma clang loop vectorize_width(8)
+    for (size_t i = 0; i < count; i++) {
+        const float radius = std::sqrt(
+                extent[i].x * extent[i].x + extent[i].y * extent[i].y + extent[i].z * extent[i].z);
+        const float cw = w.x * center[i].x + w.y * center[i].y + w.z * center[i].z + w.w;
+
+        // the second test keeps the boxes around, or behind the camera
+        int visible = fast::signbit(minSize * cw - diameterScale * radius) |
+                      fast::signbit(cw - radius);
+
+        results[i] |= result_type(visible << bit);
+    }
+}
+
 /*
  * returns whether a box intersects with the frustum
  */
@@ -135,5 +397,45 @@ void Culler::Test::intersects(
     Culler::intersects(results, frustum, b, count);
 }
 
+bool Culler::Test::isSupported(Kernel kernel) noexcept {
+    switch (kernel) {
+        case Kernel::SCALAR:
+            return true;
+        case Kernel::SSE2:
+#if defined(__SSE2__)
+            return true;
+#else
+            return false;
+#endif
+        case Kernel::AVX:
+#if defined(CULLER_HAS_AVX_KERNEL)
+            return __builtin_cpu_supports("avx");
+#else
+            return false;
+#endif
+        case Kernel::NEON:
+#if defined(__ARM_NEON) && defined(__aarch64__)
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+Culler::Test::Kernel Culler::Test::getKernel() noexcept {
+    return selectBoxKernel();
+}
+
+void Culler::Test::intersects(Kernel kernel,
+        result_type* UTILS_RESTRICT results,
+        Frustum const& UTILS_RESTRICT frustum,
+        math::float3 const* UTILS_RESTRICT c,
+        math::float3 const* UTILS_RESTRICT e,
+        size_t count, size_t bit) noexcept {
+    assert(isSupported(kernel));
+    getBoxKernel(kernel)(results, frustum, c, e, count, bit);
+}
+
 } // namespace details
 } // namespace filament
@@ -29,22 +29,25 @@ namespace filament {
 namespace details {
 
 FDebugRegistry::FDebugRegistry() noexcept {
-    mProperties.reserve(8);
+    mProperties.reserve(32);
+    mAddresses.reserve(32);
 }
 
 UTILS_NOINLINE
 void *FDebugRegistry::getPropertyAddress(const char *name) noexcept {
     StaticString key(name, strlen(name));
-    auto &propertyMap = mPropertyMap;
-    if (propertyMap.find(key) == propertyMap.end()) {
+    auto const pos = mPropertyMap.find(key);
+    if (pos == mPropertyMap.end()) {
         return nullptr;
     }
-    return propertyMap[key];
+    return mAddresses[pos->second];
 }
 
-void FDebugRegistry::registerProperty(utils::StaticString name, void *p, Type type) noexcept {
-    mProperties.push_back({name.c_str(), type});
-    mPropertyMap[name] = p;
+void FDebugRegistry::registerProperty(utils::StaticString name, void *p, Type type,
+        Kind kind) noexcept {
+    mPropertyMap[name] = mProperties.size();
+    mProperties.push_back({ name.c_str(), type, kind });
+    mAddresses.push_back(p);
 }
 
 inline std::pair<DebugRegistry::Property const *, size_t> FDebugRegistry::getProperties() const noexcept {
@@ -55,12 +58,37 @@ inline bool FDebugRegistry::hasProperty(const char *name) const noexcept {
     return const_cast<FDebugRegistry *>(this)->getPropertyAddress(name) != nullptr;
 }
 
+size_t FDebugRegistry::getCounters(CounterValue* values, size_t count) const noexcept {
+    size_t n = 0;
+    for (size_t i = 0, c = mProperties.size(); i < c; i++) {
+        Property const& property = mProperties[i];
+        if (property.kind != COUNTER) {
+            continue;
+        }
+        if (n < count) {
+            void const* const p = mAddresses[i];
+            float4 value = 0;
+            switch (property.type) {
+                case BOOL:   value.x = *static_cast<bool const*>(p) ? 1.0f : 0.0f; break;
+                case INT:    value.x = float(*static_cast<int const*>(p)); break;
+                case FLOAT:  value.x = *static_cast<float const*>(p); break;
+                case FLOAT2: value.xy = *static_cast<float2 const*>(p); break;
+                case FLOAT3: value.xyz = *static_cast<float3 const*>(p); break;
+                case FLOAT4: value = *static_cast<float4 const*>(p); break;
+            }
+            values[n] = { property.name, property.type, value };
+        }
+        n++;
+    }
+    return n;
+}
+
 template<typename T>
 inline bool FDebugRegistry::setProperty(const char *name, T v) noexcept {
     if (DEBUG_PROPERTIES_WRITABLE) {
-        T * const addr = static_cast<T *>(getPropertyAddress(name));
-        if (addr) {
-            *addr = v;
+        auto const pos = mPropertyMap.find(StaticString(name, strlen(name)));
+        if (pos != mPropertyMap.end() && mProperties[pos->second].kind == TUNABLE) {
+            *static_cast<T *>(mAddresses[pos->second]) = v;
             return true;
         }
     }
@@ -89,6 +117,10 @@ std::pair<DebugRegistry::Property const*, size_t> DebugRegistry::getProperties()
     return upcast(this)->getProperties();
 }
 
+size_t DebugRegistry::getCounters(CounterValue* values, size_t count) const noexcept {
+    return upcast(this)->getCounters(values, count);
+}
+
 bool DebugRegistry::hasProperty(const char* name) const noexcept {
     return upcast(this)->hasProperty(name);
 }
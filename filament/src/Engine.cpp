@@ -43,6 +43,7 @@
 #include <filaflat/MaterialParser.h>
 #include <filaflat/ShaderBuilder.h>
 
+#include <utils/algorithm.h>
 #include <utils/compiler.h>
 #include <utils/CString.h>
 #include <utils/Log.h>
@@ -52,9 +53,13 @@
 #include <math/fast.h>
 #include <math/scalar.h>
 
+#include <algorithm>
+#include <chrono>
 #include <functional>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 
 using namespace math;
@@ -67,12 +72,22 @@ using namespace filaflat;
 
 namespace details {
 
+static_assert(Engine::Config{}.commandBufferSize == CONFIG_COMMAND_BUFFERS_SIZE &&
+              Engine::Config{}.minCommandBufferSize == CONFIG_MIN_COMMAND_BUFFERS_SIZE,
+        "Engine::Config's defaults don't match the command buffer's configuration");
+static_assert(Engine::Config{}.perRenderPassArenaSize == CONFIG_PER_RENDER_PASS_ARENA_SIZE &&
+              Engine::Config{}.colorPassArenaSize == CONFIG_COLOR_PASS_ARENA_SIZE &&
+              Engine::Config{}.perFrameCommandsSize == CONFIG_PER_FRAME_COMMANDS_SIZE &&
+              Engine::Config{}.perThreadScratchSize == CONFIG_PER_THREAD_SCRATCH_SIZE,
+        "Engine::Config's defaults don't match the per-frame allocators' configuration");
+
 // The global list of engines
 static std::unordered_map<Engine const*, std::unique_ptr<FEngine>> sEngines;
 static std::mutex sEnginesLock;
 
-FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext) {
-    FEngine* instance = new FEngine(backend, externalContext, sharedGLContext);
+FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        Config const& config) {
+    FEngine* instance = new FEngine(backend, externalContext, sharedGLContext, config);
 
     slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << instance << io::endl;
 
@@ -82,6 +97,29 @@ FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void
     // start the driver thread
     instance->mDriverThread = std::thread(&FEngine::loop, instance);
 
+    return getEngine(instance);
+}
+
+void FEngine::createAsync(CreateCallback callback, void* user,
+        Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        Config const& config) {
+    FEngine* instance = new FEngine(backend, externalContext, sharedGLContext, config);
+
+    slog.i << "FEngine (" << sizeof(void*) * 8 << " bits) created at " << instance << io::endl;
+
+    // start the driver thread, the application can do its own initialization in the meantime
+    instance->mDriverThread = std::thread(&FEngine::loop, instance);
+
+    // the callback is called from a thread of its own, so that it can't delay the driver
+    std::thread([instance, callback, user]() {
+        instance->mDriverBarrier.await();
+        callback(instance, user);
+    }).detach();
+}
+
+FEngine* FEngine::getEngine(void* token) {
+    FEngine* instance = static_cast<FEngine*>(token);
+
     // wait for the driver to be ready
     instance->mDriverBarrier.await();
 
@@ -97,6 +135,22 @@ FEngine* FEngine::create(Backend backend, ExternalContext* externalContext, void
     return instance;
 }
 
+thread_local FEngine::DriverApi* FEngine::sWorkerDriverApi = nullptr;
+
+FEngine::WorkerScope::WorkerScope(FEngine& engine) noexcept : mEngine(engine) {
+    if (UTILS_UNLIKELY(!sWorkerDriverApi && std::this_thread::get_id() != engine.mThreadId)) {
+        mWorker = engine.mWorkerCommands.begin(engine.mCommandStream);
+        sWorkerDriverApi = &mWorker->stream;
+    }
+}
+
+FEngine::WorkerScope::~WorkerScope() noexcept {
+    if (UTILS_UNLIKELY(mWorker)) {
+        sWorkerDriverApi = nullptr;
+        mEngine.mWorkerCommands.end(mWorker);
+    }
+}
+
 UniformInterfaceBlock FEngine::PerViewUib::getUib() noexcept {
     return UibGenerator::getPerViewUib();
 }
@@ -105,6 +159,10 @@ UniformInterfaceBlock FEngine::PerRenderableUib::getUib() noexcept {
     return UibGenerator::getPerRenderableUib();
 }
 
+UniformInterfaceBlock FEngine::PerRenderableInstancesUib::getUib() noexcept {
+    return UibGenerator::getPerRenderableInstancesUib();
+}
+
 UniformInterfaceBlock FEngine::PostProcessingUib::getUib() noexcept {
     return UibGenerator::getPostProcessingUib();
 }
@@ -127,7 +185,25 @@ static const half4 sFullScreenTriangleVertices[3] = {
 // these must be static because only a pointer is copied to the render stream
 static const uint16_t sFullScreenTriangleIndices[3] = { 0, 1, 2 };
 
-FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext) :
+static JobSystem* createJobSystem(Engine::Config const& config) noexcept {
+    size_t threadCount = config.jobSystemThreadCount;
+    uint32_t affinity = config.jobSystemThreadAffinity;
+    const uint32_t bigCores = config.preferBigCores ? JobSystem::getBigCoresMask() : 0;
+    if (bigCores) {
+        affinity = affinity ? affinity : bigCores;
+        // this thread runs jobs too
+        threadCount = threadCount ? threadCount :
+                std::max(size_t(1), size_t(popcount(affinity)) - 1);
+    }
+    JobSystem* js = new JobSystem(threadCount, 1, config.perThreadScratchSize, affinity);
+    if (bigCores) {
+        js->setLowPriorityThreadAffinity(~bigCores);
+    }
+    return js;
+}
+
+FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        Config const& config) :
         mBackend(backend),
         mExternalContext(externalContext),
         mSharedGLContext(sharedGLContext),
@@ -141,8 +217,14 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
         mPerViewSib(PerViewSib::getSib()),
         mPostProcessUib(PostProcessingUib::getUib()),
         mPostProcessSib(PostProcessSib::getSib()),
-        mCommandBufferQueue(CONFIG_MIN_COMMAND_BUFFERS_SIZE, CONFIG_COMMAND_BUFFERS_SIZE),
-        mPerRenderPassAllocator("per-renderpass allocator", CONFIG_PER_RENDER_PASS_ARENA_SIZE),
+        mCommandBufferQueue(config.minCommandBufferSize,
+                std::max(config.commandBufferSize, 2 * config.minCommandBufferSize),
+                config.maxCommandBufferSize),
+        mPerRenderPassAllocator("per-renderpass allocator", config.perRenderPassArenaSize),
+        mConfig(config),
+        mStagingPool(config.stagingPoolSize),
+        mOwnJobSystem(config.jobSystem ? nullptr : createJobSystem(config)),
+        mJobSystem(config.jobSystem ? *config.jobSystem : *mOwnJobSystem),
         mEpoch(std::chrono::steady_clock::now()),
         mDriverBarrier(1)
 {
@@ -150,7 +232,11 @@ FEngine::FEngine(Backend backend, ExternalContext* externalContext, void* shared
 
     // we're assuming we're on the main thread here.
     // (it may not be the case)
-    mJobSystem.adopt();
+    // A shared JobSystem may already have adopted this thread for another engine.
+    if (JobSystem::getJobSystem() != &mJobSystem) {
+        mJobSystem.adopt();
+        mAdoptedThread = true;
+    }
 }
 
 /*
@@ -163,13 +249,60 @@ void FEngine::init() {
     mCommandStream = CommandStream(*mDriver, mCommandBufferQueue.getCircularBuffer());
     DriverApi& driverApi = getDriverApi();
 
-    // Parse all post process shaders now, but create them lazily
+    mDebugRegistry.registerCounter("d.renderpass.redundant_commands",
+            &debug.renderpass.redundant_commands);
+    mDebugRegistry.registerCounter("d.renderpass.draw_commands",
+            &debug.renderpass.draw_commands);
+    mDebugRegistry.registerCounter("d.renderpass.state_changes",
+            &debug.renderpass.state_changes);
+    mDebugRegistry.registerCounter("d.renderpass.material_instance_changes",
+            &debug.renderpass.material_instance_changes);
+    mDebugRegistry.registerCounter("d.renderpass.program_changes",
+            &debug.renderpass.program_changes);
+    mDebugRegistry.registerCounter("d.renderer.counters.scene_prepare",
+            &debug.renderer.counters[CpuStageTimings::SCENE_PREPARE]);
+    mDebugRegistry.registerCounter("d.renderer.counters.culling",
+            &debug.renderer.counters[CpuStageTimings::CULLING]);
+    mDebugRegistry.registerCounter("d.renderer.counters.partition",
+            &debug.renderer.counters[CpuStageTimings::PARTITION]);
+    mDebugRegistry.registerCounter("d.renderer.counters.command_generation",
+            &debug.renderer.counters[CpuStageTimings::COMMAND_GENERATION]);
+    mDebugRegistry.registerCounter("d.renderer.counters.command_sort",
+            &debug.renderer.counters[CpuStageTimings::COMMAND_SORT]);
+    mDebugRegistry.registerCounter("d.renderer.counters.driver_commands",
+            &debug.renderer.counters[CpuStageTimings::DRIVER_COMMANDS]);
+    mDebugRegistry.registerCounter("d.renderer.counters.froxelization",
+            &debug.renderer.counters[CpuStageTimings::FROXELIZATION]);
+
+    mDebugRegistry.registerCounter("d.stats.visible_renderables",
+            &debug.stats.visible_renderables);
+    mDebugRegistry.registerCounter("d.stats.culled_renderables",
+            &debug.stats.culled_renderables);
+    mDebugRegistry.registerCounter("d.stats.froxels", &debug.stats.froxels);
+    mDebugRegistry.registerCounter("d.stats.occupied_froxels", &debug.stats.occupied_froxels);
+    mDebugRegistry.registerCounter("d.stats.froxel_records", &debug.stats.froxel_records);
+    mDebugRegistry.registerCounter("d.stats.uniform_bytes", &debug.stats.uniform_bytes);
+    mDebugRegistry.registerCounter("d.stats.program_cache_misses",
+            &debug.stats.program_cache_misses);
+#ifdef FILAMENT_STATS_SERVER
+    if (mConfig.statsPort) {
+        mStatsServer.reset(new StatsServer(mConfig.statsPort));
+    }
+#endif
+
+    // Parse all post process shaders in a job, while the rest of the engine is initialized, but
+    // create them lazily. The package is static, it doesn't need to be copied.
     mPostProcessParser = std::make_unique<filaflat::MaterialParser>(mBackend,
-            POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE);
+            POST_PROCESS_PACKAGE, POST_PROCESS_PACKAGE_SIZE,
+            [](void*, size_t, void*) {}, nullptr);
 
-    UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
-            mPostProcessParser->parse() && mPostProcessParser->isPostProcessMaterial();
-    assert(ppMaterialOk);
+    mPostProcessParserJob = jobs::createJob(mJobSystem, nullptr,
+            [](filaflat::MaterialParser* parser) {
+                UTILS_UNUSED_IN_RELEASE bool ppMaterialOk =
+                        parser->parse() && parser->isPostProcessMaterial();
+                assert(ppMaterialOk);
+            }, mPostProcessParser.get());
+    mJobSystem.run(mPostProcessParserJob);
 
     mFullScreenTriangleVb = upcast(VertexBuffer::Builder()
             .vertexCount(3)
@@ -218,12 +351,14 @@ void FEngine::init() {
     mPostProcessManager.init(*this);
     mRenderTargetPool.init(*this);
     mLightManager.init(*this);
+    mTransformManager.init(mJobSystem);
     mDFG.reset(new DFG(*this));
 
     // Always initialize the default material, most materials' depth shaders fallback on it.
     mDefaultMaterial = upcast(
             FMaterial::DefaultMaterialBuilder()
-                    .package(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE)
+                    .package(DEFAULT_MATERIAL_PACKAGE, DEFAULT_MATERIAL_PACKAGE_SIZE,
+                            [](void*, size_t, void*) {})
                     .build(*const_cast<FEngine*>(this)));
 }
 
@@ -235,13 +370,21 @@ void FEngine::shutdown() {
 #ifndef NDEBUG
     // print out some statistics about this run
     size_t wm = mCommandBufferQueue.getHigWatermark();
-    size_t wmpct = wm / (CONFIG_COMMAND_BUFFERS_SIZE / 100);
+    size_t wmpct = wm / (mCommandBufferQueue.getStats().capacity / 100);
     slog.d << "CircularBuffer: High watermark "
             << wm / 1024 << " KiB (" << wmpct << "%)" << io::endl;
 #endif
 
     DriverApi& driver = getDriverApi();
 
+    waitForPostProcessParser();
+
+    // the objects created by other threads must be in our lists to be cleaned up
+    mergeWorkerCommands();
+
+    // the queued objects are destroyed in order, so that instances go before their materials
+    processDeferredDestructions(false);
+
     /*
      * Destroy our own state first
      */
@@ -253,6 +396,11 @@ void FEngine::shutdown() {
     mLightManager.terminate();              // free-up all lights
     mCameraManager.terminate();             // free-up all cameras
 
+    for (Handle<HwUniformBuffer> ubh : mInstancesUbhs) {
+        driver.destroyUniformBuffer(ubh);
+    }
+    mInstancesUbhs.clear();
+
     driver.destroyRenderPrimitive(mFullScreenTriangleRph);
     destroy(mFullScreenTriangleIb);
     destroy(mFullScreenTriangleVb);
@@ -271,6 +419,8 @@ void FEngine::shutdown() {
     cleanupResourceList(mViews);
     cleanupResourceList(mScenes);
     cleanupResourceList(mSkyboxes);
+    // the prefilters own textures
+    cleanupResourceList(mIblPrefilters);
 
     // this must be done after Skyboxes and before materials
     for (FMaterial const* material : mSkyboxMaterials) {
@@ -280,10 +430,13 @@ void FEngine::shutdown() {
     cleanupResourceList(mIndexBuffers);
     cleanupResourceList(mVertexBuffers);
     cleanupResourceList(mTextures);
-    cleanupResourceList(mMaterials);
+    mStreamingTextures.clear();
+    // instances release their uniforms to their material, they must go first
     for (auto& item : mMaterialInstances) {
         cleanupResourceList(item.second);
     }
+    cleanupResourceList(mMaterials);
+    mFenceCallbacks.clear();
     cleanupResourceList(mFences);
 
     for (size_t i = 0; i < POST_PROCESS_STAGES_COUNT; i++) {
@@ -301,12 +454,18 @@ void FEngine::shutdown() {
     mDriverThread.join();
     mTerminated = true;
 
-    // detach this thread from the jobsystem
-    mJobSystem.emancipate();
+    // detach this thread from the jobsystem, unless another engine adopted it
+    if (mAdoptedThread) {
+        mJobSystem.emancipate();
+    }
 }
 
 void FEngine::prepare() {
     SYSTRACE_CALL();
+
+    // this adds the material instances created by other threads since the last frame
+    mergeWorkerCommands();
+
     // prepare() is called once per Renderer frame. Ideally we would upload the content of
     // UBOs that are visible only. It's not such a big issue because the actual upload() is
     // skipped is the UBO hasn't changed. Still we could have a lot of these.
@@ -314,29 +473,360 @@ void FEngine::prepare() {
         for (auto& item : materialInstanceList.second) {
             item->commit(*this);
         }
+        // with shared instance uniforms, this replaces an upload per modified instance
+        materialInstanceList.first->commitInstanceUniforms(*this);
+    }
+    flushUniformUpdates();
+
+    // all instances uniform buffers can be reused by this frame
+    mInstancesUbhInUse = 0;
+
+    // the uploads of the next frame go into another staging pool
+    mStagingPool.nextFrame();
+}
+
+void FEngine::flushUniformUpdates() noexcept {
+    auto& pending = mUniformUpdates;
+    if (pending.empty()) {
+        return;
+    }
+    size_t size = 0;
+    for (UniformUpdate const& update : pending) {
+        size += update.uniforms->getDirtySize();
+    }
+
+    // the dirty ranges of all the buffers are packed back to back
+    DriverApi& driver = getDriverApi();
+    driver::BufferDescriptor data(allocateStagingBuffer(size));
+    if (UTILS_UNLIKELY(!data.buffer)) {
+        data = driver::BufferDescriptor(::malloc(size), size,
+                [](void* buffer, size_t, void*) { ::free(buffer); });
+    }
+    Driver::UniformBufferUpdate* const updates =
+            driver.allocatePod<Driver::UniformBufferUpdate>(pending.size());
+    char* p = static_cast<char*>(const_cast<void*>(data.buffer));
+    for (size_t i = 0, c = pending.size(); i < c; i++) {
+        UniformBuffer const& uniforms = *pending[i].uniforms;
+        const size_t offset = uniforms.getDirtyOffset();
+        const size_t byteSize = uniforms.getDirtySize();
+        memcpy(p, static_cast<char const*>(uniforms.getBuffer()) + offset, byteSize);
+        new(updates + i) Driver::UniformBufferUpdate{
+                pending[i].ubh, uint32_t(offset), uint32_t(byteSize) };
+        uniforms.clean();
+        p += byteSize;
+    }
+    driver.updateUniformBuffers(std::move(data), updates, uint32_t(pending.size()));
+    pending.clear();
+}
+
+Handle<HwUniformBuffer> FEngine::acquireInstancesUniformBuffer() noexcept {
+    if (UTILS_UNLIKELY(mInstancesUbhInUse == mInstancesUbhs.size())) {
+        mInstancesUbhs.push_back(
+                getDriverApi().createUniformBuffer(sizeof(PerRenderableInstancesUib)));
     }
+    return mInstancesUbhs[mInstancesUbhInUse++];
+}
+
+void FEngine::resetFrameCounters() noexcept {
+    debug.renderpass.redundant_commands = 0;
+    debug.renderpass.draw_commands = 0;
+    debug.renderpass.state_changes = 0;
+    debug.renderpass.material_instance_changes = 0;
+    debug.renderpass.program_changes = 0;
+    debug.stats = {};
+}
+
+void FEngine::publishFrameCounters(UTILS_UNUSED uint32_t frameId) noexcept {
+#ifdef FILAMENT_STATS_SERVER
+    if (mStatsServer) {
+        mStatsServer->publish(frameId, mDebugRegistry);
+    }
+#endif
 }
 
 void FEngine::gc() {
     JobSystem& js = mJobSystem;
     auto parent = js.createJob();
-    auto em = std::ref(mEntityManager);
+    js.setName(parent, "FEngine::gc");
+
+    // Each manager frees the components of destroyed entities in small batches, until it runs
+    // out of time or reaches its limit for this frame. The rest is freed during the next frames.
+    static constexpr size_t GC_BATCH_SIZE = 64;
+    EntityManager& em = mEntityManager;
+    const size_t maxCount = mConfig.gcMaxComponentsPerFrame;
+    const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(mConfig.gcTimeBudget);
+    auto gc = [&em, maxCount, deadline](auto& manager) {
+        size_t remaining = maxCount;
+        while (remaining) {
+            const size_t batch = std::min(remaining, GC_BATCH_SIZE);
+            const size_t count = manager.gc(em, batch);
+            remaining -= count;
+            // when a batch isn't full, the manager found only live components in a row
+            if (count < batch || std::chrono::steady_clock::now() >= deadline) {
+                break;
+            }
+        }
+    };
+
+    js.runAndRelease(js.createJob(parent, [&gc, this](JobSystem&, JobSystem::Job*) {
+        gc(mRenderableManager);
+    }), JobSystem::DONT_SIGNAL);
+    js.runAndRelease(js.createJob(parent, [&gc, this](JobSystem&, JobSystem::Job*) {
+        gc(mLightManager);
+    }), JobSystem::DONT_SIGNAL);
+    js.runAndRelease(js.createJob(parent, [&gc, this](JobSystem&, JobSystem::Job*) {
+        gc(mTransformManager);
+    }), JobSystem::DONT_SIGNAL);
+    js.runAndRelease(js.createJob(parent, [&gc, this](JobSystem&, JobSystem::Job*) {
+        gc(mCameraManager);
+    }), JobSystem::DONT_SIGNAL);
+
+    js.run(parent);
+    js.waitAndRelease(parent);
+}
+
+void FEngine::processDeferredDestructions(bool withinBudget) {
+    if (mDeferredDestructionsHead == mDeferredDestructions.size()) {
+        return;
+    }
+    SYSTRACE_CALL();
+
+    // the clock is only checked every few objects, destroying one is usually very fast
+    static constexpr size_t BATCH_SIZE = 16;
+    const auto deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(mConfig.deferredDestructionTimeBudget);
+    // Destroying a Material processes the whole queue, which can happen from this loop, so
+    // the vector is indexed with mDeferredDestructionsHead rather than iterated.
+    size_t count = 0;
+    while (mDeferredDestructionsHead < mDeferredDestructions.size()) {
+        DeferredDestruction const item = mDeferredDestructions[mDeferredDestructionsHead++];
+        item.destroy(*this, item.object);
+        if (withinBudget && (++count % BATCH_SIZE) == 0 &&
+                std::chrono::steady_clock::now() >= deadline) {
+            break;
+        }
+    }
+    if (mDeferredDestructionsHead == mDeferredDestructions.size()) {
+        mDeferredDestructions.clear();
+        mDeferredDestructionsHead = 0;
+    }
+}
+
+void FEngine::updateStreamingTextures() noexcept {
+    if (mStreamingTextures.empty()) {
+        return;
+    }
+    SYSTRACE_CALL();
 
-    js.run(jobs::createJob(js, parent, &FRenderableManager::gc, &mRenderableManager, em),
-            JobSystem::DONT_SIGNAL);
-    js.run(jobs::createJob(js, parent, &FLightManager::gc, &mLightManager, em),
-            JobSystem::DONT_SIGNAL);
-    js.run(jobs::createJob(js, parent, &FTransformManager::gc, &mTransformManager, em),
-            JobSystem::DONT_SIGNAL);
-    js.run(jobs::createJob(js, parent, &FCameraManager::gc, &mCameraManager, em),
-            JobSystem::DONT_SIGNAL);
+    // the level each texture will have: a used texture gets the level it asked for, an unused
+    // one keeps its levels until the budget needs them.
+    const uint32_t frame = mStreamingFrame;
+    struct Residency {
+        FTexture* texture;
+        size_t level;
+    };
+    std::vector<Residency> residencies;
+    residencies.reserve(mStreamingTextures.size());
+    size_t totalSize = 0;
+    for (auto const& item : mStreamingTextures) {
+        FTexture* const texture = item.second;
+        size_t level = texture->getResidentLevel();
+        if (texture->getLastUsedFrame() == frame &&
+                texture->getRequestedLevel() != FTexture::NO_REQUEST) {
+            level = std::min(texture->getRequestedLevel(), texture->getCoarseLevel());
+        }
+        residencies.push_back({ texture, level });
+        totalSize += texture->getSize(level);
+    }
+
+    const size_t budget = mConfig.textureStreamingBudget;
+    if (budget && totalSize > budget) {
+        // least recently used first
+        std::sort(residencies.begin(), residencies.end(),
+                [](Residency const& lhs, Residency const& rhs) {
+                    return lhs.texture->getLastUsedFrame() < rhs.texture->getLastUsedFrame();
+                });
+        auto evict = [&totalSize](Residency& r, size_t level) {
+            if (level > r.level) {
+                totalSize -= r.texture->getSize(r.level) - r.texture->getSize(level);
+                r.level = level;
+            }
+        };
+
+        // first the textures that weren't used during this frame, then the levels that are
+        // still needed, one level at a time, so all the visible textures degrade evenly.
+        for (Residency& r : residencies) {
+            if (totalSize <= budget) {
+                break;
+            }
+            if (r.texture->getLastUsedFrame() != frame) {
+                evict(r, r.texture->getCoarseLevel());
+            }
+        }
+        bool evicted = true;
+        while (totalSize > budget && evicted) {
+            evicted = false;
+            for (Residency& r : residencies) {
+                if (totalSize <= budget) {
+                    break;
+                }
+                if (r.level < r.texture->getCoarseLevel()) {
+                    evict(r, r.level + 1);
+                    evicted = true;
+                }
+            }
+        }
+    }
 
-    js.runAndWait(parent);
+    for (Residency const& r : residencies) {
+        r.texture->setResidentLevel(*this, r.level);
+        r.texture->clearRequest();
+    }
+    mStreamingFrame++;
 }
 
 void FEngine::flush() {
+    mergeWorkerCommands();
+
     // flush the command buffer
     flushCommandBuffer(mCommandBufferQueue);
+
+    // the command buffer is empty now, it's the only time it can grow
+    mCommandBufferQueue.growIfNeeded();
+}
+
+void FEngine::processFenceCallbacks() {
+    // the callbacks can flush, which would call us again
+    if (mProcessingFenceCallbacks) {
+        return;
+    }
+    mProcessingFenceCallbacks = true;
+    // The callbacks can create and destroy fences, which updates mFenceCallbacks. At worst a
+    // signaled fence is skipped, and its callback is called the next time we're polled.
+    for (size_t i = 0; i < mFenceCallbacks.size();) {
+        FFence* const fence = mFenceCallbacks[i];
+        const FenceStatus status = fence->wait(Fence::Mode::DONT_FLUSH, 0);
+        if (status == FenceStatus::TIMEOUT_EXPIRED) {
+            i++;
+            continue;
+        }
+        mFenceCallbacks.erase(mFenceCallbacks.begin() + i);
+        fence->invokeCallback(status);
+    }
+    mProcessingFenceCallbacks = false;
+}
+
+FEngine::CommandBufferStats FEngine::getCommandBufferStats() const noexcept {
+    const CommandBufferQueue::Stats stats = mCommandBufferQueue.getStats();
+    return { stats.capacity, stats.highWatermark,
+             stats.blockCount, stats.blockedTime, stats.growCount };
+}
+
+size_t FEngine::getDriverCommandStats(DriverCommandStats* stats, size_t count) const noexcept {
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+    CommandTimings::Entry entries[CommandTimings::COUNT];
+    mDriver->getDispatcher().timings.getLastFrame(entries);
+    size_t n = 0;
+    for (size_t i = 0; i < CommandTimings::COUNT; i++) {
+        if (entries[i].count) {
+            if (n < count) {
+                stats[n] = { CommandTimings::getName(i), entries[i].count, entries[i].time };
+            }
+            n++;
+        }
+    }
+    return n;
+#else
+    return 0;
+#endif
+}
+
+void FEngine::updateProgramCache() noexcept {
+    const size_t budget = mConfig.programCacheBudget;
+    if (!budget) {
+        return;
+    }
+    SYSTRACE_CALL();
+
+    const uint32_t frame = mProgramCacheFrame++;
+    auto& programs = mProgramInfos;
+    programs.clear();
+    size_t totalSize = 0;
+    for (FMaterial const* material : mMaterials) {
+        totalSize += material->updateProgramUsage(frame, programs);
+    }
+    if (totalSize <= budget) {
+        return;
+    }
+
+    // least recently used first, the programs of this frame are likely needed by the next one
+    std::sort(programs.begin(), programs.end(),
+            [](ProgramInfo const& lhs, ProgramInfo const& rhs) {
+                return lhs.lastUsedFrame < rhs.lastUsedFrame;
+            });
+    for (ProgramInfo const& program : programs) {
+        if (totalSize <= budget || program.lastUsedFrame == frame) {
+            break;
+        }
+        program.material->destroyProgram(program.variantKey);
+        totalSize -= program.size;
+        mProgramEvictions++;
+    }
+}
+
+FEngine::MemoryStats FEngine::getMemoryStats() const noexcept {
+    MemoryStats stats = {};
+
+    LinearAllocatorArena const& arena = mPerRenderPassAllocator;
+    stats.perRenderPassArena = arena.getArea().getSize();
+    stats.perRenderPassArenaHighWatermark = arena.getListener().getHighWatermark();
+    stats.commandBuffer = mCommandBufferQueue.getStats().capacity;
+    for (FRenderer const* renderer : mRenderers) {
+        stats.drawCommands += renderer->getCommandsMemorySize();
+    }
+    stats.jobScratch = mJobSystem.getScratchMemorySize();
+    stats.componentManagers = mRenderableManager.getMemorySize() +
+            mTransformManager.getMemorySize() +
+            mLightManager.getMemorySize() +
+            mCameraManager.getMemorySize();
+
+    for (FMaterial const* material : mMaterials) {
+        stats.materials += material->getPackageSize();
+        stats.programCount += material->getProgramCount();
+        stats.programs += material->getProgramsSize();
+    }
+    stats.programEvictions = mProgramEvictions;
+    stats.materialCount = uint32_t(mMaterials.size());
+    for (auto const& item : mMaterialInstances) {
+        stats.materialInstanceCount += item.second.size();
+    }
+
+    for (FTexture const* texture : mTextures) {
+        stats.textures += texture->getSize();
+    }
+    for (FVertexBuffer const* vertexBuffer : mVertexBuffers) {
+        stats.vertexBuffers += vertexBuffer->getSize();
+    }
+    for (FIndexBuffer const* indexBuffer : mIndexBuffers) {
+        stats.indexBuffers += indexBuffer->getSize();
+    }
+    stats.renderTargets = mRenderTargetPool.getMemorySize();
+    RenderTargetPool::Stats const& rtpStats = mRenderTargetPool.getStats();
+    stats.renderTargetHits = rtpStats.hits;
+    stats.renderTargetMisses = rtpStats.misses;
+    stats.renderTargetEvictions = rtpStats.evictions;
+
+    for (FView const* view : mViews) {
+        Froxelizer const& froxelizer = view->getFroxelizer();
+        stats.froxelizers += froxelizer.getMemorySize();
+        stats.froxelBuffers += froxelizer.getRecordBuffer().getSize() +
+                froxelizer.getFroxelBuffer().getSize();
+        stats.shadowMaps += view->getShadowMap().getTextureSize() +
+                view->getSpotShadowAtlas().getTextureSize();
+    }
+
+    return stats;
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -348,10 +838,21 @@ int FEngine::loop() {
         mExternalContext = ExternalContext::create(&mBackend);
 #if !defined(NDEBUG)
         slog.d << "FEngine resolved backend: "
-                << (mBackend == driver::Backend::VULKAN ? "Vulkan" : "OpenGL") << io::endl;
+                << (mBackend == driver::Backend::VULKAN ? "Vulkan" :
+                    mBackend == driver::Backend::NOOP ? "Noop" : "OpenGL") << io::endl;
 #endif
     }
+    if (mConfig.backgroundUploads && mBackend == driver::Backend::OPENGL) {
+        static_cast<driver::ContextManagerGL*>(mExternalContext)->setUploadContextEnabled(true);
+    }
     mDriver = mExternalContext->createDriver(mSharedGLContext);
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+    // this starts before the Engine creates its resources, so that they're in the capture
+    if (mDriver && mConfig.captureFile) {
+        mCommandCapture.reset(new CommandCapture(mConfig.captureFile, mConfig.captureFrameCount));
+        mDriver->getDispatcher().capture = mCommandCapture.get();
+    }
+#endif
     mDriverBarrier.latch();
     if (UTILS_UNLIKELY(!mDriver)) {
         // if we get here, it's because the driver couldn't be initialized and the problem has
@@ -362,8 +863,14 @@ int FEngine::loop() {
     JobSystem::setThreadName("FEngine::loop");
     JobSystem::setThreadPriority(JobSystem::Priority::DISPLAY);
 
-    // FIXME: we should do this based on the CPUs we actually have
-    uint32_t affinityMask = (std::thread::hardware_concurrency() >= 6) ? 0xF0 : 0;
+    uint32_t affinityMask = mConfig.driverThreadAffinity;
+    if (!affinityMask && mConfig.preferBigCores) {
+        affinityMask = JobSystem::getBigCoresMask();
+    }
+    if (!affinityMask) {
+        // FIXME: we should do this based on the CPUs we actually have
+        affinityMask = (std::thread::hardware_concurrency() >= 6) ? 0xF0 : 0;
+    }
 
     auto& commandBufferQueue = mCommandBufferQueue;
     while (true) {
@@ -438,9 +945,17 @@ Handle<HwProgram> FEngine::createPostProcessProgram(MaterialParser& parser,
     return program;
 }
 
+void FEngine::waitForPostProcessParser() const noexcept {
+    if (UTILS_UNLIKELY(mPostProcessParserJob)) {
+        const_cast<JobSystem&>(mJobSystem).waitAndRelease(mPostProcessParserJob);
+        mPostProcessParserJob = nullptr;
+    }
+}
+
 Handle<HwProgram> FEngine::getPostProcessProgramSlow(PostProcessStage stage) const noexcept {
     Handle<HwProgram>* const postProcessPrograms = mPostProcessPrograms;
     if (!postProcessPrograms[(uint8_t)stage]) {
+        waitForPostProcessParser();
         ShaderModel shaderModel = getDriver().getShaderModel();
         postProcessPrograms[(uint8_t)stage] = createPostProcessProgram(*mPostProcessParser, shaderModel, stage);
     }
@@ -464,15 +979,30 @@ inline T* FEngine::create(ResourceList<T>& list, typename T::Builder const& buil
 }
 
 FVertexBuffer* FEngine::createVertexBuffer(const VertexBuffer::Builder& builder) noexcept {
-    return create(mVertexBuffers, builder);
+    WorkerScope scope(*this);
+    FVertexBuffer* p = mHeapAllocator.make<FVertexBuffer>(*this, builder);
+    scope.runOnEngineThread([this, p]() { mVertexBuffers.insert(p); });
+    return p;
 }
 
 FIndexBuffer* FEngine::createIndexBuffer(const IndexBuffer::Builder& builder) noexcept {
-    return create(mIndexBuffers, builder);
+    WorkerScope scope(*this);
+    FIndexBuffer* p = mHeapAllocator.make<FIndexBuffer>(*this, builder);
+    scope.runOnEngineThread([this, p]() { mIndexBuffers.insert(p); });
+    return p;
 }
 
 FTexture* FEngine::createTexture(const Texture::Builder& builder) noexcept {
-    return create(mTextures, builder);
+    WorkerScope scope(*this);
+    FTexture* p = mHeapAllocator.make<FTexture>(*this, builder);
+    scope.runOnEngineThread([this, p]() {
+        mTextures.insert(p);
+        if (p->isStreaming()) {
+            mStreamingTextures[p->getHwHandle().getId()] = p;
+        }
+    });
+    p->loadResidentLevels(*this);
+    return p;
 }
 
 FIndirectLight* FEngine::createIndirectLight(const IndirectLight::Builder& builder) noexcept {
@@ -487,6 +1017,10 @@ FSkybox* FEngine::createSkybox(const Skybox::Builder& builder) noexcept {
     return create(mSkyboxes, builder);
 }
 
+FIblPrefilter* FEngine::createIblPrefilter(const IblPrefilter::Builder& builder) noexcept {
+    return create(mIblPrefilters, builder);
+}
+
 FStream* FEngine::createStream(const Stream::Builder& builder) noexcept {
     return create(mStreams, builder);
 }
@@ -505,10 +1039,15 @@ FRenderer* FEngine::createRenderer() noexcept {
 }
 
 FMaterialInstance* FEngine::createMaterialInstance(const FMaterial* material) noexcept {
+    WorkerScope scope(*this);
     FMaterialInstance* p = mHeapAllocator.make<FMaterialInstance>(*this, material);
     if (p) {
-        auto pos = mMaterialInstances.emplace(material, "MaterialInstance");
-        pos.first->second.insert(p);
+        // the material's shared uniforms are only used on the engine's thread
+        scope.runOnEngineThread([this, p, material]() {
+            p->acquireUniformsSlot();
+            auto pos = mMaterialInstances.emplace(material, "MaterialInstance");
+            pos.first->second.insert(p);
+        });
     }
     return p;
 }
@@ -541,6 +1080,15 @@ FFence* FEngine::createFence(Fence::Type type) noexcept {
     return p;
 }
 
+FFence* FEngine::createFence(Fence::Type type, Fence::Callback callback, void* user) noexcept {
+    FFence* p = createFence(type);
+    if (p && callback) {
+        p->setCallback(callback, user);
+        mFenceCallbacks.push_back(p);
+    }
+    return p;
+}
+
 FSwapChain* FEngine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept {
     FSwapChain* p = mHeapAllocator.make<FSwapChain>(*this, nativeWindow, flags);
     if (p) {
@@ -549,6 +1097,14 @@ FSwapChain* FEngine::createSwapChain(void* nativeWindow, uint64_t flags) noexcep
     return p;
 }
 
+FSwapChain* FEngine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    FSwapChain* p = mHeapAllocator.make<FSwapChain>(*this, width, height, flags);
+    if (p) {
+        mSwapChains.insert(p);
+    }
+    return p;
+}
+
 /*
  * Objects created with a component manager
  */
@@ -559,11 +1115,18 @@ FCamera* FEngine::createCamera(Entity entity) noexcept {
 }
 
 void FEngine::createRenderable(const RenderableManager::Builder& builder, Entity entity) {
-    mRenderableManager.create(builder, entity);
+    createRenderables(builder, &entity, 1);
+}
+
+void FEngine::createRenderables(const RenderableManager::Builder& builder,
+        Entity const* entities, size_t count) {
+    mRenderableManager.create(builder, entities, count);
     auto& tcm = mTransformManager;
-    // if this entity doesn't have a transform component, add one.
-    if (!tcm.hasComponent(entity)) {
-        tcm.create(entity, 0, mat4f());
+    // if these entities don't have a transform component, add one.
+    for (size_t i = 0; i < count; i++) {
+        if (!tcm.hasComponent(entities[i])) {
+            tcm.create(entities[i], 0, mat4f());
+        }
     }
 }
 
@@ -595,6 +1158,8 @@ void FEngine::cleanupResourceList(ResourceList<T, L>& list) {
 template<typename T, typename L>
 void FEngine::terminateAndDestroy(const T* ptr, ResourceList<T, L>& list) {
     if (ptr != nullptr) {
+        // the object might have been created by another thread and not be in the list yet
+        mergeWorkerCommands();
         if (list.remove(ptr)) {
             const_cast<T*>(ptr)->terminate(*this);
             mHeapAllocator.destroy(const_cast<T*>(ptr));
@@ -612,6 +1177,26 @@ void FEngine::terminateAndDestroy(const T* ptr, ResourceList<T, L>& list) {
 
 // -----------------------------------------------------------------------------------------------
 
+template<typename T>
+void FEngine::destroy(T const* const* p, size_t count) {
+    // the objects created by other threads are added once for the whole batch
+    mergeWorkerCommands();
+    for (size_t i = 0; i < count; i++) {
+        destroy(upcast(p[i]));
+    }
+}
+
+template<typename T>
+void FEngine::destroyDeferred(T const* p) {
+    if (p != nullptr) {
+        mDeferredDestructions.push_back({ p, [](FEngine& engine, void const* object) {
+            engine.destroy(upcast(static_cast<T const*>(object)));
+        }});
+    }
+}
+
+// -----------------------------------------------------------------------------------------------
+
 void FEngine::destroy(const FVertexBuffer* p) {
     terminateAndDestroy(p, mVertexBuffers);
 }
@@ -632,8 +1217,19 @@ inline void FEngine::destroy(const FSkybox* p) {
     terminateAndDestroy(p, mSkyboxes);
 }
 
+inline void FEngine::destroy(const FIblPrefilter* p) {
+    terminateAndDestroy(p, mIblPrefilters);
+}
+
 UTILS_NOINLINE
 void FEngine::destroy(const FTexture* p) {
+    // p isn't dereferenced before it's known to be valid
+    for (auto pos = mStreamingTextures.begin(); pos != mStreamingTextures.end(); ++pos) {
+        if (pos->second == p) {
+            mStreamingTextures.erase(pos);
+            break;
+        }
+    }
     terminateAndDestroy(p, mTextures);
 }
 
@@ -647,6 +1243,10 @@ inline void FEngine::destroy(const FIndirectLight* p) {
 
 UTILS_NOINLINE
 void FEngine::destroy(const FFence* p) {
+    auto pos = std::find(mFenceCallbacks.begin(), mFenceCallbacks.end(), p);
+    if (pos != mFenceCallbacks.end()) {
+        mFenceCallbacks.erase(pos);
+    }
     terminateAndDestroy(p, mFences);
 }
 
@@ -661,6 +1261,9 @@ void FEngine::destroy(const FStream* p) {
 
 inline void FEngine::destroy(const FMaterial* ptr) {
     if (ptr != nullptr) {
+        // some of its instances can be queued
+        processDeferredDestructions(false);
+        mergeWorkerCommands();
         auto pos = mMaterialInstances.find(ptr);
         if (pos != mMaterialInstances.cend()) {
             // we've destroyed the material before destroying all its instances
@@ -676,6 +1279,7 @@ inline void FEngine::destroy(const FMaterial* ptr) {
 
 inline void FEngine::destroy(const FMaterialInstance* ptr) {
     if (ptr != nullptr) {
+        mergeWorkerCommands();
         auto pos = mMaterialInstances.find(ptr->getMaterial());
         assert(pos != mMaterialInstances.cend());
         if (pos != mMaterialInstances.cend()) {
@@ -691,6 +1295,12 @@ void FEngine::destroy(Entity e) {
     mCameraManager.destroy(e);
 }
 
+void FEngine::compileMaterials(Material::VariantSet variants) noexcept {
+    for (FMaterial* material : mMaterials) {
+        material->compile(variants, nullptr, nullptr);
+    }
+}
+
 void* FEngine::streamAlloc(size_t size, size_t alignment) noexcept {
     // we allow this only for small allocations
     if (size > 1024) {
@@ -733,8 +1343,29 @@ EnginePerformanceTest::PFN EnginePerformanceTest::getDestroyUniverseApi() {
 
 using namespace details;
 
-Engine* Engine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext) {
-    std::unique_ptr<FEngine> engine(FEngine::create(backend, externalContext, sharedGLContext));
+Engine* Engine::create(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+        Config const* config) {
+    std::unique_ptr<FEngine> engine(FEngine::create(backend, externalContext, sharedGLContext,
+            config ? *config : Config{}));
+    if (UTILS_UNLIKELY(!engine)) {
+        // something went wrong during the driver or engine initialization
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard(sEnginesLock);
+    Engine* handle = engine.get();
+    sEngines[handle] = std::move(engine);
+    return handle;
+}
+
+void Engine::createAsync(CreateCallback callback, void* user, Backend backend,
+        ExternalContext* externalContext, void* sharedGLContext, Config const* config) {
+    FEngine::createAsync(callback, user, backend, externalContext, sharedGLContext,
+            config ? *config : Config{});
+}
+
+Engine* Engine::getEngine(void* token) {
+    std::unique_ptr<FEngine> engine(FEngine::getEngine(token));
     if (UTILS_UNLIKELY(!engine)) {
         // something went wrong during the driver or engine initialization
         return nullptr;
@@ -795,10 +1426,18 @@ Fence* Engine::createFence(Fence::Type type) noexcept {
     return upcast(this)->createFence(type);
 }
 
+Fence* Engine::createFence(Fence::Type type, Fence::Callback callback, void* user) noexcept {
+    return upcast(this)->createFence(type, callback, user);
+}
+
 SwapChain* Engine::createSwapChain(void* nativeWindow, uint64_t flags) noexcept {
     return upcast(this)->createSwapChain(nativeWindow, flags);
 }
 
+SwapChain* Engine::createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept {
+    return upcast(this)->createSwapChain(width, height, flags);
+}
+
 void Engine::destroy(const VertexBuffer* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -835,6 +1474,10 @@ void Engine::destroy(const Skybox* p) {
     upcast(this)->destroy(upcast(p));
 }
 
+void Engine::destroy(const IblPrefilter* p) {
+    upcast(this)->destroy(upcast(p));
+}
+
 void Engine::destroy(const Stream* p) {
     upcast(this)->destroy(upcast(p));
 }
@@ -855,6 +1498,46 @@ void Engine::destroy(Entity e) {
     upcast(this)->destroy(e);
 }
 
+void Engine::destroy(const VertexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const IndexBuffer* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const MaterialInstance* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroy(const Texture* const* p, size_t count) {
+    upcast(this)->destroy(p, count);
+}
+
+void Engine::destroyDeferred(const VertexBuffer* p) {
+    upcast(this)->destroyDeferred(p);
+}
+
+void Engine::destroyDeferred(const IndexBuffer* p) {
+    upcast(this)->destroyDeferred(p);
+}
+
+void Engine::destroyDeferred(const Material* p) {
+    upcast(this)->destroyDeferred(p);
+}
+
+void Engine::destroyDeferred(const MaterialInstance* p) {
+    upcast(this)->destroyDeferred(p);
+}
+
+void Engine::destroyDeferred(const Texture* p) {
+    upcast(this)->destroyDeferred(p);
+}
+
+size_t Engine::getDeferredDestructionCount() const noexcept {
+    return upcast(this)->getDeferredDestructionCount();
+}
+
 RenderableManager& Engine::getRenderableManager() noexcept {
     return upcast(this)->getRenderableManager();
 }
@@ -871,9 +1554,44 @@ void* Engine::streamAlloc(size_t size, size_t alignment) noexcept {
     return upcast(this)->streamAlloc(size, alignment);
 }
 
+driver::BufferDescriptor Engine::allocateStagingBuffer(size_t size) noexcept {
+    return upcast(this)->allocateStagingBuffer(size);
+}
+
+void Engine::flush() {
+    upcast(this)->flush();
+    // the internal flushes happen in the middle of a frame, the callbacks only run from here
+    // and Renderer::endFrame()
+    upcast(this)->processFenceCallbacks();
+}
+
+void Engine::compileMaterials(uint32_t variants) noexcept {
+    upcast(this)->compileMaterials(variants);
+}
+
+void Engine::setBlobCache(BlobCache const& cache) noexcept {
+    upcast(this)->getDriverApi().setBlobCache(cache);
+}
+
+Engine::CommandBufferStats Engine::getCommandBufferStats() const noexcept {
+    return upcast(this)->getCommandBufferStats();
+}
+
+size_t Engine::getDriverCommandStats(DriverCommandStats* stats, size_t count) const noexcept {
+    return upcast(this)->getDriverCommandStats(stats, count);
+}
+
+Engine::MemoryStats Engine::getMemoryStats() const noexcept {
+    return upcast(this)->getMemoryStats();
+}
+
 DebugRegistry& Engine::getDebugRegistry() noexcept {
     return upcast(this)->getDebugRegistry();
 }
 
+utils::JobSystem& Engine::getJobSystem() noexcept {
+    return upcast(this)->getJobSystem();
+}
+
 
 } // namespace filament
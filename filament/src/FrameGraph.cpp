@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameGraph.h"
+
+#include "driver/DriverApi.h"
+
+#include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+
+#include <assert.h>
+
+namespace filament {
+
+using namespace driver;
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraphResource FrameGraph::Builder::create(const char* name,
+        Descriptor const& desc) noexcept {
+    return mFrameGraph.createResource(name, desc);
+}
+
+FrameGraphResource FrameGraph::Builder::read(FrameGraphResource r, bool sampled) noexcept {
+    ASSERT_PRECONDITION(mPass.readCount < MAX_PASS_RESOURCE_COUNT,
+            "pass %s reads too many resources", mPass.name);
+    mPass.reads[mPass.readCount++] = r.index;
+    mFrameGraph.getResource(r).sampled |= sampled;
+    return r;
+}
+
+FrameGraphResource FrameGraph::Builder::write(FrameGraphResource r) noexcept {
+    ASSERT_PRECONDITION(mPass.writeCount < MAX_PASS_RESOURCE_COUNT,
+            "pass %s writes too many resources", mPass.name);
+    mPass.writes[mPass.writeCount++] = r.index;
+    return r;
+}
+
+void FrameGraph::Builder::sideEffect() noexcept {
+    mPass.sideEffect = true;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+RenderTargetPool::Target const& FrameGraph::Resources::get(FrameGraphResource r) const noexcept {
+    ResourceNode const& resource = mFrameGraph.getResource(r);
+    assert(resource.target);
+    assert(resource.first <= mPass && mPass <= resource.last);
+    return *resource.target;
+}
+
+RenderPassParams FrameGraph::Resources::getRenderPassParams(
+        FrameGraphResource r) const noexcept {
+    ResourceNode const& resource = mFrameGraph.getResource(r);
+    RenderPassParams params = {};
+    if (resource.first == mPass) {
+        params.discardStart = resource.isImported ?
+                resource.importedDiscardStart : TargetBufferFlags::ALL;
+    }
+    // the passes only ever read the color buffers of the targets, and the sampleable depth
+    // buffers
+    params.discardEnd = (resource.last == mPass && !resource.isImported) ?
+            TargetBufferFlags::ALL : resource.desc.sampleableDepth ?
+            TargetBufferFlags::STENCIL : TargetBufferFlags::DEPTH_AND_STENCIL;
+    return params;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+bool FrameGraph::PassNode::isReading(uint16_t index) const noexcept {
+    return std::find(reads.begin(), reads.begin() + readCount, index) != reads.begin() + readCount;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FrameGraph::FrameGraph(details::ArenaScope& arena, RenderTargetPool& rtp) noexcept
+        : mArena(arena), mRenderTargetPool(rtp) {
+}
+
+FrameGraph::~FrameGraph() noexcept {
+    // the targets of a frame graph that didn't execute (or didn't finish to) go back to the pool
+    for (size_t i = 0; i < mResourceCount; i++) {
+        ResourceNode& resource = mResources[i];
+        if (!resource.isImported && resource.target) {
+            mRenderTargetPool.put(resource.target);
+        }
+    }
+}
+
+FrameGraph::PassNode& FrameGraph::createPassNode(const char* name,
+        PassExecutor* executor) noexcept {
+    ASSERT_PRECONDITION(mPassCount < MAX_PASS_COUNT, "too many passes");
+    assert(!mCompiled);
+    PassNode& pass = mPasses[mPassCount++];
+    pass.name = name;
+    pass.executor = executor;
+    return pass;
+}
+
+FrameGraphResource FrameGraph::createResource(const char* name,
+        Descriptor const& desc) noexcept {
+    ASSERT_PRECONDITION(mResourceCount < MAX_RESOURCE_COUNT, "too many resources");
+    FrameGraphResource r;
+    r.index = mResourceCount++;
+    ResourceNode& resource = mResources[r.index];
+    resource.name = name;
+    resource.desc = desc;
+    return r;
+}
+
+FrameGraph::ResourceNode& FrameGraph::getResource(FrameGraphResource r) noexcept {
+    assert(r.isValid() && r.index < mResourceCount);
+    return mResources[r.index];
+}
+
+FrameGraph::ResourceNode const& FrameGraph::getResource(FrameGraphResource r) const noexcept {
+    assert(r.isValid() && r.index < mResourceCount);
+    return mResources[r.index];
+}
+
+FrameGraphResource FrameGraph::importRenderTarget(const char* name, Descriptor const& desc,
+        Handle<HwRenderTarget> target, TargetBufferFlags discardStart,
+        Handle<HwTexture> texture) noexcept {
+    FrameGraphResource r = createResource(name, desc);
+    ResourceNode& resource = getResource(r);
+    resource.isImported = true;
+    resource.importedDiscardStart = discardStart;
+    resource.imported.target = target;
+    resource.imported.texture = texture;
+    resource.imported.w = desc.width;
+    resource.imported.h = desc.height;
+    resource.imported.attachments = desc.attachments;
+    resource.imported.format = desc.format;
+    resource.imported.samples = desc.samples;
+    resource.target = &resource.imported;
+    return r;
+}
+
+void FrameGraph::present(FrameGraphResource r) noexcept {
+    getResource(r).presented = true;
+}
+
+void FrameGraph::compile() noexcept {
+    SYSTRACE_CALL();
+
+    // Walk the passes backward, keeping track of the resources whose content is still needed.
+    // A pass is culled when it has no side effect and none of what it writes is needed. The
+    // content of a resource a pass writes without reading isn't needed before that pass.
+    std::array<bool, MAX_RESOURCE_COUNT> needed;
+    for (size_t i = 0; i < mResourceCount; i++) {
+        needed[i] = mResources[i].presented;
+    }
+    for (size_t i = mPassCount; i-- > 0;) {
+        PassNode& pass = mPasses[i];
+        bool const used = pass.sideEffect || std::any_of(
+                pass.writes.begin(), pass.writes.begin() + pass.writeCount,
+                [&needed](uint16_t index) { return needed[index]; });
+        pass.culled = !used;
+        if (used) {
+            for (size_t j = 0; j < pass.writeCount; j++) {
+                if (!pass.isReading(pass.writes[j])) {
+                    needed[pass.writes[j]] = false;
+                }
+            }
+            for (size_t j = 0; j < pass.readCount; j++) {
+                needed[pass.reads[j]] = true;
+            }
+        }
+    }
+
+    // the lifetime of a resource spans the passes using it
+    for (size_t i = 0; i < mPassCount; i++) {
+        PassNode const& pass = mPasses[i];
+        if (pass.culled) {
+            continue;
+        }
+        auto use = [this, i](uint16_t index) {
+            ResourceNode& resource = mResources[index];
+            if (!resource.used) {
+                resource.used = true;
+                resource.first = uint16_t(i);
+            }
+            resource.last = uint16_t(i);
+        };
+        std::for_each(pass.reads.begin(), pass.reads.begin() + pass.readCount, use);
+        std::for_each(pass.writes.begin(), pass.writes.begin() + pass.writeCount, use);
+    }
+
+    mCompiled = true;
+}
+
+void FrameGraph::execute(DriverApi& driver) noexcept {
+    SYSTRACE_CALL();
+
+    assert(mCompiled);
+    RenderTargetPool& rtp = mRenderTargetPool;
+    for (size_t i = 0; i < mPassCount; i++) {
+        PassNode const& pass = mPasses[i];
+        if (pass.culled) {
+            continue;
+        }
+
+        // the targets needed from this pass on, targets only blitted from need no texture
+        for (size_t j = 0; j < mResourceCount; j++) {
+            ResourceNode& resource = mResources[j];
+            if (resource.used && !resource.isImported && resource.first == i) {
+                Descriptor const& desc = resource.desc;
+                uint8_t flags = resource.sampled ? uint8_t(0) : RenderTargetPool::Target::NO_TEXTURE;
+                if (desc.sampleableDepth) {
+                    flags |= RenderTargetPool::Target::DEPTH_TEXTURE;
+                }
+                resource.target = rtp.get(desc.attachments, desc.width, desc.height,
+                        desc.samples, desc.format, flags);
+            }
+        }
+
+        driver.pushGroupMarker(pass.name);
+        pass.executor->execute(Resources(*this, i), driver);
+        driver.popGroupMarker();
+
+        // and the ones that aren't needed anymore, later passes can reuse them
+        for (size_t j = 0; j < mResourceCount; j++) {
+            ResourceNode& resource = mResources[j];
+            if (resource.used && !resource.isImported && resource.last == i) {
+                rtp.put(resource.target);
+                resource.target = nullptr;
+            }
+        }
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_FRAMEGRAPH_H
+#define TNT_FILAMENT_FRAMEGRAPH_H
+
+#include "RenderTargetPool.h"
+
+#include "details/Allocators.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <array>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+class FrameGraph;
+
+// A render target of the FrameGraph, only valid with the FrameGraph that returned it.
+class FrameGraphResource {
+public:
+    bool isValid() const noexcept { return index != UNINITIALIZED; }
+
+private:
+    friend class FrameGraph;
+    static constexpr uint16_t UNINITIALIZED = std::numeric_limits<uint16_t>::max();
+    uint16_t index = UNINITIALIZED;
+};
+
+/*
+ * The render passes of a view, for one frame.
+ *
+ * Passes are added in the order they execute, and declare the render targets they create, read
+ * and write. compile() culls the passes whose results aren't used, and computes the lifetime
+ * of each transient target. execute() then gets each of them from the RenderTargetPool right
+ * before the first pass using it, and returns it right after the last one, so that the targets
+ * that aren't needed at the same time share the same memory.
+ *
+ * The FrameGraph's memory comes from the arena it's given, which must outlive it.
+ */
+class FrameGraph {
+    struct PassNode;
+
+public:
+    static constexpr size_t MAX_PASS_COUNT = 16;
+    static constexpr size_t MAX_RESOURCE_COUNT = 16;
+    static constexpr size_t MAX_PASS_RESOURCE_COUNT = 4;    // reads or writes
+
+    struct Descriptor {
+        driver::TargetBufferFlags attachments = driver::TargetBufferFlags::COLOR;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        uint8_t samples = 1;
+        driver::TextureFormat format = driver::TextureFormat::RGBA8;
+        // the depth buffer is a texture that later passes can sample, and is kept between passes
+        bool sampleableDepth = false;
+    };
+
+    class Builder {
+    public:
+        // a transient render target, which only exists while the passes using it run
+        FrameGraphResource create(const char* name, Descriptor const& desc) noexcept;
+
+        // sampled is false when the pass only blits from the target, which then doesn't
+        // need a texture
+        FrameGraphResource read(FrameGraphResource r, bool sampled = true) noexcept;
+
+        FrameGraphResource write(FrameGraphResource r) noexcept;
+
+        // the pass is never culled
+        void sideEffect() noexcept;
+
+    private:
+        friend class FrameGraph;
+        Builder(FrameGraph& fg, PassNode& pass) noexcept : mFrameGraph(fg), mPass(pass) { }
+        FrameGraph& mFrameGraph;
+        PassNode& mPass;
+    };
+
+    // What a pass' execute() callback can access.
+    class Resources {
+    public:
+        // the render target in use by r, its size may be larger than r's descriptor
+        RenderTargetPool::Target const& get(FrameGraphResource r) const noexcept;
+
+        // the discard flags of a render pass of this pass writing into r: everything is
+        // discarded before the first write of a transient target, only its color is kept at
+        // the end unless this is its last use
+        driver::RenderPassParams getRenderPassParams(FrameGraphResource r) const noexcept;
+
+    private:
+        friend class FrameGraph;
+        Resources(FrameGraph const& fg, size_t pass) noexcept : mFrameGraph(fg), mPass(pass) { }
+        FrameGraph const& mFrameGraph;
+        size_t mPass;
+    };
+
+    FrameGraph(details::ArenaScope& arena, RenderTargetPool& rtp) noexcept;
+    ~FrameGraph() noexcept;
+
+    FrameGraph(FrameGraph const& rhs) = delete;
+    FrameGraph& operator=(FrameGraph const& rhs) = delete;
+
+    // setup(Builder&, Data&) is called right away to declare the pass' resources, and
+    // execute(Data const&, Resources const&, DriverApi&) during execute(), unless it's culled.
+    template<typename Data, typename Setup, typename Execute>
+    Data const& addPass(const char* name, Setup setup, Execute&& execute) noexcept {
+        using PassType = Pass<Data, typename std::decay<Execute>::type>;
+        PassType* const pass = mArena.make<PassType>(std::forward<Execute>(execute));
+        Builder builder(*this, createPassNode(name, pass));
+        setup(builder, pass->data);
+        return pass->data;
+    }
+
+    // A render target owned by someone else, e.g. the view's. discardStart are the buffers that
+    // can be discarded before the first pass writing into it. texture, when given, is the
+    // target's color buffer, which the passes reading the target can then sample.
+    FrameGraphResource importRenderTarget(const char* name, Descriptor const& desc,
+            Handle<HwRenderTarget> target,
+            driver::TargetBufferFlags discardStart = driver::TargetBufferFlags::NONE,
+            Handle<HwTexture> texture = {}) noexcept;
+
+    // r's content is needed after the frame graph executes, typically because it's imported
+    void present(FrameGraphResource r) noexcept;
+
+    void compile() noexcept;
+
+    void execute(driver::DriverApi& driver) noexcept;
+
+private:
+    struct PassExecutor {
+        virtual ~PassExecutor() noexcept = default;
+        virtual void execute(Resources const& resources, driver::DriverApi& driver) noexcept = 0;
+    };
+
+    template<typename Data, typename Execute>
+    struct Pass final : public PassExecutor {
+        explicit Pass(Execute&& execute) noexcept : exec(std::move(execute)) { }
+        explicit Pass(Execute const& execute) noexcept : exec(execute) { }
+        void execute(Resources const& resources, driver::DriverApi& driver) noexcept override {
+            exec(data, resources, driver);
+        }
+        Data data = {};
+        Execute exec;
+    };
+
+    struct PassNode {
+        const char* name = nullptr;
+        PassExecutor* executor = nullptr;
+        std::array<uint16_t, MAX_PASS_RESOURCE_COUNT> reads = {};
+        std::array<uint16_t, MAX_PASS_RESOURCE_COUNT> writes = {};
+        uint8_t readCount = 0;
+        uint8_t writeCount = 0;
+        bool sideEffect = false;
+        bool culled = false;
+
+        bool isReading(uint16_t index) const noexcept;
+    };
+
+    struct ResourceNode {
+        const char* name = nullptr;
+        Descriptor desc;
+        // the transient target while it's in use, or the imported target
+        RenderTargetPool::Target const* target = nullptr;
+        RenderTargetPool::Target imported;
+        driver::TargetBufferFlags importedDiscardStart = driver::TargetBufferFlags::NONE;
+        uint16_t first = 0;     // first and last passes using it
+        uint16_t last = 0;
+        bool isImported = false;
+        bool sampled = false;
+        bool presented = false;
+        bool used = false;
+    };
+
+    PassNode& createPassNode(const char* name, PassExecutor* executor) noexcept;
+    FrameGraphResource createResource(const char* name, Descriptor const& desc) noexcept;
+    ResourceNode& getResource(FrameGraphResource r) noexcept;
+    ResourceNode const& getResource(FrameGraphResource r) const noexcept;
+
+    details::ArenaScope& mArena;
+    RenderTargetPool& mRenderTargetPool;
+    std::array<PassNode, MAX_PASS_COUNT> mPasses;
+    std::array<ResourceNode, MAX_RESOURCE_COUNT> mResources;
+    uint16_t mPassCount = 0;
+    uint16_t mResourceCount = 0;
+    bool mCompiled = false;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_FRAMEGRAPH_H
@@ -70,6 +70,19 @@ void FrameInfo::endFrame(FrameInfoManager* mgr) {
 
 // ------------------------------------------------------------------------------------------------
 
+void FrameInfoManager::terminate() {
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    for (GpuTimers& timers : mGpuTimers) {
+        for (Handle<HwTimerQuery>& query : timers.queries) {
+            if (query) {
+                driver.destroyTimerQuery(query);
+                query.clear();
+            }
+        }
+    }
+    mSyncThread.requestExitAndWait();
+}
+
 void FrameInfoManager::beginFrame(uint32_t frameId) {
     SYSTRACE_CONTEXT();
     SYSTRACE_ASYNC_BEGIN("frame latency", frameId);
@@ -80,9 +93,83 @@ void FrameInfoManager::beginFrame(uint32_t frameId) {
         info->frame = frameId;
         info->beginFrame(this);
     }
+
+    const time_point now = clock::now();
+    if (mLastBeginFrame != time_point{}) {
+        mFrameInterval = now - mLastBeginFrame;
+    }
+    mLastBeginFrame = now;
+
+    if (mGpuTimersSupported) {
+        FEngine::DriverApi& driver = mEngine.getDriverApi();
+        // the queries of this slot were issued GPU_TIMER_LATENCY frames ago
+        GpuTimers& timers = mGpuTimers[mGpuTimersIndex];
+        mGpuTimersIndex = uint32_t((mGpuTimersIndex + 1) % GPU_TIMER_LATENCY);
+        readGpuTimers(driver, timers);
+        timers.frame = frameId;
+        timers.count = 0;
+        mCurrentGpuTimers = &timers;
+    }
+}
+
+FrameInfoManager::duration FrameInfoManager::getLastGpuFrameTime() const noexcept {
+    if (!mGpuTimersSupported) {
+        return getLastFrameTime();
+    }
+    GpuFrameInfo const& info = mLastGpuFrameInfo;
+    uint64_t total = 0;
+    for (uint64_t elapsed : info.passes) {
+        total += elapsed;
+    }
+    return std::chrono::duration_cast<duration>(std::chrono::nanoseconds(total));
+}
+
+void FrameInfoManager::readGpuTimers(FEngine::DriverApi& driver, GpuTimers& timers) noexcept {
+    if (!timers.count) {
+        return;
+    }
+    GpuFrameInfo info;
+    info.frame = timers.frame;
+    for (size_t i = 0, c = timers.count; i < c; i++) {
+        uint64_t elapsed;
+        if (!driver.getTimerQueryValue(timers.queries[i], &elapsed)) {
+            // the GPU is too far behind or the result was lost, skip this frame
+            return;
+        }
+        info.passes[timers.passes[i]] += elapsed;
+    }
+    mLastGpuFrameInfo = info;
+    SYSTRACE_CONTEXT();
+    SYSTRACE_VALUE32("gpu.shadowPass", uint32_t(info.passes[GpuFrameInfo::SHADOW] / 1000));
+    SYSTRACE_VALUE32("gpu.colorPass", uint32_t(info.passes[GpuFrameInfo::COLOR] / 1000));
+    SYSTRACE_VALUE32("gpu.postProcess", uint32_t(info.passes[GpuFrameInfo::POST_PROCESS] / 1000));
+}
+
+void FrameInfoManager::beginPass(FEngine::DriverApi& driver, GpuFrameInfo::pass_id id) noexcept {
+    GpuTimers* const timers = mCurrentGpuTimers;
+    assert(!mGpuTimerActive);
+    if (!timers || timers->count >= GPU_TIMER_COUNT) {
+        return;
+    }
+    Handle<HwTimerQuery>& query = timers->queries[timers->count];
+    if (UTILS_UNLIKELY(!query)) {
+        query = driver.createTimerQuery();
+    }
+    timers->passes[timers->count] = id;
+    driver.beginTimerQuery(query);
+    mGpuTimerActive = true;
+}
+
+void FrameInfoManager::endPass(FEngine::DriverApi& driver) noexcept {
+    if (mGpuTimerActive) {
+        GpuTimers* const timers = mCurrentGpuTimers;
+        driver.endTimerQuery(timers->queries[timers->count++]);
+        mGpuTimerActive = false;
+    }
 }
 
 void FrameInfoManager::endFrame() {
+    mCurrentGpuTimers = nullptr;
     FrameInfo* const info = mCurrentFrameInfo;
     if (info) {
         mCurrentFrameInfo = nullptr;
@@ -91,6 +178,7 @@ void FrameInfoManager::endFrame() {
 }
 
 void FrameInfoManager::cancelFrame() {
+    mCurrentGpuTimers = nullptr;
     FrameInfo* info = mCurrentFrameInfo;
     if (info) {
         mCurrentFrameInfo = nullptr;
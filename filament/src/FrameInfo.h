@@ -23,6 +23,7 @@
 
 #include <utils/Allocator.h>
 
+#include <array>
 #include <deque>
 #include <chrono>
 #include <condition_variable>
@@ -70,11 +71,32 @@ public:
     time_point laps[MAX_LAPS_IDS] = { time_point::max() };
 };
 
+// GPU time of the passes of a frame, measured with timer queries
+struct GpuFrameInfo {
+    enum pass_id : uint8_t {
+        SHADOW = 0,     // all the shadow maps
+        COLOR,          // the depth prepass and the color pass, which share a render pass
+        POST_PROCESS,   // all the post-processing stages
+    };
+
+    static constexpr size_t MAX_PASS_IDS = 3;
+
+    uint32_t frame = 0;                             // 0 when no frame was measured yet
+    uint64_t passes[MAX_PASS_IDS] = {};             // in nanoseconds
+};
+
 class FrameInfoManager {
     friend class FrameInfo;
     static constexpr size_t HISTORY_COUNT = 5;
     static constexpr size_t POOL_COUNT = 8;
 
+    // timer queries are read back this many frames after they're issued, so we never wait for
+    // the GPU
+    static constexpr size_t GPU_TIMER_LATENCY = 4;
+
+    // at most this many passes are measured per frame (e.g. a frame can render several views)
+    static constexpr size_t GPU_TIMER_COUNT = 16;
+
     // set this to true to enable extra timing infos
     static constexpr bool mLapRecordsEnabled = EXTRA_TIMING_INFO;
 
@@ -89,12 +111,11 @@ public:
     Engine& getEngine() { return mEngine; }
 
     void run() {
+        mGpuTimersSupported = mEngine.getDriverApi().isTimerQuerySupported();
         mSyncThread.run();
     }
 
-    void terminate() {
-        mSyncThread.requestExitAndWait();
-    }
+    void terminate();
 
     // call this immediately after "make current"
     void beginFrame(uint32_t frameId);
@@ -113,6 +134,25 @@ public:
 
     void cancelFrame();
 
+    // call these around passes, outside of render passes, between beginFrame and endFrame to
+    // measure their GPU time
+    void beginPass(FEngine::DriverApi& driver, GpuFrameInfo::pass_id id) noexcept;
+    void endPass(FEngine::DriverApi& driver) noexcept;
+
+    // GPU times of the last frame whose timer queries are all available
+    GpuFrameInfo const& getLastGpuFrameInfo() const noexcept {
+        return mLastGpuFrameInfo;
+    }
+
+    // GPU time of the last measured frame if timer queries are supported, or the time between
+    // the fences of the last frame otherwise
+    duration getLastGpuFrameTime() const noexcept;
+
+    // time between the last two calls to beginFrame()
+    duration getFrameInterval() const noexcept {
+        return mFrameInterval;
+    }
+
     constexpr bool isLapRecordsEnabled() const noexcept {
         return mLapRecordsEnabled;
     }
@@ -169,6 +209,15 @@ private:
     FrameInfo* obtain() noexcept;
     void finish(FrameInfo* info) noexcept;
 
+    struct GpuTimers {
+        uint32_t frame = 0;
+        uint8_t count = 0;      // number of queries issued during the frame
+        GpuFrameInfo::pass_id passes[GPU_TIMER_COUNT];
+        Handle<HwTimerQuery> queries[GPU_TIMER_COUNT];
+    };
+
+    void readGpuTimers(FEngine::DriverApi& driver, GpuTimers& timers) noexcept;
+
     using PoolArena = utils::Arena<utils::ObjectPoolAllocator<FrameInfo>, utils::LockingPolicy::SpinLock>;
     FEngine& mEngine;
     PoolArena mPoolArena;
@@ -177,6 +226,16 @@ private:
 
     mutable std::mutex mLock;
     std::vector<FrameInfo> mFrameInfoHistory;
+
+    // the timer queries are only accessed from the main thread
+    std::array<GpuTimers, GPU_TIMER_LATENCY> mGpuTimers;
+    GpuTimers* mCurrentGpuTimers = nullptr;
+    GpuFrameInfo mLastGpuFrameInfo;
+    uint32_t mGpuTimersIndex = 0;
+    time_point mLastBeginFrame = {};
+    duration mFrameInterval = {};
+    bool mGpuTimersSupported = false;
+    bool mGpuTimerActive = false;
 };
 
 
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/FramePacer.h"
+
+#include <algorithm>
+
+#include <math.h>
+
+namespace filament {
+namespace details {
+
+FramePacer::FramePacer() noexcept {
+    setDisplayInfo(60.0f, 0, 0);
+}
+
+void FramePacer::setDisplayInfo(float refreshRate,
+        uint64_t presentationDeadlineNanos, uint64_t vsyncOffsetNanos) noexcept {
+    mRefreshPeriod = 1e9 / std::max(1.0, double(refreshRate));
+    mPresentationDeadline = double(presentationDeadlineNanos);
+    mVsyncOffset = double(vsyncOffsetNanos);
+}
+
+int64_t FramePacer::getPresentationTime(int64_t vsyncNanos) const noexcept {
+    // The first vsync of the display at or after the requested time is used, so the time is set
+    // half a period before the target, where jitter can't push it to the next vsync.
+    const double displayVsync = double(vsyncNanos) - mVsyncOffset;
+    return int64_t(displayVsync + (mInterval - 0.5) * mRefreshPeriod);
+}
+
+void FramePacer::update(double frameTimeNanos) noexcept {
+    // same estimator as TCP's round-trip time (RFC 6298)
+    if (!mHasSamples) {
+        mHasSamples = true;
+        mAverage = frameTimeNanos;
+    } else {
+        const double error = frameTimeNanos - mAverage;
+        mAverage += error * (1.0 / 8.0);
+        mDeviation += (fabs(error) - mDeviation) * (1.0 / 4.0);
+    }
+
+    // twice the mean deviation covers about 95% of the frames (if they're normally distributed)
+    const double predicted = mAverage + 2.0 * mDeviation + mPresentationDeadline;
+    const uint32_t needed = uint32_t(std::min(double(MAX_INTERVAL),
+            std::max(1.0, ceil(predicted / mRefreshPeriod))));
+
+    if (needed >= mInterval) {
+        // a frame that would be late is worse than one presented later, this is immediate
+        mInterval = needed;
+        mShorterIntervalFrames = 0;
+    } else if (++mShorterIntervalFrames >= HYSTERESIS) {
+        mInterval--;
+        mShorterIntervalFrames = 0;
+    }
+}
+
+} // namespace details
+} // namespace filament
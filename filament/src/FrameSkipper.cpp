@@ -64,6 +64,19 @@ bool FrameSkipper::skipFrameNeeded() const noexcept {
     return false;
 }
 
+void FrameSkipper::waitForFrame() noexcept {
+    mExtraSkipCount = 0;
+    if (mFences.empty()) {
+        return;
+    }
+    FFence* fence = mFences.front();
+    if (fence) {
+        fence->wait(Fence::Mode::FLUSH, Fence::FENCE_WAIT_FOR_EVER);
+        mEngine.destroy(fence);
+    }
+    mFences.pop_front();
+}
+
 
 } // namespace details
 } // namespace filament
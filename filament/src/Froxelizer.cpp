@@ -24,6 +24,7 @@
 #include <filament/Viewport.h>
 
 #include <utils/Allocator.h>
+#include <utils/Hash.h>
 #include <utils/Systrace.h>
 
 #include <math/mat4.h>
@@ -54,8 +55,8 @@ static constexpr bool SUPPORTS_NON_SQUARE_FROXELS = false;
 // - chosen texture width [64]
 // - size of CPU-side indices [16 bits]
 // Also, increasing the number of froxels adds more pressure on the "record buffer" which stores
-// the light indices per froxel. The record buffer is limited to 65536 entries, so with
-// 8192 froxels, we can store 8 lights per froxels assuming they're all used. In practice, some
+// the light indices per froxel. The record buffer is limited to 131072 entries, so with
+// 8192 froxels, we can store 16 lights per froxels assuming they're all used. In practice, some
 // froxels are not used, so we can store more.
 constexpr size_t FROXEL_BUFFER_ENTRY_COUNT_MAX  = 8192;
 
@@ -65,12 +66,20 @@ constexpr size_t FROXEL_BUFFER_WIDTH        = 1u << FROXEL_BUFFER_WIDTH_SHIFT;
 constexpr size_t FROXEL_BUFFER_WIDTH_MASK   = FROXEL_BUFFER_WIDTH - 1u;
 constexpr size_t FROXEL_BUFFER_HEIGHT       = (FROXEL_BUFFER_ENTRY_COUNT_MAX + FROXEL_BUFFER_WIDTH_MASK) / FROXEL_BUFFER_WIDTH;
 
-constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 5u;
+// Make sure this matches the same constants in light_punctual.fs
+constexpr size_t RECORD_BUFFER_WIDTH_SHIFT  = 6u;
 constexpr size_t RECORD_BUFFER_WIDTH        = 1u << RECORD_BUFFER_WIDTH_SHIFT;
 constexpr size_t RECORD_BUFFER_WIDTH_MASK   = RECORD_BUFFER_WIDTH - 1u;
 
 constexpr size_t RECORD_BUFFER_HEIGHT       = 2048;
-constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 64K
+constexpr size_t RECORD_BUFFER_ENTRY_COUNT  = RECORD_BUFFER_WIDTH * RECORD_BUFFER_HEIGHT; // 128K
+
+// Froxel counts chosen by updateFroxelCount(), the smaller grids have half the slices
+constexpr size_t FROXEL_COUNT_MIN = 1024;
+constexpr size_t FROXEL_COUNT_FEW_SLICES = 2048;
+
+// frames the grid must be finer than needed before it gets coarser
+constexpr uint16_t FROXEL_COUNT_COOLDOWN = 60;
 
 // Buffer needed for Froxelizer internal data structures (~256 KiB)
 constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
@@ -79,22 +88,36 @@ constexpr size_t PER_FROXELDATA_ARENA_SIZE = sizeof(float4) *
                                                   FEngine::CONFIG_FROXEL_SLICE_COUNT / 4 + 1);
 
 
-// record buffer cannot be larger than 65K entries because we're using uint16_t to store indices
-// so its maximum size is 128 KiB
-static_assert(RECORD_BUFFER_ENTRY_COUNT <= 65536,
-        "RecordBuffer cannot be larger than 65536 entries");
+// the record buffer's offsets are 32 bits, so its size is only limited by the texture size, which
+// is guaranteed to be at least 2048 in all versions of GLES
+static_assert(RECORD_BUFFER_HEIGHT <= 2048,
+        "RecordBuffer cannot be taller than 2048 texels");
+
+// light indices are stored in the records and in the per-light froxel lists (on 15 bits)
+static_assert(CONFIG_MAX_LIGHT_COUNT <= 32768,
+        "CONFIG_MAX_LIGHT_COUNT cannot be larger than 32768");
 
 Froxelizer::Froxelizer(FEngine& engine)
-        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE) {
+        : mArena("froxel", PER_FROXELDATA_ARENA_SIZE),
+          mFroxelCountTarget(uint16_t(FROXEL_BUFFER_ENTRY_COUNT_MAX)) {
 
     DriverApi& driverApi = engine.getDriverApi();
 
-    // RecordBuffer cannot be larger than 65536 entries, because indices are uint16_t
     GPUBuffer::ElementType type = std::is_same<RecordBufferType, uint8_t>::value
                                   ? GPUBuffer::ElementType::UINT8 : GPUBuffer::ElementType::UINT16;
     mRecordsBuffer = GPUBuffer(driverApi, { type, 1 }, RECORD_BUFFER_WIDTH, RECORD_BUFFER_HEIGHT);
-    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT16, 2 },
+    mFroxelBuffer  = GPUBuffer(driverApi, { GPUBuffer::ElementType::UINT32, 2 },
             FROXEL_BUFFER_WIDTH, FROXEL_BUFFER_HEIGHT);
+
+#ifndef NDEBUG
+    slog.d << "Froxel: record buffer " << getRecordBufferSize() / 1024 << " KiB, "
+           << "froxel buffer " << FROXEL_BUFFER_ENTRY_COUNT_MAX * sizeof(FroxelEntry) / 1024
+           << " KiB" << io::endl;
+#endif
+}
+
+size_t Froxelizer::getRecordBufferSize() noexcept {
+    return RECORD_BUFFER_ENTRY_COUNT * sizeof(RecordBufferType);
 }
 
 Froxelizer::~Froxelizer() {
@@ -122,6 +145,54 @@ void Froxelizer::setOptions(float zLightNear, float zLightFar) noexcept {
     }
 }
 
+void Froxelizer::setFroxelCount(uint32_t froxelCount) noexcept {
+    if (froxelCount) {
+        froxelCount = clamp(froxelCount,
+                uint32_t(FROXEL_COUNT_MIN), uint32_t(FROXEL_BUFFER_ENTRY_COUNT_MAX));
+        if (mFroxelCountTarget != froxelCount) {
+            mFroxelCountTarget = uint16_t(froxelCount);
+            mDirtyFlags |= VIEWPORT_CHANGED;
+        }
+    }
+    mPinnedFroxelCount = uint16_t(froxelCount);
+}
+
+void Froxelizer::updateFroxelCount(size_t lightCount) noexcept {
+    if (mPinnedFroxelCount || !lightCount) {
+        return;
+    }
+
+    // Many lights need small froxels to keep the lists of lights the shaders go through short,
+    // a few lights don't. The number of lights per occupied froxel doesn't depend much on the
+    // grid, it's high when lights overlap a lot.
+    size_t froxelCount = lightCount <= 8 ? FROXEL_COUNT_MIN :
+                         lightCount <= 32 ? FROXEL_COUNT_MIN * 2 :
+                         lightCount <= 128 ? FROXEL_COUNT_MIN * 4 : FROXEL_BUFFER_ENTRY_COUNT_MAX;
+    if (mOccupiedFroxelCount) {
+        const size_t lightsPerFroxel = mRecordBufferUsedCount / mOccupiedFroxelCount;
+        if (lightsPerFroxel >= 16) {
+            froxelCount *= 2;
+        } else if (lightsPerFroxel < 2) {
+            froxelCount /= 2;
+        }
+        // a finer grid needs more records, don't run out of them
+        if (mRecordBufferUsedCount >= RECORD_BUFFER_ENTRY_COUNT / 2) {
+            froxelCount = std::min(froxelCount, size_t(mFroxelCountTarget));
+        }
+    }
+    froxelCount = clamp(froxelCount, FROXEL_COUNT_MIN, FROXEL_BUFFER_ENTRY_COUNT_MAX);
+
+    if (froxelCount >= mFroxelCountTarget) {
+        mFroxelCountCooldown = FROXEL_COUNT_COOLDOWN;
+    } else if (mFroxelCountCooldown) {
+        mFroxelCountCooldown--;
+        return;
+    }
+    if (froxelCount != mFroxelCountTarget) {
+        mFroxelCountTarget = uint16_t(froxelCount);
+        mDirtyFlags |= VIEWPORT_CHANGED;
+    }
+}
 
 void Froxelizer::setViewport(Viewport const& viewport) noexcept {
     if (UTILS_UNLIKELY(mViewport != viewport)) {
@@ -147,6 +218,8 @@ bool Froxelizer::prepare(
     bool uniformsNeedUpdating = false;
     if (UTILS_UNLIKELY(mDirtyFlags)) {
         uniformsNeedUpdating = update();
+        // the froxels changed, the lights need to be froxelized again
+        mFroxelsValid = false;
     }
 
     /*
@@ -154,13 +227,13 @@ bool Froxelizer::prepare(
      * the command stream.
      */
 
-    // froxel buffer (~32 KiB)
+    // froxel buffer (~64 KiB)
     const uint32_t maxFroxelCount = FROXEL_BUFFER_WIDTH * FROXEL_BUFFER_HEIGHT;
     mFroxelBufferUser = {
             driverApi.allocatePod<FroxelEntry>(maxFroxelCount, CACHELINE_SIZE),
             maxFroxelCount };
 
-    // record buffer (~64 KiB)
+    // record buffer (~256 KiB)
     mRecordBufferUser = {
             driverApi.allocatePod<RecordBufferType>(RECORD_BUFFER_ENTRY_COUNT, CACHELINE_SIZE),
             RECORD_BUFFER_ENTRY_COUNT };
@@ -204,13 +277,18 @@ bool Froxelizer::prepare(
 
 void Froxelizer::computeFroxelLayout(
         uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-        Viewport const& viewport) noexcept {
+        Viewport const& viewport, size_t froxelCount) noexcept {
+
+    assert(froxelCount <= FROXEL_BUFFER_ENTRY_COUNT_MAX);
+
+    // the smaller grids also have fewer slices, so they keep more froxels in the x-y plane
+    const size_t froxelSliceCount = froxelCount < FROXEL_COUNT_FEW_SLICES ?
+            FEngine::CONFIG_FROXEL_SLICE_COUNT / 2 : FEngine::CONFIG_FROXEL_SLICE_COUNT;
 
     if (SUPPORTS_NON_SQUARE_FROXELS == false) {
-        // calculate froxel dimension from FROXEL_BUFFER_ENTRY_COUNT_MAX and viewport
+        // calculate froxel dimension from froxelCount and viewport
         // - Start from the maximum number of froxels we can use in the x-y plane
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
-        size_t froxelPlaneCount = FROXEL_BUFFER_ENTRY_COUNT_MAX / froxelSliceCount;
+        size_t froxelPlaneCount = froxelCount / froxelSliceCount;
         // - compute the number of square froxels we need in width and height, rounded down
         //   solving: |  froxelCountX * froxelCountY == froxelPlaneCount
         //            |  froxelCountX / froxelCountY == width / height
@@ -238,7 +316,7 @@ void Froxelizer::computeFroxelLayout(
         if (viewport.height > viewport.width) {
             std::swap(*countX, *countY);
         }
-        *countZ = uint16_t(FEngine::CONFIG_FROXEL_SLICE_COUNT);
+        *countZ = uint16_t(froxelSliceCount);
          dim->x = (viewport.width  + *countX - 1) / *countX;
          dim->y = (viewport.height + *countY - 1) / *countY;
     }
@@ -252,7 +330,8 @@ bool Froxelizer::update() noexcept {
 
         uint2 froxelDimension;
         uint16_t froxelCountX, froxelCountY, froxelCountZ;
-        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ, viewport);
+        computeFroxelLayout(&froxelDimension, &froxelCountX, &froxelCountY, &froxelCountZ,
+                viewport, mFroxelCountTarget);
 
         mFroxelDimension = froxelDimension;
         mClipToFroxelX = (0.5f * viewport.width)  / froxelDimension.x;
@@ -262,12 +341,12 @@ bool Froxelizer::update() noexcept {
         uniformsNeedUpdating = true;
 
 #ifndef NDEBUG
-        size_t froxelSliceCount = FEngine::CONFIG_FROXEL_SLICE_COUNT;
+        size_t froxelSliceCount = froxelCountZ;
         slog.d << "Froxel: " << viewport.width << "x" << viewport.height << " / "
                << froxelDimension.x << "x" << froxelDimension.y << io::endl
                << "Froxel: " << froxelCountX << "x" << froxelCountY << "x" << froxelSliceCount
                << " = " << (froxelCountX * froxelCountY * froxelSliceCount)
-               << " (" << FROXEL_BUFFER_ENTRY_COUNT_MAX - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
+               << " (" << mFroxelCountTarget - froxelCountX * froxelCountY * froxelSliceCount << " lost)"
                << io::endl;
 #endif
 
@@ -524,25 +603,75 @@ void Froxelizer::commit(driver::DriverApi& driverApi) {
 #endif
 }
 
-void Froxelizer::froxelizeLights(FEngine& engine,
+uint32_t Froxelizer::computeLightsHash(FEngine& engine,
+        math::mat4f const& viewMatrix, const FScene::LightSoa& lightData) const noexcept {
+    // this needs to cover everything froxelizeLoop() reads, the lights' colors and intensities
+    // don't matter here.
+    struct LightKey {
+        float4 sphere;
+        float3 direction;
+        float cosSqr;
+        float invSin;
+        uint32_t instance;
+    };
+    static_assert(sizeof(LightKey) == 10 * sizeof(uint32_t), "LightKey can't have padding");
+
+    auto& lcm = engine.getLightManager();
+    auto const* UTILS_RESTRICT spheres      = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
+    auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+
+    const uint32_t count = uint32_t(lightData.size());
+    uint32_t h = hash::murmur3(&count, 1, 0);
+    h = hash::murmur3(reinterpret_cast<uint32_t const*>(&viewMatrix), sizeof(mat4f) / 4, h);
+    h = hash::murmur3(reinterpret_cast<uint32_t const*>(&mProjection), sizeof(mat4f) / 4, h);
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT; i < count; i++) {
+        FLightManager::Instance li = instances[i];
+        const LightKey key = {
+                .sphere = spheres[i],
+                .direction = directions[i],
+                .cosSqr = lcm.getCosOuterSquared(li),
+                .invSin = lcm.getSinInverse(li),
+                .instance = li.asValue()
+        };
+        h = hash::murmur3(reinterpret_cast<uint32_t const*>(&key), sizeof(key) / 4, h);
+    }
+    return h;
+}
+
+bool Froxelizer::froxelizeLights(FEngine& engine,
         math::mat4f const& viewMatrix, const FScene::LightSoa& lightData) noexcept {
 
     // note: this is called asynchronously
 
+    // nothing to do if the froxels and lights are the same as last time, the GPU buffers
+    // are not invalidated and keep the last froxelization.
+    const uint32_t hash = computeLightsHash(engine, viewMatrix, lightData);
+    if (mFroxelsValid && hash == mLightsHash) {
+        return false;
+    }
+    mLightsHash = hash;
+    mFroxelsValid = true;
+
     // now that we know the light count, we can shrink the size of mFroxelListIndices
     // (account for the extra directional light)
     mFroxelListIndices.set(mFroxelListIndices.data(),
             uint32_t(lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT));
 
+    sortLightsByDepth(viewMatrix, lightData);
     froxelizeLoop(engine, mFroxelList, mFroxelListIndices, viewMatrix, lightData);
-    froxelizeAssignRecordsCompress(mFroxelList, mFroxelListIndices);
+    froxelizeAssignRecordsCompress(engine, mFroxelList, mFroxelListIndices);
 
 #ifndef NDEBUG
     if (lightData.size()) {
-        // go through every froxel
-        auto const& gpuFroxelEntries(mFroxelBufferUser);
+        // go through every froxel of the viewport, the others aren't written
+        const Slice<const FroxelEntry> gpuFroxelEntries(
+                mFroxelBufferUser.cbegin(), getFroxelCount());
         auto const& recordBufferUser(mRecordBufferUser);
-        for (auto const& entry : gpuFroxelEntries) {
+        const size_t froxelSliceSize = size_t(mFroxelCountX) * mFroxelCountY;
+        for (size_t fi = 0; fi < gpuFroxelEntries.size(); fi++) {
+            auto const& entry = gpuFroxelEntries[fi];
+            ZBin const& bin = mZBins[fi / froxelSliceSize];
             // go through every lights for that froxel
             for (size_t i = 0; i < entry.pointLightCount + entry.spotLightCount; i++) {
                 // get the light index
@@ -553,10 +682,62 @@ void Froxelizer::froxelizeLights(FEngine& engine,
 
                 // make sure it corresponds to an existing light
                 assert(lightIndex < lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
+
+                // and that it's in the z-bin of the froxel's slice
+                assert(std::any_of(mDepthSortedLights + bin.begin, mDepthSortedLights + bin.end,
+                        [lightIndex](DepthSortedLight const& l) { return l.light == lightIndex; }));
             }
         }
     }
 #endif
+
+    return true;
+}
+
+void Froxelizer::sortLightsByDepth(mat4f const& viewMatrix,
+        const FScene::LightSoa& lightData) noexcept {
+    SYSTRACE_CALL();
+
+    auto const* UTILS_RESTRICT spheres = lightData.data<FScene::POSITION_RADIUS>();
+    DepthSortedLight* const UTILS_RESTRICT sorted = mDepthSortedLights;
+
+    // find the z slices of each light, from its view-space bounding-box
+    size_t count = 0;
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
+        const float z = (viewMatrix * float4{ spheres[i].xyz, 1 }).z;
+        const float radius = spheres[i].w;
+        if (UTILS_UNLIKELY(z + radius < -mZLightFar)) { // z values are negative
+            // This light is fully behind LightFar, it doesn't light anything
+            // (we could avoid this check if we culled lights using LightFar instead of the
+            // culling camera's far plane)
+            continue;
+        }
+        sorted[count++] = {
+                .light = uint16_t(i - FScene::DIRECTIONAL_LIGHTS_COUNT),
+                .z0 = uint8_t(findSliceZ(std::min(-mNear, z + radius))),
+                .z1 = uint8_t(findSliceZ(z - radius))
+        };
+    }
+
+    // ties are broken by the light's index, so that the order doesn't change between frames
+    std::sort(sorted, sorted + count, [](DepthSortedLight const& lhs, DepthSortedLight const& rhs) {
+        return lhs.z0 < rhs.z0 || (lhs.z0 == rhs.z0 && lhs.light < rhs.light);
+    });
+    mDepthSortedLightCount = uint16_t(count);
+
+    // each light extends the range of the slices it touches, empty slices end up with an
+    // empty range
+    ZBin* const UTILS_RESTRICT bins = mZBins;
+    std::fill_n(bins, mFroxelCountZ, ZBin{ uint16_t(count), 0 });
+    for (size_t i = 0; i < count; i++) {
+        for (size_t iz = sorted[i].z0; iz <= sorted[i].z1; iz++) {
+            bins[iz].begin = std::min(bins[iz].begin, uint16_t(i));
+            bins[iz].end = uint16_t(i + 1);
+        }
+    }
+    for (size_t iz = 0; iz < mFroxelCountZ; iz++) {
+        bins[iz].begin = std::min(bins[iz].begin, bins[iz].end);
+    }
 }
 
 void Froxelizer::froxelizeLoop(FEngine& engine, utils::Slice<uint16_t>& froxelsList,
@@ -580,9 +761,11 @@ void Froxelizer::froxelizeLoop(FEngine& engine, utils::Slice<uint16_t>& froxelsL
         const mat4f& projection = mProjection;
         const mat3f& vn = viewMatrix.upperLeft();
         FroxelRunEntry* const UTILS_RESTRICT indices = froxelsListIndices.begin();
+        DepthSortedLight const* const UTILS_RESTRICT sorted = mDepthSortedLights;
 
-        for (size_t i = s; i < s + c; ++i) {
-            size_t gpuIndex = i - FScene::DIRECTIONAL_LIGHTS_COUNT;
+        for (size_t j = s; j < s + c; ++j) {
+            size_t gpuIndex = sorted[j].light;
+            size_t i = gpuIndex + FScene::DIRECTIONAL_LIGHTS_COUNT;
             FLightManager::Instance li = instances[i];
             LightParams light = {
                     .position = (viewMatrix * float4{ spheres[i].xyz, 1 }).xyz, // to view-space
@@ -590,6 +773,8 @@ void Froxelizer::froxelizeLoop(FEngine& engine, utils::Slice<uint16_t>& froxelsL
                     .axis = vn * directions[i],             // spot only
                     .invSin = lcm.getSinInverse(li),        // spot only
                     .radius = spheres[i].w,
+                    .z0 = sorted[j].z0,
+                    .z1 = sorted[j].z1,
             };
 
             // find froxels affected by this light and record them in the list
@@ -608,25 +793,47 @@ void Froxelizer::froxelizeLoop(FEngine& engine, utils::Slice<uint16_t>& froxelsL
         }
     };
 
-    // let's do at least 4 lights per Job.
+    // The lights culled by sortLightsByDepth() don't touch any froxel, they only have the
+    // entry holding their index/type.
+    {
+        const uint32_t froxelCount = mFroxelCountX * mFroxelCountY * mFroxelCountZ;
+        FroxelRunEntry* const UTILS_RESTRICT indices = froxelsListIndices.begin();
+        for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
+            size_t gpuIndex = i - FScene::DIRECTIONAL_LIGHTS_COUNT;
+            FLightManager::Type type = lcm.getType(instances[i]);
+            uint32_t index = uint32_t(gpuIndex * (froxelCount + 1));
+            froxelsList[index] = (uint16_t(gpuIndex) << 1) |
+                    uint16_t(type == FLightManager::Type::POINT ? 0 : 1);
+            indices[gpuIndex] = { index, 1 };
+        }
+    }
+
+    // the lights are processed in depth order, let's do at least 4 lights per Job.
     JobSystem& js = engine.getJobSystem();
     auto job = jobs::parallel_for(js, nullptr,
-            1, uint32_t(lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT),
+            0, mDepthSortedLightCount,
             std::cref(process), jobs::CountSplitter<4, SINGLE_THREADED ? 0 : 8>());
-    js.runAndWait(job);
+    js.setName(job, "Froxelizer::froxelizeLoop");
+    js.run(job);
+    js.waitAndRelease(job);
 }
 
-void Froxelizer::froxelizeAssignRecordsCompress(
+void Froxelizer::froxelizeAssignRecordsCompress(FEngine& engine,
         const utils::Slice<uint16_t>& froxelsList,
         const utils::Slice<FroxelRunEntry>& froxelsListIndices) noexcept {
 
     SYSTRACE_CALL();
+    constexpr bool SINGLE_THREADED = false;
 
     Slice<FroxelEntry> gpuFroxelEntries(mFroxelBufferUser);
     utils::Slice<LightRecord> records(mLightRecords);
-    memset(records.data(), 0, records.sizeInBytes());
 
-    bitset256 spotLights;
+    // the froxels past the viewport's are never read by the shaders
+    const size_t froxelCount = getFroxelCount();
+    assert(froxelCount <= records.size());
+    memset(records.data(), 0, froxelCount * sizeof(LightRecord));
+
+    LightRecord::bitset spotLights;
     for (size_t i = 0, c = froxelsListIndices.size(); i < c; ++i) {
         // (skip first entry, which is the light's index)
         const int isSpotLight = froxelsList[froxelsListIndices[i].index] & 1;
@@ -642,60 +849,129 @@ void Froxelizer::froxelizeAssignRecordsCompress(
     // 1/ compacting better and 2/ go through less data. In practice, it didn't seem to help
     // compaction much.
 
-    // todo: pld in main loop (not easy because variable size steps)
+    /*
+     * Consecutive froxels with the same lights share their records. The froxels are processed
+     * in chunks, in parallel: the records of each chunk are counted first, a prefix sum over
+     * the chunks gives the offset of their records, and then each chunk writes its records and
+     * its froxels. A run of froxels spanning two chunks is split, which costs a few records.
+     */
+    constexpr size_t CHUNK_SIZE = 256;
+    constexpr size_t CHUNK_COUNT_MAX =
+            (FROXEL_BUFFER_ENTRY_COUNT_MAX + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    struct Chunk {
+        uint32_t recordCount;   // records needed by the chunk's froxels
+        uint32_t offset;        // of the chunk's records in the record buffer
+        uint32_t end;           // end of the records written by the chunk, 0 if none
+        uint32_t occupied;      // froxels with at least one light
+    };
+    Chunk chunks[CHUNK_COUNT_MAX];
+    const uint32_t chunkCount = uint32_t((froxelCount + CHUNK_SIZE - 1) / CHUNK_SIZE);
+
+    LightRecord const* const UTILS_RESTRICT lights = records.data();
+
+    auto countRecords = [&chunks, lights, froxelCount](uint32_t s, uint32_t c) {
+        for (size_t j = s; j < s + c; j++) {
+            uint32_t recordCount = 0;
+            const size_t e = std::min((j + 1) * CHUNK_SIZE, froxelCount);
+            for (size_t i = j * CHUNK_SIZE; i < e;) {
+                auto const& b = lights[i].lights;
+                recordCount += b.count();
+                do {
+                    i++;
+                } while (i < e && lights[i].lights == b);
+            }
+            chunks[j].recordCount = recordCount;
+        }
+    };
 
-    uint16_t offset = 0;
-    FroxelEntry* const UTILS_RESTRICT froxels = gpuFroxelEntries.data();
-    RecordBufferType* UTILS_RESTRICT froxelRecords = mRecordBufferUser.data();
+    auto writeRecords = [&chunks, &spotLights, lights, froxelCount,
+            froxels = gpuFroxelEntries.data(),
+            froxelRecords = mRecordBufferUser.data()](uint32_t s, uint32_t c) {
+        for (size_t j = s; j < s + c; j++) {
+            uint32_t offset = chunks[j].offset;
+            uint32_t end = 0;
+            uint32_t occupied = 0;
+            const size_t e = std::min((j + 1) * CHUNK_SIZE, froxelCount);
+            for (size_t i = j * CHUNK_SIZE; i < e;) {
+                auto const& b = lights[i].lights;
+                const FroxelEntry entry = {
+                        .offset = offset,
+                        .pointLightCount = uint16_t((b & ~spotLights).count()),
+                        .spotLightCount  = uint16_t((b &  spotLights).count())
+                };
+                const uint32_t lightCount = entry.count[0] + entry.count[1];
+
+                if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+                    // Out of space, the offsets only grow so this is also the case of all the
+                    // next froxels, including the next chunks'.
+                    // note: instead of dropping froxels we could look for similar records we've
+                    // already filed up.
+                    do { // this compiles to memset()
+                        froxels[i++].u64 = 0;
+                    } while (i < e);
+                    break;
+                }
 
-    // how many froxel record entries were reused (for debugging)
-    UTILS_UNUSED size_t reused = FROXEL_BUFFER_ENTRY_COUNT_MAX;
+                // iterate the bitfield
+                b.forEachSetBit([&spotLights,
+                        point = froxelRecords + offset,
+                        spot = froxelRecords + offset + entry.count[0]](size_t l) mutable {
+                            (spotLights[l] ? *spot++ : *point++) = (RecordBufferType) l;
+                        });
+                offset += lightCount;
+                end = offset;
+
+                // note: we can't use partition_point() here because we're not sorted
+                const size_t first = i;
+                do {
+                    froxels[i++].u64 = entry.u64;
+                } while (i < e && lights[i].lights == b);
+                occupied += lightCount ? i - first : 0;
+            }
+            chunks[j].end = end;
+            chunks[j].occupied = occupied;
+        }
+    };
 
-    for (size_t i = 0, c = records.size(); i < c;) {
-#ifndef NDEBUG
-        reused--;
-#endif
-        auto const& b = records[i];
-        const FroxelEntry entry = {
-                .offset = offset,
-                .pointLightCount = uint8_t((b.lights & ~spotLights).count()),
-                .spotLightCount  = uint8_t((b.lights &  spotLights).count())
-        };
-        const uint8_t lightCount = entry.count[0] + entry.count[1];
-        assert(lightCount <= froxelsListIndices.size());
+    JobSystem& js = engine.getJobSystem();
+    auto job = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(countRecords), jobs::CountSplitter<2, SINGLE_THREADED ? 0 : 8>());
+    js.setName(job, "Froxelizer::countRecords");
+    js.runAndWait(job);
+
+    uint32_t offset = 0;
+    for (size_t j = 0; j < chunkCount; j++) {
+        chunks[j].offset = offset;
+        offset += chunks[j].recordCount;
+    }
+
+    job = jobs::parallel_for(js, nullptr, 0, chunkCount,
+            std::cref(writeRecords), jobs::CountSplitter<2, SINGLE_THREADED ? 0 : 8>());
+    js.setName(job, "Froxelizer::writeRecords");
+    js.runAndWait(job);
 
-        if (UTILS_UNLIKELY(offset + lightCount >= RECORD_BUFFER_ENTRY_COUNT)) {
+    uint32_t used = 0;
+    size_t occupied = 0;
+    for (size_t j = 0; j < chunkCount; j++) {
+        used = std::max(used, chunks[j].end);
+        occupied += chunks[j].occupied;
+    }
 #ifndef NDEBUG
-            slog.d << "out of space: " << i << ", at " << offset << io::endl;
+    if (used < offset) {
+        slog.d << "out of space: " << offset << " records needed" << io::endl;
+    }
 #endif
-            // note: instead of dropping froxels we could look for similar records we've already
-            // filed up.
-            do { // this compiles to memset()
-                froxels[i++].u32 = 0;
-            } while(i < c);
-            goto out_of_memory;
-        }
 
-        // iterate the bitfield
-        b.lights.forEachSetBit([&spotLights,
-                point = froxelRecords + offset,
-                spot = froxelRecords + offset + entry.count[0]](size_t l) mutable {
-                    (spotLights[l] ? *spot++ : *point++) = (RecordBufferType) l;
-                });
-        offset += lightCount;
-
-        // note: we can't use partition_point() here because we're not sorted
-        do {
-            froxels[i++].u32 = entry.u32;
-        } while(i < c && records[i].lights == b.lights);
-    }
-out_of_memory:
+    mRecordBufferUsedCount = used;
+    mOccupiedFroxelCount = occupied;
 
-    // froxel buffer is always fully invalidated
-    mFroxelBuffer.invalidate();
+    // only the rows of the froxel buffer holding the viewport's froxels are uploaded
+    const size_t froxelRowCount =
+            (froxelCount + FROXEL_BUFFER_WIDTH_MASK) >> FROXEL_BUFFER_WIDTH_SHIFT;
+    mFroxelBuffer.invalidate(0, froxelRowCount);
 
     // needed record buffer size may change at each frame
-    mRecordsBuffer.invalidate(0, (offset + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT);
+    mRecordsBuffer.invalidate(0, (used + RECORD_BUFFER_WIDTH_MASK) >> RECORD_BUFFER_WIDTH_SHIFT);
 }
 
 static inline float2 project(mat4f const& p, float3 const& v) noexcept {
@@ -720,17 +996,70 @@ static inline float2 project(mat4f const& p, float3 const& v) noexcept {
     return float2{ x, y } * (1 / w);
 }
 
+std::pair<size_t, size_t> Froxelizer::findRowRange(float4 const* UTILS_RESTRICT planesX,
+        float4 const& UTILS_RESTRICT circle, size_t x0, size_t xcenter, size_t x1) noexcept {
+    // there is one more plane than froxels in a row, at most
+    constexpr size_t PLANE_X_COUNT_MAX =
+            FROXEL_BUFFER_ENTRY_COUNT_MAX / FEngine::CONFIG_FROXEL_SLICE_COUNT + 1;
+
+    // the planes tested by the searches below, xcenter can be outside of [x0, x1)
+    const size_t first = std::min(x0, xcenter + 1);
+    float4 const* const UTILS_RESTRICT planes = planesX + first;
+    const size_t count = std::max(xcenter + 1, x1) - first;
+    assert(count <= PLANE_X_COUNT_MAX);
+
+    // Testing all the planes is often more work than the searches would do, but this loop gets
+    // vectorized (8 planes per iteration with clang on arm64, and 4 or 8 on x86 depending on the
+    // target's SSE/AVX support) and doesn't branch.
+    uint8_t intersects[PLANE_X_COUNT_MAX];
+    #pragma clang loop vectorize_width(8)
+    for (size_t i = 0; i < count; i++) {
+        intersects[i] = uint8_t(spherePlaneDistanceSquared(circle, planes[i].x, planes[i].z) > 0);
+    }
+
+    // find the begin index (left side)
+    size_t bx = x0;
+    while (bx <= xcenter && !intersects[bx - first]) {
+        ++bx;
+    }
+
+    // find the end index (right side), x1 is past the end
+    size_t ex = x1;
+    while (ex - 1 > xcenter && !intersects[ex - 1 - first]) {
+        --ex;
+    }
+
+    return { bx, ex };
+}
+
+std::pair<size_t, size_t> Froxelizer::Test::findRowRange(float4 const* UTILS_RESTRICT planesX,
+        float4 const& UTILS_RESTRICT cy, size_t x0, size_t xcenter, size_t x1) noexcept {
+    size_t bx, ex;
+    // find the begin index (left side)
+    for (bx = x0; bx <= xcenter; ++bx) {
+        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
+            // intersection
+            break;
+        }
+    }
+
+    // find the end index (right side), x1 is past the end
+    for (ex = x1; --ex > xcenter;) {
+        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
+            // intersection
+            break;
+        }
+    }
+    ++ex;
+    return { bx, ex };
+}
+
 void Froxelizer::froxelizePointAndSpotLight(
         GrowingSlice<uint16_t>& UTILS_RESTRICT froxels,
         mat4f const& UTILS_RESTRICT p,
         const Froxelizer::LightParams& UTILS_RESTRICT light) const noexcept {
 
-    if (UTILS_UNLIKELY(light.position.z + light.radius < -mZLightFar)) { // z values are negative
-        // This light is fully behind LightFar, it doesn't light anything
-        // (we could avoid this check if we culled lights using LightFar instead of the
-        // culling camera's far plane)
-        return;
-    }
+    // note: the lights fully behind LightFar have been culled by sortLightsByDepth()
 
     // the code below works with radius^2
     const float4 s = { light.position, light.radius * light.radius };
@@ -763,12 +1092,12 @@ void Froxelizer::froxelizePointAndSpotLight(
     const auto imin = clipToIndices(min(xyLeftNear, xyLeftFar));
     const size_t x0 = imin.first;
     const size_t y0 = imin.second;
-    const size_t z0 = findSliceZ(znear);
+    const size_t z0 = light.z0;         // findSliceZ(znear), computed with the z-bins
 
     const auto imax = clipToIndices(max(xyRightNear, xyRightFar));
     const size_t x1 = imax.first  + 1;  // x1 points to 1 past the last value (like end() does
     const size_t y1 = imax.second;      // y1 points to the last value
-    const size_t z1 = findSliceZ(zfar); // z1 points to the last value
+    const size_t z1 = light.z1;         // z1 points to the last value, findSliceZ(zfar)
 
     assert(x0 < x1);
     assert(y0 <= y1);
@@ -801,23 +1130,10 @@ void Froxelizer::froxelizePointAndSpotLight(
                     cy = spherePlaneIntersection(cz, plane.y, plane.z);
                 }
                 if (cy.w > 0) { // intersection of light with this horizontal plane
-                    size_t bx, ex; // horizontal begin/end indices
-                    // find the begin index (left side)
-                    for (bx = x0; bx <= xcenter; ++bx) {
-                        if (spherePlaneDistanceSquared(cy, planesX[bx].x, planesX[bx].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
-
-                    // find the end index (right side), x1 is past the end
-                    for (ex = x1; --ex > xcenter;) {
-                        if (spherePlaneDistanceSquared(cy, planesX[ex].x, planesX[ex].z) > 0) {
-                            // intersection
-                            break;
-                        }
-                    }
-                    ++ex;
+                    // horizontal begin/end indices
+                    const auto range = findRowRange(planesX, cy, x0, xcenter, x1);
+                    size_t bx = range.first;
+                    const size_t ex = range.second;
 
                     if (UTILS_UNLIKELY(bx >= ex)) {
                         continue;
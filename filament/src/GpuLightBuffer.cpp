@@ -22,12 +22,15 @@
 
 #include <private/filament/UibGenerator.h>
 
+#include <algorithm>
+
 namespace filament {
 
 using namespace driver;
 
 namespace details {
 
+// the new uniform buffer is entirely dirty, it's uploaded as a whole by the first commit()
 GpuLightBuffer::GpuLightBuffer(FEngine& engine) noexcept
         : mLightsUb(UibGenerator::getLightsUib()) {
     DriverApi& driverApi = engine.getDriverApi();
@@ -42,8 +45,22 @@ void GpuLightBuffer::terminate(FEngine& engine) {
     driverApi.destroyUniformBuffer(mLightUbh);
 }
 
+void GpuLightBuffer::invalidate(LightIndex h) noexcept {
+    // the lights are written in order, so h usually extends the last range or starts a new one
+    if (mDirtyRangeCount) {
+        Range& range = mDirtyRanges[mDirtyRangeCount - 1];
+        if ((h >= range.first && h <= range.last + MERGE_DISTANCE) ||
+                mDirtyRangeCount == MAX_DIRTY_RANGES) {
+            range.first = std::min(range.first, h);
+            range.last = std::max(range.last, LightIndex(h + 1));
+            return;
+        }
+    }
+    mDirtyRanges[mDirtyRangeCount++] = { h, LightIndex(h + 1) };
+}
+
 void GpuLightBuffer::commit(FEngine& engine) noexcept {
-    if (UTILS_UNLIKELY(mLightsUb.isDirty())) {
+    if (UTILS_UNLIKELY(mLightsUb.isDirty() || mDirtyRangeCount)) {
         commitSlow(engine);
     }
     engine.getDriverApi().bindUniforms(BindingPoints::LIGHTS, mLightUbh);
@@ -51,8 +68,23 @@ void GpuLightBuffer::commit(FEngine& engine) noexcept {
 
 void GpuLightBuffer::commitSlow(FEngine& engine) noexcept {
     DriverApi& driverApi = engine.getDriverApi();
-    driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
-    mLightsUb.clean();
+    if (mLightsUb.isDirty()) {
+        // the whole buffer, the first time
+        engine.countUniformUpdate(mLightsUb);
+        driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
+        mLightsUb.clean();
+    } else {
+        // the driver uploads the dirty range of each update
+        for (size_t i = 0; i < mDirtyRangeCount; i++) {
+            Range const& range = mDirtyRanges[i];
+            mLightsUb.invalidateUniforms(range.first * sizeof(LightParameters),
+                    (range.last - range.first) * sizeof(LightParameters));
+            engine.countUniformUpdate(mLightsUb);
+            driverApi.updateUniformBuffer(mLightUbh, UniformBuffer(mLightsUb));
+            mLightsUb.clean();
+        }
+    }
+    mDirtyRangeCount = 0;
 }
 
 } // namespace details
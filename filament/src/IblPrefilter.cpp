@@ -0,0 +1,316 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/IblPrefilter.h"
+
+#include "details/Engine.h"
+#include "details/Texture.h"
+
+#include "driver/SamplerBuffer.h"
+
+#include "FilamentAPI-impl.h"
+
+#include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace math;
+
+namespace filament {
+
+using namespace details;
+using namespace driver;
+
+struct IblPrefilter::BuilderDetails {
+    Texture const* mEnvironment = nullptr;
+    uint32_t mSize = 256;
+    uint16_t mSampleCount = 1024;
+    size_t mSampleBudget = 32u * 1000u * 1000u;
+};
+
+using BuilderType = IblPrefilter;
+BuilderType::Builder::Builder() noexcept = default;
+BuilderType::Builder::~Builder() noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder::Builder(BuilderType::Builder&& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder const& rhs) noexcept = default;
+BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs) noexcept = default;
+
+
+IblPrefilter::Builder& IblPrefilter::Builder::environment(Texture const* texture) noexcept {
+    mImpl->mEnvironment = texture;
+    return *this;
+}
+
+IblPrefilter::Builder& IblPrefilter::Builder::size(uint32_t size) noexcept {
+    mImpl->mSize = size;
+    return *this;
+}
+
+IblPrefilter::Builder& IblPrefilter::Builder::sampleCount(uint16_t count) noexcept {
+    mImpl->mSampleCount = count;
+    return *this;
+}
+
+IblPrefilter::Builder& IblPrefilter::Builder::sampleBudget(size_t budget) noexcept {
+    mImpl->mSampleBudget = budget;
+    return *this;
+}
+
+IblPrefilter* IblPrefilter::Builder::build(Engine& engine) {
+    FTexture const* environment = upcast(mImpl->mEnvironment);
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(environment, "environment texture not set")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(
+            environment->getTarget() == Texture::Sampler::SAMPLER_CUBEMAP ||
+            environment->getTarget() == Texture::Sampler::SAMPLER_2D,
+            "the environment must be a cubemap or an equirectangular 2D texture")) {
+        return nullptr;
+    }
+
+    if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mSize && !(mImpl->mSize & (mImpl->mSize - 1)),
+            "size must be a power of two")) {
+        return nullptr;
+    }
+
+    return upcast(engine).createIblPrefilter(*this);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+namespace details {
+
+FIblPrefilter::FIblPrefilter(FEngine& engine, const Builder& builder)
+        : mSource(upcast(builder->mEnvironment)),
+          mUb(engine.getPerPostProcessUib()),
+          mSize(builder->mSize),
+          mLevels(uint8_t(std::log2(float(builder->mSize)) + 1)),
+          mSampleCount(std::max(builder->mSampleCount, uint16_t(1))),
+          mSampleBudget(builder->mSampleBudget),
+          mReadback(std::make_shared<Readback>()) {
+
+    DriverApi& driver = engine.getDriverApi();
+
+    auto createCubemap = [&]() {
+        return upcast(Texture::Builder()
+                .width(mSize)
+                .height(mSize)
+                .levels(mLevels)
+                .sampler(Texture::Sampler::SAMPLER_CUBEMAP)
+                .format(Texture::InternalFormat::RGBA16F)
+                .usage(Texture::Usage::COLOR_ATTACHMENT)
+                .build(engine));
+    };
+    mEnvironment = createCubemap();
+    mReflections = createCubemap();
+
+    // one texel per SH coefficient
+    mShTexture = driver.createTexture(SamplerType::SAMPLER_2D, 1, TextureFormat::RGBA16F, 1,
+            9, 1, 1, TextureUsage::COLOR_ATTACHMENT);
+    mShTarget = driver.createRenderTarget(TargetBufferFlags::COLOR, 9, 1, 1,
+            TextureFormat::RGBA16F, { mShTexture }, {}, {});
+
+    mUbh = driver.createUniformBuffer(engine.getPerPostProcessUib().getSize());
+    mSbh = driver.createSamplerBuffer(engine.getPostProcessSib().getSize());
+}
+
+void FIblPrefilter::terminate(FEngine& engine) {
+    DriverApi& driver = engine.getDriverApi();
+    driver.destroyUniformBuffer(mUbh);
+    driver.destroySamplerBuffer(mSbh);
+    driver.destroyRenderTarget(mShTarget);
+    driver.destroyTexture(mShTexture);
+    engine.destroy(mReflections);
+    engine.destroy(mEnvironment);
+}
+
+void FIblPrefilter::restart() noexcept {
+    // a pending readback completes in the old Readback, which it keeps alive
+    if (mStep == Step::READBACK) {
+        mReadback = std::make_shared<Readback>();
+    }
+    mStep = Step::ENVIRONMENT;
+    mLevel = 0;
+    mFace = 0;
+}
+
+void FIblPrefilter::setParameters(FEngine& engine, uint8_t face, float linearRoughness,
+        size_t sampleCount) noexcept {
+    UniformBuffer& ub = mUb;
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblFace), float(face));
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblLinearRoughness), linearRoughness);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblSampleCount), float(sampleCount));
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, iblMaxLevel), float(mLevels - 1));
+    engine.countUniformUpdate(ub);
+    engine.getDriverApi().updateUniformBuffer(mUbh, UniformBuffer(ub));
+}
+
+void FIblPrefilter::draw(FEngine& engine, PostProcessStage stage,
+        Handle<HwRenderTarget> target, uint32_t width, uint32_t height) noexcept {
+    DriverApi& driver = engine.getDriverApi();
+
+    Driver::RasterState rs;
+    rs.culling = Driver::RasterState::CullingMode::NONE;
+    rs.colorWrite = true;
+    rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+    RenderPassParams params = {};
+    params.width = width;
+    params.height = height;
+    params.discardStart = TargetBufferFlags::COLOR;
+
+    driver.beginRenderPass(target, params);
+    driver.draw(engine.getPostProcessProgram(stage), rs, engine.getFullScreenRenderPrimitive());
+    driver.endRenderPass();
+}
+
+bool FIblPrefilter::update(FEngine& engine) noexcept {
+    if (mStep == Step::DONE) {
+        return true;
+    }
+
+    SYSTRACE_CALL();
+
+    DriverApi& driver = engine.getDriverApi();
+    driver.bindUniforms(BindingPoints::POST_PROCESS, mUbh);
+    driver.bindSamplers(BindingPoints::POST_PROCESS, mSbh);
+
+    SamplerParams linear;
+    linear.filterMag = SamplerMagFilter::LINEAR;
+    linear.filterMin = SamplerMinFilter::LINEAR_MIPMAP_LINEAR;
+
+    auto drawFace = [&](FTexture* cubemap, uint8_t level, uint8_t face, PostProcessStage stage) {
+        const uint32_t dim = std::max(1u, mSize >> level);
+        Handle<HwRenderTarget> target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+                dim, dim, 1, TextureFormat::RGBA16F,
+                { cubemap->getHwHandle(), level, TextureCubemapFace(face) }, {}, {});
+        draw(engine, stage, target, dim, dim);
+        driver.destroyRenderTarget(target);
+    };
+
+    // the reflections and the irradiance sample the environment's mipmaps
+    auto useEnvironment = [&]() {
+        SamplerBuffer sb(engine.getPostProcessSib());
+        sb.setSampler(FEngine::PostProcessSib::ENVIRONMENT, mEnvironment->getHwHandle(), linear);
+        driver.updateSamplerBuffer(mSbh, std::move(sb));
+    };
+
+    if (mStep == Step::ENVIRONMENT) {
+        // the environment is drawn as is (i.e. with a roughness of 0), it's cheap
+        const bool equirectangular = mSource->getTarget() == Texture::Sampler::SAMPLER_2D;
+        SamplerBuffer sb(engine.getPostProcessSib());
+        sb.setSampler(equirectangular ?
+                FEngine::PostProcessSib::COLOR_BUFFER : FEngine::PostProcessSib::ENVIRONMENT,
+                mSource->getHwHandle(), linear);
+        driver.updateSamplerBuffer(mSbh, std::move(sb));
+        for (uint8_t face = 0; face < 6; face++) {
+            setParameters(engine, face, 0.0f, 1);
+            drawFace(mEnvironment, 0, face, equirectangular ?
+                    PostProcessStage::IBL_EQUIRECTANGULAR : PostProcessStage::IBL_PREFILTER);
+        }
+        driver.generateMipmaps(mEnvironment->getHwHandle());
+        mStep = Step::REFLECTIONS;
+    } else if (mStep == Step::REFLECTIONS) {
+        useEnvironment();
+
+        // at least one face is drawn per update, the following ones within the budget
+        size_t samples = 0;
+        while (mStep == Step::REFLECTIONS) {
+            const uint32_t dim = std::max(1u, mSize >> mLevel);
+            const size_t sampleCount = mLevel ? getSampleCount(mLevel) : 1;
+            const size_t cost = size_t(dim) * dim * sampleCount;
+            if (samples && samples + cost > mSampleBudget) {
+                break;
+            }
+            samples += cost;
+
+            const float roughness = mLevels > 1 ? float(mLevel) / (mLevels - 1) : 0.0f;
+            setParameters(engine, mFace, roughness * roughness, sampleCount);
+            drawFace(mReflections, mLevel, mFace, PostProcessStage::IBL_PREFILTER);
+
+            if (++mFace == 6) {
+                mFace = 0;
+                if (++mLevel == mLevels) {
+                    mStep = Step::IRRADIANCE;
+                }
+            }
+        }
+    } else if (mStep == Step::IRRADIANCE) {
+        useEnvironment();
+        setParameters(engine, 0, 0.0f, 1);
+        draw(engine, PostProcessStage::IBL_SPHERICAL_HARMONICS, mShTarget, 9, 1);
+
+        // the callback's user data keeps the readback alive, we could be gone by then
+        Readback* const readback = mReadback.get();
+        readback->ready.store(false, std::memory_order_relaxed);
+        driver.readPixels(mShTarget, 0, 0, 9, 1,
+                PixelBufferDescriptor(readback->sh, sizeof(readback->sh),
+                        PixelDataFormat::RGBA, PixelDataType::FLOAT,
+                        [](void*, size_t, void* user) {
+                            auto* p = static_cast<std::shared_ptr<Readback>*>(user);
+                            (*p)->ready.store(true, std::memory_order_release);
+                            delete p;
+                        }, new std::shared_ptr<Readback>(mReadback)));
+        mStep = Step::READBACK;
+    } else if (mStep == Step::READBACK) {
+        if (mReadback->ready.load(std::memory_order_acquire)) {
+            for (size_t i = 0; i < 9; i++) {
+                mIrradiance[i] = mReadback->sh[i].rgb;
+            }
+            mStep = Step::DONE;
+        }
+    }
+
+    // the post-processing uses the same binding point
+    engine.getPostProcessManager().bindBuffers(driver);
+
+    return mStep == Step::DONE;
+}
+
+} // namespace details
+
+// ------------------------------------------------------------------------------------------------
+// Trampoline calling into private implementation
+// ------------------------------------------------------------------------------------------------
+
+using namespace details;
+
+bool IblPrefilter::update(Engine& engine) noexcept {
+    return upcast(this)->update(upcast(engine));
+}
+
+void IblPrefilter::restart() noexcept {
+    upcast(this)->restart();
+}
+
+bool IblPrefilter::isReady() const noexcept {
+    return upcast(this)->isReady();
+}
+
+Texture const* IblPrefilter::getReflections() const noexcept {
+    return upcast(this)->getReflections();
+}
+
+math::float3 const* IblPrefilter::getIrradiance() const noexcept {
+    return upcast(this)->getIrradiance();
+}
+
+} // namespace filament
@@ -113,6 +113,8 @@ FIndirectLight::FIndirectLight(FEngine& engine, const Builder& builder) noexcept
 
     if (builder->mReflectionsMap) {
         mReflectionsMapHandle = upcast(builder->mReflectionsMap)->getHwHandle();
+        mReflectionsMapRgbm =
+                upcast(builder->mReflectionsMap)->getFormat() == Texture::InternalFormat::RGBM;
     }
 
     std::copy(
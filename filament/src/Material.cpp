@@ -31,8 +31,10 @@
 
 #include <filaflat/MaterialParser.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
+#include <algorithm>
 #include <sstream>
 
 using namespace utils;
@@ -47,6 +49,8 @@ using namespace driver;
 struct Material::BuilderDetails {
     const void* mPayload = nullptr;
     size_t mSize = 0;
+    Material::Builder::Callback mCallback = nullptr;
+    void* mUser = nullptr;
     filaflat::MaterialParser* mMaterialParser = nullptr;
     bool mDefaultMaterial = false;
 };
@@ -66,14 +70,30 @@ BuilderType::Builder& BuilderType::Builder::operator=(BuilderType::Builder&& rhs
 Material::Builder& Material::Builder::package(const void* payload, size_t size) {
     mImpl->mPayload = payload;
     mImpl->mSize = size;
+    mImpl->mCallback = nullptr;
+    mImpl->mUser = nullptr;
+    return *this;
+}
+
+Material::Builder& Material::Builder::package(const void* payload, size_t size,
+        Callback callback, void* user) {
+    mImpl->mPayload = payload;
+    mImpl->mSize = size;
+    mImpl->mCallback = callback;
+    mImpl->mUser = user;
     return *this;
 }
 
 Material* Material::Builder::build(Engine& engine) {
-    MaterialParser* materialParser = new MaterialParser(
-            upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
+    // without a callback the package is copied, otherwise it is referenced until the material
+    // is destroyed
+    MaterialParser* materialParser = mImpl->mCallback ?
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize,
+                    mImpl->mCallback, mImpl->mUser) :
+            new MaterialParser(upcast(engine).getBackend(), mImpl->mPayload, mImpl->mSize);
     bool materialOK = materialParser->parse() && materialParser->isShadingMaterial();
     if (!ASSERT_POSTCONDITION_NON_FATAL(materialOK, "could not parse the material package")) {
+        delete materialParser;
         return nullptr;
     }
 
@@ -91,6 +111,7 @@ Material* Material::Builder::build(Engine& engine) {
             "the material '%s' does not contain shaders compatible with this platform; "
             "need shader model %d but have 0x%02x", name.c_str_safe(), sm,
             shaderModels.getValue())) {
+        delete materialParser;
         return nullptr;
     }
 
@@ -107,6 +128,7 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
 {
     MaterialParser* parser = builder->mMaterialParser;
     mMaterialParser = parser;
+    mPackageSize = builder->mSize;
 
     UTILS_UNUSED_IN_RELEASE bool nameOk = parser->getName(&mName);
     assert(nameOk);
@@ -117,9 +139,14 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     UTILS_UNUSED_IN_RELEASE bool uibOK = parser->getUIB(&mUniformInterfaceBlock);
     assert(uibOK);
 
+    if (engine.getConfig().sharedMaterialInstanceUniforms && !mUniformInterfaceBlock.isEmpty()) {
+        constexpr size_t alignment = FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
+        mInstancesStride = (mUniformInterfaceBlock.getSize() + alignment - 1) & ~(alignment - 1);
+    }
+
     // Sampler bindings are only required for Vulkan.
     UTILS_UNUSED_IN_RELEASE bool sbOK = parser->getSamplerBindingMap(&mSamplerBindings);
-    assert(engine.getBackend() == Backend::OPENGL || sbOK);
+    assert(engine.getBackend() != Backend::VULKAN || sbOK);
 
     parser->getShading(&mShading);
     parser->getBlendingMode(&mBlendingMode);
@@ -133,6 +160,7 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
         parser->hasShadowMultiplier(&mHasShadowMultiplier);
     }
     mIsVariantLit = mShading != Shading::UNLIT || mHasShadowMultiplier;
+    parser->hasPunctualLights(&mHasPunctualLights);
 
     // create raster state
     using BlendFunction = Driver::RasterState::BlendFunction;
@@ -201,11 +229,18 @@ FMaterial::FMaterial(FEngine& engine, const Material::Builder& builder)
     parser->hasCustomDepthShader(&mHasCustomDepthShader);
     mIsDefaultMaterial = builder->mDefaultMaterial;
 
+    // instancing can be filtered out of the material, or not apply to its vertex domain
+    // (this only reads the shader index, the shaders are decoded when a program is first needed)
+    mHasInstancing = parser->hasShader(engine.getDriver().getShaderModel(),
+            Variant::INSTANCING, ShaderType::VERTEX);
+    mHasStereo = parser->hasShader(engine.getDriver().getShaderModel(),
+            Variant::STEREO, ShaderType::VERTEX);
+
     // pre-cache the shared variants -- these variants are shared with the default material.
     if (UTILS_UNLIKELY(!mIsDefaultMaterial && !mHasCustomDepthShader)) {
         auto& cachedPrograms = mCachedPrograms;
         for (uint8_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
-            if (Variant(i).isDepthPass()) {
+            if (Variant(i).isDepthPass() && !Variant::isReserved(i)) {
                 cachedPrograms[i] = engine.getDefaultMaterial()->getProgram(i);
             }
         }
@@ -229,18 +264,73 @@ void FMaterial::terminate(FEngine& engine) {
     DriverApi& driverApi = engine.getDriverApi();
     auto& cachedPrograms = mCachedPrograms;
     for (size_t i = 0, n = cachedPrograms.size(); i < n; ++i) {
-        if (!mIsDefaultMaterial) {
-            // The depth variants may be shared with the default material, in which case
-            // we should not free it now.
-            bool isSharedVariant = Variant(i).isDepthPass() && !mHasCustomDepthShader;
-            if (isSharedVariant) {
-                // we don't own this variant, skip.
-                continue;
-            }
+        // The depth variants may be shared with the default material, in which case
+        // we should not free it now.
+        if (isSharedProgram(i)) {
+            // we don't own this variant, skip.
+            continue;
         }
         driverApi.destroyProgram(cachedPrograms[i]);
     }
     mDefaultInstance.terminate(engine);
+    if (mInstancesUbh) {
+        driverApi.destroyUniformBuffer(mInstancesUbh);
+    }
+}
+
+uint32_t FMaterial::acquireInstanceUniforms() const noexcept {
+    assert(mInstancesStride);
+    if (!mInstancesFreeSlots.empty()) {
+        const uint32_t slot = mInstancesFreeSlots.back();
+        mInstancesFreeSlots.pop_back();
+        return slot;
+    }
+    const uint32_t slot = mInstancesSlotCount++;
+    const size_t size = mInstancesSlotCount * mInstancesStride;
+    if (UTILS_UNLIKELY(size > mInstancesUniforms.getSize())) {
+        // leave some room to not reallocate each time a few instances are created, the
+        // driver's buffer is resized by the next commitInstanceUniforms()
+        UniformBuffer uniforms(size + size / 2);
+        if (mInstancesUniforms.getSize()) {
+            memcpy(uniforms.invalidateUniforms(0, mInstancesUniforms.getSize()),
+                    mInstancesUniforms.getBuffer(), mInstancesUniforms.getSize());
+        }
+        mInstancesUniforms = std::move(uniforms);
+    }
+    return slot;
+}
+
+void FMaterial::releaseInstanceUniforms(uint32_t slot) const noexcept {
+    mInstancesFreeSlots.push_back(slot);
+}
+
+void FMaterial::setInstanceUniforms(uint32_t slot, UniformBuffer const& uniforms) const noexcept {
+    // only the range the instance changed is copied, the dirty ranges of all the instances
+    // coalesce into the one uploaded by commitInstanceUniforms()
+    const size_t offset = uniforms.getDirtyOffset();
+    const size_t size = uniforms.getDirtySize();
+    memcpy(mInstancesUniforms.invalidateUniforms(slot * mInstancesStride + offset, size),
+            static_cast<char const*>(uniforms.getBuffer()) + offset, size);
+}
+
+void FMaterial::commitInstanceUniforms(FEngine& engine) const noexcept {
+    if (!mInstancesStride) {
+        return;
+    }
+    DriverApi& driverApi = engine.getDriverApi();
+    if (UTILS_UNLIKELY(mInstancesUniforms.getSize() > mInstancesUbSize)) {
+        if (mInstancesUbh) {
+            driverApi.destroyUniformBuffer(mInstancesUbh);
+        }
+        mInstancesUbSize = mInstancesUniforms.getSize();
+        mInstancesUbh = driverApi.createUniformBuffer(mInstancesUbSize);
+        // the new buffer needs the uniforms of all the instances
+        mInstancesUniforms.invalidate();
+    }
+    if (mInstancesUniforms.isDirty()) {
+        // only the dirty range is copied, with the uniforms of the other materials
+        engine.queueUniformUpdate(mInstancesUbh, mInstancesUniforms);
+    }
 }
 
 FMaterialInstance* FMaterial::createInstance() const noexcept {
@@ -255,6 +345,69 @@ bool FMaterial::hasParameter(const char* name) const noexcept {
 }
 
 Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
+    mEngine.debug.stats.program_cache_misses++;
+    return createProgram(variantKey, true);
+}
+
+void FMaterial::compile(VariantSet variants, CompileCallback callback, void* user) noexcept {
+    uint8_t variantKeys[VARIANT_COUNT];
+    size_t count = 0;
+    for (size_t i = 0; i < VARIANT_COUNT; i++) {
+        const uint8_t variantKey = uint8_t(i);
+        if (!(variants & (VariantSet(1) << i)) || mCachedPrograms[i] ||
+                Variant::isReserved(variantKey) ||
+                Variant::filterVariant(variantKey, mIsVariantLit, mHasPunctualLights) !=
+                        variantKey) {
+            continue;
+        }
+        variantKeys[count++] = variantKey;
+    }
+
+    // The shaders of the variants are assembled in parallel, each job with its own shader
+    // builders, then the programs are created in order from this thread.
+    std::vector<Program> programs(count);
+    bool assembled[VARIANT_COUNT];
+    auto assemble = [this, &variantKeys, &programs, &assembled](uint32_t s, uint32_t n) {
+        filaflat::ShaderBuilder vsBuilder;
+        filaflat::ShaderBuilder fsBuilder;
+        for (uint32_t i = s; i < s + n; i++) {
+            assembled[i] = assembleProgram(programs[i], variantKeys[i], false,
+                    vsBuilder, fsBuilder);
+        }
+    };
+    if (count > 1) {
+        JobSystem& js = mEngine.getJobSystem();
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+                std::cref(assemble), jobs::CountSplitter<1, 8>());
+        js.setName(job, "FMaterial::compile");
+        js.run(job);
+        js.waitAndRelease(job);
+    } else if (count) {
+        assemble(0, 1);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (assembled[i]) {
+            cacheProgram(variantKeys[i], std::move(programs[i]));
+        }
+    }
+
+    if (callback) {
+        mEngine.getDriverApi().queueCommand([this, callback, user]() { callback(this, user); });
+    }
+}
+
+Handle<HwProgram> FMaterial::createProgram(uint8_t variantKey, bool required) const noexcept {
+    Program pb;
+    if (!assembleProgram(pb, variantKey, required,
+            mEngine.getVertexShaderBuilder(), mEngine.getFragmentShaderBuilder())) {
+        return {};
+    }
+    return cacheProgram(variantKey, std::move(pb));
+}
+
+bool FMaterial::assembleProgram(Program& pb, uint8_t variantKey, bool required,
+        filaflat::ShaderBuilder& vsBuilder, filaflat::ShaderBuilder& fsBuilder) const noexcept {
     const ShaderModel sm = mEngine.getDriver().getShaderModel();
 
     assert(!Variant::isReserved(variantKey));
@@ -266,56 +419,109 @@ Handle<HwProgram> FMaterial::getProgramSlow(uint8_t variantKey) const noexcept {
      * Vertex shader
      */
 
-    filaflat::ShaderBuilder& vsBuilder = mEngine.getVertexShaderBuilder();
-
     UTILS_UNUSED_IN_RELEASE bool vsOK = mMaterialParser->getShader(sm,
             vertexVariantKey, ShaderType::VERTEX, vsBuilder);
+    if (!required && !(vsOK && vsBuilder.size() > 0)) {
+        return false;
+    }
 
     ASSERT_POSTCONDITION(vsOK && vsBuilder.size() > 0,
             "The material '%s' has not been compiled to include the required "
             "GLSL or SPIR-V chunks for the vertex shader (variant=0x%x, filtered=0x%x).",
             mName.c_str(), variantKey, vertexVariantKey);
 
-    CString vs(vsBuilder.getShader(), (CString::size_type) vsBuilder.size());
-
     /*
      * Fragment shader
      */
 
-    filaflat::ShaderBuilder& fsBuilder = mEngine.getFragmentShaderBuilder();
-
     UTILS_UNUSED_IN_RELEASE bool fsOK = mMaterialParser->getShader(sm,
             fragmentVariantKey, ShaderType::FRAGMENT, fsBuilder);
+    if (!required && !(fsOK && fsBuilder.size() > 0)) {
+        return false;
+    }
 
     ASSERT_POSTCONDITION(fsOK && fsBuilder.size() > 0,
             "The material '%s' has not been compiled to include the required "
             "GLSL or SPIR-V chunks for the fragment shader (variant=0x%x, filterer=0x%x).",
             mName.c_str(), variantKey, fragmentVariantKey);
-    CString fs(fsBuilder.getShader(), (CString::size_type) fsBuilder.size());
 
-    Program pb;
+    // this is the only copy of the shaders' text, the Program owns it from here on
     pb      .diagnostics(mName, variantKey)
-            .withVertexShader(vs)
-            .withFragmentShader(fs)
+            .withVertexShader(CString(vsBuilder.getShader(), (CString::size_type) vsBuilder.size()))
+            .withFragmentShader(CString(fsBuilder.getShader(), (CString::size_type) fsBuilder.size()))
             .withSamplerBindings(&mSamplerBindings)
             .addUniformBlock(BindingPoints::PER_VIEW, &UibGenerator::getPerViewUib())
             .addUniformBlock(BindingPoints::LIGHTS, &UibGenerator::getLightsUib())
-            .addUniformBlock(BindingPoints::PER_RENDERABLE, &UibGenerator::getPerRenderableUib())
+            .addUniformBlock(BindingPoints::PER_RENDERABLE, Variant(variantKey).hasInstancing() ?
+                    &UibGenerator::getPerRenderableInstancesUib() :
+                    &UibGenerator::getPerRenderableUib())
             .addUniformBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mUniformInterfaceBlock)
             .addSamplerBlock(BindingPoints::PER_VIEW, &SibGenerator::getPerViewSib())
-            .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock);
+            .addSamplerBlock(BindingPoints::PER_MATERIAL_INSTANCE, &mSamplerInterfaceBlock)
+            .specializationConstant(SpecializationConstants::SHADOW_SAMPLING_METHOD,
+                    int32_t(CONFIG_SHADOW_SAMPLING_METHOD));
 
     if (Variant(variantKey).hasSkinning()) {
         pb.addUniformBlock(BindingPoints::PER_RENDERABLE_BONES, &UibGenerator::getPerRenderableBonesUib());
     }
+    return true;
+}
+
+Handle<HwProgram> FMaterial::cacheProgram(uint8_t variantKey, Program&& pb) const noexcept {
+    auto const& sources = pb.getShadersSource();
+    const uint32_t size = uint32_t(sources[0].size() + sources[1].size());
 
     auto program = mEngine.getDriverApi().createProgram(std::move(pb));
     assert(program);
 
     mCachedPrograms[variantKey] = program;
+    mProgramLastUsedFrame[variantKey] = mEngine.getProgramCacheFrame();
+    mProgramSizes[variantKey] = size;
     return program;
 }
 
+size_t FMaterial::getProgramCount() const noexcept {
+    return size_t(std::count_if(mCachedPrograms.begin(), mCachedPrograms.end(),
+            [](Handle<HwProgram> const& program) { return bool(program); }));
+}
+
+size_t FMaterial::updateProgramUsage(uint32_t frame,
+        std::vector<FEngine::ProgramInfo>& programs) const noexcept {
+    const VariantSet used = mFrameVariants.exchange(0, std::memory_order_relaxed);
+    size_t size = 0;
+    for (size_t i = 0; i < VARIANT_COUNT; i++) {
+        if (!mCachedPrograms[i] || isSharedProgram(i)) {
+            continue;
+        }
+        if (used & (VariantSet(1) << i)) {
+            mProgramLastUsedFrame[i] = frame;
+        }
+        size += mProgramSizes[i];
+        // the default material's depth programs are used by the other materials
+        if (!(mIsDefaultMaterial && Variant(i).isDepthPass())) {
+            programs.push_back({ this, mProgramLastUsedFrame[i], mProgramSizes[i], uint8_t(i) });
+        }
+    }
+    return size;
+}
+
+size_t FMaterial::getProgramsSize() const noexcept {
+    size_t size = 0;
+    for (size_t i = 0; i < VARIANT_COUNT; i++) {
+        size += isSharedProgram(i) ? 0 : mProgramSizes[i];
+    }
+    return size;
+}
+
+void FMaterial::destroyProgram(uint8_t variantKey) const noexcept {
+    assert(!isSharedProgram(variantKey));
+    // the commands already recorded are executed before the program is destroyed, the program
+    // is created again if it's needed later
+    mEngine.getDriverApi().destroyProgram(mCachedPrograms[variantKey]);
+    mCachedPrograms[variantKey] = {};
+    mProgramSizes[variantKey] = 0;
+}
+
 size_t FMaterial::getParameters(ParameterInfo* parameters, size_t count) const noexcept {
     count = std::min(count, getParameterCount());
 
@@ -418,6 +624,14 @@ size_t Material::getParameters(ParameterInfo* parameters, size_t count) const no
     return upcast(this)->getParameters(parameters, count);
 }
 
+void Material::compile(VariantSet variants, CompileCallback callback, void* user) noexcept {
+    upcast(this)->compile(variants, callback, user);
+}
+
+Material::VariantSet Material::getUsedVariants() const noexcept {
+    return upcast(this)->getUsedVariants();
+}
+
 AttributeBitset Material::getRequiredAttributes() const noexcept {
     return upcast(this)->getRequiredAttributes();
 }
@@ -40,7 +40,12 @@ FMaterialInstance::FMaterialInstance(FEngine& engine, FMaterial const* material)
 
     if (!material->getUniformInterfaceBlock().isEmpty()) {
         mUniforms = UniformBuffer(upcast(material)->getDefaultInstance()->mUniforms);
-        mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
+        // the default instance may be clean already, but our uniform buffer is new
+        mUniforms.invalidate();
+        // with shared instance uniforms, the engine acquires our slot, see acquireUniformsSlot()
+        if (!material->getInstanceUniformsStride()) {
+            mUbHandle = driver.createUniformBuffer(mUniforms.getSize());
+        }
     }
 
     if (!material->getSamplerInterfaceBlock().isEmpty()) {
@@ -79,18 +84,42 @@ void FMaterialInstance::initDefaultInstance(FEngine& engine, FMaterial const* ma
 
 FMaterialInstance::~FMaterialInstance() noexcept = default;
 
+void FMaterialInstance::acquireUniformsSlot() noexcept {
+    if (!mMaterial->getUniformInterfaceBlock().isEmpty() && mMaterial->getInstanceUniformsStride()) {
+        mUniformsSlot = mMaterial->acquireInstanceUniforms();
+    }
+}
+
 void FMaterialInstance::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.destroyUniformBuffer(mUbHandle);
     driver.destroySamplerBuffer(mSbHandle);
+    if (mUniformsSlot != NO_SLOT) {
+        mMaterial->releaseInstanceUniforms(mUniformsSlot);
+        mUniformsSlot = NO_SLOT;
+    }
+}
+
+Handle<HwUniformBuffer> FMaterialInstance::getMaterialInstanceUniformsHandle() const noexcept {
+    return mMaterial->getInstanceUniformsHandle();
+}
+
+size_t FMaterialInstance::getMaterialInstanceUniformsStride() const noexcept {
+    return mMaterial->getInstanceUniformsStride();
 }
 
 void FMaterialInstance::commitSlow(FEngine& engine) const {
     // update uniforms if needed
     FEngine::DriverApi& driver = engine.getDriverApi();
     if (mUniforms.isDirty()) {
-        driver.updateUniformBuffer(mUbHandle, UniformBuffer(mUniforms));
-        mUniforms.clean();
+        if (mUbHandle) {
+            // uploaded with the other instances by FEngine::prepare(), which cleans mUniforms
+            engine.queueUniformUpdate(mUbHandle, mUniforms);
+        } else {
+            // uploaded with the other instances by FMaterial::commitInstanceUniforms()
+            mMaterial->setInstanceUniforms(mUniformsSlot, mUniforms);
+            mUniforms.clean();
+        }
     }
     if (mSamplers.isDirty()) {
         driver.updateSamplerBuffer(mSbHandle, SamplerBuffer(mSamplers));
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/OcclusionCuller.h"
+
+#include <utils/Systrace.h>
+
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <math.h>
+
+using namespace math;
+
+namespace filament {
+namespace details {
+
+// corners closer than this (in clip-space w) are considered behind the camera
+static constexpr float MIN_W = 1e-4f;
+
+void OcclusionCuller::prepare(mat4f const& viewProjection) noexcept {
+    mViewProjection = viewProjection;
+    if (mDepth.empty()) {
+        size_t size = 0;
+        for (size_t level = 0; level < LEVEL_COUNT; level++) {
+            mLevelOffsets[level] = size;
+            size += getLevelWidth(level) * getLevelHeight(level);
+        }
+        mDepth.resize(size);
+    }
+    std::fill_n(mDepth.begin(), WIDTH * HEIGHT, 0.0f);
+}
+
+bool OcclusionCuller::project(float3 const& center, float3 const& halfExtent,
+        ScreenBox& box) const noexcept {
+    const float2 size = { WIDTH, HEIGHT };
+    box.min = std::numeric_limits<float>::max();
+    box.max = std::numeric_limits<float>::lowest();
+    box.nearest = 0;
+    box.farthest = std::numeric_limits<float>::max();
+    for (size_t i = 0; i < 8; i++) {
+        const float3 p = center + float3{
+                (i & 1) ? halfExtent.x : -halfExtent.x,
+                (i & 2) ? halfExtent.y : -halfExtent.y,
+                (i & 4) ? halfExtent.z : -halfExtent.z };
+        const float4 clip = mViewProjection * float4{ p, 1 };
+        if (UTILS_UNLIKELY(clip.w < MIN_W)) {
+            return false;
+        }
+        const float invW = 1 / clip.w;
+        const float2 s = (clip.xy * (0.5f * invW) + 0.5f) * size;
+        box.corners[i] = s;
+        box.min = min(box.min, s);
+        box.max = max(box.max, s);
+        box.nearest = std::max(box.nearest, invW);
+        box.farthest = std::min(box.farthest, invW);
+    }
+    return true;
+}
+
+bool OcclusionCuller::addOccluder(float3 const& center, float3 const& halfExtent) noexcept {
+    ScreenBox box;
+    if (!project(center, halfExtent, box)) {
+        return false;
+    }
+
+    // the silhouette of the box is the convex hull of its projected corners
+    float2 points[8];
+    std::copy(std::begin(box.corners), std::end(box.corners), points);
+    std::sort(std::begin(points), std::end(points), [](float2 const& a, float2 const& b) {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+    auto cross = [](float2 const& o, float2 const& a, float2 const& b) {
+        return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+    };
+    float2 hull[16];
+    size_t k = 0;
+    for (size_t i = 0; i < 8; i++) {            // lower hull
+        while (k >= 2 && cross(hull[k - 2], hull[k - 1], points[i]) <= 0) k--;
+        hull[k++] = points[i];
+    }
+    for (size_t i = 7, t = k + 1; i > 0; i--) { // upper hull
+        while (k >= t && cross(hull[k - 2], hull[k - 1], points[i - 1]) <= 0) k--;
+        hull[k++] = points[i - 1];
+    }
+    const size_t count = k - 1;                 // the last point is the first one
+    if (count < 3) {
+        return false;
+    }
+
+    // edge equations, a pixel is entirely inside an edge (of a counter-clockwise polygon)
+    // when the distance of its center is at least half its extent along the edge's normal
+    float3 edges[8];
+    for (size_t i = 0; i < count; i++) {
+        const float2 p = hull[i];
+        const float2 d = hull[i + 1] - p;
+        const float c = d.y * p.x - d.x * p.y - 0.5f * (std::abs(d.x) + std::abs(d.y));
+        edges[i] = { -d.y, d.x, c };
+    }
+
+    const int x0 = std::max(0, int(floorf(box.min.x)));
+    const int y0 = std::max(0, int(floorf(box.min.y)));
+    const int x1 = std::min(int(WIDTH)  - 1, int(ceilf(box.max.x)));
+    const int y1 = std::min(int(HEIGHT) - 1, int(ceilf(box.max.y)));
+    const float depth = box.farthest;
+    float* const UTILS_RESTRICT buffer = mDepth.data();
+    for (int y = y0; y <= y1; y++) {
+        const float fy = y + 0.5f;
+        for (int x = x0; x <= x1; x++) {
+            const float fx = x + 0.5f;
+            bool inside = true;
+            for (size_t i = 0; i < count; i++) {
+                inside &= edges[i].x * fx + edges[i].y * fy + edges[i].z >= 0;
+            }
+            if (inside) {
+                float& d = buffer[y * WIDTH + x];
+                d = std::max(d, depth);
+            }
+        }
+    }
+    return true;
+}
+
+void OcclusionCuller::buildPyramid() noexcept {
+    SYSTRACE_CALL();
+    for (size_t level = 1; level < LEVEL_COUNT; level++) {
+        float const* const UTILS_RESTRICT src = mDepth.data() + mLevelOffsets[level - 1];
+        float* const UTILS_RESTRICT dst = mDepth.data() + mLevelOffsets[level];
+        const size_t sw = getLevelWidth(level - 1);
+        const size_t sh = getLevelHeight(level - 1);
+        const size_t w = getLevelWidth(level);
+        const size_t h = getLevelHeight(level);
+        for (size_t y = 0; y < h; y++) {
+            const size_t sy0 = std::min(y * 2, sh - 1);
+            const size_t sy1 = std::min(y * 2 + 1, sh - 1);
+            for (size_t x = 0; x < w; x++) {
+                const size_t sx0 = std::min(x * 2, sw - 1);
+                const size_t sx1 = std::min(x * 2 + 1, sw - 1);
+                dst[y * w + x] = std::min(
+                        std::min(src[sy0 * sw + sx0], src[sy0 * sw + sx1]),
+                        std::min(src[sy1 * sw + sx0], src[sy1 * sw + sx1]));
+            }
+        }
+    }
+}
+
+bool OcclusionCuller::isOccluded(float3 const& center, float3 const& halfExtent) const noexcept {
+    ScreenBox box;
+    if (!project(center, halfExtent, box)) {
+        return false;
+    }
+
+    // the parts of the box outside of the screen can't be seen anyway
+    const int x0 = std::max(0, int(floorf(box.min.x)));
+    const int y0 = std::max(0, int(floorf(box.min.y)));
+    const int x1 = std::min(int(WIDTH)  - 1, int(floorf(box.max.x)));
+    const int y1 = std::min(int(HEIGHT) - 1, int(floorf(box.max.y)));
+    if (x1 < x0 || y1 < y0) {
+        return false;
+    }
+
+    // pick the level where the box covers at most 2x2 texels
+    size_t level = 0;
+    while (level < LEVEL_COUNT - 1 &&
+            ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1)) {
+        level++;
+    }
+
+    float const* const UTILS_RESTRICT depth = mDepth.data() + mLevelOffsets[level];
+    const size_t w = getLevelWidth(level);
+    float farthest = std::numeric_limits<float>::max();
+    for (int y = y0 >> level; y <= (y1 >> level); y++) {
+        for (int x = x0 >> level; x <= (x1 >> level); x++) {
+            farthest = std::min(farthest, depth[y * w + x]);
+        }
+    }
+
+    // the box is hidden if its closest point is behind the farthest occluder covering it
+    return box.nearest < farthest;
+}
+
+} // namespace details
+} // namespace filament
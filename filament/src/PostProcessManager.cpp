@@ -17,7 +17,10 @@
 #include "PostProcessManager.h"
 #include "RenderTargetPool.h"
 
+#include "FrameInfo.h"
+
 #include "details/Engine.h"
+#include "details/View.h"
 
 #include <utils/Log.h>
 
@@ -38,6 +41,10 @@ void PostProcessManager::init(FEngine& engine) noexcept {
     DriverApi& driver = engine.getDriverApi();
     mPostProcessSbh = driver.createSamplerBuffer(engine.getPostProcessSib().getSize());
     mPostProcessUbh = driver.createUniformBuffer(engine.getPerPostProcessUib().getSize());
+    bindBuffers(driver);
+}
+
+void PostProcessManager::bindBuffers(driver::DriverApi& driver) const noexcept {
     driver.bindSamplers(BindingPoints::POST_PROCESS, mPostProcessSbh);
     driver.bindUniforms(BindingPoints::POST_PROCESS, mPostProcessUbh);
 }
@@ -48,7 +55,9 @@ void PostProcessManager::terminate(driver::DriverApi& driver) noexcept {
 }
 
 void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-        const RenderTargetPool::Target* pos) const noexcept {
+        const RenderTargetPool::Target* pos, Handle<HwTexture> colorGrading,
+        const RenderTargetPool::Target* blending, math::float2 blendingScale,
+        const TemporalSource* temporal) const noexcept {
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
 
@@ -59,6 +68,20 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     params.filterMin = SamplerMinFilter::LINEAR;
     SamplerBuffer sb(engine.getPostProcessSib());
     sb.setSampler(FEngine::PostProcessSib::COLOR_BUFFER, pos->texture, params);
+    sb.setSampler(FEngine::PostProcessSib::COLOR_GRADING, colorGrading, params);
+    if (blending) {
+        // depth textures aren't filterable, the composition only fetches texels anyway
+        driver::SamplerParams nearest;
+        sb.setSampler(FEngine::PostProcessSib::DEPTH_BUFFER, pos->depth, nearest);
+        sb.setSampler(FEngine::PostProcessSib::BLENDING_BUFFER, blending->texture, nearest);
+        sb.setSampler(FEngine::PostProcessSib::BLENDING_DEPTH, blending->depth, nearest);
+    }
+    if (temporal) {
+        // the history is reprojected anywhere between its texels, the depth is only fetched
+        driver::SamplerParams nearest;
+        sb.setSampler(FEngine::PostProcessSib::DEPTH_BUFFER, temporal->depth, nearest);
+        sb.setSampler(FEngine::PostProcessSib::HISTORY, temporal->history, params);
+    }
 
     auto duration = engine.getTime();
     float fraction = (duration.count() % 1000000000) / 1000000000.0f;
@@ -72,8 +95,16 @@ void PostProcessManager::setSource(uint32_t viewportWidth, uint32_t viewportHeig
     // of the rectangle that it actually needs to sample from.
     const float yOffset = pos->h - viewportHeight;
     ub.setUniform(offsetof(FEngine::PostProcessingUib, yOffset), yOffset);
+    ub.setUniform(offsetof(FEngine::PostProcessingUib, blendingScale), blendingScale);
+    if (temporal) {
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, temporalReprojection),
+                temporal->reprojection);
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, temporalJitter), temporal->jitter);
+        ub.setUniform(offsetof(FEngine::PostProcessingUib, temporalFeedback), temporal->feedback);
+    }
 
     driver.updateSamplerBuffer(mPostProcessSbh, std::move(sb));
+    mEngine->countUniformUpdate(ub);
     driver.updateUniformBuffer(mPostProcessUbh, UniformBuffer(ub));
 }
 
@@ -85,96 +116,193 @@ void PostProcessManager::pass(driver::TextureFormat format, Handle<HwProgram> pr
     mCommands.push_back({program, format});
 }
 
-void PostProcessManager::finish(driver::TargetBufferFlags discarded,
-        Handle<HwRenderTarget> viewRenderTarget,
-        Viewport const& vp,
-        RenderTargetPool::Target const* previous,
-        Viewport const& svp) {
-
-    assert(viewRenderTarget);
-    assert(previous);
+void PostProcessManager::finish(FrameGraph& fg,
+        FrameGraphResource input, FrameGraphResource output,
+        Viewport const& vp, Viewport const& svp, Handle<HwTexture> colorGrading,
+        FrameInfoManager& frameInfoManager) {
 
-    FEngine& engine = *mEngine;
-    DriverApi& driver = engine.getDriverApi();
-    RenderTargetPool& rtp = engine.getRenderTargetPool();
-    Handle<HwRenderPrimitive> const& fullScreenRenderPrimitive = engine.getFullScreenRenderPrimitive();
     std::vector<Command>& commands = mCommands;
-
-    if (UTILS_UNLIKELY(commands.empty())) {
-        rtp.put(previous);
-        return;
-    }
-
-    Driver::RasterState rs;
-    rs.culling = Driver::RasterState::CullingMode::NONE;
-    rs.colorWrite = true;
-    rs.depthFunc = Driver::RasterState::DepthFunc::A;
-
-    RenderPassParams params = {};
-    params.discardStart = TargetBufferFlags::ALL;
-    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-    params.left = 0;
-    params.bottom = 0;
-    params.width = svp.width;
-    params.height = svp.height;
-    params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
-
-    for (size_t i = 0, c = commands.size() - 1; i < c; i++) {
-        // if the next command is a blit, it we don't need a texture
-        uint8_t flags = !commands[i + 1].program ? RenderTargetPool::Target::NO_TEXTURE : uint8_t();
-
-        // create a render target for this pass
-        RenderTargetPool::Target const* target = rtp.get(
-                TargetBufferFlags::COLOR, svp.width, svp.height, 1, commands[i].format, flags);
-
-        assert(target);
-
-        if (commands[i].program) {
-            // set the source for this pass (i.e. previous target)
-            setSource(params.width, params.height, previous);
-
-            // draw a full screen triangle
-            driver.beginRenderPass(target->target, params);
-            driver.draw(commands[i].program, rs, fullScreenRenderPrimitive);
-            driver.endRenderPass();
-        } else {
-            driver.blit(TargetBufferFlags::COLOR,
-                    target->target, 0, 0, svp.width, svp.height,
-                    previous->target, 0, 0, svp.width, svp.height);
-        }
-        // return the previous target to the pool
-        rtp.put(previous);
-        previous = target;
-    }
-
     assert(!commands.empty());
-    assert(previous);
-
-    // The last command is special, it always draw to the viewRenderTarget and uses
-    // the non scaled viewport.
-    if (commands.back().program) {
-        params.discardStart = discarded;
-        params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
-        params.left = vp.left;
-        params.bottom = vp.bottom;
-        params.width = vp.width;
-        params.height = vp.height;
-
-        setSource(params.width, params.height, previous);
-        driver.beginRenderPass(viewRenderTarget, params);
-        driver.draw(commands.back().program, rs, fullScreenRenderPrimitive);
-        driver.endRenderPass();
-
-    } else {
-        driver.blit(TargetBufferFlags::COLOR,
-                viewRenderTarget, vp.left, vp.bottom, vp.width, vp.height,
-                previous->target, 0, 0, svp.width, svp.height);
-    }
 
-    rtp.put(previous);
+    struct PostProcessPass {
+        FrameGraphResource input;
+        FrameGraphResource output;
+    };
+
+    for (size_t i = 0, c = commands.size(); i < c; i++) {
+        Command const command = commands[i];
+        const bool first = i == 0;
+        const bool last = i == c - 1;
+
+        auto const& data = fg.addPass<PostProcessPass>(command.program ? "Post Process" : "Blit",
+                [&](FrameGraph::Builder& builder, PostProcessPass& data) {
+                    // a blit doesn't need its source's texture
+                    data.input = builder.read(input, bool(command.program));
+                    // The last command is special, it always draws to the output and uses
+                    // the non scaled viewport.
+                    data.output = builder.write(last ? output : builder.create("Post Process",
+                            { TargetBufferFlags::COLOR, svp.width, svp.height, 1, command.format }));
+                },
+                [this, command, first, last, vp, svp, colorGrading, &frameInfoManager](
+                        PostProcessPass const& data, FrameGraph::Resources const& resources,
+                        DriverApi& driver) {
+                    if (first) {
+                        frameInfoManager.beginPass(driver, GpuFrameInfo::POST_PROCESS);
+                    }
+
+                    RenderTargetPool::Target const& source = resources.get(data.input);
+                    RenderTargetPool::Target const& target = resources.get(data.output);
+                    Viewport const& viewport = last ? vp : Viewport{ 0, 0, svp.width, svp.height };
+
+                    if (command.program) {
+                        Driver::RasterState rs;
+                        rs.culling = Driver::RasterState::CullingMode::NONE;
+                        rs.colorWrite = true;
+                        rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+                        RenderPassParams params = resources.getRenderPassParams(data.output);
+                        params.left = viewport.left;
+                        params.bottom = viewport.bottom;
+                        params.width = viewport.width;
+                        params.height = viewport.height;
+                        params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+
+                        // set the source for this pass (i.e. previous target), the last pass
+                        // may scale it up to the output's viewport
+                        setSource(svp.width, svp.height, &source, colorGrading);
+
+                        // draw a full screen triangle
+                        driver.beginRenderPass(target.target, params);
+                        driver.draw(command.program, rs, mEngine->getFullScreenRenderPrimitive());
+                        driver.endRenderPass();
+                    } else {
+                        driver.blit(TargetBufferFlags::COLOR,
+                                target.target, viewport.left, viewport.bottom,
+                                viewport.width, viewport.height,
+                                source.target, 0, 0, svp.width, svp.height);
+                    }
+
+                    if (last) {
+                        frameInfoManager.endPass(driver);
+                    }
+                });
+
+        input = data.output;
+    }
 
     // clear our command buffer
     commands.clear();
 }
 
+FrameGraphResource PostProcessManager::compositeBlending(FrameGraph& fg,
+        FrameGraphResource input, FrameGraphResource blending,
+        Viewport const& svp, Viewport const& blendingViewport, driver::TextureFormat format) {
+
+    struct CompositePass {
+        FrameGraphResource input;
+        FrameGraphResource blending;
+        FrameGraphResource output;
+    };
+
+    const math::float2 blendingScale =
+            math::float2{ blendingViewport.width, blendingViewport.height } /
+            math::float2{ svp.width, svp.height };
+
+    auto const& data = fg.addPass<CompositePass>("Blending Composite",
+            [&](FrameGraph::Builder& builder, CompositePass& data) {
+                data.input = builder.read(input);
+                data.blending = builder.read(blending);
+                data.output = builder.write(builder.create("Composited Color Buffer",
+                        { TargetBufferFlags::COLOR, svp.width, svp.height, 1, format }));
+            },
+            [this, svp, blendingScale](CompositePass const& data,
+                    FrameGraph::Resources const& resources, DriverApi& driver) {
+                RenderTargetPool::Target const& source = resources.get(data.input);
+                RenderTargetPool::Target const& target = resources.get(data.output);
+
+                Driver::RasterState rs;
+                rs.culling = Driver::RasterState::CullingMode::NONE;
+                rs.colorWrite = true;
+                rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+                RenderPassParams params = resources.getRenderPassParams(data.output);
+                params.width = svp.width;
+                params.height = svp.height;
+                params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+
+                setSource(svp.width, svp.height, &source, {},
+                        &resources.get(data.blending), blendingScale);
+
+                Handle<HwProgram> program =
+                        mEngine->getPostProcessProgram(PostProcessStage::BLENDING_UPSAMPLE);
+                driver.beginRenderPass(target.target, params);
+                driver.draw(program, rs, mEngine->getFullScreenRenderPrimitive());
+                driver.endRenderPass();
+            });
+
+    return data.output;
+}
+
+FrameGraphResource PostProcessManager::temporalUpsample(FrameGraph& fg, FView const& view,
+        FrameGraphResource input, FrameGraphResource depth,
+        Viewport const& vp, Viewport const& svp, driver::TextureFormat format) {
+
+    struct TemporalPass {
+        FrameGraphResource input;
+        FrameGraphResource depth;
+        FrameGraphResource output;
+    };
+
+    // the history is written whole, it's read by the next pass and then by the next frame
+    const FrameGraphResource history = fg.importRenderTarget("Temporal History",
+            { TargetBufferFlags::COLOR, vp.width, vp.height, 1, format },
+            view.getTemporalHistoryTarget(), TargetBufferFlags::ALL,
+            view.getTemporalHistoryTexture());
+    const TemporalSource temporal{
+            .history = view.getTemporalPreviousTexture(),
+            .reprojection = view.getTemporalReprojection(),
+            .jitter = view.getTemporalJitter(),
+            // this frame's weight, a trade-off between aliasing and ghosting
+            .feedback = view.isTemporalHistoryValid() ? 0.1f : 1.0f
+    };
+
+    auto const& data = fg.addPass<TemporalPass>("Temporal Upsample",
+            [&](FrameGraph::Builder& builder, TemporalPass& data) {
+                data.input = builder.read(input);
+                data.depth = builder.read(depth);
+                data.output = builder.write(history);
+            },
+            [this, &view, vp, svp, temporal](TemporalPass const& data,
+                    FrameGraph::Resources const& resources, DriverApi& driver) {
+                RenderTargetPool::Target const& source = resources.get(data.input);
+                RenderTargetPool::Target const& target = resources.get(data.output);
+
+                Driver::RasterState rs;
+                rs.culling = Driver::RasterState::CullingMode::NONE;
+                rs.colorWrite = true;
+                rs.depthFunc = Driver::RasterState::DepthFunc::A;
+
+                RenderPassParams params = resources.getRenderPassParams(data.output);
+                params.width = vp.width;
+                params.height = vp.height;
+                params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+
+                TemporalSource sources = temporal;
+                sources.depth = resources.get(data.depth).depth;
+                setSource(svp.width, svp.height, &source, {}, nullptr, {}, &sources);
+
+                Handle<HwProgram> program =
+                        mEngine->getPostProcessProgram(PostProcessStage::TEMPORAL_UPSAMPLE);
+                driver.beginRenderPass(target.target, params);
+                driver.draw(program, rs, mEngine->getFullScreenRenderPrimitive());
+                driver.endRenderPass();
+
+                // the next passes sample the full resolution history
+                view.prepareCamera(view.getCameraInfo(), { 0, 0, vp.width, vp.height });
+                view.commitUniforms(*mEngine);
+            });
+
+    return data.output;
+}
+
 } // namespace filament
@@ -17,6 +17,7 @@
 #ifndef TNT_FILAMENT_POSTPROCESS_MANAGER_H
 #define TNT_FILAMENT_POSTPROCESS_MANAGER_H
 
+#include "FrameGraph.h"
 #include "RenderTargetPool.h"
 
 #include "driver/DriverApiForward.h"
@@ -25,6 +26,9 @@
 
 #include <filament/Viewport.h>
 
+#include <math/mat4.h>
+#include <math/vec2.h>
+
 #include <filament/driver/DriverEnums.h>
 
 #include <vector>
@@ -36,27 +40,65 @@ class FEngine;
 class FView;
 } // namespace details
 
+class FrameInfoManager;
+
 class PostProcessManager {
 public:
     void init(details::FEngine& engine) noexcept;
     void terminate(driver::DriverApi& driver) noexcept;
+
+    // binds our buffers again, after another user of the POST_PROCESS binding point
+    void bindBuffers(driver::DriverApi& driver) const noexcept;
+
+    // the temporal anti-aliasing's sources and parameters, see temporalUpsample()
+    struct TemporalSource {
+        Handle<HwTexture> depth;        // the color pass' depth buffer
+        Handle<HwTexture> history;      // the last frame's resolved color
+        math::mat4f reprojection;
+        math::float2 jitter;
+        float feedback;
+    };
+
+    // blending, when set, is composited over pos, whose depth buffer must be a texture too.
+    // blendingScale is the size of blending's viewport divided by the source's.
     void setSource(uint32_t viewportWidth, uint32_t viewportHeight,
-            const RenderTargetPool::Target* pos) const noexcept;
+            const RenderTargetPool::Target* pos, Handle<HwTexture> colorGrading,
+            const RenderTargetPool::Target* blending = nullptr,
+            math::float2 blendingScale = {},
+            const TemporalSource* temporal = nullptr) const noexcept;
 
     // start() is a scam, it does nothing
     void start() noexcept { }
 
-    // a fullscreen pass, using the given format as target and writing into the specified program
+    // a fullscreen pass, using the given format as target and writing into the specified program.
+    // When it's the last pass, the program must scale the source up to the non-scaled viewport.
     void pass(driver::TextureFormat format, Handle<HwProgram> program) noexcept;
 
     // a blit pass, using the given format as target
     void blit(driver::TextureFormat format = driver::TextureFormat::RGBA8) noexcept;
 
-    void finish(driver::TargetBufferFlags discarded,
-            Handle<HwRenderTarget> viewRenderTarget,
-            Viewport const& vp,
-            RenderTargetPool::Target const* linearTarget,
-            Viewport const& svp);
+    // Adds the passes to the frame graph, reading input and writing the last pass into output
+    // with the non-scaled viewport. The passes are timed as GpuFrameInfo::POST_PROCESS.
+    // colorGrading is the view's color grading LUT, used by the tone mapping.
+    void finish(FrameGraph& fg, FrameGraphResource input, FrameGraphResource output,
+            Viewport const& vp, Viewport const& svp, Handle<HwTexture> colorGrading,
+            FrameInfoManager& frameInfoManager);
+
+    // Adds a pass compositing the low resolution blended primitives of blending, drawn in
+    // blendingViewport, over input. Both need a sampleable depth. Returns the composited color,
+    // in format.
+    FrameGraphResource compositeBlending(FrameGraph& fg,
+            FrameGraphResource input, FrameGraphResource blending,
+            Viewport const& svp, Viewport const& blendingViewport,
+            driver::TextureFormat format);
+
+    // Adds a pass resolving input, drawn jittered in svp, with the view's previous frames into
+    // the view's history target, at the size of vp, which it returns. depth must have the color
+    // pass' sampleable depth, and the view's history must have been prepared for this frame.
+    // The post-processing passes after this one work at the full resolution.
+    FrameGraphResource temporalUpsample(FrameGraph& fg, details::FView const& view,
+            FrameGraphResource input, FrameGraphResource depth,
+            Viewport const& vp, Viewport const& svp, driver::TextureFormat format);
 
 
 private:
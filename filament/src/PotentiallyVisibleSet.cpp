@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filament/PotentiallyVisibleSet.h>
+
+#include <utils/Log.h>
+
+#include <algorithm>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+
+size_t PotentiallyVisibleSet::getSize(size_t objectCount, size_t cellCount) noexcept {
+    return sizeof(Header) + cellCount * ((objectCount + 31) / 32) * sizeof(uint32_t);
+}
+
+PotentiallyVisibleSet::PotentiallyVisibleSet(void const* data, size_t size) noexcept {
+    Header const* const header = static_cast<Header const*>(data);
+    if (!header || size < sizeof(Header) || (uintptr_t(data) & 3u) || header->magic != MAGIC) {
+        slog.e << "PotentiallyVisibleSet: invalid data" << io::endl;
+        return;
+    }
+    const size_t cellCount =
+            size_t(header->cellCount[0]) * header->cellCount[1] * header->cellCount[2];
+    if (!cellCount || size < getSize(header->objectCount, cellCount)) {
+        slog.e << "PotentiallyVisibleSet: truncated data" << io::endl;
+        return;
+    }
+    mHeader = header;
+    mBits = reinterpret_cast<uint32_t const*>(header + 1);
+    mWordsPerCell = (header->objectCount + 31) / 32;
+}
+
+size_t PotentiallyVisibleSet::getCellCount() const noexcept {
+    if (!isValid()) {
+        return 0;
+    }
+    return size_t(mHeader->cellCount[0]) * mHeader->cellCount[1] * mHeader->cellCount[2];
+}
+
+uint32_t PotentiallyVisibleSet::getCellAt(float3 const& position) const noexcept {
+    if (!isValid()) {
+        return NO_CELL;
+    }
+    uint32_t index[3];
+    for (size_t i = 0; i < 3; i++) {
+        const float d = mHeader->max[i] - mHeader->min[i];
+        const float t = (position[i] - mHeader->min[i]) / d;
+        // (this also rejects the NaNs of empty grids)
+        if (!(t >= 0.0f && t <= 1.0f)) {
+            return NO_CELL;
+        }
+        const uint32_t n = mHeader->cellCount[i];
+        index[i] = std::min(uint32_t(t * n), n - 1);
+    }
+    return index[0] + mHeader->cellCount[0] * (index[1] + mHeader->cellCount[1] * index[2]);
+}
+
+} // namespace filament
@@ -16,6 +16,8 @@
 
 #include "RenderPass.h"
 
+#include "CpuStageTimings.h"
+
 #include "details/Culler.h"
 #include "details/Material.h"
 #include "details/MaterialInstance.h"
@@ -29,6 +31,11 @@
 #include <utils/JobSystem.h>
 #include <utils/Systrace.h>
 
+#include <algorithm>
+#include <limits>
+
+#include <string.h>
+
 using namespace utils;
 using namespace math;
 
@@ -43,44 +50,138 @@ RenderPass::~RenderPass() noexcept = default;
 UTILS_ALWAYS_INLINE // this allows the compiler to devirtualize some calls
 inline              // this removes the code from the compilation unit
 void RenderPass::render(
-        FEngine& engine, JobSystem& js,
-        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
-        uint32_t commandTypeFlags, RenderFlags renderFlags,
+        FEngine& engine, JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& soa, Handle<HwUniformBuffer> renderableUbh,
+        Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
         const CameraInfo& camera, Viewport const& viewport,
-        GrowingSlice<Command>& commands) noexcept {
+        GrowingSlice<Command>& commands, CommandCache* cache) noexcept {
+    prepareCommands(js, arena, soa, vr, commandTypeFlags, renderFlags, visibleMask,
+            camera, commands, cache);
+    execute(engine, js, soa, renderableUbh, camera, viewport, commands);
+}
+
+/* static */
+void RenderPass::prepareCommands(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
+        const CameraInfo& camera, GrowingSlice<Command>& commands, CommandCache* cache) noexcept {
 
     SYSTRACE_CONTEXT();
 
     // trace the number of visible renderables
     SYSTRACE_VALUE32("visibleRenderables", vr.size());
 
-    // up-to-date summed primitive counts needed for generateCommands()
-    updateSummedPrimitiveCounts(const_cast<FScene::RenderableSoa&>(soa), vr);
+    CommandCache::Key key;
+    if (cache) {
+        key.visibleFirst = vr.first;
+        key.visibleLast = vr.last;
+        key.commandTypeFlags = commandTypeFlags;
+        key.renderFlags = renderFlags;
+        key.visibleMask = visibleMask;
+        key.model = camera.model;
+        key.cullingProjection = camera.cullingProjection;
+        key.worldOrigin = camera.worldOrigin;
+        // the buffer is sized for this frame's primitives, which the key doesn't include
+        if (cache->mValid && !memcmp(&cache->mKey, &key, sizeof(key)) &&
+                cache->mCommands.size() < commands.remain()) {
+            // nothing changed since the commands were cached, reuse them as is
+            SYSTRACE_NAME("cached commands");
+            std::vector<Command> const& cached = cache->mCommands;
+            Command* const curr = commands.grow(cached.size());
+            std::copy(cached.begin(), cached.end(), curr);
+            commands.grow(1)->key = uint64_t(Pass::SENTINEL);
+            return;
+        }
+        cache->mValid = false;
+    }
 
-    // compute how much maximum storage we need for this pass
-    uint32_t growBy = FScene::getPrimitiveCount(soa, vr.last);
-    // double the color pass for transparents that need to render twice
-    const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
-    const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
-    growBy *= uint32_t(colorPass * 2 + depthPass);
+    generateAndSortCommands(js, arena, soa, vr, commandTypeFlags, renderFlags, visibleMask,
+            camera, commands);
+    if (cache) {
+        // only keep the commands before the first sentinel, the rest is never executed
+        Command const* const last = std::partition_point(commands.begin(), commands.end(),
+                [](Command const& c) { return c.key != uint64_t(Pass::SENTINEL); });
+        cache->mCommands.assign(commands.cbegin(), last);
+        cache->mKey = key;
+        cache->mValid = true;
+    }
+}
+
+UTILS_ALWAYS_INLINE // this allows the compiler to devirtualize some calls
+inline              // this removes the code from the compilation unit
+void RenderPass::execute(FEngine& engine, JobSystem& js,
+        FScene::RenderableSoa const& soa, Handle<HwUniformBuffer> renderableUbh,
+        const CameraInfo& camera, Viewport const& viewport,
+        GrowingSlice<Command>& commands) noexcept {
+
+    SYSTRACE_CONTEXT();
+
+    // merge identical commands into instanced draws
+    RenderPass::instanceCommands(engine, soa, commands.begin(), commands.end());
+
+    // Take care not to upload data within the render pass (synchronize can commit froxel data)
+    driver::DriverApi& driver = engine.getDriverApi();
+    beginRenderPass(driver, viewport, camera);
+
+    // Now, execute all commands
+    RenderPass::RecordStats stats;
+    {
+        CpuStageTimings::Scope timing(CpuStageTimings::DRIVER_COMMANDS);
+        stats = RenderPass::recordDriverCommands(driver, js, renderableUbh,
+                engine.getRenderableManager().getBonePaletteUbh(), commands);
+    }
+    engine.debug.renderpass.redundant_commands += int(stats.redundantCommands);
+    engine.debug.renderpass.draw_commands += int(stats.draws);
+    engine.debug.renderpass.state_changes += int(stats.stateChanges);
+    engine.debug.renderpass.material_instance_changes += int(stats.materialInstanceChanges);
+    engine.debug.renderpass.program_changes += int(stats.programChanges);
+    SYSTRACE_VALUE32("redundantCommands", stats.redundantCommands);
+
+    endRenderPass(driver, viewport);
+
+    // Kick the GPU since we're done with this render target
+    driver.flush();
+    // Wake-up the driver thread
+    engine.flush();
+}
+
+/* static */
+void RenderPass::generateAndSortCommands(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa const& soa, Range<uint32_t> vr,
+        uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
+        const CameraInfo& camera, GrowingSlice<Command>& commands) noexcept {
+
+    // compute how much maximum storage we need for this pass (without the sentinel), the
+    // summed primitive counts are shared with other passes, so they don't start at vr.first
+    const uint32_t growBy = uint32_t(getCommandCount(soa, vr, commandTypeFlags) - 1);
+    assert(growBy < commands.remain());
     Command* const curr = commands.grow(growBy);
 
     // we extract camera position/forward outside of the loop, because these are not cheap.
     const float3 cameraPosition(camera.getPosition());
     const float3 cameraForwardVector(camera.getForwardVector());
-    auto work = [commandTypeFlags, curr, &soa, renderFlags, cameraPosition, cameraForwardVector]
+    const uint32_t first = vr.first;
+    auto work = [commandTypeFlags, curr, &soa, first, renderFlags, visibleMask,
+            cameraPosition, cameraForwardVector]
             (uint32_t startIndex, uint32_t indexCount) {
         RenderPass::generateCommands(commandTypeFlags, curr,
-                soa, { startIndex, startIndex + indexCount }, renderFlags,
+                soa, first, { startIndex, startIndex + indexCount }, renderFlags, visibleMask,
                 cameraPosition, cameraForwardVector);
     };
 
+    // the cost of a renderable's commands is learnt over time, it depends on the device and
+    // on the scenes
+    static jobs::AdaptiveSplitter::Cost sCommandsCost(50.0f);
     auto jobCommandsParallel = jobs::parallel_for(js, nullptr, vr.first, (uint32_t)vr.size(),
-            std::cref(work), jobs::CountSplitter<JOBS_PARALLEL_FOR_COMMANDS_COUNT, 8>());
+            std::cref(work), jobs::AdaptiveSplitter(sCommandsCost));
 
     { // scope for systrace
         SYSTRACE_NAME("jobCommandsParallel");
-        js.runAndWait(jobCommandsParallel);
+        CpuStageTimings::Scope timing(CpuStageTimings::COMMAND_GENERATION);
+        js.setName(jobCommandsParallel, "RenderPass::generateCommands");
+        js.run(jobCommandsParallel);
+        js.waitAndRelease(jobCommandsParallel);
     }
 
     // always add an "eof" command
@@ -90,59 +191,409 @@ void RenderPass::render(
 
     { // sort all commands
         SYSTRACE_NAME("sort commands");
-        std::sort(commands.begin(), commands.end());
+        CpuStageTimings::Scope timing(CpuStageTimings::COMMAND_SORT);
+        RenderPass::sortCommands(js, arena, commands.begin(), commands.end());
     }
+}
 
-    // Take care not to upload data within the render pass (synchronize can commit froxel data)
-    driver::DriverApi& driver = engine.getDriverApi();
-    beginRenderPass(driver, viewport, camera);
+/* static */
+void RenderPass::sortCommands(JobSystem& js, ArenaScope& arena,
+        Command* const begin, Command* const end) noexcept {
+    SYSTRACE_CALL();
 
-    // Now, execute all commands
-    RenderPass::recordDriverCommands(driver, commands);
+    const size_t count = size_t(end - begin);
+    if (count < RADIX_SORT_MIN_COMMAND_COUNT) {
+        std::sort(begin, end);
+        return;
+    }
 
-    endRenderPass(driver, viewport);
+    // split the commands in about as many chunks as we have threads, each chunk has its own
+    // histogram so that counting and scattering can happen in parallel.
+    size_t chunkCount = std::min(size_t(1) << js.getParallelSplitCount(),
+            RADIX_SORT_MAX_CHUNK_COUNT);
+    chunkCount = std::max(size_t(1), std::min(chunkCount, count / RADIX_SORT_MIN_CHUNK_SIZE));
+    const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    // Temporary storage is only needed for the duration of the sort. The radix passes move
+    // compact (key, index) entries, a fraction of the size of the commands, which are moved
+    // only once at the end.
+    ArenaScope scope(arena.getAllocator());
+    using Histogram = uint32_t[RADIX_DIGIT_COUNT][RADIX_BUCKET_COUNT];
+    Command* const commands = scope.allocate<Command>(count, CACHELINE_SIZE);
+    SortEntry* const entries = scope.allocate<SortEntry>(count, CACHELINE_SIZE);
+    SortEntry* const scratch = scope.allocate<SortEntry>(count, CACHELINE_SIZE);
+    Histogram* const histograms = scope.allocate<Histogram>(chunkCount, CACHELINE_SIZE);
+    if (UTILS_UNLIKELY(!commands || !entries || !scratch || !histograms)) {
+        std::sort(begin, end);
+        return;
+    }
 
-    // Kick the GPU since we're done with this render target
-    driver.flush();
-    // Wake-up the driver thread
-    engine.flush();
+    auto runChunks = [&js, chunkCount](auto const& work) {
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(chunkCount),
+                std::cref(work), jobs::CountSplitter<1, 8>());
+        js.setName(job, "RenderPass::sortCommands");
+        js.run(job);
+        js.waitAndRelease(job);
+    };
+
+    // compute the histograms of all digits in a single pass, while the entries are created and
+    // the commands are set aside
+    auto countAllDigits = [begin, commands, entries, count, chunkSize, histograms]
+            (uint32_t first, uint32_t n) {
+        for (uint32_t c = first; c < first + n; c++) {
+            Histogram& UTILS_RESTRICT h = histograms[c];
+            memset(h, 0, sizeof(Histogram));
+            const uint32_t s = uint32_t(c * chunkSize);
+            const uint32_t e = uint32_t(std::min(count, (c + 1) * chunkSize));
+            std::copy(begin + s, begin + e, commands + s);
+            for (uint32_t i = s; i < e; i++) {
+                const CommandKey key = begin[i].key;
+                entries[i] = { key, i };
+                for (size_t d = 0; d < RADIX_DIGIT_COUNT; d++) {
+                    h[d][(key >> (d * RADIX_BITS)) & (RADIX_BUCKET_COUNT - 1)]++;
+                }
+            }
+        }
+    };
+    runChunks(countAllDigits);
+
+    // Find the digits that need sorting. When all keys share the same value for a digit, there
+    // is nothing to do for it (this happens a lot for the pass, blending and priority bits).
+    uint8_t digits[RADIX_DIGIT_COUNT];
+    size_t digitCount = 0;
+    for (size_t d = 0; d < RADIX_DIGIT_COUNT; d++) {
+        bool identical = false;
+        for (size_t b = 0; b < RADIX_BUCKET_COUNT && !identical; b++) {
+            size_t total = 0;
+            for (size_t c = 0; c < chunkCount; c++) {
+                total += histograms[c][d][b];
+            }
+            identical = total == count;
+        }
+        if (!identical) {
+            digits[digitCount++] = uint8_t(d);
+        }
+    }
+
+    SortEntry* src = entries;
+    SortEntry* dst = scratch;
+    for (size_t i = 0; i < digitCount; i++) {
+        const size_t digit = digits[i];
+        const size_t shift = digit * RADIX_BITS;
+
+        if (i > 0) {
+            // the entries have moved since the histograms were computed, recount this digit
+            auto countDigit = [src, count, chunkSize, histograms, digit, shift]
+                    (uint32_t first, uint32_t n) {
+                for (uint32_t c = first; c < first + n; c++) {
+                    uint32_t* const UTILS_RESTRICT h = histograms[c][digit];
+                    memset(h, 0, sizeof(uint32_t) * RADIX_BUCKET_COUNT);
+                    SortEntry const* const UTILS_RESTRICT s = src + c * chunkSize;
+                    SortEntry const* const UTILS_RESTRICT e =
+                            src + std::min(count, (c + 1) * chunkSize);
+                    for (SortEntry const* p = s; p < e; ++p) {
+                        h[(p->key >> shift) & (RADIX_BUCKET_COUNT - 1)]++;
+                    }
+                }
+            };
+            runChunks(countDigit);
+        }
+
+        // turn the histograms into each chunk's starting offset for each bucket. Chunks are
+        // ordered within a bucket, which keeps the sort stable.
+        uint32_t offset = 0;
+        for (size_t b = 0; b < RADIX_BUCKET_COUNT; b++) {
+            for (size_t c = 0; c < chunkCount; c++) {
+                const uint32_t n = histograms[c][digit][b];
+                histograms[c][digit][b] = offset;
+                offset += n;
+            }
+        }
+
+        auto scatter = [src, dst, count, chunkSize, histograms, digit, shift]
+                (uint32_t first, uint32_t n) {
+            for (uint32_t c = first; c < first + n; c++) {
+                uint32_t* const UTILS_RESTRICT offsets = histograms[c][digit];
+                SortEntry const* const UTILS_RESTRICT s = src + c * chunkSize;
+                SortEntry const* const UTILS_RESTRICT e =
+                        src + std::min(count, (c + 1) * chunkSize);
+                for (SortEntry const* p = s; p < e; ++p) {
+                    dst[offsets[(p->key >> shift) & (RADIX_BUCKET_COUNT - 1)]++] = *p;
+                }
+            }
+        };
+        runChunks(scatter);
+
+        std::swap(src, dst);
+    }
+
+    // finally, the commands are gathered in order, the writes are sequential and the scattered
+    // reads are prefetched a few commands ahead
+    auto gather = [src, begin, commands, count, chunkSize](uint32_t first, uint32_t n) {
+        const size_t s = first * chunkSize;
+        const size_t e = std::min(count, (first + n) * chunkSize);
+        for (size_t i = s; i < e; i++) {
+            if (i + RADIX_SORT_PREFETCH_DISTANCE < e) {
+                UTILS_PREFETCH(commands + src[i + RADIX_SORT_PREFETCH_DISTANCE].index);
+            }
+            begin[i] = commands[src[i].index];
+        }
+    };
+    runChunks(gather);
+}
+
+namespace {
+
+// CommandStreamSizer that also keeps track of programs that would need to be created
+struct CommandSizer : public CommandStreamSizer {
+    bool missingPrograms = false;
+};
+
+inline Handle<HwProgram> getProgram(FEngine::DriverApi&,
+        FMaterial const* ma, uint8_t variantKey) noexcept {
+    return ma->getProgram(variantKey);
+}
+
+inline Handle<HwProgram> getProgram(CommandSizer& sizer,
+        FMaterial const* ma, uint8_t variantKey) noexcept {
+    // programs are created synchronously through the main CommandStream, so this must happen
+    // before recording in parallel.
+    sizer.missingPrograms |= !ma->isProgramCached(variantKey);
+    return {};
+}
+
+} // anonymous namespace
+
+/* static */
+template<typename DriverApi>
+UTILS_ALWAYS_INLINE
+inline RenderPass::RecordStats RenderPass::recordCommands(DriverApi& UTILS_RESTRICT driver,
+        Handle<HwUniformBuffer> renderableUbh, Handle<HwUniformBuffer> bonesUbh,
+        Command const* const first, Command const* const last) noexcept {
+    constexpr size_t stride = FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
+    constexpr size_t bonesSize = CONFIG_MAX_BONE_COUNT * sizeof(RenderableManager::Bone);
+    constexpr uint32_t UNKNOWN = std::numeric_limits<uint32_t>::max();
+    // previousMi and the bound uniforms are reset for each range of commands, which guarantees
+    // that the first command of the range sets up all its state
+    FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
+    FMaterial const* UTILS_RESTRICT ma = nullptr;
+    uint32_t boundRenderable = UNKNOWN;     // row whose uniforms are bound, if any
+    uint32_t boundBones = UNKNOWN;          // offset of the bound bones, if any
+    HandleBase::HandleId previousProgram = HandleBase::nullid;
+    RecordStats stats;
+    for (Command const* UTILS_RESTRICT c = first; c != last; ++c) {
+        /*
+         * Be careful when changing code below, this is the hot inner-loop
+         */
+
+        // per-renderable uniform
+        PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
+        if (UTILS_UNLIKELY(!info.instanceCount)) {
+            // this primitive is drawn by the preceding instanced command
+            continue;
+        }
+        if (UTILS_LIKELY(info.instanceCount == 1)) {
+            // the primitives of a renderable share its uniforms, and often follow each other
+            if (info.index != boundRenderable) {
+                boundRenderable = info.index;
+                driver.bindUniformsRange(BindingPoints::PER_RENDERABLE, renderableUbh,
+                        info.index * stride, stride);
+                stats.stateChanges++;
+            } else {
+                stats.redundantCommands++;
+            }
+        } else {
+            boundRenderable = UNKNOWN;
+            driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.instancesUniforms);
+            stats.stateChanges++;
+        }
+        if (UTILS_UNLIKELY(info.materialVariant.hasSkinning())) {
+            // all the bones live in the palette, only the bound range changes
+            if (info.bonesOffset != boundBones) {
+                boundBones = info.bonesOffset;
+                driver.bindUniformsRange(BindingPoints::PER_RENDERABLE_BONES, bonesUbh,
+                        info.bonesOffset, bonesSize);
+                stats.stateChanges++;
+            } else {
+                stats.redundantCommands++;
+            }
+        }
+
+        FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
+        if (UTILS_UNLIKELY(mi != previousMi)) {
+            // this is always taken the first time
+            stats.redundantCommands += mi->use(driver, previousMi);
+            stats.stateChanges++;
+            stats.materialInstanceChanges++;
+            previousMi = mi;
+            ma = mi->getMaterial();
+        }
+
+        Handle<HwProgram> const ph = getProgram(driver, ma, info.materialVariant.key);
+        stats.programChanges += ph.getId() != previousProgram;
+        previousProgram = ph.getId();
+        if (UTILS_LIKELY(info.instanceCount == 1)) {
+            driver.draw(ph, info.rasterState, info.primitiveHandle);
+        } else {
+            driver.drawInstanced(ph, info.rasterState, info.primitiveHandle, info.instanceCount);
+        }
+        stats.draws++;
+    }
+    return stats;
 }
 
 UTILS_NOINLINE // no need to be inlined
-void RenderPass::recordDriverCommands(
+RenderPass::RecordStats RenderPass::recordDriverCommands(
         FEngine::DriverApi& UTILS_RESTRICT driver,  // using restrict here is very important
+        JobSystem& js, Handle<HwUniformBuffer> renderableUbh, Handle<HwUniformBuffer> bonesUbh,
         Slice<Command> const& commands) noexcept {
     SYSTRACE_CALL();
 
-    if (commands.size()) {
-        FMaterialInstance const* UTILS_RESTRICT previousMi = nullptr;
-        FMaterial const* UTILS_RESTRICT ma = nullptr;
-        Command const* UTILS_RESTRICT c;
-        for (c = commands.cbegin(); c->key != -1LLU; ++c) {
-            /*
-             * Be careful when changing code below, this is the hot inner-loop
-             */
-
-            // per-renderable uniform
-            PrimitiveInfo const& UTILS_RESTRICT info = c->primitive;
-            driver.bindUniforms(BindingPoints::PER_RENDERABLE, info.perRenderableUniforms);
-            if (info.perRenderableBones) {
-                driver.bindUniforms(BindingPoints::PER_RENDERABLE_BONES, info.perRenderableBones);
-            }
+    // all commands after the first sentinel are ignored
+    Command const* const first = commands.cbegin();
+    Command const* const last = std::partition_point(commands.cbegin(), commands.cend(),
+            [](Command const& c) { return c.key != uint64_t(Pass::SENTINEL); });
+    const size_t count = size_t(last - first);
+
+    SYSTRACE_VALUE32("commandCount", count);
+
+    if (count < JOBS_RECORD_MIN_COMMAND_COUNT) {
+        return recordCommands(driver, renderableUbh, bonesUbh, first, last);
+    }
+
+    size_t chunkCount = std::min(size_t(1) << js.getParallelSplitCount(),
+            JOBS_RECORD_MAX_CHUNK_COUNT);
+    chunkCount = std::max(size_t(1), std::min(chunkCount, count / JOBS_RECORD_MIN_CHUNK_SIZE));
+    const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+    auto runChunks = [&js, chunkCount](auto const& work) {
+        auto job = jobs::parallel_for(js, nullptr, 0, uint32_t(chunkCount),
+                std::cref(work), jobs::CountSplitter<1, 8>());
+        js.setName(job, "RenderPass::recordDriverCommands");
+        js.run(job);
+        js.waitAndRelease(job);
+    };
 
-            FMaterialInstance const* const UTILS_RESTRICT mi = info.mi;
-            if (UTILS_UNLIKELY(mi != previousMi)) {
-                // this is always taken the first time
-                previousMi = mi;
-                mi->use(driver);
-                ma = mi->getMaterial();
+    // First, compute how much space each chunk needs in the CommandStream
+    size_t sizes[JOBS_RECORD_MAX_CHUNK_COUNT];
+    bool missingPrograms[JOBS_RECORD_MAX_CHUNK_COUNT];
+    auto measure = [renderableUbh, bonesUbh, first, count, chunkSize, &sizes, &missingPrograms]
+            (uint32_t s, uint32_t n) {
+        for (uint32_t i = s; i < s + n; i++) {
+            CommandSizer sizer;
+            recordCommands(sizer, renderableUbh, bonesUbh, first + i * chunkSize,
+                    first + std::min(count, (i + 1) * chunkSize));
+            sizes[i] = sizer.getSize();
+            missingPrograms[i] = sizer.missingPrograms;
+        }
+    };
+    runChunks(measure);
+
+    // Programs that don't exist yet are created here, before the recorded commands
+    for (size_t i = 0; i < chunkCount; i++) {
+        if (UTILS_UNLIKELY(missingPrograms[i])) {
+            Command const* const e = first + std::min(count, (i + 1) * chunkSize);
+            for (Command const* c = first + i * chunkSize; c != e; ++c) {
+                c->primitive.mi->getMaterial()->getProgram(c->primitive.materialVariant.key);
             }
+        }
+    }
 
-            Handle<HwProgram> const ph = ma->getProgram(info.materialVariant.key);
-            driver.draw(ph, info.rasterState, info.primitiveHandle);
+    // Then record all chunks in parallel, each in its own chunk of the CommandStream. Chunks are
+    // laid out in the order of the commands, and the driver can execute them in parallel too.
+    static_assert(JOBS_RECORD_MAX_CHUNK_COUNT <= ChunksCommand::MAX_CHUNK_COUNT,
+            "The CommandStream can't keep that many chunks.");
+    void* chunks[JOBS_RECORD_MAX_CHUNK_COUNT];
+    driver.reserveChunks(sizes, chunkCount, chunks);
+    RecordStats stats[JOBS_RECORD_MAX_CHUNK_COUNT];
+    auto record = [&driver, renderableUbh, bonesUbh, first, count, chunkSize,
+            &sizes, &chunks, &stats](uint32_t s, uint32_t n) {
+        for (uint32_t i = s; i < s + n; i++) {
+            CircularBuffer segment(chunks[i], sizes[i]);
+            CommandStream stream(driver, segment);
+            stats[i] = recordCommands(stream, renderableUbh, bonesUbh,
+                    first + i * chunkSize, first + std::min(count, (i + 1) * chunkSize));
+            assert(segment.getHead() == static_cast<char*>(chunks[i]) + sizes[i]);
         }
+    };
+    runChunks(record);
 
-        SYSTRACE_VALUE32("commandCount", c - commands.cbegin());
+    RecordStats result;
+    for (size_t i = 0; i < chunkCount; i++) {
+        result += stats[i];
+    }
+    return result;
+}
+
+/* static */
+void RenderPass::instanceCommands(FEngine& engine, FScene::RenderableSoa const& soa,
+        Command* const begin, Command* const end) noexcept {
+    SYSTRACE_CALL();
+
+    using InstancesUib = FEngine::PerRenderableInstancesUib;
+    using PerRenderableUib = FEngine::PerRenderableUib;
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    FRenderableManager& rcm = engine.getRenderableManager();
+
+    // commands with the same material instance, primitive, raster state and variant only differ
+    // by their per-renderable uniforms. Skinned commands are never instanced.
+    auto isInstanceOf = [](PrimitiveInfo const& info, PrimitiveInfo const& leader) {
+        return info.mi == leader.mi &&
+               info.primitiveHandle.getId() == leader.primitiveHandle.getId() &&
+               info.rasterState == leader.rasterState &&
+               info.materialVariant.key == leader.materialVariant.key &&
+               !info.materialVariant.hasSkinning();
+    };
+
+    // all commands after the first sentinel are ignored
+    Command* const last = std::partition_point(begin, end,
+            [](Command const& c) { return c.key != uint64_t(Pass::SENTINEL); });
+
+    for (Command* first = begin; first != last;) {
+        PrimitiveInfo& UTILS_RESTRICT leader = first->primitive;
+        Command* next = first + 1;
+        if (!leader.materialVariant.hasSkinning() && leader.mi->getMaterial()->hasInstancing()) {
+            Command* const e = first + std::min(size_t(last - first), CONFIG_MAX_INSTANCE_COUNT);
+            while (next != e && isInstanceOf(next->primitive, leader)) {
+                ++next;
+            }
+        }
+
+        const size_t count = size_t(next - first);
+        if (count >= INSTANCING_MIN_COMMAND_COUNT) {
+            // gather the per-renderable data of all instances, which is already in std140 layout
+            constexpr size_t transformSize = sizeof(InstancesUib::worldFromModelMatrix[0]);
+            constexpr size_t normalSize = sizeof(InstancesUib::worldFromModelNormalMatrix[0]);
+            UniformBuffer uniforms(sizeof(InstancesUib));
+            char* const data = static_cast<char*>(
+                    uniforms.invalidateUniforms(0, sizeof(InstancesUib)));
+            char* const UTILS_RESTRICT transforms =
+                    data + offsetof(InstancesUib, worldFromModelMatrix);
+            char* const UTILS_RESTRICT normals =
+                    data + offsetof(InstancesUib, worldFromModelNormalMatrix);
+            for (size_t i = 0; i < count; i++) {
+                PrimitiveInfo& info = first[i].primitive;
+                const FRenderableManager::Instance ri =
+                        soa.elementAt<FScene::RENDERABLE_INSTANCE>(info.index);
+                char const* const UTILS_RESTRICT src = static_cast<char const*>(
+                        rcm.getUniformBuffer(ri).getBuffer());
+                memcpy(transforms + i * transformSize,
+                        src + offsetof(PerRenderableUib, worldFromModelMatrix), transformSize);
+                memcpy(normals + i * normalSize,
+                        src + offsetof(PerRenderableUib, worldFromModelNormalMatrix), normalSize);
+                info.instanceCount = 0;
+            }
+
+            Handle<HwUniformBuffer> ubh = engine.acquireInstancesUniformBuffer();
+            engine.countUniformUpdate(uniforms);
+            driver.updateUniformBuffer(ubh, std::move(uniforms));
+
+            leader.instancesUniforms = ubh;
+            leader.materialVariant.setInstancing(true);
+            leader.instanceCount = uint16_t(count);
+        }
+        first = next;
     }
 }
 
@@ -153,8 +604,8 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
         FMaterialInstance const* const UTILS_RESTRICT mi) noexcept {
 
     FMaterial const * const UTILS_RESTRICT ma = mi->getMaterial();
-    uint8_t variant =
-            Variant::filterVariant(cmdDraw.primitive.materialVariant.key, ma->isVariantLit());
+    uint8_t variant = Variant::filterVariant(cmdDraw.primitive.materialVariant.key,
+            ma->isVariantLit(), ma->hasPunctualLights());
 
     // Below, we evaluate both commands to avoid a branch
 
@@ -167,7 +618,9 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
     keyDraw &= ~(PASS_MASK | BLENDING_MASK | MATERIAL_MASK);
     keyDraw |= uint64_t(Pass::COLOR);
     keyDraw |= mi->getSortingKey(); // already all set-up for direct or'ing
-    keyDraw |= makeField(variant, MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
+    // the variants of the pass are the same for all its commands, they don't need sorting
+    keyDraw |= makeField(variant & ~Variant::PASS_MASK,
+            MATERIAL_VARIANT_KEY_MASK, MATERIAL_VARIANT_KEY_SHIFT);
     keyDraw |= makeField(ma->getRasterState().alphaToCoverage, BLENDING_MASK, BLENDING_SHIFT);
 
     bool hasBlending = ma->getRasterState().hasBlending();
@@ -197,7 +650,8 @@ void RenderPass::setupColorCommand(Command& cmdDraw, bool hasDepthPass,
 /* static */
 UTILS_NOINLINE
 void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const commands,
-        FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
+        FScene::RenderableSoa const& soa, uint32_t first, utils::Range<uint32_t> range,
+        RenderFlags renderFlags, uint16_t visibleMask,
         math::float3 cameraPosition, math::float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
@@ -206,7 +660,7 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
     // the list twice)
 
     // compute how much maximum storage we need
-    uint32_t offset = FScene::getPrimitiveCount(soa, range.first);
+    uint32_t offset = FScene::getPrimitiveCount(soa, first, range.first);
     // double the color pass for transparents that need to render twice
     const bool colorPass  = bool(commandTypeFlags & CommandTypeFlags::COLOR);
     const bool depthPass  = bool(commandTypeFlags & (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
@@ -233,15 +687,15 @@ void RenderPass::generateCommands(uint32_t commandTypeFlags, Command* const comm
         default: // squash IDE warning -- should never happen.
         case CommandTypeFlags::COLOR:
             generateCommandsImpl<CommandTypeFlags::COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibleMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::DEPTH_AND_COLOR:
             generateCommandsImpl<CommandTypeFlags::DEPTH_AND_COLOR>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibleMask, cameraPosition, cameraForward);
             break;
         case CommandTypeFlags::SHADOW:
             generateCommandsImpl<CommandTypeFlags::SHADOW>(commandTypeFlags, curr,
-                    soa, range, renderFlags, cameraPosition, cameraForward);
+                    soa, range, renderFlags, visibleMask, cameraPosition, cameraForward);
             break;
     }
 }
@@ -252,7 +706,7 @@ UTILS_NOINLINE
 void RenderPass::generateCommandsImpl(uint32_t,
         Command* UTILS_RESTRICT curr,
         FScene::RenderableSoa const& UTILS_RESTRICT soa, utils::Range<uint32_t> range,
-        RenderFlags renderFlags,
+        RenderFlags renderFlags, uint16_t visibleMask,
         float3 cameraPosition, float3 cameraForward) noexcept {
 
     // generateCommands() writes both the draw and depth commands simultaneously such that
@@ -266,20 +720,36 @@ void RenderPass::generateCommandsImpl(uint32_t,
 
     auto const* const UTILS_RESTRICT soaWorldAABBCenter = soa.data<FScene::WORLD_AABB_CENTER>();
     auto const* const UTILS_RESTRICT soaVisibility      = soa.data<FScene::VISIBILITY_STATE>();
-    auto const* const UTILS_RESTRICT soaPrimitives      = soa.data<FScene::PRIMITIVES>();
-    auto const* const UTILS_RESTRICT soaUbh             = soa.data<FScene::UBH>();
-    auto const* const UTILS_RESTRICT soaBonesUbh        = soa.data<FScene::BONES_UBH>();
+    auto const* const UTILS_RESTRICT soaPrimitives      = shadowPass ?
+            soa.data<FScene::SHADOW_PRIMITIVES>() : soa.data<FScene::PRIMITIVES>();
+    auto const* const UTILS_RESTRICT soaBonesOffset     = soa.data<FScene::BONES_OFFSET>();
+    auto const* const UTILS_RESTRICT soaVisibleMask     = soa.data<FScene::VISIBLE_MASK>();
+    auto const* const UTILS_RESTRICT soaSpotShadowMask  = soa.data<FScene::SPOT_SHADOW_MASK>();
 
     const bool hasShadowing = renderFlags & HAS_SHADOWING;
+    const bool staticCastersOnly = shadowPass & bool(renderFlags & STATIC_SHADOW_CASTERS);
+    const bool dynamicCastersOnly = shadowPass & bool(renderFlags & DYNAMIC_SHADOW_CASTERS);
+    const bool occludersOnly = colorPass & depthPass & bool(renderFlags & DEPTH_PREPASS_OCCLUDERS);
+    const bool skipLowResolution = colorPass & bool(renderFlags & SKIP_LOW_RESOLUTION_BLENDING);
+    const bool lowResolutionOnly = colorPass & bool(renderFlags & LOW_RESOLUTION_BLENDING_ONLY);
+    const bool stereo = !shadowPass & bool(renderFlags & STEREO);
+    // Without depth pre-pass, the opaque commands are bucketed by Z, front-to-back, and then
+    // sorted by material in each bucket. The top 10 bits of the distance bucketize the depth by
+    // its log2 and in 4 linear chunks in each bucket, the top 16 bits in 256 linear chunks,
+    // which is front-to-back for all practical purposes.
+    const bool zBuckets = !bool(renderFlags & RENDER_ORDER_STATE_FIRST);
+    const uint32_t zBucketShift = (renderFlags & RENDER_ORDER_FRONT_TO_BACK) ? 16u : 22u;
     Variant materialVariant;
     materialVariant.setDirectionalLighting(renderFlags & HAS_DIRECTIONAL_LIGHT);
     materialVariant.setDynamicLighting(renderFlags & HAS_DYNAMIC_LIGHTING);
     materialVariant.setShadowReceiver(false); // this is set per Renderable
+    materialVariant.setStereo(stereo);
 
     Command cmdColor;
 
     Command cmdDepth;
     cmdDepth.primitive.materialVariant = { Variant::DEPTH_VARIANT };
+    cmdDepth.primitive.materialVariant.setStereo(stereo);
     cmdDepth.primitive.rasterState = Driver::RasterState();
     cmdDepth.primitive.rasterState.colorWrite = false;
     cmdDepth.primitive.rasterState.depthWrite = true;
@@ -318,8 +788,8 @@ void RenderPass::generateCommandsImpl(uint32_t,
         const uint32_t distanceBits = reinterpret_cast<uint32_t&>(distance);
 
         cmdColor.key = makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
-        cmdColor.primitive.perRenderableUniforms = soaUbh[i];
-        cmdColor.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdColor.primitive.bonesOffset = soaBonesOffset[i];
+        cmdColor.primitive.index = i;
         materialVariant.setShadowReceiver(soaVisibility[i].receiveShadows & hasShadowing);
         materialVariant.setSkinning(soaVisibility[i].skinning);
 
@@ -328,13 +798,31 @@ void RenderPass::generateCommandsImpl(uint32_t,
         cmdDepth.key = uint64_t(Pass::DEPTH);
         cmdDepth.key |= makeField(soaVisibility[i].priority, PRIORITY_MASK, PRIORITY_SHIFT);
         cmdDepth.key |= makeField(distanceBits, DISTANCE_BITS_MASK, DISTANCE_BITS_SHIFT);
-        cmdDepth.primitive.perRenderableUniforms = soaUbh[i];
-        cmdDepth.primitive.perRenderableBones = soaBonesUbh[i];
+        cmdDepth.primitive.bonesOffset = soaBonesOffset[i];
+        cmdDepth.primitive.index = i;
         cmdDepth.primitive.materialVariant.setSkinning(soaVisibility[i].skinning);
 
+        // the renderables left out of a limited depth prepass write their depth in the color pass
+        const bool prepassed = depthPass & (!occludersOnly | soaVisibility[i].depthPrepass);
+
         const bool shadowCaster = soaVisibility[i].castShadows & hasShadowing;
         const bool writeDepthForShadows = shadowPass & shadowCaster;
 
+        // the commands are still written, but cancelled, when the renderable isn't in this pass
+        const bool staticCaster = soaVisibility[i].staticShadowCaster;
+        const uint16_t mask = uint16_t(soaVisibleMask[i] | (soaSpotShadowMask[i] << 8u));
+        const CommandKey hidden = select(!(mask & visibleMask) |
+                (staticCastersOnly & !staticCaster) | (dynamicCastersOnly & staticCaster));
+
+        // the opaque and the blended color commands that aren't in this pass
+        const bool lowResolution = soaVisibility[i].lowResolutionBlending;
+        // the skybox is opaque, but can be drawn with the low resolution blended primitives
+        const bool lowResolutionSkybox = soaVisibility[i].skybox & lowResolution;
+        const CommandKey hiddenOpaque = select((lowResolutionOnly & !lowResolutionSkybox) |
+                (skipLowResolution & lowResolutionSkybox));
+        const CommandKey hiddenBlended = select((skipLowResolution & lowResolution) |
+                (lowResolutionOnly & !lowResolution));
+
         const Slice<FRenderPrimitive>& primitives = soaPrimitives[i];
 
         /*
@@ -343,10 +831,12 @@ void RenderPass::generateCommandsImpl(uint32_t,
          */
         for (auto const& primitive : primitives) {
             FMaterialInstance const* const mi = primitive.getMaterialInstance();
+            // the materials built without the stereo variants can't be drawn in a stereo pass
+            const CommandKey noStereo = select(stereo & !mi->getMaterial()->hasStereo());
             if (colorPass) {
                 cmdColor.primitive.primitiveHandle = primitive.getHwHandle();
                 cmdColor.primitive.materialVariant = materialVariant;
-                RenderPass::setupColorCommand(cmdColor, depthPass, mi);
+                RenderPass::setupColorCommand(cmdColor, prepassed, mi);
 
                 const bool blendPass = Pass(cmdColor.key & PASS_MASK) == Pass::BLENDED;
                 if (blendPass) {
@@ -389,6 +879,8 @@ void RenderPass::generateCommandsImpl(uint32_t,
                     // correct for TransparencyMode::DEFAULT -- i.e. cancel the command
                     key |= select(mode == TransparencyMode::DEFAULT);
 
+                    key |= hidden | noStereo | hiddenBlended;
+
                     *curr = cmdColor;
                     curr->key = key;
                     ++curr;
@@ -406,16 +898,18 @@ void RenderPass::generateCommandsImpl(uint32_t,
                             SamplerCompareFunc::LE : cmdColor.primitive.rasterState.depthFunc;
                 } else {
                     // color pass, opaque objects...
-                    if (!depthPass) {
-                        // ...without depth pre-pass:
-                        // this will bucket objects by Z, front-to-back and then sort by material
-                        // in each buckets. We use the top 10 bits of the distance, which
-                        // bucketizes the depth by its log2 and in 4 linear chunks in each bucket.
+                    if (!prepassed & zBuckets) {
+                        // ...without depth pre-pass: by Z-bucket, then by material
                         cmdColor.key &= ~Z_BUCKET_MASK;
-                        cmdColor.key |= makeField(distanceBits >> 22, Z_BUCKET_MASK,
+                        cmdColor.key |= makeField(distanceBits >> zBucketShift, Z_BUCKET_MASK,
                                 Z_BUCKET_SHIFT);
                     }
-                    // ...with depth pre-pass, we just sort by materials
+                    // ...with depth pre-pass (or RENDER_ORDER_STATE_FIRST), we just sort by
+                    // materials
+
+                    // the skybox is drawn after all the other opaque primitives, at the far
+                    // plane, so that the depth test rejects the pixels they covered
+                    cmdColor.key |= makeField(soaVisibility[i].skybox, SKYBOX_MASK, SKYBOX_SHIFT);
                     curr->key = uint64_t(Pass::SENTINEL);
                     ++curr;
                 }
@@ -423,14 +917,27 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 *curr = cmdColor;
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
+                curr->key |= hidden | noStereo | (blendPass ? hiddenBlended : hiddenOpaque);
                 ++curr;
             }
 
             if (depthPass) {
                 Driver::RasterState rs = mi->getMaterial()->getRasterState();
 
+                // the depth variants only read the positions and the bones of skinned
+                // renderables, except for masked materials which run their whole vertex shader
+                AttributeBitset required;
+                required.set(VertexAttribute::POSITION);
+                if (mi->getMaterial()->getBlendingMode() == BlendingMode::MASKED) {
+                    required |= mi->getMaterial()->getRequiredAttributes();
+                }
+                if (soaVisibility[i].skinning) {
+                    required.set(VertexAttribute::BONE_INDICES);
+                    required.set(VertexAttribute::BONE_WEIGHTS);
+                }
+
                 // unconditionally write the command
-                cmdDepth.primitive.primitiveHandle = primitive.getHwHandle();
+                cmdDepth.primitive.primitiveHandle = primitive.getDepthHwHandle(required);
                 cmdDepth.primitive.mi = mi;
                 cmdDepth.primitive.rasterState.culling = rs.culling;
                 *curr = cmdDepth;
@@ -444,7 +951,7 @@ void RenderPass::generateCommandsImpl(uint32_t,
                 bool issueDepth =
                         (rs.depthWrite & !(colorPass & (rs.alphaToCoverage | rs.hasBlending())))
                         | writeDepthForShadows;
-                curr->key |= select(!issueDepth);
+                curr->key |= select(!issueDepth | !prepassed) | hidden | noStereo;
 
                 // handle the case where this primitive is empty / no-op
                 curr->key |= select(primitive.getPrimitiveType() == PrimitiveType::NONE);
@@ -473,8 +980,10 @@ void RenderPass::updateSummedPrimitiveCounts(
 // ------------------------------------------------------------------------------------------------
 
 FRenderer::ColorPass::ColorPass(const char* name,
-        JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth)
-        : RenderPass(name), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth) {
+        JobSystem& js, JobSystem::Job* jobFroxelize,FView* view, Handle<HwRenderTarget> const rth,
+        Subpass const* subpass)
+        : RenderPass(name), js(js), jobFroxelize(jobFroxelize), view(view), rth(rth),
+          subpass(subpass) {
 }
 
 void FRenderer::ColorPass::beginRenderPass(
@@ -484,9 +993,11 @@ void FRenderer::ColorPass::beginRenderPass(
     js.wait(jobFroxelize);
     view->commitFroxels(driver);
 
-    // We won't need the depth or stencil buffers after this pass.
+    // We won't need the depth or stencil buffers after this pass, unless the low resolution
+    // blending pass tests against the depth buffer.
     RenderPassParams params = {};
-    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.discardEnd = view->hasLowResolutionBlending() ?
+            TargetBufferFlags::STENCIL : TargetBufferFlags::DEPTH_AND_STENCIL;
     params.left = viewport.left;
     params.bottom = viewport.bottom;
     params.width = viewport.width;
@@ -506,6 +1017,12 @@ void FRenderer::ColorPass::beginRenderPass(
             params.clear = TargetBufferFlags::DEPTH_AND_STENCIL;
         }
         params.discardStart = TargetBufferFlags::ALL;
+        if (subpass) {
+            // the color pass draws into a transient attachment, rth is only written by the
+            // second subpass
+            params.dependencies |= RenderPassParams::SUBPASS_INPUT;
+            params.subpassFormat = subpass->format;
+        }
         driver.beginRenderPass(rth, params);
     } else {
         params.discardStart = view->getDiscardedTargetBuffers();
@@ -523,6 +1040,13 @@ void FRenderer::ColorPass::beginRenderPass(
 }
 
 void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept {
+    if (subpass) {
+        driver.nextSubpass();
+        subpass->draw(driver);
+        driver.endRenderPass();
+        return;
+    }
+
     driver.endRenderPass();
 
     // and we don't need the color buffer in the areas we don't use
@@ -536,76 +1060,176 @@ void FRenderer::ColorPass::endRenderPass(DriverApi& driver, Viewport const& view
     }
 }
 
+static RenderPass::RenderFlags getColorPassFlags(FView const* view) noexcept {
+    RenderPass::RenderFlags flags = 0;
+    if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
+    if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    if (view->hasDirectionalLight() || view->hasSpotShadows()) {
+        // shadow receivers with dynamic lighting but no directional lighting are a reserved
+        // variant, so spot shadows need the directional lighting variant (the light is then
+        // black)
+        flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+    }
+    if (view->isStereo())               flags |= RenderPass::STEREO;
+    switch (view->getRenderOrder()) {
+        case View::RenderOrder::HYBRID:
+            break;
+        case View::RenderOrder::FRONT_TO_BACK:
+            flags |= RenderPass::RENDER_ORDER_FRONT_TO_BACK;
+            break;
+        case View::RenderOrder::STATE_FIRST:
+            flags |= RenderPass::RENDER_ORDER_STATE_FIRST;
+            break;
+    }
+    return flags;
+}
+
+JobSystem::Job* FRenderer::ColorPass::prepareColorPass(JobSystem& js, ArenaScope& arena,
+        FView* view, GrowingSlice<Command>& commands) noexcept {
+
+    RenderPass::RenderFlags flags = getColorPassFlags(view);
+    if (view->hasLowResolutionBlending()) {
+        // these are drawn by the BlendingPass
+        flags |= RenderPass::SKIP_LOW_RESOLUTION_BLENDING;
+    }
+
+    // the depth prepass strategy is picked by FView::prepare() each frame
+    const CommandTypeFlags commandType = view->hasDepthPrepass() ? DEPTH_AND_COLOR : COLOR;
+    if (view->hasDepthPrepass() && view->isDepthPrepassLimited()) {
+        flags |= RenderPass::DEPTH_PREPASS_OCCLUDERS;
+    }
+
+    // The commands only depend on the scene and the viewing camera, which don't change until
+    // the view is rendered, so they're generated while the shadow maps are being rendered.
+    // This job must only touch the arena and commands it's given.
+    JobSystem::Job* job = js.createJob(nullptr,
+            [&arena, view, &commands, commandType, flags](JobSystem& js, JobSystem::Job*) {
+                RenderPass::prepareCommands(js, arena,
+                        view->getScene()->getRenderableData(), view->getVisibleRenderables(),
+                        commandType, flags, FView::getRenderableVisibleMask(),
+                        view->getCameraInfo(), commands, view->getColorPassCommandCache());
+            });
+    js.setName(job, "ColorPass::prepareColorPass");
+    js.run(job);
+    return job;
+}
+
 void FRenderer::ColorPass::renderColorPass(FEngine& engine, JobSystem& js,
+        JobSystem::Job* jobPrepare, JobSystem::Job* jobFroxelize,
         Handle<HwRenderTarget> const rth, FView* view, Viewport const& scaledViewport,
-        GrowingSlice<Command>& commands) noexcept {
-
-    // start the froxelization immediately, it has no dependencies
-    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
-            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
-    js.run(jobFroxelize);
+        GrowingSlice<Command>& commands, Subpass const* subpass) noexcept {
 
     CameraInfo const& cameraInfo = view->getCameraInfo();
     auto& soa = view->getScene()->getRenderableData();
-    auto vr = view->getVisibleRenderables();
-
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
 
     DriverApi& driver = engine.getDriverApi();
     view->prepareCamera(cameraInfo, scaledViewport);
-    view->commitUniforms(driver);
-
-    RenderPass::RenderFlags flags = 0;
-    if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
-    if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
-    if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    view->commitUniforms(engine);
 
-    CommandTypeFlags commandType;
-    switch (view->getDepthPrepass()) {
-        case View::DepthPrepass::DEFAULT:
-            // TODO: better default strategy (can even change on a per-frame basis)
-#ifdef ANDROID
-            commandType = COLOR;
-#else
-            commandType = DEPTH_AND_COLOR;
-#endif
-            break;
-        case View::DepthPrepass::DISABLED:
-            commandType = COLOR;
-            break;
-        case View::DepthPrepass::ENABLED:
-            commandType = DEPTH_AND_COLOR;
-            break;
+    { // scope for systrace
+        SYSTRACE_NAME("wait for color pass commands");
+        js.waitAndRelease(jobPrepare);
     }
 
-    ColorPass colorPass("ColorPass", js, jobFroxelize, view, rth);
+    ColorPass colorPass("ColorPass", js, jobFroxelize, view, rth, subpass);
     driver.pushGroupMarker("Color Pass");
-    colorPass.render(engine, js, soa, vr, commandType, flags, cameraInfo, scaledViewport, commands);
+    colorPass.execute(engine, js, soa, view->getRenderableUbh(), cameraInfo, scaledViewport,
+            commands);
     driver.popGroupMarker();
+
+    // the color pass waited for the froxelization
+    if (view->hasDynamicLighting()) {
+        Froxelizer const& froxelizer = view->getFroxelizer();
+        engine.debug.stats.froxels += int(froxelizer.getFroxelCount());
+        engine.debug.stats.occupied_froxels += int(froxelizer.getOccupiedFroxelCount());
+        engine.debug.stats.froxel_records += int(froxelizer.getRecordCount());
+    }
 }
 
 // ------------------------------------------------------------------------------------------------
 
-FRenderer::ShadowPass::ShadowPass(const char* name,
-        ShadowMap const& shadowMap) noexcept
-        : RenderPass(name), shadowMap(shadowMap) {
+FRenderer::BlendingPass::BlendingPass(const char* name, FView* view,
+        Handle<HwRenderTarget> const rth) noexcept
+        : RenderPass(name), view(view), rth(rth) {
 }
 
-void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
-    shadowMap.beginRenderPass(driver);
+void FRenderer::BlendingPass::beginRenderPass(
+        driver::DriverApi& driver, Viewport const& viewport, const CameraInfo&) noexcept {
+    // The blended primitives are drawn over transparent black, and tested against the depth
+    // buffer blitted from the color pass. Neither is needed once they're composited.
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::COLOR;
+    params.discardStart = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.discardEnd = TargetBufferFlags::DEPTH_AND_STENCIL;
+    params.left = viewport.left;
+    params.bottom = viewport.bottom;
+    params.width = viewport.width;
+    params.height = viewport.height;
+    params.clearColor = {};
+    params.dependencies = RenderPassParams::DEPENDENCY_BY_REGION;
+    driver.beginRenderPass(rth, params);
 }
 
-void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
-        FView* view, GrowingSlice<Command>& commands) noexcept {
+void FRenderer::BlendingPass::endRenderPass(DriverApi& driver, Viewport const&) noexcept {
+    driver.endRenderPass();
+}
 
+void FRenderer::BlendingPass::renderBlendingPass(FEngine& engine, JobSystem& js,
+        ArenaScope& arena, Handle<HwRenderTarget> const rth, FView* view,
+        Viewport const& scaledViewport, Viewport const& viewport,
+        GrowingSlice<Command>& commands) noexcept {
+
+    CameraInfo const& cameraInfo = view->getCameraInfo();
     auto& soa = view->getScene()->getRenderableData();
-    auto vr = view->getVisibleShadowCasters();
-    ShadowMap const& shadowMap = view->getShadowMap();
-    Viewport const& viewport = shadowMap.getViewport();
-    FCamera const& camera = shadowMap.getCamera();
 
-    CameraInfo cameraInfo = {
+    // the uniforms are restored for the passes after this one
+    DriverApi& driver = engine.getDriverApi();
+    const float factor = float(scaledViewport.width) / float(viewport.width);
+    view->prepareDownsampledCamera(cameraInfo, viewport, factor);
+    view->commitUniforms(engine);
+
+    // only the blended commands of the low resolution renderables are generated
+    RenderPass::prepareCommands(js, arena, soa, view->getVisibleRenderables(),
+            CommandTypeFlags::COLOR,
+            getColorPassFlags(view) | RenderPass::LOW_RESOLUTION_BLENDING_ONLY,
+            FView::getRenderableVisibleMask(), cameraInfo, commands, nullptr);
+
+    BlendingPass blendingPass("BlendingPass", view, rth);
+    driver.pushGroupMarker("Low Resolution Blending Pass");
+    blendingPass.execute(engine, js, soa, view->getRenderableUbh(), cameraInfo, viewport,
+            commands);
+    driver.popGroupMarker();
+
+    view->prepareDownsampledCamera(cameraInfo, scaledViewport, 1.0f);
+    view->commitUniforms(engine);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+FRenderer::ShadowPass::ShadowPass(const char* name,
+        CascadedShadowMap const& shadowMap, size_t cascade, bool first, bool staticCasters) noexcept
+        : RenderPass(name), shadowMap(&shadowMap), atlas(nullptr), cascade(cascade), first(first),
+          staticCasters(staticCasters) {
+}
+
+FRenderer::ShadowPass::ShadowPass(const char* name,
+        ShadowAtlas const& atlas, size_t index, bool first) noexcept
+        : RenderPass(name), shadowMap(nullptr), atlas(&atlas), cascade(index), first(first),
+          staticCasters(false) {
+}
+
+void FRenderer::ShadowPass::beginRenderPass(driver::DriverApi& driver, Viewport const&, const CameraInfo&) noexcept {
+    if (atlas) {
+        atlas->beginRenderPass(driver, cascade, first);
+    } else if (staticCasters) {
+        shadowMap->beginStaticRenderPass(driver, cascade);
+    } else {
+        shadowMap->beginRenderPass(driver, cascade, first);
+    }
+}
+
+static CameraInfo getShadowCameraInfo(FCamera const& camera) noexcept {
+    return CameraInfo{
             .projection         = mat4f{ camera.getProjectionMatrix() },
             .cullingProjection  = mat4f{ camera.getCullingProjectionMatrix() },
             .model              = camera.getModelMatrix(),
@@ -613,22 +1237,84 @@ void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js,
             .zn                 = camera.getNear(),
             .zf                 = camera.getCullingFar(),
     };
+}
 
-    // populate the RenderPrimitive array with the proper LOD
-    view->updatePrimitivesLod(engine, cameraInfo, soa, vr);
+void FRenderer::ShadowPass::renderShadowMap(FEngine& engine, JobSystem& js, ArenaScope& arena,
+        FView* view, GrowingSlice<Command>& commands) noexcept {
 
-    driver::DriverApi& driver = engine.getDriverApi();
-    view->prepareCamera(cameraInfo, viewport);
-    view->commitUniforms(driver);
+    auto& soa = view->getScene()->getRenderableData();
+    auto vr = view->getVisibleShadowCasters();
+    CascadedShadowMap const& shadowMap = view->getShadowMap();
+    ShadowAtlas const& atlas = view->getShadowAtlas();
 
     RenderPass::RenderFlags flags = 0;
     if (view->hasShadowing())           flags |= RenderPass::HAS_SHADOWING;
-    if (view->hasDirectionalLight())    flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
     if (view->hasDynamicLighting())     flags |= RenderPass::HAS_DYNAMIC_LIGHTING;
+    if (view->hasDirectionalLight() || view->hasSpotShadows()) {
+        // see ColorPass::prepareColorPass()
+        flags |= RenderPass::HAS_DIRECTIONAL_LIGHT;
+    }
 
-    ShadowPass shadowPass("ShadowPass", shadowMap);
+    // Each cascade is rendered in its own pass, into its tile of the shadow map. The commands of
+    // a cascade are generated (in parallel) just before it's rendered, because they use the
+    // same command buffer.
+    // With static caching, the static casters are only rendered when their cached tile is out
+    // of date, and the pass of the cascade then just adds the dynamic casters.
+    const bool staticCaching = shadowMap.isStaticCachingEnabled();
+    driver::DriverApi& driver = engine.getDriverApi();
     driver.pushGroupMarker("Shadow map Pass");
-    shadowPass.render(engine, js, soa, vr, CommandTypeFlags::SHADOW, flags, cameraInfo, viewport, commands);
+    bool first = true;
+    const size_t cascadeCount = view->hasDirectionalShadows() ? shadowMap.getCascadeCount() : 0;
+    for (size_t i = 0; i < cascadeCount; i++) {
+        ShadowMap const& cascade = shadowMap.getCascade(i);
+        if (!cascade.hasVisibleShadows()) {
+            continue;
+        }
+
+        Viewport const& viewport = cascade.getViewport();
+        CameraInfo cameraInfo = getShadowCameraInfo(cascade.getCamera());
+
+        view->prepareCamera(cameraInfo, viewport);
+        view->commitUniforms(engine);
+
+        if (staticCaching && shadowMap.isStaticCacheDirty(i)) {
+            // this is rare, so it doesn't evict the cached commands of the cascade
+            commands.clear();
+            ShadowPass staticPass("StaticShadowPass", shadowMap, i, first, true);
+            staticPass.render(engine, js, arena, soa, view->getRenderableUbh(), vr,
+                    CommandTypeFlags::SHADOW, flags | RenderPass::STATIC_SHADOW_CASTERS,
+                    FView::getShadowCascadeVisibleMask(i), cameraInfo, viewport, commands,
+                    nullptr);
+        }
+
+        commands.clear();
+        ShadowPass shadowPass("ShadowPass", shadowMap, i, first, false);
+        shadowPass.render(engine, js, arena, soa, view->getRenderableUbh(), vr,
+                CommandTypeFlags::SHADOW,
+                staticCaching ? flags | RenderPass::DYNAMIC_SHADOW_CASTERS : flags,
+                FView::getShadowCascadeVisibleMask(i), cameraInfo, viewport, commands,
+                view->getShadowPassCommandCache(i));
+        first = false;
+    }
+
+    // The spot light shadow maps are rendered the same way, into their tile of the atlas.
+    // Their lights change every frame, so their commands aren't cached.
+    first = true;
+    for (size_t i = 0, c = atlas.getShadowMapCount(); i < c; i++) {
+        ShadowMap const& spotShadowMap = atlas.getShadowMap(i);
+        Viewport const& viewport = spotShadowMap.getViewport();
+        CameraInfo cameraInfo = getShadowCameraInfo(spotShadowMap.getCamera());
+
+        view->prepareCamera(cameraInfo, viewport);
+        view->commitUniforms(engine);
+
+        commands.clear();
+        ShadowPass shadowPass("SpotShadowPass", atlas, i, first);
+        shadowPass.render(engine, js, arena, soa, view->getRenderableUbh(), vr,
+                CommandTypeFlags::SHADOW, flags,
+                FView::getSpotShadowVisibleMask(i), cameraInfo, viewport, commands, nullptr);
+        first = false;
+    }
     driver.popGroupMarker();
 }
 
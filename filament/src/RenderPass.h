@@ -19,6 +19,7 @@
 
 #include <filament/Viewport.h>
 
+#include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/Material.h"
 #include "details/Scene.h"
@@ -30,6 +31,10 @@
 #include <utils/compiler.h>
 #include <utils/Slice.h>
 
+#include <limits.h>
+
+#include <vector>
+
 namespace utils {
 class JobSystem;
 }
@@ -63,7 +68,7 @@ public:
     static constexpr uint64_t MATERIAL_MASK                 = 0xFFFFFFFFllu;
     static constexpr int MATERIAL_SHIFT                     = 0;
 
-    static constexpr uint64_t Z_BUCKET_MASK                 = 0x3FF00000000llu;
+    static constexpr uint64_t Z_BUCKET_MASK                 = 0xFFFF00000000llu;
     static constexpr int Z_BUCKET_SHIFT                     = 32;
 
     static constexpr uint64_t PRIORITY_MASK                 = 0x001C000000000000llu;
@@ -72,6 +77,9 @@ public:
     static constexpr uint64_t BLENDING_MASK                 = 0x00E0000000000000llu;
     static constexpr int BLENDING_SHIFT                     = 53;
 
+    static constexpr uint64_t SKYBOX_MASK                   = 0x0040000000000000llu;
+    static constexpr int SKYBOX_SHIFT                       = 54;
+
     static constexpr uint64_t PASS_MASK                     = 0xFF00000000000000llu;
     static constexpr int PASS_SHIFT                         = 56;
 
@@ -94,6 +102,7 @@ public:
     // --------------------
     //
     // a     = alpha masking
+    // s     = skybox
     // bbb   = blending
     // ppp   = priority
     // t     = two-pass transparency ordering
@@ -110,17 +119,20 @@ public:
     // COLOR command (with depth prepass)
     // |    8   | 3 | 3 | 2|       16       |               32               |
     // +--------+---+---+--+----------------+--------------------------------+
-    // |00000001|00a|ppp|00|0000000000000000|          material-id           |
+    // |00000001|0sa|ppp|00|0000000000000000|          material-id           |
     // +--------+---+---+--+----------------+--------------------------------+
     // | correctness    |        optimizations (truncation allowed)          |
     //
     //
     // COLOR command (without depth prepass)
-    // |    8   | 3 | 3 | 2|  6   |   10     |               32               |
-    // +--------+---+---+--+------+----------+--------------------------------+
-    // |00000001|00a|ppp|00|000000| Z-bucket |          material-id           |
-    // +--------+---+---+--+------+----------+--------------------------------+
-    // | correctness    |      optimizations (truncation allowed)             |
+    // |    8   | 3 | 3 | 2|       16       |               32               |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // |00000001|0sa|ppp|00|    Z-bucket    |          material-id           |
+    // +--------+---+---+--+----------------+--------------------------------+
+    // | correctness    |      optimizations (truncation allowed)            |
+    //
+    // The Z-bucket holds the top 10 bits of the distance (RENDER_ORDER_HYBRID, the default), the
+    // top 16 bits (RENDER_ORDER_FRONT_TO_BACK) or is zero (RENDER_ORDER_STATE_FIRST).
     //
     //
     // BLENDED command
@@ -172,14 +184,16 @@ public:
         return boolish ? -1llu : 0llu;
     }
 
-    struct PrimitiveInfo { // 28 bytes
+    struct PrimitiveInfo { // 32 bytes
         FMaterialInstance const* mi = nullptr;              // 8 bytes (4)
         Handle<HwRenderPrimitive> primitiveHandle;          // 4 bytes
-        Handle<HwUniformBuffer> perRenderableUniforms;      // 4 bytes
-        Handle<HwUniformBuffer> perRenderableBones;         // 4 bytes
+        Handle<HwUniformBuffer> instancesUniforms;          // 4 bytes (instanced commands only)
+        uint32_t bonesOffset = 0;                           // 4 bytes (skinned variants only)
         Driver::RasterState rasterState;                    // 4 bytes
         Variant materialVariant;                            // 1 byte
-        uint8_t reserved[3] = { };                          // 3 bytes (that helps the compiler)
+        uint8_t reserved = 0;                               // 1 byte (that helps the compiler)
+        uint16_t instanceCount = 1;                         // 2 bytes (0 when drawn by an instanced command)
+        uint32_t index = 0;                                 // 4 bytes (renderable's row in the SoA)
     };
 
     struct alignas(8) Command {     // 32 bytes
@@ -196,24 +210,124 @@ public:
             "Command isn't trivially destructible");
 
 
-    using RenderFlags = uint8_t;
+    using RenderFlags = uint16_t;
     static constexpr RenderFlags HAS_SHADOWING          = 0x01;
     static constexpr RenderFlags HAS_DIRECTIONAL_LIGHT  = 0x02;
     static constexpr RenderFlags HAS_DYNAMIC_LIGHTING   = 0x04;
+    // shadow passes: only the static, or only the dynamic, shadow casters are rendered
+    static constexpr RenderFlags STATIC_SHADOW_CASTERS  = 0x08;
+    static constexpr RenderFlags DYNAMIC_SHADOW_CASTERS = 0x10;
+    // depth prepass: only the renderables with the Visibility::depthPrepass bit are drawn in it
+    static constexpr RenderFlags DEPTH_PREPASS_OCCLUDERS = 0x20;
+    // color passes: the blended primitives of the renderables with
+    // Visibility::lowResolutionBlending are left out, or are the only ones drawn
+    static constexpr RenderFlags SKIP_LOW_RESOLUTION_BLENDING = 0x40;
+    static constexpr RenderFlags LOW_RESOLUTION_BLENDING_ONLY = 0x80;
+    // color and depth prepass: the stereo variants draw both eyes at once
+    static constexpr RenderFlags STEREO                 = 0x100;
+    // color pass: order of the opaque commands without depth prepass, see View::RenderOrder.
+    // Without either flag, they're sorted by coarse Z-buckets then by material.
+    static constexpr RenderFlags RENDER_ORDER_FRONT_TO_BACK = 0x200;
+    static constexpr RenderFlags RENDER_ORDER_STATE_FIRST   = 0x400;
 
 
     RenderPass(const char* name) noexcept : mName(name) { }
 
     virtual ~RenderPass() noexcept;
 
-    // appends rendering commands for the given view
+    // Sorted commands kept from a previous frame. They're reused as-is for as long as none of
+    // the data they're generated from changes, which is meant for mostly static scenes.
+    class CommandCache {
+    public:
+        // forget the cached commands, they'll be regenerated at the next frame
+        void clear() noexcept {
+            mCommands.clear();
+            mValid = false;
+        }
+
+    private:
+        friend class RenderPass;
+
+        // Per-pass state generateCommands() depends on. Changes to the scene, renderables and
+        // transforms are tracked by FView, which clears the cache when they happen.
+        struct Key {
+            uint32_t visibleFirst = 0;
+            uint32_t visibleLast = 0;
+            uint32_t commandTypeFlags = 0;
+            uint32_t renderFlags = 0;
+            uint32_t visibleMask = 0;
+            math::mat4f model;
+            math::mat4f cullingProjection;
+            math::mat4f worldOrigin;
+        };
+
+        Key mKey;
+        std::vector<Command> mCommands;         // sorted, without the trailing sentinels
+        bool mValid = false;
+    };
+
+    // appends rendering commands for the given view, cache can be null. Only the renderables
+    // with one of the visibleMask bits set in their FScene::VISIBLE_MASK (low byte) or
+    // FScene::SPOT_SHADOW_MASK (high byte) generate commands. renderableUbh holds the
+    // per-renderable uniforms of the soa's rows (see FScene::updateUBOs()).
+    // The soa's primitives (i.e. LODs) and summed primitive counts must be up to date for
+    // visibleRenderables, see updateSummedPrimitiveCounts().
+    // This is prepareCommands() followed by execute().
     void render(
-            FEngine& engine, utils::JobSystem& js,
+            FEngine& engine, utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa const& soa, Handle<HwUniformBuffer> renderableUbh,
+            utils::Range<uint32_t> visibleRenderables,
+            uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
+            const CameraInfo& camera, Viewport const& viewport,
+            utils::GrowingSlice<Command>& commands, CommandCache* cache) noexcept;
+
+    // Generates and sorts the commands (or reuses the cached ones), followed by a sentinel.
+    // This doesn't use the driver or modify the soa, so it can run in a job while other
+    // passes are recorded, as long as the arena and commands are its own.
+    static void prepareCommands(utils::JobSystem& js, ArenaScope& arena,
             FScene::RenderableSoa const& soa, utils::Range<uint32_t> visibleRenderables,
-            uint32_t commandTypeFlags, RenderFlags renderFlags,
+            uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
+            const CameraInfo& camera, utils::GrowingSlice<Command>& commands,
+            CommandCache* cache) noexcept;
+
+    // Records the commands made by prepareCommands() in this pass' render target.
+    void execute(FEngine& engine, utils::JobSystem& js,
+            FScene::RenderableSoa const& soa, Handle<HwUniformBuffer> renderableUbh,
             const CameraInfo& camera, Viewport const& viewport,
             utils::GrowingSlice<Command>& commands) noexcept;
 
+    // Computes the summed primitive counts of the renderables, which the commands are generated
+    // from, their primitives (i.e. LODs) must be up to date. All the passes of a view share them,
+    // so vr must include the visible renderables of each pass.
+    static void updateSummedPrimitiveCounts(
+            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+
+    // The most commands a pass of the given kind generates for the renderables in vr, including
+    // its sentinel. The summed primitive counts must be up to date.
+    static size_t getCommandCount(FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            uint32_t commandTypeFlags) noexcept {
+        // the color pass is doubled for transparents that need to render twice
+        const bool colorPass = bool(commandTypeFlags & CommandTypeFlags::COLOR);
+        const bool depthPass = bool(commandTypeFlags &
+                (CommandTypeFlags::DEPTH | CommandTypeFlags::SHADOW));
+        return size_t(FScene::getPrimitiveCount(soa, vr.first, vr.last)) *
+                (colorPass * 2 + depthPass) + 1;
+    }
+
+    // Sorts commands by key. This uses a parallel LSD radix sort on the 64-bits keys, which
+    // skips byte-digits that are identical in all keys, and moves (key, index) pairs rather
+    // than the commands. Scratch memory is taken from the arena, if there isn't enough, we
+    // fallback to std::sort().
+    static void sortCommands(utils::JobSystem& js, ArenaScope& arena,
+            Command* begin, Command* end) noexcept;
+
+    // Merges runs of sorted commands which only differ by their per-renderable uniforms into
+    // instanced commands. Their per-renderable data is gathered in uniform buffers that are
+    // uploaded here, so this must be called outside of the render pass. soa must be the
+    // renderables the commands were generated from.
+    static void instanceCommands(FEngine& engine, FScene::RenderableSoa const& soa,
+            Command* begin, Command* end) noexcept;
+
 private:
     // Called just before rendering, make sure all needed asynchronous tasks are finished.
     // Set-up the render-target as needed. At least call driver.beginRenderPass().
@@ -228,32 +342,80 @@ private:
 private:
     friend class FRenderer;
 
-    // on 64-bits systems, we process batches of 4 (64 bytes) cache-lines, or 8 (32 bytes) commands
-    // on 32-bits systems, we process batches of 8 (32 bytes) cache-lines, or 8 (32 bytes) commands
-    static constexpr size_t JOBS_PARALLEL_FOR_COMMANDS_COUNT = 16;
-    static constexpr size_t JOBS_PARALLEL_FOR_COMMANDS_SIZE  =
-            sizeof(Command) * JOBS_PARALLEL_FOR_COMMANDS_COUNT;
+    // radix sort parameters: 8-bits digits, i.e. at most 8 passes over 64-bits keys
+    static constexpr size_t RADIX_BITS = 8;
+    static constexpr size_t RADIX_BUCKET_COUNT = 1u << RADIX_BITS;
+    static constexpr size_t RADIX_DIGIT_COUNT = (sizeof(CommandKey) * CHAR_BIT) / RADIX_BITS;
+    // below this many commands, std::sort() is faster than the radix sort
+    static constexpr size_t RADIX_SORT_MIN_COMMAND_COUNT = 1024;
+    // each job of the radix sort processes at least this many commands
+    static constexpr size_t RADIX_SORT_MIN_CHUNK_SIZE = 2048;
+    static constexpr size_t RADIX_SORT_MAX_CHUNK_COUNT = 16;
+    // the commands are gathered in their sorted order, this many commands ahead are prefetched
+    static constexpr size_t RADIX_SORT_PREFETCH_DISTANCE = 8;
+
+    // what the radix sort passes move, instead of the much larger commands
+    struct SortEntry {          // 16 bytes
+        CommandKey key;         //  8 bytes
+        uint32_t index;         //  4 bytes, the command's position before sorting
+    };
+
+    // below this many identical commands, instancing isn't worth the uniforms upload
+    static constexpr size_t INSTANCING_MIN_COMMAND_COUNT = 4;
+
+    // below this many commands, we record driver commands on the calling thread only
+    static constexpr size_t JOBS_RECORD_MIN_COMMAND_COUNT = 2048;
+    // each recording job processes at least this many commands
+    static constexpr size_t JOBS_RECORD_MIN_CHUNK_SIZE = 512;
+    static constexpr size_t JOBS_RECORD_MAX_CHUNK_COUNT = 16;
 
-    static_assert(JOBS_PARALLEL_FOR_COMMANDS_SIZE % utils::CACHELINE_SIZE == 0,
-            "Size of Commands jobs must be multiple of a cache-line size");
+    // appends the sorted commands for the visible renderables, followed by a sentinel
+    static void generateAndSortCommands(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa const& soa, utils::Range<uint32_t> vr,
+            uint32_t commandTypeFlags, RenderFlags renderFlags, uint16_t visibleMask,
+            const CameraInfo& camera, utils::GrowingSlice<Command>& commands) noexcept;
 
+    // range is a sub-range of the pass' visible renderables, which start at first
     static inline void generateCommands(uint32_t commandTypeFlags, Command* const commands,
-            FScene::RenderableSoa const& soa, utils::Range<uint32_t> range, RenderFlags renderFlags,
-            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
+            FScene::RenderableSoa const& soa, uint32_t first, utils::Range<uint32_t> range,
+            RenderFlags renderFlags,
+            uint16_t visibleMask, math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
     template<uint32_t commandTypeFlags>
     static inline void generateCommandsImpl(uint32_t, Command* commands, FScene::RenderableSoa const& soa,
-            utils::Range<uint32_t> range, RenderFlags renderFlags, math::float3 cameraPosition,
-            math::float3 cameraForward) noexcept;
+            utils::Range<uint32_t> range, RenderFlags renderFlags, uint16_t visibleMask,
+            math::float3 cameraPosition, math::float3 cameraForward) noexcept;
 
     static void setupColorCommand(Command& cmdDraw, bool hasDepthPass,
             FMaterialInstance const* const mi) noexcept;
 
-    static void recordDriverCommands(FEngine::DriverApi& driver,
+    // What recording a range of commands issued to the driver
+    struct RecordStats {
+        size_t draws = 0;               // draw calls, instanced or not
+        size_t stateChanges = 0;        // uniform bindings and material instance switches
+        size_t redundantCommands = 0;   // commands skipped because their state was already set
+        size_t materialInstanceChanges = 0; // material instance switches
+        size_t programChanges = 0;      // draws using another program than the previous one
+        RecordStats& operator+=(RecordStats const& rhs) noexcept {
+            draws += rhs.draws;
+            stateChanges += rhs.stateChanges;
+            redundantCommands += rhs.redundantCommands;
+            materialInstanceChanges += rhs.materialInstanceChanges;
+            programChanges += rhs.programChanges;
+            return *this;
+        }
+    };
+
+    // Records the driver commands of the sorted commands, the bindings and scissor that are
+    // already in place are skipped.
+    // bonesUbh is the bone palette, skinned commands bind it at their bonesOffset.
+    static RecordStats recordDriverCommands(FEngine::DriverApi& driver, utils::JobSystem& js,
+            Handle<HwUniformBuffer> renderableUbh, Handle<HwUniformBuffer> bonesUbh,
             utils::Slice<Command> const& commands) noexcept;
 
-    static void updateSummedPrimitiveCounts(
-            FScene::RenderableSoa& renderableData, utils::Range<uint32_t> vr) noexcept;
+    template<typename DriverApi>
+    static inline RecordStats recordCommands(DriverApi& driver, Handle<HwUniformBuffer> renderableUbh,
+            Handle<HwUniformBuffer> bonesUbh, Command const* first, Command const* last) noexcept;
 
     const char* const mName;
 };
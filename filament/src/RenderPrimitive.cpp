@@ -25,7 +25,7 @@ namespace filament {
 namespace details {
 
 void FRenderPrimitive::init(driver::DriverApi& driver,
-        const RenderableManager::Builder::Entry& entry) noexcept {
+        const RenderableManager::Builder::Entry& entry, Handle<HwVertexBuffer> skinned) noexcept {
 
     assert(entry.materialInstance);
 
@@ -37,41 +37,74 @@ void FRenderPrimitive::init(driver::DriverApi& driver,
         FVertexBuffer* vertexBuffer = upcast(entry.vertices);
         FIndexBuffer* indexBuffer = upcast(entry.indices);
 
-        AttributeBitset enabledAttributes = vertexBuffer->getDeclaredAttributes();
-
-        auto const& ebh = vertexBuffer->getHwHandle();
-        auto const& ibh = indexBuffer->getHwHandle();
-
-        driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
+        setBuffers(driver, vertexBuffer, indexBuffer->getHwHandle(), skinned);
         driver.setRenderPrimitiveRange(mHandle, entry.type,
                 (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
                 (uint32_t)entry.count);
+        if (mDepthHandle) {
+            driver.setRenderPrimitiveRange(mDepthHandle, entry.type,
+                    (uint32_t)entry.offset, (uint32_t)entry.minIndex, (uint32_t)entry.maxIndex,
+                    (uint32_t)entry.count);
+        }
 
         mPrimitiveType = entry.type;
-        mEnabledAttributes = enabledAttributes;
     }
 }
 
 void FRenderPrimitive::terminate(FEngine& engine) {
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.destroyRenderPrimitive(mHandle);
+    if (mDepthHandle) {
+        driver.destroyRenderPrimitive(mDepthHandle);
+    }
+}
+
+void FRenderPrimitive::setBuffers(driver::DriverApi& driver, FVertexBuffer const* vertices,
+        Handle<HwIndexBuffer> ibh, Handle<HwVertexBuffer> skinned) noexcept {
+    // the skinned vertices have the layout of the VertexBuffer's, minus the bones
+    const AttributeBitset enabledAttributes = skinned ?
+            vertices->getSkinnedAttributes() : vertices->getDeclaredAttributes();
+    const Handle<HwVertexBuffer> vbh = skinned ? skinned : vertices->getHwHandle();
+    driver.setRenderPrimitiveBuffer(mHandle, vbh, ibh, (uint32_t)enabledAttributes.getValue());
+    setDepthBuffer(driver, vertices, vbh, ibh, bool(skinned));
+    mEnabledAttributes = enabledAttributes;
+}
+
+void FRenderPrimitive::setDepthBuffer(driver::DriverApi& driver, FVertexBuffer const* vertices,
+        Handle<HwVertexBuffer> vbh, Handle<HwIndexBuffer> ibh, bool skinned) noexcept {
+    // the depth primitive shares the buffers, it only enables fewer attributes
+    mDepthAttributes = vertices->getDepthAttributes();
+    if (skinned) {
+        mDepthAttributes &= vertices->getSkinnedAttributes();
+    }
+    if (mDepthAttributes.none()) {
+        if (mDepthHandle) {
+            driver.destroyRenderPrimitive(mDepthHandle);
+            mDepthHandle.clear();
+        }
+        return;
+    }
+    if (!mDepthHandle) {
+        mDepthHandle = driver.createRenderPrimitive();
+    }
+    driver.setRenderPrimitiveBuffer(mDepthHandle, vbh, ibh,
+            (uint32_t)mDepthAttributes.getValue());
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type,
         FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
-        size_t minIndex, size_t maxIndex, size_t count) noexcept {
-    AttributeBitset enabledAttributes = vertices->getDeclaredAttributes();
-    auto const& ebh = vertices->getHwHandle();
-    auto const& ibh = indices->getHwHandle();
-
+        size_t minIndex, size_t maxIndex, size_t count, Handle<HwVertexBuffer> skinned) noexcept {
     FEngine::DriverApi& driver = engine.getDriverApi();
 
-    driver.setRenderPrimitiveBuffer(mHandle, ebh, ibh, (uint32_t)enabledAttributes.getValue());
+    setBuffers(driver, vertices, indices->getHwHandle(), skinned);
     driver.setRenderPrimitiveRange(mHandle, type,
             (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    if (mDepthHandle) {
+        driver.setRenderPrimitiveRange(mDepthHandle, type,
+                (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    }
 
     mPrimitiveType = type;
-    mEnabledAttributes = enabledAttributes;
 }
 
 void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType type, size_t offset,
@@ -79,6 +112,10 @@ void FRenderPrimitive::set(FEngine& engine, RenderableManager::PrimitiveType typ
     FEngine::DriverApi& driver = engine.getDriverApi();
     driver.setRenderPrimitiveRange(mHandle, type,
             (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    if (mDepthHandle) {
+        driver.setRenderPrimitiveRange(mDepthHandle, type,
+                (uint32_t)offset, (uint32_t)minIndex, (uint32_t)maxIndex, (uint32_t)count);
+    }
     mPrimitiveType = type;
 }
 
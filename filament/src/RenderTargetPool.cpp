@@ -29,6 +29,8 @@ using namespace details;
 
 void RenderTargetPool::init(FEngine& engine) noexcept {
     mEngine = &engine;
+    mBudget = engine.getConfig().renderTargetPoolBudget;
+    mAutoResolve = engine.getDriverApi().isAutoResolveSupported();
     mPool.reserve(16);
 }
 
@@ -46,6 +48,13 @@ RenderTargetPool::Target const* RenderTargetPool::get(
     // samples can't be less than 1
     samples = std::max(uint8_t(1), samples);
 
+    // A sampled multisampled target renders into a single-sampled texture when the driver
+    // resolves it at the end of each render pass, which saves both the memory and the resolve.
+    flags &= ~Target::AUTO_RESOLVE;
+    if (samples > 1 && !(flags & Target::NO_TEXTURE) && mAutoResolve) {
+        flags |= Target::AUTO_RESOLVE;
+    }
+
     // round all allocations to 32x32 pixels, to avoid too many small resize
     uint32_t target_w = (w + 31u) & ~31u;
     uint32_t target_h = (h + 31u) & ~31u;
@@ -54,43 +63,61 @@ RenderTargetPool::Target const* RenderTargetPool::get(
     FEngine& engine = *mEngine;
     DriverApi& driver = engine.getDriverApi();
 
-    // Since we order the cache by width then by height, we can get a cached
-    // entry with a smaller height. Only reuse if both dimensions are higher.
-    auto pos = find(&entry);
-    Entry const* const it = pos != mPool.end() ? *pos : nullptr;
-    if (UTILS_LIKELY(it &&
-                     it->attachments == attachments &&
-                     it->samples == samples &&
-                     it->format == format &&
-                     it->flags == flags &&
-                     it->w >= target_w &&
-                     it->h >= target_h)) {
-        if (2 * it->w * it->h >= 3 * target_w * target_h) {
-            // the surface we found is 1.5x larger than requested
-            // there is a performance cost, especially on tilers, it's better to not allow
-            // too much of a size difference
-            goto not_found;
+    // Use the smallest pooled target that's large enough, unless it's much larger.
+    auto& cache = mPool;
+    const size_t area = size_t(target_w) * target_h;
+    auto pos = cache.end();
+    for (auto it = cache.begin(); it != cache.end(); ++it) {
+        Entry const& candidate = **it;
+        const size_t candidateArea = size_t(candidate.w) * candidate.h;
+        if (isCompatible(candidate, entry) &&
+                candidate.w >= target_w && candidate.h >= target_h &&
+                candidateArea <= POOL_MAX_REUSE_RATIO * area &&
+                (pos == cache.end() || candidateArea < size_t((*pos)->w) * (*pos)->h)) {
+            pos = it;
         }
-
+    }
+    if (pos != cache.end()) {
         // update last usage age, remove the entry from the pool and return it
-        (*pos)->age = mCacheAge;
-        mPool.erase(pos);
+        Entry const* const it = *pos;
+        it->age = mCacheAge;
+        cache.erase(pos);
+        mStats.hits++;
         return it;
     }
 
-    not_found:
+    mStats.misses++;
 
-    if (flags & RenderTargetPool::Target::NO_TEXTURE) {
-        entry.target = driver.createRenderTarget(
-                entry.attachments, target_w, target_h, samples, format, {}, {}, {});
-    } else {
-        entry.texture = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
-                format, samples, target_w, target_h, 1, Driver::TextureUsage::COLOR_ATTACHMENT);
+    // The pooled targets this one is larger than are superseded, e.g. by a resolution change.
+    // Later requests they could serve are served by the new target.
+    auto last = std::remove_if(cache.begin(), cache.end(),
+            [this, &driver, &entry](Entry const* e) {
+                bool remove = isCompatible(*e, entry) && e->w <= entry.w && e->h <= entry.h;
+                if (remove) {
+                    destroyEntry(driver, e);
+                    mStats.evictions++;
+                }
+                return remove;
+            });
+    cache.erase(last, cache.end());
 
-        entry.target = driver.createRenderTarget(
-                entry.attachments, target_w, target_h, samples, format,
-                { entry.texture }, {}, {});
+    evict(getSize(&entry));
+
+    if (!(flags & RenderTargetPool::Target::NO_TEXTURE)) {
+        const uint8_t textureSamples = (flags & Target::AUTO_RESOLVE) ? uint8_t(1) : samples;
+        entry.texture = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
+                format, textureSamples, target_w, target_h, 1,
+                Driver::TextureUsage::COLOR_ATTACHMENT);
+    }
+    if ((flags & Target::DEPTH_TEXTURE) && (attachments & TargetBufferFlags::DEPTH)) {
+        // same format as the depth renderbuffer, so that it can be blitted into one
+        entry.depth = driver.createTexture(Driver::SamplerType::SAMPLER_2D, 1,
+                TextureFormat::DEPTH24, samples, target_w, target_h, 1,
+                Driver::TextureUsage::DEPTH_ATTACHMENT);
     }
+    entry.target = driver.createRenderTarget(
+            entry.attachments, target_w, target_h, samples, format,
+            { entry.texture }, { entry.depth }, {});
 
     // update last used age
     entry.age = mCacheAge;
@@ -108,6 +135,25 @@ void RenderTargetPool::put(Target const* target) noexcept {
     mPool.insert(pos, entry);
 }
 
+bool RenderTargetPool::isCompatible(Entry const& lhs, Entry const& rhs) noexcept {
+    return lhs.attachments == rhs.attachments &&
+           lhs.samples == rhs.samples &&
+           lhs.format == rhs.format &&
+           lhs.flags == rhs.flags;
+}
+
+void RenderTargetPool::evict(size_t size) const noexcept {
+    DriverApi& driver = mEngine->getDriverApi();
+    auto& cache = mPool;
+    while (!cache.empty() && mPoolSize + size > mBudget) {
+        auto pos = std::min_element(cache.begin(), cache.end(),
+                [](const Entry* lhs, const Entry* rhs) { return lhs->age < rhs->age; });
+        destroyEntry(driver, *pos);
+        cache.erase(pos);
+        mStats.evictions++;
+    }
+}
+
 std::vector<RenderTargetPool::Entry const*>::iterator
 RenderTargetPool::find(Entry const* entry) const noexcept {
     auto& cache = mPool;
@@ -143,7 +189,7 @@ void RenderTargetPool::gc() noexcept {
     DriverApi& driver = mEngine->getDriverApi();
     auto& cache = mPool;
     size_t count = cache.size();
-    while (count && (count > POOL_MAX_ENTRY_COUNT || mPoolSize > POOL_MAX_SIZE)) {
+    while (count && (count > POOL_MAX_ENTRY_COUNT || mPoolSize > mBudget)) {
 
         // find the least recently used entry (linear search here)
         auto pos = std::min_element(cache.begin(), cache.end(),
@@ -181,10 +227,13 @@ void RenderTargetPool::gc() noexcept {
     mCacheAge++;
 }
 
-void RenderTargetPool::destroyEntry(DriverApi& driver, Entry const* entry) noexcept {
+void RenderTargetPool::destroyEntry(DriverApi& driver, Entry const* entry) const noexcept {
     assert(entry);
     driver.destroyRenderTarget(entry->target);
     driver.destroyTexture(entry->texture);
+    if (entry->depth) {
+        driver.destroyTexture(entry->depth);
+    }
     mPoolSize -= getSize(entry);
     mEntryArena.destroy(entry);
     assert(mPoolSize >= 0);
@@ -204,7 +253,9 @@ size_t RenderTargetPool::getSize(Entry const* entry) noexcept {
         size += 1;
     }
 
-    return size * entry->samples * entry->w * entry->h;
+    // an implicitly resolved target's samples don't leave tile memory
+    const size_t samples = (entry->flags & Target::AUTO_RESOLVE) ? 1 : entry->samples;
+    return size * samples * entry->w * entry->h;
 }
 
 
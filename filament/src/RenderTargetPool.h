@@ -38,10 +38,10 @@ class RenderTargetPool {
     // entries older than this are purged
     static constexpr uint32_t POOL_ENTRY_MAX_AGE = 60 * 60;     // ~1 min
 
-    // e.g. layer sizes
-    // 1440 x 2560 is ~ 29 MB for color buffer
-    // 1280 x 720  is ~  7 MB for color buffer
-    static constexpr size_t POOL_MAX_SIZE = 128 * 1024 * 1024;
+    // A pooled target is reused for requests down to a quarter of its area, e.g. down to half
+    // its size in each dimension with dynamic resolution. The content is then rendered into its
+    // lower-left corner, through a sub-viewport.
+    static constexpr uint32_t POOL_MAX_REUSE_RATIO = 4;
 
     // 2 pages is way enough for the entry sturctures (should be about 400)
     static constexpr size_t POOL_ENTRY_ARENA_SIZE = 8192;
@@ -56,6 +56,7 @@ public:
     struct Target {
         Handle<HwRenderTarget> target;
         Handle<HwTexture> texture;
+        Handle<HwTexture> depth;    // only with DEPTH_TEXTURE
         uint32_t w = 0;
         uint32_t h = 0;
         driver::TargetBufferFlags attachments = driver::TargetBufferFlags::NONE;
@@ -63,6 +64,10 @@ public:
         uint8_t samples = 1;
         uint8_t flags = 0;
         static constexpr uint8_t NO_TEXTURE = 0x1;
+        // set by the pool: the texture is single-sampled, the samples only live in tile memory
+        static constexpr uint8_t AUTO_RESOLVE = 0x2;
+        // the depth buffer is a texture, which can be sampled or blitted from
+        static constexpr uint8_t DEPTH_TEXTURE = 0x4;
     };
 
     Target const* get(driver::TargetBufferFlags attachments,
@@ -74,6 +79,16 @@ public:
     // remove older items in the cache. call this once per frame.
     void gc() noexcept;
 
+    // size in bytes of the render targets, whether they're in use or in the pool
+    size_t getMemorySize() const noexcept { return mPoolSize; }
+
+    struct Stats {
+        uint32_t hits = 0;          // get() calls served from the pool
+        uint32_t misses = 0;        // get() calls which created a render target
+        uint32_t evictions = 0;     // pooled render targets destroyed before they aged out
+    };
+    Stats const& getStats() const noexcept { return mStats; }
+
 private:
     struct Entry : public Target {
         Entry() = default;
@@ -94,12 +109,18 @@ private:
     static constexpr size_t POOL_MAX_ENTRY_COUNT = (POOL_ENTRY_ARENA_SIZE / sizeof(Entry)) / 2;
 
     static size_t getSize(Entry const* entry) noexcept;
-    void destroyEntry(driver::DriverApi& driver, Entry const* entry) noexcept;
+    void destroyEntry(driver::DriverApi& driver, Entry const* entry) const noexcept;
     std::vector<Entry const*>::iterator find(Entry const* entry) const noexcept;
+    static bool isCompatible(Entry const& lhs, Entry const& rhs) noexcept;
+    // destroys the least recently used pooled targets until size more bytes fit in the budget
+    void evict(size_t size) const noexcept;
 
     details::FEngine* mEngine = nullptr;
     mutable std::vector<Entry const*> mPool;
     mutable size_t mPoolSize = 0;
+    size_t mBudget = 0;
+    bool mAutoResolve = false;
+    mutable Stats mStats;
     // at 60 fps, 32 bit gives us 828 days without overflow
     uint32_t mDeepPurgeCountDown = POOL_ENTRY_MAX_AGE;
     uint32_t mCacheAge = POOL_ENTRY_MAX_AGE;
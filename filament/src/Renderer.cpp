@@ -16,6 +16,8 @@
 
 #include "details/Renderer.h"
 
+#include "CpuStageTimings.h"
+#include "FrameGraph.h"
 #include "RenderPass.h"
 
 #include "details/Engine.h"
@@ -47,15 +49,43 @@ FRenderer::FRenderer(FEngine& engine) :
         mEngine(engine),
         mFrameSkipper(engine, 2),
         mFrameInfoManager(engine),
-        mPerRenderPassArena(engine.getPerRenderPassAllocator())
+        mPerRenderPassArena(engine.getPerRenderPassAllocator()),
+        mColorPassArena("FRenderer: color pass arena", engine.getConfig().colorPassArenaSize),
+        mCommands(engine.getConfig().perFrameCommandsSize),
+        mColorCommands(engine.getConfig().perFrameCommandsSize)
 {
 }
 
+FRenderer::CommandBuffer::CommandBuffer(size_t size) noexcept {
+    get(size / sizeof(Command));
+}
+
+FRenderer::CommandBuffer::~CommandBuffer() noexcept {
+    aligned_free(mCommands);
+}
+
+FRenderer::Command* FRenderer::CommandBuffer::get(size_t count) noexcept {
+    if (UTILS_UNLIKELY(count > mCapacity)) {
+        // leave some room, so that a scene that grows slowly doesn't reallocate every frame
+        const size_t capacity = mCapacity ? count + count / 4 : count;
+        Command* const commands = (Command*)utils::aligned_alloc(capacity * sizeof(Command),
+                CACHELINE_SIZE);
+        ASSERT_POSTCONDITION(commands, "Couldn't allocate %u draw commands", unsigned(capacity));
+        aligned_free(mCommands);
+        mCommands = commands;
+        mCapacity = capacity;
+    }
+    return mCommands;
+}
+
 void FRenderer::init() noexcept {
     DriverApi& driver = mEngine.getDriverApi();
     mRenderTarget = driver.createDefaultRenderTarget();
     mIsRGB16FSupported = driver.isRenderTargetFormatSupported(driver::TextureFormat::RGB16F);
     mIsRGB8Supported = driver.isRenderTargetFormatSupported(driver::TextureFormat::RGB8);
+    mIsAutoResolveSupported = driver.isAutoResolveSupported();
+    mIsMultiviewSupported = driver.isMultiviewSupported();
+    mIsSubpassSupported = driver.isSubpassSupported();
     mFrameInfoManager.run();
 }
 
@@ -64,7 +94,7 @@ FRenderer::~FRenderer() noexcept {
     // to free what we can (it would probably mean something when wrong).
 #ifndef NDEBUG
     size_t wm = getCommandsHighWatermark();
-    size_t wmpct = wm / (CONFIG_PER_FRAME_COMMANDS_SIZE / 100);
+    size_t wmpct = wm / (mEngine.getConfig().perFrameCommandsSize / 100);
     slog.d << "Renderer: Commands High watermark "
     << wm / 1024 << " KiB (" << wmpct << "%), "
     << wm / sizeof(Command) << " commands, " << sizeof(Command) << " bytes/command"
@@ -107,8 +137,21 @@ void FRenderer::render(FView const* view) {
         engine.flush();
 
         // and wait for all jobs to finish as a safety (this should be a no-op)
-        js.runAndWait(masterJob);
-        js.reset();
+        // All our jobs are released, so the job system doesn't need a reset(), which would
+        // free the jobs still running in the background.
+        js.run(masterJob);
+        js.waitAndRelease(masterJob);
+        js.setMasterJob(nullptr);
+    }
+}
+
+void FRenderer::render(View const* const* views, size_t count) {
+    SYSTRACE_CALL();
+
+    // Each view has its own master job and arena scope. The scene's preparation and the
+    // renderables' uniforms are cached by FScene, so the views of a scene share that work.
+    for (size_t i = 0; i < count; i++) {
+        render(upcast(views[i]));
     }
 }
 
@@ -122,9 +165,17 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     // DEBUG: driver commands must all happen from the same thread. Enforce that on debug builds.
     engine.getDriverApi().debugThreading();
 
+    // A stereo view is drawn directly into its layered target, in a single pass without
+    // post-processing nor multi-sampling.
+    const bool stereo = view->isStereo();
+    if (UTILS_UNLIKELY(stereo && !mIsMultiviewSupported)) {
+        return;
+    }
+
     Viewport const& vp = view->getViewport();
-    const bool hasPostProcess = view->hasPostProcessPass();
-    float2 scale = view->updateScale(mFrameInfoManager.getLastFrameTime());
+    const bool hasPostProcess = view->hasPostProcessPass() && !stereo;
+    float2 scale = view->updateScale(mFrameInfoManager.getLastGpuFrameTime(),
+            mFrameInfoManager.getFrameInterval());
     bool mUseFXAA = view->getAntiAliasing() == View::AntiAliasing::FXAA;
     if (!hasPostProcess) {
         // dynamic scaling and FXAA are part of the post-process phase and can't happen if
@@ -140,24 +191,55 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
     }
 
     view->prepare(engine, driver, arena, svp);
-    // TODO: froxelization could actually start now, instead of in ColorPass::renderColorPass()
+
+    // Start the froxelization now, it only depends on prepare() and runs concurrently with the
+    // generation of the shadow and color passes' commands. The color pass waits for it.
+    JobSystem::Job* jobFroxelize = js.createJob(nullptr,
+            [&engine, view](JobSystem&, JobSystem::Job*) { view->froxelize(engine); });
+    js.setName(jobFroxelize, "FView::froxelize");
+    js.run(jobFroxelize);
+
+    // All passes use the LOD picked with the viewing camera, so that shadows match what's
+    // visible (offset by the renderables' shadow LOD bias), and share the summed primitive
+    // counts of the renderables they draw.
+    auto& soa = view->getScene()->getRenderableData();
+    const Range<uint32_t> vr = view->getVisibleRenderables();
+    const Range<uint32_t> casters = view->getVisibleShadowCasters();
+    const Range<uint32_t> renderables{ 0,
+            view->hasShadowing() ? std::max(vr.last, casters.last) : vr.last };
+    view->updatePrimitivesLod(engine, view->getCameraInfo(), soa, renderables);
+    if (engine.hasStreamingTextures()) {
+        view->requestStreamingLevels(engine, view->getCameraInfo(), soa, vr);
+    }
+    RenderPass::updateSummedPrimitiveCounts(soa, renderables);
 
     /*
-     * Allocate command buffer.
+     * Allocate command buffers, they're sized for the passes that use them
      */
 
-    const size_t commandsSize = FEngine::CONFIG_PER_FRAME_COMMANDS_SIZE;
-    const size_t commandsCount = commandsSize / sizeof(Command);
-    GrowingSlice<Command> commands(
-            arena.allocate<Command>(commandsCount, CACHELINE_SIZE), commandsCount);
+    const size_t commandsCount = view->hasShadowing() ?
+            RenderPass::getCommandCount(soa, casters, RenderPass::SHADOW) : 0;
+    GrowingSlice<Command> commands(mCommands.get(commandsCount), commandsCount);
+
+    // The color pass' commands are generated in a job while the shadow maps are rendered, so
+    // they need their own command buffer and arena.
+    ArenaScope colorArena(mColorPassArena);
+    const size_t colorCommandsCount =
+            RenderPass::getCommandCount(soa, vr, RenderPass::DEPTH_AND_COLOR);
+    GrowingSlice<Command> colorCommands(mColorCommands.get(colorCommandsCount),
+            colorCommandsCount);
+    JobSystem::Job* jobColorCommands =
+            ColorPass::prepareColorPass(js, colorArena, view, colorCommands);
 
     /*
      * Shadow pass
      */
 
     if (view->hasShadowing()) {
-        ShadowPass::renderShadowMap(engine, js, view, commands);
-        recordHighWatermark(commands); // for debugging
+        mFrameInfoManager.beginPass(driver, GpuFrameInfo::SHADOW);
+        ShadowPass::renderShadowMap(engine, js, arena, view, commands);
+        mFrameInfoManager.endPass(driver);
+        recordHighWatermark(commands);
         // reset the command buffer
         commands.clear();
     }
@@ -166,72 +248,216 @@ void FRenderer::renderJob(ArenaScope& arena, FView* view) {
      * Depth + Color passes
      */
 
-    const uint8_t useMSAA = view->getSampleCount();
+    const uint8_t useMSAA = stereo ? uint8_t(1) : view->getSampleCount();
     const TextureFormat hdrFormat = getHdrFormat();
     const TextureFormat ldrFormat = getLdrFormat();
-    RenderTargetPool::Target const* colorTarget = nullptr;
+
+    // The color pass and the post-processing passes are scheduled by a frame graph, which gets
+    // their intermediate targets from the pool only while they're needed.
+    FrameGraph fg(arena, rtp);
+
+    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
+    const FrameGraphResource output = UTILS_LIKELY(!stereo) ?
+            fg.importRenderTarget("View Render Target",
+                    { TargetBufferFlags::COLOR, vp.width, vp.height, 1, ldrFormat },
+                    getRenderTarget(), view->getDiscardedTargetBuffers()) :
+            fg.importRenderTarget("Stereo Render Target",
+                    { TargetBufferFlags::COLOR_AND_DEPTH, vp.width, vp.height, 1, ldrFormat },
+                    view->getStereoRenderTarget(), view->getDiscardedTargetBuffers());
+    fg.present(output);
 
     if (UTILS_LIKELY(hasPostProcess)) {
-        // allocate the target we need for rendering the scene
-        colorTarget = rtp.get(TargetBufferFlags::COLOR_AND_DEPTH,
-                svp.width, svp.height, useMSAA, hdrFormat);
         svp.left = svp.bottom = 0;
     }
 
-    // FIXME: viewRenderTarget doesn't have a depth-buffer, so when skipping post-process, don't rely on it
-    const Handle<HwRenderTarget> viewRenderTarget = getRenderTarget();
-    ColorPass::renderColorPass(engine, js,
-            colorTarget ? colorTarget->target : viewRenderTarget, view, svp, commands);
+    struct ColorPassData {
+        FrameGraphResource color;
+    };
+    // the low resolution blending pass tests against the color pass' depth, see below
+    const bool lowResolutionBlending = view->hasLowResolutionBlending();
+    // the temporal anti-aliasing reprojects the color pass with its depth
+    const bool temporal = hasPostProcess && view->hasTemporalAntiAliasing();
+    FrameGraph::Descriptor colorBufferDesc = { TargetBufferFlags::COLOR_AND_DEPTH,
+            svp.width, svp.height, useMSAA, hdrFormat };
+    colorBufferDesc.sampleableDepth = lowResolutionBlending || temporal;
+
+    /*
+     * When the tone mapping is the only post-processing pass, the backend can run it as a second
+     * subpass of the color pass, which reads the color pass' output from tile memory. The
+     * intermediate color buffer then never exists in main memory.
+     */
+
+    const bool translucent = mSwapChain->isTransparent();
+    const bool toneMappingSubpass = mIsSubpassSupported && hasPostProcess && !scaled &&
+            !mUseFXAA && !temporal && !lowResolutionBlending && useMSAA == 1;
+    if (toneMappingSubpass) {
+        fg.addPass<ColorPassData>("Color Pass and Tone Mapping",
+                [&](FrameGraph::Builder& builder, ColorPassData& data) {
+                    data.color = builder.write(output);
+                    // the jobs started above must always be waited on
+                    builder.sideEffect();
+                },
+                [&](ColorPassData const& data, FrameGraph::Resources const& resources,
+                        FEngine::DriverApi& driver) {
+                    // the color pass' output isn't a texture, only its size is needed
+                    RenderTargetPool::Target source;
+                    source.w = vp.width;
+                    source.h = vp.height;
+                    ppm.setSource(vp.width, vp.height, &source, view->getColorGradingLut());
+
+                    Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
+                            translucent ? PostProcessStage::TONE_MAPPING_SUBPASS_TRANSLUCENT
+                                        : PostProcessStage::TONE_MAPPING_SUBPASS_OPAQUE);
+                    const ColorPass::Subpass toneMapping{ hdrFormat,
+                            [&engine, toneMappingProgram](FEngine::DriverApi& driver) {
+                                Driver::RasterState rs;
+                                rs.culling = Driver::RasterState::CullingMode::NONE;
+                                rs.colorWrite = true;
+                                rs.depthFunc = Driver::RasterState::DepthFunc::A;
+                                driver.draw(toneMappingProgram, rs,
+                                        engine.getFullScreenRenderPrimitive());
+                            }};
+
+                    // both subpasses draw in the output's viewport
+                    mFrameInfoManager.beginPass(driver, GpuFrameInfo::COLOR);
+                    ColorPass::renderColorPass(engine, js, jobColorCommands, jobFroxelize,
+                            resources.get(data.color).target, view, vp, colorCommands,
+                            &toneMapping);
+                    // the color pass waited for the froxelization
+                    js.release(jobFroxelize);
+                    mFrameInfoManager.endPass(driver);
+                });
+
+        fg.compile();
+        fg.execute(driver);
+
+        recordHighWatermark(colorCommands);
+        return;
+    }
+
+    auto const& colorPass = fg.addPass<ColorPassData>("Color Pass",
+            [&](FrameGraph::Builder& builder, ColorPassData& data) {
+                data.color = builder.write(!hasPostProcess ? output :
+                        builder.create("Color Buffer", colorBufferDesc));
+                // the jobs started above must always be waited on
+                builder.sideEffect();
+            },
+            [&](ColorPassData const& data, FrameGraph::Resources const& resources,
+                    FEngine::DriverApi& driver) {
+                mFrameInfoManager.beginPass(driver, GpuFrameInfo::COLOR);
+                ColorPass::renderColorPass(engine, js, jobColorCommands, jobFroxelize,
+                        resources.get(data.color).target, view, svp, colorCommands);
+                // the color pass waited for the froxelization
+                js.release(jobFroxelize);
+                mFrameInfoManager.endPass(driver);
+            });
+
+    /*
+     * Low resolution blending: the blended primitives of the renderables that allow it are
+     * drawn into a downsampled target, tested against a point sampled copy of the depth buffer,
+     * then composited back with a depth-aware upsampling, before tone mapping.
+     */
+
+    FrameGraphResource colorBuffer = colorPass.color;
+    if (lowResolutionBlending) {
+        const uint8_t factor = view->getBlendingDownsampling();
+        const Viewport bvp{ 0, 0,
+                std::max(1u, svp.width / factor), std::max(1u, svp.height / factor) };
+        FrameGraph::Descriptor blendingDesc = { TargetBufferFlags::COLOR_AND_DEPTH,
+                bvp.width, bvp.height, 1, TextureFormat::RGBA16F };
+        blendingDesc.sampleableDepth = true;
+
+        struct BlendingPassData {
+            FrameGraphResource color;
+            FrameGraphResource blending;
+        };
+        auto const& blendingPass = fg.addPass<BlendingPassData>("Low Resolution Blending",
+                [&](FrameGraph::Builder& builder, BlendingPassData& data) {
+                    // the color pass' depth is only blitted
+                    data.color = builder.read(colorPass.color, false);
+                    data.blending = builder.write(builder.create("Blending Buffer", blendingDesc));
+                },
+                [&, bvp](BlendingPassData const& data, FrameGraph::Resources const& resources,
+                        FEngine::DriverApi& driver) {
+                    RenderTargetPool::Target const& blending = resources.get(data.blending);
+                    driver.blit(TargetBufferFlags::DEPTH,
+                            blending.target, 0, 0, bvp.width, bvp.height,
+                            resources.get(data.color).target, 0, 0, svp.width, svp.height);
+
+                    // the color pass' commands have been executed, the buffer can be reused
+                    const size_t count = RenderPass::getCommandCount(soa, vr, RenderPass::COLOR);
+                    GrowingSlice<Command> blendingCommands(mCommands.get(count), count);
+                    BlendingPass::renderBlendingPass(engine, js, arena, blending.target, view,
+                            svp, bvp, blendingCommands);
+                    recordHighWatermark(blendingCommands);
+                });
+
+        colorBuffer = ppm.compositeBlending(fg, colorPass.color, blendingPass.blending,
+                svp, bvp, hdrFormat);
+    }
 
     /*
      * Post Processing...
      */
 
     if (UTILS_LIKELY(hasPostProcess)) {
-        driver.pushGroupMarker("Post Processing");
-
         ppm.start();
 
-        if (useMSAA > 1) {
+        if (useMSAA > 1 && !mIsAutoResolveSupported) {
             // Note: MSAA, when used is applied before tone-mapping (which is not ideal)
             // (tone mapping currently only works without multi-sampling)
-            // this blit does a MSAA resolve
+            // this blit does a MSAA resolve. On tilers the color pass resolves into its
+            // texture when it ends instead, which tone mapping samples directly.
             ppm.blit(hdrFormat);
         }
 
-        const bool translucent = mSwapChain->isTransparent();
-        Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
-                translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
-                            : PostProcessStage::TONE_MAPPING_OPAQUE);
-        ppm.pass(mUseFXAA ? TextureFormat::RGBA8 : ldrFormat, toneMappingProgram);
+        // The temporal anti-aliasing resolves the color buffer into a full resolution history,
+        // it replaces the scaling of the last pass.
+        Viewport ppvp = svp;
+        if (temporal) {
+            view->prepareTemporalHistory(driver, vp.width, vp.height, hdrFormat);
+            colorBuffer = ppm.temporalUpsample(fg, *view, colorBuffer, colorPass.color,
+                    vp, svp, hdrFormat);
+            ppvp = { 0, 0, vp.width, vp.height };
+        }
 
         if (mUseFXAA) {
+            // FXAA tone maps its taps and scales its output, so it's a single pass that writes
+            // the output directly
             Handle<HwProgram> antiAliasingProgram = engine.getPostProcessProgram(
-                    translucent ? PostProcessStage::ANTI_ALIASING_TRANSLUCENT
-                                : PostProcessStage::ANTI_ALIASING_OPAQUE);
+                    translucent ? PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE);
             ppm.pass(ldrFormat, antiAliasingProgram);
+        } else {
+            Handle<HwProgram> toneMappingProgram = engine.getPostProcessProgram(
+                    translucent ? PostProcessStage::TONE_MAPPING_TRANSLUCENT
+                                : PostProcessStage::TONE_MAPPING_OPAQUE);
+            ppm.pass(ldrFormat, toneMappingProgram);
+
+            if (scaled && !temporal) {
+                // because it's the last command, the TextureFormat is not relevant
+                ppm.blit();
+            }
         }
-
-        if (scaled) {
-            // because it's the last command, the TextureFormat is not relevant
-            ppm.blit();
-        }
-        ppm.finish(view->getDiscardedTargetBuffers(), viewRenderTarget, vp, colorTarget, svp);
-
-        driver.popGroupMarker();
+        ppm.finish(fg, colorBuffer, output, vp, ppvp, view->getColorGradingLut(),
+                mFrameInfoManager);
     }
 
-    // for debugging
-    recordHighWatermark(commands);
+    fg.compile();
+    fg.execute(driver);
+
+    recordHighWatermark(colorCommands);
 }
 
-bool FRenderer::beginFrame(FSwapChain* swapChain) {
+bool FRenderer::beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano) {
     SYSTRACE_CALL();
 
     assert(swapChain);
 
     mFrameId++;
+    mVsyncSteadyClockTime = vsyncSteadyClockTimeNano;
     mFrameInfoManager.beginFrame(mFrameId);
+    mBeginFrameTime = std::chrono::steady_clock::now();
 
     { // scope for frame id trace
         char buf[64];
@@ -241,17 +467,18 @@ bool FRenderer::beginFrame(FSwapChain* swapChain) {
 
     FEngine& engine = getEngine();
     FEngine::DriverApi& driver = engine.getDriverApi();
-
-    // NOTE: this makes synchronous calls to the driver
-    driver.updateStreams(&driver);
+    engine.resetFrameCounters();
 
     mSwapChain = swapChain;
     swapChain->makeCurrent(driver);
 
-    driver.beginFrame(
+    driver.beginFrame(vsyncSteadyClockTimeNano ? vsyncSteadyClockTimeNano :
             uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()), mFrameId);
 
-    if (mFrameSkipper.skipFrameNeeded()) {
+    // A headless swap chain renders every frame, as fast as the GPU allows.
+    if (swapChain->isHeadless()) {
+        mFrameSkipper.waitForFrame();
+    } else if (mFrameSkipper.skipFrameNeeded()) {
         mFrameInfoManager.cancelFrame();
         driver.endFrame(mFrameId);
         engine.flush();
@@ -279,6 +506,44 @@ void FRenderer::endFrame() {
     frameInfoManager.endFrame();
     mFrameSkipper.endFrame();
 
+    uint64_t stages[CpuStageTimings::STAGE_COUNT];
+    StageCounters counters;
+    CpuStageTimings::endFrame(stages, counters.data());
+    auto toMilliseconds = [](uint64_t ns) { return float(double(ns) * 1e-6); };
+    mCpuFrameStats.frameId = mFrameId;
+    mCpuFrameStats.scenePrepare = toMilliseconds(stages[CpuStageTimings::SCENE_PREPARE]);
+    mCpuFrameStats.culling = toMilliseconds(stages[CpuStageTimings::CULLING]);
+    mCpuFrameStats.partition = toMilliseconds(stages[CpuStageTimings::PARTITION]);
+    mCpuFrameStats.commandGeneration =
+            toMilliseconds(stages[CpuStageTimings::COMMAND_GENERATION]);
+    mCpuFrameStats.commandSort = toMilliseconds(stages[CpuStageTimings::COMMAND_SORT]);
+    mCpuFrameStats.driverCommands = toMilliseconds(stages[CpuStageTimings::DRIVER_COMMANDS]);
+    mCpuFrameStats.froxelization = toMilliseconds(stages[CpuStageTimings::FROXELIZATION]);
+    if (CpuStageTimings::isCountersEnabled()) {
+        updateCpuCounters(counters);
+    }
+
+    using duration = std::chrono::duration<float, std::milli>;
+    mFrameSummary.frameId = mFrameId;
+    mFrameSummary.frameInterval = frameInfoManager.getFrameInterval().count();
+    mFrameSummary.cpuFrameTime =
+            duration(std::chrono::steady_clock::now() - mBeginFrameTime).count();
+    mFrameSummary.gpuFrameTime = frameInfoManager.getLastGpuFrameTime().count();
+    mFrameSummary.drawCount = uint32_t(engine.debug.renderpass.draw_commands);
+    mFrameSummary.stateChangeCount = uint32_t(engine.debug.renderpass.state_changes);
+    mFrameSummary.redundantStateChangeCount =
+            uint32_t(engine.debug.renderpass.redundant_commands);
+    mFrameSummary.vsyncInterval = 0;
+    if (mVsyncSteadyClockTime) {
+        // the presentation time uses the prediction made with the previous frames
+        mFrameSummary.vsyncInterval = mFramePacer.getInterval();
+        driver.setPresentationTime(
+                mFramePacer.getPresentationTime(int64_t(mVsyncSteadyClockTime)));
+        mFramePacer.update(
+                double(mFrameSummary.cpuFrameTime + mFrameSummary.gpuFrameTime) * 1e6);
+    }
+    engine.publishFrameCounters(mFrameId);
+
     driver.endFrame(mFrameId);
 
     if (mSwapChain) {
@@ -286,6 +551,15 @@ void FRenderer::endFrame() {
         mSwapChain = nullptr;
     }
 
+    // the levels of the streaming textures used by this frame are loaded for the next one
+    engine.updateStreamingTextures();
+
+    // programs not used for a while are destroyed when there are too many
+    engine.updateProgramCache();
+
+    // the objects given to Engine::destroyDeferred(), that fit in this frame's budget
+    engine.processDeferredDestructions();
+
     // Run the component managers' GC in parallel
     // WARNING: while doing this we can't access any component manager
     auto& js = engine.getJobSystem();
@@ -296,8 +570,19 @@ void FRenderer::endFrame() {
     rtp.gc();           // gc post-processing targets (this can generate driver commands)
     engine.flush();     // flush command stream
 
-    // make sure we're done with the gcs
-    js.wait(job);
+    // make sure we're done with the gcs, they're time-bounded (see Engine::Config::gcTimeBudget).
+    // They can't overlap with the next frame because the application can use the component
+    // managers as soon as we return.
+    js.waitAndRelease(job);
+
+    // the jobs of this frame are done, their scratch memory can be reused by the next frame's
+    // (a shared JobSystem may still run the jobs of other engines, its owner resets it)
+    if (engine.ownsJobSystem()) {
+        js.resetScratch();
+    }
+
+    // the frame is done and the component managers are usable again, the callbacks can use them
+    engine.processFenceCallbacks();
 
 
 #if EXTRA_TIMING_INFO
@@ -314,6 +599,84 @@ void FRenderer::endFrame() {
 #endif
 }
 
+void FRenderer::setCpuCountersEnabled(bool enabled) noexcept {
+    CpuStageTimings::setCountersEnabled(enabled);
+    if (!enabled) {
+        mCpuCountersIndex = 0;
+        mCpuCountersFrameCount = 0;
+        mCpuCounterStats = {};
+    }
+}
+
+void FRenderer::updateCpuCounters(StageCounters const& counters) noexcept {
+    mCpuCounters[mCpuCountersIndex] = counters;
+    mCpuCountersIndex = uint32_t((mCpuCountersIndex + 1) % CPU_COUNTERS_FRAME_COUNT);
+    mCpuCountersFrameCount = std::min(mCpuCountersFrameCount + 1,
+            uint32_t(CPU_COUNTERS_FRAME_COUNT));
+
+    // sum the counters of each stage over the last frames
+    const uint32_t frameCount = mCpuCountersFrameCount;
+    StageCounters total = {};
+    uint64_t instructions = 0;
+    for (size_t i = 0; i < frameCount; i++) {
+        for (size_t s = 0; s < CpuStageTimings::STAGE_COUNT; s++) {
+            CpuStageTimings::Counters const& c = mCpuCounters[i][s];
+            total[s].instructions += c.instructions;
+            total[s].cycles += c.cycles;
+            total[s].cacheReferences += c.cacheReferences;
+            total[s].cacheMisses += c.cacheMisses;
+            total[s].branches += c.branches;
+            total[s].branchMisses += c.branchMisses;
+            instructions += c.instructions;
+        }
+    }
+    if (!instructions) {
+        // the performance counters are not supported
+        mCpuCounterStats = {};
+        return;
+    }
+
+    auto ratio = [](uint64_t n, uint64_t d) { return d ? float(double(n) / double(d)) : 0.0f; };
+    auto average = [&](CpuStageTimings::Counters const& c) {
+        CpuStageCounters stage;
+        stage.instructions = float(double(c.instructions) / frameCount);
+        stage.ipc = ratio(c.instructions, c.cycles);
+        stage.cacheMisses = float(double(c.cacheMisses) / frameCount);
+        stage.cacheMissRate = ratio(c.cacheMisses, c.cacheReferences);
+        stage.branchMisses = float(double(c.branchMisses) / frameCount);
+        stage.branchMissRate = ratio(c.branchMisses, c.branches);
+        return stage;
+    };
+
+    CpuCounterStats& stats = mCpuCounterStats;
+    stats.frameCount = frameCount;
+    stats.scenePrepare = average(total[CpuStageTimings::SCENE_PREPARE]);
+    stats.culling = average(total[CpuStageTimings::CULLING]);
+    stats.partition = average(total[CpuStageTimings::PARTITION]);
+    stats.commandGeneration = average(total[CpuStageTimings::COMMAND_GENERATION]);
+    stats.commandSort = average(total[CpuStageTimings::COMMAND_SORT]);
+    stats.driverCommands = average(total[CpuStageTimings::DRIVER_COMMANDS]);
+    stats.froxelization = average(total[CpuStageTimings::FROXELIZATION]);
+
+    // they're also published in the debug registry
+    math::float3* const properties = getEngine().debug.renderer.counters;
+    for (size_t s = 0; s < CpuStageTimings::STAGE_COUNT; s++) {
+        CpuStageCounters const stage = average(total[s]);
+        properties[s] = { stage.ipc, stage.cacheMissRate, stage.branchMissRate };
+    }
+}
+
+Renderer::FrameStats FRenderer::getFrameStats() const noexcept {
+    auto toMilliseconds = [](uint64_t ns) { return float(double(ns) * 1e-6); };
+    GpuFrameInfo const& info = mFrameInfoManager.getLastGpuFrameInfo();
+    FrameStats stats;
+    stats.frameId = info.frame;
+    stats.shadowPass = toMilliseconds(info.passes[GpuFrameInfo::SHADOW]);
+    stats.colorPass = toMilliseconds(info.passes[GpuFrameInfo::COLOR]);
+    stats.postProcess = toMilliseconds(info.passes[GpuFrameInfo::POST_PROCESS]);
+    return stats;
+}
+
 void FRenderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) {
 
@@ -367,10 +730,22 @@ void Renderer::render(View const* view) {
     upcast(this)->render(upcast(view));
 }
 
+void Renderer::render(View const* const* views, size_t count) {
+    upcast(this)->render(views, count);
+}
+
 bool Renderer::beginFrame(SwapChain* swapChain) {
     return upcast(this)->beginFrame(upcast(swapChain));
 }
 
+bool Renderer::beginFrame(SwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano) {
+    return upcast(this)->beginFrame(upcast(swapChain), vsyncSteadyClockTimeNano);
+}
+
+void Renderer::setDisplayInfo(DisplayInfo const& info) noexcept {
+    upcast(this)->setDisplayInfo(info);
+}
+
 void Renderer::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         driver::PixelBufferDescriptor&& buffer) {
     upcast(this)->readPixels(xoffset, yoffset, width, height, std::move(buffer));
@@ -380,4 +755,28 @@ void Renderer::endFrame() {
     upcast(this)->endFrame();
 }
 
+Renderer::FrameStats Renderer::getFrameStats() const noexcept {
+    return upcast(this)->getFrameStats();
+}
+
+Renderer::CpuFrameStats Renderer::getCpuFrameStats() const noexcept {
+    return upcast(this)->getCpuFrameStats();
+}
+
+void Renderer::setCpuCountersEnabled(bool enabled) noexcept {
+    upcast(this)->setCpuCountersEnabled(enabled);
+}
+
+Renderer::CpuCounterStats Renderer::getCpuCounterStats() const noexcept {
+    return upcast(this)->getCpuCounterStats();
+}
+
+size_t Renderer::getCommandsHighWatermark() const noexcept {
+    return upcast(this)->getCommandsHighWatermark();
+}
+
+Renderer::FrameSummary Renderer::getFrameSummary() const noexcept {
+    return upcast(this)->getFrameSummary();
+}
+
 } // namespace filament
@@ -25,13 +25,19 @@
 #include "details/GpuLightBuffer.h"
 #include "details/Skybox.h"
 
+#include <math/transforms.h>
+
 #include <utils/compiler.h>
 #include <utils/EntityManager.h>
+#include <utils/Hash.h>
+#include <utils/JobSystem.h>
 #include <utils/Range.h>
 #include <utils/Zip2Iterator.h>
 
 #include <algorithm>
 
+#include <string.h>
+
 using namespace math;
 using namespace utils;
 
@@ -48,11 +54,22 @@ FScene::FScene(FEngine& engine) :
 
 FScene::~FScene() noexcept = default;
 
+template<typename F>
+void FScene::forEachEntity(F f) const noexcept {
+    for (Entity e : mEntities) {
+        f(e);
+    }
+    // the hidden groups are skipped as a whole, their entities are not even looked at
+    for (Group const& group : mGroups) {
+        if (group.visible) {
+            for (Entity e : group.entities) {
+                f(e);
+            }
+        }
+    }
+}
 
 void FScene::prepare(const math::mat4f& worldOriginTansform) {
-    // TODO: can we skip this in most cases? Since we rely on indices staying the same,
-    //       we could only skip, if nothing changed in the RCM.
-
     FEngine& engine = mEngine;
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
@@ -61,105 +78,278 @@ void FScene::prepare(const math::mat4f& worldOriginTansform) {
     // go through the list of entities, and gather the data of those that are renderables
     auto& sceneData = mRenderableData;
     auto& lightData = mLightData;
-    auto const& entities = mEntities;
+    auto& preparedLights = mPreparedLights;
+
+    // The lights are culled (i.e. removed) from lightData by each View, so they're always
+    // restored below. Everything else can be skipped when nothing changed since the last time.
+    // Note that the rows of sceneData might have been reordered by the Views, which is fine.
+    const PreparedState state = { mVersion, em.getVersion(),
+            rcm.getVersion(), tcm.getVersion(), lcm.getVersion(), worldOriginTansform };
+    if (!mPreparedStateValid || memcmp(&state, &mPreparedState, sizeof(state)) != 0) {
+        mPreparedState = state;
+        mPreparedStateValid = true;
+
+        // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
+        // component can be added after the entity is added to the scene.
+
+        const mat4x3f worldOrigin(worldOriginTansform);
+
+        // for the purpose of allocation, we'll assume all our entities are renderables
+        size_t capacity = mEntities.size();
+        for (Group const& group : mGroups) {
+            capacity += group.visible ? group.entities.size() : 0;
+        }
+        // we need the capacity to be multiple of 16 for SIMD loops
+        capacity = (capacity + 0xF) & ~0xF;
+        // we need 1 extra entry at the end for teh summed primitive count
+        capacity = capacity + 1;
+
+        sceneData.clear();
+        if (sceneData.capacity() < capacity) {
+            sceneData.setCapacity(capacity);
+        }
 
+        // the first entries are reserved for the directional lights (currently only one)
+        preparedLights.clear();
+        preparedLights.resize(DIRECTIONAL_LIGHTS_COUNT);
+
+        // find the max intensity directional light index in our local array
+        float maxIntensity = 0;
+
+        forEachEntity([&](Entity e) {
+            if (!em.isAlive(e))
+                return;
+
+            // getInstance() always returns null if the entity is the Null entity
+            // so we don't need to check for that, but we need to check it's alive
+            auto ri = rcm.getInstance(e);
+            auto li = lcm.getInstance(e);
+            if (!ri & !li)
+                return;
+
+            // get the world transform, transforms are assumed to be affine
+            auto ti = tcm.getInstance(e);
+            const mat4x3f worldTransform = worldOrigin * mat4x3f(tcm.getWorldTransform(ti));
+
+            // don't even draw this object if it doesn't have a transform (which shouldn't happen
+            // because one is always created when creating a Renderable component).
+            if (ri && ti) {
+                // we know there is enough space in the array
+                // the local AABB is transformed to world space below, with all the others
+                const Box& localAABB = rcm.getAABB(ri);
+                sceneData.push_back_unsafe(
+                        ri,
+                        worldTransform,
+                        rcm.getVisibility(ri),
+                        rcm.getBonesOffset(ri),
+                        localAABB.center,
+                        0,
+                        0,
+                        false,
+                        rcm.getLayerMask(ri),
+                        localAABB.halfExtent,
+                        {}, {}, {});
+            }
 
-    // NOTE: we can't know in advance how many entities are renderable or lights because the corresponding
-    // component can be added after the entity is added to the scene.
+            if (li) {
+                // find the dominant directional light
+                if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
+                    // we don't store the directional lights, because we only have a single one
+                    if (lcm.getIntensity(li) >= maxIntensity) {
+                        float3 d = lcm.getLocalDirection(li);
+                        // using the inverse-transpose handles non-uniform scaling
+                        d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                        preparedLights[0] = { {}, d, li, LIGHT_CASTER, 0 };
+                    }
+                } else {
+                    const float3 p = worldTransform * lcm.getLocalPosition(li);
+                    float3 d = 0;
+                    if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
+                        d = lcm.getLocalDirection(li);
+                        // using the inverse-transpose handles non-uniform scaling
+                        d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
+                    }
+                    const bool spot = lcm.isSpotLight(li);
+                    const uint8_t flags =
+                            uint8_t(lcm.isLightCaster(li) && lcm.getIntensity(li) > 0.0f ?
+                                    LIGHT_CASTER : 0) |
+                            uint8_t(spot ? SPOT_LIGHT : 0);
+                    preparedLights.push_back({ float4{ p, lcm.getRadius(li) }, d, li,
+                            flags, spot ? lcm.getCosOuterSquared(li) : 0.0f });
+                }
+            }
+        });
 
-    // for the purpose of allocation, we'll assume all our entities are renderables
-    size_t capacity = entities.size();
-    // we need the capacity to be multiple of 16 for SIMD loops
-    capacity = (capacity + 0xF) & ~0xF;
-    // we need 1 extra entry at the end for teh summed primitive count
-    capacity = capacity + 1;
+        // compute the world AABBs so we can perform culling
+        const uint32_t staticShadowCastersHash = computeWorldBounds(engine.getJobSystem());
+        if (staticShadowCastersHash != mStaticShadowCastersHash) {
+            mStaticShadowCastersHash = staticShadowCastersHash;
+            ++mStaticShadowCastersVersion;
+        }
 
-    sceneData.clear();
-    if (sceneData.capacity() < capacity) {
-        sceneData.setCapacity(capacity);
+        updateRenderableBvh();
     }
 
     lightData.clear();
-    if (lightData.capacity() < capacity) {
-        lightData.setCapacity(capacity);
+    if (lightData.capacity() < preparedLights.size()) {
+        lightData.setCapacity(preparedLights.size());
     }
-    // the first entries are reserved for the directional lights (currently only one)
-    lightData.resize(DIRECTIONAL_LIGHTS_COUNT);
-
-
-    // find the max intensity directional light index in our local array
-    float maxIntensity = 0;
-
-    for (Entity e : entities) {
-        if (!em.isAlive(e))
-            continue;
-
-        // getInstance() always returns null if the entity is the Null entity
-        // so we don't need to check for that, but we need to check it's alive
-        auto ri = rcm.getInstance(e);
-        auto li = lcm.getInstance(e);
-        if (!ri & !li)
-            continue;
-
-        // get the world transform
-        auto ti = tcm.getInstance(e);
-        const mat4f worldTransform = worldOriginTansform * tcm.getWorldTransform(ti);
-
-        // don't even draw this object if it doesn't have a transform (which shouldn't happen
-        // because one is always created when creating a Renderable component).
-        if (ri && ti) {
-            // compute the world AABB so we can perform culling
-            const Box worldAABB = rigidTransform(rcm.getAABB(ri), worldTransform);
-
-            // we know there is enough space in the array
-            sceneData.push_back_unsafe(
-                    ri,
-                    worldTransform,
-                    rcm.getVisibility(ri),
-                    rcm.getUbh(ri),
-                    rcm.getBonesUbh(ri),
-                    worldAABB.center,
-                    0,
-                    rcm.getLayerMask(ri),
-                    worldAABB.halfExtent,
-                    {}, {});
-        }
+    for (PreparedLight const& light : preparedLights) {
+        // we know there is enough space in the array
+        lightData.push_back_unsafe(light.positionRadius, light.direction, light.instance, {},
+                NO_SHADOW, light.flags, light.cosOuterSquared, 1.0f);
+    }
+}
 
-        if (li) {
-            // find the dominant directional light
-            if (UTILS_UNLIKELY(lcm.isDirectionalLight(li))) {
-                // we don't store the directional lights, because we only have a single one
-                if (lcm.getIntensity(li) >= maxIntensity) {
-                    float3 d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                    // TODO: allow lightData.front() = { ... } syntax
-                    lightData.elementAt<FScene::POSITION_RADIUS>(0) = {};
-                    lightData.elementAt<FScene::DIRECTION>(0)       = d;
-                    lightData.elementAt<FScene::LIGHT_INSTANCE>(0)  = li;
-                    lightData.elementAt<FScene::VISIBILITY>(0)      = {};
-                }
-            } else {
-                const float4 p = worldTransform * float4{ lcm.getLocalPosition(li), 1 };
-                float3 d = 0;
-                if (!lcm.isPointLight(li) || lcm.isIESLight(li)) {
-                    d = lcm.getLocalDirection(li);
-                    // using the inverse-transpose handles non-uniform scaling
-                    d = normalize(transpose(inverse(worldTransform.upperLeft())) * d);
-                }
-                lightData.push_back_unsafe(
-                        float4{ p.xyz, lcm.getRadius(li) }, d, li, {});
+uint32_t FScene::computeWorldBounds(JobSystem& js) noexcept {
+    auto& sceneData = mRenderableData;
+    mat4x3f const* const transforms = sceneData.data<WORLD_TRANSFORM>();
+    float3* const centers = sceneData.data<WORLD_AABB_CENTER>();
+    float3* const extents = sceneData.data<WORLD_AABB_EXTENT>();
+    auto const* const instances = sceneData.data<RENDERABLE_INSTANCE>();
+    FRenderableManager::Visibility const* const visibility = sceneData.data<VISIBILITY_STATE>();
+    const size_t count = sceneData.size();
+
+    // summed (so it doesn't depend on the order of the entities) hash of the static
+    // shadow casters and their bounds
+    auto transformRange = [=](size_t first, size_t last) {
+        transformAABBs(transforms + first, centers + first, extents + first,
+                centers + first, extents + first, last - first);
+        uint32_t hash = 0;
+        for (size_t i = first; i < last; i++) {
+            if (UTILS_UNLIKELY(visibility[i].castShadows && visibility[i].staticShadowCaster)) {
+                const struct {
+                    uint32_t instance;
+                    Box box;
+                } caster = { instances[i].asValue(), { centers[i], extents[i] }};
+                hash += hash::MurmurHashFn<decltype(caster)>()(caster);
             }
         }
+        return hash;
+    };
+
+    // Each job transforms a range of the SoA, small scenes are processed on the calling thread.
+    constexpr size_t MIN_RANGE_SIZE = 1024;
+    constexpr size_t MAX_JOB_COUNT = 16;
+    const size_t jobCount = std::min(MAX_JOB_COUNT, std::max(count / MIN_RANGE_SIZE, size_t(1)));
+    if (jobCount == 1) {
+        return transformRange(0, count);
+    }
+
+    uint32_t hashes[MAX_JOB_COUNT];
+    const size_t rangeSize = (count + jobCount - 1) / jobCount;
+    auto processRange = [&](size_t j) {
+        const size_t first = j * rangeSize;
+        hashes[j] = transformRange(first, std::min(first + rangeSize, count));
+    };
+    auto parent = js.createJob();
+    js.setName(parent, "FScene::computeWorldBounds");
+    for (size_t j = 0; j < jobCount; j++) {
+        js.runAndRelease(js.createJob(parent, [&processRange, j](JobSystem&, JobSystem::Job*) {
+            processRange(j);
+        }), JobSystem::DONT_SIGNAL);
     }
+    js.run(parent);
+    js.waitAndRelease(parent);
+
+    uint32_t hash = 0;
+    for (size_t j = 0; j < jobCount; j++) {
+        hash += hashes[j];
+    }
+    return hash;
 }
 
-void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept {
+void FScene::updateRenderableBvh() noexcept {
+    auto const& sceneData = mRenderableData;
+    const size_t count = sceneData.size();
+    if (count < BVH_MIN_RENDERABLE_COUNT) {
+        mRenderableBvh.clear();
+        mRenderableBvhInstances.clear();
+        return;
+    }
+
+    float3 const* const centers = sceneData.data<WORLD_AABB_CENTER>();
+    float3 const* const extents = sceneData.data<WORLD_AABB_EXTENT>();
+    auto const* const instances = sceneData.data<RENDERABLE_INSTANCE>();
+
+    // when the renderables are the same, just refit the hierarchy to their new bounds
+    auto& bvhInstances = mRenderableBvhInstances;
+    if (bvhInstances.size() == count &&
+            std::equal(bvhInstances.begin(), bvhInstances.end(), instances)) {
+        mRenderableBvh.refit(centers, extents);
+        return;
+    }
+
+    mRenderableBvh.build(centers, extents, count);
+    bvhInstances.assign(instances, instances + count);
+
+    auto& boxOfInstance = mRenderableBvhBoxOfInstance;
+    const auto maxInstance = *std::max_element(instances, instances + count);
+    boxOfInstance.resize(maxInstance + 1);
+    for (uint32_t i = 0; i < count; i++) {
+        boxOfInstance[instances[i]] = i;
+    }
+    mRenderableBvhRows.resize(count);
+}
+
+void FScene::updateRenderableBvhRows() noexcept {
+    if (mRenderableBvh.empty()) {
+        return;
+    }
+    auto const* const UTILS_RESTRICT instances = mRenderableData.data<RENDERABLE_INSTANCE>();
+    uint32_t const* const UTILS_RESTRICT boxOfInstance = mRenderableBvhBoxOfInstance.data();
+    uint32_t* const UTILS_RESTRICT rows = mRenderableBvhRows.data();
+    for (uint32_t row = 0, c = uint32_t(mRenderableData.size()); row < c; row++) {
+        rows[boxOfInstance[instances[row]]] = row;
+    }
+}
+
+void FScene::updateUBOs(utils::Range<uint32_t> visibleRenderables,
+        Handle<HwUniformBuffer> renderableUbh, RenderableUbContent& content) noexcept {
+    constexpr size_t stride = FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
     FRenderableManager& rcm = mEngine.getRenderableManager();
     auto& sceneData = mRenderableData;
+
+    // The renderable manager holds a single copy of each renderable's uniforms, if another
+    // scene wrote them since we did, they have to be computed again.
+    bool* const UTILS_RESTRICT valid = sceneData.data<UNIFORMS_VALID>();
+    if (rcm.getLocalUBOsVersion() != mLocalUBOsVersion) {
+        std::fill_n(valid, sceneData.size(), false);
+    }
+    auto const* const UTILS_RESTRICT instances = sceneData.data<RENDERABLE_INSTANCE>();
+    for (uint32_t i : visibleRenderables) {
+        if (!valid[i]) {
+            rcm.updateLocalUBO(instances[i], sceneData.elementAt<WORLD_TRANSFORM>(i));
+            valid[i] = true;
+        }
+    }
+    mLocalUBOsVersion = rcm.getLocalUBOsVersion();
+
+    // A row holding the same renderable as last time is unchanged, unless some uniforms were
+    // computed since then, in which case its content has to be compared.
+    auto& rows = content.instances;
+    if (rows.size() < visibleRenderables.last) {
+        rows.resize(visibleRenderables.last);
+    }
+    const bool compare = content.localUBOsVersion != mLocalUBOsVersion;
+    UniformBuffer& uniforms = content.uniforms;
+    char const* const UTILS_RESTRICT data = static_cast<char const*>(uniforms.getBuffer());
     for (uint32_t i : visibleRenderables) {
-        auto ri = sceneData.elementAt<RENDERABLE_INSTANCE>(i);
-        rcm.updateLocalUBO(ri, sceneData.elementAt<WORLD_TRANSFORM>(i));
+        UniformBuffer const& local = rcm.getUniformBuffer(instances[i]);
+        if (rows[i] != instances[i] ||
+                (compare && memcmp(data + i * stride, local.getBuffer(), local.getSize()))) {
+            memcpy(uniforms.invalidateUniforms(i * stride, local.getSize()),
+                    local.getBuffer(), local.getSize());
+            rows[i] = instances[i];
+        }
+    }
+    content.localUBOsVersion = mLocalUBOsVersion;
+
+    // only the dirty range is uploaded by the driver
+    if (uniforms.isDirty()) {
+        mEngine.countUniformUpdate(uniforms);
+        mEngine.getDriverApi().updateUniformBuffer(renderableUbh, UniformBuffer(uniforms));
+        uniforms.clean();
     }
 }
 
@@ -212,26 +402,108 @@ void FScene::prepareLights(const CameraInfo& camera) noexcept {
     auto const* UTILS_RESTRICT positions    = lightData.data<FScene::POSITION_RADIUS>();
     auto const* UTILS_RESTRICT directions   = lightData.data<FScene::DIRECTION>();
     auto const* UTILS_RESTRICT instances    = lightData.data<FScene::LIGHT_INSTANCE>();
+    auto const* UTILS_RESTRICT shadows      = lightData.data<FScene::SHADOW_INDEX>();
+    auto const* UTILS_RESTRICT fades        = lightData.data<FScene::LIGHT_FADE>();
     for (size_t i = DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; ++i) {
         GpuLightBuffer::LightIndex gpuIndex = GpuLightBuffer::LightIndex(i - DIRECTIONAL_LIGHTS_COUNT);
-        GpuLightBuffer::LightParameters& lp = gpuLightData.getLightParameters(gpuIndex);
+        GpuLightBuffer::LightParameters lp;
         auto li = instances[i];
         lp.positionFalloff      = { positions[i].xyz, lcm.getSquaredFalloffInv(li) };
-        lp.colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) };
+        lp.colorIntensity       = { lcm.getColor(li), lcm.getIntensity(li) * fades[i] };
         lp.directionIES         = { directions[i], 0 };
         lp.spotScaleOffset.xy   = { lcm.getSpotParams(li).scaleOffset };
+        // shadow map of the light in the atlas (negative when the light has none), and its
+        // constant bias, applied in world space towards the light
+        const bool hasShadow = shadows[i] != NO_SHADOW;
+        lp.spotScaleOffset.z    = hasShadow ? float(shadows[i]) : -1.0f;
+        lp.spotScaleOffset.w    = hasShadow ? lcm.getShadowConstantBias(li) : 0.0f;
+        // only the lights that changed since the last frame are uploaded
+        gpuLightData.setLightParameters(gpuIndex, lp);
     }
 
-    gpuLightData.invalidate(0, lightData.size());
     gpuLightData.commit(mEngine);
 }
 
 void FScene::addEntity(Entity entity) {
     mEntities.insert(entity);
+    ++mVersion;
 }
 
 void FScene::remove(Entity entity) {
     mEntities.erase(entity);
+    ++mVersion;
+}
+
+FScene::Group* FScene::getGroup(GroupId group) noexcept {
+    return group < mGroups.size() && mGroups[group].alive ? &mGroups[group] : nullptr;
+}
+
+FScene::Group const* FScene::getGroup(GroupId group) const noexcept {
+    return group < mGroups.size() && mGroups[group].alive ? &mGroups[group] : nullptr;
+}
+
+Scene::GroupId FScene::createGroup(Box const& bounds) noexcept {
+    GroupId id;
+    if (!mFreeGroups.empty()) {
+        id = mFreeGroups.back();
+        mFreeGroups.pop_back();
+    } else {
+        id = GroupId(mGroups.size());
+        mGroups.emplace_back();
+    }
+    Group& group = mGroups[id];
+    group.bounds = bounds;
+    group.visible = true;
+    group.alive = true;
+    return id;
+}
+
+void FScene::removeGroup(GroupId id) noexcept {
+    Group* const group = getGroup(id);
+    if (group) {
+        if (group->visible && !group->entities.empty()) {
+            ++mVersion;
+        }
+        // release the memory, a group that's reused could be much smaller
+        std::vector<Entity>().swap(group->entities);
+        group->alive = false;
+        mFreeGroups.push_back(id);
+    }
+}
+
+void FScene::addToGroup(GroupId id, Entity const* entities, size_t count) {
+    Group* const group = getGroup(id);
+    if (group && count) {
+        group->entities.insert(group->entities.end(), entities, entities + count);
+        if (group->visible) {
+            ++mVersion;
+        }
+    }
+}
+
+void FScene::setGroupVisible(GroupId id, bool visible) noexcept {
+    Group* const group = getGroup(id);
+    if (group && group->visible != visible) {
+        group->visible = visible;
+        if (!group->entities.empty()) {
+            ++mVersion;
+        }
+    }
+}
+
+bool FScene::isGroupVisible(GroupId id) const noexcept {
+    Group const* const group = getGroup(id);
+    return group && group->visible;
+}
+
+size_t FScene::getGroupEntityCount(GroupId id) const noexcept {
+    Group const* const group = getGroup(id);
+    return group ? group->entities.size() : 0;
+}
+
+Box FScene::getGroupBounds(GroupId id) const noexcept {
+    Group const* const group = getGroup(id);
+    return group ? group->bounds : Box{};
 }
 
 size_t FScene::getRenderableCount() const noexcept {
@@ -239,10 +511,9 @@ size_t FScene::getRenderableCount() const noexcept {
     EntityManager& em = engine.getEntityManager();
     FRenderableManager& rcm = engine.getRenderableManager();
     size_t count = 0;
-    auto const& entities = mEntities;
-    for (Entity e : entities) {
+    forEachEntity([&](Entity e) {
         count += em.isAlive(e) && rcm.getInstance(e) ? 1 : 0;
-    }
+    });
     return count;
 }
 
@@ -251,10 +522,9 @@ size_t FScene::getLightCount() const noexcept {
     EntityManager& em = engine.getEntityManager();
     FLightManager& lcm = engine.getLightManager();
     size_t count = 0;
-    auto const& entities = mEntities;
-    for (Entity e : entities) {
+    forEachEntity([&](Entity e) {
         count += em.isAlive(e) && lcm.getInstance(e) ? 1 : 0;
-    }
+    });
     return count;
 }
 
@@ -268,32 +538,77 @@ void FScene::setSkybox(FSkybox const* skybox) noexcept {
     }
 }
 
-void FScene::computeBounds(
+static void computeBoundsRange(
+        float3 const* UTILS_RESTRICT worldAABBCenter, float3 const* UTILS_RESTRICT worldAABBExtent,
+        uint8_t const* UTILS_RESTRICT layers,
+        FRenderableManager::Visibility const* UTILS_RESTRICT visibility,
+        size_t first, size_t last, uint32_t visibleLayers,
+        Aabb& UTILS_RESTRICT castersBox, Aabb& UTILS_RESTRICT receiversBox) noexcept {
+    // this loop is written without branches so it can be vectorized
+    float3 cmin = castersBox.min, cmax = castersBox.max;
+    float3 rmin = receiversBox.min, rmax = receiversBox.max;
+    for (size_t i = first; i < last; i++) {
+        const float3 bmin = worldAABBCenter[i] - worldAABBExtent[i];
+        const float3 bmax = worldAABBCenter[i] + worldAABBExtent[i];
+        const bool visible = bool(layers[i] & visibleLayers);
+        const bool caster = visible & visibility[i].castShadows;
+        const bool receiver = visible & visibility[i].receiveShadows;
+        cmin = caster ? min(cmin, bmin) : cmin;
+        cmax = caster ? max(cmax, bmax) : cmax;
+        rmin = receiver ? min(rmin, bmin) : rmin;
+        rmax = receiver ? max(rmax, bmax) : rmax;
+    }
+    castersBox = { cmin, cmax };
+    receiversBox = { rmin, rmax };
+}
+
+void FScene::computeBounds(JobSystem& js,
         Aabb& UTILS_RESTRICT castersBox,
         Aabb& UTILS_RESTRICT receiversBox,
         uint32_t visibleLayers) const noexcept {
-    using State = FRenderableManager::Visibility;
-
     // Compute the scene bounding volume
     RenderableSoa const& UTILS_RESTRICT soa = mRenderableData;
-    float3 const* const UTILS_RESTRICT worldAABBCenter = soa.data<WORLD_AABB_CENTER>();
-    float3 const* const UTILS_RESTRICT worldAABBExtent = soa.data<WORLD_AABB_EXTENT>();
-    uint8_t const* const UTILS_RESTRICT layers = soa.data<LAYERS>();
-    State const* const UTILS_RESTRICT visibility = soa.data<VISIBILITY_STATE>();
-    size_t c = soa.size();
-    for (size_t i = 0; i < c; i++) {
-        if (layers[i] & visibleLayers) {
-            const Aabb aabb{ worldAABBCenter[i] - worldAABBExtent[i],
-                             worldAABBCenter[i] + worldAABBExtent[i] };
-            if (visibility[i].castShadows) {
-                castersBox.min = min(castersBox.min, aabb.min);
-                castersBox.max = max(castersBox.max, aabb.max);
-            }
-            if (visibility[i].receiveShadows) {
-                receiversBox.min = min(receiversBox.min, aabb.min);
-                receiversBox.max = max(receiversBox.max, aabb.max);
-            }
-        }
+    float3 const* const worldAABBCenter = soa.data<WORLD_AABB_CENTER>();
+    float3 const* const worldAABBExtent = soa.data<WORLD_AABB_EXTENT>();
+    uint8_t const* const layers = soa.data<LAYERS>();
+    FRenderableManager::Visibility const* const visibility = soa.data<VISIBILITY_STATE>();
+    const size_t count = soa.size();
+
+    // Each job reduces a range of the SoA into its own boxes, which are then merged. Small
+    // scenes are reduced on the calling thread.
+    constexpr size_t MIN_RANGE_SIZE = 1024;
+    constexpr size_t MAX_JOB_COUNT = 16;
+    const size_t jobCount = std::min(MAX_JOB_COUNT, std::max(count / MIN_RANGE_SIZE, size_t(1)));
+    if (jobCount == 1) {
+        computeBoundsRange(worldAABBCenter, worldAABBExtent, layers, visibility,
+                0, count, visibleLayers, castersBox, receiversBox);
+        return;
+    }
+
+    Aabb casters[MAX_JOB_COUNT];
+    Aabb receivers[MAX_JOB_COUNT];
+    const size_t rangeSize = (count + jobCount - 1) / jobCount;
+    auto reduceRange = [&](size_t j) {
+        const size_t first = j * rangeSize;
+        const size_t last = std::min(first + rangeSize, count);
+        computeBoundsRange(worldAABBCenter, worldAABBExtent, layers, visibility,
+                first, last, visibleLayers, casters[j], receivers[j]);
+    };
+    auto parent = js.createJob();
+    js.setName(parent, "FScene::computeBounds");
+    for (size_t j = 0; j < jobCount; j++) {
+        js.runAndRelease(js.createJob(parent, [&reduceRange, j](JobSystem&, JobSystem::Job*) {
+            reduceRange(j);
+        }), JobSystem::DONT_SIGNAL);
+    }
+    js.run(parent);
+    js.waitAndRelease(parent);
+
+    for (size_t j = 0; j < jobCount; j++) {
+        castersBox.min = min(castersBox.min, casters[j].min);
+        castersBox.max = max(castersBox.max, casters[j].max);
+        receiversBox.min = min(receiversBox.min, receivers[j].min);
+        receiversBox.max = max(receiversBox.max, receivers[j].max);
     }
 }
 
@@ -329,4 +644,32 @@ size_t Scene::getLightCount() const noexcept {
     return upcast(this)->getLightCount();
 }
 
+Scene::GroupId Scene::createGroup(Box const& bounds) noexcept {
+    return upcast(this)->createGroup(bounds);
+}
+
+void Scene::removeGroup(GroupId group) noexcept {
+    upcast(this)->removeGroup(group);
+}
+
+void Scene::addToGroup(GroupId group, Entity const* entities, size_t count) {
+    upcast(this)->addToGroup(group, entities, count);
+}
+
+void Scene::setGroupVisible(GroupId group, bool visible) noexcept {
+    upcast(this)->setGroupVisible(group, visible);
+}
+
+bool Scene::isGroupVisible(GroupId group) const noexcept {
+    return upcast(this)->isGroupVisible(group);
+}
+
+size_t Scene::getGroupEntityCount(GroupId group) const noexcept {
+    return upcast(this)->getGroupEntityCount(group);
+}
+
+Box Scene::getGroupBounds(GroupId group) const noexcept {
+    return upcast(this)->getGroupBounds(group);
+}
+
 } // namespace filament
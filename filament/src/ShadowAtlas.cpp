@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "details/ShadowAtlas.h"
+
+#include "components/LightManager.h"
+
+#include "details/Engine.h"
+#include "details/Scene.h"
+
+#include <filament/driver/DriverEnums.h>
+
+#include <utils/algorithm.h>
+
+#include <algorithm>
+
+using namespace math;
+using namespace utils;
+
+namespace filament {
+using namespace driver;
+
+namespace details {
+
+namespace {
+
+// largest power of two smaller or equal to x, x must not be 0
+inline uint32_t floorPowerOfTwo(uint32_t x) noexcept {
+    return 1u << (31u - utils::clz(x));
+}
+
+// smallest power of two larger or equal to x, x must not be 0
+inline uint32_t ceilPowerOfTwo(uint32_t x) noexcept {
+    return x > 1 ? 1u << (32u - utils::clz(x - 1u)) : 1u;
+}
+
+// the even bits of a Morton code
+inline uint32_t compactBits(uint32_t x) noexcept {
+    x &= 0x55555555u;
+    x = (x | (x >> 1u)) & 0x33333333u;
+    x = (x | (x >> 2u)) & 0x0F0F0F0Fu;
+    x = (x | (x >> 4u)) & 0x00FF00FFu;
+    x = (x | (x >> 8u)) & 0x0000FFFFu;
+    return x;
+}
+
+} // anonymous namespace
+
+ShadowAtlas::ShadowAtlas(FEngine& engine) noexcept : mEngine(engine) {
+    for (auto& shadowMap : mShadowMaps) {
+        shadowMap.reset(new ShadowMap(engine));
+    }
+}
+
+ShadowAtlas::~ShadowAtlas() = default;
+
+void ShadowAtlas::terminate(DriverApi& driverApi) noexcept {
+    if (mAtlasRenderTarget) {
+        driverApi.destroyRenderTarget(mAtlasRenderTarget);
+        mAtlasRenderTarget.clear();
+    }
+    if (mAtlasHandle) {
+        driverApi.destroyTexture(mAtlasHandle);
+        mAtlasHandle.clear();
+    }
+}
+
+size_t ShadowAtlas::pack(uint32_t atlasSize, uint32_t minSize,
+        uint32_t* sizes, Tile* tiles, size_t count) noexcept {
+    assert(count <= CONFIG_MAX_SHADOWED_SPOT_LIGHTS);
+
+    // halve the largest tiles until they all fit
+    const uint64_t capacity = uint64_t(atlasSize) * atlasSize;
+    uint64_t area = 0;
+    for (size_t i = 0; i < count; i++) {
+        area += uint64_t(sizes[i]) * sizes[i];
+    }
+    while (area > capacity) {
+        size_t largest = count;
+        for (size_t i = 0; i < count; i++) {
+            if (sizes[i] > minSize && (largest == count || sizes[i] > sizes[largest])) {
+                largest = i;
+            }
+        }
+        if (largest == count) {
+            break;
+        }
+        const uint64_t size = sizes[largest];
+        area -= size * size - (size / 2) * (size / 2);
+        sizes[largest] /= 2;
+    }
+
+    // Placed largest first, the offset (in texels) of each tile along the Z-order curve is a
+    // multiple of its area, so it decodes to a position aligned to the tile's size, and the
+    // tile covers a contiguous range of the curve.
+    uint8_t order[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    for (size_t i = 0; i < count; i++) {
+        order[i] = uint8_t(i);
+    }
+    std::stable_sort(order, order + count,
+            [sizes](uint8_t lhs, uint8_t rhs) { return sizes[lhs] > sizes[rhs]; });
+
+    size_t placed = 0;
+    uint64_t offset = 0;
+    for (size_t i = 0; i < count; i++) {
+        const size_t index = order[i];
+        const uint64_t size = sizes[index];
+        if (offset + size * size > capacity) {
+            sizes[index] = 0;
+            tiles[index] = {};
+            continue;
+        }
+        tiles[index] = {
+                compactBits(uint32_t(offset)),
+                compactBits(uint32_t(offset >> 1u)),
+                uint32_t(size) };
+        offset += size * size;
+        placed++;
+    }
+    return placed;
+}
+
+void ShadowAtlas::clear(FScene::LightSoa& lightData) noexcept {
+    std::fill_n(lightData.data<FScene::SHADOW_INDEX>(), lightData.size(), FScene::NO_SHADOW);
+    mShadowMapCount = 0;
+}
+
+void ShadowAtlas::update(FScene::LightSoa& lightData, CameraInfo const& camera,
+        float viewportHeight) noexcept {
+    auto& lcm = mEngine.getLightManager();
+
+    auto const* const UTILS_RESTRICT spheres   = lightData.data<FScene::POSITION_RADIUS>();
+    auto const* const UTILS_RESTRICT instances = lightData.data<FScene::LIGHT_INSTANCE>();
+    uint8_t* const UTILS_RESTRICT shadows      = lightData.data<FScene::SHADOW_INDEX>();
+    clear(lightData);
+
+    // the number of pixels the light's sphere of influence covers vertically, which is what
+    // its shadow map's dimension ideally is
+    const bool perspective = camera.projection[3][3] == 0.0f;
+    const float scale = std::abs(camera.projection[1][1]) * viewportHeight;
+    const float3 position = camera.getPosition();
+
+    std::vector<Candidate>& candidates = mCandidates;
+    candidates.clear();
+    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT, c = lightData.size(); i < c; i++) {
+        FLightManager::Instance li = instances[i];
+        if (lcm.isSpotLight(li) && lcm.isShadowCaster(li)) {
+            const float radius = spheres[i].w;
+            const float pixels = perspective ?
+                    scale * radius / std::max(distance(position, spheres[i].xyz), radius) :
+                    scale * radius;
+            const uint32_t mapSize = uint32_t(lcm.getShadowMapSize(li) * mResolutionScale);
+            const uint32_t maxSize = std::max(MIN_TILE_SIZE, std::min(MAX_TILE_SIZE,
+                    floorPowerOfTwo(std::max(1u, mapSize))));
+            const uint32_t size = ceilPowerOfTwo(uint32_t(std::min(pixels, float(maxSize))));
+            candidates.push_back({ uint32_t(i), pixels, std::max(MIN_TILE_SIZE, size) });
+        }
+    }
+
+    // the lights that are the largest on screen get a shadow map first
+    const size_t count = std::min(candidates.size(), CONFIG_MAX_SHADOWED_SPOT_LIGHTS);
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+            [](Candidate const& lhs, Candidate const& rhs) { return lhs.pixels > rhs.pixels; });
+
+    uint32_t sizes[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    Tile tiles[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    for (size_t i = 0; i < count; i++) {
+        sizes[i] = candidates[i].size;
+    }
+    pack(ATLAS_SIZE, MIN_TILE_SIZE, sizes, tiles, count);
+
+    size_t shadowMapCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (!sizes[i]) {
+            continue;
+        }
+        // tiles are aligned to their size, so the atlas is a grid of tiles of this size
+        const uint32_t size = tiles[i].size;
+        const ShadowMap::Cascade tile = {
+                .zn = 0,
+                .zf = 0,
+                .column = uint8_t(tiles[i].x / size),
+                .row = uint8_t(tiles[i].y / size),
+                .columns = uint8_t(ATLAS_SIZE / size),
+                .rows = uint8_t(ATLAS_SIZE / size),
+                .dimension = uint16_t(size)
+        };
+        const uint32_t row = candidates[i].row;
+        mShadowMaps[shadowMapCount]->update(lightData, row, camera, tile, {});
+        shadows[row] = uint8_t(shadowMapCount++);
+    }
+    mShadowMapCount = shadowMapCount;
+}
+
+void ShadowAtlas::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
+    if (mAtlasHandle) {
+        // the atlas never changes
+        return;
+    }
+
+    mAtlasHandle = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1,
+            ATLAS_SIZE, ATLAS_SIZE, 1, TextureUsage::DEPTH_ATTACHMENT);
+
+    mAtlasRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::SHADOW, ATLAS_SIZE, ATLAS_SIZE, 1, Driver::TextureFormat::DEPTH16,
+            {}, { mAtlasHandle }, {});
+
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    s.compareFunc = SamplerCompareFunc::LE;
+    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+    s.depthStencil = true;
+    sb.setSampler(FEngine::PerViewSib::SPOT_SHADOW_ATLAS, { mAtlasHandle, s });
+}
+
+void ShadowAtlas::beginRenderPass(DriverApi& driver, size_t i, bool first) const noexcept {
+    ShadowMap const& shadowMap = *mShadowMaps[i];
+    const uint32_t dim = shadowMap.getDimension();
+    Viewport const& viewport = shadowMap.getViewport();
+
+    // each pass clears its tile only, the other tiles may have been rendered already
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::SHADOW;
+    params.discardStart = first ? TargetBufferFlags::DEPTH : TargetBufferFlags::NONE;
+    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.clearDepth = 1.0;
+    params.left = viewport.left - 1;
+    params.bottom = viewport.bottom - 1;
+    params.width = params.height = dim;
+    driver.beginRenderPass(mAtlasRenderTarget, params);
+
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+} // namespace details
+} // namespace filament
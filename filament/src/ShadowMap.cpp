@@ -24,8 +24,15 @@
 
 #include <filament/driver/DriverEnums.h>
 
+#include <math/transforms.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
 #include <limits>
 
+#include <string.h>
+
 using namespace math;
 using namespace utils;
 
@@ -40,6 +47,9 @@ static constexpr bool USE_DEPTH_CLAMP = false;
 // currently disabled because it creates shadow acnee problems at a distance
 static constexpr bool ENABLE_LISPSM = true;
 
+// how cascades are split, 0 for uniform splits, 1 for logarithmic splits
+static constexpr float CASCADE_SPLIT_LAMBDA = 0.5f;
+
 ShadowMap::ShadowMap(FEngine& engine) noexcept :
         mEngine(engine),
         mClipSpaceFlipped(engine.getBackend() == Backend::VULKAN) {
@@ -60,88 +70,31 @@ ShadowMap::~ShadowMap() {
     mEngine.destroy(mDebugCamera->getEntity());
 }
 
-void ShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
-    assert(mShadowMapDimension);
-
-    uint32_t dim = mShadowMapDimension;
-    uint32_t currentDimension = mViewport.width + 2;
-    if (currentDimension == dim) {
-        // nothing to do here.
-        assert(mShadowMapHandle);
-        return;
-    }
-
-    // destroy the current rendertarget and texture
-    if (mShadowMapRenderTarget) {
-        driver.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driver.destroyTexture(mShadowMapHandle);
-    }
-
-    // allocate new ones...
-    // we set a viewport with a 1-texel border for when we index outside of the texture
-    // DON'T CHANGE this unless computeLightSpaceMatrix() is updated too.
-    // see: computeLightSpaceMatrix()
-    mViewport = { 1, 1, dim - 2, dim - 2 };
-
-    mShadowMapHandle = driver.createTexture(
-            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1, dim, dim, 1,
-            TextureUsage::DEPTH_ATTACHMENT);
-
-    mShadowMapRenderTarget = driver.createRenderTarget(
-            TargetBufferFlags::SHADOW, dim, dim, 1, Driver::TextureFormat::DEPTH16,
-            {}, { mShadowMapHandle }, {});
-
-    SamplerParams s;
-    s.filterMag = SamplerMagFilter::LINEAR;
-    s.filterMin = SamplerMinFilter::LINEAR;
-    s.compareFunc = SamplerCompareFunc::LE;
-    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
-    s.depthStencil = true;
-    sb.setSampler(FEngine::PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
-}
-
-void ShadowMap::terminate(DriverApi& driverApi) noexcept {
-    if (mShadowMapRenderTarget) {
-        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
-    }
-    if (mShadowMapHandle) {
-        driverApi.destroyTexture(mShadowMapHandle);
-    }
-}
-
-void ShadowMap::beginRenderPass(DriverApi& driver) const noexcept {
-    RenderPassParams params = {};
-    params.clear = TargetBufferFlags::SHADOW;
-    params.discardStart = TargetBufferFlags::DEPTH;
-    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
-    params.clearDepth = 1.0;
-    params.width = params.height = mShadowMapDimension;
-    // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is reloaded
-    // needlessly.
-    params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
-    driver.beginRenderPass(mShadowMapRenderTarget, params);
-
-    driver.viewport(mViewport.left, mViewport.bottom,
-            mViewport.width, mViewport.height);
-}
-
 void ShadowMap::update(
-        const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+        const FScene::LightSoa& lightData, size_t index,
+        details::CameraInfo const& camera, Cascade const& cascade,
+        SceneBounds const& bounds) noexcept {
     // this is the hard part here, find a good frustum for our camera
 
     auto& lcm = mEngine.getLightManager();
 
     FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
-    mShadowMapDimension = std::max(1u, lcm.getShadowMapSize(li));
+    const uint32_t dim = cascade.dimension ? cascade.dimension :
+            std::max(1u, lcm.getShadowMapSize(li));
+    mShadowMapDimension = dim;
+    mCascade = cascade;
+
+    // we set a viewport with a 1-texel border for when we index outside of the tile
+    // DON'T CHANGE this unless getTextureCoordsMapping() is updated too.
+    mViewport = { int32_t(cascade.column * dim + 1), int32_t(cascade.row * dim + 1),
+                  dim - 2, dim - 2 };
 
     FLightManager::ShadowParams params = lcm.getShadowParams(li);
+    const bool isCascade = cascade.zf > 0.0f;
     mat4f projection(camera.cullingProjection);
-    if (params.shadowFar > 0.0f) {
-        float n = camera.zn;
-        float f = params.shadowFar;
+    if (isCascade || params.shadowFar > 0.0f) {
+        float n = isCascade ? cascade.zn : camera.zn;
+        float f = isCascade ? cascade.zf : params.shadowFar;
         if (std::abs(projection[2].w) <= std::numeric_limits<float>::epsilon()) {
             // perspective projection
             projection[2].z =     (f + n) / (n - f);
@@ -157,22 +110,24 @@ void ShadowMap::update(
             .projection = projection,
             .model = camera.model,
             .view = camera.view,
-            .zn = camera.zn,
-            .zf = camera.zf,
+            .zn = isCascade ? cascade.zn : camera.zn,
+            .zf = isCascade ? cascade.zf : camera.zf,
             .dzn = std::max(0.0f, params.shadowNearHint - camera.zn),
             .dzf = std::max(0.0f, camera.zf - params.shadowFarHint),
             .frustum = Frustum(projection * camera.view),
             .worldOrigin = camera.worldOrigin
     };
 
-    // debugging...
-    const float dz = cameraInfo.zf - cameraInfo.zn;
-    float& dzn = mEngine.debug.shadowmap.dzn;
-    float& dzf = mEngine.debug.shadowmap.dzf;
-    if (dzn < 0)    dzn = cameraInfo.dzn / dz;
-    else            cameraInfo.dzn = dzn * dz;
-    if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
-    else            cameraInfo.dzf =-dzf * dz;
+    if (!isCascade) {
+        // debugging...
+        const float dz = cameraInfo.zf - cameraInfo.zn;
+        float& dzn = mEngine.debug.shadowmap.dzn;
+        float& dzf = mEngine.debug.shadowmap.dzf;
+        if (dzn < 0)    dzn = cameraInfo.dzn / dz;
+        else            cameraInfo.dzn = dzn * dz;
+        if (dzf > 0)    dzf =-cameraInfo.dzf / dz;
+        else            cameraInfo.dzf =-dzf * dz;
+    }
 
 
     using Type = FLightManager::Type;
@@ -180,11 +135,15 @@ void ShadowMap::update(
         case Type::SUN:
         case Type::DIRECTIONAL:
             computeShadowCameraDirectional(
-                    lightData.elementAt<FScene::DIRECTION>(index), scene, cameraInfo,
-                    visibleLayers);
+                    lightData.elementAt<FScene::DIRECTION>(index), bounds, cameraInfo);
             break;
         case Type::FOCUSED_SPOT:
         case Type::SPOT:
+            computeShadowCameraSpot(
+                    lightData.elementAt<FScene::POSITION_RADIUS>(index).xyz,
+                    lightData.elementAt<FScene::DIRECTION>(index),
+                    lightData.elementAt<FScene::POSITION_RADIUS>(index).w,
+                    lcm.getCosOuterSquared(li), cameraInfo);
             break;
         case Type::POINT:
             break;
@@ -192,12 +151,11 @@ void ShadowMap::update(
 }
 
 void ShadowMap::computeShadowCameraDirectional(
-        math::float3 const& dir, FScene const* scene, CameraInfo const& camera,
-        uint8_t visibleLayers) noexcept {
+        math::float3 const& dir, SceneBounds const& bounds, CameraInfo const& camera) noexcept {
 
     // scene bounds in world space
-    Aabb wsShadowCastersVolume, wsShadowReceiversVolume;
-    scene->computeBounds(wsShadowCastersVolume, wsShadowReceiversVolume, visibleLayers);
+    Aabb const& wsShadowCastersVolume = bounds.casters;
+    Aabb const& wsShadowReceiversVolume = bounds.receivers;
     if (wsShadowCastersVolume.isEmpty() || wsShadowReceiversVolume.isEmpty()) {
         mHasVisibleShadows = false;
         return;
@@ -214,7 +172,10 @@ void ShadowMap::computeShadowCameraDirectional(
 
     mHasVisibleShadows = vertexCount >= 2;
     if (mHasVisibleShadows) {
-        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm;
+        // cascades already concentrate the resolution near the camera, LiSPSM isn't used
+        // with them
+        const bool USE_LISPSM = ENABLE_LISPSM && mEngine.debug.shadowmap.lispsm &&
+                mCascade.zf <= 0.0f;
 
         /*
          * Compute the light's model matrix
@@ -331,9 +292,10 @@ void ShadowMap::computeShadowCameraDirectional(
 
         // For directional lights, we further constraint the light frustum to the
         // intersection of the shadow casters & receivers in light-space.
-        // However, since this relies on the 1-texel shadow map border, this wouldn't directly
-        // work if we were storing several shadow maps in a single texture.
-        if (mEngine.debug.shadowmap.focus_shadowcasters) {
+        // However, since this relies on the 1-texel shadow map border, this doesn't work when
+        // several shadow maps are stored in a single texture (i.e. with cascades).
+        if (mEngine.debug.shadowmap.focus_shadowcasters &&
+                mCascade.columns * mCascade.rows == 1) {
             intersectWithShadowCasters(lsLightFrustum, WLMpMv, wsShadowCastersVolume);
         }
 
@@ -378,7 +340,7 @@ void ShadowMap::computeShadowCameraDirectional(
         const mat4f St = mat4f(MbMt * S);
 
         mTexelSizeWs = texelSizeWorldSpace(St, float3{ 0.5f });
-        mLightSpace = St;
+        mLightSpace = getTileMapping() * St;
         mSceneRange = (zfar - znear);
         mCamera->setCustomProjection(mat4(S), znear, zfar);
 
@@ -387,6 +349,34 @@ void ShadowMap::computeShadowCameraDirectional(
     }
 }
 
+void ShadowMap::computeShadowCameraSpot(float3 const& position, float3 const& direction,
+        float radius, float cosOuterSquared, CameraInfo const& camera) noexcept {
+    // The light's frustum is the smallest one that contains its cone, up to its radius of
+    // influence. A single shadow map can't cover much more than a hemisphere.
+    constexpr float MAX_HALF_ANGLE = float(85.0 * M_PI / 180.0);
+    const float halfAngle = std::min(std::acos(std::sqrt(cosOuterSquared)), MAX_HALF_ANGLE);
+
+    // DEPTH16 keeps enough precision with a near plane at 1% of the range
+    const float zfar = std::max(radius, 1e-3f);
+    const float znear = zfar * 0.01f;
+
+    const mat4f Mv = FCamera::getViewMatrix(
+            mat4f::lookAt(position, position + direction, float3{ 0, 1, 0 }));
+    const mat4f Mp = mat4f::perspective(
+            2.0f * halfAngle * float(180.0 / M_PI), 1.0f, znear, zfar);
+    const mat4f S = Mp * Mv;
+
+    mHasVisibleShadows = true;
+    mLightSpace = getTileMapping() * getTextureCoordsMapping() * S;
+    mSceneRange = zfar - znear;
+    // size of a texel at the far plane, the largest it gets
+    mTexelSizeWs = 2.0f * zfar * std::tan(halfAngle) / mShadowMapDimension;
+    mCamera->setCustomProjection(mat4(S), znear, zfar);
+
+    // for the debug camera, we need to undo the world origin
+    mDebugCamera->setCustomProjection(mat4(S * camera.worldOrigin), znear, zfar);
+}
+
 mat4f ShadowMap::applyLISPSM(CameraInfo const& camera, float dzn, float dzf, mat4f const& LMpMv,
         Aabb const& wsShadowReceiversVolume, const float3 wsViewFrustumCorners[8],
         float3 const& dir) {
@@ -490,6 +480,18 @@ mat4f ShadowMap::getTextureCoordsMapping() const noexcept {
     return Mb * Mt;
 }
 
+mat4f ShadowMap::getTileMapping() const noexcept {
+    // maps the texture coordinates of the shadow map to those of its tile in the texture
+    const float sx = 1.0f / mCascade.columns;
+    const float sy = 1.0f / mCascade.rows;
+    return mat4f(mat4f::row_major_init{
+            sx,  0, 0, mCascade.column * sx,
+             0, sy, 0, mCascade.row * sy,
+             0,  0, 1, 0,
+             0,  0, 0, 1
+    });
+}
+
 // This construct a frustum (similar to glFrustum or math::frustum), except
 // it looks towards the +y axis, and assumes -1,1 for the left/right and bottom/top planes.
 mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
@@ -507,26 +509,16 @@ mat4f ShadowMap::warpFrustum(float n, float f) noexcept {
 
 float2 ShadowMap::computeNearFar(const mat4f& lightView,
         Aabb const& wsShadowCastersVolume) noexcept {
-    float2 nearFar = { std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max() };
-    const float3 bmin = wsShadowCastersVolume.min;
-    const float3 bmax = wsShadowCastersVolume.max;
-    const float3 wsSceneCastersCorners[8] = {
-            { bmin.x, bmin.y, bmin.z },
-            { bmax.x, bmin.y, bmin.z },
-            { bmin.x, bmax.y, bmin.z },
-            { bmax.x, bmax.y, bmin.z },
-            { bmin.x, bmin.y, bmax.z },
-            { bmax.x, bmin.y, bmax.z },
-            { bmin.x, bmax.y, bmax.z },
-            { bmax.x, bmax.y, bmax.z },
-    };
-    #pragma nounroll
-    for (float3 corner : wsSceneCastersCorners) {
-        float3 c = mat4f::project(lightView, corner);
-        nearFar.x = std::max(nearFar.x, c.z);  // near
-        nearFar.y = std::min(nearFar.y, c.z);  // far
-    }
-    return nearFar;
+    // The light-space z of the box's corners is an affine function of their position, so
+    // instead of transforming the 8 corners, we project the box's extent on the z row:
+    // the corners closest and farthest from the light are at the center +/- that extent.
+    assert(lightView[0].w == 0 && lightView[1].w == 0 && lightView[2].w == 0);
+    const float3 center = (wsShadowCastersVolume.max + wsShadowCastersVolume.min) * 0.5f;
+    const float3 extent = (wsShadowCastersVolume.max - wsShadowCastersVolume.min) * 0.5f;
+    const float3 zRow = { lightView[0].z, lightView[1].z, lightView[2].z };
+    const float z = dot(zRow, center) + lightView[3].z;
+    const float r = dot(abs(zRow), extent);
+    return { z + r, z - r };    // near, far
 }
 
 void ShadowMap::intersectWithShadowCasters(
@@ -589,9 +581,7 @@ void ShadowMap::computeFrustumCorners(
             { -1,  1, -1 },
             {  1,  1, -1 },
     };
-    for (float3 c : csViewFrustumCorners) {
-        *out++ = mat4f::project(projectionViewInverse, c);
-    }
+    projectPoints(projectionViewInverse, csViewFrustumCorners, out, 8);
 }
 
 float2 ShadowMap::computeWpNearFarOfWarpSpace(
@@ -642,16 +632,21 @@ size_t ShadowMap::intersectFrustumWithBox(
             { bmax.x, bmax.y, bmax.z },
     };
 
+    // The inside tests of a) and b) are done for the 8 points at once, and the points that
+    // pass are appended after, so that the tests are free of branches and can be vectorized.
+    bool inside[8];
+
     // a) Keep the frustum's vertices that are known to be inside the scene's box
+    for (size_t i = 0; i < 8; i++) {
+        const float3 p = wsFrustumCorners[i];
+        inside[i] = (p.x >= bmin.x) & (p.x <= bmax.x) &
+                    (p.y >= bmin.y) & (p.y <= bmax.y) &
+                    (p.z >= bmin.z) & (p.z <= bmax.z);
+    }
     #pragma nounroll
     for (size_t i = 0; i < 8; i++) {
-        float3 p = wsFrustumCorners[i];
-        outVertices[vertexCount] = p;
-        if ((p.x >= wsBox.min.x && p.x <= wsBox.max.x) &&
-            (p.y >= wsBox.min.y && p.y <= wsBox.max.y) &&
-            (p.z >= wsBox.min.z && p.z <= wsBox.max.z)) {
-            vertexCount++;
-        }
+        outVertices[vertexCount] = wsFrustumCorners[i];
+        vertexCount += inside[i];
     }
 
     // at this point if we have 8 vertices, we can skip the rest
@@ -664,21 +659,20 @@ size_t ShadowMap::intersectFrustumWithBox(
         // the frustum. This actually happens often due to fitting light-space
         // We fudge the distance to the plane by a small amount.
         constexpr const float EPSILON = 1.0f / 8192.0f; // ~0.012 mm
-        #pragma nounroll
-        for (float3 p : wsSceneReceiversCorners) {
-            outVertices[vertexCount] = p;
-            float l = dot(wsFrustumPlanes[0].xyz, p) + wsFrustumPlanes[0].w;
-            float b = dot(wsFrustumPlanes[1].xyz, p) + wsFrustumPlanes[1].w;
-            float r = dot(wsFrustumPlanes[2].xyz, p) + wsFrustumPlanes[2].w;
-            float t = dot(wsFrustumPlanes[3].xyz, p) + wsFrustumPlanes[3].w;
-            float f = dot(wsFrustumPlanes[4].xyz, p) + wsFrustumPlanes[4].w;
-            float n = dot(wsFrustumPlanes[5].xyz, p) + wsFrustumPlanes[5].w;
-            if ((l <= EPSILON) && (b <= EPSILON) &&
-                (r <= EPSILON) && (t <= EPSILON) &&
-                (f <= EPSILON) && (n <= EPSILON)) {
-                ++vertexCount;
+        for (size_t i = 0; i < 8; i++) {
+            inside[i] = true;
+        }
+        for (size_t j = 0; j < 6; j++) {
+            const float4 plane = wsFrustumPlanes[j];
+            for (size_t i = 0; i < 8; i++) {
+                inside[i] &= dot(plane.xyz, wsSceneReceiversCorners[i]) + plane.w <= EPSILON;
             }
         }
+        #pragma nounroll
+        for (size_t i = 0; i < 8; i++) {
+            outVertices[vertexCount] = wsSceneReceiversCorners[i];
+            vertexCount += inside[i];
+        }
 
         // at this point if we have 8 vertices, we can skip the segments intersection tests
         if (vertexCount < 8) {
@@ -821,5 +815,251 @@ float ShadowMap::texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix, float3
     return s;
 }
 
+// ------------------------------------------------------------------------------------------------
+
+CascadedShadowMap::CascadedShadowMap(FEngine& engine) noexcept : mEngine(engine) {
+    for (auto& cascade : mCascades) {
+        cascade.reset(new ShadowMap(engine));
+    }
+    std::fill(std::begin(mCascadeFar), std::end(mCascadeFar), std::numeric_limits<float>::max());
+}
+
+CascadedShadowMap::~CascadedShadowMap() = default;
+
+void CascadedShadowMap::terminate(DriverApi& driverApi) noexcept {
+    if (mShadowMapRenderTarget) {
+        driverApi.destroyRenderTarget(mShadowMapRenderTarget);
+        mShadowMapRenderTarget.clear();
+    }
+    if (mShadowMapHandle) {
+        driverApi.destroyTexture(mShadowMapHandle);
+        mShadowMapHandle.clear();
+    }
+    if (mStaticShadowMapRenderTarget) {
+        driverApi.destroyRenderTarget(mStaticShadowMapRenderTarget);
+        mStaticShadowMapRenderTarget.clear();
+    }
+    if (mStaticShadowMapHandle) {
+        driverApi.destroyTexture(mStaticShadowMapHandle);
+        mStaticShadowMapHandle.clear();
+    }
+    mTextureWidth = 0;
+    mTextureHeight = 0;
+    invalidateStaticCaches();
+}
+
+void CascadedShadowMap::setCascadeCount(size_t count) noexcept {
+    mCascadeCount = std::min(std::max(count, size_t(1)), CONFIG_MAX_SHADOW_CASCADES);
+}
+
+void CascadedShadowMap::setStaticCachingEnabled(bool enabled) noexcept {
+    if (mStaticCaching != enabled) {
+        mStaticCaching = enabled;
+        // the caches aren't maintained while disabled, and the cache's texture is (de)allocated
+        // by the next prepare()
+        for (StaticCache& cache : mStaticCaches) {
+            cache = {};
+        }
+    }
+}
+
+void CascadedShadowMap::invalidateStaticCaches() noexcept {
+    // the cache's content is lost, the cascades rendered this frame must be rendered again
+    for (StaticCache& cache : mStaticCaches) {
+        cache.dirty = cache.valid;
+    }
+}
+
+void CascadedShadowMap::update(
+        const FScene::LightSoa& lightData, size_t index, FScene const* scene,
+        details::CameraInfo const& camera, uint8_t visibleLayers) noexcept {
+    const size_t count = mCascadeCount;
+    std::fill(std::begin(mCascadeFar), std::end(mCascadeFar), std::numeric_limits<float>::max());
+
+    // the scene bounds are the same for all cascades
+    ShadowMap::SceneBounds bounds;
+    scene->computeBounds(mEngine.getJobSystem(), bounds.casters, bounds.receivers, visibleLayers);
+
+    auto& lcm = mEngine.getLightManager();
+    FLightManager::Instance li = lightData.elementAt<FScene::LIGHT_INSTANCE>(index);
+    const uint16_t dimension = uint16_t(std::max(1.0f,
+            std::max(1u, lcm.getShadowMapSize(li)) * mResolutionScale));
+
+    if (count == 1) {
+        // a single shadow map covers the whole view frustum
+        ShadowMap& shadowMap = *mCascades[0];
+        ShadowMap::Cascade cascade;
+        cascade.dimension = dimension;
+        shadowMap.update(lightData, index, camera, cascade, bounds);
+        mHasVisibleShadows = shadowMap.hasVisibleShadows();
+        updateStaticCaches(scene, visibleLayers);
+        return;
+    }
+
+    // the cascades cover the view frustum up to the light's shadowFar
+    const float shadowFar = lcm.getShadowParams(li).shadowFar;
+    const float n = camera.zn;
+    const float f = shadowFar > 0.0f ? std::min(shadowFar, camera.zf) : camera.zf;
+
+    // "practical" split scheme, a blend of logarithmic and uniform splits. Logarithmic splits
+    // need a positive near plane, which ortho cameras may not have.
+    const float lambda = n > 0.0f ? CASCADE_SPLIT_LAMBDA : 0.0f;
+
+    mHasVisibleShadows = false;
+    float zn = n;
+    for (size_t i = 0; i < count; i++) {
+        const float t = float(i + 1) / count;
+        const float logSplit = n > 0.0f ? n * std::pow(f / n, t) : 0.0f;
+        const float uniformSplit = n + (f - n) * t;
+        const float zf = (i + 1 == count) ? f :
+                lambda * logSplit + (1.0f - lambda) * uniformSplit;
+
+        const ShadowMap::Cascade cascade = {
+                .zn = zn,
+                .zf = zf,
+                .column = uint8_t(i % 2),
+                .row = uint8_t(i / 2),
+                .columns = 2,
+                .rows = uint8_t(count > 2 ? 2 : 1),
+                .dimension = dimension
+        };
+        ShadowMap& shadowMap = *mCascades[i];
+        shadowMap.update(lightData, index, camera, cascade, bounds);
+        mHasVisibleShadows |= shadowMap.hasVisibleShadows();
+
+        // fragments past the last split use the last cascade
+        if (i + 1 < count) {
+            mCascadeFar[i] = zf;
+        }
+        zn = zf;
+    }
+    updateStaticCaches(scene, visibleLayers);
+}
+
+void CascadedShadowMap::updateStaticCaches(FScene const* scene, uint8_t visibleLayers) noexcept {
+    if (!mStaticCaching) {
+        return;
+    }
+    // The cached static casters stay valid as long as they're rendered the same way, i.e. with
+    // the same light camera and tile, which means the view's camera and the light didn't move.
+    for (size_t i = 0; i < CONFIG_MAX_SHADOW_CASCADES; i++) {
+        StaticCache& cache = mStaticCaches[i];
+        ShadowMap const& shadowMap = *mCascades[i];
+        if (i >= mCascadeCount || !shadowMap.hasVisibleShadows()) {
+            // this cascade isn't rendered this frame, its tile can't be kept up to date
+            cache.valid = false;
+            cache.dirty = false;
+            continue;
+        }
+        const uint32_t version = scene->getStaticShadowCastersVersion();
+        cache.dirty = !cache.valid ||
+                cache.scene != scene ||
+                cache.staticCastersVersion != version ||
+                cache.visibleLayers != visibleLayers ||
+                memcmp(&cache.lightSpace, &shadowMap.getLightSpaceMatrix(), sizeof(mat4f)) != 0;
+        cache.lightSpace = shadowMap.getLightSpaceMatrix();
+        cache.scene = scene;
+        cache.staticCastersVersion = version;
+        cache.visibleLayers = visibleLayers;
+        cache.valid = true;
+    }
+}
+
+void CascadedShadowMap::prepare(DriverApi& driver, SamplerBuffer& sb) noexcept {
+    const uint32_t dim = mCascades[0]->getDimension();
+    assert(dim);
+
+    const uint32_t width = mCascadeCount > 1 ? dim * 2 : dim;
+    const uint32_t height = mCascadeCount > 2 ? dim * 2 : dim;
+    if (width == mTextureWidth && height == mTextureHeight &&
+            mStaticCaching == bool(mStaticShadowMapHandle)) {
+        // nothing to do here.
+        assert(mShadowMapHandle);
+        return;
+    }
+
+    // destroy the current rendertargets and textures, this invalidates the cache
+    terminate(driver);
+
+    // allocate new ones...
+    mTextureWidth = width;
+    mTextureHeight = height;
+
+    mShadowMapHandle = driver.createTexture(
+            Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1,
+            width, height, 1, TextureUsage::DEPTH_ATTACHMENT);
+
+    mShadowMapRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::SHADOW, width, height, 1, Driver::TextureFormat::DEPTH16,
+            {}, { mShadowMapHandle }, {});
+
+    if (mStaticCaching) {
+        // the cache is never sampled, it's only blitted into the shadow map
+        mStaticShadowMapHandle = driver.createTexture(
+                Driver::SamplerType::SAMPLER_2D, 1, Driver::TextureFormat::DEPTH16, 1,
+                width, height, 1, TextureUsage::DEPTH_ATTACHMENT);
+
+        mStaticShadowMapRenderTarget = driver.createRenderTarget(
+                TargetBufferFlags::SHADOW, width, height, 1, Driver::TextureFormat::DEPTH16,
+                {}, { mStaticShadowMapHandle }, {});
+    }
+
+    SamplerParams s;
+    s.filterMag = SamplerMagFilter::LINEAR;
+    s.filterMin = SamplerMinFilter::LINEAR;
+    s.compareFunc = SamplerCompareFunc::LE;
+    s.compareMode = SamplerCompareMode::COMPARE_TO_TEXTURE;
+    s.depthStencil = true;
+    sb.setSampler(FEngine::PerViewSib::SHADOW_MAP, { mShadowMapHandle, s });
+}
+
+RenderPassParams CascadedShadowMap::getTileRenderPassParams(size_t cascade) const noexcept {
+    ShadowMap const& shadowMap = *mCascades[cascade];
+    const uint32_t dim = shadowMap.getDimension();
+    Viewport const& viewport = shadowMap.getViewport();
+
+    // each pass clears its tile only, the other tiles may have been rendered already
+    RenderPassParams params = {};
+    params.clear = TargetBufferFlags::SHADOW;
+    params.discardEnd = TargetBufferFlags::COLOR_AND_STENCIL;
+    params.clearDepth = 1.0;
+    params.left = viewport.left - 1;
+    params.bottom = viewport.bottom - 1;
+    params.width = params.height = dim;
+    if (dim == mTextureWidth && dim == mTextureHeight) {
+        // Disable scissor and viewport to avoid bugs in some drivers where the GPU memory is
+        // reloaded needlessly. This can only be done when the tile is the whole texture.
+        params.clear |= RenderPassParams::IGNORE_SCISSOR | RenderPassParams::IGNORE_VIEWPORT;
+    }
+    return params;
+}
+
+void CascadedShadowMap::beginRenderPass(DriverApi& driver, size_t cascade,
+        bool first) const noexcept {
+    Viewport const& viewport = mCascades[cascade]->getViewport();
+    RenderPassParams params = getTileRenderPassParams(cascade);
+    if (mStaticCaching) {
+        // start from the cached static casters, the tile must be kept as is
+        driver.blit(TargetBufferFlags::DEPTH,
+                mShadowMapRenderTarget, params.left, params.bottom, params.width, params.height,
+                mStaticShadowMapRenderTarget, params.left, params.bottom, params.width, params.height);
+        params.clear &= ~TargetBufferFlags::DEPTH;
+    } else {
+        params.discardStart = first ? TargetBufferFlags::DEPTH : TargetBufferFlags::NONE;
+    }
+    driver.beginRenderPass(mShadowMapRenderTarget, params);
+
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
+void CascadedShadowMap::beginStaticRenderPass(DriverApi& driver, size_t cascade) const noexcept {
+    assert(mStaticShadowMapRenderTarget);
+    Viewport const& viewport = mCascades[cascade]->getViewport();
+    // the other tiles of the cache must be kept, so nothing is discarded
+    driver.beginRenderPass(mStaticShadowMapRenderTarget, getTileRenderPassParams(cascade));
+
+    driver.viewport(viewport.left, viewport.bottom, viewport.width, viewport.height);
+}
+
 } // namespace details
 } // namespace filament
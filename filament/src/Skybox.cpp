@@ -52,6 +52,7 @@ static const uint8_t SKYBOXRGBM_MATERIAL_PACKAGE[] = {
 struct Skybox::BuilderDetails {
     Texture* mEnvironmentMap = nullptr;
     bool mShowSun = false;
+    bool mLowResolution = false;
 };
 
 using BuilderType = Skybox;
@@ -73,6 +74,11 @@ Skybox::Builder& Skybox::Builder::showSun(bool show) noexcept {
     return *this;
 }
 
+Skybox::Builder& Skybox::Builder::lowResolution(bool enable) noexcept {
+    mImpl->mLowResolution = enable;
+    return *this;
+}
+
 Skybox* Skybox::Builder::build(Engine& engine) {
     FTexture* cubemap = upcast(mImpl->mEnvironmentMap);
 
@@ -113,20 +119,25 @@ FSkybox::FSkybox(FEngine& engine, const Builder& builder) noexcept
             .receiveShadows(false)
             .priority(0x7)
             .culling(false)
+            .lowResolutionBlending(builder->mLowResolution)
             .build(engine, mSkybox);
+
+    // the skybox is sorted after all the opaque commands, see RenderPass::generateCommandsImpl()
+    auto& rcm = mRenderableManager;
+    rcm.setSkybox(rcm.getInstance(mSkybox), true);
 }
 
 FMaterial const* FSkybox::createMaterial(FEngine& engine, driver::TextureFormat format) {
    if (format == driver::TextureFormat::RGBM) {
        FMaterial const* material = upcast(Material::Builder().package(
                (void*)SKYBOXRGBM_MATERIAL_PACKAGE,
-               sizeof(SKYBOXRGBM_MATERIAL_PACKAGE)).build(engine));
+               sizeof(SKYBOXRGBM_MATERIAL_PACKAGE), [](void*, size_t, void*) {}).build(engine));
        return material;
    }
 
     FMaterial const* material = upcast(Material::Builder().package(
             (void*)SKYBOX_MATERIAL_PACKAGE,
-            sizeof(SKYBOX_MATERIAL_PACKAGE)).build(engine));
+            sizeof(SKYBOX_MATERIAL_PACKAGE), [](void*, size_t, void*) {}).build(engine));
     return material;
 }
 
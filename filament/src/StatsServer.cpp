@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifdef FILAMENT_STATS_SERVER
+
+#include "StatsServer.h"
+
+#include <utils/Log.h>
+
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifdef MSG_NOSIGNAL
+#   define SEND_FLAGS MSG_NOSIGNAL
+#else
+#   define SEND_FLAGS 0 // SO_NOSIGPIPE is set on the clients instead
+#endif
+
+namespace filament {
+
+using namespace utils;
+
+static bool setNonBlocking(int fd) noexcept {
+    const int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+StatsServer::StatsServer(uint16_t port) noexcept {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) {
+        slog.e << "StatsServer: can't create a socket (" << errno << ")" << io::endl;
+        return;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 ||
+            listen(fd, 4) != 0 || !setNonBlocking(fd)) {
+        slog.e << "StatsServer: can't listen on port " << port << " (" << errno << ")"
+                << io::endl;
+        close(fd);
+        return;
+    }
+    mSocket = fd;
+    slog.i << "StatsServer: streaming the counters on port " << port << io::endl;
+}
+
+StatsServer::~StatsServer() noexcept {
+    for (int client : mClients) {
+        close(client);
+    }
+    if (mSocket >= 0) {
+        close(mSocket);
+    }
+}
+
+void StatsServer::acceptClients() noexcept {
+    int client;
+    while ((client = accept(mSocket, nullptr, nullptr)) >= 0) {
+        if (!setNonBlocking(client)) {
+            close(client);
+            continue;
+        }
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+        mClients.push_back(client);
+    }
+}
+
+void StatsServer::append(const char* format, ...) noexcept {
+    char buffer[64];
+    va_list args;
+    va_start(args, format);
+    const int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (n > 0) {
+        mLine.insert(mLine.end(), buffer, buffer + std::min(size_t(n), sizeof(buffer) - 1));
+    }
+}
+
+void StatsServer::format(uint32_t frameId, DebugRegistry const& registry) noexcept {
+    // the counters don't change after the engine is initialized, but they're cheap to query
+    const size_t count = registry.getCounters(nullptr, 0);
+    mValues.resize(count);
+    registry.getCounters(mValues.data(), count);
+
+    static constexpr size_t COMPONENT_COUNT[] = {
+            1, 1, 1, 2, 3, 4    // BOOL, INT, FLOAT, FLOAT2, FLOAT3, FLOAT4
+    };
+
+    mLine.clear();
+    append("{\"frame\":%u", frameId);
+    for (DebugRegistry::CounterValue const& counter : mValues) {
+        mLine.push_back(',');
+        mLine.push_back('"');
+        mLine.insert(mLine.end(), counter.name, counter.name + strlen(counter.name));
+        mLine.push_back('"');
+        mLine.push_back(':');
+        const size_t n = COMPONENT_COUNT[counter.type];
+        if (n > 1) {
+            mLine.push_back('[');
+        }
+        for (size_t i = 0; i < n; i++) {
+            append(i ? ",%g" : "%g", counter.value[i]);
+        }
+        if (n > 1) {
+            mLine.push_back(']');
+        }
+    }
+    mLine.push_back('}');
+    mLine.push_back('\n');
+}
+
+void StatsServer::publish(uint32_t frameId, DebugRegistry const& registry) noexcept {
+    if (mSocket < 0) {
+        return;
+    }
+    acceptClients();
+    if (mClients.empty()) {
+        return;
+    }
+
+    format(frameId, registry);
+
+    auto const failed = [this](int client) {
+        const ssize_t n = send(client, mLine.data(), mLine.size(), SEND_FLAGS);
+        if (n == ssize_t(mLine.size())) {
+            return false;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // the client is behind, it misses this frame
+            return false;
+        }
+        // the client went away, or a partial line would break the stream
+        close(client);
+        return true;
+    };
+    mClients.erase(std::remove_if(mClients.begin(), mClients.end(), failed), mClients.end());
+}
+
+} // namespace filament
+
+#endif // FILAMENT_STATS_SERVER
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_STATSSERVER_H
+#define TNT_FILAMENT_STATSSERVER_H
+
+#include <filament/DebugRegistry.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Streams the counters of a DebugRegistry to the clients connected to a TCP port of the local
+ * host (e.g. through "adb forward" on Android), as one line of JSON per frame:
+ *
+ *  {"frame":120,"d.renderpass.draw_commands":310,"d.renderer.counters.culling":[1.8,0.01,0]}
+ *
+ * Counters with more than one component are arrays. Everything is non-blocking and happens on
+ * the thread calling publish(): clients connecting are accepted at the next frame, a frame is
+ * skipped for a client that doesn't keep up and clients are dropped on errors.
+ */
+class StatsServer {
+public:
+    explicit StatsServer(uint16_t port) noexcept;
+    ~StatsServer() noexcept;
+
+    StatsServer(StatsServer const& rhs) = delete;
+    StatsServer& operator=(StatsServer const& rhs) = delete;
+
+    bool isListening() const noexcept { return mSocket >= 0; }
+
+    void publish(uint32_t frameId, DebugRegistry const& registry) noexcept;
+
+private:
+    void acceptClients() noexcept;
+    void format(uint32_t frameId, DebugRegistry const& registry) noexcept;
+    void append(const char* format, ...) noexcept;
+
+    int mSocket = -1;
+    std::vector<int> mClients;
+    std::vector<DebugRegistry::CounterValue> mValues;
+    std::vector<char> mLine;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_STATSSERVER_H
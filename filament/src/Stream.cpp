@@ -17,7 +17,6 @@
 #include "details/Stream.h"
 
 #include "details/Engine.h"
-#include "details/Fence.h"
 
 #include "FilamentAPI-impl.h"
 
@@ -103,13 +102,16 @@ void FStream::terminate(FEngine& engine) noexcept {
 void FStream::setDimensions(uint32_t width, uint32_t height) noexcept {
     mWidth = width;
     mHeight = height;
+    mEngine.getDriverApi().setStreamDimensions(mStreamHandle, mWidth, mHeight);
+}
 
-    // unfortunately, because this call is synchronous, we must make sure the handle has been
-    // created first
-    if (UTILS_UNLIKELY(!mStreamHandle)) {
-        FFence::waitAndDestroy(mEngine.createFence(Fence::Type::SOFT), Fence::Mode::FLUSH);
+int64_t FStream::getTimestamp() const noexcept {
+    // The handle of a copy stream is constructed on the driver thread, but they have no
+    // timestamp anyway.
+    if (!isNativeStream()) {
+        return 0;
     }
-    mEngine.getDriverApi().setStreamDimensions(mStreamHandle, mWidth, mHeight);
+    return mEngine.getDriverApi().getStreamTimestamp(mStreamHandle);
 }
 
 void FStream::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
@@ -155,4 +157,8 @@ void Stream::readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint
     upcast(this)->readPixels(xoffset, yoffset, width, height, std::move(buffer));
 }
 
+int64_t Stream::getTimestamp() const noexcept {
+    return upcast(this)->getTimestamp();
+}
+
 } // namespace filament
@@ -21,8 +21,14 @@
 
 #include "FilamentAPI-impl.h"
 
+#include <image/Mipmaps.h>
+
 #include <utils/Panic.h>
 
+#include <vector>
+
+#include <stdlib.h>
+
 namespace filament {
 
 using namespace details;
@@ -36,6 +42,8 @@ struct Texture::BuilderDetails {
     Sampler mTarget = Sampler::SAMPLER_2D;
     InternalFormat mFormat = InternalFormat::RGBA8;
     Usage mUsage = Usage::DEFAULT;
+    StreamingLoader mLoader = nullptr;
+    void* mLoaderUser = nullptr;
 };
 
 using BuilderType = Texture;
@@ -82,6 +90,12 @@ Texture::Builder& Texture::Builder::usage(Texture::Usage usage) noexcept {
     return *this;
 }
 
+Texture::Builder& Texture::Builder::streaming(StreamingLoader loader, void* user) noexcept {
+    mImpl->mLoader = loader;
+    mImpl->mLoaderUser = user;
+    return *this;
+}
+
 Texture* Texture::Builder::build(Engine& engine) {
     if (!ASSERT_POSTCONDITION_NON_FATAL(Texture::isTextureFormatSupported(engine, mImpl->mFormat),
             "Texture format %u not supported on this platform", mImpl->mFormat)) {
@@ -103,10 +117,26 @@ FTexture::FTexture(FEngine& engine, const Builder& builder) {
     mDepth  = static_cast<uint32_t>(builder->mDepth);
     mLevels = std::min(builder->mLevels,
             static_cast<uint8_t>(std::ilogbf(std::max(mWidth, mHeight)) + 1));
+    mLoader = builder->mLoader;
+    mLoaderUser = builder->mLoaderUser;
+
+    // only the levels of 64 texels or less are resident initially. Reallocating the texture
+    // when its residency changes is only implemented for 2D textures on OpenGL.
+    static constexpr uint32_t COARSE_SIZE = 64;
+    if (mLoader && mTarget == Sampler::SAMPLER_2D && mUsage == Usage::DEFAULT &&
+            getFormatSize(mFormat) && engine.getBackend() == Backend::OPENGL) {
+        uint8_t level = 0;
+        while (level < mLevels - 1 && std::max(mWidth, mHeight) >> level > COARSE_SIZE) {
+            level++;
+        }
+        mCoarseLevel = level;
+        mResidentLevel = level;
+    }
 
     FEngine::DriverApi& driver = engine.getDriverApi();
-    mHandle = driver.createTexture(
-            mTarget, mLevels, mFormat, mSampleCount, mWidth, mHeight, mDepth, mUsage);
+    mHandle = driver.createTexture(mTarget, uint8_t(mLevels - mResidentLevel), mFormat,
+            mSampleCount, uint32_t(getWidth(mResidentLevel)), uint32_t(getHeight(mResidentLevel)),
+            mDepth, mUsage);
 }
 
 // frees driver resources, object becomes invalid
@@ -119,6 +149,25 @@ static inline size_t valueForLevel(size_t level, size_t value) {
     return std::max(size_t(1), value >> level);
 }
 
+void FTexture::loadResidentLevels(FEngine& engine) noexcept {
+    if (mLoader) {
+        for (size_t level = mResidentLevel; level < mLevels; level++) {
+            mLoader(engine, this, level, mLoaderUser);
+        }
+    }
+}
+
+void FTexture::setResidentLevel(FEngine& engine, size_t level) noexcept {
+    level = std::min(level, size_t(mCoarseLevel));
+    if (isStreaming() && level != mResidentLevel) {
+        // the content of all the levels is lost, they're all reloaded
+        mResidentLevel = uint8_t(level);
+        engine.getDriverApi().reallocateTexture(mHandle, uint8_t(mLevels - level),
+                uint32_t(getWidth(level)), uint32_t(getHeight(level)), 1);
+        loadResidentLevels(engine);
+    }
+}
+
 size_t FTexture::getWidth(size_t level) const noexcept {
     return valueForLevel(level, mWidth);
 }
@@ -128,22 +177,43 @@ size_t FTexture::getHeight(size_t level) const noexcept {
 }
 
 size_t FTexture::getDepth(size_t level) const noexcept {
-    return valueForLevel(level, mDepth);
+    // the layers of an array texture are not mipmapped together
+    return isArray() ? mDepth : valueForLevel(level, mDepth);
 }
 
 void FTexture::setImage(FEngine& engine,
         size_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         Texture::PixelBufferDescriptor&& buffer) const noexcept {
+    FEngine::WorkerScope scope(engine);
+    // the levels finer than the resident level of a streaming texture are not allocated
     if (!mStream && mTarget != Sampler::SAMPLER_CUBEMAP && level < mLevels) {
+        if (buffer.buffer && level >= mResidentLevel) {
+            engine.getDriverApi().load2DImage(mHandle, uint8_t(level - mResidentLevel),
+                    xoffset, yoffset, width, height, std::move(buffer));
+        }
+    }
+}
+
+void FTexture::setImage(FEngine& engine, size_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        Texture::PixelBufferDescriptor&& buffer) const noexcept {
+    FEngine::WorkerScope scope(engine);
+    if (!mStream && mTarget == Sampler::SAMPLER_2D_ARRAY && level < mLevels) {
+        if (!ASSERT_PRECONDITION_NON_FATAL(zoffset + depth <= mDepth,
+                "layers [%u, %u) out of range (%u layers)", zoffset, zoffset + depth, mDepth)) {
+            return;
+        }
         if (buffer.buffer) {
-            engine.getDriverApi().load2DImage(mHandle,
-                    uint8_t(level), xoffset, yoffset, width, height, std::move(buffer));
+            engine.getDriverApi().load3DImage(mHandle, uint8_t(level),
+                    xoffset, yoffset, zoffset, width, height, depth, std::move(buffer));
         }
     }
 }
 
 void FTexture::setImage(FEngine& engine, size_t level,
         Texture::PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept {
+    FEngine::WorkerScope scope(engine);
     if (!mStream && mTarget == Sampler::SAMPLER_CUBEMAP && level < mLevels) {
         if (buffer.buffer) {
             engine.getDriverApi().loadCubeImage(mHandle, uint8_t(level),
@@ -173,12 +243,72 @@ void FTexture::setExternalStream(FEngine& engine, FStream* stream) noexcept {
 }
 
 void FTexture::generateMipmaps(FEngine& engine) const noexcept {
-    if ((mTarget == Sampler::SAMPLER_2D || mTarget == Sampler::SAMPLER_CUBEMAP)
-            && mLevels > 1) {
+    FEngine::WorkerScope scope(engine);
+    if ((mTarget == Sampler::SAMPLER_2D || mTarget == Sampler::SAMPLER_CUBEMAP ||
+            mTarget == Sampler::SAMPLER_2D_ARRAY) && mLevels - mResidentLevel > 1) {
         engine.getDriverApi().generateMipmaps(mHandle);
     }
 }
 
+void FTexture::setImageWithMips(FEngine& engine, PixelBufferDescriptor&& buffer,
+        MipmapFilter filter) const noexcept {
+    if (mStream || mTarget != Sampler::SAMPLER_2D || !buffer.buffer) {
+        return;
+    }
+    FEngine::WorkerScope scope(engine);
+
+    const size_t width = mWidth;
+    const size_t height = mHeight;
+    size_t channels = 0;
+    switch (buffer.format) {
+        case PixelDataFormat::R:    channels = 1; break;
+        case PixelDataFormat::RG:   channels = 2; break;
+        case PixelDataFormat::RGB:  channels = 3; break;
+        case PixelDataFormat::RGBA:
+        case PixelDataFormat::RGBM: channels = 4; break;
+        default: break;
+    }
+
+    // only tightly packed 8-bit images are filtered on the CPU
+    const bool packed = channels && buffer.type == PixelDataType::UBYTE &&
+            buffer.left == 0 && buffer.top == 0 &&
+            (buffer.stride == 0 || buffer.stride == width) &&
+            (width * channels) % buffer.alignment == 0;
+    if (!packed) {
+        setImage(engine, 0, 0, 0, uint32_t(width), uint32_t(height), std::move(buffer));
+        generateMipmaps(engine);
+        return;
+    }
+
+    image::MipmapEncoding encoding = image::MipmapEncoding::LINEAR;
+    if (buffer.format == PixelDataFormat::RGBM) {
+        encoding = image::MipmapEncoding::RGBM;
+    } else if (mFormat == InternalFormat::SRGB8 || mFormat == InternalFormat::SRGB8_A8) {
+        encoding = image::MipmapEncoding::SRGB;
+    }
+
+    // every level is a separate allocation handed over to the driver, which frees it once uploaded
+    const size_t count = std::min(size_t(mLevels), image::getMipmapCount(width, height));
+    std::vector<uint8_t*> levels(count > 1 ? count - 1 : 0);
+    for (size_t i = 1; i < count; i++) {
+        levels[i - 1] = (uint8_t*)malloc(image::getMipmapSize(width, height, channels, i));
+    }
+    image::generateMipmaps((uint8_t const*)buffer.buffer, width, height, channels,
+            levels.data(), count, encoding,
+            filter == MipmapFilter::KAISER ? image::MipmapFilter::KAISER : image::MipmapFilter::BOX,
+            // only the engine's thread can wait on its JobSystem
+            scope.isWorker() ? nullptr : &engine.getJobSystem());
+
+    const PixelDataFormat format = buffer.format;
+    setImage(engine, 0, 0, 0, uint32_t(width), uint32_t(height), std::move(buffer));
+    for (size_t i = 1; i < count; i++) {
+        const size_t size = image::getMipmapSize(width, height, channels, i);
+        setImage(engine, i, 0, 0, uint32_t(getWidth(i)), uint32_t(getHeight(i)),
+                PixelBufferDescriptor(levels[i - 1], size, format, PixelDataType::UBYTE,
+                        [](void* buffer, size_t, void*) { free(buffer); }));
+    }
+}
+
 bool FTexture::isTextureFormatSupported(FEngine& engine, InternalFormat format) noexcept {
     return engine.getDriverApi().isTextureFormatSupported(format);
 }
@@ -188,6 +318,15 @@ size_t FTexture::computeTextureDataSize(Texture::Format format, Texture::Type ty
     return PixelBufferDescriptor::computeDataSize(format, type, stride, height, alignment);
 }
 
+size_t FTexture::getSize(size_t firstLevel) const noexcept {
+    size_t size = 0;
+    for (size_t level = firstLevel; level < mLevels; level++) {
+        size += getWidth(level) * getHeight(level) * getDepth(level);
+    }
+    const size_t faceCount = isCubemap() ? 6 : 1;
+    return size * faceCount * mSampleCount * getFormatSize(mFormat);
+}
+
 size_t FTexture::getFormatSize(InternalFormat format) noexcept {
     using TextureFormat = InternalFormat;
     switch (format) {
@@ -300,6 +439,10 @@ size_t Texture::getLevels() const noexcept {
     return upcast(this)->getLevels();
 }
 
+size_t Texture::getResidentLevel() const noexcept {
+    return upcast(this)->getResidentLevel();
+}
+
 Texture::Sampler Texture::getTarget() const noexcept {
     return upcast(this)->getTarget();
 }
@@ -321,6 +464,14 @@ void Texture::setImage(Engine& engine,
             level, xoffset, yoffset, width, height, std::move(buffer));
 }
 
+void Texture::setImage(Engine& engine, size_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& buffer) const noexcept {
+    upcast(this)->setImage(upcast(engine),
+            level, xoffset, yoffset, zoffset, width, height, depth, std::move(buffer));
+}
+
 void Texture::setImage(Engine& engine, size_t level,
         Texture::PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept {
     upcast(this)->setImage(upcast(engine), level, std::move(buffer), faceOffsets);
@@ -338,6 +489,11 @@ void Texture::generateMipmaps(Engine& engine) const noexcept {
     upcast(this)->generateMipmaps(upcast(engine));
 }
 
+void Texture::setImageWithMips(Engine& engine, PixelBufferDescriptor&& buffer,
+        MipmapFilter filter) const noexcept {
+    upcast(this)->setImageWithMips(upcast(engine), std::move(buffer), filter);
+}
+
 bool Texture::isTextureFormatSupported(Engine& engine, InternalFormat format) noexcept {
     return FTexture::isTextureFormatSupported(upcast(engine), format);
 }
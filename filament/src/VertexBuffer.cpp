@@ -20,17 +20,34 @@
 
 #include "FilamentAPI-impl.h"
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 
+#include <math/norm.h>
+#include <math/quat.h>
+#include <math/vec4.h>
+
+#include <string.h>
+
 namespace filament {
 
 using namespace details;
+using namespace math;
+
+// no depth buffer was declared, the depth and shadow passes fetch all the attributes
+static constexpr uint8_t NO_DEPTH_BUFFER = 0xFF;
+
+// vertices skinned by each job of FVertexBuffer::skin()
+static constexpr size_t SKINNING_JOB_VERTEX_COUNT = 1024;
 
 struct VertexBuffer::BuilderDetails {
     VertexBuffer::Builder::AttributeData mAttributes[MAX_ATTRIBUTE_BUFFERS_COUNT];
     AttributeBitset mDeclaredAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
+    uint8_t mDepthBuffer = NO_DEPTH_BUFFER;
+    Usage mUsage = Usage::STATIC;
+    bool mCpuSkinning = false;
 };
 
 using BuilderType = VertexBuffer;
@@ -94,6 +111,21 @@ VertexBuffer::Builder& VertexBuffer::Builder::normalized(VertexAttribute attribu
     return *this;
 }
 
+VertexBuffer::Builder& VertexBuffer::Builder::usage(Usage usage) noexcept {
+    mImpl->mUsage = usage;
+    return *this;
+}
+
+VertexBuffer::Builder& VertexBuffer::Builder::depthBuffer(uint8_t bufferIndex) noexcept {
+    mImpl->mDepthBuffer = bufferIndex;
+    return *this;
+}
+
+VertexBuffer::Builder& VertexBuffer::Builder::cpuSkinning(bool enable) noexcept {
+    mImpl->mCpuSkinning = enable;
+    return *this;
+}
+
 VertexBuffer* VertexBuffer::Builder::build(Engine& engine) {
     if (!ASSERT_PRECONDITION_NON_FATAL(mImpl->mVertexCount > 0, "vertexCount cannot be 0")) {
         return nullptr;
@@ -103,6 +135,53 @@ VertexBuffer* VertexBuffer::Builder::build(Engine& engine) {
         return nullptr;
     }
 
+    if (mImpl->mDepthBuffer != NO_DEPTH_BUFFER) {
+        AttributeData const& position = mImpl->mAttributes[VertexAttribute::POSITION];
+        if (!ASSERT_PRECONDITION_NON_FATAL(
+                mImpl->mDeclaredAttributes[VertexAttribute::POSITION] &&
+                position.buffer == mImpl->mDepthBuffer,
+                "the depth buffer must hold the positions")) {
+            return nullptr;
+        }
+    }
+
+    if (mImpl->mCpuSkinning) {
+        // these are the formats FVertexBuffer::skin() reads and writes
+        AttributeBitset const& declared = mImpl->mDeclaredAttributes;
+        AttributeData const& position = mImpl->mAttributes[VertexAttribute::POSITION];
+        AttributeData const& tangents = mImpl->mAttributes[VertexAttribute::TANGENTS];
+        AttributeData const& indices = mImpl->mAttributes[VertexAttribute::BONE_INDICES];
+        AttributeData const& weights = mImpl->mAttributes[VertexAttribute::BONE_WEIGHTS];
+        if (!ASSERT_PRECONDITION_NON_FATAL(declared[VertexAttribute::POSITION] &&
+                declared[VertexAttribute::BONE_INDICES] && declared[VertexAttribute::BONE_WEIGHTS],
+                "cpuSkinning requires the positions and the bone indices and weights")) {
+            return nullptr;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL(position.type == AttributeType::FLOAT3 ||
+                position.type == AttributeType::FLOAT4 || position.type == AttributeType::HALF4,
+                "cpuSkinning requires FLOAT3, FLOAT4 or HALF4 positions")) {
+            return nullptr;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL(!declared[VertexAttribute::TANGENTS] ||
+                tangents.type == AttributeType::FLOAT4 ||
+                (tangents.type == AttributeType::SHORT4 && tangents.normalized),
+                "cpuSkinning requires FLOAT4 or normalized SHORT4 tangents")) {
+            return nullptr;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL((indices.type == AttributeType::UBYTE4 ||
+                indices.type == AttributeType::USHORT4) && !indices.normalized,
+                "cpuSkinning requires UBYTE4 or USHORT4 bone indices")) {
+            return nullptr;
+        }
+        if (!ASSERT_PRECONDITION_NON_FATAL(weights.type == AttributeType::FLOAT4 ||
+                weights.type == AttributeType::HALF4 ||
+                ((weights.type == AttributeType::UBYTE4 ||
+                  weights.type == AttributeType::USHORT4) && weights.normalized),
+                "cpuSkinning requires FLOAT4, HALF4, or normalized UBYTE4 or USHORT4 weights")) {
+            return nullptr;
+        }
+    }
+
     return upcast(engine).createVertexBuffer(*this);
 }
 
@@ -110,23 +189,15 @@ VertexBuffer* VertexBuffer::Builder::build(Engine& engine) {
 
 namespace details {
 
-FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& builder)
-        : mVertexCount(builder->mVertexCount), mBufferCount(builder->mBufferCount) {
-    std::copy(std::begin(builder->mAttributes), std::end(builder->mAttributes), mAttributes.begin());
-
-    mDeclaredAttributes = builder->mDeclaredAttributes;
-    uint8_t attributeCount = (uint8_t) mDeclaredAttributes.count();
-
+// the attributes are the builder's, see FVertexBuffer's constructor
+template<typename Attributes>
+static Driver::AttributeArray getAttributeArray(Attributes const& attributes,
+        AttributeBitset declaredAttributes) noexcept {
     Driver::AttributeArray attributeArray;
 
     static_assert(attributeArray.size() == MAX_ATTRIBUTE_BUFFERS_COUNT,
             "Driver::Attribute and Builder::Attribute arrays must match");
 
-    static_assert(sizeof(Driver::Attribute) == sizeof(Builder::AttributeData),
-            "Driver::Attribute and Builder::Attribute must match");
-
-    auto const& declaredAttributes = mDeclaredAttributes;
-    auto const& attributes = mAttributes;
     for (size_t i = 0, n = attributeArray.size(); i < n; ++i) {
         if (declaredAttributes[i]) {
             attributeArray[i].offset = attributes[i].offset;
@@ -136,10 +207,38 @@ FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& build
             attributeArray[i].normalized = attributes[i].normalized;
         }
     }
+    return attributeArray;
+}
+
+FVertexBuffer::FVertexBuffer(FEngine& engine, const VertexBuffer::Builder& builder)
+        : mVertexCount(builder->mVertexCount), mBufferCount(builder->mBufferCount),
+          mCpuSkinning(builder->mCpuSkinning) {
+    std::copy(std::begin(builder->mAttributes), std::end(builder->mAttributes), mAttributes.begin());
+
+    mDeclaredAttributes = builder->mDeclaredAttributes;
+    if (builder->mDepthBuffer != NO_DEPTH_BUFFER) {
+        for (size_t i = 0, n = mAttributes.size(); i < n; ++i) {
+            if (mDeclaredAttributes[i] && mAttributes[i].buffer == builder->mDepthBuffer) {
+                mDepthAttributes.set(i);
+            }
+        }
+    }
+    uint8_t attributeCount = (uint8_t) mDeclaredAttributes.count();
+
+    static_assert(sizeof(Driver::Attribute) == sizeof(Builder::AttributeData),
+            "Driver::Attribute and Builder::Attribute must match");
 
     FEngine::DriverApi& driver = engine.getDriverApi();
-    mHandle = driver.createVertexBuffer(
-            mBufferCount, attributeCount, mVertexCount, attributeArray);
+    mHandle = driver.createVertexBuffer(mBufferCount, attributeCount, mVertexCount,
+            getAttributeArray(mAttributes, mDeclaredAttributes), builder->mUsage);
+
+    if (mCpuSkinning) {
+        for (size_t i = 0; i < mBufferCount; i++) {
+            const size_t size = getBufferSize(i);
+            mCpuBuffers[i].reset(new uint8_t[size]);
+            memset(mCpuBuffers[i].get(), 0, size);
+        }
+    }
 }
 
 void FVertexBuffer::terminate(FEngine& engine) {
@@ -151,14 +250,38 @@ size_t FVertexBuffer::getVertexCount() const noexcept {
     return mVertexCount;
 }
 
+size_t FVertexBuffer::getBufferSize(size_t bufferIndex) const noexcept {
+    // each buffer is sized to hold the attributes that use it, see createVertexBuffer()
+    size_t bufferSize = 0;
+    for (size_t j = 0, n = mAttributes.size(); j < n; j++) {
+        if (mDeclaredAttributes[j] && mAttributes[j].buffer == bufferIndex) {
+            bufferSize = std::max(bufferSize,
+                    mAttributes[j].offset + size_t(mVertexCount) * mAttributes[j].stride);
+        }
+    }
+    return bufferSize;
+}
+
+size_t FVertexBuffer::getSize() const noexcept {
+    size_t size = 0;
+    for (size_t i = 0; i < mBufferCount; i++) {
+        size += getBufferSize(i);
+    }
+    return size;
+}
+
 void FVertexBuffer::setBufferAt(FEngine& engine, uint8_t bufferIndex,
         driver::BufferDescriptor&& buffer, uint32_t byteOffset, uint32_t byteSize) {
+    FEngine::WorkerScope scope(engine);
 
     if (byteSize == 0) {
         byteSize = uint32_t(buffer.size);
     }
 
     if (bufferIndex < mBufferCount) {
+        if (mCpuSkinning) {
+            copyToCpuBuffer(bufferIndex, buffer.buffer, byteOffset, byteSize);
+        }
         engine.getDriverApi().loadVertexBuffer(mHandle, bufferIndex,
                 std::move(buffer), byteOffset, byteSize);
     } else {
@@ -167,6 +290,193 @@ void FVertexBuffer::setBufferAt(FEngine& engine, uint8_t bufferIndex,
     }
 }
 
+void FVertexBuffer::setBufferRangesAt(FEngine& engine, uint8_t bufferIndex,
+        driver::BufferDescriptor&& buffer, BufferRange const* ranges, size_t count) {
+    if (!ASSERT_PRECONDITION_NON_FATAL(bufferIndex < mBufferCount,
+            "bufferIndex must be < bufferCount")) {
+        return;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    if (mCpuSkinning) {
+        uint8_t const* data = static_cast<uint8_t const*>(buffer.buffer);
+        for (size_t i = 0; i < count; i++) {
+            copyToCpuBuffer(bufferIndex, data, ranges[i].byteOffset, ranges[i].byteSize);
+            data += ranges[i].byteSize;
+        }
+    }
+
+    // the ranges are copied in the command stream, they're only read by the driver
+    FEngine::WorkerScope scope(engine);
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    BufferRange* const copy = driver.allocatePod<BufferRange>(count);
+    std::copy_n(ranges, count, copy);
+    driver.loadVertexBufferRanges(mHandle, bufferIndex,
+            std::move(buffer), copy, uint32_t(count));
+}
+
+void FVertexBuffer::copyToCpuBuffer(uint8_t bufferIndex, void const* data,
+        uint32_t byteOffset, uint32_t byteSize) noexcept {
+    const size_t size = getBufferSize(bufferIndex);
+    if (!ASSERT_PRECONDITION_NON_FATAL(size_t(byteOffset) + byteSize <= size,
+            "the range is out of the buffer")) {
+        return;
+    }
+    memcpy(mCpuBuffers[bufferIndex].get() + byteOffset, data, byteSize);
+    mCpuVersion = std::max(1u, mCpuVersion + 1);
+}
+
+AttributeBitset FVertexBuffer::getSkinnedAttributes() const noexcept {
+    AttributeBitset attributes = mDeclaredAttributes;
+    attributes.unset(VertexAttribute::BONE_INDICES);
+    attributes.unset(VertexAttribute::BONE_WEIGHTS);
+    return attributes;
+}
+
+Handle<HwVertexBuffer> FVertexBuffer::createSkinnedBuffer(
+        driver::DriverApi& driver) const noexcept {
+    // the skinned vertices are uploaded each time the bones change
+    const AttributeBitset attributes = getSkinnedAttributes();
+    return driver.createVertexBuffer(mBufferCount, uint8_t(attributes.count()), mVertexCount,
+            getAttributeArray(mAttributes, attributes), Driver::Usage::DYNAMIC);
+}
+
+template<typename T>
+static inline T load(uint8_t const* p) noexcept {
+    T value;
+    memcpy(&value, p, sizeof(T));
+    return value;
+}
+
+template<typename T>
+static inline void store(uint8_t* p, T const& value) noexcept {
+    memcpy(p, &value, sizeof(T));
+}
+
+static inline float4 loadBoneWeights(VertexBuffer::AttributeType type, uint8_t const* p) noexcept {
+    switch (type) {
+        case VertexBuffer::AttributeType::HALF4:    return float4(load<half4>(p));
+        case VertexBuffer::AttributeType::UBYTE4:   return float4(load<ubyte4>(p)) / 255.0f;
+        case VertexBuffer::AttributeType::USHORT4:  return unpackUnorm16(load<ushort4>(p));
+        default:                                    return load<float4>(p);
+    }
+}
+
+// this mirrors skinPosition() in getters.vs, the weights must add up to 1
+static inline float3 skinPosition(float3 const& p,
+        RenderableManager::Bone const* UTILS_RESTRICT bones, uint4 ids, float4 weights) noexcept {
+    float3 skinned = p;
+    for (size_t k = 0; k < 4; k++) {
+        quatf const& q = bones[ids[k]].unitQuaternion;
+        skinned += (2.0f * cross(q.xyz, cross(q.xyz, p) + q.w * p) + bones[ids[k]].translation) *
+                weights[k];
+    }
+    return skinned;
+}
+
+// Rotates the tangent frame by the blend of the bones' rotations. The sign of w is the sign of the
+// bitangent, so like in mat3f::packTangentFrame() w keeps its sign and is never 0.
+static inline quatf skinTangentFrame(quatf const& frame,
+        RenderableManager::Bone const* UTILS_RESTRICT bones, uint4 ids, float4 weights) noexcept {
+    constexpr float bias = 1.0f / 32767.0f;
+    quatf const& q0 = bones[ids.x].unitQuaternion;
+    float4 rotation = q0.xyzw * weights.x;
+    for (size_t k = 1; k < 4; k++) {
+        quatf const& q = bones[ids[k]].unitQuaternion;
+        rotation += (dot(q0.xyzw, q.xyzw) < 0 ? -q.xyzw : q.xyzw) * weights[k];
+    }
+    const bool reflected = frame.w < 0;
+    quatf q = positive(normalize(
+            quatf(normalize(rotation)) * (reflected ? quatf(-frame.xyzw) : frame)));
+    if (q.w < bias) {
+        q.w = bias;
+        q.xyz *= std::sqrt(1.0f - bias * bias);
+    }
+    return reflected ? quatf(-q.xyzw) : q;
+}
+
+void FVertexBuffer::skin(FEngine& engine, Handle<HwVertexBuffer> target,
+        RenderableManager::Bone const* bones, size_t boneCount, bool all) const {
+    assert(mCpuSkinning && boneCount);
+    Builder::AttributeData const& position = mAttributes[VertexAttribute::POSITION];
+    Builder::AttributeData const& tangents = mAttributes[VertexAttribute::TANGENTS];
+    Builder::AttributeData const& indices = mAttributes[VertexAttribute::BONE_INDICES];
+    Builder::AttributeData const& weights = mAttributes[VertexAttribute::BONE_WEIGHTS];
+    const bool hasTangents = mDeclaredAttributes[VertexAttribute::TANGENTS];
+
+    // the skinned buffers start as a copy of the vertices, whose positions and tangents are then
+    // overwritten. The other buffers never change, they're only uploaded when 'all' is set.
+    uint8_t* skinned[MAX_ATTRIBUTE_BUFFERS_COUNT] = {};
+    for (size_t i = 0; i < mBufferCount; i++) {
+        if (all || position.buffer == i || (hasTangents && tangents.buffer == i)) {
+            const size_t size = getBufferSize(i);
+            skinned[i] = static_cast<uint8_t*>(::malloc(size));
+            memcpy(skinned[i], mCpuBuffers[i].get(), size);
+        }
+    }
+
+    auto work = [&](uint32_t start, uint32_t count) {
+        uint8_t const* const positionIn = mCpuBuffers[position.buffer].get() + position.offset;
+        uint8_t* const positionOut = skinned[position.buffer] + position.offset;
+        uint8_t const* const indicesIn = mCpuBuffers[indices.buffer].get() + indices.offset;
+        uint8_t const* const weightsIn = mCpuBuffers[weights.buffer].get() + weights.offset;
+        for (size_t v = start, e = start + count; v < e; v++) {
+            const uint4 ids = min(indices.type == AttributeType::UBYTE4 ?
+                    uint4(load<ubyte4>(indicesIn + v * indices.stride)) :
+                    uint4(load<ushort4>(indicesIn + v * indices.stride)), uint4(boneCount - 1));
+            const float4 w = loadBoneWeights(weights.type, weightsIn + v * weights.stride);
+
+            uint8_t const* const pin = positionIn + v * position.stride;
+            uint8_t* const pout = positionOut + v * position.stride;
+            if (position.type == AttributeType::FLOAT3) {
+                store(pout, skinPosition(load<float3>(pin), bones, ids, w));
+            } else if (position.type == AttributeType::FLOAT4) {
+                const float4 p = load<float4>(pin);
+                store(pout, float4{ skinPosition(p.xyz, bones, ids, w), p.w });
+            } else {
+                const float4 p = float4(load<half4>(pin));
+                store(pout, half4(float4{ skinPosition(p.xyz, bones, ids, w), p.w }));
+            }
+
+            if (hasTangents) {
+                const size_t offset = tangents.offset + v * tangents.stride;
+                uint8_t const* const tin = mCpuBuffers[tangents.buffer].get() + offset;
+                uint8_t* const tout = skinned[tangents.buffer] + offset;
+                if (tangents.type == AttributeType::FLOAT4) {
+                    const quatf q(load<float4>(tin));
+                    store(tout, skinTangentFrame(q, bones, ids, w).xyzw);
+                } else {
+                    const quatf q(unpackSnorm16(load<short4>(tin)));
+                    store(tout, packSnorm16(skinTangentFrame(q, bones, ids, w).xyzw));
+                }
+            }
+        }
+    };
+
+    // small meshes aren't worth waking up the job system
+    if (mVertexCount >= SKINNING_JOB_VERTEX_COUNT * 2) {
+        utils::JobSystem& js = engine.getJobSystem();
+        auto job = utils::jobs::parallel_for(js, nullptr, 0, mVertexCount, std::cref(work),
+                utils::jobs::CountSplitter<SKINNING_JOB_VERTEX_COUNT, 8>());
+        js.setName(job, "FVertexBuffer::skin");
+        js.run(job);
+        js.waitAndRelease(job);
+    } else {
+        work(0, mVertexCount);
+    }
+
+    FEngine::DriverApi& driver = engine.getDriverApi();
+    for (size_t i = 0; i < mBufferCount; i++) {
+        if (skinned[i]) {
+            const size_t size = getBufferSize(i);
+            driver.loadVertexBuffer(target, i, BufferDescriptor(skinned[i], size,
+                    [](void* buffer, size_t, void*) { ::free(buffer); }), 0, uint32_t(size));
+        }
+    }
+}
+
 } // namespace details
 
 // ------------------------------------------------------------------------------------------------
@@ -185,4 +495,9 @@ void VertexBuffer::setBufferAt(Engine& engine, uint8_t bufferIndex,
             std::move(buffer), byteOffset, byteSize);
 }
 
+void VertexBuffer::setBufferRangesAt(Engine& engine, uint8_t bufferIndex,
+        driver::BufferDescriptor&& buffer, BufferRange const* ranges, size_t count) {
+    upcast(this)->setBufferRangesAt(upcast(engine), bufferIndex, std::move(buffer), ranges, count);
+}
+
 } // namespace filament
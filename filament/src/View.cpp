@@ -17,14 +17,20 @@
 #include "details/View.h"
 
 #include "details/Engine.h"
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Culler.h"
 #include "details/DFG.h"
 #include "details/Froxelizer.h"
 #include "details/IndirectLight.h"
 #include "details/MaterialInstance.h"
+#include "details/OcclusionCuller.h"
+#include "details/RenderPrimitive.h"
 #include "details/Renderer.h"
 #include "details/Scene.h"
 #include "details/Skybox.h"
+#include "details/Texture.h"
+
+#include "CpuStageTimings.h"
 
 #include <filament/Exposure.h>
 
@@ -36,6 +42,16 @@
 #include <math/scalar.h>
 #include <math/fast.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <utility>
+
+#include <assert.h>
+#include <float.h>
+#include <string.h>
+
 using namespace math;
 using namespace utils;
 
@@ -52,12 +68,44 @@ static constexpr uint8_t VISIBLE_RENDERABLE = 1u << VISIBLE_RENDERABLE_BIT;
 static constexpr uint8_t VISIBLE_SHADOW_CASTER = 1u << VISIBLE_SHADOW_CASTER_BIT;
 static constexpr uint8_t VISIBLE_ALL = VISIBLE_RENDERABLE | VISIBLE_SHADOW_CASTER;
 
+// set during culling for the renderables that are large enough on screen, this doesn't survive
+// computeVisibilityMasks()
+static constexpr size_t LARGE_ENOUGH_BIT = 2u;
+static constexpr uint8_t LARGE_ENOUGH = 1u << LARGE_ENOUGH_BIT;
+
+// with dynamic shadow resolution, the shadow maps are made larger again only above this
+// workload scale, i.e. when frames take less than 2/3 of the budget
+static constexpr float SHADOW_SCALE_UP_WORKLOAD = 1.5f;
+
+// With DepthPrepass::DEFAULT, the depth prepass is used above this estimated overdraw of the
+// opaque renderables, and not used anymore below the lower one, so it doesn't toggle each frame
+static constexpr float DEPTH_PREPASS_ENABLE_OVERDRAW = 2.5f;
+static constexpr float DEPTH_PREPASS_DISABLE_OVERDRAW = 1.5f;
+
+// the largest opaque renderables only are drawn in the depth prepass, the others would mostly
+// double their vertex work for little fragment work saved
+static constexpr size_t DEPTH_PREPASS_MAX_OCCLUDERS = 64;
+
+// set for each shadow cascade a shadow caster is visible in, along with VISIBLE_SHADOW_CASTER
+static constexpr size_t VISIBLE_CASCADE_BIT_0 = 4u;
+static constexpr uint8_t VISIBLE_CASCADES =
+        uint8_t(((1u << CONFIG_MAX_SHADOW_CASCADES) - 1u) << VISIBLE_CASCADE_BIT_0);
+static_assert(VISIBLE_CASCADE_BIT_0 + CONFIG_MAX_SHADOW_CASCADES <= 8,
+        "the shadow cascades don't fit in the VISIBLE_MASK");
+
+// the 'SPOT_SHADOW_MASK' has a bit set for each spot light shadow map a shadow caster is
+// visible in, the shadow passes see it as the high byte of the visible mask
+static constexpr size_t SPOT_SHADOW_BIT_0 = 8u;
+static_assert(CONFIG_MAX_SHADOWED_SPOT_LIGHTS <= 8,
+        "the spot light shadow maps don't fit in the SPOT_SHADOW_MASK");
+
 FView::FView(FEngine& engine)
     : mFroxelizer(engine),
       mPerViewUb(engine.getPerViewUib()),
       mPerViewSb(engine.getPerViewSib()),
       mClipSpace01(engine.getBackend() == Backend::VULKAN),
-      mDirectionalShadowMap(engine) {
+      mDirectionalShadowMap(engine),
+      mSpotShadowAtlas(engine) {
     DriverApi& driverApi = engine.getDriverApi();
 
     mPerViewUbh = driverApi.createUniformBuffer(mPerViewUb.getSize());
@@ -72,7 +120,9 @@ FView::FView(FEngine& engine)
                 engine.getDFG()->getTexture(), sampler.getSamplerParams());
     }
 
-    mIsDynamicResolutionSupported = driverApi.isFrameTimeSupported();
+    // the frame time is measured with GPU timer queries when possible, or fences
+    mIsDynamicResolutionSupported =
+            driverApi.isTimerQuerySupported() || driverApi.isFrameTimeSupported();
 
     driverApi.updateSamplerBuffer(mPerViewSbh, SamplerBuffer(mPerViewSb));
 }
@@ -83,12 +133,24 @@ void FView::terminate(FEngine& engine) {
     // Here we would cleanly free resources we've allocated or we own (currently none).
     DriverApi& driverApi = engine.getDriverApi();
     driverApi.destroyUniformBuffer(mPerViewUbh);
+    if (mRenderableUbh) {
+        driverApi.destroyUniformBuffer(mRenderableUbh);
+    }
     driverApi.destroySamplerBuffer(mPerViewSbh);
     mDirectionalShadowMap.terminate(driverApi);
+    mSpotShadowAtlas.terminate(driverApi);
     mFroxelizer.terminate(driverApi);
+    mColorGrading.terminate(driverApi);
+    destroyStereoRenderTarget(driverApi);
+    destroyTemporalHistory(driverApi);
 }
 
 void FView::setViewport(Viewport const& viewport) noexcept {
+    if (mSmallFeatureCulling > 0.0f &&
+            (viewport.width != mViewport.width || viewport.height != mViewport.height)) {
+        // the visible set depends on the size of the viewport
+        clearCommandCaches();
+    }
     mViewport = viewport;
 }
 
@@ -119,6 +181,15 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
         dynamicResolution.headRoomRatio = std::min(dynamicResolution.headRoomRatio, 1.0f);
         dynamicResolution.headRoomRatio = std::max(dynamicResolution.headRoomRatio, 0.0f);
 
+        // the controller's gains and hysteresis can't be negative
+        dynamicResolution.proportionalGain = std::max(dynamicResolution.proportionalGain, 0.0f);
+        dynamicResolution.derivativeGain = std::max(dynamicResolution.derivativeGain, 0.0f);
+        dynamicResolution.hysteresis = std::min(std::max(dynamicResolution.hysteresis, 0.0f), 0.5f);
+
+        // the GPU utilization target is in [0, 1], with 0 disabling the power saving mode
+        dynamicResolution.gpuUtilization =
+                std::min(std::max(dynamicResolution.gpuUtilization, 0.0f), 1.0f);
+
         // minScale cannot be 0 or negative
         dynamicResolution.minScale = max(dynamicResolution.minScale, float2(1.0f / 1024.0f));
 
@@ -133,6 +204,92 @@ void FView::setDynamicResolutionOptions(DynamicResolutionOptions const& options)
         mFrameTimeHistory.clear();
         mScale = 1.0f;
         mDynamicWorkloadScale = 1.0f;
+        mScaleErrors[0] = mScaleErrors[1] = 0.0f;
+        mFrameInterval = 0.0f;
+    } else {
+        // the shadows' dynamic resolution still uses the history and frame time budget
+        dynamicResolution.history = std::min(std::max(dynamicResolution.history, uint8_t(3)),
+                uint8_t(30));
+        dynamicResolution.targetFrameTimeMilli = std::min(std::max(
+                dynamicResolution.targetFrameTimeMilli, 1000.0f / 240.0f), 1000.0f);
+        dynamicResolution.headRoomRatio =
+                std::min(std::max(dynamicResolution.headRoomRatio, 0.0f), 1.0f);
+    }
+}
+
+// the filtering is passed to the shaders as is
+using ShadowFiltering = View::ShadowOptions::Filtering;
+static_assert(int32_t(ShadowFiltering::HARD) == int32_t(ShadowSamplingMethod::HARD) &&
+        int32_t(ShadowFiltering::PCF_LOW) == int32_t(ShadowSamplingMethod::PCF_LOW) &&
+        int32_t(ShadowFiltering::PCF_MEDIUM) == int32_t(ShadowSamplingMethod::PCF_MEDIUM) &&
+        int32_t(ShadowFiltering::PCF_HIGH) == int32_t(ShadowSamplingMethod::PCF_HIGH),
+        "View::ShadowOptions::Filtering must match ShadowSamplingMethod");
+
+void FView::setShadowOptions(ShadowOptions const& options) noexcept {
+    ShadowOptions& shadowOptions = mShadowOptions;
+    shadowOptions = options;
+
+    // only enable if the frame time can be measured
+    shadowOptions.dynamicResolution =
+            shadowOptions.dynamicResolution && mIsDynamicResolutionSupported;
+
+    // the scales are powers of two, smaller shadow maps are pointless, and larger than the
+    // light's shadow map size are a waste of memory
+    shadowOptions.minScale = std::min(std::max(shadowOptions.minScale, 1.0f / 16.0f), 1.0f);
+    shadowOptions.maxScale = std::min(std::max(shadowOptions.maxScale, shadowOptions.minScale), 1.0f);
+
+    // start from the largest size, the frame time will tell
+    mShadowWorkloadScale = 1.0f;
+    mShadowScaleCooldown = 0;
+    setShadowScale(shadowOptions.dynamicResolution ? shadowOptions.maxScale : 1.0f);
+}
+
+void FView::setLightCullingOptions(LightCullingOptions const& options) noexcept {
+    LightCullingOptions& lightCullingOptions = mLightCullingOptions;
+    lightCullingOptions.minContribution = std::max(options.minContribution, 0.0f);
+    lightCullingOptions.fadeContribution =
+            std::max(options.fadeContribution, lightCullingOptions.minContribution);
+}
+
+void FView::setShadowScale(float scale) noexcept {
+    ShadowOptions const& options = mShadowOptions;
+    if (options.dynamicResolution) {
+        // keep the power of two scales within [minScale, maxScale]
+        const float minScale = std::exp2(std::ceil(std::log2(options.minScale)));
+        const float maxScale = std::exp2(std::floor(std::log2(options.maxScale)));
+        scale = std::min(std::max(scale, minScale), std::max(maxScale, minScale));
+    }
+    if (scale != mShadowScale) {
+        mShadowScale = scale;
+        mDirectionalShadowMap.setResolutionScale(scale);
+        mSpotShadowAtlas.setResolutionScale(scale);
+    }
+}
+
+void FView::updateShadowScale(float workloadScale) noexcept {
+    // The shadow maps' size only changes by powers of two, and each change reallocates the
+    // directional shadow map, so it follows the low-passed workload scale with hysteresis: it's
+    // halved when frames are over budget, and doubled (which quadruples the shadow maps' area)
+    // only when there's plenty of time left. After a change, we wait for the frame time history
+    // to show its effect.
+    const float oneOverTau = mDynamicResolution.scaleRate;
+    mShadowWorkloadScale += (1.0f - std::exp(-oneOverTau)) * (workloadScale - mShadowWorkloadScale);
+    if (mShadowScaleCooldown) {
+        mShadowScaleCooldown--;
+        return;
+    }
+
+    float scale = mShadowScale;
+    if (mShadowWorkloadScale < 1.0f) {
+        scale *= 0.5f;
+    } else if (mShadowWorkloadScale > SHADOW_SCALE_UP_WORKLOAD) {
+        scale *= 2.0f;
+    }
+    const float previous = mShadowScale;
+    setShadowScale(scale);
+    if (mShadowScale != previous) {
+        mShadowWorkloadScale = 1.0f;
+        mShadowScaleCooldown = mDynamicResolution.history;
     }
 }
 
@@ -140,10 +297,15 @@ void FView::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcep
     mFroxelizer.setOptions(zLightNear, zLightFar);
 }
 
+void FView::setFroxelCount(uint32_t froxelCount) noexcept {
+    mFroxelizer.setFroxelCount(froxelCount);
+}
+
 
-math::float2 FView::updateScale(duration frameTime) noexcept {
+math::float2 FView::updateScale(duration frameTime, duration frameInterval) noexcept {
     DynamicResolutionOptions const& options = mDynamicResolution;
-    if (options.enabled) {
+    const bool dynamicShadows = mShadowOptions.dynamicResolution;
+    if (options.enabled || dynamicShadows) {
 
         if (UTILS_UNLIKELY(frameTime.count() <= std::numeric_limits<float>::epsilon())) {
             mScale = 1.0f;
@@ -169,14 +331,50 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
         std::sort(median.begin(), median.begin() + size);
         duration filteredFrameTime = median[size / 2];
 
+        // the time between frames is longer than the target when the frame rate is limited
+        // by the display or the application, it's low-passed the same way as the scale.
+        const float b = 1.0f - std::exp(-options.scaleRate);
+        mFrameInterval = mFrameInterval > 0.0f ?
+                mFrameInterval + b * (frameInterval.count() - mFrameInterval) :
+                frameInterval.count();
+
         // how much we need to scale the current workload to fit in our target, at this instant
-        const float targetWithHeadroom = options.targetFrameTimeMilli * (1 - options.headRoomRatio);
+        float targetWithHeadroom = options.targetFrameTimeMilli * (1 - options.headRoomRatio);
+        if (options.gpuUtilization > 0.0f) {
+            // in power saving mode, the GPU must also be idle for part of each frame
+            const float interval = std::max(mFrameInterval, options.targetFrameTimeMilli);
+            targetWithHeadroom = std::min(targetWithHeadroom, options.gpuUtilization * interval);
+        }
         const float workloadScale = targetWithHeadroom / filteredFrameTime.count();
 
-        // low-pass: y += b * (x - y)
-        const float oneOverTau = options.scaleRate;
-        const float x = mScale.x * mScale.y * workloadScale;
-        mDynamicWorkloadScale += (1.0f - std::exp(-oneOverTau)) * (x - mDynamicWorkloadScale);
+        if (dynamicShadows) {
+            updateShadowScale(workloadScale);
+        }
+        if (!options.enabled) {
+            mScale = 1.0f;
+            return mScale;
+        }
+
+        // The workload scale is driven by a PID controller (in its velocity form) working on
+        // the log of the relative error, so that over and under budget frames are symmetrical.
+        // The integral gain is the rate of the historical low-pass filter, errors within the
+        // hysteresis are ignored so the noise of the measurements doesn't change the scale.
+        float error = std::log(workloadScale);
+        if (std::abs(error) < std::log1p(options.hysteresis)) {
+            error = 0.0f;
+        }
+        const float delta = options.proportionalGain * (error - mScaleErrors[0])
+                + b * error
+                + options.derivativeGain * (error - 2.0f * mScaleErrors[0] + mScaleErrors[1]);
+        mScaleErrors[1] = mScaleErrors[0];
+        mScaleErrors[0] = error;
+
+        // the controller starts from the scale actually in use, which avoids winding up when
+        // the scale is clamped
+        const float minArea = options.minScale.x * options.minScale.y;
+        const float maxArea = options.maxScale.x * options.maxScale.y;
+        mDynamicWorkloadScale = clamp(mScale.x * mScale.y * std::exp(delta),
+                minArea, maxArea);
 
         // scaling factor we need to apply on the whole surface
         const float scale = mDynamicWorkloadScale;
@@ -208,6 +406,16 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
             mScale = std::sqrt(scale);
         }
 
+        // when an axis reaches its limits, the other axis takes the rest of the scaling
+        const float2 minScale = options.minScale;
+        const float2 maxScale = options.maxScale;
+        const float2 clamped = clamp(mScale, minScale, maxScale);
+        if (clamped.x != mScale.x) {
+            mScale = { clamped.x, clamp(scale / clamped.x, minScale.y, maxScale.y) };
+        } else if (clamped.y != mScale.y) {
+            mScale = { clamp(scale / clamped.y, minScale.x, maxScale.x), clamped.y };
+        }
+
         // now tweak the scaling factor to get multiples of 4 (to help quad-shading)
         mScale = (floor(mScale * float2{ w, h } / 4) * 4) / float2{ w, h };
 
@@ -221,6 +429,7 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
             sLogCounter = 15;
             slog.d << frameTime.count()
                    << ", " << filteredFrameTime.count()
+                   << ", " << mFrameInterval
                    << ", " << workloadScale
                    << ", " << mDynamicWorkloadScale
                    << ", " << mScale.x
@@ -237,6 +446,19 @@ math::float2 FView::updateScale(duration frameTime) noexcept {
     return mScale;
 }
 
+void FView::setStereo(FCamera* left, FCamera* right, FTexture* target) noexcept {
+    if (!left || !right || !target) {
+        left = right = nullptr;
+        target = nullptr;
+    }
+    assert(!target || (target->getTarget() == Texture::Sampler::SAMPLER_2D_ARRAY &&
+            target->getDepth() >= CONFIG_STEREO_EYE_COUNT));
+    mStereoCameras[0] = left;
+    mStereoCameras[1] = right;
+    mStereoTarget = target;
+    clearCommandCaches();
+}
+
 void FView::setClearColor(float4 const& clearColor) noexcept {
     mClearColor = clearColor;
 }
@@ -249,6 +471,18 @@ void FView::setClearTargets(bool color, bool depth, bool stencil) noexcept {
 
 void FView::setVisibleLayers(uint8_t select, uint8_t values) noexcept {
     mVisibleLayers = (mVisibleLayers & ~select) | (values & select);
+    clearCommandCaches();
+}
+
+void FView::setCommandCachingEnabled(bool enabled) noexcept {
+    mCommandCaching = enabled;
+    if (!enabled) {
+        // release the commands' memory
+        mColorPassCommandCache = {};
+        for (auto& cache : mShadowPassCommandCaches) {
+            cache = {};
+        }
+    }
 }
 
 bool FView::isSkyboxVisible() const noexcept {
@@ -256,43 +490,166 @@ bool FView::isSkyboxVisible() const noexcept {
     return skybox != nullptr && (skybox->getLayerMask() & mVisibleLayers);
 }
 
-void FView::prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-        FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept {
+void FView::setShadowCascades(uint8_t count) noexcept {
+    mDirectionalShadowMap.setCascadeCount(count);
+    clearCommandCaches();
+}
+
+uint16_t FView::getRenderableVisibleMask() noexcept {
+    return VISIBLE_RENDERABLE;
+}
+
+uint16_t FView::getShadowCascadeVisibleMask(size_t cascade) noexcept {
+    return uint16_t(1u << (VISIBLE_CASCADE_BIT_0 + cascade));
+}
+
+uint16_t FView::getSpotShadowVisibleMask(size_t index) noexcept {
+    return uint16_t(1u << (SPOT_SHADOW_BIT_0 + index));
+}
+
+void FView::prepareShadowing(FEngine& engine, FScene::RenderableSoa& renderableData,
+        FScene::LightSoa const& lightData, Culler::result_type* const* casterMasks) noexcept {
     SYSTRACE_CALL();
 
     // setup shadow mapping
     // TODO: for now we only consider THE directional light
 
     auto& lcm = engine.getLightManager();
-    UniformBuffer& u = getUb();
     FScene* const scene = mScene;
 
     // dominant directional light is always as index 0
     FLightManager::Instance directionalLight = lightData.elementAt<FScene::LIGHT_INSTANCE>(0);
-    mHasShadowing = mShadowingEnabled && directionalLight && lcm.isShadowCaster(directionalLight);
-    if (UTILS_UNLIKELY(mHasShadowing)) {
-        // compute the frustum for this light
-        ShadowMap& shadowMap = mDirectionalShadowMap;
+    mHasDirectionalShadows = mShadowingEnabled && directionalLight &&
+            lcm.isShadowCaster(directionalLight);
+    mShadowLight = directionalLight;
+    if (UTILS_UNLIKELY(mHasDirectionalShadows)) {
+        // compute the frustum of each cascade for this light
+        CascadedShadowMap& shadowMap = mDirectionalShadowMap;
         shadowMap.update(lightData, 0, scene, mViewingCameraInfo, mVisibleLayers);
-        if (shadowMap.hasVisibleShadows()) {
-            // Cull shadow casters
-            Frustum const& frustum = shadowMap.getCamera().getFrustum();
-            prepareVisibleShadowCasters(engine.getJobSystem(), renderableData, frustum);
 
+        // Cull each cascade's shadow casters into its own array, concurrently
+        JobSystem& js = engine.getJobSystem();
+        auto cullCascade = [this, &js, &shadowMap, &renderableData, casterMasks](size_t i) {
+            Frustum const& frustum = shadowMap.getCascade(i).getCamera().getFrustum();
+            prepareVisibleShadowCasters(js, renderableData, frustum, casterMasks[i],
+                    VISIBLE_CASCADE_BIT_0 + i);
+        };
+
+        const size_t count = shadowMap.getCascadeCount();
+        if (count == 1) {
+            if (shadowMap.hasVisibleShadows()) {
+                cullCascade(0);
+            }
+        } else {
+            auto parent = js.createJob();
+            js.setName(parent, "FView::prepareShadowing");
+            for (size_t i = 0; i < count; i++) {
+                if (shadowMap.getCascade(i).hasVisibleShadows()) {
+                    js.runAndRelease(js.createJob(parent,
+                            [&cullCascade, i](JobSystem&, JobSystem::Job*) { cullCascade(i); }),
+                            JobSystem::DONT_SIGNAL);
+                }
+            }
+            js.run(parent);
+            js.waitAndRelease(parent);
+        }
+    }
+}
+
+void FView::prepareSpotShadowing(FEngine& engine, ArenaScope& arena,
+        FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+        Culler::result_type** spotCasterMasks) noexcept {
+    SYSTRACE_CALL();
+
+    ShadowAtlas& atlas = mSpotShadowAtlas;
+    if (mShadowingEnabled) {
+        // here lightData only contains the visible lights
+        atlas.update(lightData, mViewingCameraInfo, mViewport.height);
+    } else {
+        atlas.clear(lightData);
+    }
+
+    // Like the cascades, each shadow map's casters are culled into their own array, and the
+    // unused shadow maps share the first one.
+    const size_t count = atlas.getShadowMapCount();
+    const size_t casterMaskSize = (renderableData.size() + 0xF) & ~size_t(0xF);
+    const size_t arrayCount = std::max(count, size_t(1));
+    Culler::result_type* const casterMask =
+            arena.allocate<Culler::result_type>(casterMaskSize * arrayCount);
+    std::fill_n(casterMask, casterMaskSize * arrayCount, 0);
+    for (size_t i = 0; i < CONFIG_MAX_SHADOWED_SPOT_LIGHTS; i++) {
+        spotCasterMasks[i] = casterMask + (i < count ? i * casterMaskSize : 0);
+    }
+
+    if (UTILS_UNLIKELY(count)) {
+        JobSystem& js = engine.getJobSystem();
+        auto cullSpot = [this, &js, &atlas, &renderableData, spotCasterMasks](size_t i) {
+            Frustum const& frustum = atlas.getShadowMap(i).getCamera().getFrustum();
+            prepareVisibleShadowCasters(js, renderableData, frustum, spotCasterMasks[i], i);
+        };
+        auto parent = js.createJob();
+        js.setName(parent, "FView::prepareSpotShadowing");
+        for (size_t i = 0; i < count; i++) {
+            js.runAndRelease(js.createJob(parent, [&cullSpot, i](JobSystem&, JobSystem::Job*) {
+                cullSpot(i);
+            }), JobSystem::DONT_SIGNAL);
+        }
+        js.run(parent);
+        js.waitAndRelease(parent);
+    }
+}
+
+void FView::prepareShadowMap(FEngine& engine, driver::DriverApi& driver) noexcept {
+    UniformBuffer& u = getUb();
+    u.setUniform(offsetof(FEngine::PerViewUib, directionalShadows),
+            hasDirectionalShadows() ? 1.0f : 0.0f);
+    u.setUniform(offsetof(FEngine::PerViewUib, shadowSamplingMethod),
+            int32_t(mShadowOptions.filtering));
+
+    if (UTILS_UNLIKELY(hasSpotShadows())) {
+        ShadowAtlas& atlas = mSpotShadowAtlas;
+        atlas.prepare(driver, getUs());
+        for (size_t i = 0, c = atlas.getShadowMapCount(); i < c; i++) {
+            u.setUniform(offsetof(FEngine::PerViewUib, spotLightFromWorldMatrix) +
+                    i * sizeof(mat4f), atlas.getShadowMap(i).getLightSpaceMatrix());
+        }
+    }
+
+    if (UTILS_UNLIKELY(mHasDirectionalShadows)) {
+        auto& lcm = engine.getLightManager();
+        CascadedShadowMap& shadowMap = mDirectionalShadowMap;
+        FLightManager::Instance directionalLight = mShadowLight;
+        if (shadowMap.hasVisibleShadows()) {
             // allocates shadowmap driver resources
             shadowMap.prepare(driver, getUs());
 
-            mat4f const& lightFromWorldMatrix = shadowMap.getLightSpaceMatrix();
-            u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix), lightFromWorldMatrix);
-
-            // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
-            // needed with other APIs, but at least it won't worsen the acnee there.
-            const float sceneRange = shadowMap.getSceneRange();
-            const float texelSizeWorldSpace = shadowMap.getTexelSizeWorldSpace();
             const float constantBias = lcm.getShadowConstantBias(directionalLight);
             const float normalBias = lcm.getShadowNormalBias(directionalLight);
-            u.setUniform(offsetof(FEngine::PerViewUib, shadowBias),
-                    float3{ 2 * constantBias / sceneRange, normalBias * texelSizeWorldSpace, 0 });
+
+            // the unused cascades are never selected by the shaders, see getCascadeFar()
+            float4 cascadeSplits;
+            float4 cascadeConstantBias;
+            float4 cascadeNormalBias;
+            for (size_t i = 0, c = shadowMap.getCascadeCount(); i < c; i++) {
+                ShadowMap const& cascade = shadowMap.getCascade(i);
+                mat4f const& lightFromWorldMatrix = cascade.getLightSpaceMatrix();
+                u.setUniform(offsetof(FEngine::PerViewUib, lightFromWorldMatrix) +
+                        i * sizeof(mat4f), lightFromWorldMatrix);
+
+                // the 2x bias is needed in opengl because the depth maps to -1/1. It may not be
+                // needed with other APIs, but at least it won't worsen the acnee there.
+                const float sceneRange = cascade.getSceneRange();
+                const float texelSizeWorldSpace = cascade.getTexelSizeWorldSpace();
+                cascadeSplits[i] = shadowMap.getCascadeFar(i);
+                cascadeConstantBias[i] = 2 * constantBias / sceneRange;
+                cascadeNormalBias[i] = normalBias * texelSizeWorldSpace;
+            }
+            for (size_t i = shadowMap.getCascadeCount(); i < CONFIG_MAX_SHADOW_CASCADES; i++) {
+                cascadeSplits[i] = shadowMap.getCascadeFar(i);
+            }
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowCascadeSplits), cascadeSplits);
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowConstantBias), cascadeConstantBias);
+            u.setUniform(offsetof(FEngine::PerViewUib, shadowNormalBias), cascadeNormalBias);
         }
     }
 }
@@ -323,6 +680,8 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
     FIndirectLight const* const ibl = scene->getIndirectLight();
     if (ibl) {
         u.setUniform(offsetof(FEngine::PerViewUib, iblLuminance), ibl->getIntensity() * exposure);
+        u.setUniform(offsetof(FEngine::PerViewUib, iblRgbm),
+                ibl->isReflectionMapRgbm() ? 1.0f : 0.0f);
         u.setUniformArray(offsetof(FEngine::PerViewUib, iblSH), ibl->getSH(), 9);
         if (ibl->getReflectionMap()) {
             SamplerParams reflectionSamplerParams;
@@ -364,14 +723,17 @@ void FView::prepareLighting(FEngine& engine, FEngine::DriverApi& driver, ArenaSc
         }
         u.setUniform(offsetof(FEngine::PerViewUib, sun), sun);
     } else {
-        // Disable the sun if there's no directional light
+        // The directional lighting code runs when spot lights cast shadows, so the light
+        // must contribute nothing. Also disable the sun.
         float4 sun{ 0.0f, 0.0f, 0.0f, -1.0f };
+        u.setUniform(offsetof(FEngine::PerViewUib, lightColorIntensity), float4{ 0.0f });
         u.setUniform(offsetof(FEngine::PerViewUib, sun), sun);
     }
 
     // Dynamic lighting
     if (mHasDynamicLighting) {
         Froxelizer& froxelizer = mFroxelizer;
+        froxelizer.updateFroxelCount(lightData.size() - FScene::DIRECTIONAL_LIGHTS_COUNT);
         if (froxelizer.prepare(driver, arena, viewport, camera.projection, camera.zn, camera.zf)) {
             froxelizer.updateUniforms(u); // update our uniform buffer if needed
         }
@@ -389,6 +751,18 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
 
     FScene* const scene = getScene();
 
+    if (mCommandCaching) {
+        // any change to the scene's content invalidates the cached commands
+        const uint32_t versions[3] = {
+                scene->getVersion(),
+                engine.getRenderableManager().getVersion(),
+                engine.getTransformManager().getVersion() };
+        if (memcmp(versions, mCommandCacheVersions, sizeof(versions)) != 0) {
+            memcpy(mCommandCacheVersions, versions, sizeof(versions));
+            clearCommandCaches();
+        }
+    }
+
     /*
      * We apply a "world origin" to "everything" in order to implement the IBL rotation.
      * The "world origin" could also be useful for other things, like keeping the origin
@@ -406,96 +780,236 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     /*
      * Calculate all camera parameters needed to render this View for this frame.
      */
-    FCamera const* const camera = mViewingCamera ? mViewingCamera : mCullingCamera;
-
-    // Note: for debugging (i.e. visualize what the camera / objects are doing, using
-    // the viewing camera), we can set worldOriginCamera to identity when mViewingCamera
-    // is set: e.g.
-    //      worldOriginCamera = mViewingCamera ? mat4f{} : worldOriginScene
+    mat4f cullingView;
+    mat4f cullingProjection;
+    if (UTILS_UNLIKELY(isStereo())) {
+        // both eyes are culled at once, with a camera seeing what they see
+        prepareStereoCameras(worldOriginScene);
+        prepareStereoRenderTarget(driver);
+        cullingView = mViewingCameraInfo.view;
+        cullingProjection = mViewingCameraInfo.cullingProjection;
+        mCullingFrustum = FCamera::getFrustum(mat4{ cullingProjection }, cullingView);
+    } else {
+        FCamera const* const camera = mViewingCamera ? mViewingCamera : mCullingCamera;
+
+        // Note: for debugging (i.e. visualize what the camera / objects are doing, using
+        // the viewing camera), we can set worldOriginCamera to identity when mViewingCamera
+        // is set: e.g.
+        //      worldOriginCamera = mViewingCamera ? mat4f{} : worldOriginScene
+
+        const mat4f worldOriginCamera = worldOriginScene;
+        const mat4f model{ worldOriginCamera * camera->getModelMatrix() };
+        mViewingCameraInfo = CameraInfo{
+                // projection with infinite z-far
+                .projection         = mat4f{ camera->getProjectionMatrix() },
+                // projection used for culling, with finite z-far
+                .cullingProjection  = mat4f{ camera->getCullingProjectionMatrix() },
+                // camera model matrix -- apply the world origin to it
+                .model              = model,
+                // camera view matrix
+                .view               = FCamera::getViewMatrix(model),
+                // near plane
+                .zn                 = camera->getNear(),
+                // far plane
+                .zf                 = camera->getCullingFar(),
+                // exposure
+                .ev100              = Exposure::ev100(*camera),
+                // world origin transform, use only for debugging
+                .worldOrigin        = worldOriginCamera
+        };
+        cullingView = FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix());
+        cullingProjection = mat4f{ mCullingCamera->getCullingProjectionMatrix() };
+        mCullingFrustum = FCamera::getFrustum(mCullingCamera->getCullingProjectionMatrix(),
+                cullingView);
+    }
 
-    const mat4f worldOriginCamera = worldOriginScene;
-    const mat4f model{ worldOriginCamera * camera->getModelMatrix() };
-    mViewingCameraInfo = CameraInfo{
-            // projection with infinite z-far
-            .projection         = mat4f{ camera->getProjectionMatrix() },
-            // projection used for culling, with finite z-far
-            .cullingProjection  = mat4f{ camera->getCullingProjectionMatrix() },
-            // camera model matrix -- apply the world origin to it
-            .model              = model,
-            // camera view matrix
-            .view               = FCamera::getViewMatrix(model),
-            // near plane
-            .zn                 = camera->getNear(),
-            // far plane
-            .zf                 = camera->getCullingFar(),
-            // exposure
-            .ev100              = Exposure::ev100(*camera),
-            // world origin transform, use only for debugging
-            .worldOrigin        = worldOriginCamera
-    };
-    mCullingFrustum = FCamera::getFrustum(
-            mCullingCamera->getCullingProjectionMatrix(),
-            FCamera::getViewMatrix(worldOriginScene * mCullingCamera->getModelMatrix()));
+    if (hasTemporalAntiAliasing()) {
+        prepareTemporal(viewport);
+    } else {
+        destroyTemporalHistory(driver);
+    }
 
     /*
      * Gather all information needed to render this scene. Apply the world origin to all
      * objects in the scene.
      */
-    scene->prepare(worldOriginScene);
-
-    /*
-     * Culling: as soon as possible we perform our camera-culling
-     * (this will set the VISIBLE_RENDERABLE bit)
-     */
+    {
+        CpuStageTimings::Scope timing(CpuStageTimings::SCENE_PREPARE);
+        scene->prepare(worldOriginScene);
+    }
 
     FScene::RenderableSoa& renderableData = scene->getRenderableData();
+    FScene::LightSoa& lightData = scene->getLightData();
     Slice<Culler::result_type> cullingMask = renderableData.slice<FScene::VISIBLE_MASK>();
     std::fill(cullingMask.begin(), cullingMask.end(), 0); // TODO: can we avoid this fill?
-    prepareVisibleRenderables(js, renderableData);
+    scene->updateRenderableBvhRows();
+
+    // The shadow casters of each cascade are culled into their own array, so that the camera
+    // and shadow culling jobs don't write to the same bytes. Like the SoA, their size is a
+    // multiple of 16. The unused cascades share the first array.
+    const size_t cascadeCount = mDirectionalShadowMap.getCascadeCount();
+    const size_t casterMaskSize = (renderableData.size() + 0xF) & ~size_t(0xF);
+    Culler::result_type* const casterMask =
+            arena.allocate<Culler::result_type>(casterMaskSize * cascadeCount);
+    std::fill_n(casterMask, casterMaskSize * cascadeCount, 0);
+    Culler::result_type* casterMasks[CONFIG_MAX_SHADOW_CASCADES];
+    for (size_t i = 0; i < CONFIG_MAX_SHADOW_CASCADES; i++) {
+        casterMasks[i] = casterMask + (i < cascadeCount ? i * casterMaskSize : 0);
+    }
+
+    const bool smallFeatureCulling = mSmallFeatureCulling > 0.0f && isCullingEnabled();
+    // Camera culling, shadow casters culling and light culling are independent
+    auto cameraCulling = [this, &engine, &js, &renderableData, smallFeatureCulling,
+            &cullingProjection, &cullingView]() {
+        /*
+         * Culling: as soon as possible we perform our camera-culling
+         * (this will set the VISIBLE_RENDERABLE bit)
+         */
+
+        prepareVisibleRenderables(js, renderableData);
+
+        /*
+         * PVS culling: hide the renderables that can't be seen from the camera's cell
+         * (this will clear the VISIBLE_RENDERABLE bit)
+         */
+
+        mPvsCulledCount = 0;
+        if (mPvs.isValid() && isCullingEnabled()) {
+            cullWithPvs(engine, renderableData, mCullingCamera->getPosition());
+        }
+
+        /*
+         * Small feature culling: find the renderables that are large enough on screen
+         * (this will set the LARGE_ENOUGH bit)
+         */
+
+        if (smallFeatureCulling) {
+            cullSmallFeatures(js, renderableData, cullingProjection, cullingView);
+        }
+
+        /*
+         * Occlusion culling: hide the renderables that are behind occluders
+         * (this will clear the VISIBLE_RENDERABLE bit)
+         */
+
+        mOcclusionCulledCount = 0;
+        if (mOcclusionCulling && isCullingEnabled()) {
+            cullOccludedRenderables(js, renderableData, cullingProjection * cullingView);
+        }
+    };
+
+    /*
+     * Shadowing: compute the shadow cameras and cull shadow casters
+     * (this will set the VISIBLE_CASCADE bits of casterMasks)
+     */
+
+    auto shadowCulling = [this, &engine, &renderableData, &lightData, &casterMasks]() {
+        prepareShadowing(engine, renderableData, lightData, casterMasks);
+    };
 
     /*
-     * Shadowing: compute the shadow camera and cull shadow casters
-     * (this will set the VISIBLE_SHADOW_CASTER bit)
+     * Light culling
      */
 
-    prepareShadowing(engine, driver, renderableData, scene->getLightData());
+    auto lightCulling = [this, &engine, &lightData]() {
+        prepareVisibleLights(engine, lightData);
+    };
+
+    { // scope for the timing
+        CpuStageTimings::Scope timing(CpuStageTimings::CULLING);
+        auto cullingJob = js.createJob();
+        js.setName(cullingJob, "FView::culling");
+        js.runAndRelease(jobs::createJob(js, cullingJob, std::ref(cameraCulling)),
+                JobSystem::DONT_SIGNAL);
+        js.runAndRelease(jobs::createJob(js, cullingJob, std::ref(shadowCulling)),
+                JobSystem::DONT_SIGNAL);
+        js.runAndRelease(jobs::createJob(js, cullingJob, std::ref(lightCulling)),
+                JobSystem::DONT_SIGNAL);
+        js.run(cullingJob);
+        js.waitAndRelease(cullingJob);
+    }
 
     /*
-     * partition the array of renderable w.r.t their visibility:
-     *
-     * Sort the SoA so that invisible objects are first, then renderables,
-     * then both renderable and casters, then casters only -- this operation is somewhat heavy
-     * as it sorts the whole SoA. We use std::partition instead of sort(), which gives us
-     * O(3.N) instead of O(N.log(N)) application of swap().
+     * Spot light shadows: pick the shadowed spot lights among the visible lights and cull
+     * their shadow casters (this will set the bits of spotCasterMasks)
      */
 
-    // calculate the sorting key for all elements, based on their visibility
-    uint8_t const* layers = renderableData.data<FScene::LAYERS>();
-    auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
-    computeVisibilityMasks(getVisibleLayers(), layers, visibility, cullingMask.begin(),
-            renderableData.size());
-
-    auto const beginRenderables = renderableData.begin();
-    auto beginCasters = partition(beginRenderables, renderableData.end(), VISIBLE_RENDERABLE);
-    auto beginCastersOnly = partition(beginCasters, renderableData.end(), VISIBLE_ALL);
-    auto endCastersOnly = partition(beginCastersOnly, renderableData.end(), VISIBLE_SHADOW_CASTER);
-
-    // convert to indices
-    uint32_t iEnd = uint32_t(endCastersOnly - beginRenderables);
-    mVisibleRenderables = Range{ 0, uint32_t(beginCastersOnly - beginRenderables) };
-    mVisibleShadowCasters = Range{ uint32_t(beginCasters - beginRenderables), iEnd };
-    Range merged = { 0, iEnd };
+    Culler::result_type* spotCasterMasks[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    prepareSpotShadowing(engine, arena, renderableData, lightData, spotCasterMasks);
 
-    // update those UBOs
-    scene->updateUBOs(merged);
+    prepareShadowMap(engine, driver);
 
     /*
-     * Light culling
+     * partition the array of renderable w.r.t their visibility:
      *
-     * TODO: this could be done in parallel with culling above
+     * Sort the SoA so that renderables are first, then both renderable and casters, then casters
+     * only, then invisible objects -- this operation is somewhat heavy as it sorts the whole
+     * SoA. The order is computed once and then each array is gathered separately, which moves
+     * each element once, instead of the O(3.N) swap() of the rows std::partition would do.
+     * Rows that are already in place, e.g. when the visibility didn't change since the last
+     * frame, are not moved at all.
      */
 
-    prepareVisibleLights(engine.getLightManager(), js, scene->getLightData());
+    uint32_t ends[3];
+    {
+        CpuStageTimings::Scope timing(CpuStageTimings::PARTITION);
+
+        // calculate the sorting key for all elements, based on their visibility
+        uint8_t const* layers = renderableData.data<FScene::LAYERS>();
+        auto const* visibility = renderableData.data<FScene::VISIBILITY_STATE>();
+        const uint8_t allSpotShadows =
+                uint8_t((1u << mSpotShadowAtlas.getShadowMapCount()) - 1u);
+        computeVisibilityMasks(getVisibleLayers(), smallFeatureCulling, layers, visibility,
+                cullingMask.begin(), casterMasks,
+                renderableData.data<FScene::SPOT_SHADOW_MASK>(), spotCasterMasks,
+                allSpotShadows, renderableData.size());
+
+        // this needs the final visibility of the renderables
+        mDrawBudgetCulledCount = 0;
+        if (mDrawBudget && isCullingEnabled()) {
+            applyDrawBudget(engine, arena, renderableData, cullingProjection * cullingView);
+        }
+
+        partition(js, arena, renderableData, ends);
+    }
+    const uint32_t beginCasters = ends[0];
+    const uint32_t beginCastersOnly = ends[1];
+    const uint32_t iEnd = ends[2];
+    mVisibleRenderables = Range{ 0, beginCastersOnly };
+    mVisibleShadowCasters = Range{ beginCasters, iEnd };
+    engine.debug.stats.visible_renderables += int(beginCastersOnly);
+    engine.debug.stats.culled_renderables += int(renderableData.size() - beginCastersOnly);
+    Range merged = { 0, iEnd };
+
+    prepareDepthPrepass(engine, arena, renderableData, cullingProjection, cullingView);
+
+    // the low resolution blending pass is only needed when a visible renderable uses it
+    mHasLowResolutionBlending = false;
+    if (mBlendingDownsampling > 1 && mHasPostProcessPass && mSampleCount <= 1 && !isStereo()) {
+        auto const* visibleState = renderableData.data<FScene::VISIBILITY_STATE>();
+        for (uint32_t i : mVisibleRenderables) {
+            if (visibleState[i].lowResolutionBlending) {
+                mHasLowResolutionBlending = true;
+                break;
+            }
+        }
+    }
+
+    // update those UBOs, they're all uploaded in a single buffer, which only grows
+    const size_t renderableUbSize = merged.last * FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
+    if (UTILS_UNLIKELY(renderableUbSize > mRenderableUbSize)) {
+        if (mRenderableUbh) {
+            driver.destroyUniformBuffer(mRenderableUbh);
+        }
+        // leave some room to not reallocate each time a few renderables become visible
+        mRenderableUbSize = renderableUbSize + renderableUbSize / 2;
+        mRenderableUbh = driver.createUniformBuffer(mRenderableUbSize);
+        mRenderableUbContent.uniforms = UniformBuffer(mRenderableUbSize);
+        mRenderableUbContent.instances.clear();
+    }
+    if (renderableUbSize) {
+        scene->updateUBOs(merged, mRenderableUbh, mRenderableUbContent);
+    }
 
     /*
      * Prepare lighting -- this is where we update the lights UBOs, set-up the IBL,
@@ -512,31 +1026,217 @@ void FView::prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& aren
     float fraction = (engine.getTime().count() % 1000000000) / 1000000000.0f;
     getUb().setUniform(offsetof(FEngine::PerViewUib, time), fraction);
 
-    // upload the renderables's dirty UBOs
-    engine.getRenderableManager().prepare(driver,
-            renderableData.data<FScene::RENDERABLE_INSTANCE>(), merged);
+    // upload the renderables's dirty bones
+    engine.getRenderableManager().prepare(driver);
+
+    // bake the color grading LUT, if its options changed
+    if (mHasPostProcessPass) {
+        mColorGrading.prepare(driver);
+    }
 
     // set uniforms and samplers
     bindPerViewUniformsAndSamplers(driver);
 }
 
+void FView::prepareStereoCameras(mat4f const& worldOriginScene) noexcept {
+    for (size_t i = 0; i < CONFIG_STEREO_EYE_COUNT; i++) {
+        FCamera const* const eye = mStereoCameras[i];
+        const mat4f model{ worldOriginScene * eye->getModelMatrix() };
+        mEyeCameraInfo[i] = CameraInfo{
+                .projection         = mat4f{ eye->getProjectionMatrix() },
+                .cullingProjection  = mat4f{ eye->getCullingProjectionMatrix() },
+                .model              = model,
+                .view               = FCamera::getViewMatrix(model),
+                .zn                 = eye->getNear(),
+                .zf                 = eye->getCullingFar(),
+                .ev100              = Exposure::ev100(*eye),
+                .worldOrigin        = worldOriginScene
+        };
+    }
+
+    /*
+     * The union of the frustums of the eyes is the frustum of a camera between them, moved
+     * back until its sides contain the outer sides of both eyes. This assumes the eyes are
+     * parallel, and side by side in the view space of the left eye.
+     */
+    CameraInfo const& left = mEyeCameraInfo[0];
+    CameraInfo const& right = mEyeCameraInfo[1];
+
+    // the tangents of the left, right, bottom and top sides of a perspective projection
+    auto getTangents = [](mat4f const& p) {
+        return float4{
+                (p[2][0] - 1.0f) / p[0][0], (p[2][0] + 1.0f) / p[0][0],
+                (p[2][1] - 1.0f) / p[1][1], (p[2][1] + 1.0f) / p[1][1] };
+    };
+    const float4 tl = getTangents(left.cullingProjection);
+    const float4 tr = getTangents(right.cullingProjection);
+    const float4 t{ std::min(tl.x, tr.x), std::max(tl.y, tr.y),
+                    std::min(tl.z, tr.z), std::max(tl.w, tr.w) };
+
+    // the right eye in the view space of the left eye
+    const float3 d = (left.view * float4{ right.getPosition(), 1.0f }).xyz;
+    const float h = 0.5f * length(d);
+    const float back = h * std::max(
+            1.0f / std::max(-t.x, FLT_EPSILON), 1.0f / std::max(t.y, FLT_EPSILON));
+
+    const float n = std::min(left.zn, right.zn) + back;
+    const float f = std::max(left.zf, right.zf) + back;
+    mat4f projection = mat4f::frustum(t.x * n, t.y * n, t.z * n, t.w * n, n, f);
+    const mat4f cullingProjection = projection;
+    projection[2][2] = -1.0f;       // far at infinity, like FCamera::setProjection()
+    projection[3][2] = -2.0f * n;
+
+    const float3 position{ 0.5f * d + float3{ 0.0f, 0.0f, back } };
+    const mat4f model{ left.model * mat4f::translate(float4{ position, 1.0f }) };
+    mViewingCameraInfo = CameraInfo{
+            .projection         = projection,
+            .cullingProjection  = cullingProjection,
+            .model              = model,
+            .view               = FCamera::getViewMatrix(model),
+            .zn                 = n,
+            .zf                 = f,
+            .ev100              = left.ev100,
+            .worldOrigin        = worldOriginScene
+    };
+}
+
+void FView::prepareStereoRenderTarget(DriverApi& driver) noexcept {
+    Handle<HwTexture> color = mStereoTarget->getHwHandle();
+    if (mStereoRenderTarget && mStereoColor == color) {
+        return;
+    }
+    destroyStereoRenderTarget(driver);
+
+    // the eyes share a layered depth buffer, like their color
+    const uint32_t width = uint32_t(mStereoTarget->getWidth());
+    const uint32_t height = uint32_t(mStereoTarget->getHeight());
+    mStereoColor = color;
+    mStereoDepth = driver.createTexture(SamplerType::SAMPLER_2D_ARRAY, 1, TextureFormat::DEPTH24,
+            1, width, height, CONFIG_STEREO_EYE_COUNT, TextureUsage::DEPTH_ATTACHMENT);
+    mStereoRenderTarget = driver.createRenderTarget(
+            TargetBufferFlags::COLOR_AND_DEPTH, width, height, 1,
+            mStereoTarget->getFormat(),
+            { color, 0, 0, CONFIG_STEREO_EYE_COUNT },
+            { mStereoDepth, 0, 0, CONFIG_STEREO_EYE_COUNT }, {});
+}
+
+void FView::destroyStereoRenderTarget(DriverApi& driver) noexcept {
+    if (mStereoRenderTarget) {
+        driver.destroyRenderTarget(mStereoRenderTarget);
+        driver.destroyTexture(mStereoDepth);
+        mStereoRenderTarget = {};
+        mStereoDepth = {};
+        mStereoColor = {};
+    }
+}
+
+// The radical inverse of i in base b, the Halton sequence of bases 2 and 3 covers a pixel
+// evenly in a few samples
+static float halton(uint32_t i, uint32_t b) noexcept {
+    float f = 1.0f;
+    float r = 0.0f;
+    while (i > 0) {
+        f /= float(b);
+        r += f * float(i % b);
+        i /= b;
+    }
+    return r;
+}
+
+void FView::prepareTemporal(Viewport const& viewport) noexcept {
+    CameraInfo& camera = mViewingCameraInfo;
+
+    // the resolve reprojects the fragments' centers, without this frame's jitter
+    const mat4 clipFromWorld = mat4{ camera.projection } * mat4{ camera.view };
+    mTemporalReprojection = mat4f{ mTemporalClipFromWorld * inverse(clipFromWorld) };
+    mTemporalClipFromWorld = clipFromWorld;
+
+    // The projection is offset by a subpixel jitter, cycling through 8 samples. It moves the
+    // clip space by a multiple of w, so it works for orthographic projections too.
+    mTemporalSample = (mTemporalSample + 1) % 8;
+    mTemporalJitter = float2{
+            halton(mTemporalSample + 1, 2), halton(mTemporalSample + 1, 3) } - 0.5f;
+    const float2 offset = 2.0f * mTemporalJitter / float2{ viewport.width, viewport.height };
+    camera.projection = mat4f::translate(float4{ offset, 0.0f, 1.0f }) * camera.projection;
+}
+
+void FView::prepareTemporalHistory(DriverApi& driver,
+        uint32_t width, uint32_t height, TextureFormat format) noexcept {
+    const bool valid = mTemporalHistory[0].target &&
+            width == mTemporalWidth && height == mTemporalHeight && format == mTemporalFormat;
+    if (!valid) {
+        destroyTemporalHistory(driver);
+        for (TemporalHistory& history : mTemporalHistory) {
+            history.texture = driver.createTexture(SamplerType::SAMPLER_2D, 1, format, 1,
+                    width, height, 1, TextureUsage::COLOR_ATTACHMENT);
+            history.target = driver.createRenderTarget(TargetBufferFlags::COLOR,
+                    width, height, 1, format, { history.texture }, {}, {});
+        }
+        mTemporalWidth = width;
+        mTemporalHeight = height;
+        mTemporalFormat = format;
+    }
+    mTemporalHistoryValid = valid;
+    mTemporalHistoryIndex ^= 1u;
+}
+
+void FView::destroyTemporalHistory(DriverApi& driver) noexcept {
+    if (mTemporalHistory[0].target) {
+        for (TemporalHistory& history : mTemporalHistory) {
+            driver.destroyRenderTarget(history.target);
+            driver.destroyTexture(history.texture);
+            history = {};
+        }
+        mTemporalHistoryValid = false;
+    }
+}
+
 void FView::computeVisibilityMasks(
-        uint8_t visibleLayers,
+        uint8_t visibleLayers, bool smallFeatureCulling,
         uint8_t const* UTILS_RESTRICT layers,
         FRenderableManager::Visibility const* UTILS_RESTRICT visibility,
-        uint8_t* UTILS_RESTRICT visibleMask, size_t count) const {
+        uint8_t* UTILS_RESTRICT visibleMask,
+        uint8_t const* const* casterMasks, uint8_t* UTILS_RESTRICT spotShadowMask,
+        uint8_t const* const* spotCasterMasks, uint8_t allSpotShadows, size_t count) const {
+    static_assert(CONFIG_MAX_SHADOW_CASCADES == 4, "update computeVisibilityMasks()");
+    static_assert(CONFIG_MAX_SHADOWED_SPOT_LIGHTS == 8, "update computeVisibilityMasks()");
+    uint8_t const* UTILS_RESTRICT casterMask0 = casterMasks[0];
+    uint8_t const* UTILS_RESTRICT casterMask1 = casterMasks[1];
+    uint8_t const* UTILS_RESTRICT casterMask2 = casterMasks[2];
+    uint8_t const* UTILS_RESTRICT casterMask3 = casterMasks[3];
+    uint8_t const* UTILS_RESTRICT spotMask0 = spotCasterMasks[0];
+    uint8_t const* UTILS_RESTRICT spotMask1 = spotCasterMasks[1];
+    uint8_t const* UTILS_RESTRICT spotMask2 = spotCasterMasks[2];
+    uint8_t const* UTILS_RESTRICT spotMask3 = spotCasterMasks[3];
+    uint8_t const* UTILS_RESTRICT spotMask4 = spotCasterMasks[4];
+    uint8_t const* UTILS_RESTRICT spotMask5 = spotCasterMasks[5];
+    uint8_t const* UTILS_RESTRICT spotMask6 = spotCasterMasks[6];
+    uint8_t const* UTILS_RESTRICT spotMask7 = spotCasterMasks[7];
+
     // __restrict__ seems to only be taken into account as function parameters. This is very
     // important here, otherwise, this loop doesn't get vectorized.
     // This is vectorized 16x.
     count = (count + 0xF) & ~0xF; // capacity guaranteed to be multiple of 16
     for (size_t i = 0; i < count; ++i) {
+        Culler::result_type cascades =
+                casterMask0[i] | casterMask1[i] | casterMask2[i] | casterMask3[i];
+        Culler::result_type spots =
+                spotMask0[i] | spotMask1[i] | spotMask2[i] | spotMask3[i] |
+                spotMask4[i] | spotMask5[i] | spotMask6[i] | spotMask7[i];
+        spots &= allSpotShadows; // the unused shadow maps share the first array
         Culler::result_type mask = visibleMask[i];
         FRenderableManager::Visibility v = visibility[i];
         bool inVisibleLayer = layers[i] & visibleLayers;
-        bool visRenderables   = (!v.culling || (mask & VISIBLE_RENDERABLE))    && inVisibleLayer;
-        bool visShadowCasters = (!v.culling || (mask & VISIBLE_SHADOW_CASTER)) && inVisibleLayer && v.castShadows;
+        bool largeEnough = !smallFeatureCulling || !v.smallFeatureCulling || (mask & LARGE_ENOUGH);
+        bool visRenderables   = (!v.culling || ((mask & VISIBLE_RENDERABLE) && largeEnough)) && inVisibleLayer;
+        bool visShadowCasters = (!v.culling || (cascades & VISIBLE_CASCADES) || spots) && inVisibleLayer && v.castShadows;
+        // renderables that aren't culled are in all cascades and spot light shadow maps
+        cascades = v.culling ? cascades : VISIBLE_CASCADES;
+        spots = v.culling ? spots : allSpotShadows;
         visibleMask[i] = Culler::result_type(visRenderables) |
-                         Culler::result_type(visShadowCasters << 1);
+                         Culler::result_type(visShadowCasters << 1) |
+                         Culler::result_type(visShadowCasters ? cascades : 0);
+        spotShadowMask[i] = Culler::result_type(visShadowCasters ? spots : 0);
     }
 }
 
@@ -546,10 +1246,110 @@ UTILS_NOINLINE
         FScene::RenderableSoa::iterator end,
         uint8_t mask) noexcept {
     return std::partition(begin, end, [mask](auto it) {
-        return it.template get<FScene::VISIBLE_MASK>() == mask;
+        return (it.template get<FScene::VISIBLE_MASK>() & VISIBLE_ALL) == mask;
     });
 }
 
+template<size_t ... Is>
+static void gatherArrays(FScene::RenderableSoa& soa, uint32_t const* order,
+        size_t first, size_t count, void* scratch, std::index_sequence<Is...>) noexcept {
+    int UTILS_UNUSED dummy[] = { (soa.template gather<Is>(order, first, count, scratch), 0)... };
+}
+
+template<size_t ... Is>
+static void gatherArrays(JobSystem& js, FScene::RenderableSoa& soa, uint32_t const* order,
+        size_t first, size_t count, void* scratch, std::index_sequence<Is...>) noexcept {
+    auto parent = js.createJob();
+    int UTILS_UNUSED dummy[] = {
+            (js.runAndRelease(js.createJob(parent,
+                    [&soa, order, first, count, scratch](JobSystem&, JobSystem::Job*) {
+                        soa.template gather<Is>(order, first, count, scratch);
+                    }), JobSystem::DONT_SIGNAL), 0)... };
+    js.runAndWait(parent);
+    js.release(parent);
+}
+
+/* static */ void FView::partition(JobSystem& js, ArenaScope& arena,
+        FScene::RenderableSoa& renderableData, uint32_t ends[3]) noexcept {
+    SYSTRACE_CALL();
+    using RenderableSoa = FScene::RenderableSoa;
+
+    // below this, the jobs cost more than they save
+    static constexpr size_t PARALLEL_GATHER_THRESHOLD = 1024;
+
+    // this scope's memory is reused right away (e.g. by the froxelizer)
+    ArenaScope scope(arena.getAllocator());
+    const size_t count = renderableData.size();
+    uint8_t* const buckets = scope.allocate<uint8_t>(count);
+    uint32_t* const order = scope.allocate<uint32_t>(count);
+    void* const scratch = scope.allocate(RenderableSoa::getScratchSize(count),
+            alignof(std::max_align_t));
+
+    if (UTILS_UNLIKELY(!count || !buckets || !order || !scratch)) {
+        // the arena is too small, partition the rows in place
+        auto const begin = renderableData.begin();
+        auto beginCasters = partition(begin, renderableData.end(), VISIBLE_RENDERABLE);
+        auto beginCastersOnly = partition(beginCasters, renderableData.end(), VISIBLE_ALL);
+        auto endCastersOnly = partition(beginCastersOnly, renderableData.end(),
+                VISIBLE_SHADOW_CASTER);
+        ends[0] = uint32_t(beginCasters - begin);
+        ends[1] = uint32_t(beginCastersOnly - begin);
+        ends[2] = uint32_t(endCastersOnly - begin);
+        return;
+    }
+
+    // bucket of each value of (VISIBLE_MASK & VISIBLE_ALL), in the order described in prepare()
+    static constexpr uint8_t BUCKETS[4] = { 3, 0, 2, 1 };
+    static_assert(VISIBLE_RENDERABLE == 1 && VISIBLE_SHADOW_CASTER == 2, "BUCKETS is wrong");
+
+    uint8_t const* const UTILS_RESTRICT visibleMask =
+            renderableData.data<FScene::VISIBLE_MASK>();
+    for (size_t i = 0; i < count; i++) {
+        buckets[i] = BUCKETS[visibleMask[i] & VISIBLE_ALL];
+    }
+
+    uint32_t bucketEnds[4];
+    RenderableSoa::computePartitionOrder<4>(buckets, count, order, bucketEnds);
+    std::copy_n(bucketEnds, 3, ends);
+
+    // The rows are left partitioned for the next frame and the partition is stable, so when
+    // the visibility doesn't change, they stay where they are. We only move the rows between
+    // the first and the last that change place, which makes the SoA effectively persistent.
+    uint32_t first = 0;
+    uint32_t last = uint32_t(count);
+    while (first < last && order[first] == first) {
+        first++;
+    }
+    while (last > first && order[last - 1] == last - 1) {
+        last--;
+    }
+    if (first == last) {
+        return;
+    }
+
+    // the rows outside of [first, last) don't move, so order maps [first, last) onto itself
+    uint32_t* const window = order + first;
+    const uint32_t windowSize = last - first;
+    for (size_t i = 0; i < windowSize; i++) {
+        window[i] -= first;
+    }
+
+    // The per-frame temporaries, the last arrays of the SoA, are rewritten for the visible rows
+    // after the partition, so only the arrays before them are moved.
+    using PersistentArrays = std::make_index_sequence<FScene::PRIMITIVES>;
+    if (windowSize >= PARALLEL_GATHER_THRESHOLD) {
+        gatherArrays(js, renderableData, window, first, windowSize, scratch, PersistentArrays());
+    } else {
+        gatherArrays(renderableData, window, first, windowSize, scratch, PersistentArrays());
+    }
+}
+
+void FView::prepareDownsampledCamera(const CameraInfo& camera, const Viewport& viewport,
+        float factor) const noexcept {
+    prepareCamera(camera, viewport);
+    mFroxelizer.updateUniforms(getUb(), factor);
+}
+
 void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept {
     SYSTRACE_CALL();
 
@@ -583,10 +1383,28 @@ void FView::prepareCamera(const CameraInfo& camera, const Viewport& viewport) co
     u.setUniform(offsetof(FEngine::PerViewUib, origin), float2{ viewport.left, viewport.bottom });
 
     u.setUniform(offsetof(FEngine::PerViewUib, cameraPosition), float3{camera.getPosition()});
+
+    if (UTILS_UNLIKELY(isStereo())) {
+        // the eyes are only used by the stereo variants, in the color pass
+        mat4f eyeClipFromWorld[CONFIG_STEREO_EYE_COUNT];
+        float4 eyePosition[CONFIG_STEREO_EYE_COUNT];
+        for (size_t i = 0; i < CONFIG_STEREO_EYE_COUNT; i++) {
+            CameraInfo const& eye = mEyeCameraInfo[i];
+            const mat4f eyeClipFromView(
+                    mClipSpace01 ? correction * eye.projection : eye.projection);
+            eyeClipFromWorld[i] = eyeClipFromView * eye.view;
+            eyePosition[i] = float4{ eye.getPosition(), 1.0f };
+        }
+        u.setUniformArray(offsetof(FEngine::PerViewUib, eyeClipFromWorldMatrix),
+                eyeClipFromWorld, CONFIG_STEREO_EYE_COUNT);
+        u.setUniformArray(offsetof(FEngine::PerViewUib, eyeCameraPosition),
+                eyePosition, CONFIG_STEREO_EYE_COUNT);
+    }
 }
 
 void FView::froxelize(FEngine& engine) const noexcept {
     SYSTRACE_CALL();
+    CpuStageTimings::Scope timing(CpuStageTimings::FROXELIZATION);
 
     if (mHasDynamicLighting) {
         // froxelize lights
@@ -594,8 +1412,10 @@ void FView::froxelize(FEngine& engine) const noexcept {
     }
 }
 
-void FView::commitUniforms(driver::DriverApi& driverApi) const noexcept {
+void FView::commitUniforms(FEngine& engine) const noexcept {
+    driver::DriverApi& driverApi = engine.getDriverApi();
     if (mPerViewUb.isDirty()) {
+        engine.countUniformUpdate(mPerViewUb);
         driverApi.updateUniformBuffer(mPerViewUbh, UniformBuffer(mPerViewUb));
         mPerViewUb.clean();
     }
@@ -617,7 +1437,8 @@ void FView::prepareVisibleRenderables(JobSystem& js,
         FScene::RenderableSoa& renderableData) const noexcept {
     SYSTRACE_CALL();
     if (UTILS_LIKELY(isCullingEnabled())) {
-        cullRenderables(js, renderableData, mCullingFrustum, VISIBLE_RENDERABLE_BIT);
+        cullRenderables(js, *mScene, renderableData, mCullingFrustum,
+                renderableData.data<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE_BIT);
     } else {
         std::fill(renderableData.begin<FScene::VISIBLE_MASK>(),
                   renderableData.end<FScene::VISIBLE_MASK>(), VISIBLE_RENDERABLE);
@@ -626,17 +1447,26 @@ void FView::prepareVisibleRenderables(JobSystem& js,
 
 UTILS_NOINLINE
 void FView::prepareVisibleShadowCasters(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum) const noexcept {
+        FScene::RenderableSoa& renderableData, Frustum const& lightFrustum,
+        Culler::result_type* casterMask, size_t bit) const noexcept {
     SYSTRACE_CALL();
-    cullRenderables(js, renderableData, lightFrustum, VISIBLE_SHADOW_CASTER_BIT);
+    cullRenderables(js, *mScene, renderableData, lightFrustum, casterMask, bit);
 }
 
-void FView::cullRenderables(JobSystem& js,
-        FScene::RenderableSoa& renderableData, Frustum const& frustum, size_t bit) noexcept {
+void FView::cullRenderables(JobSystem& js, FScene const& scene,
+        FScene::RenderableSoa& renderableData, Frustum const& frustum,
+        Culler::result_type* results, size_t bit) noexcept {
 
     float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
     float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
-    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    uint8_t     * visibleArray    = results;
+
+    BoundingVolumeHierarchy const* const bvh = scene.getRenderableBvh();
+    if (bvh) {
+        bvh->cull(js, frustum, worldAABBCenter, worldAABBExtent, scene.getRenderableBvhRows(),
+                visibleArray, bit);
+        return;
+    }
 
     // culling job (this runs on multiple threads)
     auto functor = [&frustum, worldAABBCenter, worldAABBExtent, visibleArray, bit]
@@ -651,73 +1481,513 @@ void FView::cullRenderables(JobSystem& js,
     // launch the computation on multiple threads
     auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
             std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
-    js.runAndWait(job);
+    js.setName(job, "FView::cullRenderables");
+    js.run(job);
+    js.waitAndRelease(job);
+}
+
+void FView::cullSmallFeatures(JobSystem& js, FScene::RenderableSoa& renderableData,
+        mat4f const& projection, mat4f const& view) const noexcept {
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // clip-space w, and the (largest) number of pixels per clip-space unit at w = 1. The size
+    // is measured in the View's viewport, regardless of dynamic resolution.
+    Viewport const& viewport = mViewport;
+    const mat4f viewProjection = projection * view;
+    const float4 w{ viewProjection[0].w, viewProjection[1].w,
+                    viewProjection[2].w, viewProjection[3].w };
+    const float scale = 0.5f * std::max(
+            std::abs(projection[0].x) * viewport.width,
+            std::abs(projection[1].y) * viewport.height);
+    const float minSize = mSmallFeatureCulling;
+
+    // culling job (this runs on multiple threads)
+    auto functor = [worldAABBCenter, worldAABBExtent, visibleArray, w, scale, minSize]
+            (uint32_t index, uint32_t c) {
+        Culler::largerThan(
+                visibleArray + index,
+                w, scale, minSize,
+                worldAABBCenter + index,
+                worldAABBExtent + index, c, LARGE_ENOUGH_BIT);
+    };
+
+    // launch the computation on multiple threads
+    auto job = jobs::parallel_for(js, nullptr, 0, (uint32_t)renderableData.size(),
+            std::ref(functor), jobs::CountSplitter<Culler::MODULO * Culler::MIN_LOOP_COUNT_HINT, 8>());
+    js.setName(job, "FView::cullSmallFeatures");
+    js.run(job);
+    js.waitAndRelease(job);
+}
+
+void FView::applyDrawBudget(FEngine& engine, ArenaScope& arena,
+        FScene::RenderableSoa& renderableData, mat4f const& viewProjection) noexcept {
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    auto const*   instances       = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const*   visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t const* visibleArray   = renderableData.data<FScene::VISIBLE_MASK>();
+    const uint32_t count = uint32_t(renderableData.size());
+
+    // The levels of detail aren't picked yet, but they all have the same number of primitives.
+    uint32_t primitiveCount = 0;
+    uint32_t candidateCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if (visibleArray[i] & VISIBLE_RENDERABLE) {
+            primitiveCount += uint32_t(rcm.getPrimitiveCount(instances[i], 0));
+            candidateCount += visibility[i].culling ? 1 : 0;
+        }
+    }
+    if (primitiveCount <= mDrawBudget) {
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    uint8_t*      visibleMask     = renderableData.data<FScene::VISIBLE_MASK>();
+
+    // The least important renderables are sorted first: the highest priority value, then the
+    // smallest projected bounding sphere (the same estimate as cullSmallFeatures()).
+    struct Candidate {
+        uint32_t index;
+        uint8_t priority;
+        float size;
+    };
+    const float4 w{ viewProjection[0].w, viewProjection[1].w,
+                    viewProjection[2].w, viewProjection[3].w };
+    Candidate* const candidates = arena.allocate<Candidate>(candidateCount);
+    if (UTILS_UNLIKELY(!candidates)) {
+        // the per-frame arena is exhausted, everything is drawn this frame
+        return;
+    }
+    for (uint32_t i = 0, c = 0; i < count; i++) {
+        if ((visibleArray[i] & VISIBLE_RENDERABLE) && visibility[i].culling) {
+            const float radius = length(worldAABBExtent[i]);
+            const float cw = dot(w.xyz, worldAABBCenter[i]) + w.w;
+            const float size = cw > radius ? radius / cw : FLT_MAX;
+            candidates[c++] = { i, visibility[i].priority, size };
+        }
+    }
+    std::sort(candidates, candidates + candidateCount,
+            [](Candidate const& lhs, Candidate const& rhs) {
+                return lhs.priority != rhs.priority ?
+                        lhs.priority > rhs.priority : lhs.size < rhs.size;
+            });
+
+    uint32_t culled = 0;
+    for (uint32_t c = 0; c < candidateCount && primitiveCount > mDrawBudget; c++) {
+        const uint32_t i = candidates[c].index;
+        primitiveCount -= uint32_t(rcm.getPrimitiveCount(instances[i], 0));
+        visibleMask[i] &= ~VISIBLE_RENDERABLE;
+        culled++;
+    }
+    mDrawBudgetCulledCount = culled;
 }
 
-void FView::prepareVisibleLights(FLightManager& lcm, utils::JobSystem&, FScene::LightSoa& lightData) const {
+void FView::prepareDepthPrepass(FEngine& engine, ArenaScope& arena,
+        FScene::RenderableSoa& renderableData,
+        mat4f const& projection, mat4f const& view) noexcept {
+    mDepthPrepassLimited = false;
+    if (mDepthPrepass != DepthPrepass::DEFAULT) {
+        mUseDepthPrepass = mDepthPrepass == DepthPrepass::ENABLED;
+        return;
+    }
+
+    SYSTRACE_CALL();
+
+    // the levels of detail aren't picked yet (and the partition doesn't move the PRIMITIVES),
+    // the first level is representative of the renderable's materials
+    FRenderableManager const& rcm = engine.getRenderableManager();
+    Range const vr = mVisibleRenderables;
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const*   instances       = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto*         visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+
+    // Same estimate as cullSmallFeatures(): the projected bounding sphere of each renderable,
+    // here as a fraction of the viewport's area. Their sum is the overdraw.
+    Viewport const& viewport = mViewport;
+    const mat4f viewProjection = projection * view;
+    const float4 w{ viewProjection[0].w, viewProjection[1].w,
+                    viewProjection[2].w, viewProjection[3].w };
+    const float scale = 0.5f * std::max(
+            std::abs(projection[0].x) * viewport.width,
+            std::abs(projection[1].y) * viewport.height);
+    const float areaScale = float(M_PI) * scale * scale /
+            std::max(1.0f, float(viewport.width) * float(viewport.height));
+
+    float* const areas = arena.allocate<float>(vr.size());
+    float overdraw = 0.0f;
+    for (uint32_t i = vr.first; i < vr.last; i++) {
+        // only the renderables which can write in the depth prepass count
+        bool opaque = false;
+        for (FRenderPrimitive const& primitive : rcm.getRenderPrimitives(instances[i], 0)) {
+            Driver::RasterState const rs =
+                    primitive.getMaterialInstance()->getMaterial()->getRasterState();
+            opaque |= rs.depthWrite && !rs.alphaToCoverage && !rs.hasBlending();
+        }
+        const float radius = length(worldAABBExtent[i]);
+        const float cw = dot(w.xyz, worldAABBCenter[i]) + w.w;
+        // boxes around, or behind the camera cover the whole viewport
+        const float area = !opaque ? 0.0f :
+                cw > radius ? std::min(1.0f, areaScale * (radius * radius) / (cw * cw)) : 1.0f;
+        areas[i - vr.first] = area;
+        overdraw += area;
+    }
+    mOverdraw = overdraw;
+
+    if (!mUseDepthPrepass && overdraw > DEPTH_PREPASS_ENABLE_OVERDRAW) {
+        mUseDepthPrepass = true;
+    } else if (mUseDepthPrepass && overdraw < DEPTH_PREPASS_DISABLE_OVERDRAW) {
+        mUseDepthPrepass = false;
+    }
+    if (!mUseDepthPrepass) {
+        return;
+    }
+
+    // the smallest area of the occluders
+    float minArea = 0.0f;
+    if (vr.size() > DEPTH_PREPASS_MAX_OCCLUDERS) {
+        float* const sorted = arena.allocate<float>(vr.size());
+        std::copy_n(areas, vr.size(), sorted);
+        float* const nth = sorted + DEPTH_PREPASS_MAX_OCCLUDERS - 1;
+        std::nth_element(sorted, nth, sorted + vr.size(), std::greater<float>());
+        minArea = *nth;
+    }
+    for (uint32_t i = vr.first; i < vr.last; i++) {
+        const float area = areas[i - vr.first];
+        visibility[i].depthPrepass = area > 0.0f && area >= minArea;
+    }
+    mDepthPrepassLimited = true;
+}
+
+void FView::cullOccludedRenderables(JobSystem& js,
+        FScene::RenderableSoa& renderableData, mat4f const& viewProjection) noexcept {
+    SYSTRACE_CALL();
+
+    float3 const* worldAABBCenter = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    float3 const* worldAABBExtent = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const*   visibility      = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t     * visibleArray    = renderableData.data<FScene::VISIBLE_MASK>();
+    const uint32_t count = uint32_t(renderableData.size());
+
+    // only the visible occluders can hide something
+    OcclusionCuller& culler = mOcclusionCuller;
+    culler.prepare(viewProjection);
+    size_t occluderCount = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        if ((visibleArray[i] & VISIBLE_RENDERABLE) && visibility[i].occluder) {
+            occluderCount += culler.addOccluder(worldAABBCenter[i], worldAABBExtent[i]) ? 1 : 0;
+        }
+    }
+    if (!occluderCount) {
+        return;
+    }
+    culler.buildPyramid();
+
+    // culling job (this runs on multiple threads)
+    std::atomic<uint32_t> culledCount = { 0 };
+    auto functor = [&culler, &culledCount, worldAABBCenter, worldAABBExtent, visibility, visibleArray]
+            (uint32_t index, uint32_t c) {
+        uint32_t culled = 0;
+        for (uint32_t i = index, e = index + c; i < e; i++) {
+            if ((visibleArray[i] & VISIBLE_RENDERABLE) &&
+                    visibility[i].culling && !visibility[i].occluder &&
+                    culler.isOccluded(worldAABBCenter[i], worldAABBExtent[i])) {
+                visibleArray[i] &= ~VISIBLE_RENDERABLE;
+                culled++;
+            }
+        }
+        culledCount.fetch_add(culled, std::memory_order_relaxed);
+    };
+
+    // launch the computation on multiple threads
+    static jobs::AdaptiveSplitter::Cost sOcclusionCullingCost(100.0f);
+    auto job = jobs::parallel_for(js, nullptr, 0, count,
+            std::ref(functor), jobs::AdaptiveSplitter(sOcclusionCullingCost));
+    js.setName(job, "FView::cullOccludedRenderables");
+    js.run(job);
+    js.waitAndRelease(job);
+
+    mOcclusionCulledCount = culledCount.load(std::memory_order_relaxed);
+}
+
+void FView::setPotentiallyVisibleSet(PotentiallyVisibleSet const* pvs,
+        utils::Entity const* entities, size_t count) noexcept {
+    mPvs = pvs ? *pvs : PotentiallyVisibleSet{};
+    count = std::min(count, mPvs.getObjectCount());
+    mPvsEntities.assign(entities, entities + count);
+    mPvsObjectsValid = false;
+    clearCommandCaches();
+}
+
+void FView::cullWithPvs(FEngine& engine, FScene::RenderableSoa& renderableData,
+        float3 const& cameraPosition) noexcept {
+    SYSTRACE_CALL();
+
+    const uint32_t cell = mPvs.getCellAt(cameraPosition);
+    if (cell == PotentiallyVisibleSet::NO_CELL) {
+        return;
+    }
+
+    // the object of each renderable instance only changes with the renderables
+    FRenderableManager& rcm = engine.getRenderableManager();
+    if (!mPvsObjectsValid || mPvsObjectsVersion != rcm.getVersion()) {
+        mPvsObjectsValid = true;
+        mPvsObjectsVersion = rcm.getVersion();
+        mPvsObjects.clear();
+        for (size_t i = 0, c = mPvsEntities.size(); i < c; i++) {
+            FRenderableManager::Instance ri = rcm.getInstance(mPvsEntities[i]);
+            if (ri.isValid()) {
+                if (ri.asValue() >= mPvsObjects.size()) {
+                    mPvsObjects.resize(ri.asValue() + 1, NO_PVS_OBJECT);
+                }
+                mPvsObjects[ri.asValue()] = uint32_t(i);
+            }
+        }
+    }
+
+    // this is a lookup and a bit test per renderable, it's not worth a job
+    uint32_t const* const UTILS_RESTRICT bits = mPvs.getCellBits(cell);
+    uint32_t const* const UTILS_RESTRICT objects = mPvsObjects.data();
+    const size_t objectCount = mPvsObjects.size();
+    auto const* instances     = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* visibility    = renderableData.data<FScene::VISIBILITY_STATE>();
+    uint8_t   * visibleArray  = renderableData.data<FScene::VISIBLE_MASK>();
+    uint32_t culled = 0;
+    for (size_t i = 0, c = renderableData.size(); i < c; i++) {
+        const size_t ri = instances[i].asValue();
+        const uint32_t object = ri < objectCount ? objects[ri] : NO_PVS_OBJECT;
+        if (object != NO_PVS_OBJECT && (visibleArray[i] & VISIBLE_RENDERABLE) &&
+                visibility[i].culling && !((bits[object / 32] >> (object % 32)) & 1u)) {
+            visibleArray[i] &= ~VISIBLE_RENDERABLE;
+            culled++;
+        }
+    }
+    mPvsCulledCount = culled;
+}
+
+void FView::prepareVisibleLights(FEngine& engine, FScene::LightSoa& lightData) const {
+    SYSTRACE_CALL();
+    JobSystem& js = engine.getJobSystem();
 
     auto const* UTILS_RESTRICT sphereArray     = lightData.data<FScene::POSITION_RADIUS>();
-    auto const* UTILS_RESTRICT directions      = lightData.data<FScene::DIRECTION>();
-    auto const* UTILS_RESTRICT instanceArray   = lightData.data<FScene::LIGHT_INSTANCE>();
     auto      * UTILS_RESTRICT visibleArray    = lightData.data<FScene::VISIBILITY>();
 
     Frustum const& frustum = mCullingFrustum;
     Culler::intersects(visibleArray, frustum, sphereArray, lightData.size());
 
-    const float4* const UTILS_RESTRICT planes = frustum.getNormalizedPlanes();
-    // the directional light is considered visible
-    size_t visibleLightCount = FScene::DIRECTIONAL_LIGHTS_COUNT;
     // skip directional light
-    for (size_t i = FScene::DIRECTIONAL_LIGHTS_COUNT; i < lightData.size(); i++) {
-        FLightManager::Instance li = instanceArray[i];
-        if (visibleArray[i]) {
-            if (!lcm.isLightCaster(li)) {
-                visibleArray[i] = 0;
-                continue;
+    const uint32_t first = uint32_t(FScene::DIRECTIONAL_LIGHTS_COUNT);
+    const uint32_t lightCount = uint32_t(lightData.size() - first);
+    if (lightCount) {
+        float4 const* const planes = frustum.getNormalizedPlanes();
+        float3 const* const directions = lightData.data<FScene::DIRECTION>();
+        uint8_t const* const flags = lightData.data<FScene::LIGHT_FLAGS>();
+        float const* const cosOuterSquared = lightData.data<FScene::COS_OUTER_SQUARED>();
+        auto const* const instances = lightData.data<FScene::LIGHT_INSTANCE>();
+        float* const fades = lightData.data<FScene::LIGHT_FADE>();
+        const bool cullSmall = mLightCullingOptions.minContribution > 0.0f;
+        auto work = [=, &engine](uint32_t start, uint32_t count) {
+            cullLights(visibleArray + start, planes, sphereArray + start, directions + start,
+                    flags + start, cosOuterSquared + start, count);
+            if (cullSmall) {
+                cullSmallLights(engine, visibleArray + start, fades + start, sphereArray + start,
+                        instances + start, count);
             }
-            if (lcm.getIntensity(li) <= 0.0f) {
-                visibleArray[i] = 0;
-                continue;
-            }
-            // cull spotlights that cannot possibly intersect the view frustum
-            if (lcm.isSpotLight(li)) {
-                const float3 position = sphereArray[i].xyz;
-                const float3 axis = directions[i];
-                const float cosSqr = lcm.getCosOuterSquared(li);
-                bool invisible = false;
-                for (size_t j = 0; j < 6; ++j) {
-                    const float p = dot(position + planes[j].xyz * planes[j].w, planes[j].xyz);
-                    const float c = dot(planes[j].xyz, axis);
-                    invisible |= ((1.0f - c * c) < cosSqr && c > 0 && p > 0);
-                }
-                if (invisible) {
-                    visibleArray[i] = 0;
-                    continue;
-                }
-            }
-            visibleLightCount++;
-        }
+        };
+        static jobs::AdaptiveSplitter::Cost sLightCullingCost(20.0f);
+        auto job = jobs::parallel_for(js, nullptr, first, lightCount,
+                std::cref(work), jobs::AdaptiveSplitter(sLightCullingCost));
+        js.setName(job, "FView::prepareVisibleLights");
+        js.run(job);
+        js.waitAndRelease(job);
     }
 
-    // Partition array such that all visible lights appear first
-    UTILS_UNUSED_IN_RELEASE auto last =
+    // Partition array such that all visible lights appear first, the directional light is
+    // considered visible
+    auto last =
             std::partition(lightData.begin() + FScene::DIRECTIONAL_LIGHTS_COUNT, lightData.end(),
                     [](auto const& it) {
                         return it.template get<FScene::VISIBILITY>() != 0;
                     });
-    assert(visibleLightCount == size_t(last - lightData.begin()));
 
+    const size_t visibleLightCount = size_t(last - lightData.begin());
     lightData.resize(visibleLightCount);
     mHasDynamicLighting = visibleLightCount > FScene::DIRECTIONAL_LIGHTS_COUNT;
 }
 
-void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo&,
+void FView::cullLights(
+        Culler::result_type* UTILS_RESTRICT visible,
+        float4 const* UTILS_RESTRICT planes,
+        float4 const* UTILS_RESTRICT spheres,
+        float3 const* UTILS_RESTRICT directions,
+        uint8_t const* UTILS_RESTRICT flags,
+        float const* UTILS_RESTRICT cosOuterSquared, size_t count) noexcept {
+    // This is branch-free, so it vectorizes. Lights that don't cast light are rejected, and so
+    // are the spotlights that cannot possibly intersect the view frustum.
+    for (size_t i = 0; i < count; i++) {
+        const float3 position = spheres[i].xyz;
+        const float3 axis = directions[i];
+        const float cosSqr = cosOuterSquared[i];
+        bool invisible = false;
+        #pragma clang loop unroll(full)
+        for (size_t j = 0; j < 6; ++j) {
+            const float p = dot(position + planes[j].xyz * planes[j].w, planes[j].xyz);
+            const float c = dot(planes[j].xyz, axis);
+            invisible |= ((1.0f - c * c) < cosSqr && c > 0 && p > 0);
+        }
+        const bool spot = (flags[i] & FScene::SPOT_LIGHT) != 0;
+        const bool caster = (flags[i] & FScene::LIGHT_CASTER) != 0;
+        visible[i] = Culler::result_type(visible[i] && caster && !(spot && invisible));
+    }
+}
+
+void FView::cullSmallLights(FEngine& engine,
+        Culler::result_type* UTILS_RESTRICT visible,
+        float* UTILS_RESTRICT fades,
+        float4 const* UTILS_RESTRICT spheres,
+        FLightManager::Instance const* UTILS_RESTRICT instances, size_t count) const noexcept {
+    FLightManager const& lcm = engine.getLightManager();
+    CameraInfo const& camera = mViewingCameraInfo;
+    const bool perspective = camera.projection[3][3] == 0.0f;
+    const float scale = camera.projection[1][1];
+    const float3 position = camera.getPosition();
+    const float exposure = Exposure::exposure(camera.ev100);
+    const float minContribution = mLightCullingOptions.minContribution;
+    const float fadeContribution = mLightCullingOptions.fadeContribution;
+    const float fadeScale = fadeContribution > minContribution ?
+            1.0f / (fadeContribution - minContribution) : 0.0f;
+
+    for (size_t i = 0; i < count; i++) {
+        if (!visible[i]) {
+            continue;
+        }
+        // same screen size as the levels of detail use, the lights the camera is in are full size
+        const float radius = spheres[i].w;
+        const float size = perspective ?
+                scale * radius / std::max(distance(position, spheres[i].xyz), radius) :
+                scale * radius;
+        // illuminance at the radius, as if there were no falloff, and once exposed
+        const float intensity = exposure * lcm.getIntensity(instances[i]) / (radius * radius);
+        const float contribution = size * std::min(intensity, 1.0f);
+        visible[i] = Culler::result_type(contribution >= minContribution);
+        fades[i] = fadeScale > 0.0f ?
+                std::min((contribution - minContribution) * fadeScale, 1.0f) : 1.0f;
+    }
+}
+
+void FView::updatePrimitivesLod(FEngine& engine, const CameraInfo& camera,
         FScene::RenderableSoa& renderableData, Range visibles) noexcept {
+    SYSTRACE_CALL();
+
+    // Screen size (fraction of the viewport's height covered by the bounding sphere) below which
+    // each level after the first one is used, and the hysteresis applied to these thresholds to
+    // avoid popping when an object stays close to one of them.
+    static constexpr float LOD_THRESHOLDS[CONFIG_MAX_LOD_COUNT - 1] = { 0.5f, 0.25f, 0.125f };
+    constexpr float LOD_HYSTERESIS = 0.1f;
+
     FRenderableManager const& rcm = engine.getRenderableManager();
-    for (uint32_t index : visibles) {
-        uint8_t level = 0; // TODO: pick the proper level of detail
-        auto ri = renderableData.elementAt<FScene::RENDERABLE_INSTANCE>(index);
-        renderableData.elementAt<FScene::PRIMITIVES>(index) = rcm.getRenderPrimitives(ri, level);
+
+    // the level picked during the previous frame, for each renderable
+    if (mLodLevels.size() <= rcm.getComponentCount()) {
+        mLodLevels.resize(rcm.getComponentCount() + 1, 0);
+    }
+
+    const bool perspective = camera.projection[3][3] == 0.0f;
+    const float scale = camera.projection[1][1];
+    const float3 position = camera.getPosition();
+
+    auto const* const UTILS_RESTRICT instances = renderableData.data<FScene::RENDERABLE_INSTANCE>();
+    auto const* const UTILS_RESTRICT centers   = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents   = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto* const UTILS_RESTRICT primitives      = renderableData.data<FScene::PRIMITIVES>();
+    auto* const UTILS_RESTRICT shadowPrimitives = renderableData.data<FScene::SHADOW_PRIMITIVES>();
+    uint8_t* const UTILS_RESTRICT lodLevels    = mLodLevels.data();
+
+    auto work = [&rcm, perspective, scale, position, instances, centers, extents, primitives,
+            shadowPrimitives, lodLevels](uint32_t start, uint32_t count) {
+        for (uint32_t index = start, e = start + count; index < e; index++) {
+            auto ri = instances[index];
+            const size_t levelCount = rcm.getLevelCount(ri);
+            uint8_t level = 0;
+            uint8_t shadowLevel = 0;
+            if (levelCount > 1) {
+                const float radius = length(extents[index]);
+                float size = perspective ?
+                        scale * radius / std::max(distance(position, centers[index]), radius) :
+                        scale * radius;
+                size *= std::exp2(rcm.getLodBias(ri));
+                const float shadowSize = size * std::exp2(rcm.getShadowLodBias(ri));
+
+                // crossing a threshold requires going past it by the hysteresis, in either
+                // direction. The shadow level only follows the on-screen one, so it uses the
+                // same hysteresis.
+                const uint8_t previous = lodLevels[ri.asValue()];
+                for (size_t i = 0; i < levelCount - 1; i++) {
+                    const float h = i < previous ? 1.0f + LOD_HYSTERESIS : 1.0f - LOD_HYSTERESIS;
+                    level += uint8_t(size < LOD_THRESHOLDS[i] * h);
+                    shadowLevel += uint8_t(shadowSize < LOD_THRESHOLDS[i] * h);
+                }
+                lodLevels[ri.asValue()] = level;
+            }
+            // all the levels have the same number of primitives, so the summed primitive counts
+            // work for both
+            primitives[index] = rcm.getRenderPrimitives(ri, level);
+            shadowPrimitives[index] = level == shadowLevel ?
+                    primitives[index] : rcm.getRenderPrimitives(ri, shadowLevel);
+        }
+    };
+
+    JobSystem& js = engine.getJobSystem();
+    static jobs::AdaptiveSplitter::Cost sLodCost(20.0f);
+    auto job = jobs::parallel_for(js, nullptr, visibles.first, uint32_t(visibles.size()),
+            std::cref(work), jobs::AdaptiveSplitter(sLodCost));
+    js.setName(job, "FView::updatePrimitivesLod");
+    js.run(job);
+    js.waitAndRelease(job);
+}
+
+void FView::requestStreamingLevels(FEngine& engine, const CameraInfo& camera,
+        FScene::RenderableSoa const& renderableData, Range visibles) const noexcept {
+    SYSTRACE_CALL();
+
+    // The screen-space size of a renderable is estimated from its bounding sphere, like the
+    // LOD selection, assuming its texture coordinates cover the texture once.
+    const bool perspective = camera.projection[3][3] == 0.0f;
+    const float scale = camera.projection[1][1] * mViewport.height;
+    const float3 position = camera.getPosition();
+    const uint32_t frame = engine.getStreamingFrame();
+
+    auto const* const UTILS_RESTRICT centers    = renderableData.data<FScene::WORLD_AABB_CENTER>();
+    auto const* const UTILS_RESTRICT extents    = renderableData.data<FScene::WORLD_AABB_EXTENT>();
+    auto const* const UTILS_RESTRICT primitives = renderableData.data<FScene::PRIMITIVES>();
+
+    for (uint32_t index = visibles.first; index < visibles.last; index++) {
+        const float radius = length(extents[index]);
+        const float pixels = std::max(1.0f, perspective ?
+                scale * radius / std::max(distance(position, centers[index]), radius) :
+                scale * radius);
+        for (FRenderPrimitive const& primitive : primitives[index]) {
+            FMaterialInstance const* mi = primitive.getMaterialInstance();
+            if (!mi) {
+                continue;
+            }
+            SamplerBuffer const& samplers = mi->getSamplerBuffer();
+            SamplerBuffer::Sampler const* sampler = samplers.getBuffer();
+            for (size_t i = 0, c = samplers.getSize(); i < c; i++) {
+                FTexture const* texture = engine.getStreamingTexture(sampler[i].t);
+                if (texture) {
+                    const float size = std::max(texture->getWidth(), texture->getHeight());
+                    const float level = std::floor(std::log2(std::max(1.0f, size / pixels)));
+                    texture->requestLevel(size_t(level), frame);
+                }
+            }
+        }
     }
 }
 
@@ -747,6 +2017,18 @@ Camera& View::getCamera() noexcept {
 }
 
 
+void View::setStereo(Camera* left, Camera* right, Texture* target) noexcept {
+    upcast(this)->setStereo(upcast(left), upcast(right), upcast(target));
+}
+
+bool View::isStereo() const noexcept {
+    return upcast(this)->isStereo();
+}
+
+bool View::isStereoSupported(Engine& engine) noexcept {
+    return upcast(engine).getDriverApi().isMultiviewSupported();
+}
+
 void View::setViewport(Viewport const& viewport) noexcept {
     upcast(this)->setViewport(viewport);
 }
@@ -780,6 +2062,63 @@ void View::setDebugCamera(Camera* camera) noexcept {
     upcast(this)->setViewingCamera(upcast(camera));
 }
 
+void View::setOcclusionCullingEnabled(bool enabled) noexcept {
+    upcast(this)->setOcclusionCullingEnabled(enabled);
+}
+
+bool View::isOcclusionCullingEnabled() const noexcept {
+    return upcast(this)->isOcclusionCullingEnabled();
+}
+
+size_t View::getOcclusionCulledCount() const noexcept {
+    return upcast(this)->getOcclusionCulledCount();
+}
+
+void View::setPotentiallyVisibleSet(PotentiallyVisibleSet const* pvs,
+        utils::Entity const* entities, size_t count) noexcept {
+    upcast(this)->setPotentiallyVisibleSet(pvs, entities, count);
+}
+
+size_t View::getPvsCulledCount() const noexcept {
+    return upcast(this)->getPvsCulledCount();
+}
+
+void View::setSmallFeatureCulling(float minSizeInPixels) noexcept {
+    upcast(this)->setSmallFeatureCulling(minSizeInPixels);
+}
+
+float View::getSmallFeatureCulling() const noexcept {
+    return upcast(this)->getSmallFeatureCulling();
+}
+
+void View::setDrawBudget(uint32_t maxPrimitiveCount) noexcept {
+    upcast(this)->setDrawBudget(maxPrimitiveCount);
+}
+
+uint32_t View::getDrawBudget() const noexcept {
+    return upcast(this)->getDrawBudget();
+}
+
+size_t View::getDrawBudgetCulledCount() const noexcept {
+    return upcast(this)->getDrawBudgetCulledCount();
+}
+
+void View::setBlendingDownsampling(uint8_t factor) noexcept {
+    upcast(this)->setBlendingDownsampling(factor);
+}
+
+uint8_t View::getBlendingDownsampling() const noexcept {
+    return upcast(this)->getBlendingDownsampling();
+}
+
+void View::setCommandCachingEnabled(bool enabled) noexcept {
+    upcast(this)->setCommandCachingEnabled(enabled);
+}
+
+bool View::isCommandCachingEnabled() const noexcept {
+    return upcast(this)->isCommandCachingEnabled();
+}
+
 void View::setVisibleLayers(uint8_t select, uint8_t values) noexcept {
     upcast(this)->setVisibleLayers(select, values);
 }
@@ -800,6 +2139,38 @@ void View::setShadowsEnabled(bool enabled) noexcept {
     upcast(this)->setShadowsEnabled(enabled);
 }
 
+void View::setShadowCascades(uint8_t count) noexcept {
+    upcast(this)->setShadowCascades(count);
+}
+
+uint8_t View::getShadowCascades() const noexcept {
+    return upcast(this)->getShadowCascades();
+}
+
+void View::setStaticShadowCachingEnabled(bool enabled) noexcept {
+    upcast(this)->setStaticShadowCachingEnabled(enabled);
+}
+
+bool View::isStaticShadowCachingEnabled() const noexcept {
+    return upcast(this)->isStaticShadowCachingEnabled();
+}
+
+void View::setShadowOptions(ShadowOptions const& options) noexcept {
+    upcast(this)->setShadowOptions(options);
+}
+
+View::ShadowOptions View::getShadowOptions() const noexcept {
+    return upcast(this)->getShadowOptions();
+}
+
+void View::setLightCullingOptions(LightCullingOptions const& options) noexcept {
+    upcast(this)->setLightCullingOptions(options);
+}
+
+View::LightCullingOptions View::getLightCullingOptions() const noexcept {
+    return upcast(this)->getLightCullingOptions();
+}
+
 void View::setRenderTarget(TargetBufferFlags discard) noexcept {
     upcast(this)->setRenderTarget(discard);
 }
@@ -820,6 +2191,14 @@ View::AntiAliasing View::getAntiAliasing() const noexcept {
     return upcast(this)->getAntiAliasing();
 }
 
+void View::setColorGradingOptions(ColorGradingOptions const& options) noexcept {
+    upcast(this)->setColorGradingOptions(options);
+}
+
+View::ColorGradingOptions View::getColorGradingOptions() const noexcept {
+    return upcast(this)->getColorGradingOptions();
+}
+
 void View::setDynamicResolutionOptions(const DynamicResolutionOptions& options) noexcept {
     upcast(this)->setDynamicResolutionOptions(options);
 }
@@ -828,6 +2207,10 @@ View::DynamicResolutionOptions View::getDynamicResolutionOptions() const noexcep
     return upcast(this)->getDynamicResolutionOptions();
 }
 
+math::float2 View::getDynamicResolutionScale() const noexcept {
+    return upcast(this)->getDynamicResolutionScale();
+}
+
 void View::setPostProcessingEnabled(bool enabled) noexcept {
     upcast(this)->setPostProcessingEnabled(enabled);
 }
@@ -836,9 +2219,21 @@ void View::setDepthPrepass(View::DepthPrepass prepass) noexcept {
     upcast(this)->setDepthPrepass(prepass);
 }
 
+void View::setRenderOrder(RenderOrder order) noexcept {
+    upcast(this)->setRenderOrder(order);
+}
+
+View::RenderOrder View::getRenderOrder() const noexcept {
+    return upcast(this)->getRenderOrder();
+}
+
 void View::setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept {
     upcast(this)->setDynamicLightingOptions(zLightNear, zLightFar);
 }
 
+void View::setFroxelCount(uint32_t froxelCount) noexcept {
+    upcast(this)->setFroxelCount(froxelCount);
+}
+
 
 } // namespace filament
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "WorkerCommands.h"
+
+#include <utils/Systrace.h>
+
+#include <mutex>
+
+#include <assert.h>
+#include <stdlib.h>
+
+namespace filament {
+
+WorkerCommands::WorkerCommands() noexcept = default;
+
+WorkerCommands::~WorkerCommands() noexcept {
+    // the commands that were never merged are lost, the engine merges them before shutting down
+    for (auto& item : mWorkers) {
+        Worker& worker = *item.second;
+        for (void* chunk : worker.chunks) {
+            ::free(chunk);
+        }
+        ::free(worker.chunk);
+    }
+}
+
+void WorkerCommands::seal(Worker& worker) noexcept {
+    // the chunk is executed like a slice of the CommandBufferQueue, up to a null NoopCommand
+    new(worker.buffer->allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    worker.chunks.push_back(worker.chunk);
+    worker.chunk = nullptr;
+    worker.buffer.reset();
+}
+
+WorkerCommands::Worker* WorkerCommands::begin(CommandStream const& engineStream) noexcept {
+    Worker* worker;
+    {
+        std::lock_guard<utils::Mutex> guard(mLock);
+        std::unique_ptr<Worker>& p = mWorkers[std::this_thread::get_id()];
+        if (!p) {
+            p.reset(new Worker);
+        }
+        worker = p.get();
+    }
+
+    worker->lock.lock();
+    if (worker->chunk) {
+        const size_t used = uintptr_t(worker->buffer->getHead()) - uintptr_t(worker->chunk);
+        if (used > CHUNK_SIZE - RECORDING_SIZE) {
+            seal(*worker);
+        }
+    }
+    if (!worker->chunk) {
+        worker->chunk = ::malloc(CHUNK_SIZE);
+        worker->buffer.reset(new CircularBuffer(worker->chunk, CHUNK_SIZE));
+        // this records the calling thread as the only one allowed to use this stream
+        worker->stream = CommandStream(engineStream, *worker->buffer);
+    }
+    return worker;
+}
+
+void WorkerCommands::post(Worker* worker, std::function<void()> work) {
+    worker->work.push_back(std::move(work));
+}
+
+void WorkerCommands::end(Worker* worker) noexcept {
+    // a recording must leave room for the NoopCommand terminating the chunk
+    assert(uintptr_t(worker->buffer->getHead()) - uintptr_t(worker->chunk) +
+            sizeof(NoopCommand) <= CHUNK_SIZE);
+    worker->lock.unlock();
+    mPending.store(true, std::memory_order_release);
+}
+
+void WorkerCommands::merge(CommandStream& stream, Driver& driver) {
+    SYSTRACE_CALL();
+
+    // a thread ending its recording from now on is picked up by this merge or the next one
+    mPending.store(false);
+
+    std::lock_guard<utils::Mutex> guard(mLock);
+    for (auto& item : mWorkers) {
+        Worker& worker = *item.second;
+        std::vector<void*> chunks;
+        std::vector<std::function<void()>> work;
+        {
+            // this waits for the thread to end its recording, if it's in the middle of one
+            std::lock_guard<utils::Mutex> lock(worker.lock);
+            if (worker.chunk && !worker.buffer->empty()) {
+                seal(worker);
+            }
+            std::swap(chunks, worker.chunks);
+            std::swap(work, worker.work);
+        }
+
+        for (auto& w : work) {
+            w();
+        }
+
+        for (void* chunk : chunks) {
+            stream.queueCommand([&driver, chunk]() {
+                CommandBase* base = static_cast<CommandBase*>(chunk);
+                while (base) {
+                    base = base->execute(driver);
+                }
+                ::free(chunk);
+            });
+        }
+    }
+}
+
+} // namespace filament
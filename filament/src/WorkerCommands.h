@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_WORKERCOMMANDS_H
+#define TNT_FILAMENT_WORKERCOMMANDS_H
+
+#include "driver/CircularBuffer.h"
+#include "driver/CommandStream.h"
+
+#include <utils/Mutex.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <stddef.h>
+
+namespace filament {
+
+/*
+ * The commands recorded by threads other than the engine's, e.g. an asset loader creating
+ * textures and vertex buffers. Each of these threads records into memory of its own, which the
+ * engine's thread hands over to the driver at its next merge(), as if these commands had been
+ * recorded in its own CommandStream at that point. The work a thread posts along with its
+ * commands (e.g. registering the objects it created with the engine) is run by merge() too.
+ *
+ * A thread can only record between begin() and end(), after which it must not touch its stream.
+ */
+class WorkerCommands {
+public:
+    struct Worker {
+        utils::Mutex lock;              // held from begin() to end()
+        CommandStream stream;
+        void* chunk = nullptr;          // the memory 'stream' records into
+        std::unique_ptr<CircularBuffer> buffer;
+        std::vector<void*> chunks;      // full chunks waiting for merge()
+        std::vector<std::function<void()>> work;
+    };
+
+    WorkerCommands() noexcept;
+    ~WorkerCommands() noexcept;
+
+    WorkerCommands(WorkerCommands const& rhs) = delete;
+    WorkerCommands& operator=(WorkerCommands const& rhs) = delete;
+
+    // true when a thread called end() since the last merge()
+    bool hasPending() const noexcept { return mPending.load(std::memory_order_acquire); }
+
+    // The calling thread records in worker->stream, which targets the same driver as
+    // 'engineStream', until end(). This can't be nested.
+    Worker* begin(CommandStream const& engineStream) noexcept;
+
+    // 'work' is run on the engine's thread by merge(), before the commands recorded since
+    // begin() are executed
+    void post(Worker* worker, std::function<void()> work);
+
+    void end(Worker* worker) noexcept;
+
+    // Called on the engine's thread: runs the work posted by the other threads and queues the
+    // commands they recorded into 'stream', which executes them with 'driver'.
+    void merge(CommandStream& stream, Driver& driver);
+
+private:
+    // memory recorded into by a thread until merge() or until it's almost full
+    static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+    // space guaranteed to be available between begin() and end()
+    static constexpr size_t RECORDING_SIZE = 128 * 1024;
+
+    static void seal(Worker& worker) noexcept;
+
+    utils::Mutex mLock;
+    std::unordered_map<std::thread::id, std::unique_ptr<Worker>> mWorkers;
+    std::atomic<bool> mPending = { false };
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_WORKERCOMMANDS_H
@@ -51,11 +51,11 @@ void FCameraManager::terminate() noexcept {
     }
 }
 
-void FCameraManager::gc(utils::EntityManager& em) noexcept {
+size_t FCameraManager::gc(utils::EntityManager& em, size_t maxCount) noexcept {
     auto& manager = mManager;
-    manager.gc(em, 4, [this](Entity e) {
+    return manager.gc(em, 4, [this](Entity e) {
         destroy(e);
-    });
+    }, maxCount);
 }
 
 FCamera* FCameraManager::create(Entity entity) {
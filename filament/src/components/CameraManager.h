@@ -48,7 +48,12 @@ public:
     // free-up all resources
     void terminate() noexcept;
 
-    void gc(utils::EntityManager& em) noexcept;
+    // memory used by the components, in bytes
+    size_t getMemorySize() const noexcept { return mManager.getMemorySize(); }
+
+    // frees at most maxCount components of destroyed entities, returns how many were freed
+    size_t gc(utils::EntityManager& em,
+            size_t maxCount = std::numeric_limits<size_t>::max()) noexcept;
 
     /*
     * Component Manager APIs
@@ -155,6 +155,7 @@ void FLightManager::create(const FLightManager::Builder& builder, utils::Entity
     }
     Instance i = manager.addComponent(entity);
     assert(i);
+    ++mVersion;
 
     if (i) {
         // This needs to happen before we call the set() methods below
@@ -196,6 +197,7 @@ void FLightManager::destroy(utils::Entity e) noexcept {
     if (i) {
         auto& manager = mManager;
         manager.removeComponent(e);
+        ++mVersion;
     }
 }
 
@@ -217,12 +219,14 @@ void FLightManager::setLocalPosition(Instance i, const math::float3& position) n
     assert(i);
     auto& manager = mManager;
     manager[i].position = position;
+    ++mVersion;
 }
 
 void FLightManager::setLocalDirection(Instance i, float3 direction) noexcept {
     assert(i);
     auto& manager = mManager;
     manager[i].direction = direction;
+    ++mVersion;
 }
 
 void FLightManager::setColor(Instance i, const LinearColor& color) noexcept {
@@ -266,6 +270,7 @@ void FLightManager::setIntensity(Instance i, float intensity) noexcept {
                 break;
         }
         manager[i].intensity = luminousIntensity;
+        ++mVersion;
     }
 }
 
@@ -276,6 +281,7 @@ void FLightManager::setFalloff(Instance i, float falloff) noexcept {
         SpotParams& spotParams = manager[i].spotParams;
         manager[i].squaredFallOffInv = sqFalloff ? (1 / sqFalloff) : 0;
         spotParams.radius = falloff;
+        ++mVersion;
     }
 }
 
@@ -308,6 +314,7 @@ void FLightManager::setSpotLightCone(Instance i, float inner, float outer) noexc
             float luminousIntensity = luminousPower / (2.0f * float(M_PI) * (1.0f - cosHalfOuter));
             manager[i].intensity = luminousIntensity;
         }
+        ++mVersion;
     }
 }
 
@@ -45,6 +45,9 @@ public:
 
     void terminate() noexcept;
 
+    // memory used by the components, in bytes
+    size_t getMemorySize() const noexcept { return mManager.getMemorySize(); }
+
     bool hasComponent(utils::Entity e) const noexcept {
         return mManager.hasComponent(e);
     }
@@ -59,10 +62,21 @@ public:
 
     void prepare(driver::DriverApi& driver) const noexcept;
 
-    void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+    // frees at most maxCount components of destroyed entities, returns how many were freed
+    size_t gc(utils::EntityManager& em,
+            size_t maxCount = std::numeric_limits<size_t>::max()) noexcept {
+        auto& manager = mManager;
+        const size_t removed = manager.gc(em, 4, [&manager](utils::Entity e) {
+            manager.removeComponent(e);
+        }, maxCount);
+        mVersion += uint32_t(removed != 0);
+        return removed;
     }
 
+    // Incremented each time a light is added, removed, moved or its intensity or falloff changes.
+    // This can be used to detect that nothing changed since a previous frame.
+    uint32_t getVersion() const noexcept { return mVersion; }
+
     struct LightType {
         Type type : 3;
         uint8_t shadowMapBits : 4;
@@ -237,6 +251,9 @@ private:
         using Base::gc;
         using Base::swap;
 
+        // FScene::prepare() looks up every entity of the scene, each frame
+        Sim() noexcept : Base(Base::InstanceMap::DENSE) { }
+
         struct Proxy {
             // all of this gets inlined
             UTILS_ALWAYS_INLINE
@@ -269,6 +286,7 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint32_t mVersion = 0;
 };
 
 FILAMENT_UPCAST(LightManager)
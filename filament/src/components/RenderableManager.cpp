@@ -37,19 +37,28 @@ using namespace details;
 struct RenderableManager::BuilderDetails {
     using Entry = RenderableManager::Builder::Entry;
     Entry* mEntries = nullptr;
-    size_t mEntriesCount = 0;
+    size_t mEntriesCount = 0;           // number of primitives per level
+    uint8_t mLevelCount = 1;
+    float mLodBias = 0.0f;
+    float mShadowLodBias = 0.0f;
     Box mAABB;
     uint8_t mLayerMask = 0x1;
     uint8_t mPriority = 0x4;
     bool mCulling : 1;
     bool mCastShadows : 1;
     bool mReceiveShadows : 1;
-    uint8_t mSkinningBoneCount = 0;
+    bool mOccluder : 1;
+    bool mSmallFeatureCulling : 1;
+    bool mStaticShadowCaster : 1;
+    bool mLowResolutionBlending : 1;
+    uint16_t mSkinningBoneCount = 0;
     Bone const* mBones = nullptr;
     math::mat4f const* mBoneMatrices = nullptr;
 
     explicit BuilderDetails(size_t count)
-            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true) {
+            : mEntriesCount(count), mCulling(true), mCastShadows(false), mReceiveShadows(true),
+              mOccluder(false), mSmallFeatureCulling(true), mStaticShadowCaster(false),
+              mLowResolutionBlending(false) {
     }
     // this is only needed for the explicit instantiation below
     BuilderDetails() = default;
@@ -95,6 +104,46 @@ RenderableManager::Builder& RenderableManager::Builder::geometry(size_t index,
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::levelCount(uint8_t count) noexcept {
+    count = (uint8_t)std::max(size_t(1), std::min(size_t(count), CONFIG_MAX_LOD_COUNT));
+    if (count != mImpl->mLevelCount) {
+        // entries are stored level after level, level 0 is kept
+        const size_t primitiveCount = mImpl->mEntriesCount;
+        Entry* entries = new Entry[primitiveCount * count];
+        std::copy_n(mImpl->mEntries, primitiveCount, entries);
+        delete [] mImpl->mEntries;
+        mImpl->mEntries = entries;
+        mImpl->mLevelCount = count;
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::lodGeometry(uint8_t level, size_t index,
+        PrimitiveType type, VertexBuffer* vertices, IndexBuffer* indices,
+        size_t offset, size_t count) noexcept {
+    if (level < mImpl->mLevelCount && index < mImpl->mEntriesCount) {
+        Entry& entry = mImpl->mEntries[level * mImpl->mEntriesCount + index];
+        entry.vertices = vertices;
+        entry.indices = indices;
+        entry.offset = offset;
+        entry.minIndex = 0;
+        entry.maxIndex = vertices->getVertexCount() - 1;
+        entry.count = count;
+        entry.type = type;
+    }
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::lodBias(float bias) noexcept {
+    mImpl->mLodBias = bias;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::shadowLodBias(float bias) noexcept {
+    mImpl->mShadowLodBias = bias;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::material(size_t index,
         MaterialInstance const* materialInstance) noexcept {
     if (index < mImpl->mEntriesCount) {
@@ -133,21 +182,41 @@ RenderableManager::Builder& RenderableManager::Builder::receiveShadows(bool enab
     return *this;
 }
 
+RenderableManager::Builder& RenderableManager::Builder::occluder(bool enable) noexcept {
+    mImpl->mOccluder = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::smallFeatureCulling(bool enable) noexcept {
+    mImpl->mSmallFeatureCulling = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::staticShadowCaster(bool enable) noexcept {
+    mImpl->mStaticShadowCaster = enable;
+    return *this;
+}
+
+RenderableManager::Builder& RenderableManager::Builder::lowResolutionBlending(bool enable) noexcept {
+    mImpl->mLowResolutionBlending = enable;
+    return *this;
+}
+
 RenderableManager::Builder& RenderableManager::Builder::skinning(size_t boneCount) noexcept {
-    mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
+    mImpl->mSkinningBoneCount = (uint16_t)std::min(CONFIG_MAX_BONE_COUNT, boneCount);
     return *this;
 }
 
 RenderableManager::Builder& RenderableManager::Builder::skinning(
         size_t boneCount, Bone const* transforms) noexcept {
-    mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
+    mImpl->mSkinningBoneCount = (uint16_t)std::min(CONFIG_MAX_BONE_COUNT, boneCount);
     mImpl->mBones = transforms;
     return *this;
 }
 
 RenderableManager::Builder& RenderableManager::Builder::skinning(
         size_t boneCount, math::mat4f const* transforms) noexcept {
-    mImpl->mSkinningBoneCount = (uint8_t)std::min(size_t(255), boneCount);
+    mImpl->mSkinningBoneCount = (uint16_t)std::min(CONFIG_MAX_BONE_COUNT, boneCount);
     mImpl->mBoneMatrices = transforms;
     return *this;
 }
@@ -160,10 +229,29 @@ RenderableManager::Builder& RenderableManager::Builder::blendOrder(size_t index,
 }
 
 RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine, Entity entity) {
+    return build(engine, &entity, 1);
+}
+
+RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& engine,
+        Entity const* entities, size_t count) {
+    // all entities get the same component, errors are reported for the first one
+    const Entity entity = count ? entities[0] : Entity();
     bool isEmpty = true;
-    for (size_t i = 0, c = mImpl->mEntriesCount; i < c; i++) {
+    const size_t primitiveCount = mImpl->mEntriesCount;
+    for (size_t i = 0, c = primitiveCount * mImpl->mLevelCount; i < c; i++) {
         auto& entry = mImpl->mEntries[i];
 
+        if (i >= primitiveCount) {
+            // all levels share the materials of level 0, and fall back to the previous level's
+            // geometry when they don't have their own
+            auto const& previous = mImpl->mEntries[i - primitiveCount];
+            if (!entry.indices || !entry.vertices) {
+                entry = previous;
+            }
+            entry.materialInstance = previous.materialInstance;
+            entry.blendOrder = previous.blendOrder;
+        }
+
         // entry.materialInstance must be set to something even if indices/vertices are null
         FMaterial const* material = nullptr;
         if (!entry.materialInstance) {
@@ -222,7 +310,7 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
     }
 
     // we get here only if there was no POSTCONDITION errors.
-    upcast(engine).createRenderable(*this, entity);
+    upcast(engine).createRenderables(*this, entities, count);
     return Success;
 }
 
@@ -231,6 +319,71 @@ RenderableManager::Builder::Result RenderableManager::Builder::build(Engine& eng
 
 namespace details {
 
+/*
+ * The primitives of the renderables created together are allocated in a single block, which is
+ * freed with the last of these renderables. Each renderable's primitives are preceded by a
+ * pointer to the block's header, which counts the renderables still using the block.
+ */
+struct PrimitivesBlock {
+    size_t refs = 0;
+
+    static constexpr size_t ALIGNMENT =
+            std::max(alignof(PrimitivesBlock*), alignof(FRenderPrimitive));
+    static constexpr size_t HEADER_SIZE =
+            (std::max(sizeof(size_t), sizeof(PrimitivesBlock*)) + ALIGNMENT - 1) &
+            ~(ALIGNMENT - 1);
+
+    static size_t getStride(size_t primitiveCount) noexcept {
+        return (HEADER_SIZE + primitiveCount * sizeof(FRenderPrimitive) + ALIGNMENT - 1) &
+                ~(ALIGNMENT - 1);
+    }
+
+    // returns the primitives of the first renderable, the next ones are getStride() apart
+    static FRenderPrimitive* create(size_t renderableCount, size_t primitiveCount) {
+        const size_t stride = getStride(primitiveCount);
+        char* const p = static_cast<char*>(
+                ::operator new(HEADER_SIZE + renderableCount * stride));
+        PrimitivesBlock* const block = new(p) PrimitivesBlock;
+        for (size_t i = 0; i < renderableCount; i++) {
+            char* const slice = p + HEADER_SIZE + i * stride;
+            *reinterpret_cast<PrimitivesBlock**>(slice) = block;
+            FRenderPrimitive* const rp =
+                    reinterpret_cast<FRenderPrimitive*>(slice + HEADER_SIZE);
+            for (size_t j = 0; j < primitiveCount; j++) {
+                new(rp + j) FRenderPrimitive();
+            }
+        }
+        return reinterpret_cast<FRenderPrimitive*>(p + 2 * HEADER_SIZE);
+    }
+
+    static PrimitivesBlock* get(FRenderPrimitive* primitives) noexcept {
+        return *reinterpret_cast<PrimitivesBlock**>(
+                reinterpret_cast<char*>(primitives) - HEADER_SIZE);
+    }
+
+    // frees the block if it's not used anymore
+    static void release(PrimitivesBlock* block) noexcept {
+        if (block->refs == 0) {
+            block->~PrimitivesBlock();
+            ::operator delete(block);
+        }
+    }
+};
+
+static_assert(sizeof(PrimitivesBlock) <= PrimitivesBlock::HEADER_SIZE,
+        "PrimitivesBlock doesn't fit in its header");
+
+// The ranges of the bone palette are bound like the per-renderable uniforms, so they need the
+// same alignment. The bound ranges always have the size of the shaders' uniform block.
+static constexpr size_t BONE_PALETTE_ALIGNMENT = FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
+static constexpr size_t BONE_PALETTE_BLOCK_SIZE =
+        CONFIG_MAX_BONE_COUNT * sizeof(RenderableManager::Bone);
+
+static inline uint32_t getBonePaletteRangeSize(size_t boneCount) noexcept {
+    return uint32_t((boneCount * sizeof(RenderableManager::Bone) + BONE_PALETTE_ALIGNMENT - 1) &
+            ~(BONE_PALETTE_ALIGNMENT - 1));
+}
+
 FRenderableManager::FRenderableManager(FEngine& engine) noexcept : mEngine(engine) {
     // DON'T use engine here in the ctor, because it's not fully constructed yet.
 }
@@ -241,11 +394,38 @@ FRenderableManager::~FRenderableManager() {
     assert(mManager.getComponentCount() == 0);
 }
 
-void FRenderableManager::create(
-        const RenderableManager::Builder& UTILS_RESTRICT builder, Entity entity) {
+void FRenderableManager::create(const RenderableManager::Builder& UTILS_RESTRICT builder,
+        Entity const* entities, size_t count) {
+    if (!count) {
+        return;
+    }
+
+    // the buffers and material instances might have been created by another thread
+    mEngine.mergeWorkerCommands();
+
+    // create the RenderPrimitives of all the components at once
+    const size_t primitiveCount = builder->mEntriesCount * builder->mLevelCount;
+    const size_t stride = PrimitivesBlock::getStride(primitiveCount);
+    FRenderPrimitive* const primitives = PrimitivesBlock::create(count, primitiveCount);
+
+    // we hold a reference to the block until we're done, because an entity that appears twice
+    // in the list releases the primitives it got first.
+    PrimitivesBlock* const block = PrimitivesBlock::get(primitives);
+    block->refs++;
+    for (size_t i = 0; i < count; i++) {
+        createComponent(builder, entities[i], pointermath::add(primitives, i * stride));
+    }
+    block->refs--;
+    PrimitivesBlock::release(block);
+}
+
+void FRenderableManager::createComponent(
+        const RenderableManager::Builder& UTILS_RESTRICT builder,
+        Entity entity, FRenderPrimitive* rp) {
     FEngine& engine = mEngine;
     auto& manager = mManager;
     FEngine::DriverApi& driver = engine.getDriverApi();
+    ++mVersion;
 
     // If we already have an instance we can reuse parts of it without completely
     // destroying it. In particular we can reuse the UBO since it's the same for
@@ -255,24 +435,48 @@ void FRenderableManager::create(
     if (UTILS_UNLIKELY(ci)) {
         canReuse = true;
         destroyComponentPrimitives(engine, manager[ci].primitives);
-        std::unique_ptr<Bones> const& bones = manager[ci].bones;
-        if (bones && !builder->mSkinningBoneCount) {
-            driver.destroyUniformBuffer(bones->handle);
-        }
+        destroySkinnedVertices(ci);
+        freeBones(ci);
     }
 
     ci = manager.addComponent(entity);
     assert(ci);
 
     if (ci) {
-        // create and initialize all needed RenderPrimitives
         using size_type = Slice<FRenderPrimitive>::size_type;
         Builder::Entry const * const entries = builder->mEntries;
-        FRenderPrimitive* rp = new FRenderPrimitive[builder->mEntriesCount];
-        for (size_t i = 0, c = builder->mEntriesCount; i < c; ++i) {
-            rp[i].init(driver, entries[i]);
+        const size_t count = builder->mEntriesCount * builder->mLevelCount;
+
+        // a skinned renderable is skinned on the CPU when all its VertexBuffers keep a CPU copy
+        SkinnedVertices* skinnedVertices = nullptr;
+        if (builder->mSkinningBoneCount) {
+            bool cpuSkinning = false;
+            for (size_t i = 0; i < count; ++i) {
+                if (entries[i].vertices) {
+                    cpuSkinning = upcast(entries[i].vertices)->hasCpuSkinning();
+                    if (!cpuSkinning) {
+                        break;
+                    }
+                }
+            }
+            if (cpuSkinning) {
+                skinnedVertices = new SkinnedVertices{ {}, 0, builder->mSkinningBoneCount, true };
+                mSkinnedVertices.push_back(skinnedVertices);
+            }
+        }
+
+        // initialize all needed RenderPrimitives, they're allocated by the caller
+        for (size_t i = 0; i < count; ++i) {
+            Handle<HwVertexBuffer> skinned;
+            if (skinnedVertices && entries[i].vertices) {
+                skinned = getSkinnedBuffer(*skinnedVertices, upcast(entries[i].vertices));
+            }
+            rp[i].init(driver, entries[i], skinned);
         }
-        setPrimitives(ci, { rp, size_type(builder->mEntriesCount) });
+        PrimitivesBlock::get(rp)->refs++;
+        setPrimitives(ci, { rp, size_type(count) });
+        manager[ci].lod = Lod{ builder->mLodBias, builder->mShadowLodBias,
+                builder->mLevelCount };
 
         setAxisAlignedBoundingBox(ci, builder->mAABB);
         setLayerMask(ci, builder->mLayerMask);
@@ -280,32 +484,35 @@ void FRenderableManager::create(
         setCastShadows(ci, builder->mCastShadows);
         setReceiveShadows(ci, builder->mReceiveShadows);
         setCulling(ci, builder->mCulling);
-        static_cast<Visibility&>(manager[ci].visibility).skinning = builder->mSkinningBoneCount > 0;
+        setOccluder(ci, builder->mOccluder);
+        setSmallFeatureCulling(ci, builder->mSmallFeatureCulling);
+        setStaticShadowCaster(ci, builder->mStaticShadowCaster);
+        setLowResolutionBlending(ci, builder->mLowResolutionBlending);
+        setSkybox(ci, false);
+        // the vertices skinned on the CPU are drawn without the skinning variant
+        static_cast<Visibility&>(manager[ci].visibility).skinning =
+                builder->mSkinningBoneCount > 0 && !skinnedVertices;
 
         if (!canReuse) {
             getUniformBuffer(ci) = UniformBuffer(engine.getPerRenderableUib());
-            setUniformHandle(ci, driver.createUniformBuffer(getUniformBuffer(ci).getSize()));
-            if (builder->mSkinningBoneCount) {
-                std::unique_ptr<Bones>& bones = manager[ci].bones;
-
-                bones.reset(new Bones); // FIXME: maybe use a pool allocator
-                bones->bones = UniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-                bones->handle = driver.createUniformBuffer(CONFIG_MAX_BONE_COUNT * sizeof(Bone));
-            }
         }
         if (builder->mSkinningBoneCount) {
-            std::unique_ptr<Bones> const& bones = manager[ci].bones;
-            assert(bones);
-            bones->count = builder->mSkinningBoneCount;
+            allocateBones(ci, builder->mSkinningBoneCount);
+            if (skinnedVertices) {
+                Bones& bones = manager[ci].bones;
+                bones.skinnedVertices = skinnedVertices;
+                skinnedVertices->bonesOffset = bones.offset;
+            }
             if (builder->mBones) {
                 setBones(ci, builder->mBones, builder->mSkinningBoneCount);
             } else if (builder->mBoneMatrices) {
                 setBones(ci, builder->mBoneMatrices, builder->mSkinningBoneCount);
             } else {
                 // initialize the bones to identity
-                Bone* UTILS_RESTRICT out =
-                        (Bone*)bones->bones.invalidateUniforms(0, bones->count * sizeof(Bone));
-                std::fill_n(out, bones->count, Bone{});
+                Bones const& bones = manager[ci].bones;
+                Bone* UTILS_RESTRICT out = (Bone*)mBonePalette.invalidateUniforms(
+                        bones.offset, bones.count * sizeof(Bone));
+                std::fill_n(out, bones.count, Bone{});
             }
         }
     }
@@ -315,6 +522,7 @@ void FRenderableManager::create(
 void FRenderableManager::destroy(utils::Entity e) noexcept {
     Instance ci = getInstance(e);
     if (ci) {
+        ++mVersion;
         destroyComponent(ci);
         mManager.removeComponent(e);
     }
@@ -334,6 +542,13 @@ void FRenderableManager::terminate() noexcept {
             manager.removeComponent(manager.getEntity(ci));
         }
     }
+    if (mBonePaletteUbh) {
+        mEngine.getDriverApi().destroyUniformBuffer(mBonePaletteUbh);
+        mBonePaletteUbh.clear();
+    }
+    mBonePalette = UniformBuffer();
+    mBonePaletteFreeList.clear();
+    mBonePaletteEnd = 0;
 }
 
 // This is basically a Renderable's destructor.
@@ -341,17 +556,117 @@ void FRenderableManager::destroyComponent(Instance ci) noexcept {
     auto& manager = mManager;
     FEngine& engine = mEngine;
 
-    FEngine::DriverApi& driver = engine.getDriverApi();
-    driver.destroyUniformBuffer(manager[ci].uniformsHandle);
-
     // See create(RenderableManager::Builder&, Entity)
     destroyComponentPrimitives(engine, manager[ci].primitives);
+    destroySkinnedVertices(ci);
+
+    // give the bones back to the palette, if any
+    freeBones(ci);
+}
 
-    // destroy the bones structures if any
-    std::unique_ptr<Bones> const& bones = manager[ci].bones;
-    if (bones) {
-        driver.destroyUniformBuffer(bones->handle);
+/*
+ * The bones of all the skinned renderables live in a single uniform buffer, which is uploaded at
+ * most once per frame. Each renderable owns an aligned range of it, allocated first-fit from a
+ * free list, and the render pass binds the palette at that offset.
+ * The palette is padded at the end by the size of the shaders' block, because a bound range
+ * always covers a full block, even when the skeleton has fewer bones.
+ */
+void FRenderableManager::allocateBones(Instance ci, size_t boneCount) noexcept {
+    assert(boneCount && boneCount <= CONFIG_MAX_BONE_COUNT);
+    const uint32_t size = getBonePaletteRangeSize(boneCount);
+    auto& freeList = mBonePaletteFreeList;
+    uint32_t offset;
+    auto pos = std::find_if(freeList.begin(), freeList.end(),
+            [size](BonePaletteRange const& range) { return range.size >= size; });
+    if (pos != freeList.end()) {
+        offset = pos->offset;
+        pos->offset += size;
+        pos->size -= size;
+        if (!pos->size) {
+            freeList.erase(pos);
+        }
+    } else {
+        offset = mBonePaletteEnd;
+        mBonePaletteEnd += size;
+        const size_t required = mBonePaletteEnd + BONE_PALETTE_BLOCK_SIZE;
+        if (required > mBonePalette.getSize()) {
+            // grow the palette, the new buffer is entirely dirty so it'll be uploaded in full
+            const size_t capacity = std::max(required, 2 * mBonePalette.getSize());
+            UniformBuffer palette(capacity);
+            if (mBonePalette.getSize()) {
+                memcpy(palette.invalidateUniforms(0, mBonePalette.getSize()),
+                        mBonePalette.getBuffer(), mBonePalette.getSize());
+            }
+            mBonePalette = std::move(palette);
+            FEngine::DriverApi& driver = mEngine.getDriverApi();
+            if (mBonePaletteUbh) {
+                driver.destroyUniformBuffer(mBonePaletteUbh);
+            }
+            mBonePaletteUbh = driver.createUniformBuffer(capacity);
+        }
     }
+    mManager[ci].bones = Bones{ offset, uint16_t(boneCount) };
+}
+
+void FRenderableManager::freeBones(Instance ci) noexcept {
+    Bones& bones = mManager[ci].bones;
+    if (!bones.count) {
+        return;
+    }
+    BonePaletteRange range{ bones.offset, getBonePaletteRangeSize(bones.count) };
+    bones = Bones{};
+
+    // insert the range in the free list, merging it with its neighbors
+    auto& freeList = mBonePaletteFreeList;
+    auto next = std::lower_bound(freeList.begin(), freeList.end(), range.offset,
+            [](BonePaletteRange const& r, uint32_t offset) { return r.offset < offset; });
+    if (next != freeList.end() && range.offset + range.size == next->offset) {
+        range.size += next->size;
+        next = freeList.erase(next);
+    }
+    if (next != freeList.begin() && std::prev(next)->offset + std::prev(next)->size == range.offset) {
+        std::prev(next)->size += range.size;
+    } else {
+        freeList.insert(next, range);
+    }
+
+    // the free range at the end of the palette just moves its end back
+    if (freeList.back().offset + freeList.back().size == mBonePaletteEnd) {
+        mBonePaletteEnd = freeList.back().offset;
+        freeList.pop_back();
+    }
+}
+
+Handle<HwVertexBuffer> FRenderableManager::getSkinnedBuffer(SkinnedVertices& skinnedVertices,
+        FVertexBuffer const* vertices) noexcept {
+    // the primitives of a renderable often share the same VertexBuffer
+    auto& buffers = skinnedVertices.buffers;
+    auto pos = std::find_if(buffers.begin(), buffers.end(),
+            [vertices](SkinnedVertices::Buffer const& buffer) {
+                return buffer.source == vertices;
+            });
+    if (pos != buffers.end()) {
+        return pos->handle;
+    }
+    Handle<HwVertexBuffer> handle = vertices->createSkinnedBuffer(mEngine.getDriverApi());
+    buffers.push_back({ vertices, handle, 0 });
+    return handle;
+}
+
+void FRenderableManager::destroySkinnedVertices(Instance ci) noexcept {
+    Bones& bones = mManager[ci].bones;
+    SkinnedVertices* const skinnedVertices = bones.skinnedVertices;
+    if (!skinnedVertices) {
+        return;
+    }
+    FEngine::DriverApi& driver = mEngine.getDriverApi();
+    for (SkinnedVertices::Buffer const& buffer : skinnedVertices->buffers) {
+        driver.destroyVertexBuffer(buffer.handle);
+    }
+    auto& list = mSkinnedVertices;
+    list.erase(std::find(list.begin(), list.end(), skinnedVertices));
+    delete skinnedVertices;
+    bones.skinnedVertices = nullptr;
 }
 
 void FRenderableManager::destroyComponentPrimitives(
@@ -359,41 +674,48 @@ void FRenderableManager::destroyComponentPrimitives(
     for (auto& primitive : primitives) {
         primitive.terminate(engine);
     }
-    delete[] primitives.data();
-}
-
-
-void FRenderableManager::prepare(
-        driver::DriverApi& UTILS_RESTRICT driver,
-        Instance const* UTILS_RESTRICT instances,
-        utils::Range<uint32_t> list) const noexcept {
-    auto& manager = mManager;
-    UniformBuffer           const * const UTILS_RESTRICT uniforms = manager.raw_array<UNIFORMS>();
-    Handle<HwUniformBuffer> const * const UTILS_RESTRICT ubhs     = manager.raw_array<UNIFORMS_HANDLE>();
-    std::unique_ptr<Bones>  const * const UTILS_RESTRICT bones    = manager.raw_array<BONES>();
-    for (uint32_t index : list) {
-        size_t i = instances[index].asValue();
-        assert(i);  // we should never get the null instance here
-        if (uniforms[i].isDirty()) {
-            // update per-renderable uniform buffer
-            driver.updateUniformBuffer(ubhs[i], UniformBuffer(uniforms[i]));
-            uniforms[i].clean(); // clean AFTER we send to the driver
-        }
-        if (UTILS_UNLIKELY(bones[i])) {
-            if (bones[i]->bones.isDirty()) {
-                driver.updateUniformBuffer(bones[i]->handle, UniformBuffer(bones[i]->bones));
-                bones[i]->bones.clean();
+    // see create(), the primitives are allocated in blocks shared by several components
+    PrimitivesBlock* const block = PrimitivesBlock::get(primitives.data());
+    assert(block->refs);
+    block->refs--;
+    PrimitivesBlock::release(block);
+}
+
+
+void FRenderableManager::prepare(driver::DriverApi& UTILS_RESTRICT driver) const noexcept {
+    // The renderables skinned on the CPU are skinned once for all the passes and views, when their
+    // bones changed. A buffer is uploaded in full when its VertexBuffer changed.
+    for (SkinnedVertices* skinnedVertices : mSkinnedVertices) {
+        Bone const* const bones = reinterpret_cast<Bone const*>(
+                static_cast<char const*>(mBonePalette.getBuffer()) + skinnedVertices->bonesOffset);
+        for (SkinnedVertices::Buffer& buffer : skinnedVertices->buffers) {
+            const uint32_t version = buffer.source->getCpuVersion();
+            if (skinnedVertices->dirty || buffer.version != version) {
+                buffer.source->skin(mEngine, buffer.handle, bones, skinnedVertices->boneCount,
+                        buffer.version != version);
+                buffer.version = version;
             }
         }
+        skinnedVertices->dirty = false;
+    }
+
+    // the per-renderable uniforms are uploaded by the View, all at once (see FScene::updateUBOs)
+    // only the dirty range of the palette is uploaded by the driver
+    if (mBonePalette.isDirty()) {
+        mEngine.countUniformUpdate(mBonePalette);
+        driver.updateUniformBuffer(mBonePaletteUbh, UniformBuffer(mBonePalette));
+        mBonePalette.clean();
     }
 }
 
-void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& model) noexcept {
+void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4x3f& model) noexcept {
     if (instance) {
+        ++mLocalUBOsVersion;
         auto& uniforms = getUniformBuffer(instance);
 
         // update our uniform buffer
-        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelMatrix), model);
+        uniforms.setUniform(offsetof(FEngine::PerRenderableUib, worldFromModelMatrix),
+                model.toMat44());
 
         // Using the inverse-transpose handles non-uniform scaling, but DOESN'T guarantee that
         // the transformed normals will have unit-length, therefore they need to be normalized
@@ -405,10 +727,20 @@ void FRenderableManager::updateLocalUBO(Instance instance, const math::mat4f& mo
     }
 }
 
+Slice<FRenderPrimitive> FRenderableManager::getRenderPrimitives(
+        Instance instance, uint8_t level) const noexcept {
+    Slice<FRenderPrimitive> primitives = mManager[instance].primitives;
+    Lod const& lod = mManager[instance].lod;
+    const size_t count = primitives.size() / lod.levelCount;
+    level = std::min(level, uint8_t(lod.levelCount - 1));
+    return { primitives.begin() + level * count, Slice<FRenderPrimitive>::size_type(count) };
+}
+
 void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
         size_t primitiveIndex, FMaterialInstance const* mi) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        ++mVersion;
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setMaterialInstance(upcast(mi));
 #ifndef NDEBUG
@@ -427,7 +759,7 @@ void FRenderableManager::setMaterialInstanceAt(Instance instance, uint8_t level,
 MaterialInstance* FRenderableManager::getMaterialInstanceAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        const Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        const Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             // We store the material instance as const because we don't want to change it internally
             // but when the user queries it, we want to allow them to call setParameter()
@@ -440,7 +772,8 @@ MaterialInstance* FRenderableManager::getMaterialInstanceAt(
 void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
         size_t primitiveIndex, uint16_t order) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        ++mVersion;
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].setBlendOrder(order);
         }
@@ -450,7 +783,7 @@ void FRenderableManager::setBlendOrderAt(Instance instance, uint8_t level,
 AttributeBitset FRenderableManager::getEnabledAttributesAt(
         Instance instance, uint8_t level, size_t primitiveIndex) const noexcept {
     if (instance) {
-        Slice<FRenderPrimitive> const& primitives = getRenderPrimitives(instance, level);
+        Slice<FRenderPrimitive> const primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             return primitives[primitiveIndex].getEnabledAttributes();
         }
@@ -462,10 +795,21 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
         PrimitiveType type, FVertexBuffer* vertices, FIndexBuffer* indices,
         size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        ++mVersion;
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
+            Bones const& bones = mManager[instance].bones;
+            SkinnedVertices* const skinnedVertices = bones.skinnedVertices;
+            Handle<HwVertexBuffer> skinned;
+            if (skinnedVertices) {
+                if (!ASSERT_PRECONDITION_NON_FATAL(vertices->hasCpuSkinning(),
+                        "a renderable skinned on the CPU needs cpuSkinning VertexBuffers")) {
+                    return;
+                }
+                skinned = getSkinnedBuffer(*skinnedVertices, vertices);
+            }
             primitives[primitiveIndex].set(mEngine, type, vertices, indices, offset,
-                    0, vertices->getVertexCount() - 1, count);
+                    0, vertices->getVertexCount() - 1, count, skinned);
         }
     }
 }
@@ -473,7 +817,8 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t primitiveIndex,
         PrimitiveType type, size_t offset, size_t count) noexcept {
     if (instance) {
-        Slice<FRenderPrimitive>& primitives = getRenderPrimitives(instance, level);
+        ++mVersion;
+        Slice<FRenderPrimitive> primitives = getRenderPrimitives(instance, level);
         if (primitiveIndex < primitives.size()) {
             primitives[primitiveIndex].set(mEngine, type, offset, 0, 0, count);
         }
@@ -483,13 +828,16 @@ void FRenderableManager::setGeometryAt(Instance instance, uint8_t level, size_t
 void FRenderableManager::setBones(Instance ci,
         Bone const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        if (bones) {
-            assert(offset + boneCount <= bones->count);
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
+        Bones const& bones = mManager[ci].bones;
+        if (bones.count && offset < bones.count) {
+            assert(offset + boneCount <= bones.count);
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = (Bone*)mBonePalette.invalidateUniforms(
+                    bones.offset + offset * sizeof(Bone),
                     boneCount * sizeof(Bone));
+            if (bones.skinnedVertices) {
+                bones.skinnedVertices->dirty = true;
+            }
             std::copy_n(transforms, boneCount, out);
         }
     }
@@ -498,14 +846,17 @@ void FRenderableManager::setBones(Instance ci,
 void FRenderableManager::setBones(Instance ci,
         math::mat4f const* UTILS_RESTRICT transforms, size_t boneCount, size_t offset) noexcept {
     if (ci) {
-        std::unique_ptr<Bones> const& bones = mManager[ci].bones;
-        if (bones) {
-            assert(offset + boneCount <= bones->count);
-            boneCount = std::min(boneCount, bones->count - offset);
-            Bone* UTILS_RESTRICT out = (Bone*)bones->bones.invalidateUniforms(
-                    offset * sizeof(Bone),
+        Bones const& bones = mManager[ci].bones;
+        if (bones.count && offset < bones.count) {
+            assert(offset + boneCount <= bones.count);
+            boneCount = std::min(boneCount, bones.count - offset);
+            Bone* UTILS_RESTRICT out = (Bone*)mBonePalette.invalidateUniforms(
+                    bones.offset + offset * sizeof(Bone),
                     boneCount * sizeof(Bone));
-            for (size_t i = 0, c = bones->count; i < c; ++i) {
+            if (bones.skinnedVertices) {
+                bones.skinnedVertices->dirty = true;
+            }
+            for (size_t i = 0; i < boneCount; ++i) {
                 mat4f const& m = transforms[i];
                 out[i].unitQuaternion = m.toQuaternion();
                 out[i].translation = m[3].xyz;
@@ -556,6 +907,30 @@ void RenderableManager::setReceiveShadows(Instance instance, bool enable) noexce
     upcast(this)->setReceiveShadows(instance, enable);
 }
 
+void RenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    upcast(this)->setOccluder(instance, enable);
+}
+
+bool RenderableManager::isOccluder(Instance instance) const noexcept {
+    return upcast(this)->isOccluder(instance);
+}
+
+void RenderableManager::setStaticShadowCaster(Instance instance, bool enable) noexcept {
+    upcast(this)->setStaticShadowCaster(instance, enable);
+}
+
+bool RenderableManager::isStaticShadowCaster(Instance instance) const noexcept {
+    return upcast(this)->isStaticShadowCaster(instance);
+}
+
+void RenderableManager::setLowResolutionBlending(Instance instance, bool enable) noexcept {
+    upcast(this)->setLowResolutionBlending(instance, enable);
+}
+
+bool RenderableManager::isLowResolutionBlending(Instance instance) const noexcept {
+    return upcast(this)->isLowResolutionBlending(instance);
+}
+
 bool RenderableManager::isShadowCaster(Instance instance) const noexcept {
     return upcast(this)->isShadowCaster(instance);
 }
@@ -572,9 +947,32 @@ size_t RenderableManager::getPrimitiveCount(Instance instance) const noexcept {
     return upcast(this)->getPrimitiveCount(instance, 0);
 }
 
+size_t RenderableManager::getLevelCount(Instance instance) const noexcept {
+    return upcast(this)->getLevelCount(instance);
+}
+
+void RenderableManager::setLodBias(Instance instance, float bias) noexcept {
+    upcast(this)->setLodBias(instance, bias);
+}
+
+float RenderableManager::getLodBias(Instance instance) const noexcept {
+    return upcast(this)->getLodBias(instance);
+}
+
+void RenderableManager::setShadowLodBias(Instance instance, float bias) noexcept {
+    upcast(this)->setShadowLodBias(instance, bias);
+}
+
+float RenderableManager::getShadowLodBias(Instance instance) const noexcept {
+    return upcast(this)->getShadowLodBias(instance);
+}
+
 void RenderableManager::setMaterialInstanceAt(Instance instance,
         size_t primitiveIndex, MaterialInstance const* materialInstance) noexcept {
-    upcast(this)->setMaterialInstanceAt(instance, 0, primitiveIndex, upcast(materialInstance));
+    for (size_t level = 0, c = upcast(this)->getLevelCount(instance); level < c; level++) {
+        upcast(this)->setMaterialInstanceAt(instance, uint8_t(level),
+                primitiveIndex, upcast(materialInstance));
+    }
 }
 
 MaterialInstance* RenderableManager::getMaterialInstanceAt(
@@ -583,7 +981,9 @@ MaterialInstance* RenderableManager::getMaterialInstanceAt(
 }
 
 void RenderableManager::setBlendOrderAt(Instance instance, size_t primitiveIndex, uint16_t order) noexcept {
-    upcast(this)->setBlendOrderAt(instance, 0, primitiveIndex, order);
+    for (size_t level = 0, c = upcast(this)->getLevelCount(instance); level < c; level++) {
+        upcast(this)->setBlendOrderAt(instance, uint8_t(level), primitiveIndex, order);
+    }
 }
 
 AttributeBitset RenderableManager::getEnabledAttributesAt(Instance instance, size_t primitiveIndex) const noexcept {
@@ -26,16 +26,21 @@
 #include <filament/Box.h>
 #include <filament/RenderableManager.h>
 
+#include <math/mat4x3.h>
+
 #include <utils/Entity.h>
 #include <utils/SingleInstanceComponentManager.h>
 #include <utils/Slice.h>
 #include <utils/Range.h>
 
+#include <vector>
+
 namespace filament {
 namespace details {
 
 class FMaterialInstance;
 class FRenderPrimitive;
+class FVertexBuffer;
 
 class FRenderableManager : public RenderableManager {
 public:
@@ -47,6 +52,12 @@ public:
         bool receiveShadows : 1;
         bool culling        : 1;
         bool skinning       : 1;
+        bool occluder       : 1;
+        bool smallFeatureCulling : 1;
+        bool staticShadowCaster : 1;
+        bool depthPrepass   : 1;    // per-frame, set by the view, see FView::prepareDepthPrepass()
+        bool lowResolutionBlending : 1;
+        bool skybox         : 1;    // drawn after all the opaque primitives, see FSkybox
     };
 
     FRenderableManager(FEngine& engine) noexcept;
@@ -55,6 +66,9 @@ public:
     // free-up all resources
     void terminate() noexcept;
 
+    // memory used by the components, in bytes
+    size_t getMemorySize() const noexcept { return mManager.getMemorySize(); }
+
     /*
      * Component Manager APIs
      */
@@ -67,29 +81,46 @@ public:
         return mManager.getInstance(e);
     }
 
-    void create(const RenderableManager::Builder& builder, utils::Entity entity);
+    size_t getComponentCount() const noexcept {
+        return mManager.getComponentCount();
+    }
 
-    void destroy(utils::Entity e) noexcept;
+    void create(const RenderableManager::Builder& builder, utils::Entity entity) {
+        create(builder, &entity, 1);
+    }
+
+    // creates the same component for count entities, their primitives are allocated together
+    void create(const RenderableManager::Builder& builder,
+            utils::Entity const* entities, size_t count);
 
-    // - instances is a list of Instance (typically the list from a given scene)
-    // - list is a list of index in 'instances' (typically the visible ones)
-    void prepare(driver::DriverApi& driver,
-            RenderableManager::Instance const* instances,
-            utils::Range<uint32_t> list) const noexcept;
+    void destroy(utils::Entity e) noexcept;
 
-    void gc(utils::EntityManager& em) noexcept {
-        mManager.gc(em);
+    // Uploads the dirty bones of all the renderables, with a single update of the bone palette,
+    // and skins the renderables skinned on the CPU whose bones changed.
+    void prepare(driver::DriverApi& driver) const noexcept;
+
+    // frees at most maxCount components of destroyed entities, returns how many were freed
+    size_t gc(utils::EntityManager& em,
+            size_t maxCount = std::numeric_limits<size_t>::max()) noexcept {
+        // destroy() also releases the primitives and the bones of the component
+        return mManager.gc(em, 4, [this](utils::Entity e) {
+            destroy(e);
+        }, maxCount);
     }
 
+    // Incremented each time a component is changed in a way that affects rendering commands.
+    // This can be used to detect that nothing changed since a previous frame.
+    uint32_t getVersion() const noexcept { return mVersion; }
+
     utils::Slice<const UniformBuffer> getUniformBuffers() const noexcept {
         return mManager.slice<UNIFORMS>();
     }
 
-    utils::Slice<const Handle<HwUniformBuffer>> getUniformBufferHandles() const noexcept {
-        return mManager.slice<UNIFORMS_HANDLE>();
-    }
+    void updateLocalUBO(Instance instance, const math::mat4x3f& model) noexcept;
 
-    void updateLocalUBO(Instance instance, const math::mat4f& model) noexcept;
+    // Incremented by each updateLocalUBO(), so a Scene can tell whether the uniforms it
+    // computed are still there.
+    uint32_t getLocalUBOsVersion() const noexcept { return mLocalUBOsVersion; }
     inline void setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept;
 
     inline void setLayerMask(Instance instance, uint8_t select, uint8_t values) noexcept;
@@ -102,8 +133,14 @@ public:
     inline void setLayerMask(Instance instance, uint8_t enable) noexcept;
     inline void setReceiveShadows(Instance instance, bool enable) noexcept;
     inline void setCulling(Instance instance, bool enable) noexcept;
-    inline void setUniformHandle(Instance instance, Handle<HwUniformBuffer> const& handle) noexcept;
+    inline void setOccluder(Instance instance, bool enable) noexcept;
+    inline void setSmallFeatureCulling(Instance instance, bool enable) noexcept;
+    inline void setStaticShadowCaster(Instance instance, bool enable) noexcept;
+    inline void setLowResolutionBlending(Instance instance, bool enable) noexcept;
+    inline void setSkybox(Instance instance, bool enable) noexcept;
     inline void setPrimitives(Instance instance, utils::Slice<FRenderPrimitive> const& primitives) noexcept;
+    inline void setLodBias(Instance instance, float bias) noexcept;
+    inline void setShadowLodBias(Instance instance, float bias) noexcept;
     inline void setBones(Instance instance, Bone const* transforms, size_t boneCount, size_t offset = 0) noexcept;
     inline void setBones(Instance instance, math::mat4f const* transforms, size_t boneCount, size_t offset = 0) noexcept;
 
@@ -111,21 +148,28 @@ public:
     inline bool isShadowCaster(Instance instance) const noexcept;
     inline bool isShadowReceiver(Instance instance) const noexcept;
     inline bool isCullingEnabled(Instance instance) const noexcept;
+    inline bool isOccluder(Instance instance) const noexcept;
+    inline bool isStaticShadowCaster(Instance instance) const noexcept;
+    inline bool isLowResolutionBlending(Instance instance) const noexcept;
 
     inline Box const& getAABB(Instance instance) const noexcept;
     inline Box const& getAxisAlignedBoundingBox(Instance instance) const noexcept { return getAABB(instance); }
     inline Visibility getVisibility(Instance instance) const noexcept;
     inline uint8_t getLayerMask(Instance instance) const noexcept;
     inline uint8_t getPriority(Instance instance) const noexcept;
+    inline float getLodBias(Instance instance) const noexcept;
+    inline float getShadowLodBias(Instance instance) const noexcept;
 
     inline UniformBuffer const& getUniformBuffer(Instance instance) const noexcept;
     inline UniformBuffer& getUniformBuffer(Instance instance) noexcept;
 
-    inline Handle<HwUniformBuffer> getUbh(Instance instance) const noexcept;
-    inline Handle<HwUniformBuffer> getBonesUbh(Instance instance) const noexcept;
+    // The bones of all the skinned renderables are stored in a single uniform buffer, the bone
+    // palette. Each renderable binds the CONFIG_MAX_BONE_COUNT bones starting at its offset.
+    Handle<HwUniformBuffer> getBonePaletteUbh() const noexcept { return mBonePaletteUbh; }
+    inline uint32_t getBonesOffset(Instance instance) const noexcept;
 
 
-    inline size_t getLevelCount(Instance instance) const noexcept { return 1; }
+    inline size_t getLevelCount(Instance instance) const noexcept;
     inline size_t getPrimitiveCount(Instance instance, uint8_t level) const noexcept;
     void setMaterialInstanceAt(Instance instance, uint8_t level,
             size_t primitiveIndex, FMaterialInstance const* materialInstance) noexcept;
@@ -137,19 +181,56 @@ public:
             PrimitiveType type, size_t offset, size_t count) noexcept;
     void setBlendOrderAt(Instance instance, uint8_t level, size_t primitiveIndex, uint16_t blendOrder) noexcept;
     AttributeBitset getEnabledAttributesAt(Instance instance, uint8_t level, size_t primitiveIndex) const noexcept;
-    inline utils::Slice<FRenderPrimitive> const& getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
-    inline utils::Slice<FRenderPrimitive>& getRenderPrimitives(Instance instance, uint8_t level) noexcept;
+    // levels past the last one return the last level
+    utils::Slice<FRenderPrimitive> getRenderPrimitives(Instance instance, uint8_t level) const noexcept;
 
 
 private:
+    void createComponent(const RenderableManager::Builder& builder, utils::Entity entity,
+            FRenderPrimitive* primitives);
     void destroyComponent(Instance ci) noexcept;
     static void destroyComponentPrimitives(FEngine& engine,
             utils::Slice<FRenderPrimitive>& primitives) noexcept;
 
+    // The vertices of a renderable skinned on the CPU, see VertexBuffer::Builder::cpuSkinning().
+    // Each VertexBuffer of its primitives is skinned into a buffer of its own, which is drawn by
+    // all the passes. The buffers are kept until the renderable is destroyed.
+    struct SkinnedVertices {
+        struct Buffer {
+            FVertexBuffer const* source;
+            Handle<HwVertexBuffer> handle;
+            uint32_t version;   // of the source's CPU copy when last skinned, 0 if never
+        };
+        std::vector<Buffer> buffers;
+        uint32_t bonesOffset;   // see Bones
+        uint16_t boneCount;
+        bool dirty;             // the bones changed since the buffers were skinned
+    };
+
     struct Bones {
-        filament::Handle<HwUniformBuffer> handle;
-        UniformBuffer bones;
-        uint8_t count;
+        uint32_t offset = 0;    // offset in bytes of the first bone in the bone palette
+        uint16_t count = 0;     // 0 when the renderable isn't skinned
+        SkinnedVertices* skinnedVertices = nullptr; // null unless skinned on the CPU
+    };
+
+    // a range of bytes of the bone palette
+    struct BonePaletteRange {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    void allocateBones(Instance ci, size_t boneCount) noexcept;
+    void freeBones(Instance ci) noexcept;
+
+    // the skinned buffer of the VertexBuffer, created if needed
+    Handle<HwVertexBuffer> getSkinnedBuffer(SkinnedVertices& skinnedVertices,
+            FVertexBuffer const* vertices) noexcept;
+    void destroySkinnedVertices(Instance ci) noexcept;
+
+    struct Lod {
+        float bias = 0.0f;
+        float shadowBias = 0.0f; // added to bias for the shadow passes
+        uint8_t levelCount = 1; // the primitives of all levels are stored one level after the other
     };
 
     enum {
@@ -158,8 +239,8 @@ private:
         VISIBILITY,         // user data
         PRIMITIVES,         // user data
         UNIFORMS,           // filament data, UBO data where world-transform is stored
-        UNIFORMS_HANDLE,    // filament data, handle to the driver's UBO
-        BONES,              // filament data, UBO storing a pointer to the bones information
+        BONES,              // filament data, range of the bone palette storing the bones
+        LOD,                // user data
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -168,14 +249,17 @@ private:
             Visibility,
             utils::Slice<FRenderPrimitive>,
             UniformBuffer,
-            filament::Handle<HwUniformBuffer>,
-            std::unique_ptr<Bones>
+            Bones,
+            Lod
     >;
 
     struct Sim : public Base {
         using Base::gc;
         using Base::swap;
 
+        // FScene::prepare() looks up every entity of the scene, each frame
+        Sim() noexcept : Base(Base::InstanceMap::DENSE) { }
+
         struct Proxy {
             // all of this gets inlined
             UTILS_ALWAYS_INLINE
@@ -189,8 +273,8 @@ private:
                 Field<VISIBILITY>       visibility;
                 Field<PRIMITIVES>       primitives;
                 Field<UNIFORMS>         uniforms;
-                Field<UNIFORMS_HANDLE>  uniformsHandle;
                 Field<BONES>            bones;
+                Field<LOD>              lod;
             };
         };
 
@@ -204,12 +288,24 @@ private:
 
     Sim mManager;
     FEngine& mEngine;
+    uint32_t mVersion = 0;
+    uint32_t mLocalUBOsVersion = 0;
+
+    // the bone palette, see allocateBones()
+    UniformBuffer mBonePalette;
+    Handle<HwUniformBuffer> mBonePaletteUbh;
+    std::vector<BonePaletteRange> mBonePaletteFreeList; // sorted by offset
+    uint32_t mBonePaletteEnd = 0;   // end of the last allocated range
+
+    // the renderables skinned on the CPU, see SkinnedVertices
+    std::vector<SkinnedVertices*> mSkinnedVertices;
 };
 
 FILAMENT_UPCAST(RenderableManager)
 
 void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box& aabb) noexcept {
     if (instance) {
+        ++mVersion;
         mManager[instance].aabb = aabb;
     }
 }
@@ -217,6 +313,7 @@ void FRenderableManager::setAxisAlignedBoundingBox(Instance instance, const Box&
 void FRenderableManager::setLayerMask(Instance instance,
         uint8_t select, uint8_t values) noexcept {
     if (instance) {
+        ++mVersion;
         uint8_t& layers = mManager[instance].layers;
         layers = (layers & ~select) | (values & select);
     }
@@ -224,12 +321,14 @@ void FRenderableManager::setLayerMask(Instance instance,
 
 void FRenderableManager::setLayerMask(Instance instance, uint8_t layerMask) noexcept {
     if (instance) {
+        ++mVersion;
         mManager[instance].layers = layerMask;
     }
 }
 
 void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexcept {
     if (instance) {
+        ++mVersion;
         Visibility& visibility = mManager[instance].visibility;
         visibility.priority = priority;
     }
@@ -237,6 +336,7 @@ void FRenderableManager::setPriority(Instance instance, uint8_t priority) noexce
 
 void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept {
     if (instance) {
+        ++mVersion;
         Visibility& visibility = mManager[instance].visibility;
         visibility.castShadows = enable;
     }
@@ -244,6 +344,7 @@ void FRenderableManager::setCastShadows(Instance instance, bool enable) noexcept
 
 void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexcept {
     if (instance) {
+        ++mVersion;
         Visibility& visibility = mManager[instance].visibility;
         visibility.receiveShadows = enable;
     }
@@ -251,25 +352,76 @@ void FRenderableManager::setReceiveShadows(Instance instance, bool enable) noexc
 
 void FRenderableManager::setCulling(Instance instance, bool enable) noexcept {
     if (instance) {
+        ++mVersion;
         Visibility& visibility = mManager[instance].visibility;
         visibility.culling = enable;
     }
 }
 
-void FRenderableManager::setUniformHandle(Instance instance,
-        Handle<HwUniformBuffer> const& handle) noexcept {
+void FRenderableManager::setOccluder(Instance instance, bool enable) noexcept {
+    if (instance) {
+        ++mVersion;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.occluder = enable;
+    }
+}
+
+void FRenderableManager::setSmallFeatureCulling(Instance instance, bool enable) noexcept {
+    if (instance) {
+        ++mVersion;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.smallFeatureCulling = enable;
+    }
+}
+
+void FRenderableManager::setStaticShadowCaster(Instance instance, bool enable) noexcept {
     if (instance) {
-        mManager[instance].uniformsHandle = handle;
+        ++mVersion;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.staticShadowCaster = enable;
+    }
+}
+
+void FRenderableManager::setLowResolutionBlending(Instance instance, bool enable) noexcept {
+    if (instance) {
+        ++mVersion;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.lowResolutionBlending = enable;
+    }
+}
+
+void FRenderableManager::setSkybox(Instance instance, bool enable) noexcept {
+    if (instance) {
+        ++mVersion;
+        Visibility& visibility = mManager[instance].visibility;
+        visibility.skybox = enable;
     }
 }
 
 void FRenderableManager::setPrimitives(Instance instance,
         utils::Slice<FRenderPrimitive> const& primitives) noexcept {
     if (instance) {
+        ++mVersion;
         mManager[instance].primitives = primitives;
     }
 }
 
+void FRenderableManager::setLodBias(Instance instance, float bias) noexcept {
+    if (instance) {
+        ++mVersion;
+        Lod& lod = mManager[instance].lod;
+        lod.bias = bias;
+    }
+}
+
+void FRenderableManager::setShadowLodBias(Instance instance, float bias) noexcept {
+    if (instance) {
+        ++mVersion;
+        Lod& lod = mManager[instance].lod;
+        lod.shadowBias = bias;
+    }
+}
+
 FRenderableManager::Visibility
 FRenderableManager::getVisibility(Instance instance) const noexcept {
     return mManager[instance].visibility;
@@ -283,6 +435,18 @@ bool FRenderableManager::isShadowReceiver(Instance instance) const noexcept {
     return getVisibility(instance).receiveShadows;
 }
 
+bool FRenderableManager::isOccluder(Instance instance) const noexcept {
+    return getVisibility(instance).occluder;
+}
+
+bool FRenderableManager::isStaticShadowCaster(Instance instance) const noexcept {
+    return getVisibility(instance).staticShadowCaster;
+}
+
+bool FRenderableManager::isLowResolutionBlending(Instance instance) const noexcept {
+    return getVisibility(instance).lowResolutionBlending;
+}
+
 bool FRenderableManager::isCullingEnabled(Instance instance) const noexcept {
     return getVisibility(instance).culling;
 }
@@ -295,6 +459,16 @@ uint8_t FRenderableManager::getPriority(Instance instance) const noexcept {
     return getVisibility(instance).priority;
 }
 
+float FRenderableManager::getLodBias(Instance instance) const noexcept {
+    Lod const& lod = mManager[instance].lod;
+    return lod.bias;
+}
+
+float FRenderableManager::getShadowLodBias(Instance instance) const noexcept {
+    Lod const& lod = mManager[instance].lod;
+    return lod.shadowBias;
+}
+
 Box const& FRenderableManager::getAABB(Instance instance) const noexcept {
     return mManager[instance].aabb;
 }
@@ -307,23 +481,14 @@ UniformBuffer& FRenderableManager::getUniformBuffer(Instance instance) noexcept
     return mManager[instance].uniforms;
 }
 
-Handle<HwUniformBuffer> FRenderableManager::getUbh(Instance instance) const noexcept {
-    return mManager[instance].uniformsHandle;
-}
-
-Handle<HwUniformBuffer> FRenderableManager::getBonesUbh(Instance instance) const noexcept {
-    std::unique_ptr<Bones> const& bones = mManager[instance].bones;
-    return bones ? bones->handle : Handle<HwUniformBuffer>{};
-}
-
-utils::Slice<FRenderPrimitive> const& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) const noexcept {
-    return mManager[instance].primitives;
+uint32_t FRenderableManager::getBonesOffset(Instance instance) const noexcept {
+    Bones const& bones = mManager[instance].bones;
+    return bones.offset;
 }
 
-utils::Slice<FRenderPrimitive>& FRenderableManager::getRenderPrimitives(
-        Instance instance, uint8_t level) noexcept {
-    return mManager[instance].primitives;
+size_t FRenderableManager::getLevelCount(Instance instance) const noexcept {
+    Lod const& lod = mManager[instance].lod;
+    return lod.levelCount;
 }
 
 size_t FRenderableManager::getPrimitiveCount(Instance instance, uint8_t level) const noexcept {
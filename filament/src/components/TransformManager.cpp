@@ -16,6 +16,8 @@
 
 #include "components/TransformManager.h"
 
+#include <utils/JobSystem.h>
+
 using namespace utils;
 using namespace math;
 
@@ -61,6 +63,7 @@ void FTransformManager::setParent(Instance i, Instance parent) noexcept {
         auto& manager = mManager;
         Instance oldParent = manager[i].parent;
         if (oldParent != parent) {
+            ++mVersion;
             // TODO: on debug builds, ensure that the new parent isn't one of our descendant
             removeNode(i);
             insertNode(i, parent);
@@ -75,13 +78,16 @@ void FTransformManager::destroy(Entity e) noexcept {
     Instance i = manager.getInstance(e);
     validateNode(i);
     if (i) {
+        ++mVersion;
+
         // 1) remove the entry from the linked lists
         removeNode(i);
 
-        // our children don't have parents anymore
+        // our children don't have parents anymore, their local transform is now their world
         Instance child = manager[i].firstChild;
         while (child) {
             manager[child].parent = 0;
+            updateNodeTransform(child);
             child = manager[child].next;
         }
 
@@ -99,27 +105,35 @@ void FTransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     validateNode(ci);
     if (ci) {
         auto& manager = mManager;
+        ++mVersion;
         // store our local transform
         manager[ci].local = model;
         updateNodeTransform(ci);
     }
 }
 
+void FTransformManager::setTransforms(Instance const* instances, mat4f const* models,
+        size_t count) noexcept {
+    // the world transforms are computed once, level by level, rather than after each node
+    const bool transactionOpen = mLocalTransformTransactionOpen;
+    openLocalTransformTransaction();
+    for (size_t i = 0; i < count; i++) {
+        setTransform(instances[i], models[i]);
+    }
+    if (!transactionOpen) {
+        commitLocalTransformTransaction();
+    }
+}
+
 void FTransformManager::updateNodeTransform(Instance i) noexcept {
     validateNode(i);
     auto& manager = mManager;
     assert(i);
 
     if (UTILS_UNLIKELY(mLocalTransformTransactionOpen)) {
-        // don't update the world transform until commitLocalTransformTransaction() is called
-        Instance ci = manager[i].firstChild;
-        while (ci) {
-            Instance child = manager[ci].firstChild;
-            ci = manager[ci].next;
-            if (child) {
-                updateNodeTransform(child);
-            }
-        }
+        // don't update the world transform until commitLocalTransformTransaction() is called,
+        // which recomputes the dirty nodes and their descendants
+        manager[i].dirty = true;
         return;
     }
 
@@ -147,19 +161,108 @@ void FTransformManager::commitLocalTransformTransaction() noexcept {
         mLocalTransformTransactionOpen = false;
         auto& manager = mManager;
 
-        // swapNode() below needs some temporary storage which we provide here
-        auto& soa = manager.getSoA();
-        soa.ensureCapacity(soa.size() + 1);
+        // This ensures that children are sorted after their parent, and that each level of the
+        // hierarchy is contiguous. Instances are invalidated.
+        if (UTILS_UNLIKELY(mHierarchyChanged)) {
+            sortBreadthFirst();
+        }
 
-        mat4f const* const UTILS_RESTRICT world = manager.raw_array<WORLD>();
-        for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
-            // Ensure that children are always sorted after their parent.
-            if (UTILS_UNLIKELY(Instance(manager[i].parent) > i)) {
-                swapNode(i, manager[i].parent);
+        // A level only depends on the previous one, so each level is processed in parallel.
+        // Only the nodes that are dirty, or have a dirty ancestor, are recomputed.
+        JobSystem* js = mJobSystem;
+        Instance first = manager.begin();
+        for (Instance last : mLevels) {
+            const uint32_t count = last - first;
+            if (js && count >= TRANSFORM_JOB_COUNT * 2) {
+                Sim* const sim = &manager;
+                auto work = [sim](uint32_t start, uint32_t count) {
+                    transformDirty(*sim, start, start + count);
+                };
+                static jobs::AdaptiveSplitter::Cost sTransformCost(50.0f);
+                auto job = jobs::parallel_for(*js, nullptr, first, count,
+                        std::cref(work), jobs::AdaptiveSplitter(sTransformCost));
+                js->setName(job, "FTransformManager::commitLocalTransformTransaction");
+                js->run(job);
+                js->waitAndRelease(job);
+            } else {
+                transformDirty(manager, first, last);
             }
-            Instance parent = manager[i].parent;
-            assert(parent < i);
-            manager[i].world = world[parent] * static_cast<mat4f const&>(manager[i].local);
+            first = last;
+        }
+
+        std::fill(manager.begin<DIRTY>(), manager.end<DIRTY>(), false);
+    }
+}
+
+void FTransformManager::transformDirty(Sim& manager, Instance first, Instance last) noexcept {
+    // note: by using the raw arrays we don't need to check that parent is valid.
+    auto& soa = manager.getSoA();
+    mat4f* const UTILS_RESTRICT world = soa.data<WORLD>();
+    mat4f const* const UTILS_RESTRICT local = soa.data<LOCAL>();
+    Instance const* const UTILS_RESTRICT parents = soa.data<PARENT>();
+    bool* const UTILS_RESTRICT dirty = soa.data<DIRTY>();
+    for (Instance i = first; i != last; ++i) {
+        const Instance parent = parents[i];
+        assert(parent < first);
+        // the root (0) is never dirty
+        dirty[i] = dirty[i] || dirty[parent];
+        if (dirty[i]) {
+            world[i] = world[parent] * local[i];
+        }
+    }
+}
+
+void FTransformManager::sortBreadthFirst() noexcept {
+    auto& manager = mManager;
+    mHierarchyChanged = false;
+
+    // swapNode() below needs some temporary storage which we provide here
+    auto& soa = manager.getSoA();
+    soa.ensureCapacity(soa.size() + 1);
+
+    // the breadth-first order, roots first, each node followed by its siblings
+    std::vector<Instance>& order = mOrder;
+    std::vector<Instance>& levels = mLevels;
+    order.clear();
+    levels.clear();
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        if (!Instance(manager[i].parent)) {
+            order.push_back(i);
+        }
+    }
+    for (size_t first = 0; first < order.size();) {
+        const size_t last = order.size();
+        for (size_t k = first; k < last; k++) {
+            for (Instance child = manager[order[k]].firstChild; child;
+                    child = manager[child].next) {
+                order.push_back(child);
+            }
+        }
+        levels.push_back(Instance(manager.begin() + last));
+        first = last;
+    }
+    assert(order.size() == manager.getComponentCount());
+
+    // Move each node to its position k in order[]. This does nothing when the hierarchy didn't
+    // change since the last sort. We track where each node is (position[]) and which node is at
+    // each position (at[]) as they're swapped.
+    const size_t count = manager.end();
+    std::vector<Instance> position(count);
+    std::vector<Instance> at(count);
+    for (Instance i = manager.begin(), e = manager.end(); i != e; ++i) {
+        position[i] = at[i] = i;
+    }
+    for (size_t k = 0, c = order.size(); k < c; k++) {
+        const Instance target = Instance(manager.begin() + k);
+        const Instance node = position[order[k]];
+        if (node != target) {
+            swapNode(target, node);
+            // the node that was at target is now where our node was
+            const Instance displaced = at[target];
+            at[node] = displaced;
+            position[displaced] = node;
+            at[target] = order[k];
+            position[order[k]] = target;
         }
     }
 }
@@ -167,6 +270,7 @@ void FTransformManager::commitLocalTransformTransaction() noexcept {
 // Inserts a parentless node in the hierarchy
 void FTransformManager::insertNode(Instance i, Instance parent) noexcept {
     auto& manager = mManager;
+    mHierarchyChanged = true;
 
     assert(manager[i].parent == Instance{});
 
@@ -197,6 +301,7 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
     // swap the content of the nodes directly
     std::swap(manager.elementAt<LOCAL>(i), manager.elementAt<LOCAL>(j));
     std::swap(manager.elementAt<WORLD>(i), manager.elementAt<WORLD>(j));
+    std::swap(manager.elementAt<DIRTY>(i), manager.elementAt<DIRTY>(j));
     manager.swap(i, j); // this swaps the data relative to SingleInstanceComponentManager
 
     // now swap the linked-list references, to do that correctly we must use a temporary
@@ -230,6 +335,7 @@ void FTransformManager::swapNode(Instance i, Instance j) noexcept {
 // (making everybody orphaned).
 void FTransformManager::removeNode(Instance i) noexcept {
     auto& manager = mManager;
+    mHierarchyChanged = true;
     Instance parent = manager[i].parent;
     Instance prev = manager[i].prev;
     Instance next = manager[i].next;
@@ -256,6 +362,7 @@ void FTransformManager::removeNode(Instance i) noexcept {
 // update references to this node after it has been moved in the array
 void FTransformManager::updateNode(Instance i) noexcept {
     auto& manager = mManager;
+    mHierarchyChanged = true;
     // update our preview sibling's next reference (to ourselves)
     Instance parent = manager[i].parent;
     Instance prev = manager[i].prev;
@@ -344,11 +451,11 @@ void FTransformManager::validateNode(Instance i) noexcept {
 #endif
 }
 
-void FTransformManager::gc(utils::EntityManager& em) noexcept {
+size_t FTransformManager::gc(utils::EntityManager& em, size_t maxCount) noexcept {
     auto& manager = mManager;
-    manager.gc(em, 4, [this](Entity e) {
+    return manager.gc(em, 4, [this](Entity e) {
                 destroy(e);
-            });
+            }, maxCount);
 }
 
 } // namespace details
@@ -380,6 +487,11 @@ void TransformManager::setTransform(Instance ci, const mat4f& model) noexcept {
     upcast(this)->setTransform(ci, model);
 }
 
+void TransformManager::setTransforms(Instance const* instances, mat4f const* models,
+        size_t count) noexcept {
+    upcast(this)->setTransforms(instances, models, count);
+}
+
 const mat4f& TransformManager::getTransform(Instance ci) const noexcept {
     return upcast(this)->getTransform(ci);
 }
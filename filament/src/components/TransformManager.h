@@ -28,6 +28,12 @@
 
 #include <math/mat4.h>
 
+#include <vector>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
 namespace filament {
 namespace details {
 
@@ -38,9 +44,18 @@ public:
     FTransformManager() noexcept;
     ~FTransformManager() noexcept;
 
+    // the job system is used to commit local transform transactions in parallel, it's optional
+    void init(utils::JobSystem& js) noexcept { mJobSystem = &js; }
+
     // free-up all resources
     void terminate() noexcept;
 
+    // memory used by the components, in bytes
+    size_t getMemorySize() const noexcept { return mManager.getMemorySize(); }
+
+    // minimum number of nodes updated per job when committing a transaction
+    static constexpr uint32_t TRANSFORM_JOB_COUNT = 256;
+
 
     /*
     * Component Manager APIs
@@ -66,7 +81,9 @@ public:
 
     void commitLocalTransformTransaction() noexcept;
 
-    void gc(utils::EntityManager& em) noexcept;
+    // frees at most maxCount components of destroyed entities, returns how many were freed
+    size_t gc(utils::EntityManager& em,
+            size_t maxCount = std::numeric_limits<size_t>::max()) noexcept;
 
     utils::Slice<const math::mat4f> getWorldTransforms() const noexcept {
         return mManager.slice<WORLD>();
@@ -74,6 +91,9 @@ public:
 
     void setTransform(Instance ci, const math::mat4f& model) noexcept;
 
+    void setTransforms(Instance const* instances, math::mat4f const* models,
+            size_t count) noexcept;
+
     const math::mat4f& getTransform(Instance ci) const noexcept {
         return mManager[ci].local;
     }
@@ -82,6 +102,10 @@ public:
         return mManager[ci].world;
     }
 
+    // Incremented each time a transform changes, or is added or removed.
+    // This can be used to detect that nothing changed since a previous frame.
+    uint32_t getVersion() const noexcept { return mVersion; }
+
 private:
     struct Sim;
 
@@ -91,7 +115,9 @@ private:
     void updateNodeTransform(Instance i) noexcept;
     void insertNode(Instance i, Instance p) noexcept;
     void swapNode(Instance i, Instance j) noexcept;
+    void sortBreadthFirst() noexcept;
     static void transformChildren(Sim& manager, Instance firstChild) noexcept;
+    static void transformDirty(Sim& manager, Instance first, Instance last) noexcept;
 
 
     enum {
@@ -101,6 +127,7 @@ private:
         FIRST_CHILD,    // instance to our first child
         NEXT,           // instance to our next sibling
         PREV,           // instance to our previous sibling
+        DIRTY,          // local transform changed during the current transaction
     };
 
     using Base = utils::SingleInstanceComponentManager<
@@ -109,13 +136,17 @@ private:
             Instance,
             Instance,
             Instance,
-            Instance
+            Instance,
+            bool
     >;
 
     struct Sim : public Base {
         using Base::gc;
         using Base::swap;
 
+        // FScene::prepare() looks up every entity of the scene, each frame
+        Sim() noexcept : Base(Base::InstanceMap::DENSE) { }
+
         typename Base::SoA& getSoA() { return mData; }
 
         struct Proxy {
@@ -132,6 +163,7 @@ private:
                 Field<FIRST_CHILD>  firstChild;
                 Field<NEXT>         next;
                 Field<PREV>         prev;
+                Field<DIRTY>        dirty;
             };
         };
 
@@ -145,6 +177,14 @@ private:
 
     Sim mManager;
     bool mLocalTransformTransactionOpen = false;
+    uint32_t mVersion = 0;
+
+    // Set when nodes are added, removed or moved in the hierarchy. The SoA is then sorted in
+    // breadth-first order at the next commit, mLevels holds the end of each level.
+    bool mHierarchyChanged = true;
+    std::vector<Instance> mLevels;
+    std::vector<Instance> mOrder;       // scratch
+    utils::JobSystem* mJobSystem = nullptr;
 };
 
 FILAMENT_UPCAST(TransformManager)
@@ -22,13 +22,21 @@
 namespace filament {
 namespace details {
 
+// The defaults of Engine::Config
+
 // per render pass allocations
-// Froxelization needs about 5 MiB. Command buffer needs about 1 MiB.
-static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 6 * 1024 * 1024;
+// Froxelization needs about 5 MiB, the rest is the scratch space for sorting the commands.
+static constexpr size_t CONFIG_PER_RENDER_PASS_ARENA_SIZE    = 7 * 1024 * 1024;
 
-// size of the high-level draw commands buffer (comes from the per-render pass allocator)
+// initial size of the high-level draw commands buffers (they grow as needed)
 static constexpr size_t CONFIG_PER_FRAME_COMMANDS_SIZE = 1 * 1024 * 1024;
 
+// the scratch space for sorting the color pass' commands
+static constexpr size_t CONFIG_COLOR_PASS_ARENA_SIZE = 2 * CONFIG_PER_FRAME_COMMANDS_SIZE;
+
+// scratch memory of each JobSystem thread, for the jobs' temporary data during a frame
+static constexpr size_t CONFIG_PER_THREAD_SCRATCH_SIZE = 128 * 1024;
+
 // size of a command-stream buffer (comes from mmap -- not the per-engine arena)
 static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE = 1 * 1024 * 1024;
 static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE     = 3 * CONFIG_MIN_COMMAND_BUFFERS_SIZE;
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+#define TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
+
+#include "details/Culler.h"
+
+#include <filament/Frustum.h>
+
+#include <utils/compiler.h>
+
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace filament {
+namespace details {
+
+/*
+ * A bounding volume hierarchy of axis-aligned boxes, used to cull large numbers of boxes
+ * against a frustum in less than linear time.
+ *
+ * Boxes are identified by their index in the arrays given to build(). The hierarchy's topology
+ * only changes with build(), refit() only updates the bounds after boxes have moved.
+ */
+class BoundingVolumeHierarchy {
+public:
+    // maximum number of boxes per leaf
+    static constexpr size_t LEAF_SIZE = 8;
+
+    // builds the hierarchy for 'count' boxes
+    void build(math::float3 const* centers, math::float3 const* extents, size_t count);
+
+    // updates the bounds of all nodes, the boxes must be the same as the ones given to build()
+    void refit(math::float3 const* centers, math::float3 const* extents) noexcept;
+
+    // removes all boxes
+    void clear() noexcept;
+
+    bool empty() const noexcept { return mNodes.empty(); }
+
+    // number of boxes in the hierarchy
+    size_t getBoxCount() const noexcept { return mBoxes.size(); }
+
+    /*
+     * Sets 'bit' in results[rows[i]] for each box i intersecting the frustum, other results are
+     * left untouched. Boxes are tested with the same math as Culler.
+     * centers[rows[i]] and extents[rows[i]] are the (current) bounds of the box i, they must
+     * be the same bounds the hierarchy was built or refit with.
+     * This descends the hierarchy in parallel using the JobSystem.
+     */
+    void cull(utils::JobSystem& js, Frustum const& frustum,
+            math::float3 const* centers, math::float3 const* extents, uint32_t const* rows,
+            Culler::result_type* results, size_t bit) const noexcept;
+
+private:
+    struct Node {                   // 32 bytes
+        math::float3 center;
+        uint32_t first;             // leaf: index of the first box, inner node: right child
+        math::float3 halfExtent;
+        uint32_t count;             // leaf: number of boxes, inner node: 0
+    };
+
+    // the left child of an inner node is always the node that follows it
+    uint32_t buildRecursive(math::float3 const* centers, math::float3 const* extents,
+            uint32_t first, uint32_t count);
+
+    void cullRecursive(uint32_t node, math::float4 const* planes,
+            math::float3 const* centers, math::float3 const* extents, uint32_t const* rows,
+            Culler::result_type* results, Culler::result_type mask) const noexcept;
+
+    void setVisible(uint32_t node, uint32_t const* rows,
+            Culler::result_type* results, Culler::result_type mask) const noexcept;
+
+    // nodes in depth-first order, the root is the first node
+    std::vector<Node> mNodes;
+    // box indices referenced by the leaves
+    std::vector<uint32_t> mBoxes;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_BOUNDINGVOLUMEHIERARCHY_H
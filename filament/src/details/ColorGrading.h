@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_COLORGRADING_H
+#define TNT_FILAMENT_DETAILS_COLORGRADING_H
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+
+#include <filament/View.h>
+
+#include <math/vec4.h>
+
+#include <utils/compiler.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The color grading and tone mapping of a view, baked into a 3D lookup table indexed by the
+ * log2 of the linear HDR color, which stores the final sRGB color. The LUT_SIZE slices along
+ * blue are stored side by side in a 2D texture, which the post-process tone mapping samples
+ * twice and interpolates.
+ */
+class ColorGrading {
+public:
+    // these must match COLOR_GRADING_LUT_* in tone_mapping.fs
+    static constexpr size_t LUT_SIZE = 32;
+    static constexpr float LUT_LOG2_MIN = -10.0f;
+    static constexpr float LUT_LOG2_MAX = 6.0f;
+
+    ColorGrading() noexcept = default;
+
+    ColorGrading(ColorGrading const& rhs) = delete;
+    ColorGrading& operator=(ColorGrading const& rhs) = delete;
+
+    void terminate(driver::DriverApi& driver) noexcept;
+
+    void setOptions(View::ColorGradingOptions const& options) noexcept {
+        mOptions = options;
+        mDirty = true;
+    }
+    View::ColorGradingOptions const& getOptions() const noexcept { return mOptions; }
+
+    // bakes the lookup table, if the options changed since the last call
+    void prepare(driver::DriverApi& driver) noexcept;
+
+    Handle<HwTexture> getTexture() const noexcept { return mLut; }
+
+private:
+    // fills the LUT_SIZE * LUT_SIZE by LUT_SIZE texture
+    static void generate(math::half4* UTILS_RESTRICT lut,
+            View::ColorGradingOptions const& options) noexcept;
+
+    View::ColorGradingOptions mOptions;
+    Handle<HwTexture> mLut;
+    bool mDirty = true;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_COLORGRADING_H
@@ -33,6 +33,9 @@ namespace details {
  *
  * The implementation assumes 'count' below is multiple of 8
  *
+ * Box culling has hand-written SIMD kernels (SSE2 and AVX on x86, NEON on AArch64), the best
+ * one the CPU supports is picked the first time it's needed. All kernels give the same results.
+ *
  */
 
 class Culler {
@@ -66,6 +69,17 @@ public:
             math::float4 const* b,
             size_t count) noexcept;
 
+    /*
+     * sets 'bit' for each AABB whose bounding sphere is at least 'minSize' pixels wide on screen
+     * or contains the camera. 'w' is the last row of the view-projection matrix (it gives the
+     * clip-space w of a point) and 'scale' converts a size at w = 1 to pixels.
+     */
+    static void largerThan(result_type* results,
+            math::float4 const& w, float scale, float minSize,
+            math::float3 const* center,
+            math::float3 const* extent,
+            size_t count, size_t bit) noexcept;
+
     /*
      * returns whether an AABB intersects with the frustum
      */
@@ -82,6 +96,26 @@ public:
 
 
     struct UTILS_PUBLIC Test {
+        // the box culling kernels
+        enum class Kernel : uint8_t {
+            SCALAR,     // auto-vectorized
+            SSE2,       // x86, 4 boxes at a time
+            AVX,        // x86 (selected at runtime), 8 boxes at a time
+            NEON,       // AArch64, 8 boxes at a time
+        };
+
+        static bool isSupported(Kernel kernel) noexcept;
+
+        // the kernel Culler::intersects() uses
+        static Kernel getKernel() noexcept;
+
+        // kernel must be supported
+        static void intersects(Kernel kernel, result_type* results,
+                Frustum const& frustum,
+                math::float3 const* c,
+                math::float3 const* e,
+                size_t count, size_t bit) noexcept;
+
         static void intersects(result_type* results,
                 Frustum const& frustum,
                 math::float3 const* c,
@@ -26,6 +26,9 @@
 
 #include <tsl/robin_map.h>
 
+#include <type_traits>
+#include <vector>
+
 namespace filament {
 namespace details {
 
@@ -47,22 +50,34 @@ public:
     template <typename T>
     bool getProperty(const char* name, T* p) const noexcept;
 
+    size_t getCounters(CounterValue* values, size_t count) const noexcept;
+
+    // a setting, writable in debug builds
     template <typename T>
     void registerProperty(utils::StaticString name, T* p) noexcept {
-        Type type = BOOL;
-        if (std::is_same<T, bool>::value)           type = BOOL;
-        if (std::is_same<T, int>::value)            type = INT;
-        if (std::is_same<T, float>::value)          type = FLOAT;
-        if (std::is_same<T, math::float2>::value)   type = FLOAT2;
-        if (std::is_same<T, math::float3>::value)   type = FLOAT3;
-        if (std::is_same<T, math::float4>::value)   type = FLOAT3;
-        registerProperty(name, p, type);
+        registerProperty(name, p, getType<T>(), TUNABLE);
+    }
+
+    // a statistic updated by the engine every frame, read-only
+    template <typename T>
+    void registerCounter(utils::StaticString name, T* p) noexcept {
+        registerProperty(name, p, getType<T>(), COUNTER);
     }
 
 private:
-    void registerProperty(utils::StaticString name, void* p, Type type) noexcept;
+    template <typename T>
+    static constexpr Type getType() noexcept {
+        return std::is_same<T, int>::value          ? INT    :
+               std::is_same<T, float>::value        ? FLOAT  :
+               std::is_same<T, math::float2>::value ? FLOAT2 :
+               std::is_same<T, math::float3>::value ? FLOAT3 :
+               std::is_same<T, math::float4>::value ? FLOAT4 : BOOL;
+    }
+
+    void registerProperty(utils::StaticString name, void* p, Type type, Kind kind) noexcept;
     std::vector<Property> mProperties;
-    tsl::robin_map<utils::StaticString, void*> mPropertyMap;
+    std::vector<void*> mAddresses;      // address of each of mProperties
+    tsl::robin_map<utils::StaticString, size_t> mPropertyMap;   // index in mProperties
 };
 
 FILAMENT_UPCAST(DebugRegistry)
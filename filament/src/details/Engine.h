@@ -18,8 +18,11 @@
 #define TNT_FILAMENT_DETAILS_ENGINE_H
 
 #include "upcast.h"
+#include "CpuStageTimings.h"
 #include "PostProcessManager.h"
 #include "RenderTargetPool.h"
+#include "StatsServer.h"
+#include "WorkerCommands.h"
 
 #include "components/CameraManager.h"
 #include "components/LightManager.h"
@@ -29,15 +32,19 @@
 #include "details/Allocators.h"
 #include "details/Camera.h"
 #include "details/DebugRegistry.h"
+#include "details/IblPrefilter.h"
 #include "details/ResourceList.h"
 #include "details/Skybox.h"
 
 #include "driver/CommandStream.h"
 #include "driver/CommandBufferQueue.h"
 #include "driver/DriverApi.h"
+#include "driver/StagingPool.h"
+#include "driver/UniformBuffer.h"
 
 #include <filament/Engine.h>
 #include <filament/VertexBuffer.h>
+#include <filament/IblPrefilter.h>
 #include <filament/IndirectLight.h>
 #include <filament/Material.h>
 #include <filament/Texture.h>
@@ -57,7 +64,9 @@
 
 #include <chrono>
 #include <memory>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace filament {
 
@@ -108,6 +117,11 @@ public:
     static constexpr size_t CONFIG_MIN_COMMAND_BUFFERS_SIZE     = details::CONFIG_MIN_COMMAND_BUFFERS_SIZE;
     static constexpr size_t CONFIG_COMMAND_BUFFERS_SIZE         = details::CONFIG_COMMAND_BUFFERS_SIZE;
 
+    // The per-renderable uniforms of all the renderables of a View are stored in a single UBO,
+    // each at a multiple of this offset. This is the largest UBO offset alignment GL and Vulkan
+    // implementations are allowed to require.
+    static constexpr size_t CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE = 256;
+
     struct PerViewUib {
         static UniformInterfaceBlock getUib() noexcept;
         // these fields are only used to call offsetof() and make it easy to visualize the UBO
@@ -117,7 +131,12 @@ public:
         math::mat4f clipFromViewMatrix;
         math::mat4f viewFromClipMatrix;
         math::mat4f clipFromWorldMatrix;
-        math::mat4f lightFromWorldMatrix;
+        math::mat4f lightFromWorldMatrix[CONFIG_MAX_SHADOW_CASCADES];
+        math::mat4f spotLightFromWorldMatrix[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+
+        math::float4 shadowCascadeSplits; // view-space far distance of each cascade
+        math::float4 shadowConstantBias;  // constant bias of each cascade
+        math::float4 shadowNormalBias;    // normal bias of each cascade
 
         math::float4 resolution; // width, height, 1/width, 1/height
 
@@ -129,9 +148,11 @@ public:
         math::float4 sun; // cos(sunAngle), sin(sunAngle), 1/(sunAngle*HALO_SIZE-sunAngle), HALO_EXP
 
         math::float3 lightDirection;
-        float padding1;
+        float directionalShadows; // 1 when the directional light casts shadows, 0 otherwise
 
-        math::float3 shadowBias; // constant bias, normal bias, unused
+        int32_t shadowSamplingMethod; // one of ShadowSamplingMethod
+        float iblRgbm; // 1 when the IBL reflections are RGBM encoded, 0 when they're linear
+        float padding3;
         float oneOverFroxelDimensionY;
 
         math::float4 zParams; // froxel Z parameters
@@ -145,6 +166,10 @@ public:
         float ev100;
 
         alignas(16) math::float4 iblSH[9]; // actually float3 entries (std140 requires float4 alignment)
+
+        // the matrices above are the culling camera's in stereo, each eye has its own projection
+        math::mat4f eyeClipFromWorldMatrix[CONFIG_STEREO_EYE_COUNT];
+        math::float4 eyeCameraPosition[CONFIG_STEREO_EYE_COUNT]; // actually float3 entries
     };
 
     struct PerRenderableUib {
@@ -154,11 +179,31 @@ public:
         math::mat3f worldFromModelNormalMatrix;
     };
 
+    static_assert(sizeof(PerRenderableUib) <= CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE,
+            "PerRenderableUib doesn't fit in CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE");
+
+    struct PerRenderableInstancesUib {
+        static UniformInterfaceBlock getUib() noexcept;
+        // these fields are only used to call offsetof() and make it easy to visualize the UBO
+        // IMPORTANT NOTE: Respect std140 layout, don't update without updating getUib()
+        math::mat4f worldFromModelMatrix[CONFIG_MAX_INSTANCE_COUNT];
+        math::float4 worldFromModelNormalMatrix[CONFIG_MAX_INSTANCE_COUNT][3]; // std140 mat3
+    };
+
     struct PostProcessingUib {
         static UniformInterfaceBlock getUib() noexcept;
         math::float2 uvScale;
         float time;             // time in seconds, with a 1 second period, used for dithering
         float yOffset;
+        math::float2 blendingScale; // size of the low resolution blending target / viewport
+        float iblFace;              // the IBL stages' parameters, see FIblPrefilter
+        float iblLinearRoughness;
+        float iblSampleCount;
+        float iblMaxLevel;
+        // the temporal stage's parameters, see FView::prepareTemporal()
+        alignas(16) math::mat4f temporalReprojection; // this frame's clip space to the last's
+        math::float2 temporalJitter;    // offset of the color pass, in its pixels
+        float temporalFeedback;         // weight of this frame, 1 without history
     };
 
     struct PerViewSib {
@@ -169,23 +214,47 @@ public:
         static constexpr size_t FROXELS        = 2;
         static constexpr size_t IBL_DFG_LUT    = 3;
         static constexpr size_t IBL_SPECULAR   = 4;
-        static constexpr size_t IBL_IRRADIANCE = 5;
+        static constexpr size_t SPOT_SHADOW_ATLAS = 5;
+        static constexpr size_t IBL_IRRADIANCE = 6;
     };
 
     struct PostProcessSib {
         static SamplerInterfaceBlock getSib() noexcept;
         // indices of each samplers in this SamplerInterfaceBlock (see: getSib())
         static constexpr size_t COLOR_BUFFER   = 0;
+        static constexpr size_t COLOR_GRADING  = 1;
+        static constexpr size_t DEPTH_BUFFER   = 2;
+        static constexpr size_t BLENDING_BUFFER = 3;
+        static constexpr size_t BLENDING_DEPTH = 4;
+        static constexpr size_t ENVIRONMENT    = 5;
+        static constexpr size_t HISTORY        = 6;
     };
 
 public:
     static FEngine* create(Backend backend = Backend::DEFAULT,
-            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr);
+            ExternalContext* externalContext = nullptr, void* sharedGLContext = nullptr,
+            Config const& config = {});
+
+    // Starts the driver thread and returns right away, callback is called from another thread
+    // once the driver is initialized. getEngine() then initializes the engine.
+    static void createAsync(CreateCallback callback, void* user,
+            Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+            Config const& config);
+
+    // Waits for the driver of the engine identified by token, and initializes the engine. This
+    // must be called on the thread that called createAsync(). Returns nullptr if the driver
+    // couldn't be initialized.
+    static FEngine* getEngine(void* token);
 
     ~FEngine() noexcept;
 
     Driver& getDriver() const noexcept { return *mDriver; }
-    DriverApi& getDriverApi() noexcept { return mCommandStream; }
+
+    // In a WorkerScope, a thread other than the engine's records in a stream of its own.
+    DriverApi& getDriverApi() noexcept {
+        DriverApi* const worker = sWorkerDriverApi;
+        return UTILS_LIKELY(!worker) ? mCommandStream : *worker;
+    }
     DFG* getDFG() const noexcept { return mDFG.get(); }
 
 
@@ -203,6 +272,9 @@ public:
     // we'll simply have to use separate Areas (for instance).
     LinearAllocatorArena& getPerRenderPassAllocator() noexcept { return mPerRenderPassAllocator; }
 
+    // the configuration this engine was created with
+    Config const& getConfig() const noexcept { return mConfig; }
+
     // Material IDs...
     uint32_t getMaterialId() const noexcept { return mMaterialId++; }
 
@@ -211,6 +283,7 @@ public:
     const FIndirectLight* getDefaultIndirectLight() const noexcept { return mDefaultIbl; }
 
     Handle <HwProgram> getPostProcessProgramSlow(PostProcessStage stage) const noexcept;
+    void waitForPostProcessParser() const noexcept;
     Handle<HwProgram> getPostProcessProgram(PostProcessStage stage) const noexcept {
         Handle<HwProgram> program = mPostProcessPrograms[uint8_t(stage)];
         if (UTILS_UNLIKELY(!program)) {
@@ -219,6 +292,33 @@ public:
         return program;
     }
 
+    // Returns a uniform buffer of PerRenderableInstancesUib size, for instanced draw calls.
+    // These buffers are recycled at each frame, they must not be destroyed.
+    Handle<HwUniformBuffer> acquireInstancesUniformBuffer() noexcept;
+
+    // Resets the counters of debug.renderpass and debug.stats, when a frame begins
+    void resetFrameCounters() noexcept;
+
+    // Streams the counters of the frame that just ended, see Config::statsPort
+    void publishFrameCounters(uint32_t frameId) noexcept;
+
+    // Counts an update of a uniform buffer in debug.stats, it must be called before the update
+    // since it counts the dirty bytes only.
+    void countUniformUpdate(UniformBuffer const& ub) noexcept {
+        debug.stats.uniform_bytes += int(ub.getDirtySize());
+    }
+
+    // Queues the upload of the dirty range of ub into ubh. The ranges queued by the material
+    // instances during prepare() are packed in one staging buffer and uploaded by a single
+    // driver command, after which ub is cleaned.
+    // Only a pointer to ub is kept: ub must stay alive, and must not change, until
+    // FEngine::prepare() calls flushUniformUpdates(). A material instance destroyed in-between
+    // would leave a dangling pointer, which is why this is only called from prepare().
+    void queueUniformUpdate(Handle<HwUniformBuffer> ubh, UniformBuffer const& ub) noexcept {
+        countUniformUpdate(ub);
+        mUniformUpdates.push_back({ ubh, &ub });
+    }
+
     Handle<HwRenderPrimitive> getFullScreenRenderPrimitive() const noexcept {
         return mFullScreenTriangleRph;
     }
@@ -281,8 +381,17 @@ public:
 
     void* streamAlloc(size_t size, size_t alignment) noexcept;
 
+    driver::BufferDescriptor allocateStagingBuffer(size_t size) noexcept {
+        return mStagingPool.allocate(size);
+    }
+
+    void compileMaterials(Material::VariantSet variants) noexcept;
+
     utils::JobSystem& getJobSystem() noexcept { return mJobSystem; }
 
+    // false when the JobSystem is shared with other engines, see Engine::Config::jobSystem
+    bool ownsJobSystem() const noexcept { return mOwnJobSystem != nullptr; }
+
     Epoch getEpoch() const { return mEpoch; }
 
     void shutdown();
@@ -296,9 +405,12 @@ public:
     FMaterial* createMaterial(const Material::Builder& builder) noexcept;
     FTexture* createTexture(const Texture::Builder& builder) noexcept;
     FSkybox* createSkybox(const Skybox::Builder& builder) noexcept;
+    FIblPrefilter* createIblPrefilter(const IblPrefilter::Builder& builder) noexcept;
     FStream* createStream(const Stream::Builder& builder) noexcept;
 
     void createRenderable(const RenderableManager::Builder& builder, utils::Entity entity);
+    void createRenderables(const RenderableManager::Builder& builder,
+            utils::Entity const* entities, size_t count);
     void createLight(const LightManager::Builder& builder, utils::Entity entity);
 
     FRenderer* createRenderer() noexcept;
@@ -308,7 +420,9 @@ public:
     FView* createView() noexcept;
     FCamera* createCamera(utils::Entity entity) noexcept;
     FFence* createFence(Fence::Type type = Fence::Type::SOFT) noexcept;
+    FFence* createFence(Fence::Type type, Fence::Callback callback, void* user) noexcept;
     FSwapChain* createSwapChain(void* nativeWindow, uint64_t flags) noexcept;
+    FSwapChain* createSwapChain(uint32_t width, uint32_t height, uint64_t flags) noexcept;
 
     void destroy(const FVertexBuffer* p);
     void destroy(const FFence* p);
@@ -319,18 +433,100 @@ public:
     void destroy(const FRenderer* p);
     void destroy(const FScene* p);
     void destroy(const FSkybox* p);
+    void destroy(const FIblPrefilter* p);
     void destroy(const FStream* p);
     void destroy(const FTexture* p);
     void destroy(const FSwapChain* p);
     void destroy(const FView* p);
     void destroy(utils::Entity e);
 
+    template<typename T>
+    void destroy(T const* const* p, size_t count);
+
+    template<typename T>
+    void destroyDeferred(T const* p);
+
+    size_t getDeferredDestructionCount() const noexcept {
+        return mDeferredDestructions.size() - mDeferredDestructionsHead;
+    }
+
+    // destroys the objects queued by destroyDeferred(), within the time budget if there's one
+    void processDeferredDestructions(bool withinBudget = true);
+
+    /*
+     * The objects that can be created from any thread (Texture, VertexBuffer, IndexBuffer and
+     * MaterialInstance) do so in a WorkerScope. On a thread other than the engine's, the scope
+     * records the driver commands in a stream of the calling thread, and postpones the
+     * bookkeeping of the engine (e.g. its lists of objects) to the engine's thread, until the
+     * next mergeWorkerCommands(). The scope does nothing on the engine's thread, and nested
+     * scopes do nothing either.
+     */
+    class WorkerScope {
+    public:
+        explicit WorkerScope(FEngine& engine) noexcept;
+        ~WorkerScope() noexcept;
+
+        WorkerScope(WorkerScope const& rhs) = delete;
+        WorkerScope& operator=(WorkerScope const& rhs) = delete;
+
+        bool isWorker() const noexcept { return mWorker != nullptr; }
+
+        // runs 'work' now on the engine's thread, or from it at the next mergeWorkerCommands()
+        template<typename F>
+        void runOnEngineThread(F&& work) {
+            if (UTILS_LIKELY(!mWorker)) {
+                work();
+            } else {
+                mEngine.mWorkerCommands.post(mWorker, std::forward<F>(work));
+            }
+        }
+
+    private:
+        FEngine& mEngine;
+        WorkerCommands::Worker* mWorker = nullptr;
+    };
+
+    // Hands the commands recorded by the other threads to the driver, and finishes the creation
+    // of their objects. This must be called on the engine's thread, outside of a render pass.
+    void mergeWorkerCommands() {
+        if (UTILS_UNLIKELY(mWorkerCommands.hasPending())) {
+            mWorkerCommands.merge(mCommandStream, getDriver());
+        }
+    }
+
     // flush the current buffer
     void flush();
 
+    // calls the callbacks of the fences that have signaled, doesn't block. This is only called
+    // from Engine::flush() and Renderer::endFrame(), never in the middle of a frame.
+    void processFenceCallbacks();
+
     void prepare();
     void gc();
 
+    // Texture streaming: the Views record the levels needed by the streaming textures during a
+    // frame, the residency is updated once the frame is done.
+    bool hasStreamingTextures() const noexcept { return !mStreamingTextures.empty(); }
+    FTexture const* getStreamingTexture(Handle<HwTexture> handle) const noexcept {
+        auto pos = mStreamingTextures.find(handle.getId());
+        return pos != mStreamingTextures.end() ? pos->second : nullptr;
+    }
+    uint32_t getStreamingFrame() const noexcept { return mStreamingFrame; }
+    void updateStreamingTextures() noexcept;
+
+    // Program cache: the materials record the frame their programs are last used in, the least
+    // recently used programs are destroyed once a frame is done to stay within the budget. A
+    // program's size is the size of the shaders it was created from, an estimate of its driver
+    // memory.
+    struct ProgramInfo {
+        FMaterial const* material;
+        uint32_t lastUsedFrame;
+        uint32_t size;
+        uint8_t variantKey;
+    };
+    uint32_t getProgramCacheFrame() const noexcept { return mProgramCacheFrame; }
+    void updateProgramCache() noexcept;
+
     filaflat::ShaderBuilder& getVertexShaderBuilder() noexcept {
         return mVertexShaderBuilder;
     }
@@ -339,12 +535,19 @@ public:
         return mFragmentShaderBuilder;
     }
 
+    CommandBufferStats getCommandBufferStats() const noexcept;
+
+    size_t getDriverCommandStats(DriverCommandStats* stats, size_t count) const noexcept;
+
+    MemoryStats getMemoryStats() const noexcept;
+
     FDebugRegistry& getDebugRegistry() noexcept {
         return mDebugRegistry;
     }
 
 private:
-    FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext);
+    FEngine(Backend backend, ExternalContext* externalContext, void* sharedGLContext,
+            Config const& config);
     void init();
 
     int loop();
@@ -361,6 +564,21 @@ private:
 
     std::unique_ptr<Driver> mDriver;
 
+    // the thread that created the engine, the others go through mWorkerCommands
+    const std::thread::id mThreadId = std::this_thread::get_id();
+    WorkerCommands mWorkerCommands;
+    static thread_local DriverApi* sWorkerDriverApi;
+
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+    // records the driver commands, see Config::captureFile
+    std::unique_ptr<CommandCapture> mCommandCapture;
+#endif
+
+#ifdef FILAMENT_STATS_SERVER
+    // streams the counters of mDebugRegistry, see Config::statsPort
+    std::unique_ptr<StatsServer> mStatsServer;
+#endif
+
     Backend mBackend;
     ExternalContext* mExternalContext = nullptr;
     void* mSharedGLContext = nullptr;
@@ -382,6 +600,16 @@ private:
     ResourceList<FView> mViews{ "View" };
     ResourceList<FScene> mScenes{ "Scene" };
     ResourceList<FFence, utils::LockingPolicy::SpinLock> mFences{"Fence"};
+    // fences whose callback hasn't been called yet, only accessed from the main thread
+    std::vector<FFence*> mFenceCallbacks;
+    // objects given to destroyDeferred(), the ones before mDeferredDestructionsHead are gone
+    struct DeferredDestruction {
+        void const* object;
+        void (*destroy)(FEngine& engine, void const* object);
+    };
+    std::vector<DeferredDestruction> mDeferredDestructions;
+    size_t mDeferredDestructionsHead = 0;
+    bool mProcessingFenceCallbacks = false;
     ResourceList<FSwapChain> mSwapChains{ "SwapChain" };
     ResourceList<FStream> mStreams{ "Stream" };
     ResourceList<FIndexBuffer> mIndexBuffers{ "IndexBuffer" };
@@ -390,6 +618,15 @@ private:
     ResourceList<FMaterial> mMaterials{ "Material" };
     ResourceList<FTexture> mTextures{ "Texture" };
     ResourceList<FSkybox> mSkyboxes{ "Skybox" };
+    ResourceList<FIblPrefilter> mIblPrefilters{ "IblPrefilter" };
+
+    // streaming textures by hardware handle, they're also in mTextures
+    std::unordered_map<HandleBase::HandleId, FTexture*> mStreamingTextures;
+    uint32_t mStreamingFrame = 0;
+
+    uint32_t mProgramCacheFrame = 0;
+    uint32_t mProgramEvictions = 0;
+    std::vector<ProgramInfo> mProgramInfos;      // scratch of updateProgramCache()
 
     mutable uint32_t mMaterialId = 0;
 
@@ -407,6 +644,10 @@ private:
     // Per-view Sampler interface block
     SamplerInterfaceBlock mPerViewSib;
 
+    // uniform buffers for instanced draws, the first mInstancesUbhInUse are used by this frame
+    std::vector<Handle<HwUniformBuffer>> mInstancesUbhs;
+    size_t mInstancesUbhInUse = 0;
+
     // post-process interface blocks
     UniformInterfaceBlock mPostProcessUib;
     SamplerInterfaceBlock mPostProcessSib;
@@ -417,8 +658,22 @@ private:
 
     LinearAllocatorArena mPerRenderPassAllocator;
     HeapAllocatorArena mHeapAllocator;
+    const Config mConfig;
+
+    driver::StagingPool mStagingPool;
+
+    // uploads and cleans the uniform buffers given to queueUniformUpdate(), which must all
+    // still be alive
+    void flushUniformUpdates() noexcept;
+    struct UniformUpdate {
+        Handle<HwUniformBuffer> ubh;
+        UniformBuffer const* uniforms;
+    };
+    std::vector<UniformUpdate> mUniformUpdates;
 
-    utils::JobSystem mJobSystem;
+    std::unique_ptr<utils::JobSystem> mOwnJobSystem;   // null when the JobSystem is shared
+    utils::JobSystem& mJobSystem;
+    bool mAdoptedThread = false;
 
     Epoch mEpoch;
 
@@ -430,6 +685,8 @@ private:
 
     mutable Handle<HwProgram> mPostProcessPrograms[POST_PROCESS_STAGES_COUNT];
     mutable std::unique_ptr<filaflat::MaterialParser> mPostProcessParser;
+    // parses mPostProcessParser, null once it's done and released
+    mutable utils::JobSystem::Job* mPostProcessParserJob = nullptr;
 
     mutable utils::CountDownLatch mDriverBarrier;
 
@@ -447,6 +704,35 @@ public:
             float dzn = -1.0f;
             float dzf =  1.0f;
         } shadowmap;
+        struct {
+            // driver commands the render passes skipped since the current frame began, because
+            // they would set state that's already set (read-only)
+            int redundant_commands = 0;
+            // draw calls and state changes (uniform bindings, material instance switches) the
+            // render passes issued since the current frame began (read-only)
+            int draw_commands = 0;
+            int state_changes = 0;
+            // material instance and program switches of the render passes, the cost that
+            // View::RenderOrder trades against overdraw (read-only)
+            int material_instance_changes = 0;
+            int program_changes = 0;
+        } renderpass;
+        struct {
+            // statistics of the current frame, summed over its views, see resetFrameCounters()
+            // (read-only)
+            int visible_renderables = 0;    // renderables in the views' frustum
+            int culled_renderables = 0;     // renderables outside of it
+            int froxels = 0;                // froxels of the views with dynamic lighting
+            int occupied_froxels = 0;       // froxels lit by at least one light
+            int froxel_records = 0;         // light indices in the froxels' records
+            int uniform_bytes = 0;          // bytes of uniform buffer updates
+            int program_cache_misses = 0;   // programs created when they were first drawn
+        } stats;
+        struct {
+            // { IPC, cache miss rate, branch miss rate } of each CpuStageTimings::Stage, see
+            // Renderer::setCpuCountersEnabled() (read-only)
+            math::float3 counters[CpuStageTimings::STAGE_COUNT] = {};
+        } renderer;
     } debug;
 };
 
@@ -43,6 +43,19 @@ public:
 
     static FenceStatus waitAndDestroy(FFence* fence, Mode mode) noexcept;
 
+    void setCallback(Callback callback, void* user) noexcept {
+        mCallback = callback;
+        mUser = user;
+    }
+
+    void invokeCallback(FenceStatus status) noexcept {
+        Callback callback = mCallback;
+        mCallback = nullptr;
+        if (callback) {
+            callback(this, status, mUser);
+        }
+    }
+
 private:
     // We assume we don't have a lot of contention of fence and have all of them
     // share a single lock/condition
@@ -64,6 +77,8 @@ private:
     Handle<HwFence> mFenceHandle;
     // TODO: use custom allocator for these small objects
     std::shared_ptr<FenceSignal> mFenceSignal;
+    Callback mCallback = nullptr;
+    void* mUser = nullptr;
 };
 
 FILAMENT_UPCAST(Fence)
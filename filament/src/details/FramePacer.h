@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_FRAMEPACER_H
+#define TNT_FILAMENT_DETAILS_FRAMEPACER_H
+
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Chooses when the frames started at a vsync (e.g. by Android's Choreographer) are presented:
+ * at the first vsync they're expected to make, given a prediction of the time they take on the
+ * CPU and the GPU. The number of refresh periods between the start of a frame and its
+ * presentation only goes down after it's been too high for a while, so that the frames are
+ * presented at a steady cadence instead of alternating between one and two periods.
+ */
+class FramePacer {
+public:
+    FramePacer() noexcept;
+
+    void setDisplayInfo(float refreshRate,
+            uint64_t presentationDeadlineNanos, uint64_t vsyncOffsetNanos) noexcept;
+
+    // time at which the frame started at the given vsync of the application should be presented
+    int64_t getPresentationTime(int64_t vsyncNanos) const noexcept;
+
+    // updates the prediction with the time the last frame took, in nanoseconds
+    void update(double frameTimeNanos) noexcept;
+
+    // refresh periods between the start of a frame and its presentation
+    uint32_t getInterval() const noexcept { return mInterval; }
+
+private:
+    static constexpr uint32_t MAX_INTERVAL = 4;
+    // frames a shorter interval must be sufficient for before it's used
+    static constexpr uint32_t HYSTERESIS = 60;
+
+    double mRefreshPeriod;
+    double mPresentationDeadline = 0;
+    double mVsyncOffset = 0;
+    // smoothed frame time and its mean deviation
+    double mAverage = 0;
+    double mDeviation = 0;
+    bool mHasSamples = false;
+    uint32_t mInterval = 1;
+    uint32_t mShorterIntervalFrames = 0;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_FRAMEPACER_H
@@ -35,6 +35,10 @@ public:
 
     bool skipFrameNeeded() const noexcept;
 
+    // Blocks until the oldest frame in flight has completed, for the frames that must not be
+    // skipped (e.g. headless rendering, which is limited by the GPU rather than a display).
+    void waitForFrame() noexcept;
+
 private:
     FEngine& mEngine;
     mutable std::deque<FFence *> mFences;
@@ -53,8 +53,8 @@ public:
 
 //
 // Light UBO           Froxel Record Buffer     per-froxel light list texture
-// {4 x float4}         R_U8  {index into        RG_U16 {offset, point-count, spot-sount}
-// (spot/point            light texture}
+// {4 x float4}         R_U16 {index into       RG_U32 {offset, point-count | spot-count << 16}
+// (spot/point            light UBO}
 //
 //  +----+                     +-+                     +----+
 // 0|....| <------------+     0| |         +-----------|0221| (e.g. offset=02, 2-point, 1-spot)
@@ -66,11 +66,15 @@ public:
 //  :    :                     | |                     |    |
 //  :    :                     | |                     |    |
 //  :    :                     +-+                     |    |
-//  :    :                  65536 max                  +----+
+//  :    :                  131072 max                 +----+
 //  |....|                                          h = num froxels
 //  |....|
 //  +----+
-// 256 lights max
+// CONFIG_MAX_LIGHT_COUNT lights max
+//
+// Records are 16 bits, so the number of lights is only limited by the size of the light UBO.
+// Offsets are 32 bits and counts 16 bits, so the record buffer's size is only limited by the
+// maximum texture size.
 //
 
 class Froxelizer {
@@ -86,8 +90,20 @@ public:
     // gpu buffer containing froxels. valid after construction.
     GPUBuffer const& getFroxelBuffer() const noexcept { return mFroxelBuffer; }
 
+    // cpu memory reserved for froxelizing, in bytes
+    size_t getMemorySize() const noexcept { return mArena.getArea().getSize(); }
+
     void setOptions(float zLightNear, float zLightFar) noexcept;
 
+    // Number of froxels of the grid, between 1024 and 8192, or 0 to let updateFroxelCount()
+    // choose it (default).
+    void setFroxelCount(uint32_t froxelCount) noexcept;
+
+    // Chooses the number of froxels from the number of visible lights and from how many lights
+    // the froxels held at the last froxelization, unless it was set by setFroxelCount(). The
+    // grid only gets coarser after it could have been for a while, to not change every frame.
+    void updateFroxelCount(size_t lightCount) noexcept;
+
     /*
      * Allocate per-frame data structures for froxelization.
      *
@@ -107,16 +123,24 @@ public:
     size_t getFroxelCountX() const noexcept { return mFroxelCountX; }
     size_t getFroxelCountY() const noexcept { return mFroxelCountY; }
     size_t getFroxelCountZ() const noexcept { return mFroxelCountZ; }
+    size_t getFroxelCount() const noexcept {
+        return size_t(mFroxelCountX) * mFroxelCountY * mFroxelCountZ;
+    }
 
     // update Records and Froxels texture with lights data. this is thread-safe.
-    void froxelizeLights(FEngine& engine, math::mat4f const& viewMatrix,
+    // returns false if neither the camera nor the lights changed since the last call, in which
+    // case the previous froxels are kept and commit() won't upload anything.
+    bool froxelizeLights(FEngine& engine, math::mat4f const& viewMatrix,
             const FScene::LightSoa& lightData) noexcept;
 
-    void updateUniforms(UniformBuffer& u) {
+    // scale is the ratio of the froxelized viewport to the rendered one, when they differ
+    void updateUniforms(UniformBuffer& u, float scale = 1.0f) {
         u.setUniform(offsetof(FEngine::PerViewUib, zParams), mParamsZ);
         u.setUniform(offsetof(FEngine::PerViewUib, fParams), mParamsF);
-        u.setUniform(offsetof(FEngine::PerViewUib, oneOverFroxelDimensionX), mOneOverDimension.x);
-        u.setUniform(offsetof(FEngine::PerViewUib, oneOverFroxelDimensionY), mOneOverDimension.y);
+        u.setUniform(offsetof(FEngine::PerViewUib, oneOverFroxelDimensionX),
+                mOneOverDimension.x * scale);
+        u.setUniform(offsetof(FEngine::PerViewUib, oneOverFroxelDimensionY),
+                mOneOverDimension.y * scale);
     }
 
     // send froxel data to GPU
@@ -129,24 +153,54 @@ public:
 
     struct FroxelEntry {
         union {
-            uint32_t u32;
+            uint64_t u64;
             struct {
-                uint16_t offset = 0;
+                uint32_t offset = 0;
                 union {
-                    uint8_t count[2] = { 0, 0 };
+                    uint16_t count[2] = { 0, 0 };
                     struct {
-                        uint8_t pointLightCount;
-                        uint8_t spotLightCount;
+                        uint16_t pointLightCount;
+                        uint16_t spotLightCount;
                     };
                 };
             };
         };
     };
-    // This depends on the maximum number of lights (currently 256),and can't be more than 16 bits.
+    // This depends on the maximum number of lights, and can't be more than 16 bits.
     using RecordBufferType = std::conditional_t<CONFIG_MAX_LIGHT_COUNT <= 255, uint8_t, uint16_t>;
     const utils::Slice<FroxelEntry>& getFroxelBufferUser() const { return mFroxelBufferUser; }
     const utils::Slice<RecordBufferType>& getRecordBufferUser() const { return mRecordBufferUser; }
 
+    // size of the records buffer, in bytes
+    static size_t getRecordBufferSize() noexcept;
+
+    // number of bytes of the records buffer used by the last call to froxelizeLights()
+    size_t getRecordBufferUsedSize() const noexcept {
+        return mRecordBufferUsedCount * sizeof(RecordBufferType);
+    }
+
+    // number of light indices in the records buffer, after the last call to froxelizeLights()
+    size_t getRecordCount() const noexcept { return mRecordBufferUsedCount; }
+
+    // number of froxels lit by at least one light, after the last call to froxelizeLights()
+    size_t getOccupiedFroxelCount() const noexcept { return mOccupiedFroxelCount; }
+
+    /*
+     * Finds the froxels of a row intersected by a light. 'circle' is the intersection of the
+     * light with the row (its radius is squared), the search goes from x0 and x1 (past the end)
+     * towards xcenter, the froxel that contains the light's center. Returns the range
+     * [begin, end) of the intersected froxels.
+     * All the planes of the row are tested at once, in a loop that gets vectorized.
+     */
+    static std::pair<size_t, size_t> findRowRange(math::float4 const* planesX,
+            math::float4 const& circle, size_t x0, size_t xcenter, size_t x1) noexcept;
+
+    struct Test {
+        // reference implementation of findRowRange(), which tests one plane at a time
+        static std::pair<size_t, size_t> findRowRange(math::float4 const* planesX,
+                math::float4 const& circle, size_t x0, size_t xcenter, size_t x1) noexcept;
+    };
+
 private:
     struct FroxelRunEntry {
         uint32_t index;
@@ -154,7 +208,8 @@ private:
     };
 
     struct LightRecord {
-        utils::bitset256 lights;
+        using bitset = utils::bitset<uint64_t, (CONFIG_MAX_LIGHT_COUNT + 63) / 64>;
+        bitset lights;
     };
 
     struct LightParams {
@@ -165,12 +220,39 @@ private:
         float invSin = std::numeric_limits<float>::infinity();
         // radius is not used in the hot loop, so leave it at the end
         float radius;
+        // first and last z slices the light's bounding-box touches, see ZBin
+        uint16_t z0;
+        uint16_t z1;
+    };
+
+    // A light sorted by view depth, by its first z slice
+    struct DepthSortedLight {
+        uint16_t light;     // index of the light in the light UBO
+        uint8_t z0;         // first z slice the light touches
+        uint8_t z1;         // last z slice the light touches
+    };
+
+    // Range [begin, end) of the depth sorted lights touching a z slice. The lights are sorted
+    // by their first slice, so the range of a slice can also contain lights that end before it,
+    // it's only a bound of the lights considered by the slice.
+    struct ZBin {
+        uint16_t begin;
+        uint16_t end;
     };
 
     void setViewport(Viewport const& viewport) noexcept;
     void setProjection(const math::mat4f& projection, float near, float far) noexcept;
     bool update() noexcept;
 
+    // hash of everything froxelizeLights() depends on
+    uint32_t computeLightsHash(FEngine& engine, math::mat4f const& viewMatrix,
+            const FScene::LightSoa& lightData) const noexcept;
+
+    // sorts the lights by view depth and computes the z-bins, culls the lights that don't
+    // touch any z slice
+    void sortLightsByDepth(math::mat4f const& viewMatrix,
+            const FScene::LightSoa& lightData) noexcept;
+
     void froxelizeLoop(FEngine& engine, utils::Slice<uint16_t>& froxelsList,
             utils::Slice<FroxelRunEntry> froxelsListIndices, const math::mat4f& viewMatrix,
             const FScene::LightSoa& lightData) noexcept;
@@ -179,7 +261,8 @@ private:
             utils::GrowingSlice<uint16_t>& froxels,
             math::mat4f const& projection, const LightParams& light) const noexcept;
 
-    void froxelizeAssignRecordsCompress(
+    // assigns the records of the froxels, in parallel
+    void froxelizeAssignRecordsCompress(FEngine& engine,
             const utils::Slice<uint16_t>& froxelsList,
             const utils::Slice<FroxelRunEntry>& froxelsListIndices) noexcept;
 
@@ -193,7 +276,7 @@ private:
 
     static void computeFroxelLayout(
             math::uint2* dim, uint16_t* countX, uint16_t* countY, uint16_t* countZ,
-            Viewport const& viewport) noexcept;
+            Viewport const& viewport, size_t froxelCount) noexcept;
 
     // internal state dependant on the viewport and needed for froxelizing
     LinearAllocatorArena mArena;                    // ~256 KiB
@@ -203,13 +286,21 @@ private:
     math::float4* mPlanesY = nullptr;
     math::float4* mBoundingSpheres = nullptr;
 
+    // lights sorted by view depth and the range of these lights touching each z slice, these
+    // are computed once per froxelization, before the lights are assigned to froxels
+    DepthSortedLight mDepthSortedLights[CONFIG_MAX_LIGHT_COUNT];    // 1 KiB
+    ZBin mZBins[FEngine::CONFIG_FROXEL_SLICE_COUNT];
+    uint16_t mDepthSortedLightCount = 0;
+
     utils::Slice<FroxelRunEntry> mFroxelListIndices;    // ~2 KiB
     utils::Slice<uint16_t> mFroxelList;                 // ~4 MiB + 510 B
     utils::Slice<FroxelEntry> mFroxelBufferUser;
 
-    // max 32 KiB  (actual: resolution dependant)
-    utils::Slice<RecordBufferType> mRecordBufferUser;   // max 64 KiB
+    // max 64 KiB  (actual: resolution dependant)
+    utils::Slice<RecordBufferType> mRecordBufferUser;   // max 256 KiB
     utils::Slice<LightRecord> mLightRecords;            // 256 KiB
+    size_t mRecordBufferUsedCount = 0;
+    size_t mOccupiedFroxelCount = 0;
 
     uint16_t mFroxelCountX = 0;
     uint16_t mFroxelCountY = 0;
@@ -233,6 +324,15 @@ private:
     float mZLightFar = FEngine::CONFIG_Z_LIGHT_FAR;
     float mZLightNear = FEngine::CONFIG_Z_LIGHT_NEAR;  // light near (first slice)
 
+    // number of froxels the layout is computed for, see updateFroxelCount()
+    uint16_t mFroxelCountTarget;
+    uint16_t mPinnedFroxelCount = 0;
+    uint16_t mFroxelCountCooldown = 0;
+
+    // used to reuse the froxels of the previous frame
+    uint32_t mLightsHash = 0;
+    bool mFroxelsValid = false;
+
     // track if we need to update our internal state before froxelizing
     uint8_t mDirtyFlags = 0;
     enum {
@@ -22,6 +22,10 @@
 
 #include <math/vec4.h>
 
+#include <utils/compiler.h>
+
+#include <string.h>
+
 namespace filament {
 namespace details {
 
@@ -35,7 +39,7 @@ public:
         math::float4 positionFalloff;   // { float3(pos), 1/falloff^2 }
         math::float4 colorIntensity;    // { float3(col), intensity }
         math::float4 directionIES;      // { float3(dir), IES index }
-        math::float4 spotScaleOffset;   // { scale, offset, unused, unused }
+        math::float4 spotScaleOffset;   // { scale, offset, shadow index, shadow bias }
     };
 
     explicit GpuLightBuffer(FEngine& engine) noexcept;
@@ -50,21 +54,40 @@ public:
     GpuLightBuffer& operator=(GpuLightBuffer&& rhs) = delete;
     ~GpuLightBuffer() noexcept;
 
-    LightParameters& getLightParameters(LightIndex h) noexcept {
+    LightParameters const& getLightParameters(LightIndex h) const noexcept {
         // This assumes the layout of the LightsUniforms uniform buffer
         // it is defined in UibGenerator.cpp
-        LightParameters* lights = (LightParameters *)mLightsUb.getBuffer();
+        LightParameters const* lights = (LightParameters const*)mLightsUb.getBuffer();
         return lights[h];
     }
 
-    void invalidate(LightIndex h, size_t count) noexcept {
-        mLightsUb.invalidateUniforms(h * sizeof(LightParameters), count * sizeof(LightParameters));
+    // Only the records whose parameters changed are uploaded by the next commit().
+    void setLightParameters(LightIndex h, LightParameters const& lp) noexcept {
+        LightParameters& current = const_cast<LightParameters&>(getLightParameters(h));
+        if (UTILS_UNLIKELY(memcmp(&current, &lp, sizeof(LightParameters)) != 0)) {
+            current = lp;
+            invalidate(h);
+        }
     }
 
 private:
+    // the changed records closer than this are uploaded together
+    static constexpr LightIndex MERGE_DISTANCE = 4;
+    // the ranges of changed records uploaded separately, the last one grows when they run out
+    static constexpr size_t MAX_DIRTY_RANGES = 8;
+
+    struct Range {
+        LightIndex first;
+        LightIndex last;    // exclusive
+    };
+
+    void invalidate(LightIndex h) noexcept;
     void commitSlow(FEngine& engine) noexcept;
+
     Handle<HwUniformBuffer> mLightUbh;
     mutable UniformBuffer mLightsUb;
+    Range mDirtyRanges[MAX_DIRTY_RANGES];
+    size_t mDirtyRangeCount = 0;
 };
 
 } // namespace details
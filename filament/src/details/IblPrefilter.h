@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_IBLPREFILTER_H
+#define TNT_FILAMENT_DETAILS_IBLPREFILTER_H
+
+#include "upcast.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/Handle.h"
+#include "driver/UniformBuffer.h"
+
+#include <filament/IblPrefilter.h>
+#include <filament/MaterialEnums.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <atomic>
+#include <memory>
+
+namespace filament {
+namespace details {
+
+class FEngine;
+class FTexture;
+
+/*
+ * The prefiltering draws with the IBL post-process stages, see ibl_prefilter.fs:
+ *  - the environment is first drawn into a cubemap of the output's size, whose mipmaps are
+ *    generated, as filtered importance sampling needs them,
+ *  - then each face of each level of the reflections, in turn, within the sample budget,
+ *  - finally the 9 SH coefficients are summed by as many fragments and read back.
+ */
+class FIblPrefilter : public IblPrefilter {
+public:
+    FIblPrefilter(FEngine& engine, const Builder& builder);
+
+    void terminate(FEngine& engine);
+
+    bool update(FEngine& engine) noexcept;
+
+    void restart() noexcept;
+
+    bool isReady() const noexcept { return mStep == Step::DONE; }
+
+    FTexture const* getReflections() const noexcept { return mReflections; }
+
+    math::float3 const* getIrradiance() const noexcept { return mIrradiance; }
+
+private:
+    enum class Step : uint8_t {
+        ENVIRONMENT,
+        REFLECTIONS,
+        IRRADIANCE,
+        READBACK,
+        DONE
+    };
+
+    // written by the driver once the SH are read back, it outlives us if we're destroyed first
+    struct Readback {
+        math::float4 sh[9];
+        std::atomic<bool> ready = { false };
+    };
+
+    // draws a face of a cubemap (or the SH target) with one of the IBL stages
+    void draw(FEngine& engine, PostProcessStage stage,
+            Handle<HwRenderTarget> target, uint32_t width, uint32_t height) noexcept;
+
+    void setParameters(FEngine& engine, uint8_t face, float linearRoughness,
+            size_t sampleCount) noexcept;
+
+    // sample count of a level of the reflections, see cmgen
+    size_t getSampleCount(uint8_t level) const noexcept {
+        return level < 2 ? mSampleCount : size_t(mSampleCount) << (level - 1u);
+    }
+
+    // we don't own this
+    FTexture const* mSource = nullptr;
+
+    // we own these
+    FTexture* mEnvironment = nullptr;
+    FTexture* mReflections = nullptr;
+    Handle<HwTexture> mShTexture;
+    Handle<HwRenderTarget> mShTarget;
+    Handle<HwUniformBuffer> mUbh;
+    Handle<HwSamplerBuffer> mSbh;
+    UniformBuffer mUb;
+
+    uint32_t mSize = 256;
+    uint8_t mLevels = 1;
+    uint16_t mSampleCount = 1024;
+    size_t mSampleBudget = 0;
+
+    Step mStep = Step::ENVIRONMENT;
+    uint8_t mLevel = 0;
+    uint8_t mFace = 0;
+
+    std::shared_ptr<Readback> mReadback;
+    math::float3 mIrradiance[9] = {};
+};
+
+FILAMENT_UPCAST(IblPrefilter)
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_IBLPREFILTER_H
@@ -42,6 +42,8 @@ public:
 
     Handle<HwTexture> getReflectionMap() const noexcept { return mReflectionsMapHandle; }
     Handle<HwTexture> getIrradianceMap() const noexcept { return mIrradianceMapHandle; }
+    // whether the reflections are RGBM encoded, rather than linear
+    bool isReflectionMapRgbm() const noexcept { return mReflectionsMapRgbm; }
     math::float3 const* getSH() const noexcept{ return mIrradianceCoefs.data(); }
     float getIntensity() const noexcept { return mIntensity; }
     void setIntensity(float intensity) noexcept { mIntensity = intensity; }
@@ -51,6 +53,7 @@ public:
 private:
     Handle<HwTexture> mReflectionsMapHandle;
     Handle<HwTexture> mIrradianceMapHandle;
+    bool mReflectionsMapRgbm = true;
     std::array<math::float3, 9> mIrradianceCoefs;
     float mIntensity = DEFAULT_INTENSITY;
     math::mat3f mRotation;
@@ -29,12 +29,17 @@
 
 #include <utils/compiler.h>
 
+#include <atomic>
+#include <vector>
 
 namespace filaflat {
     class MaterialParser;
 }
 
 namespace filament {
+
+class Program;
+
 namespace details {
 
 class  FEngine;
@@ -77,14 +82,38 @@ public:
     Handle<HwProgram> getProgram(uint8_t variantKey) const noexcept {
 
         // filterVariant() has already been applied in generateCommands(), shouldn't be needed here
-        assert( variantKey == Variant::filterVariant(variantKey, isVariantLit()) );
+        assert( variantKey ==
+                Variant::filterVariant(variantKey, isVariantLit(), hasPunctualLights()) );
+
+        // this can be called from several threads, only write the sets the first time
+        const VariantSet bit = VariantSet(1) << variantKey;
+        if (UTILS_UNLIKELY(!(mUsedVariants.load(std::memory_order_relaxed) & bit))) {
+            mUsedVariants.fetch_or(bit, std::memory_order_relaxed);
+        }
+        if (UTILS_UNLIKELY(!(mFrameVariants.load(std::memory_order_relaxed) & bit))) {
+            mFrameVariants.fetch_or(bit, std::memory_order_relaxed);
+        }
 
         Handle<HwProgram> const entry = mCachedPrograms[variantKey];
         return UTILS_LIKELY(entry) ? entry : getProgramSlow(variantKey);
     }
 
+    void compile(VariantSet variants, CompileCallback callback, void* user) noexcept;
+
+    VariantSet getUsedVariants() const noexcept {
+        return mUsedVariants.load(std::memory_order_relaxed);
+    }
+
+    // whether getProgram() can be called without creating the program (i.e. from any thread)
+    bool isProgramCached(uint8_t variantKey) const noexcept {
+        return bool(mCachedPrograms[variantKey]);
+    }
+
     bool isVariantLit() const noexcept { return mIsVariantLit; }
 
+    // materials compiled without punctual lights don't have the dynamic lighting variants
+    bool hasPunctualLights() const noexcept { return mHasPunctualLights; }
+
     const utils::CString& getName() const noexcept { return mName; }
     Driver::RasterState getRasterState() const noexcept  { return mRasterState; }
     uint32_t getId() const noexcept { return mMaterialId; }
@@ -103,6 +132,8 @@ public:
     bool isDoubleSided() const noexcept { return mDoubleSided; }
     float getMaskThreshold() const noexcept { return mMaskTreshold; }
     bool hasShadowMultiplier() const noexcept { return mHasShadowMultiplier; }
+    bool hasInstancing() const noexcept { return mHasInstancing; }
+    bool hasStereo() const noexcept { return mHasStereo; }
     AttributeBitset getRequiredAttributes() const noexcept { return mRequiredAttributes; }
 
     size_t getParameterCount() const noexcept {
@@ -113,9 +144,55 @@ public:
 
     uint32_t generateMaterialInstanceId() const noexcept { return mMaterialInstanceId++; }
 
+    // size of the material package, which is kept for creating the programs
+    size_t getPackageSize() const noexcept { return mPackageSize; }
+
+    // With Engine::Config::sharedMaterialInstanceUniforms, the uniforms of the instances live
+    // in a single buffer owned by the material, each in a slot of getInstanceUniformsStride()
+    // bytes. The instances copy their changes in their slot when they're committed, and
+    // commitInstanceUniforms() uploads all of them at once. The stride is 0 otherwise.
+    size_t getInstanceUniformsStride() const noexcept { return mInstancesStride; }
+    Handle<HwUniformBuffer> getInstanceUniformsHandle() const noexcept { return mInstancesUbh; }
+    uint32_t acquireInstanceUniforms() const noexcept;
+    void releaseInstanceUniforms(uint32_t slot) const noexcept;
+    void setInstanceUniforms(uint32_t slot, UniformBuffer const& uniforms) const noexcept;
+    void commitInstanceUniforms(FEngine& engine) const noexcept;
+
+    // number of programs created so far
+    size_t getProgramCount() const noexcept;
+
+    // Program cache, see FEngine::updateProgramCache(). This records the variants used since the last call as used in 'frame', and appends the
+    // programs that can be destroyed to 'programs'. Returns the size of all the programs.
+    size_t updateProgramUsage(uint32_t frame,
+            std::vector<FEngine::ProgramInfo>& programs) const noexcept;
+    void destroyProgram(uint8_t variantKey) const noexcept;
+    size_t getProgramsSize() const noexcept;
+
 private:
+    // creates the program of a variant, if 'required' is false the program isn't created
+    // (rather than failing) when the material doesn't have that variant.
+    Handle<HwProgram> createProgram(uint8_t variantKey, bool required) const noexcept;
+
+    // assembles the shaders of a variant into 'program' with the given builders, this doesn't
+    // use the driver and can be called from several threads. Returns false when 'required' is
+    // false and the material doesn't have the variant.
+    bool assembleProgram(Program& program, uint8_t variantKey, bool required,
+            filaflat::ShaderBuilder& vsBuilder, filaflat::ShaderBuilder& fsBuilder) const noexcept;
+
+    // creates the program assembled by assembleProgram() and caches it
+    Handle<HwProgram> cacheProgram(uint8_t variantKey, Program&& program) const noexcept;
+
+    // the depth variants can be the default material's
+    bool isSharedProgram(size_t variantKey) const noexcept {
+        return !mIsDefaultMaterial && !mHasCustomDepthShader && Variant(variantKey).isDepthPass();
+    }
+
     // try to order by frequency of use
     mutable std::array<Handle<HwProgram>, VARIANT_COUNT> mCachedPrograms;
+    mutable std::atomic<VariantSet> mUsedVariants = { 0 };
+    mutable std::atomic<VariantSet> mFrameVariants = { 0 };     // since updateProgramUsage()
+    mutable std::array<uint32_t, VARIANT_COUNT> mProgramLastUsedFrame = {};
+    mutable std::array<uint32_t, VARIANT_COUNT> mProgramSizes = {};
     Driver::RasterState mRasterState;
     Shading mShading;
     bool mIsVariantLit;
@@ -128,7 +205,10 @@ private:
     CullingMode mCullingMode;
     float mMaskTreshold;
     bool mHasShadowMultiplier = false;
+    bool mHasPunctualLights = true;
     bool mHasCustomDepthShader = false;
+    bool mHasInstancing = false;
+    bool mHasStereo = false;
     bool mIsDefaultMaterial = false;
 
     FMaterialInstance mDefaultInstance;
@@ -139,8 +219,18 @@ private:
     utils::CString mName;
     FEngine& mEngine;
     const uint32_t mMaterialId;
-    mutable uint32_t mMaterialInstanceId = 0;
+    // instances can be created from any thread
+    mutable std::atomic<uint32_t> mMaterialInstanceId = { 0 };
     filaflat::MaterialParser* mMaterialParser = nullptr;
+    size_t mPackageSize = 0;
+
+    // shared storage of the instances' uniforms, see getInstanceUniformsStride()
+    size_t mInstancesStride = 0;
+    mutable UniformBuffer mInstancesUniforms;
+    mutable Handle<HwUniformBuffer> mInstancesUbh;
+    mutable size_t mInstancesUbSize = 0;
+    mutable uint32_t mInstancesSlotCount = 0;
+    mutable std::vector<uint32_t> mInstancesFreeSlots;
 };
 
 
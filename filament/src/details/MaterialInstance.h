@@ -27,6 +27,8 @@
 
 #include <filament/MaterialInstance.h>
 
+#include <string.h>
+
 namespace filament {
 namespace details {
 
@@ -42,22 +44,39 @@ public:
 
     void terminate(FEngine& engine);
 
+    // Acquires the slot of our uniforms in the material's shared buffer, if it has one. This is
+    // done on the engine's thread, which the material's buffer belongs to.
+    void acquireUniformsSlot() noexcept;
+
     void commit(FEngine& engine) const {
         if (UTILS_UNLIKELY(mUniforms.isDirty() || mSamplers.isDirty())) {
             commitSlow(engine);
         }
     }
 
-    void use(FEngine::DriverApi& driver) const {
+    // DriverApi can be a CommandStream or a CommandStreamSizer. previous is the material
+    // instance used last with this driver, if any, the state it already set up is skipped.
+    // Returns the number of commands skipped.
+    template<typename DriverApi>
+    size_t use(DriverApi& driver, FMaterialInstance const* previous = nullptr) const {
         if (mUbHandle) {
             driver.bindUniforms(BindingPoints::PER_MATERIAL_INSTANCE, mUbHandle);
+        } else if (mUniformsSlot != NO_SLOT) {
+            // the uniforms live in the material's buffer, see FMaterial::setInstanceUniforms()
+            driver.bindUniformsRange(BindingPoints::PER_MATERIAL_INSTANCE,
+                    getMaterialInstanceUniformsHandle(),
+                    mUniformsSlot * getMaterialInstanceUniformsStride(), mUniforms.getSize());
         }
         if (mSbHandle) {
             driver.bindSamplers(BindingPoints::PER_MATERIAL_INSTANCE, mSbHandle);
         }
+        if (previous && !memcmp(previous->mScissorRect, mScissorRect, sizeof(mScissorRect))) {
+            return 1;
+        }
         driver.setViewportScissor(
                 mScissorRect[0], mScissorRect[1],
                 uint32_t(mScissorRect[2]), uint32_t(mScissorRect[3]));
+        return 0;
     }
 
     template <typename T>
@@ -96,6 +115,12 @@ private:
 
     void commitSlow(FEngine& engine) const;
 
+    // FMaterial is incomplete here
+    Handle<HwUniformBuffer> getMaterialInstanceUniformsHandle() const noexcept;
+    size_t getMaterialInstanceUniformsStride() const noexcept;
+
+    static constexpr uint32_t NO_SLOT = uint32_t(-1);
+
     // keep these grouped, they're accessed together in the render-loop
     FMaterial const* mMaterial = nullptr;
     Handle<HwUniformBuffer> mUbHandle;
@@ -106,6 +131,10 @@ private:
 
     uint64_t mMaterialSortingKey = 0;
 
+    // slot of the uniforms in the material's buffer, when Engine::Config::
+    // sharedMaterialInstanceUniforms is set (mUbHandle is null then)
+    uint32_t mUniformsSlot = NO_SLOT;
+
     // Scissor rectangle is specified as: Left Bottom Width Height.
     int32_t mScissorRect[4] = {
         0, 0, std::numeric_limits<int32_t>::max(), std::numeric_limits<int32_t>::max()
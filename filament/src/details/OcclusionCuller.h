@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+#define TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
+
+#include <utils/compiler.h>
+
+#include <math/mat4.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * Software occlusion culling.
+ *
+ * Occluders' bounding boxes are rasterized in a small depth buffer, from which a hierarchical
+ * depth pyramid (each texel holds the farthest depth of the 4 texels below it) is built.
+ * Boxes can then be tested against the pyramid in constant time.
+ *
+ * Occluders are rasterized conservatively: only the pixels entirely covered by the box's
+ * silhouette are written, with the depth of the box's farthest corner. This means an occluder's
+ * geometry must fill its bounding box for the results to be correct.
+ *
+ * Depths are stored as 1/w, so that 0 means "nothing", and larger values are closer.
+ */
+class OcclusionCuller {
+public:
+    // resolution of the depth buffer
+    static constexpr size_t WIDTH = 256;
+    static constexpr size_t HEIGHT = 128;
+
+    // clears the depth buffer, boxes are given in the space transformed by viewProjection
+    void prepare(math::mat4f const& viewProjection) noexcept;
+
+    // rasterizes an occluder, returns false if it couldn't be used (e.g. it's behind the camera)
+    bool addOccluder(math::float3 const& center, math::float3 const& halfExtent) noexcept;
+
+    // builds the depth pyramid, must be called after all occluders have been added
+    void buildPyramid() noexcept;
+
+    // returns true if the box is entirely hidden by the occluders. This can be called from
+    // several threads concurrently.
+    bool isOccluded(math::float3 const& center, math::float3 const& halfExtent) const noexcept;
+
+private:
+    struct ScreenBox {
+        math::float2 corners[8];
+        math::float2 min;
+        math::float2 max;
+        float nearest;      // largest 1/w of the corners
+        float farthest;     // smallest 1/w of the corners
+    };
+
+    // returns false if part of the box is behind the camera
+    bool project(math::float3 const& center, math::float3 const& halfExtent,
+            ScreenBox& box) const noexcept;
+
+    static constexpr size_t LEVEL_COUNT = 9; // 256x128 down to 1x1
+
+    static constexpr size_t getLevelWidth(size_t level) noexcept {
+        return (WIDTH >> level) ? (WIDTH >> level) : 1;
+    }
+    static constexpr size_t getLevelHeight(size_t level) noexcept {
+        return (HEIGHT >> level) ? (HEIGHT >> level) : 1;
+    }
+
+    math::mat4f mViewProjection;
+    std::vector<float> mDepth;          // all the levels, finest first
+    size_t mLevelOffsets[LEVEL_COUNT] = {};
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_OCCLUSIONCULLER_H
@@ -37,11 +37,15 @@ class FRenderPrimitive {
 public:
     FRenderPrimitive() noexcept = default;
 
-    void init(driver::DriverApi& driver, const RenderableManager::Builder::Entry& entry) noexcept;
+    // When 'skinned' is set, it holds the CPU-skinned vertices of the VertexBuffer, which the
+    // primitive draws instead, without the bone indices and weights.
+    void init(driver::DriverApi& driver, const RenderableManager::Builder::Entry& entry,
+            Handle<HwVertexBuffer> skinned = {}) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             FVertexBuffer* vertices, FIndexBuffer* indices, size_t offset,
-            size_t minIndex, size_t maxIndex, size_t count) noexcept;
+            size_t minIndex, size_t maxIndex, size_t count,
+            Handle<HwVertexBuffer> skinned = {}) noexcept;
 
     void set(FEngine& engine, RenderableManager::PrimitiveType type,
             size_t offset, size_t minIndex, size_t maxIndex, size_t count) noexcept;
@@ -51,6 +55,14 @@ public:
 
     const FMaterialInstance* getMaterialInstance() const noexcept { return mMaterialInstance; }
     Handle<HwRenderPrimitive> getHwHandle() const noexcept { return mHandle; }
+
+    // the primitive fetching only the VertexBuffer's depth attributes, if it has all the required
+    // ones, see VertexBuffer::Builder::depthBuffer()
+    Handle<HwRenderPrimitive> getDepthHwHandle(AttributeBitset required) const noexcept {
+        return (mDepthHandle && (mDepthAttributes & required) == required) ?
+                mDepthHandle : mHandle;
+    }
+
     driver::PrimitiveType getPrimitiveType() const noexcept { return mPrimitiveType; }
     AttributeBitset getEnabledAttributes() const noexcept { return mEnabledAttributes; }
     uint16_t getBlendOrder() const noexcept { return mBlendOrder; }
@@ -61,10 +73,17 @@ public:
     }
 
 private:
+    void setBuffers(driver::DriverApi& driver, FVertexBuffer const* vertices,
+            Handle<HwIndexBuffer> ibh, Handle<HwVertexBuffer> skinned) noexcept;
+    void setDepthBuffer(driver::DriverApi& driver, FVertexBuffer const* vertices,
+            Handle<HwVertexBuffer> vbh, Handle<HwIndexBuffer> ibh, bool skinned) noexcept;
+
     FMaterialInstance const* mMaterialInstance = nullptr;
     Handle<HwRenderPrimitive> mHandle;
+    Handle<HwRenderPrimitive> mDepthHandle;
     driver::PrimitiveType mPrimitiveType = driver::PrimitiveType::NONE;
     AttributeBitset mEnabledAttributes;
+    AttributeBitset mDepthAttributes;
     uint16_t mBlendOrder = 0;
 };
 
@@ -19,10 +19,12 @@
 
 #include "upcast.h"
 
+#include "CpuStageTimings.h"
 #include "FrameInfo.h"
 #include "RenderPass.h"
 
 #include "details/Allocators.h"
+#include "details/FramePacer.h"
 #include "details/FrameSkipper.h"
 #include "details/SwapChain.h"
 
@@ -36,6 +38,10 @@
 #include <utils/Allocator.h>
 #include <utils/Slice.h>
 
+#include <array>
+#include <chrono>
+#include <functional>
+
 namespace filament {
 
 class Driver;
@@ -43,9 +49,10 @@ class View;
 
 namespace details {
 
+class CascadedShadowMap;
+class ShadowAtlas;
 class FEngine;
 class FView;
-class ShadowMap;
 
 /*
  * A concrete implementation of the Renderer Interface.
@@ -61,14 +68,39 @@ public:
 
     // do all the work here!
     void render(FView const* view);
+    void render(View const* const* views, size_t count);
     void renderJob(ArenaScope& arena, FView* view);
 
-    bool beginFrame(FSwapChain* swapChain);
+    bool beginFrame(FSwapChain* swapChain, uint64_t vsyncSteadyClockTimeNano = 0);
     void endFrame();
 
+    void setDisplayInfo(DisplayInfo const& info) noexcept {
+        mFramePacer.setDisplayInfo(info.refreshRate,
+                info.presentationDeadlineNanos, info.vsyncOffsetNanos);
+    }
+
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer);
 
+    FrameStats getFrameStats() const noexcept;
+
+    CpuFrameStats getCpuFrameStats() const noexcept { return mCpuFrameStats; }
+    FrameSummary getFrameSummary() const noexcept { return mFrameSummary; }
+
+    void setCpuCountersEnabled(bool enabled) noexcept;
+
+    CpuCounterStats getCpuCounterStats() const noexcept { return mCpuCounterStats; }
+
+    size_t getCommandsHighWatermark() const noexcept {
+        return mCommandsHighWatermark * sizeof(RenderPass::Command);
+    }
+
+    // memory used by the draw commands and the color pass arena, in bytes
+    size_t getCommandsMemorySize() const noexcept {
+        return mCommands.getSize() + mColorCommands.getSize() +
+                mColorPassArena.getArea().getSize();
+    }
+
     // Clean-up everything, this is typically called when the client calls Engine::destroyRenderer()
     void terminate(FEngine& engine);
 
@@ -78,43 +110,97 @@ private:
     // this class is defined in RenderPass.cpp
     class ColorPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
+    public:
+        // The second subpass of the color pass' render pass, which reads the color pass' output
+        // from tile memory and draws into rth, see RenderPassParams::SUBPASS_INPUT.
+        struct Subpass {
+            driver::TextureFormat format;   // of the color pass' transient output
+            std::function<void(DriverApi&)> draw;
+        };
+    private:
         utils::JobSystem& js;
         utils::JobSystem::Job* jobFroxelize = nullptr;
         FView* const view;
         Handle<HwRenderTarget> const rth;
+        Subpass const* const subpass;
         virtual void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         virtual void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
         ColorPass(const char* name, utils::JobSystem& js, utils::JobSystem::Job* jobFroxelize,
-                FView* view, Handle<HwRenderTarget> const rth);
+                FView* view, Handle<HwRenderTarget> const rth, Subpass const* subpass = nullptr);
+        // starts generating the commands of the view's color pass in a job, arena and
+        // commands must not be used by anyone else until renderColorPass() returns, which
+        // releases the job
+        static utils::JobSystem::Job* prepareColorPass(utils::JobSystem& js, ArenaScope& arena,
+                FView* view, utils::GrowingSlice<Command>& commands) noexcept;
         static void renderColorPass(FEngine& engine, utils::JobSystem& js,
+                utils::JobSystem::Job* jobPrepare, utils::JobSystem::Job* jobFroxelize,
                 Handle<HwRenderTarget> const rth,
                 FView* view, Viewport const& scaledViewport,
+                utils::GrowingSlice<Command>& commands,
+                Subpass const* subpass = nullptr) noexcept;
+    };
+
+    // this class is defined in RenderPass.cpp
+    // draws the blended primitives of the renderables with lowResolutionBlending into a
+    // downsampled target, see View::setBlendingDownsampling()
+    class BlendingPass final : public RenderPass {
+        using DriverApi = driver::DriverApi;
+        FView* const view;
+        Handle<HwRenderTarget> const rth;
+        virtual void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
+        virtual void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
+    public:
+        BlendingPass(const char* name, FView* view, Handle<HwRenderTarget> const rth) noexcept;
+        // rth's depth buffer must hold the color pass' depth, downsampled to viewport
+        static void renderBlendingPass(FEngine& engine, utils::JobSystem& js, ArenaScope& arena,
+                Handle<HwRenderTarget> const rth, FView* view,
+                Viewport const& scaledViewport, Viewport const& viewport,
                 utils::GrowingSlice<Command>& commands) noexcept;
     };
 
     // this class is defined in RenderPass.cpp
     class ShadowPass final : public RenderPass {
         using DriverApi = driver::DriverApi;
-        ShadowMap const& shadowMap;
+        // renders either a cascade of the directional shadow map or a spot light shadow map
+        CascadedShadowMap const* const shadowMap;
+        ShadowAtlas const* const atlas;
+        size_t const cascade;       // or index of the shadow map in the atlas
+        bool const first;
+        bool const staticCasters;   // renders the static casters in the cache
         virtual void beginRenderPass(driver::DriverApi& driver, Viewport const& viewport, const CameraInfo& camera) noexcept override;
         virtual void endRenderPass(DriverApi& driver, Viewport const& viewport) noexcept override;
     public:
-        ShadowPass(const char* name, ShadowMap const& shadowMap) noexcept;
-        static void renderShadowMap(FEngine& engine, utils::JobSystem& js,
+        ShadowPass(const char* name, CascadedShadowMap const& shadowMap, size_t cascade,
+                bool first, bool staticCasters) noexcept;
+        ShadowPass(const char* name, ShadowAtlas const& atlas, size_t index, bool first) noexcept;
+        static void renderShadowMap(FEngine& engine, utils::JobSystem& js, ArenaScope& arena,
                 FView* view, utils::GrowingSlice<Command>& commands) noexcept;
     };
 
     Handle<HwRenderTarget> getRenderTarget() const noexcept { return mRenderTarget; }
 
+    // Storage for the high-level draw commands of a pass. It grows when a pass needs more
+    // commands than it can hold, and keeps its size afterwards.
+    class CommandBuffer {
+    public:
+        explicit CommandBuffer(size_t size) noexcept;
+        ~CommandBuffer() noexcept;
+        CommandBuffer(CommandBuffer const&) = delete;
+        CommandBuffer& operator=(CommandBuffer const&) = delete;
+
+        // storage for at least count commands, it's valid until the next call
+        Command* get(size_t count) noexcept;
+
+        size_t getSize() const noexcept { return mCapacity * sizeof(Command); }
+
+    private:
+        Command* mCommands = nullptr;
+        size_t mCapacity = 0;
+    };
+
     void recordHighWatermark(utils::Slice<Command> const& commands) noexcept {
-#ifndef NDEBUG
         mCommandsHighWatermark = std::max(mCommandsHighWatermark, size_t(commands.size()));
-#endif
-    }
-
-    size_t getCommandsHighWatermark() const noexcept {
-        return mCommandsHighWatermark * sizeof(RenderPass::Command);
     }
 
     driver::TextureFormat getHdrFormat() const noexcept {
@@ -132,17 +218,40 @@ private:
     // keep a reference to our engine
     FEngine& mEngine;
     FrameSkipper mFrameSkipper;
+    FramePacer mFramePacer;
+    uint64_t mVsyncSteadyClockTime = 0;     // vsync that started the current frame, 0 if none
     Handle<HwRenderTarget> mRenderTarget;
     FSwapChain* mSwapChain = nullptr;
     size_t mCommandsHighWatermark = 0;
     uint32_t mFrameId = 0;
     FrameInfoManager mFrameInfoManager;
+    CpuFrameStats mCpuFrameStats;
+    FrameSummary mFrameSummary;
+    std::chrono::steady_clock::time_point mBeginFrameTime;
+
+    // the stages' counters of the last frames, mCpuCounterStats is their average
+    static constexpr size_t CPU_COUNTERS_FRAME_COUNT = 60;
+    using StageCounters = std::array<CpuStageTimings::Counters, CpuStageTimings::STAGE_COUNT>;
+    std::array<StageCounters, CPU_COUNTERS_FRAME_COUNT> mCpuCounters;
+    uint32_t mCpuCountersIndex = 0;
+    uint32_t mCpuCountersFrameCount = 0;
+    CpuCounterStats mCpuCounterStats;
+    void updateCpuCounters(StageCounters const& counters) noexcept;
+
     bool mIsRGB16FSupported : 1;
     bool mIsRGB8Supported : 1;
+    bool mIsAutoResolveSupported : 1;
+    bool mIsMultiviewSupported : 1;
+    bool mIsSubpassSupported : 1;
 
     // per-frame arena for this Renderer
     LinearAllocatorArena& mPerRenderPassArena;
 
+    // the color pass' commands are generated concurrently with the shadow passes
+    LinearAllocatorArena mColorPassArena;
+    CommandBuffer mCommands;
+    CommandBuffer mColorCommands;
+
 #if EXTRA_TIMING_INFO
     Series<float> mRendering;
     Series<float> mPostProcess;
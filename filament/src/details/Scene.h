@@ -22,18 +22,25 @@
 #include "components/RenderableManager.h"
 #include "components/TransformManager.h"
 
+#include "details/BoundingVolumeHierarchy.h"
 #include "details/Culler.h"
 #include "details/GpuLightBuffer.h"
 
+#include "driver/UniformBuffer.h"
+
 #include <filament/Box.h>
 #include <filament/Scene.h>
 
+#include <math/mat4x3.h>
+
 #include <utils/compiler.h>
 #include <utils/Entity.h>
 #include <utils/Slice.h>
 #include <utils/StructureOfArrays.h>
 #include <utils/Range.h>
 
+#include <vector>
+
 #include <cstddef>
 #include <tsl/robin_set.h>
 
@@ -82,7 +89,10 @@ public:
 
     void prepare(const math::mat4f& worldOriginTansform);
     void prepareLights(const CameraInfo& camera) noexcept;
-    void computeBounds(Aabb& castersBox, Aabb& receiversBox, uint32_t visibleLayers) const noexcept;
+    // Bounds of the shadow casters and receivers in the visible layers, this runs on multiple
+    // threads when the scene is large.
+    void computeBounds(utils::JobSystem& js, Aabb& castersBox, Aabb& receiversBox,
+            uint32_t visibleLayers) const noexcept;
 
     /*
      * Storage for per-frame renderable data
@@ -90,33 +100,38 @@ public:
 
     enum {
         RENDERABLE_INSTANCE,    //  4 instance of the Renderable component
-        WORLD_TRANSFORM,        // 16 instance of the Transform component
-        VISIBILITY_STATE,       //  1 visibility data of the component
-        UBH,                    //  4 uniform buffer handle
-        BONES_UBH,              //  4 bones uniform buffer handle
+        WORLD_TRANSFORM,        // 12 instance of the Transform component (affine)
+        VISIBILITY_STATE,       //  2 visibility data of the component
+        BONES_OFFSET,           //  4 offset of the renderable's bones in the bone palette
         WORLD_AABB_CENTER,      // 12 world-space bounding box center of the renderable
         VISIBLE_MASK,           //  1 each bit represents a visibility in a pass
+        SPOT_SHADOW_MASK,       //  1 each bit represents a visibility in a spot light's shadow map
+        UNIFORMS_VALID,         //  1 the renderable's uniforms are up to date, see updateUBOs()
 
         // These are not needed anymore after culling
         LAYERS,                 //  1 layers
         WORLD_AABB_EXTENT,      // 12 world-space bounding box half-extent of the renderable
 
-        // These are temporaries and should be stored out of line
+        // These are temporaries, written each frame for the visible rows once they're
+        // partitioned, which doesn't move them. They must stay last.
         PRIMITIVES,             //  8 level-of-detail'ed primitives
+        SHADOW_PRIMITIVES,      //  8 level-of-detail'ed primitives of the shadow passes
         SUMMED_PRIMITIVE_COUNT, //  4 summed visible primitive counts
     };
 
     using RenderableSoa = utils::StructureOfArrays<
             utils::EntityInstance<RenderableManager>,
-            math::mat4f,
+            math::mat4x3f,
             FRenderableManager::Visibility,
-            Handle<HwUniformBuffer>,
-            Handle<HwUniformBuffer>,
+            uint32_t,
             math::float3,
             Culler::result_type,
+            Culler::result_type,
+            bool,
             uint8_t,
             math::float3,
             utils::Slice<FRenderPrimitive>,
+            utils::Slice<FRenderPrimitive>,
             uint32_t
     >;
 
@@ -143,22 +158,97 @@ public:
         POSITION_RADIUS,
         DIRECTION,
         LIGHT_INSTANCE,
-        VISIBILITY
+        VISIBILITY,
+        SHADOW_INDEX,           // shadow map of the light in the View's ShadowAtlas, or NO_SHADOW
+        LIGHT_FLAGS,            // LIGHT_CASTER | SPOT_LIGHT, see below
+        COS_OUTER_SQUARED,      // spot lights only, squared cosine of the outer cone angle
+        LIGHT_FADE              // scales the intensity, see FView::cullSmallLights()
     };
 
+    static constexpr uint8_t NO_SHADOW = 0xFF;
+
+    // LIGHT_FLAGS bits, copied from the LightManager so culling doesn't need to look lights up
+    static constexpr uint8_t LIGHT_CASTER = 0x1;    // the light casts light, with some intensity
+    static constexpr uint8_t SPOT_LIGHT = 0x2;
+
     using LightSoa = utils::StructureOfArrays<
             math::float4,
             math::float3,
             FLightManager::Instance,
-            Culler::result_type
+            Culler::result_type,
+            uint8_t,
+            uint8_t,
+            float,
+            float
     >;
 
     LightSoa const& getLightData() const noexcept { return mLightData; }
     LightSoa& getLightData() noexcept { return mLightData; }
 
-    void updateUBOs(utils::Range<uint32_t> visibleRenderables) const noexcept;
+    // What a View's buffer of per-renderable uniforms holds: a copy of its content and the
+    // renderable of each of its rows, see updateUBOs().
+    struct RenderableUbContent {
+        UniformBuffer uniforms;
+        std::vector<FRenderableManager::Instance> instances;
+        // FRenderableManager::getLocalUBOsVersion() when the content was last updated
+        uint32_t localUBOsVersion = 0;
+    };
+
+    // Updates the per-renderable uniforms of the visible renderables and uploads them into
+    // renderableUbh, which must be as large as content.uniforms: the uniforms of the renderable
+    // at row i are at offset i * FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE.
+    // The uniforms are only computed again when the renderable's transform changed, so the
+    // views of a scene share that work, and so do frames where nothing moves. Only the rows
+    // that differ from content are uploaded, nothing at all when the same renderables are
+    // visible and didn't move.
+    void updateUBOs(utils::Range<uint32_t> visibleRenderables,
+            Handle<HwUniformBuffer> renderableUbh, RenderableUbContent& content) noexcept;
+
+    GroupId createGroup(Box const& bounds) noexcept;
+    void removeGroup(GroupId group) noexcept;
+    void addToGroup(GroupId group, utils::Entity const* entities, size_t count);
+    void setGroupVisible(GroupId group, bool visible) noexcept;
+    bool isGroupVisible(GroupId group) const noexcept;
+    size_t getGroupEntityCount(GroupId group) const noexcept;
+    Box getGroupBounds(GroupId group) const noexcept;
+
+    // Incremented each time entities are added to or removed from the scene, or a group is
+    // shown or hidden.
+    uint32_t getVersion() const noexcept { return mVersion; }
+
+    // Incremented by prepare() each time a static shadow caster is added, removed or moved.
+    uint32_t getStaticShadowCastersVersion() const noexcept { return mStaticShadowCastersVersion; }
+
+    // Hierarchy of the renderables' world AABBs, null when the scene is too small to need one.
+    BoundingVolumeHierarchy const* getRenderableBvh() const noexcept {
+        return mRenderableBvh.empty() ? nullptr : &mRenderableBvh;
+    }
+
+    // Row in the renderable SoA of each of the BVH's boxes, valid after
+    // updateRenderableBvhRows() as long as the SoA isn't reordered.
+    uint32_t const* getRenderableBvhRows() const noexcept { return mRenderableBvhRows.data(); }
+
+    // must be called after the renderable SoA is reordered, before culling with the BVH
+    void updateRenderableBvhRows() noexcept;
+
+    // below this many renderables, the BVH isn't worth it
+    static constexpr size_t BVH_MIN_RENDERABLE_COUNT = 2048;
 
 private:
+    void updateRenderableBvh() noexcept;
+
+    // transforms the local bounding boxes of the renderables to world space, and returns the
+    // hash of the static shadow casters
+    uint32_t computeWorldBounds(utils::JobSystem& js) noexcept;
+
+    struct Group;
+    Group* getGroup(GroupId group) noexcept;
+    Group const* getGroup(GroupId group) const noexcept;
+
+    // calls f(entity) for the entities added directly and those of the visible groups
+    template<typename F>
+    void forEachEntity(F f) const noexcept;
+
     FEngine& mEngine;
     FSkybox const* mSkybox = nullptr;
     FIndirectLight const* mIndirectLight = nullptr;
@@ -168,8 +258,53 @@ private:
     // (a vector<> could work, but removes would be O(n)). robin_set<> iterates almost as
     // nicely as vector<>, which is a good compromise.
     tsl::robin_set<utils::Entity> mEntities;
+
+    // Groups are not indexed, their entities are only ever iterated, all at once. A GroupId is
+    // the index of the group in mGroups; the slots of the removed groups are reused.
+    struct Group {
+        std::vector<utils::Entity> entities;
+        Box bounds;
+        bool visible = true;
+        bool alive = false;
+    };
+    std::vector<Group> mGroups;
+    std::vector<GroupId> mFreeGroups;
     RenderableSoa mRenderableData;
     LightSoa mLightData;
+    uint32_t mVersion = 0;
+
+    // what mRenderableData and mPreparedLights were last computed from, see prepare()
+    struct PreparedState {
+        uint32_t sceneVersion;
+        uint32_t entityVersion;     // destroyed entities stay in the managers until their gc
+        uint32_t renderableVersion;
+        uint32_t transformVersion;
+        uint32_t lightVersion;
+        math::mat4f worldOrigin;
+    };
+    PreparedState mPreparedState = {};
+    bool mPreparedStateValid = false;
+    // FRenderableManager::getLocalUBOsVersion() after our last updateUBOs()
+    uint32_t mLocalUBOsVersion = 0;
+    uint32_t mStaticShadowCastersHash = 0;
+    uint32_t mStaticShadowCastersVersion = 0;
+
+    // lights gathered by prepare(), the first entries are the directional lights
+    struct PreparedLight {
+        math::float4 positionRadius;
+        math::float3 direction;
+        FLightManager::Instance instance;
+        uint8_t flags;
+        float cosOuterSquared;
+    };
+    std::vector<PreparedLight> mPreparedLights;
+
+    // built in the order of mRenderableData right after prepare(), identifies renderables by
+    // their index in mRenderableBvhInstances
+    BoundingVolumeHierarchy mRenderableBvh;
+    std::vector<FRenderableManager::Instance> mRenderableBvhInstances;
+    std::vector<uint32_t> mRenderableBvhBoxOfInstance;
+    std::vector<uint32_t> mRenderableBvhRows;
 };
 
 FILAMENT_UPCAST(Scene)
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+#define TNT_FILAMENT_DETAILS_SHADOWATLAS_H
+
+#include "details/ShadowMap.h"
+
+#include "driver/DriverApiForward.h"
+#include "driver/SamplerBuffer.h"
+
+#include <filament/EngineEnums.h>
+
+#include <math/vec2.h>
+
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace details {
+
+/*
+ * The shadow maps of the spot lights, packed in a single depth texture.
+ *
+ * Each frame, up to CONFIG_MAX_SHADOWED_SPOT_LIGHTS of the visible spot lights that cast shadows
+ * get a square tile of the atlas, sized after how large the light is on screen (but never more
+ * than its shadow map size). Tiles are powers of two, and the largest ones are shrunk until they
+ * all fit, so the atlas' memory never changes. The lights that are the largest on screen get a
+ * shadow map first.
+ */
+class ShadowAtlas {
+public:
+    // dimension of the (DEPTH16) atlas texture, i.e. 8 MiB
+    static constexpr uint32_t ATLAS_SIZE = 2048;
+
+    // range of the tiles' dimension
+    static constexpr uint32_t MIN_TILE_SIZE = 64;
+    static constexpr uint32_t MAX_TILE_SIZE = 1024;
+
+    struct Tile {
+        uint32_t x;
+        uint32_t y;
+        uint32_t size;
+    };
+
+    explicit ShadowAtlas(FEngine& engine) noexcept;
+    ~ShadowAtlas();
+
+    void terminate(driver::DriverApi& driverApi) noexcept;
+
+    // Picks the shadowed spot lights among the visible lights, sets their FScene::SHADOW_INDEX
+    // (and resets the other lights') and computes their tiles and cameras. lightData must only
+    // contain the visible lights. viewportHeight is used to measure the lights' size on screen.
+    void update(FScene::LightSoa& lightData, CameraInfo const& camera,
+            float viewportHeight) noexcept;
+
+    // Scale of the tiles' largest size w.r.t. the lights' shadow map size, 1 by default.
+    void setResolutionScale(float scale) noexcept { mResolutionScale = scale; }
+
+    // Resets the lights' FScene::SHADOW_INDEX and removes all shadow maps, e.g. when the
+    // view's shadows are disabled.
+    void clear(FScene::LightSoa& lightData) noexcept;
+
+    // Number of shadow maps in the atlas. Valid after update().
+    size_t getShadowMapCount() const noexcept { return mShadowMapCount; }
+
+    // Shadow map of the light whose FScene::SHADOW_INDEX is i. Valid after update().
+    ShadowMap const& getShadowMap(size_t i) const noexcept { return *mShadowMaps[i]; }
+
+    // Allocates the atlas texture (once) and sets it in the sampler buffer.
+    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
+
+    // Size in bytes of the atlas texture. Valid after prepare().
+    size_t getTextureSize() const noexcept {
+        return mAtlasHandle ? ATLAS_SIZE * ATLAS_SIZE * sizeof(uint16_t) : 0;   // DEPTH16
+    }
+
+    // Set-up the render target, call before rendering each shadow map. This clears the shadow
+    // map's tile only, 'first' must be set for the first shadow map rendered in a frame.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t i, bool first) const noexcept;
+
+    /*
+     * Places square tiles in an atlas of atlasSize x atlasSize texels. The tiles' dimensions
+     * must be powers of two no larger than the atlas, and no smaller than minSize. The largest
+     * tiles are halved (down to minSize) until they all fit, sizes are updated accordingly.
+     * Tiles are placed largest first in Z-order, which packs them without gaps. Returns the
+     * number of tiles placed, tiles that can't fit even at minSize are dropped (their size is
+     * set to 0).
+     */
+    static size_t pack(uint32_t atlasSize, uint32_t minSize,
+            uint32_t* sizes, Tile* tiles, size_t count) noexcept;
+
+private:
+    // a visible spot light that casts shadows, and the tile size it would like
+    struct Candidate {
+        uint32_t row;
+        float pixels;           // size on screen
+        uint32_t size;
+    };
+
+    std::unique_ptr<ShadowMap> mShadowMaps[CONFIG_MAX_SHADOWED_SPOT_LIGHTS];
+    size_t mShadowMapCount = 0;
+    float mResolutionScale = 1.0f;
+    std::vector<Candidate> mCandidates;
+
+    // set-up in prepare()
+    Handle<HwTexture> mAtlasHandle;
+    Handle<HwRenderTarget> mAtlasRenderTarget;
+
+    FEngine& mEngine;
+};
+
+} // namespace details
+} // namespace filament
+
+#endif // TNT_FILAMENT_DETAILS_SHADOWATLAS_H
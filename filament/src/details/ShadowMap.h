@@ -25,36 +25,59 @@
 #include "driver/DriverApiForward.h"
 #include "driver/SamplerBuffer.h"
 
+#include <filament/EngineEnums.h>
 #include <filament/Viewport.h>
+#include <filament/driver/DriverEnums.h>
 
 #include <math/mat4.h>
 #include <math/vec4.h>
 
+#include <memory>
+
 namespace filament {
 namespace details {
 
 class ShadowMap {
 public:
+    // The part of the view frustum a shadow map covers and its tile in the shadow map texture.
+    // The default covers the whole view frustum (up to the light's shadowFar) with the whole
+    // texture. Spot lights ignore zn and zf, their shadow map always covers their cone.
+    struct Cascade {
+        float zn = 0;               // view-space distances, the view frustum is used when zf is 0
+        float zf = 0;
+        uint8_t column = 0;         // tile of this shadow map
+        uint8_t row = 0;
+        uint8_t columns = 1;        // tiles in the texture
+        uint8_t rows = 1;
+        uint16_t dimension = 0;     // of the tile, the light's shadow map size when 0
+    };
+
+    // World-space bounds of the scene's shadow casters and receivers, see FScene::computeBounds().
+    // Only directional lights use them.
+    struct SceneBounds {
+        Aabb casters;
+        Aabb receivers;
+    };
+
     explicit ShadowMap(FEngine& engine) noexcept;
     ~ShadowMap();
 
-    void terminate(driver::DriverApi& driverApi) noexcept;
-
     // Call once per frame if the light, scene (or visible layers) or camera changes.
     // This computes the light's camera.
     void update(
-            const FScene::LightSoa& lightData, size_t index, FScene const* scene,
-            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
+            const FScene::LightSoa& lightData, size_t index,
+            details::CameraInfo const& camera, Cascade const& cascade,
+            SceneBounds const& bounds) noexcept;
 
     // Do we have visible shadows. Valid after calling update().
     bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
 
-    // Allocates shadow texture based on user parameters (e.g. dimensions)
-    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
-
-    // Returns the shadow map's viewport. Valid after prepare().
+    // Returns the shadow map's viewport in the shadow map texture. Valid after update().
     Viewport const& getViewport() const noexcept { return mViewport; }
 
+    // Returns the dimension of the shadow map (i.e. of its tile). Valid after update().
+    uint32_t getDimension() const noexcept { return mShadowMapDimension; }
+
     // Computes the transform to use in the shader to access the shadow map.
     // Valid after calling update().
     math::mat4f const& getLightSpaceMatrix() const noexcept { return mLightSpace; }
@@ -68,9 +91,6 @@ public:
     // Returns the light's projection. Valid after calling update().
     FCamera const& getCamera() const noexcept { return *mCamera; }
 
-    // Set-up the render target, call before rendering the shadow map.
-    void beginRenderPass(driver::DriverApi& driverApi) const noexcept;
-
     // use only for debugging
     FCamera const& getDebugCamera() const noexcept { return *mDebugCamera; }
 
@@ -105,8 +125,11 @@ private:
     using FrustumBoxIntersection = std::array<math::float3, 64>;
 
     void computeShadowCameraDirectional(
-            math::float3 const& direction, FScene const* scene, CameraInfo const& camera,
-            uint8_t visibleLayers) noexcept;
+            math::float3 const& direction, SceneBounds const& bounds,
+            CameraInfo const& camera) noexcept;
+
+    void computeShadowCameraSpot(math::float3 const& position, math::float3 const& direction,
+            float radius, float cosOuterSquared, CameraInfo const& camera) noexcept;
 
     static math::mat4f applyLISPSM(
             CameraInfo const& camera, float dzn, float dzf, const math::mat4f& LMpMv,
@@ -119,6 +142,7 @@ private:
     static inline void computeFrustumCorners(math::float3* out,
             const math::mat4f& projectionViewInverse) noexcept;
 
+    // light-space z range of a box, lightView must be affine
     static inline math::float2 computeNearFar(math::mat4f const& lightView,
             Aabb const& wsShadowCastersVolume) noexcept;
 
@@ -149,6 +173,7 @@ private:
     static math::mat4f warpFrustum(float n, float f) noexcept;
 
     math::mat4f getTextureCoordsMapping() const noexcept;
+    math::mat4f getTileMapping() const noexcept;
 
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix) const noexcept;
     float texelSizeWorldSpace(const math::mat4f& lightSpaceMatrix, math::float3 const& str) const noexcept;
@@ -173,12 +198,9 @@ private:
     float mSceneRange = 0.0f;
     float mTexelSizeWs = 0.0f;
 
-    // set-up in prepare()
-    Viewport mViewport;
-    Handle<HwTexture> mShadowMapHandle;
-    Handle<HwRenderTarget> mShadowMapRenderTarget;
-
     // set-up in update()
+    Viewport mViewport;
+    Cascade mCascade;
     uint32_t mShadowMapDimension = 0;
     bool mHasVisibleShadows = false;
 
@@ -190,6 +212,109 @@ private:
     const bool mClipSpaceFlipped;
 };
 
+/*
+ * The directional light's shadow map, split in cascades which each cover a slice of the view
+ * frustum in their own tile of a single texture. Tiles are the size the light asks for, see
+ * FLightManager::getShadowMapSize(), so the texture is 2x1 tiles with 2 cascades and 2x2 tiles
+ * with 3 or 4.
+ *
+ * With static caching, the static shadow casters of each cascade are rendered in a second
+ * texture, only when the cascade's light camera, the visible layers or the scene's static
+ * casters change. Each frame, the cached tiles are blitted into the shadow map before the dynamic
+ * casters are rendered on top.
+ */
+class CascadedShadowMap {
+public:
+    explicit CascadedShadowMap(FEngine& engine) noexcept;
+    ~CascadedShadowMap();
+
+    void terminate(driver::DriverApi& driverApi) noexcept;
+
+    // between 1 and CONFIG_MAX_SHADOW_CASCADES, 1 by default
+    void setCascadeCount(size_t count) noexcept;
+    size_t getCascadeCount() const noexcept { return mCascadeCount; }
+
+    // Caches the static shadow casters, see RenderableManager::Builder::staticShadowCaster().
+    // Disabled by default.
+    void setStaticCachingEnabled(bool enabled) noexcept;
+    bool isStaticCachingEnabled() const noexcept { return mStaticCaching; }
+
+    // Scale of the cascades' size w.r.t. the light's shadow map size, 1 by default. A new
+    // scale reallocates the texture in the next prepare().
+    void setResolutionScale(float scale) noexcept { mResolutionScale = scale; }
+
+    // Computes the cascades' split distances and cameras, see ShadowMap::update().
+    void update(
+            const FScene::LightSoa& lightData, size_t index, FScene const* scene,
+            details::CameraInfo const& camera, uint8_t visibleLayers) noexcept;
+
+    // Does any cascade have visible shadows. Valid after calling update().
+    bool hasVisibleShadows() const noexcept { return mHasVisibleShadows; }
+
+    ShadowMap& getCascade(size_t cascade) noexcept { return *mCascades[cascade]; }
+    ShadowMap const& getCascade(size_t cascade) const noexcept { return *mCascades[cascade]; }
+
+    // Returns the view-space distance at which the cascade ends, infinite for the last one.
+    // Valid after calling update().
+    float getCascadeFar(size_t cascade) const noexcept { return mCascadeFar[cascade]; }
+
+    // Allocates the shadow map texture based on user parameters (e.g. dimensions)
+    void prepare(driver::DriverApi& driver, SamplerBuffer& buffer) noexcept;
+
+    // Size in bytes of the shadow map texture and of the static cache's. Valid after prepare().
+    size_t getTextureSize() const noexcept {
+        const size_t count = size_t(bool(mShadowMapHandle)) + size_t(bool(mStaticShadowMapHandle));
+        return count * mTextureWidth * mTextureHeight * sizeof(uint16_t);   // DEPTH16
+    }
+
+    // Set-up the render target, call before rendering each cascade. This clears the cascade's
+    // tile only, 'first' must be set for the first cascade rendered in a frame.
+    // With static caching, the tile is instead initialized with the cached static casters and
+    // only the dynamic casters must be rendered.
+    void beginRenderPass(driver::DriverApi& driverApi, size_t cascade, bool first) const noexcept;
+
+    // Whether the static casters of a cascade must be rendered (again) in the cache this frame,
+    // with beginStaticRenderPass() and before beginRenderPass(). Valid after prepare().
+    bool isStaticCacheDirty(size_t cascade) const noexcept { return mStaticCaches[cascade].dirty; }
+
+    // Set-up the cache's render target to render the static casters of a cascade.
+    void beginStaticRenderPass(driver::DriverApi& driverApi, size_t cascade) const noexcept;
+
+private:
+    // what the static casters of a cascade were last rendered with
+    struct StaticCache {
+        math::mat4f lightSpace;
+        FScene const* scene = nullptr;
+        uint32_t staticCastersVersion = 0;
+        uint8_t visibleLayers = 0;
+        bool valid = false;
+        bool dirty = false;
+    };
+
+    void invalidateStaticCaches() noexcept;
+    void updateStaticCaches(FScene const* scene, uint8_t visibleLayers) noexcept;
+    driver::RenderPassParams getTileRenderPassParams(size_t cascade) const noexcept;
+
+    std::unique_ptr<ShadowMap> mCascades[CONFIG_MAX_SHADOW_CASCADES];
+    float mCascadeFar[CONFIG_MAX_SHADOW_CASCADES] = {};
+    size_t mCascadeCount = 1;
+    float mResolutionScale = 1.0f;
+    bool mHasVisibleShadows = false;
+
+    // set-up in prepare()
+    uint32_t mTextureWidth = 0;
+    uint32_t mTextureHeight = 0;
+    Handle<HwTexture> mShadowMapHandle;
+    Handle<HwRenderTarget> mShadowMapRenderTarget;
+
+    bool mStaticCaching = false;
+    StaticCache mStaticCaches[CONFIG_MAX_SHADOW_CASCADES];
+    Handle<HwTexture> mStaticShadowMapHandle;
+    Handle<HwRenderTarget> mStaticShadowMapRenderTarget;
+
+    FEngine& mEngine;
+};
+
 } // namespace details
 } // namespace filament
 
@@ -42,6 +42,8 @@ public:
     void readPixels(uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             driver::PixelBufferDescriptor&& buffer) noexcept;
 
+    int64_t getTimestamp() const noexcept;
+
     bool isNativeStream() const noexcept { return mNativeStream != nullptr; }
 
     bool isExternalTextureId() const noexcept { return !isNativeStream(); }
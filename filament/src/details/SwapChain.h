@@ -33,6 +33,7 @@ class FEngine;
 class FSwapChain : public SwapChain {
 public:
     FSwapChain(FEngine& engine, void* nativeWindow, uint64_t flags);
+    FSwapChain(FEngine& engine, uint32_t width, uint32_t height, uint64_t flags);
     void terminate(FEngine& engine) noexcept;
 
     void makeCurrent(driver::DriverApi& driverApi) noexcept {
@@ -51,10 +52,16 @@ public:
         return (mConfigFlags & CONFIG_TRANSPARENT) != 0;
     }
 
+    // the frames of a headless swap chain are never presented
+    bool isHeadless() const noexcept {
+        return mHeadless;
+    }
+
 private:
     Handle<HwSwapChain> mSwapChain;
     void* mNativeWindow = nullptr;
     uint64_t mConfigFlags = 0;
+    bool mHeadless = false;
 };
 
 FILAMENT_UPCAST(SwapChain)
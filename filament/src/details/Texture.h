@@ -25,6 +25,8 @@
 
 #include <utils/compiler.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace details {
 
@@ -55,6 +57,11 @@ public:
             uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
             PixelBufferDescriptor&& buffer) const noexcept;
 
+    void setImage(FEngine& engine, size_t level,
+            uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+            uint32_t width, uint32_t height, uint32_t depth,
+            PixelBufferDescriptor&& buffer) const noexcept;
+
     void setImage(FEngine& engine, size_t level,
             PixelBufferDescriptor&& buffer, const FaceOffsets& faceOffsets) const noexcept;
 
@@ -62,15 +69,44 @@ public:
     void setExternalStream(FEngine& engine, FStream* stream) noexcept;
 
     void generateMipmaps(FEngine& engine) const noexcept;
+    void setImageWithMips(FEngine& engine, PixelBufferDescriptor&& buffer,
+            MipmapFilter filter) const noexcept;
 
     void setSampleCount(size_t sampleCount) noexcept { mSampleCount = uint8_t(sampleCount); }
     size_t getSampleCount() const noexcept { return mSampleCount; }
     bool isMultisample() const noexcept { return mSampleCount > 1; }
 
     bool isCubemap() const noexcept { return mTarget == Sampler::SAMPLER_CUBEMAP; }
+    bool isArray() const noexcept { return mTarget == Sampler::SAMPLER_2D_ARRAY; }
 
     FStream const* getStream() const noexcept { return mStream; }
 
+    // size of all the resident levels in bytes, 0 for compressed formats
+    size_t getSize() const noexcept { return getSize(mResidentLevel); }
+
+    // size of the levels from firstLevel to the last one
+    size_t getSize(size_t firstLevel) const noexcept;
+
+    // Streaming: the hardware texture only holds the levels from mResidentLevel on, it's
+    // reallocated when the resident level changes and the loader refills it.
+    static constexpr uint8_t NO_REQUEST = 0xFF;
+    bool isStreaming() const noexcept { return mCoarseLevel > 0; }
+    size_t getResidentLevel() const noexcept { return mResidentLevel; }
+    size_t getCoarseLevel() const noexcept { return mCoarseLevel; }
+    size_t getRequestedLevel() const noexcept { return mRequestedLevel; }
+    uint32_t getLastUsedFrame() const noexcept { return mLastUsedFrame; }
+
+    // records that this texture is sampled at (about) the given level during the given frame
+    void requestLevel(size_t level, uint32_t frame) const noexcept {
+        mRequestedLevel = uint8_t(std::min(size_t(mRequestedLevel), level));
+        mLastUsedFrame = frame;
+    }
+    void clearRequest() noexcept { mRequestedLevel = NO_REQUEST; }
+
+    // calls the loader for all the resident levels
+    void loadResidentLevels(FEngine& engine) noexcept;
+    void setResidentLevel(FEngine& engine, size_t level) noexcept;
+
     static size_t getFormatSize(InternalFormat format) noexcept;
 
 private:
@@ -85,6 +121,13 @@ private:
     uint8_t mSampleCount = 1;
     FStream* mStream = nullptr;
     Usage mUsage = Usage::DEFAULT;
+
+    StreamingLoader mLoader = nullptr;
+    void* mLoaderUser = nullptr;
+    uint8_t mResidentLevel = 0;
+    uint8_t mCoarseLevel = 0;
+    mutable uint8_t mRequestedLevel = NO_REQUEST;
+    mutable uint32_t mLastUsedFrame = 0;
 };
 
 
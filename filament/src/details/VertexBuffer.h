@@ -19,14 +19,17 @@
 
 #include "upcast.h"
 
+#include "driver/DriverApiForward.h"
 #include "driver/Handle.h"
 
+#include <filament/RenderableManager.h>
 #include <filament/VertexBuffer.h>
 
 #include <utils/bitset.h>
 #include <utils/compiler.h>
 
 #include <array>
+#include <memory>
 #include <type_traits>
 
 namespace filament {
@@ -45,23 +48,62 @@ public:
 
     size_t getVertexCount() const noexcept;
 
+    // size of all the buffers in bytes
+    size_t getSize() const noexcept;
+
     AttributeBitset getDeclaredAttributes() const noexcept {
         return mDeclaredAttributes;
     }
 
+    // attributes fetched by the depth and shadow passes, empty if they fetch all of them
+    AttributeBitset getDepthAttributes() const noexcept {
+        return mDepthAttributes;
+    }
+
+    // whether skinned renderables using this buffer are skinned on the CPU, see cpuSkinning()
+    bool hasCpuSkinning() const noexcept { return mCpuSkinning; }
+
+    // incremented each time the CPU copy of the buffers changes
+    uint32_t getCpuVersion() const noexcept { return mCpuVersion; }
+
+    // the attributes of the buffers created by createSkinnedBuffer()
+    AttributeBitset getSkinnedAttributes() const noexcept;
+
+    // a buffer with the same layout, minus the bone indices and weights, to skin() into
+    Handle<HwVertexBuffer> createSkinnedBuffer(driver::DriverApi& driver) const noexcept;
+
+    // Skins the CPU copy of the vertices into a buffer created by createSkinnedBuffer(). Only the
+    // buffers holding positions or tangents are uploaded, unless 'all' is set.
+    void skin(FEngine& engine, Handle<HwVertexBuffer> target,
+            RenderableManager::Bone const* bones, size_t boneCount, bool all) const;
+
     // no-op if bufferIndex out of range
     void setBufferAt(FEngine& engine, uint8_t bufferIndex,
             driver::BufferDescriptor&& buffer,
             uint32_t byteOffset = 0, uint32_t byteSize = 0);
 
+    // no-op if bufferIndex out of range
+    void setBufferRangesAt(FEngine& engine, uint8_t bufferIndex,
+            driver::BufferDescriptor&& buffer, BufferRange const* ranges, size_t count);
+
 private:
     friend class VertexBuffer;
 
+    size_t getBufferSize(size_t bufferIndex) const noexcept;
+    void copyToCpuBuffer(uint8_t bufferIndex, void const* data,
+            uint32_t byteOffset, uint32_t byteSize) noexcept;
+
     Handle<HwVertexBuffer> mHandle;
     std::array<Builder::AttributeData, MAX_ATTRIBUTE_BUFFERS_COUNT> mAttributes;
     AttributeBitset mDeclaredAttributes;
+    AttributeBitset mDepthAttributes;
     uint32_t mVertexCount = 0;
     uint8_t mBufferCount = 0;
+
+    // the CPU copy of the buffers, only kept for cpuSkinning()
+    std::unique_ptr<uint8_t[]> mCpuBuffers[MAX_ATTRIBUTE_BUFFERS_COUNT];
+    uint32_t mCpuVersion = 1;   // never 0, which is the version of a buffer never skinned
+    bool mCpuSkinning = false;
 };
 
 FILAMENT_UPCAST(VertexBuffer)
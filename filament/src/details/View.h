@@ -18,12 +18,18 @@
 #define TNT_FILAMENT_DETAILS_VIEW_H
 
 #include <filament/View.h>
+#include <filament/PotentiallyVisibleSet.h>
 
 #include "upcast.h"
 
+#include "RenderPass.h"
+
 #include "details/Allocators.h"
 #include "details/Camera.h"
+#include "details/ColorGrading.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/ShadowAtlas.h"
 #include "details/ShadowMap.h"
 #include "details/Scene.h"
 
@@ -38,6 +44,7 @@
 #include <utils/Range.h>
 
 #include <deque>
+#include <vector>
 
 namespace utils {
 class JobSystem;
@@ -50,6 +57,7 @@ class FEngine;
 class FMaterialInstance;
 class FRenderer;
 class FScene;
+class FTexture;
 class Froxelizer;
 
 class FView : public View {
@@ -64,15 +72,30 @@ public:
     void prepare(FEngine& engine, driver::DriverApi& driver, ArenaScope& arena,
             Viewport const& viewport) noexcept;
 
-    void setScene(FScene* scene) { mScene = scene; }
+    void setScene(FScene* scene) {
+        mScene = scene;
+        clearCommandCaches();
+    }
     FScene const* getScene() const noexcept { return mScene; }
     FScene* getScene() noexcept { return mScene; }
 
-    void setCullingCamera(FCamera* camera) noexcept { mCullingCamera = camera; }
-    void setViewingCamera(FCamera* camera) noexcept { mViewingCamera = camera; }
+    void setCullingCamera(FCamera* camera) noexcept {
+        mCullingCamera = camera;
+        clearCommandCaches();
+    }
+    void setViewingCamera(FCamera* camera) noexcept {
+        mViewingCamera = camera;
+        clearCommandCaches();
+    }
 
     CameraInfo const& getCameraInfo() const noexcept { return mViewingCameraInfo; }
 
+    void setStereo(FCamera* left, FCamera* right, FTexture* target) noexcept;
+    bool isStereo() const noexcept { return mStereoTarget != nullptr; }
+
+    // the multiview render target drawing both eyes into the stereo texture, created by prepare()
+    Handle<HwRenderTarget> getStereoRenderTarget() const noexcept { return mStereoRenderTarget; }
+
     void setViewport(Viewport const& viewport) noexcept;
     Viewport const& getViewport() const noexcept {
         return mViewport;
@@ -96,9 +119,55 @@ public:
     }
     bool isSkyboxVisible() const noexcept;
 
-    void setCulling(bool culling) noexcept { mCulling = culling; }
+    void setCulling(bool culling) noexcept {
+        mCulling = culling;
+        clearCommandCaches();
+    }
     bool isCullingEnabled() const noexcept { return mCulling; }
 
+    void setOcclusionCullingEnabled(bool enabled) noexcept {
+        mOcclusionCulling = enabled;
+        clearCommandCaches();
+    }
+    bool isOcclusionCullingEnabled() const noexcept { return mOcclusionCulling; }
+    size_t getOcclusionCulledCount() const noexcept { return mOcclusionCulledCount; }
+
+    void setPotentiallyVisibleSet(PotentiallyVisibleSet const* pvs,
+            utils::Entity const* entities, size_t count) noexcept;
+    size_t getPvsCulledCount() const noexcept { return mPvsCulledCount; }
+
+    void setSmallFeatureCulling(float minSizeInPixels) noexcept {
+        mSmallFeatureCulling = std::max(0.0f, minSizeInPixels);
+        clearCommandCaches();
+    }
+    float getSmallFeatureCulling() const noexcept { return mSmallFeatureCulling; }
+
+    void setDrawBudget(uint32_t maxPrimitiveCount) noexcept {
+        mDrawBudget = maxPrimitiveCount;
+        clearCommandCaches();
+    }
+    uint32_t getDrawBudget() const noexcept { return mDrawBudget; }
+    size_t getDrawBudgetCulledCount() const noexcept { return mDrawBudgetCulledCount; }
+
+    void setBlendingDownsampling(uint8_t factor) noexcept {
+        mBlendingDownsampling = uint8_t(factor >= 4 ? 4 : factor >= 2 ? 2 : 1);
+    }
+    uint8_t getBlendingDownsampling() const noexcept { return mBlendingDownsampling; }
+
+    // whether this frame draws the low resolution blended primitives in their own pass
+    bool hasLowResolutionBlending() const noexcept { return mHasLowResolutionBlending; }
+
+    void setCommandCachingEnabled(bool enabled) noexcept;
+    bool isCommandCachingEnabled() const noexcept { return mCommandCaching; }
+
+    // the caches to use for this frame's passes, null when command caching is disabled
+    RenderPass::CommandCache* getColorPassCommandCache() noexcept {
+        return mCommandCaching ? &mColorPassCommandCache : nullptr;
+    }
+    RenderPass::CommandCache* getShadowPassCommandCache(size_t cascade) noexcept {
+        return mCommandCaching ? &mShadowPassCommandCaches[cascade] : nullptr;
+    }
+
     void setVisibleLayers(uint8_t select, uint8_t values) noexcept;
     uint8_t getVisibleLayers() const noexcept {
         return mVisibleLayers;
@@ -114,36 +183,116 @@ public:
     }
 
     void prepareCamera(const CameraInfo& camera, const Viewport& viewport) const noexcept;
-    void prepareShadowing(FEngine& engine, driver::DriverApi& driver,
-            FScene::RenderableSoa& renderableData, FScene::LightSoa const& lightData) noexcept;
+    // prepareCamera() for a pass drawing into a viewport downsampled by factor, the froxels stay
+    // those of the full resolution viewport. A factor of 1 restores the full resolution.
+    void prepareDownsampledCamera(const CameraInfo& camera, const Viewport& viewport,
+            float factor) const noexcept;
+    // computes the shadow cameras and culls the shadow casters of each cascade into its own
+    // casterMasks array, this doesn't use the driver and can run concurrently with the camera
+    // and light culling
+    void prepareShadowing(FEngine& engine, FScene::RenderableSoa& renderableData,
+            FScene::LightSoa const& lightData, Culler::result_type* const* casterMasks) noexcept;
+    // picks the shadowed spot lights and culls their shadow casters, each into its own
+    // spotCasterMasks array allocated from the arena, after the lights are culled
+    void prepareSpotShadowing(FEngine& engine, ArenaScope& arena,
+            FScene::RenderableSoa& renderableData, FScene::LightSoa& lightData,
+            Culler::result_type** spotCasterMasks) noexcept;
+    // allocates the shadow maps and sets their uniforms, after prepareShadowing() and
+    // prepareSpotShadowing()
+    void prepareShadowMap(FEngine& engine, driver::DriverApi& driver) noexcept;
     void prepareLighting(
             FEngine& engine, FEngine::DriverApi& driver, ArenaScope& arena, Viewport const& viewport) noexcept;
     void froxelize(FEngine& engine) const noexcept;
-    void commitUniforms(driver::DriverApi& driverApi) const noexcept;
+    void commitUniforms(FEngine& engine) const noexcept;
     void commitFroxels(driver::DriverApi& driverApi) const noexcept;
 
     bool hasDirectionalLight() const noexcept { return mHasDirectionalLight; }
     bool hasDynamicLighting() const noexcept { return mHasDynamicLighting; }
-    bool hasShadowing() const noexcept { return mHasShadowing & mDirectionalShadowMap.hasVisibleShadows(); }
+    bool hasDirectionalShadows() const noexcept {
+        return mHasDirectionalShadows & mDirectionalShadowMap.hasVisibleShadows();
+    }
+    bool hasSpotShadows() const noexcept { return mSpotShadowAtlas.getShadowMapCount() > 0; }
+    bool hasShadowing() const noexcept { return hasDirectionalShadows() | hasSpotShadows(); }
 
     void prepareVisibleRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData) const noexcept;
 
     void prepareVisibleShadowCasters(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-                                     Frustum const& lightFrustum) const noexcept;
+            Frustum const& lightFrustum, Culler::result_type* casterMask,
+            size_t bit) const noexcept;
 
     void updatePrimitivesLod(
             FEngine& engine, const CameraInfo& camera,
             FScene::RenderableSoa& renderableData, Range visibles) noexcept;
 
-    static void cullRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
-                                Frustum const& frustum, size_t bit) noexcept;
+    // records the levels the streaming textures of the visible renderables need
+    void requestStreamingLevels(FEngine& engine, const CameraInfo& camera,
+            FScene::RenderableSoa const& renderableData, Range visibles) const noexcept;
+
+    // sets the LARGE_ENOUGH bit of the renderables that aren't too small on screen
+    void cullSmallFeatures(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+            math::mat4f const& projection, math::mat4f const& view) const noexcept;
+
+    void cullOccludedRenderables(utils::JobSystem& js, FScene::RenderableSoa& renderableData,
+            math::mat4f const& viewProjection) noexcept;
+
+    // clears the VISIBLE_RENDERABLE bit of the renderables the PVS hides from the camera's cell
+    void cullWithPvs(FEngine& engine, FScene::RenderableSoa& renderableData,
+            math::float3 const& cameraPosition) noexcept;
+
+    // clears the VISIBLE_RENDERABLE bit of the least important renderables, until the visible ones
+    // fit in the draw budget
+    void applyDrawBudget(FEngine& engine, ArenaScope& arena,
+            FScene::RenderableSoa& renderableData, math::mat4f const& viewProjection) noexcept;
+
+    // picks the depth prepass strategy of this frame, with DepthPrepass::DEFAULT the largest
+    // visible opaque renderables get the Visibility::depthPrepass bit
+    void prepareDepthPrepass(FEngine& engine, ArenaScope& arena,
+            FScene::RenderableSoa& renderableData,
+            math::mat4f const& projection, math::mat4f const& view) noexcept;
+
+    // uses the scene's BVH when it has one
+    static void cullRenderables(utils::JobSystem& js, FScene const& scene,
+            FScene::RenderableSoa& renderableData, Frustum const& frustum,
+            Culler::result_type* results, size_t bit) noexcept;
 
     void setShadowsEnabled(bool enabled) noexcept { mShadowingEnabled = enabled; }
 
-    ShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
+    void setShadowCascades(uint8_t count) noexcept;
+    uint8_t getShadowCascades() const noexcept {
+        return uint8_t(mDirectionalShadowMap.getCascadeCount());
+    }
+
+    void setStaticShadowCachingEnabled(bool enabled) noexcept {
+        mDirectionalShadowMap.setStaticCachingEnabled(enabled);
+        clearCommandCaches();
+    }
+    bool isStaticShadowCachingEnabled() const noexcept {
+        return mDirectionalShadowMap.isStaticCachingEnabled();
+    }
+
+    void setShadowOptions(View::ShadowOptions const& options) noexcept;
+    ShadowOptions getShadowOptions() const noexcept { return mShadowOptions; }
+
+    void setLightCullingOptions(View::LightCullingOptions const& options) noexcept;
+    LightCullingOptions getLightCullingOptions() const noexcept { return mLightCullingOptions; }
+
+    // The bits of the visible renderables, of the shadow casters visible in a cascade and of
+    // those visible in a spot light's shadow map. The low byte selects bits of the
+    // VISIBLE_MASK, the high byte bits of the SPOT_SHADOW_MASK.
+    static uint16_t getRenderableVisibleMask() noexcept;
+    static uint16_t getShadowCascadeVisibleMask(size_t cascade) noexcept;
+    static uint16_t getSpotShadowVisibleMask(size_t index) noexcept;
+
+    // the per-renderable uniforms of this frame's visible renderables, see FScene::updateUBOs()
+    Handle<HwUniformBuffer> getRenderableUbh() const noexcept { return mRenderableUbh; }
+
+    CascadedShadowMap const& getShadowMap() const { return mDirectionalShadowMap; }
+    ShadowAtlas const& getSpotShadowAtlas() const noexcept { return mSpotShadowAtlas; }
+    Froxelizer const& getFroxelizer() const noexcept { return mFroxelizer; }
+    ShadowAtlas const& getShadowAtlas() const { return mSpotShadowAtlas; }
 
     FCamera const* getDirectionalLightCamera() const noexcept {
-        return &mDirectionalShadowMap.getDebugCamera();
+        return &mDirectionalShadowMap.getCascade(0).getDebugCamera();
     }
 
     void setRenderTarget(TargetBufferFlags discard) noexcept {
@@ -166,13 +315,50 @@ public:
         return mAntiAliasing;
     }
 
+    // the temporal anti-aliasing needs the post-processing, and replaces the multi-sampling
+    bool hasTemporalAntiAliasing() const noexcept {
+        return mAntiAliasing == AntiAliasing::TEMPORAL && mHasPostProcessPass &&
+                mSampleCount <= 1 && !isStereo();
+    }
+
+    // Swaps the history targets of the temporal anti-aliasing, the one written by the last
+    // frame becomes the texture to resolve with. They're recreated, and invalid for this frame,
+    // the first time or when their size or format changes. prepare() destroys them when the
+    // temporal anti-aliasing is off.
+    void prepareTemporalHistory(driver::DriverApi& driver,
+            uint32_t width, uint32_t height, driver::TextureFormat format) noexcept;
+
+    // the target this frame's resolve writes into, and its texture
+    Handle<HwRenderTarget> getTemporalHistoryTarget() const noexcept {
+        return mTemporalHistory[mTemporalHistoryIndex].target;
+    }
+    Handle<HwTexture> getTemporalHistoryTexture() const noexcept {
+        return mTemporalHistory[mTemporalHistoryIndex].texture;
+    }
+    // the last frame's resolved color
+    Handle<HwTexture> getTemporalPreviousTexture() const noexcept {
+        return mTemporalHistory[mTemporalHistoryIndex ^ 1u].texture;
+    }
+
+    // offset of this frame's color pass, in its pixels, set by prepare()
+    math::float2 getTemporalJitter() const noexcept { return mTemporalJitter; }
+
+    // this frame's clip space to the last frame's, without the jitter
+    math::mat4f const& getTemporalReprojection() const noexcept { return mTemporalReprojection; }
+
+    // false when the last frame's history can't be used
+    bool isTemporalHistoryValid() const noexcept { return mTemporalHistoryValid; }
+
     TargetBufferFlags getDiscardedTargetBuffers() const noexcept { return mDiscardedTargetBuffers; }
 
     bool hasPostProcessPass() const noexcept {
         return mHasPostProcessPass;
     }
 
-    math::float2 updateScale(std::chrono::duration<float, std::milli> frameTime) noexcept;
+    // frameTime is the GPU time of the last measured frame, frameInterval the time between
+    // the last two frames
+    math::float2 updateScale(std::chrono::duration<float, std::milli> frameTime,
+            std::chrono::duration<float, std::milli> frameInterval) noexcept;
 
     void setDynamicResolutionOptions(View::DynamicResolutionOptions const& options) noexcept;
 
@@ -180,7 +366,23 @@ public:
         return mDynamicResolution;
     }
 
+    math::float2 getDynamicResolutionScale() const noexcept {
+        return mScale;
+    }
+
     void setDynamicLightingOptions(float zLightNear, float zLightFar) noexcept;
+    void setFroxelCount(uint32_t froxelCount) noexcept;
+
+    void setColorGradingOptions(View::ColorGradingOptions const& options) noexcept {
+        mColorGrading.setOptions(options);
+    }
+
+    ColorGradingOptions getColorGradingOptions() const noexcept {
+        return mColorGrading.getOptions();
+    }
+
+    // the color grading LUT of the post-process tone mapping, baked by prepare()
+    Handle<HwTexture> getColorGradingLut() const noexcept { return mColorGrading.getTexture(); }
 
     void setPostProcessingEnabled(bool enabled) noexcept {
         mHasPostProcessPass = enabled;
@@ -194,6 +396,23 @@ public:
         return mDepthPrepass;
     }
 
+    void setRenderOrder(RenderOrder order) noexcept {
+        mRenderOrder = order;
+    }
+
+    RenderOrder getRenderOrder() const noexcept {
+        return mRenderOrder;
+    }
+
+    // whether this frame's color pass is preceded by a depth prepass, see prepareDepthPrepass()
+    bool hasDepthPrepass() const noexcept { return mUseDepthPrepass; }
+
+    // only the renderables with the Visibility::depthPrepass bit are drawn in the depth prepass
+    bool isDepthPrepassLimited() const noexcept { return mDepthPrepassLimited; }
+
+    // estimated overdraw of the opaque renderables during the last frame
+    float getOverdraw() const noexcept { return mOverdraw; }
+
     Range const& getVisibleRenderables() const noexcept {
         return mVisibleRenderables;
     }
@@ -206,13 +425,28 @@ public:
     void setCameraUser(FCamera* camera) noexcept { setCullingCamera(camera); }
 
 private:
-    void prepareVisibleLights(
-            FLightManager& lcm, utils::JobSystem& js, FScene::LightSoa& lightData) const;
+    void prepareVisibleLights(FEngine& engine, FScene::LightSoa& lightData) const;
+
+    static void cullLights(Culler::result_type* visible, math::float4 const* planes,
+            math::float4 const* spheres, math::float3 const* directions, uint8_t const* flags,
+            float const* cosOuterSquared, size_t count) noexcept;
+
+    // culls the lights visible[i] whose contribution is below the LightCullingOptions, and
+    // sets the fade factor of the others
+    void cullSmallLights(FEngine& engine, Culler::result_type* visible, float* fades,
+            math::float4 const* spheres, FLightManager::Instance const* instances,
+            size_t count) const noexcept;
 
     void computeVisibilityMasks(
-            uint8_t visibleLayers, uint8_t const* layers,
+            uint8_t visibleLayers, bool smallFeatureCulling, uint8_t const* layers,
             FRenderableManager::Visibility const* visibility, uint8_t* visibleMask,
-            size_t count) const;
+            uint8_t const* const* casterMasks, uint8_t* spotShadowMask,
+            uint8_t const* const* spotCasterMasks, uint8_t allSpotShadows, size_t count) const;
+
+    // sets the cameras of the eyes, and the viewing camera and culling frustum to their union
+    void prepareStereoCameras(math::mat4f const& worldOriginScene) noexcept;
+    void prepareStereoRenderTarget(driver::DriverApi& driver) noexcept;
+    void destroyStereoRenderTarget(driver::DriverApi& driver) noexcept;
 
     void bindPerViewUniformsAndSamplers(FEngine::DriverApi& driver) const noexcept {
         driver.bindUniforms(BindingPoints::PER_VIEW, getUbh());
@@ -224,10 +458,18 @@ private:
     static FScene::RenderableSoa::iterator partition(
             FScene::RenderableSoa::iterator begin, FScene::RenderableSoa::iterator end, uint8_t mask) noexcept;
 
+    // partitions the renderables w.r.t. their visibility (see prepare()) and returns the end of
+    // the renderable-only, renderable and caster, and caster-only ranges in ends.
+    static void partition(utils::JobSystem& js, ArenaScope& arena,
+            FScene::RenderableSoa& renderableData, uint32_t ends[3]) noexcept;
+
 
     // these are accessed in the render loop, keep together
     Handle<HwSamplerBuffer> mPerViewSbh;
     Handle<HwUniformBuffer> mPerViewUbh;
+    Handle<HwUniformBuffer> mRenderableUbh;
+    size_t mRenderableUbSize = 0;
+    FScene::RenderableUbContent mRenderableUbContent;
 
     UniformBuffer& getUb() const noexcept { return mPerViewUb; }
     Handle<HwUniformBuffer> getUbh() const noexcept { return mPerViewUbh; }
@@ -235,6 +477,13 @@ private:
     SamplerBuffer& getUs() const noexcept { return mPerViewSb; }
     Handle<HwSamplerBuffer> getUsh() const noexcept { return mPerViewSbh; }
 
+    void clearCommandCaches() noexcept {
+        mColorPassCommandCache.clear();
+        for (auto& cache : mShadowPassCommandCaches) {
+            cache.clear();
+        }
+    }
+
     FScene* mScene = nullptr;
     FCamera* mCullingCamera = nullptr;
     FCamera* mViewingCamera = nullptr;
@@ -242,6 +491,32 @@ private:
     CameraInfo mViewingCameraInfo;
     Frustum mCullingFrustum;
 
+    // stereo rendering, see setStereo()
+    FCamera* mStereoCameras[CONFIG_STEREO_EYE_COUNT] = {};
+    FTexture* mStereoTarget = nullptr;
+    CameraInfo mEyeCameraInfo[CONFIG_STEREO_EYE_COUNT];
+    Handle<HwTexture> mStereoColor;             // the texture mStereoRenderTarget draws into
+    Handle<HwTexture> mStereoDepth;
+    Handle<HwRenderTarget> mStereoRenderTarget;
+
+    // temporal anti-aliasing, see prepareTemporal() and prepareTemporalHistory()
+    void prepareTemporal(Viewport const& viewport) noexcept;
+    void destroyTemporalHistory(driver::DriverApi& driver) noexcept;
+    struct TemporalHistory {
+        Handle<HwTexture> texture;
+        Handle<HwRenderTarget> target;
+    };
+    TemporalHistory mTemporalHistory[2];    // the last frame's and this frame's, they alternate
+    uint8_t mTemporalHistoryIndex = 0;
+    bool mTemporalHistoryValid = false;
+    uint32_t mTemporalWidth = 0;
+    uint32_t mTemporalHeight = 0;
+    driver::TextureFormat mTemporalFormat = driver::TextureFormat::RGBA16F;
+    uint32_t mTemporalSample = 0;
+    math::float2 mTemporalJitter = {};
+    math::mat4 mTemporalClipFromWorld;      // the last frame's, without the jitter
+    math::mat4f mTemporalReprojection;
+
     mutable Froxelizer mFroxelizer;
 
     Viewport mViewport;
@@ -257,6 +532,38 @@ private:
     bool mShadowingEnabled = true;
     bool mHasPostProcessPass = true;
     DepthPrepass mDepthPrepass = DepthPrepass::DEFAULT;
+    RenderOrder mRenderOrder = RenderOrder::HYBRID;
+    bool mUseDepthPrepass = false;
+    bool mDepthPrepassLimited = false;
+    float mOverdraw = 0.0f;
+    uint8_t mBlendingDownsampling = 1;
+    bool mHasLowResolutionBlending = false;
+
+    float mSmallFeatureCulling = 0.0f;
+    uint32_t mDrawBudget = 0;
+    uint32_t mDrawBudgetCulledCount = 0;
+    bool mOcclusionCulling = false;
+    uint32_t mOcclusionCulledCount = 0;
+    OcclusionCuller mOcclusionCuller;
+
+    // the potentially visible set, the renderable of each of its objects, and the object of
+    // each renderable instance (or NO_PVS_OBJECT), rebuilt when the renderables change
+    static constexpr uint32_t NO_PVS_OBJECT = 0xFFFFFFFF;
+    PotentiallyVisibleSet mPvs;
+    std::vector<utils::Entity> mPvsEntities;
+    std::vector<uint32_t> mPvsObjects;
+    uint32_t mPvsObjectsVersion = 0;
+    bool mPvsObjectsValid = false;
+    uint32_t mPvsCulledCount = 0;
+
+    // level of detail picked for each renderable, indexed by instance
+    std::vector<uint8_t> mLodLevels;
+
+    // versions of the scene, renderable and transform managers the cached commands were made with
+    bool mCommandCaching = false;
+    uint32_t mCommandCacheVersions[3] = {};
+    RenderPass::CommandCache mColorPassCommandCache;
+    RenderPass::CommandCache mShadowPassCommandCaches[CONFIG_MAX_SHADOW_CASCADES];
 
     using duration = std::chrono::duration<float, std::milli>;
     DynamicResolutionOptions mDynamicResolution;
@@ -264,8 +571,20 @@ private:
 
     math::float2 mScale = 1.0f;
     float mDynamicWorkloadScale = 1.0f;
+    float mScaleErrors[2] = {};     // the controller's last two errors
+    float mFrameInterval = 0.0f;    // low-passed time between frames, in ms
     bool mIsDynamicResolutionSupported = false;
 
+    // the shadow maps' size follows the same frame times, see updateShadowScale()
+    void updateShadowScale(float workloadScale) noexcept;
+    void setShadowScale(float scale) noexcept;
+    ShadowOptions mShadowOptions;
+    LightCullingOptions mLightCullingOptions;
+    ColorGrading mColorGrading;
+    float mShadowScale = 1.0f;
+    float mShadowWorkloadScale = 1.0f;
+    uint8_t mShadowScaleCooldown = 0;
+
     mutable UniformBuffer mPerViewUb;
     mutable SamplerBuffer mPerViewSb;
 
@@ -277,8 +596,10 @@ private:
     Range mVisibleShadowCasters;
     mutable bool mHasDirectionalLight = false;
     mutable bool mHasDynamicLighting = false;
-    mutable bool mHasShadowing = false;
-    mutable ShadowMap mDirectionalShadowMap;
+    mutable bool mHasDirectionalShadows = false;
+    FLightManager::Instance mShadowLight;
+    mutable CascadedShadowMap mDirectionalShadowMap;
+    mutable ShadowAtlas mSpotShadowAtlas;
 };
 
 FILAMENT_UPCAST(View)
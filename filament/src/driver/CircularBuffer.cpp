@@ -49,16 +49,43 @@ CircularBuffer::CircularBuffer(size_t size) {
     mHead = mData;
 }
 
+CircularBuffer::CircularBuffer(void* begin, size_t size) noexcept {
+    // mData stays null, so we never try to free or circularize this memory
+    mSize = size;
+    mTail = begin;
+    mHead = begin;
+}
+
 CircularBuffer::~CircularBuffer() noexcept {
+    release({ mData, mSize, mUsesAshmem });
+}
+
+CircularBuffer::Storage CircularBuffer::grow(size_t size) noexcept {
+    assert(mData && empty());
+    assert(size >= mSize);
+    Storage previous = { mData, mSize, mUsesAshmem };
+#if HAS_MMAP
+    mUsesAshmem = -1;
+    mData = alloc(size);
+#else
+    mData = malloc(2 * size);
+#endif
+    mSize = size;
+    mTail = mData;
+    mHead = mData;
+    return previous;
+}
+
+void CircularBuffer::release(Storage const& storage) noexcept {
 #if HAS_MMAP
-    if (mData) {
-        munmap(mData, mSize * 2 + BLOCK_SIZE);
-        if (mUsesAshmem >= 0) {
-            close(mUsesAshmem);
+    if (storage.data) {
+        munmap(storage.data, storage.size * 2 + BLOCK_SIZE);
+        if (storage.ashmem >= 0) {
+            close(storage.ashmem);
         }
     }
 #else
-    free(mData);
+    free(storage.data);
 #endif
 }
 
@@ -120,16 +147,17 @@ void* CircularBuffer::alloc(size_t size) noexcept {
         if (fd >= 0)
             close(fd);
 
-        data = mmap(nullptr, size * 2 + BLOCK_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        data = mmap(nullptr, size * 2 + BLOCK_SIZE,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-        ASSERT_POSTCONDITION(mData,
+        ASSERT_POSTCONDITION(data != MAP_FAILED,
                 "couldn't allocate %u KiB of memory for the command buffer",
                 (size * 2 / 1024));
 
         slog.d << "WARNING: Using soft CircularBuffer (" << (size*2 / 1024) << " KiB)" << io::endl;
 
         // guard page at the end
-        void* guard = (void*)(uintptr_t(mData) + size * 2);
+        void* guard = (void*)(uintptr_t(data) + size * 2);
         mprotect(guard, BLOCK_SIZE, PROT_NONE);
     }
     return data;
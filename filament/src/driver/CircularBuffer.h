@@ -37,6 +37,11 @@ public:
     //      to set it to 3*requiredSize to avoid blocking the render thread (usually the UI thread).
     CircularBuffer(size_t bufferSize);
 
+    // Wraps 'size' bytes of memory owned by someone else (e.g.: space reserved in another
+    // CircularBuffer), so it can be recorded into by a CommandStream. This memory is not freed
+    // and such a buffer must never be circularized.
+    CircularBuffer(void* begin, size_t size) noexcept;
+
     // can't be moved or copy-constructed
     CircularBuffer(CircularBuffer const& rhs) = delete;
     CircularBuffer(CircularBuffer&& rhs) noexcept = delete;
@@ -66,6 +71,20 @@ public:
     // call at least once every getRequiredSize() bytes allocated from the buffer
     void circularize() noexcept;
 
+    // The memory of a buffer.
+    struct Storage {
+        void* data;
+        size_t size;
+        int ashmem;
+    };
+
+    // Replaces the memory with a new (larger) buffer of 'size' bytes, the buffer must be empty,
+    // i.e. circularize() was just called. The previous memory is returned rather than freed, since
+    // the commands recorded in it might not have been executed yet, release() frees it.
+    Storage grow(size_t size) noexcept;
+
+    static void release(Storage const& storage) noexcept;
+
 private:
     void* alloc(size_t size) noexcept;
 
@@ -18,6 +18,8 @@
 
 #include <assert.h>
 
+#include <algorithm>
+
 #include <utils/Log.h>
 #include <utils/Systrace.h>
 
@@ -27,21 +29,79 @@ using namespace utils;
 
 namespace filament {
 
-CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize)
+CommandBufferQueue::CommandBufferQueue(size_t requiredSize, size_t bufferSize,
+        size_t maxBufferSize)
         : mRequiredSize((requiredSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK),
-          mCircularBuffer(bufferSize),
+          mMaxBufferSize((maxBufferSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK),
+          mCircularBuffer((bufferSize + CircularBuffer::BLOCK_MASK) & ~CircularBuffer::BLOCK_MASK),
           mFreeSpace(mCircularBuffer.size()) {
     assert(mCircularBuffer.size() > requiredSize);
 }
 
 CommandBufferQueue::~CommandBufferQueue() {
-    assert(!mCommandBuffersToExecute.size());
+    assert(mReadIndex.load() == mWriteIndex.load());
+    CircularBuffer::release(mRetired);
+}
+
+CommandBufferQueue::Stats CommandBufferQueue::getStats() const noexcept {
+    return { mCircularBuffer.size(), mHighWatermark, mBlockCount, mBlockedTime, mGrowCount };
+}
+
+bool CommandBufferQueue::growIfNeeded() noexcept {
+    CircularBuffer& circularBuffer = mCircularBuffer;
+    assert(circularBuffer.empty());
+
+    // we're done with the previous memory once its slices have all been released
+    if (mRetired.data && int32_t(mReadIndex.load() - mRetiredIndex) >= 0) {
+        CircularBuffer::release(mRetired);
+        mRetired = {};
+    }
+
+    // flush() keeps mRequiredSize available, so the commands in flight can only use the rest
+    const size_t size = circularBuffer.size();
+    const size_t threshold = (size - mRequiredSize) / 4 * 3;
+    if (size >= mMaxBufferSize || mRecentHighWatermark <= threshold || mRetired.data) {
+        return false;
+    }
+
+    SYSTRACE_CALL();
+    const size_t newSize = std::min(size * 2, mMaxBufferSize);
+    mRetired = circularBuffer.grow(newSize);
+    mRetiredIndex = mWriteIndex.load(std::memory_order_relaxed);
+    mRecentHighWatermark = 0;
+    mGrowCount++;
+
+    // The slices in flight are in the previous memory, the space they'll give back when they're
+    // released makes up for the space they don't actually use in the new one.
+    mFreeSpace.fetch_add(newSize - size);
+
+#ifndef NDEBUG
+    slog.d << "CircularBuffer grew to " << newSize / 1024 << " KiB" << io::endl;
+#endif
+    return true;
+}
+
+void CommandBufferQueue::wakeUp() const noexcept {
+    // Only pay for the lock and the notification when the other thread sleeps, or is about to. It
+    // registers itself before checking its predicate, so either it sees the change we've just made
+    // or we see it. Taking the lock guarantees it's not in-between its check and its sleep.
+    if (UTILS_UNLIKELY(mWaiters.load() != 0)) {
+        std::unique_lock<utils::Mutex> lock(mLock);
+        lock.unlock();
+        mCondition.notify_all();
+    }
+}
+
+void CommandBufferQueue::recordBlockedTime(
+        std::chrono::steady_clock::time_point start) noexcept {
+    mBlockCount++;
+    mBlockedTime += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
 }
 
 void CommandBufferQueue::requestExit() {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mExitRequested = true;
-    mCondition.notify_one();
+    mExitRequested.store(true);
+    wakeUp();
 }
 
 void CommandBufferQueue::flush() noexcept {
@@ -67,53 +127,68 @@ void CommandBufferQueue::flush() noexcept {
 
     circularBuffer.circularize();
 
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mCommandBuffersToExecute.push_back({ tail, head });
-
     // circular buffer is too small, we corrupted the stream
-    assert(used <= mFreeSpace);
+    assert(used <= mFreeSpace.load());
+
+    // the ring of slices is full, which only happens with lots of tiny slices
+    const uint32_t writeIndex = mWriteIndex.load(std::memory_order_relaxed);
+    if (UTILS_UNLIKELY(writeIndex - mReadIndex.load() >= MAX_PENDING_SLICES)) {
+        SYSTRACE_NAME("waiting: CommandBufferQueue::flush()");
+        const auto start = std::chrono::steady_clock::now();
+        sleepUntil([this, writeIndex]() -> bool {
+            return writeIndex - mReadIndex.load() < MAX_PENDING_SLICES;
+        });
+        recordBlockedTime(start);
+    }
+
+    // hand the slice over to the consumer
+    mSlices[writeIndex % MAX_PENDING_SLICES] = { tail, head };
+    const size_t freeSpace = mFreeSpace.fetch_sub(used) - used;
+    mWriteIndex.store(writeIndex + 1);
+    wakeUp();
 
     // wait until there is enough space in the buffer
-    mFreeSpace -= used;
     const size_t requiredSize = mRequiredSize;
 
-#ifndef NDEBUG
-    size_t totalUsed = circularBuffer.size() - mFreeSpace;
+    size_t totalUsed = circularBuffer.size() - freeSpace;
     mHighWatermark = std::max(mHighWatermark, totalUsed);
+    mRecentHighWatermark = std::max(mRecentHighWatermark, totalUsed);
+#ifndef NDEBUG
     if (UTILS_UNLIKELY(totalUsed > requiredSize)) {
         slog.d << "CommandStream used too much space: " << totalUsed
             << ", out of " << requiredSize << " (will block)" << io::endl;
     }
 #endif
 
-    if (UTILS_LIKELY(mFreeSpace >= requiredSize)) {
-        // ideally (and usually) we don't have to wait, this is the common case, so special case
-        // the unlock-before-notify, optimization.
-        lock.unlock();
-        mCondition.notify_one();
-    } else {
+    if (UTILS_UNLIKELY(freeSpace < requiredSize)) {
         // unfortunately, there is not enough space left, we'll have to wait.
-        mCondition.notify_one(); // too bad there isn't a notify-and-wait
         SYSTRACE_NAME("waiting: CircularBuffer::flush()");
-        mCondition.wait(lock, [this, requiredSize]() -> bool {
-            return mFreeSpace >= requiredSize;
+        const auto start = std::chrono::steady_clock::now();
+        sleepUntil([this, requiredSize]() -> bool {
+            return mFreeSpace.load() >= requiredSize;
         });
+        recordBlockedTime(start);
     }
 }
 
-std::vector<CommandBufferQueue::Slice> CommandBufferQueue::waitForCommands() const {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    while (!mCommandBuffersToExecute.size() && !mExitRequested) {
-        mCondition.wait(lock);
+CommandBufferQueue::SliceRange CommandBufferQueue::waitForCommands() const {
+    const uint32_t begin = mConsumedIndex;
+    auto ready = [this, begin]() -> bool {
+        return mWriteIndex.load() != begin || mExitRequested.load();
+    };
+    if (!ready()) {
+        sleepUntil(ready);
     }
-    return std::move(mCommandBuffersToExecute);
+    const uint32_t end = mWriteIndex.load();
+    mConsumedIndex = end;
+    return { mSlices, begin, end };
 }
 
 void CommandBufferQueue::releaseBuffer(CommandBufferQueue::Slice const& buffer) {
-    std::unique_lock<utils::Mutex> lock(mLock);
-    mFreeSpace += uintptr_t(buffer.end) - uintptr_t(buffer.begin);
-    lock.unlock();
-    mCondition.notify_one();
+    // the slot can be reused as soon as mReadIndex moves past it, read it first
+    mFreeSpace.fetch_add(uintptr_t(buffer.end) - uintptr_t(buffer.begin));
+    mReadIndex.store(mReadIndex.load(std::memory_order_relaxed) + 1);
+    wakeUp();
 }
 
 } // namespace filament
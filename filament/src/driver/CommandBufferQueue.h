@@ -19,16 +19,25 @@
 
 #include "driver/CircularBuffer.h"
 
+#include <utils/architecture.h>
 #include <utils/compiler.h>
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
 
-#include <vector>
+#include <atomic>
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
 
 namespace filament {
 
 /*
  * A produdcer-consumer command queue that uses a CircularBuffer as main storage
+ *
+ * The flushed Slices are handed over through a lock-free single-producer / single-consumer ring,
+ * the lock is only taken by a thread that has to sleep (the consumer when there are no commands,
+ * the producer when the CircularBuffer is full) and by the other thread to wake it up.
  */
 class CommandBufferQueue {
     struct Slice {
@@ -36,30 +45,114 @@ class CommandBufferQueue {
         void* end;
     };
 
+public:
+    // Maximum number of flushed Slices not yet released, flush() blocks when there are more.
+    static constexpr uint32_t MAX_PENDING_SLICES = 1024;
+
+    // The Slices returned by waitForCommands(), in order.
+    class SliceRange {
+    public:
+        class const_iterator {
+        public:
+            Slice const& operator*() const noexcept { return mSlices[mIndex % MAX_PENDING_SLICES]; }
+            const_iterator& operator++() noexcept { ++mIndex; return *this; }
+            bool operator!=(const_iterator const& rhs) const noexcept {
+                return mIndex != rhs.mIndex;
+            }
+        private:
+            friend class SliceRange;
+            const_iterator(Slice const* slices, uint32_t index) noexcept
+                    : mSlices(slices), mIndex(index) { }
+            Slice const* mSlices;
+            uint32_t mIndex;
+        };
+        const_iterator begin() const noexcept { return { mSlices, mBegin }; }
+        const_iterator end() const noexcept { return { mSlices, mEnd }; }
+        size_t size() const noexcept { return mEnd - mBegin; }
+    private:
+        friend class CommandBufferQueue;
+        SliceRange(Slice const* slices, uint32_t begin, uint32_t end) noexcept
+                : mSlices(slices), mBegin(begin), mEnd(end) { }
+        Slice const* mSlices;
+        uint32_t mBegin;
+        uint32_t mEnd;
+    };
+
+private:
     const size_t mRequiredSize;
+    const size_t mMaxBufferSize;
 
     CircularBuffer mCircularBuffer;
 
+    // the memory of the CircularBuffer before it last grew, freed once the consumer has released
+    // the slices up to mRetiredIndex (the slices flushed before growing)
+    CircularBuffer::Storage mRetired = {};
+    uint32_t mRetiredIndex = 0;
+
+    // The ring of flushed Slices. Both indices only grow (and wrap around), the producer owns
+    // mWriteIndex and the consumer mReadIndex, which it advances as the Slices are released.
+    // mConsumedIndex is the consumer's private end of the Slices it has already been given.
+    Slice mSlices[MAX_PENDING_SLICES];
+    alignas(utils::CACHELINE_SIZE) std::atomic<uint32_t> mWriteIndex = { 0 };
+    alignas(utils::CACHELINE_SIZE) std::atomic<uint32_t> mReadIndex = { 0 };
+    mutable uint32_t mConsumedIndex = 0;
+
     // space available in the circular buffer
+    std::atomic<size_t> mFreeSpace;
+    std::atomic<bool> mExitRequested = { false };
 
+    // only used to sleep and to wake up the sleeping thread (if any)
     mutable utils::Mutex mLock;
     mutable utils::Condition mCondition;
-    mutable std::vector<Slice> mCommandBuffersToExecute;
-    size_t mFreeSpace = 0;
+    mutable std::atomic<uint32_t> mWaiters = { 0 };
+
     size_t mHighWatermark = 0;
-    bool mExitRequested = false;
+    size_t mRecentHighWatermark = 0;   // since the buffer last grew
+    uint32_t mBlockCount = 0;
+    uint64_t mBlockedTime = 0;
+    uint32_t mGrowCount = 0;
+
+    // Sleeps until the predicate is true, the other thread must call wakeUp() after each change
+    // that can make it true.
+    template<typename P>
+    void sleepUntil(P predicate) const noexcept {
+        std::unique_lock<utils::Mutex> lock(mLock);
+        mWaiters++;
+        mCondition.wait(lock, predicate);
+        mWaiters--;
+    }
+
+    void wakeUp() const noexcept;
+    void recordBlockedTime(std::chrono::steady_clock::time_point start) noexcept;
 
 public:
     // requiredSize: guaranteed available space after flush()
-    CommandBufferQueue(size_t requiredSize, size_t bufferSize);
+    // maxBufferSize: size up to which growIfNeeded() can grow the buffer, 0 to never grow it
+    CommandBufferQueue(size_t requiredSize, size_t bufferSize, size_t maxBufferSize = 0);
     ~CommandBufferQueue();
 
     CircularBuffer& getCircularBuffer() { return mCircularBuffer; }
 
     size_t getHigWatermark() noexcept { return mHighWatermark; }
 
-    // wait for commands to be available and returns an array containing these commands
-    std::vector<Slice> waitForCommands() const;
+    struct Stats {
+        size_t capacity;            // current size of the buffer
+        size_t highWatermark;       // most space ever used by the commands in flight
+        uint32_t blockCount;        // number of flush() that had to wait for the consumer
+        uint64_t blockedTime;       // total time flush() waited, in nanoseconds
+        uint32_t growCount;         // number of times the buffer grew
+    };
+    Stats getStats() const noexcept;
+
+    // Doubles the size of the buffer (up to maxBufferSize) if the commands in flight used more
+    // than 3/4 of the space beyond requiredSize since it last grew. Call this right after
+    // flush(), between frames. Returns true if the buffer grew.
+    bool growIfNeeded() noexcept;
+
+    // wait for commands to be available and returns the Slices containing these commands. The
+    // pending Slices are still returned after exit was requested, the range is only empty once
+    // exit was requested and nothing is pending. This doesn't allocate.
+    SliceRange waitForCommands() const;
 
     // return the memory used by this command buffer to the circular buffer
     // WARNING: releaseBuffer() must be called in sequence of the Slices returned by
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandCapture.h"
+
+#include "driver/Program.h"
+#include "driver/SamplerBuffer.h"
+#include "driver/UniformBuffer.h"
+
+#include <utils/Log.h>
+
+namespace filament {
+
+using namespace utils;
+
+static const char* const sCommandNames[CommandCapture::COUNT] = {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     #methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     #methodName,
+#include "driver/DriverAPI.inc"
+};
+
+namespace capture {
+
+void Writer::writeString(char const* s, size_t length) {
+    writeValue(uint32_t(length));
+    write(s, length);
+}
+
+static void encode(Writer& w, CString const& s) {
+    w.writeString(s.c_str(), s.size());
+}
+
+void encode(Writer& w, driver::BufferDescriptor const& buffer) {
+    encode(w, buffer.size);
+    w.write(buffer.buffer, buffer.size);
+}
+
+void encodePixels(Writer& w, driver::PixelBufferDescriptor const& buffer, bool withContent) {
+    encode(w, buffer.size);
+    encode(w, withContent);
+    if (withContent) {
+        w.write(buffer.buffer, buffer.size);
+    }
+    encode(w, buffer.left);
+    encode(w, buffer.top);
+    encode(w, driver::PixelDataType(buffer.type));
+    encode(w, uint8_t(buffer.alignment));
+    if (buffer.type == driver::PixelDataType::COMPRESSED) {
+        encode(w, buffer.imageSize);
+        encode(w, buffer.compressedFormat);
+    } else {
+        encode(w, buffer.stride);
+        encode(w, buffer.format);
+    }
+}
+
+void encode(Writer& w, driver::PixelBufferDescriptor const& buffer) {
+    encodePixels(w, buffer, true);
+}
+
+void encode(Writer& w, driver::FaceOffsets const& offsets) {
+    for (size_t offset : offsets.offsets) {
+        encode(w, offset);
+    }
+}
+
+void encode(Writer& w, Driver::TargetBufferInfo const& info) {
+    // layer is the largest member of the union
+    encode(w, info.handle);
+    encode(w, info.level);
+    encode(w, info.viewCount);
+    encode(w, info.layer);
+}
+
+void encode(Writer& w, Program const& program) {
+    encode(w, program.getName());
+    encode(w, program.getVariant());
+    for (CString const& source : program.getShadersSource()) {
+        encode(w, source);
+    }
+
+    for (UniformInterfaceBlock const* uib : program.getUniformInterfaceBlocks()) {
+        encode(w, uib != nullptr);
+        if (uib) {
+            encode(w, uib->getName());
+            encode(w, uib->getUniformInfoList().size());
+            for (auto const& info : uib->getUniformInfoList()) {
+                encode(w, info.name);
+                encode(w, info.size);
+                encode(w, info.type);
+                encode(w, info.precision);
+            }
+        }
+    }
+
+    for (SamplerInterfaceBlock const* sib : program.getSamplerInterfaceBlocks()) {
+        encode(w, sib != nullptr);
+        if (sib) {
+            encode(w, sib->getName());
+            encode(w, sib->getSamplerInfoList().size());
+            for (auto const& info : sib->getSamplerInfoList()) {
+                encode(w, info.name);
+                encode(w, info.type);
+                encode(w, info.format);
+                encode(w, info.precision);
+                encode(w, info.multisample);
+            }
+        }
+    }
+
+    SamplerBindingMap const* bindings = program.getSamplerBindings();
+    encode(w, bindings != nullptr);
+    if (bindings) {
+        encode(w, bindings->getBindingList().size());
+        for (SamplerBindingInfo const& info : bindings->getBindingList()) {
+            encode(w, info);
+        }
+    }
+
+    const uint32_t mask = program.getSpecializationConstantMask();
+    encode(w, mask);
+    for (size_t i = 0; i < Program::NUM_SPECIALIZATION_CONSTANTS; i++) {
+        if (mask & (1u << i)) {
+            encode(w, program.getSpecializationConstants()[i]);
+        }
+    }
+}
+
+void encode(Writer& w, SamplerBuffer const& buffer) {
+    encode(w, buffer.getSize());
+    for (size_t i = 0; i < buffer.getSize(); i++) {
+        encode(w, buffer.getBuffer()[i].t);
+        encode(w, buffer.getBuffer()[i].s);
+    }
+}
+
+void encode(Writer& w, UniformBuffer const& buffer) {
+    // the whole content is written, only the dirty range is uploaded during the replay
+    encode(w, buffer.getSize());
+    encode(w, buffer.getDirtyOffset());
+    encode(w, buffer.getDirtySize());
+    w.write(buffer.getBuffer(), buffer.getSize());
+}
+
+void encodeArgs(Writer& w, std::tuple<Driver::VertexBufferHandle, size_t,
+        Driver::BufferDescriptor, Driver::BufferRange const*, uint32_t> const& args) {
+    const uint32_t count = std::get<4>(args);
+    encode(w, std::get<0>(args));
+    encode(w, std::get<1>(args));
+    encode(w, std::get<2>(args));
+    encode(w, count);
+    for (uint32_t i = 0; i < count; i++) {
+        encode(w, std::get<3>(args)[i]);
+    }
+    encode(w, count);
+}
+
+void encode(Writer& w, Driver::UniformBufferUpdate const& update) {
+    encode(w, update.ubh);
+    encode(w, update.byteOffset);
+    encode(w, update.byteSize);
+}
+
+void encodeArgs(Writer& w, std::tuple<Driver::BufferDescriptor,
+        Driver::UniformBufferUpdate const*, uint32_t> const& args) {
+    const uint32_t count = std::get<2>(args);
+    encode(w, std::get<0>(args));
+    encode(w, count);
+    for (uint32_t i = 0; i < count; i++) {
+        encode(w, std::get<1>(args)[i]);
+    }
+    encode(w, count);
+}
+
+void encodeArgs(Writer& w, std::tuple<Driver::RenderTargetHandle, uint32_t, uint32_t,
+        uint32_t, uint32_t, Driver::PixelBufferDescriptor> const& args) {
+    encode(w, std::get<0>(args));
+    encode(w, std::get<1>(args));
+    encode(w, std::get<2>(args));
+    encode(w, std::get<3>(args));
+    encode(w, std::get<4>(args));
+    encodePixels(w, std::get<5>(args), false);
+}
+
+} // namespace capture
+
+// ------------------------------------------------------------------------------------------------
+
+const char* CommandCapture::getName(size_t command) noexcept {
+    return command < COUNT ? sCommandNames[command] : nullptr;
+}
+
+CommandCapture::CommandCapture(const char* path, uint32_t frameCount) noexcept
+        : mFrameCount(frameCount) {
+    mFile = fopen(path, "wb");
+    if (!mFile) {
+        slog.e << "Can't open " << path << " to capture the driver commands" << io::endl;
+        return;
+    }
+
+    capture::Writer& w = mWriter;
+    w.writeValue(capture::MAGIC);
+    w.writeValue(capture::VERSION);
+    w.writeValue(uint32_t(COUNT));
+    for (const char* name : sCommandNames) {
+        w.writeString(name, strlen(name));
+    }
+    fwrite(w.getData().data(), 1, w.getData().size(), mFile);
+    slog.i << "Capturing " << frameCount << " frames of driver commands to " << path << io::endl;
+}
+
+CommandCapture::~CommandCapture() noexcept {
+    close();
+}
+
+void CommandCapture::writeRecord(Command command) noexcept {
+    // the capture ends with the commands of the last frame, up to its swap chain's commit
+    if (command == beginFrame && mFramesCaptured == mFrameCount) {
+        close();
+        return;
+    }
+
+    std::vector<uint8_t> const& data = mWriter.getData();
+    const uint16_t index = command;
+    const uint32_t size = uint32_t(data.size());
+    fwrite(&index, sizeof(index), 1, mFile);
+    fwrite(&size, sizeof(size), 1, mFile);
+    fwrite(data.data(), 1, size, mFile);
+    mCommandsCaptured++;
+    if (command == endFrame) {
+        mFramesCaptured++;
+    }
+}
+
+void CommandCapture::close() noexcept {
+    if (mFile) {
+        fclose(mFile);
+        mFile = nullptr;
+        slog.i << "Captured " << mFramesCaptured << " frames, "
+                << mCommandsCaptured << " driver commands" << io::endl;
+    }
+}
+
+} // namespace filament
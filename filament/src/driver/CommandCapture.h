@@ -0,0 +1,216 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
+#define TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
+
+#include "driver/Driver.h"
+#include "driver/Handle.h"
+
+#include <utils/compiler.h>
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace filament {
+
+class Program;
+class SamplerBuffer;
+class UniformBuffer;
+
+/*
+ * A capture file starts with a header:
+ *      uint32_t    MAGIC
+ *      uint32_t    VERSION
+ *      uint32_t    number of commands, followed by each command's name as a string
+ *
+ * followed by one record per command:
+ *      uint16_t    index of the command's name in the header
+ *      uint32_t    size of the arguments, in bytes
+ *      ...         the arguments
+ *
+ * The names make the capture independent of the order of DriverAPI.inc. Integers are widened to
+ * 64 bits and strings are prefixed by their 32 bits length. Other trivially copyable arguments
+ * (e.g. RasterState) are stored as they are in memory, prefixed by their size, so a capture can
+ * only be replayed on a platform with the same layouts and endianness.
+ */
+namespace capture {
+
+static constexpr uint32_t MAGIC = 0x50414346;   // 'FCAP'
+static constexpr uint32_t VERSION = 2;
+
+// the arguments of a record, encode() functions append to it
+class Writer {
+public:
+    void write(void const* data, size_t size) {
+        uint8_t const* p = static_cast<uint8_t const*>(data);
+        mData.insert(mData.end(), p, p + size);
+    }
+
+    template<typename T>
+    void writeValue(T const& v) {
+        write(&v, sizeof(T));
+    }
+
+    void writeString(char const* s, size_t length);
+
+    std::vector<uint8_t> const& getData() const noexcept { return mData; }
+    void clear() noexcept { mData.clear(); }
+
+private:
+    std::vector<uint8_t> mData;
+};
+
+template<typename T>
+using IsHandle = std::is_base_of<HandleBase, T>;
+
+// integers, widened to 64 bits so that e.g. size_t doesn't depend on the platform
+template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+inline void encode(Writer& w, T const& v) {
+    w.writeValue(std::is_signed<T>::value ? uint64_t(int64_t(v)) : uint64_t(v));
+}
+
+template<typename T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
+inline void encode(Writer& w, T const& v) {
+    encode(w, typename std::underlying_type<T>::type(v));
+}
+
+// other trivially copyable types, e.g. RasterState or AttributeArray
+template<typename T, typename std::enable_if<
+        !std::is_integral<T>::value && !std::is_enum<T>::value && !std::is_pointer<T>::value &&
+        !IsHandle<T>::value, int>::type = 0>
+inline void encode(Writer& w, T const& v) {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "this type of driver command argument needs its own encode()");
+    w.writeValue(uint32_t(sizeof(T)));
+    w.writeValue(v);
+}
+
+template<typename T>
+inline void encode(Writer& w, Handle<T> const& h) {
+    w.writeValue(uint32_t(h.getId()));
+}
+
+// only the swap chain's window is passed as a void*, the replay uses its own
+inline void encode(Writer&, void* const&) { }
+
+// the callbacks of a blob cache are meaningless in another process
+inline void encode(Writer&, driver::BlobCache const&) { }
+
+inline void encode(Writer& w, char const* const& s) {
+    w.writeString(s, s ? strlen(s) : 0);
+}
+
+void encode(Writer& w, driver::BufferDescriptor const& buffer);
+void encode(Writer& w, driver::PixelBufferDescriptor const& buffer);
+void encode(Writer& w, driver::FaceOffsets const& offsets);
+void encode(Writer& w, Driver::TargetBufferInfo const& info);
+void encode(Writer& w, Program const& program);
+void encode(Writer& w, SamplerBuffer const& buffer);
+void encode(Writer& w, UniformBuffer const& buffer);
+
+template<typename... ARGS, size_t... I>
+inline void encodeArgs(Writer& w, std::tuple<ARGS...> const& args, std::index_sequence<I...>) {
+    // evaluated in order, this is a braced-init-list
+    int dummy[] = { 0, (encode(w, std::get<I>(args)), 0)... };
+    (void)dummy;
+}
+
+template<typename... ARGS>
+inline void encodeArgs(Writer& w, std::tuple<ARGS...> const& args) {
+    encodeArgs(w, args, std::make_index_sequence<sizeof...(ARGS)>{});
+}
+
+// loadVertexBufferRanges(): the ranges are written as an array, before their count
+void encodeArgs(Writer& w, std::tuple<Driver::VertexBufferHandle, size_t,
+        Driver::BufferDescriptor, Driver::BufferRange const*, uint32_t> const& args);
+
+// updateUniformBuffers(): the updates are written as an array, before their count
+void encode(Writer& w, Driver::UniformBufferUpdate const& update);
+void encodeArgs(Writer& w, std::tuple<Driver::BufferDescriptor,
+        Driver::UniformBufferUpdate const*, uint32_t> const& args);
+
+// readPixels(): the content of the destination buffer is not written, only its size
+void encodeArgs(Writer& w, std::tuple<Driver::RenderTargetHandle, uint32_t, uint32_t,
+        uint32_t, uint32_t, Driver::PixelBufferDescriptor> const& args);
+
+void encodePixels(Writer& w, driver::PixelBufferDescriptor const& buffer, bool withContent);
+
+} // namespace capture
+
+/*
+ * Writes the asynchronous driver commands, with their arguments and the data they point to, to
+ * a file that CommandReplay can execute again without the engine, e.g. to measure the driver
+ * and the GPU on exactly the same frames.
+ *
+ * When filament is built with FILAMENT_ENABLE_COMMAND_CAPTURE, ConcreteDispatcher records each
+ * command before executing it, once Dispatcher::capture is set (see Engine::Config::captureFile).
+ * Everything happens on the driver thread.
+ */
+class CommandCapture {
+public:
+    // one per asynchronous command of DriverAPI.inc
+    enum Command : uint16_t {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#include "driver/DriverAPI.inc"
+        COUNT
+    };
+
+    // name of the driver's method, e.g. "draw"
+    static const char* getName(size_t command) noexcept;
+
+    // The capture ends with the frameCount-th frame, or when this is destroyed.
+    CommandCapture(const char* path, uint32_t frameCount) noexcept;
+    ~CommandCapture() noexcept;
+
+    CommandCapture(CommandCapture const& rhs) = delete;
+    CommandCapture& operator=(CommandCapture const& rhs) = delete;
+
+    bool isCapturing() const noexcept { return mFile != nullptr; }
+
+    // called on the driver thread, before the command is executed
+    template<typename... ARGS>
+    void record(Command command, std::tuple<ARGS...> const& args) noexcept {
+        if (mFile) {
+            mWriter.clear();
+            capture::encodeArgs(mWriter, args);
+            writeRecord(command);
+        }
+    }
+
+private:
+    void writeRecord(Command command) noexcept;
+    void close() noexcept;
+
+    FILE* mFile = nullptr;
+    capture::Writer mWriter;
+    uint32_t mFrameCount;
+    uint32_t mFramesCaptured = 0;
+    uint32_t mCommandsCaptured = 0;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDCAPTURE_H
@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandReplay.h"
+
+#include "driver/CommandStream.h"
+#include "driver/Program.h"
+#include "driver/SamplerBuffer.h"
+#include "driver/UniformBuffer.h"
+
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <thread>
+#include <type_traits>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace filament {
+
+using namespace driver;
+using namespace utils;
+
+namespace capture {
+
+void Reader::read(void* data, size_t size) noexcept {
+    if (UTILS_UNLIKELY(getRemaining() < size)) {
+        memset(data, 0, size);
+        mCurrent = mEnd;
+        mValid = false;
+        return;
+    }
+    memcpy(data, mCurrent, size);
+    mCurrent += size;
+}
+
+char const* Reader::readString() noexcept {
+    const uint32_t length = readValue<uint32_t>();
+    if (UTILS_UNLIKELY(getRemaining() < length)) {
+        mCurrent = mEnd;
+        mValid = false;
+        return "";
+    }
+    mStorage.strings.emplace_back(reinterpret_cast<char const*>(mCurrent), length);
+    mCurrent += length;
+    return mStorage.strings.back().c_str();
+}
+
+HandleBase::HandleId Reader::getHandle(HandleBase::HandleId id) const noexcept {
+    auto pos = mHandles.find(id);
+    return pos != mHandles.end() ? pos->second : HandleBase::nullid;
+}
+
+// The decode() functions mirror the encode() functions of CommandCapture.h, the type of the
+// argument is given by the tag.
+
+template<typename T>
+struct Type { };
+
+template<typename T>
+using Decayed = typename std::decay<T>::type;
+
+template<typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+inline T decode(Reader& r, Type<T>) noexcept {
+    return T(r.readValue<uint64_t>());
+}
+
+template<typename T, typename std::enable_if<std::is_enum<T>::value, int>::type = 0>
+inline T decode(Reader& r, Type<T>) noexcept {
+    return T(decode(r, Type<typename std::underlying_type<T>::type>{}));
+}
+
+template<typename T, typename std::enable_if<
+        !std::is_integral<T>::value && !std::is_enum<T>::value && !std::is_pointer<T>::value &&
+        !IsHandle<T>::value, int>::type = 0>
+inline T decode(Reader& r, Type<T>) noexcept {
+    static_assert(std::is_trivially_copyable<T>::value,
+            "this type of driver command argument needs its own decode()");
+    T v;
+    if (r.readValue<uint32_t>() != sizeof(T)) {
+        // the capture was made on a platform with another layout
+        r.fail();
+        return v;
+    }
+    r.read(&v, sizeof(T));
+    return v;
+}
+
+template<typename T>
+inline Handle<T> decode(Reader& r, Type<Handle<T>>) noexcept {
+    const HandleBase::HandleId id = r.getHandle(r.readValue<uint32_t>());
+    return id != HandleBase::nullid ? Handle<T>(id) : Handle<T>();
+}
+
+inline void* decode(Reader& r, Type<void*>) noexcept {
+    return r.getStorage().nativeWindow;
+}
+
+inline BlobCache decode(Reader&, Type<BlobCache>) noexcept {
+    return {};
+}
+
+inline char const* decode(Reader& r, Type<char const*>) noexcept {
+    return r.readString();
+}
+
+static void freeBuffer(void* buffer, size_t, void*) {
+    free(buffer);
+}
+
+static void* readBuffer(Reader& r, size_t size, bool withContent) noexcept {
+    if (withContent && r.getRemaining() < size) {
+        r.fail();
+        return nullptr;
+    }
+    void* buffer = calloc(1, size);
+    if (withContent && buffer) {
+        r.read(buffer, size);
+    }
+    return buffer;
+}
+
+BufferDescriptor decode(Reader& r, Type<BufferDescriptor>) noexcept {
+    const size_t size = decode(r, Type<size_t>{});
+    void* buffer = readBuffer(r, size, true);
+    return BufferDescriptor(buffer, buffer ? size : 0, freeBuffer);
+}
+
+PixelBufferDescriptor decode(Reader& r, Type<PixelBufferDescriptor>) noexcept {
+    const size_t size = decode(r, Type<size_t>{});
+    const bool withContent = decode(r, Type<bool>{});
+    void* buffer = readBuffer(r, size, withContent);
+    const uint32_t left = decode(r, Type<uint32_t>{});
+    const uint32_t top = decode(r, Type<uint32_t>{});
+    const PixelDataType type = decode(r, Type<PixelDataType>{});
+    const uint8_t alignment = decode(r, Type<uint8_t>{});
+    if (type == PixelDataType::COMPRESSED) {
+        const uint32_t imageSize = decode(r, Type<uint32_t>{});
+        const CompressedPixelDataType format = decode(r, Type<CompressedPixelDataType>{});
+        PixelBufferDescriptor data(buffer, buffer ? size : 0, format, imageSize, freeBuffer);
+        data.left = left;
+        data.top = top;
+        return data;
+    }
+    const uint32_t stride = decode(r, Type<uint32_t>{});
+    const PixelDataFormat format = decode(r, Type<PixelDataFormat>{});
+    return PixelBufferDescriptor(buffer, buffer ? size : 0, format, type, alignment,
+            left, top, stride, freeBuffer);
+}
+
+FaceOffsets decode(Reader& r, Type<FaceOffsets>) noexcept {
+    FaceOffsets offsets;
+    for (size_t& offset : offsets.offsets) {
+        offset = decode(r, Type<size_t>{});
+    }
+    return offsets;
+}
+
+Driver::TargetBufferInfo decode(Reader& r, Type<Driver::TargetBufferInfo>) noexcept {
+    const Driver::TextureHandle handle = decode(r, Type<Driver::TextureHandle>{});
+    const uint8_t level = decode(r, Type<uint8_t>{});
+    const uint8_t viewCount = decode(r, Type<uint8_t>{});
+    const uint16_t layer = decode(r, Type<uint16_t>{});
+    return { handle, level, layer, viewCount };
+}
+
+Program decode(Reader& r, Type<Program>) noexcept {
+    Storage& storage = r.getStorage();
+    Program program;
+
+    const CString name(r.readString());
+    const uint8_t variant = decode(r, Type<uint8_t>{});
+    program.diagnostics(name, variant);
+    program.shader(Program::Shader::VERTEX, CString(r.readString()));
+    program.shader(Program::Shader::FRAGMENT, CString(r.readString()));
+
+    for (size_t i = 0; i < Program::NUM_UNIFORM_BINDINGS; i++) {
+        if (decode(r, Type<bool>{})) {
+            UniformInterfaceBlock::Builder builder;
+            builder.name(r.readString());
+            const size_t count = decode(r, Type<size_t>{});
+            for (size_t j = 0; j < count && r.isValid(); j++) {
+                const std::string uniform(r.readString());
+                const uint32_t size = decode(r, Type<uint32_t>{});
+                const auto type = decode(r, Type<UniformInterfaceBlock::Type>{});
+                const auto precision = decode(r, Type<UniformInterfaceBlock::Precision>{});
+                builder.add(uniform, size, type, precision);
+            }
+            storage.uniformBlocks.emplace_back(new UniformInterfaceBlock(builder.build()));
+            program.addUniformBlock(i, storage.uniformBlocks.back().get());
+        }
+    }
+
+    for (size_t i = 0; i < Program::NUM_SAMPLER_BINDINGS; i++) {
+        if (decode(r, Type<bool>{})) {
+            SamplerInterfaceBlock::Builder builder;
+            builder.name(r.readString());
+            const size_t count = decode(r, Type<size_t>{});
+            for (size_t j = 0; j < count && r.isValid(); j++) {
+                const std::string sampler(r.readString());
+                const auto type = decode(r, Type<SamplerInterfaceBlock::Type>{});
+                const auto format = decode(r, Type<SamplerInterfaceBlock::Format>{});
+                const auto precision = decode(r, Type<SamplerInterfaceBlock::Precision>{});
+                const bool multisample = decode(r, Type<bool>{});
+                builder.add(sampler, type, format, precision, multisample);
+            }
+            storage.samplerBlocks.emplace_back(new SamplerInterfaceBlock(builder.build()));
+            program.addSamplerBlock(i, storage.samplerBlocks.back().get());
+        }
+    }
+
+    if (decode(r, Type<bool>{})) {
+        SamplerBindingMap* bindings = new SamplerBindingMap();
+        storage.samplerBindings.emplace_back(bindings);
+        const size_t count = decode(r, Type<size_t>{});
+        for (size_t j = 0; j < count && r.isValid(); j++) {
+            bindings->addSampler(decode(r, Type<SamplerBindingInfo>{}));
+        }
+        program.withSamplerBindings(bindings);
+    }
+
+    const uint32_t mask = decode(r, Type<uint32_t>{});
+    for (size_t i = 0; i < Program::NUM_SPECIALIZATION_CONSTANTS; i++) {
+        if (mask & (1u << i)) {
+            program.specializationConstant(uint32_t(i), decode(r, Type<int32_t>{}));
+        }
+    }
+    return program;
+}
+
+SamplerBuffer decode(Reader& r, Type<SamplerBuffer>) noexcept {
+    // a SamplerBuffer holds up to 16 samplers
+    size_t size = decode(r, Type<size_t>{});
+    if (size > 16) {
+        r.fail();
+        size = 0;
+    }
+    SamplerBuffer buffer(size);
+    for (size_t i = 0; i < size; i++) {
+        const Driver::TextureHandle t = decode(r, Type<Driver::TextureHandle>{});
+        const SamplerParams s = decode(r, Type<SamplerParams>{});
+        buffer.setSampler(i, { t, s });
+    }
+    return buffer;
+}
+
+UniformBuffer decode(Reader& r, Type<UniformBuffer>) noexcept {
+    const size_t size = decode(r, Type<size_t>{});
+    const size_t dirtyOffset = decode(r, Type<size_t>{});
+    const size_t dirtySize = decode(r, Type<size_t>{});
+    if (r.getRemaining() < size || dirtyOffset + dirtySize > size) {
+        r.fail();
+        return UniformBuffer();
+    }
+    UniformBuffer buffer(size);
+    r.read(buffer.invalidateUniforms(0, size), size);
+    // only the range that was dirty during the capture is uploaded
+    buffer.clean();
+    if (dirtySize) {
+        buffer.invalidateUniforms(dirtyOffset, dirtySize);
+    }
+    return buffer;
+}
+
+Driver::BufferRange const* decode(Reader& r, Type<Driver::BufferRange const*>) noexcept {
+    const uint32_t count = decode(r, Type<uint32_t>{});
+    if (r.getRemaining() < count * sizeof(Driver::BufferRange)) {
+        r.fail();
+        return nullptr;
+    }
+    std::vector<Driver::BufferRange> ranges(count);
+    for (Driver::BufferRange& range : ranges) {
+        range = decode(r, Type<Driver::BufferRange>{});
+    }
+    r.getStorage().ranges.push_back(std::move(ranges));
+    return r.getStorage().ranges.back().data();
+}
+
+Driver::UniformBufferUpdate const* decode(Reader& r,
+        Type<Driver::UniformBufferUpdate const*>) noexcept {
+    const uint32_t count = decode(r, Type<uint32_t>{});
+    // a handle and two integers each
+    if (r.getRemaining() < count * (sizeof(uint32_t) + 2 * sizeof(uint64_t))) {
+        r.fail();
+        return nullptr;
+    }
+    std::vector<Driver::UniformBufferUpdate> updates(count);
+    for (Driver::UniformBufferUpdate& update : updates) {
+        update.ubh = decode(r, Type<Driver::UniformBufferHandle>{});
+        update.byteOffset = decode(r, Type<uint32_t>{});
+        update.byteSize = decode(r, Type<uint32_t>{});
+    }
+    r.getStorage().uniformBufferUpdates.push_back(std::move(updates));
+    return r.getStorage().uniformBufferUpdates.back().data();
+}
+
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * Executes a driver command through the dispatcher, like CommandStream::execute() does, but
+ * with a Command constructed on the stack.
+ */
+
+template<typename... ARGS>
+struct Replayer;
+
+template<typename... ARGS>
+struct Replayer<void (Driver::*)(ARGS...)> {
+    template<void (Driver::*METHOD)(ARGS...)>
+    using Cmd = typename CommandType<void (Driver::*)(ARGS...)>::template Command<METHOD>;
+
+    template<void (Driver::*METHOD)(ARGS...)>
+    static void call(Driver& driver, Dispatcher::Execute execute, Decayed<ARGS>... args) {
+        typename std::aligned_storage<sizeof(Cmd<METHOD>), alignof(Cmd<METHOD>)>::type storage;
+        CommandBase* const cmd = new(&storage) Cmd<METHOD>(execute, std::move(args)...);
+        cmd->execute(driver);
+    }
+
+    // the arguments are read from the record
+    template<void (Driver::*METHOD)(ARGS...)>
+    static bool replay(Driver& driver, Dispatcher::Execute execute, Reader& r) {
+        typename std::aligned_storage<sizeof(Cmd<METHOD>), alignof(Cmd<METHOD>)>::type storage;
+        // the arguments are decoded in order, this is a braced-init-list
+        Cmd<METHOD>* const cmd = new(&storage) Cmd<METHOD>{
+                execute, decode(r, Type<Decayed<ARGS>>{})... };
+        if (UTILS_UNLIKELY(!r.isValid())) {
+            cmd->~Cmd<METHOD>();
+            return false;
+        }
+        static_cast<CommandBase*>(cmd)->execute(driver);
+        return true;
+    }
+};
+
+} // namespace capture
+
+// ------------------------------------------------------------------------------------------------
+
+using capture::Replayer;
+
+constexpr uint16_t CommandReplay::SKIP;
+
+static bool isReplayable(uint16_t command) noexcept {
+    switch (command) {
+        // they use external images or streams, which aren't in the capture
+        case CommandCapture::setExternalImage:
+        case CommandCapture::setExternalStream:
+        case CommandCapture::createStreamFromTextureId:
+        case CommandCapture::readStreamPixels:
+        // timer queries can't be nested, the replay times the whole frames instead
+        case CommandCapture::beginTimerQuery:
+        case CommandCapture::endTimerQuery:
+            return false;
+        default:
+            return true;
+    }
+}
+
+CommandReplay::CommandReplay(Driver& driver, void* nativeWindow) noexcept : mDriver(driver) {
+    mStorage.nativeWindow = nativeWindow;
+    mTimerQueriesSupported = driver.isTimerQuerySupported();
+    if (mTimerQueriesSupported) {
+        Dispatcher& dispatcher = driver.getDispatcher();
+        for (Driver::TimerQueryHandle& query : mTimerQueries) {
+            query = driver.createTimerQuerySynchronous();
+            Replayer<decltype(&Driver::createTimerQuery)>::call<&Driver::createTimerQuery>(
+                    driver, dispatcher.createTimerQuery_, query, 0);
+        }
+    }
+}
+
+CommandReplay::~CommandReplay() noexcept {
+    if (mTimerQueriesSupported) {
+        Dispatcher& dispatcher = mDriver.getDispatcher();
+        for (Driver::TimerQueryHandle query : mTimerQueries) {
+            Replayer<decltype(&Driver::destroyTimerQuery)>::call<&Driver::destroyTimerQuery>(
+                    mDriver, dispatcher.destroyTimerQuery_, query);
+        }
+    }
+}
+
+bool CommandReplay::open(const char* path) noexcept {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        slog.e << "Can't open " << path << io::endl;
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    const long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    mCapture.resize(size_t(size > 0 ? size : 0));
+    const size_t read = fread(mCapture.data(), 1, mCapture.size(), file);
+    fclose(file);
+    if (read != mCapture.size()) {
+        slog.e << "Can't read " << path << io::endl;
+        return false;
+    }
+
+    capture::Reader r(mCapture.data(), mCapture.size(), mHandles, mStorage);
+    if (r.readValue<uint32_t>() != capture::MAGIC) {
+        slog.e << path << " is not a capture of driver commands" << io::endl;
+        return false;
+    }
+    const uint32_t version = r.readValue<uint32_t>();
+    if (version != capture::VERSION) {
+        slog.e << path << " is a capture of version " << version
+                << ", only version " << capture::VERSION << " is supported" << io::endl;
+        return false;
+    }
+
+    // the commands are matched by name, their order can be different in this build
+    const uint32_t count = std::min(r.readValue<uint32_t>(), uint32_t(UINT16_MAX));
+    mCommands.assign(count, SKIP);
+    for (uint32_t i = 0; i < count && r.isValid(); i++) {
+        const char* name = r.readString();
+        for (uint16_t command = 0; command < CommandCapture::COUNT; command++) {
+            if (!strcmp(name, CommandCapture::getName(command))) {
+                mCommands[i] = isReplayable(command) ? command : SKIP;
+                break;
+            }
+        }
+    }
+    mStorage.strings.clear();
+    if (!r.isValid()) {
+        slog.e << path << " is truncated" << io::endl;
+        return false;
+    }
+    mPosition = mCapture.size() - r.getRemaining();
+    return true;
+}
+
+bool CommandReplay::replayFrame() noexcept {
+    // a frame starts with its beginFrame command, and ends before the next one
+    bool inFrame = false;
+    while (mCapture.size() - mPosition >= sizeof(uint16_t) + sizeof(uint32_t)) {
+        uint16_t index;
+        uint32_t size;
+        memcpy(&index, mCapture.data() + mPosition, sizeof(index));
+        memcpy(&size, mCapture.data() + mPosition + sizeof(index), sizeof(size));
+        const size_t data = mPosition + sizeof(index) + sizeof(size);
+        if (size > mCapture.size() - data) {
+            slog.e << "The capture is truncated" << io::endl;
+            mPosition = mCapture.size();
+            break;
+        }
+
+        const uint16_t command = index < mCommands.size() ? mCommands[index] : SKIP;
+        if (command == CommandCapture::beginFrame) {
+            if (inFrame) {
+                break;
+            }
+            inFrame = true;
+            mFrameTimes.emplace_back();
+            mFrameStart = clock::now();
+        }
+
+        mPosition = data + size;
+        if (command == SKIP) {
+            continue;
+        }
+        if (command == CommandCapture::endFrame) {
+            endFrameTimer();
+        }
+        if (!execute(command, mCapture.data() + data, size)) {
+            slog.e << "The capture is corrupted, at a "
+                    << CommandCapture::getName(command) << " command" << io::endl;
+            mPosition = mCapture.size();
+            break;
+        }
+        if (command == CommandCapture::beginFrame) {
+            beginFrameTimer();
+        }
+    }
+
+    if (inFrame) {
+        mFrameTimes.back().cpu = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - mFrameStart).count());
+        // this is where the driver calls the callbacks of the buffers, which frees them
+        mDriver.purge();
+        pollFrameTimers();
+    }
+    return inFrame;
+}
+
+void CommandReplay::finish() noexcept {
+    while (replayFrame()) {
+    }
+
+    // wait up to a second for the GPU
+    for (size_t i = 0; i < 1000; i++) {
+        pollFrameTimers();
+        if (std::none_of(std::begin(mTimerQueryPending), std::end(mTimerQueryPending),
+                [](bool pending) { return pending; })) {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    mDriver.purge();
+}
+
+bool CommandReplay::execute(uint16_t command, uint8_t const* data, uint32_t size) noexcept {
+    Dispatcher& dispatcher = mDriver.getDispatcher();
+    capture::Reader r(data, size, mHandles, mStorage);
+    bool valid = false;
+    switch (command) {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+        case CommandCapture::methodName:                                                        \
+            valid = Replayer<decltype(&Driver::methodName)>::replay<&Driver::methodName>(       \
+                    mDriver, dispatcher.methodName##_, r);                                      \
+            break;
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
+        case CommandCapture::methodName:                                                        \
+            mapHandle(data, size, mDriver.methodName##Synchronous());                           \
+            valid = Replayer<decltype(&Driver::methodName)>::replay<&Driver::methodName>(       \
+                    mDriver, dispatcher.methodName##_, r);                                      \
+            break;
+#include "driver/DriverAPI.inc"
+        default:
+            break;
+    }
+    mStorage.strings.clear();
+    mStorage.ranges.clear();
+    mStorage.uniformBufferUpdates.clear();
+    return valid;
+}
+
+void CommandReplay::mapHandle(uint8_t const* data, uint32_t size,
+        HandleBase const& handle) noexcept {
+    // the handle created by the command is its first argument
+    HandleBase::HandleId id;
+    if (size >= sizeof(id)) {
+        memcpy(&id, data, sizeof(id));
+        mHandles[id] = handle.getId();
+    }
+}
+
+void CommandReplay::beginFrameTimer() noexcept {
+    if (!mTimerQueriesSupported) {
+        return;
+    }
+    const size_t frame = mFrameTimes.size() - 1;
+    const size_t i = frame % TIMER_QUERY_COUNT;
+    if (mTimerQueryPending[i]) {
+        // the GPU is too far behind, the time of that older frame is lost
+        pollFrameTimers();
+        mTimerQueryPending[i] = false;
+    }
+    Dispatcher& dispatcher = mDriver.getDispatcher();
+    Replayer<decltype(&Driver::beginTimerQuery)>::call<&Driver::beginTimerQuery>(
+            mDriver, dispatcher.beginTimerQuery_, mTimerQueries[i]);
+    mTimerQueryFrames[i] = frame;
+    mTimerQueryPending[i] = true;
+}
+
+void CommandReplay::endFrameTimer() noexcept {
+    if (!mTimerQueriesSupported || mFrameTimes.empty()) {
+        return;
+    }
+    const size_t frame = mFrameTimes.size() - 1;
+    const size_t i = frame % TIMER_QUERY_COUNT;
+    if (mTimerQueryPending[i] && mTimerQueryFrames[i] == frame) {
+        Dispatcher& dispatcher = mDriver.getDispatcher();
+        Replayer<decltype(&Driver::endTimerQuery)>::call<&Driver::endTimerQuery>(
+                mDriver, dispatcher.endTimerQuery_, mTimerQueries[i]);
+    }
+}
+
+void CommandReplay::pollFrameTimers() noexcept {
+    for (size_t i = 0; i < TIMER_QUERY_COUNT; i++) {
+        uint64_t elapsed;
+        if (mTimerQueryPending[i] && mDriver.getTimerQueryValue(mTimerQueries[i], &elapsed)) {
+            mFrameTimes[mTimerQueryFrames[i]].gpu = elapsed;
+            mTimerQueryPending[i] = false;
+        }
+    }
+}
+
+} // namespace filament
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
+#define TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
+
+#include "driver/CommandCapture.h"
+#include "driver/Driver.h"
+#include "driver/Handle.h"
+
+#include <filament/SamplerBindingMap.h>
+#include <filament/SamplerInterfaceBlock.h>
+#include <filament/UniformInterfaceBlock.h>
+
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+namespace capture {
+
+using HandleMap = std::unordered_map<HandleBase::HandleId, HandleBase::HandleId>;
+
+// the objects the arguments of the commands point to
+struct Storage {
+    // replaces the window of the captured swap chains
+    void* nativeWindow = nullptr;
+    // these only need to live until the command has been executed
+    std::deque<std::string> strings;
+    std::deque<std::vector<Driver::BufferRange>> ranges;
+    std::deque<std::vector<Driver::UniformBufferUpdate>> uniformBufferUpdates;
+    // the programs keep pointers to these, they live as long as the replay
+    std::vector<std::unique_ptr<UniformInterfaceBlock>> uniformBlocks;
+    std::vector<std::unique_ptr<SamplerInterfaceBlock>> samplerBlocks;
+    std::vector<std::unique_ptr<SamplerBindingMap>> samplerBindings;
+};
+
+// reads the arguments of a record, decode() functions consume it
+class Reader {
+public:
+    Reader(uint8_t const* data, size_t size, HandleMap const& handles, Storage& storage) noexcept
+            : mCurrent(data), mEnd(data + size), mHandles(handles), mStorage(storage) { }
+
+    void read(void* data, size_t size) noexcept;
+
+    template<typename T>
+    T readValue() noexcept {
+        T v;
+        read(&v, sizeof(T));
+        return v;
+    }
+
+    char const* readString() noexcept;
+
+    // marks the record as corrupted
+    void fail() noexcept { mValid = false; }
+
+    size_t getRemaining() const noexcept { return size_t(mEnd - mCurrent); }
+
+    // the handle of the replay for a handle of the capture, or nullid
+    HandleBase::HandleId getHandle(HandleBase::HandleId id) const noexcept;
+
+    Storage& getStorage() noexcept { return mStorage; }
+
+    // false once something was read past the end of the record
+    bool isValid() const noexcept { return mValid; }
+
+private:
+    uint8_t const* mCurrent;
+    uint8_t const* mEnd;
+    HandleMap const& mHandles;
+    Storage& mStorage;
+    bool mValid = true;
+};
+
+} // namespace capture
+
+/*
+ * Executes the driver commands of a capture written by CommandCapture, one frame at a time, and
+ * measures how long each frame takes on the CPU (executing the commands) and on the GPU, if the
+ * driver supports timer queries.
+ *
+ * The handles of the capture are replaced by handles created by the driver of the replay. The
+ * swap chains render into the given native window. External images and streams can't be
+ * replayed, the commands that use them are skipped.
+ *
+ * This must be used on the thread the driver was created on.
+ */
+class CommandReplay {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct FrameTime {
+        uint64_t cpu = 0;   // in nanoseconds
+        uint64_t gpu = 0;   // in nanoseconds, 0 if unknown
+    };
+
+    CommandReplay(Driver& driver, void* nativeWindow) noexcept;
+    ~CommandReplay() noexcept;
+
+    CommandReplay(CommandReplay const& rhs) = delete;
+    CommandReplay& operator=(CommandReplay const& rhs) = delete;
+
+    // reads the whole capture in memory, returns false if it can't be replayed
+    bool open(const char* path) noexcept;
+
+    // Executes the commands up to and including the next endFrame.
+    // Returns false when the capture is over.
+    bool replayFrame() noexcept;
+
+    // Executes the frames that are left, and waits for the GPU times of all the frames.
+    void finish() noexcept;
+
+    // times of the frames replayed so far, the GPU times might not be known yet
+    std::vector<FrameTime> const& getFrameTimes() const noexcept { return mFrameTimes; }
+
+private:
+    static constexpr size_t TIMER_QUERY_COUNT = 4;
+
+    // the commands of the capture this build doesn't know about, or can't replay
+    static constexpr uint16_t SKIP = CommandCapture::COUNT;
+
+    // executes the command of a record, returns false if the record is corrupted
+    bool execute(uint16_t command, uint8_t const* data, uint32_t size) noexcept;
+    void mapHandle(uint8_t const* data, uint32_t size, HandleBase const& handle) noexcept;
+    void beginFrameTimer() noexcept;
+    void endFrameTimer() noexcept;
+    void pollFrameTimers() noexcept;
+
+    Driver& mDriver;
+    std::vector<uint8_t> mCapture;
+    size_t mPosition = 0;
+
+    // command of the replay, for each command of the capture
+    std::vector<uint16_t> mCommands;
+
+    capture::HandleMap mHandles;
+    capture::Storage mStorage;
+
+    std::vector<FrameTime> mFrameTimes;
+    clock::time_point mFrameStart;
+    bool mTimerQueriesSupported = false;
+    Driver::TimerQueryHandle mTimerQueries[TIMER_QUERY_COUNT];
+    size_t mTimerQueryFrames[TIMER_QUERY_COUNT] = {};
+    bool mTimerQueryPending[TIMER_QUERY_COUNT] = {};
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDREPLAY_H
@@ -60,6 +60,16 @@ CommandStream::CommandStream(Driver& driver, CircularBuffer& buffer) noexcept
 {
 }
 
+CommandStream::CommandStream(CommandStream const& rhs, CircularBuffer& buffer) noexcept
+        : mDispatcher(rhs.mDispatcher),
+          mDriver(rhs.mDriver),
+          mCurrentBuffer(&buffer)
+#ifndef NDEBUG
+          , mThreadId(std::this_thread::get_id())
+#endif
+{
+}
+
 void CommandStream::execute(void* buffer) {
     SYSTRACE_CALL();
     Profiler::Counters c0;
@@ -95,10 +105,34 @@ void CommandStream::execute(void* buffer) {
     }
 }
 
+void CommandStream::reserveChunks(size_t const* sizes, size_t count, void** chunks) noexcept {
+    assert(count <= ChunksCommand::MAX_CHUNK_COUNT);
+
+    // each chunk ends with a null command, where its execution stops
+    const size_t header = CommandBase::align(sizeof(ChunksCommand));
+    const size_t terminator = CommandBase::align(sizeof(NoopCommand));
+    size_t total = header;
+    for (size_t i = 0; i < count; i++) {
+        total += sizes[i] + terminator;
+    }
+
+    char* const p = static_cast<char*>(allocateCommand(total));
+    char* chunk = p + header;
+    for (size_t i = 0; i < count; i++) {
+        chunks[i] = chunk;
+        chunk += sizes[i];
+        new(chunk) NoopCommand(nullptr);
+        chunk += terminator;
+    }
+    new(p) ChunksCommand(chunks, count, p + total);
+}
+
 void CommandStream::queueCommand(std::function<void()> command) {
     new(allocateCommand(CustomCommand::align(sizeof(CustomCommand)))) CustomCommand(command);
 }
 
+// ------------------------------------------------------------------------------------------------
+
 template<typename... ARGS>
 template<void (Driver::*METHOD)(ARGS...)>
 template<std::size_t... I>
@@ -140,6 +174,21 @@ void CustomCommand::execute(Driver&, CommandBase* base, intptr_t* next) noexcept
     static_cast<CustomCommand*>(base)->~CustomCommand();
 }
 
+// ------------------------------------------------------------------------------------------------
+
+ChunksCommand::ChunksCommand(void* const* chunks, size_t count, void* next) noexcept
+        : CommandBase(execute), mNext(intptr_t((char*)next - (char*)this)), mCount(count) {
+    for (size_t i = 0; i < count; i++) {
+        mChunks[i] = static_cast<CommandBase*>(chunks[i]);
+    }
+}
+
+void ChunksCommand::execute(Driver& driver, CommandBase* base, intptr_t* next) noexcept {
+    ChunksCommand* self = static_cast<ChunksCommand*>(base);
+    driver.executeChunks(self->mChunks, self->mCount);
+    *next = self->mNext;
+}
+
 } // namespace filament
 
 
@@ -206,6 +255,7 @@ io::ostream& operator<<(io::ostream& out, ElementType type) {
         CASE(ElementType, HALF2)
         CASE(ElementType, HALF3)
         CASE(ElementType, HALF4)
+        CASE(ElementType, INT_2_10_10_10_REV)
     }
     return out;
 }
@@ -234,6 +284,7 @@ io::ostream& operator<<(io::ostream& out, SamplerType type) {
         CASE(SamplerType, SAMPLER_2D)
         CASE(SamplerType, SAMPLER_CUBEMAP)
         CASE(SamplerType, SAMPLER_EXTERNAL)
+        CASE(SamplerType, SAMPLER_2D_ARRAY)
     }
     return out;
 }
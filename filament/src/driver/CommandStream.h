@@ -20,7 +20,16 @@
 #include "driver/CircularBuffer.h"
 #include "driver/Driver.h"
 
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+#include "driver/CommandTimings.h"
+#endif
+
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+#include "driver/CommandCapture.h"
+#endif
+
 #include <utils/compiler.h>
+#include <utils/Systrace.h>
 
 #include <functional>
 #include <tuple>
@@ -48,6 +57,9 @@ class CommandBase;
  *
  * When a command is inserted into the stream, the corresponding function pointer is copied
  * directly into CommandBase from Dispatcher.
+ *
+ * With FILAMENT_DRIVER_COMMAND_TIMING, Dispatcher also holds the timings of the commands.
+ * With FILAMENT_DRIVER_COMMAND_CAPTURE, the commands are recorded by 'capture' when it is set.
  */
 class Dispatcher {
 public:
@@ -56,6 +68,14 @@ public:
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                     Execute methodName##_;
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     Execute methodName##_;
 #include "driver/DriverAPI.inc"
+
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+    CommandTimings timings;
+#endif
+
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+    CommandCapture* capture = nullptr;
+#endif
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -143,6 +163,9 @@ struct CommandType<void (Driver::*)(ARGS...)> {
         // A command can be moved
         inline explicit Command(Command&& rhs) = default;
 
+        // the arguments of the command, e.g. to record them
+        SavedParameters const& getArgs() const noexcept { return mArgs; }
+
         template<typename... A>
         inline explicit constexpr Command(Execute execute, A&& ... args)
                 : CommandBase(execute), mArgs(std::move(args)...) {
@@ -181,6 +204,59 @@ public:
 
 // ------------------------------------------------------------------------------------------------
 
+/*
+ * ChunksCommand precedes the chunks of commands reserved by CommandStream::reserveChunks(). It
+ * hands them to Driver::executeChunks(), then the stream resumes after the last one.
+ */
+class ChunksCommand : public CommandBase {
+public:
+    static constexpr size_t MAX_CHUNK_COUNT = 16;
+
+    ChunksCommand(void* const* chunks, size_t count, void* next) noexcept;
+
+    // executes the commands of a chunk, up to the null command that ends it
+    static void executeChunk(Driver& driver, CommandBase* chunk) {
+        while (chunk) {
+            chunk = chunk->execute(driver);
+        }
+    }
+
+private:
+    static void execute(Driver& driver, CommandBase* self, intptr_t* next) noexcept;
+    intptr_t mNext;
+    size_t mCount;
+    CommandBase* mChunks[MAX_CHUNK_COUNT];
+};
+
+// ------------------------------------------------------------------------------------------------
+
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+    #define COMMAND_TIMING_BEGIN()                                                              \
+        const CommandTimings::clock::time_point start = CommandTimings::clock::now();
+    #define COMMAND_TIMING_END(methodName)                                                      \
+        timeCommand(concreteDriver, CommandTimings::methodName, start);
+#else
+    #define COMMAND_TIMING_BEGIN()
+    #define COMMAND_TIMING_END(methodName)
+#endif
+
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+    #define COMMAND_CAPTURE(methodName)                                                         \
+        if (UTILS_UNLIKELY(concreteDriver.getDispatcher().capture)) {                           \
+            concreteDriver.getDispatcher().capture->record(CommandCapture::methodName,          \
+                    static_cast<Cmd*>(base)->getArgs());                                        \
+        }
+#else
+    #define COMMAND_CAPTURE(methodName)
+#endif
+
+#ifdef UTILS_ENABLE_TRACER
+    #define COMMAND_TRACE(methodName)                                                           \
+        utils::Tracer::ScopedTrace ___trace(SYSTRACE_TAG_FILAMENT, #methodName);
+#else
+    #define COMMAND_TRACE(methodName)
+#endif
+
 template<typename ConcreteDriver>
 class ConcreteDispatcher final : public Dispatcher {
 public:
@@ -192,24 +268,48 @@ public:
 #include "driver/DriverAPI.inc"
     }
 private:
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+    static void timeCommand(ConcreteDriver& driver, CommandTimings::Command command,
+            CommandTimings::clock::time_point start) noexcept {
+        CommandTimings& timings = driver.getDispatcher().timings;
+        timings.record(command, start);
+        if (command == CommandTimings::endFrame) {
+            timings.publishFrame();
+        }
+    }
+#endif
+
 #define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
 #define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
         using Type = CommandType<decltype(&Driver::methodName)>;                                \
         using Cmd = typename Type::template Command<&Driver::methodName>;                       \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
+        COMMAND_TRACE(methodName)                                                               \
+        COMMAND_CAPTURE(methodName)                                                             \
+        COMMAND_TIMING_BEGIN()                                                                  \
         Cmd::execute(&ConcreteDriver::methodName, concreteDriver, base, next);                  \
+        COMMAND_TIMING_END(methodName)                                                          \
      }
 #define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)                         \
     static void methodName(Driver& driver, CommandBase* base, intptr_t* next) {                 \
         using Type = CommandType<decltype(&Driver::methodName)>;                                \
         using Cmd = typename Type::template Command<&Driver::methodName>;                       \
         ConcreteDriver& concreteDriver = static_cast<ConcreteDriver&>(driver);                  \
+        COMMAND_TRACE(methodName)                                                               \
+        COMMAND_CAPTURE(methodName)                                                             \
+        COMMAND_TIMING_BEGIN()                                                                  \
         Cmd::execute(&ConcreteDriver::methodName, concreteDriver, base, next);                  \
+        COMMAND_TIMING_END(methodName)                                                          \
      }
 #include "driver/DriverAPI.inc"
 };
 
+#undef COMMAND_TIMING_BEGIN
+#undef COMMAND_TIMING_END
+#undef COMMAND_CAPTURE
+#undef COMMAND_TRACE
+
 // ------------------------------------------------------------------------------------------------
 
 #ifdef NDEBUG
@@ -261,6 +361,11 @@ public:
     CommandStream() noexcept { }
     CommandStream(Driver& driver, CircularBuffer& buffer) noexcept;
 
+    // Creates a CommandStream targeting the same driver as 'rhs', but recording into 'buffer'.
+    // This is used to record commands from another thread into memory obtained with
+    // reserveCommands().
+    CommandStream(CommandStream const& rhs, CircularBuffer& buffer) noexcept;
+
     // This is for debugging only. Currently CircularBuffer can only be written from a
     // single thread. In debug builds we assert this condition.
     // Call this first in the render loop.
@@ -272,6 +377,24 @@ public:
 
     void execute(void* buffer);
 
+    /*
+     * Reserves 'size' bytes in the command stream, to be filled later -- possibly from another
+     * thread -- by a CommandStream recording into that memory. The reserved space must be
+     * filled exactly; CommandStreamSizer can be used to compute its size.
+     */
+    void* reserveCommands(size_t size) noexcept {
+        return allocateCommand(size);
+    }
+
+    /*
+     * Like reserveCommands(), but reserves 'count' chunks of the given sizes (at most
+     * ChunksCommand::MAX_CHUNK_COUNT) and returns where each starts in 'chunks'. The chunks are
+     * executed in order, or in parallel by drivers that can (see Driver::executeChunks()), so
+     * each must only depend on the state set before them. Only binding and draw commands
+     * can be recorded into them.
+     */
+    void reserveChunks(size_t const* sizes, size_t count, void** chunks) noexcept;
+
     /*
      * queueCommand() allows to queue a lambda function as a command.
      * This is much less efficient than using the Driver* API.
@@ -311,6 +434,35 @@ private:
     }
 };
 
+// ------------------------------------------------------------------------------------------------
+
+/*
+ * CommandStreamSizer has the same asynchronous API as CommandStream, but only computes how much
+ * space the commands would use in a CommandStream, without recording them.
+ */
+class CommandStreamSizer {
+public:
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                                         \
+    inline void methodName(paramsDecl) noexcept {                                               \
+        using CmdType = CommandType<decltype(&Driver::methodName)>;                             \
+        using Cmd = CmdType::Command<&Driver::methodName>;                                      \
+        mSize += CommandBase::align(sizeof(Cmd));                                               \
+    }
+
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)
+
+#include "driver/DriverAPI.inc"
+
+public:
+    size_t getSize() const noexcept { return mSize; }
+
+private:
+    size_t mSize = 0;
+};
+
+// ------------------------------------------------------------------------------------------------
+
 void* CommandStream::allocate(size_t size, size_t alignment) noexcept {
     // make sure alignment is a power of two
     assert(alignment && !(alignment & alignment-1));
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandTimings.h"
+
+#include <utils/Systrace.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace filament {
+
+using namespace utils;
+
+// names of the systrace counters, which are the time spent in each command, in microseconds
+static const char* const sTraceNames[CommandTimings::COUNT] = {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     "driver." #methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     "driver." #methodName,
+#include "driver/DriverAPI.inc"
+};
+
+const char* CommandTimings::getName(size_t command) noexcept {
+    // skip the "driver." prefix
+    return command < COUNT ? sTraceNames[command] + 7 : nullptr;
+}
+
+void CommandTimings::publishFrame() noexcept {
+    SYSTRACE_CONTEXT();
+    for (size_t i = 0; i < COUNT; i++) {
+        if (mCurrent[i].count) {
+            SYSTRACE_VALUE32(sTraceNames[i], mCurrent[i].time / 1000);
+        }
+    }
+
+    std::lock_guard<Mutex> guard(mLock);
+    std::copy(std::begin(mCurrent), std::end(mCurrent), std::begin(mLastFrame));
+    std::fill(std::begin(mCurrent), std::end(mCurrent), Entry{});
+    mFrameCount++;
+}
+
+uint32_t CommandTimings::getLastFrame(Entry* entries) const noexcept {
+    std::lock_guard<Mutex> guard(mLock);
+    std::copy(std::begin(mLastFrame), std::end(mLastFrame), entries);
+    return mFrameCount;
+}
+
+} // namespace filament
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_COMMANDTIMINGS_H
+#define TNT_FILAMENT_DRIVER_COMMANDTIMINGS_H
+
+#include <utils/compiler.h>
+#include <utils/Mutex.h>
+
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+/*
+ * Number of calls and time spent in each asynchronous driver command, on the driver thread.
+ *
+ * When filament is built with FILAMENT_ENABLE_COMMAND_TIMING, ConcreteDispatcher times every
+ * command it executes. The totals of a frame are published when its endFrame command has been
+ * executed, they can then be read from any thread.
+ */
+class CommandTimings {
+public:
+    // one per asynchronous command of DriverAPI.inc
+    enum Command : uint16_t {
+#define DECL_DRIVER_API_SYNCHRONOUS(RetType, methodName, paramsDecl, params)
+#define DECL_DRIVER_API(methodName, paramsDecl, params)                     methodName,
+#define DECL_DRIVER_API_RETURN(RetType, methodName, paramsDecl, params)     methodName,
+#include "driver/DriverAPI.inc"
+        COUNT
+    };
+
+    struct Entry {
+        uint32_t count = 0;
+        uint64_t time = 0;      // in nanoseconds
+    };
+
+    using clock = std::chrono::steady_clock;
+
+    // name of the driver's method, e.g. "draw"
+    static const char* getName(size_t command) noexcept;
+
+    // called on the driver thread, after executing a command
+    void record(Command command, clock::time_point start) noexcept {
+        Entry& entry = mCurrent[command];
+        entry.count++;
+        entry.time += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - start).count());
+    }
+
+    // called on the driver thread, after executing endFrame. This publishes the frame's
+    // timings, and traces them.
+    void publishFrame() noexcept;
+
+    // Copies the timings of the last completed frame into entries (COUNT of them), this can be
+    // called from any thread. Returns the number of frames completed so far.
+    uint32_t getLastFrame(Entry* entries) const noexcept;
+
+private:
+    Entry mCurrent[COUNT];
+    Entry mLastFrame[COUNT];
+    uint32_t mFrameCount = 0;
+    mutable utils::Mutex mLock;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_COMMANDTIMINGS_H
@@ -171,6 +171,12 @@ Driver::SamplerFormat DriverBase::getSamplerFormat(TextureFormat format) noexcep
 
 Driver::~Driver() noexcept = default;
 
+void Driver::executeChunks(CommandBase* const* chunks, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        ChunksCommand::executeChunk(*this, chunks[i]);
+    }
+}
+
 // forward to DriverBase, where the implementation really is
 Driver::SamplerPrecision Driver::getSamplerPrecision(TextureFormat format) noexcept {
     return DriverBase::getSamplerPrecision(format);
@@ -209,6 +215,7 @@ size_t Driver::getElementTypeSize(ElementType type) noexcept {
         case ElementType::HALF2:    return sizeof(math::half2);
         case ElementType::HALF3:    return sizeof(math::half3);
         case ElementType::HALF4:    return sizeof(math::half4);
+        case ElementType::INT_2_10_10_10_REV: return sizeof(uint32_t);
     }
 }
 
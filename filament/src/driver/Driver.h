@@ -41,6 +41,7 @@ namespace filament {
 
 template<typename T>
 class ConcreteDispatcher;
+class CommandBase;
 class Dispatcher;
 
 /* ------------------------------------------------------------------------------------------------
@@ -82,6 +83,7 @@ public:
     using BufferDescriptor = driver::BufferDescriptor;
     using PixelBufferDescriptor = driver::PixelBufferDescriptor;
     using FaceOffsets = driver::FaceOffsets;
+    using BufferRange = driver::BufferRange;
     using FenceStatus = driver::FenceStatus;
     using TargetBufferFlags = driver::TargetBufferFlags;
     using RenderPassParams = driver::RenderPassParams;
@@ -101,6 +103,7 @@ public:
     using FenceHandle           = Handle<HwFence>;
     using SwapChainHandle       = Handle<HwSwapChain>;
     using StreamHandle          = Handle<HwStream>;
+    using TimerQueryHandle      = Handle<HwTimerQuery>;
 
     struct Attribute {
         uint32_t offset = 0;
@@ -112,6 +115,13 @@ public:
 
     using AttributeArray = std::array<Attribute, MAX_ATTRIBUTE_BUFFER_COUNT>;
 
+    // A range of a uniform buffer written by updateUniformBuffers()
+    struct UniformBufferUpdate {
+        UniformBufferHandle ubh;
+        uint32_t byteOffset;
+        uint32_t byteSize;
+    };
+
     // types of the data returned by samplers in the shaders
     enum class SamplerFormat : uint8_t {
         // don't change values of enums (used w/ UniformInterfaceBlock::Type)
@@ -128,14 +138,18 @@ public:
         // ctor for cubemaps
         TargetBufferInfo(TextureHandle h, uint8_t level, TextureCubemapFace face) noexcept
                 : handle(h), level(level), face(face) { }
-        // ctor for 3D textures
-        TargetBufferInfo(TextureHandle h, uint8_t level, uint16_t layer) noexcept
-                : handle(h), level(level), layer(layer) { }
+        // ctor for 3D textures and 2D arrays, viewCount layers starting at layer are the views
+        // of a multiview render target
+        TargetBufferInfo(TextureHandle h, uint8_t level, uint16_t layer,
+                uint8_t viewCount = 1) noexcept
+                : handle(h), level(level), viewCount(viewCount), layer(layer) { }
 
         // texture to be used as render target
         TextureHandle handle;
         // level to be used
         uint8_t level = 0;
+        // number of views, see isMultiviewSupported()
+        uint8_t viewCount = 1;
         union {
             // face if texture is a cubemap
             TextureCubemapFace face;
@@ -234,6 +248,12 @@ public:
     virtual void debugCommand(const char* methodName) {}
 #endif
 
+    // Executes the chunks of commands recorded with CommandStream::reserveChunks(), each ends
+    // with a null command. They're independent of each other, a driver can execute them in
+    // parallel as long as their effects are in the same order. By default they're executed one
+    // after the other on the calling thread.
+    virtual void executeChunks(CommandBase* const* chunks, size_t count);
+
     /*
      *
      * Asynchronous calls here only to provide a type to CommandStream. They must be non-virtual
@@ -18,6 +18,7 @@
 #define TNT_FILAMENT_DRIVER_DRIVERBASE_H
 
 #include <array>
+#include <atomic>
 #include <mutex>
 #include <assert.h>
 #include <stdint.h>
@@ -29,6 +30,7 @@
 
 #include "driver/Driver.h"
 #include "driver/SamplerBuffer.h"
+#include "driver/StagingPool.h"
 #include "driver/UniformBuffer.h"
 
 namespace filament {
@@ -139,6 +141,11 @@ struct HwStream : public HwBase {
     driver::ExternalContext::Stream* stream = nullptr;
     uint32_t width = 0;
     uint32_t height = 0;
+    // written by the driver thread when the stream is latched, read by the application thread
+    std::atomic<int64_t> timestamp = { 0 };
+};
+
+struct HwTimerQuery : public HwBase {
 };
 
 /*
@@ -165,8 +172,9 @@ public:
 protected:
     Dispatcher* mDispatcher;
 
+    // staging memory is released by the caller's descriptor, right here on the driver thread
     inline void scheduleDestroy(BufferDescriptor&& buffer) noexcept {
-        if (buffer.hasCallback()) {
+        if (buffer.hasCallback() && !driver::StagingPool::isStaging(buffer)) {
             scheduleDestroySlow(std::move(buffer));
         }
     }
@@ -16,6 +16,8 @@
 
 #include <filament/driver/ExternalContext.h>
 
+#include "driver/noop/ContextManagerNoop.h"
+
 #if defined(ANDROID)
     #include "driver/opengl/ContextManagerEGL.h"
     #if defined (FILAMENT_DRIVER_SUPPORTS_VULKAN)
@@ -55,6 +57,9 @@ ExternalContext* ExternalContext::create(Backend* backend) noexcept {
     if (*backend == Backend::DEFAULT) {
         *backend = Backend::OPENGL;
     }
+    if (*backend == Backend::NOOP) {
+        return new ContextManagerNoop();
+    }
     if (*backend == Backend::VULKAN) {
         #if defined(FILAMENT_DRIVER_SUPPORTS_VULKAN)
             #if defined(ANDROID)
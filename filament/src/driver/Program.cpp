@@ -16,6 +16,8 @@
 
 #include "driver/Program.h"
 
+#include <assert.h>
+
 using namespace utils;
 
 namespace filament {
@@ -43,6 +45,13 @@ Program& Program::withSamplerBindings(const SamplerBindingMap* bindings) {
     return *this;
 }
 
+Program& Program::specializationConstant(uint32_t id, int32_t value) {
+    assert(id < NUM_SPECIALIZATION_CONSTANTS);
+    mSpecializationConstants[id] = value;
+    mSpecializationConstantMask |= 1u << id;
+    return *this;
+}
+
 Program& Program::shader(Program::Shader shader, CString source) {
     std::swap(mShadersSource[size_t(shader)], source);
     return *this;
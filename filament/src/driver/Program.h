@@ -37,6 +37,8 @@ public:
     static constexpr size_t NUM_SHADER_TYPES = 2;
     static constexpr size_t NUM_UNIFORM_BINDINGS = filament::BindingPoints::COUNT;
     static constexpr size_t NUM_SAMPLER_BINDINGS = filament::BindingPoints::COUNT;
+    static constexpr size_t NUM_SPECIALIZATION_CONSTANTS =
+            filament::SpecializationConstants::COUNT;
 
     enum class Shader : uint8_t {
         VERTEX = 0,
@@ -75,6 +77,10 @@ public:
     // sets up sampler bindings for this program
     Program& withSamplerBindings(const SamplerBindingMap* bindings);
 
+    // sets the value of one of the shaders' specialization constants (only used by Vulkan), the
+    // default value is the one declared in the shaders
+    Program& specializationConstant(uint32_t id, int32_t value);
+
     // in order to workaround certain driver bugs, we need to be able to modify the
     // shader string (this happens in OpenGLProgram.cpp)
     std::array<utils::CString, NUM_SHADER_TYPES>&
@@ -97,6 +103,16 @@ public:
         return mSamplerInterfaceBlocks;
     }
 
+    // returns the ids of the specialization constants that were set, one bit per id
+    uint32_t getSpecializationConstantMask() const noexcept {
+        return mSpecializationConstantMask;
+    }
+
+    std::array<int32_t, NUM_SPECIALIZATION_CONSTANTS> const&
+    getSpecializationConstants() const noexcept {
+        return mSpecializationConstants;
+    }
+
     const SamplerBindingMap* getSamplerBindings() const {
         return mSamplerBindings;
     }
@@ -122,6 +138,8 @@ private:
     std::array<SamplerInterfaceBlock const *, NUM_SAMPLER_BINDINGS> mSamplerInterfaceBlocks;
     const SamplerBindingMap* mSamplerBindings = nullptr;
     std::array<utils::CString, NUM_SHADER_TYPES> mShadersSource;
+    std::array<int32_t, NUM_SPECIALIZATION_CONSTANTS> mSpecializationConstants = {};
+    uint32_t mSpecializationConstantMask = 0;
     size_t mSamplerCount = 0;
     utils::CString mName;
     uint8_t mVariant;
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/StagingPool.h"
+
+#include <utils/Log.h>
+#include <utils/memalign.h>
+
+namespace filament {
+namespace driver {
+
+StagingPool::StagingPool(size_t poolSize) noexcept : mPoolSize(poolSize) {
+}
+
+StagingPool::~StagingPool() noexcept {
+    retire();
+#ifndef NDEBUG
+    for (Pool const& pool : mPools) {
+        if (pool.refs.load(std::memory_order_relaxed)) {
+            utils::slog.w << "StagingPool destroyed with allocations in flight" << utils::io::endl;
+            break;
+        }
+    }
+#endif
+    utils::aligned_free(mArea);
+}
+
+BufferDescriptor StagingPool::allocate(size_t size, size_t alignment) noexcept {
+    if (UTILS_UNLIKELY(!size || size > mPoolSize)) {
+        return {};
+    }
+    if (UTILS_UNLIKELY(!mArea)) {
+        // the pools are only allocated when they're used
+        mArea = (char*)utils::aligned_alloc(mPoolSize * POOL_COUNT, 64);
+        if (!mArea) {
+            return {};
+        }
+        for (size_t i = 0; i < POOL_COUNT; i++) {
+            mPools[i].base = mArea + i * mPoolSize;
+        }
+    }
+
+    if (mCurrent) {
+        const size_t head = (mCurrent->head + alignment - 1) & ~(alignment - 1);
+        if (head + size > mPoolSize) {
+            retire();
+        }
+    }
+    if (!mCurrent) {
+        mCurrent = acquire();
+        if (!mCurrent) {
+            return {};
+        }
+    }
+
+    Pool& pool = *mCurrent;
+    const size_t head = (pool.head + alignment - 1) & ~(alignment - 1);
+    pool.head = head + size;
+    pool.refs.fetch_add(1, std::memory_order_relaxed);
+    return BufferDescriptor(pool.base + head, size, &release, &pool);
+}
+
+void StagingPool::nextFrame() noexcept {
+    if (mCurrent && mCurrent->head) {
+        retire();
+    }
+}
+
+void StagingPool::release(void*, size_t, void* user) noexcept {
+    Pool* const pool = static_cast<Pool*>(user);
+    // pairs with the acquire in acquire(), the driver is done reading this memory
+    pool->refs.fetch_sub(1, std::memory_order_release);
+}
+
+StagingPool::Pool* StagingPool::acquire() noexcept {
+    for (Pool& pool : mPools) {
+        if (pool.refs.load(std::memory_order_acquire) == 0) {
+            pool.refs.store(1, std::memory_order_relaxed);
+            pool.head = 0;
+            return &pool;
+        }
+    }
+    // all the pools are still read by the driver
+    return nullptr;
+}
+
+void StagingPool::retire() noexcept {
+    if (mCurrent) {
+        mCurrent->refs.fetch_sub(1, std::memory_order_release);
+        mCurrent = nullptr;
+    }
+}
+
+} // namespace driver
+} // namespace filament
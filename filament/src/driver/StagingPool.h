@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_STAGINGPOOL_H
+#define TNT_FILAMENT_DRIVER_STAGINGPOOL_H
+
+#include <filament/driver/BufferDescriptor.h>
+
+#include <utils/compiler.h>
+
+#include <array>
+#include <atomic>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+namespace driver {
+
+/*
+ * Linear pools upload payloads are allocated from, on the main thread. Allocations go into the
+ * current pool until it's full or the frame ends, then the next free pool becomes current. A pool
+ * is free again once all the BufferDescriptors holding its memory are destroyed, which the driver
+ * does right after consuming them, on its own thread (see DriverBase::scheduleDestroy()).
+ */
+class StagingPool {
+public:
+    static constexpr size_t POOL_COUNT = 4;
+
+    explicit StagingPool(size_t poolSize) noexcept;
+    ~StagingPool() noexcept;
+
+    StagingPool(StagingPool const& rhs) = delete;
+    StagingPool& operator=(StagingPool const& rhs) = delete;
+
+    // Returns a descriptor owning size bytes, its buffer is nullptr when no pool has room.
+    BufferDescriptor allocate(size_t size, size_t alignment = 16) noexcept;
+
+    // retires the current pool, called once per frame
+    void nextFrame() noexcept;
+
+    // the callback of the descriptors holding pool memory, it can be called from any thread
+    static void release(void* buffer, size_t size, void* user) noexcept;
+
+    static bool isStaging(BufferDescriptor const& buffer) noexcept {
+        return buffer.getCallback() == &release;
+    }
+
+private:
+    struct Pool {
+        // one reference per live allocation, plus one while the pool is current
+        std::atomic<uint32_t> refs = { 0 };
+        char* base = nullptr;
+        size_t head = 0;
+    };
+
+    Pool* acquire() noexcept;
+    void retire() noexcept;
+
+    std::array<Pool, POOL_COUNT> mPools;
+    Pool* mCurrent = nullptr;
+    char* mArea = nullptr;
+    size_t mPoolSize;
+};
+
+} // namespace driver
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_STAGINGPOOL_H
@@ -98,7 +98,8 @@ static Pool sMemoryPool;
 UniformBuffer::UniformBuffer(size_t size) noexcept
     : mBuffer(mStorage),
       mSize(uint32_t(size)),
-      mSomethingDirty(true) {
+      mDirtyBegin(0),
+      mDirtyEnd(uint32_t(size)) {
     if (UTILS_LIKELY(size > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(size);
     }
@@ -112,7 +113,8 @@ UniformBuffer::UniformBuffer(UniformInterfaceBlock const& uib) noexcept
 UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
         : mBuffer(mStorage),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mDirtyBegin(rhs.mDirtyBegin),
+          mDirtyEnd(rhs.mDirtyEnd) {
     if (UTILS_LIKELY(mSize > sizeof(mStorage))) {
         mBuffer = UniformBuffer::alloc(rhs.mSize);
     }
@@ -122,7 +124,8 @@ UniformBuffer::UniformBuffer(const UniformBuffer& rhs)
 UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
         : mBuffer(rhs.mBuffer),
           mSize(rhs.mSize),
-          mSomethingDirty(rhs.mSomethingDirty) {
+          mDirtyBegin(rhs.mDirtyBegin),
+          mDirtyEnd(rhs.mDirtyEnd) {
     if (UTILS_LIKELY(rhs.isLocalStorage())) {
         mBuffer = mStorage;
         memcpy(mBuffer, rhs.mBuffer, mSize);
@@ -133,7 +136,8 @@ UniformBuffer::UniformBuffer(UniformBuffer&& rhs) noexcept
 
 UniformBuffer& UniformBuffer::operator=(UniformBuffer&& rhs) noexcept {
     if (this != &rhs) {
-        mSomethingDirty = rhs.mSomethingDirty;
+        mDirtyBegin = rhs.mDirtyBegin;
+        mDirtyEnd = rhs.mDirtyEnd;
         if (UTILS_LIKELY(rhs.isLocalStorage())) {
             mBuffer = mStorage;
             mSize = rhs.mSize;
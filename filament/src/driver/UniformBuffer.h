@@ -64,10 +64,17 @@ public:
     // invalidate a range of uniforms and return a pointer to it. offset and size given in bytes
     void* invalidateUniforms(size_t offset, size_t size) {
         assert(offset + size <= mSize);
-        mSomethingDirty = true;
+        mDirtyBegin = std::min(mDirtyBegin, uint32_t(offset));
+        mDirtyEnd = std::max(mDirtyEnd, uint32_t(offset + size));
         return static_cast<char*>(mBuffer) + offset;
     }
 
+    // mark the whole buffer as dirty, e.g. when it's uploaded to a new uniform buffer
+    void invalidate() noexcept {
+        mDirtyBegin = 0;
+        mDirtyEnd = mSize;
+    }
+
     // pointer to the uniform buffer
     void const* getBuffer() const noexcept { return mBuffer; }
 
@@ -75,10 +82,18 @@ public:
     size_t getSize() const noexcept { return mSize; }
 
     // return if any uniform has been changed
-    bool isDirty() const noexcept { return mSomethingDirty; }
+    bool isDirty() const noexcept { return mDirtyBegin < mDirtyEnd; }
+
+    // smallest range of bytes that contains all the uniforms changed since the last clean(),
+    // only valid if isDirty()
+    size_t getDirtyOffset() const noexcept { return mDirtyBegin; }
+    size_t getDirtySize() const noexcept { return mDirtyEnd - mDirtyBegin; }
 
     // mark the whole buffer as clean (no modified uniforms)
-    void clean() const noexcept { mSomethingDirty = false; }
+    void clean() const noexcept {
+        mDirtyBegin = mSize;
+        mDirtyEnd = 0;
+    }
 
     /*
      * -----------------------------------------------
@@ -158,10 +173,12 @@ private:
     // TODO: we need a better to calculate this local storage.
     // Probably the better thing to do would be to use a special allocator.
     // Local storage is limited by the total size of a handle (128 byte for GL)
-    char mStorage[96];
+    char mStorage[88];
     void *mBuffer = nullptr;
     uint32_t mSize = 0;
-    mutable bool mSomethingDirty = false;
+    // the dirty range of bytes is [mDirtyBegin, mDirtyEnd[, it's empty when the buffer is clean
+    mutable uint32_t mDirtyBegin = 0;
+    mutable uint32_t mDirtyEnd = 0;
 };
 
 // specialization for float3 (which has a different alignment)
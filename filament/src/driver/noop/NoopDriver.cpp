@@ -19,7 +19,6 @@
 
 namespace filament {
 
-
 std::unique_ptr<Driver> NoopDriver::create() {
     return std::unique_ptr<Driver>(new NoopDriver());
 }
@@ -30,6 +29,14 @@ NoopDriver::NoopDriver() noexcept
 
 NoopDriver::~NoopDriver() noexcept = default;
 
+driver::ShaderModel NoopDriver::getShaderModel() const noexcept {
+#if defined(ANDROID) || defined(IOS)
+    return driver::ShaderModel::GL_ES_30;
+#else
+    return driver::ShaderModel::GL_CORE_41;
+#endif
+}
+
 // explicit instantiation of the Dispatcher
 template class ConcreteDispatcher<NoopDriver>;
 
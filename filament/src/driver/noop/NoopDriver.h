@@ -32,7 +32,8 @@ public:
     static std::unique_ptr<Driver> create();
 
 private:
-    virtual ShaderModel getShaderModel() const noexcept override final { return ShaderModel::UNKNOWN; }
+    // the shader model of the OpenGL driver on this platform, so that the same materials load
+    virtual ShaderModel getShaderModel() const noexcept override final;
 
     /*
      * Driver interface
@@ -71,6 +71,7 @@ UTILS_PRIVATE PFNEGLCLIENTWAITSYNCKHRPROC eglClientWaitSyncKHR;
 UTILS_PRIVATE PFNEGLCREATEIMAGEKHRPROC eglCreateImageKHR;
 UTILS_PRIVATE PFNEGLDESTROYIMAGEKHRPROC eglDestroyImageKHR;
 UTILS_PRIVATE PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC eglGetNativeClientBufferANDROID;
+UTILS_PRIVATE PFNEGLPRESENTATIONTIMEANDROIDPROC eglPresentationTimeANDROID;
 }
 using namespace glext;
 
@@ -224,7 +225,7 @@ public:
     void release(EGLStream* stream) noexcept;
     void attach(EGLStream* stream, intptr_t tname) noexcept;
     void detach(EGLStream* stream) noexcept;
-    void updateTexImage(EGLStream* stream) noexcept;
+    void updateTexImage(EGLStream* stream, int64_t* timestamp) noexcept;
 
 private:
     VirtualMachineEnv& mVm;
@@ -241,6 +242,7 @@ private:
     JNIEnv* getEnvironmentSlow() noexcept;
 
     jmethodID mSurfaceTextureClass_updateTexImage;
+    jmethodID mSurfaceTextureClass_getTimestamp;
     jmethodID mSurfaceTextureClass_attachToGLContext;
     jmethodID mSurfaceTextureClass_detachFromGLContext;
 
@@ -249,6 +251,7 @@ private:
     int  (*ASurfaceTexture_attachToGLContext)(ASurfaceTexture*, uint32_t);
     int  (*ASurfaceTexture_detachFromGLContext)(ASurfaceTexture*);
     int  (*ASurfaceTexture_updateTexImage)(ASurfaceTexture*);
+    int64_t (*ASurfaceTexture_getTimestamp)(ASurfaceTexture*);
 };
 
 // ---------------------------------------------------------------------------------------------
@@ -524,6 +527,9 @@ std::unique_ptr<Driver> ContextManagerEGL::createDriver(void* const sharedGLCont
     eglCreateImageKHR = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
     eglDestroyImageKHR = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
     eglGetNativeClientBufferANDROID = (PFNEGLGETNATIVECLIENTBUFFERANDROIDPROC) eglGetProcAddress("eglGetNativeClientBufferANDROID");
+    if (extensions.has("EGL_ANDROID_presentation_time")) {
+        eglPresentationTimeANDROID = (PFNEGLPRESENTATIONTIMEANDROIDPROC) eglGetProcAddress("eglPresentationTimeANDROID");
+    }
 
     EGLint configsCount;
     EGLint configAttribs[] = {
@@ -610,6 +616,23 @@ std::unique_ptr<Driver> ContextManagerEGL::createDriver(void* const sharedGLCont
         goto error;
     }
 
+    if (mUploadContextEnabled) {
+        // without an upload context, the uploads just stay on the driver thread
+        mEGLUploadSurface = eglCreatePbufferSurface(mEGLDisplay, mEGLTransparentConfig,
+                pbufferAttribs);
+        if (mEGLUploadSurface != EGL_NO_SURFACE) {
+            mEGLUploadContext = eglCreateContext(mEGLDisplay, eglConfig, mEGLContext,
+                    contextAttribs);
+        }
+        if (mEGLUploadContext == EGL_NO_CONTEXT) {
+            logEglError("eglCreateContext (upload context)");
+            if (mEGLUploadSurface != EGL_NO_SURFACE) {
+                eglDestroySurface(mEGLDisplay, mEGLUploadSurface);
+                mEGLUploadSurface = EGL_NO_SURFACE;
+            }
+        }
+    }
+
     // success!!
     return OpenGLDriver::create(this, sharedGLContext);
 
@@ -639,8 +662,21 @@ EGLBoolean ContextManagerEGL::makeCurrent(EGLSurface surface) noexcept {
     return EGL_TRUE;
 }
 
+bool ContextManagerEGL::makeUploadContextCurrent() noexcept {
+    return eglMakeCurrent(mEGLDisplay, mEGLUploadSurface, mEGLUploadSurface, mEGLUploadContext);
+}
+
+void ContextManagerEGL::releaseUploadContext() noexcept {
+    eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
+
 void ContextManagerEGL::terminate() noexcept {
     eglMakeCurrent(mEGLDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (mEGLUploadContext != EGL_NO_CONTEXT) {
+        eglDestroySurface(mEGLDisplay, mEGLUploadSurface);
+        eglDestroyContext(mEGLDisplay, mEGLUploadContext);
+    }
     eglDestroySurface(mEGLDisplay, mEGLDummySurface);
     eglDestroyContext(mEGLDisplay, mEGLContext);
     eglTerminate(mEGLDisplay);
@@ -663,6 +699,28 @@ ExternalContext::SwapChain* ContextManagerEGL::createSwapChain(
     return (SwapChain*)sur;
 }
 
+ExternalContext::SwapChain* ContextManagerEGL::createSwapChainHeadless(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+    EGLint attribs[] = {
+            EGL_WIDTH,  EGLint(width),
+            EGL_HEIGHT, EGLint(height),
+            EGL_NONE
+    };
+    EGLSurface sur = EGL_NO_SURFACE;
+    if (!(flags & driver::SWAP_CHAIN_CONFIG_TRANSPARENT)) {
+        sur = eglCreatePbufferSurface(mEGLDisplay, mEGLConfig, attribs);
+    }
+    if (sur == EGL_NO_SURFACE) {
+        // the transparent config is known to support pbuffers, it's used for the dummy surface
+        sur = eglCreatePbufferSurface(mEGLDisplay, mEGLTransparentConfig, attribs);
+    }
+    if (UTILS_UNLIKELY(sur == EGL_NO_SURFACE)) {
+        logEglError("eglCreatePbufferSurface");
+        return nullptr;
+    }
+    return (SwapChain*)sur;
+}
+
 void ContextManagerEGL::destroySwapChain(ExternalContext::SwapChain* swapChain) noexcept {
     EGLSurface sur = (EGLSurface) swapChain;
     if (sur != EGL_NO_SURFACE) {
@@ -685,6 +743,13 @@ void ContextManagerEGL::commit(ExternalContext::SwapChain* swapChain) noexcept {
     }
 }
 
+void ContextManagerEGL::setPresentationTime(int64_t presentationTimeInNanosecond) noexcept {
+    if (eglPresentationTimeANDROID && mCurrentSurface != EGL_NO_SURFACE &&
+            mCurrentSurface != mEGLDummySurface) {
+        eglPresentationTimeANDROID(mEGLDisplay, mCurrentSurface, presentationTimeInNanosecond);
+    }
+}
+
 ExternalContext::Fence* ContextManagerEGL::createFence() noexcept {
     Fence* f = nullptr;
 #ifdef EGL_KHR_reusable_sync
@@ -735,8 +800,8 @@ void ContextManagerEGL::detach(Stream* stream) noexcept {
     mExternalStreamManager.detach(static_cast<EGLStream*>(stream));
 }
 
-void ContextManagerEGL::updateTexImage(Stream* stream) noexcept {
-    mExternalStreamManager.updateTexImage(static_cast<EGLStream*>(stream));
+void ContextManagerEGL::updateTexImage(Stream* stream, int64_t* timestamp) noexcept {
+    mExternalStreamManager.updateTexImage(static_cast<EGLStream*>(stream), timestamp);
 }
 
 ExternalContext::ExternalTexture* ContextManagerEGL::createExternalTextureStorage() noexcept {
@@ -786,6 +851,7 @@ ExternalStreamManagerAndroid::ExternalStreamManagerAndroid() noexcept
     loadSymbol(ASurfaceTexture_attachToGLContext,   "ASurfaceTexture_attachToGLContext");
     loadSymbol(ASurfaceTexture_detachFromGLContext, "ASurfaceTexture_detachFromGLContext");
     loadSymbol(ASurfaceTexture_updateTexImage,      "ASurfaceTexture_updateTexImage");
+    loadSymbol(ASurfaceTexture_getTimestamp,        "ASurfaceTexture_getTimestamp");
     if (ASurfaceTexture_fromSurfaceTexture) {
         slog.d << "Using ASurfaceTexture" << io::endl;
     }
@@ -807,6 +873,9 @@ JNIEnv* ExternalStreamManagerAndroid::getEnvironmentSlow() noexcept {
                 SurfaceTextureClass, "updateTexImage", "()V");
     }
 
+    mSurfaceTextureClass_getTimestamp = env->GetMethodID(
+            SurfaceTextureClass, "getTimestamp", "()J");
+
     mSurfaceTextureClass_attachToGLContext = env->GetMethodID(
             SurfaceTextureClass, "attachToGLContext", "(I)V");
 
@@ -897,14 +966,19 @@ void ExternalStreamManagerAndroid::detach(EGLStream* stream) noexcept {
     }
 }
 
-void ExternalStreamManagerAndroid::updateTexImage(EGLStream* stream) noexcept {
+void ExternalStreamManagerAndroid::updateTexImage(EGLStream* stream, int64_t* timestamp) noexcept {
     if (ASurfaceTexture_fromSurfaceTexture) {
         ASurfaceTexture_updateTexImage(ASurfaceTexture_cast(stream));
+        if (ASurfaceTexture_getTimestamp) {
+            *timestamp = ASurfaceTexture_getTimestamp(ASurfaceTexture_cast(stream));
+        }
     } else {
         JNIEnv* const env = mVm.getEnvironment();
         assert(env); // we should have called attach() by now
         env->CallVoidMethod(jobject_cast(stream), mSurfaceTextureClass_updateTexImage);
         mVm.handleException(env);
+        *timestamp = env->CallLongMethod(jobject_cast(stream), mSurfaceTextureClass_getTimestamp);
+        mVm.handleException(env);
     }
 }
 
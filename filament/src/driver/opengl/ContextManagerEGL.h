@@ -42,9 +42,12 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept final override;
+    SwapChain* createSwapChainHeadless(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept final override;
     void destroySwapChain(SwapChain* swapChain) noexcept final override;
     void makeCurrent(SwapChain* swapChain) noexcept final override;
     void commit(SwapChain* swapChain) noexcept final override;
+    void setPresentationTime(int64_t presentationTimeInNanosecond) noexcept final override;
 
     bool canCreateFence() noexcept final override { return true; }
     Fence* createFence() noexcept final override;
@@ -55,7 +58,7 @@ public:
     void destroyStream(Stream* stream) noexcept final override;
     void attach(Stream* stream, intptr_t tname) noexcept final override;
     void detach(Stream* stream) noexcept final override;
-    void updateTexImage(Stream* stream) noexcept final override;
+    void updateTexImage(Stream* stream, int64_t* timestamp) noexcept final override;
 
     ExternalTexture* createExternalTextureStorage() noexcept final override;
     void reallocateExternalStorage(ExternalTexture* ets,
@@ -64,6 +67,12 @@ public:
 
     int getOSVersion() const noexcept final override;
 
+    bool hasUploadContext() const noexcept final override {
+        return mEGLUploadContext != EGL_NO_CONTEXT;
+    }
+    bool makeUploadContextCurrent() noexcept final override;
+    void releaseUploadContext() noexcept final override;
+
 private:
     EGLBoolean makeCurrent(EGLSurface surface) noexcept;
 
@@ -71,6 +80,8 @@ private:
     EGLContext mEGLContext = EGL_NO_CONTEXT;
     EGLSurface mCurrentSurface = EGL_NO_SURFACE;
     EGLSurface mEGLDummySurface = EGL_NO_SURFACE;
+    EGLContext mEGLUploadContext = EGL_NO_CONTEXT;
+    EGLSurface mEGLUploadSurface = EGL_NO_SURFACE;
     EGLConfig mEGLConfig;
     EGLConfig mEGLTransparentConfig;
     int mOSVersion;
@@ -27,6 +27,7 @@
 
 #include <dlfcn.h>
 
+#include <algorithm>
 #include <iostream>
 
 #define LIBRARY_GLX "libGL.so.1"
@@ -35,6 +36,7 @@
 // Function pointer types for X11 functions
 typedef Display* (*X11_OPEN_DISPLAY)(const char*);
 typedef Display* (*X11_CLOSE_DISPLAY)(Display*);
+typedef int (*X11_INIT_THREADS)();
 
 // Function pointer types for GLX functions
 typedef void (*GLX_DESTROY_CONTEXT)(Display*, GLXContext);
@@ -55,6 +57,7 @@ struct GLXFunctions {
 struct X11Functions {
     X11_OPEN_DISPLAY openDisplay;
     X11_CLOSE_DISPLAY closeDisplay;
+    X11_INIT_THREADS initThreads;
     void* library;
 } g_x11;
 
@@ -94,6 +97,7 @@ static bool loadLibraries() {
 
     g_x11.openDisplay  = (X11_OPEN_DISPLAY)  dlsym(g_x11.library, "XOpenDisplay");
     g_x11.closeDisplay = (X11_CLOSE_DISPLAY) dlsym(g_x11.library, "XCloseDisplay");
+    g_x11.initThreads  = (X11_INIT_THREADS)  dlsym(g_x11.library, "XInitThreads");
     return true;
 }
 
@@ -103,6 +107,10 @@ using namespace driver;
 
 std::unique_ptr<Driver> ContextManagerGLX::createDriver(void* const sharedGLContext) noexcept {
     loadLibraries();
+    if (mUploadContextEnabled) {
+        // the upload thread uses the display too
+        g_x11.initThreads();
+    }
     // Get the display device
     mGLXDisplay = g_x11.openDisplay(NULL);
     if (!mGLXDisplay) {
@@ -145,14 +153,37 @@ std::unique_ptr<Driver> ContextManagerGLX::createDriver(void* const sharedGLCont
     mDummySurface = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
     g_glx.setCurrentContext(mGLXDisplay, mDummySurface, mDummySurface, mGLXContext);
 
+    if (mUploadContextEnabled) {
+        // without an upload context, the uploads just stay on the driver thread
+        mUploadContext = g_glx.createContext(mGLXDisplay, mGLXConfig[0],
+                mGLXContext, True, context_attribs);
+        if (mUploadContext) {
+            mUploadSurface = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
+        } else {
+            utils::slog.w << "Unable to create the upload context" << utils::io::endl;
+        }
+    }
+
     int result = bluegl::bind();
     ASSERT_POSTCONDITION(!result, "Unable to load OpenGL entry points.");
 
     return OpenGLDriver::create(this, sharedGLContext);
 }
 
+bool ContextManagerGLX::makeUploadContextCurrent() noexcept {
+    return g_glx.setCurrentContext(mGLXDisplay, mUploadSurface, mUploadSurface, mUploadContext);
+}
+
+void ContextManagerGLX::releaseUploadContext() noexcept {
+    g_glx.setCurrentContext(mGLXDisplay, None, None, nullptr);
+}
+
 void ContextManagerGLX::terminate() noexcept {
     g_glx.setCurrentContext(mGLXDisplay, None, None, nullptr);
+    if (mUploadContext) {
+        g_glx.destroyPbuffer(mGLXDisplay, mUploadSurface);
+        g_glx.destroyContext(mGLXDisplay, mUploadContext);
+    }
     g_glx.destroyPbuffer(mGLXDisplay, mDummySurface);
     g_glx.destroyContext(mGLXDisplay, mGLXContext);
     g_x11.closeDisplay(mGLXDisplay);
@@ -167,7 +198,31 @@ ExternalContext::SwapChain* ContextManagerGLX::createSwapChain(
     return (SwapChain*) nativeWindow;
 }
 
-void ContextManagerGLX::destroySwapChain(ExternalContext::SwapChain* /*swapChain*/) noexcept {
+ExternalContext::SwapChain* ContextManagerGLX::createSwapChainHeadless(
+        uint32_t width, uint32_t height, uint64_t& flags) noexcept {
+
+    // Transparent swap chain is not supported
+    flags &= ~driver::SWAP_CHAIN_CONFIG_TRANSPARENT;
+    int pbufferAttribs[] = {
+            GLX_PBUFFER_WIDTH,  int(width),
+            GLX_PBUFFER_HEIGHT, int(height),
+            GL_NONE
+    };
+    GLXPbuffer sur = g_glx.createPbuffer(mGLXDisplay, mGLXConfig[0], pbufferAttribs);
+    if (sur) {
+        mPBuffers.push_back(sur);
+    }
+    return (SwapChain*) sur;
+}
+
+void ContextManagerGLX::destroySwapChain(ExternalContext::SwapChain* swapChain) noexcept {
+    // the windows are owned by the client, only the pbuffers are ours
+    auto pos = std::find(mPBuffers.begin(), mPBuffers.end(), (GLXPbuffer) swapChain);
+    if (pos != mPBuffers.end()) {
+        g_glx.setCurrentContext(mGLXDisplay, mDummySurface, mDummySurface, mGLXContext);
+        g_glx.destroyPbuffer(mGLXDisplay, *pos);
+        mPBuffers.erase(pos);
+    }
 }
 
 void ContextManagerGLX::makeCurrent(ExternalContext::SwapChain* swapChain) noexcept {
@@ -17,6 +17,8 @@
 #ifndef TNT_FILAMENT_DRIVER_OPENGL_CONTEXT_MANAGER_GLX_H
 #define TNT_FILAMENT_DRIVER_OPENGL_CONTEXT_MANAGER_GLX_H
 
+#include <vector>
+
 #include <stdint.h>
 
 #include <bluegl/BlueGL.h>
@@ -35,6 +37,8 @@ public:
     void terminate() noexcept override;
 
     SwapChain* createSwapChain(void* nativewindow, uint64_t& flags) noexcept override;
+    SwapChain* createSwapChainHeadless(uint32_t width, uint32_t height,
+            uint64_t& flags) noexcept override;
     void destroySwapChain(SwapChain* swapChain) noexcept override;
     void makeCurrent(SwapChain* swapChain) noexcept override;
     void commit(SwapChain* swapChain) noexcept override;
@@ -47,7 +51,7 @@ public:
     void destroyStream(Stream* stream) noexcept final override {}
     void attach(Stream* stream, intptr_t tname) noexcept final override {}
     void detach(Stream* stream) noexcept final override {}
-    void updateTexImage(Stream* stream) noexcept final override {}
+    void updateTexImage(Stream* stream, int64_t* timestamp) noexcept final override {}
 
     ExternalTexture* createExternalTextureStorage() noexcept final override { return nullptr; }
     void reallocateExternalStorage(ExternalTexture* ets,
@@ -56,11 +60,18 @@ public:
 
     int getOSVersion() const noexcept final override { return 0; }
 
+    bool hasUploadContext() const noexcept final override { return mUploadContext != nullptr; }
+    bool makeUploadContextCurrent() noexcept final override;
+    void releaseUploadContext() noexcept final override;
+
 private:
     Display *mGLXDisplay;
     GLXContext mGLXContext;
     GLXFBConfig* mGLXConfig;
     GLXPbuffer mDummySurface;
+    GLXContext mUploadContext = nullptr;
+    GLXPbuffer mUploadSurface = 0;
+    std::vector<GLXPbuffer> mPBuffers;  // the headless swap chains
 };
 
 using ContextManager = filament::ContextManagerGLX;
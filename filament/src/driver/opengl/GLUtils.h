@@ -70,6 +70,7 @@ constexpr inline GLuint getComponentCount(filament::driver::ElementType type) no
         case ElementType::UBYTE4:
         case ElementType::SHORT4:
         case ElementType::USHORT4:
+        case ElementType::INT_2_10_10_10_REV:
             return 4;
     }
 }
@@ -119,6 +120,8 @@ constexpr inline GLenum getComponentType(filament::driver::ElementType type) noe
         case ElementType::HALF3:
         case ElementType::HALF4:
             return GL_HALF_FLOAT;
+        case ElementType::INT_2_10_10_10_REV:
+            return GL_INT_2_10_10_10_REV;
     }
 }
 
@@ -240,6 +243,7 @@ constexpr inline GLenum getType(filament::driver::PixelDataType type) noexcept {
         case PixelDataType::HALF:               return GL_HALF_FLOAT;
         case PixelDataType::FLOAT:              return GL_FLOAT;
         case PixelDataType::COMPRESSED:         return 0; // should never happen
+        case PixelDataType::UINT_5_9_9_9_REV:   return GL_UNSIGNED_INT_5_9_9_9_REV;
     }
 }
 
@@ -117,100 +117,48 @@ void OpenGLBlitter::terminate() noexcept {
 }
 
 void OpenGLBlitter::blit(GLuint srcTextureExternal, GLuint dstTexture2d, GLuint w, GLuint h) noexcept {
-    const float2 vtx[3] = {{ -1.0f,  3.0f },
-                           { -1.0f, -1.0f },
-                           {  3.0f, -1.0f }};
+    static const float2 vtx[3] = {{ -1.0f,  3.0f },
+                                  { -1.0f, -1.0f },
+                                  {  3.0f, -1.0f }};
+
+    OpenGLDriver& gl = mOpenGLDriver;
 
     // we're using tmu 0 as the source texture
     GLuint tmu = 0;
 
     // source texture
-    glBindSampler(tmu, mSampler);
-    glBindTexture(GL_TEXTURE_EXTERNAL_OES, srcTextureExternal);
+    gl.bindSampler(tmu, mSampler);
+    gl.bindTexture(tmu, GL_TEXTURE_EXTERNAL_OES, srcTextureExternal);
     CHECK_GL_ERROR(utils::slog.e)
 
     // destination texture
-    glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+    gl.bindFramebuffer(GL_FRAMEBUFFER, mFBO);
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, dstTexture2d, 0);
     CHECK_GL_ERROR(utils::slog.e)
     CHECK_GL_FRAMEBUFFER_STATUS(utils::slog.e)
 
+    // state
+    OpenGLDriver::RasterState rs;
+    rs.depthFunc = OpenGLDriver::RasterState::DepthFunc::A;
+    rs.depthWrite = false;
+    rs.colorWrite = true;
+    gl.setRasterState(rs);
+    gl.disable(GL_SCISSOR_TEST);
+    gl.setViewport(0, 0, w, h);
+    gl.useProgram(mProgram);
+
     // geometry
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    gl.bindVertexArray(nullptr);
+    gl.bindBuffer(GL_ARRAY_BUFFER, 0);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, vtx);
 
     // blit...
-    glViewport(0, 0, w, h);
-    glUseProgram(mProgram);
     glDrawArrays(GL_TRIANGLES, 0, 3);
 
-    CHECK_GL_ERROR(utils::slog.e)
-}
-
-void OpenGLBlitter::State::save() noexcept {
-    mHasState = true;
-    // TODO: technically we should also save glVertexAttribPointer
-    GLuint tmu = 0;
-    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
-    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &array);
-    glGetIntegerv(GL_CURRENT_PROGRAM, &program);
-    glGetIntegerv(GL_VIEWPORT, viewport);
-    glGetIntegerv(GL_COLOR_WRITEMASK, writeMask);
-    scissorTest = glIsEnabled(GL_SCISSOR_TEST);
-    stencilTest = glIsEnabled(GL_STENCIL_TEST);
-    cullFace = glIsEnabled(GL_CULL_FACE);
-    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &vertexAttrib);
-
-    // save the current active texture first
-    glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
-
-    // we're using tmu 0 as the source texture
-    glActiveTexture(GL_TEXTURE0 + tmu);
+    // the driver always leaves the scissor test enabled
+    gl.enable(GL_SCISSOR_TEST);
 
-    // save that depends on glActiveTexture
-    glGetIntegerv(GL_SAMPLER_BINDING, &sampler);
-    glGetIntegerv(GL_TEXTURE_BINDING_2D, &texture);
-
-    /*
-     * Set the state
-     */
-
-    // we're using tmu 0 as the source texture
-    glDisable(GL_SCISSOR_TEST);
-    glDisable(GL_STENCIL_TEST);
-    glDisable(GL_CULL_FACE);
-    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
-    CHECK_GL_ERROR(utils::slog.e)
-}
-
-void OpenGLBlitter::State::restore() noexcept {
-    GLuint tmu = 0;
-    glColorMask(
-            (GLboolean)writeMask[0],
-            (GLboolean)writeMask[1],
-            (GLboolean)writeMask[2],
-            (GLboolean)writeMask[3]);
-    if (cullFace) {
-        glEnable(GL_CULL_FACE);
-    }
-    if (stencilTest) {
-        glEnable(GL_STENCIL_TEST);
-    }
-    if (scissorTest) {
-        glEnable(GL_SCISSOR_TEST);
-    }
-    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
-    glUseProgram(static_cast<GLuint>(program));
-    glBindBuffer(GL_ARRAY_BUFFER, static_cast<GLuint>(array));
-    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(framebuffer));
-    if (!vertexAttrib) {
-        glDisableVertexAttribArray(0);
-    }
-
-    glBindTexture(GL_TEXTURE_2D, static_cast<GLuint>(texture));
-    glBindSampler(tmu, static_cast<GLuint>(sampler));
-    glActiveTexture(static_cast<GLenum>(activeTexture));
     CHECK_GL_ERROR(utils::slog.e)
 }
 
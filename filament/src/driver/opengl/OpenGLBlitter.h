@@ -31,28 +31,10 @@ public:
     void init() noexcept;
     void terminate() noexcept;
 
+    // Copies an external texture into a 2D texture. This must be called on the driver thread,
+    // the GL state is changed through the driver's state cache.
     void blit(GLuint srcTextureExternal, GLuint dstTexture2d, GLuint w, GLuint h) noexcept;
 
-    class State {
-        bool mHasState = false;
-        GLint activeTexture, sampler, texture, framebuffer, array, vertexAttrib, program;
-        GLboolean stencilTest, scissorTest, cullFace;
-        GLint viewport[4], writeMask[4];
-        void save() noexcept;
-        void restore() noexcept;
-    public:
-        void setup() noexcept {
-            if (UTILS_UNLIKELY(!mHasState)) {
-                save();
-            }
-        }
-        ~State() noexcept {
-            if (UTILS_UNLIKELY(mHasState)) {
-                restore();
-            }
-        }
-    };
-
 private:
     OpenGLDriver& mOpenGLDriver;
     GLuint mSampler;
@@ -16,9 +16,12 @@
 
 #include "driver/opengl/OpenGLDriver.h"
 
+#include <algorithm>
+#include <limits>
 #include <set>
 
 #include <utils/compiler.h>
+#include <utils/Hash.h>
 #include <utils/Log.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
@@ -27,6 +30,7 @@
 #include "driver/CommandStream.h"
 #include "driver/opengl/OpenGLProgram.h"
 #include "driver/opengl/OpenGLBlitter.h"
+#include "driver/opengl/OpenGLUploader.h"
 
 #include <filament/driver/ExternalContext.h>
 
@@ -126,6 +130,12 @@ OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
     glGetIntegerv(GL_MAJOR_VERSION, &major);
     glGetIntegerv(GL_MINOR_VERSION, &minor);
     glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &mMaxRenderBufferSize);
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &mNumProgramBinaryFormats);
+
+    // program binaries are only valid for the implementation (and version) that produced them
+    mDriverIdentity = hash::fnv1a(vendor, strlen(vendor));
+    mDriverIdentity = hash::fnv1a(renderer, strlen(renderer), mDriverIdentity);
+    mDriverIdentity = hash::fnv1a(version, strlen(version), mDriverIdentity);
 
     if (strstr(renderer, "Adreno")) {
         bugs.clears_hurt_performance = true;
@@ -211,6 +221,10 @@ OpenGLDriver::OpenGLDriver(ContextManagerGL* externalContext) noexcept
         mOpenGLBlitter = new OpenGLBlitter(*this);
         mOpenGLBlitter->init();
     }
+
+    if (mContextManager.hasUploadContext()) {
+        mUploader = new OpenGLUploader(mContextManager);
+    }
 }
 
 OpenGLDriver::~OpenGLDriver() noexcept {
@@ -233,6 +247,16 @@ void OpenGLDriver::initExtensionsGLES(GLint major, GLint minor, std::set<StaticS
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = hasExtension(exts, "GL_EXT_color_buffer_half_float");
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = hasExtension(exts, "GL_EXT_disjoint_timer_query");
+#ifdef GL_EXT_multisampled_render_to_texture
+    ext.EXT_multisampled_render_to_texture =
+            hasExtension(exts, "GL_EXT_multisampled_render_to_texture") ||
+            hasExtension(exts, "GL_EXT_multisampled_render_to_texture2");
+#endif
+#ifdef GL_OVR_multiview
+    ext.OVR_multiview2 = hasExtension(exts, "GL_OVR_multiview2");
+#endif
 }
 
 void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, std::set<StaticString> const& exts) {
@@ -242,6 +266,12 @@ void OpenGLDriver::initExtensionsGL(GLint major, GLint minor, std::set<StaticStr
     ext.OES_EGL_image_external_essl3 = hasExtension(exts, "GL_OES_EGL_image_external_essl3");
     ext.EXT_debug_marker = hasExtension(exts, "GL_EXT_debug_marker");
     ext.EXT_color_buffer_half_float = true;  // Assumes core profile.
+    ext.KHR_parallel_shader_compile = hasExtension(exts, "GL_KHR_parallel_shader_compile") ||
+            hasExtension(exts, "GL_ARB_parallel_shader_compile");
+    ext.EXT_disjoint_timer_query = true;  // GL_TIME_ELAPSED queries are core since GL 3.3
+#ifdef GL_OVR_multiview
+    ext.OVR_multiview2 = hasExtension(exts, "GL_OVR_multiview2");
+#endif
 }
 
 void OpenGLDriver::terminate() {
@@ -250,6 +280,28 @@ void OpenGLDriver::terminate() {
         glDeleteSamplers(1, &item.second);
     }
     mSamplerMap.clear();
+    if (mUploader) {
+        retireBackgroundUploads(true);
+        delete mUploader;
+        mUploader = nullptr;
+    }
+    // the client is owed the readbacks it has already requested
+    updatePendingReadPixels(true);
+    for (auto const& item : mFreePixelPackBuffers) {
+        glDeleteBuffers(1, &item.first);
+    }
+    mFreePixelPackBuffers.clear();
+    for (auto& u : mPendingUploads) {
+        scheduleDestroy(std::move(u.p));
+    }
+    mPendingUploads.clear();
+    for (auto const& range : mStagingRanges) {
+        glDeleteSync(range.sync);
+    }
+    mStagingRanges.clear();
+    if (mStagingBuffer) {
+        glDeleteBuffers(1, &mStagingBuffer);
+    }
     if (mOpenGLBlitter) {
         mOpenGLBlitter->terminate();
     }
@@ -390,10 +442,10 @@ void OpenGLDriver::bindBuffer(GLenum target, GLuint buffer) noexcept {
         // the index buffer, unless there are no VAO bound (see: bindVertexArray)
         assert(state.vao.p);
         if (state.buffers.targets[targetIndex].genericBinding != buffer
-                || ((state.vao.p != &mDefaultVAO) && (state.vao.p->gl.elementArray != buffer))) {
+                || ((state.vao.p != &mDefaultVAO) && (state.vao.p->elementArray != buffer))) {
             state.buffers.targets[targetIndex].genericBinding = buffer;
             if (state.vao.p != &mDefaultVAO) {
-                state.vao.p->gl.elementArray = buffer;
+                state.vao.p->elementArray = buffer;
             }
             glBindBuffer(target, buffer);
         }
@@ -406,15 +458,37 @@ void OpenGLDriver::bindBuffer(GLenum target, GLuint buffer) noexcept {
 
 void OpenGLDriver::bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept {
     size_t targetIndex = getIndexForBufferTarget(target);
+    auto& targetState = state.buffers.targets[targetIndex];
     // this ALSO sets the generic binding
-    if (state.buffers.targets[targetIndex].buffers[index] != buffer
-            || state.buffers.targets[targetIndex].genericBinding != buffer) {
-        state.buffers.targets[targetIndex].buffers[index] = buffer;
-        state.buffers.targets[targetIndex].genericBinding = buffer;
+    if (targetState.buffers[index] != buffer
+            || targetState.offsets[index] != 0
+            || targetState.sizes[index] != 0
+            || targetState.genericBinding != buffer) {
+        targetState.buffers[index] = buffer;
+        targetState.offsets[index] = 0;
+        targetState.sizes[index] = 0;
+        targetState.genericBinding = buffer;
         glBindBufferBase(target, index, buffer);
     }
 }
 
+void OpenGLDriver::bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+        GLintptr offset, GLsizeiptr size) noexcept {
+    size_t targetIndex = getIndexForBufferTarget(target);
+    auto& targetState = state.buffers.targets[targetIndex];
+    // this ALSO sets the generic binding
+    if (targetState.buffers[index] != buffer
+            || targetState.offsets[index] != offset
+            || targetState.sizes[index] != size
+            || targetState.genericBinding != buffer) {
+        targetState.buffers[index] = buffer;
+        targetState.offsets[index] = offset;
+        targetState.sizes[index] = size;
+        targetState.genericBinding = buffer;
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+}
+
 void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
     switch (target) {
         case GL_FRAMEBUFFER:
@@ -440,17 +514,17 @@ void OpenGLDriver::bindFramebuffer(GLenum target, GLuint buffer) noexcept {
     }
 }
 
-void OpenGLDriver::bindVertexArray(GLRenderPrimitive const* p) noexcept {
-    GLRenderPrimitive* vao = p ? const_cast<GLRenderPrimitive *>(p) : &mDefaultVAO;
+void OpenGLDriver::bindVertexArray(GLVertexArray const* p) noexcept {
+    GLVertexArray* vao = p ? const_cast<GLVertexArray *>(p) : &mDefaultVAO;
     update_state(state.vao.p, vao, [&]() {
-        glBindVertexArray(vao->gl.vao);
+        glBindVertexArray(vao->vao);
         // update GL_ELEMENT_ARRAY_BUFFER, which is updated by glBindVertexArray
         size_t targetIndex = getIndexForBufferTarget(GL_ELEMENT_ARRAY_BUFFER);
-        state.buffers.targets[targetIndex].genericBinding = vao->gl.elementArray;
+        state.buffers.targets[targetIndex].genericBinding = vao->elementArray;
         if (UTILS_UNLIKELY(bugs.vao_doesnt_store_element_array_buffer_binding)) {
             // This shouldn't be needed, but it looks like some drivers don't do the implicit
             // glBindBuffer().
-            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao->gl.elementArray);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vao->elementArray);
         }
     });
 }
@@ -478,18 +552,18 @@ void OpenGLDriver::useProgram(OpenGLProgram* p) noexcept {
 
 void OpenGLDriver::enableVertexAttribArray(GLuint index) noexcept {
     assert(state.vao.p);
-    assert(index < state.vao.p->gl.vertexAttribArray.size());
-    if (UTILS_UNLIKELY(!state.vao.p->gl.vertexAttribArray[index])) {
-        state.vao.p->gl.vertexAttribArray.set(index);
+    assert(index < state.vao.p->vertexAttribArray.size());
+    if (UTILS_UNLIKELY(!state.vao.p->vertexAttribArray[index])) {
+        state.vao.p->vertexAttribArray.set(index);
         glEnableVertexAttribArray(index);
     }
 }
 
 void OpenGLDriver::disableVertexAttribArray(GLuint index) noexcept {
     assert(state.vao.p);
-    assert(index < state.vao.p->gl.vertexAttribArray.size());
-    if (UTILS_UNLIKELY(state.vao.p->gl.vertexAttribArray[index])) {
-        state.vao.p->gl.vertexAttribArray.unset(index);
+    assert(index < state.vao.p->vertexAttribArray.size());
+    if (UTILS_UNLIKELY(state.vao.p->vertexAttribArray[index])) {
+        state.vao.p->vertexAttribArray.unset(index);
         glDisableVertexAttribArray(index);
     }
 }
@@ -661,6 +735,7 @@ default_case:
 
 // For reference on a 64-bits machine:
 //    GLFence                   :  8
+//    GLTimerQuery              : 16        few
 //    GLIndexBuffer             : 12        moderate
 //    GLSamplerBuffer           : 16        moderate
 // -- less than 16 bytes
@@ -687,6 +762,7 @@ OpenGLDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
 
 #ifndef NDEBUG
     slog.d << "HwFence: " << sizeof(HwFence) << io::endl;
+    slog.d << "GLTimerQuery: " << sizeof(GLTimerQuery) << io::endl;
     slog.d << "GLIndexBuffer: " << sizeof(GLIndexBuffer) << io::endl;
     slog.d << "GLSamplerBuffer: " << sizeof(GLSamplerBuffer) << io::endl;
     slog.d << "GLRenderPrimitive: " << sizeof(GLRenderPrimitive) << io::endl;
@@ -798,16 +874,25 @@ Handle<HwSwapChain> OpenGLDriver::createSwapChainSynchronous() noexcept {
     return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
 }
 
+Handle<HwSwapChain> OpenGLDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return Handle<HwSwapChain>( allocateHandle(sizeof(HwSwapChain)) );
+}
+
 Handle<HwStream> OpenGLDriver::createStreamFromTextureIdSynchronous() noexcept {
     return Handle<HwStream>( allocateHandle(sizeof(GLStream)) );
 }
 
+Handle<HwTimerQuery> OpenGLDriver::createTimerQuerySynchronous() noexcept {
+    return Handle<HwTimerQuery>( allocateHandle(sizeof(GLTimerQuery)) );
+}
+
 void OpenGLDriver::createVertexBuffer(
     Driver::VertexBufferHandle vbh,
     uint8_t bufferCount,
     uint8_t attributeCount,
     uint32_t elementCount,
-    Driver::AttributeArray attributes) {
+    Driver::AttributeArray attributes,
+    Driver::Usage usage) {
     DEBUG_MARKER()
 
     GLVertexBuffer* vb = construct<GLVertexBuffer>(vbh,
@@ -815,6 +900,9 @@ void OpenGLDriver::createVertexBuffer(
 
     GLsizei n = GLsizei(vb->bufferCount);
     glGenBuffers(n, vb->gl.buffers.data());
+    if (usage == Driver::Usage::DYNAMIC) {
+        vb->gl.dynamic.reset(new GLDynamicBuffer[n]);
+    }
 
     for (GLsizei i = 0; i < n; i++) {
         // figure out the size needed for each buffer
@@ -826,14 +914,19 @@ void OpenGLDriver::createVertexBuffer(
             }
         }
         bindBuffer(GL_ARRAY_BUFFER, vb->gl.buffers[i]);
-        glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        if (vb->gl.dynamic) {
+            vb->gl.dynamic[i].size = uint32_t(size);
+            glBufferData(GL_ARRAY_BUFFER, size * DYNAMIC_REGION_COUNT, nullptr, GL_DYNAMIC_DRAW);
+        } else {
+            glBufferData(GL_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+        }
     }
 
     CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
-        uint32_t indexCount) {
+        uint32_t indexCount, Driver::Usage usage) {
     DEBUG_MARKER()
 
     uint8_t elementSize = static_cast<uint8_t>(getElementTypeSize(elementType));
@@ -842,22 +935,27 @@ void OpenGLDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::Elem
     GLsizeiptr size = elementSize * indexCount;
     bindVertexArray(nullptr);
     bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    if (usage == Driver::Usage::DYNAMIC) {
+        ib->gl.dynamic.reset(new GLDynamicBuffer);
+        ib->gl.dynamic->size = uint32_t(size);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size * DYNAMIC_REGION_COUNT, nullptr, GL_DYNAMIC_DRAW);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, nullptr, GL_STATIC_DRAW);
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
 void OpenGLDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int) {
     DEBUG_MARKER()
 
-    GLRenderPrimitive* rp = construct<GLRenderPrimitive>(rph);
-    glGenVertexArrays(1, &rp->gl.vao);
-    CHECK_GL_ERROR(utils::slog.e)
+    // the VAO is only known once the buffers are, see setRenderPrimitiveBuffer()
+    construct<GLRenderPrimitive>(rph);
 }
 
 void OpenGLDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
     DEBUG_MARKER()
 
-    construct<OpenGLProgram>(ph, this, program);
+    construct<OpenGLProgram>(ph, this, std::move(program));
     CHECK_GL_ERROR(utils::slog.e)
 }
 
@@ -891,7 +989,8 @@ void OpenGLDriver::textureStorage(OpenGLDriver::GLTexture* t,
             glTexStorage2D(t->gl.target, GLsizei(t->levels), t->gl.internalFormat,
                     GLsizei(width), GLsizei(height));
             break;
-        case GL_TEXTURE_3D: {
+        case GL_TEXTURE_3D:
+        case GL_TEXTURE_2D_ARRAY: {
             glTexStorage3D(t->gl.target, GLsizei(t->levels), t->gl.internalFormat,
                     GLsizei(width), GLsizei(height), GLsizei(depth));
             break;
@@ -956,6 +1055,10 @@ void OpenGLDriver::createTexture(Driver::TextureHandle th, SamplerType target, u
                 t->gl.targetIndex = (uint8_t)
                         getIndexForTextureTarget(t->gl.target = GL_TEXTURE_CUBE_MAP);
                 break;
+            case SamplerType::SAMPLER_2D_ARRAY:
+                t->gl.targetIndex = (uint8_t)
+                        getIndexForTextureTarget(t->gl.target = GL_TEXTURE_2D_ARRAY);
+                break;
         }
 
         if (t->samples > 1) {
@@ -980,6 +1083,14 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
     // NOTE: on GL3.2 / GLES3.1 and above multisample is handled when creating the texture
     switch (t->target) {
         case SamplerType::SAMPLER_2D:
+#ifdef GL_EXT_multisampled_render_to_texture
+            if (rt->gl.autoResolve) {
+                // the samples only live in tile memory
+                glFramebufferTexture2DMultisampleEXT(GL_FRAMEBUFFER, attachment,
+                        t->gl.target, t->gl.texture_id, binfo.level, rt->gl.samples);
+                break;
+            }
+#endif
             glFramebufferTexture2D(GL_FRAMEBUFFER, attachment,
                     t->gl.target, t->gl.texture_id, binfo.level);
             break;
@@ -989,6 +1100,19 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
                     target, t->gl.texture_id, binfo.level);
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+#ifdef GL_OVR_multiview
+            if (binfo.viewCount > 1) {
+                // the views are rendered at once, in consecutive layers
+                assert(ext.OVR_multiview2);
+                glFramebufferTextureMultiviewOVR(GL_FRAMEBUFFER, attachment,
+                        t->gl.texture_id, binfo.level, binfo.layer, binfo.viewCount);
+                break;
+            }
+#endif
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, attachment,
+                    t->gl.texture_id, binfo.level, binfo.layer);
+            break;
         case SamplerType::SAMPLER_EXTERNAL:
             // cannot happen by construction
             break;
@@ -998,8 +1122,16 @@ void OpenGLDriver::framebufferTexture(Driver::TargetBufferInfo& binfo,
 }
 
 void OpenGLDriver::renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-        uint32_t height, uint8_t samples) const noexcept {
+        uint32_t height, uint8_t samples, bool autoResolve) const noexcept {
     glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+#ifdef GL_EXT_multisampled_render_to_texture
+    if (autoResolve) {
+        // the attachments of an implicitly resolved render target must all use the extension
+        glRenderbufferStorageMultisampleEXT(GL_RENDERBUFFER, samples, internalformat,
+                width, height);
+        return;
+    }
+#endif
     if (samples > 1) {
         glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, internalformat, width, height);
     } else {
@@ -1008,17 +1140,19 @@ void OpenGLDriver::renderBufferStorage(GLuint rbo, GLenum internalformat, uint32
 }
 
 void OpenGLDriver::framebufferRenderbuffer(GLRenderTarget::GL::RenderBuffer* rb, GLenum attachment,
-        GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo) noexcept {
-    rb->id = framebufferRenderbuffer(width, height, samples, attachment, internalformat, fbo);
+        GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo,
+        bool autoResolve) noexcept {
+    rb->id = framebufferRenderbuffer(width, height, samples, attachment, internalformat, fbo,
+            autoResolve);
     rb->internalFormat = internalformat;
 }
 
 GLuint OpenGLDriver::framebufferRenderbuffer(uint32_t width, uint32_t height, uint8_t samples,
-        GLenum attachment, GLenum internalformat, GLuint fbo) noexcept {
+        GLenum attachment, GLenum internalformat, GLuint fbo, bool autoResolve) noexcept {
 
     GLuint rbo;
     glGenRenderbuffers(1, &rbo);
-    renderBufferStorage(rbo, internalformat, width, height, samples);
+    renderBufferStorage(rbo, internalformat, width, height, samples, autoResolve);
 
     bindFramebuffer(GL_FRAMEBUFFER, fbo);
     glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment, GL_RENDERBUFFER, rbo);
@@ -1055,6 +1189,14 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
     rt->height = height;
     rt->gl.samples = samples;
 
+    // A multisampled target rendering into a single-sampled texture resolves into it implicitly
+    if (samples > 1 && (targets & TargetBufferFlags::COLOR) && color.handle) {
+        GLTexture const* t = handle_cast<const GLTexture*>(color.handle);
+        rt->gl.autoResolve = ext.EXT_multisampled_render_to_texture &&
+                t->target == SamplerType::SAMPLER_2D && t->samples <= 1;
+    }
+    const bool autoResolve = rt->gl.autoResolve;
+
     if (targets & TargetBufferFlags::COLOR) {
         // TODO: handle multiple color attachments
         if (color.handle) {
@@ -1063,7 +1205,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         } else {
             GLenum internalFormat = getInternalFormat(format);
             framebufferRenderbuffer(&rt->gl.color, GL_COLOR_ATTACHMENT0, internalFormat,
-                    width, height, samples, rt->gl.fbo);
+                    width, height, samples, rt->gl.fbo, autoResolve);
         }
     }
 
@@ -1074,7 +1216,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
             // special case: depth & stencil requested, but both not provided
             specialCased = true;
             framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_STENCIL_ATTACHMENT, GL_DEPTH24_STENCIL8,
-                    width, height, samples, rt->gl.fbo);
+                    width, height, samples, rt->gl.fbo, autoResolve);
 
         } else if (depth.handle == stencil.handle) {
             // special case: depth & stencil requested, and both provided as the same texture
@@ -1091,7 +1233,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
                 framebufferTexture(depth, rt, GL_DEPTH_ATTACHMENT);
             } else {
                 framebufferRenderbuffer(&rt->gl.depth, GL_DEPTH_ATTACHMENT, GL_DEPTH_COMPONENT24,
-                        width, height, samples, rt->gl.fbo);
+                        width, height, samples, rt->gl.fbo, autoResolve);
             }
         }
         if (targets & TargetBufferFlags::STENCIL) {
@@ -1100,7 +1242,7 @@ void OpenGLDriver::createRenderTarget(Driver::RenderTargetHandle rth,
                 framebufferTexture(stencil, rt, GL_STENCIL_ATTACHMENT);
             } else {
                 framebufferRenderbuffer(&rt->gl.stencil, GL_STENCIL_ATTACHMENT, GL_STENCIL_INDEX8,
-                        width, height, samples, rt->gl.fbo);
+                        width, height, samples, rt->gl.fbo, autoResolve);
             }
         }
     }
@@ -1127,6 +1269,25 @@ void OpenGLDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     sc->swapChain = mContextManager.createSwapChain(nativeWindow, flags);
 }
 
+void OpenGLDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    DEBUG_MARKER()
+
+    HwSwapChain* sc = construct<HwSwapChain>(sch);
+    sc->swapChain = mContextManager.createSwapChainHeadless(width, height, flags);
+    if (UTILS_UNLIKELY(!sc->swapChain)) {
+        slog.e << "Headless swap chains are not supported by this platform" << io::endl;
+    }
+}
+
+void OpenGLDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = construct<GLTimerQuery>(tqh);
+    glGenQueries(1, &tq->gl.query);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::createStreamFromTextureId(Driver::StreamHandle sh,
         intptr_t externalTextureId, uint32_t width, uint32_t height) {
     DEBUG_MARKER()
@@ -1153,8 +1314,14 @@ void OpenGLDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
 
     if (vbh) {
         GLVertexBuffer const* eb = handle_cast<const GLVertexBuffer*>(vbh);
+        evictVertexArrays([eb](VertexArrayKey const& key) { return key.vb == eb; });
         GLsizei n = GLsizei(eb->bufferCount);
         glDeleteBuffers(n, eb->gl.buffers.data());
+        if (eb->gl.dynamic) {
+            for (GLsizei i = 0; i < n; i++) {
+                destroyDynamicBuffer(eb->gl.dynamic[i]);
+            }
+        }
         // bindings of bound buffers are reset to 0
         const size_t targetIndex = getIndexForBufferTarget(GL_ARRAY_BUFFER);
         auto& target = state.buffers.targets[targetIndex];
@@ -1172,7 +1339,11 @@ void OpenGLDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
 
     if (ibh) {
         GLIndexBuffer const* ib = handle_cast<const GLIndexBuffer*>(ibh);
+        evictVertexArrays([ib](VertexArrayKey const& key) { return key.ib == ib; });
         glDeleteBuffers(1, &ib->gl.buffer);
+        if (ib->gl.dynamic) {
+            destroyDynamicBuffer(*ib->gl.dynamic);
+        }
         // bindings of bound buffers are reset to 0
         const size_t targetIndex = getIndexForBufferTarget(GL_ELEMENT_ARRAY_BUFFER);
         auto& target = state.buffers.targets[targetIndex];
@@ -1188,11 +1359,7 @@ void OpenGLDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
 
     if (rph) {
         GLRenderPrimitive const* rp = handle_cast<const GLRenderPrimitive*>(rph);
-        glDeleteVertexArrays(1, &rp->gl.vao);
-        // binding of a bound VAO is reset to 0
-        if (state.vao.p == rp) {
-            state.vao.p = &mDefaultVAO;
-        }
+        releaseVertexArray(rp->gl.va);
         destruct(rph, rp);
     }
 }
@@ -1241,6 +1408,7 @@ void OpenGLDriver::destroyTexture(Driver::TextureHandle th) {
 
     if (th) {
         GLTexture* t = handle_cast<GLTexture*>(th);
+        dropPendingUploads(t);
         unbindTexture(t->gl.target, t->gl.texture_id);
         if (UTILS_UNLIKELY(t->hwStream)) {
             detachStream(t);
@@ -1333,25 +1501,12 @@ Handle<HwStream> OpenGLDriver::createStream(void* nativeStream) {
     return sh;
 }
 
-void OpenGLDriver::updateStreams(driver::DriverApi* driver) {
-    if (UTILS_UNLIKELY(!mExternalStreams.empty())) {
-        OpenGLBlitter::State state;
-        for (GLTexture* t : mExternalStreams) {
-            assert(t && t->hwStream);
-            if (!static_cast<GLStream*>(t->hwStream)->isNativeStream()) {
-                state.setup();
-                updateStream(t, driver);
-            }
-        }
-    }
-}
-
-void OpenGLDriver::setStreamDimensions(Driver::StreamHandle sh, uint32_t width, uint32_t height) {
+int64_t OpenGLDriver::getStreamTimestamp(Driver::StreamHandle sh) {
     if (sh) {
         GLStream* s = handle_cast<GLStream*>(sh);
-        s->width = width;
-        s->height = height;
+        return s->timestamp.load(std::memory_order_relaxed);
     }
+    return 0;
 }
 
 void OpenGLDriver::destroyFence(Driver::FenceHandle fh) {
@@ -1362,6 +1517,21 @@ void OpenGLDriver::destroyFence(Driver::FenceHandle fh) {
     }
 }
 
+void OpenGLDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        auto& queries = mTimerQueries;
+        auto pos = std::find(queries.begin(), queries.end(), tq);
+        if (pos != queries.end()) {
+            queries.erase(pos);
+        }
+        glDeleteQueries(1, &tq->gl.query);
+        destruct(tqh, tq);
+    }
+}
+
 Driver::FenceStatus OpenGLDriver::wait(Driver::FenceHandle fh, uint64_t timeout) {
     if (fh) {
         HwFence* f = handle_cast<HwFence*>(fh);
@@ -1439,11 +1609,40 @@ bool OpenGLDriver::isRenderTargetFormatSupported(Driver::TextureFormat format) {
     }
 }
 
+bool OpenGLDriver::isAutoResolveSupported() {
+    return ext.EXT_multisampled_render_to_texture;
+}
+
+bool OpenGLDriver::isMultiviewSupported() {
+    return ext.OVR_multiview2;
+}
+
+bool OpenGLDriver::isSubpassSupported() {
+    // TODO: EXT_shader_pixel_local_storage or EXT_shader_framebuffer_fetch
+    return false;
+}
+
 bool OpenGLDriver::isFrameTimeSupported() {
     // TODO: Measuring the frame time is currently only done using fences
     return mContextManager.canCreateFence();
 }
 
+bool OpenGLDriver::isTimerQuerySupported() {
+    return ext.EXT_disjoint_timer_query;
+}
+
+bool OpenGLDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    if (tqh) {
+        GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+        int64_t elapsed = tq->elapsed.load(std::memory_order_relaxed);
+        if (elapsed >= 0) {
+            *elapsedTime = uint64_t(elapsed);
+            return true;
+        }
+    }
+    return false;
+}
+
 // ------------------------------------------------------------------------------------------------
 // Swap chains
 // ------------------------------------------------------------------------------------------------
@@ -1458,6 +1657,12 @@ void OpenGLDriver::commit(Driver::SwapChainHandle sch) {
     }
 }
 
+void OpenGLDriver::setPresentationTime(int64_t monotonic_clock_ns) {
+    DEBUG_MARKER()
+
+    mContextManager.setPresentationTime(monotonic_clock_ns);
+}
+
 void OpenGLDriver::makeCurrent(Driver::SwapChainHandle sch) {
     DEBUG_MARKER()
 
@@ -1482,8 +1687,45 @@ void OpenGLDriver::loadVertexBuffer(
 
     GLVertexBuffer* eb = handle_cast<GLVertexBuffer *>(vbh);
 
-    bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index]);
-    glBufferSubData(GL_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    if (eb->gl.dynamic) {
+        BufferRange range{ byteOffset, byteSize };
+        if (loadDynamicBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index], eb->gl.dynamic[index],
+                p.buffer, &range, 1)) {
+            eb->gl.version++;
+        }
+    } else {
+        bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index]);
+        glBufferSubData(GL_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    }
+
+    scheduleDestroy(std::move(p));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::loadVertexBufferRanges(
+        Driver::VertexBufferHandle vbh,
+        size_t index,
+        BufferDescriptor&& p,
+        BufferRange const* ranges,
+        uint32_t count) {
+    DEBUG_MARKER()
+
+    GLVertexBuffer* eb = handle_cast<GLVertexBuffer *>(vbh);
+
+    if (eb->gl.dynamic) {
+        if (loadDynamicBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index], eb->gl.dynamic[index],
+                p.buffer, ranges, count)) {
+            eb->gl.version++;
+        }
+    } else {
+        bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[index]);
+        uint8_t const* data = static_cast<uint8_t const*>(p.buffer);
+        for (uint32_t i = 0; i < count; i++) {
+            glBufferSubData(GL_ARRAY_BUFFER, ranges[i].byteOffset, ranges[i].byteSize, data);
+            data += ranges[i].byteSize;
+        }
+    }
 
     scheduleDestroy(std::move(p));
 
@@ -1500,8 +1742,14 @@ void OpenGLDriver::loadIndexBuffer(
     assert(ib->elementSize == 2 || ib->elementSize == 4);
 
     bindVertexArray(nullptr);
-    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
-    glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    if (ib->gl.dynamic) {
+        BufferRange range{ byteOffset, byteSize };
+        loadDynamicBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer, *ib->gl.dynamic,
+                p.buffer, &range, 1);
+    } else {
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, byteOffset, byteSize, p.buffer);
+    }
 
     scheduleDestroy(std::move(p));
 
@@ -1525,16 +1773,17 @@ void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     const TargetBufferFlags clearFlags = (TargetBufferFlags) params.clear;
     const TargetBufferFlags discardFlags = (TargetBufferFlags) params.discardStart;
 
+    // this can't be done only when the framebuffer changes, because blit() binds it too
+    if (clearFlags & RenderPassParams::SHADOW_PASS) {
+        enable(GL_POLYGON_OFFSET_FILL);
+    } else {
+        disable(GL_POLYGON_OFFSET_FILL);
+    }
+
     GLRenderTarget* rt = handle_cast<GLRenderTarget*>(rth);
     if (UTILS_UNLIKELY(state.draw_fbo != rt->gl.fbo)) {
         bindFramebuffer(GL_FRAMEBUFFER, rt->gl.fbo);
 
-        if ((clearFlags & TargetBufferFlags::SHADOW) == TargetBufferFlags::SHADOW) {
-            enable(GL_POLYGON_OFFSET_FILL);
-        } else {
-            disable(GL_POLYGON_OFFSET_FILL);
-        }
-
         // glInvalidateFramebuffer appeared on GLES 3.0 and GL4.3, for simplicity we just
         // ignore it on GL (rather than having to do a runtime check).
         if (GLES31_HEADERS) {
@@ -1613,6 +1862,10 @@ void OpenGLDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     }
 }
 
+void OpenGLDriver::nextSubpass(int) {
+    // render passes never have subpasses, see isSubpassSupported()
+}
+
 void OpenGLDriver::endRenderPass(int) {
     DEBUG_MARKER()
     assert(mRenderPassTarget);
@@ -1723,7 +1976,8 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 
     if (rt->gl.color.id) {
         // if we have a depth renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.color.id, rt->gl.color.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.color.id, rt->gl.color.internalFormat, width, height,
+                rt->gl.samples, rt->gl.autoResolve);
     } else if (rt->gl.color.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.color.texture, width, height, rt->gl.color.texture->depth);
@@ -1731,7 +1985,8 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 
     if (rt->gl.depth.id) {
         // if we have a depth renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.depth.id, rt->gl.depth.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.depth.id, rt->gl.depth.internalFormat, width, height,
+                rt->gl.samples, rt->gl.autoResolve);
     } else if (rt->gl.depth.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.depth.texture, width, height, rt->gl.depth.texture->depth);
@@ -1739,7 +1994,8 @@ void OpenGLDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 
     if (rt->gl.stencil.id) {
         // if we have a stencil renderbuffer, reallocate it
-        renderBufferStorage(rt->gl.stencil.id, rt->gl.stencil.internalFormat, width, height, rt->gl.samples);
+        renderBufferStorage(rt->gl.stencil.id, rt->gl.stencil.internalFormat, width, height,
+                rt->gl.samples, rt->gl.autoResolve);
     } else if (rt->gl.stencil.texture) {
         // if it was a texture, reallocate the texture and discard content
         textureStorage(rt->gl.stencil.texture, width, height, rt->gl.stencil.texture->depth);
@@ -1758,38 +2014,104 @@ void OpenGLDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
 
     if (rph) {
         GLRenderPrimitive* const rp = handle_cast<GLRenderPrimitive*>(rph);
-        GLVertexBuffer const* const eb = handle_cast<const GLVertexBuffer*>(vbh);
-        GLIndexBuffer const* const ib = handle_cast<const GLIndexBuffer*>(ibh);
+        GLVertexBuffer* const eb = handle_cast<GLVertexBuffer*>(vbh);
+        GLIndexBuffer* const ib = handle_cast<GLIndexBuffer*>(ibh);
 
         assert(ib->elementSize == 2 || ib->elementSize == 4);
 
-        bindVertexArray(rp);
-        CHECK_GL_ERROR(utils::slog.e)
-
         rp->gl.indicesType = ib->elementSize == 4 ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
         rp->maxVertexCount = eb->vertexCount;
-        for (size_t i = 0, n = eb->attributes.size(); i < n; i++) {
-            if (enabledAttributes & (1U << i)) {
-                uint8_t bi = eb->attributes[i].buffer;
-                assert(bi != 0xFF);
-                bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[bi]);
-                glVertexAttribPointer(GLuint(i),
-                        getComponentCount(eb->attributes[i].type),
-                        getComponentType(eb->attributes[i].type),
-                        getNormalization(eb->attributes[i].normalized),
-                        eb->attributes[i].stride,
-                        (void*)uintptr_t(eb->attributes[i].offset));
-
-                enableVertexAttribArray(GLuint(i));
-            } else {
-                disableVertexAttribArray(GLuint(i));
+        rp->gl.vb = eb->gl.dynamic ? eb : nullptr;
+        rp->gl.ib = ib->gl.dynamic ? ib : nullptr;
+
+        GLVertexArray* const previous = rp->gl.va;
+        rp->gl.va = acquireVertexArray(eb, ib, enabledAttributes);
+        releaseVertexArray(previous);
+
+        CHECK_GL_ERROR(utils::slog.e)
+    }
+}
+
+OpenGLDriver::GLVertexArray* OpenGLDriver::acquireVertexArray(GLVertexBuffer const* eb,
+        GLIndexBuffer const* ib, uint32_t enabledAttributes) noexcept {
+    const VertexArrayKey key{ eb, ib, enabledAttributes };
+    auto pos = mVertexArrays.find(key);
+    if (pos != mVertexArrays.end()) {
+        pos.value()->refs++;
+        return pos.value();
+    }
+
+    GLVertexArray* const va = new GLVertexArray;
+    glGenVertexArrays(1, &va->vao);
+    va->enabledAttributes = enabledAttributes;
+    va->refs = 1;
+    va->cached = true;
+    setVertexAttributes(va, eb);
+
+    // this records the index buffer into the currently bound VAO
+    bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
+
+    mVertexArrays[key] = va;
+    return va;
+}
+
+void OpenGLDriver::releaseVertexArray(GLVertexArray* va) noexcept {
+    if (va && --va->refs == 0) {
+        if (va->cached) {
+            for (auto it = mVertexArrays.begin(); it != mVertexArrays.end(); ++it) {
+                if (it->second == va) {
+                    mVertexArrays.erase(it);
+                    break;
+                }
             }
         }
-        // this records the index buffer into the currently bound VAO
-        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, ib->gl.buffer);
+        glDeleteVertexArrays(1, &va->vao);
+        // binding of a bound VAO is reset to 0
+        if (state.vao.p == va) {
+            state.vao.p = &mDefaultVAO;
+        }
+        delete va;
+    }
+}
 
-        CHECK_GL_ERROR(utils::slog.e)
+template<typename P>
+void OpenGLDriver::evictVertexArrays(P predicate) noexcept {
+    // the VAOs stay alive until the primitives using them are destroyed, but can't be shared
+    for (auto it = mVertexArrays.begin(); it != mVertexArrays.end();) {
+        if (predicate(it->first)) {
+            it->second->cached = false;
+            it = mVertexArrays.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void OpenGLDriver::setVertexAttributes(GLVertexArray* va, GLVertexBuffer const* eb) noexcept {
+    bindVertexArray(va);
+    CHECK_GL_ERROR(utils::slog.e)
+
+    const uint32_t enabledAttributes = va->enabledAttributes;
+    for (size_t i = 0, n = eb->attributes.size(); i < n; i++) {
+        if (enabledAttributes & (1U << i)) {
+            uint8_t bi = eb->attributes[i].buffer;
+            assert(bi != 0xFF);
+            // the attributes of a dynamic buffer point into its current region
+            const uint32_t base = eb->gl.dynamic ? eb->gl.dynamic[bi].getOffset() : 0;
+            bindBuffer(GL_ARRAY_BUFFER, eb->gl.buffers[bi]);
+            glVertexAttribPointer(GLuint(i),
+                    getComponentCount(eb->attributes[i].type),
+                    getComponentType(eb->attributes[i].type),
+                    getNormalization(eb->attributes[i].normalized),
+                    eb->attributes[i].stride,
+                    (void*)uintptr_t(base + eb->attributes[i].offset));
+
+            enableVertexAttribArray(GLuint(i));
+        } else {
+            disableVertexAttribArray(GLuint(i));
+        }
     }
+    va->vbVersion = eb->gl.version;
 }
 
 void OpenGLDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
@@ -1844,35 +2166,92 @@ void OpenGLDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
     assert(ub);
 
     if (UTILS_UNLIKELY(uniformBuffer.isDirty())) {
-        // TODO: upload only the dirty parts
+        // only the dirty range is uploaded, the rest of the buffer already has its content
         assert(ub->gl.ubo);
+        const size_t offset = uniformBuffer.getDirtyOffset();
+        const size_t size = uniformBuffer.getDirtySize();
         bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
-        glBufferSubData(GL_UNIFORM_BUFFER, 0, uniformBuffer.getSize(), uniformBuffer.getBuffer());
+        glBufferSubData(GL_UNIFORM_BUFFER, GLintptr(offset), GLsizeiptr(size),
+                static_cast<char const*>(uniformBuffer.getBuffer()) + offset);
         CHECK_GL_ERROR(utils::slog.e)
     }
     ub->ub = std::move(uniformBuffer);
 }
 
+void OpenGLDriver::updateUniformBuffers(
+        BufferDescriptor&& p,
+        UniformBufferUpdate const* updates,
+        uint32_t count) {
+    DEBUG_MARKER()
+
+    uint8_t const* data = static_cast<uint8_t const*>(p.buffer);
+    for (uint32_t i = 0; i < count; i++) {
+        UniformBufferHandle ubh = updates[i].ubh;
+        GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+        assert(ub->gl.ubo);
+        bindBuffer(GL_UNIFORM_BUFFER, ub->gl.ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, updates[i].byteOffset, updates[i].byteSize, data);
+        data += updates[i].byteSize;
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+
+    scheduleDestroy(std::move(p));
+}
+
 void OpenGLDriver::load2DImage(Driver::TextureHandle th,
         uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& data) {
     DEBUG_MARKER()
 
     GLTexture* t = handle_cast<GLTexture *>(th);
+    if (mUploader && t->gl.target == GL_TEXTURE_2D && !hasPendingUploads(t) &&
+            (data.size >= BACKGROUND_UPLOAD_SIZE || t->gl.backgroundUploads) &&
+            (level < t->gl.baseLevel || level > t->gl.maxLevel)) {
+        uploadInBackground(t, level, xoffset, yoffset, width, height, std::move(data));
+        return;
+    }
+    if (UTILS_UNLIKELY(t->gl.backgroundUploads)) {
+        // this upload must come after the ones in flight
+        retireBackgroundUploads(true);
+    }
     if (data.type == driver::PixelDataType::COMPRESSED) {
+        flushPendingUploads(t);
         setCompressedTextureData(t,
                 level, xoffset, yoffset, 0, width, height, 1, std::move(data), nullptr);
+    } else if (t->gl.target == GL_TEXTURE_2D &&
+            (data.size > TEXTURE_UPLOAD_BUDGET || hasPendingUploads(t))) {
+        // large uploads, and the ones that must come after them, are spread over frames
+        mPendingUploads.push_back({ t, level, xoffset, yoffset, width, height, 0, std::move(data) });
+        updatePendingUploads();
     } else {
         setTextureData(t,
                 level, xoffset, yoffset, 0, width, height, 1, std::move(data), nullptr);
     }
 }
 
+void OpenGLDriver::load3DImage(Driver::TextureHandle th,
+        uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& data) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    flushPendingUploads(t);
+    if (data.type == driver::PixelDataType::COMPRESSED) {
+        setCompressedTextureData(t,
+                level, xoffset, yoffset, zoffset, width, height, depth, std::move(data), nullptr);
+    } else {
+        setTextureData(t,
+                level, xoffset, yoffset, zoffset, width, height, depth, std::move(data), nullptr);
+    }
+}
+
 void OpenGLDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     DEBUG_MARKER()
 
     GLTexture* t = handle_cast<GLTexture *>(th);
+    flushPendingUploads(t);
     if (data.type == driver::PixelDataType::COMPRESSED) {
         setCompressedTextureData(t, level, 0, 0, 0, 0, 0, 0, std::move(data), &faceOffsets);
     } else {
@@ -1885,6 +2264,7 @@ void OpenGLDriver::generateMipmaps(Driver::TextureHandle th) {
 
     GLTexture* t = handle_cast<GLTexture *>(th);
     assert(t->gl.target != GL_TEXTURE_2D_MULTISAMPLE);
+    flushPendingUploads(t);
     // Note: glGenerateMimap can also fail if the internal format is not both
     // color-renderable and filterable (i.e.: doesn't work for depth)
     bindTexture(MAX_TEXTURE_UNITS - 1, t->gl.target, t, t->gl.targetIndex);
@@ -1900,6 +2280,28 @@ void OpenGLDriver::generateMipmaps(Driver::TextureHandle th) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::reallocateTexture(Driver::TextureHandle th,
+        uint8_t levels, uint32_t width, uint32_t height, uint32_t depth) {
+    DEBUG_MARKER()
+
+    GLTexture* t = handle_cast<GLTexture *>(th);
+    assert(t->target == SamplerType::SAMPLER_2D && t->samples <= 1);
+
+    // glTexStorage textures are immutable, so the texture object is replaced; the handle, and
+    // therefore the sampler buffers referencing it, stay valid. The content is lost.
+    dropPendingUploads(t);
+    unbindTexture(t->gl.target, t->gl.texture_id);
+    glDeleteTextures(1, &t->gl.texture_id);
+    glGenTextures(1, &t->gl.texture_id);
+
+    t->levels = levels;
+    t->gl.baseLevel = 255;
+    t->gl.maxLevel = 0;
+    textureStorage(t, width, height, depth);
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::setTextureData(GLTexture* t,
         uint32_t level,
         uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -1925,6 +2327,8 @@ void OpenGLDriver::setTextureData(GLTexture* t,
     pixelStore(GL_UNPACK_SKIP_PIXELS, p.left);
     pixelStore(GL_UNPACK_SKIP_ROWS, p.top);
 
+    void const* pixels = stagePixels(p.buffer, p.size);
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -1937,7 +2341,7 @@ void OpenGLDriver::setTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, glFormat, glType, p.buffer);
+                    width, height, glFormat, glType, pixels);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(t->gl.target == GL_TEXTURE_CUBE_MAP);
@@ -1949,12 +2353,29 @@ void OpenGLDriver::setTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, glFormat, glType,
-                        static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        static_cast<uint8_t const*>(pixels) + offsets[face]);
             }
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(t->gl.target == GL_TEXTURE_2D_ARRAY);
+            bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_2D_ARRAY, t);
+            activeTexture(MAX_TEXTURE_UNITS - 1);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                    GLint(level), GLint(xoffset), GLint(yoffset), GLint(zoffset),
+                    width, height, depth, glFormat, glType, pixels);
+            break;
     }
 
+    unstagePixels();
+    updateTextureLevels(t, level);
+
+    scheduleDestroy(std::move(p));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::updateTextureLevels(GLTexture* t, uint32_t level) noexcept {
     // update the base/max LOD so we don't access undefined LOD. this allows the app to
     // specify levels as they become available.
 
@@ -1966,12 +2387,265 @@ void OpenGLDriver::setTextureData(GLTexture* t,
         t->gl.maxLevel = uint8_t(level);
         glTexParameteri(t->gl.target, GL_TEXTURE_MAX_LEVEL, t->gl.maxLevel);
     }
+}
 
-    scheduleDestroy(std::move(p));
+bool OpenGLDriver::loadDynamicBuffer(GLenum target, GLuint buffer, GLDynamicBuffer& db,
+        void const* data, BufferRange const* ranges, uint32_t count) noexcept {
+    bindBuffer(target, buffer);
+
+    bool changed = false;
+    bool mapped = false;
+    if (db.used) {
+        // the GPU may still read the current region, the update goes into the next one
+        const GLintptr previous = db.getOffset();
+        db.syncs[db.current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        db.current = uint8_t((db.current + 1) % DYNAMIC_REGION_COUNT);
+        db.used = false;
+        changed = true;
+        GLsync& sync = db.syncs[db.current];
+        if (sync) {
+            glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, std::numeric_limits<GLuint64>::max());
+            glDeleteSync(sync);
+            sync = nullptr;
+        }
+
+        const bool whole = count == 1 && ranges[0].byteOffset == 0 && ranges[0].byteSize >= db.size;
+        if (whole) {
+            // nothing reads the new region anymore, it's written without synchronization
+            void* ptr = glMapBufferRange(target, db.getOffset(), db.size,
+                    GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            if (ptr) {
+                memcpy(ptr, data, db.size);
+                glUnmapBuffer(target);
+                mapped = true;
+            }
+        } else {
+            // a partial update starts from the content of the previous region
+            glCopyBufferSubData(target, target, previous, db.getOffset(), db.size);
+        }
+    }
+
+    if (!mapped) {
+        const GLintptr base = db.getOffset();
+        uint8_t const* p = static_cast<uint8_t const*>(data);
+        for (uint32_t i = 0; i < count; i++) {
+            glBufferSubData(target, base + ranges[i].byteOffset, ranges[i].byteSize, p);
+            p += ranges[i].byteSize;
+        }
+    }
+    return changed;
+}
+
+void OpenGLDriver::destroyDynamicBuffer(GLDynamicBuffer& db) noexcept {
+    for (GLsync& sync : db.syncs) {
+        if (sync) {
+            glDeleteSync(sync);
+            sync = nullptr;
+        }
+    }
+}
+
+uint32_t OpenGLDriver::prepareDynamicBuffers(GLRenderPrimitive const* p) noexcept {
+    // the attributes point to the current regions of the vertex buffers, which may have changed
+    GLRenderPrimitive* rp = const_cast<GLRenderPrimitive*>(p);
+    GLVertexBuffer* vb = rp->gl.vb;
+    if (vb) {
+        if (rp->gl.va->vbVersion != vb->gl.version) {
+            setVertexAttributes(rp->gl.va, vb);
+        }
+        for (size_t i = 0, n = vb->bufferCount; i < n; i++) {
+            vb->gl.dynamic[i].used = true;
+        }
+    }
+    GLIndexBuffer* ib = rp->gl.ib;
+    if (ib) {
+        ib->gl.dynamic->used = true;
+        return ib->gl.dynamic->getOffset();
+    }
+    return 0;
+}
+
+void const* OpenGLDriver::stagePixels(void const* data, size_t size) noexcept {
+    // uploads that don't fit in the staging buffer read the client's memory directly
+    if (UTILS_UNLIKELY(!data || !size || size > STAGING_BUFFER_SIZE)) {
+        return data;
+    }
+
+    if (UTILS_UNLIKELY(!mStagingBuffer)) {
+        glGenBuffers(1, &mStagingBuffer);
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, STAGING_BUFFER_SIZE, nullptr, GL_STREAM_DRAW);
+    }
+
+    // when the range doesn't fit at the end of the ring, the end is skipped and must be free too
+    const size_t head = (mStagingHead + 255u) & ~size_t(255u);
+    const bool wraps = head + size > STAGING_BUFFER_SIZE;
+    const size_t begin = wraps ? 0 : head;
+    const size_t end = begin + size;
+    auto overlaps = [=](StagingRange const& r) {
+        return (r.begin < end && begin < r.end) || (wraps && r.end > mStagingHead);
+    };
+
+    // ranges are retired in order, so the first one that's not in the way ends the search
+    auto& ranges = mStagingRanges;
+    while (!ranges.empty() && overlaps(ranges.front())) {
+        glClientWaitSync(ranges.front().sync, GL_SYNC_FLUSH_COMMANDS_BIT,
+                std::numeric_limits<GLuint64>::max());
+        glDeleteSync(ranges.front().sync);
+        ranges.pop_front();
+    }
+
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, mStagingBuffer);
+    void* ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, GLintptr(begin), GLsizeiptr(size),
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (UTILS_UNLIKELY(!ptr)) {
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return data;
+    }
+    memcpy(ptr, data, size);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // the fence is inserted by unstagePixels(), after the upload that reads this range
+    ranges.push_back({ nullptr, begin, end });
+    mStagingHead = end;
+    return reinterpret_cast<void const*>(uintptr_t(begin));
+}
+
+void OpenGLDriver::unstagePixels() noexcept {
+    auto& ranges = mStagingRanges;
+    if (!ranges.empty() && !ranges.back().sync) {
+        ranges.back().sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+}
+
+bool OpenGLDriver::hasPendingUploads(GLTexture const* t) const noexcept {
+    return std::any_of(mPendingUploads.begin(), mPendingUploads.end(),
+            [t](PendingUpload const& u) { return u.t == t; });
+}
+
+void OpenGLDriver::updatePendingUploads() noexcept {
+    auto& uploads = mPendingUploads;
+    while (!uploads.empty() && mUploadBudget) {
+        if (!uploadRows(uploads.front(), false)) {
+            break;
+        }
+        uploads.pop_front();
+    }
+}
+
+void OpenGLDriver::dropPendingUploads(GLTexture const* t) noexcept {
+    if (UTILS_UNLIKELY(t->gl.backgroundUploads)) {
+        // they're not cancelled, but the upload thread must be done with the texture
+        retireBackgroundUploads(true);
+    }
+    if (UTILS_LIKELY(mPendingUploads.empty())) {
+        return;
+    }
+    auto last = std::remove_if(mPendingUploads.begin(), mPendingUploads.end(),
+            [this, t](PendingUpload& u) {
+                if (u.t != t) {
+                    return false;
+                }
+                scheduleDestroy(std::move(u.p));
+                return true;
+            });
+    mPendingUploads.erase(last, mPendingUploads.end());
+}
+
+void OpenGLDriver::flushPendingUploads(GLTexture const* t) noexcept {
+    if (UTILS_UNLIKELY(t->gl.backgroundUploads)) {
+        retireBackgroundUploads(true);
+    }
+    if (UTILS_LIKELY(mPendingUploads.empty())) {
+        return;
+    }
+    // the texture is about to be used in a way that needs all its data, e.g. mipmap generation.
+    auto last = std::remove_if(mPendingUploads.begin(), mPendingUploads.end(),
+            [this, t](PendingUpload& u) {
+                if (u.t != t) {
+                    return false;
+                }
+                uploadRows(u, true);
+                return true;
+            });
+    mPendingUploads.erase(last, mPendingUploads.end());
+}
 
+void OpenGLDriver::uploadInBackground(GLTexture* t, uint32_t level,
+        uint32_t xoffset, uint32_t yoffset, uint32_t width, uint32_t height,
+        PixelBufferDescriptor&& data) noexcept {
+    // the upload context waits on this before using the texture, so it must reach the GPU
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    t->gl.backgroundUploads++;
+    mBackgroundUploads++;
+    mUploader->push({ t, t->gl.texture_id, t->gl.internalFormat,
+            level, xoffset, yoffset, width, height, std::move(data), sync });
+}
+
+void OpenGLDriver::retireBackgroundUploads(bool wait) noexcept {
+    if (UTILS_LIKELY(!mBackgroundUploads)) {
+        return;
+    }
+    std::vector<OpenGLUploader::Upload> done(mUploader->retire(wait));
+    for (OpenGLUploader::Upload& u : done) {
+        GLTexture* t = static_cast<GLTexture*>(u.user);
+        // this only orders our GPU commands after the upload, it doesn't block
+        glWaitSync(u.sync, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(u.sync);
+        bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_2D, t);
+        activeTexture(MAX_TEXTURE_UNITS - 1);
+        updateTextureLevels(t, u.level);
+        t->gl.backgroundUploads--;
+        mBackgroundUploads--;
+        scheduleDestroy(std::move(u.data));
+    }
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+bool OpenGLDriver::uploadRows(PendingUpload& u, bool unlimited) noexcept {
+    PixelBufferDescriptor& p = u.p;
+    GLTexture* t = u.t;
+
+    const size_t stride = p.stride ? p.stride : u.width;
+    const size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
+    const size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
+
+    // as many rows as fit in both the staging buffer and this frame's budget, at least one
+    const size_t maxSize = unlimited ? STAGING_BUFFER_SIZE :
+            std::min(STAGING_BUFFER_SIZE, mUploadBudget);
+    const uint32_t rows = uint32_t(std::min(size_t(u.height - u.row),
+            std::max(size_t(1), maxSize / bpr)));
+
+    // the last row doesn't necessarily have its padding
+    char const* src = static_cast<char const*>(p.buffer) + bpr * (p.top + u.row);
+    const size_t size = bpr * (rows - 1) + bpp * (p.left + u.width);
+
+    pixelStore(GL_UNPACK_ROW_LENGTH, p.stride);
+    pixelStore(GL_UNPACK_ALIGNMENT, p.alignment);
+    pixelStore(GL_UNPACK_SKIP_PIXELS, p.left);
+    pixelStore(GL_UNPACK_SKIP_ROWS, 0);
+
+    bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_2D, t);
+    activeTexture(MAX_TEXTURE_UNITS - 1);
+    void const* pixels = stagePixels(src, size);
+    glTexSubImage2D(GL_TEXTURE_2D, GLint(u.level), GLint(u.xoffset), GLint(u.yoffset + u.row),
+            GLsizei(u.width), GLsizei(rows), getFormat(p.format), getType(p.type), pixels);
+    unstagePixels();
+    CHECK_GL_ERROR(utils::slog.e)
+
+    mUploadBudget -= std::min(mUploadBudget, size);
+    u.row += rows;
+    if (u.row < u.height) {
+        return false;
+    }
+
+    updateTextureLevels(t, u.level);
+    scheduleDestroy(std::move(p));
+    return true;
+}
+
 void OpenGLDriver::setCompressedTextureData(GLTexture* t,
         uint32_t level,
         uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
@@ -1995,6 +2669,8 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
 
     //  TODO: maybe assert the size is right (b/c we can compute it ourselves)
 
+    void const* pixels = stagePixels(p.buffer, p.size);
+
     switch (t->target) {
         case SamplerType::SAMPLER_EXTERNAL:
             // if we get there, it's because the user is trying to use an external texture
@@ -2007,7 +2683,7 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
             activeTexture(MAX_TEXTURE_UNITS - 1);
             glCompressedTexSubImage2D(GL_TEXTURE_2D,
                     GLint(level), GLint(xoffset), GLint(yoffset),
-                    width, height, t->gl.internalFormat, imageSize, p.buffer);
+                    width, height, t->gl.internalFormat, imageSize, pixels);
             break;
         case SamplerType::SAMPLER_CUBEMAP: {
             assert(faceOffsets);
@@ -2020,23 +2696,22 @@ void OpenGLDriver::setCompressedTextureData(GLTexture* t,
                 GLenum target = getCubemapTarget(TextureCubemapFace(face));
                 glCompressedTexSubImage2D(target, GLint(level), 0, 0,
                         t->width >> level, t->height >> level, t->gl.internalFormat,
-                        imageSize, static_cast<uint8_t const*>(p.buffer) + offsets[face]);
+                        imageSize, static_cast<uint8_t const*>(pixels) + offsets[face]);
             }
             break;
         }
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(t->gl.target == GL_TEXTURE_2D_ARRAY);
+            bindTexture(MAX_TEXTURE_UNITS - 1, GL_TEXTURE_2D_ARRAY, t);
+            activeTexture(MAX_TEXTURE_UNITS - 1);
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                    GLint(level), GLint(xoffset), GLint(yoffset), GLint(zoffset),
+                    width, height, depth, t->gl.internalFormat, imageSize, pixels);
+            break;
     }
 
-    // update the base/max LOD so we don't access undefined LOD. this allows the app to
-    // specify levels as they become available.
-
-    if (uint8_t(level) < t->gl.baseLevel) {
-        t->gl.baseLevel = uint8_t(level);
-        glTexParameteri(t->gl.target, GL_TEXTURE_BASE_LEVEL, t->gl.baseLevel);
-    }
-    if (uint8_t(level) > t->gl.maxLevel) {
-        t->gl.maxLevel = uint8_t(level);
-        glTexParameteri(t->gl.target, GL_TEXTURE_MAX_LEVEL, t->gl.maxLevel);
-    }
+    unstagePixels();
+    updateTextureLevels(t, level);
 
     scheduleDestroy(std::move(p));
 
@@ -2084,6 +2759,16 @@ void OpenGLDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHan
     }
 }
 
+void OpenGLDriver::setStreamDimensions(Driver::StreamHandle sh, uint32_t width, uint32_t height) {
+    DEBUG_MARKER()
+
+    if (sh) {
+        GLStream* s = handle_cast<GLStream*>(sh);
+        s->width = width;
+        s->height = height;
+    }
+}
+
 UTILS_NOINLINE
 void OpenGLDriver::attachStream(GLTexture* t, GLStream* hwStream) noexcept {
     mExternalStreams.push_back(t);
@@ -2136,104 +2821,55 @@ void OpenGLDriver::replaceStream(GLTexture* t, GLStream* hwStream) noexcept {
 }
 
 /*
- * This is called in the user thread
+ * This is called in the driver thread, at the beginning of each frame
  */
 
 #define DEBUG_NO_EXTERNAL_STREAM_COPY false
 
-void OpenGLDriver::updateStream(GLTexture* t, driver::DriverApi* driver) noexcept {
+void OpenGLDriver::updateStream(GLTexture* t) noexcept {
     GLStream* s = static_cast<GLStream*>(t->hwStream);
-    if (UTILS_UNLIKELY(s == nullptr)) {
-        // this can happen because we're called synchronously and the setExternalStream() call
-        // may bot have been processed yet.
+    assert(!s->isNativeStream());
+
+    if (UTILS_UNLIKELY(DEBUG_NO_EXTERNAL_STREAM_COPY ||
+                       bugs.disable_shared_context_draws || !mOpenGLBlitter)) {
+        t->gl.texture_id = s->gl.externalTextureId;
         return;
     }
 
-    if (UTILS_LIKELY(!s->isNativeStream())) {
-        // round-robin to the next texture name
-        if (UTILS_UNLIKELY(DEBUG_NO_EXTERNAL_STREAM_COPY ||
-                           bugs.disable_shared_context_draws || !mOpenGLBlitter)) {
-            driver->queueCommand([this, t, s]() {
-                // the stream may have been destroyed since we enqueued the command
-                // also make sure that this texture is still associated with the same stream
-                auto& streams = mExternalStreams;
-                if (UTILS_LIKELY(std::find(streams.begin(), streams.end(), t) != streams.end()) &&
-                    (t->hwStream == s)) {
-                    t->gl.texture_id = s->gl.externalTextureId;
-                }
-            });
-        } else {
-            s->user_thread.cur = uint8_t(
-                    (s->user_thread.cur + 1) % GLStream::ROUND_ROBIN_TEXTURE_COUNT);
-            GLuint writeTexture = s->user_thread.write[s->user_thread.cur];
-            GLuint readTexture = s->user_thread.read[s->user_thread.cur];
-
-            // Make sure we're using the proper size
-            GLStream::Info& info = s->user_thread.infos[s->user_thread.cur];
-            if (UTILS_UNLIKELY(info.width != s->width || info.height != s->height)) {
-
-                // nothing guarantees that this buffer is free (i.e. has been consumed by the
-                // GL thread), so we could potentially cause a glitch by reallocating the
-                // texture here. This should be very rare though.
-                // This could be fixed by always using a new temporary texture here, and
-                // replacing it in the queueCommand() below. imho, not worth it.
-
-                info.width = s->width;
-                info.height = s->height;
-
-                ExternalContext::ExternalTexture* ets = s->user_thread.infos[s->user_thread.cur].ets;
-                mContextManager.reallocateExternalStorage(ets, info.width, info.height,
-                        TextureFormat::RGB8);
-
-                glActiveTexture(GL_TEXTURE0);
-                glBindTexture(GL_TEXTURE_2D, writeTexture);
-                glBindTexture(GL_TEXTURE_EXTERNAL_OES, readTexture);
-#ifdef GL_OES_EGL_image
-                glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)ets->image);
-                glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)ets->image);
-#endif
-            }
+    // round-robin to the next texture name
+    s->user_thread.cur = uint8_t((s->user_thread.cur + 1) % GLStream::ROUND_ROBIN_TEXTURE_COUNT);
+    GLuint writeTexture = s->user_thread.write[s->user_thread.cur];
+    GLuint readTexture = s->user_thread.read[s->user_thread.cur];
 
-            // copy the texture...
-#ifndef NDEBUG
-            if (t->gl.fence) {
-                // we're about to overwrite a buffer that hasn't been consumed
-                slog.d << "OpenGLDriver::updateStream(): about to overwrite buffer " <<
-                       int(s->user_thread.cur) << " of Texture at " << t << " of Stream at " << s
-                       << io::endl;
-            }
+    // Make sure we're using the proper size
+    GLStream::Info& info = s->user_thread.infos[s->user_thread.cur];
+    if (UTILS_UNLIKELY(info.width != s->width || info.height != s->height)) {
+        // Commands already issued that sample this buffer are ordered before the reallocation,
+        // since they happen in the same context.
+        info.width = s->width;
+        info.height = s->height;
+
+        ExternalContext::ExternalTexture* ets = info.ets;
+        mContextManager.reallocateExternalStorage(ets, info.width, info.height,
+                TextureFormat::RGB8);
+
+        bindTexture(0, GL_TEXTURE_2D, writeTexture);
+        bindTexture(0, GL_TEXTURE_EXTERNAL_OES, readTexture);
+#ifdef GL_OES_EGL_image
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)ets->image);
+        glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, (GLeglImageOES)ets->image);
 #endif
-            mOpenGLBlitter->blit(s->gl.externalTextureId, writeTexture, s->width, s->height);
-
-            // We need a fence to guarantee that this copy has happened when we need the texture
-            // in OpenGLProgram::updateSamplers(), i.e. when we bind textures just before use.
-            GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-            // Per https://www.khronos.org/opengl/wiki/Sync_Object, flush to make sure that the
-            // sync object is in the driver's command queue.
-            glFlush();
-
-            driver->queueCommand([this, t, s, fence, readTexture, writeTexture,
-                    width = info.width, height = info.height]() {
-                // the stream may have been destroyed since we enqueued the command
-                // also make sure that this texture is still associated with the same stream
-                auto& streams = mExternalStreams;
-                if (UTILS_LIKELY(std::find(streams.begin(), streams.end(), t) != streams.end()) &&
-                    (t->hwStream == s)) {
-                    if (UTILS_UNLIKELY(t->gl.fence)) {
-                        // if the texture still has a fence set, destroy it now, so it's not leaked.
-                        glDeleteSync(t->gl.fence);
-                    }
-                    t->gl.texture_id = readTexture;
-                    t->gl.fence = fence;
-                    s->gl.externalTexture2DId = writeTexture;
-                    s->gl.width = width;
-                    s->gl.height = height;
-                } else {
-                    glDeleteSync(fence);
-                }
-            });
-        }
     }
+
+    // copy the texture...
+    mOpenGLBlitter->blit(s->gl.externalTextureId, writeTexture, info.width, info.height);
+
+    // The copy and the draws that sample it are in the same context, so unlike when the copy
+    // was made in the application's context, no fence is needed.
+    t->gl.texture_id = readTexture;
+    s->gl.externalTexture2DId = writeTexture;
+    s->gl.width = info.width;
+    s->gl.height = info.height;
 }
 
 void OpenGLDriver::readStreamPixels(Driver::StreamHandle sh,
@@ -2297,12 +2933,10 @@ void OpenGLDriver::readStreamPixels(Driver::StreamHandle sh,
         // be corrected to match glReadPixels()'s behavior.
         y = (s->height - height) - y;
 
-        // TODO: we could use a PBO to make this asynchronous
-        glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
-        CHECK_GL_ERROR(utils::slog.e)
+        // the image is not y-reversed, see above
+        readPixelsAsync(x, y, width, height, glFormat, glType, false, std::move(p));
 
         bindFramebuffer(GL_FRAMEBUFFER, 0);
-        scheduleDestroy(std::move(p));
     }
 }
 
@@ -2334,6 +2968,16 @@ void OpenGLDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    DEBUG_MARKER()
+
+    GLUniformBuffer* ub = handle_cast<GLUniformBuffer *>(ubh);
+    bindBufferRange(GL_UNIFORM_BUFFER, GLuint(index), ub->gl.ubo,
+            GLintptr(offset), GLsizeiptr(size));
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 void OpenGLDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
     DEBUG_MARKER()
 
@@ -2391,6 +3035,67 @@ void OpenGLDriver::popGroupMarker(int) {
 #endif
 }
 
+// ------------------------------------------------------------------------------------------------
+// Timer queries
+// ------------------------------------------------------------------------------------------------
+
+void OpenGLDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    tq->elapsed.store(-1, std::memory_order_relaxed);
+    glBeginQuery(GL_TIME_ELAPSED, tq->gl.query);
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    DEBUG_MARKER()
+
+    GLTimerQuery* tq = handle_cast<GLTimerQuery*>(tqh);
+    glEndQuery(GL_TIME_ELAPSED);
+    auto& queries = mTimerQueries;
+    if (std::find(queries.begin(), queries.end(), tq) == queries.end()) {
+        queries.push_back(tq);
+    }
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::updateTimerQueries() noexcept {
+    auto& queries = mTimerQueries;
+    if (queries.empty()) {
+        return;
+    }
+
+    // when the GPU was disjoint (e.g. its frequency changed), the results of the queries
+    // that completed since the last check are meaningless, they're dropped and stay unavailable.
+    GLint disjoint = 0;
+#if defined(ANDROID) && GL_EXT_disjoint_timer_query
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+#endif
+
+    auto last = std::remove_if(queries.begin(), queries.end(), [disjoint](GLTimerQuery* tq) {
+        GLuint available = 0;
+        glGetQueryObjectuiv(tq->gl.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return false;
+        }
+        GLuint64 elapsed = 0;
+#if defined(ANDROID)
+#   if GL_EXT_disjoint_timer_query
+        glGetQueryObjectui64vEXT(tq->gl.query, GL_QUERY_RESULT, &elapsed);
+#   endif
+#else
+        glGetQueryObjectui64v(tq->gl.query, GL_QUERY_RESULT, &elapsed);
+#endif
+        if (!disjoint) {
+            tq->elapsed.store(int64_t(elapsed), std::memory_order_relaxed);
+        }
+        return true;
+    });
+    queries.erase(last, queries.end());
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
 // ------------------------------------------------------------------------------------------------
 // Read-back ops
 // ------------------------------------------------------------------------------------------------
@@ -2436,44 +3141,116 @@ void OpenGLDriver::readPixels(Driver::RenderTargetHandle src,
     GLRenderTarget const* s = handle_cast<GLRenderTarget const*>(src);
     bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
 
-    // TODO: we could use a PBO to make this asynchronous
-    glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), glFormat, glType, p.buffer);
-
-    // now we need to flip the buffer vertically to match our API
-    size_t stride = p.stride ? p.stride : width;
-    size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
-    size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
-    char* head = (char*)p.buffer + p.left * bpp + bpr * p.top;
-    char* tail = (char*)p.buffer + p.left * bpp + bpr * (p.top + height - 1);
-    // clang vectorizes this loop
-    while (head < tail) {
-        std::swap_ranges(head, head + bpp * width, tail);
-        head += bpr;
-        tail -= bpr;
+    readPixelsAsync(x, y, width, height, glFormat, glType, true, std::move(p));
+}
+
+void OpenGLDriver::readPixelsAsync(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+        GLenum format, GLenum type, bool flip, PixelBufferDescriptor&& p) noexcept {
+    // The read goes into a pixel pack buffer laid out like the client's buffer, so it doesn't
+    // stall the pipeline. Pack buffers are recycled, there are as many as outstanding reads.
+    const GLsizeiptr size = GLsizeiptr(p.size);
+    GLuint pbo = 0;
+    auto pos = std::find_if(mFreePixelPackBuffers.begin(), mFreePixelPackBuffers.end(),
+            [size](std::pair<GLuint, GLsizeiptr> const& item) { return item.second >= size; });
+    if (pos != mFreePixelPackBuffers.end()) {
+        pbo = pos->first;
+        mFreePixelPackBuffers.erase(pos);
+        bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+    } else {
+        glGenBuffers(1, &pbo);
+        bindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
     }
 
-    scheduleDestroy(std::move(p));
+    glReadPixels(GLint(x), GLint(y), GLint(width), GLint(height), format, type, nullptr);
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    mPendingReadPixels.push_back({ pbo, size, sync, width, height, flip, std::move(p) });
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::updatePendingReadPixels(bool wait) noexcept {
+    auto& pending = mPendingReadPixels;
+    if (pending.empty()) {
+        return;
+    }
 
+    // fences signal in order, so we can stop at the first one that hasn't
+    auto first = pending.begin();
+    for ( ; first != pending.end(); ++first) {
+        GLenum status = glClientWaitSync(first->sync, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0,
+                wait ? std::numeric_limits<GLuint64>::max() : 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        completeReadPixels(*first);
+    }
+    pending.erase(pending.begin(), first);
     CHECK_GL_ERROR(utils::slog.e)
 }
 
+void OpenGLDriver::completeReadPixels(PendingReadPixels& r) noexcept {
+    PixelBufferDescriptor& p = r.p;
+    bindBuffer(GL_PIXEL_PACK_BUFFER, r.pbo);
+    void const* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, r.size, GL_MAP_READ_BIT);
+    if (data) {
+        // only the rows that were read are copied, flipped vertically if needed to match our API
+        size_t stride = p.stride ? p.stride : r.width;
+        size_t bpp = PixelBufferDescriptor::computeDataSize(p.format, p.type, 1, 1, 1);
+        size_t bpr = PixelBufferDescriptor::computeDataSize(p.format, p.type, stride, 1, p.alignment);
+        size_t offset = p.left * bpp + bpr * p.top;
+        char const* src = static_cast<char const*>(data) + offset;
+        char* dst = static_cast<char*>(p.buffer) + offset;
+        ssize_t dstStep = ssize_t(bpr);
+        if (r.flip) {
+            dst += bpr * (r.height - 1);
+            dstStep = -dstStep;
+        }
+        for (size_t row = 0; row < r.height; row++) {
+            memcpy(dst, src, bpp * r.width);
+            src += bpr;
+            dst += dstStep;
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    glDeleteSync(r.sync);
+    mFreePixelPackBuffers.emplace_back(r.pbo, r.size);
+    scheduleDestroy(std::move(p));
+}
+
 // ------------------------------------------------------------------------------------------------
 // Rendering ops
 // ------------------------------------------------------------------------------------------------
 
 void OpenGLDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     insertEventMarker("beginFrame");
+    retireBackgroundUploads(false);
+    if (UTILS_UNLIKELY(!mPendingUploads.empty())) {
+        mUploadBudget = TEXTURE_UPLOAD_BUDGET;
+        updatePendingUploads();
+    }
     if (UTILS_UNLIKELY(!mExternalStreams.empty())) {
+        // Streams are latched here, on the driver thread, rather than by a synchronous call
+        // from the application thread, which would otherwise have to make GL calls each frame.
         driver::ContextManagerGL& contextManager = mContextManager;
         const size_t index = getIndexForTextureTarget(GL_TEXTURE_EXTERNAL_OES);
-        for (GLTexture const* t : mExternalStreams) {
+        for (GLTexture* t : mExternalStreams) {
             assert(t && t->hwStream);
-            if (static_cast<GLStream*>(t->hwStream)->isNativeStream()) {
-                assert(t->hwStream->stream);
-                contextManager.updateTexImage(t->hwStream->stream);
+            GLStream* s = static_cast<GLStream*>(t->hwStream);
+            if (s->isNativeStream()) {
+                assert(s->stream);
+                int64_t timestamp = s->timestamp.load(std::memory_order_relaxed);
+                contextManager.updateTexImage(s->stream, &timestamp);
+                s->timestamp.store(timestamp, std::memory_order_relaxed);
                 // NOTE: We assume that updateTexImage() binds the texture on our behalf
                 GLuint activeUnit = state.textures.active;
                 state.textures.units[activeUnit].targets[index].texture_id = t->gl.texture_id;
+            } else {
+                updateStream(t);
             }
         }
     }
@@ -2482,6 +3259,8 @@ void OpenGLDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
 void OpenGLDriver::endFrame(uint32_t frameId) {
     //SYSTRACE_NAME("glFinish");
     //glFinish();
+    updateTimerQueries();
+    updatePendingReadPixels(false);
     insertEventMarker("endFrame");
 }
 
@@ -2489,6 +3268,15 @@ void OpenGLDriver::flush(int) {
     glFlush();
 }
 
+void OpenGLDriver::setBlobCache(driver::BlobCache cache) {
+    if (!mNumProgramBinaryFormats) {
+        // the driver can't give us program binaries, don't bother calling the cache
+        slog.w << "program binaries are not supported, the blob cache is ignored" << io::endl;
+        return;
+    }
+    mBlobCache = cache;
+}
+
 UTILS_NOINLINE
 void OpenGLDriver::clearWithRasterPipe(
         bool clearColor, float4 const& linearColor,
@@ -2591,10 +3379,13 @@ void OpenGLDriver::blit(TargetBufferFlags buffers,
         bindFramebuffer(GL_READ_FRAMEBUFFER, s->gl.fbo);
         bindFramebuffer(GL_DRAW_FRAMEBUFFER, d->gl.fbo);
         disable(GL_SCISSOR_TEST);
+        // depth and stencil buffers can only be blitted with GL_NEAREST
+        const GLenum filter = (mask & (GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT)) ?
+                GL_NEAREST : GL_LINEAR;
         glBlitFramebuffer(
                 srcLeft, srcBottom, srcLeft + srcWidth, srcBottom + srcHeight,
                 dstLeft, dstBottom, dstLeft + dstWidth, dstBottom + dstHeight,
-                mask, GL_LINEAR);
+                mask, filter);
         enable(GL_SCISSOR_TEST);
         CHECK_GL_ERROR(utils::slog.e)
     }
@@ -2607,15 +3398,53 @@ void OpenGLDriver::draw(
     DEBUG_MARKER()
 
     OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling, skip this draw rather than waiting for it
+        return;
+    }
     useProgram(p);
 
     const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
-    bindVertexArray(rp);
+    uint32_t offset = rp->offset;
+    if (UTILS_UNLIKELY(rp->gl.vb || rp->gl.ib)) {
+        offset += prepareDynamicBuffers(rp);
+    }
+    bindVertexArray(rp->gl.va);
 
     setRasterState(rs);
 
     glDrawRangeElements(GLenum(rp->type), rp->minIndex, rp->maxIndex, rp->count,
-            rp->gl.indicesType, reinterpret_cast<const void*>(rp->offset));
+            rp->gl.indicesType, reinterpret_cast<const void*>(uintptr_t(offset)));
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+void OpenGLDriver::drawInstanced(
+        Driver::ProgramHandle ph,
+        Driver::RasterState rs,
+        Driver::RenderPrimitiveHandle rph,
+        uint32_t instanceCount) {
+    DEBUG_MARKER()
+
+    OpenGLProgram* p = handle_cast<OpenGLProgram*>(ph);
+    if (UTILS_UNLIKELY(!p->isReady(this))) {
+        // the program is still compiling, skip this draw rather than waiting for it
+        return;
+    }
+    useProgram(p);
+
+    const GLRenderPrimitive* rp = handle_cast<const GLRenderPrimitive *>(rph);
+    uint32_t offset = rp->offset;
+    if (UTILS_UNLIKELY(rp->gl.vb || rp->gl.ib)) {
+        offset += prepareDynamicBuffers(rp);
+    }
+    bindVertexArray(rp->gl.va);
+
+    setRasterState(rs);
+
+    // there is no instanced version of glDrawRangeElements()
+    glDrawElementsInstanced(GLenum(rp->type), rp->count, rp->gl.indicesType,
+            reinterpret_cast<const void*>(uintptr_t(offset)), GLsizei(instanceCount));
 
     CHECK_GL_ERROR(utils::slog.e)
 }
@@ -23,11 +23,15 @@
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/Hash.h>
 
 #include <math/vec4.h>
 
 #include <tsl/robin_map.h>
 
+#include <atomic>
+#include <deque>
+#include <memory>
 #include <set>
 
 #include <assert.h>
@@ -41,6 +45,7 @@ class PixelBufferDescriptor;
 
 class OpenGLProgram;
 class OpenGLBlitter;
+class OpenGLUploader;
 
 class OpenGLDriver final : public DriverBase {
     inline OpenGLDriver(driver::ContextManagerGL* external_context) noexcept;
@@ -51,10 +56,25 @@ public:
             driver::ContextManagerGL* externalContext, void* sharedGLContext) noexcept;
 
     // OpenGLDriver specific fields
+
+    // A Usage::DYNAMIC buffer holds DYNAMIC_REGION_COUNT copies of its content, one after the
+    // other. Draws read the current region, an update that follows a draw moves on to the next
+    // region, once the fence that followed the last draws reading it has signaled.
+    static constexpr size_t DYNAMIC_REGION_COUNT = 3;
+    struct GLDynamicBuffer {
+        std::array<GLsync, DYNAMIC_REGION_COUNT> syncs{};
+        uint32_t size = 0;          // size of a region
+        uint8_t current = 0;        // region read by the draws
+        bool used = false;          // a draw read the current region since it was written
+        uint32_t getOffset() const noexcept { return current * size; }
+    };
+
     struct GLVertexBuffer : public HwVertexBuffer {
         using HwVertexBuffer::HwVertexBuffer;
         struct {
             std::array<GLuint, MAX_ATTRIBUTE_BUFFER_COUNT> buffers;  // 4*6 bytes
+            std::unique_ptr<GLDynamicBuffer[]> dynamic;              // Usage::DYNAMIC only
+            uint32_t version = 0;   // incremented each time a region changes
         } gl;
     };
 
@@ -62,16 +82,31 @@ public:
         using HwIndexBuffer::HwIndexBuffer;
         struct {
             GLuint buffer;
+            std::unique_ptr<GLDynamicBuffer> dynamic;                // Usage::DYNAMIC only
         } gl;
     };
 
+    // A VAO is shared by all the render primitives using the same buffers with the same
+    // attributes, which only differ by their range. Consecutive draws of such primitives don't
+    // change the VAO binding.
+    struct GLVertexArray {
+        GLuint vao = 0;
+        GLuint elementArray = 0;
+        utils::bitset32 vertexAttribArray;
+        uint32_t enabledAttributes = 0;
+        uint32_t vbVersion = 0;     // regions of a dynamic vertex buffer the attributes point to
+        uint32_t refs = 0;          // render primitives using this VAO
+        bool cached = false;        // can still be found in mVertexArrays
+    };
+
     struct GLRenderPrimitive : public HwRenderPrimitive {
         using HwRenderPrimitive::HwRenderPrimitive;
         struct {
-            GLuint vao = 0;
+            GLVertexArray* va = nullptr;
             GLenum indicesType = GL_UNSIGNED_INT;
-            GLuint elementArray = 0;
-            utils::bitset32 vertexAttribArray;
+            // set when the buffers are Usage::DYNAMIC, their regions are checked at each draw
+            GLVertexBuffer* vb = nullptr;
+            GLIndexBuffer* ib = nullptr;
         } gl;
     };
 
@@ -88,6 +123,7 @@ public:
             uint8_t baseLevel = 255;
             uint8_t maxLevel = 0;
             uint8_t targetIndex = 0;
+            uint16_t backgroundUploads = 0;     // uploads in flight on the upload thread
         } gl;
     };
 
@@ -129,13 +165,13 @@ public:
         } gl;
 
         /*
-         * The fields below are access from the main application thread
-         * (not the GL thread)
+         * The fields below are used to copy the external texture, at the beginning of each
+         * frame (in the GL thread)
          */
         struct {
-            // texture id used to texture from, always used in the GL thread
+            // texture id used to texture from
             GLuint read[ROUND_ROBIN_TEXTURE_COUNT];
-            // texture id to write into, always used from the user thread
+            // texture id to write into, sharing its storage with the read texture
             GLuint write[ROUND_ROBIN_TEXTURE_COUNT];
             Info infos[ROUND_ROBIN_TEXTURE_COUNT];
             uint8_t cur = 0;
@@ -171,9 +207,19 @@ public:
             GLuint fbo = 0;
             uint8_t samples = 1;
             bool useQCOMTiledRendering = false;
+            bool autoResolve = false;   // samples in tile memory only, see createRenderTarget()
         } gl;
     };
 
+    struct GLTimerQuery : public HwTimerQuery {
+        struct {
+            GLuint query = 0;
+        } gl;
+        // written on the GL thread when the result is available, read from any thread;
+        // negative while the query is in flight
+        std::atomic<int64_t> elapsed{ -1 };
+    };
+
     void useProgram(GLuint program) noexcept;
 
 private:
@@ -256,6 +302,7 @@ private:
     typedef math::details::TVec4<GLint> vec4gli;
 
     friend class OpenGLProgram;
+    friend class OpenGLBlitter;
     OpenGLDriver(OpenGLDriver const&) = delete;
     OpenGLDriver& operator = (OpenGLDriver const&) = delete;
 
@@ -275,10 +322,11 @@ private:
     void framebufferTexture(Driver::TargetBufferInfo& binfo, GLRenderTarget* rt, GLenum attachment) noexcept;
 
     void framebufferRenderbuffer(GLRenderTarget::GL::RenderBuffer* rb, GLenum attachment,
-            GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo) noexcept;
+            GLenum internalformat, uint32_t width, uint32_t height, uint8_t samples, GLuint fbo,
+            bool autoResolve) noexcept;
 
     GLuint framebufferRenderbuffer(uint32_t width, uint32_t height, uint8_t samples,
-            GLenum attachment, GLenum internalformat, GLuint fbo) noexcept;
+            GLenum attachment, GLenum internalformat, GLuint fbo, bool autoResolve) noexcept;
 
     void setRasterStateSlow(RasterState rs) noexcept;
     void setRasterState(RasterState rs) noexcept {
@@ -299,11 +347,19 @@ private:
             PixelBufferDescriptor&& data, FaceOffsets const* faceOffsets);
 
     void renderBufferStorage(GLuint rbo, GLenum internalformat, uint32_t width,
-            uint32_t height, uint8_t samples) const noexcept;
+            uint32_t height, uint8_t samples, bool autoResolve) const noexcept;
 
     void textureStorage(GLTexture* t,
             uint32_t width, uint32_t height, uint32_t depth) noexcept;
 
+    void updateTextureLevels(GLTexture* t, uint32_t level) noexcept;
+
+    void setVertexAttributes(GLVertexArray* va, GLVertexBuffer const* eb) noexcept;
+    uint32_t prepareDynamicBuffers(GLRenderPrimitive const* rp) noexcept;
+    bool loadDynamicBuffer(GLenum target, GLuint buffer, GLDynamicBuffer& db,
+            void const* data, Driver::BufferRange const* ranges, uint32_t count) noexcept;
+    static void destroyDynamicBuffer(GLDynamicBuffer& db) noexcept;
+
     /* State tracking GL wrappers... */
 
     constexpr inline size_t getIndexForCap(GLenum cap) noexcept;
@@ -325,10 +381,12 @@ private:
 
     inline void bindBuffer(GLenum target, GLuint buffer) noexcept;
     inline void bindBufferBase(GLenum target, GLuint index, GLuint buffer) noexcept;
+    inline void bindBufferRange(GLenum target, GLuint index, GLuint buffer,
+            GLintptr offset, GLsizeiptr size) noexcept;
 
     inline void bindFramebuffer(GLenum target, GLuint buffer) noexcept;
 
-    inline void bindVertexArray(GLRenderPrimitive const* vao) noexcept;
+    inline void bindVertexArray(GLVertexArray const* va) noexcept;
     inline void enableVertexAttribArray(GLuint index) noexcept;
     inline void disableVertexAttribArray(GLuint index) noexcept;
     inline void enable(GLenum cap) noexcept;
@@ -361,14 +419,39 @@ private:
         return mSamplerBindings;
     }
 
+    // cache of program binaries, its callbacks are null if program binaries aren't supported
+    driver::BlobCache const& getBlobCache() const noexcept { return mBlobCache; }
+
+    // identifies the GL implementation that produced a program binary
+    uint64_t getDriverIdentity() const noexcept { return mDriverIdentity; }
+
     GLsizei getAttachments(std::array<GLenum, 3>& attachments,
             GLRenderTarget const* rt, uint8_t buffers) const noexcept;
 
     static constexpr const size_t MAX_TEXTURE_UNITS = 16;   // All mobile GPUs as of 2016
     static constexpr const size_t MAX_BUFFER_BINDINGS = 32;
 
-    GLRenderPrimitive mDefaultVAO;
+    GLVertexArray mDefaultVAO;
+
+    struct VertexArrayKey {
+        GLVertexBuffer const* vb;
+        GLIndexBuffer const* ib;
+        uint64_t enabledAttributes;
+        bool operator==(VertexArrayKey const& rhs) const noexcept {
+            return vb == rhs.vb && ib == rhs.ib && enabledAttributes == rhs.enabledAttributes;
+        }
+    };
+    tsl::robin_map<VertexArrayKey, GLVertexArray*,
+            utils::hash::MurmurHashFn<VertexArrayKey>> mVertexArrays;
+    GLVertexArray* acquireVertexArray(GLVertexBuffer const* eb, GLIndexBuffer const* ib,
+            uint32_t enabledAttributes) noexcept;
+    void releaseVertexArray(GLVertexArray* va) noexcept;
+    template<typename P>
+    void evictVertexArrays(P predicate) noexcept;
     GLint mMaxRenderBufferSize = 0;
+    GLint mNumProgramBinaryFormats = 0;
+    uint64_t mDriverIdentity = 0;
+    driver::BlobCache mBlobCache;
 
     template <typename T, typename F>
     inline void update_state(T& state, T const& expected, F functor, bool force = false) noexcept {
@@ -388,7 +471,7 @@ private:
         } program;
 
         struct {
-            GLRenderPrimitive* p = nullptr;
+            GLVertexArray* p = nullptr;
         } vao;
 
         struct {
@@ -411,6 +494,9 @@ private:
         struct {
             struct {
                 GLuint buffers[MAX_BUFFER_BINDINGS] = { 0 };
+                // offset and size of the bound range, a size of 0 is the whole buffer
+                GLintptr offsets[MAX_BUFFER_BINDINGS] = { 0 };
+                GLsizeiptr sizes[MAX_BUFFER_BINDINGS] = { 0 };
                 GLuint genericBinding = 0;
             } targets[13];
         } buffers;
@@ -421,7 +507,7 @@ private:
                 GLuint sampler = 0;
                 struct {
                     GLuint texture_id = 0;
-                } targets[5];
+                } targets[6];
             } units[MAX_TEXTURE_UNITS];
         } textures;
 
@@ -486,6 +572,75 @@ private:
     mutable tsl::robin_map<uint32_t, GLuint> mSamplerMap;
     mutable std::vector<GLTexture*> mExternalStreams;
 
+    // timer queries we're waiting the result of, polled at the end of each frame
+    std::vector<GLTimerQuery*> mTimerQueries;
+    void updateTimerQueries() noexcept;
+
+    // readPixels() and readStreamPixels() read into a pixel pack buffer and return immediately.
+    // The pixels are copied to the client's buffer once the fence that follows the read has
+    // signaled, which is polled at the end of each frame, in order.
+    struct PendingReadPixels {
+        GLuint pbo;
+        GLsizeiptr size;
+        GLsync sync;
+        uint32_t width;
+        uint32_t height;
+        bool flip;
+        PixelBufferDescriptor p;
+    };
+    std::vector<PendingReadPixels> mPendingReadPixels;
+    std::vector<std::pair<GLuint, GLsizeiptr>> mFreePixelPackBuffers;
+    void readPixelsAsync(uint32_t x, uint32_t y, uint32_t width, uint32_t height,
+            GLenum format, GLenum type, bool flip, PixelBufferDescriptor&& p) noexcept;
+    void updatePendingReadPixels(bool wait) noexcept;
+    void completeReadPixels(PendingReadPixels& r) noexcept;
+
+    // Texture data is copied into a ring of GL_PIXEL_UNPACK_BUFFER memory before being uploaded,
+    // which lets the client's buffer go right away. Each staged range is followed by a fence,
+    // which is only waited on when the ring wraps around onto a range the GPU may still read.
+    static constexpr size_t STAGING_BUFFER_SIZE = 16u * 1024u * 1024u;
+    struct StagingRange {
+        GLsync sync;
+        size_t begin;
+        size_t end;
+    };
+    GLuint mStagingBuffer = 0;
+    size_t mStagingHead = 0;
+    std::deque<StagingRange> mStagingRanges;
+    void const* stagePixels(void const* data, size_t size) noexcept;
+    void unstagePixels() noexcept;
+
+    // 2D uploads larger than the per-frame budget are split in bands of rows, uploaded over
+    // several frames. A texture's level only becomes visible once all its rows are uploaded.
+    static constexpr size_t TEXTURE_UPLOAD_BUDGET = 4u * 1024u * 1024u;
+    struct PendingUpload {
+        GLTexture* t;
+        uint32_t level;
+        uint32_t xoffset;
+        uint32_t yoffset;
+        uint32_t width;
+        uint32_t height;
+        uint32_t row;       // number of rows already uploaded
+        PixelBufferDescriptor p;
+    };
+    std::deque<PendingUpload> mPendingUploads;
+    size_t mUploadBudget = TEXTURE_UPLOAD_BUDGET;
+    bool hasPendingUploads(GLTexture const* t) const noexcept;
+    void updatePendingUploads() noexcept;
+    void flushPendingUploads(GLTexture const* t) noexcept;
+    void dropPendingUploads(GLTexture const* t) noexcept;
+    bool uploadRows(PendingUpload& u, bool unlimited) noexcept;
+
+    // With an upload context, large uploads of 2D levels that aren't visible yet (so that they
+    // can't be sampled meanwhile) happen on the upload thread. They're retired, i.e. the level
+    // made visible, at the next frame; or right away when the texture is used in other ways.
+    static constexpr size_t BACKGROUND_UPLOAD_SIZE = 256u * 1024u;
+    OpenGLUploader* mUploader = nullptr;
+    uint32_t mBackgroundUploads = 0;
+    void uploadInBackground(GLTexture* t, uint32_t level, uint32_t xoffset, uint32_t yoffset,
+            uint32_t width, uint32_t height, PixelBufferDescriptor&& data) noexcept;
+    void retireBackgroundUploads(bool wait) noexcept;
+
     // supported extensions detected at runtime
     struct {
         bool texture_compression_s3tc = false;
@@ -495,6 +650,10 @@ private:
         bool OES_EGL_image_external_essl3 = false;
         bool EXT_debug_marker = false;
         bool EXT_color_buffer_half_float = false;
+        bool KHR_parallel_shader_compile = false;
+        bool EXT_disjoint_timer_query = false;
+        bool EXT_multisampled_render_to_texture = false;
+        bool OVR_multiview2 = false;
     } ext;
 
     struct {
@@ -525,7 +684,7 @@ private:
     driver::ContextManagerGL& mContextManager;
 
     OpenGLBlitter* mOpenGLBlitter = nullptr;
-    void updateStream(GLTexture* t, driver::DriverApi* driver) noexcept;
+    void updateStream(GLTexture* t) noexcept;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -537,6 +696,7 @@ constexpr size_t OpenGLDriver::getIndexForTextureTarget(GLuint target) noexcept
         case GL_TEXTURE_CUBE_MAP:       return 2;
         case GL_TEXTURE_2D_MULTISAMPLE: return 3;
         case GL_TEXTURE_EXTERNAL_OES:   return 4;
+        case GL_TEXTURE_2D_ARRAY:       return 5;
         default:                        return 0;
     }
 }
@@ -17,8 +17,10 @@
 #include "driver/opengl/OpenGLProgram.h"
 
 #include <cctype>
+#include <memory>
 #include <sstream>
 
+#include <utils/Hash.h>
 #include <utils/Log.h>
 #include <utils/compiler.h>
 #include <utils/Panic.h>
@@ -29,15 +31,244 @@ namespace filament {
 
 using namespace math;
 using namespace utils;
+using namespace driver;
+
+namespace {
+
+// Key of a program binary in the blob cache. The sources include everything that defines the
+// program (material, variant, driver workarounds), the driver identity makes sure we don't
+// reload a binary produced by another GPU or driver version.
+struct ProgramBinaryKey {
+    uint64_t driver;
+    uint64_t sources[Program::NUM_SHADER_TYPES];
+    uint32_t lengths[Program::NUM_SHADER_TYPES];
+};
+
+// Values are stored as the binary format, followed by the binary itself
+struct ProgramBinaryHeader {
+    GLenum format;
+};
+
+ProgramBinaryKey getProgramBinaryKey(uint64_t driver, const Program& programBuilder) noexcept {
+    ProgramBinaryKey key = {};
+    key.driver = driver;
+    const auto& shadersSource = programBuilder.getShadersSource();
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        key.sources[i] = hash::fnv1a(shadersSource[i].c_str(), shadersSource[i].length());
+        key.lengths[i] = uint32_t(shadersSource[i].length());
+    }
+    return key;
+}
+
+GLuint loadProgramBinary(BlobCache const& cache, ProgramBinaryKey const& key) noexcept {
+    const size_t size = cache.retrieve(cache.user, &key, sizeof(key), nullptr, 0);
+    if (size <= sizeof(ProgramBinaryHeader)) {
+        return 0;
+    }
+
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[size]);
+    if (cache.retrieve(cache.user, &key, sizeof(key), blob.get(), size) != size) {
+        return 0;
+    }
+
+    ProgramBinaryHeader header;
+    memcpy(&header, blob.get(), sizeof(header));
+
+    GLint status;
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format,
+            blob.get() + sizeof(header), GLsizei(size - sizeof(header)));
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (UTILS_UNLIKELY(status != GL_TRUE)) {
+        // this is expected after a driver update, we'll just compile the program again
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void storeProgramBinary(BlobCache const& cache, ProgramBinaryKey const& key,
+        GLuint program) noexcept {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    const size_t size = sizeof(ProgramBinaryHeader) + size_t(length);
+    std::unique_ptr<uint8_t[]> blob(new uint8_t[size]);
+    ProgramBinaryHeader header;
+    glGetProgramBinary(program, length, nullptr, &header.format, blob.get() + sizeof(header));
+    memcpy(blob.get(), &header, sizeof(header));
+    cache.insert(cache.user, &key, sizeof(key), blob.get(), size);
+}
+
+} // anonymous namespace
 
-OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) noexcept
+OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, Program&& programBuilder) noexcept
         :  HwProgram(programBuilder.getName()), mIsValid(false) {
+    this->gl.program = 0;
+
+    // Try the cache of program binaries first, the program doesn't have shader objects then.
+    BlobCache const& blobCache = gl->getBlobCache();
+    if (blobCache.retrieve && blobCache.insert) {
+        const ProgramBinaryKey key = getProgramBinaryKey(gl->getDriverIdentity(), programBuilder);
+        const GLuint program = loadProgramBinary(blobCache, key);
+        if (program) {
+            this->gl.program = program;
+            initialize(gl, programBuilder);
+            return;
+        }
+    }
+
+    if (UTILS_UNLIKELY(!compileAndLink(programBuilder, blobCache.insert != nullptr))) {
+        PANIC_LOG("failed to compile glsl program");
+        return;
+    }
+
+    if (gl->ext.KHR_parallel_shader_compile) {
+        // The driver compiles and links the program in the background, querying it now would
+        // block until it's done. We keep what we need to finish the job in isReady().
+        mPendingBuilder.reset(new Program(std::move(programBuilder)));
+        return;
+    }
+    finalize(gl, programBuilder);
+}
+
+bool OpenGLProgram::updatePending(OpenGLDriver* gl) noexcept {
+    GLint status = GL_FALSE;
+    glGetProgramiv(this->gl.program, GL_COMPLETION_STATUS_KHR, &status);
+    if (status != GL_TRUE) {
+        return false;
+    }
+    finalize(gl, *mPendingBuilder);
+    mPendingBuilder.reset();
+    return true;
+}
+
+void OpenGLProgram::finalize(OpenGLDriver* gl, const Program& programBuilder) noexcept {
+    const GLuint program = this->gl.program;
+    const auto& shadersSource = programBuilder.getShadersSource();
+
+    GLint status;
+    bool success = true;
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        if (mValidShaderSet & (1U << i)) {
+            const GLuint shaderId = this->gl.shaders[i];
+            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
+            if (UTILS_UNLIKELY(status != GL_TRUE)) {
+                logCompilationError(slog.e, shaderId, shadersSource[i].c_str());
+                success = false;
+            }
+        }
+    }
+
+    if (success) {
+        glGetProgramiv(program, GL_LINK_STATUS, &status);
+        if (UTILS_UNLIKELY(status != GL_TRUE)) {
+            char error[512];
+            glGetProgramInfoLog(program, sizeof(error), nullptr, error);
+            slog.e << "LINKING: " << error << io::endl;
+            success = false;
+        }
+    }
+
+    // failing to compile a program can't be fatal, because this will happen a lot in
+    // the material tools. We need to have a better way to handle these errors and
+    // return to the editor.
+    if (UTILS_UNLIKELY(!success)) {
+        PANIC_LOG("failed to compile glsl program");
+        return;
+    }
+
+    BlobCache const& blobCache = gl->getBlobCache();
+    if (blobCache.retrieve && blobCache.insert) {
+        storeProgramBinary(blobCache,
+                getProgramBinaryKey(gl->getDriverIdentity(), programBuilder), program);
+    }
 
+    initialize(gl, programBuilder);
+}
+
+void OpenGLProgram::initialize(OpenGLDriver* gl, const Program& programBuilder) noexcept {
+    const GLuint program = this->gl.program;
+
+    // Associate each UniformBlock in the program to a known binding.
+    auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
+    size_t n = uniformInterfaceBlocks.size();
+    #pragma nounroll
+    for (GLuint binding = 0; binding < n; binding++) {
+        auto const& uib = uniformInterfaceBlocks[binding];
+        if (uib != nullptr) {
+            GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
+            if (index >= 0) {
+                glUniformBlockBinding(program, GLuint(index), binding);
+            }
+        }
+    }
+
+    if (programBuilder.hasSamplers()) {
+        // if we have samplers, we need to do a bit of extra work
+        // activate this program so we can set all its samplers once and for all (glUniform1i)
+        gl->useProgram(program);
+
+        auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
+        auto& indicesRun = mIndicesRuns;
+        uint8_t numUsedBindings = 0;
+        uint8_t tmu = 0;
+        #pragma nounroll
+        for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
+            auto const& sib = samplerInterfaceBlocks[i];
+            if (sib != nullptr) {
+                // Cache the sampler uniform locations for each interface block
+                auto const& infos(sib->getSamplerInfoList());
+                if (!infos.empty()) {
+                    BlockInfo& info = mBlockInfos[numUsedBindings];
+                    info.binding = uint8_t(i);
+
+                    // sampler interface block name
+                    std::string sib_name(sib->getName().c_str());
+                    sib_name.front() = char(std::tolower(sib_name.front()));
+
+                    uint8_t count = 0;
+                    for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
+                        // build unique name for this uniform (sampler)
+                        auto const& e = infos[j];
+                        std::string e_name(e.name.c_str());
+                        std::string uniformSamplerName(sib_name + "_" + e_name);
+
+                        // find its location and associate a TMU to it
+                        GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
+                        if (loc >= 0) {
+                            glUniform1i(loc, tmu);
+                            indicesRun[tmu] = j;
+                            count++;
+                            tmu++;
+                        } else {
+                            // glGetUniformLocation could fail if the uniform is not used
+                            // in the program. We should just ignore the error in that case.
+                        }
+                    }
+
+                    if (count > 0) {
+                        numUsedBindings++;
+                        info.count = uint8_t(count - 1);
+                    }
+                }
+            }
+        }
+        mUsedBindingsCount = numUsedBindings;
+    }
+    mIsValid = true;
+}
+
+bool OpenGLProgram::compileAndLink(const Program& programBuilder, bool retrievable) noexcept {
     using Shader = Program::Shader;
 
     const auto& shadersSource = programBuilder.getShadersSource();
 
-    // build all shaders
+    // build all shaders, we don't check the compilation status here as it would wait for the
+    // compiler, this is done by finalize().
     #pragma nounroll
     for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
         GLenum glShaderType;
@@ -52,19 +283,12 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
         }
 
         if (shadersSource[i].length()) {
-            GLint status;
             char const* const source = shadersSource[i].c_str();
 
             GLuint shaderId = glCreateShader(glShaderType);
             glShaderSource(shaderId, 1, &source, nullptr);
             glCompileShader(shaderId);
 
-            glGetShaderiv(shaderId, GL_COMPILE_STATUS, &status);
-            if (UTILS_UNLIKELY(status != GL_TRUE)) {
-                logCompilationError(slog.e, shaderId, source);
-                glDeleteShader(shaderId);
-                return;
-            }
             this->gl.shaders[i] = shaderId;
             mValidShaderSet |= 1U << i;
         }
@@ -73,121 +297,40 @@ OpenGLProgram::OpenGLProgram(OpenGLDriver* gl, const Program& programBuilder) no
     // we need at least a vertex and fragment program
     const uint8_t validShaderSet = mValidShaderSet;
     const uint8_t mask = VERTEX_SHADER_BIT | FRAGMENT_SHADER_BIT;
-    if (UTILS_LIKELY((mValidShaderSet & mask) == mask)) {
-        GLint status;
-        GLuint program = glCreateProgram();
-        for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
-            if (validShaderSet & (1U << i)) {
-                glAttachShader(program, this->gl.shaders[i]);
-            }
-        }
-        glLinkProgram(program);
-
-        glGetProgramiv(program, GL_LINK_STATUS, &status);
-        if (UTILS_UNLIKELY(status != GL_TRUE)) {
-            char error[512];
-            glGetProgramInfoLog(program, sizeof(error), nullptr, error);
-
-            slog.e << "LINKING: " << error << io::endl;
-            glDeleteProgram(program);
-            return;
-        }
-        this->gl.program = program;
-
-        // Associate each UniformBlock in the program to a known binding.
-        auto const& uniformInterfaceBlocks = programBuilder.getUniformInterfaceBlocks();
-        size_t n = uniformInterfaceBlocks.size();
-        #pragma nounroll
-        for (GLuint binding = 0; binding < n; binding++) {
-            auto const& uib = uniformInterfaceBlocks[binding];
-            if (uib != nullptr) {
-                GLint index = glGetUniformBlockIndex(program, uib->getName().c_str());
-                if (index >= 0) {
-                    glUniformBlockBinding(program, GLuint(index), binding);
-                }
-            }
-        }
-
-        if (programBuilder.hasSamplers()) {
-            // if we have samplers, we need to do a bit of extra work
-            // activate this program so we can set all its samplers once and for all (glUniform1i)
-            gl->useProgram(program);
-
-            auto const& samplerInterfaceBlocks = programBuilder.getSamplerInterfaceBlocks();
-            auto& indicesRun = mIndicesRuns;
-            uint8_t numUsedBindings = 0;
-            uint8_t tmu = 0;
-            #pragma nounroll
-            for (size_t i = 0, c = samplerInterfaceBlocks.size(); i < c; i++) {
-                auto const& sib = samplerInterfaceBlocks[i];
-                if (sib != nullptr) {
-                    // Cache the sampler uniform locations for each interface block
-                    auto const& infos(sib->getSamplerInfoList());
-                    if (!infos.empty()) {
-                        BlockInfo& info = mBlockInfos[numUsedBindings];
-                        info.binding = uint8_t(i);
-
-                        // sampler interface block name
-                        std::string sib_name(sib->getName().c_str());
-                        sib_name.front() = char(std::tolower(sib_name.front()));
-
-                        uint8_t count = 0;
-                        for (uint8_t j = 0, m = uint8_t(infos.size()); j < m; ++j) {
-                            // build unique name for this uniform (sampler)
-                            auto const& e = infos[j];
-                            std::string e_name(e.name.c_str());
-                            std::string uniformSamplerName(sib_name + "_" + e_name);
-
-                            // find its location and associate a TMU to it
-                            GLint loc = glGetUniformLocation(program, uniformSamplerName.c_str());
-                            if (loc >= 0) {
-                                glUniform1i(loc, tmu);
-                                indicesRun[tmu] = j;
-                                count++;
-                                tmu++;
-                            } else {
-                                // glGetUniformLocation could fail if the uniform is not used
-                                // in the program. We should just ignore the error in that case.
-                            }
-                        }
+    if (UTILS_UNLIKELY((validShaderSet & mask) != mask)) {
+        return false;
+    }
 
-                        if (count > 0) {
-                            numUsedBindings++;
-                            info.count = uint8_t(count - 1);
-                        }
-                    }
-                }
-            }
-            mUsedBindingsCount = numUsedBindings;
+    GLuint program = glCreateProgram();
+    for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
+        if (validShaderSet & (1U << i)) {
+            glAttachShader(program, this->gl.shaders[i]);
         }
-        mIsValid = true;
     }
-
-    // failing to compile a program can't be fatal, because this will happen a lot in
-    // the material tools. We need to have a better way to handle these errors and
-    // return to the editor.
-    if (UTILS_UNLIKELY(!isValid())) {
-        PANIC_LOG("failed to compile glsl program");
+    if (retrievable) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
+    glLinkProgram(program);
+    this->gl.program = program;
+    return true;
 }
 
 OpenGLProgram::~OpenGLProgram() noexcept {
     const size_t validShaderSet = mValidShaderSet;
-    const bool isValid = mIsValid;
     GLuint program = gl.program;
     if (validShaderSet) {
         #pragma nounroll
         for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
             if (validShaderSet & (1U << i)) {
                 const GLuint shader = gl.shaders[i];
-                if (isValid) {
+                if (program) {
                     glDetachShader(program, shader);
                 }
                 glDeleteShader(shader);
             }
         }
     }
-    if (isValid) {
+    if (program) {
         glDeleteProgram(program);
     }
 }
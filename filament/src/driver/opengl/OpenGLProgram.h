@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include <utils/compiler.h>
@@ -38,11 +39,17 @@ class Program;
 class OpenGLProgram : public HwProgram {
 public:
 
-    OpenGLProgram(OpenGLDriver* gl, const Program& builder) noexcept;
+    OpenGLProgram(OpenGLDriver* gl, Program&& builder) noexcept;
     ~OpenGLProgram() noexcept;
 
     bool isValid() const noexcept { return mIsValid; }
 
+    // Whether the program is done compiling and linking, draws must be skipped until then.
+    // This only returns false when the driver compiles programs in the background.
+    bool isReady(OpenGLDriver* const gl) noexcept {
+        return UTILS_LIKELY(!mPendingBuilder) || updatePending(gl);
+    }
+
     void use(OpenGLDriver* const gl) noexcept {
         if (UTILS_UNLIKELY(mUsedBindingsCount)) {
             // We rely on GL state tracking to avoid unnecessary glBindTexture / glBindSampler
@@ -95,7 +102,22 @@ private:
     // runs of indices into SamplerBuffer -- run start index and size given by BlockInfo
     std::array<uint8_t, NUM_TEXTURE_UNITS> mIndicesRuns;    // 16 bytes
 
+    // compiles the shaders and links them, without waiting for the result
+    bool compileAndLink(const Program& builder, bool retrievable) noexcept;
+
+    // checks the compilation and link status, then calls initialize()
+    void finalize(OpenGLDriver* gl, const Program& builder) noexcept;
+
+    // sets up the uniform blocks and samplers of a linked program
+    void initialize(OpenGLDriver* gl, const Program& builder) noexcept;
+
+    // finalizes the program if the background compilation is done
+    bool updatePending(OpenGLDriver* gl) noexcept;
+
     void updateSamplers(OpenGLDriver* gl) noexcept;
+
+    // kept until the program is finalized when it's compiled in the background
+    std::unique_ptr<Program> mPendingBuilder;
 };
 
 
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/opengl/OpenGLUploader.h"
+
+#include "driver/opengl/GLUtils.h"
+
+#include <utils/JobSystem.h>
+#include <utils/Log.h>
+#include <utils/Systrace.h>
+
+namespace filament {
+
+using namespace driver;
+
+OpenGLUploader::OpenGLUploader(ContextManagerGL& contextManager) noexcept
+        : mContextManager(contextManager) {
+    mThread = std::thread(&OpenGLUploader::loop, this);
+}
+
+OpenGLUploader::~OpenGLUploader() noexcept {
+    std::unique_lock<utils::Mutex> lock(mLock);
+    mExitRequested = true;
+    lock.unlock();
+    mCondition.notify_all();
+    mThread.join();
+}
+
+void OpenGLUploader::push(Upload&& upload) noexcept {
+    std::unique_lock<utils::Mutex> lock(mLock);
+    mQueue.push_back(std::move(upload));
+    lock.unlock();
+    mCondition.notify_all();
+}
+
+std::vector<OpenGLUploader::Upload> OpenGLUploader::retire(bool wait) noexcept {
+    std::unique_lock<utils::Mutex> lock(mLock);
+    if (wait) {
+        mCondition.wait(lock, [this]() { return mQueue.empty() && !mBusy; });
+    }
+    std::vector<Upload> done;
+    std::swap(done, mDone);
+    return done;
+}
+
+void OpenGLUploader::loop() noexcept {
+    utils::JobSystem::setThreadName("OpenGLUploader");
+    if (!mContextManager.makeUploadContextCurrent()) {
+        utils::slog.e << "Unable to make the upload context current" << utils::io::endl;
+    }
+
+    std::unique_lock<utils::Mutex> lock(mLock);
+    while (true) {
+        mCondition.wait(lock, [this]() { return mExitRequested || !mQueue.empty(); });
+        if (mQueue.empty()) {
+            // all the uploads are submitted before exiting
+            break;
+        }
+        Upload u(std::move(mQueue.front()));
+        mQueue.pop_front();
+        mBusy = true;
+        lock.unlock();
+
+        upload(u);
+
+        lock.lock();
+        mBusy = false;
+        mDone.push_back(std::move(u));
+        mCondition.notify_all();
+    }
+    lock.unlock();
+
+    mContextManager.releaseUploadContext();
+}
+
+void OpenGLUploader::upload(Upload& u) noexcept {
+    SYSTRACE_CALL();
+
+    // the texture exists once the driver's commands creating it are done
+    glWaitSync(u.sync, 0, GL_TIMEOUT_IGNORED);
+    glDeleteSync(u.sync);
+
+    PixelBufferDescriptor const& p = u.data;
+
+    // this context's state is only ever changed here
+    glBindTexture(GL_TEXTURE_2D, u.texture);
+    if (p.type == PixelDataType::COMPRESSED) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D,
+                GLint(u.level), GLint(u.xoffset), GLint(u.yoffset),
+                u.width, u.height, u.internalFormat, GLsizei(p.imageSize), p.buffer);
+    } else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, p.stride);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, p.alignment);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, p.left);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, p.top);
+        glTexSubImage2D(GL_TEXTURE_2D,
+                GLint(u.level), GLint(u.xoffset), GLint(u.yoffset),
+                u.width, u.height, GLUtils::getFormat(p.format), GLUtils::getType(p.type),
+                p.buffer);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // the fence must reach the GPU for the driver's context to be able to wait on it
+    u.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+
+    CHECK_GL_ERROR(utils::slog.e)
+}
+
+} // namespace filament
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
+#define TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
+
+#include "driver/opengl/gl_headers.h"
+
+#include <filament/driver/ExternalContext.h>
+#include <filament/driver/PixelBufferDescriptor.h>
+
+#include <utils/compiler.h>
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+
+#include <deque>
+#include <thread>
+#include <vector>
+
+namespace filament {
+
+/*
+ * Uploads texture data on a background thread, using the context manager's upload context,
+ * which shares its objects with the driver's context. Uploads are submitted in order.
+ *
+ * The driver inserts a fence after the commands creating the texture, which the upload thread
+ * waits on; the upload thread inserts a fence after each upload, which the driver waits on
+ * before the upload is retired, i.e. before the texture level it wrote is used.
+ */
+class OpenGLUploader {
+public:
+    struct Upload {
+        void* user;             // opaque to the uploader, the driver's texture
+        GLuint texture;
+        GLenum internalFormat;  // only used for compressed data
+        uint32_t level;
+        uint32_t xoffset;
+        uint32_t yoffset;
+        uint32_t width;
+        uint32_t height;
+        driver::PixelBufferDescriptor data;
+        GLsync sync;            // ready to upload, then upload done
+    };
+
+    explicit OpenGLUploader(driver::ContextManagerGL& contextManager) noexcept;
+    ~OpenGLUploader() noexcept;
+
+    OpenGLUploader(OpenGLUploader const& rhs) = delete;
+    OpenGLUploader& operator=(OpenGLUploader const& rhs) = delete;
+
+    // Queues an upload, called on the driver thread which must have flushed upload.sync.
+    void push(Upload&& upload) noexcept;
+
+    // Returns the uploads submitted by the upload thread, in order. With wait, returns once all
+    // the queued uploads are submitted.
+    std::vector<Upload> retire(bool wait) noexcept;
+
+private:
+    void loop() noexcept;
+    static void upload(Upload& u) noexcept;
+
+    driver::ContextManagerGL& mContextManager;
+    utils::Mutex mLock;
+    utils::Condition mCondition;
+    std::deque<Upload> mQueue;
+    std::vector<Upload> mDone;
+    bool mBusy = false;
+    bool mExitRequested = false;
+    std::thread mThread;
+};
+
+} // namespace filament
+
+#endif // TNT_FILAMENT_DRIVER_OPENGLUPLOADER_H
@@ -33,6 +33,16 @@ PFNGLINSERTEVENTMARKEREXTPROC glInsertEventMarkerEXT;
 PFNGLPUSHGROUPMARKEREXTPROC glPushGroupMarkerEXT;
 PFNGLPOPGROUPMARKEREXTPROC glPopGroupMarkerEXT;
 #endif
+#if GL_EXT_disjoint_timer_query
+PFNGLGETQUERYOBJECTUI64VEXTPROC glGetQueryObjectui64vEXT;
+#endif
+#ifdef GL_EXT_multisampled_render_to_texture
+PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC glRenderbufferStorageMultisampleEXT;
+PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC glFramebufferTexture2DMultisampleEXT;
+#endif
+#ifdef GL_OVR_multiview
+PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC glFramebufferTextureMultiviewOVR;
+#endif
 };
 
 using namespace glext;
@@ -70,6 +80,28 @@ public:
                 (PFNGLPOPGROUPMARKEREXTPROC)eglGetProcAddress(
                         "glPopGroupMarkerEXT");
 #endif
+
+#if GL_EXT_disjoint_timer_query
+        glGetQueryObjectui64vEXT =
+                (PFNGLGETQUERYOBJECTUI64VEXTPROC)eglGetProcAddress(
+                        "glGetQueryObjectui64vEXT");
+#endif
+
+#ifdef GL_EXT_multisampled_render_to_texture
+        glRenderbufferStorageMultisampleEXT =
+                (PFNGLRENDERBUFFERSTORAGEMULTISAMPLEEXTPROC)eglGetProcAddress(
+                        "glRenderbufferStorageMultisampleEXT");
+
+        glFramebufferTexture2DMultisampleEXT =
+                (PFNGLFRAMEBUFFERTEXTURE2DMULTISAMPLEEXTPROC)eglGetProcAddress(
+                        "glFramebufferTexture2DMultisampleEXT");
+#endif
+
+#ifdef GL_OVR_multiview
+        glFramebufferTextureMultiviewOVR =
+                (PFNGLFRAMEBUFFERTEXTUREMULTIVIEWOVRPROC)eglGetProcAddress(
+                        "glFramebufferTextureMultiviewOVR");
+#endif
     }
 } instance;
 } // namespace filament
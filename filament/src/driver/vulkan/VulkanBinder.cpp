@@ -19,6 +19,8 @@
 #include <utils/Panic.h>
 #include <utils/trap.h>
 
+#include <stddef.h>
+
 #define FILAMENT_VULKAN_VERBOSE 0
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
@@ -40,9 +42,39 @@ static constexpr VkAllocationCallbacks* VKALLOC = nullptr;
 // - Allow multiple descriptors to bind simultaneously; organize binding points into groups.
 static constexpr uint32_t MAX_NUM_DESCRIPTORS = 1000;
 
+// Number of descriptor sets of each of the pools of transient descriptor sets.
+static constexpr uint32_t MAX_NUM_TRANSIENT_DESCRIPTORS = 128;
+
+// Default maximum number of cached pipelines.
+static constexpr uint32_t MAX_NUM_PIPELINES = 1000;
+
 static VulkanBinder::RasterState createDefaultRasterState();
 
-VulkanBinder::VulkanBinder() : mDefaultRasterState(createDefaultRasterState()) {
+// Returns the timestamp under which the unbound entries of a cache are evicted so that it doesn't
+// hold more than maxCount entries. Only entries older than safeTime are candidates, so the result
+// is never more than safeTime, and never less than evictTime.
+template<typename Cache>
+static uint32_t getEvictionTime(Cache const& cache, uint32_t maxCount, uint32_t evictTime,
+        uint32_t safeTime) {
+    if (cache.size() <= maxCount) {
+        return evictTime;
+    }
+    std::vector<uint32_t> timestamps;
+    for (auto const& entry : cache) {
+        if (!entry.second.bound && entry.second.timestamp < safeTime) {
+            timestamps.push_back(entry.second.timestamp);
+        }
+    }
+    const size_t count = std::min(cache.size() - maxCount, timestamps.size());
+    if (count == 0) {
+        return evictTime;
+    }
+    std::nth_element(timestamps.begin(), timestamps.begin() + count - 1, timestamps.end());
+    return std::max(evictTime, timestamps[count - 1] + 1);
+}
+
+VulkanBinder::VulkanBinder() : mDefaultRasterState(createDefaultRasterState()),
+        mMaxPipelines(MAX_NUM_PIPELINES), mMaxDescriptorSets(MAX_NUM_DESCRIPTORS) {
     mColorBlendState = VkPipelineColorBlendStateCreateInfo{};
     mColorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
     mColorBlendState.attachmentCount = 1;
@@ -89,6 +121,7 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
     // value method for obtaining a stable reference.
     auto iter = mDescriptorSets.find(mDescriptorKey);
     if (UTILS_LIKELY(iter != mDescriptorSets.end())) {
+        mDescriptorStats.hits++;
         mCurrentDescriptor = &iter.value();
         *descriptor = mCurrentDescriptor->handle;
         mCurrentDescriptor->timestamp = mCurrentTime;
@@ -102,63 +135,96 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
     }
 
     // If we reach this point, we need to create and stash a brand new descriptor set.
-    ASSERT_POSTCONDITION(mDescriptorSets.size() < MAX_NUM_DESCRIPTORS, "Too many descriptors.");
-
-    // Allocate descriptor (does not need explicit destruction)
-    VkDescriptorSetAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    allocInfo.descriptorPool = mDescriptorPool;
-    allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &mDescriptorSetLayout;
-    VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptor);
-    ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+    mDescriptorStats.misses++;
     *pipelineLayout = mPipelineLayout;
 
-    // Here we construct a DescriptorVal in place, then stash its pointer to allow fast subsequent
-    // calls to getOrCreateDescriptor when nothing has been dirtied. Note that the robin_map
-    // iterator type proffers a "value" method, which returns a stable reference.
-    mCurrentDescriptor = &mDescriptorSets.emplace(std::make_pair(mDescriptorKey, DescriptorVal {
-        *descriptor, mCurrentTime, true })).first.value();
+    // The sets in the graveyard come out of the same pool as the cached ones. When the pool is
+    // full, the set is allocated for this frame only instead of being cached.
+    if (mDescriptorSets.size() + mDescriptorGraveyard.size() < MAX_NUM_DESCRIPTORS) {
+        // Allocate descriptor (does not need explicit destruction)
+        VkDescriptorSetAllocateInfo allocInfo = {};
+        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        allocInfo.descriptorPool = mDescriptorPool;
+        allocInfo.descriptorSetCount = 1;
+        allocInfo.pSetLayouts = &mDescriptorSetLayout;
+        VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, descriptor);
+        ASSERT_POSTCONDITION(!err, "Unable to allocate descriptor set.");
+
+        // Here we construct a DescriptorVal in place, then stash its pointer to allow fast
+        // subsequent calls to getOrCreateDescriptor when nothing has been dirtied. Note that the
+        // robin_map iterator type proffers a "value" method, which returns a stable reference.
+        mCurrentDescriptor = &mDescriptorSets.emplace(std::make_pair(mDescriptorKey,
+                DescriptorVal { *descriptor, mCurrentTime, true })).first.value();
+    } else {
+        *descriptor = allocateTransientDescriptor();
+        mTransientDescriptor = { *descriptor, mCurrentTime, true };
+        mCurrentDescriptor = &mTransientDescriptor;
+    }
     mDirtyDescriptor = false;
 
-    // Mutate the descriptor by setting all non-null bindings.
-    uint32_t& nwrites = mDescriptorUpdateOp.count;
-    VkWriteDescriptorSet* writes = &mDescriptorUpdateOp.writes[0];
-    nwrites = 0;
+    updateDescriptor(*descriptor, changes);
+    return true;
+}
+
+// Mutates the descriptor by setting all non-null bindings.
+void VulkanBinder::updateDescriptor(VkDescriptorSet descriptor,
+        DescriptorUpdateOp** changes) noexcept {
+    DescriptorInfos& infos = mDescriptorInfos;
+    BindingMask bindings = 0;
     for (uint32_t binding = 0; binding < NUM_UBUFFER_BINDINGS; binding++) {
         if (mDescriptorKey.uniformBuffers[binding]) {
-            VkDescriptorBufferInfo& bufferInfo = mDescriptorBuffers[binding];
+            VkDescriptorBufferInfo& bufferInfo = infos.uniformBuffers[binding];
             bufferInfo.buffer = mDescriptorKey.uniformBuffers[binding];
-            bufferInfo.offset = 0;
-            bufferInfo.range = VK_WHOLE_SIZE;
-            VkWriteDescriptorSet& writeInfo = writes[nwrites++];
-            writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptor->handle;
-            writeInfo.dstBinding = binding;
-            writeInfo.dstArrayElement = 0;
-            writeInfo.descriptorCount = 1;
-            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            writeInfo.pImageInfo = nullptr;
-            writeInfo.pBufferInfo = &bufferInfo;
-            writeInfo.pTexelBufferView = nullptr;
+            bufferInfo.offset = mDescriptorKey.uniformBufferOffsets[binding];
+            bufferInfo.range = mDescriptorKey.uniformBufferSizes[binding];
+            bindings |= 1u << binding;
         }
     }
     for (uint32_t binding = 0; binding < NUM_SAMPLER_BINDINGS; binding++) {
         if (mDescriptorKey.samplers[binding].sampler) {
-            VkDescriptorImageInfo& imageInfo = mDescriptorSamplers[binding];
-            imageInfo = mDescriptorKey.samplers[binding];
-            VkWriteDescriptorSet& writeInfo = writes[nwrites++];
-            writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeInfo.pNext = nullptr;
-            writeInfo.dstSet = mCurrentDescriptor->handle;
-            writeInfo.dstBinding = NUM_UBUFFER_BINDINGS + binding;
-            writeInfo.dstArrayElement = 0;
-            writeInfo.descriptorCount = 1;
+            infos.samplers[binding] = mDescriptorKey.samplers[binding];
+            bindings |= 1u << (NUM_UBUFFER_BINDINGS + binding);
+        }
+    }
+    if (mDescriptorKey.inputAttachment.imageView) {
+        infos.inputAttachment = mDescriptorKey.inputAttachment;
+        bindings |= 1u << INPUT_ATTACHMENT_BINDING;
+    }
+
+    // A template writes the whole set from the infos in a single call, without the driver having
+    // to go through a list of writes each time.
+    if (!changes && mUseUpdateTemplates) {
+        vkUpdateDescriptorSetWithTemplateKHR(mDevice, descriptor,
+                getOrCreateUpdateTemplate(bindings), &infos);
+        return;
+    }
+
+    uint32_t& nwrites = mDescriptorUpdateOp.count;
+    VkWriteDescriptorSet* writes = &mDescriptorUpdateOp.writes[0];
+    nwrites = 0;
+    for (uint32_t binding = 0; binding <= INPUT_ATTACHMENT_BINDING; binding++) {
+        if (!(bindings & (1u << binding))) {
+            continue;
+        }
+        VkWriteDescriptorSet& writeInfo = writes[nwrites++];
+        writeInfo.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeInfo.pNext = nullptr;
+        writeInfo.dstSet = descriptor;
+        writeInfo.dstBinding = binding;
+        writeInfo.dstArrayElement = 0;
+        writeInfo.descriptorCount = 1;
+        writeInfo.pImageInfo = nullptr;
+        writeInfo.pBufferInfo = nullptr;
+        writeInfo.pTexelBufferView = nullptr;
+        if (binding < NUM_UBUFFER_BINDINGS) {
+            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeInfo.pBufferInfo = &infos.uniformBuffers[binding];
+        } else if (binding < INPUT_ATTACHMENT_BINDING) {
             writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            writeInfo.pImageInfo = &imageInfo;
-            writeInfo.pBufferInfo = nullptr;
-            writeInfo.pTexelBufferView = nullptr;
+            writeInfo.pImageInfo = &infos.samplers[binding - NUM_UBUFFER_BINDINGS];
+        } else {
+            writeInfo.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            writeInfo.pImageInfo = &infos.inputAttachment;
         }
     }
     if (changes) {
@@ -166,7 +232,80 @@ bool VulkanBinder::getOrCreateDescriptor(VkDescriptorSet* descriptor,
     } else {
         vkUpdateDescriptorSets(mDevice, nwrites, writes, 0, nullptr);
     }
-    return true;
+}
+
+// Returns the template that writes the given bindings from a DescriptorInfos. There is one for
+// each combination of bindings used by the programs, which in practice is a handful.
+VkDescriptorUpdateTemplateKHR VulkanBinder::getOrCreateUpdateTemplate(
+        BindingMask bindings) noexcept {
+    auto iter = mUpdateTemplates.find(bindings);
+    if (UTILS_LIKELY(iter != mUpdateTemplates.end())) {
+        return iter->second;
+    }
+
+    VkDescriptorUpdateTemplateEntryKHR entries[INPUT_ATTACHMENT_BINDING + 1];
+    uint32_t count = 0;
+    for (uint32_t binding = 0; binding <= INPUT_ATTACHMENT_BINDING; binding++) {
+        if (!(bindings & (1u << binding))) {
+            continue;
+        }
+        VkDescriptorUpdateTemplateEntryKHR& entry = entries[count++];
+        entry.dstBinding = binding;
+        entry.dstArrayElement = 0;
+        entry.descriptorCount = 1;
+        if (binding < NUM_UBUFFER_BINDINGS) {
+            entry.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            entry.offset = offsetof(DescriptorInfos, uniformBuffers) +
+                    binding * sizeof(VkDescriptorBufferInfo);
+            entry.stride = sizeof(VkDescriptorBufferInfo);
+        } else if (binding < INPUT_ATTACHMENT_BINDING) {
+            entry.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            entry.offset = offsetof(DescriptorInfos, samplers) +
+                    (binding - NUM_UBUFFER_BINDINGS) * sizeof(VkDescriptorImageInfo);
+            entry.stride = sizeof(VkDescriptorImageInfo);
+        } else {
+            entry.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            entry.offset = offsetof(DescriptorInfos, inputAttachment);
+            entry.stride = sizeof(VkDescriptorImageInfo);
+        }
+    }
+
+    VkDescriptorUpdateTemplateCreateInfoKHR createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO_KHR;
+    createInfo.descriptorUpdateEntryCount = count;
+    createInfo.pDescriptorUpdateEntries = entries;
+    createInfo.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET_KHR;
+    createInfo.descriptorSetLayout = mDescriptorSetLayout;
+    VkDescriptorUpdateTemplateKHR updateTemplate;
+    VkResult err = vkCreateDescriptorUpdateTemplateKHR(mDevice, &createInfo, VKALLOC,
+            &updateTemplate);
+    ASSERT_POSTCONDITION(!err, "Unable to create descriptor update template.");
+    mUpdateTemplates.emplace(bindings, updateTemplate);
+    return updateTemplate;
+}
+
+// Allocates a descriptor set from the pools of the current frame.
+VkDescriptorSet VulkanBinder::allocateTransientDescriptor() noexcept {
+    TransientPools& transient = mTransientPools[mCurrentTime % NUM_TRANSIENT_POOLS];
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &mDescriptorSetLayout;
+    VkDescriptorSet descriptor;
+    while (true) {
+        if (transient.current == transient.pools.size()) {
+            transient.pools.push_back(createDescriptorPool(MAX_NUM_TRANSIENT_DESCRIPTORS, 0));
+        }
+        allocInfo.descriptorPool = transient.pools[transient.current];
+        VkResult err = vkAllocateDescriptorSets(mDevice, &allocInfo, &descriptor);
+        if (UTILS_LIKELY(!err)) {
+            return descriptor;
+        }
+        // the pool is full, move on to the next one
+        ASSERT_POSTCONDITION(err == VK_ERROR_OUT_OF_POOL_MEMORY_KHR ||
+                err == VK_ERROR_FRAGMENTED_POOL, "Unable to allocate descriptor set.");
+        transient.current++;
+    }
 }
 
 bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
@@ -193,6 +332,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     // method for obtaining a stable reference.
     auto iter = mPipelines.find(mPipelineKey);
     if (UTILS_LIKELY(iter != mPipelines.end())) {
+        mPipelineStats.hits++;
         mCurrentPipeline = &iter.value();
         *pipeline = mCurrentPipeline->handle;
         mCurrentPipeline->timestamp = mCurrentTime;
@@ -202,6 +342,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     }
 
     // If we reach this point, we need to create and stash a brand new pipeline object.
+    mPipelineStats.misses++;
     mShaderStages[0].module = mPipelineKey.shaders[0];
     mShaderStages[1].module = mPipelineKey.shaders[1];
 
@@ -249,6 +390,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
     pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
     pipelineCreateInfo.layout = mPipelineLayout;
     pipelineCreateInfo.renderPass = mPipelineKey.renderPass;
+    pipelineCreateInfo.subpass = mPipelineKey.subpassIndex;
     pipelineCreateInfo.stageCount = hasFragmentShader ? NUM_SHADER_MODULES : 1;
     pipelineCreateInfo.pStages = mShaderStages;
     pipelineCreateInfo.pVertexInputState = &vertexInputState;
@@ -268,7 +410,7 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
             << mShaderStages[0].module << ", " << mShaderStages[1].module << ")" << utils::io::endl;
     #endif
 
-    VkResult err = vkCreateGraphicsPipelines(mDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo,
+    VkResult err = vkCreateGraphicsPipelines(mDevice, mPipelineCache, 1, &pipelineCreateInfo,
             VKALLOC, pipeline);
     if (err) {
         utils::slog.e << "vkCreateGraphicsPipelines error " << err << utils::io::endl;
@@ -286,6 +428,8 @@ bool VulkanBinder::getOrCreatePipeline(VkPipeline* pipeline) noexcept {
 
 void VulkanBinder::bindProgramBundle(const ProgramBundle& bundle) noexcept {
     const VkShaderModule shaders[2] = { bundle.vertex, bundle.fragment };
+    mShaderStages[0].pSpecializationInfo = bundle.specialization;
+    mShaderStages[1].pSpecializationInfo = bundle.specialization;
     for (uint32_t ssi = 0; ssi < NUM_SHADER_MODULES; ssi++) {
         if (mPipelineKey.shaders[ssi] != shaders[ssi]) {
             mDirtyPipeline = true;
@@ -328,6 +472,13 @@ void VulkanBinder::bindRenderPass(VkRenderPass renderPass) noexcept {
     }
 }
 
+void VulkanBinder::bindSubpass(uint32_t subpassIndex) noexcept {
+    if (mPipelineKey.subpassIndex != subpassIndex) {
+        mDirtyPipeline = true;
+        mPipelineKey.subpassIndex = subpassIndex;
+    }
+}
+
 void VulkanBinder::bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept {
     if (mPipelineKey.topology != topology) {
         mDirtyPipeline = true;
@@ -384,13 +535,17 @@ void VulkanBinder::unbindImageView(VkImageView imageView) noexcept {
             mDirtyDescriptor = true;
         }
     }
+    if (mDescriptorKey.inputAttachment.imageView == imageView) {
+        mDescriptorKey.inputAttachment = {};
+        mDirtyDescriptor = true;
+    }
     evictDescriptors([imageView] (const DescriptorKey& key) {
         for (const auto& binding : key.samplers) {
             if (binding.imageView == imageView) {
                 return true;
             }
         }
-        return false;
+        return key.inputAttachment.imageView == imageView;
     });
 }
 
@@ -411,10 +566,15 @@ void VulkanBinder::evictDescriptors(std::function<bool(const DescriptorKey&)> fi
     }
 }
 
-void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept {
+void VulkanBinder::bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
+        VkDeviceSize offset, VkDeviceSize size) noexcept {
     assert(bindingIndex < NUM_UBUFFER_BINDINGS);
-    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer) {
+    if (mDescriptorKey.uniformBuffers[bindingIndex] != uniformBuffer ||
+            mDescriptorKey.uniformBufferOffsets[bindingIndex] != offset ||
+            mDescriptorKey.uniformBufferSizes[bindingIndex] != size) {
         mDescriptorKey.uniformBuffers[bindingIndex] = uniformBuffer;
+        mDescriptorKey.uniformBufferOffsets[bindingIndex] = offset;
+        mDescriptorKey.uniformBufferSizes[bindingIndex] = size;
         mDirtyDescriptor = true;
     }
 }
@@ -431,6 +591,15 @@ void VulkanBinder::bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo samp
     }
 }
 
+void VulkanBinder::bindInputAttachment(VkDescriptorImageInfo attachmentInfo) noexcept {
+    VkDescriptorImageInfo& imageInfo = mDescriptorKey.inputAttachment;
+    if (imageInfo.imageView != attachmentInfo.imageView ||
+        imageInfo.imageLayout != attachmentInfo.imageLayout) {
+        imageInfo = attachmentInfo;
+        mDirtyDescriptor = true;
+    }
+}
+
 void VulkanBinder::destroyCache() noexcept {
     // Symmetric to createLayoutsAndDescriptors.
     destroyLayoutsAndDescriptors();
@@ -442,29 +611,68 @@ void VulkanBinder::destroyCache() noexcept {
     mDirtyPipeline = true;
 }
 
+void VulkanBinder::setCacheLimits(uint32_t maxPipelines, uint32_t maxDescriptorSets) noexcept {
+    mMaxPipelines = maxPipelines;
+    mMaxDescriptorSets = std::min(maxDescriptorSets, MAX_NUM_DESCRIPTORS);
+}
+
 void VulkanBinder::resetBindings() noexcept {
     mDirtyPipeline = true;
     mDirtyDescriptor = true;
 }
 
+void VulkanBinder::copyBindings(VulkanBinder const& other) noexcept {
+    mPipelineKey = other.mPipelineKey;
+    mDescriptorKey = other.mDescriptorKey;
+    for (uint32_t ssi = 0; ssi < NUM_SHADER_MODULES; ssi++) {
+        mShaderStages[ssi].pSpecializationInfo = other.mShaderStages[ssi].pSpecializationInfo;
+    }
+    resetBindings();
+}
+
 // Frees up old descriptor sets and pipelines, then nulls out their key.
 void VulkanBinder::gc() noexcept {
     // This method is designed to be called once per frame, and our notion of "time" is actually a
     // frame counter. Frames are a better metric than wall clock because we know with certainty that
     // objects last bound more than n frames ago are no longer in use (due to existing fences).
     mCurrentTime++;
+
+    // The transient descriptor sets of this frame are recycled from a frame old enough that they
+    // can't be in use anymore. resetBindings() was called, so none of them is bound.
+    TransientPools& transient = mTransientPools[mCurrentTime % NUM_TRANSIENT_POOLS];
+    for (VkDescriptorPool pool : transient.pools) {
+        vkResetDescriptorPool(mDevice, pool, 0);
+    }
+    transient.current = 0;
+    if (mCurrentDescriptor == &mTransientDescriptor) {
+        mCurrentDescriptor = nullptr;
+        mDirtyDescriptor = true;
+    }
+
     // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
-    if (mCurrentTime <= TIME_BEFORE_EVICTION) {
+    if (mCurrentTime <= MIN_TIME_BEFORE_EVICTION) {
         return;
     }
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
+    const uint32_t safeTime = mCurrentTime - MIN_TIME_BEFORE_EVICTION;
+    const uint32_t evictTime = mCurrentTime > mTimeBeforeEviction ?
+            mCurrentTime - mTimeBeforeEviction : 0;
+
+    // The descriptor sets in the graveyard come out of the same pool.
+    const uint32_t maxDescriptorSets = mMaxDescriptorSets -
+            std::min(mMaxDescriptorSets, uint32_t(mDescriptorGraveyard.size()));
+    const uint32_t descriptorEvictTime = getEvictionTime(mDescriptorSets, maxDescriptorSets,
+            evictTime, safeTime);
+    const uint32_t pipelineEvictTime = getEvictionTime(mPipelines, mMaxPipelines,
+            evictTime, safeTime);
+
     // Due to robin_map restrictions, we cannot use auto or a range-based loop.
     for (decltype(mDescriptorSets)::const_iterator iter = mDescriptorSets.begin();
             iter != mDescriptorSets.end();) {
         auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
+        if (cacheEntry.timestamp < descriptorEvictTime && !cacheEntry.bound) {
             vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &cacheEntry.handle);
             iter = mDescriptorSets.erase(iter);
+            mDescriptorStats.evictions++;
         } else {
             ++iter;
         }
@@ -472,9 +680,10 @@ void VulkanBinder::gc() noexcept {
     for (decltype(mPipelines)::const_iterator iter = mPipelines.begin();
             iter != mPipelines.end();) {
         auto& cacheEntry = iter->second;
-        if (cacheEntry.timestamp < evictTime && !cacheEntry.bound) {
+        if (cacheEntry.timestamp < pipelineEvictTime && !cacheEntry.bound) {
             vkDestroyPipeline(mDevice, cacheEntry.handle, VKALLOC);
             iter = mPipelines.erase(iter);
+            mPipelineStats.evictions++;
         } else {
             ++iter;
         }
@@ -485,7 +694,7 @@ void VulkanBinder::gc() noexcept {
     decltype(mDescriptorGraveyard) graveyard;
     graveyard.swap(mDescriptorGraveyard);
     for (auto& val : graveyard) {
-        if (val.timestamp < evictTime) {
+        if (val.timestamp < safeTime) {
            vkFreeDescriptorSets(mDevice, mDescriptorPool, 1, &val.handle);
         } else {
             mDescriptorGraveyard.emplace_back(DescriptorVal {
@@ -497,7 +706,7 @@ void VulkanBinder::gc() noexcept {
 }
 
 void VulkanBinder::createLayoutsAndDescriptors() noexcept {
-    VkDescriptorSetLayoutBinding bindings[NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS];
+    VkDescriptorSetLayoutBinding bindings[NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS + 1];
     VkDescriptorSetLayoutBinding binding = {};
     binding.descriptorCount = 1; // NOTE: We never use arrays-of-blocks.
     binding.stageFlags = VK_SHADER_STAGE_ALL_GRAPHICS; // NOTE: This is potentially non-optimal.
@@ -516,10 +725,16 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
         bindings[binding.binding] = binding;
     }
 
+    // The last slot is the input attachment of the subpasses that read the previous one's color.
+    binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    binding.binding = INPUT_ATTACHMENT_BINDING;
+    bindings[binding.binding] = binding;
+
     // Create the one and only VkDescriptorSetLayout that we'll ever use.
     VkDescriptorSetLayoutCreateInfo dlinfo = {};
     dlinfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    dlinfo.bindingCount = NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS;
+    dlinfo.bindingCount = NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS + 1;
     dlinfo.pBindings = &bindings[0];
     VkResult err = vkCreateDescriptorSetLayout(mDevice, &dlinfo, VKALLOC, &mDescriptorSetLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create descriptor set layout.");
@@ -532,21 +747,30 @@ void VulkanBinder::createLayoutsAndDescriptors() noexcept {
     err = vkCreatePipelineLayout(mDevice, &pPipelineLayoutCreateInfo, VKALLOC, &mPipelineLayout);
     ASSERT_POSTCONDITION(!err, "Unable to create pipeline layout.");
 
-    // Create the VkDescriptorPool.
-    VkDescriptorPoolSize poolSizes[2] = {};
+    mDescriptorPool = createDescriptorPool(MAX_NUM_DESCRIPTORS,
+            VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT);
+}
+
+VkDescriptorPool VulkanBinder::createDescriptorPool(uint32_t maxSets,
+        VkDescriptorPoolCreateFlags flags) {
+    VkDescriptorPoolSize poolSizes[3] = {};
     VkDescriptorPoolCreateInfo poolInfo {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .poolSizeCount = 2,
+        .poolSizeCount = 3,
         .pPoolSizes = &poolSizes[0],
-        .maxSets = MAX_NUM_DESCRIPTORS,
-        .flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT
+        .maxSets = maxSets,
+        .flags = flags
     };
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[0].descriptorCount = poolInfo.maxSets * NUM_UBUFFER_BINDINGS;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
     poolSizes[1].descriptorCount = poolInfo.maxSets * NUM_SAMPLER_BINDINGS;
-    err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &mDescriptorPool);
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+    poolSizes[2].descriptorCount = poolInfo.maxSets;
+    VkDescriptorPool pool;
+    VkResult err = vkCreateDescriptorPool(mDevice, &poolInfo, VKALLOC, &pool);
     ASSERT_POSTCONDITION(!err, "Unable to create descriptor pool.");
+    return pool;
 }
 
 void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
@@ -562,12 +786,23 @@ void VulkanBinder::destroyLayoutsAndDescriptors() noexcept {
     #endif
 
     mDescriptorSets.clear();
+    for (auto& iter : mUpdateTemplates) {
+        vkDestroyDescriptorUpdateTemplateKHR(mDevice, iter.second, VKALLOC);
+    }
+    mUpdateTemplates.clear();
     vkDestroyPipelineLayout(mDevice, mPipelineLayout, VKALLOC);
     mPipelineLayout = VK_NULL_HANDLE;
     vkDestroyDescriptorSetLayout(mDevice, mDescriptorSetLayout, VKALLOC);
     mDescriptorSetLayout = VK_NULL_HANDLE;
     vkDestroyDescriptorPool(mDevice, mDescriptorPool, VKALLOC);
     mDescriptorPool = VK_NULL_HANDLE;
+    for (TransientPools& transient : mTransientPools) {
+        for (VkDescriptorPool pool : transient.pools) {
+            vkDestroyDescriptorPool(mDevice, pool, VKALLOC);
+        }
+        transient.pools.clear();
+        transient.current = 0;
+    }
     mCurrentDescriptor = nullptr;
     mDirtyDescriptor = true;
 }
@@ -580,7 +815,9 @@ bool VulkanBinder::PipelineEqual::operator()(const VulkanBinder::PipelineKey& k1
 bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
         const VulkanBinder::DescriptorKey& k2) const {
     for (uint32_t i = 0; i < NUM_UBUFFER_BINDINGS; i++) {
-        if (k1.uniformBuffers[i] != k2.uniformBuffers[i]) {
+        if (k1.uniformBuffers[i] != k2.uniformBuffers[i] ||
+            k1.uniformBufferOffsets[i] != k2.uniformBufferOffsets[i] ||
+            k1.uniformBufferSizes[i] != k2.uniformBufferSizes[i]) {
             return false;
         }
     }
@@ -591,7 +828,8 @@ bool VulkanBinder::DescEqual::operator()(const VulkanBinder::DescriptorKey& k1,
             return false;
         }
     }
-    return true;
+    return k1.inputAttachment.imageView == k2.inputAttachment.imageView &&
+            k1.inputAttachment.imageLayout == k2.inputAttachment.imageLayout;
 }
 
 static VulkanBinder::RasterState createDefaultRasterState() {
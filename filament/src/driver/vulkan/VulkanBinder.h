@@ -23,6 +23,8 @@
 #include <utils/Hash.h>
 
 #include <tsl/robin_map.h>
+
+#include <algorithm>
 #include <vector>
 
 namespace filament {
@@ -71,8 +73,11 @@ class VulkanBinder {
 public:
     static constexpr uint32_t NUM_UBUFFER_BINDINGS = filament::BindingPoints::COUNT;
     static constexpr uint32_t NUM_SAMPLER_BINDINGS = 8;
+    static constexpr uint32_t INPUT_ATTACHMENT_BINDING = filament::SUBPASS_INPUT_BINDING;
     static constexpr uint32_t NUM_SHADER_MODULES = 2;
     static constexpr uint32_t MAX_VERTEX_ATTRIBUTES = filament::ATTRIBUTE_INDEX_COUNT;
+    static_assert(INPUT_ATTACHMENT_BINDING == NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS,
+            "The input attachment must follow the samplers in the descriptor set.");
 
     // The VertexArray POD is an array of buffer targets and an array of attributes that refer to
     // those targets. It does not include any references to actual buffers, so you can think of it
@@ -83,10 +88,13 @@ public:
         VkVertexInputBindingDescription buffers[MAX_VERTEX_ATTRIBUTES];
     };
 
-    // The ProgramBundle contains weak references to the compiled vertex and fragment shaders.
+    // The ProgramBundle contains weak references to the compiled vertex and fragment shaders, and
+    // to the values of their specialization constants (null when the defaults are used). Since the
+    // values belong to the shader modules, they don't need to be part of the pipeline key.
     struct ProgramBundle {
         VkShaderModule vertex;
         VkShaderModule fragment;
+        const VkSpecializationInfo* specialization;
     };
 
     // The RasterState POD contains standard graphics-related state like blending, culling, etc.
@@ -103,7 +111,7 @@ public:
     // Encapsulates the arguments passed to vkUpdateDescriptorSets.
     struct DescriptorUpdateOp {
         uint32_t count;
-        VkWriteDescriptorSet writes[NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS];
+        VkWriteDescriptorSet writes[NUM_UBUFFER_BINDINGS + NUM_SAMPLER_BINDINGS + 1];
     };
 
     // Upon construction, the binder initializes some internal state but does not make any Vulkan
@@ -114,6 +122,13 @@ public:
     ~VulkanBinder();
     void setDevice(VkDevice device) { mDevice = device; }
 
+    // The pipeline cache is used to create all pipelines, it's owned by the client.
+    void setPipelineCache(VkPipelineCache cache) { mPipelineCache = cache; }
+
+    // When the device has VK_KHR_descriptor_update_template enabled, new descriptor sets are
+    // written with a template for the set of bindings in use rather than with a list of writes.
+    void setUseUpdateTemplates(bool enabled) noexcept { mUseUpdateTemplates = enabled; }
+
     // Clients should initialize their copy of the raster state using this method. They can then
     // mutate their copy and pass it back through bindRasterState().
     const RasterState& getDefaultRasterState() const { return mDefaultRasterState; }
@@ -130,9 +145,12 @@ public:
     void bindProgramBundle(const ProgramBundle& bundle) noexcept;
     void bindRasterState(const RasterState& rasterState) noexcept;
     void bindRenderPass(VkRenderPass renderPass) noexcept;
+    void bindSubpass(uint32_t subpassIndex) noexcept;
     void bindPrimitiveTopology(VkPrimitiveTopology topology) noexcept;
-    void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer) noexcept;
+    void bindUniformBuffer(uint32_t bindingIndex, VkBuffer uniformBuffer,
+            VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE) noexcept;
     void bindSampler(uint32_t bindingIndex, VkDescriptorImageInfo imageInfo) noexcept;
+    void bindInputAttachment(VkDescriptorImageInfo imageInfo) noexcept;
     void bindVertexArray(const VertexArray& varray) noexcept;
 
     // Checks if the given uniform is bound to any slot, and if so binds "null" to that slot.
@@ -140,15 +158,16 @@ public:
     // This is only necessary when the client knows that the UBO is about to be destroyed.
     void unbindUniformBuffer(VkBuffer uniformBuffer) noexcept;
 
-    // Checks if an image view is bound to any sampler, and if so resets that particular slot.
+    // Checks if an image view is bound to any sampler or to the input attachment, and if so resets
+    // that particular slot.
     // Also invalidates all cached descriptors that refer to the given image view.
     // This is only necessary when the client knows that a texture is about to be destroyed.
     void unbindImageView(VkImageView imageView) noexcept;
 
     // NOTE: In theory we should proffer "unbindSampler" but in practice we never destroy samplers.
 
-    // Destroys all managed Vulkan objects. This should be called before changing the VkDevice, or
-    // when the cache gets too big.
+    // Destroys all managed Vulkan objects. This should be called before changing the VkDevice.
+    // The size of the caches is bounded by gc(), see setCacheLimits().
     void destroyCache() noexcept;
 
     // Force the subsequent call to getOrCreate to unconditionally return true, thus signaling
@@ -156,9 +175,35 @@ public:
     // be called after every swap if the VulkanBinder is shared amongst command buffers.
     void resetBindings() noexcept;
 
-    // Evicts old unused Vulkan objects. Call this once per frame.
+    // Copies the current bindings of another binder, e.g. to carry on its work in a command buffer
+    // recorded by another thread. The caches aren't shared, so this also resets the bindings.
+    void copyBindings(VulkanBinder const& other) noexcept;
+
+    // Evicts old unused Vulkan objects and recycles the transient descriptor sets of an old frame.
+    // Call this once per frame, after resetBindings().
     void gc() noexcept;
 
+    // Objects that haven't been used for the given number of frames are evicted. Objects used in
+    // the last MIN_TIME_BEFORE_EVICTION frames might still be referenced by a command buffer in
+    // flight, they're never evicted.
+    void setTimeBeforeEviction(uint32_t frames) noexcept {
+        mTimeBeforeEviction = std::max(frames, MIN_TIME_BEFORE_EVICTION);
+    }
+
+    // Maximum number of cached objects, the least recently used ones are evicted first when a
+    // cache gets larger. The number of descriptor sets can't exceed the size of the pool.
+    void setCacheLimits(uint32_t maxPipelines, uint32_t maxDescriptorSets) noexcept;
+
+    struct CacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+    CacheStats const& getPipelineStats() const noexcept { return mPipelineStats; }
+    CacheStats const& getDescriptorStats() const noexcept { return mDescriptorStats; }
+
+    static constexpr uint32_t MIN_TIME_BEFORE_EVICTION = 2;
+
 private:
     // The pipeline key is a POD that represents all currently bound states that form the immutable
     // VkPipeline object. We apply a hash function to its contents only if has been mutated since
@@ -167,18 +212,22 @@ private:
         VkShaderModule shaders[NUM_SHADER_MODULES]; // 8*2 bytes
         RasterState rasterState; // 248 bytes
         VkRenderPass renderPass; // 8 bytes
+        uint32_t subpassIndex; // 4 bytes
         VkPrimitiveTopology topology; // 4 bytes
         VkVertexInputAttributeDescription vertexAttributes[MAX_VERTEX_ATTRIBUTES]; // 16*5 bytes
         VkVertexInputBindingDescription vertexBuffers[MAX_VERTEX_ATTRIBUTES]; // 12*5 bytes
+        uint32_t padding; // 4 bytes
     };
 
     static_assert(sizeof(PipelineKey) ==
         sizeof(PipelineKey::shaders) +
         sizeof(PipelineKey::rasterState) +
         sizeof(PipelineKey::renderPass) +
+        sizeof(PipelineKey::subpassIndex) +
         sizeof(PipelineKey::topology) +
         sizeof(PipelineKey::vertexAttributes) +
-        sizeof(PipelineKey::vertexBuffers),
+        sizeof(PipelineKey::vertexBuffers) +
+        sizeof(PipelineKey::padding),
         "Implicit padding is not allowed for fast hashing");
 
     static_assert(std::is_pod<PipelineKey>::value, "PipelineKey must be a POD for fast hashing.");
@@ -205,12 +254,18 @@ private:
     // the previous call to getOrCreateDescriptor.
     struct alignas(8) DescriptorKey {
         VkBuffer uniformBuffers[NUM_UBUFFER_BINDINGS];
+        VkDeviceSize uniformBufferOffsets[NUM_UBUFFER_BINDINGS];
+        VkDeviceSize uniformBufferSizes[NUM_UBUFFER_BINDINGS];
         VkDescriptorImageInfo samplers[NUM_SAMPLER_BINDINGS];
+        VkDescriptorImageInfo inputAttachment; // only the image view and layout are used
     };
 
     static_assert(sizeof(DescriptorKey) ==
         sizeof(DescriptorKey::uniformBuffers) +
-        sizeof(DescriptorKey::samplers),
+        sizeof(DescriptorKey::uniformBufferOffsets) +
+        sizeof(DescriptorKey::uniformBufferSizes) +
+        sizeof(DescriptorKey::samplers) +
+        sizeof(DescriptorKey::inputAttachment),
         "Implicit padding is not allowed for fast hashing");
 
     static_assert(std::is_pod<DescriptorKey>::value, "DescriptorKey must be a POD.");
@@ -232,18 +287,42 @@ private:
         DescriptorVal& operator=(DescriptorVal &&) = default;
     };
 
+    // The infos of the bound descriptors, laid out for the update templates. Only the entries of
+    // the bindings in use are written.
+    struct DescriptorInfos {
+        VkDescriptorBufferInfo uniformBuffers[NUM_UBUFFER_BINDINGS];
+        VkDescriptorImageInfo samplers[NUM_SAMPLER_BINDINGS];
+        VkDescriptorImageInfo inputAttachment;
+    };
+
+    // One bit per binding of the descriptor set layout.
+    using BindingMask = uint32_t;
+    static_assert(INPUT_ATTACHMENT_BINDING < sizeof(BindingMask) * 8,
+            "Too many bindings for the binding mask.");
+
+    // The transient descriptor sets of a frame come from linear pools that are reset all at once,
+    // more pools are created when the frame needs more sets.
+    struct TransientPools {
+        std::vector<VkDescriptorPool> pools;
+        size_t current = 0;
+    };
+
     void createLayoutsAndDescriptors() noexcept;
     void destroyLayoutsAndDescriptors() noexcept;
     void evictDescriptors(std::function<bool(const DescriptorKey&)> filter) noexcept;
+    VkDescriptorPool createDescriptorPool(uint32_t maxSets, VkDescriptorPoolCreateFlags flags);
+    VkDescriptorSet allocateTransientDescriptor() noexcept;
+    void updateDescriptor(VkDescriptorSet descriptor, DescriptorUpdateOp** changes) noexcept;
+    VkDescriptorUpdateTemplateKHR getOrCreateUpdateTemplate(BindingMask bindings) noexcept;
 
     VkDevice mDevice = nullptr;
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
     const RasterState mDefaultRasterState;
 
     // Info structs used only in a transient way but they are stored for convenience.
     VkPipelineShaderStageCreateInfo mShaderStages[NUM_SHADER_MODULES];
     VkPipelineColorBlendStateCreateInfo mColorBlendState;
-    VkDescriptorBufferInfo mDescriptorBuffers[NUM_UBUFFER_BINDINGS];
-    VkDescriptorImageInfo mDescriptorSamplers[NUM_SAMPLER_BINDINGS];
+    DescriptorInfos mDescriptorInfos;
     DescriptorUpdateOp mDescriptorUpdateOp;
 
     // Current bindings are divided into two "keys" which are composed of a mix of actual values
@@ -268,10 +347,23 @@ private:
     tsl::robin_map<DescriptorKey, DescriptorVal, DescHashFn, DescEqual> mDescriptorSets;
     VkDescriptorPool mDescriptorPool;
     std::vector<DescriptorVal> mDescriptorGraveyard;
+    tsl::robin_map<BindingMask, VkDescriptorUpdateTemplateKHR> mUpdateTemplates;
+    bool mUseUpdateTemplates = false;
+
+    // Descriptor sets that don't fit in the cache are used for the current frame only. The pools
+    // of a frame are reset MIN_TIME_BEFORE_EVICTION frames later, when their sets can no longer be
+    // referenced by a command buffer in flight.
+    static constexpr uint32_t NUM_TRANSIENT_POOLS = MIN_TIME_BEFORE_EVICTION + 1;
+    TransientPools mTransientPools[NUM_TRANSIENT_POOLS];
+    DescriptorVal mTransientDescriptor = { VK_NULL_HANDLE, 0, false };
 
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint32_t mCurrentTime = 0;
-    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    uint32_t mTimeBeforeEviction = MIN_TIME_BEFORE_EVICTION;
+    uint32_t mMaxPipelines;
+    uint32_t mMaxDescriptorSets;
+    CacheStats mPipelineStats;
+    CacheStats mDescriptorStats;
 };
 
 } // namespace filament
@@ -22,7 +22,8 @@ namespace filament {
 namespace driver {
 
 VulkanBuffer::VulkanBuffer(VulkanContext& context, VulkanStagePool& stagePool,
-        VkBufferUsageFlags usage, uint32_t numBytes) : mContext(context), mStagePool(stagePool) {
+        VkBufferUsageFlags usage, uint32_t numBytes) : mContext(context), mStagePool(stagePool),
+        mNumBytes(numBytes) {
     // Create the VkBuffer.
     VkBufferCreateInfo bufferInfo {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -42,29 +43,43 @@ VulkanBuffer::~VulkanBuffer() {
 
 void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes) {
     assert(byteOffset == 0);
-    VkDevice device = mContext.device;
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
+    memcpy(stage->mapped, cpuData, numBytes);
+
+    // When the whole buffer is replaced, its previous content doesn't need to be handed over to
+    // the transfer queue, so the upload can go there and overlap with rendering.
+    if (mContext.transferQueue && numBytes == mNumBytes) {
+        VkBufferMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+            .srcQueueFamilyIndex = mContext.transferQueueFamilyIndex,
+            .dstQueueFamilyIndex = mContext.graphicsQueueFamilyIndex,
+            .buffer = mGpuBuffer,
+            .size = VK_WHOLE_SIZE
+        };
+        auto release = [this, stage, barrier, numBytes] (VkCommandBuffer cmd) {
+            VkBufferCopy region { .srcOffset = stage->offset, .size = numBytes };
+            vkCmdCopyBuffer(cmd, stage->buffer, mGpuBuffer, 1, &region);
+            VkBufferMemoryBarrier release = barrier;
+            release.dstAccessMask = 0;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &release, 0, nullptr);
+        };
+        auto acquire = [barrier] (VkCommandBuffer cmd) {
+            VkBufferMemoryBarrier acquire = barrier;
+            acquire.srcAccessMask = 0;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                    VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &acquire, 0, nullptr);
+        };
+        submitTransfer(mContext, release, acquire, [this, stage] () {
+            mStagePool.releaseStage(stage);
+        });
+        return;
+    }
 
     // Create and submit a one-off command buffer to allow uploading outside a frame.
-    VkCommandBuffer cmdbuffer;
-    VkFence fence;
-    VkCommandBufferBeginInfo beginInfo { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    VkCommandBufferAllocateInfo allocateInfo {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = mContext.commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
-    };
-    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
-    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
-    vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
-    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
-    vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
+    VkBufferCopy region { .srcOffset = stage->offset, .size = numBytes };
 
     // Ensure that the copy finishes before the next draw call.
     VkBufferMemoryBarrier barrier {
@@ -76,23 +91,11 @@ void VulkanBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_
         .buffer = mGpuBuffer,
         .size = VK_WHOLE_SIZE
     };
-    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
-    vkEndCommandBuffer(cmdbuffer);
-    VkSubmitInfo submitInfo {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuffer,
-    };
-    vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, fence);
-
-    // Enqueue some work to reclaim the staging area and free the command buffer. The pipeline
-    // barrier we already placed is a GPU-to-GPU sync point, but reclaimation of the staging area
-    // needs GPU-CPU synchronization. That's what the fence is for.
-    mContext.pendingWork.emplace_back([this, fence, device, cmdbuffer, stage] (VkCommandBuffer)  {
-        vkWaitForFences(device, 1, &fence, VK_FALSE, UINT64_MAX);
-        vkFreeCommandBuffers(device, mContext.commandPool, 1, &cmdbuffer);
-        vkDestroyFence(device, fence, VKALLOC);
+    submitOneOff(mContext, [this, stage, region, barrier] (VkCommandBuffer cmdbuffer) {
+        vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }, [this, stage] () {
         mStagePool.releaseStage(stage);
     });
 }
@@ -25,8 +25,15 @@
 #include <utils/CString.h>
 #include <utils/trap.h>
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <csignal>
+#include <memory>
 #include <set>
+#include <thread>
+
+#include <string.h>
 
 // Vulkan functions often immediately dereference pointers, so it's fine to pass in a pointer
 // to a stack-allocated variable.
@@ -36,13 +43,21 @@
 
 static constexpr bool SWAPCHAIN_HAS_DEPTH = true;
 
+// How long beginFrame() waits for a swap chain image with the low-latency present modes before it
+// drops the frame. FIFO waits as long as it takes, since that's what paces the frames.
+static constexpr uint64_t ACQUIRE_TIMEOUT_NS = 4000000;
+
 namespace filament {
 namespace driver {
 
+thread_local VulkanDriver::Recorder* VulkanDriver::sRecorder = nullptr;
+
 VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept :
         DriverBase(new ConcreteDispatcher<VulkanDriver>(this)),
-        mContextManager(*externalContext), mStagePool(mContext), mFramebufferCache(mContext),
+        mContextManager(*externalContext),
+        mHandleArena("Handles", 2U * 1024U * 1024U), // TODO: set the amount in configuration
+        mStagePool(mContext), mFramebufferCache(mContext),
         mSamplerCache(mContext) {
     mContext.rasterState = mBinder.getDefaultRasterState();
 
@@ -148,6 +163,8 @@ VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
     // Initialize device and graphicsQueue.
     createVirtualDevice(mContext);
     mBinder.setDevice(mContext.device);
+    mBinder.setUseUpdateTemplates(mContext.descriptorUpdateTemplateSupported);
+    createPipelineCache(nullptr, 0);
 
     // Choose a depth format that meets our requirements. Take care not to include stencil formats
     // just yet, since that would require a corollary change to the "aspect" flags for the VkImage.
@@ -158,6 +175,38 @@ VulkanDriver::VulkanDriver(ContextManagerVk* externalContext,
 
 VulkanDriver::~VulkanDriver() noexcept = default;
 
+VulkanDriver::HandleAllocator::HandleAllocator(const utils::HeapArea& area)
+        : mPool0(area.begin(),
+                  utils::pointermath::add(area.begin(), (1 * area.getSize()) / 16)),
+          mPool1( utils::pointermath::add(area.begin(), (1 * area.getSize()) / 16),
+                  utils::pointermath::add(area.begin(), (8 * area.getSize()) / 16)),
+          mPool2( utils::pointermath::add(area.begin(), (8 * area.getSize()) / 16),
+                  area.end()) {
+}
+
+void* VulkanDriver::HandleAllocator::alloc(size_t size, size_t alignment, size_t extra) noexcept {
+    assert(size <= mPool2.getSize());
+    if (size <= mPool0.getSize()) return mPool0.alloc(size, 16, extra);
+    if (size <= mPool1.getSize()) return mPool1.alloc(size, 32, extra);
+    if (size <= mPool2.getSize()) return mPool2.alloc(size, 32, extra);
+    return nullptr;
+}
+
+void VulkanDriver::HandleAllocator::free(void* p, size_t size) noexcept {
+    if (size <= mPool0.getSize()) { mPool0.free(p); return; }
+    if (size <= mPool1.getSize()) { mPool1.free(p); return; }
+    if (size <= mPool2.getSize()) { mPool2.free(p); return; }
+}
+
+// mHandleArena is accessed from 2 threads, so this needs a lock
+UTILS_NOINLINE
+HandleBase::HandleId VulkanDriver::allocateHandle(size_t size) noexcept {
+    void* addr = mHandleArena.alloc(size);
+    char* const base = (char *)mHandleArena.getArea().begin();
+    size_t offset = (char*)addr - base;
+    return HandleBase::HandleId(offset >> HandleAllocator::MIN_ALIGNMENT_SHIFT);
+}
+
 std::unique_ptr<Driver> VulkanDriver::create(ContextManagerVk* const externalContext,
         const char* const* ppEnabledExtensions, uint32_t enabledExtensionCount) noexcept {
     assert(externalContext);
@@ -179,12 +228,49 @@ void VulkanDriver::terminate() {
         return;
     }
     waitForIdle(mContext);
+    if (mJobSystem) {
+        mJobSystem->emancipate();
+        mJobSystem.reset();
+    }
     mBinder.destroyCache();
+    for (auto& recorder : mRecorders) {
+        recorder->binder.destroyCache();
+        vkDestroyCommandPool(mContext.device, recorder->commandPool, VKALLOC);
+        recorder->commandPool = VK_NULL_HANDLE;
+        recorder->freeBuffers.clear();
+    }
+    mInlineFreeBuffers.clear();
+    savePipelineCache();
+    vkDestroyPipelineCache(mContext.device, mPipelineCache, VKALLOC);
     mStagePool.reset();
+    destroySubpassColor();
     mFramebufferCache.reset();
+    mContext.pendingFences.clear();
     mSamplerCache.reset();
+#ifndef NDEBUG
+    // anything still allocated at this point is a leak
+    logMemoryStats();
+    auto logCacheStats = [](const char* name, auto const& stats) {
+        utils::slog.d << name << " cache: "
+                << stats.hits << " hits, "
+                << stats.misses << " misses, "
+                << stats.evictions << " evictions" << utils::io::endl;
+    };
+    logCacheStats("Pipeline", mBinder.getPipelineStats());
+    logCacheStats("Descriptor set", mBinder.getDescriptorStats());
+    logCacheStats("Framebuffer", mFramebufferCache.getFramebufferStats());
+    logCacheStats("Render pass", mFramebufferCache.getRenderPassStats());
+    VulkanStagePool::Stats const& stageStats = mStagePool.getStats();
+    utils::slog.d << "Staging: "
+            << stageStats.bytesUploaded << " bytes uploaded, "
+            << stageStats.ringOverflows << " ring overflows, "
+            << stageStats.buffersCreated << " buffers created" << utils::io::endl;
+#endif
     vmaDestroyAllocator(mContext.allocator);
     vkDestroyCommandPool(mContext.device, mContext.commandPool, VKALLOC);
+    if (mContext.transferCommandPool) {
+        vkDestroyCommandPool(mContext.device, mContext.transferCommandPool, VKALLOC);
+    }
     vkDestroyDevice(mContext.device, VKALLOC);
     if (mDebugCallback) {
         vkDestroyDebugReportCallbackEXT(mContext.instance, mDebugCallback, VKALLOC);
@@ -196,12 +282,25 @@ void VulkanDriver::terminate() {
 
 void VulkanDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     // We allow multiple beginFrame / endFrame pairs before commit(), so gracefully return early
-    // if the swap chain has already been acquired.
-    if (mContext.cmdbuffer) {
+    // if the swap chain has already been acquired, or if the frame has been dropped.
+    if (mContext.cmdbuffer || mFrameDropped) {
         return;
     }
 
-    acquireCommandBuffer(mContext);
+    // Rather than blocking the driver thread, the low-latency present modes drop the frame if no
+    // image is available in time. A stale swap chain is replaced and the acquisition is retried.
+    VulkanSurfaceContext& surface = *mContext.currentSurface;
+    const uint64_t timeout =
+            surface.presentMode == VK_PRESENT_MODE_FIFO_KHR ? UINT64_MAX : ACQUIRE_TIMEOUT_NS;
+    VkResult result = acquireCommandBuffer(mContext, timeout);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        refreshSwapChain(surface);
+        result = acquireCommandBuffer(mContext, timeout);
+    }
+    if (!mContext.cmdbuffer) {
+        mFrameDropped = true;
+        return;
+    }
     SwapContext& swapContext = getSwapContext(mContext);
 
     // vkCmdBindPipeline and vkCmdBindDescriptorSets establish bindings to a specific command
@@ -215,6 +314,10 @@ void VulkanDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     // of allowing us to safely mutate descriptor sets. For now we're avoiding that strategy in the
     // interest of maintaining a small memory footprint.
     mBinder.resetBindings();
+    for (auto& recorder : mRecorders) {
+        recorder->binder.resetBindings();
+    }
+    mPrimaryStateLost = false;
 
     // Now that a command buffer is ready, perform any pending work that has been scheduled by
     // VulkanDriver, such as reclaiming memory. There are two sets of work queues: one in the
@@ -226,6 +329,9 @@ void VulkanDriver::beginFrame(uint64_t monotonic_clock_ns, uint32_t frameId) {
     mStagePool.gc();
     mFramebufferCache.gc();
     mBinder.gc();
+    for (auto& recorder : mRecorders) {
+        recorder->binder.gc();
+    }
 }
 
 void VulkanDriver::endFrame(uint32_t frameId) {
@@ -236,54 +342,149 @@ void VulkanDriver::flush(int) {
     // Todo: equivalent of glFlush()
 }
 
+namespace {
+
+// The pipeline cache data has a header identifying the device, which the driver checks, but two
+// devices of a system must not overwrite each other's cache.
+struct PipelineCacheKey {
+    char tag[8];
+    uint32_t vendorID;
+    uint32_t deviceID;
+    uint32_t driverVersion;
+    uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+};
+
+PipelineCacheKey getPipelineCacheKey(VkPhysicalDeviceProperties const& props) noexcept {
+    PipelineCacheKey key = {};
+    memcpy(key.tag, "VkPCache", sizeof(key.tag));
+    key.vendorID = props.vendorID;
+    key.deviceID = props.deviceID;
+    key.driverVersion = props.driverVersion;
+    memcpy(key.pipelineCacheUUID, props.pipelineCacheUUID, VK_UUID_SIZE);
+    return key;
+}
+
+} // anonymous namespace
+
+void VulkanDriver::setBlobCache(driver::BlobCache cache) {
+    mBlobCache = cache;
+    if (!cache.retrieve) {
+        return;
+    }
+
+    const PipelineCacheKey key = getPipelineCacheKey(mContext.physicalDeviceProperties);
+    const size_t size = cache.retrieve(cache.user, &key, sizeof(key), nullptr, 0);
+    if (!size) {
+        return;
+    }
+    std::vector<uint8_t> data(size);
+    if (cache.retrieve(cache.user, &key, sizeof(key), data.data(), size) != size) {
+        return;
+    }
+
+    // The pipelines created so far are kept in the new cache. The driver ignores the data if it
+    // was produced by another device or driver version.
+    VkPipelineCache previous = mPipelineCache;
+    createPipelineCache(data.data(), size);
+    vkMergePipelineCaches(mContext.device, mPipelineCache, 1, &previous);
+    vkDestroyPipelineCache(mContext.device, previous, VKALLOC);
+}
+
+void VulkanDriver::createPipelineCache(void const* data, size_t size) noexcept {
+    VkPipelineCacheCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    info.initialDataSize = size;
+    info.pInitialData = data;
+    VkResult err = vkCreatePipelineCache(mContext.device, &info, VKALLOC, &mPipelineCache);
+    if (err != VK_SUCCESS && size) {
+        // the data is invalid, start from scratch
+        info.initialDataSize = 0;
+        info.pInitialData = nullptr;
+        err = vkCreatePipelineCache(mContext.device, &info, VKALLOC, &mPipelineCache);
+    }
+    ASSERT_POSTCONDITION(err == VK_SUCCESS, "Unable to create pipeline cache.");
+    mBinder.setPipelineCache(mPipelineCache);
+}
+
+void VulkanDriver::savePipelineCache() noexcept {
+    if (!mBlobCache.insert) {
+        return;
+    }
+    size_t size = 0;
+    vkGetPipelineCacheData(mContext.device, mPipelineCache, &size, nullptr);
+    if (!size) {
+        return;
+    }
+    std::vector<uint8_t> data(size);
+    if (vkGetPipelineCacheData(mContext.device, mPipelineCache, &size, data.data()) != VK_SUCCESS) {
+        return;
+    }
+    const PipelineCacheKey key = getPipelineCacheKey(mContext.physicalDeviceProperties);
+    mBlobCache.insert(mBlobCache.user, &key, sizeof(key), data.data(), size);
+}
+
+void VulkanDriver::logMemoryStats() const noexcept {
+    // images and buffers all come from the VMA allocator, its stats cover all the device memory
+    // the backend owns except the swap chain's
+    VmaStats stats;
+    vmaCalculateStats(mContext.allocator, &stats);
+    VmaStatInfo const& total = stats.total;
+    utils::slog.d << "Vulkan memory: "
+            << total.blockCount << " blocks, "
+            << total.allocationCount << " allocations, "
+            << total.usedBytes << " bytes used, "
+            << total.unusedBytes << " bytes unused" << utils::io::endl;
+}
+
 void VulkanDriver::createVertexBuffer(Driver::VertexBufferHandle vbh, uint8_t bufferCount,
-        uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes) {
-    construct_handle<VulkanVertexBuffer>(mHandleMap, vbh, mContext, mStagePool, bufferCount,
+        uint8_t attributeCount, uint32_t elementCount, Driver::AttributeArray attributes,
+        Driver::Usage usage) {
+    construct_handle<VulkanVertexBuffer>(vbh, mContext, mStagePool, bufferCount,
             attributeCount, elementCount, attributes);
 }
 
 void VulkanDriver::createIndexBuffer(Driver::IndexBufferHandle ibh, Driver::ElementType elementType,
-        uint32_t indexCount) {
+        uint32_t indexCount, Driver::Usage usage) {
     auto elementSize = (uint8_t) getElementTypeSize(elementType);
-    construct_handle<VulkanIndexBuffer>(mHandleMap, ibh, mContext, mStagePool, elementSize,
+    construct_handle<VulkanIndexBuffer>(ibh, mContext, mStagePool, elementSize,
             indexCount);
 }
 
 void VulkanDriver::createTexture(Driver::TextureHandle th, SamplerType target, uint8_t levels,
         TextureFormat format, uint8_t samples, uint32_t w, uint32_t h, uint32_t depth,
         TextureUsage usage) {
-    construct_handle<VulkanTexture>(mHandleMap, th, mContext, target, levels, format, samples,
+    construct_handle<VulkanTexture>(th, mContext, target, levels, format, samples,
             w, h, depth, usage, mStagePool);
 }
 
 void VulkanDriver::createSamplerBuffer(Driver::SamplerBufferHandle sbh, size_t count) {
-    construct_handle<VulkanSamplerBuffer>(mHandleMap, sbh, mContext, count);
+    construct_handle<VulkanSamplerBuffer>(sbh, mContext, count);
 }
 
 void VulkanDriver::createUniformBuffer(Driver::UniformBufferHandle ubh, size_t size) {
-    construct_handle<VulkanUniformBuffer>(mHandleMap, ubh, mContext, mStagePool, size);
+    construct_handle<VulkanUniformBuffer>(ubh, mContext, mStagePool, size);
 }
 
 void VulkanDriver::createRenderPrimitive(Driver::RenderPrimitiveHandle rph, int) {
-    construct_handle<VulkanRenderPrimitive>(mHandleMap, rph, mContext);
+    construct_handle<VulkanRenderPrimitive>(rph, mContext);
 }
 
 void VulkanDriver::createProgram(Driver::ProgramHandle ph, Program&& program) {
-    construct_handle<VulkanProgram>(mHandleMap, ph, mContext, program);
+    construct_handle<VulkanProgram>(ph, mContext, program);
 }
 
 void VulkanDriver::createDefaultRenderTarget(Driver::RenderTargetHandle rth, int) {
-    construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext);
+    construct_handle<VulkanRenderTarget>(rth, mContext);
 }
 
 void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         Driver::TargetBufferFlags targets, uint32_t width, uint32_t height, uint8_t samples,
         TextureFormat format, Driver::TargetBufferInfo color, Driver::TargetBufferInfo depth,
         Driver::TargetBufferInfo stencil) {
-    auto& renderTarget = *construct_handle<VulkanRenderTarget>(mHandleMap, rth, mContext,
+    auto& renderTarget = *construct_handle<VulkanRenderTarget>(rth, mContext,
             width, height);
     if (color.handle) {
-        auto colorTexture = handle_cast<VulkanTexture>(mHandleMap, color.handle);
+        auto colorTexture = handle_cast<VulkanTexture>(color.handle);
         renderTarget.setColorImage({
             .view = colorTexture->imageView,
             .format = colorTexture->format
@@ -292,7 +493,7 @@ void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
         renderTarget.createColorImage(getVkFormat(format));
     }
     if (depth.handle) {
-        auto depthTexture = handle_cast<VulkanTexture>(mHandleMap, depth.handle);
+        auto depthTexture = handle_cast<VulkanTexture>(depth.handle);
         renderTarget.setDepthImage({
             .view = depthTexture->imageView,
             .format = depthTexture->format
@@ -303,12 +504,21 @@ void VulkanDriver::createRenderTarget(Driver::RenderTargetHandle rth,
 }
 
 void VulkanDriver::createFence(Driver::FenceHandle fh, int) {
+    auto* fence = construct_handle<VulkanFence>(fh,
+            std::make_shared<VulkanCmdFence>(mContext.device));
+
+    // Within a frame, the fence is submitted after its command buffer.
+    mContext.pendingFences.push_back(fence->cmdfence);
+    if (!mContext.cmdbuffer) {
+        submitPendingFences(mContext);
+    }
 }
 
 void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWindow,
         uint64_t flags) {
-    auto* swapChain = construct_handle<VulkanSwapChain>(mHandleMap, sch);
+    auto* swapChain = construct_handle<VulkanSwapChain>(sch);
     VulkanSurfaceContext& sc = swapChain->surfaceContext;
+    sc.flags = flags;
     sc.surface = (VkSurfaceKHR) mContextManager.createVkSurfaceKHR(nativeWindow,
             mContext.instance, &sc.clientSize.width, &sc.clientSize.height);
     getPresentationQueue(mContext, sc);
@@ -324,10 +534,35 @@ void VulkanDriver::createSwapChain(Driver::SwapChainHandle sch, void* nativeWind
     }
 }
 
+void VulkanDriver::createSwapChainHeadless(Driver::SwapChainHandle sch,
+        uint32_t width, uint32_t height, uint64_t flags) {
+    auto* swapChain = construct_handle<VulkanSwapChain>(sch);
+    VulkanSurfaceContext& sc = swapChain->surfaceContext;
+    sc.flags = flags;
+    sc.headless = true;
+    sc.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    sc.presentQueue = mContext.graphicsQueue;
+    sc.surfaceCapabilities.currentExtent = { width, height };
+    sc.clientSize = { width, height };
+    createHeadlessImages(mContext, sc);
+    createCommandBuffersAndFences(mContext, sc);
+
+    // TODO: move the following line into makeCurrent.
+    mContext.currentSurface = &sc;
+
+    if (SWAPCHAIN_HAS_DEPTH) {
+        transitionDepthBuffer(mContext, sc, mContext.depthFormat);
+    }
+}
+
 void VulkanDriver::createStreamFromTextureId(Driver::StreamHandle sh, intptr_t externalTextureId,
         uint32_t width, uint32_t height) {
 }
 
+void VulkanDriver::createTimerQuery(Driver::TimerQueryHandle tqh, int) {
+    construct_handle<VulkanTimerQuery>(tqh, mContext);
+}
+
 Handle<HwVertexBuffer> VulkanDriver::createVertexBufferSynchronous() noexcept {
     return alloc_handle<VulkanVertexBuffer, HwVertexBuffer>();
 }
@@ -365,42 +600,46 @@ Handle<HwRenderTarget> VulkanDriver::createRenderTargetSynchronous() noexcept {
 }
 
 Handle<HwFence> VulkanDriver::createFenceSynchronous() noexcept {
-    return {};
+    return alloc_handle<VulkanFence, HwFence>();
 }
 
 Handle<HwSwapChain> VulkanDriver::createSwapChainSynchronous() noexcept {
     return alloc_handle<VulkanSwapChain, HwSwapChain>();
 }
 
+Handle<HwSwapChain> VulkanDriver::createSwapChainHeadlessSynchronous() noexcept {
+    return alloc_handle<VulkanSwapChain, HwSwapChain>();
+}
+
 Handle<HwStream> VulkanDriver::createStreamFromTextureIdSynchronous() noexcept {
     return {};
 }
 
+Handle<HwTimerQuery> VulkanDriver::createTimerQuerySynchronous() noexcept {
+    return alloc_handle<VulkanTimerQuery, HwTimerQuery>();
+}
+
 void VulkanDriver::destroyVertexBuffer(Driver::VertexBufferHandle vbh) {
     if (vbh) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanVertexBuffer>(mHandleMap, vbh);
+        deferred_destruct_handle<VulkanVertexBuffer>(vbh);
     }
 }
 
 void VulkanDriver::destroyIndexBuffer(Driver::IndexBufferHandle ibh) {
     if (ibh) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanIndexBuffer>(mHandleMap, ibh);
+        deferred_destruct_handle<VulkanIndexBuffer>(ibh);
     }
 }
 
 void VulkanDriver::destroyRenderPrimitive(Driver::RenderPrimitiveHandle rph) {
     if (rph) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanRenderPrimitive>(mHandleMap, rph);
+        deferred_destruct_handle<VulkanRenderPrimitive>(rph);
     }
 }
 
 void VulkanDriver::destroyProgram(Driver::ProgramHandle ph) {
     if (ph) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanProgram>(mHandleMap, ph);
+        deferred_destruct_handle<VulkanProgram>(ph);
     }
 }
 
@@ -410,47 +649,57 @@ void VulkanDriver::destroySamplerBuffer(Driver::SamplerBufferHandle sbh) {
         // not map to any Vulkan objects. To handle destruction, the only thing we need to do is
         // ensure that the next draw call doesn't try to access a zombie sampler buffer. Therefore,
         // simply replace all weak references with null.
-        auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+        auto* hwsb = handle_cast<VulkanSamplerBuffer>(sbh);
         for (auto& binding : mSamplerBindings) {
             if (binding == hwsb) {
                 binding = nullptr;
             }
         }
-        destruct_handle<VulkanSamplerBuffer>(mHandleMap, sbh);
+        for (auto& recorder : mRecorders) {
+            for (auto& binding : recorder->samplerBindings) {
+                if (binding == hwsb) {
+                    binding = nullptr;
+                }
+            }
+        }
+        destruct_handle<VulkanSamplerBuffer>(sbh);
     }
 }
 
 void VulkanDriver::destroyUniformBuffer(Driver::UniformBufferHandle ubh) {
     if (ubh) {
-        auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+        auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
         mBinder.unbindUniformBuffer(buffer->getGpuBuffer());
-        waitForIdle(mContext);
-        destruct_handle<VulkanUniformBuffer>(mHandleMap, ubh);
+        for (auto& recorder : mRecorders) {
+            recorder->binder.unbindUniformBuffer(buffer->getGpuBuffer());
+        }
+        deferred_destruct_handle<VulkanUniformBuffer>(ubh);
     }
 }
 
 void VulkanDriver::destroyTexture(Driver::TextureHandle th) {
     if (th) {
-        auto* tex = handle_cast<VulkanTexture>(mHandleMap, th);
+        auto* tex = handle_cast<VulkanTexture>(th);
         mBinder.unbindImageView(tex->imageView);
-        waitForIdle(mContext);
-        destruct_handle<VulkanTexture>(mHandleMap, th);
+        for (auto& recorder : mRecorders) {
+            recorder->binder.unbindImageView(tex->imageView);
+        }
+        deferred_destruct_handle<VulkanTexture>(th);
     }
 }
 
 void VulkanDriver::destroyRenderTarget(Driver::RenderTargetHandle rth) {
     if (rth) {
-        waitForIdle(mContext);
-        destruct_handle<VulkanRenderTarget>(mHandleMap, rth);
+        deferred_destruct_handle<VulkanRenderTarget>(rth);
     }
 }
 
 void VulkanDriver::destroySwapChain(Driver::SwapChainHandle sch) {
     if (sch) {
         waitForIdle(mContext);
-        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+        VulkanSurfaceContext& sc = handle_cast<VulkanSwapChain>(sch)->surfaceContext;
         destroySurfaceContext(mContext, sc);
-        destruct_handle<VulkanSwapChain>(mHandleMap, sch);
+        destruct_handle<VulkanSwapChain>(sch);
     }
 }
 
@@ -464,14 +713,43 @@ Handle<HwStream> VulkanDriver::createStream(void* nativeStream) {
 void VulkanDriver::setStreamDimensions(Driver::StreamHandle sh, uint32_t width, uint32_t height) {
 }
 
-void VulkanDriver::updateStreams(CommandStream* driver) {
+int64_t VulkanDriver::getStreamTimestamp(Driver::StreamHandle sh) {
+    return 0;
 }
 
 void VulkanDriver::destroyFence(Driver::FenceHandle fh) {
+    // The VkFence itself goes away with the last reference to it, which the driver thread holds
+    // until the fence is submitted.
+    if (fh) {
+        destruct_handle<VulkanFence>(fh);
+    }
+}
+
+void VulkanDriver::destroyTimerQuery(Driver::TimerQueryHandle tqh) {
+    if (tqh) {
+        deferred_destruct_handle<VulkanTimerQuery>(tqh);
+    }
 }
 
 Driver::FenceStatus VulkanDriver::wait(Driver::FenceHandle fh, uint64_t timeout) {
-    return FenceStatus::ERROR;
+    if (!fh) {
+        return FenceStatus::ERROR;
+    }
+    // This is called from the client thread, the fence might not be submitted yet.
+    std::shared_ptr<VulkanCmdFence> cmdfence = handle_cast<VulkanFence>(fh)->cmdfence;
+    std::unique_lock<std::mutex> lock(cmdfence->mutex);
+    if (timeout == FENCE_WAIT_FOR_EVER) {
+        cmdfence->condition.wait(lock, [&cmdfence]() { return cmdfence->submitted; });
+    } else if (!cmdfence->condition.wait_for(lock, std::chrono::nanoseconds(timeout),
+            [&cmdfence]() { return cmdfence->submitted; })) {
+        return FenceStatus::TIMEOUT_EXPIRED;
+    }
+    lock.unlock();
+    VkResult result = vkWaitForFences(mContext.device, 1, &cmdfence->fence, VK_TRUE, timeout);
+    if (result == VK_SUCCESS) {
+        return FenceStatus::CONDITION_SATISFIED;
+    }
+    return result == VK_TIMEOUT ? FenceStatus::TIMEOUT_EXPIRED : FenceStatus::ERROR;
 }
 
 // We create all textures using VK_IMAGE_TILING_OPTIMAL, so our definition of "supported" is that
@@ -498,20 +776,72 @@ bool VulkanDriver::isRenderTargetFormatSupported(Driver::TextureFormat format) {
     return (info.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT) != 0;
 }
 
+bool VulkanDriver::isAutoResolveSupported() {
+    // render targets are single-sampled
+    return false;
+}
+
+bool VulkanDriver::isMultiviewSupported() {
+    // TODO: render passes with VK_KHR_multiview, for now stereo views can't be rendered
+    return false;
+}
+
+bool VulkanDriver::isSubpassSupported() {
+    return true;
+}
+
 bool VulkanDriver::isFrameTimeSupported() {
     return false;
 }
 
+bool VulkanDriver::isTimerQuerySupported() {
+    return mContext.physicalDeviceProperties.limits.timestampComputeAndGraphics == VK_TRUE;
+}
+
+bool VulkanDriver::getTimerQueryValue(Driver::TimerQueryHandle tqh, uint64_t* elapsedTime) {
+    if (!tqh) {
+        return false;
+    }
+    // This is called from the client thread, the timestamps of a query that was never recorded
+    // (or whose frame was dropped) are undefined.
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(tqh);
+    if (!tq->recorded.load(std::memory_order_acquire)) {
+        return false;
+    }
+    // each timestamp is followed by its availability
+    uint64_t results[4] = {};
+    VkResult result = vkGetQueryPoolResults(mContext.device, tq->pool, 0, 2, sizeof(results),
+            results, 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if ((result != VK_SUCCESS && result != VK_NOT_READY) || !results[1] || !results[3]) {
+        return false;
+    }
+    const double period = mContext.physicalDeviceProperties.limits.timestampPeriod;
+    *elapsedTime = uint64_t(double(results[2] - results[0]) * period);
+    return true;
+}
+
 void VulkanDriver::loadVertexBuffer(Driver::VertexBufferHandle vbh, size_t index,
         BufferDescriptor&& p, uint32_t byteOffset, uint32_t byteSize) {
-    auto& vb = *handle_cast<VulkanVertexBuffer>(mHandleMap, vbh);
+    auto& vb = *handle_cast<VulkanVertexBuffer>(vbh);
     vb.buffers[index]->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
 
+void VulkanDriver::loadVertexBufferRanges(Driver::VertexBufferHandle vbh, size_t index,
+        BufferDescriptor&& p, Driver::BufferRange const* ranges, uint32_t count) {
+    auto& vb = *handle_cast<VulkanVertexBuffer>(vbh);
+    uint8_t const* data = static_cast<uint8_t const*>(p.buffer);
+    for (uint32_t i = 0; i < count; i++) {
+        vb.buffers[index]->loadFromCpu(data, ranges[i].byteOffset, ranges[i].byteSize);
+        data += ranges[i].byteSize;
+    }
+    scheduleDestroy(std::move(p));
+}
+
 void VulkanDriver::loadIndexBuffer(Driver::IndexBufferHandle ibh, BufferDescriptor&& p,
         uint32_t byteOffset, uint32_t byteSize) {
-    auto& ib = *handle_cast<VulkanIndexBuffer>(mHandleMap, ibh);
+    auto& ib = *handle_cast<VulkanIndexBuffer>(ibh);
     ib.buffer->loadFromCpu(p.buffer, byteOffset, byteSize);
     scheduleDestroy(std::move(p));
 }
@@ -521,14 +851,25 @@ void VulkanDriver::load2DImage(Driver::TextureHandle th,
         PixelBufferDescriptor&& data) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
     assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->load2DImage(std::move(data), width, height, level);
+    handle_cast<VulkanTexture>(th)->load2DImage(std::move(data), width, height, level);
+    scheduleDestroy(std::move(data));
+}
+
+void VulkanDriver::load3DImage(Driver::TextureHandle th,
+        uint32_t level, uint32_t xoffset, uint32_t yoffset, uint32_t zoffset,
+        uint32_t width, uint32_t height, uint32_t depth,
+        PixelBufferDescriptor&& data) {
+    assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
+    assert(xoffset == 0 && yoffset == 0 && "Offsets not yet supported.");
+    handle_cast<VulkanTexture>(th)->loadArrayImage(std::move(data), width, height,
+            zoffset, depth, level);
     scheduleDestroy(std::move(data));
 }
 
 void VulkanDriver::loadCubeImage(Driver::TextureHandle th, uint32_t level,
         PixelBufferDescriptor&& data, FaceOffsets faceOffsets) {
     assert(data.type != driver::PixelDataType::COMPRESSED && "Compression not yet supported.");
-    handle_cast<VulkanTexture>(mHandleMap, th)->loadCubeImage(std::move(data), faceOffsets, level);
+    handle_cast<VulkanTexture>(th)->loadCubeImage(std::move(data), faceOffsets, level);
     scheduleDestroy(std::move(data));
 }
 
@@ -541,29 +882,77 @@ void VulkanDriver::setExternalStream(Driver::TextureHandle th, Driver::StreamHan
 void VulkanDriver::generateMipmaps(Driver::TextureHandle th) {
 }
 
+void VulkanDriver::reallocateTexture(Driver::TextureHandle th,
+        uint8_t levels, uint32_t width, uint32_t height, uint32_t depth) {
+}
+
 void VulkanDriver::updateUniformBuffer(Driver::UniformBufferHandle ubh,
         UniformBuffer&& uniformBuffer) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
     if (uniformBuffer.isDirty()) {
-        buffer->loadFromCpu(uniformBuffer.getBuffer(), (uint32_t) uniformBuffer.getSize());
+        // only the dirty range is uploaded, the rest of the buffer already has its content
+        const size_t offset = uniformBuffer.getDirtyOffset();
+        buffer->loadFromCpu(static_cast<char const*>(uniformBuffer.getBuffer()) + offset,
+                (uint32_t) offset, (uint32_t) uniformBuffer.getDirtySize());
     }
     buffer->ub = std::move(uniformBuffer);
 }
 
+void VulkanDriver::updateUniformBuffers(BufferDescriptor&& p,
+        Driver::UniformBufferUpdate const* updates, uint32_t count) {
+    if (count == 0) {
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    // The ranges are packed back to back, they're staged with a single copy and uploaded by a
+    // single one-off command buffer, rather than one per buffer like loadFromCpu() does.
+    VulkanStage const* stage = mStagePool.acquireStage(uint32_t(p.size));
+    memcpy(stage->mapped, p.buffer, p.size);
+    scheduleDestroy(std::move(p));
+
+    submitOneOff(mContext, [this, updates, count, stage] (VkCommandBuffer cmdbuffer) {
+        VkDeviceSize srcOffset = stage->offset;
+        for (uint32_t i = 0; i < count; i++) {
+            Driver::UniformBufferHandle ubh = updates[i].ubh;
+            auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
+            VkBufferCopy region {
+                .srcOffset = srcOffset,
+                .dstOffset = updates[i].byteOffset,
+                .size = updates[i].byteSize
+            };
+            vkCmdCopyBuffer(cmdbuffer, stage->buffer, buffer->getGpuBuffer(), 1, &region);
+            srcOffset += updates[i].byteSize;
+        }
+
+        // A single barrier ensures that all the copies finish before the next draw call.
+        VkMemoryBarrier barrier {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+            .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT
+        };
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+                1, &barrier, 0, nullptr, 0, nullptr);
+    }, [this, stage] () {
+        mStagePool.releaseStage(stage);
+    });
+}
+
 void VulkanDriver::updateSamplerBuffer(Driver::SamplerBufferHandle sbh,
         SamplerBuffer&& samplerBuffer) {
-    auto* sb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
+    auto* sb = handle_cast<VulkanSamplerBuffer>(sbh);
     *sb->sb = samplerBuffer;
 }
 
 void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
         const Driver::RenderPassParams& params) {
-
+    if (mFrameDropped) {
+        return;
+    }
     assert(mContext.cmdbuffer);
     assert(mContext.currentSurface);
-    VulkanSurfaceContext& surface = *mContext.currentSurface;
-    const SwapContext& swapContext = surface.swapContexts[surface.currentSwapIndex];
-    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(mHandleMap, rth);
+    mCurrentRenderTarget = handle_cast<VulkanRenderTarget>(rth);
     VulkanRenderTarget* rt = mCurrentRenderTarget;
     const VkExtent2D extent = rt->getExtent();
     assert(extent.width > 0 && extent.height > 0);
@@ -574,9 +963,19 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
     const bool hasDepth = depth.format != VK_FORMAT_UNDEFINED;
     const bool depthOnly = hasDepth && !hasColor;
 
+    // The first subpass draws into a transient attachment that the second one reads, the render
+    // target's color is only written by the second subpass.
+    VulkanAttachment subpassColor = {};
+    if (params.dependencies & RenderPassParams::SUBPASS_INPUT) {
+        assert(hasColor);
+        subpassColor = getSubpassColor(getVkFormat(params.subpassFormat), extent);
+    }
+    const bool hasSubpasses = subpassColor.format != VK_FORMAT_UNDEFINED;
+
     VkImageLayout finalLayout;
     if (!rt->isOffscreen()) {
-        finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        finalLayout = mContext.currentSurface->headless ?
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
     } else if (depthOnly) {
         finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
     } else {
@@ -588,11 +987,16 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
         .colorFormat = color.format,
         .depthFormat = depth.format,
         .flags.value = params.flags,
+        .subpassFormat = subpassColor.format,
     });
     mBinder.bindRenderPass(renderPass);
+    mBinder.bindSubpass(0);
 
     VulkanFboCache::FboKey fbo { .renderPass = renderPass };
     int numAttachments = 0;
+    if (hasSubpasses) {
+      fbo.attachments[numAttachments++] = subpassColor.view;
+    }
     if (hasColor) {
       fbo.attachments[numAttachments++] = color.view;
     }
@@ -612,33 +1016,71 @@ void VulkanDriver::beginRenderPass(Driver::RenderTargetHandle rth,
 
     rt->transformClientRectToPlatform(&renderPassInfo.renderArea);
 
-    VkClearValue clearValues[2] = {};
+    // these are kept until the render pass begins, see getCommandBuffer()
+    if (hasSubpasses) {
+        VkClearValue& clearValue = mClearValues[renderPassInfo.clearValueCount++];
+        clearValue.color.float32[0] = params.clearColor.r;
+        clearValue.color.float32[1] = params.clearColor.g;
+        clearValue.color.float32[2] = params.clearColor.b;
+        clearValue.color.float32[3] = params.clearColor.a;
+    }
     if (hasColor) {
-        VkClearValue& clearValue = clearValues[renderPassInfo.clearValueCount++];
+        VkClearValue& clearValue = mClearValues[renderPassInfo.clearValueCount++];
         clearValue.color.float32[0] = params.clearColor.r;
         clearValue.color.float32[1] = params.clearColor.g;
         clearValue.color.float32[2] = params.clearColor.b;
         clearValue.color.float32[3] = params.clearColor.a;
     }
     if (hasDepth) {
-        VkClearValue& clearValue = clearValues[renderPassInfo.clearValueCount++];
+        VkClearValue& clearValue = mClearValues[renderPassInfo.clearValueCount++];
         clearValue.depthStencil = {(float) params.clearDepth, 0};
     }
-    renderPassInfo.pClearValues = &clearValues[0];
+    renderPassInfo.pClearValues = &mClearValues[0];
 
-    vkCmdBeginRenderPass(swapContext.cmdbuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    mContext.currentRenderPass = renderPassInfo;
+    mSubpassContents = SubpassContents::PENDING;
     if (!(params.clear & RenderPassParams::IGNORE_VIEWPORT)) {
         viewport(params.left, params.bottom, params.width, params.height);
     }
+}
 
-    mContext.currentRenderPass = renderPassInfo;
+void VulkanDriver::nextSubpass(int) {
+    if (mFrameDropped) {
+        return;
+    }
+    assert(mContext.cmdbuffer);
+    assert(mCurrentRenderTarget);
+    // the second subpass is always recorded inline
+    if (mSubpassContents == SubpassContents::SECONDARY) {
+        flushInlineSecondary();
+    } else {
+        getCommandBuffer();
+    }
+    vkCmdNextSubpass(mContext.cmdbuffer, VK_SUBPASS_CONTENTS_INLINE);
+    mSubpassContents = SubpassContents::INLINE;
+    mBinder.bindSubpass(1);
+    mBinder.bindInputAttachment({
+        .imageView = mSubpassColor.view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    });
 }
 
 void VulkanDriver::endRenderPass(int) {
+    if (mFrameDropped) {
+        return;
+    }
     assert(mContext.cmdbuffer);
     assert(mContext.currentSurface);
     assert(mCurrentRenderTarget);
+    // a render pass without any command still needs to begin, for its clears
+    if (mSubpassContents == SubpassContents::SECONDARY) {
+        flushInlineSecondary();
+    } else {
+        getCommandBuffer();
+    }
     vkCmdEndRenderPass(mContext.cmdbuffer);
+    mSubpassContents = SubpassContents::NONE;
+    mBinder.bindInputAttachment({});
     mCurrentRenderTarget = VK_NULL_HANDLE;
     mContext.currentRenderPass.renderPass = VK_NULL_HANDLE;
 }
@@ -655,15 +1097,15 @@ void VulkanDriver::resizeRenderTarget(Driver::RenderTargetHandle rth,
 void VulkanDriver::setRenderPrimitiveBuffer(Driver::RenderPrimitiveHandle rph,
         Driver::VertexBufferHandle vbh, Driver::IndexBufferHandle ibh,
         uint32_t enabledAttributes) {
-    auto primitive = handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
-    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(mHandleMap, vbh),
-            handle_cast<VulkanIndexBuffer>(mHandleMap, ibh), enabledAttributes);
+    auto primitive = handle_cast<VulkanRenderPrimitive>(rph);
+    primitive->setBuffers(handle_cast<VulkanVertexBuffer>(vbh),
+            handle_cast<VulkanIndexBuffer>(ibh), enabledAttributes);
 }
 
 void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
         Driver::PrimitiveType pt, uint32_t offset,
         uint32_t minIndex, uint32_t maxIndex, uint32_t count) {
-    auto& primitive = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    auto& primitive = *handle_cast<VulkanRenderPrimitive>(rph);
     primitive.setPrimitiveType(pt);
     primitive.offset = offset * primitive.indexBuffer->elementSize;
     primitive.count = count;
@@ -673,6 +1115,9 @@ void VulkanDriver::setRenderPrimitiveRange(Driver::RenderPrimitiveHandle rph,
 
 void VulkanDriver::setViewportScissor(
         int32_t left, int32_t bottom, uint32_t width, uint32_t height) {
+    if (mFrameDropped) {
+        return;
+    }
     assert(mContext.cmdbuffer && mCurrentRenderTarget);
     // Compute the intersection of the requested scissor rectangle with the current viewport.
     int32_t x = std::max(left, (int32_t) mContext.viewport.x);
@@ -687,22 +1132,39 @@ void VulkanDriver::setViewportScissor(
     };
 
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
-    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    vkCmdSetScissor(getCommandBuffer(false), 0, 1, &scissor);
+    (sRecorder ? sRecorder->scissor : mCurrentScissor) = scissor;
 }
 
 void VulkanDriver::makeCurrent(Driver::SwapChainHandle sch) {
-    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    VulkanSurfaceContext& sContext = handle_cast<VulkanSwapChain>(sch)->surfaceContext;
     mContext.currentSurface = &sContext;
 }
 
+void VulkanDriver::setPresentationTime(int64_t monotonic_clock_ns) {
+    mPresentationTime = monotonic_clock_ns;
+}
+
 void VulkanDriver::commit(Driver::SwapChainHandle sch) {
+    // There's nothing to present for a dropped frame, its fences can be signaled right away.
+    if (mFrameDropped) {
+        mFrameDropped = false;
+        mPresentationTime = 0;
+        submitPendingFences(mContext);
+        return;
+    }
+
     // Tell Vulkan we're done appending to the command buffer.
     ASSERT_POSTCONDITION(mContext.cmdbuffer,
             "Vulkan driver requires at least one frame before a commit.");
     releaseCommandBuffer(mContext);
 
-    // Present the backbuffer.
-    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(mHandleMap, sch)->surfaceContext;
+    // Present the backbuffer, the frames of a headless swap chain are only read back.
+    VulkanSurfaceContext& surface = handle_cast<VulkanSwapChain>(sch)->surfaceContext;
+    if (surface.headless) {
+        mPresentationTime = 0;
+        return;
+    }
     VkPresentInfoKHR presentInfo {
         .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
         .waitSemaphoreCount = 1,
@@ -711,13 +1173,115 @@ void VulkanDriver::commit(Driver::SwapChainHandle sch) {
         .pSwapchains = &surface.swapchain,
         .pImageIndices = &surface.currentSwapIndex,
     };
+    const VkPresentTimeGOOGLE presentTime {
+        .presentID = mPresentId++,
+        .desiredPresentTime = uint64_t(mPresentationTime),
+    };
+    const VkPresentTimesInfoGOOGLE presentTimesInfo {
+        .sType = VK_STRUCTURE_TYPE_PRESENT_TIMES_INFO_GOOGLE,
+        .swapchainCount = 1,
+        .pTimes = &presentTime,
+    };
+    if (mContext.displayTimingSupported && mPresentationTime) {
+        presentInfo.pNext = &presentTimesInfo;
+    }
+    mPresentationTime = 0;
     VkResult result = vkQueuePresentKHR(surface.presentQueue, &presentInfo);
-    ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR && result != VK_SUBOPTIMAL_KHR,
-            "Stale / resized swap chain not yet supported.");
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        refreshSwapChain(surface);
+        return;
+    }
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueuePresentKHR error.");
 }
 
+// The transient attachment is shared by all the render passes with two subpasses, it's recreated
+// when they need another size or format. Its content never leaves the render pass, so when the
+// device can allocate it lazily, it only ever exists in tile memory.
+VulkanAttachment const& VulkanDriver::getSubpassColor(VkFormat format, VkExtent2D extent) noexcept {
+    if (mSubpassColor.format == format && mSubpassExtent.width == extent.width &&
+            mSubpassExtent.height == extent.height) {
+        return mSubpassColor;
+    }
+    destroySubpassColor();
+
+    VkImageCreateInfo imageInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        .imageType = VK_IMAGE_TYPE_2D,
+        .extent = { extent.width, extent.height, 1 },
+        .format = format,
+        .mipLevels = 1,
+        .arrayLayers = 1,
+        .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+    };
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY,
+        .preferredFlags = VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT
+    };
+    VkResult error = vmaCreateImage(mContext.allocator, &imageInfo, &allocInfo,
+            &mSubpassColor.image, &mSubpassColor.memory, nullptr);
+    ASSERT_POSTCONDITION(!error, "Unable to create transient attachment.");
+
+    VkImageViewCreateInfo viewInfo {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = mSubpassColor.image,
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange.levelCount = 1,
+        .subresourceRange.layerCount = 1,
+    };
+    error = vkCreateImageView(mContext.device, &viewInfo, VKALLOC, &mSubpassColor.view);
+    ASSERT_POSTCONDITION(!error, "Unable to create transient attachment view.");
+
+    mSubpassColor.format = format;
+    mSubpassExtent = extent;
+    return mSubpassColor;
+}
+
+void VulkanDriver::destroySubpassColor() noexcept {
+    if (mSubpassColor.format == VK_FORMAT_UNDEFINED) {
+        return;
+    }
+    const VulkanAttachment attachment = mSubpassColor;
+    mFramebufferCache.evictImageView(attachment.view);
+    mBinder.unbindImageView(attachment.view);
+    for (auto& recorder : mRecorders) {
+        recorder->binder.unbindImageView(attachment.view);
+    }
+    auto destroy = [this, attachment](VkCommandBuffer) {
+        vkDestroyImageView(mContext.device, attachment.view, VKALLOC);
+        vmaDestroyImage(mContext.allocator, attachment.image, attachment.memory);
+    };
+    if (mContext.cmdbuffer) {
+        // the frames in flight may still be using it
+        getSwapContext(mContext).pendingWork.emplace_back(destroy);
+    } else {
+        waitForIdle(mContext);
+        destroy(VK_NULL_HANDLE);
+    }
+    mSubpassColor = {};
+    mSubpassExtent = {};
+}
+
+void VulkanDriver::refreshSwapChain(VulkanSurfaceContext& sc) noexcept {
+    // The framebuffers of the old images must go before new image views can reuse their handles.
+    std::vector<VkImageView> staleViews = { sc.depth.view };
+    for (SwapContext const& swapContext : sc.swapContexts) {
+        staleViews.push_back(swapContext.attachment.view);
+    }
+    if (recreateSwapChain(mContext, sc)) {
+        for (VkImageView view : staleViews) {
+            mFramebufferCache.evictImageView(view);
+        }
+    }
+}
+
 void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t height) {
+    if (mFrameDropped) {
+        return;
+    }
     assert(mContext.cmdbuffer && mCurrentRenderTarget);
     VkViewport viewport = mContext.viewport = {
         .x = (float) left,
@@ -732,21 +1296,30 @@ void VulkanDriver::viewport(ssize_t left, ssize_t bottom, size_t width, size_t h
         .offset = { std::max(0, (int32_t) left), std::max(0, (int32_t) bottom) }
     };
 
+    VkCommandBuffer cmdbuffer = getCommandBuffer(false);
     mCurrentRenderTarget->transformClientRectToPlatform(&scissor);
-    vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &scissor);
+    vkCmdSetScissor(cmdbuffer, 0, 1, &scissor);
+    mCurrentScissor = scissor;
 
     mCurrentRenderTarget->transformClientRectToPlatform(&viewport);
-    vkCmdSetViewport(mContext.cmdbuffer, 0, 1, &viewport);
+    vkCmdSetViewport(cmdbuffer, 0, 1, &viewport);
+    mCurrentViewport = viewport;
 }
 
 void VulkanDriver::bindUniforms(size_t index, Driver::UniformBufferHandle ubh) {
-    auto* buffer = handle_cast<VulkanUniformBuffer>(mHandleMap, ubh);
-    mBinder.bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer());
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
+    getBinder().bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer());
+}
+
+void VulkanDriver::bindUniformsRange(size_t index, Driver::UniformBufferHandle ubh,
+        size_t offset, size_t size) {
+    auto* buffer = handle_cast<VulkanUniformBuffer>(ubh);
+    getBinder().bindUniformBuffer((uint32_t) index, buffer->getGpuBuffer(), offset, size);
 }
 
 void VulkanDriver::bindSamplers(size_t index, Driver::SamplerBufferHandle sbh) {
-    auto* hwsb = handle_cast<VulkanSamplerBuffer>(mHandleMap, sbh);
-    mSamplerBindings[index] = hwsb;
+    auto* hwsb = handle_cast<VulkanSamplerBuffer>(sbh);
+    (sRecorder ? sRecorder->samplerBindings : mSamplerBindings)[index] = hwsb;
 }
 
 void VulkanDriver::insertEventMarker(char const* string, size_t len) {
@@ -755,6 +1328,9 @@ void VulkanDriver::insertEventMarker(char const* string, size_t len) {
 void VulkanDriver::pushGroupMarker(char const* string,  size_t len) {
     // TODO: Add group marker color to the Driver API
     constexpr float MARKER_COLOR[] = { 0.0f, 1.0f, 0.0f, 1.0f };
+    if (mFrameDropped) {
+        return;
+    }
     ASSERT_POSTCONDITION(mContext.cmdbuffer,
             "Markers can only be inserted within a beginFrame / endFrame.");
     if (mContext.debugMarkersSupported) {
@@ -762,22 +1338,147 @@ void VulkanDriver::pushGroupMarker(char const* string,  size_t len) {
         markerInfo.sType = VK_STRUCTURE_TYPE_DEBUG_MARKER_MARKER_INFO_EXT;
         memcpy(markerInfo.color, &MARKER_COLOR[0], sizeof(MARKER_COLOR));
         markerInfo.pMarkerName = string;
-        vkCmdDebugMarkerBeginEXT(mContext.cmdbuffer, &markerInfo);
+        vkCmdDebugMarkerBeginEXT(getCommandBuffer(false), &markerInfo);
     }
 }
 
 void VulkanDriver::popGroupMarker(int) {
+    if (mFrameDropped) {
+        return;
+    }
     ASSERT_POSTCONDITION(mContext.cmdbuffer,
             "Markers can only be inserted within a beginFrame / endFrame.");
     if (mContext.debugMarkersSupported) {
-        vkCmdDebugMarkerEndEXT(mContext.cmdbuffer);
+        vkCmdDebugMarkerEndEXT(getCommandBuffer(false));
+    }
+}
+
+void VulkanDriver::beginTimerQuery(Driver::TimerQueryHandle tqh) {
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(tqh);
+    tq->recorded.store(false, std::memory_order_relaxed);
+    if (mFrameDropped) {
+        return;
     }
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VkCommandBuffer cmdbuffer = getCommandBuffer(false);
+    vkCmdResetQueryPool(cmdbuffer, tq->pool, 0, 2);
+    vkCmdWriteTimestamp(cmdbuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, tq->pool, 0);
+}
+
+void VulkanDriver::endTimerQuery(Driver::TimerQueryHandle tqh) {
+    if (mFrameDropped) {
+        return;
+    }
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Timer queries can only be used within a beginFrame / endFrame.");
+    VulkanTimerQuery* tq = handle_cast<VulkanTimerQuery>(tqh);
+    vkCmdWriteTimestamp(getCommandBuffer(false), VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, tq->pool,
+            1);
+    tq->recorded.store(true, std::memory_order_release);
 }
 
 void VulkanDriver::readPixels(Driver::RenderTargetHandle src,
         uint32_t x, uint32_t y, uint32_t width, uint32_t height,
         PixelBufferDescriptor&& p) {
-    scheduleDestroy(std::move(p));
+    // Only 8-bit RGBA color attachments are read back, outside of a render pass. The copy is
+    // recorded into the frame's command buffer and the pixels are handed over once that command
+    // buffer has completed, so this never stalls.
+    VulkanRenderTarget* rt = handle_cast<VulkanRenderTarget>(src);
+    const VulkanAttachment color = mContext.cmdbuffer ? rt->getColor() : VulkanAttachment {};
+    if (mFrameDropped || mCurrentRenderTarget || color.format != VK_FORMAT_R8G8B8A8_UNORM ||
+            p.format != PixelDataFormat::RGBA || p.type != PixelDataType::UBYTE) {
+        utils::slog.w << "readPixels: unsupported format or render target" << utils::io::endl;
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    // The color attachments are left in the final layout of their render pass.
+    VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    if (!rt->isOffscreen()) {
+        layout = mContext.currentSurface->headless ?
+                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+
+    VkRect2D rect { { int32_t(x), int32_t(y) }, { width, height } };
+    rt->transformClientRectToPlatform(&rect);
+    width = rect.extent.width;
+    height = rect.extent.height;
+    if (width == 0 || height == 0) {
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    VkBuffer buffer;
+    VmaAllocation memory;
+    VkBufferCreateInfo bufferInfo {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .size = VkDeviceSize(width) * height * 4,
+        .usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+    };
+    // Coherent, so the mapped memory never needs to be invalidated.
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_TO_CPU,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+    };
+    VkResult result = vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &buffer,
+            &memory, nullptr);
+    if (result != VK_SUCCESS) {
+        utils::slog.e << "readPixels: unable to create the readback buffer" << utils::io::endl;
+        scheduleDestroy(std::move(p));
+        return;
+    }
+
+    VkImageMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT,
+        .oldLayout = layout,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = color.image,
+        .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .subresourceRange.levelCount = 1,
+        .subresourceRange.layerCount = 1,
+    };
+    vkCmdPipelineBarrier(mContext.cmdbuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    VkBufferImageCopy region {
+        .imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .imageSubresource.layerCount = 1,
+        .imageOffset = { rect.offset.x, rect.offset.y, 0 },
+        .imageExtent = { width, height, 1 },
+    };
+    vkCmdCopyImageToBuffer(mContext.cmdbuffer, color.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            buffer, 1, &region);
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = layout;
+    vkCmdPipelineBarrier(mContext.cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    // The tasks of a swap context run once its command buffer has completed. Vulkan's rows go
+    // top-down, they're flipped into the bottom-up layout of the client's buffer.
+    auto pbd = std::make_shared<PixelBufferDescriptor>(std::move(p));
+    getSwapContext(mContext).pendingWork.emplace_back(
+            [this, pbd, buffer, memory, width, height](VkCommandBuffer) {
+        PixelBufferDescriptor& pixels = *pbd;
+        void* mapped = nullptr;
+        vmaMapMemory(mContext.allocator, memory, &mapped);
+        const size_t bpr = PixelBufferDescriptor::computeDataSize(pixels.format, pixels.type,
+                pixels.stride ? pixels.stride : width, 1, pixels.alignment);
+        const size_t rowSize = width * 4;
+        auto* const dst = static_cast<uint8_t*>(pixels.buffer) + pixels.left * 4;
+        auto const* const src = static_cast<uint8_t const*>(mapped);
+        for (uint32_t row = 0; row < height; row++) {
+            memcpy(dst + (pixels.top + height - 1 - row) * bpr, src + row * rowSize, rowSize);
+        }
+        vmaUnmapMemory(mContext.allocator, memory);
+        vmaDestroyBuffer(mContext.allocator, buffer, memory);
+        scheduleDestroy(std::move(pixels));
+    });
 }
 
 void VulkanDriver::readStreamPixels(Driver::StreamHandle sh, uint32_t x, uint32_t y, uint32_t width,
@@ -794,12 +1495,29 @@ void VulkanDriver::blit(TargetBufferFlags buffers,
 
 void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterState,
         Driver::RenderPrimitiveHandle rph) {
-    VkCommandBuffer cmdbuffer = mContext.cmdbuffer;
-    ASSERT_POSTCONDITION(cmdbuffer, "Draw calls can occur only within a beginFrame / endFrame.");
-    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(mHandleMap, rph);
+    drawInstanced(ph, rasterState, rph, 1);
+}
+
+// This is also called by the threads recording the chunks of commands, everything it changes
+// belongs to their recorder, see executeChunks().
+void VulkanDriver::drawInstanced(Driver::ProgramHandle ph, Driver::RasterState rasterState,
+        Driver::RenderPrimitiveHandle rph, uint32_t instanceCount) {
+    if (mFrameDropped) {
+        return;
+    }
+    ASSERT_POSTCONDITION(mContext.cmdbuffer,
+            "Draw calls can occur only within a beginFrame / endFrame.");
+    Recorder* const recorder = sRecorder;
+    VkCommandBuffer cmdbuffer = getCommandBuffer();
+    VulkanBinder& binder = recorder ? recorder->binder : mBinder;
+    VulkanSamplerBuffer* const* samplerBindings =
+            recorder ? recorder->samplerBindings : mSamplerBindings;
+    VulkanBinder::RasterState& vkRasterState =
+            recorder ? recorder->rasterState : mContext.rasterState;
+    const VulkanRenderPrimitive& prim = *handle_cast<VulkanRenderPrimitive>(rph);
 
     // If this is a debug build, validate the current shader.
-    auto* program = handle_cast<VulkanProgram>(mHandleMap, ph);
+    auto* program = handle_cast<VulkanProgram>(ph);
 #if !defined(NDEBUG)
     if (program->bundle.vertex == VK_NULL_HANDLE || program->bundle.fragment == VK_NULL_HANDLE) {
         utils::slog.e << "Binding missing shader: " << program->name.c_str() << utils::io::endl;
@@ -807,7 +1525,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
 #endif
 
     // Update the VK raster state.
-    mContext.rasterState.depthStencil = {
+    vkRasterState.depthStencil = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
         .depthTestEnable = VK_TRUE,
         .depthWriteEnable = (VkBool32) rasterState.depthWrite,
@@ -815,7 +1533,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
         .depthBoundsTestEnable = VK_FALSE,
         .stencilTestEnable = VK_FALSE,
     };
-    mContext.rasterState.blending = {
+    vkRasterState.blending = {
         .blendEnable = rasterState.hasBlending(),
         .srcColorBlendFactor = getBlendFactor(rasterState.blendFunctionSrcRGB),
         .dstColorBlendFactor = getBlendFactor(rasterState.blendFunctionDstRGB),
@@ -839,16 +1557,16 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     }
 
     // Push state changes to the VulkanBinder instance. This is fast and does not make VK calls.
-    mBinder.bindProgramBundle(shaderHandles);
-    mBinder.bindRasterState(mContext.rasterState);
-    mBinder.bindPrimitiveTopology(prim.primitiveTopology);
-    mBinder.bindVertexArray(prim.varray);
+    binder.bindProgramBundle(shaderHandles);
+    binder.bindRasterState(vkRasterState);
+    binder.bindPrimitiveTopology(prim.primitiveTopology);
+    binder.bindVertexArray(prim.varray);
 
     // Query the program for the mapping from (SamplerBufferBinding,Offset) to (SamplerBinding),
     // where "SamplerBinding" is the integer in the GLSL, and SamplerBufferBinding is the abstract
     // Filament concept used to form groups of samplers.
     for (uint8_t bufferIdx = 0; bufferIdx < VulkanBinder::NUM_SAMPLER_BINDINGS; bufferIdx++) {
-        VulkanSamplerBuffer* vksb = mSamplerBindings[bufferIdx];
+        VulkanSamplerBuffer* vksb = samplerBindings[bufferIdx];
         if (!vksb) {
             continue;
         }
@@ -863,8 +1581,8 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
                     &group)) {
                 const SamplerParams& samplerParams = sampler->s;
                 VkSampler vksampler = mSamplerCache.getSampler(samplerParams);
-                const auto* tex = handle_const_cast<VulkanTexture>(mHandleMap, sampler->t);
-                mBinder.bindSampler(binding, {
+                const auto* tex = handle_const_cast<VulkanTexture>(sampler->t);
+                binder.bindSampler(binding, {
                     .sampler = vksampler,
                     .imageView = tex->imageView,
                     .imageLayout = samplerParams.depthStencil ?
@@ -878,7 +1596,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     // Bind a new descriptor set if it needs to change.
     VkDescriptorSet descriptor;
     VkPipelineLayout pipelineLayout;
-    if (mBinder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
+    if (binder.getOrCreateDescriptor(&descriptor, &pipelineLayout)) {
         vkCmdBindDescriptorSets(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
                 &descriptor, 0, nullptr);
     }
@@ -886,7 +1604,7 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
     // Bind the pipeline if it changed. This can happen, for example, if the raster state changed.
     // Creating a new pipeline is slow, so we should consider using pipeline cache objects.
     VkPipeline pipeline;
-    if (mBinder.getOrCreatePipeline(&pipeline)) {
+    if (binder.getOrCreatePipeline(&pipeline)) {
         vkCmdBindPipeline(cmdbuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
     }
 
@@ -899,26 +1617,215 @@ void VulkanDriver::draw(Driver::ProgramHandle ph, Driver::RasterState rasterStat
             prim.indexBuffer->indexType);
 
     // Finally, make the actual draw call. TODO: support subranges
+    // gl_InstanceIndex must start at zero, because it indexes the instances uniform buffer.
     const uint32_t indexCount = prim.count;
-    const uint32_t instanceCount = 1;
     const uint32_t firstIndex = prim.offset / prim.indexBuffer->elementSize;
     const int32_t vertexOffset = 0;
-    const uint32_t firstInstId = 1;
+    const uint32_t firstInstId = 0;
     vkCmdDrawIndexed(cmdbuffer, indexCount, instanceCount, firstIndex, vertexOffset, firstInstId);
 }
 
+// The chunks are recorded in parallel into secondary command buffers when they start a subpass,
+// or follow other secondary command buffers. They're executed in order on this thread otherwise,
+// since the contents of a subpass can't change, as well as when the commands are timed or
+// captured, which isn't thread-safe.
+void VulkanDriver::executeChunks(CommandBase* const* chunks, size_t count) {
+    bool parallel = count > 1 && !mFrameDropped &&
+            (mSubpassContents == SubpassContents::PENDING ||
+             mSubpassContents == SubpassContents::SECONDARY);
+#ifdef FILAMENT_DRIVER_COMMAND_TIMING
+    parallel = false;
+#endif
+#ifdef FILAMENT_DRIVER_COMMAND_CAPTURE
+    parallel = parallel && !getDispatcher().capture;
+#endif
+    if (!parallel) {
+        Driver::executeChunks(chunks, count);
+        return;
+    }
+
+    if (mSubpassContents == SubpassContents::PENDING) {
+        vkCmdBeginRenderPass(mContext.cmdbuffer, &mContext.currentRenderPass,
+                VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        mSubpassContents = SubpassContents::SECONDARY;
+    }
+    // the commands of this thread since the previous chunks go first
+    flushInlineSecondary();
+
+    // The recorders and their threads are created the first time they're needed, each chunk starts
+    // with the state left by the commands before it.
+    if (UTILS_UNLIKELY(!mJobSystem)) {
+        const size_t threadCount = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        mJobSystem.reset(new utils::JobSystem(
+                std::min(threadCount, size_t(ChunksCommand::MAX_CHUNK_COUNT - 1))));
+        mJobSystem->adopt();
+    }
+    while (UTILS_UNLIKELY(mRecorders.size() < count)) {
+        std::unique_ptr<Recorder> recorder(new Recorder());
+        VkCommandPoolCreateInfo createInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+            .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+                    VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+            .queueFamilyIndex = mContext.graphicsQueueFamilyIndex,
+        };
+        VkResult result = vkCreateCommandPool(mContext.device, &createInfo, VKALLOC,
+                &recorder->commandPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+        recorder->binder.setDevice(mContext.device);
+        recorder->binder.setPipelineCache(mPipelineCache);
+        recorder->binder.setUseUpdateTemplates(mContext.descriptorUpdateTemplateSupported);
+        mRecorders.push_back(std::move(recorder));
+    }
+    for (size_t i = 0; i < count; i++) {
+        Recorder& recorder = *mRecorders[i];
+        recorder.binder.copyBindings(mBinder);
+        std::copy(std::begin(mSamplerBindings), std::end(mSamplerBindings),
+                recorder.samplerBindings);
+        recorder.rasterState = mContext.rasterState;
+        recorder.scissor = mCurrentScissor;
+    }
+
+    auto record = [this, chunks](uint32_t s, uint32_t n) {
+        for (uint32_t i = s; i < s + n; i++) {
+            recordChunk(*mRecorders[i], chunks[i]);
+        }
+    };
+    utils::JobSystem& js = *mJobSystem;
+    auto job = utils::jobs::parallel_for(js, nullptr, 0, uint32_t(count),
+            std::cref(record), utils::jobs::CountSplitter<1, 8>());
+    js.run(job);
+    js.waitAndRelease(job);
+
+    std::array<VkCommandBuffer, ChunksCommand::MAX_CHUNK_COUNT> cmdbuffers;
+    for (size_t i = 0; i < count; i++) {
+        cmdbuffers[i] = mRecorders[i]->cmdbuffer;
+    }
+    vkCmdExecuteCommands(mContext.cmdbuffer, (uint32_t) count, cmdbuffers.data());
+    mPrimaryStateLost = true;
+
+    // the commands that follow see the state left by the last chunk
+    Recorder const& last = *mRecorders[count - 1];
+    mBinder.copyBindings(last.binder);
+    std::copy(std::begin(last.samplerBindings), std::end(last.samplerBindings),
+            mSamplerBindings);
+    mContext.rasterState = last.rasterState;
+    mCurrentScissor = last.scissor;
+
+    // the command buffers are recycled once the GPU is done with this frame
+    getSwapContext(mContext).pendingWork.emplace_back(
+            [this, cmdbuffers, count](VkCommandBuffer) {
+        for (size_t i = 0; i < count; i++) {
+            mRecorders[i]->freeBuffers.push_back(cmdbuffers[i]);
+        }
+    });
+}
+
+void VulkanDriver::recordChunk(Recorder& recorder, CommandBase* chunk) noexcept {
+    recorder.cmdbuffer = beginSecondary(recorder.commandPool, recorder.freeBuffers,
+            recorder.scissor);
+    sRecorder = &recorder;
+    ChunksCommand::executeChunk(*this, chunk);
+    sRecorder = nullptr;
+    vkEndCommandBuffer(recorder.cmdbuffer);
+}
+
+// Returns the command buffer the commands of this thread are recorded into. The first command
+// recorded inside a pending render pass begins it with inline contents, while the dynamic state
+// (inRenderPass false) can still be set beforehand.
+VkCommandBuffer VulkanDriver::getCommandBuffer(bool inRenderPass) noexcept {
+    if (sRecorder) {
+        return sRecorder->cmdbuffer;
+    }
+    if (mSubpassContents == SubpassContents::SECONDARY) {
+        if (!mInlineSecondary) {
+            mInlineSecondary = beginSecondary(mContext.commandPool, mInlineFreeBuffers,
+                    mCurrentScissor);
+            mBinder.resetBindings();
+        }
+        return mInlineSecondary;
+    }
+    if (mSubpassContents == SubpassContents::PENDING && inRenderPass) {
+        vkCmdBeginRenderPass(mContext.cmdbuffer, &mContext.currentRenderPass,
+                VK_SUBPASS_CONTENTS_INLINE);
+        mSubpassContents = SubpassContents::INLINE;
+    }
+    if (UTILS_UNLIKELY(mPrimaryStateLost)) {
+        vkCmdSetViewport(mContext.cmdbuffer, 0, 1, &mCurrentViewport);
+        vkCmdSetScissor(mContext.cmdbuffer, 0, 1, &mCurrentScissor);
+        mBinder.resetBindings();
+        mPrimaryStateLost = false;
+    }
+    return mContext.cmdbuffer;
+}
+
+// Secondary command buffers continue the first subpass of the current render pass, they don't
+// inherit any dynamic state.
+VkCommandBuffer VulkanDriver::beginSecondary(VkCommandPool pool,
+        std::vector<VkCommandBuffer>& freeBuffers, VkRect2D const& scissor) noexcept {
+    VkCommandBuffer cmdbuffer;
+    if (freeBuffers.empty()) {
+        VkCommandBufferAllocateInfo allocateInfo {
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            .commandPool = pool,
+            .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+            .commandBufferCount = 1,
+        };
+        VkResult result = vkAllocateCommandBuffers(mContext.device, &allocateInfo, &cmdbuffer);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkAllocateCommandBuffers error.");
+    } else {
+        cmdbuffer = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    VkCommandBufferInheritanceInfo inheritanceInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .renderPass = mContext.currentRenderPass.renderPass,
+        .subpass = 0,
+        .framebuffer = mContext.currentRenderPass.framebuffer,
+    };
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT |
+                VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = &inheritanceInfo,
+    };
+    VkResult result = vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkBeginCommandBuffer error.");
+    vkCmdSetViewport(cmdbuffer, 0, 1, &mCurrentViewport);
+    vkCmdSetScissor(cmdbuffer, 0, 1, &scissor);
+    return cmdbuffer;
+}
+
+void VulkanDriver::flushInlineSecondary() noexcept {
+    if (!mInlineSecondary) {
+        return;
+    }
+    const VkCommandBuffer cmdbuffer = mInlineSecondary;
+    vkEndCommandBuffer(cmdbuffer);
+    vkCmdExecuteCommands(mContext.cmdbuffer, 1, &cmdbuffer);
+    mInlineSecondary = VK_NULL_HANDLE;
+    mPrimaryStateLost = true;
+    getSwapContext(mContext).pendingWork.emplace_back([this, cmdbuffer](VkCommandBuffer) {
+        mInlineFreeBuffers.push_back(cmdbuffer);
+    });
+}
+
 #ifndef NDEBUG
 void VulkanDriver::debugCommand(const char* methodName) {
     static const std::set<utils::StaticString> OUTSIDE_COMMANDS = {
         "updateUniformBuffer",
+        "updateUniformBuffers",
         "loadVertexBuffer",
+        "loadVertexBufferRanges",
         "loadIndexBuffer",
         "load2DImage",
+        "load3DImage",
         "loadCubeImage",
+        "reallocateTexture",
     };
     static const utils::StaticString BEGIN_COMMAND = "beginRenderPass";
     static const utils::StaticString END_COMMAND = "endRenderPass";
-    static bool inRenderPass = false;
+    // commands are also recorded by the threads creating objects, outside of any render pass
+    static thread_local bool inRenderPass = false;
     const utils::StaticString command(methodName, strlen(methodName));
     if (command == BEGIN_COMMAND) {
         assert(!inRenderPass);
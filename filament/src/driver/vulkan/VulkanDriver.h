@@ -28,8 +28,9 @@
 
 #include <utils/compiler.h>
 #include <utils/Allocator.h>
+#include <utils/JobSystem.h>
 
-#include <unordered_map>
+#include <memory>
 #include <vector>
 
 namespace filament {
@@ -56,6 +57,8 @@ private:
 
     virtual ShaderModel getShaderModel() const noexcept override final;
 
+    void executeChunks(CommandBase* const* chunks, size_t count) override;
+
     template<typename T>
     friend class ::filament::ConcreteDispatcher;
 
@@ -77,65 +80,148 @@ private:
 
     driver::ContextManagerVk& mContextManager;
 
-    // For now we're not bothering to store handles in pools, just simple on-demand allocation.
-    // We have a little map from integer handles to "blobs" which get replaced with the Hw objects.
-    using Blob = std::vector<uint8_t>;
-    using HandleMap = std::unordered_map<HandleBase::HandleId, Blob>;
-    HandleMap mHandleMap;
-    HandleBase::HandleId mNextId = 1;
+    // Hardware objects live in an arena, the handle's id is their offset from its start
+    // (in units of 16 bytes), so that handle_cast is a simple addition.
+    class HandleAllocator {
+        utils::PoolAllocator< 32, 16>   mPool0;
+        utils::PoolAllocator<128, 32>   mPool1;
+        utils::PoolAllocator<256, 32>   mPool2;
+    public:
+        static constexpr size_t MIN_ALIGNMENT_SHIFT = 4;
+        HandleAllocator(const utils::HeapArea& area);
+        void* alloc(size_t size, size_t alignment, size_t extra = 0) noexcept;
+        void free(void* p, size_t size) noexcept;
+    };
+
+    // the handles are allocated on the main thread and constructed on the driver thread
+#ifndef NDEBUG
+    using HandleArena = utils::Arena<HandleAllocator,
+            utils::LockingPolicy::SpinLock,
+            utils::TrackingPolicy::HighWatermark>;
+#else
+    using HandleArena = utils::Arena<HandleAllocator,
+            utils::LockingPolicy::SpinLock>;
+#endif
+
+    HandleArena mHandleArena;
+
+    HandleBase::HandleId allocateHandle(size_t size) noexcept;
 
     template<typename Dp, typename B>
     Handle<B> alloc_handle() {
-        mHandleMap[mNextId] = Blob(sizeof(Dp));
-        return Handle<B>(mNextId++);
+        static_assert(sizeof(Dp) <= 256, "Handle<> too large");
+        return Handle<B>(allocateHandle(sizeof(Dp)));
     }
 
     template<typename Dp, typename B>
-    Dp* handle_cast(HandleMap& handleMap, Handle<B>& handle) noexcept {
+    Dp* handle_cast(Handle<B> const& handle) noexcept {
         assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<Dp*>(blob.data());
+        char* const base = (char *)mHandleArena.getArea().begin();
+        size_t offset = handle.getId() << HandleAllocator::MIN_ALIGNMENT_SHIFT;
+        return reinterpret_cast<Dp*>(base + offset);
     }
 
     template<typename Dp, typename B>
-    const Dp* handle_const_cast(HandleMap& handleMap, const Handle<B>& handle) noexcept {
-        assert(handle);
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        return reinterpret_cast<const Dp*>(blob.data());
+    const Dp* handle_const_cast(const Handle<B>& handle) noexcept {
+        return handle_cast<Dp>(handle);
     }
 
     template<typename Dp, typename B, typename ... ARGS>
-    Dp* construct_handle(HandleMap& handleMap, Handle<B>& handle, ARGS&& ... args) noexcept {
-        auto iter = handleMap.find(handle.getId());
-        assert(iter != handleMap.end());
-        Blob& blob = iter->second;
-        assert(blob.size() == sizeof(Dp));
-        Dp* addr = reinterpret_cast<Dp*>(blob.data());
+    Dp* construct_handle(Handle<B>& handle, ARGS&& ... args) noexcept {
+        Dp* addr = handle_cast<Dp>(handle);
         new(addr) Dp(std::forward<ARGS>(args)...);
         return addr;
     }
 
     template<typename Dp, typename B>
-    void destruct_handle(HandleMap& handleMap, Handle<B>& handle) noexcept {
-        // Call the destructor, remove the blob, don't bother reclaiming the integer id.
-        handle_cast<Dp>(handleMap, handle)->~Dp();
-        handleMap.erase(handle.getId());
+    void destruct_handle(Handle<B>& handle) noexcept {
+        Dp* addr = handle_cast<Dp>(handle);
+        addr->~Dp();
+        mHandleArena.free(addr, sizeof(Dp));
+    }
+
+    // Destroys the object once the GPU is done with the current frame: this is deferred until
+    // the current swap context's fence signals, i.e. when it's acquired again. Outside of a
+    // frame loop, this waits for the GPU instead.
+    template<typename Dp, typename B>
+    void deferred_destruct_handle(Handle<B>& handle) noexcept {
+        if (UTILS_UNLIKELY(!mContext.currentSurface)) {
+            waitForIdle(mContext);
+            destruct_handle<Dp>(handle);
+            return;
+        }
+        getSwapContext(mContext).pendingWork.emplace_back([this, handle](VkCommandBuffer) {
+            Handle<B> h(handle);
+            destruct_handle<Dp>(h);
+        });
     }
 
     VulkanContext mContext = {};
     VulkanBinder mBinder;
+    VkClearValue mClearValues[3] = {};
     VulkanStagePool mStagePool;
     VulkanFboCache mFramebufferCache;
     VulkanSamplerCache mSamplerCache;
     VulkanRenderTarget* mCurrentRenderTarget = nullptr;
     VulkanSamplerBuffer* mSamplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
     VkDebugReportCallbackEXT mDebugCallback = VK_NULL_HANDLE;
+
+    // set when no swap chain image could be acquired in time, the commands are then ignored until
+    // the next commit()
+    bool mFrameDropped = false;
+    // desired presentation time of the next frame, 0 if none
+    int64_t mPresentationTime = 0;
+    uint32_t mPresentId = 0;
+    void refreshSwapChain(VulkanSurfaceContext& sc) noexcept;
+
+    // The chunks of draw commands are recorded in parallel into secondary command buffers, each
+    // chunk by its own recorder. A recorder is only used by one thread at a time, so it has its
+    // own command pool and its own copy of the state used by the draw calls.
+    struct Recorder {
+        VkCommandPool commandPool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> freeBuffers;
+        VkCommandBuffer cmdbuffer = VK_NULL_HANDLE;
+        VulkanBinder binder;
+        VulkanSamplerBuffer* samplerBindings[VulkanBinder::NUM_SAMPLER_BINDINGS] = {};
+        VulkanBinder::RasterState rasterState;
+        VkRect2D scissor;
+    };
+    std::vector<std::unique_ptr<Recorder>> mRecorders;
+    std::unique_ptr<utils::JobSystem> mJobSystem;
+    static thread_local Recorder* sRecorder;    // the recorder of this thread, if any
+    void recordChunk(Recorder& recorder, CommandBase* chunk) noexcept;
+    VulkanBinder& getBinder() noexcept { return sRecorder ? sRecorder->binder : mBinder; }
+
+    // The contents of a subpass are either inline or secondary command buffers, the render pass
+    // only begins with its first command to find out which. The commands of the driver thread in
+    // a subpass of secondary command buffers are recorded into one of their own.
+    enum class SubpassContents : uint8_t { NONE, PENDING, INLINE, SECONDARY };
+    SubpassContents mSubpassContents = SubpassContents::NONE;
+    VkCommandBuffer mInlineSecondary = VK_NULL_HANDLE;
+    std::vector<VkCommandBuffer> mInlineFreeBuffers;
+    VkCommandBuffer getCommandBuffer(bool inRenderPass = true) noexcept;
+    VkCommandBuffer beginSecondary(VkCommandPool pool, std::vector<VkCommandBuffer>& freeBuffers,
+            VkRect2D const& scissor) noexcept;
+    void flushInlineSecondary() noexcept;
+
+    // The dynamic state isn't inherited by secondary command buffers, and is lost by the primary
+    // once they've been executed, so it's kept here (already transformed to the platform).
+    VkViewport mCurrentViewport = {};
+    VkRect2D mCurrentScissor = {};
+    bool mPrimaryStateLost = false;
+
+    // the transient color attachment of the render passes with two subpasses, see nextSubpass()
+    VulkanAttachment mSubpassColor = {};
+    VkExtent2D mSubpassExtent = {};
+    VulkanAttachment const& getSubpassColor(VkFormat format, VkExtent2D extent) noexcept;
+    void destroySubpassColor() noexcept;
+
+    // all pipelines are created through this cache, it's seeded from and saved to mBlobCache
+    VkPipelineCache mPipelineCache = VK_NULL_HANDLE;
+    BlobCache mBlobCache;
+    void createPipelineCache(void const* data, size_t size) noexcept;
+    void savePipelineCache() noexcept;
+    void logMemoryStats() const noexcept;
 };
 
 } // namespace driver
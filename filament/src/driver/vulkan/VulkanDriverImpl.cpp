@@ -31,9 +31,25 @@
 
 #include <utils/Panic.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
+VulkanCmdFence::VulkanCmdFence(VkDevice device) : device(device) {
+    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    VkResult result = vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateFence error.");
+}
+
+VulkanCmdFence::~VulkanCmdFence() {
+    // A fence can't be destroyed while its submission is pending.
+    if (submitted) {
+        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    }
+    vkDestroyFence(device, fence, VKALLOC);
+}
+
 void selectPhysicalDevice(VulkanContext& context) {
     uint32_t physicalDeviceCount = 0;
     VkResult result = vkEnumeratePhysicalDevices(context.instance, &physicalDeviceCount, nullptr);
@@ -76,6 +92,19 @@ void selectPhysicalDevice(VulkanContext& context) {
         }
         if (context.graphicsQueueFamilyIndex == 0xffff) continue;
 
+        // A queue family that supports transfers but neither graphics nor compute is typically
+        // backed by a DMA engine, uploads submitted there overlap with rendering.
+        context.transferQueueFamilyIndex = context.graphicsQueueFamilyIndex;
+        for (uint32_t j = 0; j < queueFamiliesCount; ++j) {
+            VkQueueFamilyProperties props = queueFamiliesProperties[j];
+            const VkQueueFlags flags = VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT |
+                    VK_QUEUE_COMPUTE_BIT;
+            if (props.queueCount > 0 && (props.queueFlags & flags) == VK_QUEUE_TRANSFER_BIT) {
+                context.transferQueueFamilyIndex = j;
+                break;
+            }
+        }
+
         // Does the device support the VK_KHR_swapchain extension?
         uint32_t extensionCount;
         result = vkEnumerateDeviceExtensionProperties(physicalDevice, /*pLayerName = */ nullptr,
@@ -88,6 +117,8 @@ void selectPhysicalDevice(VulkanContext& context) {
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEnumerateDeviceExtensionProperties error.");
         bool supportsSwapchain = false;
         context.debugMarkersSupported = false;
+        context.displayTimingSupported = false;
+        context.descriptorUpdateTemplateSupported = false;
         for (uint32_t k = 0; k < extensionCount; ++k) {
             if (!strcmp(extensions[k].extensionName, VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
                 supportsSwapchain = true;
@@ -95,6 +126,13 @@ void selectPhysicalDevice(VulkanContext& context) {
             if (!strcmp(extensions[k].extensionName, VK_EXT_DEBUG_MARKER_EXTENSION_NAME)) {
                 context.debugMarkersSupported = true;
             }
+            if (!strcmp(extensions[k].extensionName, VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME)) {
+                context.displayTimingSupported = true;
+            }
+            if (!strcmp(extensions[k].extensionName,
+                    VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME)) {
+                context.descriptorUpdateTemplateSupported = true;
+            }
         }
         if (!supportsSwapchain) continue;
 
@@ -109,7 +147,7 @@ void selectPhysicalDevice(VulkanContext& context) {
 }
 
 void createVirtualDevice(VulkanContext& context) {
-    VkDeviceQueueCreateInfo deviceQueueCreateInfo[1] = {};
+    VkDeviceQueueCreateInfo deviceQueueCreateInfo[2] = {};
     static const float queuePriority[] = {1.0f};
     VkDeviceCreateInfo deviceCreateInfo = {};
     std::vector<const char*> deviceExtensionNames = {
@@ -118,12 +156,24 @@ void createVirtualDevice(VulkanContext& context) {
     if (context.debugMarkersSupported) {
         deviceExtensionNames.push_back(VK_EXT_DEBUG_MARKER_EXTENSION_NAME);
     }
+    if (context.displayTimingSupported) {
+        deviceExtensionNames.push_back(VK_GOOGLE_DISPLAY_TIMING_EXTENSION_NAME);
+    }
+    if (context.descriptorUpdateTemplateSupported) {
+        deviceExtensionNames.push_back(VK_KHR_DESCRIPTOR_UPDATE_TEMPLATE_EXTENSION_NAME);
+    }
     deviceQueueCreateInfo->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
     deviceQueueCreateInfo->queueFamilyIndex = context.graphicsQueueFamilyIndex;
     deviceQueueCreateInfo->queueCount = 1;
     deviceQueueCreateInfo->pQueuePriorities = &queuePriority[0];
+    const bool hasTransferQueue =
+            context.transferQueueFamilyIndex != context.graphicsQueueFamilyIndex;
+    if (hasTransferQueue) {
+        deviceQueueCreateInfo[1] = deviceQueueCreateInfo[0];
+        deviceQueueCreateInfo[1].queueFamilyIndex = context.transferQueueFamilyIndex;
+    }
     deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    deviceCreateInfo.queueCreateInfoCount = 1;
+    deviceCreateInfo.queueCreateInfoCount = hasTransferQueue ? 2 : 1;
     deviceCreateInfo.pQueueCreateInfos = deviceQueueCreateInfo;
     deviceCreateInfo.pEnabledFeatures = nullptr;
     deviceCreateInfo.enabledExtensionCount = deviceExtensionNames.size();
@@ -131,6 +181,11 @@ void createVirtualDevice(VulkanContext& context) {
     VkResult result = vkCreateDevice(context.physicalDevice, &deviceCreateInfo, VKALLOC,
             &context.device);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateDevice error.");
+
+    // Load the device-level entry points from the device itself, to bypass the loader's dispatch
+    // in the command buffer recording calls. This must happen before VMA copies the pointers.
+    bluevk::bindDevice(context.device);
+
     vkGetDeviceQueue(context.device, context.graphicsQueueFamilyIndex, 0,
             &context.graphicsQueue);
     VkCommandPoolCreateInfo createInfo = {};
@@ -140,6 +195,14 @@ void createVirtualDevice(VulkanContext& context) {
     createInfo.queueFamilyIndex = context.graphicsQueueFamilyIndex;
     result = vkCreateCommandPool(context.device, &createInfo, VKALLOC, &context.commandPool);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    if (hasTransferQueue) {
+        vkGetDeviceQueue(context.device, context.transferQueueFamilyIndex, 0,
+                &context.transferQueue);
+        createInfo.queueFamilyIndex = context.transferQueueFamilyIndex;
+        result = vkCreateCommandPool(context.device, &createInfo, VKALLOC,
+                &context.transferCommandPool);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateCommandPool error.");
+    }
 
     const VmaVulkanFunctions funcs {
         .vkGetPhysicalDeviceProperties = vkGetPhysicalDeviceProperties,
@@ -217,12 +280,37 @@ void getSurfaceCaps(VulkanContext& context, VulkanSurfaceContext& sc) {
 }
 
 void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
-    // Pick an image count and format.
-    uint32_t desiredImageCount = 2;
-    if (desiredImageCount < surfaceContext.surfaceCapabilities.minImageCount ||
-            desiredImageCount > surfaceContext.surfaceCapabilities.maxImageCount) {
+    // Pick a present mode, FIFO is the only one that is always supported.
+    VkPresentModeKHR desiredPresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (surfaceContext.flags & SWAP_CHAIN_CONFIG_NO_VSYNC) {
+        desiredPresentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+    } else if (surfaceContext.flags & SWAP_CHAIN_CONFIG_LOW_LATENCY) {
+        desiredPresentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    }
+    uint32_t presentModesCount;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, surfaceContext.surface,
+            &presentModesCount, nullptr);
+    std::vector<VkPresentModeKHR> presentModes(presentModesCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(context.physicalDevice, surfaceContext.surface,
+            &presentModesCount, presentModes.data());
+    surfaceContext.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (std::find(presentModes.begin(), presentModes.end(), desiredPresentMode) !=
+            presentModes.end()) {
+        surfaceContext.presentMode = desiredPresentMode;
+    } else {
+        utils::slog.w << "Swap chain does not support present mode " << desiredPresentMode
+                << ", using FIFO." << utils::io::endl;
+    }
+
+    // Pick an image count and format. Mailbox needs a third image to render into while one is
+    // being displayed and another one is queued. A maxImageCount of 0 means there's no limit.
+    const auto& caps = surfaceContext.surfaceCapabilities;
+    uint32_t desiredImageCount = surfaceContext.presentMode == VK_PRESENT_MODE_MAILBOX_KHR ? 3 : 2;
+    if (desiredImageCount < caps.minImageCount ||
+            (caps.maxImageCount && desiredImageCount > caps.maxImageCount)) {
         utils::slog.e << "Swap chain does not support " << desiredImageCount << " images.\n";
-        desiredImageCount = surfaceContext.surfaceCapabilities.minImageCount;
+        desiredImageCount = std::max(caps.minImageCount, std::min(desiredImageCount,
+                caps.maxImageCount ? caps.maxImageCount : desiredImageCount));
     }
     surfaceContext.surfaceFormat = surfaceContext.surfaceFormats[0];
     for (const VkSurfaceFormatKHR& format : surfaceContext.surfaceFormats) {
@@ -245,11 +333,13 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         .imageColorSpace = surfaceContext.surfaceFormat.colorSpace,
         .imageExtent = size,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                (caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
         .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
         .compositeAlpha = compositeAlpha,
-        .presentMode = VK_PRESENT_MODE_FIFO_KHR,
-        .clipped = VK_TRUE
+        .presentMode = surfaceContext.presentMode,
+        .clipped = VK_TRUE,
+        .oldSwapchain = surfaceContext.swapchain
     };
     VkSwapchainKHR swapchain;
     VkResult result = vkCreateSwapchainKHR(context.device, &createInfo, VKALLOC, &swapchain);
@@ -277,6 +367,7 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
             << ", " << surfaceContext.surfaceFormat.format
             << ", " << surfaceContext.surfaceFormat.colorSpace
             << ", " << imageCount
+            << ", " << surfaceContext.presentMode
             << utils::io::endl;
 
     // Create image views.
@@ -294,12 +385,114 @@ void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& surf
         ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateImageView error.");
     }
 
-    createSemaphore(context.device, &surfaceContext.imageAvailable);
-    createSemaphore(context.device, &surfaceContext.renderingFinished);
+    // The semaphores outlive the swap chain when it's recreated.
+    if (!surfaceContext.imageAvailable) {
+        createSemaphore(context.device, &surfaceContext.imageAvailable);
+        createSemaphore(context.device, &surfaceContext.renderingFinished);
+    }
+
+    surfaceContext.depth = {};
+}
 
+void createHeadlessImages(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
+    // Two images are enough for the CPU to record a frame while the GPU renders the previous one,
+    // more frames in flight are paced by the engine's fences.
+    const auto size = surfaceContext.surfaceCapabilities.currentExtent;
+    surfaceContext.surfaceFormat = { VK_FORMAT_R8G8B8A8_UNORM, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+    surfaceContext.swapContexts.resize(2);
+    for (SwapContext& swapContext : surfaceContext.swapContexts) {
+        VkImageCreateInfo imageInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .extent = { size.width, size.height, 1 },
+            .format = surfaceContext.surfaceFormat.format,
+            .mipLevels = 1,
+            .arrayLayers = 1,
+            .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                    VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+            .samples = VK_SAMPLE_COUNT_1_BIT,
+        };
+        VmaAllocationCreateInfo allocInfo {
+            .usage = VMA_MEMORY_USAGE_GPU_ONLY
+        };
+        VulkanAttachment& attachment = swapContext.attachment;
+        attachment.format = surfaceContext.surfaceFormat.format;
+        VkResult result = vmaCreateImage(context.allocator, &imageInfo, &allocInfo,
+                &attachment.image, &attachment.memory, nullptr);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "Unable to create headless image.");
+
+        VkImageViewCreateInfo viewInfo {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+            .image = attachment.image,
+            .viewType = VK_IMAGE_VIEW_TYPE_2D,
+            .format = attachment.format,
+            .subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .subresourceRange.levelCount = 1,
+            .subresourceRange.layerCount = 1,
+        };
+        result = vkCreateImageView(context.device, &viewInfo, VKALLOC, &attachment.view);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkCreateImageView error.");
+    }
+    utils::slog.i << "Headless swap chain: " << size.width << "x" << size.height
+            << utils::io::endl;
     surfaceContext.depth = {};
 }
 
+bool recreateSwapChain(VulkanContext& context, VulkanSurfaceContext& surfaceContext) {
+    assert(!context.cmdbuffer);
+    VkDevice device = context.device;
+
+    // There's nothing to present to while the surface has no size (e.g. a minimized window), keep
+    // the stale swap chain until it has one.
+    const VkSurfaceCapabilitiesKHR previousCaps = surfaceContext.surfaceCapabilities;
+    getSurfaceCaps(context, surfaceContext);
+    const VkExtent2D size = surfaceContext.surfaceCapabilities.currentExtent;
+    if (size.width == 0 || size.height == 0) {
+        surfaceContext.surfaceCapabilities = previousCaps;
+        return false;
+    }
+
+    // Rather than idling the device, wait for the frames that render into this swap chain only.
+    // After that the work deferred to their swap contexts can run anytime, it's handed over to the
+    // global queue (after the work already there, which might refer to it).
+    std::vector<VkFence> fences;
+    for (SwapContext& swapContext : surfaceContext.swapContexts) {
+        fences.push_back(swapContext.fence);
+    }
+    vkWaitForFences(device, (uint32_t) fences.size(), fences.data(), VK_TRUE, UINT64_MAX);
+    for (SwapContext& swapContext : surfaceContext.swapContexts) {
+        for (VulkanTask& task : swapContext.pendingWork) {
+            context.pendingWork.push_back(std::move(task));
+        }
+        vkFreeCommandBuffers(device, context.commandPool, 1, &swapContext.cmdbuffer);
+        vkDestroyFence(device, swapContext.fence, VKALLOC);
+        vkDestroyImageView(device, swapContext.attachment.view, VKALLOC);
+    }
+    surfaceContext.swapContexts.clear();
+    const VkFormat depthFormat = surfaceContext.depth.format;
+    if (surfaceContext.depth.view) {
+        vkDestroyImageView(device, surfaceContext.depth.view, VKALLOC);
+        vmaDestroyImage(context.allocator, surfaceContext.depth.image, surfaceContext.depth.memory);
+    }
+
+    // The platform only reports the client size when the surface is created, keep its ratio to
+    // the surface size.
+    VkExtent2D& clientSize = surfaceContext.clientSize;
+    clientSize.width = clientSize.width * size.width / previousCaps.currentExtent.width;
+    clientSize.height = clientSize.height * size.height / previousCaps.currentExtent.height;
+
+    // The old swap chain is retired by the new one, which it hands its resources over to.
+    VkSwapchainKHR oldSwapchain = surfaceContext.swapchain;
+    createSwapChainAndImages(context, surfaceContext);
+    vkDestroySwapchainKHR(device, oldSwapchain, VKALLOC);
+    createCommandBuffersAndFences(context, surfaceContext);
+    surfaceContext.currentSwapIndex = 0;
+    if (depthFormat != VK_FORMAT_UNDEFINED) {
+        transitionDepthBuffer(context, surfaceContext, depthFormat);
+    }
+    return true;
+}
+
 void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceContext,
         VkFormat depthFormat) {
     assert(context.cmdbuffer);
@@ -317,23 +510,12 @@ void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& surfaceCont
         .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &depthImage);
-    ASSERT_POSTCONDITION(!error, "Unable to create depth image.");
-
-    // Allocate memory for the VkImage and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(context.device, depthImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
-    error = vkAllocateMemory(context.device, &allocInfo, nullptr,
-            &surfaceContext.depth.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate depth memory.");
-    error = vkBindImageMemory(context.device, depthImage, surfaceContext.depth.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind depth memory.");
+    VkResult error = vmaCreateImage(context.allocator, &imageInfo, &allocInfo, &depthImage,
+            &surfaceContext.depth.memory, nullptr);
+    ASSERT_POSTCONDITION(!error, "Unable to create depth image.");
 
     // Create a VkImageView so that we can attach depth to the framebuffer.
     VkImageView depthView;
@@ -436,16 +618,21 @@ void destroySurfaceContext(VulkanContext& context, VulkanSurfaceContext& surface
         vkFreeCommandBuffers(context.device, context.commandPool, 1, &swapContext.cmdbuffer);
         vkDestroyFence(context.device, swapContext.fence, VKALLOC);
         vkDestroyImageView(context.device, swapContext.attachment.view, VKALLOC);
+        if (swapContext.attachment.memory) {
+            vmaDestroyImage(context.allocator, swapContext.attachment.image,
+                    swapContext.attachment.memory);
+        }
         swapContext.fence = VK_NULL_HANDLE;
         swapContext.attachment.view = VK_NULL_HANDLE;
     }
-    vkDestroySwapchainKHR(context.device, surfaceContext.swapchain, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.imageAvailable, VKALLOC);
-    vkDestroySemaphore(context.device, surfaceContext.renderingFinished, VKALLOC);
-    vkDestroySurfaceKHR(context.instance, surfaceContext.surface, VKALLOC);
+    if (!surfaceContext.headless) {
+        vkDestroySwapchainKHR(context.device, surfaceContext.swapchain, VKALLOC);
+        vkDestroySemaphore(context.device, surfaceContext.imageAvailable, VKALLOC);
+        vkDestroySemaphore(context.device, surfaceContext.renderingFinished, VKALLOC);
+        vkDestroySurfaceKHR(context.instance, surfaceContext.surface, VKALLOC);
+    }
     vkDestroyImageView(context.device, surfaceContext.depth.view, VKALLOC);
-    vkDestroyImage(context.device, surfaceContext.depth.image, VKALLOC);
-    vkFreeMemory(context.device, surfaceContext.depth.memory, VKALLOC);
+    vmaDestroyImage(context.allocator, surfaceContext.depth.image, surfaceContext.depth.memory);
     if (context.currentSurface == &surfaceContext) {
         context.currentSurface = nullptr;
     }
@@ -488,6 +675,7 @@ VkFormat getVkFormat(ElementType type, bool normalized) {
             case ElementType::UBYTE4: return VK_FORMAT_R8G8B8A8_UNORM;
             case ElementType::SHORT4: return VK_FORMAT_R16G16B16A16_SNORM;
             case ElementType::USHORT4: return VK_FORMAT_R16G16B16A16_UNORM;
+            case ElementType::INT_2_10_10_10_REV: return VK_FORMAT_A2B10G10R10_SNORM_PACK32;
             default:
                 ASSERT_POSTCONDITION(false, "Normalized format does not exist.");
                 return VK_FORMAT_UNDEFINED;
@@ -524,6 +712,8 @@ VkFormat getVkFormat(ElementType type, bool normalized) {
         case ElementType::USHORT4: return VK_FORMAT_R16G16B16A16_UINT;
         case ElementType::HALF4: return VK_FORMAT_R16G16B16A16_SFLOAT;
         case ElementType::FLOAT4: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        // Packed Types, read as floats like glVertexAttribPointer() does
+        case ElementType::INT_2_10_10_10_REV: return VK_FORMAT_A2B10G10R10_SSCALED_PACK32;
     }
     return VK_FORMAT_UNDEFINED;
 }
@@ -683,18 +873,16 @@ void waitForIdle(VulkanContext& context) {
     }
 
     // First, wait for submitted command buffer(s) to finish.
-    VkFence fences[2];
-    uint32_t nfences = 0;
+    std::vector<VkFence> fences;
     auto& surfaceContext = *context.currentSurface;
     for (auto& swapContext : surfaceContext.swapContexts) {
-        assert(nfences < 2);
         if (swapContext.submitted && swapContext.fence) {
-            fences[nfences++] = swapContext.fence;
+            fences.push_back(swapContext.fence);
             swapContext.submitted = false;
         }
     }
-    if (nfences > 0) {
-        vkWaitForFences(context.device, nfences, fences, VK_FALSE, ~0ull);
+    if (!fences.empty()) {
+        vkWaitForFences(context.device, (uint32_t) fences.size(), fences.data(), VK_TRUE, ~0ull);
     }
 
     // If we don't have any pending work, we're done.
@@ -723,10 +911,9 @@ void waitForIdle(VulkanContext& context) {
 
     // Keep performing work until there's nothing queued up. This should never iterate more than
     // a couple times because the only work we queue up is for resource transition / reclamation.
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    std::vector<VkPipelineStageFlags> waitDestStageMasks;
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .pWaitDstStageMask = &waitDestStageMask,
         .commandBufferCount = 1,
         .pCommandBuffers = &cmdbuffer,
     };
@@ -740,7 +927,13 @@ void waitForIdle(VulkanContext& context) {
             vkBeginCommandBuffer(cmdbuffer, &beginInfo);
             performPendingWork(context, swapContext, cmdbuffer);
             vkEndCommandBuffer(cmdbuffer);
+            waitDestStageMasks.assign(context.transferSemaphores.size(),
+                    VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+            submitInfo.waitSemaphoreCount = (uint32_t) context.transferSemaphores.size();
+            submitInfo.pWaitSemaphores = context.transferSemaphores.data();
+            submitInfo.pWaitDstStageMask = waitDestStageMasks.data();
             vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, fence);
+            context.transferSemaphores.clear();
             vkWaitForFences(context.device, 1, &fence, VK_FALSE, UINT64_MAX);
             vkResetFences(context.device, 1, &fence);
             vkResetCommandBuffer(cmdbuffer, 0);
@@ -750,15 +943,24 @@ void waitForIdle(VulkanContext& context) {
     vkDestroyFence(context.device, fence, VKALLOC);
 }
 
-void acquireCommandBuffer(VulkanContext& context) {
+VkResult acquireCommandBuffer(VulkanContext& context, uint64_t timeout) {
     // Ask Vulkan for the next image in the swap chain and update the currentSwapIndex.
+    // Headless swap chains simply cycle through their images.
     VulkanSurfaceContext& surface = *context.currentSurface;
-    VkResult result = vkAcquireNextImageKHR(context.device, surface.swapchain,
-            UINT64_MAX, surface.imageAvailable, VK_NULL_HANDLE, &surface.currentSwapIndex);
-    ASSERT_POSTCONDITION(result != VK_ERROR_OUT_OF_DATE_KHR,
-            "Stale / resized swap chain not yet supported.");
-    ASSERT_POSTCONDITION(result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS,
-            "vkAcquireNextImageKHR error.");
+    uint32_t swapIndex;
+    VkResult result = VK_SUCCESS;
+    if (surface.headless) {
+        swapIndex = (surface.currentSwapIndex + 1) % (uint32_t) surface.swapContexts.size();
+    } else {
+        result = vkAcquireNextImageKHR(context.device, surface.swapchain,
+                timeout, surface.imageAvailable, VK_NULL_HANDLE, &swapIndex);
+        if (result == VK_TIMEOUT || result == VK_NOT_READY || result == VK_ERROR_OUT_OF_DATE_KHR) {
+            return result;
+        }
+        ASSERT_POSTCONDITION(result == VK_SUBOPTIMAL_KHR || result == VK_SUCCESS,
+                "vkAcquireNextImageKHR error.");
+    }
+    surface.currentSwapIndex = swapIndex;
     SwapContext& swap = getSwapContext(context);
 
     // Ensure that the previous submission of this command buffer has finished.
@@ -779,6 +981,7 @@ void acquireCommandBuffer(VulkanContext& context) {
     ASSERT_POSTCONDITION(not error, "vkBeginCommandBuffer error.");
     context.cmdbuffer = cmdbuffer;
     swap.submitted = false;
+    return result;
 }
 
 void releaseCommandBuffer(VulkanContext& context) {
@@ -787,38 +990,157 @@ void releaseCommandBuffer(VulkanContext& context) {
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkEndCommandBuffer error.");
     context.cmdbuffer = nullptr;
 
-    // Submit the command buffer.
-    VkPipelineStageFlags waitDestStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    // Submit the command buffer, it also waits for the uploads it has acquired.
     VulkanSurfaceContext& surfaceContext = *context.currentSurface;
     SwapContext& swapContext = getSwapContext(context);
+    // There's no image to wait for, nor a presentation to signal, with a headless swap chain.
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<VkPipelineStageFlags> waitDestStageMasks;
+    if (!surfaceContext.headless) {
+        waitSemaphores.push_back(surfaceContext.imageAvailable);
+        waitDestStageMasks.push_back(VK_PIPELINE_STAGE_TRANSFER_BIT);
+    }
+    waitSemaphores.insert(waitSemaphores.end(),
+            context.transferSemaphores.begin(), context.transferSemaphores.end());
+    waitDestStageMasks.resize(waitSemaphores.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+    context.transferSemaphores.clear();
     VkSubmitInfo submitInfo {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .waitSemaphoreCount = 1u,
-        .pWaitSemaphores = &surfaceContext.imageAvailable,
-        .pWaitDstStageMask = &waitDestStageMask,
+        .waitSemaphoreCount = (uint32_t) waitSemaphores.size(),
+        .pWaitSemaphores = waitSemaphores.data(),
+        .pWaitDstStageMask = waitDestStageMasks.data(),
         .commandBufferCount = 1,
         .pCommandBuffers = &swapContext.cmdbuffer,
-        .signalSemaphoreCount = 1u,
+        .signalSemaphoreCount = surfaceContext.headless ? 0u : 1u,
         .pSignalSemaphores = &surfaceContext.renderingFinished,
     };
     result = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, swapContext.fence);
     ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
     swapContext.submitted = true;
+
+    // The fences created during the frame are signaled once it has completed.
+    submitPendingFences(context);
+}
+
+void submitPendingFences(VulkanContext& context) {
+    for (auto& cmdfence : context.pendingFences) {
+        // Don't bother with the fences that have been destroyed already.
+        if (cmdfence.use_count() == 1) {
+            continue;
+        }
+        VkResult result = vkQueueSubmit(context.graphicsQueue, 0, nullptr, cmdfence->fence);
+        ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
+        std::unique_lock<std::mutex> lock(cmdfence->mutex);
+        cmdfence->submitted = true;
+        lock.unlock();
+        cmdfence->condition.notify_all();
+    }
+    context.pendingFences.clear();
+}
+
+void submitTransfer(VulkanContext& context, VulkanTask record, VulkanTask acquire,
+        std::function<void()> cleanup) {
+    assert(context.transferQueue);
+    VkDevice device = context.device;
+    VkCommandBuffer cmdbuffer;
+    VkSemaphore semaphore;
+    VkCommandBufferAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context.transferCommandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkCommandBufferBeginInfo beginInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+    };
+    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
+    createSemaphore(device, &semaphore);
+    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    record(cmdbuffer);
+    vkEndCommandBuffer(cmdbuffer);
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdbuffer,
+        .signalSemaphoreCount = 1u,
+        .pSignalSemaphores = &semaphore,
+    };
+    VkResult result = vkQueueSubmit(context.transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "vkQueueSubmit error.");
+
+    // The graphics command buffer that acquires the resource waits on the semaphore, so once it
+    // has completed, so has the upload and everything it used can be released.
+    auto acquireOnGraphics = [&context, device, cmdbuffer, semaphore, acquire, cleanup]
+            (VkCommandBuffer cmd) {
+        acquire(cmd);
+        context.transferSemaphores.push_back(semaphore);
+        getSwapContext(context).pendingWork.emplace_back(
+                [&context, device, cmdbuffer, semaphore, cleanup] (VkCommandBuffer) {
+            vkFreeCommandBuffers(device, context.transferCommandPool, 1, &cmdbuffer);
+            vkDestroySemaphore(device, semaphore, VKALLOC);
+            cleanup();
+        });
+    };
+    if (context.cmdbuffer) {
+        acquireOnGraphics(context.cmdbuffer);
+    } else {
+        context.pendingWork.emplace_back(acquireOnGraphics);
+    }
+}
+
+void submitOneOff(VulkanContext& context, VulkanTask record, std::function<void()> cleanup) {
+    VkDevice device = context.device;
+    VkCommandBuffer cmdbuffer;
+    VkFence fence;
+    VkCommandBufferBeginInfo beginInfo { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+    VkCommandBufferAllocateInfo allocateInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = context.commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1
+    };
+    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
+    vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
+    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
+    record(cmdbuffer);
+    vkEndCommandBuffer(cmdbuffer);
+    VkSubmitInfo submitInfo {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &cmdbuffer,
+    };
+    vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, fence);
+
+    // The pipeline barriers recorded by the caller are GPU-to-GPU sync points, but reclaiming what
+    // the command buffer used needs GPU-CPU synchronization. That's what the fence is for.
+    context.pendingWork.emplace_back([&context, fence, device, cmdbuffer, cleanup]
+            (VkCommandBuffer) {
+        vkWaitForFences(device, 1, &fence, VK_FALSE, UINT64_MAX);
+        vkFreeCommandBuffers(device, context.commandPool, 1, &cmdbuffer);
+        vkDestroyFence(device, fence, VKALLOC);
+        cleanup();
+    });
 }
 
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf) {
-    // First, execute pending tasks that are specific to this swap context. Copy the tasks into a
-    // local queue first, which allows newly added tasks to be deferred until the next frame.
-    decltype(swapContext.pendingWork) tasks;
-    tasks.swap(swapContext.pendingWork);
+    // Copy the tasks that are specific to this swap context into a local queue first, which allows
+    // newly added tasks to be deferred until the next frame.
+    decltype(swapContext.pendingWork) swapTasks;
+    swapTasks.swap(swapContext.pendingWork);
+
+    // Execute the global pending work first, it can refer to objects whose destruction has been
+    // deferred to this swap context. Again, we copy the work queue into a local queue to allow
+    // tasks to re-add themselves.
+    decltype(context.pendingWork) tasks;
+    tasks.swap(context.pendingWork);
     for (auto& callback : tasks) {
         callback(cmdbuf);
     }
-    // Next, execute the global pending work. Again, we copy the work queue into a local queue
-    // to allow tasks to re-add themselves.
-    tasks.clear();
-    tasks.swap(context.pendingWork);
-    for (auto& callback : tasks) {
+
+    // Next, execute pending tasks that are specific to this swap context.
+    for (auto& callback : swapTasks) {
         callback(cmdbuf);
     }
 }
@@ -27,8 +27,11 @@
 
 #include "vk_mem_alloc.h"
 
-#include <vector>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace filament {
 namespace driver {
@@ -42,6 +45,19 @@ using VulkanTaskQueue = std::vector<VulkanTask>;
 
 struct VulkanSurfaceContext;
 
+// The VkFence behind a driver fence. It's signaled by an empty submission that follows the command
+// buffer of the frame the fence was created in, and it's shared between the fence handle (which is
+// waited on and destroyed from the client thread) and the driver's list of fences to submit.
+struct VulkanCmdFence {
+    VulkanCmdFence(VkDevice device);
+    ~VulkanCmdFence();
+    const VkDevice device;
+    VkFence fence;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool submitted = false;
+};
+
 // For now we only support a single-device, single-instance scenario. Our concept of "context" is a
 // bundle of state containing the Device, the Instance, and various globally-useful Vulkan objects.
 struct VulkanContext {
@@ -54,7 +70,14 @@ struct VulkanContext {
     VkCommandPool commandPool;
     uint32_t graphicsQueueFamilyIndex;
     VkQueue graphicsQueue;
+    uint32_t transferQueueFamilyIndex;
+    VkQueue transferQueue;      // null if the device doesn't have a dedicated transfer queue
+    VkCommandPool transferCommandPool;
+    std::vector<VkSemaphore> transferSemaphores;
+    std::vector<std::shared_ptr<VulkanCmdFence>> pendingFences;
     bool debugMarkersSupported;
+    bool displayTimingSupported;    // VK_GOOGLE_display_timing
+    bool descriptorUpdateTemplateSupported;     // VK_KHR_descriptor_update_template
     VulkanTaskQueue pendingWork;
     VulkanBinder::RasterState rasterState;
     VkCommandBuffer cmdbuffer;
@@ -69,7 +92,7 @@ struct VulkanAttachment {
     VkFormat format;
     VkImage image;
     VkImageView view;
-    VkDeviceMemory memory;
+    VmaAllocation memory;   // null when the image isn't owned by the attachment
 };
 
 // The SwapContext is the set of objects that gets "swapped" at each beginFrame().
@@ -87,6 +110,8 @@ struct SwapContext {
 struct VulkanSurfaceContext {
     VkSurfaceKHR surface;
     VkSwapchainKHR swapchain;
+    uint64_t flags;
+    VkPresentModeKHR presentMode;
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     VkSurfaceFormatKHR surfaceFormat;
     VkExtent2D clientSize;
@@ -97,6 +122,7 @@ struct VulkanSurfaceContext {
     VulkanAttachment depth;
     VkSemaphore imageAvailable;
     VkSemaphore renderingFinished;
+    bool headless;  // no surface, the images are owned by the swap contexts
 };
 
 void selectPhysicalDevice(VulkanContext& context);
@@ -105,9 +131,29 @@ void createSemaphore(VkDevice device, VkSemaphore* semaphore);
 void getPresentationQueue(VulkanContext& context, VulkanSurfaceContext& sc);
 void getSurfaceCaps(VulkanContext& context, VulkanSurfaceContext& sc);
 void createSwapChainAndImages(VulkanContext& context, VulkanSurfaceContext& sc);
+
+// Creates the images of a swap chain that isn't presented, they can be read back from once a frame
+// has rendered into them. The size must be set in the surface capabilities.
+void createHeadlessImages(VulkanContext& context, VulkanSurfaceContext& sc);
 void createDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 void transitionDepthBuffer(VulkanContext& context, VulkanSurfaceContext& sc, VkFormat depthFormat);
 void createCommandBuffersAndFences(VulkanContext& context, VulkanSurfaceContext& sc);
+
+// Replaces a stale or resized swap chain, this only waits for the frames in flight on this swap
+// chain rather than for the whole device. Returns false if the surface has no size, in which case
+// the stale swap chain is kept.
+bool recreateSwapChain(VulkanContext& context, VulkanSurfaceContext& sc);
+
+// Uploads on the dedicated transfer queue, which must exist. The upload is submitted right away,
+// 'record' records the copy followed by the release half of the queue family ownership transfer.
+// 'acquire' records the acquire half into the next graphics command buffer, whose submission then
+// waits for the upload. 'cleanup' runs once that command buffer has completed.
+void submitTransfer(VulkanContext& context, VulkanTask record, VulkanTask acquire,
+        std::function<void()> cleanup);
+// Records and submits a one-off command buffer on the graphics queue, which allows uploading
+// outside a frame. 'cleanup' runs from the pending work once the command buffer has completed, it
+// must reclaim what 'record' used, e.g. the staging area.
+void submitOneOff(VulkanContext& context, VulkanTask record, std::function<void()> cleanup);
 void destroySurfaceContext(VulkanContext& context, VulkanSurfaceContext& sc);
 uint32_t selectMemoryType(VulkanContext& context, uint32_t flags, VkFlags reqs);
 VkFormat getVkFormat(ElementType type, bool normalized);
@@ -119,10 +165,18 @@ bool hasPendingWork(VulkanContext& context);
 VkCompareOp getCompareOp(SamplerCompareFunc func);
 VkBlendFactor getBlendFactor(BlendFunction mode);
 void waitForIdle(VulkanContext& context);
-void acquireCommandBuffer(VulkanContext& context);
+
+// Returns the result of the swap chain image acquisition. The command buffer is started only for
+// VK_SUCCESS and VK_SUBOPTIMAL_KHR, otherwise (VK_TIMEOUT, VK_NOT_READY or
+// VK_ERROR_OUT_OF_DATE_KHR) there's no image to render into.
+VkResult acquireCommandBuffer(VulkanContext& context, uint64_t timeout);
 void releaseCommandBuffer(VulkanContext& context);
 void performPendingWork(VulkanContext& context, SwapContext& swapContext, VkCommandBuffer cmdbuf);
 void flushCommandBuffer(VulkanContext& context);
+
+// Submits the fences of context.pendingFences, each gets signaled once all the work submitted so
+// far has completed.
+void submitPendingFences(VulkanContext& context);
 VkFormat findSupportedFormat(VulkanContext& context, const std::vector<VkFormat>& candidates,
         VkImageTiling tiling, VkFormatFeatureFlags features);
 
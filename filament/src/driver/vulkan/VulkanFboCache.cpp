@@ -27,7 +27,8 @@ bool VulkanFboCache::RenderPassEq::operator()(const RenderPassKey& k1,
             k1.finalLayout == k2.finalLayout &&
             k1.colorFormat == k2.colorFormat &&
             k1.depthFormat == k2.depthFormat &&
-            k1.flags.value == k2.flags.value;
+            k1.flags.value == k2.flags.value &&
+            k1.subpassFormat == k2.subpassFormat;
 }
 
 bool VulkanFboCache::FboKeyEqualFn::operator()(const FboKey& k1, const FboKey& k2) const {
@@ -48,10 +49,12 @@ VulkanFboCache::~VulkanFboCache() {
 
 VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config, uint32_t w, uint32_t h) noexcept {
     auto iter = mFramebufferCache.find(config);
-    if (UTILS_LIKELY(iter != mFramebufferCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
+    if (UTILS_LIKELY(iter != mFramebufferCache.end())) {
+        mFramebufferStats.hits++;
         iter.value().timestamp = mCurrentTime;
         return iter->second.handle;
     }
+    mFramebufferStats.misses++;
     uint32_t nattachments = 0;
     for (auto attachment : config.attachments) {
         if (attachment) {
@@ -77,10 +80,17 @@ VkFramebuffer VulkanFboCache::getFramebuffer(FboKey config, uint32_t w, uint32_t
 
 VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     auto iter = mRenderPassCache.find(config);
-    if (UTILS_LIKELY(iter != mRenderPassCache.end() && iter->second.handle != VK_NULL_HANDLE)) {
+    if (UTILS_LIKELY(iter != mRenderPassCache.end())) {
+        mRenderPassStats.hits++;
         iter.value().timestamp = mCurrentTime;
         return iter->second.handle;
     }
+    mRenderPassStats.misses++;
+    if (config.subpassFormat != VK_FORMAT_UNDEFINED) {
+        VkRenderPass renderPass = createSubpassRenderPass(config);
+        mRenderPassCache[config] = {renderPass, mCurrentTime};
+        return renderPass;
+    }
     const bool hasColor = config.colorFormat != VK_FORMAT_UNDEFINED;
     const bool hasDepth = config.depthFormat != VK_FORMAT_UNDEFINED;
     const bool depthOnly = hasDepth && !hasColor;
@@ -131,6 +141,9 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     // NOTE: It's likely that VK_DEPENDENCY_BY_REGION_BIT and VK_ACCESS_COLOR_ATTACHMENT_READ do
     // not actually achieve anything since are neither defining multiple subpasses, nor reading back
     // from the framebuffer in the shader using subpassLoad().
+    const VkDependencyFlags dependencyFlags =
+            (config.flags.dependencies & RenderPassParams::DEPENDENCY_BY_REGION) ?
+            VK_DEPENDENCY_BY_REGION_BIT : 0;
     VkSubpassDependency dependencies[] = {{
         .srcSubpass = VK_SUBPASS_EXTERNAL,
         .dstSubpass = 0,
@@ -138,7 +151,7 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
         .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
         .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
         .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-        .dependencyFlags = config.flags.dependencies
+        .dependencyFlags = dependencyFlags
     }, {
         .srcSubpass = 0,
         .dstSubpass = VK_SUBPASS_EXTERNAL,
@@ -146,7 +159,7 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
         .dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
         .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
         .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
-        .dependencyFlags = config.flags.dependencies
+        .dependencyFlags = dependencyFlags
     }};
 
     // Finally, create the VkRenderPass.
@@ -155,8 +168,8 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .attachmentCount = 0u,
         .pAttachments = attachments,
-        .dependencyCount = config.flags.dependencies ? 2u : 0u,
-        .pDependencies = config.flags.dependencies ? dependencies : nullptr,
+        .dependencyCount = dependencyFlags ? 2u : 0u,
+        .pDependencies = dependencyFlags ? dependencies : nullptr,
         .subpassCount = 1,
         .pSubpasses = &subpass
     };
@@ -173,6 +186,123 @@ VkRenderPass VulkanFboCache::getRenderPass(RenderPassKey config) noexcept {
     return renderPass;
 }
 
+// The first subpass draws into the transient attachment (0), tested against the depth attachment
+// (2), the second one reads the transient attachment where its fragment is, and draws into the
+// color attachment (1). Only the latter is stored, the others can stay in tile memory.
+VkRenderPass VulkanFboCache::createSubpassRenderPass(RenderPassKey config) noexcept {
+    const bool hasDepth = config.depthFormat != VK_FORMAT_UNDEFINED;
+    const uint8_t clear = config.flags.clear;
+    const uint8_t discardEnd = config.flags.discardEnd;
+
+    VkAttachmentDescription attachments[3] = {{
+        .format = config.subpassFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = (clear & TargetBufferFlags::COLOR) ?
+                VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    }, {
+        // the second subpass covers the whole render area
+        .format = config.colorFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = config.finalLayout
+    }, {
+        .format = config.depthFormat,
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .loadOp = (clear & TargetBufferFlags::DEPTH) ?
+                VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .storeOp = (discardEnd & TargetBufferFlags::DEPTH) ?
+                VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+        .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    }};
+
+    const VkAttachmentReference transientRef = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+    const VkAttachmentReference inputRef = {
+        .attachment = 0,
+        .layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+    };
+    const VkAttachmentReference colorRef = {
+        .attachment = 1,
+        .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+    const VkAttachmentReference depthRef = {
+        .attachment = 2,
+        .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+    };
+    // the depth isn't used by the second subpass, but must survive it when it's stored
+    const uint32_t preserved = 2;
+    const VkSubpassDescription subpasses[2] = {{
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &transientRef,
+        .pDepthStencilAttachment = hasDepth ? &depthRef : nullptr
+    }, {
+        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+        .inputAttachmentCount = 1,
+        .pInputAttachments = &inputRef,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorRef,
+        .preserveAttachmentCount = hasDepth ? 1u : 0u,
+        .pPreserveAttachments = hasDepth ? &preserved : nullptr
+    }};
+
+    // The second subpass only reads the fragment it's drawing, the dependency between the two
+    // subpasses is framebuffer-local, which keeps the transient attachment in tile memory.
+    const VkSubpassDependency dependencies[] = {{
+        .srcSubpass = VK_SUBPASS_EXTERNAL,
+        .dstSubpass = 0,
+        .srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+        .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT
+    }, {
+        .srcSubpass = 0,
+        .dstSubpass = 1,
+        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT,
+        .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT
+    }, {
+        .srcSubpass = 1,
+        .dstSubpass = VK_SUBPASS_EXTERNAL,
+        .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+        .dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT
+    }};
+
+    VkRenderPassCreateInfo renderPassInfo {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        .attachmentCount = hasDepth ? 3u : 2u,
+        .pAttachments = attachments,
+        .subpassCount = 2,
+        .pSubpasses = subpasses,
+        .dependencyCount = 3,
+        .pDependencies = dependencies
+    };
+    VkRenderPass renderPass;
+    VkResult error = vkCreateRenderPass(mContext.device, &renderPassInfo, VKALLOC, &renderPass);
+    ASSERT_POSTCONDITION(!error, "Unable to create render pass.");
+    return renderPass;
+}
+
 void VulkanFboCache::reset() noexcept {
     for (auto pair : mFramebufferCache) {
         mRenderPassRefCount[pair.first.renderPass]--;
@@ -185,22 +315,75 @@ void VulkanFboCache::reset() noexcept {
     mRenderPassCache.clear();
 }
 
-// Frees up old framebuffers and render passes, then nulls out their key.  Doesn't bother removing
-// the actual map entry since it is fairly small.
+void VulkanFboCache::evictImageView(VkImageView view) noexcept {
+    if (view == VK_NULL_HANDLE) {
+        return;
+    }
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (decltype(mFramebufferCache)::const_iterator iter = mFramebufferCache.begin();
+            iter != mFramebufferCache.end();) {
+        const VkImageView* attachments = iter->first.attachments;
+        if (std::find(attachments, attachments + 3, view) != attachments + 3) {
+            mRenderPassRefCount[iter->first.renderPass]--;
+            vkDestroyFramebuffer(mContext.device, iter->second.handle, VKALLOC);
+            iter = mFramebufferCache.erase(iter);
+            mFramebufferStats.evictions++;
+        } else {
+            ++iter;
+        }
+    }
+}
+
+// Frees up old framebuffers, then the render passes that are old and no longer referenced by any
+// framebuffer. When there are more framebuffers than the limit, the least recently used ones are
+// evicted even if they're not that old (but not in use by the GPU).
 void VulkanFboCache::gc() noexcept {
     mCurrentTime++;
-    const uint32_t evictTime = mCurrentTime - TIME_BEFORE_EVICTION;
-    for (auto iter = mFramebufferCache.begin(); iter != mFramebufferCache.end(); ++iter) {
-        if (iter->second.timestamp < evictTime) {
+    // If this is one of the first few frames, return early to avoid wrapping unsigned integers.
+    if (mCurrentTime <= MIN_TIME_BEFORE_EVICTION) {
+        return;
+    }
+    const uint32_t safeTime = mCurrentTime - MIN_TIME_BEFORE_EVICTION;
+    const uint32_t evictTime = mCurrentTime > mTimeBeforeEviction ?
+            mCurrentTime - mTimeBeforeEviction : 0;
+    uint32_t framebufferEvictTime = evictTime;
+    if (mFramebufferCache.size() > mMaxFramebuffers) {
+        std::vector<uint32_t> timestamps;
+        for (auto const& pair : mFramebufferCache) {
+            if (pair.second.timestamp < safeTime) {
+                timestamps.push_back(pair.second.timestamp);
+            }
+        }
+        const size_t count = std::min(mFramebufferCache.size() - mMaxFramebuffers,
+                timestamps.size());
+        if (count > 0) {
+            std::nth_element(timestamps.begin(), timestamps.begin() + count - 1, timestamps.end());
+            framebufferEvictTime = std::max(evictTime, timestamps[count - 1] + 1);
+        }
+    }
+
+    // Due to robin_map restrictions, we cannot use auto or a range-based loop.
+    for (decltype(mFramebufferCache)::const_iterator iter = mFramebufferCache.begin();
+            iter != mFramebufferCache.end();) {
+        if (iter->second.timestamp < framebufferEvictTime) {
+            mRenderPassRefCount[iter->first.renderPass]--;
             vkDestroyFramebuffer(mContext.device, iter->second.handle, VKALLOC);
-            iter.value().handle = VK_NULL_HANDLE;
+            iter = mFramebufferCache.erase(iter);
+            mFramebufferStats.evictions++;
+        } else {
+            ++iter;
         }
     }
-    for (auto iter = mRenderPassCache.begin(); iter != mRenderPassCache.end(); ++iter) {
+    for (decltype(mRenderPassCache)::const_iterator iter = mRenderPassCache.begin();
+            iter != mRenderPassCache.end();) {
         VkRenderPass handle = iter->second.handle;
         if (iter->second.timestamp < evictTime && mRenderPassRefCount[handle] == 0) {
             vkDestroyRenderPass(mContext.device, handle, VKALLOC);
-            iter.value().handle = VK_NULL_HANDLE;
+            mRenderPassRefCount.erase(handle);
+            iter = mRenderPassCache.erase(iter);
+            mRenderPassStats.evictions++;
+        } else {
+            ++iter;
         }
     }
 }
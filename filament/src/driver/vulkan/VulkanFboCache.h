@@ -23,6 +23,8 @@
 
 #include <tsl/robin_map.h>
 
+#include <algorithm>
+
 namespace filament {
 namespace driver {
 
@@ -50,13 +52,17 @@ public:
             };
             uint32_t value; // 4 bytes
         } flags;
+        // When defined, the render pass has two subpasses: the first one draws into a transient
+        // color attachment of this format, which the second one reads as an input attachment.
+        VkFormat subpassFormat; // 4 bytes
+        uint32_t padding; // 4 bytes
     };
     struct RenderPassVal {
         VkRenderPass handle;
         uint32_t timestamp;
     };
     static_assert(sizeof(VkFormat) == 4, "VkFormat has unexpected size.");
-    static_assert(sizeof(RenderPassKey) == 16, "RenderPassKey has unexpected size.");
+    static_assert(sizeof(RenderPassKey) == 24, "RenderPassKey has unexpected size.");
     using RenderPassHash = utils::hash::MurmurHashFn<RenderPassKey>;
     struct RenderPassEq {
         bool operator()(const RenderPassKey& k1, const RenderPassKey& k2) const;
@@ -64,7 +70,8 @@ public:
 
     // FboKey is a small POD representing the immutable state that we wish to configure
     // in VkFramebuffer. It is hashed and used as a lookup key. There are 1-3 attachments, but
-    // rather than storing a count, we simply zero out the unused slots. We do not bother storing
+    // rather than storing a count, we simply zero out the unused slots. With two subpasses, the
+    // transient attachment comes first, followed by the color and depth attachments. We do not bother storing
     // width and height in the key since they are immutable aspects of the image views.
     struct alignas(8) FboKey {
         VkRenderPass renderPass; // 8 bytes
@@ -98,13 +105,42 @@ public:
     // Frees all Vulkan objects. Call this during shutdown before the device is destroyed.
     void reset() noexcept;
 
+    // Frees the framebuffers that refer to the given image view right away, e.g. before the view
+    // is destroyed, when they're no longer in use by the GPU.
+    void evictImageView(VkImageView view) noexcept;
+
+    // Objects that haven't been used for the given number of frames are evicted, but never
+    // before MIN_TIME_BEFORE_EVICTION frames since they might still be in use by the GPU.
+    void setTimeBeforeEviction(uint32_t frames) noexcept {
+        mTimeBeforeEviction = std::max(frames, MIN_TIME_BEFORE_EVICTION);
+    }
+
+    // Maximum number of cached framebuffers, the least recently used ones are evicted first when
+    // the cache gets larger.
+    void setCacheLimit(uint32_t maxFramebuffers) noexcept { mMaxFramebuffers = maxFramebuffers; }
+
+    struct CacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+    };
+    CacheStats const& getFramebufferStats() const noexcept { return mFramebufferStats; }
+    CacheStats const& getRenderPassStats() const noexcept { return mRenderPassStats; }
+
+    static constexpr uint32_t MIN_TIME_BEFORE_EVICTION = 2;
+
 private:
+    VkRenderPass createSubpassRenderPass(RenderPassKey config) noexcept;
+
     VulkanContext& mContext;
     tsl::robin_map<FboKey, FboVal, FboKeyHashFn, FboKeyEqualFn> mFramebufferCache;
     tsl::robin_map<RenderPassKey, RenderPassVal, RenderPassHash, RenderPassEq> mRenderPassCache;
     tsl::robin_map<VkRenderPass, uint32_t> mRenderPassRefCount;
     uint32_t mCurrentTime = 0;
-    static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+    uint32_t mTimeBeforeEviction = MIN_TIME_BEFORE_EVICTION;
+    uint32_t mMaxFramebuffers = 256;
+    CacheStats mFramebufferStats;
+    CacheStats mRenderPassStats;
 };
 
 } // namespace filament
@@ -48,6 +48,34 @@ VulkanProgram::VulkanProgram(VulkanContext& context, const Program& builder) noe
         HwProgram(builder.getName()), context(context) {
     auto const& blobs = builder.getShadersSource();
     VkShaderModule* modules[2] = { &bundle.vertex, &bundle.fragment };
+    bundle.specialization = nullptr;
+
+    // Both stages share the specialization info, a constant that doesn't exist in a stage is
+    // ignored by the driver.
+    const uint32_t specializationMask = builder.getSpecializationConstantMask();
+    if (specializationMask) {
+        auto const& values = builder.getSpecializationConstants();
+        uint32_t count = 0;
+        for (uint32_t id = 0; id < Program::NUM_SPECIALIZATION_CONSTANTS; id++) {
+            if (specializationMask & (1u << id)) {
+                specializationEntries[count] = {
+                    .constantID = id,
+                    .offset = uint32_t(count * sizeof(int32_t)),
+                    .size = sizeof(int32_t)
+                };
+                specializationData[count] = values[id];
+                count++;
+            }
+        }
+        specializationInfo = {
+            .mapEntryCount = count,
+            .pMapEntries = specializationEntries,
+            .dataSize = count * sizeof(int32_t),
+            .pData = specializationData
+        };
+        bundle.specialization = &specializationInfo;
+    }
+
     bool missing = false;
     for (size_t i = 0; i < Program::NUM_SHADER_TYPES; i++) {
         const auto& blob = blobs[i];
@@ -96,13 +124,11 @@ VulkanProgram::~VulkanProgram() {
 VulkanRenderTarget::~VulkanRenderTarget() {
     if (!mSharedColorImage) {
         vkDestroyImageView(mContext.device, mColor.view, VKALLOC);
-        vkDestroyImage(mContext.device, mColor.image, VKALLOC);
-        vkFreeMemory(mContext.device, mColor.memory, VKALLOC);
+        vmaDestroyImage(mContext.allocator, mColor.image, mColor.memory);
     }
     if (!mSharedDepthImage) {
         vkDestroyImageView(mContext.device, mDepth.view, VKALLOC);
-        vkDestroyImage(mContext.device, mDepth.image, VKALLOC);
-        vkFreeMemory(mContext.device, mDepth.memory, VKALLOC);
+        vmaDestroyImage(mContext.allocator, mDepth.image, mDepth.memory);
     }
 }
 
@@ -185,22 +211,12 @@ void VulkanRenderTarget::createColorImage(VkFormat format) {
         .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(mContext.device, &colorImageInfo, VKALLOC, &mColor.image);
-    ASSERT_POSTCONDITION(!error, "Unable to create color attachment.");
-
-    // Allocate memory for the color image and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(mContext.device, mColor.image, &memReqs);
-    VkMemoryAllocateInfo allocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
-    error = vkAllocateMemory(mContext.device, &allocInfo, nullptr, &mColor.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate color memory.");
-    error = vkBindImageMemory(mContext.device, mColor.image, mColor.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind color memory.");
+    VkResult error = vmaCreateImage(mContext.allocator, &colorImageInfo, &allocInfo,
+            &mColor.image, &mColor.memory, nullptr);
+    ASSERT_POSTCONDITION(!error, "Unable to create color attachment.");
 
     // Transition the color image into an optimal layout.
     VkImageMemoryBarrier barrier {
@@ -247,22 +263,12 @@ void VulkanRenderTarget::createDepthImage(VkFormat format) {
         .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
         .samples = VK_SAMPLE_COUNT_1_BIT,
     };
-    VkResult error = vkCreateImage(mContext.device, &depthImageInfo, VKALLOC, &mDepth.image);
-    ASSERT_POSTCONDITION(!error, "Unable to create depth attachment.");
-
-    // Allocate memory for the depth image and bind it.
-    VkMemoryRequirements memReqs;
-    vkGetImageMemoryRequirements(mContext.device, mDepth.image, &memReqs);
-    VkMemoryAllocateInfo depthAllocInfo {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(mContext, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    VmaAllocationCreateInfo depthAllocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY
     };
-    error = vkAllocateMemory(mContext.device, &depthAllocInfo, nullptr, &mDepth.memory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate depth memory.");
-    error = vkBindImageMemory(mContext.device, mDepth.image, mDepth.memory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind depth memory.");
+    VkResult error = vmaCreateImage(mContext.allocator, &depthImageInfo, &depthAllocInfo,
+            &mDepth.image, &mDepth.memory, nullptr);
+    ASSERT_POSTCONDITION(!error, "Unable to create depth attachment.");
 
     // Transition the depth image into an optimal layout and assume there's no need to read from it.
     VkImageMemoryBarrier depthBarrier {
@@ -336,30 +342,17 @@ VulkanUniformBuffer::VulkanUniformBuffer(VulkanContext& context, VulkanStagePool
     vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &mGpuBuffer, &mGpuMemory, 0);
 }
 
-void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
-    VkDevice device = mContext.device;
+void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t byteOffset,
+        uint32_t numBytes) {
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
-
-    // Create and submit a one-off command buffer to allow uploading outside a frame.
-    VkCommandBuffer cmdbuffer;
-    VkFence fence;
-    VkCommandBufferBeginInfo beginInfo { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
-    VkCommandBufferAllocateInfo allocateInfo {
-        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-        .commandPool = mContext.commandPool,
-        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = 1
+    memcpy(stage->mapped, cpuData, numBytes);
+
+    // Upload with a one-off command buffer to allow uploading outside a frame.
+    VkBufferCopy region {
+        .srcOffset = stage->offset,
+        .dstOffset = byteOffset,
+        .size = numBytes
     };
-    VkFenceCreateInfo fenceCreateInfo { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
-    VkBufferCopy region { .size = numBytes };
-    vkAllocateCommandBuffers(device, &allocateInfo, &cmdbuffer);
-    vkCreateFence(device, &fenceCreateInfo, VKALLOC, &fence);
-    vkBeginCommandBuffer(cmdbuffer, &beginInfo);
-    vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
 
     // Ensure that the copy finishes before the next draw call.
     VkBufferMemoryBarrier barrier {
@@ -371,27 +364,28 @@ void VulkanUniformBuffer::loadFromCpu(const void* cpuData, uint32_t numBytes) {
         .buffer = mGpuBuffer,
         .size = VK_WHOLE_SIZE
     };
-    vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-            VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
-    vkEndCommandBuffer(cmdbuffer);
-    VkSubmitInfo submitInfo {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &cmdbuffer,
-    };
-    vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, fence);
-
-    // Enqueue some work to reclaim the staging area and free the command buffer. The pipeline
-    // barrier we already placed is a GPU-to-GPU sync point, but reclaimation of the staging area
-    // needs GPU-CPU synchronization. That's what the fence is for.
-    mContext.pendingWork.emplace_back([this, fence, device, cmdbuffer, stage] (VkCommandBuffer)  {
-        vkWaitForFences(device, 1, &fence, VK_FALSE, UINT64_MAX);
-        vkFreeCommandBuffers(device, mContext.commandPool, 1, &cmdbuffer);
-        vkDestroyFence(device, fence, VKALLOC);
+    submitOneOff(mContext, [this, stage, region, barrier] (VkCommandBuffer cmdbuffer) {
+        vkCmdCopyBuffer(cmdbuffer, stage->buffer, mGpuBuffer, 1, &region);
+        vkCmdPipelineBarrier(cmdbuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }, [this, stage] () {
         mStagePool.releaseStage(stage);
     });
 }
 
+VulkanTimerQuery::VulkanTimerQuery(VulkanContext& context) : context(context) {
+    VkQueryPoolCreateInfo info = {};
+    info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    info.queryCount = 2;
+    VkResult result = vkCreateQueryPool(context.device, &info, VKALLOC, &pool);
+    ASSERT_POSTCONDITION(result == VK_SUCCESS, "Unable to create query pool.");
+}
+
+VulkanTimerQuery::~VulkanTimerQuery() {
+    vkDestroyQueryPool(context.device, pool, VKALLOC);
+}
+
 VulkanUniformBuffer::~VulkanUniformBuffer() {
     assert(!hasPendingWork(mContext) && "Buffer destroyed while work is pending.");
     vmaDestroyBuffer(mContext.allocator, mGpuBuffer, mGpuMemory);
@@ -411,7 +405,7 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
         .imageType = VK_IMAGE_TYPE_2D,
         .extent.width = w,
         .extent.height = h,
-        .extent.depth = depth,
+        .extent.depth = 1,
         .format = format,
         .mipLevels = levels,
         .arrayLayers = 1,
@@ -421,6 +415,8 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         imageInfo.arrayLayers = 6;
         imageInfo.flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT;
+    } else if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        imageInfo.arrayLayers = depth;
     }
     if (usage == TextureUsage::COLOR_ATTACHMENT) {
         imageInfo.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
@@ -429,9 +425,13 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     } else {
         imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     }
-    VkResult error = vkCreateImage(context.device, &imageInfo, VKALLOC, &textureImage);
+    VmaAllocationCreateInfo allocInfo {
+        .usage = VMA_MEMORY_USAGE_GPU_ONLY
+    };
+    VkResult error = vmaCreateImage(context.allocator, &imageInfo, &allocInfo, &textureImage,
+            &textureImageMemory, nullptr);
     if (error) {
-        utils::slog.d << "vkCreateImage: "
+        utils::slog.d << "vmaCreateImage: "
             << "result = " << error << ", "
             << "extent = " << w << "x" << h << "x"<< depth << ", "
             << "mipLevels = " << levels << ", "
@@ -439,20 +439,6 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     }
     ASSERT_POSTCONDITION(!error, "Unable to create image.");
 
-    // Allocate memory for the VkImage and bind it.
-    VkMemoryRequirements memReqs = {};
-    vkGetImageMemoryRequirements(context.device, textureImage, &memReqs);
-    VkMemoryAllocateInfo allocInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memReqs.size,
-        .memoryTypeIndex = selectMemoryType(context, memReqs.memoryTypeBits,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
-    };
-    error = vkAllocateMemory(context.device, &allocInfo, nullptr, &textureImageMemory);
-    ASSERT_POSTCONDITION(!error, "Unable to allocate image memory.");
-    error = vkBindImageMemory(context.device, textureImage, textureImageMemory, 0);
-    ASSERT_POSTCONDITION(!error, "Unable to bind image.");
-
     // Create a VkImageView so that shaders can sample from the image.
     VkImageViewCreateInfo viewInfo = {};
     viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -467,6 +453,9 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_CUBE;
         viewInfo.subresourceRange.layerCount = 6;
+    } else if (target == SamplerType::SAMPLER_2D_ARRAY) {
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+        viewInfo.subresourceRange.layerCount = depth;
     }
     if (usage == TextureUsage::DEPTH_ATTACHMENT) {
         viewInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
@@ -477,9 +466,8 @@ VulkanTexture::VulkanTexture(VulkanContext& context, SamplerType target, uint8_t
 
 VulkanTexture::~VulkanTexture() {
     assert(!hasPendingWork(mContext) && "Texture destroyed while work is pending.");
-    vkDestroyImage(mContext.device, textureImage, VKALLOC);
     vkDestroyImageView(mContext.device, imageView, VKALLOC);
-    vkFreeMemory(mContext.device, textureImageMemory, VKALLOC);
+    vmaDestroyImage(mContext.allocator, textureImage, textureImageMemory);
 }
 
 void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height,
@@ -493,23 +481,26 @@ void VulkanTexture::load2DImage(PixelBufferDescriptor&& data, uint32_t width, ui
 
     // Create and populate the staging buffer.
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
+    memcpy(stage->mapped, cpuData, numBytes);
 
     // Create a copy-to-device functor because we might need to defer it.
     auto copyToDevice = [this, stage, width, height, miplevel] (VkCommandBuffer cmd) {
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel);
-        copyBufferToImage(cmd, stage->buffer, textureImage, width, height, nullptr, miplevel);
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, 0, 1);
+        copyBufferToImage(cmd, stage, textureImage, width, height, nullptr, miplevel, 0, 1);
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel);
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel, 0, 1);
         getSwapContext(mContext).pendingWork.emplace_back([this, stage] (VkCommandBuffer) {
             mStagePool.releaseStage(stage);
         });
     };
 
+    // Prefer the transfer queue, so that the upload overlaps with rendering.
+    if (mContext.transferQueue) {
+        transferToDevice(stage, width, height, nullptr, miplevel, 0, 1);
+        return;
+    }
+
     // If possible, perform the upload immediately, otherwise queue up the work.
     if (mContext.cmdbuffer) {
         copyToDevice(mContext.cmdbuffer);
@@ -525,23 +516,26 @@ void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffse
     assert(this->target == SamplerType::SAMPLER_CUBEMAP);
     // Create and populate the staging buffer.
     VulkanStage const* stage = mStagePool.acquireStage(numBytes);
-    void* mapped;
-    vmaMapMemory(mContext.allocator, stage->memory, &mapped);
-    memcpy(mapped, cpuData, numBytes);
-    vmaUnmapMemory(mContext.allocator, stage->memory);
+    memcpy(stage->mapped, cpuData, numBytes);
 
     // Create a copy-to-device functor because we might need to defer it.
     auto copyToDevice = [this, faceOffsets, stage, miplevel] (VkCommandBuffer cmd) {
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel);
-        copyBufferToImage(cmd, stage->buffer, textureImage, width, height, &faceOffsets, miplevel);
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, 0, 6);
+        copyBufferToImage(cmd, stage, textureImage, width, height, &faceOffsets, miplevel, 0, 6);
         transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel);
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel, 0, 6);
         getSwapContext(mContext).pendingWork.emplace_back([this, stage] (VkCommandBuffer) {
             mStagePool.releaseStage(stage);
         });
     };
 
+    // Prefer the transfer queue, so that the upload overlaps with rendering.
+    if (mContext.transferQueue) {
+        transferToDevice(stage, width, height, &faceOffsets, miplevel, 0, 6);
+        return;
+    }
+
     // If possible, perform the upload immediately, otherwise queue up the work.
     if (mContext.cmdbuffer) {
         copyToDevice(mContext.cmdbuffer);
@@ -550,8 +544,89 @@ void VulkanTexture::loadCubeImage(PixelBufferDescriptor&& data,  const FaceOffse
     }
 }
 
+void VulkanTexture::loadArrayImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height,
+        uint32_t baseLayer, uint32_t layerCount, int miplevel) {
+    assert(this->target == SamplerType::SAMPLER_2D_ARRAY);
+    assert(width <= this->width && height <= this->height);
+    assert(baseLayer + layerCount <= this->depth);
+    const void* cpuData = data.buffer;
+    const uint32_t numBytes = data.size;
+
+    // Create and populate the staging buffer.
+    VulkanStage const* stage = mStagePool.acquireStage(numBytes);
+    memcpy(stage->mapped, cpuData, numBytes);
+
+    // Only the layers being updated are transitioned, so the content of the others is kept.
+    auto copyToDevice = [this, stage, width, height, baseLayer, layerCount, miplevel]
+            (VkCommandBuffer cmd) {
+        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, baseLayer, layerCount);
+        copyBufferToImage(cmd, stage, textureImage, width, height, nullptr, miplevel,
+                baseLayer, layerCount);
+        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, miplevel, baseLayer, layerCount);
+        getSwapContext(mContext).pendingWork.emplace_back([this, stage] (VkCommandBuffer) {
+            mStagePool.releaseStage(stage);
+        });
+    };
+
+    // Prefer the transfer queue, so that the upload overlaps with rendering.
+    if (mContext.transferQueue) {
+        transferToDevice(stage, width, height, nullptr, miplevel, baseLayer, layerCount);
+        return;
+    }
+
+    // If possible, perform the upload immediately, otherwise queue up the work.
+    if (mContext.cmdbuffer) {
+        copyToDevice(mContext.cmdbuffer);
+    } else {
+        mContext.pendingWork.emplace_back(copyToDevice);
+    }
+}
+
+void VulkanTexture::transferToDevice(VulkanStage const* stage, uint32_t width, uint32_t height,
+        FaceOffsets const* faceOffsets, uint32_t miplevel, uint32_t baseLayer,
+        uint32_t layerCount) {
+    // The image's layout changes as part of the queue family ownership transfer. The miplevel's
+    // content is discarded anyway, so it doesn't need to be acquired by the transfer queue first.
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = mContext.transferQueueFamilyIndex;
+    barrier.dstQueueFamilyIndex = mContext.graphicsQueueFamilyIndex;
+    barrier.image = textureImage;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = miplevel;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = baseLayer;
+    barrier.subresourceRange.layerCount = layerCount;
+
+    auto release = [this, stage, width, height, faceOffsets, miplevel, baseLayer, layerCount,
+            barrier] (VkCommandBuffer cmd) {
+        transitionImageLayout(cmd, textureImage, VK_IMAGE_LAYOUT_UNDEFINED,
+                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, miplevel, baseLayer, layerCount);
+        copyBufferToImage(cmd, stage, textureImage, width, height, faceOffsets, miplevel,
+                baseLayer, layerCount);
+        VkImageMemoryBarrier release = barrier;
+        release.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, 1, &release);
+    };
+    auto acquire = [barrier] (VkCommandBuffer cmd) {
+        VkImageMemoryBarrier acquire = barrier;
+        acquire.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &acquire);
+    };
+    submitTransfer(mContext, release, acquire, [this, stage] () {
+        mStagePool.releaseStage(stage);
+    });
+}
+
 void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
-        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel) {
+        VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel, uint32_t baseLayer,
+        uint32_t layerCount) {
     VkImageMemoryBarrier barrier = {};
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     barrier.oldLayout = oldLayout;
@@ -562,8 +637,8 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = miplevel;
     barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = this->target == SamplerType::SAMPLER_CUBEMAP ? 6 : 1;
+    barrier.subresourceRange.baseArrayLayer = baseLayer;
+    barrier.subresourceRange.layerCount = layerCount;
     VkPipelineStageFlags sourceStage;
     VkPipelineStageFlags destinationStage;
     if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED &&
@@ -585,8 +660,9 @@ void VulkanTexture::transitionImageLayout(VkCommandBuffer cmd, VkImage image,
             &barrier);
 }
 
-void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkImage image,
-        uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel) {
+void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VulkanStage const* stage, VkImage image,
+        uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel,
+        uint32_t baseLayer, uint32_t layerCount) {
     if (target == SamplerType::SAMPLER_CUBEMAP) {
         assert(faceOffsets);
         VkBufferImageCopy regions[6] = {{}};
@@ -599,22 +675,25 @@ void VulkanTexture::copyBufferToImage(VkCommandBuffer cmd, VkBuffer buffer, VkIm
             region.imageExtent.width = width >> miplevel;
             region.imageExtent.height = height >> miplevel;
             region.imageExtent.depth = 1;
-            region.bufferOffset = faceOffsets->offsets[face];
+            region.bufferOffset = stage->offset + faceOffsets->offsets[face];
         }
-        vkCmdCopyBufferToImage(cmd, buffer, image,
+        vkCmdCopyBufferToImage(cmd, stage->buffer, image,
                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 6, regions);
         return;
     }
     VkBufferImageCopy region = {};
+    region.bufferOffset = stage->offset;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     region.imageSubresource.mipLevel = miplevel;
-    region.imageSubresource.layerCount = 1;
+    region.imageSubresource.baseArrayLayer = baseLayer;
+    region.imageSubresource.layerCount = layerCount;
     region.imageExtent = {
         .width = width >> miplevel,
         .height = height >> miplevel,
         .depth = 1,
     };
-    vkCmdCopyBufferToImage(cmd, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+    vkCmdCopyBufferToImage(cmd, stage->buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1,
+            &region);
 }
 
 void VulkanRenderPrimitive::setPrimitiveType(Driver::PrimitiveType pt) {
@@ -24,6 +24,8 @@
 #include <filament/EngineEnums.h>
 #include <filament/SamplerBindingMap.h>
 
+#include <atomic>
+
 namespace filament {
 namespace driver {
 
@@ -33,6 +35,9 @@ struct VulkanProgram : public HwProgram {
     VulkanContext& context;
     VulkanBinder::ProgramBundle bundle;
     SamplerBindingMap samplerBindings;
+    VkSpecializationInfo specializationInfo;
+    VkSpecializationMapEntry specializationEntries[Program::NUM_SPECIALIZATION_CONSTANTS];
+    int32_t specializationData[Program::NUM_SPECIALIZATION_CONSTANTS];
 };
 
 struct VulkanTexture;
@@ -81,6 +86,21 @@ struct VulkanSwapChain : public HwSwapChain {
     VulkanSurfaceContext surfaceContext;
 };
 
+struct VulkanFence : public HwFence {
+    explicit VulkanFence(std::shared_ptr<VulkanCmdFence> fence) : cmdfence(std::move(fence)) {}
+    std::shared_ptr<VulkanCmdFence> cmdfence;
+};
+
+// A pair of timestamps, written at the start and at the end of the measured commands.
+struct VulkanTimerQuery : public HwTimerQuery {
+    explicit VulkanTimerQuery(VulkanContext& context);
+    ~VulkanTimerQuery();
+    VulkanContext& context;
+    VkQueryPool pool = VK_NULL_HANDLE;
+    // set when both timestamps are recorded in a command buffer, read from the client thread
+    std::atomic<bool> recorded{ false };
+};
+
 struct VulkanVertexBuffer : public HwVertexBuffer {
     VulkanVertexBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint8_t bufferCount,
             uint8_t attributeCount, uint32_t elementCount,
@@ -101,7 +121,7 @@ struct VulkanIndexBuffer : public HwIndexBuffer {
 struct VulkanUniformBuffer : public HwUniformBuffer {
     VulkanUniformBuffer(VulkanContext& context, VulkanStagePool& stagePool, uint32_t numBytes);
     ~VulkanUniformBuffer();
-    void loadFromCpu(const void* cpuData, uint32_t numBytes);
+    void loadFromCpu(const void* cpuData, uint32_t byteOffset, uint32_t numBytes);
     VkBuffer getGpuBuffer() const { return mGpuBuffer; }
 private:
     VulkanContext& mContext;
@@ -121,15 +141,22 @@ struct VulkanTexture : public HwTexture {
     ~VulkanTexture();
     void load2DImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height, int miplevel);
     void loadCubeImage(PixelBufferDescriptor&& data, const FaceOffsets& faceOffsets, int miplevel);
+    void loadArrayImage(PixelBufferDescriptor&& data, uint32_t width, uint32_t height,
+            uint32_t baseLayer, uint32_t layerCount, int miplevel);
     VkFormat format;
     VkImageView imageView = VK_NULL_HANDLE;
     VkImage textureImage = VK_NULL_HANDLE;
-    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VmaAllocation textureImageMemory = VK_NULL_HANDLE;
 private:
     void transitionImageLayout(VkCommandBuffer cmdbuffer, VkImage image,
-            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel);
-    void copyBufferToImage(VkCommandBuffer cmdbuffer, VkBuffer buffer, VkImage image,
-            uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel);
+            VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t miplevel,
+            uint32_t baseLayer, uint32_t layerCount);
+    void copyBufferToImage(VkCommandBuffer cmdbuffer, VulkanStage const* stage, VkImage image,
+            uint32_t width, uint32_t height, FaceOffsets const* faceOffsets, uint32_t miplevel,
+            uint32_t baseLayer, uint32_t layerCount);
+    void transferToDevice(VulkanStage const* stage, uint32_t width, uint32_t height,
+            FaceOffsets const* faceOffsets, uint32_t miplevel, uint32_t baseLayer,
+            uint32_t layerCount);
     VulkanContext& mContext;
     VulkanStagePool& mStagePool;
     uint32_t mByteCount;
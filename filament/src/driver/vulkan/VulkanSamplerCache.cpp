@@ -98,6 +98,7 @@ constexpr inline VkBool32 getCompareEnable(SamplerCompareMode mode) noexcept {
 VulkanSamplerCache::VulkanSamplerCache(VulkanContext& context) : mContext(context) {}
 
 VkSampler VulkanSamplerCache::getSampler(driver::SamplerParams params) noexcept {
+    std::lock_guard<utils::Mutex> guard(mLock);
     auto iter = mCache.find(params.u);
     if (UTILS_LIKELY(iter != mCache.end())) {
         return iter->second;
@@ -19,12 +19,15 @@
 
 #include "VulkanDriverImpl.h"
 
+#include <utils/Mutex.h>
+
 #include <tsl/robin_map.h>
 
 namespace filament {
 namespace driver {
 
-// Simple manager for VkSampler objects.
+// Simple manager for VkSampler objects. The samplers are looked up by all the threads that record
+// draw calls, see VulkanDriver::executeChunks().
 class VulkanSamplerCache {
 public:
     explicit VulkanSamplerCache(VulkanContext&);
@@ -32,6 +35,7 @@ public:
     void reset() noexcept;
 private:
     VulkanContext& mContext;
+    utils::Mutex mLock;
     tsl::robin_map<uint32_t, VkSampler> mCache;
 };
 
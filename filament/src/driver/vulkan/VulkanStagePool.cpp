@@ -17,11 +17,25 @@
 #include "driver/vulkan/VulkanStagePool.h"
 
 #include <utils/Panic.h>
+#include <utils/Systrace.h>
+
+#include <algorithm>
 
 namespace filament {
 namespace driver {
 
 VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
+    mBytesThisFrame += numBytes;
+    mStats.bytesUploaded += numBytes;
+
+    if (numBytes <= MAX_RING_STAGE_SIZE) {
+        VulkanStage const* stage = acquireRingStage(numBytes);
+        if (UTILS_LIKELY(stage)) {
+            return stage;
+        }
+        mStats.ringOverflows++;
+    }
+
     // First check if a stage exists whose capacity is greater than or equal to the requested size.
     auto iter = mFreeStages.lower_bound(numBytes);
     if (iter != mFreeStages.end()) {
@@ -31,27 +45,89 @@ VulkanStage const* VulkanStagePool::acquireStage(uint32_t numBytes) noexcept {
         return stage;
     }
     // We were not able to find a sufficiently large stage, so create a new one.
-    VulkanStage* stage = new VulkanStage({
+    VulkanStage* stage = new VulkanStage(createBuffer(numBytes));
+    mUsedStages.insert(stage);
+    return stage;
+}
+
+VulkanStage const* VulkanStagePool::acquireRingStage(uint32_t numBytes) noexcept {
+    if (UTILS_UNLIKELY(!mRing.buffer)) {
+        mRing = createBuffer(RING_SIZE);
+    }
+
+    // Stages are aligned so that they can be the source of any copy.
+    const VkDeviceSize alignment = std::max(VkDeviceSize(16),
+            mContext.physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment);
+    VkDeviceSize offset = ((mRingHead + alignment - 1) / alignment) * alignment;
+    if (mRingStages.empty()) {
+        offset = 0;
+    } else {
+        const VkDeviceSize tail = mRingStages.front().offset;
+        const bool wrapped = mRingStages.back().offset < tail;
+        if (!wrapped) {
+            // the free space is [offset, RING_SIZE) and [0, tail)
+            if (offset + numBytes > RING_SIZE) {
+                if (numBytes > tail) {
+                    return nullptr;
+                }
+                offset = 0;
+            }
+        } else if (offset + numBytes > tail) {
+            // the free space is [offset, tail)
+            return nullptr;
+        }
+    }
+
+    mRingStages.emplace_back();
+    RingStage& stage = mRingStages.back();
+    stage.memory = mRing.memory;
+    stage.buffer = mRing.buffer;
+    stage.capacity = numBytes;
+    stage.lastAccessed = mCurrentFrame;
+    stage.offset = offset;
+    stage.mapped = static_cast<char*>(mRing.mapped) + offset;
+    stage.released = false;
+    mRingHead = offset + numBytes;
+    return &stage;
+}
+
+VulkanStage VulkanStagePool::createBuffer(uint32_t numBytes) noexcept {
+    VulkanStage stage = {
         .memory = VK_NULL_HANDLE,
         .buffer = VK_NULL_HANDLE,
-        .lastAccessed = mCurrentFrame,
         .capacity = numBytes,
-    });
-    // Create the VkBuffer.
-    mUsedStages.insert(stage);
+        .lastAccessed = mCurrentFrame,
+        .offset = 0,
+        .mapped = nullptr
+    };
     VkBufferCreateInfo bufferInfo {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         .size = numBytes,
         .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
     };
+    // Stages are mapped for as long as they exist, and coherent so they never need flushing.
     VmaAllocationCreateInfo allocInfo {
-        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU
+        .flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
+        .usage = VMA_MEMORY_USAGE_CPU_TO_GPU,
+        .requiredFlags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
     };
-    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage->buffer, &stage->memory, 0);
+    VmaAllocationInfo info = {};
+    vmaCreateBuffer(mContext.allocator, &bufferInfo, &allocInfo, &stage.buffer, &stage.memory,
+            &info);
+    stage.mapped = info.pMappedData;
+    mStats.buffersCreated++;
     return stage;
 }
 
 void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
+    if (stage->buffer == mRing.buffer) {
+        // The ring's space is reclaimed in order, up to the oldest stage still in use.
+        static_cast<RingStage const*>(stage)->released = true;
+        while (!mRingStages.empty() && mRingStages.front().released) {
+            mRingStages.pop_front();
+        }
+        return;
+    }
     auto iter = mUsedStages.find(stage);
     if (iter == mUsedStages.end()) {
         utils::slog.e << "Unknown stage: " << stage->capacity << " bytes" << utils::io::endl;
@@ -64,12 +140,18 @@ void VulkanStagePool::releaseStage(VulkanStage const* stage) noexcept {
 
 void VulkanStagePool::gc() noexcept {
     mCurrentFrame++;
+    SYSTRACE_VALUE32("vkStagingBytes", mBytesThisFrame);
+    SYSTRACE_VALUE32("vkStagingRingOverflows", mStats.ringOverflows);
+    mStats.bytesLastFrame = mBytesThisFrame;
+    mBytesThisFrame = 0;
     decltype(mFreeStages) stages;
     stages.swap(mFreeStages);
-    const uint64_t evictionTime = mCurrentFrame - TIME_BEFORE_EVICTION;
+    const uint64_t evictionTime = mCurrentFrame > TIME_BEFORE_EVICTION ?
+            mCurrentFrame - TIME_BEFORE_EVICTION : 0;
     for (auto pair : stages) {
         if (pair.second->lastAccessed < evictionTime) {
             vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+            delete pair.second;
         } else {
             mFreeStages.insert(pair);
         }
@@ -77,11 +159,16 @@ void VulkanStagePool::gc() noexcept {
 }
 
 void VulkanStagePool::reset() noexcept {
-    assert(mUsedStages.empty());
+    assert(mUsedStages.empty() && mRingStages.empty());
     for (auto pair : mFreeStages) {
         vmaDestroyBuffer(mContext.allocator, pair.second->buffer, pair.second->memory);
+        delete pair.second;
     }
     mFreeStages.clear();
+    if (mRing.buffer) {
+        vmaDestroyBuffer(mContext.allocator, mRing.buffer, mRing.memory);
+        mRing = {};
+    }
 }
 
 } // namespace filament
@@ -19,21 +19,29 @@
 
 #include "VulkanDriverImpl.h"
 
+#include <deque>
 #include <map>
 #include <unordered_set>
 
 namespace filament {
 namespace driver {
 
-// Immutable POD representing a shared CPU-GPU staging area.
+// Immutable POD representing a shared CPU-GPU staging area. The stage is the range
+// [offset, offset + capacity) of the buffer, its memory is persistently mapped.
 struct VulkanStage {
     VmaAllocation memory;
     VkBuffer buffer;
     uint32_t capacity;
     mutable uint64_t lastAccessed;
+    VkDeviceSize offset;
+    void* mapped;   // points to the stage's first byte
 };
 
 // Manages a pool of stages, periodically releasing stages that have been unused for a while.
+//
+// Stages that are small enough are sub-allocated linearly from a ring buffer, which avoids creating
+// a buffer for each upload. Their space is reclaimed when they're released, which happens once the
+// GPU is done with them, in the order they were acquired.
 class VulkanStagePool {
 public:
     explicit VulkanStagePool(VulkanContext& context) noexcept : mContext(context) {}
@@ -50,7 +58,24 @@ public:
     // Destroys all unused stages and asserts that there are no stages currently in use.
     // This should be called while the context's VkDevice is still alive.
     void reset() noexcept;
+
+    struct Stats {
+        uint64_t bytesUploaded = 0;     // since the beginning
+        uint32_t bytesLastFrame = 0;    // uploaded during the last frame
+        uint32_t ringOverflows = 0;     // stages that didn't fit in the ring
+        uint32_t buffersCreated = 0;
+    };
+    Stats const& getStats() const noexcept { return mStats; }
+
+    static constexpr uint32_t RING_SIZE = 4 * 1024 * 1024;
+
+    // the largest stage allocated from the ring
+    static constexpr uint32_t MAX_RING_STAGE_SIZE = RING_SIZE / 8;
+
 private:
+    VulkanStage const* acquireRingStage(uint32_t numBytes) noexcept;
+    VulkanStage createBuffer(uint32_t numBytes) noexcept;
+
     VulkanContext& mContext;
 
     // Use an ordered multimap for quick (capacity => stage) lookups using lower_bound().
@@ -60,9 +85,21 @@ private:
     // In theory this need not exist, but is useful for validation and ensuring no leaks.
     std::unordered_set<VulkanStage const*> mUsedStages;
 
+    // The ring's stages, in allocation order. A deque never moves its elements when adding or
+    // removing them at either end, so they can be handed out directly.
+    struct RingStage : public VulkanStage {
+        mutable bool released;
+    };
+    VulkanStage mRing = {};
+    std::deque<RingStage> mRingStages;
+    VkDeviceSize mRingHead = 0;
+
     // Store the current "time" (really just a frame count) and LRU eviction parameters.
     uint64_t mCurrentFrame = 0;
     static constexpr uint32_t TIME_BEFORE_EVICTION = 2;
+
+    Stats mStats;
+    uint32_t mBytesThisFrame = 0;
 };
 
 } // namespace filament
@@ -17,15 +17,24 @@
 #include <filament/Box.h>
 #include <filament/Frustum.h>
 #include "details/Culler.h"
+#include "details/Froxelizer.h"
+#include "RenderPass.h"
 
+#include <private/filament/SpirvCompression.h>
+
+#include <utils/JobSystem.h>
 #include <utils/Profiler.h>
 #include <utils/compiler.h>
 #include <math/fast.h>
 #include <math/scalar.h>
+#include <math/transforms.h>
 
+#include <algorithm>
+#include <cstdlib>
 #include <iostream>
 #include <vector>
 #include <random>
+#include <string>
 
 using namespace filament;
 using namespace filament::details;
@@ -112,6 +121,21 @@ int main(void) {
         vb = vb + (visibles[i] ? 1 : 0);
     }
 
+    const std::pair<Culler::Test::Kernel, const char*> kernels[] = {
+            { Culler::Test::Kernel::SCALAR, "Box Culling (scalar)" },
+            { Culler::Test::Kernel::SSE2,   "Box Culling (SSE2)" },
+            { Culler::Test::Kernel::AVX,    "Box Culling (AVX)" },
+            { Culler::Test::Kernel::NEON,   "Box Culling (NEON)" },
+    };
+    for (auto const& kernel : kernels) {
+        if (Culler::Test::isSupported(kernel.first)) {
+            benchmark(p, kernel.second, [&]() {
+                Culler::Test::intersects(kernel.first, visibles, frustum,
+                        boxesCenter.data(), boxesExtent.data(), batch, 0);
+            });
+        }
+    }
+
     benchmark(p, "Sphere Culling Direct", [&]() {
         Culler::Test::intersects(visibles, frustum, spheres.data(), batch);
     });
@@ -169,6 +193,149 @@ int main(void) {
         }
     });
 
+    // World AABBs
+
+    constexpr size_t boxCount = 100000;
+    std::vector<mat4x3f> transforms(boxCount);
+    std::vector<Box> localBoxes(boxCount);
+    std::vector<Box> worldBoxes(boxCount);
+    std::vector<float3> centers(boxCount);
+    std::vector<float3> extents(boxCount);
+    for (size_t i = 0; i < boxCount; i++) {
+        transforms[i] = mat4x3f(mat4f::translate(float4{ rand(gen), rand(gen), rand(gen), 1 }) *
+                mat4f::rotate(rand(gen), normalize(float3{ rand(gen), rand(gen), 1 })));
+        localBoxes[i] = { { rand(gen), rand(gen), rand(gen) }, boxesExtent[i % batch] };
+    }
+
+    benchmark(p, "World AABB, rigidTransform() x 100k", [&]() {
+        for (size_t i = 0; i < boxCount; i++) {
+            worldBoxes[i] = rigidTransform(localBoxes[i], transforms[i]);
+        }
+    });
+
+    benchmark(p, "World AABB, copy + transformAABBs() x 100k", [&]() {
+        for (size_t i = 0; i < boxCount; i++) {
+            centers[i] = localBoxes[i].center;
+            extents[i] = localBoxes[i].halfExtent;
+        }
+        transformAABBs(transforms.data(), centers.data(), extents.data(),
+                centers.data(), extents.data(), boxCount);
+    });
+
+    // Froxel row search
+
+    constexpr size_t planeCount = 33;
+    float4 planesX[planeCount];
+    for (size_t i = 0; i < planeCount; i++) {
+        const float a = float(M_PI) * (0.25f + 0.5f * i / (planeCount - 1));
+        planesX[i] = { std::cos(a), 0, std::sin(a), 0 };
+    }
+    std::vector<float4> circles(batch);
+    for (size_t i = 0; i < batch; i++) {
+        const float r = rand(gen, std::uniform_real_distribution<float>::param_type{0.1f, 10.0f});
+        circles[i] = { rand(gen) * 0.1f, rand(gen) * 0.1f, -std::abs(rand(gen)) * 0.1f, r * r };
+    }
+
+    size_t rowRange = 0;
+    benchmark(p, "Froxel row (scalar)", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            auto range = Froxelizer::Test::findRowRange(planesX, circles[i], 0, 16, 32);
+            rowRange += range.second - range.first;
+        }
+    });
+
+    benchmark(p, "Froxel row", [&]() {
+        for (size_t i = 0; i < batch; i++) {
+            auto range = Froxelizer::findRowRange(planesX, circles[i], 0, 16, 32);
+            rowRange += range.second - range.first;
+        }
+    });
+
+    std::cout << "froxels: " << rowRange << std::endl;
+    std::cout << std::endl;
+
+    // Command sorting
+
+    using Command = RenderPass::Command;
+    JobSystem js;
+    js.adopt();
+    LinearAllocatorArena arena("benchmark", 8 * 1024 * 1024);
+
+    // below RenderPass::RADIX_SORT_MIN_COMMAND_COUNT (1024), sortCommands() is std::sort
+    for (size_t count : { 2048, 10000, 100000 }) {
+        // keys look like a typical color+depth pass: a few passes and priorities, a handful of
+        // materials and random distances. About a third of the commands are sentinels.
+        std::uniform_int_distribution<uint32_t> materials(0, 63);
+        std::uniform_int_distribution<uint32_t> priorities(0, 3);
+        std::uniform_int_distribution<uint32_t> bits;
+        std::vector<Command> source(count);
+        for (size_t i = 0; i < count; i++) {
+            Command& cmd = source[i];
+            switch (i % 3) {
+                case 0:
+                    cmd.key = uint64_t(RenderPass::Pass::DEPTH);
+                    cmd.key |= uint64_t(priorities(gen)) << RenderPass::PRIORITY_SHIFT;
+                    cmd.key |= bits(gen);
+                    break;
+                case 1:
+                    cmd.key = uint64_t(RenderPass::Pass::COLOR);
+                    cmd.key |= uint64_t(priorities(gen)) << RenderPass::PRIORITY_SHIFT;
+                    cmd.key |= RenderPass::makeMaterialSortingKey(materials(gen), materials(gen));
+                    break;
+                case 2:
+                    cmd.key = uint64_t(RenderPass::Pass::SENTINEL);
+                    break;
+            }
+        }
+        std::vector<Command> commands(count);
+
+        std::string name = std::to_string(count) + " commands, ";
+        benchmark(p, (name + "std::sort").c_str(), [&]() {
+            std::copy(source.begin(), source.end(), commands.begin());
+            std::sort(commands.begin(), commands.end());
+        });
+
+        benchmark(p, (name + "RenderPass::sortCommands").c_str(), [&]() {
+            std::copy(source.begin(), source.end(), commands.begin());
+            filament::details::ArenaScope scope(arena);
+            RenderPass::sortCommands(js, scope, commands.data(), commands.data() + count);
+        });
+
+        // the benchmarks are built in release, where assert() is a no-op
+        if (!std::is_sorted(commands.begin(), commands.end())) {
+            std::cerr << name << "RenderPass::sortCommands: not sorted" << std::endl;
+            abort();
+        }
+    }
+
+    js.emancipate();
+
+    {
+        // SPIR-V dictionary: decompression speed vs. size, on a synthetic module
+        std::vector<uint32_t> module = { 0x07230203, 0x00010000, 0x00080001, 4096, 0 };
+        while (module.size() < 64 * 1024) {
+            const uint32_t count = std::uniform_int_distribution<uint32_t>(1, 6)(gen);
+            module.push_back((count << 16u) |
+                    std::uniform_int_distribution<uint32_t>(1, 400)(gen));
+            for (uint32_t i = 1; i < count; i++) {
+                module.push_back(std::uniform_int_distribution<uint32_t>(1, 4096)(gen));
+            }
+        }
+        std::vector<uint8_t> compressed;
+        SpirvCompressor::compress(module.data(), module.size(), compressed);
+        std::vector<uint32_t> words(module.size());
+
+        benchmark(p, "SPIR-V copy", [&]() {
+            std::copy(module.begin(), module.end(), words.begin());
+        });
+        benchmark(p, "SPIR-V decompress", [&]() {
+            SpirvCompressor::decompress(compressed.data(), compressed.size(), words.data());
+        });
+        std::cout << "SPIR-V: " << module.size() * sizeof(uint32_t) << " bytes, compressed: "
+                << compressed.size() << " bytes" << std::endl;
+        std::cout << std::endl;
+    }
+
     return 0;
 }
 
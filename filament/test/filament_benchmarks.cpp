@@ -0,0 +1,654 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filament/Box.h>
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/Frustum.h>
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/Renderer.h>
+#include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+
+#include "details/Allocators.h"
+#include "details/Culler.h"
+#include "details/Engine.h"
+#include "driver/CircularBuffer.h"
+#include "driver/CommandStream.h"
+#include "driver/noop/NoopDriver.h"
+#include "RenderPass.h"
+
+#include <utils/Entity.h>
+#include <utils/EntityManager.h>
+#include <utils/JobSystem.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <getopt/getopt.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace filament;
+using namespace filament::details;
+using namespace math;
+using utils::Entity;
+using utils::EntityManager;
+using utils::JobSystem;
+
+// End-to-end benchmarks of the hot paths of a frame. Scenes are rendered with the no-op driver,
+// so this doesn't need a GPU. Results are printed as a table, or as JSON to track them over
+// time (--json).
+
+struct Options {
+    std::string filter;
+    std::string output;
+    double minTime = 0.5;   // seconds per benchmark
+    size_t frames = 50;
+    bool json = false;
+};
+
+static void printUsage(const char* name) {
+    std::cout << "Benchmarks the hot paths of a frame, without a GPU\n"
+            "Usage:\n"
+            "    " << name << " [options]\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Print this message\n\n"
+            "   --filter=<string>, -f <string>\n"
+            "       Only run the benchmarks whose name contains <string>\n\n"
+            "   --min-time=<seconds>, -t <seconds>\n"
+            "       Minimum time spent in each benchmark, 0.5s by default\n\n"
+            "   --frames=<count>, -n <count>\n"
+            "       Number of frames rendered by the scene benchmarks, 50 by default\n\n"
+            "   --json, -j\n"
+            "       Print the results as JSON\n\n"
+            "   --output=<path>, -o <path>\n"
+            "       Also write the results as JSON to <path>\n\n";
+}
+
+static Options handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hf:t:n:jo:";
+    static const struct option OPTIONS[] = {
+            { "help",     no_argument,       0, 'h' },
+            { "filter",   required_argument, 0, 'f' },
+            { "min-time", required_argument, 0, 't' },
+            { "frames",   required_argument, 0, 'n' },
+            { "json",     no_argument,       0, 'j' },
+            { "output",   required_argument, 0, 'o' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    Options options;
+    int opt;
+    int optionIndex = 0;
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+                // break;
+            case 'f':
+                options.filter = arg;
+                break;
+            case 't':
+                options.minTime = std::max(0.0, std::stod(arg));
+                break;
+            case 'n':
+                options.frames = std::max(size_t(1), size_t(std::stoul(arg)));
+                break;
+            case 'j':
+                options.json = true;
+                break;
+            case 'o':
+                options.output = arg;
+                break;
+        }
+    }
+    return options;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+class Suite {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Result {
+        std::string name;
+        size_t iterations;
+        size_t items;       // items processed per iteration, e.g. boxes culled
+        double mean;        // in nanoseconds per iteration
+        double median;
+        double min;
+    };
+
+    explicit Suite(Options const& options) : mOptions(options) { }
+
+    bool isEnabled(std::string const& name) const noexcept {
+        return mOptions.filter.empty() || name.find(mOptions.filter) != std::string::npos;
+    }
+
+    // Times f() until minTime has elapsed. Calls that are too short to be timed individually
+    // are timed in batches.
+    template<typename F>
+    void run(std::string const& name, size_t items, F f) {
+        if (!isEnabled(name)) {
+            return;
+        }
+        f();    // warm up
+
+        const auto start = clock::now();
+        f();
+        const double first = double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - start).count());
+        const size_t batch = size_t(std::max(1.0, MIN_SAMPLE_TIME / std::max(first, 1.0)));
+
+        std::vector<double> samples;
+        const auto end = start + std::chrono::duration<double>(mOptions.minTime);
+        do {
+            const auto t = clock::now();
+            for (size_t i = 0; i < batch; i++) {
+                f();
+            }
+            samples.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - t).count()) / batch);
+        } while (samples.size() < MIN_SAMPLE_COUNT || clock::now() < end);
+        add(name, items, std::move(samples), batch);
+    }
+
+    // adds a result measured elsewhere, samples are in nanoseconds
+    void add(std::string const& name, size_t items, std::vector<double> samples,
+            size_t batch = 1) {
+        if (!isEnabled(name) || samples.empty()) {
+            return;
+        }
+        std::sort(samples.begin(), samples.end());
+        double total = 0;
+        for (double s : samples) {
+            total += s;
+        }
+        mResults.push_back({ name, samples.size() * batch, items,
+                total / samples.size(), samples[samples.size() / 2], samples.front() });
+        if (!mOptions.json) {
+            print(std::cout, mResults.back());
+        }
+    }
+
+    void printHeader(std::ostream& out) const {
+        out << std::left << std::setw(48) << "benchmark" << std::right
+                << std::setw(12) << "mean" << std::setw(12) << "median" << std::setw(12) << "min"
+                << std::setw(12) << "iterations" << std::setw(14) << "items/s" << std::endl;
+    }
+
+    void writeJson(std::ostream& out) const {
+        out << "{\n";
+        out << "  \"context\": {\n";
+        out << "    \"threads\": " << std::thread::hardware_concurrency() << ",\n";
+#ifdef NDEBUG
+        out << "    \"build\": \"release\",\n";
+#else
+        out << "    \"build\": \"debug\",\n";
+#endif
+        out << "    \"min_time\": " << mOptions.minTime << ",\n";
+        out << "    \"frames\": " << mOptions.frames << "\n";
+        out << "  },\n";
+        out << "  \"benchmarks\": [";
+        for (size_t i = 0; i < mResults.size(); i++) {
+            Result const& r = mResults[i];
+            out << (i ? ",\n" : "\n") << std::fixed << std::setprecision(1)
+                    << "    { \"name\": \"" << r.name << "\""
+                    << ", \"iterations\": " << r.iterations
+                    << ", \"items\": " << r.items
+                    << ", \"mean_ns\": " << r.mean
+                    << ", \"median_ns\": " << r.median
+                    << ", \"min_ns\": " << r.min
+                    << ", \"items_per_second\": " << getItemsPerSecond(r) << " }";
+        }
+        out << "\n  ]\n}" << std::endl;
+    }
+
+private:
+    static constexpr double MIN_SAMPLE_TIME = 10000.0;  // 10us
+    static constexpr size_t MIN_SAMPLE_COUNT = 5;
+
+    static double getItemsPerSecond(Result const& r) noexcept {
+        return r.median > 0 ? r.items * 1e9 / r.median : 0.0;
+    }
+
+    static void print(std::ostream& out, Result const& r) {
+        auto time = [](double ns) {
+            std::ostringstream s;
+            s << std::fixed << std::setprecision(ns < 1e4 ? 0 : 3);
+            if (ns < 1e4) {
+                s << ns << " ns";
+            } else if (ns < 1e7) {
+                s << ns * 1e-3 << " us";
+            } else {
+                s << ns * 1e-6 << " ms";
+            }
+            return s.str();
+        };
+        out << std::left << std::setw(48) << r.name << std::right
+                << std::setw(12) << time(r.mean) << std::setw(12) << time(r.median)
+                << std::setw(12) << time(r.min) << std::setw(12) << r.iterations
+                << std::setw(14) << std::scientific << std::setprecision(3)
+                << getItemsPerSecond(r) << std::defaultfloat << std::endl;
+    }
+
+    Options const& mOptions;
+    std::vector<Result> mResults;
+};
+
+constexpr double Suite::MIN_SAMPLE_TIME;
+constexpr size_t Suite::MIN_SAMPLE_COUNT;
+
+// ------------------------------------------------------------------------------------------------
+
+static constexpr float3 CUBE_VERTICES[8] = {
+        { -1, -1, -1 }, {  1, -1, -1 }, { -1,  1, -1 }, {  1,  1, -1 },
+        { -1, -1,  1 }, {  1, -1,  1 }, { -1,  1,  1 }, {  1,  1,  1 },
+};
+
+static constexpr uint16_t CUBE_INDICES[36] = {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 4, 2,  2, 4, 6,
+        1, 3, 5,  3, 7, 5,  0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+};
+
+// renderables made of chains of 'depth' transforms, spread over a square, and point lights
+class TestScene {
+public:
+    TestScene(Engine& engine, size_t renderables, size_t lights, size_t depth)
+            : mEngine(engine), mDepth(depth) {
+        mScene = engine.createScene();
+        mView = engine.createView();
+        mCamera = engine.createCamera();
+
+        // the renderables are spread over a square of this size, so that some are culled
+        const float extent = std::sqrt(float(renderables)) * 4.0f;
+        mCamera->setProjection(60.0, 16.0 / 9.0, 0.1, extent * 2.0);
+        mCamera->lookAt({ 0, extent * 0.25f, extent * 0.5f }, { 0, 0, 0 });
+        mView->setViewport({ 0, 0, 1920, 1080 });
+        mView->setScene(mScene);
+        mView->setCamera(mCamera);
+
+        mVertexBuffer = VertexBuffer::Builder()
+                .vertexCount(8)
+                .bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(engine);
+        mVertexBuffer->setBufferAt(engine, 0,
+                VertexBuffer::BufferDescriptor(CUBE_VERTICES, sizeof(CUBE_VERTICES), nullptr));
+        mIndexBuffer = IndexBuffer::Builder()
+                .indexCount(36)
+                .bufferType(IndexBuffer::IndexType::USHORT)
+                .build(engine);
+        mIndexBuffer->setBuffer(engine,
+                IndexBuffer::BufferDescriptor(CUBE_INDICES, sizeof(CUBE_INDICES), nullptr));
+
+        // the instances of the default material still sort and bind as different materials
+        mMaterials.resize(16);
+        for (MaterialInstance*& mi : mMaterials) {
+            mi = engine.getDefaultMaterial()->createInstance();
+        }
+
+        std::mt19937 gen;
+        std::uniform_real_distribution<float> position(-extent, extent);
+        std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+
+        auto& tcm = engine.getTransformManager();
+        mRenderables.resize(renderables);
+        EntityManager::get().create(mRenderables.size(), mRenderables.data());
+        for (size_t i = 0; i < mRenderables.size(); i++) {
+            const bool root = i % depth == 0;
+            const mat4f transform = mat4f::translate(root ?
+                    float4{ position(gen), 0, position(gen), 1 } :
+                    float4{ offset(gen), offset(gen), offset(gen), 1 });
+            tcm.create(mRenderables[i],
+                    root ? TransformManager::Instance{} : tcm.getInstance(mRenderables[i - 1]),
+                    transform);
+            RenderableManager::Builder(1)
+                    .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                    .material(0, mMaterials[i % mMaterials.size()])
+                    .geometry(0, RenderableManager::PrimitiveType::TRIANGLES,
+                            mVertexBuffer, mIndexBuffer)
+                    .castShadows(true)
+                    .build(engine, mRenderables[i]);
+            mScene->addEntity(mRenderables[i]);
+        }
+
+        mLights.resize(lights + 1);
+        EntityManager::get().create(mLights.size(), mLights.data());
+        LightManager::Builder(LightManager::Type::SUN)
+                .direction({ 0.2f, -1.0f, -0.3f })
+                .castShadows(true)
+                .build(engine, mLights[0]);
+        mScene->addEntity(mLights[0]);
+        // the point lights are in front of the camera, so that they all need froxelization
+        std::uniform_real_distribution<float> x(-extent * 0.25f, extent * 0.25f);
+        std::uniform_real_distribution<float> z(-extent * 0.25f, extent * 0.25f);
+        for (size_t i = 1; i < mLights.size(); i++) {
+            LightManager::Builder(LightManager::Type::POINT)
+                    .position({ x(gen), 2.0f, z(gen) })
+                    .falloff(8.0f)
+                    .build(engine, mLights[i]);
+            mScene->addEntity(mLights[i]);
+        }
+    }
+
+    ~TestScene() {
+        for (Entity e : mLights) {
+            mEngine.destroy(e);
+        }
+        for (Entity e : mRenderables) {
+            mEngine.destroy(e);
+        }
+        EntityManager::get().destroy(mLights.size(), mLights.data());
+        EntityManager::get().destroy(mRenderables.size(), mRenderables.data());
+        for (MaterialInstance* mi : mMaterials) {
+            mEngine.destroy(mi);
+        }
+        mEngine.destroy(mVertexBuffer);
+        mEngine.destroy(mIndexBuffer);
+        mEngine.destroy(mCamera);
+        mEngine.destroy(mView);
+        mEngine.destroy(mScene);
+    }
+
+    View* getView() const noexcept { return mView; }
+    std::vector<Entity> const& getRenderables() const noexcept { return mRenderables; }
+    size_t getDepth() const noexcept { return mDepth; }
+
+    // moves the roots, which updates the world transforms of all the renderables
+    void animate(size_t frame) noexcept {
+        auto& tcm = mEngine.getTransformManager();
+        const float4 delta{ 0.0f, frame & 1u ? 0.01f : -0.01f, 0.0f, 1.0f };
+        for (size_t i = 0; i < mRenderables.size(); i += mDepth) {
+            auto ti = tcm.getInstance(mRenderables[i]);
+            tcm.setTransform(ti, mat4f::translate(delta) * tcm.getTransform(ti));
+        }
+    }
+
+private:
+    Engine& mEngine;
+    size_t mDepth;
+    Scene* mScene = nullptr;
+    View* mView = nullptr;
+    Camera* mCamera = nullptr;
+    VertexBuffer* mVertexBuffer = nullptr;
+    IndexBuffer* mIndexBuffer = nullptr;
+    std::vector<MaterialInstance*> mMaterials;
+    std::vector<Entity> mRenderables;
+    std::vector<Entity> mLights;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+static void benchmarkTransforms(Suite& suite, Engine& engine) {
+    for (size_t depth : { 1, 4 }) {
+        const size_t count = 10000;
+        const std::string name = "transforms/" + std::to_string(count) + "x" +
+                std::to_string(depth);
+        if (!suite.isEnabled(name)) {
+            continue;
+        }
+        TestScene scene(engine, count, 0, depth);
+        auto& tcm = engine.getTransformManager();
+        std::vector<Entity> const& renderables = scene.getRenderables();
+
+        // setting the roots updates their children right away
+        size_t frame = 0;
+        suite.run(name + "/setTransform(roots)", count, [&]() {
+            scene.animate(frame++);
+        });
+
+        // all the local transforms are set, and the world transforms computed once at the end
+        std::vector<mat4f> locals(count);
+        for (size_t i = 0; i < count; i++) {
+            locals[i] = tcm.getTransform(tcm.getInstance(renderables[i]));
+        }
+        suite.run(name + "/transaction", count, [&]() {
+            tcm.openLocalTransformTransaction();
+            for (size_t i = 0; i < count; i++) {
+                tcm.setTransform(tcm.getInstance(renderables[i]), locals[i]);
+            }
+            tcm.commitLocalTransformTransaction();
+        });
+
+        std::vector<TransformManager::Instance> instances(count);
+        for (size_t i = 0; i < count; i++) {
+            instances[i] = tcm.getInstance(renderables[i]);
+        }
+        suite.run(name + "/setTransforms", count, [&]() {
+            tcm.setTransforms(instances.data(), locals.data(), count);
+        });
+    }
+}
+
+// The stages of a frame, as measured by the renderer: FScene::prepare, culling, the SoA
+// partition, command generation and sorting, driver commands and froxelization.
+static void benchmarkFrames(Suite& suite, Options const& options, Engine& engine) {
+    struct Config {
+        size_t renderables;
+        size_t lights;
+    };
+    for (Config config : { Config{ 1000, 16 }, Config{ 10000, 16 }, Config{ 10000, 256 } }) {
+        const std::string name = "frame/" + std::to_string(config.renderables) + "_renderables_" +
+                std::to_string(config.lights) + "_lights";
+        if (!suite.isEnabled(name)) {
+            continue;
+        }
+        TestScene scene(engine, config.renderables, config.lights, 1);
+        SwapChain* swapChain = engine.createSwapChain(nullptr);
+        Renderer* renderer = engine.createRenderer();
+
+        std::vector<double> total, scenePrepare, culling, partition, commandGeneration;
+        std::vector<double> commandSort, driverCommands, froxelization;
+        // the first frames warm up the caches and the adaptive job splitting
+        const size_t warmup = 10;
+        for (size_t frame = 0; frame < options.frames + warmup; frame++) {
+            scene.animate(frame);
+            const auto start = Suite::clock::now();
+            if (renderer->beginFrame(swapChain)) {
+                renderer->render(scene.getView());
+                renderer->endFrame();
+                const double ns = double(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Suite::clock::now() - start).count());
+                if (frame >= warmup) {
+                    Renderer::CpuFrameStats stats = renderer->getCpuFrameStats();
+                    total.push_back(ns);
+                    scenePrepare.push_back(stats.scenePrepare * 1e6);
+                    culling.push_back(stats.culling * 1e6);
+                    partition.push_back(stats.partition * 1e6);
+                    commandGeneration.push_back(stats.commandGeneration * 1e6);
+                    commandSort.push_back(stats.commandSort * 1e6);
+                    driverCommands.push_back(stats.driverCommands * 1e6);
+                    froxelization.push_back(stats.froxelization * 1e6);
+                }
+            }
+        }
+
+        suite.add(name + "/total", config.renderables, std::move(total));
+        suite.add(name + "/scenePrepare", config.renderables, std::move(scenePrepare));
+        suite.add(name + "/culling", config.renderables, std::move(culling));
+        suite.add(name + "/partition", config.renderables, std::move(partition));
+        suite.add(name + "/commandGeneration", config.renderables, std::move(commandGeneration));
+        suite.add(name + "/commandSort", config.renderables, std::move(commandSort));
+        suite.add(name + "/driverCommands", config.renderables, std::move(driverCommands));
+        suite.add(name + "/froxelization", config.lights, std::move(froxelization));
+
+        engine.destroy(renderer);
+        engine.destroy(swapChain);
+    }
+}
+
+static void benchmarkCulling(Suite& suite) {
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.1f, 25.0f);
+    const Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    for (size_t count : { 1000, 10000, 100000 }) {
+        std::vector<float3> centers(count);
+        std::vector<float3> extents(count);
+        std::vector<Culler::result_type> results(Culler::round(count));
+        for (size_t i = 0; i < count; i++) {
+            centers[i] = { rand(gen), rand(gen), -std::abs(rand(gen)) };
+            extents[i] = { size(gen), size(gen), size(gen) };
+        }
+        suite.run("culling/boxes/" + std::to_string(count), count, [&]() {
+            Culler::intersects(results.data(), frustum, centers.data(), extents.data(), count, 0);
+        });
+    }
+}
+
+static void benchmarkCommandSort(Suite& suite, JobSystem& js) {
+    using Command = RenderPass::Command;
+    LinearAllocatorArena arena("benchmark", 8 * 1024 * 1024);
+    std::mt19937 gen;
+
+    for (size_t count : { 1000, 10000, 100000 }) {
+        // keys look like a typical color+depth pass: a few passes and priorities, a handful of
+        // materials and random distances
+        std::uniform_int_distribution<uint32_t> materials(0, 63);
+        std::uniform_int_distribution<uint32_t> priorities(0, 3);
+        std::uniform_int_distribution<uint32_t> bits;
+        std::vector<Command> source(count);
+        for (size_t i = 0; i < count; i++) {
+            Command& cmd = source[i];
+            if (i & 1u) {
+                cmd.key = uint64_t(RenderPass::Pass::COLOR);
+                cmd.key |= uint64_t(priorities(gen)) << RenderPass::PRIORITY_SHIFT;
+                cmd.key |= RenderPass::makeMaterialSortingKey(materials(gen), materials(gen));
+            } else {
+                cmd.key = uint64_t(RenderPass::Pass::DEPTH);
+                cmd.key |= uint64_t(priorities(gen)) << RenderPass::PRIORITY_SHIFT;
+                cmd.key |= bits(gen);
+            }
+        }
+        std::vector<Command> commands(count);
+        suite.run("commands/sort/" + std::to_string(count), count, [&]() {
+            std::copy(source.begin(), source.end(), commands.begin());
+            ArenaScope scope(arena);
+            RenderPass::sortCommands(js, scope, commands.data(), commands.data() + count);
+        });
+    }
+}
+
+// Records the commands of a typical draw loop in a CommandStream, and executes them with the
+// no-op driver: this is the cost of the command stream itself.
+static void benchmarkCommandStream(Suite& suite) {
+    std::unique_ptr<Driver> driver(NoopDriver::create());
+    const size_t drawCount = 10000;
+    const Driver::RasterState rs;
+    const Driver::ProgramHandle ph(1);
+    const Driver::UniformBufferHandle ubh(2);
+    const Driver::RenderPrimitiveHandle rph(3);
+
+    std::vector<uint8_t> storage(drawCount * 128 + CircularBuffer::BLOCK_SIZE);
+    std::unique_ptr<CircularBuffer> buffer;
+    CommandStream stream;
+    auto encode = [&]() {
+        buffer.reset(new CircularBuffer(storage.data(), storage.size()));
+        stream = CommandStream(*driver, *buffer);
+        for (size_t i = 0; i < drawCount; i++) {
+            stream.bindUniformsRange(0, ubh, i * 256, 256);
+            stream.draw(ph, rs, rph);
+        }
+        new(buffer->allocate(sizeof(NoopCommand))) NoopCommand(nullptr);
+    };
+
+    suite.run("command_stream/encode", drawCount * 2, encode);
+    suite.run("command_stream/encode+execute", drawCount * 2, [&]() {
+        encode();
+        stream.execute(buffer->getTail());
+    });
+}
+
+// the cost of scheduling jobs, the work itself is next to nothing
+static void benchmarkJobSystem(Suite& suite, JobSystem& js) {
+    suite.run("jobs/empty_job", 1, [&]() {
+        js.runAndWait(js.createJob());
+    });
+
+    for (size_t count : { 1024, 16384, 262144 }) {
+        std::vector<float> data(count, 1.0f);
+        suite.run("jobs/parallel_for/" + std::to_string(count), count, [&]() {
+            auto job = utils::jobs::parallel_for(js, nullptr, data.data(), uint32_t(count),
+                    [](float* v, uint32_t c) {
+                        for (uint32_t i = 0; i < c; i++) {
+                            v[i] = v[i] * 0.5f + 0.5f;
+                        }
+                    }, utils::jobs::CountSplitter<1024, 8>());
+            js.runAndWait(job);
+        });
+    }
+}
+
+// ------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+    const Options options = handleArguments(argc, argv);
+    Suite suite(options);
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    JobSystem& js = upcast(engine)->getJobSystem();
+
+    if (!options.json) {
+        suite.printHeader(std::cout);
+    }
+    benchmarkTransforms(suite, *engine);
+    benchmarkFrames(suite, options, *engine);
+    benchmarkCulling(suite);
+    benchmarkCommandSort(suite, js);
+    benchmarkCommandStream(suite);
+    benchmarkJobSystem(suite, js);
+
+    Engine::destroy(&engine);
+
+    if (options.json) {
+        suite.writeJson(std::cout);
+    }
+    if (!options.output.empty()) {
+        std::ofstream out(options.output);
+        suite.writeJson(out);
+        if (!out) {
+            std::cerr << "Can't write " << options.output << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filament/Camera.h>
+#include <filament/Engine.h>
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/Renderer.h>
+#include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+#include <filament/TransformManager.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+
+#include <utils/Entity.h>
+#include <utils/EntityManager.h>
+
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <getopt/getopt.h>
+
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace filament;
+using namespace math;
+using utils::Entity;
+using utils::EntityManager;
+
+// Renders a synthetic scene with the no-op driver and prints the CPU time of each stage of the
+// frame, averaged over the rendered frames. Nothing is sent to a GPU, so this can run anywhere.
+
+struct Options {
+    size_t renderables = 4096;
+    size_t lights = 64;
+    size_t materials = 16;
+    size_t depth = 1;
+    size_t frames = 200;
+    bool shadows = true;
+};
+
+static void printUsage(const char* name) {
+    std::cout << "Measures the CPU cost of the stages of a frame, without a GPU\n"
+            "Usage:\n"
+            "    " << name << " [options]\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Print this message\n\n"
+            "   --renderables=<count>, -n <count>\n"
+            "       Number of renderables, 4096 by default\n\n"
+            "   --lights=<count>, -l <count>\n"
+            "       Number of point lights, 64 by default\n\n"
+            "   --materials=<count>, -m <count>\n"
+            "       Number of material instances the renderables use, 16 by default\n\n"
+            "   --depth=<levels>, -d <levels>\n"
+            "       Depth of the transform hierarchies, 1 (flat) by default\n\n"
+            "   --frames=<count>, -f <count>\n"
+            "       Number of frames to render, 200 by default\n\n"
+            "   --no-shadows, -s\n"
+            "       Don't cast shadows from the sun\n\n";
+}
+
+static Options handleArguments(int argc, char* argv[]) {
+    static constexpr const char* OPTSTR = "hn:l:m:d:f:s";
+    static const struct option OPTIONS[] = {
+            { "help",        no_argument,       0, 'h' },
+            { "renderables", required_argument, 0, 'n' },
+            { "lights",      required_argument, 0, 'l' },
+            { "materials",   required_argument, 0, 'm' },
+            { "depth",       required_argument, 0, 'd' },
+            { "frames",      required_argument, 0, 'f' },
+            { "no-shadows",  no_argument,       0, 's' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    Options options;
+    int opt;
+    int optionIndex = 0;
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+                // break;
+            case 'n':
+                options.renderables = size_t(std::stoul(arg));
+                break;
+            case 'l':
+                options.lights = size_t(std::stoul(arg));
+                break;
+            case 'm':
+                options.materials = std::max(size_t(1), size_t(std::stoul(arg)));
+                break;
+            case 'd':
+                options.depth = std::max(size_t(1), size_t(std::stoul(arg)));
+                break;
+            case 'f':
+                options.frames = std::max(size_t(1), size_t(std::stoul(arg)));
+                break;
+            case 's':
+                options.shadows = false;
+                break;
+        }
+    }
+    return options;
+}
+
+static constexpr float3 CUBE_VERTICES[8] = {
+        { -1, -1, -1 }, {  1, -1, -1 }, { -1,  1, -1 }, {  1,  1, -1 },
+        { -1, -1,  1 }, {  1, -1,  1 }, { -1,  1,  1 }, {  1,  1,  1 },
+};
+
+static constexpr uint16_t CUBE_INDICES[36] = {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,  0, 4, 2,  2, 4, 6,
+        1, 3, 5,  3, 7, 5,  0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+};
+
+int main(int argc, char* argv[]) {
+    const Options options = handleArguments(argc, argv);
+
+    Engine* engine = Engine::create(Engine::Backend::NOOP);
+    SwapChain* swapChain = engine->createSwapChain(nullptr);
+    Renderer* renderer = engine->createRenderer();
+    Scene* scene = engine->createScene();
+    View* view = engine->createView();
+    Camera* camera = engine->createCamera();
+
+    // the renderables are spread over a square of this size, so that some are culled
+    const float extent = std::sqrt(float(options.renderables)) * 4.0f;
+    camera->setProjection(60.0, 16.0 / 9.0, 0.1, extent * 2.0);
+    camera->lookAt({ 0, extent * 0.25f, extent * 0.5f }, { 0, 0, 0 });
+    view->setViewport({ 0, 0, 1920, 1080 });
+    view->setScene(scene);
+    view->setCamera(camera);
+
+    VertexBuffer* vb = VertexBuffer::Builder()
+            .vertexCount(8)
+            .bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(*engine);
+    vb->setBufferAt(*engine, 0,
+            VertexBuffer::BufferDescriptor(CUBE_VERTICES, sizeof(CUBE_VERTICES), nullptr));
+    IndexBuffer* ib = IndexBuffer::Builder()
+            .indexCount(36)
+            .bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    ib->setBuffer(*engine,
+            IndexBuffer::BufferDescriptor(CUBE_INDICES, sizeof(CUBE_INDICES), nullptr));
+
+    // Materials can't be compiled here, the instances of the default material still sort and
+    // bind as different materials.
+    std::vector<MaterialInstance*> materials(options.materials);
+    for (MaterialInstance*& mi : materials) {
+        mi = engine->getDefaultMaterial()->createInstance();
+    }
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> position(-extent, extent);
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+
+    // the renderables form chains of options.depth transforms, each relative to its parent
+    auto& tcm = engine->getTransformManager();
+    std::vector<Entity> renderables(options.renderables);
+    EntityManager::get().create(renderables.size(), renderables.data());
+    for (size_t i = 0; i < renderables.size(); i++) {
+        const bool root = i % options.depth == 0;
+        const mat4f transform = mat4f::translate(root ?
+                float4{ position(gen), 0, position(gen), 1 } :
+                float4{ offset(gen), offset(gen), offset(gen), 1 });
+        tcm.create(renderables[i],
+                root ? TransformManager::Instance{} : tcm.getInstance(renderables[i - 1]),
+                transform);
+        RenderableManager::Builder(1)
+                .boundingBox({{ -1, -1, -1 }, { 1, 1, 1 }})
+                .material(0, materials[i % materials.size()])
+                .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib)
+                .castShadows(options.shadows)
+                .build(*engine, renderables[i]);
+        scene->addEntity(renderables[i]);
+    }
+
+    std::vector<Entity> lights(options.lights + 1);
+    EntityManager::get().create(lights.size(), lights.data());
+    LightManager::Builder(LightManager::Type::SUN)
+            .direction({ 0.2f, -1.0f, -0.3f })
+            .castShadows(options.shadows)
+            .build(*engine, lights[0]);
+    scene->addEntity(lights[0]);
+    for (size_t i = 1; i < lights.size(); i++) {
+        LightManager::Builder(LightManager::Type::POINT)
+                .position({ position(gen), 2.0f, position(gen) })
+                .falloff(8.0f)
+                .build(*engine, lights[i]);
+        scene->addEntity(lights[i]);
+    }
+
+    // the first frames warm up the caches and the adaptive job splitting
+    const size_t warmup = std::min(options.frames, size_t(10));
+    Renderer::CpuFrameStats total;
+    size_t measured = 0;
+    for (size_t frame = 0; frame < options.frames + warmup; frame++) {
+        // move the roots so that the world transforms are updated every frame
+        const float4 delta{ 0.0f, frame & 1u ? 0.01f : -0.01f, 0.0f, 1.0f };
+        for (size_t i = 0; i < renderables.size(); i += options.depth) {
+            auto ti = tcm.getInstance(renderables[i]);
+            tcm.setTransform(ti, mat4f::translate(delta) * tcm.getTransform(ti));
+        }
+
+        if (renderer->beginFrame(swapChain)) {
+            renderer->render(view);
+            renderer->endFrame();
+            if (frame >= warmup) {
+                Renderer::CpuFrameStats stats = renderer->getCpuFrameStats();
+                total.scenePrepare += stats.scenePrepare;
+                total.culling += stats.culling;
+                total.partition += stats.partition;
+                total.commandGeneration += stats.commandGeneration;
+                total.commandSort += stats.commandSort;
+                total.driverCommands += stats.driverCommands;
+                total.froxelization += stats.froxelization;
+                measured++;
+            }
+        }
+    }
+
+    std::cout << options.renderables << " renderables, " << options.lights << " lights, "
+            << options.materials << " materials, depth " << options.depth << ", "
+            << measured << " frames" << std::endl;
+    auto print = [measured](const char* name, float ms) {
+        std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+                << std::setprecision(3) << std::setw(10) << (measured ? ms / measured : 0.0f)
+                << " ms" << std::endl;
+    };
+    print("scene prepare", total.scenePrepare);
+    print("culling", total.culling);
+    print("partition", total.partition);
+    print("command generation", total.commandGeneration);
+    print("command sort", total.commandSort);
+    print("driver commands", total.driverCommands);
+    print("froxelization", total.froxelization);
+
+    for (Entity e : lights) {
+        engine->destroy(e);
+    }
+    for (Entity e : renderables) {
+        engine->destroy(e);
+    }
+    EntityManager::get().destroy(lights.size(), lights.data());
+    EntityManager::get().destroy(renderables.size(), renderables.data());
+    for (MaterialInstance* mi : materials) {
+        engine->destroy(mi);
+    }
+    engine->destroy(vb);
+    engine->destroy(ib);
+    engine->destroy(camera);
+    engine->destroy(view);
+    engine->destroy(scene);
+    engine->destroy(renderer);
+    engine->destroy(swapChain);
+    Engine::destroy(&engine);
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "driver/CommandReplay.h"
+#include "driver/Driver.h"
+
+#include <filament/driver/ExternalContext.h>
+
+#include <getopt/getopt.h>
+
+#include <SDL.h>
+
+#include "NativeWindowHelper.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+
+using namespace filament;
+using namespace filament::driver;
+
+// Replays a capture of driver commands (see Engine::Config::captureFile) in a window, without
+// the engine, and prints the CPU and GPU times of its frames.
+
+struct Options {
+    Backend backend = Backend::DEFAULT;
+    int width = 1280;
+    int height = 720;
+    bool printFrames = false;
+};
+
+static void printUsage(const char* name) {
+    std::cout << "Replays a capture of driver commands and measures its frames\n"
+            "Usage:\n"
+            "    " << name << " [options] <capture>\n"
+            "Options:\n"
+            "   --help, -h\n"
+            "       Print this message\n\n"
+            "   --api, -a\n"
+            "       Specify the backend API: opengl (default) or vulkan\n\n"
+            "   --size=<width>x<height>, -s <width>x<height>\n"
+            "       Size of the window, 1280x720 by default. It should be the size of the window\n"
+            "       the capture was made with\n\n"
+            "   --print-frames, -p\n"
+            "       Print the times of each frame\n\n";
+}
+
+static int handleArguments(int argc, char* argv[], Options* options) {
+    static constexpr const char* OPTSTR = "ha:s:p";
+    static const struct option OPTIONS[] = {
+            { "help",         no_argument,       0, 'h' },
+            { "api",          required_argument, 0, 'a' },
+            { "size",         required_argument, 0, 's' },
+            { "print-frames", no_argument,       0, 'p' },
+            { 0, 0, 0, 0 }  // termination of the option list
+    };
+
+    int opt;
+    int optionIndex = 0;
+    while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
+        std::string arg(optarg ? optarg : "");
+        switch (opt) {
+            default:
+            case 'h':
+                printUsage(argv[0]);
+                exit(0);
+                // break;
+            case 'a':
+                if (arg == "opengl") {
+                    options->backend = Backend::OPENGL;
+                } else if (arg == "vulkan") {
+                    options->backend = Backend::VULKAN;
+                } else {
+                    std::cerr << "Unrecognized backend. Must be 'opengl'|'vulkan'." << std::endl;
+                }
+                break;
+            case 's': {
+                const size_t x = arg.find('x');
+                if (x != std::string::npos) {
+                    options->width = std::max(1, std::stoi(arg.substr(0, x)));
+                    options->height = std::max(1, std::stoi(arg.substr(x + 1)));
+                }
+                break;
+            }
+            case 'p':
+                options->printFrames = true;
+                break;
+        }
+    }
+    return optind;
+}
+
+static void printStats(const char* name, std::vector<uint64_t> times) {
+    if (times.empty()) {
+        std::cout << std::left << std::setw(8) << name << "unknown" << std::endl;
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    uint64_t total = 0;
+    for (uint64_t t : times) {
+        total += t;
+    }
+    auto ms = [](double ns) { return ns * 1e-6; };
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+            << std::setprecision(3)
+            << "average " << std::setw(8) << ms(double(total) / times.size()) << " ms, "
+            << "median " << std::setw(8) << ms(times[times.size() / 2]) << " ms, "
+            << "max " << std::setw(8) << ms(times.back()) << " ms" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    const int optionIndex = handleArguments(argc, argv, &options);
+    if (optionIndex >= argc) {
+        printUsage(argv[0]);
+        return 1;
+    }
+    const char* path = argv[optionIndex];
+
+    if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+        std::cerr << "SDL_Init failure" << std::endl;
+        return 1;
+    }
+    SDL_Window* window = SDL_CreateWindow("filament_replay",
+            SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, options.width, options.height,
+            SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL);
+
+    // the replay creates the driver the way the engine does
+    Backend backend = options.backend;
+    std::unique_ptr<ExternalContext> context(ExternalContext::create(&backend));
+    std::unique_ptr<Driver> driver(context ? context->createDriver(nullptr) : nullptr);
+    if (!driver) {
+        std::cerr << "Can't create the driver" << std::endl;
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 1;
+    }
+
+    std::vector<CommandReplay::FrameTime> frames;
+    {
+        CommandReplay replay(*driver, getNativeWindow(window));
+        if (replay.open(path)) {
+            while (replay.replayFrame()) {
+                SDL_PumpEvents();
+            }
+            replay.finish();
+            frames = replay.getFrameTimes();
+        }
+    }
+    driver->terminate();
+    driver.reset();
+    context.reset();
+    SDL_DestroyWindow(window);
+    SDL_Quit();
+
+    if (frames.empty()) {
+        return 1;
+    }
+
+    std::vector<uint64_t> cpu;
+    std::vector<uint64_t> gpu;
+    for (size_t i = 0; i < frames.size(); i++) {
+        cpu.push_back(frames[i].cpu);
+        if (frames[i].gpu) {
+            gpu.push_back(frames[i].gpu);
+        }
+        if (options.printFrames) {
+            std::cout << "frame " << std::setw(5) << i << std::fixed << std::setprecision(3)
+                    << "  cpu " << std::setw(8) << frames[i].cpu * 1e-6 << " ms"
+                    << "  gpu " << std::setw(8) << frames[i].gpu * 1e-6 << " ms" << std::endl;
+        }
+    }
+    std::cout << frames.size() << " frames replayed with "
+            << (backend == Backend::VULKAN ? "Vulkan" : "OpenGL") << std::endl;
+    printStats("cpu", cpu);
+    printStats("gpu", gpu);
+    return 0;
+}
@@ -14,30 +14,56 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include <math/vec3.h>
 #include <math/vec4.h>
 #include <math/mat4.h>
+#include <math/transforms.h>
 
 #include <filament/Camera.h>
 #include <filament/Color.h>
 #include <filament/Frustum.h>
 #include <filament/Material.h>
+#include <filament/PotentiallyVisibleSet.h>
 #include <filament/Engine.h>
-
+#include <filament/IndexBuffer.h>
+#include <filament/LightManager.h>
+#include <filament/RenderableManager.h>
+#include <filament/Scene.h>
+#include <filament/Texture.h>
+#include <filament/VertexBuffer.h>
+#include <filament/View.h>
+
+#include "driver/CommandBufferQueue.h"
+#include "driver/CommandTimings.h"
+#include "driver/Program.h"
 #include "driver/UniformBuffer.h"
 #include <filament/UniformInterfaceBlock.h>
 
 #include "details/Allocators.h"
+#include "details/BoundingVolumeHierarchy.h"
+#include "details/Culler.h"
+#include "details/DebugRegistry.h"
+#include "details/FramePacer.h"
 #include "details/Material.h"
 #include "details/Camera.h"
 #include "details/Froxelizer.h"
+#include "details/OcclusionCuller.h"
+#include "details/Scene.h"
+#include "RenderPass.h"
+#include "details/ShadowAtlas.h"
 #include "details/Engine.h"
 #include "components/TransformManager.h"
 #include "utils/RangeSet.h"
+#include <private/filament/SpirvCompression.h>
+#include <utils/JobSystem.h>
 
 using namespace filament;
 using namespace math;
@@ -144,6 +170,87 @@ TEST(FilamentTest, TransformManager) {
     EXPECT_EQ(tcm.getWorldTransform(child), mat4f{ float4{ 8 }});
 }
 
+TEST(FilamentTest, TransformManagerTransaction) {
+    JobSystem js;
+    js.adopt();
+
+    filament::details::FTransformManager tcm;
+    tcm.init(js);
+    EntityManager& em = EntityManager::get();
+    std::vector<Entity> entities(4096);
+    em.create(entities.size(), entities.data());
+
+    // A random tree, wide enough for its levels to be updated in parallel. Children are created
+    // before their parent, which the transaction must reorder.
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(-1.0f, 1.0f);
+    std::vector<size_t> parents(entities.size(), 0);
+    for (Entity e : entities) {
+        tcm.create(e);
+    }
+    for (size_t i = 1; i < entities.size(); i++) {
+        parents[i] = gen() % i;
+        tcm.setParent(tcm.getInstance(entities[i]), tcm.getInstance(entities[parents[i]]));
+    }
+
+    auto randomTransform = [&]() {
+        return mat4f::translate(float4{ rand(gen), rand(gen), rand(gen), 1.0f }) *
+               mat4f::rotate(rand(gen), normalize(float3{ rand(gen), rand(gen), 1.0f }));
+    };
+
+    // parents have a lower index than their children
+    auto check = [&]() {
+        std::vector<mat4f> world(entities.size());
+        size_t mismatches = 0;
+        for (size_t i = 0; i < entities.size(); i++) {
+            auto ti = tcm.getInstance(entities[i]);
+            world[i] = (i ? world[parents[i]] : mat4f{}) * tcm.getTransform(ti);
+            mismatches += tcm.getWorldTransform(ti) == world[i] ? 0 : 1;
+        }
+        return mismatches;
+    };
+
+    // all the transforms
+    tcm.openLocalTransformTransaction();
+    for (Entity e : entities) {
+        tcm.setTransform(tcm.getInstance(e), randomTransform());
+    }
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(check(), 0);
+
+    // a few subtrees, including the root's
+    tcm.openLocalTransformTransaction();
+    for (size_t i : { size_t(0), size_t(7), size_t(100), size_t(4000) }) {
+        tcm.setTransform(tcm.getInstance(entities[i]), randomTransform());
+    }
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(check(), 0);
+
+    // re-parenting during a transaction
+    tcm.openLocalTransformTransaction();
+    parents[4095] = 1;
+    tcm.setParent(tcm.getInstance(entities[4095]), tcm.getInstance(entities[1]));
+    tcm.setTransform(tcm.getInstance(entities[2]), randomTransform());
+    tcm.commitLocalTransformTransaction();
+    EXPECT_EQ(check(), 0);
+
+    // in bulk, which commits its own transaction
+    std::vector<TransformManager::Instance> instances;
+    std::vector<mat4f> locals;
+    for (size_t i = 0; i < entities.size(); i += 3) {
+        instances.push_back(tcm.getInstance(entities[i]));
+        locals.push_back(randomTransform());
+    }
+    tcm.setTransforms(instances.data(), locals.data(), instances.size());
+    EXPECT_EQ(check(), 0);
+
+    for (Entity e : entities) {
+        tcm.destroy(e);
+    }
+    em.destroy(entities.size(), entities.data());
+    js.emancipate();
+}
+
 TEST(FilamentTest, UniformInterfaceBlock) {
 
     UniformInterfaceBlock::Builder b;
@@ -328,6 +435,45 @@ TEST(FilamentTest, UniformBuffer) {
     //buffer.log(std::cout, ib);
 }
 
+TEST(FilamentTest, UniformBufferDirtyRange) {
+    // a new buffer is entirely dirty
+    UniformBuffer buffer(256);
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(0, buffer.getDirtyOffset());
+    EXPECT_EQ(256, buffer.getDirtySize());
+
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+
+    // the dirty range covers all the uniforms set since clean()
+    buffer.setUniform(64, 1.0f);
+    EXPECT_TRUE(buffer.isDirty());
+    EXPECT_EQ(64, buffer.getDirtyOffset());
+    EXPECT_EQ(4, buffer.getDirtySize());
+
+    buffer.setUniform(32, float4{ 1, 2, 3, 4 });
+    buffer.setUniform(128, mat3f{});
+    EXPECT_EQ(32, buffer.getDirtyOffset());
+    EXPECT_EQ(128 + 48 - 32, buffer.getDirtySize());
+
+    // copies (i.e. what's sent to the driver) keep the dirty range
+    UniformBuffer copy(buffer);
+    EXPECT_EQ(32, copy.getDirtyOffset());
+    EXPECT_EQ(128 + 48 - 32, copy.getDirtySize());
+
+    buffer.clean();
+    EXPECT_FALSE(buffer.isDirty());
+    EXPECT_TRUE(copy.isDirty());
+
+    UniformBuffer moved(std::move(copy));
+    EXPECT_EQ(32, moved.getDirtyOffset());
+    EXPECT_EQ(128 + 48 - 32, moved.getDirtySize());
+
+    buffer.invalidate();
+    EXPECT_EQ(0, buffer.getDirtyOffset());
+    EXPECT_EQ(256, buffer.getDirtySize());
+}
+
 TEST(FilamentTest, BoxCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -371,6 +517,64 @@ TEST(FilamentTest, BoxCulling) {
     EXPECT_TRUE( frustum.intersects( { 0, 200 }) );
 }
 
+TEST(FilamentTest, AffineRigidTransform) {
+    const mat4f m = mat4f::translate(float4{ 1, -2, 3, 1 }) *
+                    mat4f::rotate(0.7f, normalize(float3{ 1, 2, -3 })) *
+                    mat4f::scale(float4{ 2, 0.5f, 3, 1 });
+    const Box box = { { 1, 2, 3 }, { 0.5f, 4, 2 } };
+    const Box expected = rigidTransform(box, m);
+    const Box affine = rigidTransform(box, mat4x3f(m));
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_NEAR(expected.center[i], affine.center[i], 1e-5f);
+        EXPECT_NEAR(expected.halfExtent[i], affine.halfExtent[i], 1e-5f);
+    }
+
+    // the same, on arrays
+    const mat4x3f transform(m);
+    float3 center = box.center;
+    float3 extent = box.halfExtent;
+    transformAABBs(&transform, &center, &extent, &center, &extent, 1);
+    for (size_t i = 0; i < 3; i++) {
+        EXPECT_NEAR(center[i], affine.center[i], 1e-5f);
+        EXPECT_NEAR(extent[i], affine.halfExtent[i], 1e-5f);
+    }
+}
+
+TEST(FilamentTest, BoxCullingKernels) {
+    using filament::details::Culler;
+    Frustum frustum(mat4f::perspective(45.0f, 1.0f, 0.1f, 100.0f));
+
+    // boxes straddling the frustum's planes, some results bits are already set
+    constexpr size_t count = 256;
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> size(0.0f, 25.0f);
+    std::vector<float3> centers(count);
+    std::vector<float3> extents(count);
+    std::vector<Culler::result_type> initial(count);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = { rand(gen), rand(gen), rand(gen) };
+        extents[i] = { size(gen), size(gen), size(gen) };
+        initial[i] = Culler::result_type(gen() & 0xF5u);
+    }
+
+    std::vector<Culler::result_type> expected(initial);
+    Culler::Test::intersects(Culler::Test::Kernel::SCALAR,
+            expected.data(), frustum, centers.data(), extents.data(), count, 1);
+    EXPECT_NE(expected, initial);
+
+    for (auto kernel : { Culler::Test::Kernel::SSE2, Culler::Test::Kernel::AVX,
+                         Culler::Test::Kernel::NEON }) {
+        if (Culler::Test::isSupported(kernel)) {
+            std::vector<Culler::result_type> results(initial);
+            Culler::Test::intersects(kernel,
+                    results.data(), frustum, centers.data(), extents.data(), count, 1);
+            EXPECT_EQ(expected, results) << "kernel " << int(kernel);
+        }
+    }
+    EXPECT_TRUE(Culler::Test::isSupported(Culler::Test::getKernel()));
+}
+
 TEST(FilamentTest, SphereCulling) {
     Frustum frustum(mat4f::frustum(-1, 1, -1, 1, 1, 100));
 
@@ -408,6 +612,187 @@ TEST(FilamentTest, SphereCulling) {
     EXPECT_TRUE(frustum.intersects({ 0, 200 }));
 }
 
+TEST(FilamentTest, BoundingVolumeHierarchyCulling) {
+    using namespace filament::details;
+
+    Frustum frustum(mat4f::perspective(60, 1.0f, 0.1f, 50.0f) * mat4f::translate(float4{ 0, 0, 5, 1 }));
+
+    // a grid of small boxes around the frustum, some inside, some clipped, most outside
+    const size_t count = Culler::round(40 * 40 * 8);
+    std::vector<float3> centers(count);
+    std::vector<float3> extents(count);
+    for (size_t i = 0; i < count; i++) {
+        centers[i] = float3{ float(i % 40) - 20, float((i / 40) % 40) - 20, -float(i / 1600) * 8 };
+        extents[i] = float3{ 0.25f + (i % 3) * 0.25f };
+    }
+
+    std::vector<Culler::result_type> expected(count, 0);
+    Culler::Test::intersects(expected.data(), frustum, centers.data(), extents.data(), count);
+
+    // the boxes are in a different order in the arrays than in the BVH
+    std::vector<uint32_t> rows(count);
+    for (size_t i = 0; i < count; i++) {
+        rows[i] = uint32_t(count - 1 - i);
+    }
+    std::vector<float3> shuffledCenters(count);
+    std::vector<float3> shuffledExtents(count);
+    for (size_t i = 0; i < count; i++) {
+        shuffledCenters[rows[i]] = centers[i];
+        shuffledExtents[rows[i]] = extents[i];
+    }
+
+    JobSystem js;
+    js.adopt();
+
+    BoundingVolumeHierarchy bvh;
+    bvh.build(centers.data(), extents.data(), count);
+    EXPECT_EQ(count, bvh.getBoxCount());
+
+    std::vector<Culler::result_type> results(count, 0);
+    bvh.cull(js, frustum, shuffledCenters.data(), shuffledExtents.data(), rows.data(),
+            results.data(), 1);
+
+    size_t visibleCount = 0;
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(expected[i] ? 2 : 0, results[rows[i]]);
+        visibleCount += expected[i] ? 1 : 0;
+    }
+    EXPECT_GT(visibleCount, 0);
+    EXPECT_LT(visibleCount, count);
+
+    // move all boxes out of the frustum, the hierarchy must follow them
+    for (size_t i = 0; i < count; i++) {
+        centers[i].z += 1000;
+        shuffledCenters[rows[i]].z += 1000;
+    }
+    bvh.refit(centers.data(), extents.data());
+    std::fill(results.begin(), results.end(), 0);
+    bvh.cull(js, frustum, shuffledCenters.data(), shuffledExtents.data(), rows.data(),
+            results.data(), 1);
+    EXPECT_EQ(count, size_t(std::count(results.begin(), results.end(), 0)));
+
+    js.emancipate();
+}
+
+TEST(FilamentTest, OcclusionCulling) {
+    using namespace filament::details;
+
+    // camera at the origin looking down -z
+    OcclusionCuller culler;
+    culler.prepare(mat4f::perspective(90, 2.0f, 0.1f, 100.0f));
+
+    // a wall at z=-10
+    EXPECT_TRUE(culler.addOccluder({ 0, 0, -10 }, { 8, 4, 0.5f }));
+    // an occluder behind the camera can't be used
+    EXPECT_FALSE(culler.addOccluder({ 0, 0, 1 }, { 1, 1, 3 }));
+    culler.buildPyramid();
+
+    // behind the wall
+    EXPECT_TRUE(culler.isOccluded({ 0, 0, -20 }, { 1, 1, 1 }));
+    EXPECT_TRUE(culler.isOccluded({ 2, 1, -50 }, { 3, 1, 1 }));
+
+    // in front of the wall, or intersecting it
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -5 }, { 1, 1, 1 }));
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -11 }, { 1, 1, 1 }));
+
+    // behind the wall, but sticking out of it
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -20 }, { 1, 10, 1 }));
+    EXPECT_FALSE(culler.isOccluded({ 20, 0, -20 }, { 1, 1, 1 }));
+
+    // the wall itself isn't hidden
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, -10 }, { 8, 4, 0.5f }));
+
+    // crossing the camera plane
+    EXPECT_FALSE(culler.isOccluded({ 0, 0, 0 }, { 1, 1, 100 }));
+}
+
+TEST(FilamentTest, PotentiallyVisibleSet) {
+    // 2x1x1 cells over [0, 4]x[0, 1]x[0, 1], with 40 objects
+    const size_t size = PotentiallyVisibleSet::getSize(40, 2);
+    std::vector<uint32_t> data(size / sizeof(uint32_t), 0);
+    PotentiallyVisibleSet::Header header = {
+            PotentiallyVisibleSet::MAGIC, 40, { 2, 1, 1 }, { 0, 0, 0 }, { 4, 1, 1 } };
+    memcpy(data.data(), &header, sizeof(header));
+    uint32_t* bits = data.data() + sizeof(header) / sizeof(uint32_t);
+    bits[0] = 0x1;          // cell 0 sees object 0
+    bits[3] = 0x80;         // cell 1 sees object 39
+
+    PotentiallyVisibleSet pvs(data.data(), size);
+    EXPECT_TRUE(pvs.isValid());
+    EXPECT_EQ(40u, pvs.getObjectCount());
+    EXPECT_EQ(2u, pvs.getCellCount());
+
+    EXPECT_EQ(0u, pvs.getCellAt({ 1, 0.5f, 0.5f }));
+    EXPECT_EQ(1u, pvs.getCellAt({ 3, 0.5f, 0.5f }));
+    EXPECT_EQ(1u, pvs.getCellAt({ 4, 1, 1 }));
+    EXPECT_EQ(PotentiallyVisibleSet::NO_CELL, pvs.getCellAt({ -1, 0.5f, 0.5f }));
+    EXPECT_EQ(PotentiallyVisibleSet::NO_CELL, pvs.getCellAt({ 1, 2, 0.5f }));
+
+    EXPECT_TRUE(pvs.isVisible(0, 0));
+    EXPECT_FALSE(pvs.isVisible(0, 39));
+    EXPECT_FALSE(pvs.isVisible(1, 0));
+    EXPECT_TRUE(pvs.isVisible(1, 39));
+
+    // truncated or not a set
+    EXPECT_FALSE(PotentiallyVisibleSet(data.data(), size - 4).isValid());
+    data[0] = 0;
+    EXPECT_FALSE(PotentiallyVisibleSet(data.data(), size).isValid());
+}
+
+TEST(FilamentTest, SmallFeatureCulling) {
+    using namespace filament::details;
+
+    // perspective camera looking down -z, with 2 pixels per unit at w = 1
+    const float4 w{ 0, 0, -1, 0 };
+    const float scale = 2.0f;
+
+    float3 centers[Culler::MODULO] = {
+            { 0, 0, -10 }, { 0, 0, -10 }, { 0, 0, -100 }, { 0, 0, 0 }, { 0, 0, 5 } };
+    float3 extents[Culler::MODULO] = {
+            { 1, 0, 0 },   { 4, 0, 0 },   { 4, 0, 0 },    { 0.01f, 0, 0 }, { 10, 0, 0 } };
+    Culler::result_type results[Culler::MODULO] = { 0x1 };
+
+    Culler::largerThan(results, w, scale, 1.5f, centers, extents, Culler::MODULO, 2);
+
+    EXPECT_EQ(0x1, results[0]);     // 0.4 pixels
+    EXPECT_EQ(0x4, results[1]);     // 1.6 pixels
+    EXPECT_EQ(0x0, results[2]);     // 0.16 pixels
+    EXPECT_EQ(0x4, results[3]);     // contains the camera
+    EXPECT_EQ(0x4, results[4]);     // contains the camera, behind it
+}
+
+TEST(FilamentTest, SortCommands) {
+    using namespace filament;
+    using namespace filament::details;
+
+    JobSystem js;
+    js.adopt();
+
+    LinearAllocatorArena arena("sort", 4 * 1024 * 1024);
+    filament::details::ArenaScope scope(arena);
+
+    // enough commands for the radix sort, whose keys only differ in some of the digits
+    const size_t count = 20000;
+    std::default_random_engine generator(82828);
+    std::uniform_int_distribution<uint32_t> distribution(0, 4095);
+    std::vector<RenderPass::Command> commands(count);
+    for (size_t i = 0; i < count; i++) {
+        const uint64_t r = distribution(generator);
+        commands[i].key = (r & 0xFF) | ((r >> 8) << 40) | (uint64_t(1) << 62);
+        commands[i].primitive.index = uint32_t(i);
+    }
+    std::vector<RenderPass::Command> expected(commands);
+    std::stable_sort(expected.begin(), expected.end());
+
+    RenderPass::sortCommands(js, scope, commands.data(), commands.data() + count);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(expected[i].key, commands[i].key);
+        EXPECT_EQ(expected[i].primitive.index, commands[i].primitive.index);
+    }
+
+    js.emancipate();
+}
+
 TEST(FilamentTest, ColorConversion) {
     // Linear to Gamma
     // 0.0 stays 0.0
@@ -517,11 +902,14 @@ TEST(FilamentTest, FroxelData) {
     LightManager::Instance instance = engine->getLightManager().getInstance(e);
 
     FScene::LightSoa lights;
-    lights.push_back({}, {}, {}, {});   // first one is always skipped
-    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1);
+    lights.push_back({}, {}, {}, {}, {}, {}, {}, {});   // first one is always skipped
+    lights.push_back(float4{ 0, 0, -5, 1 }, {}, instance, 1, FScene::NO_SHADOW,
+            FScene::LIGHT_CASTER, 0.0f, 1.0f);
 
     {
-        froxelData.froxelizeLights(*engine, {}, lights);
+        EXPECT_TRUE(froxelData.froxelizeLights(*engine, {}, lights));
+        // nothing changed, the froxels are reused
+        EXPECT_FALSE(froxelData.froxelizeLights(*engine, {}, lights));
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
         // light straddles the "light near" plane
@@ -541,7 +929,7 @@ TEST(FilamentTest, FroxelData) {
         auto pos = lights.elementAt<FScene::POSITION_RADIUS>(1);
         EXPECT_TRUE(pos == float4( 0, 0, -3, 1 ));
 
-        froxelData.froxelizeLights(*engine, {}, lights);
+        EXPECT_TRUE(froxelData.froxelizeLights(*engine, {}, lights));
         auto const& froxelBuffer = froxelData.getFroxelBufferUser();
         auto const& recordBuffer = froxelData.getRecordBufferUser();
         size_t pointCount = 0;
@@ -551,6 +939,11 @@ TEST(FilamentTest, FroxelData) {
             pointCount += entry.pointLightCount;
         }
         EXPECT_GT(pointCount, 0);
+
+        // each froxel containing the light uses one record
+        EXPECT_GT(froxelData.getRecordBufferUsedSize(), 0);
+        EXPECT_LE(froxelData.getRecordBufferUsedSize(), pointCount * sizeof(recordBuffer[0]));
+        EXPECT_LE(froxelData.getRecordBufferUsedSize(), Froxelizer::getRecordBufferSize());
     }
 
     froxelData.terminate(engine->getDriverApi());
@@ -558,6 +951,488 @@ TEST(FilamentTest, FroxelData) {
     delete engine;
 }
 
+TEST(FilamentTest, MemoryStats) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+
+    Engine::MemoryStats before = engine->getMemoryStats();
+    EXPECT_EQ(before.perRenderPassArena, engine->getConfig().perRenderPassArenaSize);
+    EXPECT_GT(before.commandBuffer, 0);
+    EXPECT_GT(before.componentManagers, 0);
+    EXPECT_GE(before.jobScratch, engine->getConfig().perThreadScratchSize);
+
+    Texture* texture = Texture::Builder()
+            .width(64).height(32).levels(2)
+            .format(Texture::InternalFormat::RGBA8)
+            .build(*engine);
+    IndexBuffer* indexBuffer = IndexBuffer::Builder()
+            .indexCount(300).bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    VertexBuffer* vertexBuffer = VertexBuffer::Builder()
+            .vertexCount(100).bufferCount(2)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .attribute(VertexAttribute::UV0, 1, VertexBuffer::AttributeType::HALF2, 0, 8)
+            .build(*engine);
+    View* view = api.createView();
+
+    Engine::MemoryStats after = engine->getMemoryStats();
+    EXPECT_EQ(after.textures - before.textures, (64 * 32 + 32 * 16) * 4);
+    EXPECT_EQ(after.indexBuffers - before.indexBuffers, 300 * 2);
+    EXPECT_EQ(after.vertexBuffers - before.vertexBuffers, 100 * 12 + 100 * 8);
+    EXPECT_GT(after.froxelizers, before.froxelizers);
+    EXPECT_GT(after.froxelBuffers, before.froxelBuffers);
+
+    api.destroy(view);
+    api.destroy(vertexBuffer);
+    api.destroy(indexBuffer);
+    api.destroy(texture);
+
+    Engine::MemoryStats end = engine->getMemoryStats();
+    EXPECT_EQ(end.textures, before.textures);
+    EXPECT_EQ(end.indexBuffers, before.indexBuffers);
+    EXPECT_EQ(end.vertexBuffers, before.vertexBuffers);
+    EXPECT_EQ(end.froxelizers, before.froxelizers);
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, TextureArray) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine::MemoryStats before = engine->getMemoryStats();
+
+    Texture* texture = Texture::Builder()
+            .width(16).height(16).depth(4).levels(3)
+            .sampler(Texture::Sampler::SAMPLER_2D_ARRAY)
+            .format(Texture::InternalFormat::RGBA8)
+            .build(*engine);
+
+    // the layers are not reduced by the mipmap levels
+    EXPECT_EQ(texture->getDepth(0), 4);
+    EXPECT_EQ(texture->getDepth(2), 4);
+    EXPECT_EQ(texture->getWidth(2), 4);
+
+    Engine::MemoryStats after = engine->getMemoryStats();
+    EXPECT_EQ(after.textures - before.textures, (16 * 16 + 8 * 8 + 4 * 4) * 4 * 4);
+
+    Engine& api = *engine;
+    api.destroy(texture);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, TextureStreaming) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine::MemoryStats before = engine->getMemoryStats();
+
+    std::vector<size_t> loaded;
+    Texture* texture = Texture::Builder()
+            .width(256).height(256).levels(9)
+            .format(Texture::InternalFormat::RGBA8)
+            .streaming([](Engine&, Texture*, size_t level, void* user) {
+                static_cast<std::vector<size_t>*>(user)->push_back(level);
+            }, &loaded)
+            .build(*engine);
+
+    // only the coarse levels are loaded, or all of them if the backend can't stream
+    const size_t resident = texture->getResidentLevel();
+    EXPECT_TRUE(resident == 0 || resident == 2);
+    ASSERT_EQ(loaded.size(), 9 - resident);
+    EXPECT_EQ(loaded.front(), resident);
+    EXPECT_EQ(loaded.back(), 8);
+
+    size_t size = 0;
+    for (size_t level = resident; level < 9; level++) {
+        size += texture->getWidth(level) * texture->getHeight(level) * 4;
+    }
+    Engine::MemoryStats after = engine->getMemoryStats();
+    EXPECT_EQ(after.textures - before.textures, size);
+
+    Engine& api = *engine;
+    api.destroy(texture);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, BulkRenderables) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+    RenderableManager& rcm = api.getRenderableManager();
+    EntityManager& em = EntityManager::get();
+
+    IndexBuffer* indexBuffer = IndexBuffer::Builder()
+            .indexCount(3).bufferType(IndexBuffer::IndexType::USHORT)
+            .build(*engine);
+    VertexBuffer* vertexBuffer = VertexBuffer::Builder()
+            .vertexCount(3).bufferCount(1)
+            .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+            .build(*engine);
+
+    // the last entity appears twice, it keeps the component it got last
+    Entity entities[6];
+    em.create(5, entities);
+    entities[5] = entities[4];
+
+    RenderableManager::Builder builder(2);
+    builder.boundingBox({ {}, { 1, 1, 1 } })
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vertexBuffer, indexBuffer)
+            .geometry(1, RenderableManager::PrimitiveType::TRIANGLES, vertexBuffer, indexBuffer);
+    EXPECT_EQ(RenderableManager::Builder::Success, builder.build(api, entities, 6));
+
+    for (Entity e : entities) {
+        auto ri = rcm.getInstance(e);
+        EXPECT_TRUE(ri);
+        EXPECT_EQ(2, rcm.getPrimitiveCount(ri));
+        EXPECT_TRUE(api.getTransformManager().hasComponent(e));
+    }
+
+    // components built together can also be rebuilt and destroyed separately
+    EXPECT_EQ(RenderableManager::Builder::Success, builder.build(api, entities[1]));
+    rcm.destroy(entities[0]);
+    EXPECT_FALSE(rcm.hasComponent(entities[0]));
+    EXPECT_TRUE(rcm.hasComponent(entities[1]));
+    for (Entity e : entities) {
+        rcm.destroy(e);
+    }
+
+    api.destroy(vertexBuffer);
+    api.destroy(indexBuffer);
+    em.destroy(5, entities);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, WorkerThreadResources) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+    EntityManager& em = EntityManager::get();
+
+    IndexBuffer* indexBuffer = nullptr;
+    VertexBuffer* vertexBuffer = nullptr;
+    Texture* texture = nullptr;
+    std::thread worker([&]() {
+        static const uint16_t indices[3] = { 0, 1, 2 };
+        indexBuffer = IndexBuffer::Builder()
+                .indexCount(3).bufferType(IndexBuffer::IndexType::USHORT)
+                .build(api);
+        indexBuffer->setBuffer(api, { indices, sizeof(indices) });
+        vertexBuffer = VertexBuffer::Builder()
+                .vertexCount(3).bufferCount(1)
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .build(api);
+        texture = Texture::Builder().width(4).height(4).build(api);
+    });
+    worker.join();
+
+    // the objects are only registered with the engine by the next flush
+    EXPECT_EQ(0, api.getMemoryStats().vertexBuffers);
+    api.flush();
+    EXPECT_LT(0, api.getMemoryStats().vertexBuffers);
+    EXPECT_LT(0, api.getMemoryStats().textures);
+
+    Entity entity = em.create();
+    EXPECT_EQ(RenderableManager::Builder::Success, RenderableManager::Builder(1)
+            .boundingBox({ {}, { 1, 1, 1 } })
+            .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vertexBuffer, indexBuffer)
+            .build(api, entity));
+    api.getRenderableManager().destroy(entity);
+
+    // objects created on another thread and never flushed are destroyed with the engine
+    std::thread([&]() {
+        Texture::Builder().width(4).height(4).build(api);
+    }).join();
+
+    api.destroy(texture);
+    api.destroy(vertexBuffer);
+    api.destroy(indexBuffer);
+    em.destroy(entity);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, FenceCallback) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+
+    struct State {
+        Engine* engine;
+        size_t count = 0;
+        Fence::FenceStatus status = Fence::FenceStatus::TIMEOUT_EXPIRED;
+    } state{ &api };
+
+    Fence::Callback callback = [](Fence* fence, Fence::FenceStatus status, void* user) {
+        State* state = static_cast<State*>(user);
+        state->count++;
+        state->status = status;
+        state->engine->destroy(fence);
+    };
+    Fence* fence = api.createFence(Fence::Type::SOFT, callback, &state);
+
+    // a fence that's destroyed before it signals never calls its callback
+    api.destroy(api.createFence(Fence::Type::SOFT, callback, &state));
+
+    // the internal flushes, like the one done by wait(), don't call the callbacks
+    EXPECT_EQ(Fence::FenceStatus::CONDITION_SATISFIED,
+            fence->wait(Fence::Mode::FLUSH, Fence::FENCE_WAIT_FOR_EVER));
+    engine->flush();
+    EXPECT_EQ(0, state.count);
+
+    // the public flush polls the fence
+    api.flush();
+    api.flush();
+    EXPECT_EQ(1, state.count);
+    EXPECT_EQ(Fence::FenceStatus::CONDITION_SATISFIED, state.status);
+
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, DeferredDestruction) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+
+    const size_t textureCount = api.getMemoryStats().textures;
+    std::vector<Texture*> textures;
+    for (size_t i = 0; i < 8; i++) {
+        textures.push_back(Texture::Builder().width(4).height(4).build(api));
+    }
+    textures.push_back(nullptr);
+    api.destroy(textures.data(), textures.size());
+    EXPECT_EQ(textureCount, api.getMemoryStats().textures);
+
+    Material const* material = api.getDefaultMaterial();
+    for (size_t i = 0; i < 8; i++) {
+        api.destroyDeferred(material->createInstance());
+        api.destroyDeferred(Texture::Builder().width(4).height(4).build(api));
+    }
+    EXPECT_EQ(16, api.getDeferredDestructionCount());
+    EXPECT_LT(textureCount, api.getMemoryStats().textures);
+
+    // without a time budget, the queue is emptied at once
+    engine->processDeferredDestructions(false);
+    EXPECT_EQ(0, api.getDeferredDestructionCount());
+    EXPECT_EQ(textureCount, api.getMemoryStats().textures);
+
+    // the objects still queued are destroyed with the engine
+    api.destroyDeferred(material->createInstance());
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, SceneGroups) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    Engine& api = *engine;
+    EntityManager& em = EntityManager::get();
+
+    Entity entities[3];
+    em.create(3, entities);
+    for (Entity e : entities) {
+        LightManager::Builder(LightManager::Type::POINT).build(api, e);
+    }
+
+    Scene* scene = api.createScene();
+    scene->addEntity(entities[0]);
+    Scene::GroupId group = scene->createGroup({{ 1, 2, 3 }, { 4, 5, 6 }});
+    scene->addToGroup(group, entities + 1, 2);
+    EXPECT_EQ(2, scene->getGroupEntityCount(group));
+    EXPECT_EQ(3, scene->getLightCount());
+    EXPECT_EQ(float3(4, 5, 6), scene->getGroupBounds(group).halfExtent);
+
+    // hiding the group changes the scene's version once, whatever its size
+    uint32_t version = upcast(scene)->getVersion();
+    scene->setGroupVisible(group, false);
+    EXPECT_FALSE(scene->isGroupVisible(group));
+    EXPECT_EQ(1, scene->getLightCount());
+    EXPECT_EQ(version + 1, upcast(scene)->getVersion());
+    scene->setGroupVisible(group, false);
+    EXPECT_EQ(version + 1, upcast(scene)->getVersion());
+    scene->setGroupVisible(group, true);
+    EXPECT_EQ(3, scene->getLightCount());
+
+    // the slot of a removed group is reused, empty
+    scene->removeGroup(group);
+    EXPECT_EQ(1, scene->getLightCount());
+    EXPECT_EQ(0, scene->getGroupEntityCount(group));
+    Scene::GroupId other = scene->createGroup();
+    EXPECT_EQ(group, other);
+    EXPECT_EQ(0, scene->getGroupEntityCount(other));
+    EXPECT_TRUE(scene->isGroupVisible(other));
+
+    api.destroy(scene);
+    for (Entity e : entities) {
+        api.getLightManager().destroy(e);
+    }
+    em.destroy(3, entities);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, BonePalette) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FEngine* engine = FEngine::create();
+    FRenderableManager& rcm = engine->getRenderableManager();
+    EntityManager& em = EntityManager::get();
+
+    // skeletons of 1, 600 (clamped to the maximum) and 40 bones
+    Entity entities[3];
+    em.create(3, entities);
+    const size_t boneCounts[3] = { 1, 600, 40 };
+    for (size_t i = 0; i < 3; i++) {
+        RenderableManager::Builder(0).culling(false).skinning(boneCounts[i])
+                .build(*engine, entities[i]);
+    }
+    EXPECT_TRUE(rcm.getBonePaletteUbh());
+
+    const size_t alignment = FEngine::CONFIG_PER_RENDERABLE_UNIFORMS_STRIDE;
+    uint32_t offsets[3];
+    for (size_t i = 0; i < 3; i++) {
+        auto ri = rcm.getInstance(entities[i]);
+        EXPECT_TRUE(rcm.getVisibility(ri).skinning);
+        offsets[i] = rcm.getBonesOffset(ri);
+        EXPECT_EQ(0, offsets[i] % alignment);
+    }
+    // the ranges are allocated one after the other
+    EXPECT_EQ(0, offsets[0]);
+    EXPECT_EQ(alignment, offsets[1]);
+    EXPECT_EQ(alignment + CONFIG_MAX_BONE_COUNT * sizeof(RenderableManager::Bone), offsets[2]);
+
+    // a freed range is reused by a skeleton that fits
+    rcm.destroy(entities[0]);
+    RenderableManager::Builder(0).culling(false).skinning(8).build(*engine, entities[0]);
+    EXPECT_EQ(0, rcm.getBonesOffset(rcm.getInstance(entities[0])));
+
+    // rebuilding without skinning gives the bones back
+    RenderableManager::Builder(0).culling(false).build(*engine, entities[2]);
+    EXPECT_FALSE(rcm.getVisibility(rcm.getInstance(entities[2])).skinning);
+    RenderableManager::Builder(0).culling(false).skinning(4).build(*engine, entities[2]);
+    EXPECT_EQ(offsets[2], rcm.getBonesOffset(rcm.getInstance(entities[2])));
+
+    for (Entity e : entities) {
+        rcm.destroy(e);
+    }
+    em.destroy(3, entities);
+    engine->shutdown();
+    delete engine;
+}
+
+TEST(FilamentTest, FroxelRowRange) {
+    using namespace filament::details;
+
+    // vertical planes of the form {x, 0, z, 0}, like the froxelizer's, fanning out of the origin
+    constexpr size_t COUNT = 32;
+    float4 planes[COUNT + 1];
+    for (size_t i = 0; i <= COUNT; i++) {
+        const float a = float(M_PI) * (0.25f + 0.5f * i / COUNT);
+        planes[i] = { std::cos(a), 0, std::sin(a), 0 };
+    }
+
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> position(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> radius(0.01f, 10.0f);
+    std::uniform_int_distribution<size_t> index(0, COUNT - 1);
+    for (size_t i = 0; i < 10000; i++) {
+        const float r = radius(gen);
+        const float4 circle{ position(gen), position(gen), -std::abs(position(gen)), r * r };
+        size_t x0 = index(gen);
+        size_t x1 = index(gen) + 1;
+        if (x0 >= x1) {
+            std::swap(x0, x1);
+            x1++;
+        }
+        const size_t xcenter = index(gen);
+        auto expected = Froxelizer::Test::findRowRange(planes, circle, x0, xcenter, x1);
+        auto actual = Froxelizer::findRowRange(planes, circle, x0, xcenter, x1);
+        EXPECT_EQ(expected.first, actual.first);
+        EXPECT_EQ(expected.second, actual.second);
+    }
+}
+
+TEST(FilamentTest, ShadowAtlasPacking) {
+    using namespace filament::details;
+    using Tile = ShadowAtlas::Tile;
+
+    auto overlap = [](Tile const& a, Tile const& b) {
+        return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+    };
+
+    auto check = [&overlap](uint32_t atlasSize, Tile const* tiles, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            if (!tiles[i].size) continue;
+            EXPECT_LE(tiles[i].x + tiles[i].size, atlasSize);
+            EXPECT_LE(tiles[i].y + tiles[i].size, atlasSize);
+            // tiles are aligned to their size
+            EXPECT_EQ(0, tiles[i].x % tiles[i].size);
+            EXPECT_EQ(0, tiles[i].y % tiles[i].size);
+            for (size_t j = i + 1; j < count; j++) {
+                if (tiles[j].size) {
+                    EXPECT_FALSE(overlap(tiles[i], tiles[j]));
+                }
+            }
+        }
+    };
+
+    // tiles that fit are left alone
+    uint32_t sizes[8] = { 512, 1024, 256, 512 };
+    Tile tiles[8];
+    EXPECT_EQ(4, ShadowAtlas::pack(2048, 64, sizes, tiles, 4));
+    EXPECT_EQ(512, sizes[0]);
+    EXPECT_EQ(1024, sizes[1]);
+    EXPECT_EQ(256, sizes[2]);
+    EXPECT_EQ(512, sizes[3]);
+    check(2048, tiles, 4);
+
+    // the largest tiles are halved until they all fit
+    std::fill_n(sizes, 8, 1024);
+    EXPECT_EQ(8, ShadowAtlas::pack(2048, 64, sizes, tiles, 8));
+    EXPECT_EQ(2, std::count(sizes, sizes + 8, 1024));
+    EXPECT_EQ(6, std::count(sizes, sizes + 8, 512));
+    check(2048, tiles, 8);
+
+    // tiles that can't fit at the minimum size are dropped
+    std::fill_n(sizes, 8, 128);
+    EXPECT_EQ(4, ShadowAtlas::pack(128, 64, sizes, tiles, 8));
+    EXPECT_EQ(4, std::count(sizes, sizes + 8, 64));
+    EXPECT_EQ(4, std::count(sizes, sizes + 8, 0));
+    check(128, tiles, 8);
+
+    // random sizes
+    std::mt19937 gen;
+    std::uniform_int_distribution<uint32_t> size(6, 10);
+    for (size_t n = 0; n < 1000; n++) {
+        for (uint32_t& s : sizes) {
+            s = 1u << size(gen);
+        }
+        EXPECT_EQ(8, ShadowAtlas::pack(2048, 64, sizes, tiles, 8));
+        check(2048, tiles, 8);
+    }
+}
+
 TEST(FilamentTest, RangeSet) {
 
     utils::RangeSet<4> rs;
@@ -806,6 +1681,252 @@ TEST(FilamentTest, RangeSet) {
     EXPECT_EQ(250, b[2].end);
 }
 
+TEST(FilamentTest, CommandBufferQueue) {
+    // small buffer, so that the producer has to wait for the consumer often
+    constexpr size_t requiredSize = CircularBuffer::BLOCK_SIZE;
+    constexpr uint32_t count = 20000;
+    CommandBufferQueue queue(requiredSize, requiredSize * 4);
+
+    std::thread consumer([&queue]() {
+        uint32_t expected = 0;
+        while (expected < count) {
+            auto slices = queue.waitForCommands();
+            EXPECT_NE(0, slices.size());
+            for (auto& slice : slices) {
+                // the slices come in order, and each one is intact
+                uint32_t const* data = static_cast<uint32_t const*>(slice.begin);
+                EXPECT_EQ(expected, data[0]);
+                EXPECT_EQ(expected, data[1 + expected % 64]);
+                queue.releaseBuffer(slice);
+                expected++;
+            }
+        }
+    });
+
+    CircularBuffer& buffer = queue.getCircularBuffer();
+    for (uint32_t i = 0; i < count; i++) {
+        // slices of various sizes, up to almost the required size
+        const size_t size = (i % 7 == 0) ? requiredSize / 2 : sizeof(uint32_t) * (2 + i % 64);
+        uint32_t* data = static_cast<uint32_t*>(buffer.allocate(size));
+        data[0] = i;
+        data[1 + i % 64] = i;
+        queue.flush();
+    }
+
+    consumer.join();
+    queue.requestExit();
+    EXPECT_EQ(0, queue.waitForCommands().size());
+}
+
+TEST(FilamentTest, CommandBufferQueueGrow) {
+    constexpr size_t requiredSize = CircularBuffer::BLOCK_SIZE;
+    CommandBufferQueue queue(requiredSize, requiredSize * 4, requiredSize * 16);
+    CircularBuffer& buffer = queue.getCircularBuffer();
+
+    // records 'count' slices of about requiredSize bytes, without consuming them
+    uint32_t recorded = 0;
+    uint32_t consumed = 0;
+    auto record = [&](uint32_t count) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t* data = static_cast<uint32_t*>(buffer.allocate(requiredSize - 64));
+            data[0] = recorded++;
+            queue.flush();
+        }
+    };
+    auto consume = [&](uint32_t count) {
+        auto slices = queue.waitForCommands();
+        EXPECT_EQ(count, slices.size());
+        for (auto& slice : slices) {
+            EXPECT_EQ(consumed++, static_cast<uint32_t const*>(slice.begin)[0]);
+            queue.releaseBuffer(slice);
+        }
+    };
+
+    // not enough to grow
+    record(2);
+    EXPECT_FALSE(queue.growIfNeeded());
+    consume(2);
+
+    // the slices in flight (in the previous memory) stay valid after growing
+    record(3);
+    EXPECT_TRUE(queue.growIfNeeded());
+    EXPECT_EQ(requiredSize * 8, queue.getStats().capacity);
+    record(1);
+    consume(4);
+    EXPECT_FALSE(queue.growIfNeeded());
+
+    // up to the maximum size
+    record(7);
+    EXPECT_TRUE(queue.growIfNeeded());
+    consume(7);
+    record(15);
+    EXPECT_FALSE(queue.growIfNeeded());
+    consume(15);
+
+    CommandBufferQueue::Stats stats = queue.getStats();
+    EXPECT_EQ(requiredSize * 16, stats.capacity);
+    EXPECT_EQ(2, stats.growCount);
+    EXPECT_EQ(0, stats.blockCount);
+    EXPECT_LE(requiredSize * 14, stats.highWatermark);
+}
+
+TEST(FilamentTest, CommandTimings) {
+    EXPECT_STREQ("draw", CommandTimings::getName(CommandTimings::draw));
+    EXPECT_STREQ("endFrame", CommandTimings::getName(CommandTimings::endFrame));
+
+    CommandTimings timings;
+    CommandTimings::Entry entries[CommandTimings::COUNT];
+    EXPECT_EQ(0, timings.getLastFrame(entries));
+
+    const auto start = CommandTimings::clock::now();
+    timings.record(CommandTimings::draw, start);
+    timings.record(CommandTimings::draw, start);
+    timings.record(CommandTimings::endFrame, start);
+
+    // nothing is visible until the frame is published
+    EXPECT_EQ(0, timings.getLastFrame(entries));
+    EXPECT_EQ(0, entries[CommandTimings::draw].count);
+
+    timings.publishFrame();
+    EXPECT_EQ(1, timings.getLastFrame(entries));
+    EXPECT_EQ(2, entries[CommandTimings::draw].count);
+    EXPECT_EQ(1, entries[CommandTimings::endFrame].count);
+    EXPECT_EQ(0, entries[CommandTimings::beginFrame].count);
+
+    // the next frame starts from scratch
+    timings.record(CommandTimings::beginFrame, start);
+    timings.publishFrame();
+    EXPECT_EQ(2, timings.getLastFrame(entries));
+    EXPECT_EQ(0, entries[CommandTimings::draw].count);
+    EXPECT_EQ(1, entries[CommandTimings::beginFrame].count);
+}
+
+TEST(FilamentTest, SpirvCompression) {
+    // a module shaped like SPIR-V: a header, then instructions with small ids and literals
+    std::mt19937 gen(1234);
+    std::vector<uint32_t> module = { 0x07230203, 0x00010000, 0x00080001, 512, 0 };
+    while (module.size() < 4096) {
+        const uint32_t count = std::uniform_int_distribution<uint32_t>(1, 6)(gen);
+        const uint32_t opcode = std::uniform_int_distribution<uint32_t>(1, 400)(gen);
+        module.push_back((count << 16u) | opcode);
+        for (uint32_t i = 1; i < count; i++) {
+            module.push_back(std::uniform_int_distribution<uint32_t>(1, 512)(gen));
+        }
+    }
+    module.push_back(0x3f800000);   // a float literal doesn't compress, but must round-trip
+
+    std::vector<uint8_t> compressed;
+    SpirvCompressor::compress(module.data(), module.size(), compressed);
+    EXPECT_LT(compressed.size(), module.size() * sizeof(uint32_t) * 2 / 3);
+    ASSERT_EQ(module.size(), SpirvCompressor::getWordCount(compressed.data(), compressed.size()));
+
+    std::vector<uint32_t> words(module.size());
+    EXPECT_TRUE(SpirvCompressor::decompress(compressed.data(), compressed.size(), words.data()));
+    EXPECT_EQ(module, words);
+
+    // arbitrary words, including instructions whose word count overflows the module
+    std::vector<uint32_t> garbage(257);
+    for (uint32_t& word : garbage) {
+        word = gen();
+    }
+    compressed.clear();
+    SpirvCompressor::compress(garbage.data(), garbage.size(), compressed);
+    ASSERT_EQ(garbage.size(), SpirvCompressor::getWordCount(compressed.data(), compressed.size()));
+    words.resize(garbage.size());
+    EXPECT_TRUE(SpirvCompressor::decompress(compressed.data(), compressed.size(), words.data()));
+    EXPECT_EQ(garbage, words);
+
+    // a truncated blob is rejected
+    EXPECT_FALSE(SpirvCompressor::decompress(compressed.data(), compressed.size() - 1,
+            words.data()));
+    EXPECT_EQ(0, SpirvCompressor::getWordCount(compressed.data(), 0));
+
+    // an empty module
+    compressed.clear();
+    SpirvCompressor::compress(nullptr, 0, compressed);
+    EXPECT_EQ(0, SpirvCompressor::getWordCount(compressed.data(), compressed.size()));
+}
+
+TEST(FilamentTest, ProgramSpecializationConstants) {
+    Program program;
+    EXPECT_EQ(program.getSpecializationConstantMask(), 0u);
+
+    program.specializationConstant(SpecializationConstants::SHADOW_SAMPLING_METHOD,
+            int32_t(ShadowSamplingMethod::PCF_HIGH));
+    EXPECT_EQ(program.getSpecializationConstantMask(),
+            1u << SpecializationConstants::SHADOW_SAMPLING_METHOD);
+    EXPECT_EQ(program.getSpecializationConstants()[SpecializationConstants::SHADOW_SAMPLING_METHOD],
+            int32_t(ShadowSamplingMethod::PCF_HIGH));
+
+    // the values follow the program
+    Program moved(std::move(program));
+    EXPECT_EQ(moved.getSpecializationConstantMask(),
+            1u << SpecializationConstants::SHADOW_SAMPLING_METHOD);
+    EXPECT_EQ(moved.getSpecializationConstants()[SpecializationConstants::SHADOW_SAMPLING_METHOD],
+            int32_t(ShadowSamplingMethod::PCF_HIGH));
+}
+
+TEST(FilamentTest, DebugRegistryCounters) {
+    using namespace filament;
+    using namespace filament::details;
+
+    FDebugRegistry registry;
+    bool tunable = false;
+    int draws = 12;
+    math::float3 rates = { 1.5f, 0.25f, 0.125f };
+    registry.registerProperty("d.test.tunable", &tunable);
+    registry.registerCounter("d.test.draws", &draws);
+    registry.registerCounter("d.test.rates", &rates);
+    DebugRegistry& api = registry;
+
+    auto properties = api.getProperties();
+    ASSERT_EQ(properties.second, 3);
+    EXPECT_EQ(properties.first[0].kind, DebugRegistry::TUNABLE);
+    EXPECT_EQ(properties.first[1].kind, DebugRegistry::COUNTER);
+    EXPECT_EQ(properties.first[1].type, DebugRegistry::INT);
+    EXPECT_EQ(properties.first[2].type, DebugRegistry::FLOAT3);
+
+    // counters are read-only, even in debug builds
+    EXPECT_FALSE(api.setProperty("d.test.draws", 3));
+    EXPECT_EQ(draws, 12);
+
+    EXPECT_EQ(api.getCounters(nullptr, 0), 2);
+    DebugRegistry::CounterValue values[2];
+    draws = 34;
+    EXPECT_EQ(api.getCounters(values, 2), 2);
+    EXPECT_STREQ(values[0].name, "d.test.draws");
+    EXPECT_EQ(values[0].value, math::float4(34, 0, 0, 0));
+    EXPECT_STREQ(values[1].name, "d.test.rates");
+    EXPECT_EQ(values[1].value, math::float4(1.5f, 0.25f, 0.125f, 0));
+}
+
+TEST(FilamentTest, FramePacer) {
+    filament::details::FramePacer pacer;
+    pacer.setDisplayInfo(50.0f, 0, 1000000);    // a 20 ms period, the app's vsync 1 ms late
+    EXPECT_EQ(pacer.getInterval(), 1);
+    EXPECT_EQ(pacer.getPresentationTime(101000000), 110000000);
+
+    // frames that take longer than a period are presented two periods after their vsync
+    for (size_t i = 0; i < 10; i++) {
+        pacer.update(25e6);
+    }
+    EXPECT_EQ(pacer.getInterval(), 2);
+    EXPECT_EQ(pacer.getPresentationTime(101000000), 130000000);
+
+    // the interval only goes back down once the frames have been fast for a while
+    for (size_t i = 0; i < 20; i++) {
+        pacer.update(5e6);
+    }
+    EXPECT_EQ(pacer.getInterval(), 2);
+    for (size_t i = 0; i < 100; i++) {
+        pacer.update(5e6);
+    }
+    EXPECT_EQ(pacer.getInterval(), 1);
+
+    // a single slow frame is enough to go up
+    pacer.update(60e6);
+    EXPECT_GT(pacer.getInterval(), 1);
+}
 
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
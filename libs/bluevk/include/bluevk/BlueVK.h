@@ -45,6 +45,13 @@ namespace bluevk {
 
     void bindInstance(VkInstance instance);
 
+    // Reloads the device-level entry points from vkGetDeviceProcAddr, so that they dispatch
+    // directly to the driver of the given device rather than through the loader trampolines.
+    // Must be called after bindInstance(). The entry points are global, so BlueVK can only be
+    // bound to a single device at a time; the functions of extensions that the device doesn't
+    // enable are null after this call.
+    void bindDevice(VkDevice device);
+
 }; // namespace bluevk
 
 #if defined(VK_VERSION_1_0)
@@ -55,6 +55,10 @@ void bluevk::bindInstance(VkInstance instance) {
     loadDeviceFunctions(instance, vkGetInstanceProcAddrWrapper);
 }
 
+void bluevk::bindDevice(VkDevice device) {
+    loadDeviceFunctions(device, vkGetDeviceProcAddrWrapper);
+}
+
 static PFN_vkVoidFunction vkGetInstanceProcAddrWrapper(void* context, const char* name) {
     return vkGetInstanceProcAddr((VkInstance) context, name);
 }
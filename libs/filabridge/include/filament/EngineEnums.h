@@ -25,7 +25,8 @@ constexpr uint32_t ATTRIBUTE_INDEX_COUNT = 5;
 
 enum VertexAttribute : uint8_t {
     POSITION        = 0, // XYZ position (float3)
-    TANGENTS        = 1, // tangent, bitangent and normal, encoded as a quaternion (float4)
+    TANGENTS        = 1, // tangent, bitangent and normal, encoded as a unit quaternion (float4)
+                         // or packed by filamesh in an INT_2_10_10_10_REV, see getters.vs
     COLOR           = 2, // vertex color (float4)
     UV0             = 3, // texture coordinates (float2)
     UV1             = 4, // texture coordinates (float2)
@@ -49,14 +50,57 @@ namespace BindingPoints {
 static_assert(BindingPoints::PER_MATERIAL_INSTANCE == BindingPoints::COUNT - 1,
         "Dynamically sized sampler buffer must be the last binding point.");
 
+// Binding of the input attachment of the Vulkan shaders that read the color of the previous
+// subpass, it follows the uniform buffers and the samplers in the descriptor set.
+constexpr uint32_t SUBPASS_INPUT_BINDING = 14;
+
 constexpr size_t MAX_ATTRIBUTE_BUFFERS_COUNT = 8;   // FIXME: should match Driver::MAX_ATTRIBUTE_BUFFER_COUNT
 
 // This value is limited by UBO size, ES3.0 only guarantees 16 KiB.
 constexpr size_t CONFIG_MAX_LIGHT_COUNT = 256;
 
-// This value is also limited by UBO size, ES3.0 only guarantees 16 KiB.
-// 256 is enough, but we could use 512 if needed
-constexpr size_t CONFIG_MAX_BONE_COUNT = 256;
+// This value is also limited by UBO size, ES3.0 only guarantees 16 KiB, that's 512 bones.
+// Materials built with a smaller bones block still work, they just see fewer bones.
+constexpr size_t CONFIG_MAX_BONE_COUNT = 512;
+
+// This value is also limited by UBO size, each instance needs 112 bytes.
+constexpr size_t CONFIG_MAX_INSTANCE_COUNT = 128;
+
+// Number of views rendered at once by a stereoscopic View, one per eye.
+constexpr size_t CONFIG_STEREO_EYE_COUNT = 2;
+
+// Maximum number of levels of detail of a renderable.
+constexpr size_t CONFIG_MAX_LOD_COUNT = 4;
+
+// Maximum number of cascades of the directional light's shadow map. This value is limited by
+// the shaders, which select the cascade with a vec4 of split distances.
+constexpr size_t CONFIG_MAX_SHADOW_CASCADES = 4;
+
+// Maximum number of spot lights casting shadows in a View. This value is limited by the
+// renderables' SPOT_SHADOW_MASK, which has a bit per shadowed spot light.
+constexpr size_t CONFIG_MAX_SHADOWED_SPOT_LIGHTS = 8;
+
+// Specialization constants of the Vulkan shaders. Their ids are injected in the shaders by the
+// code generator, their values are set when the pipelines are created. Changing a value doesn't
+// require compiling another shader, unlike a variant.
+namespace SpecializationConstants {
+    constexpr uint32_t SHADOW_SAMPLING_METHOD  = 0;    // int, one of ShadowSamplingMethod
+    constexpr uint32_t COUNT                   = 1;
+};
+
+// Filtering of the shadow maps, these values must match SHADOW_SAMPLING_* in shadowing.fs and
+// View::ShadowOptions::Filtering
+enum class ShadowSamplingMethod : int32_t {
+    HARD        = 0,    // single tap
+    PCF_LOW     = 1,    // PCF, 4 taps
+    PCF_MEDIUM  = 2,    // PCF, 9 taps
+    PCF_HIGH    = 3     // PCF, 16 taps
+};
+
+// Most expensive shadow sampling method of the Vulkan pipelines, the View's filtering is clamped
+// to it and the more expensive kernels are eliminated by the driver. The other backends use the
+// limit chosen when the materials were compiled.
+constexpr ShadowSamplingMethod CONFIG_SHADOW_SAMPLING_METHOD = ShadowSamplingMethod::PCF_HIGH;
 
 // can't really use std::underlying_type<AttributeIndex>::type because the driver takes a uint32_t
 using AttributeBitset = utils::bitset32;
@@ -83,12 +83,22 @@ namespace filament {
         // when adding more entries, make sure to update VERTEX_DOMAIN_COUNT
     };
 
-    static constexpr size_t POST_PROCESS_STAGES_COUNT = 4;
+    static constexpr size_t POST_PROCESS_STAGES_COUNT = 13;
     enum class PostProcessStage : uint8_t {
         TONE_MAPPING_OPAQUE,           // Tone mapping post-process
         TONE_MAPPING_TRANSLUCENT,      // Tone mapping post-process
         ANTI_ALIASING_OPAQUE,          // Anti-aliasing stage
         ANTI_ALIASING_TRANSLUCENT,     // Anti-aliasing stage
+        TONE_MAPPING_ANTI_ALIASING_OPAQUE,      // Tone mapping, anti-aliasing and scaling
+        TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT, // Tone mapping, anti-aliasing and scaling
+        BLENDING_UPSAMPLE,             // Composites the low resolution blended primitives
+        TEMPORAL_UPSAMPLE,             // Temporal anti-aliasing, reconstructs the full resolution
+        TONE_MAPPING_SUBPASS_OPAQUE,       // Tone mapping the previous subpass' color
+        TONE_MAPPING_SUBPASS_TRANSLUCENT,  // Tone mapping the previous subpass' color
+        IBL_EQUIRECTANGULAR,           // Draws a cubemap face from an equirectangular image
+        IBL_PREFILTER,                 // Draws a cubemap face of a reflections' roughness level
+        IBL_SPHERICAL_HARMONICS,       // Projects a cubemap on the irradiance SH
+        // when adding more entries, make sure to update POST_PROCESS_STAGES_COUNT
     };
 
     static constexpr size_t MATERIAL_VARIABLES_COUNT = 4;
@@ -42,6 +42,7 @@ enum class Backend : uint8_t {
     DEFAULT = 0,  //!< Automatically selects an appropriate driver for the platform.
     OPENGL = 1,   //!< Selects the OpenGL driver (which supports OpenGL ES as well).
     VULKAN = 2,   //!< Selects the Vulkan driver if the platform supports it.
+    NOOP = 3,     //!< Selects the no-op driver, which ignores all commands, for CPU benchmarks.
 };
 
 /**
@@ -59,6 +60,8 @@ enum TargetBufferFlags : uint8_t {
     ALL = COLOR | DEPTH | STENCIL,
 };
 
+enum class TextureFormat : uint16_t;
+
 /**
  * Selects which buffers to clear at the beginning of the render pass, as well as which buffers
  * can be discarded and the beginning and end of the render pass.
@@ -76,6 +79,10 @@ struct RenderPassParams {
         uint32_t flags = 0;
     };
     static constexpr uint8_t DEPENDENCY_BY_REGION = 1; // see "framebuffer-local" in Vulkan spec.
+    // The render pass has two subpasses, the first one draws into a transient color attachment
+    // of subpassFormat, which the second one reads as an input attachment while drawing into the
+    // render target's color buffer. See Driver::isSubpassSupported() and nextSubpass().
+    static constexpr uint8_t SUBPASS_INPUT = 2;
     // Viewport (16 bytes)
     int32_t left;
     int32_t bottom;
@@ -85,10 +92,14 @@ struct RenderPassParams {
     math::float4 clearColor = {};
     double clearDepth = 1.0;
     uint32_t clearStencil = 0;
-    uint32_t reserved1 = 0;
+    TextureFormat subpassFormat = {};
+    uint16_t reserved1 = 0;
     // Extra RenderPass-only flags stashed in the "clear" field.
     static const uint8_t IGNORE_SCISSOR = 0x10;
     static const uint8_t IGNORE_VIEWPORT = 0x20;
+    // The bit TargetBufferFlags::SHADOW adds to DEPTH, marks shadow passes (which use the
+    // polygon offset) even when they don't clear the depth buffer.
+    static const uint8_t SHADOW_PASS = TargetBufferFlags::SHADOW & ~TargetBufferFlags::DEPTH;
 };
 
 /**
@@ -154,6 +165,7 @@ enum class SamplerType : uint8_t {
     SAMPLER_2D,         //!< 2D texture
     SAMPLER_CUBEMAP,    //!< Cube map texture
     SAMPLER_EXTERNAL,   //!< External texture
+    SAMPLER_2D_ARRAY,   //!< 2D array texture, its depth is the number of layers
 };
 
 enum class SamplerFormat : uint8_t {
@@ -191,6 +203,7 @@ enum class ElementType : uint8_t {
     HALF2,
     HALF3,
     HALF4,
+    INT_2_10_10_10_REV,     // 4 signed components of 10, 10, 10 and 2 bits packed in 32 bits
 };
 
 enum class Usage : uint8_t {
@@ -231,7 +244,8 @@ enum class PixelDataType : uint8_t {
     INT,
     HALF,
     FLOAT,
-    COMPRESSED
+    COMPRESSED,
+    UINT_5_9_9_9_REV    // RGB9_E5 packed in a uint32_t, the format must be RGB
 };
 
 enum class CompressedPixelDataType : uint16_t {
@@ -426,6 +440,12 @@ struct FaceOffsets {
     }
 };
 
+//! A range of bytes in a buffer
+struct BufferRange {
+    uint32_t byteOffset;
+    uint32_t byteSize;
+};
+
 enum class SamplerWrapMode : uint8_t {
     CLAMP_TO_EDGE,
     REPEAT,
@@ -514,6 +534,28 @@ enum ShaderType : uint8_t {
 };
 
 static constexpr uint64_t SWAP_CHAIN_CONFIG_TRANSPARENT = 0x1;
+// Presents the latest frame at the next vertical blank, without waiting for the queued ones.
+static constexpr uint64_t SWAP_CHAIN_CONFIG_LOW_LATENCY = 0x2;
+// Presents frames as soon as they're done, without waiting for the vertical blank (may tear).
+static constexpr uint64_t SWAP_CHAIN_CONFIG_NO_VSYNC = 0x4;
+
+/*
+ * A key/value store for the driver's compiled programs, in the spirit of EGL_ANDROID_blob_cache.
+ * The driver calls insert() with the binary of each program it links, and retrieve() before
+ * compiling one: retrieve() must copy the value associated to the key to 'value' if it is at
+ * most valueSize bytes and return its size, or return 0 if the key is unknown. The driver
+ * queries the size first, with a null value. Both functions are called on the driver thread.
+ * The cache can evict entries (or ignore insertions) at will.
+ */
+struct BlobCache {
+    using Insert = void(*)(void* user,
+            void const* key, size_t keySize, void const* value, size_t valueSize);
+    using Retrieve = size_t(*)(void* user,
+            void const* key, size_t keySize, void* value, size_t valueSize);
+    Insert insert = nullptr;
+    Retrieve retrieve = nullptr;
+    void* user = nullptr;
+};
 
 } // namespace driver
 } // namespace filament
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILABRIDGE_SPIRVCOMPRESSION_H
+#define TNT_FILABRIDGE_SPIRVCOMPRESSION_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+
+// Compression schemes of the blobs of the SPIR-V dictionary chunk.
+enum class SpirvCompression : uint32_t {
+    NONE = 0,
+    VARINT = 1,     // see SpirvCompressor
+};
+
+/*
+ * A lossless and fast compression of SPIR-V modules. Most SPIR-V words are small ids or
+ * literals, so each word is stored as a variable length integer (7 bits per byte). The first word
+ * of each instruction packs the word count and the opcode in its two halves: these are stored
+ * separately so they stay small too. A compressed blob starts with the module's word count.
+ *
+ * Any sequence of words round-trips, even if it isn't valid SPIR-V.
+ */
+class SpirvCompressor {
+public:
+    // appends the compressed form of count words to out
+    static void compress(uint32_t const* words, size_t count, std::vector<uint8_t>& out);
+
+    // returns the number of words of a compressed blob, or 0 if it's invalid
+    static size_t getWordCount(uint8_t const* data, size_t size) noexcept;
+
+    // decompresses a blob into words, which must hold getWordCount() words
+    static bool decompress(uint8_t const* data, size_t size, uint32_t* words) noexcept;
+};
+
+} // namespace filament
+
+#endif // TNT_FILABRIDGE_SPIRVCOMPRESSION_H
@@ -28,6 +28,7 @@ public:
     static UniformInterfaceBlock& getLightsUib() noexcept;
     static UniformInterfaceBlock& getPostProcessingUib() noexcept;
     static UniformInterfaceBlock& getPerRenderableBonesUib() noexcept;
+    static UniformInterfaceBlock& getPerRenderableInstancesUib() noexcept;
 };
 
 }
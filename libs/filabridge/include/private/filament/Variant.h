@@ -21,7 +21,7 @@
 #include <cstddef>
 
 namespace filament {
-    static constexpr size_t VARIANT_COUNT = 16;
+    static constexpr size_t VARIANT_COUNT = 64;
 
     // IMPORTANT: update filterVariant() when adding more variants
     struct Variant {
@@ -33,17 +33,20 @@ namespace filament {
         // DYL: Dynamic Lighting
         // SRE: Shadow Receiver
         // SKN: Skinning
+        // INS: Instancing
+        // STE: Stereo
         //
-        //                    ...-----+-----+-----+-----+-----+
-        // Variant                 0  | SKN | SRE | DYN | DIR |
-        //                    ...-----+-----+-----+-----+-----+
+        //                    ...-----+-----+-----+-----+-----+-----+-----+
+        // Variant                 0  | STE | INS | SKN | SRE | DYN | DIR |
+        //                    ...-----+-----+-----+-----+-----+-----+-----+
         // Reserved variants:
-        //       Depth shader            X     1     0     0
-        //           Reserved            X     1     1     0
+        //       Depth shader            X     X     X     1     0     0
+        //           Reserved            X     X     X     1     1     0
+        //           Reserved            X     1     1     X     X     X
         //
         // Standard variants:
-        //      Vertex shader            X     X     0     X
-        //    Fragment shader            0     X     X     X
+        //      Vertex shader            X     X     X     X     0     X
+        //    Fragment shader            X     0     0     X     X     X
 
         uint8_t key = 0;
 
@@ -53,14 +56,19 @@ namespace filament {
         static constexpr uint8_t DYNAMIC_LIGHTING       = 0x02; // point, spot or area present, per frame/world position
         static constexpr uint8_t SHADOW_RECEIVER        = 0x04; // receives shadows, per renderable
         static constexpr uint8_t SKINNING               = 0x08; // GPU skinning
+        static constexpr uint8_t INSTANCING             = 0x10; // instanced draw, per draw call
+        static constexpr uint8_t STEREO                 = 0x20; // both eyes in one pass, per view
 
         static constexpr uint8_t VERTEX_MASK = DIRECTIONAL_LIGHTING |
                                                SHADOW_RECEIVER |
-                                               SKINNING;
+                                               SKINNING |
+                                               INSTANCING |
+                                               STEREO;
 
         static constexpr uint8_t FRAGMENT_MASK = DIRECTIONAL_LIGHTING |
                                                  DYNAMIC_LIGHTING |
-                                                 SHADOW_RECEIVER;
+                                                 SHADOW_RECEIVER |
+                                                 STEREO;
 
         static constexpr uint8_t DEPTH_MASK = DIRECTIONAL_LIGHTING |
                                               DYNAMIC_LIGHTING |
@@ -71,7 +79,11 @@ namespace filament {
         static constexpr uint8_t DEPTH_VARIANT = SHADOW_RECEIVER;
 
         // this mask filters out the lighting variants
-        static constexpr uint8_t UNLIT_MASK    = SKINNING;
+        static constexpr uint8_t UNLIT_MASK    = SKINNING | INSTANCING | STEREO;
+
+        // the variants that aren't in the key of the commands, the same for all the commands of
+        // a pass
+        static constexpr uint8_t PASS_MASK = STEREO;
 
         static_assert((VERTEX_MASK | FRAGMENT_MASK) == VARIANT_COUNT - 1,
                 "inconsistency between vertex/fragment masks and variant count");
@@ -80,11 +92,15 @@ namespace filament {
         inline bool hasDirectionalLighting() const noexcept { return key & DIRECTIONAL_LIGHTING; }
         inline bool hasDynamicLighting() const noexcept { return key & DYNAMIC_LIGHTING; }
         inline bool hasShadowReceiver() const noexcept { return key & SHADOW_RECEIVER; }
+        inline bool hasInstancing() const noexcept { return key & INSTANCING; }
+        inline bool hasStereo() const noexcept { return key & STEREO; }
 
         inline void setSkinning(bool v) noexcept { set(v, SKINNING); }
         inline void setDirectionalLighting(bool v) noexcept { set(v, DIRECTIONAL_LIGHTING); }
         inline void setDynamicLighting(bool v) noexcept { set(v, DYNAMIC_LIGHTING); }
         inline void setShadowReceiver(bool v) noexcept { set(v, SHADOW_RECEIVER); }
+        inline void setInstancing(bool v) noexcept { set(v, INSTANCING); }
+        inline void setStereo(bool v) noexcept { set(v, STEREO); }
 
         inline constexpr bool isDepthPass() const noexcept {
             return (key & DEPTH_MASK) == DEPTH_VARIANT;
@@ -92,7 +108,9 @@ namespace filament {
 
         static constexpr bool isReserved(uint8_t variantKey) noexcept {
             // reserved variants that should just be skipped.
-            return (variantKey & DEPTH_MASK) == (SHADOW_RECEIVER | DYNAMIC_LIGHTING);
+            // skinned primitives are never instanced, since bones are per renderable.
+            return (variantKey & DEPTH_MASK) == (SHADOW_RECEIVER | DYNAMIC_LIGHTING) ||
+                   (variantKey & (SKINNING | INSTANCING)) == (SKINNING | INSTANCING);
         }
 
         static constexpr uint8_t filterVariantVertex(uint8_t variantKey) noexcept {
@@ -102,18 +120,31 @@ namespace filament {
         }
 
         static constexpr uint8_t filterVariantFragment(uint8_t variantKey) noexcept {
-            // filter out fragment variants that are not needed. For e.g. skinning doesn't
-            // affect the fragment shader.
+            // filter out fragment variants that are not needed. For e.g. skinning or
+            // instancing don't affect the fragment shader, stereo does: it shades each eye
+            // from its own position.
             return variantKey & FRAGMENT_MASK;
         }
 
-        static constexpr uint8_t filterVariant(uint8_t variantKey, bool isLit) noexcept {
+        static constexpr uint8_t filterVariant(uint8_t variantKey, bool isLit,
+                bool hasPunctualLights = true) noexcept {
             // special case for depth variant
             if ((variantKey & DEPTH_MASK) == DEPTH_VARIANT) {
                 return variantKey;
             }
             // when the shading mode is unlit, remove all the lighting variants
-            return isLit ? variantKey : (variantKey & UNLIT_MASK);
+            if (!isLit) {
+                return variantKey & UNLIT_MASK;
+            }
+            // when the material ignores punctual lights, remove the dynamic lighting variants
+            if (!hasPunctualLights) {
+                variantKey &= ~DYNAMIC_LIGHTING;
+                // without a directional light either, there are no shadows left to receive
+                if ((variantKey & DEPTH_MASK) == DEPTH_VARIANT) {
+                    variantKey &= ~SHADOW_RECEIVER;
+                }
+            }
+            return variantKey;
         }
 
     private:
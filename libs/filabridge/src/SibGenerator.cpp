@@ -28,9 +28,10 @@ SamplerInterfaceBlock& SibGenerator::getPerViewSib() noexcept {
             .name("Light")
             .add("shadowMap",     Type::SAMPLER_2D,      Format::SHADOW,Precision::LOW)
             .add("records",       Type::SAMPLER_2D,      Format::UINT,  Precision::MEDIUM)
-            .add("froxels",       Type::SAMPLER_2D,      Format::UINT,  Precision::MEDIUM)
+            .add("froxels",       Type::SAMPLER_2D,      Format::UINT,  Precision::HIGH)
             .add("iblDFG",        Type::SAMPLER_2D,      Format::FLOAT, Precision::MEDIUM)
             .add("iblSpecular",   Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::MEDIUM)
+            .add("spotShadowAtlas", Type::SAMPLER_2D,    Format::SHADOW,Precision::LOW)
             .build();
     return sib;
 }
@@ -42,6 +43,12 @@ SamplerInterfaceBlock& SibGenerator::getPostProcessSib() noexcept {
     static SamplerInterfaceBlock sib = SamplerInterfaceBlock::Builder()
             .name("PostProcess")
             .add("colorBuffer", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("colorGrading", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("depthBuffer", Type::SAMPLER_2D, Format::FLOAT, Precision::HIGH, false)
+            .add("blendingBuffer", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
+            .add("blendingDepth", Type::SAMPLER_2D, Format::FLOAT, Precision::HIGH, false)
+            .add("environment", Type::SAMPLER_CUBEMAP, Format::FLOAT, Precision::MEDIUM, false)
+            .add("history", Type::SAMPLER_2D, Format::FLOAT, Precision::MEDIUM, false)
             .build();
     return sib;
 }
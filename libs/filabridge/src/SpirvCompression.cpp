@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "private/filament/SpirvCompression.h"
+
+#include <utils/compiler.h>
+
+#include <algorithm>
+
+namespace filament {
+
+// words of the module header (magic, version, generator, bound, schema)
+static constexpr size_t HEADER_WORD_COUNT = 5;
+
+static inline void writeVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(uint8_t(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(uint8_t(value));
+}
+
+static inline bool readVarint(uint8_t const*& p, uint8_t const* end, uint32_t* value) noexcept {
+    uint32_t v = 0;
+    for (uint32_t shift = 0; shift < 35; shift += 7) {
+        if (UTILS_UNLIKELY(p == end)) {
+            return false;
+        }
+        const uint8_t byte = *p++;
+        v |= uint32_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SpirvCompressor::compress(uint32_t const* words, size_t count, std::vector<uint8_t>& out) {
+    writeVarint(out, uint32_t(count));
+    size_t i = 0;
+    for (; i < count && i < HEADER_WORD_COUNT; i++) {
+        writeVarint(out, words[i]);
+    }
+    while (i < count) {
+        // the operands of an instruction that runs past the end are the words left
+        const uint32_t opcode = words[i] & 0xFFFF;
+        const uint32_t wordCount = words[i] >> 16;
+        writeVarint(out, opcode);
+        writeVarint(out, wordCount);
+        i++;
+        for (size_t e = i + std::min(size_t(wordCount ? wordCount - 1 : 0), count - i); i < e; i++) {
+            writeVarint(out, words[i]);
+        }
+    }
+}
+
+size_t SpirvCompressor::getWordCount(uint8_t const* data, size_t size) noexcept {
+    // each word takes at least a byte, which bounds what a corrupted blob can claim
+    uint32_t count = 0;
+    return readVarint(data, data + size, &count) && count <= size ? count : 0;
+}
+
+bool SpirvCompressor::decompress(uint8_t const* data, size_t size, uint32_t* words) noexcept {
+    uint8_t const* p = data;
+    uint8_t const* const end = data + size;
+    uint32_t count;
+    if (!readVarint(p, end, &count)) {
+        return false;
+    }
+    size_t i = 0;
+    for (; i < count && i < HEADER_WORD_COUNT; i++) {
+        if (!readVarint(p, end, &words[i])) {
+            return false;
+        }
+    }
+    while (i < count) {
+        uint32_t opcode, wordCount;
+        if (!readVarint(p, end, &opcode) || !readVarint(p, end, &wordCount)) {
+            return false;
+        }
+        words[i++] = (wordCount << 16) | opcode;
+        for (size_t e = i + std::min(size_t(wordCount ? wordCount - 1 : 0), count - i); i < e; i++) {
+            if (!readVarint(p, end, &words[i])) {
+                return false;
+            }
+        }
+    }
+    return p == end;
+}
+
+} // namespace filament
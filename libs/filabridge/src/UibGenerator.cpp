@@ -32,7 +32,12 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("clipFromViewMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("viewFromClipMatrix",      1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
             .add("clipFromWorldMatrix",     1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
-            .add("lightFromWorldMatrix",    1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("lightFromWorldMatrix",    CONFIG_MAX_SHADOW_CASCADES, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("spotLightFromWorldMatrix", CONFIG_MAX_SHADOWED_SPOT_LIGHTS, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            // shadow cascades
+            .add("shadowCascadeSplits",     1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("shadowConstantBias",      1, UniformInterfaceBlock::Type::FLOAT4, Precision::HIGH)
+            .add("shadowNormalBias",        1, UniformInterfaceBlock::Type::FLOAT4)
             // view
             .add("resolution",              1, UniformInterfaceBlock::Type::FLOAT4)
             // camera
@@ -43,9 +48,10 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("lightColorIntensity",     1, UniformInterfaceBlock::Type::FLOAT4)
             .add("sun",                     1, UniformInterfaceBlock::Type::FLOAT4)
             .add("lightDirection",          1, UniformInterfaceBlock::Type::FLOAT3)
-            .add("padding1",                1, UniformInterfaceBlock::Type::FLOAT)
-            // shadow
-            .add("shadowBias",              1, UniformInterfaceBlock::Type::FLOAT3)
+            .add("directionalShadows",      1, UniformInterfaceBlock::Type::FLOAT)
+            .add("shadowSamplingMethod",    1, UniformInterfaceBlock::Type::INT)
+            .add("iblRgbm",                 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("padding3",                1, UniformInterfaceBlock::Type::FLOAT)
             .add("oneOverFroxelDimensionY", 1, UniformInterfaceBlock::Type::FLOAT)
             // froxels
             .add("zParams",                 1, UniformInterfaceBlock::Type::FLOAT4)
@@ -60,6 +66,9 @@ UniformInterfaceBlock& UibGenerator::getPerViewUib() noexcept  {
             .add("ev100",                   1, UniformInterfaceBlock::Type::FLOAT)
             // ibl
             .add("iblSH",                   9, UniformInterfaceBlock::Type::FLOAT3)
+            // stereo
+            .add("eyeClipFromWorldMatrix",  CONFIG_STEREO_EYE_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("eyeCameraPosition",       CONFIG_STEREO_EYE_COUNT, UniformInterfaceBlock::Type::FLOAT3, Precision::HIGH)
             .build();
     return uib;
 }
@@ -73,6 +82,16 @@ UniformInterfaceBlock& UibGenerator::getPerRenderableUib() noexcept {
     return uib;
 }
 
+UniformInterfaceBlock& UibGenerator::getPerRenderableInstancesUib() noexcept {
+    // IMPORTANT NOTE: Respect std140 layout, don't update without updating Engine::PerRenderableInstancesUib
+    static UniformInterfaceBlock uib =  UniformInterfaceBlock::Builder()
+            .name("InstancesUniforms")
+            .add("worldFromModelMatrix",       CONFIG_MAX_INSTANCE_COUNT, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("worldFromModelNormalMatrix", CONFIG_MAX_INSTANCE_COUNT, UniformInterfaceBlock::Type::MAT3, Precision::HIGH)
+            .build();
+    return uib;
+}
+
 UniformInterfaceBlock& UibGenerator::getLightsUib() noexcept {
     static UniformInterfaceBlock uib = UniformInterfaceBlock::Builder()
             .name("LightsUniforms")
@@ -87,6 +106,14 @@ UniformInterfaceBlock& UibGenerator::getPostProcessingUib() noexcept {
             .add("uvScale", 1, UniformInterfaceBlock::Type::FLOAT2)
             .add("time",    1, UniformInterfaceBlock::Type::FLOAT)
             .add("yOffset", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("blendingScale", 1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("iblFace", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblLinearRoughness", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblSampleCount", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("iblMaxLevel", 1, UniformInterfaceBlock::Type::FLOAT)
+            .add("temporalReprojection", 1, UniformInterfaceBlock::Type::MAT4, Precision::HIGH)
+            .add("temporalJitter", 1, UniformInterfaceBlock::Type::FLOAT2)
+            .add("temporalFeedback", 1, UniformInterfaceBlock::Type::FLOAT)
             .build();
     return uib;
 }
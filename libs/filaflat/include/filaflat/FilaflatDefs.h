@@ -65,6 +65,7 @@ enum UTILS_PUBLIC ChunkType : uint64_t {
     MaterialTransparencyMode = charTo64bitNum("MAT_TRMD"),
     MaterialMaskThreshold = charTo64bitNum("MAT_THRS"),
     MaterialShadowMultiplier = charTo64bitNum("MAT_SHML"),
+    MaterialPunctualLights = charTo64bitNum("MAT_PUNC"),
 
     MaterialRequiredAttributes = charTo64bitNum("MAT_REQA"),
     MaterialDepthWriteSet = charTo64bitNum("MAT_DEWS"),
@@ -20,6 +20,7 @@
 #include <filament/EngineEnums.h>
 #include <filament/MaterialEnums.h>
 
+#include <filament/driver/BufferDescriptor.h>
 #include <filament/driver/DriverEnums.h>
 
 #include <utils/compiler.h>
@@ -42,7 +43,14 @@ struct MaterialParserDetails;
 
 class UTILS_PUBLIC MaterialParser {
 public:
+    using Callback = filament::driver::BufferDescriptor::Callback;
+
+    // makes a copy of the package
     MaterialParser(filament::driver::Backend backend, const void* data, size_t size);
+
+    // references the package, which must stay valid until callback is called by the destructor
+    MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+            Callback callback, void* user);
     ~MaterialParser();
 
     MaterialParser(MaterialParser const& rhs) noexcept = delete;
@@ -74,9 +82,15 @@ public:
     bool getBlendingMode(filament::BlendingMode*) const noexcept;
     bool getMaskThreshold(float*) const noexcept;
     bool hasShadowMultiplier(bool*) const noexcept;
+    bool hasPunctualLights(bool*) const noexcept;
     bool getRequiredAttributes(filament::AttributeBitset*) const noexcept;
     bool hasCustomDepthShader(bool* value) const noexcept;
 
+    // only reads the shader index, not the dictionary nor the shader
+    bool hasShader(filament::driver::ShaderModel shaderModel, uint8_t variant,
+            filament::driver::ShaderType st) noexcept;
+
+    // can be called from several threads at once, each with its own ShaderBuilder
     bool getShader(
             filament::driver::ShaderModel shaderModel, uint8_t variant,
             filament::driver::ShaderType st,
@@ -17,6 +17,7 @@
 #ifndef TNT_FILAFLAT_BLOBDICTIONARY_H
 #define TNT_FILAFLAT_BLOBDICTIONARY_H
 
+#include <memory>
 #include <vector>
 
 #include <stddef.h>
@@ -41,6 +42,13 @@ public:
         mBlobs.reserve(size);
     }
 
+    // Storage for blobs that don't live in the package (e.g. decompressed ones), it lasts as
+    // long as the dictionary. Only one allocation is supported.
+    inline uint32_t* allocateStorage(size_t wordCount) {
+        mStorage.reset(new uint32_t[wordCount]);
+        return mStorage.get();
+    }
+
     inline const char* getBlob(size_t index, size_t* size) const noexcept {
         *size = mBlobs[index].size;
         return mBlobs[index].data;
@@ -58,6 +66,7 @@ private:
         size_t size;
     };
     std::vector<Blob> mBlobs;
+    std::unique_ptr<uint32_t[]> mStorage;
 };
 
 } // namespace filaflat
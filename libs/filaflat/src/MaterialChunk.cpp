@@ -80,6 +80,21 @@ bool MaterialChunk::readIndex(Unflattener& unflattener) {
     return true;
 }
 
+bool MaterialChunk::hasShader(Unflattener unflattener, ShaderModel shaderModel, uint8_t variant,
+        ShaderType stage, bool isText) {
+    if (mBase == nullptr ) {
+        if (!readIndex(unflattener)) {
+            return false;
+        }
+    }
+    auto pos = mOffsets.find(makeKey(shaderModel, variant, stage));
+    if (pos == mOffsets.end()) {
+        return false;
+    }
+    // text shaders use an offset of zero for missing shaders, SPIR-V ones are indices
+    return !isText || pos->second != 0;
+}
+
 bool MaterialChunk::getTextShader(Unflattener unflattener, BlobDictionary& dictionary,
         ShaderBuilder& shader, ShaderModel shaderModel, uint8_t variant, ShaderType ps) {
 
@@ -33,6 +33,9 @@ namespace filaflat {
 
 class MaterialChunk {
 public:
+    bool hasShader(Unflattener unflattener, filament::driver::ShaderModel shaderModel,
+            uint8_t variant, filament::driver::ShaderType stage, bool isText);
+
     bool getTextShader(
             Unflattener unflattener, BlobDictionary& dictionary, ShaderBuilder& shaderBuilder,
             filament::driver::ShaderModel shaderModel, uint8_t variant,
@@ -43,8 +46,10 @@ public:
             filament::driver::ShaderModel shaderModel, uint8_t variant,
             filament::driver::ShaderType stage);
 
-private:
+    // reads the shader index, the getters read it if it's not read yet
     bool readIndex(Unflattener& unflattener);
+
+private:
     const uint8_t* mBase = nullptr;
     tsl::robin_map<uint32_t, uint32_t> mOffsets;
 };
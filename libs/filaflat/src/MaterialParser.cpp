@@ -32,7 +32,9 @@
 
 #include <utils/CString.h>
 
+#include <atomic>
 #include <cstdlib>
+#include <mutex>
 
 #include <string>
 
@@ -42,22 +44,36 @@ using namespace filamat;
 
 namespace filaflat {
 
-// Make a copy of content and own the allocated memory.
+// Either makes a copy of content and owns the allocated memory, or references the content, which
+// stays valid until the callback is called.
 class ManagedBuffer  {
     void* mStart = nullptr;
     size_t mSize = 0;
+    MaterialParser::Callback mCallback = nullptr;
+    void* mUser = nullptr;
 public:
     explicit ManagedBuffer(const void* start, size_t size)
             : mStart(malloc(size)), mSize(size) {
         memcpy(mStart, start, size);
     }
 
+    ManagedBuffer(const void* start, size_t size, MaterialParser::Callback callback, void* user)
+            : mStart(const_cast<void*>(start)), mSize(size), mCallback(callback), mUser(user) {
+    }
+
+    ManagedBuffer(ManagedBuffer const& rhs) = delete;
+    ManagedBuffer& operator=(ManagedBuffer const& rhs) = delete;
+
     void* begin() const noexcept { return mStart; }
     void* end() const noexcept { return (uint8_t*)mStart + mSize; }
     size_t size() const noexcept { return mSize; }
 
     ~ManagedBuffer() noexcept {
-        free(mStart);
+        if (mCallback) {
+            mCallback(mStart, mSize, mUser);
+        } else {
+            free(mStart);
+        }
     }
 };
 
@@ -67,14 +83,31 @@ struct MaterialParserDetails {
               mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
               mBackend(backend) {
     }
+
+    MaterialParserDetails(filament::driver::Backend backend, const void* data, size_t size,
+            MaterialParser::Callback callback, void* user)
+            : mUnflattenable(data, size, callback, user),
+              mChunkContainer(mUnflattenable.begin(), mUnflattenable.size()),
+              mBackend(backend) {
+    }
     ManagedBuffer mUnflattenable;
     ChunkContainer mChunkContainer;
 
     // Keep MaterialChunk alive between calls to getShader to avoid reload the shader index.
+    // The dictionary is only read by the first getShader() call.
     filament::driver::Backend mBackend;
     MaterialChunk mMaterialChunk;
     BlobDictionary mBlobDictionary;
 
+    // The shader index and the dictionary are read once, under mLock, by the first calls that
+    // need them. After that they're only read, so the shaders can be read from several threads.
+    static constexpr uint8_t INDEX = 0x1;
+    static constexpr uint8_t DICTIONARY = 0x2;
+    std::atomic<uint8_t> mReady = { 0 };
+    std::mutex mLock;
+
+    bool prepare(ChunkType shaders, uint8_t needed) noexcept;
+
     template<typename T>
     bool getFromSimpleChunk(filamat::ChunkType type, T* value) const noexcept;
 
@@ -100,6 +133,11 @@ MaterialParser::MaterialParser(filament::driver::Backend backend, const void* da
         : mImpl(new MaterialParserDetails(backend, data, size)) {
 }
 
+MaterialParser::MaterialParser(filament::driver::Backend backend, const void* data, size_t size,
+        Callback callback, void* user)
+        : mImpl(new MaterialParserDetails(backend, data, size, callback, user)) {
+}
+
 MaterialParser::~MaterialParser() {
     delete mImpl;
 }
@@ -248,6 +286,10 @@ bool MaterialParser::hasShadowMultiplier(bool* value) const noexcept {
     return mImpl->getFromSimpleChunk(ChunkType::MaterialShadowMultiplier, value);
 }
 
+bool MaterialParser::hasPunctualLights(bool* value) const noexcept {
+    return mImpl->getFromSimpleChunk(ChunkType::MaterialPunctualLights, value);
+}
+
 bool MaterialParser::getShading(Shading* value) const noexcept {
     assert(sizeof(Shading) == sizeof(uint8_t));
     return mImpl->getFromSimpleChunk(ChunkType::MaterialShading, reinterpret_cast<uint8_t*>(value));
@@ -277,6 +319,19 @@ bool MaterialParser::getShader(
            mImpl->getGlShader(shaderModel, variant, st, shader);
 }
 
+bool MaterialParser::hasShader(filament::driver::ShaderModel shaderModel, uint8_t variant,
+        filament::driver::ShaderType st) noexcept {
+    const ChunkType type = (mImpl->mBackend == filament::driver::Backend::VULKAN) ?
+            ChunkType::MaterialSpirv : ChunkType::MaterialGlsl;
+    ChunkContainer const& container = mImpl->mChunkContainer;
+    if (!container.hasChunk(type) || !mImpl->prepare(type, MaterialParserDetails::INDEX)) {
+        return false;
+    }
+    Unflattener unflattener(container, type);
+    return mImpl->mMaterialChunk.hasShader(unflattener, shaderModel, variant, st,
+            type == ChunkType::MaterialGlsl);
+}
+
 bool MaterialParserDetails::getVkShader(filament::driver::ShaderModel shaderModel, uint8_t variant,
         filament::driver::ShaderType st, ShaderBuilder& shader) noexcept {
 
@@ -286,10 +341,8 @@ bool MaterialParserDetails::getVkShader(filament::driver::ShaderModel shaderMode
         return false;
     }
 
-    if (UTILS_UNLIKELY(mBlobDictionary.isEmpty())) {
-        if (!SpirvDictionaryReader::unflatten(container, mBlobDictionary)) {
-            return false;
-        }
+    if (!prepare(ChunkType::MaterialSpirv, INDEX | DICTIONARY)) {
+        return false;
     }
 
     Unflattener unflattener(container, ChunkType::MaterialSpirv);
@@ -305,15 +358,39 @@ bool MaterialParserDetails::getGlShader(filament::driver::ShaderModel shaderMode
         return false;
     }
 
-    // Read the dictionary only if it has not been read yet.
-    if (UTILS_UNLIKELY(mBlobDictionary.isEmpty())) {
-        if (!TextDictionaryReader::unflatten(container, mBlobDictionary)) {
-            return false;
-        }
+    if (!prepare(ChunkType::MaterialGlsl, INDEX | DICTIONARY)) {
+        return false;
     }
 
     Unflattener unflattener(container, ChunkType::MaterialGlsl);
     return mMaterialChunk.getTextShader(unflattener, mBlobDictionary, shader, shaderModel, variant, st);
 }
 
+bool MaterialParserDetails::prepare(ChunkType shaders, uint8_t needed) noexcept {
+    if (UTILS_LIKELY((mReady.load(std::memory_order_acquire) & needed) == needed)) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> guard(mLock);
+    uint8_t ready = mReady.load(std::memory_order_relaxed);
+    ChunkContainer const& container = mChunkContainer;
+    if ((needed & INDEX) && !(ready & INDEX)) {
+        Unflattener unflattener(container, shaders);
+        if (!mMaterialChunk.readIndex(unflattener)) {
+            return false;
+        }
+        ready |= INDEX;
+    }
+    if ((needed & DICTIONARY) && !(ready & DICTIONARY)) {
+        const bool read = (shaders == ChunkType::MaterialSpirv) ?
+                SpirvDictionaryReader::unflatten(container, mBlobDictionary) :
+                TextDictionaryReader::unflatten(container, mBlobDictionary);
+        if (read) {
+            ready |= DICTIONARY;
+        }
+    }
+    mReady.store(ready, std::memory_order_release);
+    return (ready & needed) == needed;
+}
+
 } // namespace filaflat
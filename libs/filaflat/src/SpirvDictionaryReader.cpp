@@ -16,18 +16,22 @@
 
 #include "SpirvDictionaryReader.h"
 
-#include <assert.h>
+#include <private/filament/SpirvCompression.h>
 
 namespace filaflat {
 
 bool SpirvDictionaryReader::unflatten(Unflattener& f, BlobDictionary& dictionary) {
+    using filament::SpirvCompression;
+    using filament::SpirvCompressor;
+
     uint32_t compressionScheme;
     if (!f.read(&compressionScheme)) {
         return false;
     }
-
-    // TODO: support compression
-    assert(compressionScheme == 0);
+    if (compressionScheme != uint32_t(SpirvCompression::NONE) &&
+            compressionScheme != uint32_t(SpirvCompression::VARINT)) {
+        return false;
+    }
 
     uint32_t numBlobs;
     if (!f.read(&numBlobs)) {
@@ -35,13 +39,46 @@ bool SpirvDictionaryReader::unflatten(Unflattener& f, BlobDictionary& dictionary
     }
 
     dictionary.reserve(numBlobs);
+    if (compressionScheme == uint32_t(SpirvCompression::NONE)) {
+        for (uint32_t i = 0; i < numBlobs; i++) {
+            const char* blob;
+            size_t size;
+            if (!f.read(&blob, &size)) {
+                return false;
+            }
+            dictionary.addBlob(blob, size);
+        }
+        return true;
+    }
+
+    // All the blobs are decompressed in a single allocation owned by the dictionary, its size
+    // is given by a first pass over the blobs.
+    Unflattener sizes(f);
+    size_t totalWordCount = 0;
+    for (uint32_t i = 0; i < numBlobs; i++) {
+        const char* blob;
+        size_t size;
+        if (!sizes.read(&blob, &size)) {
+            return false;
+        }
+        totalWordCount += SpirvCompressor::getWordCount(
+                reinterpret_cast<uint8_t const*>(blob), size);
+    }
+
+    uint32_t* words = dictionary.allocateStorage(totalWordCount);
     for (uint32_t i = 0; i < numBlobs; i++) {
         const char* blob;
         size_t size;
         if (!f.read(&blob, &size)) {
             return false;
         }
-        dictionary.addBlob(blob, size);
+        uint8_t const* const data = reinterpret_cast<uint8_t const*>(blob);
+        const size_t wordCount = SpirvCompressor::getWordCount(data, size);
+        if (!wordCount || !SpirvCompressor::decompress(data, size, words)) {
+            return false;
+        }
+        dictionary.addBlob(reinterpret_cast<char const*>(words), wordCount * sizeof(uint32_t));
+        words += wordCount;
     }
     return true;
 }
@@ -19,11 +19,13 @@
 
 #include <vector>
 #include <functional>
+#include <memory>
 
 #include <filament/Engine.h>
 #include <filament/IndexBuffer.h>
 #include <filament/Material.h>
 #include <filament/MaterialInstance.h>
+#include <filament/Renderer.h>
 #include <filament/Texture.h>
 #include <filament/VertexBuffer.h>
 #include <filament/View.h>
@@ -32,6 +34,8 @@ struct ImDrawData;
 
 namespace filagui {
 
+class PerformanceHud;
+
 // Translates ImGui's draw commands into Filament primitives, textures, vertex buffers, etc.
 // Creates a UI-specific Scene object and populates it with a Renderable. Does not handle
 // event processing; clients can simply call ImGui::GetIO() directly and set the mouse state.
@@ -54,13 +58,30 @@ public:
     // whether the Renderer wants to skip or not.
     void render(float timeStepInSeconds, Callback imguiCommands);
 
+    // Draws a PerformanceHud of the given Renderer after the client's widgets in each call to
+    // render(), the view is optional and only used for its dynamic resolution scale. Passing a
+    // null renderer hides it.
+    void showPerformanceHud(filament::Renderer* renderer, filament::View* view = nullptr);
+
   private:
+      // The draw commands with the same scissor rectangle and texture share a material instance,
+      // which keeps its key from one frame to the next.
+      struct MaterialKey {
+          uint64_t scissor;
+          filament::Texture const* texture;
+          bool operator==(MaterialKey const& rhs) const noexcept {
+              return scissor == rhs.scissor && texture == rhs.texture;
+          }
+      };
+
       void renderDrawData(ImDrawData* imguiData);
       void createBuffers(int numRequiredBuffers);
       void populateVertexData(size_t bufferIndex, size_t vbSizeInBytes, void* vbData,
                   size_t ibSizeInBytes, void* ibData);
       void createVertexBuffer(size_t bufferIndex, size_t capacity);
       void createIndexBuffer(size_t bufferIndex, size_t capacity);
+      void createRenderable(size_t primitiveCount);
+      filament::MaterialInstance* getMaterialInstance(MaterialKey const& key);
       void syncThreads();
       filament::Engine* mEngine;
       filament::View* mView;
@@ -68,9 +89,13 @@ public:
       std::vector<filament::VertexBuffer*> mVertexBuffers;
       std::vector<filament::IndexBuffer*> mIndexBuffers;
       std::vector<filament::MaterialInstance*> mMaterialInstances;
+      std::vector<MaterialKey> mMaterialKeys;     // of each of mMaterialInstances
+      std::vector<bool> mMaterialUsed;            // by the current frame
       utils::Entity mRenderable;
+      size_t mPrimitiveCount = 0;                 // of mRenderable, which is reused
       filament::Texture* mTexture = nullptr;
       bool mHasSynced = false;
+      std::unique_ptr<PerformanceHud> mPerformanceHud;
 };
 
 } // namespace filagui
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILAGUI_PERFORMANCEHUD_H_
+#define FILAGUI_PERFORMANCEHUD_H_
+
+#include <filament/Engine.h>
+#include <filament/Renderer.h>
+#include <filament/View.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filagui {
+
+// An ImGui window that plots the performance stats of a Renderer over its last frames: CPU and
+// GPU frame times, the CPU stages and GPU passes, the draw and state change counts, the usage of
+// the command buffer, the memory of the engine and the dynamic resolution scale of a View.
+// The easiest way to use it is ImGuiHelper::showPerformanceHud().
+class PerformanceHud {
+public:
+    // The view is optional, it's only used to show its dynamic resolution scale.
+    explicit PerformanceHud(filament::Renderer* renderer, filament::View* view = nullptr);
+
+    // Records the stats of the last frame ended by the Renderer, if it wasn't recorded yet, and
+    // draws the window. This must be called between ImGui::NewFrame() and ImGui::Render().
+    void draw();
+
+private:
+    // number of frames plotted
+    static constexpr size_t SAMPLE_COUNT = 120;
+    // the memory stats walk all the engine's objects, they're only refreshed every so often
+    static constexpr uint32_t MEMORY_REFRESH_INTERVAL = 60;
+
+    enum Series {
+        FRAME_INTERVAL,
+        CPU_FRAME,
+        GPU_FRAME,
+        SCENE_PREPARE,
+        CULLING,
+        PARTITION,
+        COMMAND_GENERATION,
+        COMMAND_SORT,
+        DRIVER_COMMANDS,
+        FROXELIZATION,
+        SHADOW_PASS,
+        COLOR_PASS,
+        POST_PROCESS,
+        DRAW_COUNT,
+        STATE_CHANGE_COUNT,
+        REDUNDANT_STATE_CHANGE_COUNT,
+        COMMAND_BUFFER_HIGH_WATERMARK,
+        DYNAMIC_RESOLUTION_SCALE,
+        SERIES_COUNT
+    };
+
+    void sample() noexcept;
+    void plot(Series series, const char* label, const char* format) const;
+
+    filament::Renderer* mRenderer;
+    filament::View* mView;
+    filament::Engine::CommandBufferStats mCommandBufferStats = {};
+    filament::Engine::MemoryStats mMemoryStats = {};
+    filament::Renderer::CpuCounterStats mCpuCounterStats;
+    float mSamples[SERIES_COUNT][SAMPLE_COUNT] = {};
+    size_t mNextSample = 0;         // oldest sample, overwritten by the next one
+    size_t mSampleCount = 0;
+    uint32_t mLastFrameId = 0;
+    uint32_t mFramesSinceMemoryStats = MEMORY_REFRESH_INTERVAL;
+    bool mCpuCountersEnabled = false;
+};
+
+} // namespace filagui
+
+#endif /* FILAGUI_PERFORMANCEHUD_H_ */
@@ -15,9 +15,10 @@
  */
 
 #include <filagui/ImGuiHelper.h>
+#include <filagui/PerformanceHud.h>
 
+#include <algorithm>
 #include <vector>
-#include <unordered_map>
 
 #include <imgui.h>
 
@@ -68,6 +69,7 @@ ImGuiHelper::ImGuiHelper(Engine* engine, filament::View* view) : mEngine(engine)
             .sampler(Texture::Sampler::SAMPLER_2D)
             .build(*engine);
     mTexture->setImage(*engine, 0, std::move(pb));
+    io.Fonts->TexID = (ImTextureID) mTexture;
 
     // Create a simple alpha-blended 2D blitting material.
     filament::Material* material = Material::Builder()
@@ -120,12 +122,19 @@ void ImGuiHelper::render(float timeStepInSeconds, Callback imguiCommands) {
     ImGui::NewFrame();
     // Allow the client app to create widgets.
     imguiCommands(mEngine, mView);
+    if (mPerformanceHud) {
+        mPerformanceHud->draw();
+    }
     // Let ImGui build up its draw data.
     ImGui::Render();
     // Finally, translate the draw data into Filament objects.
     renderDrawData(ImGui::GetDrawData());
 }
 
+void ImGuiHelper::showPerformanceHud(Renderer* renderer, filament::View* view) {
+    mPerformanceHud.reset(renderer ? new PerformanceHud(renderer, view) : nullptr);
+}
+
 // To help with mapping unique scissor rectangles to material instances, we create a 64-bit
 // key from a 4-tuple that defines an AABB in screen space.
 static uint64_t makeScissorKey(int fbheight, const ImVec4& clipRect) {
@@ -155,42 +164,31 @@ void ImGuiHelper::renderDrawData(ImDrawData* imguiData) {
     // Ensure that we have enough vertex buffers and index buffers.
     createBuffers(imguiData->CmdListsCount);
 
-    // Count how many primitives we'll need, then create a Renderable builder.
-    // Also count how many unique scissor rectangles are required.
+    // Count how many primitives we'll need, and keep the material instances of the scissor
+    // rectangles and textures that are still drawn.
     size_t nPrims = 0;
-    std::unordered_map<uint64_t, filament::MaterialInstance*> scissorRects;
+    mMaterialUsed.assign(mMaterialInstances.size(), false);
     for (int cmdListIndex = 0; cmdListIndex < imguiData->CmdListsCount; cmdListIndex++) {
         const ImDrawList* cmds = imguiData->CmdLists[cmdListIndex];
         nPrims += cmds->CmdBuffer.size();
         for (const auto& pcmd : cmds->CmdBuffer) {
-            scissorRects[makeScissorKey(fbheight, pcmd.ClipRect)] = nullptr;
-        }
-    }
-    auto rbuilder = RenderableManager::Builder(nPrims);
-    rbuilder.boundingBox({{ 0, 0, 0 }, { 10000, 10000, 10000 }}).culling(false);
-
-    // Ensure that we have a material instance for each scissor rectangle.
-    size_t previousSize = mMaterialInstances.size();
-    if (scissorRects.size() > mMaterialInstances.size()) {
-        mMaterialInstances.resize(scissorRects.size());
-        for (size_t i = previousSize; i < mMaterialInstances.size(); i++) {
-            mMaterialInstances[i] = mMaterial->createInstance();
+            const MaterialKey key = { makeScissorKey(fbheight, pcmd.ClipRect),
+                    pcmd.TextureId ? (Texture const*)pcmd.TextureId : mTexture };
+            auto pos = std::find(mMaterialKeys.begin(), mMaterialKeys.end(), key);
+            if (pos != mMaterialKeys.end()) {
+                mMaterialUsed[pos - mMaterialKeys.begin()] = true;
+            }
         }
     }
 
-    // Push each unique scissor rectangle to a MaterialInstance.
-    size_t matIndex = 0;
-    for (auto& pair : scissorRects) {
-        pair.second = mMaterialInstances[matIndex++];
-        uint32_t left = (pair.first >> 0ull) & 0xffffull;
-        uint32_t bottom = (pair.first >> 16ull) & 0xffffull;
-        uint32_t width = (pair.first >> 32ull) & 0xffffull;
-        uint32_t height = (pair.first >> 48ull) & 0xffffull;
-        pair.second->setScissor(left, bottom, width, height);
+    // The renderable is only rebuilt when it needs more primitives, it then doubles their count
+    // so that it rarely happens. The primitives not drawn this frame are left empty.
+    if (nPrims > mPrimitiveCount) {
+        createRenderable(std::max(nPrims, 2 * mPrimitiveCount));
     }
 
-    // Recreate the Renderable component and point it to the vertex buffers.
-    rcm.destroy(mRenderable);
+    // Point each primitive to its draw command's range of the vertex buffers.
+    auto ci = rcm.getInstance(mRenderable);
     int bufferIndex = 0;
     int primIndex = 0;
     for (int cmdListIndex = 0; cmdListIndex < imguiData->CmdListsCount; cmdListIndex++) {
@@ -206,24 +204,66 @@ void ImGuiHelper::renderDrawData(ImDrawData* imguiData) {
             if (pcmd.UserCallback) {
                 pcmd.UserCallback(cmds, &pcmd);
             } else {
-                uint64_t skey = makeScissorKey(fbheight, pcmd.ClipRect);
-                auto miter = scissorRects.find(skey);
-                assert(miter != scissorRects.end());
-                rbuilder
-                        .geometry(primIndex, RenderableManager::PrimitiveType::TRIANGLES,
-                                mVertexBuffers[bufferIndex], mIndexBuffers[bufferIndex],
-                                indexOffset, pcmd.ElemCount)
-                        .blendOrder(primIndex, primIndex)
-                        .material(primIndex, miter->second);
+                const MaterialKey key = { makeScissorKey(fbheight, pcmd.ClipRect),
+                        pcmd.TextureId ? (Texture const*)pcmd.TextureId : mTexture };
+                rcm.setGeometryAt(ci, primIndex, RenderableManager::PrimitiveType::TRIANGLES,
+                        mVertexBuffers[bufferIndex], mIndexBuffers[bufferIndex],
+                        indexOffset, pcmd.ElemCount);
+                rcm.setBlendOrderAt(ci, primIndex, (uint16_t)primIndex);
+                rcm.setMaterialInstanceAt(ci, primIndex, getMaterialInstance(key));
                 primIndex++;
             }
             indexOffset += pcmd.ElemCount;
         }
         bufferIndex++;
     }
-    if (imguiData->CmdListsCount > 0) {
-        rbuilder.build(*mEngine, mRenderable);
+    for (size_t i = primIndex; i < mPrimitiveCount; i++) {
+        rcm.setGeometryAt(ci, i, RenderableManager::PrimitiveType::TRIANGLES, 0, 0);
+    }
+}
+
+void ImGuiHelper::createRenderable(size_t primitiveCount) {
+    // the geometry and materials are set by renderDrawData()
+    auto& rcm = mEngine->getRenderableManager();
+    rcm.destroy(mRenderable);
+    auto rbuilder = RenderableManager::Builder(primitiveCount);
+    rbuilder.boundingBox({{ 0, 0, 0 }, { 10000, 10000, 10000 }}).culling(false);
+    for (size_t i = 0; i < primitiveCount; i++) {
+        rbuilder
+                .geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
+                        mVertexBuffers[0], mIndexBuffers[0], 0, 0)
+                .material(i, mMaterial->getDefaultInstance());
+    }
+    rbuilder.build(*mEngine, mRenderable);
+    mPrimitiveCount = primitiveCount;
+}
+
+MaterialInstance* ImGuiHelper::getMaterialInstance(MaterialKey const& key) {
+    size_t index = std::find(mMaterialKeys.begin(), mMaterialKeys.end(), key) -
+            mMaterialKeys.begin();
+    if (index < mMaterialKeys.size()) {
+        return mMaterialInstances[index];
+    }
+
+    // a new key takes an instance unused this frame, or a new one
+    index = std::find(mMaterialUsed.begin(), mMaterialUsed.end(), false) - mMaterialUsed.begin();
+    if (index == mMaterialInstances.size()) {
+        mMaterialInstances.push_back(mMaterial->createInstance());
+        mMaterialKeys.push_back(key);
+        mMaterialUsed.push_back(true);
     }
+    mMaterialKeys[index] = key;
+    mMaterialUsed[index] = true;
+
+    MaterialInstance* mi = mMaterialInstances[index];
+    uint32_t left = (key.scissor >> 0ull) & 0xffffull;
+    uint32_t bottom = (key.scissor >> 16ull) & 0xffffull;
+    uint32_t width = (key.scissor >> 32ull) & 0xffffull;
+    uint32_t height = (key.scissor >> 48ull) & 0xffffull;
+    mi->setScissor(left, bottom, width, height);
+    TextureSampler sampler(TextureSampler::MinFilter::LINEAR, TextureSampler::MagFilter::LINEAR);
+    mi->setParameter("albedo", key.texture, sampler);
+    return mi;
 }
 
 void ImGuiHelper::createVertexBuffer(size_t bufferIndex, size_t capacity) {
@@ -273,12 +313,13 @@ void ImGuiHelper::createBuffers(int numRequiredBuffers) {
 void ImGuiHelper::populateVertexData(size_t bufferIndex, size_t vbSizeInBytes, void* vbImguiData,
         size_t ibSizeInBytes, void* ibImguiData)
 {
-    // Create a new vertex buffer if the size isn't large enough, then copy the ImGui data into
-    // a staging area since Filament's render thread might consume the data at any time.
+    // Create a new vertex buffer if the size isn't large enough, doubling its capacity so that it
+    // rarely happens, then copy the ImGui data into a staging area since Filament's render
+    // thread might consume the data at any time.
     size_t requiredVertCount = vbSizeInBytes / sizeof(ImDrawVert);
     size_t capacityVertCount = mVertexBuffers[bufferIndex]->getVertexCount();
     if (requiredVertCount > capacityVertCount) {
-        createVertexBuffer(bufferIndex, requiredVertCount);
+        createVertexBuffer(bufferIndex, std::max(requiredVertCount, 2 * capacityVertCount));
     }
     size_t nVbBytes = requiredVertCount * sizeof(ImDrawVert);
     void* vbFilamentData = malloc(nVbBytes);
@@ -292,7 +333,7 @@ void ImGuiHelper::populateVertexData(size_t bufferIndex, size_t vbSizeInBytes, v
     size_t requiredIndexCount = ibSizeInBytes / 2;
     size_t capacityIndexCount = mIndexBuffers[bufferIndex]->getIndexCount();
     if (requiredIndexCount > capacityIndexCount) {
-        createIndexBuffer(bufferIndex, requiredIndexCount);
+        createIndexBuffer(bufferIndex, std::max(requiredIndexCount, 2 * capacityIndexCount));
     }
     size_t nIbBytes = requiredIndexCount * 2;
     void* ibFilamentData = malloc(nIbBytes);
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filagui/PerformanceHud.h>
+
+#include <imgui.h>
+
+#include <algorithm>
+
+#include <float.h>
+#include <stdio.h>
+
+using namespace filament;
+
+namespace filagui {
+
+static constexpr float MiB = 1.0f / (1024.0f * 1024.0f);
+
+PerformanceHud::PerformanceHud(Renderer* renderer, View* view)
+        : mRenderer(renderer), mView(view) {
+}
+
+void PerformanceHud::sample() noexcept {
+    Renderer::FrameSummary const summary = mRenderer->getFrameSummary();
+    if (summary.frameId == 0 || summary.frameId == mLastFrameId) {
+        return;
+    }
+    mLastFrameId = summary.frameId;
+
+    Engine* const engine = mRenderer->getEngine();
+    Renderer::CpuFrameStats const cpu = mRenderer->getCpuFrameStats();
+    Renderer::FrameStats const gpu = mRenderer->getFrameStats();
+    mCommandBufferStats = engine->getCommandBufferStats();
+    if (mCpuCountersEnabled) {
+        mCpuCounterStats = mRenderer->getCpuCounterStats();
+    }
+    if (++mFramesSinceMemoryStats >= MEMORY_REFRESH_INTERVAL) {
+        mFramesSinceMemoryStats = 0;
+        mMemoryStats = engine->getMemoryStats();
+    }
+
+    const size_t i = mNextSample;
+    mSamples[FRAME_INTERVAL][i] = summary.frameInterval;
+    mSamples[CPU_FRAME][i] = summary.cpuFrameTime;
+    mSamples[GPU_FRAME][i] = summary.gpuFrameTime;
+    mSamples[SCENE_PREPARE][i] = cpu.scenePrepare;
+    mSamples[CULLING][i] = cpu.culling;
+    mSamples[PARTITION][i] = cpu.partition;
+    mSamples[COMMAND_GENERATION][i] = cpu.commandGeneration;
+    mSamples[COMMAND_SORT][i] = cpu.commandSort;
+    mSamples[DRIVER_COMMANDS][i] = cpu.driverCommands;
+    mSamples[FROXELIZATION][i] = cpu.froxelization;
+    mSamples[SHADOW_PASS][i] = gpu.shadowPass;
+    mSamples[COLOR_PASS][i] = gpu.colorPass;
+    mSamples[POST_PROCESS][i] = gpu.postProcess;
+    mSamples[DRAW_COUNT][i] = float(summary.drawCount);
+    mSamples[STATE_CHANGE_COUNT][i] = float(summary.stateChangeCount);
+    mSamples[REDUNDANT_STATE_CHANGE_COUNT][i] = float(summary.redundantStateChangeCount);
+    mSamples[COMMAND_BUFFER_HIGH_WATERMARK][i] = float(mCommandBufferStats.highWatermark) * MiB;
+    // the area of the view that's rendered, relative to its full resolution
+    const math::float2 scale = mView ? mView->getDynamicResolutionScale() : math::float2(1.0f);
+    mSamples[DYNAMIC_RESOLUTION_SCALE][i] = scale.x * scale.y;
+
+    mNextSample = (mNextSample + 1) % SAMPLE_COUNT;
+    mSampleCount = std::min(mSampleCount + 1, SAMPLE_COUNT);
+}
+
+void PerformanceHud::plot(Series series, const char* label, const char* format) const {
+    float const* const samples = mSamples[series];
+    const float last = samples[(mNextSample + SAMPLE_COUNT - 1) % SAMPLE_COUNT];
+    float maximum = 0.0f;
+    for (size_t i = 0; i < SAMPLE_COUNT; i++) {
+        maximum = std::max(maximum, samples[i]);
+    }
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), format, last, maximum);
+    ImGui::PlotLines(label, samples, int(SAMPLE_COUNT), int(mNextSample), overlay,
+            0.0f, FLT_MAX, ImVec2(0.0f, 40.0f));
+}
+
+void PerformanceHud::draw() {
+    sample();
+
+    ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+    ImGui::SetNextWindowBgAlpha(0.6f);
+    if (!ImGui::Begin("Performance", nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::Text("frame %u, %zu frames plotted", mLastFrameId, mSampleCount);
+    if (ImGui::CollapsingHeader("Frame", ImGuiTreeNodeFlags_DefaultOpen)) {
+        plot(FRAME_INTERVAL, "interval", "%.2f ms (max %.2f)");
+        plot(CPU_FRAME, "cpu", "%.2f ms (max %.2f)");
+        plot(GPU_FRAME, "gpu", "%.2f ms (max %.2f)");
+    }
+
+    if (ImGui::CollapsingHeader("CPU stages")) {
+        plot(SCENE_PREPARE, "scene prepare", "%.3f ms (max %.3f)");
+        plot(CULLING, "culling", "%.3f ms (max %.3f)");
+        plot(PARTITION, "partition", "%.3f ms (max %.3f)");
+        plot(COMMAND_GENERATION, "command generation", "%.3f ms (max %.3f)");
+        plot(COMMAND_SORT, "command sort", "%.3f ms (max %.3f)");
+        plot(DRIVER_COMMANDS, "driver commands", "%.3f ms (max %.3f)");
+        plot(FROXELIZATION, "froxelization", "%.3f ms (max %.3f)");
+
+        if (ImGui::Checkbox("performance counters", &mCpuCountersEnabled)) {
+            mRenderer->setCpuCountersEnabled(mCpuCountersEnabled);
+            mCpuCounterStats = {};
+        }
+        if (mCpuCountersEnabled) {
+            if (mCpuCounterStats.frameCount == 0) {
+                ImGui::TextDisabled("not supported");
+            } else {
+                struct {
+                    const char* name;
+                    Renderer::CpuStageCounters const& counters;
+                } const stages[] = {
+                        { "scene prepare",      mCpuCounterStats.scenePrepare },
+                        { "culling",            mCpuCounterStats.culling },
+                        { "partition",          mCpuCounterStats.partition },
+                        { "command generation", mCpuCounterStats.commandGeneration },
+                        { "command sort",       mCpuCounterStats.commandSort },
+                        { "driver commands",    mCpuCounterStats.driverCommands },
+                        { "froxelization",      mCpuCounterStats.froxelization },
+                };
+                for (auto const& stage : stages) {
+                    ImGui::Text("%-18s IPC %4.2f, cache misses %5.2f%%, branch misses %5.2f%%",
+                            stage.name, stage.counters.ipc,
+                            stage.counters.cacheMissRate * 100.0f,
+                            stage.counters.branchMissRate * 100.0f);
+                }
+            }
+        }
+    }
+
+    if (ImGui::CollapsingHeader("GPU passes")) {
+        plot(SHADOW_PASS, "shadows", "%.3f ms (max %.3f)");
+        plot(COLOR_PASS, "color", "%.3f ms (max %.3f)");
+        plot(POST_PROCESS, "post-process", "%.3f ms (max %.3f)");
+    }
+
+    if (ImGui::CollapsingHeader("Draws")) {
+        plot(DRAW_COUNT, "draws", "%.0f (max %.0f)");
+        plot(STATE_CHANGE_COUNT, "state changes", "%.0f (max %.0f)");
+        plot(REDUNDANT_STATE_CHANGE_COUNT, "skipped changes", "%.0f (max %.0f)");
+    }
+
+    if (ImGui::CollapsingHeader("Command buffer")) {
+        plot(COMMAND_BUFFER_HIGH_WATERMARK, "high watermark", "%.2f MiB (max %.2f)");
+        ImGui::Text("capacity %.2f MiB, grew %u times",
+                mCommandBufferStats.capacity * MiB, mCommandBufferStats.growCount);
+        ImGui::Text("blocked %u times, %.2f ms", mCommandBufferStats.blockCount,
+                double(mCommandBufferStats.blockedTimeNs) * 1e-6);
+        ImGui::Text("draw commands high watermark %.2f MiB",
+                mRenderer->getCommandsHighWatermark() * MiB);
+    }
+
+    if (ImGui::CollapsingHeader("Memory")) {
+        Engine::MemoryStats const& m = mMemoryStats;
+        ImGui::Text("CPU");
+        ImGui::BulletText("render pass arena %.2f MiB", m.perRenderPassArena * MiB);
+        ImGui::BulletText("command buffer %.2f MiB", m.commandBuffer * MiB);
+        ImGui::BulletText("draw commands %.2f MiB", m.drawCommands * MiB);
+        ImGui::BulletText("job scratch %.2f MiB", m.jobScratch * MiB);
+        ImGui::BulletText("components %.2f MiB", m.componentManagers * MiB);
+        ImGui::BulletText("froxelizers %.2f MiB", m.froxelizers * MiB);
+        ImGui::BulletText("materials %.2f MiB (%u materials, %u instances, %u programs)",
+                m.materials * MiB, m.materialCount, m.materialInstanceCount, m.programCount);
+        ImGui::Text("GPU");
+        ImGui::BulletText("textures %.2f MiB", m.textures * MiB);
+        ImGui::BulletText("vertex buffers %.2f MiB", m.vertexBuffers * MiB);
+        ImGui::BulletText("index buffers %.2f MiB", m.indexBuffers * MiB);
+        ImGui::BulletText("render targets %.2f MiB", m.renderTargets * MiB);
+        ImGui::BulletText("shadow maps %.2f MiB", m.shadowMaps * MiB);
+        ImGui::BulletText("froxel buffers %.2f MiB", m.froxelBuffers * MiB);
+        ImGui::Text("Render target pool");
+        ImGui::BulletText("%u hits, %u misses, %u evictions",
+                m.renderTargetHits, m.renderTargetMisses, m.renderTargetEvictions);
+    }
+
+    if (mView && ImGui::CollapsingHeader("Dynamic resolution")) {
+        const math::float2 scale = mView->getDynamicResolutionScale();
+        ImGui::Text("scale %.2f x %.2f", scale.x, scale.y);
+        plot(DYNAMIC_RESOLUTION_SCALE, "area", "%.2f (max %.2f)");
+    }
+
+    ImGui::End();
+}
+
+} // namespace filagui
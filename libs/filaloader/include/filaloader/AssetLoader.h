@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILALOADER_ASSETLOADER_H_
+#define FILALOADER_ASSETLOADER_H_
+
+#include <filament/Engine.h>
+
+#include <utils/Entity.h>
+#include <utils/JobSystem.h>
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+class IndexBuffer;
+class Material;
+class MaterialInstance;
+class Texture;
+class VertexBuffer;
+} // namespace filament
+
+namespace filaloader {
+
+/*
+ * Loads filamesh files, textures and material packages without stalling the frames.
+ *
+ * The files are read and decoded by jobs of the Engine's JobSystem, at low priority so that
+ * they only use the time its threads don't spend on the frames. Each call to update(), once per
+ * frame on the Engine's thread, then creates the objects of the decoded assets, highest
+ * priority first, and hands their data to the Engine until the upload budget of the frame is
+ * spent. A single large asset is never held back: the first one of each frame is always
+ * uploaded.
+ *
+ * The callback of a request is called by update(), with the created object, or nullptr if the
+ * asset could not be loaded. The caller owns the objects, a loaded mesh must be destroyed with
+ * its buffers and its entity.
+ *
+ * All the methods must be called on the thread the Engine was created on.
+ *
+ *  AssetLoader loader(*engine);
+ *  loader.loadTexture("textures/albedo.png", {}, [&](AssetLoader::RequestId, Texture* t) {
+ *      if (t) { instance->setParameter("albedo", t, sampler); }
+ *  });
+ *
+ *  // at every frame
+ *  loader.update();
+ */
+class AssetLoader {
+public:
+    // identifies a request, 0 is never used
+    using RequestId = uint32_t;
+
+    struct Config {
+        // bytes handed to the Engine by each update(), at least one asset is always uploaded
+        size_t uploadBudget = 8 * 1024 * 1024;
+        // number of assets read and decoded at the same time
+        size_t maxConcurrentLoads = 4;
+    };
+
+    // Where an asset comes from: a file, or bytes the loader takes over (the name is only used
+    // for messages and to guess the format of images).
+    struct Source {
+        Source(const char* path) : name(path), isFile(true) { } // NOLINT
+        Source(std::string path) : name(std::move(path)), isFile(true) { } // NOLINT
+        Source(std::string name, std::vector<uint8_t> data)
+                : name(std::move(name)), data(std::move(data)), isFile(false) { }
+
+        std::string name;
+        std::vector<uint8_t> data;
+        bool isFile;
+    };
+
+    struct Mesh {
+        utils::Entity renderable;
+        filament::VertexBuffer* vertexBuffer = nullptr;
+        filament::IndexBuffer* indexBuffer = nullptr;
+    };
+
+    // material instances of a mesh, by the names of its materials. Parts whose material isn't
+    // found use "DefaultMaterial".
+    using MaterialMap = std::map<std::string, filament::MaterialInstance*>;
+
+    struct TextureOptions {
+        // 8-bit images with 3 or 4 channels are sRGB-encoded
+        bool srgb = true;
+        // computes the whole mip chain, on the CPU for 8-bit images
+        bool mipmaps = true;
+    };
+
+    // the mesh is only valid during the call
+    using MeshCallback = std::function<void(RequestId id, Mesh const* mesh)>;
+    using TextureCallback = std::function<void(RequestId id, filament::Texture* texture)>;
+    using MaterialCallback = std::function<void(RequestId id, filament::Material* material)>;
+
+    explicit AssetLoader(filament::Engine& engine);
+    AssetLoader(filament::Engine& engine, Config const& config);
+
+    // cancels the pending requests, and waits for the jobs decoding them
+    ~AssetLoader();
+
+    AssetLoader(AssetLoader const&) = delete;
+    AssetLoader& operator=(AssetLoader const&) = delete;
+
+    // Requests are decoded and uploaded highest priority first, in the order they're made for
+    // the same priority.
+    RequestId loadMesh(Source source, MaterialMap materials, MeshCallback callback,
+            int priority = 0);
+
+    // PNG, JPEG, TGA, BMP, PSD and GIF images become 8-bit textures of 1 to 4 channels, Radiance
+    // and OpenEXR images become half-float textures.
+    RequestId loadTexture(Source source, TextureOptions const& options,
+            TextureCallback callback, int priority = 0);
+
+    // loads a package created by matc
+    RequestId loadMaterial(Source source, MaterialCallback callback, int priority = 0);
+
+    // Drops a request, its callback won't be called. Returns false if the request isn't pending,
+    // e.g. it was already delivered.
+    bool cancel(RequestId id) noexcept;
+
+    // Delivers the loaded assets, within the upload budget, and starts loading the next ones.
+    // This must be called once per frame, it never waits for a job.
+    void update();
+
+    // number of requests not delivered yet
+    size_t getPendingCount() const noexcept { return mRequests.size(); }
+
+private:
+    struct Request;
+
+    RequestId enqueue(Request* request);
+    void startLoads();
+    bool upload(Request& request);
+    void deliver(Request& request, bool succeeded);
+    static void decode(Request& request) noexcept;
+
+    filament::Engine& mEngine;
+    utils::JobSystem& mJobSystem;
+    utils::JobSystem::Job* mParent = nullptr;  // parent of all the jobs, waited on at the end
+    const Config mConfig;
+    std::vector<Request*> mRequests;
+    RequestId mNextId = 1;
+};
+
+} // namespace filaloader
+
+#endif /* FILALOADER_ASSETLOADER_H_ */
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILALOADER_PVSBAKER_H_
+#define FILALOADER_PVSBAKER_H_
+
+#include <filament/Box.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filaloader {
+
+/*
+ * Computes a filament::PotentiallyVisibleSet, offline or when a scene is loaded.
+ *
+ * The bounds of the scene are divided in cells of Config::cellSize, and an object is visible
+ * from a cell if a segment between a point of the cell and a point of the object's bounding box
+ * doesn't go through an occluder. Occluders are boxes that block the view entirely, such as the
+ * walls, floors and ceilings of a building. The points are sampled on a regular grid, so very
+ * thin openings can be missed, the cells should be smaller than the openings.
+ *
+ * The cost is O(cells x objects x occluders), this is meant to be baked once and stored, the
+ * result can be written to a file as is and memory mapped later.
+ *
+ *  PvsBaker baker;
+ *  for (auto const& wall : walls) {
+ *      baker.addOccluder(wall.box);
+ *  }
+ *  for (auto const& object : objects) {
+ *      baker.addObject(object.worldBox);
+ *  }
+ *  std::vector<uint32_t> data = baker.bake();
+ *  PotentiallyVisibleSet pvs(data.data(), data.size() * sizeof(uint32_t));
+ *  view->setPotentiallyVisibleSet(&pvs, entities.data(), entities.size());
+ */
+class PvsBaker {
+public:
+    struct Config {
+        // size of the cells, in world units
+        float cellSize = 2.0f;
+        // points sampled along each axis of a cell
+        uint32_t samplesPerAxis = 2;
+        // the cells are made larger if the bounds would need more than this many cells
+        uint32_t maxCellCount = 65536;
+    };
+
+    PvsBaker() noexcept;
+    explicit PvsBaker(Config const& config) noexcept;
+
+    // Adds an object, returns its index in the set. Objects can be occluders too.
+    size_t addObject(filament::Box const& worldBox);
+
+    // Adds a box that blocks the view.
+    void addOccluder(filament::Box const& worldBox);
+
+    // Sets the bounds of the grid, by default they're the bounds of the objects and occluders.
+    // The set has no effect when the camera is outside of them.
+    void setBounds(filament::Box const& worldBox) noexcept;
+
+    size_t getObjectCount() const noexcept { return mObjects.size(); }
+
+    // Computes the set, its data is the returned array.
+    std::vector<uint32_t> bake() const;
+
+private:
+    const Config mConfig;
+    std::vector<filament::Aabb> mObjects;
+    std::vector<filament::Aabb> mOccluders;
+    filament::Aabb mBounds;
+    bool mHasBounds = false;
+};
+
+} // namespace filaloader
+
+#endif /* FILALOADER_PVSBAKER_H_ */
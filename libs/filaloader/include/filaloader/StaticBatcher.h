@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FILALOADER_STATICBATCHER_H_
+#define FILALOADER_STATICBATCHER_H_
+
+#include <filament/Engine.h>
+
+#include <utils/Entity.h>
+
+#include <math/mat4.h>
+#include <math/quat.h>
+#include <math/vec2.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace filament {
+class IndexBuffer;
+class MaterialInstance;
+class VertexBuffer;
+} // namespace filament
+
+namespace filaloader {
+
+/*
+ * Merges the geometry of many small static meshes into a few renderables.
+ *
+ * Each mesh added is transformed to world space, and the meshes with the same material instance,
+ * the same attributes and the same shadow settings are stored in shared vertex and index buffers.
+ * These meshes are then clustered by their position, each cluster becoming a renderable with a
+ * single primitive, so that the merged geometry can still be culled. A cluster grows until its
+ * bounding box would be larger than Config::clusterSize.
+ *
+ * The engine doesn't keep a copy of the buffers it's given, so the batcher works from the data
+ * the meshes are created from, it can't merge renderables that already exist.
+ *
+ *  StaticBatcher batcher;
+ *  for (auto const& rock : rocks) {
+ *      batcher.add(rock.geometry, rock.transform, rockMaterial);
+ *  }
+ *  StaticBatcher::Result batches = batcher.build(*engine);
+ *  scene->addEntities(batches.renderables.data(), batches.renderables.size());
+ */
+class StaticBatcher {
+public:
+    struct Config {
+        // largest extent, in world units, of the bounding box of a cluster
+        float clusterSize = 16.0f;
+        // shadow settings of the meshes added without their own
+        bool castShadows = false;
+        bool receiveShadows = true;
+    };
+
+    // A mesh, all the arrays have vertexCount elements, the optional ones may be null. The data
+    // is copied by add().
+    struct Geometry {
+        math::float3 const* positions = nullptr;
+        math::quatf const* tangents = nullptr;  // tangent frames, see VertexAttribute::TANGENTS
+        math::float4 const* colors = nullptr;
+        math::float2 const* uv0 = nullptr;
+        math::float2 const* uv1 = nullptr;
+        size_t vertexCount = 0;
+        uint32_t const* indices = nullptr;      // triangles
+        size_t indexCount = 0;
+    };
+
+    // objects created by build(), owned by the caller
+    struct Result {
+        std::vector<utils::Entity> renderables;
+        std::vector<filament::VertexBuffer*> vertexBuffers;
+        std::vector<filament::IndexBuffer*> indexBuffers;
+    };
+
+    StaticBatcher() noexcept;
+    explicit StaticBatcher(Config const& config) noexcept;
+    ~StaticBatcher();
+
+    StaticBatcher(StaticBatcher const&) = delete;
+    StaticBatcher& operator=(StaticBatcher const&) = delete;
+
+    // Adds a mesh, returns false if its geometry is invalid (no positions, or indices out of
+    // range). The shadows settings of the Config can be overridden for each mesh.
+    bool add(Geometry const& geometry, math::mat4f const& transform,
+            filament::MaterialInstance const* materialInstance) noexcept;
+    bool add(Geometry const& geometry, math::mat4f const& transform,
+            filament::MaterialInstance const* materialInstance,
+            bool castShadows, bool receiveShadows) noexcept;
+
+    size_t getMeshCount() const noexcept { return mMeshes.size(); }
+
+    // Creates the buffers and the renderables of all the meshes added, and forgets them.
+    Result build(filament::Engine& engine);
+
+private:
+    struct Mesh;
+
+    const Config mConfig;
+    std::vector<Mesh*> mMeshes;
+};
+
+} // namespace filaloader
+
+#endif /* FILALOADER_STATICBATCHER_H_ */
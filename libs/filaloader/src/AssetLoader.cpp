@@ -0,0 +1,789 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filaloader/AssetLoader.h>
+
+#include <filament/Box.h>
+#include <filament/IndexBuffer.h>
+#include <filament/Material.h>
+#include <filament/MaterialInstance.h>
+#include <filament/RenderableManager.h>
+#include <filament/Texture.h>
+#include <filament/VertexBuffer.h>
+
+#include <image/Mipmaps.h>
+
+#include <imageio/ImageDecoder.h>
+
+#include <utils/EntityManager.h>
+#include <utils/Log.h>
+
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+#include <algorithm>
+#include <atomic>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <streambuf>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace filament;
+using namespace utils;
+
+namespace filaloader {
+
+namespace {
+
+// The bytes of an asset. They're released once every buffer referencing them has been
+// uploaded, which happens on the driver thread.
+struct Blob {
+    std::vector<uint8_t> bytes;
+    std::atomic<int> refs = { 1 };
+
+    void acquire() noexcept {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+        }
+    }
+
+    static void releaseCallback(void*, size_t, void* user) {
+        static_cast<Blob*>(user)->release();
+    }
+};
+
+// istream over the bytes of a blob, for the image decoders
+class MemoryBuffer : public std::streambuf {
+public:
+    MemoryBuffer(uint8_t const* data, size_t size) {
+        char* const begin = const_cast<char*>(reinterpret_cast<char const*>(data));
+        setg(begin, begin, begin + size);
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+            std::ios_base::openmode which) override {
+        char* const base = dir == std::ios_base::beg ? eback() :
+                           dir == std::ios_base::cur ? gptr() : egptr();
+        if (!(which & std::ios_base::in) || base + off < eback() || base + off > egptr()) {
+            return pos_type(off_type(-1));
+        }
+        setg(eback(), base + off, egptr());
+        return pos_type(gptr() - eback());
+    }
+
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+// The layout of a filamesh file, see tools/filamesh. Versions 2, 3 and 4 append fields to the
+// header, and the vertex and index data are aligned on pages from version 2.
+struct FilameshHeader {
+    uint32_t version;
+    uint32_t parts;
+    Box      aabb;
+    uint32_t interleaved;
+    uint32_t offsetPosition;
+    uint32_t stridePosition;
+    uint32_t offsetTangents;
+    uint32_t strideTangents;
+    uint32_t offsetColor;
+    uint32_t strideColor;
+    uint32_t offsetUV0;
+    uint32_t strideUV0;
+    uint32_t offsetUV1;
+    uint32_t strideUV1;
+    uint32_t vertexCount;
+    uint32_t vertexSize;
+    uint32_t indexType;
+    uint32_t indexCount;
+    uint32_t indexSize;
+};
+
+struct FilameshPart {
+    uint32_t offset;
+    uint32_t indexCount;
+    uint32_t minIndex;
+    uint32_t maxIndex;
+    uint32_t materialID;
+    Box      aabb;
+};
+
+struct FilameshLodPart {
+    uint32_t offset;
+    uint32_t indexCount;
+    float    error;
+};
+
+// a filamesh file, pointing into its bytes
+struct Filamesh {
+    FilameshHeader header = {};
+    uint32_t lodCount = 1;
+    uint32_t packedTangents = 0;    // see getters.vs
+    uint8_t const* vertices = nullptr;
+    uint8_t const* indices = nullptr;
+    std::vector<FilameshPart> parts;
+    std::vector<std::string> materials;
+    std::vector<FilameshLodPart> lodParts;   // (lodCount - 1) levels of parts
+};
+
+// reads a file without trusting it, every read past the end fails
+class Reader {
+public:
+    Reader(uint8_t const* data, size_t size) noexcept : mData(data), mSize(size) { }
+
+    bool failed() const noexcept { return mFailed; }
+    size_t remaining() const noexcept { return mFailed ? 0 : mSize - mOffset; }
+
+    uint8_t const* skip(size_t size) noexcept {
+        if (size > remaining()) {
+            mFailed = true;
+            return nullptr;
+        }
+        uint8_t const* p = mData + mOffset;
+        mOffset += size;
+        return p;
+    }
+
+    template<typename T>
+    bool read(T* out, size_t count = 1) noexcept {
+        if (count > remaining() / sizeof(T)) {
+            mFailed = true;
+            return false;
+        }
+        memcpy(out, skip(count * sizeof(T)), count * sizeof(T));
+        return true;
+    }
+
+    void seek(size_t offset) noexcept {
+        if (offset > mSize) {
+            mFailed = true;
+        }
+        mOffset = std::min(offset, mSize);
+    }
+
+    void align(size_t alignment) noexcept {
+        seek((mOffset + alignment - 1) & ~(alignment - 1));
+    }
+
+private:
+    uint8_t const* mData;
+    size_t mSize;
+    size_t mOffset = 0;
+    bool mFailed = false;
+};
+
+bool parseFilamesh(uint8_t const* data, size_t size, Filamesh& mesh) noexcept {
+    Reader reader(data, size);
+    char magic[8];
+    if (!reader.read(magic, sizeof(magic)) || memcmp(magic, "FILAMESH", sizeof(magic)) != 0) {
+        return false;
+    }
+
+    FilameshHeader& header = mesh.header;
+    uint32_t offsetVertexData = 0;
+    uint32_t offsetIndexData = 0;
+    reader.read(&header);
+    if (header.version >= 2) {
+        reader.read(&offsetVertexData);
+        reader.read(&offsetIndexData);
+    }
+    if (header.version >= 3) {
+        reader.read(&mesh.lodCount);
+    }
+    if (header.version >= 4) {
+        reader.read(&mesh.packedTangents);
+    }
+    const size_t indexSize = header.indexType ? sizeof(uint16_t) : sizeof(uint32_t);
+    if (reader.failed() || header.parts == 0 || header.vertexCount == 0 ||
+            size_t(header.indexCount) * indexSize != header.indexSize ||
+            mesh.lodCount == 0 || mesh.lodCount > std::numeric_limits<uint8_t>::max()) {
+        return false;
+    }
+
+    if (header.version >= 2) {
+        reader.seek(offsetVertexData);
+    }
+    mesh.vertices = reader.skip(header.vertexSize);
+    if (header.version >= 2) {
+        reader.seek(offsetIndexData);
+    }
+    mesh.indices = reader.skip(header.indexSize);
+    if (header.version >= 2) {
+        reader.align(4);
+    }
+
+    // the counts are checked against what's left before anything is allocated
+    if (header.parts > reader.remaining() / sizeof(FilameshPart)) {
+        return false;
+    }
+    mesh.parts.resize(header.parts);
+    reader.read(mesh.parts.data(), mesh.parts.size());
+
+    uint32_t materialCount = 0;
+    reader.read(&materialCount);
+    if (materialCount > reader.remaining() / sizeof(uint32_t)) {
+        return false;
+    }
+    mesh.materials.resize(materialCount);
+    for (std::string& name : mesh.materials) {
+        uint32_t length = 0;
+        reader.read(&length);
+        // names are null terminated
+        char const* p = reinterpret_cast<char const*>(reader.skip(size_t(length) + 1));
+        if (!p) {
+            return false;
+        }
+        name.assign(p, length);
+    }
+
+    // the parts of the levels of detail follow the material names, unaligned
+    const size_t lodPartCount = size_t(mesh.lodCount - 1) * header.parts;
+    if (lodPartCount > reader.remaining() / sizeof(FilameshLodPart)) {
+        return false;
+    }
+    mesh.lodParts.resize(lodPartCount);
+    reader.read(mesh.lodParts.data(), mesh.lodParts.size());
+    return !reader.failed();
+}
+
+// a decoded image, the levels are tightly packed one after the other in the blob
+struct TextureData {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint8_t channels = 0;
+    uint8_t levels = 1;             // levels in the blob
+    bool isFloat = false;
+    bool generateMipmaps = false;   // the other levels are generated by the GPU
+};
+
+Texture::Format getPixelFormat(size_t channels) noexcept {
+    static constexpr Texture::Format FORMATS[] = {
+            Texture::Format::R, Texture::Format::RG, Texture::Format::RGB, Texture::Format::RGBA
+    };
+    return FORMATS[channels - 1];
+}
+
+Texture::InternalFormat getInternalFormat(TextureData const& data, bool srgb) noexcept {
+    using InternalFormat = Texture::InternalFormat;
+    switch (data.channels) {
+        case 1: return data.isFloat ? InternalFormat::R16F : InternalFormat::R8;
+        case 2: return data.isFloat ? InternalFormat::RG16F : InternalFormat::RG8;
+        case 3: return data.isFloat ? InternalFormat::RGB16F :
+                       (srgb ? InternalFormat::SRGB8 : InternalFormat::RGB8);
+        default: return data.isFloat ? InternalFormat::RGBA16F :
+                       (srgb ? InternalFormat::SRGB8_A8 : InternalFormat::RGBA8);
+    }
+}
+
+bool readFile(std::string const& path, std::vector<uint8_t>& bytes) noexcept {
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    bool succeeded = fseek(file, 0, SEEK_END) == 0;
+    const long size = ftell(file);
+    succeeded = succeeded && size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (succeeded) {
+        bytes.resize(size_t(size));
+        succeeded = fread(bytes.data(), 1, bytes.size(), file) == bytes.size();
+    }
+    fclose(file);
+    return succeeded;
+}
+
+} // anonymous namespace
+
+struct AssetLoader::Request {
+    enum class Type : uint8_t {
+        MESH, TEXTURE, MATERIAL
+    };
+
+    // written by the job once it's done, read by update()
+    enum State : uint8_t {
+        QUEUED, LOADING, DECODED, FAILED
+    };
+
+    Request(Type type, Source&& source, int priority)
+            : type(type), priority(priority), source(std::move(source)) { }
+
+    ~Request() {
+        if (blob) {
+            blob->release();
+        }
+    }
+
+    RequestId id = 0;
+    const Type type;
+    const int priority;
+    Source source;
+    std::atomic<uint8_t> state = { QUEUED };
+    bool cancelled = false;
+
+    // the decoded asset
+    Blob* blob = nullptr;
+    size_t uploadSize = 0;
+    Filamesh mesh;
+    TextureData texture;
+
+    MaterialMap materials;
+    TextureOptions options;
+    MeshCallback onMesh;
+    TextureCallback onTexture;
+    MaterialCallback onMaterial;
+};
+
+AssetLoader::AssetLoader(Engine& engine) : AssetLoader(engine, Config()) {
+}
+
+AssetLoader::AssetLoader(Engine& engine, Config const& config)
+        : mEngine(engine), mJobSystem(engine.getJobSystem()), mConfig(config) {
+}
+
+AssetLoader::~AssetLoader() {
+    for (Request* request : mRequests) {
+        request->cancelled = true;
+    }
+    if (mParent) {
+        mJobSystem.runAndWait(mParent);
+        mJobSystem.release(mParent);
+    }
+    for (Request* request : mRequests) {
+        delete request;
+    }
+}
+
+AssetLoader::RequestId AssetLoader::enqueue(Request* request) {
+    request->id = mNextId++;
+    if (mNextId == 0) {
+        mNextId = 1;
+    }
+    mRequests.push_back(request);
+    startLoads();
+    return request->id;
+}
+
+AssetLoader::RequestId AssetLoader::loadMesh(Source source, MaterialMap materials,
+        MeshCallback callback, int priority) {
+    Request* request = new Request(Request::Type::MESH, std::move(source), priority);
+    request->materials = std::move(materials);
+    request->onMesh = std::move(callback);
+    return enqueue(request);
+}
+
+AssetLoader::RequestId AssetLoader::loadTexture(Source source, TextureOptions const& options,
+        TextureCallback callback, int priority) {
+    Request* request = new Request(Request::Type::TEXTURE, std::move(source), priority);
+    request->options = options;
+    request->onTexture = std::move(callback);
+    return enqueue(request);
+}
+
+AssetLoader::RequestId AssetLoader::loadMaterial(Source source, MaterialCallback callback,
+        int priority) {
+    Request* request = new Request(Request::Type::MATERIAL, std::move(source), priority);
+    request->onMaterial = std::move(callback);
+    return enqueue(request);
+}
+
+bool AssetLoader::cancel(RequestId id) noexcept {
+    auto pos = std::find_if(mRequests.begin(), mRequests.end(),
+            [id](Request const* request) { return request->id == id; });
+    if (pos == mRequests.end() || (*pos)->cancelled) {
+        return false;
+    }
+    // a request being decoded is dropped once its job is done with it
+    (*pos)->cancelled = true;
+    return true;
+}
+
+void AssetLoader::decode(Request& request) noexcept {
+    Blob* blob = new Blob;
+    request.blob = blob;
+    if (request.source.isFile) {
+        if (!readFile(request.source.name, blob->bytes)) {
+            slog.e << "AssetLoader: can't read " << request.source.name << io::endl;
+            request.state.store(Request::FAILED, std::memory_order_release);
+            return;
+        }
+    } else {
+        std::swap(blob->bytes, request.source.data);
+    }
+
+    bool succeeded = true;
+    switch (request.type) {
+        case Request::Type::MESH: {
+            Filamesh& mesh = request.mesh;
+            succeeded = parseFilamesh(blob->bytes.data(), blob->bytes.size(), mesh);
+            request.uploadSize = mesh.header.vertexSize + mesh.header.indexSize;
+            break;
+        }
+        case Request::Type::TEXTURE: {
+            TextureData& texture = request.texture;
+            uint8_t const* data = blob->bytes.data();
+            const int size = int(std::min(blob->bytes.size(),
+                    size_t(std::numeric_limits<int>::max())));
+            int w, h, n;
+            if (!stbi_is_hdr_from_memory(data, size) &&
+                    stbi_info_from_memory(data, size, &w, &h, &n)) {
+                stbi_uc* pixels = stbi_load_from_memory(data, size, &w, &h, &n, 0);
+                if (!pixels) {
+                    succeeded = false;
+                    break;
+                }
+                texture.width = uint32_t(w);
+                texture.height = uint32_t(h);
+                texture.channels = uint8_t(n);
+                texture.levels = uint8_t(request.options.mipmaps ?
+                        image::getMipmapCount(texture.width, texture.height) : 1);
+
+                // the levels are computed here, rather than by the engine on its thread
+                std::vector<uint8_t*> levels(texture.levels);
+                std::vector<size_t> sizes(texture.levels);
+                size_t total = 0;
+                for (size_t i = 0; i < texture.levels; i++) {
+                    sizes[i] = image::getMipmapSize(texture.width, texture.height, size_t(n), i);
+                    total += sizes[i];
+                }
+                Blob* levelsBlob = new Blob;
+                levelsBlob->bytes.resize(total);
+                uint8_t* p = levelsBlob->bytes.data();
+                for (size_t i = 0; i < texture.levels; i++) {
+                    levels[i] = p;
+                    p += sizes[i];
+                }
+                memcpy(levels[0], pixels, sizes[0]);
+                stbi_image_free(pixels);
+                if (texture.levels > 1) {
+                    // sRGB only applies to the color channels
+                    const bool srgb = request.options.srgb && n >= 3;
+                    image::generateMipmaps(levels[0], texture.width, texture.height, size_t(n),
+                            levels.data() + 1, texture.levels,
+                            srgb ? image::MipmapEncoding::SRGB : image::MipmapEncoding::LINEAR);
+                }
+                blob->release();
+                request.blob = blob = levelsBlob;
+                request.uploadSize = total;
+            } else {
+                // the floats are decoded straight into the blob uploaded to the texture
+                MemoryBuffer buffer(data, blob->bytes.size());
+                std::istream stream(&buffer);
+                Blob* pixels = new Blob;
+                image::Image decoded = image::ImageDecoder::decode(stream, request.source.name,
+                        [pixels](size_t, size_t height, size_t, size_t& bytesPerRow) -> void* {
+                            pixels->bytes.resize(bytesPerRow * height);
+                            return pixels->bytes.data();
+                        },
+                        request.options.srgb ? image::ImageDecoder::ColorSpace::SRGB :
+                                               image::ImageDecoder::ColorSpace::LINEAR);
+                if (!decoded.isValid() || decoded.getChannelsCount() < 1 ||
+                        decoded.getChannelsCount() > 4) {
+                    pixels->release();
+                    succeeded = false;
+                    break;
+                }
+                texture.width = uint32_t(decoded.getWidth());
+                texture.height = uint32_t(decoded.getHeight());
+                texture.channels = uint8_t(decoded.getChannelsCount());
+                texture.isFloat = true;
+                texture.generateMipmaps = request.options.mipmaps;
+                blob->release();
+                request.blob = blob = pixels;
+                request.uploadSize = pixels->bytes.size();
+            }
+            break;
+        }
+        case Request::Type::MATERIAL:
+            // the package is parsed by the engine, on its thread
+            request.uploadSize = blob->bytes.size();
+            succeeded = !blob->bytes.empty();
+            break;
+    }
+
+    if (!succeeded) {
+        slog.e << "AssetLoader: can't decode " << request.source.name << io::endl;
+    }
+    request.state.store(succeeded ? Request::DECODED : Request::FAILED,
+            std::memory_order_release);
+}
+
+void AssetLoader::startLoads() {
+    size_t loading = 0;
+    std::vector<Request*> queued;
+    for (Request* request : mRequests) {
+        const uint8_t state = request->state.load(std::memory_order_relaxed);
+        if (state == Request::LOADING) {
+            loading++;
+        } else if (state == Request::QUEUED && !request->cancelled) {
+            queued.push_back(request);
+        }
+    }
+    if (loading >= mConfig.maxConcurrentLoads || queued.empty()) {
+        return;
+    }
+
+    // highest priority first, then in the order of the requests
+    std::sort(queued.begin(), queued.end(), [](Request const* lhs, Request const* rhs) {
+        return lhs->priority != rhs->priority ? lhs->priority > rhs->priority : lhs->id < rhs->id;
+    });
+
+    JobSystem& js = mJobSystem;
+    if (!mParent) {
+        mParent = js.createJob();
+    }
+    const size_t count = std::min(queued.size(), mConfig.maxConcurrentLoads - loading);
+    for (size_t i = 0; i < count; i++) {
+        Request* request = queued[i];
+        request->state.store(Request::LOADING, std::memory_order_relaxed);
+        JobSystem::Job* job = js.createJob(mParent, [request](JobSystem&, JobSystem::Job*) {
+            decode(*request);
+        });
+        // the loads don't delay the jobs of the frames
+        js.runAndRelease(job, JobSystem::LOW_PRIORITY);
+    }
+}
+
+bool AssetLoader::upload(Request& request) {
+    Engine& engine = mEngine;
+    Blob* const blob = request.blob;
+
+    switch (request.type) {
+        case Request::Type::MESH: {
+            Filamesh const& mesh = request.mesh;
+            FilameshHeader const& header = mesh.header;
+
+            // all the materials are looked up before anything is created
+            std::vector<MaterialInstance*> instances(mesh.parts.size());
+            auto const defaultMaterial = request.materials.find("DefaultMaterial");
+            for (size_t i = 0; i < mesh.parts.size(); i++) {
+                const uint32_t materialID = mesh.parts[i].materialID;
+                auto pos = materialID < mesh.materials.size() ?
+                        request.materials.find(mesh.materials[materialID]) :
+                        request.materials.end();
+                if (pos == request.materials.end()) {
+                    pos = defaultMaterial;
+                }
+                if (pos == request.materials.end()) {
+                    slog.e << "AssetLoader: no material for " << request.source.name << io::endl;
+                    return false;
+                }
+                instances[i] = pos->second;
+            }
+
+            Mesh result;
+            result.indexBuffer = IndexBuffer::Builder()
+                    .indexCount(header.indexCount)
+                    .bufferType(header.indexType ? IndexBuffer::IndexType::USHORT
+                                                 : IndexBuffer::IndexType::UINT)
+                    .build(engine);
+
+            // the data is not copied, the blob is released once it's been uploaded
+            blob->acquire();
+            result.indexBuffer->setBuffer(engine,
+                    IndexBuffer::BufferDescriptor(mesh.indices, header.indexSize,
+                            &Blob::releaseCallback, blob));
+
+            // packed tangent frames are read without normalization
+            VertexBuffer::Builder vbb;
+            if (!mesh.packedTangents) {
+                vbb.normalized(VertexAttribute::TANGENTS);
+            }
+            vbb.vertexCount(header.vertexCount)
+                    .bufferCount(1)
+                    .normalized(VertexAttribute::COLOR)
+                    .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4,
+                            header.offsetPosition, uint8_t(header.stridePosition))
+                    .attribute(VertexAttribute::TANGENTS, 0, mesh.packedTangents ?
+                            VertexBuffer::AttributeType::INT_2_10_10_10_REV :
+                            VertexBuffer::AttributeType::SHORT4,
+                            header.offsetTangents, uint8_t(header.strideTangents))
+                    .attribute(VertexAttribute::COLOR,    0, VertexBuffer::AttributeType::UBYTE4,
+                            header.offsetColor, uint8_t(header.strideColor))
+                    .attribute(VertexAttribute::UV0,      0, VertexBuffer::AttributeType::HALF2,
+                            header.offsetUV0, uint8_t(header.strideUV0));
+            if (header.offsetUV1 != std::numeric_limits<uint32_t>::max() &&
+                    header.strideUV1 != std::numeric_limits<uint32_t>::max()) {
+                vbb.attribute(VertexAttribute::UV1,   0, VertexBuffer::AttributeType::HALF2,
+                        header.offsetUV1, uint8_t(header.strideUV1));
+            }
+            result.vertexBuffer = vbb.build(engine);
+
+            blob->acquire();
+            result.vertexBuffer->setBufferAt(engine, 0,
+                    VertexBuffer::BufferDescriptor(mesh.vertices, header.vertexSize,
+                            &Blob::releaseCallback, blob));
+
+            RenderableManager::Builder builder(header.parts);
+            builder.boundingBox(header.aabb);
+            builder.levelCount(uint8_t(mesh.lodCount));
+            for (size_t i = 0; i < mesh.parts.size(); i++) {
+                FilameshPart const& part = mesh.parts[i];
+                builder.geometry(i, RenderableManager::PrimitiveType::TRIANGLES,
+                        result.vertexBuffer, result.indexBuffer, part.offset,
+                        part.minIndex, part.maxIndex, part.indexCount);
+                builder.material(i, instances[i]);
+            }
+            for (uint8_t level = 1; level < mesh.lodCount; level++) {
+                for (size_t i = 0; i < mesh.parts.size(); i++) {
+                    FilameshLodPart const& part =
+                            mesh.lodParts[(level - 1) * mesh.parts.size() + i];
+                    builder.lodGeometry(level, i, RenderableManager::PrimitiveType::TRIANGLES,
+                            result.vertexBuffer, result.indexBuffer, part.offset, part.indexCount);
+                }
+            }
+            result.renderable = EntityManager::get().create();
+            builder.build(engine, result.renderable);
+
+            if (request.onMesh) {
+                request.onMesh(request.id, &result);
+            }
+            return true;
+        }
+
+        case Request::Type::TEXTURE: {
+            TextureData const& data = request.texture;
+            const uint8_t levels = data.generateMipmaps ?
+                    uint8_t(image::getMipmapCount(data.width, data.height)) : data.levels;
+            Texture* texture = Texture::Builder()
+                    .width(data.width)
+                    .height(data.height)
+                    .levels(levels)
+                    .format(getInternalFormat(data, request.options.srgb))
+                    .build(engine);
+
+            const Texture::Format format = getPixelFormat(data.channels);
+            const Texture::Type type = data.isFloat ? Texture::Type::FLOAT : Texture::Type::UBYTE;
+            uint8_t const* p = blob->bytes.data();
+            for (size_t i = 0; i < data.levels; i++) {
+                const size_t size = data.isFloat ? blob->bytes.size() :
+                        image::getMipmapSize(data.width, data.height, data.channels, i);
+                blob->acquire();
+                texture->setImage(engine, i, Texture::PixelBufferDescriptor(p, size,
+                        format, type, &Blob::releaseCallback, blob));
+                p += size;
+            }
+            if (data.generateMipmaps && levels > 1) {
+                texture->generateMipmaps(engine);
+            }
+
+            if (request.onTexture) {
+                request.onTexture(request.id, texture);
+            }
+            return true;
+        }
+
+        case Request::Type::MATERIAL: {
+            // the package is referenced, not copied
+            blob->acquire();
+            Material* material = Material::Builder()
+                    .package(blob->bytes.data(), blob->bytes.size(), &Blob::releaseCallback, blob)
+                    .build(engine);
+            if (!material) {
+                slog.e << "AssetLoader: invalid material " << request.source.name << io::endl;
+                return false;
+            }
+            if (request.onMaterial) {
+                request.onMaterial(request.id, material);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void AssetLoader::deliver(Request& request, bool succeeded) {
+    if (succeeded && upload(request)) {
+        return;
+    }
+    switch (request.type) {
+        case Request::Type::MESH:
+            if (request.onMesh) {
+                request.onMesh(request.id, nullptr);
+            }
+            break;
+        case Request::Type::TEXTURE:
+            if (request.onTexture) {
+                request.onTexture(request.id, nullptr);
+            }
+            break;
+        case Request::Type::MATERIAL:
+            if (request.onMaterial) {
+                request.onMaterial(request.id, nullptr);
+            }
+            break;
+    }
+}
+
+void AssetLoader::update() {
+    // the finished requests are taken out first, the callbacks can make or cancel requests
+    std::vector<Request*> done;
+    auto const finished = [&done](Request* request) {
+        const uint8_t state = request->state.load(std::memory_order_acquire);
+        if (state == Request::LOADING) {
+            return false;
+        }
+        if (request->cancelled) {
+            delete request;
+            return true;
+        }
+        if (state == Request::QUEUED) {
+            return false;
+        }
+        done.push_back(request);
+        return true;
+    };
+    mRequests.erase(std::remove_if(mRequests.begin(), mRequests.end(), finished),
+            mRequests.end());
+
+    std::sort(done.begin(), done.end(), [](Request const* lhs, Request const* rhs) {
+        return lhs->priority != rhs->priority ? lhs->priority > rhs->priority : lhs->id < rhs->id;
+    });
+
+    // the failures don't cost anything, the uploads stop once the budget is spent
+    size_t spent = 0;
+    auto const fits = [this, &spent](Request const* request) {
+        if (request->state.load(std::memory_order_relaxed) == Request::FAILED) {
+            return true;
+        }
+        if (spent > 0 && spent + request->uploadSize > mConfig.uploadBudget) {
+            return false;
+        }
+        spent += std::max(request->uploadSize, size_t(1));
+        return true;
+    };
+    auto const deferred = std::stable_partition(done.begin(), done.end(), fits);
+    // what doesn't fit waits for the next frame, in front of the newer requests
+    mRequests.insert(mRequests.begin(), deferred, done.end());
+    done.erase(deferred, done.end());
+
+    for (Request* request : done) {
+        std::unique_ptr<Request> r(request);
+        deliver(*r, r->state.load(std::memory_order_relaxed) == Request::DECODED);
+    }
+
+    startLoads();
+}
+
+} // namespace filaloader
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filaloader/PvsBaker.h>
+
+#include <filament/PotentiallyVisibleSet.h>
+
+#include <math/vec3.h>
+
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <string.h>
+
+using namespace filament;
+using namespace math;
+using namespace utils;
+
+namespace filaloader {
+
+static bool contains(Aabb const& box, float3 const& p) noexcept {
+    return p.x >= box.min.x && p.y >= box.min.y && p.z >= box.min.z &&
+           p.x <= box.max.x && p.y <= box.max.y && p.z <= box.max.z;
+}
+
+static bool overlaps(Aabb const& a, Aabb const& b) noexcept {
+    return a.min.x <= b.max.x && a.min.y <= b.max.y && a.min.z <= b.max.z &&
+           b.min.x <= a.max.x && b.min.y <= a.max.y && b.min.z <= a.max.z;
+}
+
+// returns whether the segment [p, p + d] intersects the box (slab test)
+static bool intersects(Aabb const& box, float3 const& p, float3 const& d) noexcept {
+    float t0 = 0.0f;
+    float t1 = 1.0f;
+    for (size_t i = 0; i < 3; i++) {
+        if (std::abs(d[i]) < 1e-12f) {
+            if (p[i] < box.min[i] || p[i] > box.max[i]) {
+                return false;
+            }
+            continue;
+        }
+        const float inv = 1.0f / d[i];
+        float ta = (box.min[i] - p[i]) * inv;
+        float tb = (box.max[i] - p[i]) * inv;
+        if (ta > tb) std::swap(ta, tb);
+        t0 = std::max(t0, ta);
+        t1 = std::min(t1, tb);
+        if (t0 > t1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+PvsBaker::PvsBaker() noexcept : PvsBaker(Config{}) {
+}
+
+PvsBaker::PvsBaker(Config const& config) noexcept : mConfig(config) {
+}
+
+size_t PvsBaker::addObject(Box const& worldBox) {
+    mObjects.push_back({ worldBox.getMin(), worldBox.getMax() });
+    return mObjects.size() - 1;
+}
+
+void PvsBaker::addOccluder(Box const& worldBox) {
+    mOccluders.push_back({ worldBox.getMin(), worldBox.getMax() });
+}
+
+void PvsBaker::setBounds(Box const& worldBox) noexcept {
+    mBounds = { worldBox.getMin(), worldBox.getMax() };
+    mHasBounds = true;
+}
+
+std::vector<uint32_t> PvsBaker::bake() const {
+    Aabb bounds = mBounds;
+    if (!mHasBounds) {
+        for (Aabb const& box : mObjects) {
+            bounds.min = min(bounds.min, box.min);
+            bounds.max = max(bounds.max, box.max);
+        }
+        for (Aabb const& box : mOccluders) {
+            bounds.min = min(bounds.min, box.min);
+            bounds.max = max(bounds.max, box.max);
+        }
+    }
+    if (!(bounds.min.x < bounds.max.x &&
+          bounds.min.y < bounds.max.y &&
+          bounds.min.z < bounds.max.z)) {
+        slog.e << "PvsBaker: the bounds are empty" << io::endl;
+        return {};
+    }
+
+    // the cells are grown until there are few enough of them
+    const float3 extent = bounds.max - bounds.min;
+    float cellSize = std::max(mConfig.cellSize, 1e-3f);
+    uint32_t cellCount[3];
+    size_t totalCellCount;
+    do {
+        for (size_t i = 0; i < 3; i++) {
+            cellCount[i] = std::max(1u, uint32_t(std::ceil(extent[i] / cellSize)));
+        }
+        totalCellCount = size_t(cellCount[0]) * cellCount[1] * cellCount[2];
+        cellSize *= 1.25f;
+    } while (totalCellCount > std::max(1u, mConfig.maxCellCount));
+
+    const size_t objectCount = mObjects.size();
+    const size_t wordsPerCell = (objectCount + 31) / 32;
+    const size_t size = PotentiallyVisibleSet::getSize(objectCount, totalCellCount);
+    std::vector<uint32_t> data(size / sizeof(uint32_t), 0);
+
+    PotentiallyVisibleSet::Header header = {};
+    header.magic = PotentiallyVisibleSet::MAGIC;
+    header.objectCount = uint32_t(objectCount);
+    for (size_t i = 0; i < 3; i++) {
+        header.cellCount[i] = cellCount[i];
+        header.min[i] = bounds.min[i];
+        header.max[i] = bounds.max[i];
+    }
+    memcpy(data.data(), &header, sizeof(header));
+    uint32_t* const bits = data.data() + sizeof(header) / sizeof(uint32_t);
+
+    // the points sampled in the objects: their center and their corners, moved slightly inside
+    // so that they're not on the faces of the occluders the objects lie against
+    auto getObjectPoints = [](Aabb const& box, float3 points[9]) {
+        const float3 center = box.center();
+        const float3 halfExtent = (box.max - box.min) * (0.5f * 0.98f);
+        points[0] = center;
+        for (size_t i = 0; i < 8; i++) {
+            points[i + 1] = center + halfExtent * float3{
+                    i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f };
+        }
+    };
+
+    // an occluder hides what's behind it, unless the camera or the object is inside of it
+    auto isBlocked = [this](float3 const& p, float3 const& q) {
+        const float3 d = q - p;
+        for (Aabb const& occluder : mOccluders) {
+            if (intersects(occluder, p, d) && !contains(occluder, p) && !contains(occluder, q)) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    const float3 cellExtent = extent / float3{
+            float(cellCount[0]), float(cellCount[1]), float(cellCount[2]) };
+    const uint32_t n = std::max(1u, mConfig.samplesPerAxis);
+    std::vector<float3> cellPoints;
+    cellPoints.reserve(n * n * n);
+
+    for (uint32_t z = 0, cell = 0; z < cellCount[2]; z++) {
+        for (uint32_t y = 0; y < cellCount[1]; y++) {
+            for (uint32_t x = 0; x < cellCount[0]; x++, cell++) {
+                const float3 cellMin =
+                        bounds.min + cellExtent * float3{ float(x), float(y), float(z) };
+                const Aabb cellBox = { cellMin, cellMin + cellExtent };
+
+                cellPoints.clear();
+                for (uint32_t k = 0; k < n * n * n; k++) {
+                    const float3 k3{ float(k % n), float((k / n) % n), float(k / (n * n)) };
+                    const float3 t = (k3 + 0.5f) / float(n);
+                    cellPoints.push_back(cellMin + cellExtent * t);
+                }
+
+                uint32_t* const cellBits = bits + cell * wordsPerCell;
+                for (size_t o = 0; o < objectCount; o++) {
+                    Aabb const& object = mObjects[o];
+                    bool visible = overlaps(cellBox, object);
+                    float3 objectPoints[9];
+                    getObjectPoints(object, objectPoints);
+                    for (size_t i = 0; !visible && i < cellPoints.size(); i++) {
+                        for (size_t j = 0; !visible && j < 9; j++) {
+                            visible = !isBlocked(cellPoints[i], objectPoints[j]);
+                        }
+                    }
+                    if (visible) {
+                        cellBits[o / 32] |= 1u << (o % 32);
+                    }
+                }
+            }
+        }
+    }
+
+    return data;
+}
+
+} // namespace filaloader
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <filaloader/StaticBatcher.h>
+
+#include <filament/Box.h>
+#include <filament/IndexBuffer.h>
+#include <filament/RenderableManager.h>
+#include <filament/VertexBuffer.h>
+
+#include <math/mat3.h>
+#include <math/norm.h>
+
+#include <utils/EntityManager.h>
+#include <utils/Log.h>
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+
+#include <stdlib.h>
+#include <string.h>
+
+using namespace filament;
+using namespace math;
+using namespace utils;
+
+namespace filaloader {
+
+// the optional attributes of a mesh, the meshes of a group have the same ones
+enum : uint8_t {
+    HAS_TANGENTS    = 0x1,
+    HAS_COLORS      = 0x2,
+    HAS_UV0         = 0x4,
+    HAS_UV1         = 0x8,
+};
+
+// a mesh, already in world space and in the formats of the merged buffers
+struct StaticBatcher::Mesh {
+    MaterialInstance const* materialInstance;
+    uint8_t attributes;
+    bool castShadows;
+    bool receiveShadows;
+    float3 min;
+    float3 max;
+    uint32_t order = 0;     // position along a Morton curve in the bounds of its group
+    std::vector<float3> positions;
+    std::vector<short4> tangents;
+    std::vector<ubyte4> colors;
+    std::vector<float2> uv0;
+    std::vector<float2> uv1;
+    std::vector<uint32_t> indices;
+
+    bool sameGroup(Mesh const& rhs) const noexcept {
+        return materialInstance == rhs.materialInstance && attributes == rhs.attributes &&
+               castShadows == rhs.castShadows && receiveShadows == rhs.receiveShadows;
+    }
+};
+
+namespace {
+
+// the shaders compute the bitangent as cross(n, t) * sign(w)
+quatf transformTangentFrame(quatf const& q, mat3f const& m, mat3f const& normalMatrix) noexcept {
+    const mat3f frame(q);
+    const float3 b = cross(frame[2], frame[0]) * (q.w < 0.0f ? -1.0f : 1.0f);
+    const float3 n = normalize(normalMatrix * frame[2]);
+    float3 t = m * frame[0];
+    t = normalize(t - n * dot(n, t));
+    // packTangentFrame() makes w negative when dot(cross(t, n), b) < 0
+    const float sign = dot(cross(n, t), m * b) < 0.0f ? -1.0f : 1.0f;
+    return mat3f::packTangentFrame({ t, cross(t, n) * sign, n });
+}
+
+// spreads the 10 lower bits of v, two zeros between each
+uint32_t spreadBits(uint32_t v) noexcept {
+    v &= 0x3FFu;
+    v = (v | (v << 16u)) & 0x030000FFu;
+    v = (v | (v <<  8u)) & 0x0300F00Fu;
+    v = (v | (v <<  4u)) & 0x030C30C3u;
+    v = (v | (v <<  2u)) & 0x09249249u;
+    return v;
+}
+
+void freeCallback(void* buffer, size_t, void*) {
+    free(buffer);
+}
+
+} // anonymous namespace
+
+StaticBatcher::StaticBatcher() noexcept : StaticBatcher(Config{}) {
+}
+
+StaticBatcher::StaticBatcher(Config const& config) noexcept : mConfig(config) {
+}
+
+StaticBatcher::~StaticBatcher() {
+    for (Mesh* mesh : mMeshes) {
+        delete mesh;
+    }
+}
+
+bool StaticBatcher::add(Geometry const& geometry, mat4f const& transform,
+        MaterialInstance const* materialInstance) noexcept {
+    return add(geometry, transform, materialInstance,
+            mConfig.castShadows, mConfig.receiveShadows);
+}
+
+bool StaticBatcher::add(Geometry const& geometry, mat4f const& transform,
+        MaterialInstance const* materialInstance,
+        bool castShadows, bool receiveShadows) noexcept {
+    const size_t vertexCount = geometry.vertexCount;
+    if (!geometry.positions || vertexCount == 0 || !geometry.indices ||
+            geometry.indexCount % 3 != 0 || !materialInstance) {
+        slog.e << "StaticBatcher: invalid geometry" << io::endl;
+        return false;
+    }
+    for (size_t i = 0; i < geometry.indexCount; i++) {
+        if (geometry.indices[i] >= vertexCount) {
+            slog.e << "StaticBatcher: index out of range" << io::endl;
+            return false;
+        }
+    }
+
+    Mesh* mesh = new Mesh;
+    mesh->materialInstance = materialInstance;
+    mesh->attributes = uint8_t((geometry.tangents ? HAS_TANGENTS : 0) |
+                               (geometry.colors   ? HAS_COLORS   : 0) |
+                               (geometry.uv0      ? HAS_UV0      : 0) |
+                               (geometry.uv1      ? HAS_UV1      : 0));
+    mesh->castShadows = castShadows;
+    mesh->receiveShadows = receiveShadows;
+    mesh->min = std::numeric_limits<float>::max();
+    mesh->max = std::numeric_limits<float>::lowest();
+
+    mesh->positions.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        const float3 p = (transform * float4(geometry.positions[i], 1.0f)).xyz;
+        mesh->positions[i] = p;
+        mesh->min = min(mesh->min, p);
+        mesh->max = max(mesh->max, p);
+    }
+    if (geometry.tangents) {
+        const mat3f m = transform.upperLeft();
+        const mat3f normalMatrix = transpose(inverse(m));
+        mesh->tangents.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            mesh->tangents[i] = packSnorm16(
+                    transformTangentFrame(geometry.tangents[i], m, normalMatrix).xyzw);
+        }
+    }
+    if (geometry.colors) {
+        mesh->colors.resize(vertexCount);
+        for (size_t i = 0; i < vertexCount; i++) {
+            mesh->colors[i] = packUnorm8(clamp(geometry.colors[i], 0.0f, 1.0f));
+        }
+    }
+    if (geometry.uv0) {
+        mesh->uv0.assign(geometry.uv0, geometry.uv0 + vertexCount);
+    }
+    if (geometry.uv1) {
+        mesh->uv1.assign(geometry.uv1, geometry.uv1 + vertexCount);
+    }
+    mesh->indices.assign(geometry.indices, geometry.indices + geometry.indexCount);
+
+    mMeshes.push_back(mesh);
+    return true;
+}
+
+StaticBatcher::Result StaticBatcher::build(Engine& engine) {
+    Result result;
+
+    // the meshes of a group are next to each other
+    std::stable_sort(mMeshes.begin(), mMeshes.end(), [](Mesh const* lhs, Mesh const* rhs) {
+        if (lhs->materialInstance != rhs->materialInstance) {
+            return lhs->materialInstance < rhs->materialInstance;
+        }
+        if (lhs->attributes != rhs->attributes) {
+            return lhs->attributes < rhs->attributes;
+        }
+        return uint8_t(lhs->castShadows | lhs->receiveShadows << 1) <
+               uint8_t(rhs->castShadows | rhs->receiveShadows << 1);
+    });
+
+    for (auto first = mMeshes.begin(); first != mMeshes.end();) {
+        auto last = std::find_if(first, mMeshes.end(),
+                [first](Mesh const* mesh) { return !mesh->sameGroup(**first); });
+
+        // the meshes close to each other are next to each other along a Morton curve
+        float3 groupMin = std::numeric_limits<float>::max();
+        float3 groupMax = std::numeric_limits<float>::lowest();
+        for (auto it = first; it != last; ++it) {
+            groupMin = min(groupMin, (*it)->min);
+            groupMax = max(groupMax, (*it)->max);
+        }
+        const float3 scale = 1023.0f / max(groupMax - groupMin, float3(1e-6f));
+        for (auto it = first; it != last; ++it) {
+            const uint3 q = uint3((((*it)->min + (*it)->max) * 0.5f - groupMin) * scale);
+            (*it)->order = spreadBits(q.x) | (spreadBits(q.y) << 1u) | (spreadBits(q.z) << 2u);
+        }
+        std::stable_sort(first, last,
+                [](Mesh const* lhs, Mesh const* rhs) { return lhs->order < rhs->order; });
+
+        size_t vertexCount = 0;
+        size_t indexCount = 0;
+        for (auto it = first; it != last; ++it) {
+            vertexCount += (*it)->positions.size();
+            indexCount += (*it)->indices.size();
+        }
+
+        // the positions are alone in the first buffer, for the depth and shadow passes
+        Mesh const& leader = **first;
+        const uint8_t attributes = leader.attributes;
+        const uint32_t tangentsOffset = 0;
+        const uint32_t colorsOffset = tangentsOffset +
+                uint32_t(attributes & HAS_TANGENTS ? sizeof(short4) : 0);
+        const uint32_t uv0Offset = colorsOffset +
+                uint32_t(attributes & HAS_COLORS ? sizeof(ubyte4) : 0);
+        const uint32_t uv1Offset = uv0Offset +
+                uint32_t(attributes & HAS_UV0 ? sizeof(float2) : 0);
+        const uint32_t stride = uv1Offset +
+                uint32_t(attributes & HAS_UV1 ? sizeof(float2) : 0);
+
+        const bool shortIndices = vertexCount <= std::numeric_limits<uint16_t>::max();
+        const size_t indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+
+        float3* const positions = static_cast<float3*>(malloc(vertexCount * sizeof(float3)));
+        uint8_t* const vertices = stride ? static_cast<uint8_t*>(malloc(vertexCount * stride))
+                                         : nullptr;
+        uint8_t* const indices = static_cast<uint8_t*>(malloc(indexCount * indexSize));
+
+        VertexBuffer::Builder vbb;
+        vbb.vertexCount(uint32_t(vertexCount))
+                .bufferCount(uint8_t(stride ? 2 : 1))
+                .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::FLOAT3)
+                .depthBuffer(0);
+        if (attributes & HAS_TANGENTS) {
+            vbb.attribute(VertexAttribute::TANGENTS, 1, VertexBuffer::AttributeType::SHORT4,
+                    tangentsOffset, uint8_t(stride)).normalized(VertexAttribute::TANGENTS);
+        }
+        if (attributes & HAS_COLORS) {
+            vbb.attribute(VertexAttribute::COLOR, 1, VertexBuffer::AttributeType::UBYTE4,
+                    colorsOffset, uint8_t(stride)).normalized(VertexAttribute::COLOR);
+        }
+        if (attributes & HAS_UV0) {
+            vbb.attribute(VertexAttribute::UV0, 1, VertexBuffer::AttributeType::FLOAT2,
+                    uv0Offset, uint8_t(stride));
+        }
+        if (attributes & HAS_UV1) {
+            vbb.attribute(VertexAttribute::UV1, 1, VertexBuffer::AttributeType::FLOAT2,
+                    uv1Offset, uint8_t(stride));
+        }
+        VertexBuffer* vb = vbb.build(engine);
+        IndexBuffer* ib = IndexBuffer::Builder()
+                .indexCount(uint32_t(indexCount))
+                .bufferType(shortIndices ? IndexBuffer::IndexType::USHORT
+                                         : IndexBuffer::IndexType::UINT)
+                .build(engine);
+        result.vertexBuffers.push_back(vb);
+        result.indexBuffers.push_back(ib);
+
+        // each cluster is a renderable drawing a range of the shared buffers
+        uint32_t vertexOffset = 0;
+        uint32_t indexOffset = 0;
+        for (auto it = first; it != last;) {
+            float3 clusterMin = (*it)->min;
+            float3 clusterMax = (*it)->max;
+            auto end = it + 1;
+            while (end != last) {
+                const float3 extent = max(clusterMax, (*end)->max) - min(clusterMin, (*end)->min);
+                if (std::max(extent.x, std::max(extent.y, extent.z)) > mConfig.clusterSize) {
+                    break;
+                }
+                clusterMin = min(clusterMin, (*end)->min);
+                clusterMax = max(clusterMax, (*end)->max);
+                ++end;
+            }
+
+            const uint32_t firstVertex = vertexOffset;
+            const uint32_t firstIndex = indexOffset;
+            for (; it != end; ++it) {
+                Mesh const& mesh = **it;
+                const size_t count = mesh.positions.size();
+                std::copy(mesh.positions.begin(), mesh.positions.end(), positions + vertexOffset);
+                for (size_t i = 0; i < count && stride; i++) {
+                    uint8_t* const vertex = vertices + (vertexOffset + i) * stride;
+                    if (attributes & HAS_TANGENTS) {
+                        memcpy(vertex + tangentsOffset, &mesh.tangents[i], sizeof(short4));
+                    }
+                    if (attributes & HAS_COLORS) {
+                        memcpy(vertex + colorsOffset, &mesh.colors[i], sizeof(ubyte4));
+                    }
+                    if (attributes & HAS_UV0) {
+                        memcpy(vertex + uv0Offset, &mesh.uv0[i], sizeof(float2));
+                    }
+                    if (attributes & HAS_UV1) {
+                        memcpy(vertex + uv1Offset, &mesh.uv1[i], sizeof(float2));
+                    }
+                }
+                for (uint32_t index : mesh.indices) {
+                    if (shortIndices) {
+                        reinterpret_cast<uint16_t*>(indices)[indexOffset++] =
+                                uint16_t(index + vertexOffset);
+                    } else {
+                        reinterpret_cast<uint32_t*>(indices)[indexOffset++] =
+                                index + vertexOffset;
+                    }
+                }
+                vertexOffset += uint32_t(count);
+            }
+
+            Entity entity = EntityManager::get().create();
+            RenderableManager::Builder(1)
+                    .boundingBox(Box().set(clusterMin, clusterMax))
+                    .geometry(0, RenderableManager::PrimitiveType::TRIANGLES, vb, ib,
+                            firstIndex, firstVertex, vertexOffset - 1, indexOffset - firstIndex)
+                    .material(0, leader.materialInstance)
+                    .castShadows(leader.castShadows)
+                    .receiveShadows(leader.receiveShadows)
+                    .build(engine, entity);
+            result.renderables.push_back(entity);
+        }
+
+        // the Engine frees the data once it's uploaded
+        vb->setBufferAt(engine, 0, VertexBuffer::BufferDescriptor(
+                positions, vertexCount * sizeof(float3), &freeCallback));
+        if (stride) {
+            vb->setBufferAt(engine, 1, VertexBuffer::BufferDescriptor(
+                    vertices, vertexCount * stride, &freeCallback));
+        }
+        ib->setBuffer(engine, IndexBuffer::BufferDescriptor(
+                indices, indexCount * indexSize, &freeCallback));
+
+        first = last;
+    }
+
+    for (Mesh* mesh : mMeshes) {
+        delete mesh;
+    }
+    mMeshes.clear();
+    return result;
+}
+
+} // namespace filaloader
@@ -99,8 +99,15 @@ public:
     using SamplerPrecision = filament::driver::Precision;
     using CullingMode = filament::driver::CullingMode;
 
+    // Image based lighting evaluated by lit materials
+    enum class IblMode : uint8_t {
+        FULL,       // diffuse spherical harmonics and specular reflections (default)
+        SH_ONLY,    // diffuse spherical harmonics only, the reflections cubemap is never sampled
+        NONE        // no image based lighting at all
+    };
+
     // Each shader generated while building the package content can be post-processed via this
-    // callback.
+    // callback. The shaders are built in parallel, so the callback must be thread-safe.
     MaterialBuilder& postProcessor(PostProcessCallBack callback);
 
     // set name of this material
@@ -178,6 +185,21 @@ public:
     // specifies how transparent objects should be rendered (default is DEFAULT)
     MaterialBuilder& transparencyMode(TransparencyMode mode) noexcept;
 
+    // allows the post-processor to demote values to mediump on mobile when it doesn't lose
+    // precision (enabled by default)
+    MaterialBuilder& precisionLowering(bool enable) noexcept;
+
+    // selects the image based lighting compiled in lit materials (FULL by default)
+    MaterialBuilder& ibl(IblMode mode) noexcept;
+
+    // enable/disable point and spot lights (enabled by default). When disabled, the dynamic
+    // lighting variants aren't generated and the material ignores these lights.
+    MaterialBuilder& punctualLights(bool enable) noexcept;
+
+    // enable/disable the specular occlusion derived from the ambient occlusion (enabled by
+    // default, never used on mobile)
+    MaterialBuilder& specularAmbientOcclusion(bool enable) noexcept;
+
     // specifies desktop vs mobile; works in concert with TargetApi to determine the shader models
     // (used to generate code) and final output representations (spirv and/or text).
     MaterialBuilder& platform(Platform platform) noexcept;
@@ -246,6 +268,14 @@ public:
 
     uint8_t getVariantFilter() const { return mVariantFilter; }
 
+    bool isPrecisionLoweringEnabled() const noexcept { return mPrecisionLowering; }
+
+    IblMode getIblMode() const noexcept { return mIblMode; }
+
+    bool hasPunctualLights() const noexcept { return mPunctualLights; }
+
+    bool hasSpecularAmbientOcclusion() const noexcept { return mSpecularAmbientOcclusion; }
+
 private:
     void prepareToBuild(MaterialInfo& info) noexcept;
 
@@ -268,6 +298,7 @@ private:
     Interpolation mInterpolation = Interpolation::SMOOTH;
     VertexDomain mVertexDomain = VertexDomain::OBJECT;
     TransparencyMode mTransparencyMode = TransparencyMode::DEFAULT;
+    IblMode mIblMode = IblMode::FULL;
 
     filament::AttributeBitset mRequiredAttributes;
 
@@ -282,6 +313,9 @@ private:
     bool mDepthTest = true;
     bool mDepthWrite = true;
     bool mDepthWriteSet = false;
+    bool mPrecisionLowering = true;
+    bool mPunctualLights = true;
+    bool mSpecularAmbientOcclusion = true;
 
     PostProcessCallBack mPostprocessorCallback = nullptr;
 };
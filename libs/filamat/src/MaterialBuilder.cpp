@@ -18,6 +18,7 @@
 
 #include <vector>
 
+#include <utils/JobSystem.h>
 #include <utils/Panic.h>
 #include <utils/Log.h>
 
@@ -243,6 +244,26 @@ MaterialBuilder& MaterialBuilder::transparencyMode(TransparencyMode mode) noexce
     return *this;
 }
 
+MaterialBuilder& MaterialBuilder::precisionLowering(bool enable) noexcept {
+    mPrecisionLowering = enable;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::ibl(IblMode mode) noexcept {
+    mIblMode = mode;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::punctualLights(bool enable) noexcept {
+    mPunctualLights = enable;
+    return *this;
+}
+
+MaterialBuilder& MaterialBuilder::specularAmbientOcclusion(bool enable) noexcept {
+    mSpecularAmbientOcclusion = enable;
+    return *this;
+}
+
 MaterialBuilder& MaterialBuilder::platform(Platform platform) noexcept {
     mPlatform = platform;
     return *this;
@@ -310,6 +331,10 @@ void MaterialBuilder::prepareToBuild(MaterialInfo& info) noexcept {
     info.blendingMode = mBlendingMode;
     info.shading = mShading;
     info.hasShadowMultiplier = mShadowMultiplier;
+    info.hasIbl = mIblMode != IblMode::NONE;
+    info.hasIblSpecular = mIblMode == IblMode::FULL;
+    info.hasPunctualLights = mPunctualLights;
+    info.hasSpecularAmbientOcclusion = mSpecularAmbientOcclusion;
     info.samplerBindings.populate(&info.sib);
 }
 
@@ -359,6 +384,9 @@ Package MaterialBuilder::build() noexcept {
         container.addChild(&matShadowMultiplier);
     }
 
+    SimpleFieldChunk<bool> matPunctualLights(ChunkType::MaterialPunctualLights, mPunctualLights);
+    container.addChild(&matPunctualLights);
+
     SimpleFieldChunk<uint8_t> matTransparency(ChunkType::MaterialTransparencyMode,
             static_cast<uint8_t>(mTransparencyMode));
     container.addChild(&matTransparency);
@@ -425,7 +453,6 @@ Package MaterialBuilder::build() noexcept {
     std::vector<SpirvEntry> spirvEntries;
     LineDictionary glslDictionary;
     BlobDictionary spirvDictionary;
-    std::vector<uint32_t> spirv;
 
     ShaderGenerator sg(mProperties, mVariables,
             mMaterialCode, mMaterialLineOffset, mMaterialVertexCode, mMaterialVertexLineOffset);
@@ -436,19 +463,17 @@ Package MaterialBuilder::build() noexcept {
     SimpleFieldChunk<bool> hasCustomDepth(ChunkType::MaterialHasCustomDepthShader, customDepth);
     container.addChild(&hasCustomDepth);
 
-    bool errorOccured = false;
+    // List all the shaders to generate, in the order they're stored in the package.
+    struct Shader {
+        CodeGenParams const* params;
+        uint8_t variant;
+        filament::driver::ShaderType stage;
+        bool ok = true;
+        std::string code;
+        std::vector<uint32_t> spirv;
+    };
+    std::vector<Shader> shaders;
     for (const auto& params : mCodeGenPermutations) {
-        const ShaderModel shaderModel = ShaderModel(params.shaderModel);
-        const TargetApi targetApi = params.targetApi;
-        const TargetApi codeGenTargetApi = params.codeGenTargetApi;
-        std::vector<uint32_t>* pSpirv = (targetApi == TargetApi::VULKAN) ? &spirv : nullptr;
-
-        GlslEntry glslEntry;
-        SpirvEntry spirvEntry;
-
-        glslEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-        spirvEntry.shaderModel = static_cast<uint8_t>(params.shaderModel);
-
         // apply custom variants filters
         uint8_t variantMask = ~mVariantFilter;
 
@@ -458,74 +483,94 @@ Package MaterialBuilder::build() noexcept {
                 continue;
             }
 
-            glslEntry.variant = k;
-            spirvEntry.variant = k;
+            // instancing only replaces the model to world transform, which other vertex
+            // domains don't use
+            if (filament::Variant(k).hasInstancing() && mVertexDomain != VertexDomain::OBJECT) {
+                continue;
+            }
 
-            // Remove variants for unlit materials
-            uint8_t v = filament::Variant::filterVariant(k & variantMask, isLit() || mShadowMultiplier);
+            // Remove variants for unlit materials, and the dynamic lighting variants when
+            // punctual lights are disabled (the engine filters them out the same way)
+            uint8_t v = filament::Variant::filterVariant(k & variantMask,
+                    isLit() || mShadowMultiplier, mPunctualLights);
 
             if (filament::Variant::filterVariantVertex(v) == k) {
-                // Vertex Shader
-                std::string vs = sg.createVertexProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k,
-                        mInterpolation, mVertexDomain);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(vs, filament::driver::ShaderType::VERTEX,
-                            shaderModel, &vs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::VERTEX, vs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::VERTEX;
-                    glslEntry.shaderSize = vs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, vs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::VERTEX;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                shaders.push_back({ &params, k, filament::driver::ShaderType::VERTEX });
             }
-
             if (filament::Variant::filterVariantFragment(v) == k) {
-                // Fragment Shader
-                std::string fs = sg.createFragmentProgram(
-                        shaderModel, targetApi, codeGenTargetApi, info, k, mInterpolation);
-                if (mPostprocessorCallback != nullptr) {
-                    bool ok = mPostprocessorCallback(fs, filament::driver::ShaderType::FRAGMENT,
-                            shaderModel, &fs, pSpirv);
-                    if (!ok) {
-                        showErrorMessage(mMaterialName.c_str_safe(), k, targetApi,
-                                filament::driver::ShaderType::FRAGMENT, fs);
-                        errorOccured = true;
-                        break;
-                    }
-                }
-                if (targetApi == TargetApi::OPENGL) {
-                    glslEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    glslEntry.shaderSize = fs.size();
-                    glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
-                    strcpy(glslEntry.shader, fs.c_str());
-                    glslDictionary.addText(glslEntry.shader);
-                    glslEntries.push_back(glslEntry);
-                }
-                if (targetApi == TargetApi::VULKAN) {
-                    assert(spirv.size() > 0);
-                    spirvEntry.stage = filament::driver::ShaderType::FRAGMENT;
-                    spirvEntry.dictionaryIndex = spirvDictionary.addBlob(spirv);
-                    spirv.clear();
-                    spirvEntries.push_back(spirvEntry);
-                }
+                shaders.push_back({ &params, k, filament::driver::ShaderType::FRAGMENT });
+            }
+        }
+    }
+
+    // Generating and post-processing the shaders is independent for each of them, and by far
+    // the most expensive part of the build, so it runs on all cores. The post-processor callback
+    // is called concurrently.
+    auto generate = [this, &sg, &info](Shader* const shaders, uint32_t count) {
+        for (Shader* shader = shaders; shader != shaders + count; ++shader) {
+            const ShaderModel shaderModel = ShaderModel(shader->params->shaderModel);
+            const TargetApi targetApi = shader->params->targetApi;
+            const TargetApi codeGenTargetApi = shader->params->codeGenTargetApi;
+            if (shader->stage == filament::driver::ShaderType::VERTEX) {
+                shader->code = sg.createVertexProgram(shaderModel, targetApi, codeGenTargetApi,
+                        info, shader->variant, mInterpolation, mVertexDomain);
+            } else {
+                shader->code = sg.createFragmentProgram(shaderModel, targetApi, codeGenTargetApi,
+                        info, shader->variant, mInterpolation);
             }
+            if (mPostprocessorCallback != nullptr) {
+                std::vector<uint32_t>* pSpirv =
+                        (targetApi == TargetApi::VULKAN) ? &shader->spirv : nullptr;
+                shader->ok = mPostprocessorCallback(shader->code, shader->stage,
+                        shaderModel, &shader->code, pSpirv);
+            }
+        }
+    };
+
+    JobSystem js;
+    js.adopt();
+    JobSystem::Job* job = jobs::parallel_for(js, nullptr, shaders.data(), uint32_t(shaders.size()),
+            std::cref(generate), jobs::CountSplitter<1, 8>());
+    js.run(job);
+    js.waitAndRelease(job);
+    js.emancipate();
+
+    // The shaders are added to the dictionaries in order, so that the package's content doesn't
+    // depend on how the jobs were scheduled. An error skips the remaining variants of its
+    // permutation.
+    bool errorOccured = false;
+    CodeGenParams const* failedParams = nullptr;
+    for (Shader& shader : shaders) {
+        if (shader.params == failedParams) {
+            continue;
+        }
+        const TargetApi targetApi = shader.params->targetApi;
+        if (!shader.ok) {
+            showErrorMessage(mMaterialName.c_str_safe(), shader.variant, targetApi,
+                    shader.stage, shader.code);
+            errorOccured = true;
+            failedParams = shader.params;
+            continue;
+        }
+        if (targetApi == TargetApi::OPENGL) {
+            GlslEntry glslEntry;
+            glslEntry.shaderModel = static_cast<uint8_t>(shader.params->shaderModel);
+            glslEntry.variant = shader.variant;
+            glslEntry.stage = shader.stage;
+            glslEntry.shaderSize = shader.code.size();
+            glslEntry.shader = (char*)malloc(glslEntry.shaderSize + 1);
+            strcpy(glslEntry.shader, shader.code.c_str());
+            glslDictionary.addText(glslEntry.shader);
+            glslEntries.push_back(glslEntry);
+        }
+        if (targetApi == TargetApi::VULKAN) {
+            assert(shader.spirv.size() > 0);
+            SpirvEntry spirvEntry;
+            spirvEntry.shaderModel = static_cast<uint8_t>(shader.params->shaderModel);
+            spirvEntry.variant = shader.variant;
+            spirvEntry.stage = shader.stage;
+            spirvEntry.dictionaryIndex = spirvDictionary.addBlob(shader.spirv);
+            spirvEntries.push_back(spirvEntry);
         }
     }
 
@@ -16,6 +16,8 @@
 
 #include "DictionarySpirvChunk.h"
 
+#include <private/filament/SpirvCompression.h>
+
 namespace filamat {
 
 DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary& dictionary) :
@@ -23,12 +25,15 @@ DictionarySpirvChunk::DictionarySpirvChunk(BlobDictionary& dictionary) :
 }
 
 void DictionarySpirvChunk::flatten(Flattener& f) {
-    // TODO: for now the compression option is always 0, fix this.
-    f.writeUint32(0);
+    f.writeUint32(uint32_t(filament::SpirvCompression::VARINT));
     f.writeUint32(mDictionary.getBlobCount());
+    std::vector<uint8_t> compressed;
     for (size_t i = 0 ; i < mDictionary.getBlobCount() ; i++) {
         const std::string& blob = mDictionary.getBlob(i);
-        f.writeBlob(blob.data(), blob.size());
+        compressed.clear();
+        filament::SpirvCompressor::compress(reinterpret_cast<uint32_t const*>(blob.data()),
+                blob.size() / sizeof(uint32_t), compressed);
+        f.writeBlob(reinterpret_cast<char const*>(compressed.data()), compressed.size());
     }
 }
 
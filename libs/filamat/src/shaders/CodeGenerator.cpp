@@ -34,7 +34,7 @@ std::ostream& CodeGenerator::generateSeparator(std::ostream& out) const {
 }
 
 std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
-        bool hasExternalSamplers) const {
+        bool hasExternalSamplers, bool hasStereo) const {
     assert(mShaderModel != ShaderModel::UNKNOWN);
     switch (mShaderModel) {
         case ShaderModel::UNKNOWN:
@@ -64,6 +64,18 @@ std::ostream& CodeGenerator::generateProlog(std::ostream& out, ShaderType type,
             break;
     }
 
+    // the eyes of a stereo variant are the views of a multiview render pass
+    if (hasStereo) {
+        if (mCodeGenTargetApi == TargetApi::VULKAN) {
+            out << "#extension GL_EXT_multiview : require\n\n";
+        } else {
+            out << "#extension GL_OVR_multiview2 : require\n\n";
+            if (type == ShaderType::VERTEX) {
+                out << "layout(num_views = " << filament::CONFIG_STEREO_EYE_COUNT << ") in;\n\n";
+            }
+        }
+    }
+
     if (mTargetApi == TargetApi::VULKAN) {
         out << "#define TARGET_VULKAN_ENVIRONMENT\n";
     }
@@ -131,6 +143,8 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
         switch (variant) {
             case PostProcessStage::TONE_MAPPING_OPAQUE:
             case PostProcessStage::TONE_MAPPING_TRANSLUCENT:
+            case PostProcessStage::TONE_MAPPING_SUBPASS_OPAQUE:
+            case PostProcessStage::TONE_MAPPING_SUBPASS_TRANSLUCENT:
                 out << filament::shaders::tone_mapping_fs;
                 out << filament::shaders::conversion_functions_fs;
                 out << filament::shaders::dithering_fs;
@@ -139,6 +153,21 @@ std::ostream& CodeGenerator::generatePostProcessMain(std::ostream& out,
             case PostProcessStage::ANTI_ALIASING_TRANSLUCENT:
                 out << filament::shaders::fxaa_fs;
                 break;
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+                out << filament::shaders::tone_mapping_fs;
+                out << filament::shaders::conversion_functions_fs;
+                out << filament::shaders::dithering_fs;
+                out << filament::shaders::fxaa_fs;
+                break;
+            case PostProcessStage::BLENDING_UPSAMPLE:
+            case PostProcessStage::TEMPORAL_UPSAMPLE:
+                break;
+            case PostProcessStage::IBL_EQUIRECTANGULAR:
+            case PostProcessStage::IBL_PREFILTER:
+            case PostProcessStage::IBL_SPHERICAL_HARMONICS:
+                out << filament::shaders::ibl_prefilter_fs;
+                break;
         }
         out << filament::shaders::post_process_fs;
     }
@@ -511,6 +540,14 @@ char const* CodeGenerator::getSamplerTypeName(SamplerType type, SamplerFormat fo
             // are created via VK_ANDROID_external_memory_android_hardware_buffer, but they are
             // backed by VkImage just like a normal texture, and sampled from normally.
             return (mCodeGenTargetApi == TargetApi::VULKAN) ? "sampler2D" : "samplerExternalOES";
+        case SamplerType::SAMPLER_2D_ARRAY:
+            assert(!multisample);
+            switch (format) {
+                case SamplerFormat::INT:    return "isampler2DArray";
+                case SamplerFormat::UINT:   return "usampler2DArray";
+                case SamplerFormat::FLOAT:  return "sampler2DArray";
+                case SamplerFormat::SHADOW: return "sampler2DArrayShadow";
+            }
     }
 }
 
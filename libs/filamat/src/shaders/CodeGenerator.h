@@ -54,7 +54,8 @@ public:
     std::ostream& generateSeparator(std::ostream& out) const;
 
     // generate prolog for the given shader
-    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers) const;
+    std::ostream& generateProlog(std::ostream& out, ShaderType type, bool hasExternalSamplers,
+            bool hasStereo = false) const;
 
     std::ostream& generateEpilog(std::ostream& out) const;
 
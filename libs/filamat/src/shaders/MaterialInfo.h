@@ -37,6 +37,10 @@ struct UTILS_PUBLIC MaterialInfo {
     bool isDoubleSided;
     bool hasExternalSamplers;
     bool hasShadowMultiplier;
+    bool hasIbl;
+    bool hasIblSpecular;
+    bool hasPunctualLights;
+    bool hasSpecularAmbientOcclusion;
     filament::AttributeBitset requiredAttributes;
     filament::BlendingMode blendingMode;
     filament::Shading shading;
@@ -149,7 +149,7 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     const bool lit = material.isLit;
     const filament::Variant variant(variantKey);
 
-    cg.generateProlog(vs, ShaderType::VERTEX, material.hasExternalSamplers);
+    cg.generateProlog(vs, ShaderType::VERTEX, material.hasExternalSamplers, variant.hasStereo());
 
     if (cg.getShaderModel() >= filament::driver::ShaderModel::GL_CORE_41) {
         // TODO: find a better way to set this, esp. on mobile
@@ -160,6 +160,8 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     cg.generateDefine(vs, "HAS_DIRECTIONAL_LIGHTING", litVariants && variant.hasDirectionalLighting());
     cg.generateDefine(vs, "HAS_SHADOWING", litVariants && variant.hasShadowReceiver());
     cg.generateDefine(vs, "HAS_SKINNING", variant.hasSkinning());
+    cg.generateDefine(vs, "HAS_INSTANCING", variant.hasInstancing());
+    cg.generateDefine(vs, "HAS_STEREO", variant.hasStereo());
     cg.generateDefine(vs, getShadingDefine(material.shading), true);
     generateMaterialDefines(vs, cg, mProperties);
 
@@ -182,8 +184,11 @@ const std::string ShaderGenerator::createVertexProgram(filament::driver::ShaderM
     // uniforms
     cg.generateUniforms(vs, ShaderType::VERTEX,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
+    // instanced draws replace the per-renderable uniforms by an array of them
     cg.generateUniforms(vs, ShaderType::VERTEX,
-            BindingPoints::PER_RENDERABLE, UibGenerator::getPerRenderableUib());
+            BindingPoints::PER_RENDERABLE, variant.hasInstancing() ?
+                    UibGenerator::getPerRenderableInstancesUib() :
+                    UibGenerator::getPerRenderableUib());
     if (variant.hasSkinning()) {
         cg.generateUniforms(vs, ShaderType::VERTEX,
                 BindingPoints::PER_RENDERABLE_BONES,
@@ -238,10 +243,13 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
     const filament::Variant variant(variantKey);
 
     std::stringstream fs;
-    cg.generateProlog(fs, ShaderType::FRAGMENT, material.hasExternalSamplers);
+    cg.generateProlog(fs, ShaderType::FRAGMENT, material.hasExternalSamplers,
+            variant.hasStereo());
 
     cg.generateDefine(fs, "IBL_USE_RGBM", filament::CONFIG_IBL_RGBM);
     cg.generateDefine(fs, "IBL_MAX_MIP_LEVEL", std::log2f(filament::CONFIG_IBL_SIZE));
+    cg.generateDefine(fs, "SPECIALIZATION_ID_SHADOW_SAMPLING_METHOD",
+            SpecializationConstants::SHADOW_SAMPLING_METHOD);
 
     // this should probably be a code generation option
     cg.generateDefine(fs, "USE_MULTIPLE_SCATTERING_COMPENSATION", true);
@@ -251,9 +259,14 @@ const std::string ShaderGenerator::createFragmentProgram(filament::driver::Shade
     cg.generateDefine(fs, "HAS_DIRECTIONAL_LIGHTING", litVariants && variant.hasDirectionalLighting());
     cg.generateDefine(fs, "HAS_DYNAMIC_LIGHTING", litVariants && variant.hasDynamicLighting());
     cg.generateDefine(fs, "HAS_SHADOWING", litVariants && variant.hasShadowReceiver());
+    cg.generateDefine(fs, "HAS_STEREO", variant.hasStereo());
 
     // material defines
     cg.generateDefine(fs, "MATERIAL_IS_DOUBLE_SIDED", material.isDoubleSided);
+    cg.generateDefine(fs, "MATERIAL_HAS_IBL", material.hasIbl);
+    cg.generateDefine(fs, "MATERIAL_HAS_IBL_SPECULAR", material.hasIblSpecular);
+    cg.generateDefine(fs, "MATERIAL_HAS_SPECULAR_AMBIENT_OCCLUSION",
+            material.hasSpecularAmbientOcclusion);
     switch (material.blendingMode) {
         case BlendingMode::OPAQUE:
             cg.generateDefine(fs, "BLEND_MODE_OPAQUE", true);
@@ -365,6 +378,7 @@ const std::string ShaderPostProcessGenerator::createPostProcessFragmentProgram(
     std::stringstream fs;
     cg.generateProlog(fs, ShaderType::FRAGMENT, false);
     generatePostProcessStageDefines(fs, cg, variant);
+    cg.generateDefine(fs, "SUBPASS_INPUT_BINDING", SUBPASS_INPUT_BINDING);
 
     cg.generateUniforms(fs, ShaderType::FRAGMENT,
             BindingPoints::PER_VIEW, UibGenerator::getPerViewUib());
@@ -389,30 +403,158 @@ void ShaderPostProcessGenerator::generatePostProcessStageDefines(std::stringstre
             uint32_t(PostProcessStage::ANTI_ALIASING_OPAQUE));
     cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING_TRANSLUCENT",
             uint32_t(PostProcessStage::ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT",
+            uint32_t(PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_BLENDING_UPSAMPLE",
+            uint32_t(PostProcessStage::BLENDING_UPSAMPLE));
+    cg.generateDefine(vs, "POST_PROCESS_TEMPORAL_UPSAMPLE",
+            uint32_t(PostProcessStage::TEMPORAL_UPSAMPLE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_SUBPASS_OPAQUE",
+            uint32_t(PostProcessStage::TONE_MAPPING_SUBPASS_OPAQUE));
+    cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING_SUBPASS_TRANSLUCENT",
+            uint32_t(PostProcessStage::TONE_MAPPING_SUBPASS_TRANSLUCENT));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_EQUIRECTANGULAR",
+            uint32_t(PostProcessStage::IBL_EQUIRECTANGULAR));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_PREFILTER",
+            uint32_t(PostProcessStage::IBL_PREFILTER));
+    cg.generateDefine(vs, "POST_PROCESS_IBL_SPHERICAL_HARMONICS",
+            uint32_t(PostProcessStage::IBL_SPHERICAL_HARMONICS));
     switch (variant) {
         case PostProcessStage::TONE_MAPPING_OPAQUE:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TONE_MAPPING_OPAQUE");
             cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
             cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
             cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
             break;
         case PostProcessStage::TONE_MAPPING_TRANSLUCENT:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TONE_MAPPING_TRANSLUCENT");
             cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
             cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
             cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
             break;
         case PostProcessStage::ANTI_ALIASING_OPAQUE:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_ANTI_ALIASING_OPAQUE");
             cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
             cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
             cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
             break;
         case PostProcessStage::ANTI_ALIASING_TRANSLUCENT:
             cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_ANTI_ALIASING_TRANSLUCENT");
             cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
             cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
             cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_OPAQUE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_OPAQUE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_ANTI_ALIASING_TRANSLUCENT");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 1u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::BLENDING_UPSAMPLE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_BLENDING_UPSAMPLE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      1u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::TEMPORAL_UPSAMPLE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_TEMPORAL_UPSAMPLE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      1u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::TONE_MAPPING_SUBPASS_OPAQUE:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_SUBPASS_OPAQUE");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       1u);
+            break;
+        case PostProcessStage::TONE_MAPPING_SUBPASS_TRANSLUCENT:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE",
+                    "POST_PROCESS_TONE_MAPPING_SUBPASS_TRANSLUCENT");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  1u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        0u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           0u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       1u);
+            break;
+        case PostProcessStage::IBL_EQUIRECTANGULAR:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_EQUIRECTANGULAR");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           1u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::IBL_PREFILTER:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_PREFILTER");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           1u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
+            break;
+        case PostProcessStage::IBL_SPHERICAL_HARMONICS:
+            cg.generateDefine(vs, "POST_PROCESS_STAGE", "POST_PROCESS_IBL_SPHERICAL_HARMONICS");
+            cg.generateDefine(vs, "POST_PROCESS_TONE_MAPPING",  0u);
+            cg.generateDefine(vs, "POST_PROCESS_ANTI_ALIASING", 0u);
+            cg.generateDefine(vs, "POST_PROCESS_OPAQUE",        1u);
+            cg.generateDefine(vs, "POST_PROCESS_BLENDING",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_TEMPORAL",      0u);
+            cg.generateDefine(vs, "POST_PROCESS_IBL",           1u);
+            cg.generateDefine(vs, "POST_PROCESS_SUBPASS",       0u);
             break;
     }
 }
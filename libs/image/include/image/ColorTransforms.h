@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_COLORTRANSFORMS_H_
+#define IMAGE_COLORTRANSFORMS_H_
+
+#include <math/half.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+/*
+ * Conversions of arrays of pixels, the bulk versions of the functions in utilities.h.
+ *
+ * The loops are branchless so the compiler vectorizes them, the transfer functions use
+ * polynomial approximations of pow() accurate to about 1e-6. When a JobSystem is given, large
+ * arrays are split in jobs, and these functions wait for the jobs to finish.
+ *
+ * The pixels are tightly packed. With 4 channels the fourth one is alpha, it is linear and is
+ * copied as is, all the channels of 1, 2 or 3 channel pixels are colors. The input and output
+ * arrays can be the same when they have the same type.
+ */
+namespace image {
+
+void linearTosRGB(float const* in, float* out, size_t count, size_t channels,
+        utils::JobSystem* js = nullptr);
+
+void sRGBToLinear(float const* in, float* out, size_t count, size_t channels,
+        utils::JobSystem* js = nullptr);
+
+// encodes to 8-bit sRGB, rounded to the nearest value after clamping to [0, 1]
+void linearTosRGB8(float const* in, uint8_t* out, size_t count, size_t channels,
+        utils::JobSystem* js = nullptr);
+
+// rounds to the nearest half, including denormals, count is the number of floats
+void floatToHalf(float const* in, math::half* out, size_t count, utils::JobSystem* js = nullptr);
+
+void halfToFloat(math::half const* in, float* out, size_t count, utils::JobSystem* js = nullptr);
+
+// same as linearToRGBM() in utilities.h
+void linearToRGBM(math::float3 const* in, math::float4* out, size_t count,
+        utils::JobSystem* js = nullptr);
+
+// unsigned normalized 10 bits per color and 2 bits of alpha, red in the least significant bits
+// (GL_RGB10_A2 with GL_UNSIGNED_INT_2_10_10_10_REV), values are clamped to [0, 1]
+void linearToRGB10A2(math::float4 const* in, uint32_t* out, size_t count,
+        utils::JobSystem* js = nullptr);
+
+// multiplies the colors by alpha, in place
+void premultiply(math::float4* data, size_t count, utils::JobSystem* js = nullptr);
+
+} // namespace image
+
+#endif /* IMAGE_COLORTRANSFORMS_H_ */
@@ -32,6 +32,9 @@ public:
     Image(std::unique_ptr<uint8_t[]> data, size_t w, size_t h,
           size_t bpr, size_t bpp, size_t channels = 3);
 
+    // an image of pixels it doesn't own, they must outlive it
+    Image(void* data, size_t w, size_t h, size_t bpr, size_t bpp, size_t channels = 3);
+
     enum {
         FLIP_X = 0x1,
         FLIP_Y = 0x2,
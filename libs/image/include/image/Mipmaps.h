@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_MIPMAPS_H_
+#define IMAGE_MIPMAPS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace image {
+
+enum class MipmapFilter {
+    BOX,        // 2x2 average, fastest
+    KAISER      // Kaiser-windowed sinc over 8x8 texels, sharper
+};
+
+// How the 8-bit channels are encoded. Filtering always happens on linear values.
+enum class MipmapEncoding {
+    LINEAR,
+    SRGB,       // the first 3 channels are sRGB-encoded, alpha is linear
+    RGBM        // 4 channels, see linearToRGBM()
+};
+
+// number of levels of a full mip chain, including the base level
+size_t getMipmapCount(size_t width, size_t height) noexcept;
+
+// size in bytes of a tightly packed level, level 0 being the base level
+size_t getMipmapSize(size_t width, size_t height, size_t channels, size_t level) noexcept;
+
+/*
+ * Computes the levels 1 to count-1 of the mip chain of a tightly packed 8-bit image with 1 to 4
+ * channels. Level i is written to levels[i - 1], which must hold getMipmapSize(..., i) bytes.
+ *
+ * Each level is filtered from the previous one, kept in floating point to not accumulate
+ * quantization errors. When a JobSystem is given, the rows of each level are processed in
+ * parallel, and this waits for the jobs to finish.
+ */
+void generateMipmaps(uint8_t const* base, size_t width, size_t height, size_t channels,
+        uint8_t* const* levels, size_t count,
+        MipmapEncoding encoding, MipmapFilter filter = MipmapFilter::BOX,
+        utils::JobSystem* js = nullptr);
+
+} // namespace image
+
+#endif /* IMAGE_MIPMAPS_H_ */
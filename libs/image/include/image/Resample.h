@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_RESAMPLE_H_
+#define IMAGE_RESAMPLE_H_
+
+#include <stddef.h>
+
+namespace utils {
+class JobSystem;
+} // namespace utils
+
+namespace image {
+
+enum class ResampleFilter {
+    BOX,        // average of the source texels under a destination texel, nearest when magnifying
+    LANCZOS     // Lanczos-windowed sinc with 3 lobes, sharper, can ring around edges
+};
+
+/*
+ * Resamples a tightly packed float image with 1 to 4 channels to any size, e.g. to downsample
+ * an environment before filtering it. Filtering happens on the values as they are, which should
+ * be linear. The Lanczos filter can produce values out of the range of its input.
+ *
+ * The image is filtered horizontally then vertically, with the weights of each destination
+ * column and row computed once. When a JobSystem is given, the rows are processed in parallel,
+ * and this waits for the jobs to finish.
+ */
+void resample(float const* src, size_t srcWidth, size_t srcHeight, size_t channels,
+        float* dst, size_t dstWidth, size_t dstHeight,
+        ResampleFilter filter = ResampleFilter::LANCZOS, utils::JobSystem* js = nullptr);
+
+} // namespace image
+
+#endif /* IMAGE_RESAMPLE_H_ */
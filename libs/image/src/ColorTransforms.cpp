@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/ColorTransforms.h>
+
+#include <math/scalar.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "Jobs.h"
+
+using namespace math;
+using namespace utils;
+using image::details::forEachRange;
+
+namespace image {
+
+namespace {
+
+// arrays are processed by jobs of at least this many values
+constexpr size_t VALUES_PER_JOB = 64 * 1024;
+
+// All the functions below are written without branches nor calls to libm, which would prevent
+// the loops that use them from being vectorized.
+
+inline uint32_t asUint(float f) noexcept {
+    union {
+        float f;
+        uint32_t u;
+    } v = { f };
+    return v.u;
+}
+
+inline float asFloat(uint32_t u) noexcept {
+    union {
+        uint32_t u;
+        float f;
+    } v = { u };
+    return v.f;
+}
+
+// log2(x) for x > 0, the result of other values is finite but undefined
+inline float log2(float x) noexcept {
+    const uint32_t bits = asUint(x);
+    float e = float(int32_t(bits >> 23u) - 127);
+    float m = asFloat((bits & 0x007FFFFFu) | 0x3F800000u);
+    // m in [sqrt(1/2), sqrt(2)) so that the series below converges faster
+    const bool high = m > float(M_SQRT2);
+    m = high ? m * 0.5f : m;
+    e = high ? e + 1.0f : e;
+    // log2(m) = 2 / ln(2) * atanh(t)
+    const float t = (m - 1.0f) / (m + 1.0f);
+    const float t2 = t * t;
+    const float s = 1.0f + t2 * (1.0f / 3.0f + t2 * (1.0f / 5.0f + t2 * (1.0f / 7.0f +
+            t2 * (1.0f / 9.0f))));
+    return e + t * s * float(2.0 / M_LN2);
+}
+
+// 2^x, with x clamped to the range of normal floats
+inline float exp2(float x) noexcept {
+    x = clamp(x, -126.0f, 127.0f);
+    // round(x) without a call to std::floor(), x + 128.5 is always positive
+    const int32_t n = int32_t(x + 128.5f) - 128;
+    const float f = (x - float(n)) * float(M_LN2);
+    // Taylor series of e^f, f in [-ln(2) / 2, ln(2) / 2]
+    const float p = 1.0f + f * (1.0f + f * (1.0f / 2.0f + f * (1.0f / 6.0f + f * (1.0f / 24.0f +
+            f * (1.0f / 120.0f + f * (1.0f / 720.0f + f * (1.0f / 5040.0f)))))));
+    return p * asFloat(uint32_t(n + 127) << 23u);
+}
+
+inline float pow(float x, float y) noexcept {
+    return exp2(y * log2(x));
+}
+
+inline float ceilPositive(float x) noexcept {
+    const float i = float(int32_t(x));
+    return i < x ? i + 1.0f : i;
+}
+
+inline float encodesRGB(float linear) noexcept {
+    const float sRGB = 1.055f * pow(linear, 1.0f / 2.4f) - 0.055f;
+    return linear <= 0.0031308f ? linear * 12.92f : sRGB;
+}
+
+inline float decodesRGB(float sRGB) noexcept {
+    const float linear = pow((sRGB + 0.055f) * (1.0f / 1.055f), 2.4f);
+    return sRGB <= 0.04045f ? sRGB * (1.0f / 12.92f) : linear;
+}
+
+inline uint8_t quantize8(float v) noexcept {
+    // through int32_t, float to uint8_t conversions are not vectorized
+    return uint8_t(int32_t(saturate(v) * 255.0f + 0.5f));
+}
+
+// Applies color() to the colors and alpha() to the alpha of the values [first, last) of in.
+template<typename IN, typename OUT, typename COLOR, typename ALPHA>
+void transformValues(IN const* in, OUT* out, size_t first, size_t last, size_t channels,
+        COLOR color, ALPHA alpha) noexcept {
+    if (channels == 4) {
+        // the pixels are unrolled so that alpha is selected without a branch
+        for (size_t i = first; i < last; i += 4) {
+            out[i + 0] = color(in[i + 0]);
+            out[i + 1] = color(in[i + 1]);
+            out[i + 2] = color(in[i + 2]);
+            out[i + 3] = alpha(in[i + 3]);
+        }
+    } else {
+        for (size_t i = first; i < last; i++) {
+            out[i] = color(in[i]);
+        }
+    }
+}
+
+template<typename IN, typename OUT, typename COLOR, typename ALPHA>
+void transform(IN const* in, OUT* out, size_t count, size_t channels, JobSystem* js,
+        COLOR color, ALPHA alpha) {
+    constexpr size_t BLOCK_SIZE = 1024;
+    forEachRange(js, count, VALUES_PER_JOB / channels, [=](size_t first, size_t n) {
+        const size_t begin = first * channels;
+        const size_t end = (first + n) * channels;
+        if (static_cast<void const*>(in) != static_cast<void const*>(out)) {
+            transformValues(in, out, begin, end, channels, color, alpha);
+            return;
+        }
+        // The compiler can't tell arrays that are the same from arrays that overlap, and
+        // wouldn't vectorize the loop, so the values are converted from a copy.
+        IN block[BLOCK_SIZE];
+        for (size_t i = begin; i < end; i += BLOCK_SIZE) {
+            const size_t size = std::min(BLOCK_SIZE, end - i);
+            std::copy_n(in + i, size, block);
+            transformValues(block, out + i, 0, size, channels, color, alpha);
+        }
+    });
+}
+
+} // anonymous namespace
+
+void linearTosRGB(float const* in, float* out, size_t count, size_t channels, JobSystem* js) {
+    transform(in, out, count, channels, js,
+            [](float v) { return encodesRGB(v); }, [](float v) { return v; });
+}
+
+void sRGBToLinear(float const* in, float* out, size_t count, size_t channels, JobSystem* js) {
+    transform(in, out, count, channels, js,
+            [](float v) { return decodesRGB(v); }, [](float v) { return v; });
+}
+
+void linearTosRGB8(float const* in, uint8_t* out, size_t count, size_t channels, JobSystem* js) {
+    transform(in, out, count, channels, js,
+            [](float v) { return quantize8(encodesRGB(v)); },
+            [](float v) { return quantize8(v); });
+}
+
+void floatToHalf(float const* in, half* out, size_t count, JobSystem* js) {
+    forEachRange(js, count, VALUES_PER_JOB, [=](size_t first, size_t n) {
+        convertToHalf(in + first, out + first, n);
+    });
+}
+
+void halfToFloat(half const* in, float* out, size_t count, JobSystem* js) {
+    forEachRange(js, count, VALUES_PER_JOB, [=](size_t first, size_t n) {
+        convertToFloat(in + first, out + first, n);
+    });
+}
+
+void linearToRGBM(float3 const* in, float4* out, size_t count, JobSystem* js) {
+    forEachRange(js, count, VALUES_PER_JOB / 4, [=](size_t first, size_t n) {
+        for (size_t i = first; i < first + n; i++) {
+            // linear to gamma space, in the [0..16] range
+            const float r = std::sqrt(in[i].r) * (1.0f / 16.0f);
+            const float g = std::sqrt(in[i].g) * (1.0f / 16.0f);
+            const float b = std::sqrt(in[i].b) * (1.0f / 16.0f);
+            // don't let M go below 1 in the [0..16] range
+            float m = std::max(std::max(r, g), std::max(b, 1e-6f));
+            m = ceilPositive(clamp(m, 1.0f / 16.0f, 1.0f) * 255.0f) * (1.0f / 255.0f);
+            out[i] = float4(saturate(r / m), saturate(g / m), saturate(b / m), m);
+        }
+    });
+}
+
+void linearToRGB10A2(float4 const* in, uint32_t* out, size_t count, JobSystem* js) {
+    forEachRange(js, count, VALUES_PER_JOB / 4, [=](size_t first, size_t n) {
+        for (size_t i = first; i < first + n; i++) {
+            const uint32_t r = uint32_t(saturate(in[i].r) * 1023.0f + 0.5f);
+            const uint32_t g = uint32_t(saturate(in[i].g) * 1023.0f + 0.5f);
+            const uint32_t b = uint32_t(saturate(in[i].b) * 1023.0f + 0.5f);
+            const uint32_t a = uint32_t(saturate(in[i].a) * 3.0f + 0.5f);
+            out[i] = r | (g << 10u) | (b << 20u) | (a << 30u);
+        }
+    });
+}
+
+void premultiply(float4* data, size_t count, JobSystem* js) {
+    forEachRange(js, count, VALUES_PER_JOB / 4, [=](size_t first, size_t n) {
+        for (size_t i = first; i < first + n; i++) {
+            data[i].rgb *= data[i].a;
+        }
+    });
+}
+
+} // namespace image
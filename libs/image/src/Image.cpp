@@ -35,6 +35,16 @@ Image::Image(std::unique_ptr<uint8_t[]> data,
 {
 }
 
+Image::Image(void* data, size_t w, size_t h, size_t bpr, size_t bpp, size_t channels)
+    : mData(data),
+      mWidth(w),
+      mHeight(h),
+      mBpr(bpr),
+      mBpp(bpp),
+      mChannels(channels)
+{
+}
+
 void Image::reset() {
     mOwnedData.release();
     mWidth = 0;
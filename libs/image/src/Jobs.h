@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_JOBS_H_
+#define IMAGE_JOBS_H_
+
+#include <utils/JobSystem.h>
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <functional>
+
+namespace image {
+namespace details {
+
+// rows of an image are processed by jobs of at least this many texels
+constexpr size_t TEXELS_PER_JOB = 64 * 64;
+
+// Runs work(first, count) on [0, count), in parallel by ranges of at least grain items when a
+// JobSystem is given and there is more than one range. This waits for the jobs to finish.
+template<typename F>
+void forEachRange(utils::JobSystem* js, size_t count, size_t grain, F const& work) {
+    grain = std::max(size_t(1), grain);
+    if (js && count > grain) {
+        const size_t ranges = (count + grain - 1) / grain;
+        auto range = [&work, grain, count](uint32_t start, uint32_t n) {
+            const size_t first = start * grain;
+            work(first, std::min((start + n) * grain, count) - first);
+        };
+        auto job = utils::jobs::parallel_for(*js, nullptr, 0, uint32_t(ranges),
+                std::cref(range), utils::jobs::CountSplitter<1>());
+        js->runAndWait(job);
+        js->release(job);
+    } else {
+        work(0, count);
+    }
+}
+
+// Runs work(firstRow, rowCount) on all the rows of an image, see forEachRange().
+template<typename F>
+void forEachRow(utils::JobSystem* js, size_t width, size_t height, F const& work) {
+    forEachRange(js, height, TEXELS_PER_JOB / std::max(size_t(1), width), work);
+}
+
+} // namespace details
+} // namespace image
+
+#endif /* IMAGE_JOBS_H_ */
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/Mipmaps.h>
+
+#include <utils/JobSystem.h>
+
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <image/ColorTransforms.h>
+#include <image/utilities.h>
+
+#include "Jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+
+using namespace math;
+using namespace utils;
+using image::details::forEachRow;
+
+namespace image {
+
+namespace {
+
+// Half width in source texels of the Kaiser kernel, the kernel spans 2 * KAISER_RADIUS texels.
+constexpr int KAISER_RADIUS = 4;
+constexpr float KAISER_ALPHA = 4.0f;
+
+struct Level {
+    float* data;
+    size_t width;
+    size_t height;
+};
+
+float bessel0(float x) noexcept {
+    // power series of the zero-th order modified Bessel function of the first kind
+    float sum = 1.0f;
+    float term = 1.0f;
+    const float x2 = (x * x) / 4.0f;
+    for (int k = 1; k < 16; k++) {
+        term *= x2 / float(k * k);
+        sum += term;
+    }
+    return sum;
+}
+
+struct KaiserWeights {
+    float w[2 * KAISER_RADIUS];
+    KaiserWeights() noexcept {
+        // The destination texel is centered between the source texels -1 and 0, the tap k is at
+        // a distance of k + 0.5 source texels, which is half that in destination texels.
+        const float norm = 1.0f / bessel0(KAISER_ALPHA);
+        float sum = 0;
+        for (int k = -KAISER_RADIUS; k < KAISER_RADIUS; k++) {
+            const float d = (k + 0.5f) * 0.5f;
+            const float x = float(M_PI) * d;
+            const float sinc = std::sin(x) / x;
+            const float r = d / (KAISER_RADIUS * 0.5f);
+            const float window = bessel0(KAISER_ALPHA * std::sqrt(std::max(0.0f, 1.0f - r * r)));
+            w[k + KAISER_RADIUS] = sinc * window * norm;
+            sum += w[k + KAISER_RADIUS];
+        }
+        for (float& v : w) {
+            v /= sum;
+        }
+    }
+};
+
+struct SRGBTable {
+    float toLinear[256];
+    SRGBTable() noexcept {
+        for (size_t i = 0; i < 256; i++) {
+            toLinear[i] = sRGBToLinear(float3(i / 255.0f)).r;
+        }
+    }
+};
+
+inline uint8_t quantize(float v) noexcept {
+    return uint8_t(clamp(v, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+// C is a template parameter so the per-channel loops are unrolled and vectorized.
+
+template<size_t C>
+void boxRows(Level src, Level dst, size_t first, size_t count) noexcept {
+    const size_t x1 = src.width > 1 ? 1 : 0;
+    for (size_t y = first; y < first + count; y++) {
+        const size_t y0 = std::min(2 * y, src.height - 1);
+        const size_t y1 = std::min(2 * y + 1, src.height - 1);
+        float const* r0 = src.data + y0 * src.width * C;
+        float const* r1 = src.data + y1 * src.width * C;
+        float* out = dst.data + y * dst.width * C;
+        for (size_t x = 0; x < dst.width; x++) {
+            float const* a = r0 + 2 * x * C;
+            float const* b = r1 + 2 * x * C;
+            for (size_t c = 0; c < C; c++) {
+                out[c] = 0.25f * (a[c] + a[c + x1 * C] + b[c] + b[c + x1 * C]);
+            }
+            out += C;
+        }
+    }
+}
+
+// horizontal pass, src is width x height and dst is dst.width x height
+template<size_t C>
+void kaiserRowsH(KaiserWeights const& k, Level src, Level dst, size_t first, size_t count) noexcept {
+    const ssize_t last = ssize_t(src.width) - 1;
+    for (size_t y = first; y < first + count; y++) {
+        float const* in = src.data + y * src.width * C;
+        float* out = dst.data + y * dst.width * C;
+        for (size_t x = 0; x < dst.width; x++) {
+            float acc[C] = {};
+            const ssize_t center = ssize_t(2 * x + 1);
+            for (int t = -KAISER_RADIUS; t < KAISER_RADIUS; t++) {
+                const ssize_t sx = std::min(std::max(center + t, ssize_t(0)), last);
+                const float w = k.w[t + KAISER_RADIUS];
+                for (size_t c = 0; c < C; c++) {
+                    acc[c] += w * in[sx * C + c];
+                }
+            }
+            for (size_t c = 0; c < C; c++) {
+                out[c] = acc[c];
+            }
+            out += C;
+        }
+    }
+}
+
+// vertical pass, src is dst.width x height
+template<size_t C>
+void kaiserRowsV(KaiserWeights const& k, Level src, Level dst, size_t first, size_t count) noexcept {
+    const ssize_t last = ssize_t(src.height) - 1;
+    const size_t stride = dst.width * C;
+    for (size_t y = first; y < first + count; y++) {
+        float* out = dst.data + y * stride;
+        std::fill(out, out + stride, 0.0f);
+        const ssize_t center = ssize_t(2 * y + 1);
+        for (int t = -KAISER_RADIUS; t < KAISER_RADIUS; t++) {
+            const ssize_t sy = std::min(std::max(center + t, ssize_t(0)), last);
+            const float w = k.w[t + KAISER_RADIUS];
+            float const* in = src.data + sy * stride;
+            for (size_t i = 0; i < stride; i++) {
+                out[i] += w * in[i];
+            }
+        }
+    }
+}
+
+template<size_t C>
+void downsample(Level src, Level dst, std::vector<float>& scratch,
+        MipmapFilter filter, JobSystem* js) {
+    if (filter == MipmapFilter::BOX) {
+        forEachRow(js, dst.width, dst.height, [=](size_t first, size_t count) {
+            boxRows<C>(src, dst, first, count);
+        });
+        return;
+    }
+    static const KaiserWeights weights;
+    if (src.width == 1 || src.height == 1) {
+        // the kernel needs a 2D neighbourhood to behave, thin levels are box filtered
+        forEachRow(js, dst.width, dst.height, [=](size_t first, size_t count) {
+            boxRows<C>(src, dst, first, count);
+        });
+        return;
+    }
+    scratch.resize(dst.width * src.height * C);
+    Level tmp = { scratch.data(), dst.width, src.height };
+    forEachRow(js, tmp.width, tmp.height, [&](size_t first, size_t count) {
+        kaiserRowsH<C>(weights, src, tmp, first, count);
+    });
+    forEachRow(js, dst.width, dst.height, [&](size_t first, size_t count) {
+        kaiserRowsV<C>(weights, tmp, dst, first, count);
+    });
+}
+
+void decode(uint8_t const* in, Level dst, size_t channels, MipmapEncoding encoding,
+        JobSystem* js) {
+    static const SRGBTable srgb;
+    forEachRow(js, dst.width, dst.height, [=](size_t first, size_t count) {
+        const size_t n = dst.width * channels;
+        for (size_t y = first; y < first + count; y++) {
+            uint8_t const* src = in + y * n;
+            float* out = dst.data + y * n;
+            switch (encoding) {
+                case MipmapEncoding::LINEAR:
+                    for (size_t i = 0; i < n; i++) {
+                        out[i] = src[i] / 255.0f;
+                    }
+                    break;
+                case MipmapEncoding::SRGB:
+                    for (size_t i = 0; i < n; i++) {
+                        out[i] = (i % channels) < 3 ? srgb.toLinear[src[i]] : src[i] / 255.0f;
+                    }
+                    break;
+                case MipmapEncoding::RGBM:
+                    for (size_t i = 0; i < n; i += 4) {
+                        float4 rgbm(src[i] / 255.0f, src[i + 1] / 255.0f,
+                                src[i + 2] / 255.0f, src[i + 3] / 255.0f);
+                        float3 linear = RGBMtoLinear(rgbm);
+                        out[i + 0] = linear.r;
+                        out[i + 1] = linear.g;
+                        out[i + 2] = linear.b;
+                        out[i + 3] = 1.0f;
+                    }
+                    break;
+            }
+        }
+    });
+}
+
+void encode(Level src, uint8_t* out, size_t channels, MipmapEncoding encoding, JobSystem* js) {
+    forEachRow(js, src.width, src.height, [=](size_t first, size_t count) {
+        const size_t n = src.width * channels;
+        for (size_t y = first; y < first + count; y++) {
+            float const* in = src.data + y * n;
+            uint8_t* dst = out + y * n;
+            switch (encoding) {
+                case MipmapEncoding::LINEAR:
+                    for (size_t i = 0; i < n; i++) {
+                        dst[i] = quantize(in[i]);
+                    }
+                    break;
+                case MipmapEncoding::SRGB:
+                    linearTosRGB8(in, dst, src.width, channels);
+                    break;
+                case MipmapEncoding::RGBM:
+                    for (size_t i = 0; i < n; i += 4) {
+                        float3 linear(std::max(0.0f, in[i + 0]),
+                                std::max(0.0f, in[i + 1]), std::max(0.0f, in[i + 2]));
+                        float4 rgbm = linearToRGBM(linear);
+                        dst[i + 0] = quantize(rgbm.r);
+                        dst[i + 1] = quantize(rgbm.g);
+                        dst[i + 2] = quantize(rgbm.b);
+                        dst[i + 3] = quantize(rgbm.a);
+                    }
+                    break;
+            }
+        }
+    });
+}
+
+} // anonymous namespace
+
+size_t getMipmapCount(size_t width, size_t height) noexcept {
+    size_t count = 1;
+    for (size_t size = std::max(width, height); size > 1; size >>= 1) {
+        count++;
+    }
+    return count;
+}
+
+size_t getMipmapSize(size_t width, size_t height, size_t channels, size_t level) noexcept {
+    return std::max(size_t(1), width >> level) * std::max(size_t(1), height >> level) * channels;
+}
+
+void generateMipmaps(uint8_t const* base, size_t width, size_t height, size_t channels,
+        uint8_t* const* levels, size_t count,
+        MipmapEncoding encoding, MipmapFilter filter, JobSystem* js) {
+    if (channels < 1 || channels > 4 || (encoding == MipmapEncoding::RGBM && channels != 4)) {
+        return;
+    }
+    count = std::min(count, getMipmapCount(width, height));
+    if (count < 2) {
+        return;
+    }
+
+    // two float levels, ping-ponged, the second one being a quarter of the first
+    std::vector<float> current(width * height * channels);
+    std::vector<float> next(getMipmapSize(width, height, channels, 1));
+    std::vector<float> scratch;
+
+    Level src = { current.data(), width, height };
+    decode(base, src, channels, encoding, js);
+
+    for (size_t i = 1; i < count; i++) {
+        Level dst = { next.data(),
+                std::max(size_t(1), src.width / 2), std::max(size_t(1), src.height / 2) };
+        switch (channels) {
+            case 1: downsample<1>(src, dst, scratch, filter, js); break;
+            case 2: downsample<2>(src, dst, scratch, filter, js); break;
+            case 3: downsample<3>(src, dst, scratch, filter, js); break;
+            case 4: downsample<4>(src, dst, scratch, filter, js); break;
+        }
+        encode(dst, levels[i - 1], channels, encoding, js);
+        std::swap(current, next);
+        src = { current.data(), dst.width, dst.height };
+    }
+}
+
+} // namespace image
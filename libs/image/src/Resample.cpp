@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/Resample.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Jobs.h"
+
+using namespace utils;
+using image::details::forEachRow;
+
+namespace image {
+
+namespace {
+
+constexpr float LANCZOS_LOBES = 3.0f;
+
+// The source texels, and their weights, that make each destination texel along one axis.
+struct Taps {
+    size_t count = 0;               // per destination texel
+    std::vector<uint32_t> indices;  // clamped to the edges of the source
+    std::vector<float> weights;     // normalized
+};
+
+float sinc(float x) noexcept {
+    x *= float(M_PI);
+    return std::abs(x) < 1e-6f ? 1.0f : std::sin(x) / x;
+}
+
+float weight(ResampleFilter filter, float x) noexcept {
+    if (filter == ResampleFilter::BOX) {
+        return (x >= -0.5f && x < 0.5f) ? 1.0f : 0.0f;
+    }
+    return std::abs(x) < LANCZOS_LOBES ? sinc(x) * sinc(x / LANCZOS_LOBES) : 0.0f;
+}
+
+Taps computeTaps(ResampleFilter filter, size_t srcSize, size_t dstSize) {
+    const float scale = float(srcSize) / float(dstSize);
+    // when minifying, the filter is stretched over the source texels of a destination texel
+    const float stretch = std::max(1.0f, scale);
+    const float radius = (filter == ResampleFilter::BOX ? 0.5f : LANCZOS_LOBES) * stretch;
+
+    Taps taps;
+    taps.count = size_t(std::ceil(2.0f * radius)) + 1;
+    taps.indices.resize(taps.count * dstSize);
+    taps.weights.resize(taps.count * dstSize);
+    for (size_t i = 0; i < dstSize; i++) {
+        // the source texel j covers [j, j + 1)
+        const float center = (i + 0.5f) * scale;
+        const ssize_t first = ssize_t(std::floor(center - radius));
+        uint32_t* indices = taps.indices.data() + i * taps.count;
+        float* weights = taps.weights.data() + i * taps.count;
+        float sum = 0;
+        for (size_t t = 0; t < taps.count; t++) {
+            const ssize_t j = first + ssize_t(t);
+            indices[t] = uint32_t(std::min(std::max(j, ssize_t(0)), ssize_t(srcSize) - 1));
+            weights[t] = weight(filter, (j + 0.5f - center) / stretch);
+            sum += weights[t];
+        }
+        for (size_t t = 0; t < taps.count; t++) {
+            weights[t] /= sum;
+        }
+    }
+    return taps;
+}
+
+// C is a template parameter so the per-channel loops are unrolled and vectorized.
+
+// horizontal pass, src is srcWidth x height and dst is dstWidth x height
+template<size_t C>
+void resampleRowsH(Taps const& taps, float const* src, size_t srcWidth,
+        float* dst, size_t dstWidth, size_t first, size_t count) noexcept {
+    for (size_t y = first; y < first + count; y++) {
+        float const* in = src + y * srcWidth * C;
+        float* out = dst + y * dstWidth * C;
+        for (size_t x = 0; x < dstWidth; x++) {
+            uint32_t const* indices = taps.indices.data() + x * taps.count;
+            float const* weights = taps.weights.data() + x * taps.count;
+            float acc[C] = {};
+            for (size_t t = 0; t < taps.count; t++) {
+                float const* texel = in + indices[t] * C;
+                for (size_t c = 0; c < C; c++) {
+                    acc[c] += weights[t] * texel[c];
+                }
+            }
+            for (size_t c = 0; c < C; c++) {
+                out[c] = acc[c];
+            }
+            out += C;
+        }
+    }
+}
+
+// vertical pass, the rows are stride floats long
+void resampleRowsV(Taps const& taps, float const* src, float* dst, size_t stride,
+        size_t first, size_t count) noexcept {
+    for (size_t y = first; y < first + count; y++) {
+        uint32_t const* indices = taps.indices.data() + y * taps.count;
+        float const* weights = taps.weights.data() + y * taps.count;
+        float* out = dst + y * stride;
+        std::fill(out, out + stride, 0.0f);
+        for (size_t t = 0; t < taps.count; t++) {
+            const float w = weights[t];
+            float const* in = src + indices[t] * stride;
+            for (size_t i = 0; i < stride; i++) {
+                out[i] += w * in[i];
+            }
+        }
+    }
+}
+
+template<size_t C>
+void resampleH(Taps const& taps, float const* src, size_t srcWidth,
+        float* dst, size_t dstWidth, size_t height, JobSystem* js) {
+    forEachRow(js, std::max(srcWidth, dstWidth), height, [&](size_t first, size_t count) {
+        resampleRowsH<C>(taps, src, srcWidth, dst, dstWidth, first, count);
+    });
+}
+
+} // anonymous namespace
+
+void resample(float const* src, size_t srcWidth, size_t srcHeight, size_t channels,
+        float* dst, size_t dstWidth, size_t dstHeight, ResampleFilter filter, JobSystem* js) {
+    if (channels < 1 || channels > 4 || !srcWidth || !srcHeight || !dstWidth || !dstHeight) {
+        return;
+    }
+
+    const Taps horizontal = computeTaps(filter, srcWidth, dstWidth);
+    const Taps vertical = computeTaps(filter, srcHeight, dstHeight);
+
+    std::vector<float> tmp(dstWidth * srcHeight * channels);
+    switch (channels) {
+        case 1: resampleH<1>(horizontal, src, srcWidth, tmp.data(), dstWidth, srcHeight, js); break;
+        case 2: resampleH<2>(horizontal, src, srcWidth, tmp.data(), dstWidth, srcHeight, js); break;
+        case 3: resampleH<3>(horizontal, src, srcWidth, tmp.data(), dstWidth, srcHeight, js); break;
+        case 4: resampleH<4>(horizontal, src, srcWidth, tmp.data(), dstWidth, srcHeight, js); break;
+    }
+
+    const size_t stride = dstWidth * channels;
+    forEachRow(js, stride, dstHeight, [&](size_t first, size_t count) {
+        resampleRowsV(vertical, tmp.data(), dst, stride, first, count);
+    });
+}
+
+} // namespace image
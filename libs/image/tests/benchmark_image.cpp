@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <image/ColorTransforms.h>
+#include <image/Resample.h>
+#include <image/utilities.h>
+
+#include <utils/JobSystem.h>
+#include <utils/compiler.h>
+
+#include <math/half.h>
+#include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace image;
+using namespace math;
+using namespace utils;
+
+// Times the conversions of a 2048x2048 RGB image, with the per-texel functions of utilities.h,
+// the bulk functions on one thread, and the bulk functions on a JobSystem.
+
+static constexpr size_t WIDTH = 2048;
+static constexpr size_t HEIGHT = 2048;
+static constexpr size_t REPEAT = 5;
+
+template<typename F>
+UTILS_NOINLINE
+void benchmark(const char* name, size_t texels, F f) {
+    f(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < REPEAT; i++) {
+        f();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    const double seconds = duration.count() / REPEAT;
+    std::cout << std::left << std::setw(36) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << seconds * 1000.0 << " ms"
+              << std::setw(10) << texels / seconds * 1e-6 << " Mtexels/s" << std::endl;
+}
+
+int main() {
+    JobSystem js;
+    js.adopt();
+
+    const size_t count = WIDTH * HEIGHT;
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(0.0f, 4.0f);
+    std::vector<float3> linear(count);
+    for (float3& texel : linear) {
+        texel = { rand(gen), rand(gen), rand(gen) };
+    }
+    float const* values = &linear.data()->x;
+
+    std::vector<float> floats(count * 3);
+    std::vector<uint8_t> bytes(count * 3);
+    std::vector<half> halfs(count * 3);
+    std::vector<float4> rgbm(count);
+
+    benchmark("linearTosRGB (per texel)", count, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            reinterpret_cast<float3&>(floats[i * 3]) = image::linearTosRGB(linear[i]);
+        }
+    });
+    benchmark("linearTosRGB", count, [&]() {
+        linearTosRGB(values, floats.data(), count, 3);
+    });
+    benchmark("linearTosRGB (jobs)", count, [&]() {
+        linearTosRGB(values, floats.data(), count, 3, &js);
+    });
+
+    benchmark("sRGBToLinear (per texel)", count, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            reinterpret_cast<float3&>(floats[i * 3]) = image::sRGBToLinear(linear[i]);
+        }
+    });
+    benchmark("sRGBToLinear", count, [&]() {
+        sRGBToLinear(values, floats.data(), count, 3);
+    });
+    benchmark("sRGBToLinear (jobs)", count, [&]() {
+        sRGBToLinear(values, floats.data(), count, 3, &js);
+    });
+
+    benchmark("linearTosRGB8 (per texel)", count, [&]() {
+        for (size_t i = 0; i < count * 3; i++) {
+            bytes[i] = uint8_t(saturate(image::linearTosRGB(values[i])) * 255.0f + 0.5f);
+        }
+    });
+    benchmark("linearTosRGB8", count, [&]() {
+        linearTosRGB8(values, bytes.data(), count, 3);
+    });
+    benchmark("linearTosRGB8 (jobs)", count, [&]() {
+        linearTosRGB8(values, bytes.data(), count, 3, &js);
+    });
+
+    benchmark("floatToHalf (per texel)", count, [&]() {
+        for (size_t i = 0; i < count * 3; i++) {
+            halfs[i] = half(values[i]);
+        }
+    });
+    benchmark("floatToHalf", count, [&]() {
+        floatToHalf(values, halfs.data(), count * 3);
+    });
+    benchmark("floatToHalf (jobs)", count, [&]() {
+        floatToHalf(values, halfs.data(), count * 3, &js);
+    });
+    benchmark("halfToFloat", count, [&]() {
+        halfToFloat(halfs.data(), floats.data(), count * 3);
+    });
+
+    benchmark("linearToRGBM (per texel)", count, [&]() {
+        for (size_t i = 0; i < count; i++) {
+            rgbm[i] = image::linearToRGBM(linear[i]);
+        }
+    });
+    benchmark("linearToRGBM", count, [&]() {
+        linearToRGBM(linear.data(), rgbm.data(), count);
+    });
+    benchmark("linearToRGBM (jobs)", count, [&]() {
+        linearToRGBM(linear.data(), rgbm.data(), count, &js);
+    });
+
+    std::vector<float> small((WIDTH / 3) * (HEIGHT / 3) * 3);
+    benchmark("resample box to 1/3", count, [&]() {
+        resample(values, WIDTH, HEIGHT, 3, small.data(), WIDTH / 3, HEIGHT / 3,
+                ResampleFilter::BOX);
+    });
+    benchmark("resample Lanczos to 1/3", count, [&]() {
+        resample(values, WIDTH, HEIGHT, 3, small.data(), WIDTH / 3, HEIGHT / 3,
+                ResampleFilter::LANCZOS);
+    });
+    benchmark("resample Lanczos to 1/3 (jobs)", count, [&]() {
+        resample(values, WIDTH, HEIGHT, 3, small.data(), WIDTH / 3, HEIGHT / 3,
+                ResampleFilter::LANCZOS, &js);
+    });
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_ASYNCIMAGEENCODER_H_
+#define IMAGE_ASYNCIMAGEENCODER_H_
+
+#include <atomic>
+#include <string>
+
+#include <image/Image.h>
+
+#include <imageio/ImageEncoder.h>
+
+#include <utils/JobSystem.h>
+
+namespace image {
+
+/*
+ * Encodes images to files on the threads of a JobSystem, e.g. all the faces and levels of a
+ * cubemap, while the next ones are computed.
+ *
+ * The encodings are low priority jobs, they run when the threads have nothing else to do.
+ * The thread that calls encode() and wait() must be adopted by the JobSystem. The pixels of the
+ * images must stay valid until wait() returns, the Image objects themselves don't need to.
+ */
+class AsyncImageEncoder {
+public:
+    explicit AsyncImageEncoder(utils::JobSystem& js);
+
+    // waits for the images that are still queued
+    ~AsyncImageEncoder();
+
+    AsyncImageEncoder(AsyncImageEncoder const&) = delete;
+    AsyncImageEncoder& operator=(AsyncImageEncoder const&) = delete;
+
+    // queues the encoding of image to the file at path, see ImageEncoder::encode()
+    void encode(std::string const& path, ImageEncoder::Format format, Image const& image,
+            std::string const& compression = "");
+
+    // Waits for all the queued images, returns false if any of them could not be written.
+    // More images can be queued afterwards.
+    bool wait();
+
+private:
+    utils::JobSystem& mJobSystem;
+    utils::JobSystem::Job* mParent = nullptr;
+    std::atomic<bool> mFailed = { false };
+};
+
+} // namespace image
+
+#endif /* IMAGE_ASYNCIMAGEENCODER_H_ */
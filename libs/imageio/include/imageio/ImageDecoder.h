@@ -17,6 +17,7 @@
 #ifndef IMAGE_IMAGEDECODER_H_
 #define IMAGE_IMAGEDECODER_H_
 
+#include <functional>
 #include <string>
 
 #include <image/Image.h>
@@ -30,7 +31,31 @@ public:
         SRGB
     };
 
+    // Called with the consecutive bands of rows of an image, in the order of the file.
+    // height is the height of the whole image. Returns false to stop decoding.
+    using BandCallback = std::function<bool(const Image& band, size_t firstRow, size_t height)>;
+
+    // Returns the memory a width x height image of float pixels with the given number of
+    // channels is decoded to, or nullptr to stop decoding. bytesPerRow is set to the size of a
+    // tightly packed row, and can be increased to pad the rows.
+    using Allocator = std::function<void*(size_t width, size_t height, size_t channels,
+            size_t& bytesPerRow)>;
+
+    static Image decode(std::istream& stream, const std::string& sourceName,
+            ColorSpace sourceSpace = ColorSpace::SRGB);
+
+    // Decodes an image straight into the memory returned by allocator, e.g. aligned memory or
+    // the memory of a texture upload, without an intermediate copy. The returned image doesn't
+    // own its pixels.
     static Image decode(std::istream& stream, const std::string& sourceName,
+            Allocator const& allocator, ColorSpace sourceSpace = ColorSpace::SRGB);
+
+    // Decodes an image in bands of at most bandHeight rows, so that a large image never needs
+    // to be entirely in memory. Radiance files are decoded band by band, the other formats are
+    // decoded at once and handed out as a single band.
+    // Returns false if the image could not be decoded.
+    static bool decodeBands(std::istream& stream, const std::string& sourceName,
+            size_t bandHeight, BandCallback const& callback,
             ColorSpace sourceSpace = ColorSpace::SRGB);
 
     class Decoder {
@@ -38,6 +63,15 @@ public:
         virtual Image decode() = 0;
         virtual ~Decoder() = default;
 
+        virtual bool decodeBands(size_t bandHeight, BandCallback const& callback) {
+            Image image(decode());
+            if (!image.isValid()) {
+                return false;
+            }
+            callback(image, 0, image.getHeight());
+            return true;
+        }
+
         ColorSpace getColorSpace() const noexcept {
             return mColorSpace;
         }
@@ -46,11 +80,23 @@ public:
             mColorSpace = colorSpace;
         }
 
+        void setAllocator(Allocator allocator) {
+            mAllocator = std::move(allocator);
+        }
+
+    protected:
+        // the image decode() returns, allocated by the Allocator if there is one
+        Image allocateImage(size_t width, size_t height, size_t channels = 3) const;
+
     private:
         ColorSpace mColorSpace = ColorSpace::SRGB;
+        Allocator mAllocator;
     };
 
 private:
+    static Decoder* create(std::istream& stream, const std::string& sourceName,
+            ColorSpace sourceSpace);
+
     enum class Format {
         NONE,
         PNG,
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXDECODER_H_
+#define IMAGE_KTXDECODER_H_
+
+#include <filament/driver/DriverEnums.h>
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace image {
+
+/**
+ * The content of a KTX or KTX2 container, as it can be uploaded to a filament::Texture: the
+ * images are kept in their stored (possibly compressed) format.
+ *
+ * For each level, the faces of a cubemap are stored one after the other, getFaceSize() bytes
+ * apart, matching filament::Texture::FaceOffsets.
+ */
+class KtxTexture {
+public:
+    using TextureFormat = filament::driver::TextureFormat;
+    using PixelDataFormat = filament::driver::PixelDataFormat;
+    using PixelDataType = filament::driver::PixelDataType;
+    using CompressedPixelDataType = filament::driver::CompressedPixelDataType;
+
+    bool isValid() const noexcept { return mData != nullptr; }
+
+    uint32_t getWidth() const noexcept { return mWidth; }
+    uint32_t getHeight() const noexcept { return mHeight; }
+    uint32_t getLevels() const noexcept { return uint32_t(mLevels.size()); }
+    uint32_t getFaces() const noexcept { return mFaces; }
+    bool isCubemap() const noexcept { return mFaces == 6; }
+
+    // internal format of the texture to create
+    TextureFormat getTextureFormat() const noexcept { return mTextureFormat; }
+
+    // PixelBufferDescriptor parameters, the format is meaningless for compressed textures
+    bool isCompressed() const noexcept { return mType == PixelDataType::COMPRESSED; }
+    PixelDataFormat getPixelDataFormat() const noexcept { return mFormat; }
+    PixelDataType getPixelDataType() const noexcept { return mType; }
+    CompressedPixelDataType getCompressedPixelDataType() const noexcept { return mCompressedType; }
+
+    // row alignment of the uncompressed images, in bytes
+    uint8_t getAlignment() const noexcept { return mAlignment; }
+
+    // all the faces of a level, and the size of one of them
+    void const* getLevelData(size_t level) const noexcept {
+        return mData.get() + mLevels[level].offset;
+    }
+    size_t getLevelSize(size_t level) const noexcept { return mLevels[level].size * mFaces; }
+    size_t getFaceSize(size_t level) const noexcept { return mLevels[level].size; }
+
+private:
+    friend class KtxDecoder;
+    struct Level {
+        size_t offset;
+        size_t size;
+    };
+    std::unique_ptr<uint8_t[]> mData;
+    std::vector<Level> mLevels;
+    uint32_t mWidth = 0;
+    uint32_t mHeight = 0;
+    uint32_t mFaces = 1;
+    TextureFormat mTextureFormat = TextureFormat::RGBA8;
+    PixelDataFormat mFormat = PixelDataFormat::RGBA;
+    PixelDataType mType = PixelDataType::UBYTE;
+    CompressedPixelDataType mCompressedType = CompressedPixelDataType::ETC2_RGB8;
+    uint8_t mAlignment = 1;
+};
+
+/**
+ * Reads KTX (1.1) and KTX2 containers of 2D textures and cubemaps. Only the formats that have
+ * a filament::driver::TextureFormat are supported, and supercompressed KTX2 files (e.g. Basis
+ * Universal) are rejected. Decoding has no global state, it can run on any thread.
+ */
+class KtxDecoder {
+public:
+    static bool checkSignature(char const* buf);
+
+    // returns an invalid texture if the stream is not a supported KTX file
+    static KtxTexture decode(std::istream& stream);
+
+private:
+    static KtxTexture decodeKtx1(std::istream& stream);
+    static KtxTexture decodeKtx2(std::istream& stream);
+};
+
+} // namespace image
+
+#endif /* IMAGE_KTXDECODER_H_ */
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMAGE_KTXENCODER_H_
+#define IMAGE_KTXENCODER_H_
+
+#include <image/Image.h>
+
+#include <iosfwd>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace image {
+
+/**
+ * Writes KTX (1.1) containers of 2D textures and cubemaps, which KtxDecoder can read back.
+ */
+class KtxEncoder {
+public:
+    /**
+     * Writes images storing linear float3 pixels as RGB9_E5, an HDR format with a 9 bits
+     * mantissa per channel and a shared 5 bits exponent, 4 bytes per pixel.
+     *
+     * images[level * faces + face] is a face of a level, the levels are the mipmaps starting at
+     * the base level. faces is 1 or 6, in the +X, -X, +Y, -Y, +Z, -Z order.
+     * Returns false if the images are invalid or if the stream couldn't be written.
+     */
+    static bool encodeRGB9E5(std::ostream& stream, Image const* const* images,
+            size_t levels, size_t faces);
+
+    // packs a linear color in the RGB9_E5 format, the values are clamped to [0, 65408]
+    static uint32_t packRGB9E5(float r, float g, float b) noexcept;
+};
+
+} // namespace image
+
+#endif /* IMAGE_KTXENCODER_H_ */
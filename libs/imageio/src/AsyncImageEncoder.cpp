@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/AsyncImageEncoder.h>
+
+#include <fstream>
+#include <memory>
+
+using namespace utils;
+
+namespace image {
+
+namespace {
+
+struct Task {
+    std::string path;
+    ImageEncoder::Format format;
+    Image image;    // doesn't own the pixels
+    std::string compression;
+};
+
+} // anonymous namespace
+
+AsyncImageEncoder::AsyncImageEncoder(JobSystem& js) : mJobSystem(js) {
+}
+
+AsyncImageEncoder::~AsyncImageEncoder() {
+    wait();
+}
+
+void AsyncImageEncoder::encode(std::string const& path, ImageEncoder::Format format,
+        Image const& image, std::string const& compression) {
+    JobSystem& js = mJobSystem;
+    if (!mParent) {
+        mParent = js.createJob();
+    }
+
+    Task* task = new Task{ path, format, {}, compression };
+    task->image.set(image);
+
+    // the functor only holds pointers, so it fits in the job
+    std::atomic<bool>* failed = &mFailed;
+    JobSystem::Job* job = js.createJob(mParent, [task, failed](JobSystem&, JobSystem::Job*) {
+        std::unique_ptr<Task> t(task);
+        std::ofstream stream(t->path, std::ios::binary | std::ios::trunc);
+        if (stream) {
+            ImageEncoder::encode(stream, t->format, t->image, t->compression, t->path);
+            stream.close();
+        }
+        if (!stream) {
+            failed->store(true, std::memory_order_relaxed);
+        }
+    });
+    js.runAndRelease(job, JobSystem::LOW_PRIORITY);
+}
+
+bool AsyncImageEncoder::wait() {
+    if (mParent) {
+        mJobSystem.runAndWait(mParent);
+        mJobSystem.release(mParent);
+        mParent = nullptr;
+    }
+    return !mFailed.exchange(false);
+}
+
+} // namespace image
@@ -16,6 +16,7 @@
 
 #include <imageio/ImageDecoder.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <istream>
 #include <limits>
@@ -87,6 +88,11 @@ private:
 
     // ImageDecoder::Decoder interface
     virtual Image decode() override;
+    virtual bool decodeBands(size_t bandHeight,
+            ImageDecoder::BandCallback const& callback) override;
+
+    void readHeader(size_t& width, size_t& height, uint32_t& flags);
+    void readScanline(math::float3* dst, size_t width, uint8_t* rgbe);
 
     static const char sigRadiance[];
     static const char sigRGBE[];
@@ -141,8 +147,8 @@ private:
 
 // -----------------------------------------------------------------------------------------------
 
-Image ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
-        ColorSpace sourceSpace) {
+ImageDecoder::Decoder* ImageDecoder::create(std::istream& stream,
+        const std::string& sourceName, ColorSpace sourceSpace) {
 
     Format format = Format::NONE;
 
@@ -162,63 +168,104 @@ Image ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
 
     stream.seekg(pos);
 
-    std::unique_ptr<Decoder> decoder;
+    Decoder* decoder = nullptr;
     switch (format) {
         case Format::NONE:
-            return Image();
+            return nullptr;
         case Format::PNG:
-            decoder.reset(PNGDecoder::create(stream));
+            decoder = PNGDecoder::create(stream);
             decoder->setColorSpace(sourceSpace);
             break;
         case Format::HDR:
-            decoder.reset(HDRDecoder::create(stream));
+            decoder = HDRDecoder::create(stream);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
         case Format::PSD:
-            decoder.reset(PSDDecoder::create(stream));
+            decoder = PSDDecoder::create(stream);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
         case Format::EXR:
-            decoder.reset(EXRDecoder::create(stream, sourceName));
+            decoder = EXRDecoder::create(stream, sourceName);
             decoder->setColorSpace(ColorSpace::LINEAR);
             break;
     }
+    return decoder;
+}
+
+Image ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
+        ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(create(stream, sourceName, sourceSpace));
+    if (!decoder) {
+        return Image();
+    }
+    return decoder->decode();
+}
 
+Image ImageDecoder::decode(std::istream& stream, const std::string& sourceName,
+        Allocator const& allocator, ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(create(stream, sourceName, sourceSpace));
+    if (!decoder) {
+        return Image();
+    }
+    decoder->setAllocator(allocator);
     return decoder->decode();
 }
 
+bool ImageDecoder::decodeBands(std::istream& stream, const std::string& sourceName,
+        size_t bandHeight, BandCallback const& callback, ColorSpace sourceSpace) {
+    std::unique_ptr<Decoder> decoder(create(stream, sourceName, sourceSpace));
+    if (!decoder) {
+        return false;
+    }
+    return decoder->decodeBands(bandHeight, callback);
+}
+
 // -----------------------------------------------------------------------------------------------
 
+Image ImageDecoder::Decoder::allocateImage(size_t width, size_t height, size_t channels) const {
+    const size_t bpp = channels * sizeof(float);
+    size_t bpr = width * bpp;
+    if (mAllocator) {
+        void* data = mAllocator(width, height, channels, bpr);
+        if (!data) {
+            throw std::runtime_error("the image could not be allocated");
+        }
+        return Image(data, width, height, bpr, bpp, channels);
+    }
+    std::unique_ptr<uint8_t[]> data(new uint8_t[height * bpr]);
+    return Image(std::move(data), width, height, bpr, bpp, channels);
+}
+
+// dst is a float3 image of the size of src
 template<typename T, typename PROCESS, typename TRANSFORM>
-static Image toLinear(size_t w, size_t h, size_t bpr,
+static Image toLinear(Image dst, size_t bpr,
         const std::unique_ptr<uint8_t[]>& src, PROCESS proc, TRANSFORM transform) {
-    std::unique_ptr<uint8_t[]> dst(new uint8_t[w * h * sizeof(math::float3)]);
-    math::float3* d = reinterpret_cast<math::float3*>(dst.get());
-    for (size_t y = 0; y < h; ++y) {
+    for (size_t y = 0; y < dst.getHeight(); ++y) {
         T const* p = reinterpret_cast<T const*>(src.get() + y * bpr);
-        for (size_t x = 0; x < w; ++x, p += 3) {
+        math::float3* d = static_cast<math::float3*>(dst.getPixelRef(0, y));
+        for (size_t x = 0; x < dst.getWidth(); ++x, p += 3) {
             math::float3 sRGB(proc(p[0]), proc(p[1]), proc(p[2]));
             sRGB /= std::numeric_limits<T>::max();
             *d++ = transform(sRGB);
         }
     }
-    return Image(std::move(dst), w, h, w * sizeof(math::float3), sizeof(math::float3));
+    return dst;
 }
 
+// dst is a float4 image of the size of src
 template<typename T, typename PROCESS, typename TRANSFORM>
-static Image toLinearWithAlpha(size_t w, size_t h, size_t bpr,
+static Image toLinearWithAlpha(Image dst, size_t bpr,
         const std::unique_ptr<uint8_t[]>& src, PROCESS proc, TRANSFORM transform) {
-    std::unique_ptr<uint8_t[]> dst(new uint8_t[w * h * sizeof(math::float4)]);
-    math::float4* d = reinterpret_cast<math::float4*>(dst.get());
-    for (size_t y = 0; y < h; ++y) {
+    for (size_t y = 0; y < dst.getHeight(); ++y) {
         T const* p = reinterpret_cast<T const*>(src.get() + y * bpr);
-        for (size_t x = 0; x < w; ++x, p += 4) {
+        math::float4* d = static_cast<math::float4*>(dst.getPixelRef(0, y));
+        for (size_t x = 0; x < dst.getWidth(); ++x, p += 4) {
             math::float4 sRGB(proc(p[0]), proc(p[1]), proc(p[2]), proc(p[3]));
             sRGB /= std::numeric_limits<T>::max();
             *d++ = transform(sRGB);
         }
     }
-    return Image(std::move(dst), w, h, w * sizeof(math::float4), sizeof(math::float4), 4);
+    return dst;
 }
 
 
@@ -300,22 +347,24 @@ Image PNGDecoder::decode() {
 
         if (colorType == PNG_COLOR_TYPE_RGBA) {
             if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
+                return toLinearWithAlpha<uint16_t>(allocateImage(width, height, 4), rowBytes,
+                        imageData,
                         [ ](uint16_t v) -> uint16_t { return ntohs(v); },
                         sRGBToLinear<math::float4>);
             } else {
-                return toLinearWithAlpha<uint16_t>(width, height, rowBytes, imageData,
+                return toLinearWithAlpha<uint16_t>(allocateImage(width, height, 4), rowBytes,
+                        imageData,
                         [ ](uint16_t v) -> uint16_t { return ntohs(v); },
                         [ ](const math::float4& color) -> math::float4 { return color; });
             }
         } else {
             // Convert to linear float (PNG 16 stores data in network order (big endian).
             if (getColorSpace() == ImageDecoder::ColorSpace::SRGB) {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
+                return toLinear<uint16_t>(allocateImage(width, height), rowBytes, imageData,
                         [ ](uint16_t v) -> uint16_t { return ntohs(v); },
                         sRGBToLinear<math::float3>);
             } else {
-                return toLinear<uint16_t>(width, height, rowBytes, imageData,
+                return toLinear<uint16_t>(allocateImage(width, height), rowBytes, imageData,
                         [ ](uint16_t v) -> uint16_t { return ntohs(v); },
                         [ ](const math::float3& color) -> math::float3 { return color; });
             }
@@ -372,95 +421,136 @@ HDRDecoder::HDRDecoder(std::istream& stream)
 HDRDecoder::~HDRDecoder() {
 }
 
-Image HDRDecoder::decode() {
-    try {
-        float gamma;
-        float exposure;
-        char sy, sx;
-        unsigned int height, width;
-
-        {
-            char buf[1024];
-            do {
-                char format[128];
-                mStream.getline(buf, sizeof(buf), 0xa);
-                if (buf[0] == '#') continue;
-                sscanf(buf, "FORMAT=%127s", format);
-                sscanf(buf, "GAMMA=%f", &gamma);
-                sscanf(buf, "EXPOSURE=%f", &exposure);
-                if ((sscanf(buf, "%cY %u %cX %u", &sy, &height, &sx, &width) == 4)||
-                    (sscanf(buf, "%cX %u %cY %u", &sx, &width, &sy, &height) == 4)) {
-                    break;
+void HDRDecoder::readHeader(size_t& width, size_t& height, uint32_t& flags) {
+    float gamma;
+    float exposure;
+    char sy, sx;
+    unsigned int h, w;
+
+    char buf[1024];
+    do {
+        char format[128];
+        mStream.getline(buf, sizeof(buf), 0xa);
+        if (!mStream) {
+            throw std::runtime_error("invalid header");
+        }
+        if (buf[0] == '#') continue;
+        sscanf(buf, "FORMAT=%127s", format);
+        sscanf(buf, "GAMMA=%f", &gamma);
+        sscanf(buf, "EXPOSURE=%f", &exposure);
+        if ((sscanf(buf, "%cY %u %cX %u", &sy, &h, &sx, &w) == 4)||
+            (sscanf(buf, "%cX %u %cY %u", &sx, &w, &sy, &h) == 4)) {
+            break;
+        }
+    } while (true);
+
+    flags = 0;
+    if (sx == '-') flags |= Image::FLIP_X;
+
+    // Experimentally, "-Y" means vertical origin at the top, "+Y" at the bottom
+    if (sy == '+') flags |= Image::FLIP_Y;
+
+    width = w;
+    height = h;
+}
+
+void HDRDecoder::readScanline(math::float3* i, size_t width, uint8_t* rgbe) {
+    uint16_t w;
+    uint16_t magic;
+    mStream.read((char*)&magic, 2);
+    if (magic != 0x0202) {
+        throw std::runtime_error("invalid scanline (magic)");
+    }
+    mStream.read((char*)&w, 2);
+    if (ntohs(w) != width) {
+        throw std::runtime_error("invalid scanline (width)");
+    }
+
+    char *d = (char *)rgbe;
+    for (size_t p=0 ; p<4 ; p++) {
+        size_t num_bytes = 0;
+        while (num_bytes < width) {
+            uint8_t rle_count;
+            mStream.read((char*)&rle_count, 1);
+            if (rle_count > 128) {
+                char v;
+                mStream.read(&v, 1);
+                memset(d, v, size_t(rle_count - 128));
+                d += rle_count - 128;
+                num_bytes += rle_count - 128;
+            } else {
+                if (rle_count == 0) {
+                    throw std::runtime_error("run length is zero");
                 }
-            } while (true);
+                mStream.read(d, rle_count);
+                d += rle_count;
+                num_bytes += rle_count;
+            }
         }
+    }
 
-        uint32_t flags = 0;
-        if (sx == '-') flags |= Image::FLIP_X;
+    uint8_t const* r = &rgbe[0];
+    uint8_t const* g = &rgbe[width];
+    uint8_t const* b = &rgbe[2*width];
+    uint8_t const* e = &rgbe[3*width];
+    // (rgb/256) * 2^(e-128)
+    for (size_t x=0 ; x<width ; x++, r++, g++, b++, e++) {
+        math::float3 v(r[0], g[0], b[0]);
+        i[x] = v * std::ldexp(1.0f, e[0]-(128+8));
+    }
+}
 
-        // Experimentally, "-Y" means vertical origin at the top, "+Y" at the bottom
-        if (sy == '+') flags |= Image::FLIP_Y;
+Image HDRDecoder::decode() {
+    try {
+        size_t width, height;
+        uint32_t flags;
+        readHeader(width, height, flags);
 
-        std::unique_ptr<uint8_t[]> data(new uint8_t[width * height * sizeof(math::float3)]);
-        Image image(std::move(data), width, height, width*sizeof(math::float3), sizeof(math::float3));
+        Image image(allocateImage(width, height));
         image.setFlags(flags);
 
-        uint16_t w;
-        uint16_t magic;
         std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width*4]);
         for (size_t y=0 ; y<height ; y++) {
-            //std::cout << "line: " << y << std::endl;
-            mStream.read((char*)&magic, 2);
-            if (magic != 0x0202) {
-                throw std::runtime_error("invalid scanline (magic)");
-            }
-            mStream.read((char*)&w, 2);
-            if (ntohs(w) != width) {
-                throw std::runtime_error("invalid scanline (width)");
-            }
+            readScanline(static_cast<math::float3*>(image.getPixelRef(0, y)), width, rgbe.get());
+        }
+        return image;
 
-            char *d = (char *)rgbe.get();
-            for (size_t p=0 ; p<4 ; p++) {
-                size_t num_bytes = 0;
-                while (num_bytes < width) {
-                    uint8_t rle_count;
-                    mStream.read((char*)&rle_count, 1);
-                    if (rle_count > 128) {
-                        char v;
-                        mStream.read(&v, 1);
-                        memset(d, v, size_t(rle_count - 128));
-                        d += rle_count - 128;
-                        num_bytes += rle_count - 128;
-                    } else {
-                        if (rle_count == 0) {
-                            throw std::runtime_error("run length is zero");
-                        }
-                        mStream.read(d, rle_count);
-                        d += rle_count;
-                        num_bytes += rle_count;
-                    }
-                }
-            }
+    } catch(std::runtime_error& e) {
+        // reset the stream, like we found it
+        std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
+        mStream.seekg(mStreamStartPos);
+    }
+    return Image();
+}
+
+bool HDRDecoder::decodeBands(size_t bandHeight, ImageDecoder::BandCallback const& callback) {
+    try {
+        size_t width, height;
+        uint32_t flags;
+        readHeader(width, height, flags);
 
-            uint8_t const* r = &rgbe[0];
-            uint8_t const* g = &rgbe[width];
-            uint8_t const* b = &rgbe[2*width];
-            uint8_t const* e = &rgbe[3*width];
-            math::float3* i = static_cast<math::float3*>(image.getPixelRef(0, y));
-            // (rgb/256) * 2^(e-128)
-            for (size_t x=0 ; x<width ; x++, r++, g++, b++, e++) {
-                math::float3 v(r[0], g[0], b[0]);
-                i[x] = v * std::ldexp(1.0f, e[0]-(128+8));
+        bandHeight = std::max(size_t(1), std::min(bandHeight, height));
+        std::unique_ptr<uint8_t[]> rgbe(new uint8_t[width*4]);
+        for (size_t y0=0 ; y0<height ; y0+=bandHeight) {
+            const size_t rows = std::min(bandHeight, height - y0);
+            std::unique_ptr<uint8_t[]> data(new uint8_t[width * rows * sizeof(math::float3)]);
+            Image band(std::move(data), width, rows, width*sizeof(math::float3), sizeof(math::float3));
+            band.setFlags(flags);
+            for (size_t y=0 ; y<rows ; y++) {
+                readScanline(static_cast<math::float3*>(band.getPixelRef(0, y)), width, rgbe.get());
+            }
+            if (!callback(band, y0, height)) {
+                break;
             }
         }
-        return image;
+        return true;
 
     } catch(std::runtime_error& e) {
         // reset the stream, like we found it
         std::cerr << "Runtime error while decoding HDR: " << e.what() << std::endl;
         mStream.seekg(mStreamStartPos);
     }
-    return Image();
+    return false;
 }
 
 // -----------------------------------------------------------------------------------------------
@@ -542,9 +632,7 @@ Image PSDDecoder::decode() {
             throw std::runtime_error("compressed images are not supported");
         }
 
-        std::unique_ptr<uint8_t[]> data(new uint8_t[width * height * sizeof(math::float3)]);
-        Image image(std::move(data), width, height,
-                    width * sizeof(math::float3), sizeof(math::float3));
+        Image image(allocateImage(width, height));
 
         if (depth == 32) {
             for (size_t i = 0; i < 3; i++) {
@@ -620,9 +708,9 @@ Image EXRDecoder::decode() {
 
         src.resize(0);
 
-        std::unique_ptr<uint8_t[]> data(new uint8_t[width * height * sizeof(math::float3)]);
-        Image image(std::move(data), static_cast<size_t>(width), static_cast<size_t>(height),
-                    width * sizeof(math::float3), sizeof(math::float3));
+        // rgba is allocated by tinyexr with malloc()
+        std::unique_ptr<float, decltype(&free)> pixels(rgba, &free);
+        Image image(allocateImage(static_cast<size_t>(width), static_cast<size_t>(height)));
 
         size_t i = 0;
         for (size_t y = 0; y < height; y++) {
@@ -38,6 +38,7 @@
 #include <math/vec3.h>
 #include <math/vec4.h>
 
+#include <image/ColorTransforms.h>
 #include <image/utilities.h>
 
 using namespace math;
@@ -266,11 +267,13 @@ std::unique_ptr<uint8_t[]> fromLinearTosRGB(const Image& image) {
     size_t h = image.getHeight();
     size_t channels = image.getChannelsCount();
     std::unique_ptr<uint8_t[]> dst(new uint8_t[w * h * 3 * sizeof(T)]);
+    std::unique_ptr<float3[]> row(new float3[w]);
     T* d = reinterpret_cast<T*>(dst.get());
     for (size_t y = 0; y < h; ++y) {
-        float3 const* p = static_cast<float3 const*>(image.getPixelRef(0, y));
-        for (size_t x = 0; x < w; ++x, ++p, d += channels) {
-            float3 l(linearTosRGB(saturate(*p)) * std::numeric_limits<T>::max());
+        float const* p = static_cast<float const*>(image.getPixelRef(0, y));
+        linearTosRGB(p, &row[0].x, w, 3);
+        for (size_t x = 0; x < w; ++x, d += channels) {
+            float3 l(saturate(row[x]) * std::numeric_limits<T>::max());
             for (size_t i = 0; i < 3; i++) {
                 d[i] = T(l[i]);
             }
@@ -303,11 +306,13 @@ std::unique_ptr<uint8_t[]> fromLinearToRGBM(const Image& image) {
     size_t w = image.getWidth();
     size_t h = image.getHeight();
     std::unique_ptr<uint8_t[]> dst(new uint8_t[w * h * 4 * sizeof(T)]);
+    std::unique_ptr<float4[]> row(new float4[w]);
     T* d = reinterpret_cast<T*>(dst.get());
     for (size_t y = 0; y < h; ++y) {
         float3 const* p = static_cast<float3 const*>(image.getPixelRef(0, y));
-        for (size_t x = 0; x < w; ++x, ++p, d += 4) {
-            float4 l(linearToRGBM(*p) * std::numeric_limits<T>::max());
+        linearToRGBM(p, row.get(), w);
+        for (size_t x = 0; x < w; ++x, d += 4) {
+            float4 l(row[x] * std::numeric_limits<T>::max());
             for (size_t i = 0; i < 4; i++) {
                 d[i] = T(l[i]);
             }
@@ -791,22 +796,26 @@ void EXREncoder::encode(const Image& image) {
         exrImage.width = static_cast<int>(width);
         exrImage.height = static_cast<int>(height);
 
-        std::unique_ptr<float[]> r(new float[width * height]);
-        std::unique_ptr<float[]> g(new float[width * height]);
-        std::unique_ptr<float[]> b(new float[width * height]);
+        // the pixels are converted to half here rather than by tinyexr, which does it one
+        // value at a time
+        std::unique_ptr<half[]> r(new half[width * height]);
+        std::unique_ptr<half[]> g(new half[width * height]);
+        std::unique_ptr<half[]> b(new half[width * height]);
+        std::unique_ptr<half3[]> row(new half3[width]);
 
         size_t i = 0;
         for (size_t y = 0; y < height; y++) {
-            const float3* data = static_cast<float3*>(image.getPixelRef(0, y));
-            for (size_t x = 0; x < width; x++, data++) {
-                r[i] = data->r;
-                g[i] = data->g;
-                b[i] = data->b;
+            const float* data = static_cast<float*>(image.getPixelRef(0, y));
+            floatToHalf(data, &row[0].x, width * 3);
+            for (size_t x = 0; x < width; x++) {
+                r[i] = row[x].r;
+                g[i] = row[x].g;
+                b[i] = row[x].b;
                 i++;
             }
         }
 
-        float* imageData[3];
+        half* imageData[3];
         imageData[0] = &b[0];
         imageData[1] = &g[0];
         imageData[2] = &r[0];
@@ -827,7 +836,7 @@ void EXREncoder::encode(const Image& image) {
         header.pixel_types = (int*) malloc(sizeof(int) * header.num_channels);
         header.requested_pixel_types = (int*) malloc(sizeof(int) * header.num_channels);
         for (i = 0; i < header.num_channels; i++) {
-            header.pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+            header.pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
             header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_HALF;
         }
 
@@ -1003,16 +1012,15 @@ void DDSEncoder::encode(const Image& image) {
         switch (headerDX10.dxgiFormat) {
             case DXGI_FORMAT_R8_UINT: {
                 switch (mFormat) {
-                    case PixelFormat::sRGB:
+                    case PixelFormat::sRGB: {
+                        std::unique_ptr<uint8_t[]> row(new uint8_t[width]);
                         for (size_t y = 0; y < height; y++) {
                             const float* data = static_cast<float*>(image.getPixelRef(0, y));
-                            for (size_t x = 0; x < width; x++) {
-                                uint8_t b = (uint8_t) (linearTosRGB(saturate(*data)) * 255);
-                                mStream.write((const char*) &b, 1);
-                                data++;
-                            }
+                            linearTosRGB8(data, row.get(), width, 1);
+                            mStream.write((const char*) row.get(), width);
                         }
                         break;
+                    }
                     case PixelFormat::LINEAR_RGB:
                         for (size_t y = 0; y < height; y++) {
                             const float* data = static_cast<float*>(image.getPixelRef(0, y));
@@ -1027,13 +1035,11 @@ void DDSEncoder::encode(const Image& image) {
                 break;
             }
             case DXGI_FORMAT_R16_FLOAT: {
+                std::unique_ptr<half[]> row(new half[width]);
                 for (size_t y = 0; y < height; y++) {
                     const float* data = static_cast<float*>(image.getPixelRef(0, y));
-                    for (size_t x = 0; x < width; x++) {
-                        math::half p = math::half(*data);
-                        mStream.write((const char*) &p, 2);
-                        data++;
-                    }
+                    floatToHalf(data, row.get(), width);
+                    mStream.write((const char*) row.get(), width * sizeof(half));
                 }
                 break;
             }
@@ -1046,19 +1052,18 @@ void DDSEncoder::encode(const Image& image) {
             }
             case DXGI_FORMAT_R8G8_UINT: {
                 switch (mFormat) {
-                    case PixelFormat::sRGB:
+                    case PixelFormat::sRGB: {
+                        std::unique_ptr<uint8_t[]> row(new uint8_t[width * 2]);
                         for (size_t y = 0; y < height; y++) {
-                            const float2* data = static_cast<float2*>(image.getPixelRef(0, y));
+                            const float* data = static_cast<float*>(image.getPixelRef(0, y));
+                            linearTosRGB8(data, row.get(), width, 2);
                             for (size_t x = 0; x < width; x++) {
-                                uint8_t b;
-                                b = (uint8_t) (linearTosRGB(saturate(data->g)) * 255);
-                                mStream.write((const char*) &b, 1);
-                                b = (uint8_t) (linearTosRGB(saturate(data->r)) * 255);
-                                mStream.write((const char*) &b, 1);
-                                data++;
+                                std::swap(row[x * 2], row[x * 2 + 1]);
                             }
+                            mStream.write((const char*) row.get(), width * 2);
                         }
                         break;
+                    }
                     case PixelFormat::LINEAR_RGB:
                         for (size_t y = 0; y < height; y++) {
                             const float2* data = static_cast<float2*>(image.getPixelRef(0, y));
@@ -1076,13 +1081,11 @@ void DDSEncoder::encode(const Image& image) {
                 break;
             }
             case DXGI_FORMAT_R16G16_FLOAT: {
+                std::unique_ptr<half[]> row(new half[width * 2]);
                 for (size_t y = 0; y < height; y++) {
-                    const float2* data = static_cast<float2*>(image.getPixelRef(0, y));
-                    for (size_t x = 0; x < width; x++) {
-                        half2 p = half2(*data);
-                        mStream.write((const char*) &p, sizeof(p));
-                        data++;
-                    }
+                    const float* data = static_cast<float*>(image.getPixelRef(0, y));
+                    floatToHalf(data, row.get(), width * 2);
+                    mStream.write((const char*) row.get(), width * sizeof(half2));
                 }
                 break;
             }
@@ -1095,20 +1098,22 @@ void DDSEncoder::encode(const Image& image) {
             }
             case DXGI_FORMAT_R8G8B8A8_UINT: {
                 switch (mFormat) {
-                    case PixelFormat::sRGB:
+                    case PixelFormat::sRGB: {
+                        std::unique_ptr<uint8_t[]> rgb(new uint8_t[width * 3]);
+                        std::unique_ptr<uint8_t[]> row(new uint8_t[width * 4]);
                         for (size_t y = 0; y < height; y++) {
-                            const float3* data = static_cast<float3*>(image.getPixelRef(0, y));
+                            const float* data = static_cast<float*>(image.getPixelRef(0, y));
+                            linearTosRGB8(data, rgb.get(), width, 3);
                             for (size_t x = 0; x < width; x++) {
-                                uint8_t r = (uint8_t) (linearTosRGB(saturate(data->r)) * 255);
-                                uint8_t g = (uint8_t) (linearTosRGB(saturate(data->g)) * 255);
-                                uint8_t b = (uint8_t) (linearTosRGB(saturate(data->b)) * 255);
-                                uint32_t p = (uint8_t) 0xff << 24 | b << 16 | g << 8 | r;
-                                mStream.write((const char*) &p, 4);
-                                data++;
+                                row[x * 4 + 0] = rgb[x * 3 + 0];
+                                row[x * 4 + 1] = rgb[x * 3 + 1];
+                                row[x * 4 + 2] = rgb[x * 3 + 2];
+                                row[x * 4 + 3] = 0xff;
                             }
+                            mStream.write((const char*) row.get(), width * 4);
                         }
-
                         break;
+                    }
                     case PixelFormat::LINEAR_RGB:
                         for (size_t y = 0; y < height; y++) {
                             const float3* data = static_cast<float3*>(image.getPixelRef(0, y));
@@ -1126,13 +1131,15 @@ void DDSEncoder::encode(const Image& image) {
                 break;
             }
             case DXGI_FORMAT_R16G16B16A16_FLOAT: {
+                std::unique_ptr<half3[]> rgb(new half3[width]);
+                std::unique_ptr<half4[]> row(new half4[width]);
                 for (size_t y = 0; y < height; y++) {
-                    const float3* data = static_cast<float3*>(image.getPixelRef(0, y));
+                    const float* data = static_cast<float*>(image.getPixelRef(0, y));
+                    floatToHalf(data, &rgb[0].x, width * 3);
                     for (size_t x = 0; x < width; x++) {
-                        half4 p = half4(half3(*data), 1);
-                        mStream.write((const char*) &p, sizeof(ushort4));
-                        data++;
+                        row[x] = half4(rgb[x], 1);
                     }
+                    mStream.write((const char*) row.get(), width * sizeof(half4));
                 }
                 break;
             }
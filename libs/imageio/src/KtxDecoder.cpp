@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/KtxDecoder.h>
+
+#include <algorithm>
+#include <istream>
+
+#include <string.h>
+
+namespace image {
+
+using namespace filament::driver;
+
+static const char sigKtx1[] =
+        { '\xAB', 'K', 'T', 'X', ' ', '1', '1', '\xBB', '\r', '\n', '\x1A', '\n' };
+static const char sigKtx2[] =
+        { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+// Only the formats filament can sample are listed. KTX identifies them with their GL internal
+// format, KTX2 with their Vulkan format.
+struct FormatInfo {
+    uint32_t glInternalFormat;
+    uint32_t vkFormat;
+    TextureFormat textureFormat;
+    PixelDataFormat format;
+    PixelDataType type;
+    CompressedPixelDataType compressedType;
+};
+
+static const FormatInfo FORMATS[] = {
+    { 0x8229, 9,  TextureFormat::R8,      PixelDataFormat::R,    PixelDataType::UBYTE, {} },
+    { 0x822B, 16, TextureFormat::RG8,     PixelDataFormat::RG,   PixelDataType::UBYTE, {} },
+    { 0x8051, 23, TextureFormat::RGB8,    PixelDataFormat::RGB,  PixelDataType::UBYTE, {} },
+    { 0x8C41, 29, TextureFormat::SRGB8,   PixelDataFormat::RGB,  PixelDataType::UBYTE, {} },
+    { 0x8058, 37, TextureFormat::RGBA8,   PixelDataFormat::RGBA, PixelDataType::UBYTE, {} },
+    { 0x8C43, 43, TextureFormat::SRGB8_A8, PixelDataFormat::RGBA, PixelDataType::UBYTE, {} },
+    { 0x881B, 90, TextureFormat::RGB16F,  PixelDataFormat::RGB,  PixelDataType::HALF,  {} },
+    { 0x881A, 97, TextureFormat::RGBA16F, PixelDataFormat::RGBA, PixelDataType::HALF,  {} },
+    { 0x8C3D, 123, TextureFormat::RGB9_E5, PixelDataFormat::RGB,
+      PixelDataType::UINT_5_9_9_9_REV, {} },
+
+#define COMPRESSED(gl, vk, f) \
+    { gl, vk, TextureFormat::f, PixelDataFormat::RGBA, PixelDataType::COMPRESSED, \
+      CompressedPixelDataType::f }
+    COMPRESSED(0x9270, 153, EAC_R11),
+    COMPRESSED(0x9271, 154, EAC_R11_SIGNED),
+    COMPRESSED(0x9272, 155, EAC_RG11),
+    COMPRESSED(0x9273, 156, EAC_RG11_SIGNED),
+    COMPRESSED(0x9274, 147, ETC2_RGB8),
+    COMPRESSED(0x9275, 148, ETC2_SRGB8),
+    COMPRESSED(0x9276, 149, ETC2_RGB8_A1),
+    COMPRESSED(0x9277, 150, ETC2_SRGB8_A1),
+    COMPRESSED(0x9278, 151, ETC2_EAC_RGBA8),
+    COMPRESSED(0x9279, 152, ETC2_EAC_SRGBA8),
+    COMPRESSED(0x83F0, 131, DXT1_RGB),
+    COMPRESSED(0x83F1, 133, DXT1_RGBA),
+    COMPRESSED(0x83F2, 135, DXT3_RGBA),
+    COMPRESSED(0x83F3, 137, DXT5_RGBA),
+#undef COMPRESSED
+};
+
+static FormatInfo const* findFormat(uint32_t glInternalFormat, uint32_t vkFormat) {
+    for (FormatInfo const& info : FORMATS) {
+        if ((glInternalFormat && info.glInternalFormat == glInternalFormat) ||
+                (vkFormat && info.vkFormat == vkFormat)) {
+            return &info;
+        }
+    }
+    return nullptr;
+}
+
+// KTX files are little-endian, like all the platforms filament runs on
+template<typename T>
+static inline T read(std::istream& stream) {
+    T data = 0;
+    stream.read(reinterpret_cast<char*>(&data), sizeof(T));
+    return data;
+}
+
+// -----------------------------------------------------------------------------------------------
+
+bool KtxDecoder::checkSignature(char const* buf) {
+    return !memcmp(buf, sigKtx1, sizeof(sigKtx1)) || !memcmp(buf, sigKtx2, sizeof(sigKtx2));
+}
+
+KtxTexture KtxDecoder::decode(std::istream& stream) {
+    char buf[sizeof(sigKtx1)];
+    stream.read(buf, sizeof(buf));
+    if (!stream) {
+        return KtxTexture();
+    }
+    if (!memcmp(buf, sigKtx1, sizeof(sigKtx1))) {
+        return decodeKtx1(stream);
+    }
+    if (!memcmp(buf, sigKtx2, sizeof(sigKtx2))) {
+        return decodeKtx2(stream);
+    }
+    return KtxTexture();
+}
+
+KtxTexture KtxDecoder::decodeKtx1(std::istream& stream) {
+    const uint32_t endianness = read<uint32_t>(stream);
+    read<uint32_t>(stream); // glType
+    read<uint32_t>(stream); // glTypeSize
+    read<uint32_t>(stream); // glFormat
+    const uint32_t glInternalFormat = read<uint32_t>(stream);
+    read<uint32_t>(stream); // glBaseInternalFormat
+    const uint32_t width = read<uint32_t>(stream);
+    const uint32_t height = read<uint32_t>(stream);
+    const uint32_t depth = read<uint32_t>(stream);
+    const uint32_t arrayElements = read<uint32_t>(stream);
+    const uint32_t faces = read<uint32_t>(stream);
+    const uint32_t levels = read<uint32_t>(stream);
+    const uint32_t keyValueDataSize = read<uint32_t>(stream);
+
+    // big-endian files, 3D textures and arrays are not supported
+    FormatInfo const* info = findFormat(glInternalFormat, 0);
+    if (!stream || endianness != 0x04030201 || !info || !width || !height || depth ||
+            arrayElements || (faces != 1 && faces != 6)) {
+        return KtxTexture();
+    }
+    stream.ignore(keyValueDataSize);
+
+    KtxTexture texture;
+    texture.mWidth = width;
+    texture.mHeight = height;
+    texture.mFaces = faces;
+    texture.mTextureFormat = info->textureFormat;
+    texture.mFormat = info->format;
+    texture.mType = info->type;
+    texture.mCompressedType = info->compressedType;
+    // the rows of uncompressed images are 4-byte aligned
+    texture.mAlignment = 4;
+
+    // Each level is its size, followed by its faces. The faces and the levels are 4-byte
+    // aligned, the images are read one by one so the padding is dropped.
+    std::vector<std::unique_ptr<uint8_t[]>> images;
+    const uint32_t levelCount = std::max(1u, levels);
+    size_t offset = 0;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        const uint32_t imageSize = read<uint32_t>(stream);
+        if (!stream || !imageSize) {
+            return KtxTexture();
+        }
+        std::unique_ptr<uint8_t[]> image(new uint8_t[size_t(imageSize) * faces]);
+        const uint32_t padding = (4 - (imageSize & 3)) & 3;
+        for (uint32_t face = 0; face < faces; face++) {
+            stream.read(reinterpret_cast<char*>(image.get() + imageSize * face), imageSize);
+            stream.ignore(padding);
+        }
+        if (!stream) {
+            return KtxTexture();
+        }
+        texture.mLevels.push_back({ offset, imageSize });
+        offset += size_t(imageSize) * faces;
+        images.push_back(std::move(image));
+    }
+
+    texture.mData.reset(new uint8_t[offset]);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        memcpy(texture.mData.get() + texture.mLevels[level].offset, images[level].get(),
+                texture.getLevelSize(level));
+    }
+    return texture;
+}
+
+KtxTexture KtxDecoder::decodeKtx2(std::istream& stream) {
+    const std::streampos start = stream.tellg() - std::streamoff(sizeof(sigKtx2));
+    const uint32_t vkFormat = read<uint32_t>(stream);
+    read<uint32_t>(stream); // typeSize
+    const uint32_t width = read<uint32_t>(stream);
+    const uint32_t height = read<uint32_t>(stream);
+    const uint32_t depth = read<uint32_t>(stream);
+    const uint32_t layers = read<uint32_t>(stream);
+    const uint32_t faces = read<uint32_t>(stream);
+    const uint32_t levels = read<uint32_t>(stream);
+    const uint32_t supercompressionScheme = read<uint32_t>(stream);
+    // data format descriptor, key/value data and supercompression global data
+    stream.ignore(4 * sizeof(uint32_t) + 2 * sizeof(uint64_t));
+
+    // Basis Universal textures have no vkFormat and need to be transcoded, which isn't
+    // supported, like any other supercompression scheme.
+    FormatInfo const* info = findFormat(0, vkFormat);
+    if (!stream || !info || supercompressionScheme || !width || !height || depth || layers ||
+            (faces != 1 && faces != 6)) {
+        return KtxTexture();
+    }
+
+    struct LevelIndex {
+        uint64_t offset;
+        uint64_t size;
+    };
+    const uint32_t levelCount = std::max(1u, levels);
+    std::vector<LevelIndex> index(levelCount);
+    size_t totalSize = 0;
+    for (LevelIndex& level : index) {
+        level.offset = read<uint64_t>(stream);
+        level.size = read<uint64_t>(stream);
+        read<uint64_t>(stream); // uncompressedByteLength
+        totalSize += level.size;
+        if (!level.size || level.size % faces) {
+            return KtxTexture();
+        }
+    }
+    if (!stream) {
+        return KtxTexture();
+    }
+
+    KtxTexture texture;
+    texture.mWidth = width;
+    texture.mHeight = height;
+    texture.mFaces = faces;
+    texture.mTextureFormat = info->textureFormat;
+    texture.mFormat = info->format;
+    texture.mType = info->type;
+    texture.mCompressedType = info->compressedType;
+    texture.mData.reset(new uint8_t[totalSize]);
+
+    // the faces of a level are stored contiguously, the smallest level first
+    size_t offset = 0;
+    for (LevelIndex const& level : index) {
+        stream.seekg(start + std::streamoff(level.offset));
+        stream.read(reinterpret_cast<char*>(texture.mData.get() + offset), level.size);
+        texture.mLevels.push_back({ offset, size_t(level.size / faces) });
+        offset += level.size;
+    }
+    if (!stream) {
+        return KtxTexture();
+    }
+    return texture;
+}
+
+} // namespace image
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <imageio/KtxEncoder.h>
+
+#include <math/vec3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+#include <vector>
+
+using namespace math;
+
+namespace image {
+
+static const char sigKtx1[] =
+        { '\xAB', 'K', 'T', 'X', ' ', '1', '1', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+// GL enums of the header
+static constexpr uint32_t GL_RGB = 0x1907;
+static constexpr uint32_t GL_RGB9_E5 = 0x8C3D;
+static constexpr uint32_t GL_UNSIGNED_INT_5_9_9_9_REV = 0x8C3E;
+
+// KTX files are little-endian, like all the platforms filament runs on
+template<typename T>
+static inline void write(std::ostream& stream, T data) {
+    stream.write(reinterpret_cast<char const*>(&data), sizeof(T));
+}
+
+// see EXT_texture_shared_exponent
+uint32_t KtxEncoder::packRGB9E5(float r, float g, float b) noexcept {
+    constexpr int N = 9;            // mantissa bits
+    constexpr int B = 15;           // exponent bias
+    constexpr float MAX = 65408.0f; // (2^N - 1) / 2^N * 2^(Emax - B)
+
+    // (this also turns the NaNs into 0)
+    const float rc = std::min(MAX, std::max(0.0f, r));
+    const float gc = std::min(MAX, std::max(0.0f, g));
+    const float bc = std::min(MAX, std::max(0.0f, b));
+    const float maxc = std::max(rc, std::max(gc, bc));
+
+    int exp = std::max(-B - 1, maxc > 0.0f ? int(std::floor(std::log2(maxc))) : -B - 1) + 1 + B;
+    if (int(std::floor(maxc / std::exp2(float(exp - B - N)) + 0.5f)) == (1 << N)) {
+        exp++;
+    }
+    const float scale = 1.0f / std::exp2(float(exp - B - N));
+    const uint32_t rm = uint32_t(std::floor(rc * scale + 0.5f));
+    const uint32_t gm = uint32_t(std::floor(gc * scale + 0.5f));
+    const uint32_t bm = uint32_t(std::floor(bc * scale + 0.5f));
+    return rm | (gm << 9) | (bm << 18) | (uint32_t(exp) << 27);
+}
+
+bool KtxEncoder::encodeRGB9E5(std::ostream& stream, Image const* const* images,
+        size_t levels, size_t faces) {
+    if (!images || !levels || (faces != 1 && faces != 6) || !images[0]) {
+        return false;
+    }
+    const size_t width = images[0]->getWidth();
+    const size_t height = images[0]->getHeight();
+    for (size_t level = 0; level < levels; level++) {
+        const size_t w = std::max(size_t(1), width >> level);
+        const size_t h = std::max(size_t(1), height >> level);
+        for (size_t face = 0; face < faces; face++) {
+            Image const* image = images[level * faces + face];
+            if (!image || image->getWidth() != w || image->getHeight() != h ||
+                    image->getBytesPerPixel() < sizeof(float3)) {
+                return false;
+            }
+        }
+    }
+
+    stream.write(sigKtx1, sizeof(sigKtx1));
+    write<uint32_t>(stream, 0x04030201);    // endianness
+    write<uint32_t>(stream, GL_UNSIGNED_INT_5_9_9_9_REV);
+    write<uint32_t>(stream, 4);             // glTypeSize
+    write<uint32_t>(stream, GL_RGB);
+    write<uint32_t>(stream, GL_RGB9_E5);
+    write<uint32_t>(stream, GL_RGB);        // glBaseInternalFormat
+    write<uint32_t>(stream, uint32_t(width));
+    write<uint32_t>(stream, uint32_t(height));
+    write<uint32_t>(stream, 0);             // depth
+    write<uint32_t>(stream, 0);             // arrayElements
+    write<uint32_t>(stream, uint32_t(faces));
+    write<uint32_t>(stream, uint32_t(levels));
+    write<uint32_t>(stream, 0);             // keyValueDataSize
+
+    // The pixels are 4 bytes, so the rows and the faces don't need padding. For cubemaps,
+    // imageSize is the size of one face.
+    std::vector<uint32_t> packed;
+    for (size_t level = 0; level < levels; level++) {
+        Image const& base = *images[level * faces];
+        const size_t w = base.getWidth();
+        const size_t h = base.getHeight();
+        write<uint32_t>(stream, uint32_t(w * h * sizeof(uint32_t)));
+        for (size_t face = 0; face < faces; face++) {
+            Image const& image = *images[level * faces + face];
+            packed.resize(w * h);
+            for (size_t y = 0; y < h; y++) {
+                for (size_t x = 0; x < w; x++) {
+                    float3 const& c = *static_cast<float3 const*>(image.getPixelRef(x, y));
+                    packed[y * w + x] = packRGB9E5(c.r, c.g, c.b);
+                }
+            }
+            stream.write(reinterpret_cast<char const*>(packed.data()),
+                    packed.size() * sizeof(uint32_t));
+        }
+    }
+    return bool(stream);
+}
+
+} // namespace image
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MATH_TSIMDHELPERS_H_
+#define MATH_TSIMDHELPERS_H_
+
+/*
+ * No user serviceable parts here.
+ *
+ * Don't use this file directly, instead include math/mat*.h
+ *
+ * A minimal set of operations on 4 floats, implemented with NEON or SSE, used by the float
+ * specializations of the hot matrix and quaternion operations. MATH_HAS_SIMD is 0 when neither
+ * is available, and the generic code is used instead.
+ *
+ * The operations are only multiplies and adds, never fused, so that the results are the same
+ * as the generic code, which computes the same products and sums in the same order.
+ */
+
+#if defined(MATH_DISABLE_SIMD)
+#   define MATH_HAS_SIMD 0
+#elif defined(__ARM_NEON) && (defined(__clang__) || defined(__GNUC__))
+#   include <arm_neon.h>
+#   define MATH_HAS_SIMD 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <xmmintrin.h>
+#   define MATH_HAS_SIMD 1
+#else
+#   define MATH_HAS_SIMD 0
+#endif
+
+#if MATH_HAS_SIMD
+
+namespace math {
+namespace details {
+namespace simd {
+
+#if defined(__ARM_NEON)
+
+typedef float32x4_t float4x;
+
+inline float4x load(float const* p) noexcept { return vld1q_f32(p); }
+inline void store(float* p, float4x v) noexcept { vst1q_f32(p, v); }
+inline void store3(float* p, float4x v) noexcept {
+    vst1_f32(p, vget_low_f32(v));
+    vst1q_lane_f32(p + 2, v, 2);
+}
+inline float4x splat(float v) noexcept { return vdupq_n_f32(v); }
+inline float4x set(float x, float y, float z, float w) noexcept {
+    const float v[4] = { x, y, z, w };
+    return vld1q_f32(v);
+}
+inline float4x add(float4x a, float4x b) noexcept { return vaddq_f32(a, b); }
+inline float4x sub(float4x a, float4x b) noexcept { return vsubq_f32(a, b); }
+inline float4x mul(float4x a, float4x b) noexcept { return vmulq_f32(a, b); }
+
+template<int X, int Y, int Z, int W>
+inline float4x swizzle(float4x v) noexcept {
+#if defined(__clang__)
+    return __builtin_shufflevector(v, v, X, Y, Z, W);
+#else
+    return __builtin_shuffle(v, (uint32x4_t){ X, Y, Z, W });
+#endif
+}
+
+// transposes the 4x4 matrix whose columns are c0..c3
+inline void transpose(float4x& c0, float4x& c1, float4x& c2, float4x& c3) noexcept {
+    const float32x4x2_t t01 = vtrnq_f32(c0, c1);
+    const float32x4x2_t t23 = vtrnq_f32(c2, c3);
+    c0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    c1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    c2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    c3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+typedef __m128 float4x;
+
+inline float4x load(float const* p) noexcept { return _mm_loadu_ps(p); }
+inline void store(float* p, float4x v) noexcept { _mm_storeu_ps(p, v); }
+inline void store3(float* p, float4x v) noexcept {
+    _mm_storel_pi(reinterpret_cast<__m64*>(p), v);
+    _mm_store_ss(p + 2, _mm_movehl_ps(v, v));
+}
+inline float4x splat(float v) noexcept { return _mm_set1_ps(v); }
+inline float4x set(float x, float y, float z, float w) noexcept { return _mm_setr_ps(x, y, z, w); }
+inline float4x add(float4x a, float4x b) noexcept { return _mm_add_ps(a, b); }
+inline float4x sub(float4x a, float4x b) noexcept { return _mm_sub_ps(a, b); }
+inline float4x mul(float4x a, float4x b) noexcept { return _mm_mul_ps(a, b); }
+
+template<int X, int Y, int Z, int W>
+inline float4x swizzle(float4x v) noexcept {
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(W, Z, Y, X));
+}
+
+// transposes the 4x4 matrix whose columns are c0..c3
+inline void transpose(float4x& c0, float4x& c1, float4x& c2, float4x& c3) noexcept {
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+}
+
+#endif
+
+} // namespace simd
+} // namespace details
+} // namespace math
+
+#endif // MATH_HAS_SIMD
+
+#endif // MATH_TSIMDHELPERS_H_
@@ -49,3 +49,11 @@
 #else
 #   define MATH_EMPTY_BASES
 #endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#   define MATH_RESTRICT __restrict__
+#elif defined(_MSC_VER)
+#   define MATH_RESTRICT __restrict
+#else
+#   define MATH_RESTRICT
+#endif
@@ -17,10 +17,17 @@
 #ifndef TNT_MATH_HALF_H
 #define TNT_MATH_HALF_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <limits>
 #include <type_traits>
 
+#if defined(__ARM_NEON)
+#   include <arm_neon.h>
+#elif defined(__F16C__)
+#   include <immintrin.h>
+#endif
+
 #ifdef __cplusplus
 #   define LIKELY( exp )    (__builtin_expect( !!(exp), true ))
 #   define UNLIKELY( exp )  (__builtin_expect( !!(exp), false ))
@@ -154,6 +161,95 @@ inline constexpr math::half operator"" _h(long double v) {
     return math::half(v);
 }
 
+namespace details {
+
+// Conversions of the bits, without branches so that the loops that use them are vectorized.
+// Floats are rounded to the nearest even half (Fabian Giesen, "float->half variants"), like
+// the hardware conversions.
+
+inline uint32_t asUint(float f) noexcept {
+    union { float f; uint32_t u; } v = { f };
+    return v.u;
+}
+
+inline float asFloat(uint32_t u) noexcept {
+    union { uint32_t u; float f; } v = { u };
+    return v.f;
+}
+
+inline uint16_t floatToHalfBits(float v) noexcept {
+    const uint32_t bits = asUint(v);
+    const uint32_t sign = (bits >> 16u) & 0x8000u;
+    const uint32_t a = bits & 0x7FFFFFFFu;
+    // NaNs become quiet NaNs, and the values too large become infinities
+    const uint32_t special = a > 0x7F800000u ? 0x7E00u : 0x7C00u;
+    // denormals: adding 0.5 aligns the 10 bits of mantissa at the bottom of the float
+    const uint32_t denormal = asUint(asFloat(a) + 0.5f) - asUint(0.5f);
+    // normals: rebias the exponent, and round
+    const uint32_t normal = (a + (uint32_t(15 - 127) << 23u) + 0xFFFu + ((a >> 13u) & 1u)) >> 13u;
+    const uint32_t h = a >= (uint32_t(127 + 16) << 23u) ? special :
+            (a < (uint32_t(127 - 14) << 23u) ? denormal : normal);
+    return uint16_t(h | sign);
+}
+
+inline float halfBitsToFloat(uint16_t h) noexcept {
+    constexpr uint32_t exponentMask = 0x7C00u << 13u;
+    const uint32_t shifted = (uint32_t(h) & 0x7FFFu) << 13u;
+    const uint32_t exponent = shifted & exponentMask;
+    const uint32_t normal = shifted + (uint32_t(127 - 15) << 23u);
+    const uint32_t special = normal + (uint32_t(128 - 16) << 23u);
+    const uint32_t denormal =
+            asUint(asFloat(normal + (1u << 23u)) - asFloat(uint32_t(127 - 14) << 23u));
+    const uint32_t f = exponent == exponentMask ? special : (exponent == 0 ? denormal : normal);
+    return asFloat(f | ((uint32_t(h) & 0x8000u) << 16u));
+}
+
+} // namespace details
+
+/*
+ * Converts count floats to halfs, with the F16C or NEON instructions when available.
+ * The values are rounded to the nearest even half, which can differ by one ulp from half(float)
+ * when a value is halfway between two halfs.
+ */
+inline void convertToHalf(float const* in, half* out, size_t count) noexcept {
+    size_t i = 0;
+#if defined(__ARM_NEON) && (defined(__aarch64__) || (defined(__ARM_FP) && (__ARM_FP & 2)))
+    for (; i + 4 <= count; i += 4) {
+        const float16x4_t h = vcvt_f16_f32(vld1q_f32(in + i));
+        vst1_u16(reinterpret_cast<uint16_t*>(out + i), vreinterpret_u16_f16(h));
+    }
+#elif defined(__F16C__)
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), h);
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = makeHalf(details::floatToHalfBits(in[i]));
+    }
+}
+
+/*
+ * Converts count halfs to floats, this is exact.
+ */
+inline void convertToFloat(half const* in, float* out, size_t count) noexcept {
+    size_t i = 0;
+#if defined(__ARM_NEON) && (defined(__aarch64__) || (defined(__ARM_FP) && (__ARM_FP & 2)))
+    for (; i + 4 <= count; i += 4) {
+        const uint16x4_t h = vld1_u16(reinterpret_cast<uint16_t const*>(in + i));
+        vst1q_f32(out + i, vcvt_f32_f16(vreinterpret_f16_u16(h)));
+    }
+#elif defined(__F16C__)
+    for (; i + 8 <= count; i += 8) {
+        const __m128i h = _mm_loadu_si128(reinterpret_cast<__m128i const*>(in + i));
+        _mm256_storeu_ps(out + i, _mm256_cvtph_ps(h));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = details::halfBitsToFloat(getBits(in[i]));
+    }
+}
+
 } // namespace math
 
 namespace std {
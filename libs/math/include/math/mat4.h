@@ -20,6 +20,7 @@
 #include <math/mat3.h>
 #include <math/quat.h>
 #include <math/TMatHelpers.h>
+#include <math/TSimdHelpers.h>
 #include <math/vec3.h>
 #include <math/vec4.h>
 
@@ -571,6 +572,111 @@ constexpr typename TMat44<T>::col_type PURE diag(const TMat44<T>& m) {
     return matrix::diag(m);
 }
 
+/**
+ * Inverse of an affine transform, i.e. a matrix whose last row is (0, 0, 0, 1), such as a model
+ * or view matrix. This is much cheaper than inverse(), which handles any invertible matrix.
+ */
+template<typename T>
+TMat44<T> PURE affineInverse(const TMat44<T>& m) {
+    const TMat33<T> inv(inverse(m.upperLeft()));
+    const TVec3<T> translation(-(inv * m[3].xyz));
+    return TMat44<T>(
+            TVec4<T>(inv[0], 0),
+            TVec4<T>(inv[1], 0),
+            TVec4<T>(inv[2], 0),
+            TVec4<T>(translation, 1));
+}
+
+// ----------------------------------------------------------------------------------------
+// SIMD specializations for float
+//
+// The products compute the same sums, in the same order, as the generic code above. The
+// affine inverse uses the adjugate and can differ from the generic version in the last bits.
+// ----------------------------------------------------------------------------------------
+
+#if MATH_HAS_SIMD
+
+namespace matrix {
+
+template<>
+inline TMat44<float> MATH_PURE multiply<TMat44<float>, TMat44<float>, TMat44<float>>(
+        const TMat44<float>& lhs, const TMat44<float>& rhs) {
+    using namespace simd;
+    const float4x l0 = load(&lhs[0].x);
+    const float4x l1 = load(&lhs[1].x);
+    const float4x l2 = load(&lhs[2].x);
+    const float4x l3 = load(&lhs[3].x);
+    TMat44<float> res(TMat44<float>::NO_INIT);
+    for (size_t col = 0; col < 4; ++col) {
+        const TVec4<float>& r = rhs[col];
+        float4x c = mul(l0, splat(r.x));
+        c = add(c, mul(l1, splat(r.y)));
+        c = add(c, mul(l2, splat(r.z)));
+        c = add(c, mul(l3, splat(r.w)));
+        store(&res[col].x, c);
+    }
+    return res;
+}
+
+} // namespace matrix
+
+inline TVec4<float> PURE operator *(const TMat44<float>& lhs, const TVec4<float>& rhs) {
+    using namespace simd;
+    float4x c = mul(load(&lhs[0].x), splat(rhs.x));
+    c = add(c, mul(load(&lhs[1].x), splat(rhs.y)));
+    c = add(c, mul(load(&lhs[2].x), splat(rhs.z)));
+    c = add(c, mul(load(&lhs[3].x), splat(rhs.w)));
+    TVec4<float> result;
+    store(&result.x, c);
+    return result;
+}
+
+inline TMat44<float> PURE affineInverse(const TMat44<float>& m) {
+    using namespace simd;
+    // the 4th component of the columns is ignored until the end
+    const float4x c0 = load(&m[0].x);
+    const float4x c1 = load(&m[1].x);
+    const float4x c2 = load(&m[2].x);
+
+    // the rows of the adjugate are the cross products of the columns
+    auto cross = [](float4x a, float4x b) {
+        return sub(mul(swizzle<1, 2, 0, 3>(a), swizzle<2, 0, 1, 3>(b)),
+                   mul(swizzle<2, 0, 1, 3>(a), swizzle<1, 2, 0, 3>(b)));
+    };
+    float4x r0 = cross(c1, c2);
+    float4x r1 = cross(c2, c0);
+    float4x r2 = cross(c0, c1);
+    float4x r3 = splat(0.0f);
+
+    TVec4<float> d;
+    store(&d.x, mul(c0, r0));
+    const float invDet = 1.0f / (d.x + d.y + d.z);
+    const float4x s = splat(invDet);
+    r0 = mul(r0, s);
+    r1 = mul(r1, s);
+    r2 = mul(r2, s);
+
+    // the inverse of the linear part is the transpose of the rows
+    transpose(r0, r1, r2, r3);
+
+    const TVec4<float>& t = m[3];
+    float4x translation = mul(r0, splat(t.x));
+    translation = add(translation, mul(r1, splat(t.y)));
+    translation = add(translation, mul(r2, splat(t.z)));
+    translation = sub(splat(0.0f), translation);
+
+    TMat44<float> result(TMat44<float>::NO_INIT);
+    store(&result[0].x, r0);
+    store(&result[1].x, r1);
+    store(&result[2].x, r2);
+    store(&result[3].x, translation);
+    // the last row is the 4th components of r3, i.e. 0, except for the translation
+    result[3].w = 1.0f;
+    return result;
+}
+
+#endif // MATH_HAS_SIMD
+
 } // namespace details
 
 // ----------------------------------------------------------------------------------------
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MATH_MAT4X3_H_
+#define MATH_MAT4X3_H_
+
+#include <math/compiler.h>
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/vec3.h>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace math {
+// -------------------------------------------------------------------------------------
+namespace details {
+
+/**
+ * An affine transform stored as a 4x3 column-major matrix (4 columns, 3 rows, like GLSL's
+ * mat4x3), that is a 4x4 matrix without its last row, which is implicitly (0, 0, 0, 1).
+ *
+ * Conceptually it is an array of 4 column vec3, the first 3 are the linear part of the
+ * transform and the last one is the translation:
+ *
+ *      \f$
+ *      \left(
+ *      \begin{array}{cccc}
+ *      m[0][0] & m[1][0] & m[2][0] & m[3][0] \\
+ *      m[0][1] & m[1][1] & m[2][1] & m[3][1] \\
+ *      m[0][2] & m[1][2] & m[2][2] & m[3][2] \\
+ *      0       & 0       & 0       & 1       \\
+ *      \end{array}
+ *      \right)
+ *      \f$
+ *
+ * It takes 3/4 of the space of a mat4, and composing two of them takes 36 multiplies and 27
+ * adds instead of 64 and 48. The operations are written on whole columns so they vectorize.
+ */
+template <typename T>
+class MATH_EMPTY_BASES TMat43 {
+public:
+    typedef T value_type;
+    typedef T& reference;
+    typedef T const& const_reference;
+    typedef size_t size_type;
+    typedef TVec3<T> col_type;
+    enum no_init { NO_INIT };
+
+    static constexpr size_t COL_SIZE = col_type::SIZE;  // size of a column (i.e.: # of rows)
+    static constexpr size_t NUM_COLS = 4;
+
+private:
+    col_type m_value[NUM_COLS];
+
+public:
+    // array access
+    inline constexpr col_type const& operator[](size_t column) const {
+        return m_value[column];
+    }
+
+    inline constexpr col_type& operator[](size_t column) {
+        return m_value[column];
+    }
+
+    /**
+     * leaves object uninitialized. use with caution.
+     */
+    constexpr explicit TMat43(no_init) { }
+
+    /**
+     * initialize to identity.
+     */
+    constexpr TMat43() :
+            m_value{ col_type(1, 0, 0), col_type(0, 1, 0), col_type(0, 0, 1), col_type(0) } {
+    }
+
+    /**
+     * initialize from the linear part and the translation of the transform
+     */
+    template <typename U, typename V>
+    constexpr TMat43(const TMat33<U>& linear, const TVec3<V>& translation) :
+            m_value{ col_type(linear[0]), col_type(linear[1]), col_type(linear[2]),
+                     col_type(translation) } {
+    }
+
+    /**
+     * initialize from a 4x4 matrix, its last row is ignored (i.e. assumed to be (0, 0, 0, 1))
+     */
+    template <typename U>
+    explicit constexpr TMat43(const TMat44<U>& m) :
+            m_value{ col_type(m[0].xyz), col_type(m[1].xyz), col_type(m[2].xyz),
+                     col_type(m[3].xyz) } {
+    }
+
+    /**
+     * the linear part of the transform
+     */
+    inline constexpr TMat33<T> upperLeft() const {
+        return TMat33<T>(m_value[0], m_value[1], m_value[2]);
+    }
+
+    /**
+     * the transform as a 4x4 matrix
+     */
+    inline constexpr TMat44<T> toMat44() const {
+        return TMat44<T>(
+                TVec4<T>(m_value[0], 0),
+                TVec4<T>(m_value[1], 0),
+                TVec4<T>(m_value[2], 0),
+                TVec4<T>(m_value[3], 1));
+    }
+
+    // transforms the vector v, i.e. ignores the translation
+    template <typename U>
+    inline constexpr col_type transformVector(const TVec3<U>& v) const {
+        return m_value[0] * T(v.x) + m_value[1] * T(v.y) + m_value[2] * T(v.z);
+    }
+
+    // composition of two affine transforms, i.e. rhs, then lhs
+    friend inline constexpr TMat43 MATH_PURE operator*(const TMat43& lhs, const TMat43& rhs) {
+        TMat43 result(NO_INIT);
+        for (size_t col = 0; col < 3; ++col) {
+            result[col] = lhs.transformVector(rhs[col]);
+        }
+        result[3] = lhs.transformVector(rhs[3]) + lhs[3];
+        return result;
+    }
+
+    // transforms the point p, i.e. the vec4 { p, 1 }
+    template <typename U>
+    friend inline constexpr col_type MATH_PURE operator*(const TMat43& lhs, const TVec3<U>& p) {
+        return lhs.transformVector(p) + lhs[3];
+    }
+
+    friend inline constexpr bool MATH_PURE operator==(const TMat43& lhs, const TMat43& rhs) {
+        return lhs[0] == rhs[0] && lhs[1] == rhs[1] && lhs[2] == rhs[2] && lhs[3] == rhs[3];
+    }
+
+    friend inline constexpr bool MATH_PURE operator!=(const TMat43& lhs, const TMat43& rhs) {
+        return !(lhs == rhs);
+    }
+};
+
+}  // namespace details
+
+// ----------------------------------------------------------------------------------------
+
+typedef details::TMat43<double> mat4x3;
+typedef details::TMat43<float> mat4x3f;
+
+// ----------------------------------------------------------------------------------------
+}  // namespace math
+
+#endif  // MATH_MAT4X3_H_
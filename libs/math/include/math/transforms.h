@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MATH_TRANSFORMS_H_
+#define MATH_TRANSFORMS_H_
+
+#include <math/compiler.h>
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/mat4x3.h>
+#include <math/vec3.h>
+
+#include <stddef.h>
+
+/*
+ * Transforms of arrays of points, vectors and boxes.
+ *
+ * The float3 variants transform a point at a time with mat4f * float4 (which has SIMD
+ * specializations), in and out can be the same array. The SoA (one array per component)
+ * variants are written without branches so the compiler vectorizes them across points, they are
+ * several times faster and should be preferred for large arrays.
+ */
+
+namespace math {
+
+/**
+ * out[i] = (m * float4(in[i], 1)).xyz, m is assumed to be affine (last row (0, 0, 0, 1))
+ */
+inline void transformPoints(const mat4f& m,
+        float3 const* in, float3* out, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (m * float4{ in[i], 1 }).xyz;
+    }
+}
+
+/**
+ * Same as above, with the x, y and z coordinates in separate arrays, which mustn't overlap.
+ */
+inline void transformPoints(const mat4f& m,
+        float const* MATH_RESTRICT x, float const* MATH_RESTRICT y, float const* MATH_RESTRICT z,
+        float* MATH_RESTRICT outX, float* MATH_RESTRICT outY, float* MATH_RESTRICT outZ,
+        size_t count) noexcept {
+    const float3 c0 = m[0].xyz, c1 = m[1].xyz, c2 = m[2].xyz, c3 = m[3].xyz;
+    for (size_t i = 0; i < count; i++) {
+        outX[i] = c0.x * x[i] + c1.x * y[i] + c2.x * z[i] + c3.x;
+        outY[i] = c0.y * x[i] + c1.y * y[i] + c2.y * z[i] + c3.y;
+        outZ[i] = c0.z * x[i] + c1.z * y[i] + c2.z * z[i] + c3.z;
+    }
+}
+
+/**
+ * out[i] = m.upperLeft() * in[i], i.e. a transform that ignores the translation
+ */
+inline void transformVectors(const mat4f& m,
+        float3 const* in, float3* out, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        out[i] = (m * float4{ in[i], 0 }).xyz;
+    }
+}
+
+/**
+ * Transforms directions and normals by the inverse-transpose of m.upperLeft(), which handles
+ * non-uniform scaling, and normalizes them.
+ */
+inline void transformNormals(const mat4f& m,
+        float3 const* in, float3* out, size_t count) noexcept {
+    const mat3f n = transpose(inverse(m.upperLeft()));
+    for (size_t i = 0; i < count; i++) {
+        const float3 v = in[i];
+        const float3 r = n[0] * v.x + n[1] * v.y + n[2] * v.z;
+        out[i] = normalize(r);
+    }
+}
+
+/**
+ * out[i] = mat4f::project(m, in[i]), i.e. the point transformed by m, divided by its w
+ */
+inline void projectPoints(const mat4f& m,
+        float3 const* in, float3* out, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        const float4 r = m * float4{ in[i], 1 };
+        out[i] = r.xyz * (1 / r.w);
+    }
+}
+
+/**
+ * Same as above, with the x, y and z coordinates in separate arrays, which mustn't overlap.
+ */
+inline void projectPoints(const mat4f& m,
+        float const* MATH_RESTRICT x, float const* MATH_RESTRICT y, float const* MATH_RESTRICT z,
+        float* MATH_RESTRICT outX, float* MATH_RESTRICT outY, float* MATH_RESTRICT outZ,
+        size_t count) noexcept {
+    const float4 c0 = m[0], c1 = m[1], c2 = m[2], c3 = m[3];
+    for (size_t i = 0; i < count; i++) {
+        const float w = c0.w * x[i] + c1.w * y[i] + c2.w * z[i] + c3.w;
+        const float s = 1 / w;
+        outX[i] = (c0.x * x[i] + c1.x * y[i] + c2.x * z[i] + c3.x) * s;
+        outY[i] = (c0.y * x[i] + c1.y * y[i] + c2.y * z[i] + c3.y) * s;
+        outZ[i] = (c0.z * x[i] + c1.z * y[i] + c2.z * z[i] + c3.z) * s;
+    }
+}
+
+/**
+ * Transforms axis-aligned boxes, given by their centers and half-extents, each by its own affine
+ * transform, and returns the axis-aligned boxes of the results: the extents are transformed by
+ * the absolute value of the linear part. The outputs can be the same arrays as the inputs.
+ */
+inline void transformAABBs(mat4x3f const* transforms,
+        float3 const* centers, float3 const* extents,
+        float3* outCenters, float3* outExtents, size_t count) noexcept {
+    for (size_t i = 0; i < count; i++) {
+        mat4x3f const& m = transforms[i];
+        const float3 c = centers[i];
+        const float3 e = extents[i];
+        outCenters[i] = m[0] * c.x + m[1] * c.y + m[2] * c.z + m[3];
+        outExtents[i] = abs(m[0]) * e.x + abs(m[1]) * e.y + abs(m[2]) * e.z;
+    }
+}
+
+} // namespace math
+
+#endif // MATH_TRANSFORMS_H_
@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/quat.h>
+#include <math/transforms.h>
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace math;
+
+// Times the float matrix and quaternion operations used per renderable and per frame, and the
+// batched transforms. Build with -DMATH_DISABLE_SIMD to compare with the generic code.
+
+static constexpr size_t COUNT = 1024 * 1024;
+static constexpr size_t REPEAT = 10;
+
+template<typename F>
+__attribute__((noinline))
+void benchmark(const char* name, F f) {
+    f(); // warm up
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < REPEAT; i++) {
+        f();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    const double seconds = duration.count() / REPEAT;
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(10) << seconds * 1000.0 << " ms"
+              << std::setw(10) << COUNT / seconds * 1e-6 << " Mops/s" << std::endl;
+}
+
+int main() {
+    std::mt19937 gen;
+    std::uniform_real_distribution<float> rand(-1.0f, 1.0f);
+
+    std::vector<quatf> quats(COUNT);
+    std::vector<mat4f> transforms(COUNT);
+    std::vector<float4> points(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        quats[i] = normalize(quatf(rand(gen), rand(gen), rand(gen), rand(gen)));
+        transforms[i] = mat4f::translate(float4{ rand(gen), rand(gen), rand(gen), 1.0f }) *
+                        mat4f(mat3f(quats[i]));
+        points[i] = { rand(gen), rand(gen), rand(gen), 1.0f };
+    }
+    const mat4f viewProjection = mat4f::perspective(45.0f, 1.5f, 0.1f, 100.0f) *
+                                 affineInverse(transforms[0]);
+
+    std::vector<mat4f> matrices(COUNT);
+    std::vector<mat3f> rotations(COUNT);
+    std::vector<float4> results(COUNT);
+
+    benchmark("mat4f * mat4f", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            matrices[i] = viewProjection * transforms[i];
+        }
+    });
+    benchmark("mat4f * float4", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            results[i] = transforms[i] * points[i];
+        }
+    });
+    benchmark("affineInverse(mat4f)", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            matrices[i] = affineInverse(transforms[i]);
+        }
+    });
+    benchmark("inverse(mat4f)", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            matrices[i] = inverse(transforms[i]);
+        }
+    });
+    benchmark("mat3f(quatf)", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            rotations[i] = mat3f(quats[i]);
+        }
+    });
+
+    std::vector<float3> positions(COUNT);
+    std::vector<float3> transformed(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        positions[i] = points[i].xyz;
+    }
+    std::vector<float> x(COUNT), y(COUNT), z(COUNT), ox(COUNT), oy(COUNT), oz(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        x[i] = positions[i].x;
+        y[i] = positions[i].y;
+        z[i] = positions[i].z;
+    }
+
+    benchmark("mat4f * float3, loop", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            transformed[i] = (transforms[0] * float4{ positions[i], 1 }).xyz;
+        }
+    });
+    benchmark("transformPoints", [&]() {
+        transformPoints(transforms[0], positions.data(), transformed.data(), COUNT);
+    });
+    benchmark("transformPoints, SoA", [&]() {
+        transformPoints(transforms[0], x.data(), y.data(), z.data(),
+                ox.data(), oy.data(), oz.data(), COUNT);
+    });
+    benchmark("project, loop", [&]() {
+        for (size_t i = 0; i < COUNT; i++) {
+            transformed[i] = mat4f::project(viewProjection, positions[i]);
+        }
+    });
+    benchmark("projectPoints", [&]() {
+        projectPoints(viewProjection, positions.data(), transformed.data(), COUNT);
+    });
+    benchmark("projectPoints, SoA", [&]() {
+        projectPoints(viewProjection, x.data(), y.data(), z.data(),
+                ox.data(), oy.data(), oz.data(), COUNT);
+    });
+
+    return 0;
+}
@@ -16,6 +16,8 @@
 
 #include <math.h>
 
+#include <vector>
+
 #include <gtest/gtest.h>
 
 #include <math/half.h>
@@ -90,3 +92,48 @@ TEST_F(HalfTest, Vec) {
     EXPECT_EQ(f4.xyz, h3);
     EXPECT_EQ(f4.xy, h2);
 }
+
+TEST_F(HalfTest, Arrays) {
+    // an odd count, so that the SIMD loops have a remainder
+    const float in[] = {
+            0.0f, -0.0f, 1.0f, -2.0f, 65504.0f, 65520.0f, -1e10f,
+            std::numeric_limits<float>::infinity(), NAN,
+            6.10352e-5f, 6.09756e-5f, -5.96046e-8f, 1e-10f,
+            1.0f + 1.0f / 2048, 1.0f + 3.0f / 2048,   // halfway, rounded to even
+    };
+    const uint16_t expected[] = {
+            0x0000, 0x8000, 0x3C00, 0xC000, 0x7BFF, 0x7C00, 0xFC00,
+            0x7C00, 0x7E00,
+            0x0400, 0x03FF, 0x8001, 0x0000,
+            0x3C00, 0x3C02,
+    };
+    constexpr size_t count = sizeof(in) / sizeof(in[0]);
+    half out[count];
+    convertToHalf(in, out, count);
+    for (size_t i = 0; i < count; i++) {
+        if (isnan(in[i])) {
+            EXPECT_EQ(0x7C00, getBits(out[i]) & 0x7C00u);
+            EXPECT_NE(0, getBits(out[i]) & 0x3FFu);
+        } else {
+            EXPECT_EQ(expected[i], getBits(out[i])) << in[i];
+        }
+    }
+
+    // all the halfs, to floats and back
+    std::vector<half> halfs(0x10000);
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        halfs[i] = makeHalf(uint16_t(i));
+    }
+    std::vector<float> floats(0x10000);
+    convertToFloat(halfs.data(), floats.data(), halfs.size());
+    std::vector<half> back(0x10000);
+    convertToHalf(floats.data(), back.data(), floats.size());
+    for (uint32_t i = 0; i < 0x10000; i++) {
+        if ((i & 0x7C00u) == 0x7C00u && (i & 0x3FFu)) {
+            EXPECT_TRUE(isnan(floats[i]));
+        } else {
+            EXPECT_EQ(float(halfs[i]), floats[i]);
+            EXPECT_EQ(i, getBits(back[i]));
+        }
+    }
+}
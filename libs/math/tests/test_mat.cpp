@@ -23,6 +23,7 @@
 #include <math/mat2.h>
 #include <math/mat4.h>
 #include <math/mat3.h>
+#include <math/mat4x3.h>
 #include <math/quat.h>
 
 using namespace math;
@@ -686,3 +687,119 @@ TYPED_TEST(MatTestT, ToQuaternionPointTransformation44) {
 }
 
 #undef TEST_MATRIX_INVERSE
+
+//------------------------------------------------------------------------------
+// Test some mat4x3 operations.
+
+class Mat43Test : public testing::Test {
+protected:
+};
+
+TEST_F(Mat43Test, Basics) {
+    EXPECT_EQ(sizeof(mat4x3f), sizeof(float)*12);
+    EXPECT_EQ(mat4x3f().toMat44(), mat4f());
+}
+
+TEST_F(Mat43Test, MatchesMat4) {
+    const mat4f a = mat4f::translate(float4{ 1, -2, 3, 1 }) *
+                    mat4f::rotate(0.5f, normalize(float3{ 1, 2, 3 })) *
+                    mat4f::scale(float4{ 2, 3, 4, 1 });
+    const mat4f b = mat4f::translate(float4{ -5, 6, 7, 1 }) *
+                    mat4f::rotate(-1.2f, normalize(float3{ 3, -1, 2 }));
+
+    // conversions
+    EXPECT_EQ(mat4x3f(a).toMat44(), a);
+    EXPECT_EQ(mat4x3f(a).upperLeft(), a.upperLeft());
+    EXPECT_EQ(mat4x3f(a.upperLeft(), a[3].xyz), mat4x3f(a));
+
+    // composition and points, up to (the lack of) rounding of the terms with the last row
+    const mat4f ab = (mat4x3f(a) * mat4x3f(b)).toMat44();
+    const mat4f expected = a * b;
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            EXPECT_NEAR(ab[i][j], expected[i][j], 1e-5f);
+        }
+    }
+
+    const float3 p = { 0.25f, -8, 3 };
+    const float3 ap = mat4x3f(a) * p;
+    const float3 expectedPoint = (a * float4{ p, 1 }).xyz;
+    EXPECT_NEAR(ap.x, expectedPoint.x, 1e-5f);
+    EXPECT_NEAR(ap.y, expectedPoint.y, 1e-5f);
+    EXPECT_NEAR(ap.z, expectedPoint.z, 1e-5f);
+    EXPECT_EQ(mat4x3f(a).transformVector(p), a.upperLeft() * p);
+}
+
+//------------------------------------------------------------------------------
+// Test the float specializations (SIMD when available) against the double versions.
+
+class MatSimdTest : public testing::Test {
+protected:
+    static void expectNear(const mat4f& m, const mat4& expected, double epsilon) {
+        for (size_t i = 0; i < 4; i++) {
+            for (size_t j = 0; j < 4; j++) {
+                EXPECT_NEAR(m[i][j], expected[i][j], epsilon) << "[" << i << "][" << j << "]";
+            }
+        }
+    }
+};
+
+TEST_F(MatSimdTest, Multiply) {
+    const mat4f a = mat4f::translate(float4{ 1, -2, 3, 1 }) *
+                    mat4f::rotate(0.5f, normalize(float3{ 1, 2, 3 })) *
+                    mat4f::scale(float4{ 2, 3, 4, 1 });
+    const mat4f b = mat4f::perspective(45.0f, 1.5f, 0.1f, 100.0f);
+
+    expectNear(a * b, mat4(a) * mat4(b), 1e-5);
+    expectNear(b * a, mat4(b) * mat4(a), 1e-5);
+    expectNear(a * mat4f(), mat4(a), 0);
+
+    const float4 v = { 0.25f, -8, 3, 0.5f };
+    const float4 av = a * v;
+    const double4 expected = mat4(a) * double4(v);
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_NEAR(av[i], expected[i], 1e-5);
+    }
+    EXPECT_EQ(mat4f() * v, v);
+}
+
+TEST_F(MatSimdTest, AffineInverse) {
+    const mat4f a = mat4f::translate(float4{ 1, -2, 3, 1 }) *
+                    mat4f::rotate(0.5f, normalize(float3{ 1, 2, 3 })) *
+                    mat4f::scale(float4{ 2, 3, 4, 1 });
+    const mat4f inv = affineInverse(a);
+    expectNear(inv, inverse(mat4(a)), 1e-5);
+    expectNear(inv * a, mat4(), 1e-5);
+    EXPECT_EQ(inv[0].w, 0);
+    EXPECT_EQ(inv[1].w, 0);
+    EXPECT_EQ(inv[2].w, 0);
+    EXPECT_EQ(inv[3].w, 1);
+
+    // the generic version
+    const mat4 ad(a);
+    const mat4 invd = affineInverse(ad);
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            EXPECT_NEAR(invd[i][j], inverse(ad)[i][j], 1e-12);
+        }
+    }
+}
+
+TEST_F(MatSimdTest, FromQuaternion) {
+    const quatf qs[] = {
+            quatf(1, 0, 0, 0),
+            quatf::fromAxisAngle(normalize(float3{ 1, 2, 3 }), 0.5f),
+            quatf::fromAxisAngle(normalize(float3{ -3, 1, 2 }), 2.5f),
+            quatf(0.5f, -1, 2, 0.25f),  // not normalized
+            quatf(0, 0, 0, 0)
+    };
+    for (const quatf& q : qs) {
+        const mat3f m(q);
+        const mat3 expected(quat(q.w, q.x, q.y, q.z));
+        for (size_t i = 0; i < 3; i++) {
+            for (size_t j = 0; j < 3; j++) {
+                EXPECT_NEAR(m[i][j], expected[i][j], 1e-6);
+            }
+        }
+    }
+}
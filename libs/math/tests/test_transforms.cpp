@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <math/mat3.h>
+#include <math/mat4.h>
+#include <math/mat4x3.h>
+#include <math/transforms.h>
+#include <math/vec3.h>
+
+#include <vector>
+
+using namespace math;
+
+class TransformsTest : public testing::Test {
+protected:
+    void SetUp() override {
+        for (size_t i = 0; i < COUNT; i++) {
+            const float t = float(i);
+            points.push_back({ t * 0.5f - 4.0f, 3.0f - t, t * t * 0.1f });
+        }
+    }
+
+    static void expectNear(float3 a, float3 b) {
+        EXPECT_NEAR(a.x, b.x, 1e-4f);
+        EXPECT_NEAR(a.y, b.y, 1e-4f);
+        EXPECT_NEAR(a.z, b.z, 1e-4f);
+    }
+
+    // an odd count, so that the vectorized loops have a remainder
+    static constexpr size_t COUNT = 19;
+
+    const mat4f affine = mat4f::translate(float4{ 1, -2, 3, 1 }) *
+                         mat4f::rotate(0.5f, normalize(float3{ 1, 2, 3 })) *
+                         mat4f::scale(float4{ 2, 3, 4, 1 });
+    std::vector<float3> points;
+};
+
+TEST_F(TransformsTest, Points) {
+    std::vector<float3> out(COUNT);
+    transformPoints(affine, points.data(), out.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear(out[i], (affine * float4{ points[i], 1 }).xyz);
+    }
+
+    // in place
+    transformPoints(affine, points.data(), points.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        EXPECT_EQ(points[i], out[i]);
+    }
+}
+
+TEST_F(TransformsTest, PointsSoa) {
+    std::vector<float> x(COUNT), y(COUNT), z(COUNT), ox(COUNT), oy(COUNT), oz(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        x[i] = points[i].x;
+        y[i] = points[i].y;
+        z[i] = points[i].z;
+    }
+    std::vector<float3> out(COUNT);
+
+    transformPoints(affine, x.data(), y.data(), z.data(), ox.data(), oy.data(), oz.data(), COUNT);
+    transformPoints(affine, points.data(), out.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear({ ox[i], oy[i], oz[i] }, out[i]);
+    }
+
+    const mat4f projection = mat4f::perspective(45.0f, 1.5f, 0.1f, 100.0f) * affine;
+    projectPoints(projection, x.data(), y.data(), z.data(), ox.data(), oy.data(), oz.data(), COUNT);
+    projectPoints(projection, points.data(), out.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear({ ox[i], oy[i], oz[i] }, out[i]);
+    }
+}
+
+TEST_F(TransformsTest, VectorsAndNormals) {
+    std::vector<float3> out(COUNT);
+    transformVectors(affine, points.data(), out.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear(out[i], affine.upperLeft() * points[i]);
+    }
+
+    transformNormals(affine, points.data(), out.data(), COUNT);
+    const mat3f normalMatrix = transpose(inverse(affine.upperLeft()));
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear(out[i], normalize(normalMatrix * points[i]));
+    }
+}
+
+TEST_F(TransformsTest, Project) {
+    const mat4f projection = mat4f::perspective(45.0f, 1.5f, 0.1f, 100.0f) * affine;
+    std::vector<float3> out(COUNT);
+    projectPoints(projection, points.data(), out.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        expectNear(out[i], mat4f::project(projection, points[i]));
+    }
+}
+
+TEST_F(TransformsTest, AABBs) {
+    std::vector<mat4x3f> transforms(COUNT);
+    std::vector<float3> extents(COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        transforms[i] = mat4x3f(mat4f::rotate(0.1f * i, normalize(float3{ 1, -2, 3 })) * affine);
+        extents[i] = abs(points[i]) + 0.5f;
+    }
+    std::vector<float3> centers(points);
+
+    transformAABBs(transforms.data(), points.data(), extents.data(),
+            centers.data(), extents.data(), COUNT);
+    for (size_t i = 0; i < COUNT; i++) {
+        const mat3f u = transforms[i].upperLeft();
+        const float3 e = abs(points[i]) + 0.5f;
+        expectNear(centers[i], transforms[i] * points[i]);
+        expectNear(extents[i], abs(u) * e);
+        // the corners of the transformed box are inside the result
+        for (float3 sign : { float3{ 1, 1, 1 }, float3{ -1, 1, -1 }, float3{ 1, -1, -1 } }) {
+            const float3 corner = transforms[i] * (points[i] + sign * e);
+            EXPECT_TRUE(all(lessThanEqual(abs(corner - centers[i]), extents[i] + 1e-4f)));
+        }
+    }
+}
@@ -23,6 +23,7 @@
 #include <stdlib.h>
 
 #include <atomic>
+#include <cstddef>
 #include <mutex>
 
 #include <utils/compiler.h>
@@ -366,6 +367,9 @@ struct Untracked {
     void onFree(void* p, size_t = 0) noexcept { }
     void onReset() noexcept { }
     void onRewind(void* addr) noexcept { }
+    // nothing is tracked, these always return 0
+    size_t getCurrent() const noexcept { return 0; }
+    size_t getHighWatermark() const noexcept { return 0; }
 };
 
 // This high watermark tracker works only with allocator that either implement
@@ -385,6 +389,10 @@ struct HighWatermark {
     void onReset() noexcept {  mCurrent = 0; }
     void onRewind(void const* addr) noexcept { mCurrent = uint32_t(uintptr_t(addr) - uintptr_t(mBase)); }
 
+    // bytes currently allocated, and most bytes ever allocated at once
+    size_t getCurrent() const noexcept { return mCurrent; }
+    size_t getHighWatermark() const noexcept { return mHighWaterMark; }
+
 private:
     const char* mName = nullptr;
     void* mBase = nullptr;
@@ -20,6 +20,7 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <mutex>
 
 #include <utils/Entity.h>
@@ -73,6 +74,12 @@ public:
         return (!e.isNull()) && (getGeneration(e) == mGens[getIndex(e)]);
     }
 
+    // incremented each time entities are destroyed, e.g. to invalidate what was cached about
+    // them. Thread safe.
+    uint32_t getVersion() const noexcept {
+        return mVersion.load(std::memory_order_relaxed);
+    }
+
     // registers a listener to be called when an entity is destroyed. thread safe.
     // if the listener is already register, this method has no effect.
     void registerListener(Listener* l) noexcept;
@@ -91,6 +98,13 @@ public:
     uint8_t getGenerationForIndex(size_t index) const noexcept {
         return mGens[index];
     }
+
+    // index of the given Entity, always smaller than RAW_INDEX_COUNT. Entities that were
+    // destroyed can share their index with a live one.
+    static inline Entity::Type getIndex(Entity e) noexcept  {
+        return e.getId() & INDEX_MASK;
+    }
+
     // singleton, can't be copied
     EntityManager(const EntityManager& rhs) = delete;
     EntityManager& operator=(const EntityManager& rhs) = delete;
@@ -109,15 +123,14 @@ private:
     static inline Entity::Type getGeneration(Entity e) noexcept {
         return e.getId() >> GENERATION_SHIFT;
     }
-    static inline Entity::Type getIndex(Entity e) noexcept  {
-        return e.getId() & INDEX_MASK;
-    }
     static inline Entity::Type makeIdentity(Entity::Type g, Entity::Type i) noexcept {
         return (g << GENERATION_SHIFT) | (i & INDEX_MASK);
     }
 
     // stores the generation of each index.
     uint8_t * const mGens;
+
+    std::atomic<uint32_t> mVersion = { 0 };
 };
 
 } // namespace utils
@@ -17,6 +17,9 @@
 #ifndef TNT_UTILS_HASH_H
 #define TNT_UTILS_HASH_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 namespace utils {
 namespace hash {
 
@@ -41,6 +44,16 @@ inline uint32_t murmur3(const uint32_t* key, size_t wordCount, uint32_t seed) {
     return h;
 }
 
+// 64-bits FNV-1a of a byte string; pass a previous result as seed to hash several strings
+inline uint64_t fnv1a(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull) {
+    uint8_t const* p = static_cast<uint8_t const*>(data);
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
 template<typename T>
 struct MurmurHashFn {
     uint32_t operator()(const T& key) const {
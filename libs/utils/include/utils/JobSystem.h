@@ -19,11 +19,14 @@
 
 #include <assert.h>
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <vector>
 
+#include <utils/Allocator.h>
 #include <utils/architecture.h>
 #include <utils/Condition.h>
 #include <utils/Log.h>
@@ -44,8 +47,13 @@
 namespace utils {
 
 class JobSystem {
-    static constexpr size_t MAX_JOB_COUNT = 4096;
+    // jobs are allocated in chunks, as needed
+    static constexpr size_t JOB_CHUNK_SIZE = 4096;
+    static constexpr size_t JOB_CHUNK_COUNT = 4;
+    static constexpr size_t MAX_JOB_COUNT = JOB_CHUNK_SIZE * JOB_CHUNK_COUNT;
     static_assert(MAX_JOB_COUNT <= 0x7FFE, "MAX_JOB_COUNT must be <= 0x7FFE");
+    static_assert(!(JOB_CHUNK_SIZE & (JOB_CHUNK_SIZE - 1)),
+            "JOB_CHUNK_SIZE must be a power of two");
     using WorkQueue = WorkStealingDequeue<uint16_t, MAX_JOB_COUNT>;
 
 public:
@@ -63,6 +71,9 @@ public:
         void const* getData() const { return padding; }
     private:
         friend class JobSystem;
+        // RETAINED is set in runningJobCount until the job is released
+        static constexpr uint16_t RETAINED = 0x8000;
+        static constexpr uint16_t COUNT_MASK = 0x7FFF;
         JobFunc function;
         uint16_t parent;
         std::atomic<uint16_t> runningJobCount = { 0 };
@@ -75,7 +86,14 @@ public:
             (CACHELINE_SIZE % sizeof(Job) == 0),
             "A Job must be N cache-lines long or N Jobs must fit in a cache line exactly.");
 
-    JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1) noexcept;
+    // default size of each thread's scratch memory, see getScratch()
+    static constexpr size_t SCRATCH_SIZE = 128 * 1024;
+
+    // threadAffinity is the mask of the CPUs the worker threads can run on (see
+    // setThreadAffinity()), 0 leaves them on all of them. Several engines can share a JobSystem,
+    // which must then have an adoptable thread for each of the threads they're created on.
+    JobSystem(size_t threadCount = 0, size_t adoptableThreadsCount = 1,
+            size_t scratchSize = SCRATCH_SIZE, uint32_t threadAffinity = 0) noexcept;
 
     ~JobSystem();
 
@@ -95,6 +113,7 @@ public:
     // Free-up all allocated jobs (without calling destructors)
     // Make sure to call this when all call to wait() have returned.
     // Also clears the master job
+    // This is not needed if all jobs are released, see release().
     void reset() noexcept;
 
     // resets a job
@@ -222,9 +241,20 @@ public:
         return job;
     }
 
+    // Names a job in the traces recorded by utils::Tracer, the jobs it creates get the same
+    // name unless they're named themselves. This must be called before the job runs, and the
+    // name must outlive the JobSystem (typically a string literal).
+    // This does nothing unless utils is built with UTILS_ENABLE_TRACER.
+    void setName(Job* job, const char* name) noexcept;
+
     // Add job to this thread's execution queue.
     // Current thread must be owned by JobSystem's thread pool. See adopt().
-    enum runFlags { DONT_SIGNAL = 0x1 };
+    //
+    // LOW_PRIORITY jobs are for background work, they only run when no thread can find a
+    // normal job to run, and threads that wait() don't pick them up (unless they're running a
+    // LOW_PRIORITY job themselves, or there are no worker threads). The jobs run by a
+    // LOW_PRIORITY job are LOW_PRIORITY as well.
+    enum runFlags { DONT_SIGNAL = 0x1, LOW_PRIORITY = 0x2 };
     void run(Job* job, uint32_t flags = 0) noexcept;
 
     // Wait on a job.
@@ -240,8 +270,44 @@ public:
     // before it is run.
     void finish(Job* job) noexcept;
 
+    // Jobs are only freed by reset(), unless they're released: the job is then recycled as
+    // soon as it's finished (or right away if it already is), so it must not be used anymore
+    // by the caller. This lets the JobSystem run any number of jobs without reset(), as long as
+    // no more than MAX_JOB_COUNT exist at the same time.
+    void release(Job* job) noexcept;
+
+    void runAndRelease(Job* job, uint32_t flags = 0) noexcept {
+        run(job, flags);
+        release(job);
+    }
+
+    void waitAndRelease(Job* job) noexcept {
+        wait(job);
+        release(job);
+    }
+
+    // Scratch memory of the current thread, which must be owned by JobSystem's thread pool.
+    // Jobs can allocate their temporary data from it without locking or using the heap, alloc()
+    // returns nullptr when it's exhausted. The allocations are valid until resetScratch() is
+    // called, and a job's allocations stay valid until it returns in any case.
+    LinearAllocator& getScratch() noexcept;
+
+    // Frees the allocations made from the threads' scratch memory, typically at the end of a
+    // frame. This must be called when no job uses its allocations anymore, each thread's
+    // scratch is then reset before it starts its next job.
+    void resetScratch() noexcept {
+        mScratchGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // total size of the threads' scratch memory
+    size_t getScratchMemorySize() const noexcept {
+        return mScratchSize * mThreadStates.size();
+    }
+
     // for debugging
-    size_t getJobWatermark() const noexcept { return mJobWaterMark; }
+    size_t getJobWatermark() const noexcept {
+        return std::max(mJobWaterMark, size_t(mNextJobIndex.load(std::memory_order_relaxed)));
+    }
     friend utils::io::ostream& operator << (utils::io::ostream& out, JobSystem const& js);
 
 
@@ -259,10 +325,44 @@ public:
     static void setThreadPriority(Priority priority) noexcept;
     static void setThreadAffinity(uint32_t mask) noexcept;
 
+    // Mask of the fastest CPUs, on CPUs whose cores don't all run at the same maximum frequency
+    // (e.g. big.LITTLE). 0 when all the cores are the same, or that's unknown (Linux and
+    // Android only).
+    static uint32_t getBigCoresMask() noexcept;
+
+    // The worker threads move to the CPUs of 'mask' while they run LOW_PRIORITY jobs (e.g. the
+    // little cores), and back to the threadAffinity given to the constructor afterwards. 0 (the
+    // default) doesn't move them. This must be called before any job is run.
+    void setLowPriorityThreadAffinity(uint32_t mask) noexcept {
+        mLowPriorityThreadAffinity = mask;
+    }
+
+    // Before parking, an idle worker thread spins looking for work for up to 'spins' iterations
+    // (each is a CPU pause, i.e. tens of nanoseconds), which hides the latency of waking it up
+    // when jobs come in bursts, e.g. the chunks of a parallel_for(). Each thread adapts how long
+    // it spins to how often it finds work doing so. 0 parks the threads right away, which uses
+    // the least power.
+    static constexpr uint32_t DEFAULT_SPIN_BUDGET = 1024;
+
+    void setSpinBudget(uint32_t spins) noexcept {
+        mSpinBudget.store(spins, std::memory_order_relaxed);
+    }
+
+    uint32_t getSpinBudget() const noexcept {
+        return mSpinBudget.load(std::memory_order_relaxed);
+    }
+
     size_t getParallelSplitCount() const noexcept {
         return mParallelSplitCount;
     }
 
+    // true when there are fewer jobs waiting to run than threads to run them, this is only a
+    // hint as it changes concurrently
+    bool hasIdleThreads() const noexcept {
+        return mActiveJobs.load(std::memory_order_relaxed) <
+               uint32_t(mThreadCount + mAdoptedThreads.load(std::memory_order_relaxed));
+    }
+
 private:
     // this is just to avoid using std::default_random_engine, since we're in a public header.
     class default_random_engine {
@@ -277,9 +377,11 @@ private:
         }
     };
 
+    enum { HIGH, LOW, PRIORITY_COUNT };
+
     struct alignas(CACHELINE_SIZE) ThreadState {    // this causes 40-bytes padding
-        // make sure storage is cache-line aligned
-        WorkQueue workQueue;
+        // make sure storage is cache-line aligned, one queue per priority
+        WorkQueue workQueues[PRIORITY_COUNT];
 
         // these are not accessed by the worker threads
         alignas(CACHELINE_SIZE)     // this causes 56-bytes padding
@@ -287,6 +389,11 @@ private:
         std::thread thread;
         default_random_engine rndGen;
         uint32_t mask;
+        bool lowPriority = false;   // we're running a LOW_PRIORITY job
+        uint16_t jobDepth = 0;      // number of jobs this thread is running (nested in wait())
+        uint32_t scratchGeneration = 0;
+        uint32_t spinCount = UINT32_MAX;    // how long this thread spins, within the budget
+        LinearAllocator scratch = { nullptr, nullptr };
     };
 
     static_assert(sizeof(ThreadState) % CACHELINE_SIZE == 0,
@@ -296,27 +403,53 @@ private:
 
     Job* create(Job* parent, JobFunc func) noexcept;
     Job* allocateJob() noexcept;
+    void recycleJob(Job* job) noexcept;
+    Job* getChunk(size_t chunk) noexcept;
     JobSystem::ThreadState& getStateToStealFrom(JobSystem::ThreadState& state) noexcept;
     bool hasJobCompleted(Job const* job) noexcept;
+    void updateScratch(ThreadState& state) noexcept;
 
     void requestExit() noexcept;
     bool exitRequested() const noexcept;
 
     void loop(ThreadState* threadState) noexcept;
-    bool execute(JobSystem::ThreadState& state) noexcept;
+    bool spin(ThreadState& state) noexcept;
+    void park() noexcept;
+    void wakeOne() noexcept;
+    bool execute(JobSystem::ThreadState& state, bool allowLowPriority) noexcept;
+    Job* find(JobSystem::ThreadState& state, size_t priority) noexcept;
 
     void put(WorkQueue& workQueue, Job* job) noexcept { workQueue.push(jobToIndex(job)); }
     Job* pop(WorkQueue& workQueue) noexcept { return indexToJob(workQueue.pop()); }
     Job* steal(WorkQueue& workQueue) noexcept { return indexToJob(workQueue.steal()); }
 
+    // The chunk of a job was published before the job was handed to us, which synchronized
+    // with its allocation, so the chunks don't need stronger ordering here.
+    Job* jobAt(size_t index) const noexcept {
+        assert(index < MAX_JOB_COUNT);
+        return mJobChunks[index / JOB_CHUNK_SIZE].load(std::memory_order_relaxed) +
+                (index % JOB_CHUNK_SIZE);
+    }
+
+    size_t indexOf(Job const* job) const noexcept {
+        for (size_t i = 0; i < JOB_CHUNK_COUNT; i++) {
+            Job const* const chunk = mJobChunks[i].load(std::memory_order_relaxed);
+            if (job >= chunk && job < chunk + JOB_CHUNK_SIZE) {
+                return i * JOB_CHUNK_SIZE + size_t(job - chunk);
+            }
+        }
+        assert(false);
+        return MAX_JOB_COUNT;
+    }
+
     Job* indexToJob(size_t index) {
         assert(index <= MAX_JOB_COUNT);
-        return !index ? nullptr : (&mJobStorage[0] - 1) + index;
+        return !index ? nullptr : jobAt(index - 1);
     }
 
     uint16_t jobToIndex(Job const* job) const {
         // we offset index by +1 so b/c workQueue returns 0 on failure
-        size_t index = job - (&mJobStorage[0] - 1);
+        size_t index = indexOf(job) + 1;
         assert(index > 0 && index <= MAX_JOB_COUNT);
         return uint16_t(index);
     }
@@ -325,7 +458,13 @@ private:
     utils::Mutex mLock;
     utils::Condition mCondition;
     std::atomic<uint32_t> mActiveJobs = { 0 };
+    std::atomic<uint32_t> mSpinningThreads = { 0 };     // looking for work before parking
+    std::atomic<uint32_t> mParkedThreads = { 0 };       // waiting on mCondition
     std::atomic<uint16_t> mNextJobIndex = { 0 };
+    // stack of the recycled jobs, the top's index + 1 in the low 16 bits and a tag (against
+    // ABA) in the high 16 bits
+    std::atomic<uint32_t> mFreeJobs = { 0 };
+    std::atomic<uint32_t> mScratchGeneration = { 0 };
 
     template <typename T>
     using aligned_vector = std::vector<T, utils::STLAlignedAllocator<T>>;
@@ -340,7 +479,14 @@ private:
     aligned_vector<ThreadState> mThreadStates;          // actual data is stored offline
     std::atomic<bool> mExitRequested = { 0 };           // this one is almost never written
     std::atomic<uint16_t> mAdoptedThreads = { 0 };      // this one is almost never written
-    Job* mJobStorage = nullptr;
+    std::atomic<uint32_t> mSpinBudget = { DEFAULT_SPIN_BUDGET };    // almost never written
+    std::atomic<Job*> mJobChunks[JOB_CHUNK_COUNT] = {};
+    std::atomic<uint16_t>* mNextFreeJob = nullptr;      // links of mFreeJobs, per job index
+    const char** mJobNames = nullptr;                   // per job index, UTILS_ENABLE_TRACER only
+    void* mScratch = nullptr;                           // the scratch memory of all threads
+    size_t mScratchSize = 0;                            // per thread
+    uint32_t mThreadAffinity = 0;                       // of the worker threads, 0 for any CPU
+    uint32_t mLowPriorityThreadAffinity = 0;            // while running LOW_PRIORITY jobs
     uint16_t mThreadCount = 0;
     uint8_t mParallelSplitCount = 0;
     Job* mMasterJob = nullptr;
@@ -412,7 +558,8 @@ struct ParallelForJobData {
         // We first split about the number of threads we have, and only then we split the rest
         // in a single thread (but execute the final cut in new jobs, see parallel() below),
         // this way we save a lot of copies of JobData.
-        if (splits == js.getParallelSplitCount()) {
+        // Lazy splitters decide as the jobs run instead, so they keep splitting here.
+        if (!SplitterType::LAZY && splits == js.getParallelSplitCount()) {
             parallel(js, parent);
             return;
         }
@@ -429,7 +576,7 @@ struct ParallelForJobData {
 
             // start the left side before attempting the right side, so we parallelize in case
             // of job creation failure -- rare, but still.
-            js.run(l);
+            js.runAndRelease(l);
 
             const size_type rc = count - lc;
             JobData rd(start + lc, rc, splits + uint8_t(1), functor, splitter);
@@ -437,17 +584,17 @@ struct ParallelForJobData {
 
             if (UTILS_UNLIKELY(r == nullptr)) {
                 // couldn't allocate right side job, execute it right now
-                functor(start + lc, rc);
+                splitter.execute(functor, start + lc, rc);
                 return;
             }
 
             // All good, execute the right side, but don't signal it,
             // so it's more likely to be executed next on the same thread
-            js.run(r, JobSystem::DONT_SIGNAL);
+            js.runAndRelease(r, JobSystem::DONT_SIGNAL);
         } else {
             done:
             // we're done splitting, do the real work here!
-            functor(start, count);
+            splitter.execute(functor, start, count);
         }
     }
 
@@ -473,15 +620,16 @@ struct ParallelForJobData {
         } else {
             // only capture what we need
             auto job = js.createJob(parent,
-                    [f = functor, s = start, c = count](JobSystem&, JobSystem::Job*) {
+                    [f = functor, s = start, c = count, sp = splitter]
+                    (JobSystem&, JobSystem::Job*) {
                 // we're done splitting, do the real work here!
-                f(s, c);
+                sp.execute(f, s, c);
             });
             if (UTILS_LIKELY(job)) {
-                js.run(job);
+                js.runAndRelease(job);
             } else {
                 // oops, no more job available
-                functor(start, count);
+                splitter.execute(functor, start, count);
             }
         }
     }
@@ -490,7 +638,7 @@ struct ParallelForJobData {
     size_type count;            // 4
     Functor functor;            // ?
     uint8_t splits;             // 1
-    SplitterType splitter;      // 1
+    SplitterType splitter;      // 1 or 8
 };
 
 } // namespace details
@@ -528,6 +676,7 @@ JobSystem::Job* parallel_for(JobSystem& js, JobSystem::Job* parent,
         auto parallelJob = js.createJob<JobData, &JobData::parallelWithJobs>(p, std::move(jobData));
         js.runAndWait(parallelJob);
         finish(js, parallelJob);
+        js.release(parallelJob);
     });
     return wrapper;
 }
@@ -545,6 +694,7 @@ JobSystem::Job* parallel_for(JobSystem& js, JobSystem::Job* parent,
         auto parallelJob = js.createJob<JobData, &JobData::parallelWithJobs>(p, std::move(jobData));
         js.runAndWait(parallelJob);
         finish(js, parallelJob);
+        js.release(parallelJob);
     });
     return wrapper;
 }
@@ -564,12 +714,81 @@ JobSystem::Job* parallel_for(JobSystem& js, JobSystem::Job* parent,
 }
 
 
+// A splitter decides whether a range is split in two more jobs with split(), given how many
+// times it was split already, and runs the work of a range that's not split with execute().
+// The ranges of a LAZY splitter are split as the jobs run, otherwise they are all split
+// upfront past the first getParallelSplitCount() levels.
+
 template <size_t COUNT, size_t MAX_SPLITS = 12>
 class CountSplitter {
 public:
+    static constexpr bool LAZY = false;
+
     bool split(size_t splits, size_t count) const noexcept {
         return (splits < MAX_SPLITS && count >= COUNT * 2);
     }
+
+    template <typename F>
+    void execute(F& functor, uint32_t start, uint32_t count) const noexcept {
+        functor(start, count);
+    }
+};
+
+// Splits a range as long as both halves are worth a job, based on the measured cost of an item,
+// and, past the first levels, only when some threads are idle (lazy binary splitting). The cost
+// is learnt across invocations in a Cost, which is typically kept with the call site.
+class AdaptiveSplitter {
+public:
+    static constexpr bool LAZY = true;
+    static constexpr size_t MAX_SPLITS = 12;
+
+    // running a job costs about a microsecond, so we don't go much lower
+    static constexpr float MIN_JOB_DURATION_NS = 20000.0f;
+
+    // exponential moving average of the duration of an item
+    class Cost {
+    public:
+        explicit Cost(float initialDurationNs) noexcept : mDurationNs(initialDurationNs) { }
+
+        float getItemDuration() const noexcept {
+            return mDurationNs.load(std::memory_order_relaxed);
+        }
+
+        // concurrent updates can be lost, which is fine for an estimate
+        void update(uint32_t count, int64_t durationNs) noexcept {
+            if (count) {
+                const float item = float(durationNs) / float(count);
+                const float previous = mDurationNs.load(std::memory_order_relaxed);
+                mDurationNs.store(previous + (item - previous) * 0.125f,
+                        std::memory_order_relaxed);
+            }
+        }
+
+    private:
+        std::atomic<float> mDurationNs;
+    };
+
+    explicit AdaptiveSplitter(Cost& cost) noexcept : mCost(&cost) { }
+
+    bool split(size_t splits, size_t count) const noexcept {
+        if (splits >= MAX_SPLITS || count * mCost->getItemDuration() < 2 * MIN_JOB_DURATION_NS) {
+            return false;
+        }
+        // spread the work over all threads first, then only split for idle threads
+        JobSystem const* const js = JobSystem::getJobSystem();
+        return js && (splits < js->getParallelSplitCount() || js->hasIdleThreads());
+    }
+
+    template <typename F>
+    void execute(F& functor, uint32_t start, uint32_t count) const noexcept {
+        const auto begin = std::chrono::steady_clock::now();
+        functor(start, count);
+        mCost->update(count, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin).count());
+    }
+
+private:
+    Cost* mCost;
 };
 
 } // namespace jobs
@@ -64,6 +64,10 @@ public:
 
     static Profiler& get() noexcept;
 
+    // The counters only count the events of the thread that created them: get() is for the
+    // thread that first calls it, this returns counters of the calling thread, created the first
+    // time it calls this (and destroyed when it exits).
+    static Profiler& getForCurrentThread() noexcept;
 
     Profiler(const Profiler& rhs) = delete;
     Profiler(Profiler&& rhs) = delete;
@@ -215,6 +219,10 @@ public:
     }
 
 private:
+    struct Deleter {
+        void operator()(Profiler* p) const noexcept { delete p; }
+    };
+
     Profiler() noexcept;
     ~Profiler() noexcept;
 
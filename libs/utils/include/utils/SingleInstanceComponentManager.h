@@ -19,6 +19,8 @@
 
 // FIXME: get rid of this STL headers
 #include <tsl/robin_map.h>
+#include <limits>
+#include <vector>
 
 #include <assert.h>
 #include <stddef.h>
@@ -65,7 +67,14 @@ public:
 
     using Instance = EntityInstanceBase::Type;
 
-    SingleInstanceComponentManager() noexcept {
+    // How entities are mapped to their instance.
+    enum class InstanceMap : uint8_t {
+        HASHED,     // hash-map lookup, memory proportional to the number of components
+        DENSE       // array indexed by the entity index, memory proportional to the highest index
+    };
+
+    explicit SingleInstanceComponentManager(InstanceMap mode = InstanceMap::HASHED) noexcept
+            : mDense(mode == InstanceMap::DENSE) {
         // We always start with a dummy entry because index=0 is reserved. The component
         // at index = 0, is guaranteed to be default-initialized.
         // Sub-classes can use this to their advantage.
@@ -89,10 +98,31 @@ public:
     // Get instance of this Entity to be used to retrieve components
     UTILS_NOINLINE
     Instance getInstance(Entity e) const noexcept {
-        auto const& map = mInstanceMap;
-        // find() generates quite a bit of code
-        auto pos = map.find(e);
-        return pos != map.end() ? pos->second : 0;
+        if (mDense) {
+            Instance i = getDenseInstance(e);
+            if (UTILS_LIKELY(getEntity(i) == e)) {
+                return i;
+            }
+            if (UTILS_LIKELY(mInstanceMap.empty())) {
+                return 0;
+            }
+        }
+        return getHashedInstance(e);
+    }
+
+    // Get the instances of n entities, 0 for those which don't have a component.
+    void getInstances(Entity const* entities, size_t n, Instance* instances) const noexcept {
+        if (mDense && mInstanceMap.empty()) {
+            Entity const* const UTILS_RESTRICT data = raw_array<ENTITY_INDEX>();
+            for (size_t k = 0; k < n; k++) {
+                Instance i = getDenseInstance(entities[k]);
+                instances[k] = data[i] == entities[k] ? i : 0;
+            }
+        } else {
+            for (size_t k = 0; k < n; k++) {
+                instances[k] = getInstance(entities[k]);
+            }
+        }
     }
 
     // returns the number of components (i.e. size of each arrays)
@@ -105,6 +135,14 @@ public:
         return getComponentCount() == 0;
     }
 
+    // returns the memory used by the component arrays and the entity map, in bytes
+    size_t getMemorySize() const noexcept {
+        using value_type = typename tsl::robin_map<Entity, Instance>::value_type;
+        return SoA::getNeededSize(mData.capacity()) +
+                mInstanceMap.bucket_count() * sizeof(value_type) +
+                mDenseMap.capacity() * sizeof(Instance);
+    }
+
     // returns a pointer to the Entity array. This is basically the list
     // of entities this component manager handles.
     // The pointer becomes invalid when adding or removing a component.
@@ -113,7 +151,8 @@ public:
     }
 
     Entity getEntity(Instance i) const noexcept {
-        return elementAt<ENTITY_INDEX>(i);
+        // the dummy component at index 0 always refers to the null entity
+        return data<ENTITY_INDEX>()[i];
     }
 
     // Add a component to the given Entity. If the entity already has a component from this
@@ -218,28 +257,34 @@ protected:
         assert(j);
         if (i && j) {
             // update the index map
-            auto& map = mInstanceMap;
             Entity& ei = elementAt<ENTITY_INDEX>(i);
             Entity& ej = elementAt<ENTITY_INDEX>(j);
             std::swap(ei, ej);
+            // find where each entity is mapped before updating anything, they can share a slot
+            const bool di = isDense(ei, j);
+            const bool dj = isDense(ej, i);
             if (ei) {
-                map[ei] = i;
+                setInstance(ei, i, di);
             }
             if (ej) {
-                map[ej] = j;
+                setInstance(ej, j, dj);
             }
         }
     }
 
+    // same as above, but also gives up after freeing maxCount components. This returns the number
+    // of components freed, so the collection of a large number of components can be spread
+    // over several calls.
     template<typename REMOVE>
-    void gc(const EntityManager& em, size_t ratio,
-            REMOVE removeComponent) noexcept {
+    size_t gc(const EntityManager& em, size_t ratio,
+            REMOVE removeComponent, size_t maxCount = std::numeric_limits<size_t>::max()) noexcept {
         Entity const* entities = getEntities();
         size_t count = getComponentCount();
         size_t aliveInARow = 0;
+        size_t removed = 0;
         default_random_engine& rng = mRng;
         #pragma nounroll
-        while (count && aliveInARow < ratio) {
+        while (count && aliveInARow < ratio && removed < maxCount) {
             // note: using the modulo favorizes lower number
             size_t i = rng() % count;
             if (UTILS_LIKELY(em.isAlive(entities[i]))) {
@@ -248,17 +293,50 @@ protected:
             }
             aliveInARow = 0;
             count--;
+            removed++;
             removeComponent(entities[i]);
         }
+        return removed;
     }
 
 protected:
     SoA mData;
 
 private:
+    Instance getHashedInstance(Entity e) const noexcept {
+        auto const& map = mInstanceMap;
+        // find() generates quite a bit of code
+        auto pos = map.find(e);
+        return pos != map.end() ? pos->second : 0;
+    }
+
+    // this is only a candidate, its entity must be checked
+    Instance getDenseInstance(Entity e) const noexcept {
+        const size_t index = EntityManager::getIndex(e);
+        return index < mDenseMap.size() ? mDenseMap[index] : Instance(0);
+    }
+
+    // whether e, at instance i, is mapped through the dense array
+    bool isDense(Entity e, Instance i) const noexcept {
+        return mDense && getDenseInstance(e) == i;
+    }
+
+    void setInstance(Entity e, Instance i, bool dense) noexcept {
+        if (dense) {
+            mDenseMap[EntityManager::getIndex(e)] = i;
+        } else {
+            mInstanceMap[e] = i;
+        }
+    }
+
+    // In DENSE mode, mDenseMap holds the instance of the most recently added entity for each
+    // index. Components of destroyed entities that haven't been gc'ed yet are moved to
+    // mInstanceMap when their index is reused, which is otherwise empty.
+    std::vector<Instance> mDenseMap;
     // maps an entity to an instance index
     tsl::robin_map<Entity, Instance> mInstanceMap;
     default_random_engine mRng;
+    bool mDense = false;
 };
 
 // Keep these outside of the class because CLion has trouble parsing them
@@ -272,10 +350,23 @@ SingleInstanceComponentManager<Elements ...>::addComponent(Entity e) {
             mData.push_back().template back<ENTITY_INDEX>() = e;
             // index 0 is used when the component doesn't exist
             ci = Instance(mData.size() - 1);
-            mInstanceMap[e] = ci;
+            if (mDense) {
+                const size_t index = EntityManager::getIndex(e);
+                if (index >= mDenseMap.size()) {
+                    mDenseMap.resize(index + 1);
+                }
+                // the entity previously using this index is dead, but can still have a component
+                Instance const stale = mDenseMap[index];
+                if (stale) {
+                    mInstanceMap[getEntity(stale)] = stale;
+                }
+                mDenseMap[index] = ci;
+            } else {
+                mInstanceMap[e] = ci;
+            }
         } else {
             // if the entity already has this component, just return its instance
-            ci = mInstanceMap[e];
+            ci = getInstance(e);
         }
     }
     assert(ci != 0);
@@ -286,11 +377,9 @@ SingleInstanceComponentManager<Elements ...>::addComponent(Entity e) {
 template <typename ... Elements>
 typename SingleInstanceComponentManager<Elements ...>::Instance
 SingleInstanceComponentManager<Elements ... >::removeComponent(Entity e) {
-    auto& map = mInstanceMap;
-    auto pos = map.find(e);
-    if (UTILS_LIKELY(pos != map.end())) {
-        size_t index = pos->second;
-        assert(index != 0);
+    Instance index = getInstance(e);
+    if (UTILS_LIKELY(index != 0)) {
+        const bool dense = isDense(e, index);
         size_t last = mData.size() - 1;
         if (last != index) {
             // move the last item to where we removed this component, as to keep
@@ -300,10 +389,14 @@ SingleInstanceComponentManager<Elements ... >::removeComponent(Entity e) {
             });
 
             Entity lastEntity = mData.template elementAt<ENTITY_INDEX>(index);
-            map[lastEntity] = index;
+            setInstance(lastEntity, index, isDense(lastEntity, Instance(last)));
         }
         mData.pop_back();
-        map.erase(pos);
+        if (dense) {
+            mDenseMap[EntityManager::getIndex(e)] = 0;
+        } else {
+            mInstanceMap.erase(e);
+        }
         return last;
     }
     return 0;
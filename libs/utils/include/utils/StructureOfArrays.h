@@ -20,11 +20,14 @@
 #include <array>        // note: this is safe, see how std::array is used below (inline / private)
 #include <cstddef>
 #include <functional>
+#include <type_traits>
 #include <utility>
 
+#include <assert.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <utils/Allocator.h>
 #include <utils/compiler.h>
@@ -317,6 +320,88 @@ public:
         });
     }
 
+    // Computes the order of a stable partition of count elements by their bucket, which must be
+    // smaller than BUCKET_COUNT. order[i] receives the index of the element that goes to position
+    // i: all the elements of a bucket come before those of the next bucket, in their original
+    // order. ends[b] receives the position past the last element of bucket b.
+    template<size_t BUCKET_COUNT>
+    static void computePartitionOrder(uint8_t const* UTILS_RESTRICT buckets, size_t count,
+            uint32_t* UTILS_RESTRICT order, uint32_t* UTILS_RESTRICT ends) noexcept {
+        uint32_t offsets[BUCKET_COUNT] = {};
+        for (size_t i = 0; i < count; i++) {
+            assert(buckets[i] < BUCKET_COUNT);
+            offsets[buckets[i]]++;
+        }
+        // exclusive prefix sum of the bucket sizes
+        uint32_t sum = 0;
+        for (size_t b = 0; b < BUCKET_COUNT; b++) {
+            const uint32_t size = offsets[b];
+            offsets[b] = sum;
+            sum += size;
+            ends[b] = sum;
+        }
+        for (size_t i = 0; i < count; i++) {
+            order[offsets[buckets[i]]++] = uint32_t(i);
+        }
+    }
+
+    // Size in bytes of the scratch buffer needed by gather() and scatter() for count elements.
+    static size_t getScratchSize(size_t count) noexcept {
+        return getNeededSize(count);
+    }
+
+    // Reorders the elements [first, first + count) of the ElementIndex'th array, such that the
+    // element at first + order[i] moves to first + i. order must be a permutation of [0, count).
+    // scratch must be at least getScratchSize(count) bytes, aligned like malloc() memory.
+    // Each array uses its own part of scratch, so different arrays can be gathered concurrently.
+    template<size_t ElementIndex>
+    void gather(uint32_t const* UTILS_RESTRICT order, size_t first, size_t count,
+            void* scratch) noexcept {
+        using T = TypeAt<ElementIndex>;
+        T* const UTILS_RESTRICT p = data<ElementIndex>() + first;
+        T* const UTILS_RESTRICT s = getScratchArray<T>(ElementIndex, count, scratch);
+        if (std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value) {
+            for (size_t i = 0; i < count; i++) {
+                s[i] = p[order[i]];
+            }
+            memcpy(p, s, count * sizeof(T));
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                new(s + i) T(std::move(p[order[i]]));
+            }
+            moveBack(p, s, count);
+        }
+    }
+
+    // Inverse of gather(): the element at first + i moves to first + order[i].
+    template<size_t ElementIndex>
+    void scatter(uint32_t const* UTILS_RESTRICT order, size_t first, size_t count,
+            void* scratch) noexcept {
+        using T = TypeAt<ElementIndex>;
+        T* const UTILS_RESTRICT p = data<ElementIndex>() + first;
+        T* const UTILS_RESTRICT s = getScratchArray<T>(ElementIndex, count, scratch);
+        if (std::is_trivially_copyable<T>::value && std::is_trivially_destructible<T>::value) {
+            for (size_t i = 0; i < count; i++) {
+                s[order[i]] = p[i];
+            }
+            memcpy(p, s, count * sizeof(T));
+        } else {
+            for (size_t i = 0; i < count; i++) {
+                new(s + order[i]) T(std::move(p[i]));
+            }
+            moveBack(p, s, count);
+        }
+    }
+
+    // gather() or scatter() all the arrays
+    void gather(uint32_t const* order, size_t first, size_t count, void* scratch) noexcept {
+        gather_each(order, first, count, scratch, std::make_index_sequence<kArrayCount>());
+    }
+
+    void scatter(uint32_t const* order, size_t first, size_t count, void* scratch) noexcept {
+        scatter_each(order, first, count, scratch, std::make_index_sequence<kArrayCount>());
+    }
+
     // remove and destroy the last element of each array
     inline void pop_back() noexcept {
         if (mSize) {
@@ -495,6 +580,31 @@ private:
         return static_cast<T*>(mArrayOffset[arrayIndex]);
     }
 
+    template<typename T>
+    static T* getScratchArray(size_t arrayIndex, size_t count, void* scratch) noexcept {
+        return reinterpret_cast<T*>(uintptr_t(scratch) + getOffset(arrayIndex, count));
+    }
+
+    template<typename T>
+    static void moveBack(T* UTILS_RESTRICT p, T* UTILS_RESTRICT s, size_t count) noexcept {
+        for (size_t i = 0; i < count; i++) {
+            p[i] = std::move(s[i]);
+            s[i].~T();
+        }
+    }
+
+    template<size_t ... Is>
+    void gather_each(uint32_t const* order, size_t first, size_t count, void* scratch,
+            std::index_sequence<Is...>) noexcept {
+        int UTILS_UNUSED dummy[] = { (gather<Is>(order, first, count, scratch), 0)... };
+    }
+
+    template<size_t ... Is>
+    void scatter_each(uint32_t const* order, size_t first, size_t count, void* scratch,
+            std::index_sequence<Is...>) noexcept {
+        int UTILS_UNUSED dummy[] = { (scatter<Is>(order, first, count, scratch), 0)... };
+    }
+
     inline void resizeNoCheck(size_t needed) noexcept {
         assert(mCapacity >= needed);
         if (needed < mSize) {
@@ -24,7 +24,35 @@
 #define SYSTRACE_TAG_JOBSYSTEM      (1<<2)
 
 
-#if defined(ANDROID)
+#if defined(UTILS_ENABLE_TRACER)
+
+// ------------------------------------------------------------------------------------------------
+// The events are recorded by utils::Tracer, in-process or to the platform's tracer, see Tracer.h
+// ------------------------------------------------------------------------------------------------
+
+#include <utils/Tracer.h>
+
+#ifndef SYSTRACE_TAG
+#define SYSTRACE_TAG (SYSTRACE_TAG_ALWAYS)
+#endif
+
+#define SYSTRACE_ENABLE() utils::Tracer::enable(SYSTRACE_TAG)
+#define SYSTRACE_DISABLE() utils::Tracer::disable(SYSTRACE_TAG)
+#define SYSTRACE_CONTEXT()
+#define SYSTRACE_NAME(name) utils::Tracer::ScopedTrace ___tracer(SYSTRACE_TAG, name)
+#define SYSTRACE_CALL() SYSTRACE_NAME(__FUNCTION__)
+#define SYSTRACE_ASYNC_BEGIN(name, cookie) \
+        utils::Tracer::asyncBegin(SYSTRACE_TAG, name, int64_t(cookie))
+#define SYSTRACE_ASYNC_END(name, cookie) \
+        utils::Tracer::asyncEnd(SYSTRACE_TAG, name, int64_t(cookie))
+#define SYSTRACE_VALUE32(name, val) \
+        utils::Tracer::value(SYSTRACE_TAG, name, int64_t(int32_t(val)))
+#define SYSTRACE_VALUE64(name, val) \
+        utils::Tracer::value(SYSTRACE_TAG, name, int64_t(val))
+
+// ------------------------------------------------------------------------------------------------
+#elif defined(ANDROID)
+// ------------------------------------------------------------------------------------------------
 
 #include <atomic>
 
@@ -219,7 +247,7 @@ private:
 } // namespace utils
 
 // ------------------------------------------------------------------------------------------------
-#else // !ANDROID
+#else // !ANDROID && !UTILS_ENABLE_TRACER
 // ------------------------------------------------------------------------------------------------
 
 #define SYSTRACE_ENABLE()
@@ -232,6 +260,6 @@ private:
 #define SYSTRACE_VALUE32(name, val)
 #define SYSTRACE_VALUE64(name, val)
 
-#endif // ANDROID
+#endif // UTILS_ENABLE_TRACER
 
 #endif // TNT_UTILS_SYSTRACE_H
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_TRACER_H
+#define TNT_UTILS_TRACER_H
+
+#include <utils/compiler.h>
+
+#include <atomic>
+#include <iosfwd>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace utils {
+
+/*
+ * An in-process trace recorder, for platforms that don't have atrace.
+ *
+ * Each thread records its events in its own ring buffer, without locks, the oldest events are
+ * overwritten when a buffer is full. The events can be dumped at any time in the Chrome trace
+ * event format (JSON), which chrome://tracing and the Perfetto UI open.
+ *
+ * When utils is built with UTILS_ENABLE_TRACER (see FILAMENT_ENABLE_TRACER), the SYSTRACE_
+ * macros of Systrace.h record into the Tracer, as do jobs that run in the JobSystem (with the
+ * SYSTRACE_TAG_JOBSYSTEM tag) and the driver commands (with SYSTRACE_TAG_FILAMENT).
+ *
+ * The events can instead be sent to the tracing facility of the platform, see Backend. Either
+ * way, a disabled tag costs a relaxed atomic load and a branch, so tracing can stay compiled in.
+ *
+ * All names must outlive the Tracer, typically they're string literals.
+ */
+class Tracer {
+public:
+    // number of events each thread keeps
+    static constexpr size_t CAPACITY = 16384;
+
+    enum class Backend : uint8_t {
+        // the per-thread ring buffers, see dump()
+        RING_BUFFER,
+        // the system's tracer: ftrace (what atrace and Perfetto record) on Linux and Android,
+        // os_signpost (Instruments) on Apple platforms and ETW (Windows Performance Recorder,
+        // provider "Filament") on Windows. Nothing is kept in-process, dump() writes no event.
+        PLATFORM
+    };
+
+    // Selects where the events go, this is RING_BUFFER unless the UTILS_TRACER_BACKEND
+    // environment variable is "platform". It's best changed while tracing is disabled, so that
+    // no scope begins with one backend and ends with the other.
+    // Returns false, and keeps the current backend, if the platform's tracer isn't available.
+    static bool setBackend(Backend backend) noexcept;
+
+    static Backend getBackend() noexcept {
+        return sBackend.load(std::memory_order_relaxed);
+    }
+
+    // starts recording the events of the given tags (see SYSTRACE_TAG_*)
+    static void enable(uint32_t tags) noexcept;
+
+    // stops recording the events of the given tags
+    static void disable(uint32_t tags) noexcept;
+
+    static bool isEnabled(uint32_t tag) noexcept {
+        return tag && (sEnabledTags.load(std::memory_order_relaxed) & tag);
+    }
+
+    // beginning and end of a synchronous event, these must be nested on a given thread
+    static void begin(uint32_t tag, const char* name) noexcept {
+        if (UTILS_UNLIKELY(isEnabled(tag))) {
+            record(BEGIN, name, 0);
+        }
+    }
+
+    static void end(uint32_t tag) noexcept {
+        if (UTILS_UNLIKELY(isEnabled(tag))) {
+            record(END, nullptr, 0);
+        }
+    }
+
+    // beginning and end of an asynchronous event, identified by its name and cookie
+    static void asyncBegin(uint32_t tag, const char* name, int64_t cookie) noexcept {
+        if (UTILS_UNLIKELY(isEnabled(tag))) {
+            record(ASYNC_BEGIN, name, cookie);
+        }
+    }
+
+    static void asyncEnd(uint32_t tag, const char* name, int64_t cookie) noexcept {
+        if (UTILS_UNLIKELY(isEnabled(tag))) {
+            record(ASYNC_END, name, cookie);
+        }
+    }
+
+    // value of a counter
+    static void value(uint32_t tag, const char* name, int64_t value) noexcept {
+        if (UTILS_UNLIKELY(isEnabled(tag))) {
+            record(COUNTER, name, value);
+        }
+    }
+
+    // name of the current thread in the trace
+    static void setThreadName(const char* name) noexcept;
+
+    // Writes the events recorded so far by all threads. Events recorded while this runs may be
+    // dropped, so this is best called while the traced threads are idle, e.g. between frames.
+    static void dump(std::ostream& out) noexcept;
+
+    // same as dump(std::ostream&) into a file, returns false if the file can't be written
+    static bool dump(const char* path) noexcept;
+
+    // discards all the events recorded so far
+    static void clear() noexcept;
+
+    class ScopedTrace {
+    public:
+        ScopedTrace(uint32_t tag, const char* name) noexcept
+                : mTag(isEnabled(tag) ? tag : 0) {
+            if (UTILS_UNLIKELY(mTag)) {
+                record(BEGIN, name, 0);
+            }
+        }
+
+        ~ScopedTrace() noexcept {
+            // we always close a scope that we opened, even if the tag was disabled since
+            if (UTILS_UNLIKELY(mTag)) {
+                record(END, nullptr, 0);
+            }
+        }
+
+    private:
+        const uint32_t mTag;
+    };
+
+private:
+    enum Type : uint8_t { BEGIN, END, ASYNC_BEGIN, ASYNC_END, COUNTER };
+
+    static void record(Type type, const char* name, int64_t value) noexcept;
+    static void recordPlatform(Type type, const char* name, int64_t value) noexcept;
+
+    static std::atomic<uint32_t> sEnabledTags;
+    static std::atomic<Backend> sBackend;
+};
+
+} // namespace utils
+
+#endif // TNT_UTILS_TRACER_H
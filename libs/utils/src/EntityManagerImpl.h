@@ -19,9 +19,11 @@
 
 #include <utils/EntityManager.h>
 
-#include <deque>
+#include <algorithm>
+#include <atomic>
 #include <mutex>
 #include <set>
+#include <thread>
 
 #include <utils/compiler.h>
 #include <utils/Entity.h>
@@ -42,46 +44,45 @@ public:
     using EntityManager::create;
     using EntityManager::destroy;
 
-    void create(size_t n, Entity* entities) {
-        Entity::Type index;
-        auto& freeList = mFreeList;
-        uint8_t* const gens = mGens;
+    EntityManagerImpl() : mFreeIndices(new std::atomic<Entity::Type>[RAW_INDEX_COUNT]) {
+        for (size_t i = 0; i < RAW_INDEX_COUNT; i++) {
+            mFreeIndices[i].store(0, std::memory_order_relaxed);
+        }
+    }
 
-        // this must be thread-safe, acquire the free-list mutex
-        std::lock_guard<Mutex> lock(mFreeListLock);
-        Entity::Type currentIndex = mCurrentIndex;
-        for (size_t i = 0; i < n; i++) {
-            // If we have more than a certain number of freed indices, get one from the list.
-            // this is a trade-off between how often we recycle indices and how large the free list
-            // can grow.
-            if (UTILS_UNLIKELY(currentIndex >= RAW_INDEX_COUNT || freeList.size() >= MIN_FREE_INDICES)) {
-
-                // this could only happen if we had gone through all the indices at least once
-                if (UTILS_UNLIKELY(freeList.empty())) {
-                    // return the null entity
-                    entities[i] = {};
-                    continue;
-                }
+    ~EntityManagerImpl() noexcept {
+        delete [] mFreeIndices;
+    }
 
-                index = freeList.front();
-                freeList.pop_front();
-            } else {
-                // In the common case, we just grab the next index.
-                // This works only until all indices have been used once, at which point
-                // we're always in the slower case above. The idea is that we have enough indices
-                // that it doesn't happen in practice.
-                index = currentIndex++;
-            }
-            entities[i] = Entity{ makeIdentity(gens[index], index) };
+    // this is lock-free, unless a thread is preempted while it's accessing the free list, which
+    // could make another thread wait for it.
+    void create(size_t n, Entity* entities) {
+        // If we have more than a certain number of freed indices, get them from the list.
+        // this is a trade-off between how often we recycle indices and how large the free list
+        // can grow.
+        size_t i = popFreeIndices(n, entities, MIN_FREE_INDICES);
+
+        // In the common case, we just grab the next indices.
+        // This works only until all indices have been used once, at which point
+        // we're always in the slower case above. The idea is that we have enough indices
+        // that it doesn't happen in practice.
+        i += allocateIndices(n - i, entities + i);
+
+        // this could only happen if we had gone through all the indices at least once
+        if (UTILS_UNLIKELY(i < n)) {
+            i += popFreeIndices(n - i, entities + i, 1);
+            // return the null entity for the indices we couldn't allocate
+            std::fill(entities + i, entities + n, Entity{});
         }
-        mCurrentIndex = currentIndex;
     }
 
     void destroy(size_t n, Entity* entities) noexcept {
-        auto& freeList = mFreeList;
         uint8_t* const gens = mGens;
 
-        std::unique_lock<Mutex> lock(mFreeListLock);
+        // the indices are pushed in batches, which each need a single atomic operation
+        constexpr size_t BATCH_SIZE = 64;
+        Entity::Type batch[BATCH_SIZE];
+        size_t count = 0;
         for (size_t i = 0; i < n; i++) {
             if (!entities[i]) {
                 // behave like free(), ok to free null Entity.
@@ -96,16 +97,22 @@ public:
             // will be called.
             if (isAlive(entities[i])) {
                 Entity::Type index = getIndex(entities[i]);
-                freeList.push_back(index);
 
-                // The generation update doesn't require the lock because it's only used for isAlive()
-                // and entities work as weak references -- it just means that isAlive() could return
-                // true a little longer than expected in some other threads.
-                // We do need a memory fence though, it is provided by the mFreeListLock.unlock() below.
+                // The generation update doesn't need to be atomic because it's only used for
+                // isAlive() and entities work as weak references -- it just means that isAlive()
+                // could return true a little longer than expected in some other threads.
+                // We do need a memory fence though, it is provided by pushFreeIndices() below.
                 gens[index]++;
+
+                batch[count++] = index;
+                if (count == BATCH_SIZE) {
+                    pushFreeIndices(count, batch);
+                    count = 0;
+                }
             }
         }
-        lock.unlock();
+        pushFreeIndices(count, batch);
+        mVersion.fetch_add(1, std::memory_order_relaxed);
 
         // notify our listeners that some entities are being destroyed
         std::set<Listener*> listeners = getListeners();
@@ -114,22 +121,23 @@ public:
         }
     }
 
-
+    // this must not be called concurrently with create() or destroy()
     void clear() noexcept {
         uint8_t* const gens = mGens;
 
-        std::unique_lock<Mutex> lock(mFreeListLock);
-
         // make all indices that were ever used invalid
-        for (size_t i = 0, c = mCurrentIndex; i < c; i++) {
+        for (size_t i = 0, c = mCurrentIndex.load(std::memory_order_relaxed); i < c; i++) {
             gens[i]++;
         }
 
         // clear the free-list entirely.
-        mCurrentIndex = 1;
-        mFreeList.clear();
-        mFreeList.shrink_to_fit();
-        lock.unlock();
+        mCurrentIndex.store(1, std::memory_order_relaxed);
+        for (size_t i = 0; i < RAW_INDEX_COUNT; i++) {
+            mFreeIndices[i].store(0, std::memory_order_relaxed);
+        }
+        mFreeHead.store(0, std::memory_order_relaxed);
+        mFreeTail.store(0, std::memory_order_release);
+        mVersion.fetch_add(1, std::memory_order_relaxed);
 
         // notify our listeners that all entities are being destroyed
         std::set<Listener*> listeners = getListeners();
@@ -154,11 +162,83 @@ public:
     }
 
 private:
-    uint32_t mCurrentIndex = 1;
+    // takes up to n never used indices, returns how many were taken
+    size_t allocateIndices(size_t n, Entity* entities) noexcept {
+        Entity::Type current = mCurrentIndex.load(std::memory_order_relaxed);
+        size_t count;
+        do {
+            count = std::min(n, size_t(RAW_INDEX_COUNT - current));
+            if (!count) {
+                return 0;
+            }
+        } while (!mCurrentIndex.compare_exchange_weak(current, Entity::Type(current + count),
+                std::memory_order_relaxed, std::memory_order_relaxed));
+
+        uint8_t const* const gens = mGens;
+        for (size_t i = 0; i < count; i++) {
+            const Entity::Type index = Entity::Type(current + i);
+            entities[i] = Entity{ makeIdentity(gens[index], index) };
+        }
+        return count;
+    }
+
+    // Takes up to n of the oldest freed indices, as long as 'reserve - 1' are left in the list,
+    // returns how many were taken.
+    size_t popFreeIndices(size_t n, Entity* entities, size_t reserve) noexcept {
+        uint32_t head = mFreeHead.load(std::memory_order_relaxed);
+        size_t count;
+        do {
+            const uint32_t available = mFreeTail.load(std::memory_order_relaxed) - head;
+            count = available >= reserve ? std::min(n, size_t(available - reserve + 1)) : 0;
+            if (!count) {
+                return 0;
+            }
+        } while (!mFreeHead.compare_exchange_weak(head, uint32_t(head + count),
+                std::memory_order_relaxed, std::memory_order_relaxed));
+
+        uint8_t const* const gens = mGens;
+        for (size_t i = 0; i < count; i++) {
+            std::atomic<Entity::Type>& slot = mFreeIndices[(head + i) & FREE_INDEX_MASK];
+            // the thread that reserved this slot in pushFreeIndices() might not have filled it yet
+            Entity::Type index;
+            while (!(index = slot.exchange(0, std::memory_order_acquire))) {
+                std::this_thread::yield();
+            }
+            entities[i] = Entity{ makeIdentity(gens[index], index) };
+        }
+        return count;
+    }
+
+    void pushFreeIndices(size_t n, Entity::Type const* indices) noexcept {
+        if (!n) {
+            return;
+        }
+        const uint32_t tail = mFreeTail.fetch_add(uint32_t(n), std::memory_order_relaxed);
+        for (size_t i = 0; i < n; i++) {
+            std::atomic<Entity::Type>& slot = mFreeIndices[(tail + i) & FREE_INDEX_MASK];
+            // The slot is still full if the thread that popped it a lap ago hasn't emptied it
+            // yet. There are fewer free indices than slots, so this can't happen otherwise.
+            Entity::Type empty = 0;
+            while (!slot.compare_exchange_weak(empty, indices[i],
+                    std::memory_order_release, std::memory_order_relaxed)) {
+                empty = 0;
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // the free indices are stored in a ring buffer, so that the oldest ones are recycled first.
+    // The index 0 is never freed (it's the null entity), so it marks the empty slots.
+    static constexpr const uint32_t FREE_INDEX_MASK = RAW_INDEX_COUNT - 1u;
+    std::atomic<Entity::Type>* const mFreeIndices;
+
+    // mFreeHead and mFreeTail are the positions of the next slots to read and write, they're
+    // incremented when reserving slots
+    std::atomic<uint32_t> mFreeHead = { 0 };
+    std::atomic<uint32_t> mFreeTail = { 0 };
 
-    // stores indices that got freed
-    mutable Mutex mFreeListLock;
-    std::deque<Entity::Type> mFreeList;
+    // the next never used index
+    std::atomic<Entity::Type> mCurrentIndex = { 1 };
 
     mutable Mutex mListenerLock;
     std::set<Listener*> mListeners;
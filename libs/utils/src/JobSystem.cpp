@@ -27,10 +27,13 @@
 #include <cmath>
 #include <random>
 
+#include <stdio.h>
+
 #include <utils/compiler.h>
 #include <utils/memalign.h>
 #include <utils/Panic.h>
 #include <utils/Systrace.h>
+#include <utils/Tracer.h>
 
 #if !defined(WIN32)
 #    include <pthread.h>
@@ -67,6 +70,9 @@ void JobSystem::setThreadName(const char* name) noexcept {
 #else
 // TODO: implement setting thread name on WIN32 
 #endif
+#if defined(UTILS_ENABLE_TRACER)
+    Tracer::setThreadName(name);
+#endif
 }
 
 void JobSystem::setThreadPriority(Priority priority) noexcept {
@@ -103,11 +109,49 @@ void JobSystem::setThreadAffinity(uint32_t mask) noexcept {
 #endif
 }
 
-JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept {
+uint32_t JobSystem::getBigCoresMask() noexcept {
+    uint32_t mask = 0;
+#if defined(__linux__)
+    // the CPUs with the highest maximum frequency are the big ones
+    uint32_t maxFrequency[32] = {};
+    uint32_t highest = 0;
+    uint32_t lowest = UINT32_MAX;
+    for (uint32_t cpu = 0; cpu < 32; cpu++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/cpuinfo_max_freq", cpu);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+        if (fscanf(file, "%u", &maxFrequency[cpu]) == 1 && maxFrequency[cpu]) {
+            highest = std::max(highest, maxFrequency[cpu]);
+            lowest = std::min(lowest, maxFrequency[cpu]);
+        }
+        fclose(file);
+    }
+    if (highest > lowest) {
+        for (uint32_t cpu = 0; cpu < 32; cpu++) {
+            if (maxFrequency[cpu] == highest) {
+                mask |= 1u << cpu;
+            }
+        }
+    }
+#endif
+    return mask;
+}
+
+JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount,
+        size_t scratchSize, uint32_t threadAffinity) noexcept
+        : mThreadAffinity(threadAffinity) {
     SYSTRACE_ENABLE();
 
-    void* p = aligned_alloc(MAX_JOB_COUNT * sizeof(Job), CACHELINE_SIZE);
-    mJobStorage = (Job*)p;
+    // the first chunk of jobs is always needed, the other ones are allocated on demand
+    mJobChunks[0].store((Job*)aligned_alloc(JOB_CHUNK_SIZE * sizeof(Job), CACHELINE_SIZE),
+            std::memory_order_relaxed);
+    mNextFreeJob = new std::atomic<uint16_t>[MAX_JOB_COUNT];
+#if defined(UTILS_ENABLE_TRACER)
+    mJobNames = new const char*[MAX_JOB_COUNT];
+#endif
 
     if (threadCount == 0) {
         // default value, system dependant
@@ -131,6 +175,13 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
     assert(mNextJobIndex.is_lock_free());
     assert(Job().runningJobCount.is_lock_free());
 
+    // each thread's scratch is a cache-line aligned slice of a single allocation
+    mScratchSize = (scratchSize + CACHELINE_SIZE - 1) & ~(CACHELINE_SIZE - 1);
+    if (mScratchSize) {
+        mScratch = aligned_alloc(mScratchSize * mThreadStates.size(), CACHELINE_SIZE);
+        ASSERT_POSTCONDITION(mScratch, "Couldn't allocate the scratch memory");
+    }
+
     std::random_device rd;
     const size_t hardwareThreadCount = mThreadCount;
     auto& states = mThreadStates;
@@ -141,6 +192,10 @@ JobSystem::JobSystem(size_t threadCount, size_t adoptableThreadsCount) noexcept
         state.rndGen = default_random_engine(rd());
         state.mask = uint32_t(1UL << i);
         state.js = this;
+        if (mScratch) {
+            char* const scratch = static_cast<char*>(mScratch) + i * mScratchSize;
+            state.scratch = LinearAllocator(scratch, scratch + mScratchSize);
+        }
         if (i < hardwareThreadCount) {
             // don't start a thread of adoptable thread slots
             state.thread = std::thread(&JobSystem::loop, this, &state);
@@ -159,7 +214,12 @@ JobSystem::~JobSystem() {
         }
     }
 
-    aligned_free(mJobStorage);
+    for (auto& chunk : mJobChunks) {
+        aligned_free(chunk.load(std::memory_order_relaxed));
+    }
+    delete [] mNextFreeJob;
+    delete [] mJobNames;
+    aligned_free(mScratch);
 }
 
 JobSystem* JobSystem::getJobSystem() noexcept {
@@ -184,7 +244,7 @@ inline bool JobSystem::exitRequested() const noexcept {
 }
 
 inline bool JobSystem::hasJobCompleted(JobSystem::Job const* job) noexcept {
-    return job->runningJobCount.load(std::memory_order_relaxed) <= 0;
+    return !(job->runningJobCount.load(std::memory_order_relaxed) & Job::COUNT_MASK);
 }
 
 inline JobSystem::ThreadState& JobSystem::getState() noexcept {
@@ -193,13 +253,57 @@ inline JobSystem::ThreadState& JobSystem::getState() noexcept {
     return *sThreadState;
 }
 
+JobSystem::Job* JobSystem::getChunk(size_t chunk) noexcept {
+    Job* jobs = mJobChunks[chunk].load(std::memory_order_acquire);
+    if (UTILS_UNLIKELY(!jobs)) {
+        // several threads can race to allocate the chunk, only one wins
+        Job* const allocated = (Job*)aligned_alloc(JOB_CHUNK_SIZE * sizeof(Job), CACHELINE_SIZE);
+        if (mJobChunks[chunk].compare_exchange_strong(jobs, allocated,
+                std::memory_order_acq_rel, std::memory_order_acquire)) {
+            jobs = allocated;
+        } else {
+            aligned_free(allocated);
+        }
+    }
+    return jobs;
+}
+
 JobSystem::Job* JobSystem::allocateJob() noexcept {
+    // recycled jobs first
+    uint32_t head = mFreeJobs.load(std::memory_order_acquire);
+    while (head & 0xFFFFu) {
+        const size_t index = (head & 0xFFFFu) - 1u;
+        // this can read the link of a job that was popped under our feet, in which case the
+        // tag changed and the exchange below fails
+        const uint32_t next = mNextFreeJob[index].load(std::memory_order_relaxed);
+        const uint32_t newHead = ((head + 0x10000u) & 0xFFFF0000u) | next;
+        if (mFreeJobs.compare_exchange_weak(head, newHead,
+                std::memory_order_acquire, std::memory_order_acquire)) {
+            return new(jobAt(index)) Job();
+        }
+    }
+
     size_t index = mNextJobIndex.fetch_add(1, std::memory_order_relaxed);
     if (UTILS_UNLIKELY(index >= MAX_JOB_COUNT)) {
         mNextJobIndex.fetch_sub(1, std::memory_order_relaxed);
         return nullptr;
     }
-    return new(&mJobStorage[index]) Job();
+    Job* const chunk = getChunk(index / JOB_CHUNK_SIZE);
+    if (UTILS_UNLIKELY(!chunk)) {
+        return nullptr;
+    }
+    return new(chunk + (index % JOB_CHUNK_SIZE)) Job();
+}
+
+void JobSystem::recycleJob(Job* job) noexcept {
+    const uint32_t index = uint32_t(indexOf(job));
+    uint32_t head = mFreeJobs.load(std::memory_order_relaxed);
+    uint32_t newHead;
+    do {
+        mNextFreeJob[index].store(uint16_t(head & 0xFFFFu), std::memory_order_relaxed);
+        newHead = ((head + 0x10000u) & 0xFFFF0000u) | (index + 1u);
+    } while (!mFreeJobs.compare_exchange_weak(head, newHead,
+            std::memory_order_release, std::memory_order_relaxed));
 }
 
 inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadState& state) noexcept {
@@ -210,18 +314,29 @@ inline JobSystem::ThreadState& JobSystem::getStateToStealFrom(JobSystem::ThreadS
     return mThreadStates[index];
 }
 
-bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
-
-    Job* job = pop(state.workQueue);
+inline JobSystem::Job* JobSystem::find(JobSystem::ThreadState& state, size_t priority) noexcept {
+    Job* job = pop(state.workQueues[priority]);
     if (job == nullptr) {
         // our queue is empty, try to steal a job
         ThreadState& stateToStealFrom = getStateToStealFrom(state);
         if (&stateToStealFrom != &state) {
             // don't steal from our own queue
-            job = steal(stateToStealFrom.workQueue);
+            job = steal(stateToStealFrom.workQueues[priority]);
             // nullptr -> nothing to steal in that queue either
         }
     }
+    return job;
+}
+
+bool JobSystem::execute(JobSystem::ThreadState& state, bool allowLowPriority) noexcept {
+
+    // low priority jobs are only looked at when we didn't find any other work
+    bool lowPriority = false;
+    Job* job = find(state, HIGH);
+    if (job == nullptr && allowLowPriority) {
+        job = find(state, LOW);
+        lowPriority = true;
+    }
 
     if (job) {
         SYSTRACE_CALL();
@@ -233,7 +348,32 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
 
         if (UTILS_LIKELY(job->function)) {
             SYSTRACE_NAME("job->function");
+#if defined(UTILS_ENABLE_TRACER)
+            const char* const name = mJobNames[indexOf(job)];
+            Tracer::ScopedTrace trace(SYSTRACE_TAG_JOBSYSTEM, name ? name : "job");
+#endif
+            // the scratch is only reset between top-level jobs, so that a job's allocations
+            // stay valid while it runs, even when it waits on other jobs
+            if (!state.jobDepth) {
+                updateScratch(state);
+            }
+            // the jobs this job runs inherit its priority
+            const bool wasLowPriority = state.lowPriority;
+            // background work moves off the CPUs of the frame's jobs, only worker threads are
+            // moved (the adopted threads are the application's)
+            const bool moveThread = lowPriority && !wasLowPriority && mLowPriorityThreadAffinity &&
+                    size_t(&state - mThreadStates.data()) < mThreadCount;
+            if (UTILS_UNLIKELY(moveThread)) {
+                setThreadAffinity(mLowPriorityThreadAffinity);
+            }
+            state.lowPriority = lowPriority;
+            state.jobDepth++;
             job->function(job->padding, *this, job);
+            state.jobDepth--;
+            state.lowPriority = wasLowPriority;
+            if (UTILS_UNLIKELY(moveThread)) {
+                setThreadAffinity(mThreadAffinity ? mThreadAffinity : UINT32_MAX);
+            }
         }
         finish(job);
     }
@@ -243,21 +383,83 @@ bool JobSystem::execute(JobSystem::ThreadState& state) noexcept {
 void JobSystem::loop(ThreadState* threadState) noexcept {
     setThreadName("JobSystem::loop");
     setThreadPriority(Priority::DISPLAY);
+    if (mThreadAffinity) {
+        setThreadAffinity(mThreadAffinity);
+    }
 
     // record our work queue to thread-local storage
     sThreadState = threadState;
 
     // run our main loop...
     do {
-        if (!execute(*threadState)) {
-            std::unique_lock<Mutex> lock(mLock);
-            while (!exitRequested() && !(mActiveJobs.load(std::memory_order_relaxed))) {
-                mCondition.wait(lock);
+        if (!execute(*threadState, true)) {
+            if (!spin(*threadState)) {
+                park();
             }
         }
     } while (!exitRequested());
 }
 
+bool JobSystem::spin(ThreadState& state) noexcept {
+    const uint32_t budget = mSpinBudget.load(std::memory_order_relaxed);
+    if (!budget) {
+        return false;
+    }
+
+    // run() doesn't wake a thread up while another one is spinning
+    const uint32_t spins = std::min(state.spinCount, budget);
+    bool found = false;
+    mSpinningThreads.fetch_add(1, std::memory_order_seq_cst);
+    for (uint32_t i = 0; i < spins; i++) {
+        if (mActiveJobs.load(std::memory_order_relaxed) || exitRequested()) {
+            found = true;
+            break;
+        }
+        UTILS_PAUSE();
+    }
+    mSpinningThreads.fetch_sub(1, std::memory_order_seq_cst);
+
+    // spin the whole budget after finding work, otherwise spin half as long next time, but
+    // never less than a fraction of the budget so we keep finding out whether spinning helps
+    state.spinCount = found ? budget : std::max(spins / 2u, std::max(budget / 8u, 1u));
+
+    if (found && mActiveJobs.load(std::memory_order_relaxed) > 1) {
+        // there is more work than this thread can take, pass the wake-up on
+        wakeOne();
+    }
+    return found;
+}
+
+void JobSystem::park() noexcept {
+    SYSTRACE_CALL();
+
+    std::unique_lock<Mutex> lock(mLock);
+    // mParkedThreads and mActiveJobs are updated in the opposite order by run(), with
+    // sequential consistency at least one of us sees the other's update, so a job can't be
+    // missed.
+    mParkedThreads.fetch_add(1, std::memory_order_seq_cst);
+    while (!exitRequested() && !(mActiveJobs.load(std::memory_order_seq_cst))) {
+        mCondition.wait(lock);
+    }
+    mParkedThreads.fetch_sub(1, std::memory_order_relaxed);
+    lock.unlock();
+
+    if (mActiveJobs.load(std::memory_order_relaxed) > 1) {
+        // there is more work than this thread can take, pass the wake-up on
+        wakeOne();
+    }
+}
+
+void JobSystem::wakeOne() noexcept {
+    // only pay for the lock and the system call when a thread is actually parked
+    if (mParkedThreads.load(std::memory_order_seq_cst)) {
+        // the lock guarantees that a thread that's about to park sees the new job, or is
+        // waiting already and gets the notification
+        { std::lock_guard<Mutex> lock(mLock); }
+        mCondition.notify_one();
+    }
+}
+
 // -----------------------------------------------------------------------------------------------
 // public API...
 
@@ -269,42 +471,83 @@ JobSystem::Job* JobSystem::create(JobSystem::Job* parent, JobFunc func) noexcept
         size_t index = 0x7FFF;
         if (parent) {
             // can't create a child job of a terminated parent
-            assert(parent->runningJobCount.load(std::memory_order_relaxed) > 0);
+            assert(parent->runningJobCount.load(std::memory_order_relaxed) & Job::COUNT_MASK);
             parent->runningJobCount.fetch_add(1, std::memory_order_relaxed);
-            index = parent - &mJobStorage[0];
+            index = indexOf(parent);
             assert(index < MAX_JOB_COUNT);
         }
         job->function = func;
         job->parent = uint16_t(index);
-        job->runningJobCount.store(1, std::memory_order_relaxed);
+#if defined(UTILS_ENABLE_TRACER)
+        mJobNames[indexOf(job)] = parent ? mJobNames[index] : nullptr;
+#endif
+        job->runningJobCount.store(Job::RETAINED | 1u, std::memory_order_relaxed);
     }
     return job;
 }
 
+void JobSystem::setName(UTILS_UNUSED JobSystem::Job* job,
+        UTILS_UNUSED const char* name) noexcept {
+#if defined(UTILS_ENABLE_TRACER)
+    if (job) {
+        mJobNames[indexOf(job)] = name;
+    }
+#endif
+}
+
+void JobSystem::updateScratch(ThreadState& state) noexcept {
+    const uint32_t generation = mScratchGeneration.load(std::memory_order_relaxed);
+    if (UTILS_UNLIKELY(state.scratchGeneration != generation)) {
+        state.scratchGeneration = generation;
+        if (mScratch) {
+            state.scratch.reset();
+        }
+    }
+}
+
+LinearAllocator& JobSystem::getScratch() noexcept {
+    ThreadState& state(getState());
+    if (!state.jobDepth) {
+        // not called from a job
+        updateScratch(state);
+    }
+    return state.scratch;
+}
+
 void JobSystem::reset(JobSystem::Job* job) noexcept {
-    JobSystem::Job* parent = job->parent ? &mJobStorage[job->parent] : mMasterJob;
+    JobSystem::Job* parent = job->parent != 0x7FFF ? jobAt(job->parent) : mMasterJob;
     if (parent) {
-        assert(parent->runningJobCount.load(std::memory_order_relaxed) > 0);
+        assert(parent->runningJobCount.load(std::memory_order_relaxed) & Job::COUNT_MASK);
         parent->runningJobCount.fetch_add(1, std::memory_order_relaxed);
     }
-    job->runningJobCount.store(1, std::memory_order_relaxed);
+    // only a job that's still retained can be reset
+    assert(job->runningJobCount.load(std::memory_order_relaxed) & Job::RETAINED);
+    job->runningJobCount.store(Job::RETAINED | 1u, std::memory_order_relaxed);
 }
 
 void JobSystem::finish(Job* job) noexcept {
     SYSTRACE_CALL();
 
     // terminate this job and notify its parent
-    Job* const storage = mJobStorage;
     do {
         // std::memory_order_release here is needed to synchronize with JobSystem::wait()
         // which needs to "see" all changes that happened before the job terminated.
-        int32_t runningJobCount = job->runningJobCount.fetch_sub(1, std::memory_order_release) - 1;
-        assert(runningJobCount >= 0);
-        if (runningJobCount >= 1) {
+        // std::memory_order_acquire is needed in case we recycle the job.
+        // The job can be recycled by release() as soon as it's finished, so its parent must be
+        // read before.
+        Job* const parent = job->parent == 0x7FFF ? nullptr : jobAt(job->parent);
+        uint32_t runningJobCount = job->runningJobCount.fetch_sub(1, std::memory_order_acq_rel);
+        assert(runningJobCount & Job::COUNT_MASK);
+        runningJobCount -= 1;
+        if (runningJobCount & Job::COUNT_MASK) {
             // there is still work (e.g.: children), we're done.
             break;
         }
-        job = job->parent == 0x7FFF ? nullptr : &storage[job->parent];
+        if (!(runningJobCount & Job::RETAINED)) {
+            // nobody refers to this job anymore
+            recycleJob(job);
+        }
+        job = parent;
     } while (job);
 
 #if __ARM_ARCH_7A__
@@ -324,31 +567,46 @@ void JobSystem::run(JobSystem::Job* job, uint32_t flags) noexcept {
     // increase the active job count before we add the job to the queue, because otherwise
     // the job could run and finish before the counter is incremented, which would trigger
     // an assert() in execute(). Either way, it's not "wrong", but the assert() is useful.
-    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_relaxed);
+    // this needs sequential consistency with the parking of the worker threads, see park().
+    uint32_t activeJobs = mActiveJobs.fetch_add(1, std::memory_order_seq_cst);
 
-    put(state.workQueue, job);
+    const bool lowPriority = (flags & LOW_PRIORITY) || state.lowPriority;
+    put(state.workQueues[lowPriority ? LOW : HIGH], job);
 
     SYSTRACE_CONTEXT();
     SYSTRACE_VALUE32("JobSystem::activeJobs", activeJobs + 1);
 
     // wake-up a thread if needed...
     if (!(flags & DONT_SIGNAL)) {
-        // if it was busy before, try to wake-up another sleeping thread
-        if (activeJobs) {
-            // wake-up a queue
-            { std::lock_guard<Mutex> lock(mLock); }
-            mCondition.notify_one();
+        // if it was busy before, try to wake-up one other sleeping thread for this job, unless
+        // a thread is spinning, it will find the job (and wake-up another one if needed).
+        if (activeJobs && !mSpinningThreads.load(std::memory_order_seq_cst)) {
+            wakeOne();
         }
     }
 }
 
+void JobSystem::release(JobSystem::Job* job) noexcept {
+    assert(job);
+    uint32_t runningJobCount = job->runningJobCount.fetch_and(
+            uint16_t(~Job::RETAINED), std::memory_order_acq_rel);
+    assert(runningJobCount & Job::RETAINED);
+    if (!(runningJobCount & Job::COUNT_MASK)) {
+        // the job is already finished
+        recycleJob(job);
+    }
+}
+
 void JobSystem::wait(JobSystem::Job const* job) noexcept {
     SYSTRACE_CALL();
 
     assert(job);
     ThreadState& state(getState());
+    // a waiter could be stuck in a long background job, so it only helps with those if it's
+    // itself doing background work or if nobody else can run them.
+    const bool allowLowPriority = state.lowPriority || !mThreadCount;
     do {
-        if (!execute(state)) {
+        if (!execute(state, allowLowPriority)) {
             // we're a waiter so we spin!!!
             UTILS_WAIT_FOR_EVENT();
         }
@@ -396,12 +654,14 @@ void JobSystem::reset() noexcept {
     assert(!mActiveJobs.load(std::memory_order_relaxed));
     mJobWaterMark = std::max(mJobWaterMark, (size_t)mNextJobIndex.load(std::memory_order_relaxed));
     mNextJobIndex.store(0, std::memory_order_relaxed);
+    mFreeJobs.store(0, std::memory_order_relaxed);
     mMasterJob = nullptr;
 }
 
 io::ostream& operator<<(io::ostream& out, JobSystem const& js) {
     for (auto const& item : js.mThreadStates) {
-        out << size_t(std::log2f(item.mask)) << ": " << item.workQueue.getCount() << io::endl;
+        out << size_t(std::log2f(item.mask)) << ": " << item.workQueues[JobSystem::HIGH].getCount()
+            << " (" << item.workQueues[JobSystem::LOW].getCount() << " low priority)" << io::endl;
     }
     return out;
 }
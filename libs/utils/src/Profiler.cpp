@@ -15,6 +15,7 @@
  */
 
 #include <utils/Profiler.h>
+#include <utils/ThreadLocal.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -57,6 +58,16 @@ Profiler& Profiler::get() noexcept {
     return sProfiler;
 }
 
+Profiler& Profiler::getForCurrentThread() noexcept {
+    using Pointer = std::unique_ptr<Profiler, Deleter>;
+    static UTILS_DECLARE_TLS(Pointer) sProfiler;
+    Pointer& profiler = sProfiler;
+    if (UTILS_UNLIKELY(!profiler)) {
+        profiler.reset(new Profiler());
+    }
+    return *profiler;
+}
+
 Profiler::Profiler() noexcept {
     std::uninitialized_fill(std::begin(mCountersFd), std::end(mCountersFd), -1);
     Profiler::resetEvents(EV_CPU_CYCLES | EV_L1D_RATES | EV_BPU_RATES);
@@ -16,7 +16,7 @@
 
 #include <utils/Systrace.h>
 
-#if defined(ANDROID)
+#if defined(ANDROID) && !defined(UTILS_ENABLE_TRACER)
 
 #include <cinttypes>
 
@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <utils/Tracer.h>
+
+#include "TracerPlatform.h"
+
+#include <utils/ThreadLocal.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace utils {
+
+namespace {
+
+using clock = std::chrono::steady_clock;
+
+struct Event {
+    const char* name;
+    int64_t time;       // in nanoseconds, since sEpoch
+    int64_t value;      // counter value or async cookie
+    uint8_t type;
+};
+
+// Written by its thread only. The events in [head - CAPACITY, head) are valid, unless they were
+// cleared.
+struct Buffer {
+    std::atomic<uint64_t> head = { 0 };
+    std::atomic<uint64_t> tail = { 0 };
+    std::atomic<const char*> threadName = { nullptr };
+    uint32_t tid = 0;
+    Buffer* next = nullptr;
+    Event events[Tracer::CAPACITY];
+};
+
+static_assert(!(Tracer::CAPACITY & (Tracer::CAPACITY - 1)), "CAPACITY must be a power of two");
+
+const clock::time_point sEpoch = clock::now();
+
+// buffers are kept when their thread exits, so their events can still be dumped
+std::atomic<Buffer*> sBuffers = { nullptr };
+std::atomic<uint32_t> sThreadCount = { 0 };
+UTILS_DEFINE_TLS(Buffer*) sBuffer(nullptr);
+
+Buffer* getBuffer() noexcept {
+    Buffer* buffer = sBuffer;
+    if (UTILS_UNLIKELY(!buffer)) {
+        buffer = new Buffer;
+        buffer->tid = sThreadCount.fetch_add(1, std::memory_order_relaxed) + 1;
+        Buffer* head = sBuffers.load(std::memory_order_relaxed);
+        do {
+            buffer->next = head;
+        } while (!sBuffers.compare_exchange_weak(head, buffer,
+                std::memory_order_release, std::memory_order_relaxed));
+        sBuffer = buffer;
+    }
+    return buffer;
+}
+
+void writeString(std::ostream& out, const char* s) {
+    out << '"';
+    for (; s && *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            out << '\\';
+        }
+        if (uint8_t(*s) >= 0x20) {
+            out << *s;
+        }
+    }
+    out << '"';
+}
+
+Tracer::Backend getInitialBackend() noexcept {
+    const char* const backend = getenv("UTILS_TRACER_BACKEND");
+    if (backend && !strcmp(backend, "platform") && tracer::isAvailable()) {
+        return Tracer::Backend::PLATFORM;
+    }
+    return Tracer::Backend::RING_BUFFER;
+}
+
+} // anonymous namespace
+
+std::atomic<uint32_t> Tracer::sEnabledTags = { 0 };
+std::atomic<Tracer::Backend> Tracer::sBackend = { getInitialBackend() };
+
+bool Tracer::setBackend(Backend backend) noexcept {
+    if (backend == Backend::PLATFORM && !tracer::isAvailable()) {
+        return false;
+    }
+    sBackend.store(backend, std::memory_order_relaxed);
+    return true;
+}
+
+void Tracer::enable(uint32_t tags) noexcept {
+    sEnabledTags.fetch_or(tags, std::memory_order_relaxed);
+}
+
+void Tracer::disable(uint32_t tags) noexcept {
+    sEnabledTags.fetch_and(~tags, std::memory_order_relaxed);
+}
+
+void Tracer::record(Type type, const char* name, int64_t value) noexcept {
+    if (UTILS_UNLIKELY(getBackend() == Backend::PLATFORM)) {
+        recordPlatform(type, name, value);
+        return;
+    }
+    Buffer* const buffer = getBuffer();
+    const uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    Event& e = buffer->events[head & (CAPACITY - 1)];
+    e.name = name;
+    e.time = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - sEpoch).count();
+    e.value = value;
+    e.type = type;
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+UTILS_NOINLINE
+void Tracer::recordPlatform(Type type, const char* name, int64_t value) noexcept {
+    switch (type) {
+        case BEGIN:         tracer::begin(name);                break;
+        case END:           tracer::end();                      break;
+        case ASYNC_BEGIN:   tracer::asyncBegin(name, value);    break;
+        case ASYNC_END:     tracer::asyncEnd(name, value);      break;
+        case COUNTER:       tracer::value(name, value);         break;
+    }
+}
+
+void Tracer::setThreadName(const char* name) noexcept {
+    getBuffer()->threadName.store(name, std::memory_order_relaxed);
+}
+
+void Tracer::clear() noexcept {
+    for (Buffer* b = sBuffers.load(std::memory_order_acquire); b; b = b->next) {
+        b->tail.store(b->head.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+void Tracer::dump(std::ostream& out) noexcept {
+    static constexpr const char PHASES[] = { 'B', 'E', 'b', 'e', 'C' };
+    bool first = true;
+    auto writeEvent = [&out, &first](uint32_t tid, Event const& e) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"ph\":\"" << PHASES[e.type] << "\",\"pid\":1,\"tid\":" << tid
+            << ",\"ts\":" << e.time / 1000 << '.'
+            << char('0' + (e.time / 100) % 10) << char('0' + (e.time / 10) % 10)
+            << char('0' + e.time % 10);
+        if (e.name) {
+            out << ",\"name\":";
+            writeString(out, e.name);
+        }
+        if (e.type == ASYNC_BEGIN || e.type == ASYNC_END) {
+            out << ",\"cat\":\"async\",\"id\":" << e.value;
+        } else if (e.type == COUNTER) {
+            out << ",\"args\":{\"value\":" << e.value << "}";
+        }
+        out << "}";
+    };
+
+    std::vector<Event> events;
+    out << "{\"traceEvents\":[";
+    for (Buffer* b = sBuffers.load(std::memory_order_acquire); b; b = b->next) {
+        const char* const threadName = b->threadName.load(std::memory_order_relaxed);
+        if (threadName) {
+            out << (first ? "\n" : ",\n");
+            first = false;
+            out << "{\"ph\":\"M\",\"pid\":1,\"tid\":" << b->tid
+                << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+            writeString(out, threadName);
+            out << "}}";
+        }
+
+        const uint64_t tail = b->tail.load(std::memory_order_relaxed);
+        uint64_t head = b->head.load(std::memory_order_acquire);
+        uint64_t begin = std::max(tail, head > CAPACITY ? head - CAPACITY : 0);
+        events.clear();
+        for (uint64_t i = begin; i < head; i++) {
+            events.push_back(b->events[i & (CAPACITY - 1)]);
+        }
+
+        // drop the events that were overwritten while we were copying them
+        head = b->head.load(std::memory_order_acquire);
+        const uint64_t overwritten = head > CAPACITY ? head - CAPACITY : 0;
+        const size_t skip = size_t(std::min(uint64_t(events.size()),
+                overwritten > begin ? overwritten - begin : 0));
+
+        // the beginning of the first events might be lost, we skip their ends
+        size_t depth = 0;
+        for (size_t i = skip, c = events.size(); i < c; i++) {
+            Event const& e = events[i];
+            if (e.type == END) {
+                if (!depth) {
+                    continue;
+                }
+                depth--;
+            } else if (e.type == BEGIN) {
+                depth++;
+            }
+            writeEvent(b->tid, e);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    out.flush();
+}
+
+bool Tracer::dump(const char* path) noexcept {
+    std::ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    dump(out);
+    return bool(out);
+}
+
+} // namespace utils
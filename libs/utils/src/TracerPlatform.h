@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_UTILS_TRACERPLATFORM_H
+#define TNT_UTILS_TRACERPLATFORM_H
+
+#include <stdint.h>
+
+namespace utils {
+namespace tracer {
+
+/*
+ * The tracing facility of the platform, used by Tracer::Backend::PLATFORM. There is one
+ * implementation per platform: linux/TracerPlatform.cpp (ftrace), darwin/TracerPlatform.cpp
+ * (os_signpost) and win32/TracerPlatform.cpp (ETW).
+ *
+ * These are only called while tracing is enabled, they're not meant to be inlined.
+ */
+
+// whether the platform's tracer can be used, this is checked once
+bool isAvailable() noexcept;
+
+void begin(const char* name) noexcept;
+void end() noexcept;
+void asyncBegin(const char* name, int64_t cookie) noexcept;
+void asyncEnd(const char* name, int64_t cookie) noexcept;
+void value(const char* name, int64_t value) noexcept;
+
+} // namespace tracer
+} // namespace utils
+
+#endif // TNT_UTILS_TRACERPLATFORM_H
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../TracerPlatform.h"
+
+#include <utils/ThreadLocal.h>
+
+#include <os/log.h>
+#include <os/signpost.h>
+
+/*
+ * The events are os_signposts of the "com.google.filament" subsystem, in the "Points of Interest"
+ * category, they show up in Instruments. os_signpost's names must be string literals, so each
+ * event is "Filament" and its actual name is the argument of the signpost.
+ */
+
+namespace utils {
+namespace tracer {
+
+namespace {
+
+// the deepest nesting of scopes for which an interval is emitted, the ones below are ignored
+static constexpr size_t MAX_DEPTH = 64;
+
+struct Nesting {
+    os_signpost_id_t ids[MAX_DEPTH];
+    size_t depth;
+};
+
+UTILS_DEFINE_TLS(Nesting) sNesting;
+
+os_log_t getLog() noexcept {
+    static os_log_t const log = os_log_create("com.google.filament",
+            OS_LOG_CATEGORY_POINTS_OF_INTEREST);
+    return log;
+}
+
+} // anonymous namespace
+
+bool isAvailable() noexcept {
+    if (__builtin_available(macOS 10.14, iOS 12.0, tvOS 12.0, *)) {
+        return getLog() != nullptr;
+    }
+    return false;
+}
+
+// the availability is checked by Tracer::setBackend(), before any of these is called
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunguarded-availability"
+
+void begin(const char* name) noexcept {
+    Nesting& nesting = sNesting;
+    const size_t depth = nesting.depth++;
+    if (depth < MAX_DEPTH) {
+        os_log_t const log = getLog();
+        const os_signpost_id_t id = os_signpost_id_generate(log);
+        nesting.ids[depth] = id;
+        os_signpost_interval_begin(log, id, "Filament", "%{public}s", name);
+    }
+}
+
+void end() noexcept {
+    Nesting& nesting = sNesting;
+    if (nesting.depth == 0) {
+        // the scope began before the backend was selected
+        return;
+    }
+    const size_t depth = --nesting.depth;
+    if (depth < MAX_DEPTH) {
+        os_signpost_interval_end(getLog(), nesting.ids[depth], "Filament");
+    }
+}
+
+void asyncBegin(const char* name, int64_t cookie) noexcept {
+    // an id can't be OS_SIGNPOST_ID_NULL (0) or OS_SIGNPOST_ID_INVALID (~0)
+    const os_signpost_id_t id = os_signpost_id_t(cookie) + 1;
+    os_signpost_interval_begin(getLog(), id, "Filament (async)", "%{public}s", name);
+}
+
+void asyncEnd(const char* name, int64_t cookie) noexcept {
+    const os_signpost_id_t id = os_signpost_id_t(cookie) + 1;
+    os_signpost_interval_end(getLog(), id, "Filament (async)", "%{public}s", name);
+}
+
+void value(const char* name, int64_t value) noexcept {
+    os_signpost_event_emit(getLog(), OS_SIGNPOST_ID_EXCLUSIVE, "Filament (counter)",
+            "%{public}s %lld", name, (long long)value);
+}
+
+#pragma clang diagnostic pop
+
+} // namespace tracer
+} // namespace utils
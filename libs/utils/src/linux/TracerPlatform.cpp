@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../TracerPlatform.h"
+
+#include <algorithm>
+#include <cinttypes>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * The events are written to ftrace's marker file, in the format of atrace. They show up in
+ * systrace, in Perfetto traces recording the "ftrace/print" events (or the "linux.ftrace" data
+ * source with atrace categories on Android), and in trace-cmd.
+ */
+
+namespace utils {
+namespace tracer {
+
+// same as atrace's, this includes the type, the pid and the name
+static constexpr size_t MESSAGE_LENGTH = 512;
+
+namespace {
+
+struct Marker {
+    int fd = -1;
+    int pid = 0;
+    Marker() noexcept {
+        // tracefs is usually mounted at /sys/kernel/tracing on recent kernels
+        fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        }
+        pid = getpid();
+    }
+    ~Marker() noexcept {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+};
+
+Marker const& getMarker() noexcept {
+    static const Marker marker;
+    return marker;
+}
+
+template<typename ... ARGS>
+void write(const char* format, ARGS ... args) noexcept {
+    Marker const& marker = getMarker();
+    char buffer[MESSAGE_LENGTH];
+    const int length = snprintf(buffer, sizeof(buffer), format, marker.pid, args...);
+    if (length > 0) {
+        // a truncated message is still written, rather than lost
+        ::write(marker.fd, buffer, std::min(size_t(length), sizeof(buffer) - 1));
+    }
+}
+
+} // anonymous namespace
+
+bool isAvailable() noexcept {
+    return getMarker().fd >= 0;
+}
+
+void begin(const char* name) noexcept {
+    write("B|%d|%s", name);
+}
+
+void end() noexcept {
+    write("E|%d");
+}
+
+void asyncBegin(const char* name, int64_t cookie) noexcept {
+    write("S|%d|%s|%" PRId64, name, cookie);
+}
+
+void asyncEnd(const char* name, int64_t cookie) noexcept {
+    write("F|%d|%s|%" PRId64, name, cookie);
+}
+
+void value(const char* name, int64_t value) noexcept {
+    write("C|%d|%s|%" PRId64, name, value);
+}
+
+} // namespace tracer
+} // namespace utils
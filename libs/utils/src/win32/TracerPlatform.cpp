@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../TracerPlatform.h"
+
+#include <mutex>
+
+#include <windows.h>
+#include <TraceLoggingProvider.h>
+
+/*
+ * The events are written to the ETW TraceLogging provider "Filament" (with the GUID below),
+ * they're recorded with a WPR profile or tracelog that enables this provider, and show up in Windows Performance Analyzer as "Generic Events", where the start/stop opcodes
+ * pair the scopes into regions.
+ */
+
+// {5a9d7b8e-3f0c-4c8e-9a3d-6f1b2e8c4d71}
+TRACELOGGING_DEFINE_PROVIDER(gFilamentProvider, "Filament",
+        (0x5a9d7b8e, 0x3f0c, 0x4c8e, 0x9a, 0x3d, 0x6f, 0x1b, 0x2e, 0x8c, 0x4d, 0x71));
+
+namespace utils {
+namespace tracer {
+
+bool isAvailable() noexcept {
+    static std::once_flag once;
+    static bool registered = false;
+    std::call_once(once, []() {
+        registered = SUCCEEDED(TraceLoggingRegister(gFilamentProvider));
+    });
+    return registered;
+}
+
+void begin(const char* name) noexcept {
+    TraceLoggingWrite(gFilamentProvider, "Scope",
+            TraceLoggingOpcode(WINEVENT_OPCODE_START),
+            TraceLoggingString(name, "Name"));
+}
+
+void end() noexcept {
+    TraceLoggingWrite(gFilamentProvider, "Scope",
+            TraceLoggingOpcode(WINEVENT_OPCODE_STOP));
+}
+
+void asyncBegin(const char* name, int64_t cookie) noexcept {
+    TraceLoggingWrite(gFilamentProvider, "Async",
+            TraceLoggingOpcode(WINEVENT_OPCODE_START),
+            TraceLoggingString(name, "Name"),
+            TraceLoggingInt64(cookie, "Cookie"));
+}
+
+void asyncEnd(const char* name, int64_t cookie) noexcept {
+    TraceLoggingWrite(gFilamentProvider, "Async",
+            TraceLoggingOpcode(WINEVENT_OPCODE_STOP),
+            TraceLoggingString(name, "Name"),
+            TraceLoggingInt64(cookie, "Cookie"));
+}
+
+void value(const char* name, int64_t value) noexcept {
+    TraceLoggingWrite(gFilamentProvider, "Counter",
+            TraceLoggingString(name, "Name"),
+            TraceLoggingInt64(value, "Value"));
+}
+
+} // namespace tracer
+} // namespace utils
@@ -16,7 +16,12 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+#include <chrono>
+#include <iostream>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include "../src/EntityManagerImpl.h"
 #include <utils/NameComponentManager.h>
@@ -97,6 +102,23 @@ TEST(EntityTest, Free) {
     EXPECT_EQ(EntityManagerImpl::makeIdentity(1, 1), e.getId());
 }
 
+TEST(EntityTest, Version) {
+    EntityManagerImpl em;
+    Entity entities[4];
+
+    // creating entities doesn't invalidate anything
+    uint32_t version = em.getVersion();
+    em.create(4, entities);
+    EXPECT_EQ(version, em.getVersion());
+
+    em.destroy(2, entities);
+    EXPECT_NE(version, em.getVersion());
+
+    version = em.getVersion();
+    em.clear();
+    EXPECT_NE(version, em.getVersion());
+}
+
 TEST(EntityTest, Lots) {
     EntityManagerImpl em;
     std::unique_ptr<Entity[]> entities(new Entity[EntityManager::getMaxEntityCount()]);
@@ -129,6 +151,50 @@ TEST(EntityTest, Lots) {
 }
 
 
+TEST(EntityTest, Contention) {
+    // several threads create and destroy entities concurrently, in small batches
+    constexpr size_t THREAD_COUNT = 4;
+    constexpr size_t ITERATION_COUNT = 20000;
+    constexpr size_t BATCH_SIZE = 16;
+
+    EntityManagerImpl em;
+    std::atomic<size_t> failures = { 0 };
+    std::vector<std::thread> threads;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t t = 0; t < THREAD_COUNT; t++) {
+        threads.emplace_back([&em, &failures]() {
+            Entity entities[BATCH_SIZE];
+            for (size_t i = 0; i < ITERATION_COUNT; i++) {
+                em.create(BATCH_SIZE, entities);
+                for (Entity e : entities) {
+                    failures += !em.isAlive(e);
+                }
+                em.destroy(BATCH_SIZE, entities);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+    EXPECT_EQ(0, failures.load());
+    std::cout << "created and destroyed "
+              << THREAD_COUNT * ITERATION_COUNT * BATCH_SIZE / duration.count() / 1e6
+              << " M entities/s with " << THREAD_COUNT << " threads" << std::endl;
+
+    // all the indices were recycled, none was lost
+    std::unique_ptr<Entity[]> entities(new Entity[EntityManager::getMaxEntityCount()]);
+    em.create(EntityManager::getMaxEntityCount(), entities.get());
+    tsl::robin_set<uint32_t> ids;
+    for (size_t i = 0; i < EntityManager::getMaxEntityCount(); i++) {
+        EXPECT_TRUE(em.isAlive(entities[i]));
+        ids.insert(EntityManagerImpl::getIndex(entities[i]));
+    }
+    EXPECT_EQ(EntityManager::getMaxEntityCount(), ids.size());
+    EXPECT_TRUE(em.create().isNull());
+}
+
 TEST(EntityTest, NameComponent) {
 
     EntityManagerImpl em;
@@ -176,3 +242,102 @@ TEST(EntityTest, NameComponent) {
 
     cm.gc(em);
 }
+
+TEST(EntityTest, DenseInstanceMap) {
+    using Base = SingleInstanceComponentManager<uint32_t>;
+    struct Manager : public Base {
+        explicit Manager(InstanceMap mode) noexcept : Base(mode) { }
+        using Base::gc;
+        void set(Instance i, uint32_t v) noexcept { elementAt<0>(i) = v; }
+        uint32_t get(Instance i) const noexcept { return elementAt<0>(i); }
+    };
+
+    EntityManagerImpl em;
+    Manager hashed(Manager::InstanceMap::HASHED);
+    Manager dense(Manager::InstanceMap::DENSE);
+
+    // enough entities for some of their indices to be recycled below
+    const size_t count = 4096;
+    std::vector<Entity> a(count);
+    std::vector<Entity> b(count);
+    em.create(count, a.data());
+    for (size_t i = 0; i < count; i++) {
+        hashed.set(hashed.addComponent(a[i]), uint32_t(i));
+        dense.set(dense.addComponent(a[i]), uint32_t(i));
+    }
+
+    // the components of the destroyed entities are still there until they're gc'ed
+    em.destroy(count, a.data());
+    em.create(count, b.data());
+    for (size_t i = 0; i < count; i += 2) {
+        hashed.set(hashed.addComponent(b[i]), uint32_t(count + i));
+        dense.set(dense.addComponent(b[i]), uint32_t(count + i));
+    }
+    dense.removeComponent(a[1]);
+    hashed.removeComponent(a[1]);
+
+    EXPECT_EQ(hashed.getComponentCount(), dense.getComponentCount());
+    for (Entity const* e : { a.data(), b.data() }) {
+        std::vector<Manager::Instance> instances(count);
+        dense.getInstances(e, count, instances.data());
+        for (size_t i = 0; i < count; i++) {
+            auto hi = hashed.getInstance(e[i]);
+            auto di = dense.getInstance(e[i]);
+            EXPECT_EQ(di, instances[i]);
+            EXPECT_EQ(bool(hi), bool(di));
+            if (hi && di) {
+                EXPECT_EQ(hashed.get(hi), dense.get(di));
+            }
+        }
+    }
+    EXPECT_FALSE(dense.hasComponent(a[1]));
+    EXPECT_FALSE(dense.hasComponent(b[1]));
+    EXPECT_EQ(count, dense.get(dense.getInstance(b[0])));
+
+    // collect all the components of a[]
+    while (dense.getComponentCount() > count / 2) {
+        dense.gc(em);
+    }
+    EXPECT_EQ(count / 2, dense.getComponentCount());
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_FALSE(dense.hasComponent(a[i]));
+        EXPECT_EQ(!(i & 1), dense.hasComponent(b[i]));
+        if (!(i & 1)) {
+            EXPECT_EQ(count + i, dense.get(dense.getInstance(b[i])));
+        }
+    }
+
+    em.destroy(count, b.data());
+}
+
+TEST(EntityTest, IncrementalGc) {
+    using Base = SingleInstanceComponentManager<uint32_t>;
+    struct Manager : public Base {
+        size_t gc(const EntityManager& em, size_t maxCount) noexcept {
+            return Base::gc(em, 4, [this](Entity e) { removeComponent(e); }, maxCount);
+        }
+    };
+
+    EntityManagerImpl em;
+    Manager cm;
+
+    const size_t count = 1024;
+    std::vector<Entity> entities(count);
+    em.create(count, entities.data());
+    for (Entity e : entities) {
+        cm.addComponent(e);
+    }
+    em.destroy(count, entities.data());
+
+    // each round of gc frees at most maxCount components
+    size_t freed = 0;
+    while (cm.getComponentCount()) {
+        const size_t n = cm.gc(em, 100);
+        EXPECT_LE(n, 100);
+        EXPECT_GT(n, 0);
+        EXPECT_EQ(count - freed - n, cm.getComponentCount());
+        freed += n;
+    }
+    EXPECT_EQ(count, freed);
+    EXPECT_EQ(0, cm.gc(em, 100));
+}
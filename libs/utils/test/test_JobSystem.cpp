@@ -23,9 +23,17 @@
 #include <math/mat3.h>
 
 #include <array>
+#include <chrono>
+#include <iostream>
+#include <limits>
 #include <thread>
+#include <vector>
 #include <utils/Allocator.h>
 
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 using namespace utils;
 using namespace jobs;
 
@@ -219,6 +227,59 @@ TEST(JobSystem, JobSystemParallelChildren) {
 }
 
 
+TEST(JobSystem, JobSystemLowPriorityChildren) {
+    JobSystem js;
+    js.adopt();
+
+    struct User {
+        std::atomic_int calls = {0};
+        bool spawn;
+        void func(JobSystem& js, JobSystem::Job* job) {
+            calls++;
+            if (spawn) {
+                // this job inherits our priority, and we can wait for it
+                JobSystem::Job* p = js.createJob(job,
+                        [this](JobSystem&, JobSystem::Job*) { calls++; });
+                js.runAndWait(p);
+            }
+        };
+    } high{ {0}, false }, low{ {0}, true };
+
+    JobSystem::Job* root = js.createJob();
+    for (int i=0 ; i<64 ; i++) {
+        js.run(js.createJob<User, &User::func>(root, &low), JobSystem::LOW_PRIORITY);
+        js.run(js.createJob<User, &User::func>(root, &high));
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(64, high.calls);
+    EXPECT_EQ(128, low.calls);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemReleasedJobsAreRecycled) {
+    JobSystem js;
+    js.adopt();
+
+    std::atomic_int calls = {0};
+    for (int i=0 ; i<64 ; i++) {
+        JobSystem::Job* root = js.createJob();
+        for (int j=0 ; j<1000 ; j++) {
+            js.runAndRelease(js.createJob(root,
+                    [&calls](JobSystem&, JobSystem::Job*) { calls++; }));
+        }
+        js.runAndWait(root);
+        js.release(root);
+    }
+
+    // far more jobs than the job system can hold ran without a reset()
+    EXPECT_EQ(64000, calls.load());
+    EXPECT_LE(js.getJobWatermark(), 1001u);
+
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemSequentialChildren) {
     JobSystem js;
     js.adopt();
@@ -283,6 +344,70 @@ TEST(JobSystem, JobSystemParallelFor) {
     js.emancipate();
 }
 
+TEST(JobSystem, JobSystemParallelForAdaptive) {
+    JobSystem js;
+    js.adopt();
+
+    std::vector<uint32_t> visits(4096 * 16);
+    AdaptiveSplitter::Cost cost(100.0f);
+
+    // run a few times, so the cost estimate gets updated along the way
+    for (size_t k = 0; k < 4; k++) {
+        JobSystem::Job* job = parallel_for(js, nullptr, 0, uint32_t(visits.size()),
+                [&visits](uint32_t start, uint32_t count) {
+                    for (uint32_t i = start; i < start + count; i++) {
+                        visits[i]++;
+                    }
+                }, AdaptiveSplitter(cost));
+        js.runAndWait(job);
+    }
+
+    for (size_t i = 0; i < visits.size(); i++) {
+        EXPECT_EQ(4u, visits[i]);
+    }
+    EXPECT_GT(cost.getItemDuration(), 0.0f);
+
+    js.emancipate();
+}
+
+TEST(JobSystem, JobSystemScratch) {
+    JobSystem js(2, 1, 4096);
+    js.adopt();
+
+    // each job's allocation must not overlap with the others'
+    uint32_t* values[64] = {};
+    JobSystem::Job* root = js.createJob();
+    for (uint32_t i = 0; i < 64; i++) {
+        js.run(js.createJob(root, [&values, i](JobSystem& js, JobSystem::Job*) {
+            uint32_t* const p = (uint32_t*)js.getScratch().alloc(32);
+            if (p) {
+                std::fill_n(p, 8, i);
+            }
+            values[i] = p;
+        }));
+    }
+    js.runAndWait(root);
+    for (uint32_t i = 0; i < 64; i++) {
+        ASSERT_NE(nullptr, values[i]);
+        EXPECT_EQ(i, values[i][0]);
+        EXPECT_EQ(i, values[i][7]);
+    }
+
+    // the allocations fail when the scratch is exhausted
+    EXPECT_EQ(nullptr, js.getScratch().alloc(8192));
+
+    // and they're freed by resetScratch()
+    js.resetScratch();
+    void* const p = js.getScratch().alloc(16);
+    EXPECT_NE(nullptr, p);
+    EXPECT_NE(p, js.getScratch().alloc(16));
+    js.resetScratch();
+    EXPECT_EQ(p, js.getScratch().alloc(16));
+
+    js.reset();
+    js.emancipate();
+}
+
 TEST(JobSystem, JobSystemDelegates) {
     JobSystem js;
     js.adopt();
@@ -343,3 +468,115 @@ TEST(JobSystem, JobSystemDelegates) {
 
     js.emancipate();
 }
+
+TEST(JobSystem, JobSystemShared) {
+    // one JobSystem for several client threads (e.g. engines), with its workers on one CPU
+    JobSystem js(2, 2, JobSystem::SCRATCH_SIZE, 0x1);
+
+    std::atomic<uint32_t> count = { 0 };
+    auto client = [&js, &count]() {
+        js.adopt();
+        JobSystem::Job* root = js.createJob();
+        for (uint32_t i = 0; i < 32; i++) {
+            js.run(js.createJob(root, [&count](JobSystem&, JobSystem::Job*) {
+                count.fetch_add(1, std::memory_order_relaxed);
+            }));
+        }
+        js.runAndWait(root);
+        js.emancipate();
+    };
+    std::thread first(client);
+    std::thread second(client);
+    first.join();
+    second.join();
+
+    EXPECT_EQ(64u, count.load());
+}
+
+TEST(JobSystem, JobSystemSpinBudget) {
+    // Measures how long the jobs take to start on the worker threads after they've gone idle,
+    // when they park right away and when they spin first.
+    using clock = std::chrono::steady_clock;
+    constexpr size_t ROUND_COUNT = 100;
+    constexpr size_t JOB_COUNT = 4;
+    constexpr clock::rep NEVER = std::numeric_limits<clock::rep>::max();
+
+    for (uint32_t budget : { 0u, JobSystem::DEFAULT_SPIN_BUDGET }) {
+        JobSystem js(2, 1);
+        js.setSpinBudget(budget);
+        EXPECT_EQ(budget, js.getSpinBudget());
+        js.adopt();
+
+        const std::thread::id self = std::this_thread::get_id();
+        std::atomic_int calls = {0};
+        double latency = 0;
+        size_t samples = 0;
+        for (size_t r = 0; r < ROUND_COUNT; r++) {
+            // let the workers go idle
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+            std::atomic<clock::rep> firstStart = { NEVER };
+            const clock::time_point start = clock::now();
+            JobSystem::Job* root = js.createJob();
+            for (size_t i = 0; i < JOB_COUNT; i++) {
+                js.run(js.createJob(root, [&](JobSystem&, JobSystem::Job*) {
+                    if (std::this_thread::get_id() != self) {
+                        clock::rep now = clock::now().time_since_epoch().count();
+                        clock::rep first = firstStart.load();
+                        while (now < first && !firstStart.compare_exchange_weak(first, now)) { }
+                    }
+                    // enough work for the workers to get a share
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    calls++;
+                }));
+            }
+            js.runAndWait(root);
+
+            const clock::rep first = firstStart.load();
+            if (first != NEVER) {
+                std::chrono::duration<double, std::micro> d =
+                        clock::time_point(clock::duration(first)) - start;
+                latency += d.count();
+                samples++;
+            }
+        }
+
+        EXPECT_EQ(int(ROUND_COUNT * JOB_COUNT), calls.load());
+        if (samples) {
+            std::cout << "spin budget " << budget << ": jobs start on the workers after "
+                      << latency / samples << " us" << std::endl;
+        }
+
+        js.emancipate();
+    }
+}
+
+#if defined(__linux__)
+TEST(JobSystem, JobSystemLowPriorityAffinity) {
+    // the workers move to CPU 0 while they run LOW_PRIORITY jobs
+    JobSystem js(2, 1);
+    js.setLowPriorityThreadAffinity(0x1);
+    js.adopt();
+
+    std::atomic_int pinned = {0};
+    std::atomic_int calls = {0};
+    JobSystem::Job* root = js.createJob();
+    for (int i = 0; i < 16; i++) {
+        js.run(js.createJob(root, [&pinned, &calls](JobSystem&, JobSystem::Job*) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (sched_getaffinity(0, sizeof(set), &set) == 0 &&
+                    CPU_COUNT(&set) == 1 && CPU_ISSET(0, &set)) {
+                pinned++;
+            }
+            calls++;
+        }), JobSystem::LOW_PRIORITY);
+    }
+    js.runAndWait(root);
+
+    EXPECT_EQ(16, calls);
+    EXPECT_EQ(16, pinned);
+
+    js.emancipate();
+}
+#endif
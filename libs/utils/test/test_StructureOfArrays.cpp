@@ -16,6 +16,9 @@
 
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <vector>
+
 #include <utils/StructureOfArrays.h>
 #include <math/vec4.h>
 
@@ -170,3 +173,50 @@ TEST(StructureOfArraysTest, Simple) {
     soa.push_back(0.0f, 1.0, std::move(destroyedFloat4));
 }
 
+
+TEST(StructureOfArraysTest, PartitionGatherScatter) {
+    SoA soa;
+    const size_t count = 37;
+    soa.resize(count);
+    uint8_t buckets[count];
+    for (size_t i = 0; i < count; i++) {
+        buckets[i] = uint8_t((i * 7) % 3);
+        soa.elementAt<0>(i) = i;
+        soa.elementAt<1>(i) = i * 2;
+        soa.elementAt<2>(i) = TestFloat4(i * 4);
+    }
+
+    uint32_t order[count];
+    uint32_t ends[3];
+    SoA::computePartitionOrder<3>(buckets, count, order, ends);
+    EXPECT_EQ(count, ends[2]);
+
+    std::vector<uint8_t> scratch(SoA::getScratchSize(count) + alignof(std::max_align_t));
+    void* p = scratch.data();
+    size_t space = scratch.size();
+    p = std::align(alignof(std::max_align_t), SoA::getScratchSize(count), p, space);
+
+    // the partition is stable, and all the rows are moved together
+    soa.gather(order, 0, count, p);
+    for (size_t i = 0, b = 0; i < count; i++) {
+        while (i >= ends[b]) {
+            b++;
+        }
+        const size_t index = size_t(soa.elementAt<0>(i));
+        EXPECT_EQ(b, buckets[index]);
+        EXPECT_EQ(order[i], index);
+        EXPECT_EQ(index * 2, soa.elementAt<1>(i));
+        EXPECT_TRUE(soa.elementAt<2>(i) == TestFloat4(index * 4));
+        if (i && i != ends[0] && i != ends[1]) {
+            EXPECT_LT(soa.elementAt<0>(i - 1), soa.elementAt<0>(i));
+        }
+    }
+
+    // scatter() undoes gather()
+    soa.scatter(order, 0, count, p);
+    for (size_t i = 0; i < count; i++) {
+        EXPECT_EQ(i, soa.elementAt<0>(i));
+        EXPECT_EQ(i * 2, soa.elementAt<1>(i));
+        EXPECT_TRUE(soa.elementAt<2>(i) == TestFloat4(i * 4));
+    }
+}
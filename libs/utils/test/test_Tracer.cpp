@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include <utils/Systrace.h>
+#include <utils/Tracer.h>
+
+#include <sstream>
+#include <string>
+#include <thread>
+
+using namespace utils;
+
+static size_t countOf(std::string const& s, const char* pattern) {
+    size_t count = 0;
+    for (size_t i = s.find(pattern); i != std::string::npos; i = s.find(pattern, i + 1)) {
+        count++;
+    }
+    return count;
+}
+
+TEST(TracerTest, Events) {
+    Tracer::clear();
+    Tracer::enable(SYSTRACE_TAG_ALWAYS);
+
+    Tracer::begin(SYSTRACE_TAG_ALWAYS, "outer");
+    {
+        Tracer::ScopedTrace trace(SYSTRACE_TAG_ALWAYS, "inner");
+        Tracer::value(SYSTRACE_TAG_ALWAYS, "counter", 42);
+    }
+    Tracer::end(SYSTRACE_TAG_ALWAYS);
+
+    // disabled tags aren't recorded
+    Tracer::begin(SYSTRACE_TAG_JOBSYSTEM, "ignored");
+    Tracer::end(SYSTRACE_TAG_JOBSYSTEM);
+
+    std::thread t([]() {
+        Tracer::setThreadName("worker");
+        Tracer::asyncBegin(SYSTRACE_TAG_ALWAYS, "async", 7);
+        Tracer::asyncEnd(SYSTRACE_TAG_ALWAYS, "async", 7);
+    });
+    t.join();
+
+    Tracer::disable(SYSTRACE_TAG_ALWAYS);
+    Tracer::begin(SYSTRACE_TAG_ALWAYS, "disabled");
+
+    std::stringstream out;
+    Tracer::dump(out);
+    const std::string json = out.str();
+
+    EXPECT_EQ(0u, json.find("{\"traceEvents\":["));
+    EXPECT_EQ(1u, countOf(json, "\"name\":\"outer\""));
+    EXPECT_EQ(1u, countOf(json, "\"name\":\"inner\""));
+    EXPECT_EQ(2u, countOf(json, "\"ph\":\"B\""));
+    EXPECT_EQ(2u, countOf(json, "\"ph\":\"E\""));
+    EXPECT_EQ(1u, countOf(json, "\"args\":{\"value\":42}"));
+    EXPECT_EQ(1u, countOf(json, "\"args\":{\"name\":\"worker\"}"));
+    EXPECT_EQ(2u, countOf(json, "\"id\":7"));
+    EXPECT_EQ(0u, countOf(json, "ignored"));
+    EXPECT_EQ(0u, countOf(json, "disabled"));
+
+    Tracer::clear();
+    std::stringstream empty;
+    Tracer::dump(empty);
+    EXPECT_EQ(0u, countOf(empty.str(), "\"ph\":\"B\""));
+}
+
+TEST(TracerTest, Overflow) {
+    Tracer::clear();
+    Tracer::enable(SYSTRACE_TAG_ALWAYS);
+
+    // the oldest events are overwritten, including the beginning of "first"
+    Tracer::begin(SYSTRACE_TAG_ALWAYS, "first");
+    for (size_t i = 0; i < Tracer::CAPACITY; i++) {
+        Tracer::value(SYSTRACE_TAG_ALWAYS, "counter", int64_t(i));
+    }
+    Tracer::end(SYSTRACE_TAG_ALWAYS);
+    Tracer::disable(SYSTRACE_TAG_ALWAYS);
+
+    std::stringstream out;
+    Tracer::dump(out);
+    const std::string json = out.str();
+    EXPECT_EQ(0u, countOf(json, "\"name\":\"first\""));
+    EXPECT_EQ(0u, countOf(json, "\"ph\":\"E\""));
+    EXPECT_EQ(Tracer::CAPACITY - 1, countOf(json, "\"ph\":\"C\""));
+    EXPECT_EQ(1u, countOf(json, "\"args\":{\"value\":16383}"));
+    Tracer::clear();
+}
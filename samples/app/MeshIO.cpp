@@ -20,8 +20,11 @@
 #include <string>
 #include <vector>
 
+#include <atomic>
+
 #include <fcntl.h>
 #if !defined(WIN32)
+#    include <sys/mman.h>
 #    include <unistd.h>
 #else
 #    include <io.h>
@@ -35,7 +38,6 @@
 
 #include <filament/Box.h>
 #include <filament/Engine.h>
-#include <filament/Fence.h>
 #include <filament/Material.h>
 #include <filament/MaterialInstance.h>
 #include <filament/RenderableManager.h>
@@ -73,6 +75,71 @@ struct Header {
     uint32_t indexSize;
 };
 
+// version 2 adds the page-aligned offsets of the vertex and index data in the file
+struct HeaderV2 : public Header {
+    uint32_t offsetVertexData;
+    uint32_t offsetIndexData;
+};
+
+// version 3 adds levels of detail, whose parts are listed after the materials
+struct HeaderV3 : public HeaderV2 {
+    uint32_t lodCount;
+};
+
+// version 4 can pack the tangent frames in an INT_2_10_10_10_REV, decoded by the shaders
+struct HeaderV4 : public HeaderV3 {
+    uint32_t packedTangents;
+};
+
+// The content of the file, memory mapped when possible. It's released once the vertex and the
+// index buffers have been uploaded, and we're done reading it.
+struct FileData {
+    char* data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+    std::atomic<int> refs = { 1 };
+
+    static FileData* load(int fd, size_t size) {
+        FileData* file = new FileData;
+        file->size = size;
+#if !defined(WIN32)
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            file->data = (char*) data;
+            file->mapped = true;
+            return file;
+        }
+#endif
+        file->data = (char*) malloc(size);
+        if (file->data) {
+            read(fd, file->data, size);
+        }
+        return file;
+    }
+
+    void acquire() noexcept {
+        refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release() noexcept {
+        if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+#if !defined(WIN32)
+            if (mapped) {
+                munmap(data, size);
+            } else
+#endif
+            {
+                free(data);
+            }
+            delete this;
+        }
+    }
+
+    static void releaseCallback(void*, size_t, void* user) {
+        static_cast<FileData*>(user)->release();
+    }
+};
+
 struct Vertex {
     half4  position;
     short4 tangents;
@@ -89,6 +156,12 @@ struct Part {
     Box      aabb;
 };
 
+struct LodPart {
+    uint32_t offset;
+    uint32_t indexCount;
+    float    error;
+};
+
 MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Path& path,
         const std::map<std::string, filament::MaterialInstance*>& materials) {
 
@@ -97,8 +170,8 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
     int fd = open(path.c_str(), O_RDONLY);
 
     size_t size = fileSize(fd);
-    char* data = (char*) malloc(size);
-    read(fd, data, size);
+    FileData* file = FileData::load(fd, size);
+    char* data = file->data;
 
     if (data) {
         char *p = data;
@@ -110,14 +183,29 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
 
         if (!strcmp("FILAMESH", magic)) {
             Header* header = (Header*) p;
-            p += sizeof(Header);
-
+            p += header->version >= 4 ? sizeof(HeaderV4) :
+                    header->version >= 3 ? sizeof(HeaderV3) :
+                    (header->version >= 2 ? sizeof(HeaderV2) : sizeof(Header));
+            const uint32_t lodCount = header->version >= 3 ? ((HeaderV3*) header)->lodCount : 1;
+            const bool packedTangents =
+                    header->version >= 4 && ((HeaderV4*) header)->packedTangents;
+
+            if (header->version >= 2) {
+                p = data + ((HeaderV2*) header)->offsetVertexData;
+            }
             char* vertexData = p;
             p += header->vertexSize;
 
+            if (header->version >= 2) {
+                p = data + ((HeaderV2*) header)->offsetIndexData;
+            }
             char* indices = p;
             p += header->indexSize;
 
+            if (header->version >= 2) {
+                // the parts are aligned on 4 bytes
+                p = data + ((p - data + 3) & ~size_t(3));
+            }
             Part* parts = (Part*) p;
             p += header->parts * sizeof(Part);
 
@@ -141,17 +229,24 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
                                                   : IndexBuffer::IndexType::UINT)
                     .build(*engine);
 
+            // the data is not copied, the file is released once it's been uploaded
+            file->acquire();
             mesh.indexBuffer->setBuffer(*engine,
-                    IndexBuffer::BufferDescriptor(indices, header->indexSize));
+                    IndexBuffer::BufferDescriptor(indices, header->indexSize,
+                            &FileData::releaseCallback, file));
 
             VertexBuffer::Builder vbb;
+            if (!packedTangents) {
+                vbb.normalized(VertexAttribute::TANGENTS);
+            }
             vbb.vertexCount(header->vertexCount)
                 .bufferCount(1)
-                .normalized(VertexAttribute::TANGENTS)
                 .normalized(VertexAttribute::COLOR)
                 .attribute(VertexAttribute::POSITION, 0, VertexBuffer::AttributeType::HALF4,
                         header->offsetPosition, uint8_t(header->stridePosition))
-                .attribute(VertexAttribute::TANGENTS, 0, VertexBuffer::AttributeType::SHORT4,
+                .attribute(VertexAttribute::TANGENTS, 0, packedTangents ?
+                        VertexBuffer::AttributeType::INT_2_10_10_10_REV :
+                        VertexBuffer::AttributeType::SHORT4,
                         header->offsetTangents, uint8_t(header->strideTangents))
                 .attribute(VertexAttribute::COLOR,    0, VertexBuffer::AttributeType::UBYTE4,
                         header->offsetColor, uint8_t(header->strideColor))
@@ -166,11 +261,14 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
 
             mesh.vertexBuffer = vbb.build(*engine);
 
-            VertexBuffer::BufferDescriptor buffer(vertexData, header->vertexSize);
+            file->acquire();
+            VertexBuffer::BufferDescriptor buffer(vertexData, header->vertexSize,
+                    &FileData::releaseCallback, file);
             mesh.vertexBuffer->setBufferAt(*engine, 0, std::move(buffer));
 
             RenderableManager::Builder builder(header->parts);
             builder.boundingBox(header->aabb);
+            builder.levelCount(uint8_t(lodCount));
 
 
             for (size_t i = 0; i < header->parts; i++) {
@@ -185,13 +283,22 @@ MeshIO::Mesh MeshIO::loadMeshFromFile(filament::Engine* engine, const utils::Pat
                 }
             }
 
+            // the parts of the levels of detail follow the material names, unaligned
+            for (uint8_t level = 1; level < lodCount; level++) {
+                for (size_t i = 0; i < header->parts; i++) {
+                    LodPart part;
+                    memcpy(&part, p, sizeof(LodPart));
+                    p += sizeof(LodPart);
+                    builder.lodGeometry(level, i, RenderableManager::PrimitiveType::TRIANGLES,
+                            mesh.vertexBuffer, mesh.indexBuffer, part.offset, part.indexCount);
+                }
+            }
+
             mesh.renderable = utils::EntityManager::get().create();
             builder.build(*engine, mesh.renderable);
         }
-
-        Fence::waitAndDestroy(engine->createFence());
-        free(data);
     }
+    file->release();
     close(fd);
 
     return mesh;
@@ -171,8 +171,7 @@ void loadTexture(Engine* engine, const std::string& filePath, Texture** map, boo
                 Texture::PixelBufferDescriptor buffer(data, size_t(w * h * 3),
                         Texture::Format::RGB, Texture::Type::UBYTE,
                         (driver::BufferDescriptor::Callback) &stbi_image_free);
-                (*map)->setImage(*engine, 0, std::move(buffer));
-                (*map)->generateMipmaps(*engine);
+                (*map)->setImageWithMips(*engine, std::move(buffer));
             } else {
                 std::cout << "The texture " << path << " could not be loaded" << std::endl;
             }
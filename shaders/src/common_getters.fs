@@ -2,6 +2,14 @@
 // Uniforms access
 //------------------------------------------------------------------------------
 
+#if defined(HAS_STEREO)
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+#define EYE_INDEX gl_ViewIndex
+#else
+#define EYE_INDEX int(gl_ViewID_OVR)
+#endif
+#endif
+
 /** @public-api */
 mat4 getViewFromWorldMatrix() {
     return frameUniforms.viewFromWorldMatrix;
@@ -24,7 +32,11 @@ mat4 getViewFromClipMatrix() {
 
 /** @public-api */
 mat4 getClipFromWorldMatrix() {
+#if defined(HAS_STEREO)
+    return frameUniforms.eyeClipFromWorldMatrix[EYE_INDEX];
+#else
     return frameUniforms.clipFromWorldMatrix;
+#endif
 }
 
 /** @public-api */
@@ -34,7 +46,11 @@ vec4 getResolution() {
 
 /** @public-api */
 vec3 getWorldCameraPosition() {
+#if defined(HAS_STEREO)
+    return frameUniforms.eyeCameraPosition[EYE_INDEX];
+#else
     return frameUniforms.cameraPosition;
+#endif
 }
 
 /** @public-api */
@@ -417,7 +417,13 @@ NOTE the other tuning knobs are now in the shader function inputs!
 /*--------------------------------------------------------------------------*/
 #if (FXAA_GLSL_130 == 1)
     // Requires "#version 130" or better
-    #define FxaaTexTop(t, p) textureLod(t, p, 0.0)
+    #if POST_PROCESS_TONE_MAPPING
+        // each tap is tone mapped on the fly, see post_process.fs
+        vec4 resolveColor(vec4 color);
+        #define FxaaTexTop(t, p) resolveColor(textureLod(t, p, 0.0))
+    #else
+        #define FxaaTexTop(t, p) textureLod(t, p, 0.0)
+    #endif
     #define FxaaTexOff(t, p, o, r) textureLodOffset(t, p, 0.0, o)
     #if (FXAA_GATHER4_ALPHA == 1)
         // use #extension gpu_shader5 : enable
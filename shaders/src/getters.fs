@@ -22,9 +22,3 @@ vec2 getUV1() {
     return vertex_uv01.zw;
 }
 #endif
-
-#if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
-HIGHP vec3 getLightSpacePosition() {
-    return vertex_lightSpacePosition.xyz * (1.0 / vertex_lightSpacePosition.w);
-}
-#endif
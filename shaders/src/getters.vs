@@ -2,18 +2,30 @@
 // Uniforms access
 //------------------------------------------------------------------------------
 
-mat4 getLightFromWorldMatrix() {
-    return frameUniforms.lightFromWorldMatrix;
-}
+#if defined(HAS_INSTANCING)
+#if defined(CODEGEN_TARGET_VULKAN_ENVIRONMENT)
+#define INSTANCE_INDEX gl_InstanceIndex
+#else
+#define INSTANCE_INDEX gl_InstanceID
+#endif
+#endif
 
 /** @public-api */
 mat4 getWorldFromModelMatrix() {
+#if defined(HAS_INSTANCING)
+    return instancesUniforms.worldFromModelMatrix[INSTANCE_INDEX];
+#else
     return objectUniforms.worldFromModelMatrix;
+#endif
 }
 
 /** @public-api */
 mat3 getWorldFromModelNormalMatrix() {
+#if defined(HAS_INSTANCING)
+    return instancesUniforms.worldFromModelNormalMatrix[INSTANCE_INDEX];
+#else
     return objectUniforms.worldFromModelNormalMatrix;
+#endif
 }
 
 //------------------------------------------------------------------------------
@@ -38,6 +50,65 @@ void skinPosition(inout vec3 p, const uvec4 ids, const vec4 weights) {
 }
 #endif
 
+#if defined(HAS_ATTRIBUTE_TANGENTS)
+/*
+ * The tangent frames are unit quaternions, or are packed by filamesh in 4 bytes (an
+ * INT_2_10_10_10_REV read without normalization) as an octahedral normal, the tangent in a basis
+ * derived from the normal, and the sign of the bitangent. The first component of a packed frame
+ * is stored in [2..511], so it can't be mistaken for the component of a unit quaternion.
+ */
+bool isPackedTangentFrame(const HIGHP vec4 tangents) {
+    return tangents.x > 1.5;
+}
+
+vec3 unpackNormal(const HIGHP vec4 tangents) {
+    HIGHP vec2 e = vec2((tangents.x - 256.5) * (1.0 / 254.5), tangents.y * (1.0 / 511.0));
+    HIGHP vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    HIGHP float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+
+vec3 unpackTangent(const HIGHP vec4 tangents, const HIGHP vec3 n) {
+    // the basis of the plane orthogonal to n, see "Building an Orthonormal Basis, Revisited"
+    HIGHP float s = n.z >= 0.0 ? 1.0 : -1.0;
+    HIGHP float a = -1.0 / (s + n.z);
+    HIGHP float b = n.x * n.y * a;
+    HIGHP vec3 b1 = vec3(1.0 + s * n.x * n.x * a, s * b, -s * n.x);
+    HIGHP vec3 b2 = vec3(b, s + n.y * n.y * a, -n.y);
+    // the tangent's coordinates in this basis are diamond encoded in [0..1]
+    HIGHP float d = tangents.z * (1.0 / 1022.0) + 0.5;
+    HIGHP float ds = d > 0.5 ? 1.0 : -1.0;
+    HIGHP float x = -ds * 4.0 * d + 1.0 + ds * 2.0;
+    HIGHP vec2 v = normalize(vec2(x, ds * (1.0 - abs(x))));
+    return b1 * v.x + b2 * v.y;
+}
+
+/**
+ * Extracts the normal of the vertex's tangent frame, in model space.
+ */
+void getMeshTangentFrame(out HIGHP vec3 n) {
+    if (isPackedTangentFrame(mesh_tangents)) {
+        n = unpackNormal(mesh_tangents);
+    } else {
+        toTangentFrame(normalize(mesh_tangents), n);
+    }
+}
+
+/**
+ * Extracts the normal and the tangent of the vertex's tangent frame, in model space. The sign of
+ * mesh_tangents.w is the sign of the bitangent in both encodings.
+ */
+void getMeshTangentFrame(out HIGHP vec3 n, out HIGHP vec3 t) {
+    if (isPackedTangentFrame(mesh_tangents)) {
+        n = unpackNormal(mesh_tangents);
+        t = unpackTangent(mesh_tangents, n);
+    } else {
+        toTangentFrame(normalize(mesh_tangents), n, t);
+    }
+}
+#endif
+
 /** @public-api */
 vec4 getPosition() {
     return mesh_position;
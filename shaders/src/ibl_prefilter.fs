@@ -0,0 +1,153 @@
+// Runtime image based lighting prefiltering, see FIblPrefilter.
+// The math is the same as cmgen's, see CubemapIBL::roughnessFilter() and
+// CubemapSH::computeIrradianceSH3Bands().
+
+// direction of the center of a texel of a cubemap face, uv in [0, 1], following the GL
+// cubemap conventions (same as Cubemap::getDirectionFor())
+vec3 getCubemapDirection(int face, HIGHP vec2 uv) {
+    HIGHP vec2 p = uv * 2.0 - 1.0;
+    HIGHP vec3 direction;
+    if (face == 0) {
+        direction = vec3( 1.0, -p.y, -p.x);
+    } else if (face == 1) {
+        direction = vec3(-1.0, -p.y,  p.x);
+    } else if (face == 2) {
+        direction = vec3( p.x,  1.0,  p.y);
+    } else if (face == 3) {
+        direction = vec3( p.x, -1.0, -p.y);
+    } else if (face == 4) {
+        direction = vec3( p.x, -p.y,  1.0);
+    } else {
+        direction = vec3(-p.x, -p.y, -1.0);
+    }
+    return normalize(direction);
+}
+
+#if POST_PROCESS_STAGE == POST_PROCESS_IBL_EQUIRECTANGULAR
+vec4 PostProcess_IblEquirectangular() {
+    // the mapping of CubemapUtils::equirectangularToCubemap()
+    HIGHP vec3 s = getCubemapDirection(int(postProcessUniforms.iblFace), vertex_uv);
+    HIGHP vec2 uv = vec2(atan(s.x, -s.z) * (1.0 / PI), asin(-s.y) * (2.0 / PI));
+    return vec4(texture(postProcess_colorBuffer, uv * 0.5 + 0.5).rgb, 1.0);
+}
+#endif
+
+#if POST_PROCESS_STAGE == POST_PROCESS_IBL_PREFILTER
+HIGHP vec2 hammersley(uint i, HIGHP float iN) {
+    uint bits = i;
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return vec2(float(i) * iN, float(bits) * 2.3283064365386963e-10);
+}
+
+vec4 PostProcess_IblPrefilter() {
+    HIGHP vec3 N = getCubemapDirection(int(postProcessUniforms.iblFace), vertex_uv);
+    HIGHP float a = postProcessUniforms.iblLinearRoughness;
+    if (a == 0.0) {
+        return vec4(textureLod(postProcess_environment, N, 0.0).rgb, 1.0);
+    }
+
+    // center the cone around the normal (handle case of normal close to up)
+    HIGHP vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    HIGHP vec3 T = normalize(cross(up, N));
+    HIGHP vec3 B = cross(N, T);
+
+    uint sampleCount = uint(postProcessUniforms.iblSampleCount);
+    HIGHP float iN = 1.0 / postProcessUniforms.iblSampleCount;
+    float maxLevel = postProcessUniforms.iblMaxLevel;
+
+    // solid angle of a texel of the environment's base level
+    HIGHP float dim0 = float(textureSize(postProcess_environment, 0).x);
+    HIGHP float omegaP = (4.0 * PI) / (6.0 * dim0 * dim0);
+
+    HIGHP vec3 Li = vec3(0.0);
+    HIGHP float weight = 0.0;
+    for (uint i = 0u; i < sampleCount; i++) {
+        // importance sampling GGX, with N == V
+        HIGHP vec2 u = hammersley(i, iN);
+        HIGHP float phi = 2.0 * PI * u.x;
+        HIGHP float cosTheta2 = (1.0 - u.y) / (1.0 + (a + 1.0) * ((a - 1.0) * u.y));
+        HIGHP float NoH = sqrt(cosTheta2);
+        HIGHP float sinTheta = sqrt(1.0 - cosTheta2);
+        HIGHP vec3 H = vec3(sinTheta * cos(phi), sinTheta * sin(phi), NoH);
+        HIGHP float NoL = 2.0 * cosTheta2 - 1.0;
+        if (NoL <= 0.0) {
+            continue;
+        }
+        HIGHP vec3 L = vec3(2.0 * NoH * H.x, 2.0 * NoH * H.y, NoL);
+
+        // pre-filtered importance sampling, with a log4(K) = 1 LOD bias
+        HIGHP float f = (a - 1.0) * ((a + 1.0) * cosTheta2) + 1.0;
+        HIGHP float pdf = (a * a) / (PI * f * f) / 4.0;
+        HIGHP float omegaS = iN / pdf;
+        float lod = clamp(0.5 * log2(omegaS / omegaP) + 1.0, 0.0, maxLevel);
+
+        // height-correlated GGX visibility and Schlick's fresnel with f0 = 1, f90 = 0, LoH == NoH
+        HIGHP float a2 = a * a;
+        HIGHP float GGXL = sqrt((NoL - NoL * a2) * NoL + a2);
+        HIGHP float GGXV = NoL; // NoV == 1
+        HIGHP float V = 0.5 / (GGXV + GGXL);
+        HIGHP float Fc = pow(1.0 - NoH, 5.0);
+        HIGHP float brdf_NoL = (1.0 - Fc) * V * NoL;
+
+        HIGHP vec3 direction = T * L.x + B * L.y + N * L.z;
+        Li += textureLod(postProcess_environment, direction, lod).rgb * brdf_NoL;
+        weight += brdf_NoL;
+    }
+    return vec4(Li / max(weight, FLT_EPS), 1.0);
+}
+#endif
+
+#if POST_PROCESS_STAGE == POST_PROCESS_IBL_SPHERICAL_HARMONICS
+// the environment is projected from its level whose faces are this size
+#define IBL_SH_DIMENSION 16
+
+HIGHP float sphereQuadrantArea(HIGHP float x, HIGHP float y) {
+    return atan(x * y, sqrt(x * x + y * y + 1.0));
+}
+
+// the pre-convolved, pre-scaled 3 bands SH basis of the coefficient k
+HIGHP float shBasis(int k, HIGHP vec3 s) {
+    if (k == 0) return 1.0 / 4.0;
+    if (k == 1) return 1.0 / 2.0 * s.y;
+    if (k == 2) return 1.0 / 2.0 * s.z;
+    if (k == 3) return 1.0 / 2.0 * s.x;
+    if (k == 4) return 15.0 / 16.0 * s.y * s.x;
+    if (k == 5) return 15.0 / 16.0 * s.y * s.z;
+    if (k == 6) return 5.0 / 64.0 * (3.0 * s.z * s.z - 1.0);
+    if (k == 7) return 15.0 / 16.0 * s.z * s.x;
+    return 15.0 / 64.0 * (s.x * s.x - s.y * s.y);
+}
+
+// each of the 9 fragments of the target sums one of the coefficients over the environment
+vec4 PostProcess_IblSphericalHarmonics() {
+    int k = int(gl_FragCoord.x);
+    HIGHP float dim0 = float(textureSize(postProcess_environment, 0).x);
+    float lod = max(0.0, log2(dim0 / float(IBL_SH_DIMENSION)));
+
+    const HIGHP float iDim = 1.0 / float(IBL_SH_DIMENSION);
+    HIGHP vec3 sh = vec3(0.0);
+    for (int face = 0; face < 6; face++) {
+        for (int y = 0; y < IBL_SH_DIMENSION; y++) {
+            for (int x = 0; x < IBL_SH_DIMENSION; x++) {
+                HIGHP vec2 uv = (vec2(x, y) + 0.5) * iDim;
+                HIGHP vec3 s = getCubemapDirection(face, uv);
+
+                // solid angle of the texel, see CubemapUtils::solidAngle()
+                HIGHP vec2 p0 = uv * 2.0 - 1.0 - iDim;
+                HIGHP vec2 p1 = uv * 2.0 - 1.0 + iDim;
+                HIGHP float solidAngle =
+                        sphereQuadrantArea(p0.x, p0.y) - sphereQuadrantArea(p0.x, p1.y) -
+                        sphereQuadrantArea(p1.x, p0.y) + sphereQuadrantArea(p1.x, p1.y);
+
+                HIGHP vec3 color = textureLod(postProcess_environment, s, lod).rgb;
+                sh += color * (solidAngle * shBasis(k, s));
+            }
+        }
+    }
+    return vec4(sh, 1.0);
+}
+#endif
@@ -30,7 +30,10 @@ void evaluateDirectionalLight(const PixelParams pixel, inout vec3 color) {
     float visibility = 1.0;
 #ifdef HAS_SHADOWING
     // TODO: don't compute when NoL < 0.0
-    visibility = shadow(light_shadowMap, getLightSpacePosition());
+    // the shadowing variant is also used when only spot lights cast shadows
+    if (frameUniforms.directionalShadows > 0.0) {
+        visibility = shadow(light_shadowMap, getLightSpacePosition());
+    }
 #endif
     // TODO: skip when visibility == 0.0 (shading model dependent)
     color.rgb += surfaceShading(pixel, light, visibility);
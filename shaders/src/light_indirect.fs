@@ -3,7 +3,9 @@
 //------------------------------------------------------------------------------
 
 #ifndef TARGET_MOBILE
+#if defined(MATERIAL_HAS_SPECULAR_AMBIENT_OCCLUSION)
 #define IBL_SPECULAR_OCCLUSION
+#endif
 #define IBL_OFF_SPECULAR_PEAK
 #endif
 
@@ -29,7 +31,8 @@
 
 vec3 decodeDataForIBL(const vec4 data) {
 #if defined(IBL_USE_RGBM)
-    return decodeRGBM(data);
+    // the reflections can also be stored linearly, e.g. as RGB9_E5, this branch is uniform
+    return frameUniforms.iblRgbm > 0.0 ? decodeRGBM(data) : data.rgb;
 #else
     return data.rgb;
 #endif
@@ -212,7 +215,11 @@ void evaluateSubsurfaceIBL(const PixelParams pixel, const vec3 diffuseIrradiance
         inout vec3 Fd, inout vec3 Fr) {
 #if defined(SHADING_MODEL_SUBSURFACE)
     vec3 viewIndependent = diffuseIrradiance;
+#if defined(MATERIAL_HAS_IBL_SPECULAR)
     vec3 viewDependent = specularIrradiance(-shading_view, pixel.roughness, 1.0 + pixel.thickness);
+#else
+    vec3 viewDependent = vec3(0.0);
+#endif
     float attenuation = (1.0 - pixel.thickness) / (2.0 * PI);
     Fd += pixel.subsurfaceColor * (viewIndependent + viewDependent) * attenuation;
 #elif defined(SHADING_MODEL_CLOTH) && defined(MATERIAL_HAS_SUBSURFACE_COLOR)
@@ -235,11 +242,15 @@ void evaluateIBL(const MaterialInputs material, const PixelParams pixel, inout v
     vec3 diffuseIrradiance = diffuseIrradiance(n);
     vec3 Fd = pixel.diffuseColor * diffuseIrradiance * diffuseBRDF;
 
-    // specular indirect
+    // specular indirect, the material can restrict the IBL to its spherical harmonics
+#if defined(MATERIAL_HAS_IBL_SPECULAR)
     vec3 Fr = specularDFG(pixel) * specularIrradiance(r, pixel.roughness) * specularAO;
     Fr *= pixel.energyCompensation;
 
     evaluateClearCoatIBL(pixel, specularAO, Fd, Fr);
+#else
+    vec3 Fr = vec3(0.0);
+#endif
     evaluateSubsurfaceIBL(pixel, diffuseIrradiance, Fd, Fr);
 
     // Note: iblLuminance is already premultiplied by the exposure
@@ -2,12 +2,12 @@
 // Punctual lights evaluation
 //------------------------------------------------------------------------------
 
-// Make sure this matches the same constants in Froxel.cpp
+// Make sure this matches the same constants in Froxelizer.cpp
 #define FROXEL_BUFFER_WIDTH_SHIFT   6u
 #define FROXEL_BUFFER_WIDTH         (1u << FROXEL_BUFFER_WIDTH_SHIFT)
 #define FROXEL_BUFFER_WIDTH_MASK    (FROXEL_BUFFER_WIDTH - 1u)
 
-#define RECORD_BUFFER_WIDTH_SHIFT   5u
+#define RECORD_BUFFER_WIDTH_SHIFT   6u
 #define RECORD_BUFFER_WIDTH         (1u << RECORD_BUFFER_WIDTH_SHIFT)
 #define RECORD_BUFFER_WIDTH_MASK    (RECORD_BUFFER_WIDTH - 1u)
 
@@ -64,8 +64,8 @@ FroxelParams getFroxelParams(uint froxelIndex) {
 
     FroxelParams froxel;
     froxel.recordOffset = entry.r;
-    froxel.pointCount = entry.g & 0xFFu;
-    froxel.spotCount = entry.g >> 8u;
+    froxel.pointCount = entry.g & 0xFFFFu;
+    froxel.spotCount = entry.g >> 16u;
     return froxel;
 }
 
@@ -128,14 +128,21 @@ Light getSpotLight(uint index) {
     HIGHP vec4 positionFalloff = lightsUniforms.lights[lightIndex][0];
     HIGHP vec4 colorIntensity  = lightsUniforms.lights[lightIndex][1];
           vec4 directionIES    = lightsUniforms.lights[lightIndex][2];
-          vec2 scaleOffset     = lightsUniforms.lights[lightIndex][3].xy;
+          vec4 scaleOffset     = lightsUniforms.lights[lightIndex][3];
 
     light.colorIntensity.rgb = colorIntensity.rgb;
     light.colorIntensity.w = computePreExposedIntensity(colorIntensity.w, frameUniforms.exposure);
 
     setupPunctualLight(light, positionFalloff);
 
-    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset);
+    light.attenuation *= getAngleAttenuation(-directionIES.xyz, light.l, scaleOffset.xy);
+
+#if defined(HAS_SHADOWING)
+    // scaleOffset.z is the index of the light's shadow map, negative if it has none
+    if (scaleOffset.z >= 0.0) {
+        light.attenuation *= spotShadow(uint(scaleOffset.z), light.l, scaleOffset.w);
+    }
+#endif
 
     return light;
 }
@@ -164,6 +171,26 @@ Light getPointLight(uint index) {
     return light;
 }
 
+/**
+ * Returns the window coordinates of the current fragment in the froxel grid. In
+ * stereo, the froxels are built for the culling camera, which sees both eyes,
+ * so the fragment is projected with the culling camera.
+ */
+vec3 getFroxelFragCoord() {
+#if defined(HAS_STEREO)
+    HIGHP vec4 p = frameUniforms.clipFromWorldMatrix * vec4(shading_position, 1.0);
+    p.xyz *= 1.0 / p.w;
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    HIGHP float z = p.z;
+#else
+    HIGHP float z = p.z * 0.5 + 0.5;
+#endif
+    return vec3((p.xy * 0.5 + 0.5) * frameUniforms.resolution.xy + frameUniforms.origin, z);
+#else
+    return gl_FragCoord.xyz;
+#endif
+}
+
 /**
  * Evaluates all punctual lights that my affect the current fragment.
  * The result of the lighting computations is accumulated in the color
@@ -172,7 +199,7 @@ Light getPointLight(uint index) {
 void evaluatePunctualLights(const PixelParams pixel, inout vec3 color) {
     // Fetch the light information stored in the froxel that contains the
     // current fragment
-    FroxelParams froxel = getFroxelParams(getFroxelIndex(gl_FragCoord.xyz));
+    FroxelParams froxel = getFroxelParams(getFroxelIndex(getFroxelFragCoord()));
 
     // Each froxel contains how many point and spot lights can influence
     // the current fragment. A froxel also contains a record offset that
@@ -3,29 +3,33 @@ LAYOUT_LOCATION(0) in HIGHP vec2 vertex_uv;
 LAYOUT_LOCATION(0) out vec4 fragColor;
 
 #if POST_PROCESS_TONE_MAPPING
-vec3 resolveFragment(const ivec2 uv) {
-    return texelFetch(postProcess_colorBuffer, uv, 0).rgb;
-}
-
-vec4 resolveAlphaFragment(const ivec2 uv) {
-    return texelFetch(postProcess_colorBuffer, uv, 0);
-}
-
-vec4 resolve() {
+vec4 resolveColor(vec4 color) {
 #if POST_PROCESS_OPAQUE
-    vec4 color = vec4(resolveFragment(ivec2(vertex_uv)), 1.0);
-    color.rgb  = tonemap(color.rgb);
-    color.rgb  = OECF(color.rgb);
+    color.rgb  = colorGrade(color.rgb);
     color.a    = luminance(color.rgb);
 #else
-    vec4 color = resolveAlphaFragment(ivec2(vertex_uv));
     color.rgb /= color.a + FLT_EPS;
-    color.rgb  = tonemap(color.rgb);
-    color.rgb  = OECF(color.rgb);
+    color.rgb  = colorGrade(color.rgb);
     color.rgb *= color.a + FLT_EPS;
 #endif
     return color;
 }
+#endif
+
+#if POST_PROCESS_SUBPASS && defined(TARGET_VULKAN_ENVIRONMENT)
+// the color drawn by the previous subpass, only its value at this fragment can be read
+layout(input_attachment_index = 0, binding = SUBPASS_INPUT_BINDING) uniform mediump subpassInput
+        postProcess_subpassColor;
+#endif
+
+#if POST_PROCESS_TONE_MAPPING && !POST_PROCESS_ANTI_ALIASING
+vec4 resolve() {
+#if POST_PROCESS_SUBPASS && defined(TARGET_VULKAN_ENVIRONMENT)
+    return resolveColor(subpassLoad(postProcess_subpassColor));
+#else
+    return resolveColor(texelFetch(postProcess_colorBuffer, ivec2(vertex_uv), 0));
+#endif
+}
 
 vec4 PostProcess_ToneMapping() {
     vec4 color = resolve();
@@ -35,16 +39,21 @@ vec4 PostProcess_ToneMapping() {
 
 #if POST_PROCESS_ANTI_ALIASING
 vec4 PostProcess_AntiAliasing() {
-    vec4 resolution = frameUniforms.resolution;
+#if POST_PROCESS_TONE_MAPPING
+    // the size of the source's texels, the target can be larger
+    vec2 texelSize = frameUniforms.resolution.zw * postProcessUniforms.uvScale;
+#else
+    vec2 texelSize = frameUniforms.resolution.zw;
+#endif
     HIGHP vec2 texelCenter = vertex_uv;
-    vec2 halfResolutionFraction = resolution.zw * 0.5;
+    vec2 halfResolutionFraction = texelSize * 0.5;
 
     vec4 color = fxaa(
             texelCenter,
             vec4(texelCenter - halfResolutionFraction, texelCenter + halfResolutionFraction),
             postProcess_colorBuffer,
-            resolution.zw,       // FxaaFloat4 fxaaConsoleRcpFrameOpt,
-            2.0 * resolution.zw, // FxaaFloat4 fxaaConsoleRcpFrameOpt2,
+            texelSize,           // FxaaFloat4 fxaaConsoleRcpFrameOpt,
+            2.0 * texelSize,     // FxaaFloat4 fxaaConsoleRcpFrameOpt2,
             8.0,                 // FxaaFloat fxaaConsoleEdgeSharpness,
 #if defined(G3D_FXAA_PATCHES) && G3D_FXAA_PATCHES == 1
             0.08,                // FxaaFloat fxaaConsoleEdgeThreshold,
@@ -55,16 +64,159 @@ vec4 PostProcess_AntiAliasing() {
     );
 #if POST_PROCESS_OPAQUE
     color.a = 1.0;
+#endif
+#if POST_PROCESS_TONE_MAPPING
+    color = dither(color);
 #endif
     return color;
 }
 #endif
 
+#if POST_PROCESS_BLENDING
+// distance from the camera of a depth buffer value
+HIGHP float linearizeDepth(HIGHP float depth) {
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    HIGHP float z = depth;
+#else
+    HIGHP float z = depth * 2.0 - 1.0;
+#endif
+    HIGHP vec4 v = frameUniforms.viewFromClipMatrix * vec4(0.0, 0.0, z, 1.0);
+    return -v.z / v.w;
+}
+
+vec4 PostProcess_BlendingUpsample() {
+    ivec2 fragment = ivec2(vertex_uv);
+    vec4 color = texelFetch(postProcess_colorBuffer, fragment, 0);
+    HIGHP float depth = linearizeDepth(texelFetch(postProcess_depthBuffer, fragment, 0).r);
+
+    // The 2x2 low resolution texels around the fragment, weighted bilinearly and by how close
+    // their depth is to the fragment's, so that the blended primitives don't bleed across the
+    // edges of what's in front of, or behind them.
+    HIGHP vec2 position = vertex_uv * postProcessUniforms.blendingScale - 0.5;
+    ivec2 base = ivec2(floor(position));
+    vec2 f = position - vec2(base);
+    ivec2 last = ivec2(frameUniforms.resolution.xy * postProcessUniforms.blendingScale + 0.5) - 1;
+
+    vec4 blended = vec4(0.0);
+    float weights = 0.0;
+    for (int i = 0; i < 4; i++) {
+        ivec2 offset = ivec2(i & 1, i >> 1);
+        ivec2 texel = clamp(base + offset, ivec2(0), last);
+        HIGHP float d = linearizeDepth(texelFetch(postProcess_blendingDepth, texel, 0).r);
+        vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+        float weight = bilinear.x * bilinear.y / (1e-3 + abs(depth - d) / max(depth, FLT_EPS));
+        blended += texelFetch(postProcess_blendingBuffer, texel, 0) * weight;
+        weights += weight;
+    }
+    blended /= max(weights, FLT_EPS);
+
+    // the blended primitives were drawn over transparent black, with premultiplied alpha
+    return blended + color * (1.0 - blended.a);
+}
+#endif
+
+#if POST_PROCESS_TEMPORAL
+// The colors are averaged and clamped after a reversible tone mapping, so that a few very bright
+// samples don't dominate their neighborhood
+vec4 temporalCompress(const vec4 color) {
+    return vec4(color.rgb / (1.0 + luminance(color.rgb)), color.a);
+}
+
+vec4 temporalUncompress(const vec4 color) {
+    return vec4(color.rgb / max(1.0 - luminance(color.rgb), FLT_EPS), color.a);
+}
+
+// Converts between the normalized coordinates of the viewport and the OpenGL clip space of
+// the reprojection matrix. Vulkan rendered the color pass upside down.
+HIGHP vec2 temporalUvToClip(HIGHP vec2 uv) {
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    uv.y = 1.0 - uv.y;
+#endif
+    return uv * 2.0 - 1.0;
+}
+
+HIGHP vec2 temporalClipToUv(HIGHP vec2 clip) {
+    HIGHP vec2 uv = clip * 0.5 + 0.5;
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    uv.y = 1.0 - uv.y;
+#endif
+    return uv;
+}
+
+vec4 PostProcess_TemporalUpsample() {
+    // vertex_uv spans the source's pixels, while this pass covers the full resolution viewport
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+    HIGHP vec2 origin = vec2(0.0, postProcessUniforms.yOffset);
+    vec2 jitter = postProcessUniforms.temporalJitter * vec2(1.0, -1.0);
+#else
+    HIGHP vec2 origin = vec2(0.0);
+    vec2 jitter = postProcessUniforms.temporalJitter;
+#endif
+    HIGHP vec2 uv = (vertex_uv - origin) * frameUniforms.resolution.zw;
+
+    // The color pass was shifted by the jitter, the 3x3 source texels around the fragment are
+    // filtered for this frame's color and give the distribution of its neighborhood
+    HIGHP vec2 position = vertex_uv + jitter;
+    ivec2 center = ivec2(floor(position));
+    ivec2 first = ivec2(origin);
+    ivec2 last = first + ivec2(frameUniforms.resolution.xy) - 1;
+
+    vec4 current = vec4(0.0);
+    float weights = 0.0;
+    vec4 m1 = vec4(0.0);
+    vec4 m2 = vec4(0.0);
+    HIGHP float depth = 1.0;
+    for (int i = 0; i < 9; i++) {
+        ivec2 texel = clamp(center + ivec2(i % 3 - 1, i / 3 - 1), first, last);
+        vec4 color = temporalCompress(texelFetch(postProcess_colorBuffer, texel, 0));
+        // a Gaussian fitted to a Blackman-Harris window
+        vec2 d = vec2(texel) + 0.5 - position;
+        float weight = exp(-2.29 * dot(d, d));
+        current += color * weight;
+        weights += weight;
+        m1 += color;
+        m2 += color * color;
+        // the closest surface, so that the edges follow what's in front
+        depth = min(depth, texelFetch(postProcess_depthBuffer, texel, 0).r);
+    }
+    current /= weights;
+
+    // Only the camera moved since the last frame as far as the reprojection knows, objects in
+    // motion rely on the clamping below. The depth is in [0, 1] with either backend.
+    HIGHP vec4 clip = postProcessUniforms.temporalReprojection *
+            vec4(temporalUvToClip(uv), depth * 2.0 - 1.0, 1.0);
+    HIGHP vec2 previous = temporalClipToUv(clip.xy / clip.w);
+    vec4 history = temporalCompress(texture(postProcess_history, previous));
+
+    // The history is clamped to the box of the neighborhood's mean and variance, which rejects
+    // most of what was disoccluded or changed
+    vec4 mean = m1 * (1.0 / 9.0);
+    vec4 sigma = sqrt(max(m2 * (1.0 / 9.0) - mean * mean, 0.0));
+    history = clamp(history, mean - 1.25 * sigma, mean + 1.25 * sigma);
+
+    float feedback = postProcessUniforms.temporalFeedback;
+    if (any(lessThan(previous, vec2(0.0))) || any(greaterThan(previous, vec2(1.0)))) {
+        feedback = 1.0;
+    }
+    return temporalUncompress(mix(history, current, feedback));
+}
+#endif
+
 vec4 postProcess() {
-#if POST_PROCESS_TONE_MAPPING
-    return PostProcess_ToneMapping();
+#if POST_PROCESS_STAGE == POST_PROCESS_IBL_EQUIRECTANGULAR
+    return PostProcess_IblEquirectangular();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_PREFILTER
+    return PostProcess_IblPrefilter();
+#elif POST_PROCESS_STAGE == POST_PROCESS_IBL_SPHERICAL_HARMONICS
+    return PostProcess_IblSphericalHarmonics();
+#elif POST_PROCESS_BLENDING
+    return PostProcess_BlendingUpsample();
+#elif POST_PROCESS_TEMPORAL
+    return PostProcess_TemporalUpsample();
 #elif POST_PROCESS_ANTI_ALIASING
     return PostProcess_AntiAliasing();
+#elif POST_PROCESS_TONE_MAPPING
+    return PostProcess_ToneMapping();
 #endif
 }
 
@@ -4,6 +4,13 @@ LAYOUT_LOCATION(LOCATION_POSITION) in vec4 position;
 LAYOUT_LOCATION(0) out vec2 vertex_uv;
 
 void main() {
+#if POST_PROCESS_IBL
+    // the IBL stages draw cubemap faces, outside of any view, with normalized coordinates
+    vertex_uv = position.xy * 0.5 + 0.5;
+    gl_Position = position;
+    return;
+#endif
+
     vertex_uv = (position.xy * 0.5 + 0.5) * frameUniforms.resolution.xy;
 
 #if defined(TARGET_VULKAN_ENVIRONMENT)
@@ -16,7 +23,11 @@ void main() {
     vertex_uv.y += postProcessUniforms.yOffset;
 #endif
 
-#if POST_PROCESS_ANTI_ALIASING
+#if POST_PROCESS_TONE_MAPPING && POST_PROCESS_ANTI_ALIASING
+    // The fused stage filters its taps with normalized coordinates, it can then scale the
+    // source up to a larger viewport
+    vertex_uv *= frameUniforms.resolution.zw * postProcessUniforms.uvScale;
+#elif POST_PROCESS_ANTI_ALIASING
     // Account for the texture actual size
     vertex_uv *= postProcessUniforms.uvScale;
     // Compute texel center
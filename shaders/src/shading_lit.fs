@@ -134,8 +134,10 @@ vec4 evaluateLights(const MaterialInputs material) {
     vec3 color = vec3(0.0);
 
     // We always evaluate the IBL as not having one is going to be uncommon,
-    // it also saves 1 shader variant
+    // it also saves 1 shader variant. Materials can still opt out entirely.
+#if defined(MATERIAL_HAS_IBL)
     evaluateIBL(material, pixel, color);
+#endif
 
 #if defined(HAS_DIRECTIONAL_LIGHTING)
     evaluateDirectionalLight(pixel, color);
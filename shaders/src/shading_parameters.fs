@@ -31,7 +31,7 @@ void computeShadingParams() {
 #endif
 
     shading_position = vertex_worldPosition;
-    shading_view = normalize(frameUniforms.cameraPosition - shading_position);
+    shading_view = normalize(getWorldCameraPosition() - shading_position);
 }
 
 /**
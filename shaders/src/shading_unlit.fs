@@ -27,7 +27,11 @@ vec4 evaluateMaterial(const MaterialInputs material) {
 
 #if defined(HAS_DIRECTIONAL_LIGHTING)
 #if defined(HAS_SHADOWING)
-    color *= 1.0 - shadow(light_shadowMap, getLightSpacePosition());
+    if (frameUniforms.directionalShadows > 0.0) {
+        color *= 1.0 - shadow(light_shadowMap, getLightSpacePosition());
+    } else {
+        color = vec4(0.0);
+    }
 #else
     color = vec4(0.0);
 #endif
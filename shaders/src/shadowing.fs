@@ -15,16 +15,32 @@
 
 #define SHADOW_RECEIVER_PLANE_DEPTH_BIAS_MIN_SAMPLING_METHOD    SHADOW_SAMPLING_PCF_MEDIUM
 
+// The sampling method is chosen per view (frameUniforms.shadowSamplingMethod), and
+// SHADOW_SAMPLING_METHOD is the most expensive method compiled in the shaders: the view's method
+// is clamped to it. The branch on the method is uniform, only the selected method's taps are paid.
 #ifdef TARGET_MOBILE
-  #define SHADOW_SAMPLING_METHOD            SHADOW_SAMPLING_PCF_LOW
+  #define SHADOW_SAMPLING_METHOD            SHADOW_SAMPLING_PCF_MEDIUM
   #define SHADOW_SAMPLING_ERROR             SHADOW_SAMPLING_ERROR_DISABLED
   #define SHADOW_RECEIVER_PLANE_DEPTH_BIAS  SHADOW_RECEIVER_PLANE_DEPTH_BIAS_DISABLED
 #else
-  #define SHADOW_SAMPLING_METHOD            SHADOW_SAMPLING_PCF_LOW
+  #define SHADOW_SAMPLING_METHOD            SHADOW_SAMPLING_PCF_HIGH
   #define SHADOW_SAMPLING_ERROR             SHADOW_SAMPLING_ERROR_DISABLED
   #define SHADOW_RECEIVER_PLANE_DEPTH_BIAS  SHADOW_RECEIVER_PLANE_DEPTH_BIAS_DISABLED
 #endif
 
+// With Vulkan, the most expensive method is a specialization constant set when the pipeline is
+// created: every method is compiled and the ones above it are eliminated by the driver.
+// SHADOW_SAMPLING_METHOD is only the constant's default value, and still selects the receiver
+// plane depth bias.
+#if defined(TARGET_VULKAN_ENVIRONMENT)
+  #define SHADOW_SAMPLING_SPECIALIZED
+layout(constant_id = SPECIALIZATION_ID_SHADOW_SAMPLING_METHOD)
+        const int shadowSamplingMethod = SHADOW_SAMPLING_METHOD;
+  #define SHADOW_SAMPLING_MAX_METHOD        shadowSamplingMethod
+#else
+  #define SHADOW_SAMPLING_MAX_METHOD        SHADOW_SAMPLING_METHOD
+#endif
+
 #if SHADOW_SAMPLING_ERROR == SHADOW_SAMPLING_ERROR_ENABLED
   #undef SHADOW_RECEIVER_PLANE_DEPTH_BIAS
   #define SHADOW_RECEIVER_PLANE_DEPTH_BIAS  SHADOW_RECEIVER_PLANE_DEPTH_BIAS_ENABLED
@@ -68,15 +84,13 @@ float sampleDepth(const lowp sampler2DShadow map, vec2 base, vec2 dudv, float de
     return texture(map, vec3(base + dudv, depth));
 }
 
-#if SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_HARD
 float ShadowSample_Hard(const lowp sampler2DShadow map, const vec2 size, const vec3 position) {
     vec2 rpdb = computeReceiverPlaneDepthBias(position);
     float depth = samplingBias(position.z, rpdb, vec2(1.0) / size);
     return texture(map, vec3(position.xy, depth));
 }
-#endif
 
-#if SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_LOW
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_LOW || defined(SHADOW_SAMPLING_SPECIALIZED)
 float ShadowSample_PCF_Low(const lowp sampler2DShadow map, const vec2 size, const vec3 position) {
     //  Castaño, 2013, "Shadow Mapping Summary Part 1"
     vec2 texelSize = vec2(1.0) / size;
@@ -110,7 +124,7 @@ float ShadowSample_PCF_Low(const lowp sampler2DShadow map, const vec2 size, cons
 }
 #endif
 
-#if SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_MEDIUM
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_MEDIUM || defined(SHADOW_SAMPLING_SPECIALIZED)
 float ShadowSample_PCF_Medium(const lowp sampler2DShadow map, const vec2 size, const vec3 position) {
     //  Castaño, 2013, "Shadow Mapping Summary Part 1"
     vec2 texelSize = vec2(1.0) / size;
@@ -150,7 +164,7 @@ float ShadowSample_PCF_Medium(const lowp sampler2DShadow map, const vec2 size, c
 }
 #endif
 
-#if SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_HIGH
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_HIGH || defined(SHADOW_SAMPLING_SPECIALIZED)
 float ShadowSample_PCF_High(const lowp sampler2DShadow map, const vec2 size, const vec3 position) {
     //  Castaño, 2013, "Shadow Mapping Summary Part 1"
     vec2 texelSize = vec2(1.0) / size;
@@ -225,13 +239,68 @@ float ShadowSample_PCF_High(const lowp sampler2DShadow map, const vec2 size, con
  */
 float shadow(const lowp sampler2DShadow shadowMap, const vec3 shadowPosition) {
     vec2 size = vec2(textureSize(shadowMap, 0));
-#if SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_HARD
+    int method = min(frameUniforms.shadowSamplingMethod, SHADOW_SAMPLING_MAX_METHOD);
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_HIGH || defined(SHADOW_SAMPLING_SPECIALIZED)
+    if (method == SHADOW_SAMPLING_PCF_HIGH) {
+        return ShadowSample_PCF_High(shadowMap, size, shadowPosition);
+    }
+#endif
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_MEDIUM || defined(SHADOW_SAMPLING_SPECIALIZED)
+    if (method == SHADOW_SAMPLING_PCF_MEDIUM) {
+        return ShadowSample_PCF_Medium(shadowMap, size, shadowPosition);
+    }
+#endif
+#if SHADOW_SAMPLING_METHOD >= SHADOW_SAMPLING_PCF_LOW || defined(SHADOW_SAMPLING_SPECIALIZED)
+    if (method == SHADOW_SAMPLING_PCF_LOW) {
+        return ShadowSample_PCF_Low(shadowMap, size, shadowPosition);
+    }
+#endif
     return ShadowSample_Hard(shadowMap, size, shadowPosition);
-#elif SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_LOW
-    return ShadowSample_PCF_Low(shadowMap, size, shadowPosition);
-#elif SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_MEDIUM
-    return ShadowSample_PCF_Medium(shadowMap, size, shadowPosition);
-#elif SHADOW_SAMPLING_METHOD == SHADOW_SAMPLING_PCF_HIGH
-    return ShadowSample_PCF_High(shadowMap, size, shadowPosition);
+}
+
+//------------------------------------------------------------------------------
+// Shadow cascades
+//------------------------------------------------------------------------------
+
+#if defined(HAS_SHADOWING) && defined(HAS_DIRECTIONAL_LIGHTING)
+/**
+ * Returns the index of the shadow cascade covering the specified world space
+ * position, i.e. the number of cascades that end before the position's view space
+ * depth. The last cascade (and the unused ones) end at infinity.
+ */
+uint getShadowCascade(const HIGHP vec3 position) {
+    HIGHP float z = -(frameUniforms.viewFromWorldMatrix * vec4(position, 1.0)).z;
+    vec4 greater = step(frameUniforms.shadowCascadeSplits, vec4(z));
+    return uint(min(dot(greater, vec4(1.0)), 3.0));
+}
+
+/**
+ * Returns the position of the current fragment in the light space of its shadow
+ * cascade, biased with the cascade's constant and normal biases.
+ */
+HIGHP vec3 getLightSpacePosition() {
+    uint cascade = getShadowCascade(vertex_worldPosition);
+    HIGHP vec3 p = vertex_worldPosition +
+            vertex_shadowNormalOffset * frameUniforms.shadowNormalBias[cascade];
+    HIGHP vec4 lightSpacePosition = frameUniforms.lightFromWorldMatrix[cascade] * vec4(p, 1.0);
+    lightSpacePosition.z -= frameUniforms.shadowConstantBias[cascade];
+    return lightSpacePosition.xyz * (1.0 / lightSpacePosition.w);
+}
 #endif
+
+//------------------------------------------------------------------------------
+// Spot light shadows
+//------------------------------------------------------------------------------
+
+#if defined(HAS_SHADOWING) && defined(HAS_DYNAMIC_LIGHTING)
+/**
+ * Returns the visibility of the spot light whose shadow map is at the specified
+ * index in the shadow atlas. l is the normalized direction to the light, bias the
+ * light's constant bias in world units, applied towards the light.
+ */
+float spotShadow(const uint index, const vec3 l, const float bias) {
+    HIGHP vec3 p = vertex_worldPosition + l * bias;
+    HIGHP vec4 lightSpacePosition = frameUniforms.spotLightFromWorldMatrix[index] * vec4(p, 1.0);
+    return shadow(light_spotShadowAtlas, lightSpacePosition.xyz * (1.0 / lightSpacePosition.w));
 }
+#endif
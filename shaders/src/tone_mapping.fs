@@ -14,15 +14,9 @@
 // Debug operators
 #define TONE_MAPPING_DISPLAY_RANGE    9
 
-#ifdef TARGET_MOBILE
-    #ifdef HAS_HARDWARE_CONVERSION_FUNCTION
-        #define TONE_MAPPING_OPERATOR TONE_MAPPING_ACES
-    #else
-        #define TONE_MAPPING_OPERATOR TONE_MAPPING_UNREAL
-    #endif
-#else
-    #define TONE_MAPPING_OPERATOR     TONE_MAPPING_ACES
-#endif
+// The post-process tone mapping uses the operator baked in the color grading LUT (see
+// colorGrade()), which is always ACES: its cost doesn't matter on mobile anymore
+#define TONE_MAPPING_OPERATOR     TONE_MAPPING_ACES
 
 //------------------------------------------------------------------------------
 // Tone-mapping operators for LDR output
@@ -156,6 +150,37 @@ vec3 tonemap(const vec3 x) {
 #endif
 }
 
+//------------------------------------------------------------------------------
+// Color grading
+//------------------------------------------------------------------------------
+
+// these must match ColorGrading::LUT_* in ColorGrading.h
+#define COLOR_GRADING_LUT_SIZE       32.0
+#define COLOR_GRADING_LUT_LOG2_MIN  -10.0
+#define COLOR_GRADING_LUT_LOG2_MAX    6.0
+
+/**
+ * Color grades and tone-maps the specified RGB color, using the 3D LUT baked by the CPU.
+ * The input color must be in linear HDR and pre-exposed, the output is in sRGB space (the
+ * LUT includes the opto-electronic conversion function). The LUT is indexed by the log2 of
+ * the color, and stores its slices along blue side by side.
+ */
+vec3 colorGrade(const vec3 x) {
+    vec3 v = (log2(max(x, vec3(FLT_EPS))) - COLOR_GRADING_LUT_LOG2_MIN) *
+            (1.0 / (COLOR_GRADING_LUT_LOG2_MAX - COLOR_GRADING_LUT_LOG2_MIN));
+    v = saturate(v) * (COLOR_GRADING_LUT_SIZE - 1.0);
+
+    float slice = floor(v.b);
+    float t = v.b - slice;
+    vec2 uv = (vec2(v.r + slice * COLOR_GRADING_LUT_SIZE, v.g) + 0.5) *
+            vec2(1.0 / (COLOR_GRADING_LUT_SIZE * COLOR_GRADING_LUT_SIZE),
+                 1.0 / COLOR_GRADING_LUT_SIZE);
+    vec3 c0 = textureLod(postProcess_colorGrading, uv, 0.0).rgb;
+    vec3 c1 = textureLod(postProcess_colorGrading,
+            uv + vec2(1.0 / COLOR_GRADING_LUT_SIZE, 0.0), 0.0).rgb;
+    return mix(c0, c1, t);
+}
+
 //------------------------------------------------------------------------------
 // Processing tone-mappers
 //------------------------------------------------------------------------------
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <iostream>
 #include <vector>
 
 #include "CubemapIBL.h"
@@ -33,6 +34,10 @@ using namespace utils;
 
 extern bool g_quiet;
 
+// DEBUG: enable this to check the filtered texels against rotating the samples in double
+// precision, the results must match within a relative 1e-3
+static constexpr bool VALIDATE_FLOAT_ROTATION = false;
+
 static double pow5(double x) {
     return (x*x)*(x*x)*x;
 }
@@ -110,7 +115,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
 
     // be careful w/ the size of this structure, the smaller the better
     struct CacheEntry {
-        double3 L;
+        float3 L;
         float brdf_NoL;
         float lerp;
         uint8_t l0;
@@ -197,7 +202,7 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
             uint8_t l0 = uint8_t(mipLevel);
             uint8_t l1 = uint8_t(std::min(maxLevel, size_t(l0 + 1)));
             float lerp = mipLevel - l0;
-            cache.push_back({ L, brdf_NoL, lerp, l0, l1 });
+            cache.push_back({ float3(L), brdf_NoL, lerp, l0, l1 });
             sample++;
         }
 
@@ -239,28 +244,75 @@ void CubemapIBL::roughnessFilter(Cubemap& dst,
             return;
         }
 
-        mat3 R;
+        // The texels are filtered in groups, so that rotating a sample into the tangent frame
+        // of each texel of the group vectorizes, and each entry of the cache is loaded once
+        // per group.
+        constexpr size_t GROUP_SIZE = 4;
         const size_t numSamples = cache.size();
-        for (size_t x=0 ; x<dim ; ++x, ++data) {
-            const double2 p(dst.center(x, y));
-            const double3 N(dst.getDirectionFor(f, p.x, p.y));
-
-            // center the cone around the normal (handle case of normal close to up)
-            const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
-            R[0] = normalize(cross(up, N));
-            R[1] = cross(N, R[0]);
-            R[2] = N;
+        for (size_t x0=0 ; x0<dim ; x0+=GROUP_SIZE) {
+            const size_t count = std::min(GROUP_SIZE, dim - x0);
+
+            // the tangent frames of the group, as a structure of arrays
+            float Tx[GROUP_SIZE], Ty[GROUP_SIZE], Tz[GROUP_SIZE];
+            float Bx[GROUP_SIZE], By[GROUP_SIZE], Bz[GROUP_SIZE];
+            float Nx[GROUP_SIZE], Ny[GROUP_SIZE], Nz[GROUP_SIZE];
+            for (size_t i=0 ; i<GROUP_SIZE ; i++) {
+                // the last group is padded with its last texel
+                const double2 p(dst.center(x0 + std::min(i, count - 1), y));
+                const double3 N(dst.getDirectionFor(f, p.x, p.y));
+                // center the cone around the normal (handle case of normal close to up)
+                const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
+                const double3 T = normalize(cross(up, N));
+                const double3 B = cross(N, T);
+                Tx[i] = float(T.x); Ty[i] = float(T.y); Tz[i] = float(T.z);
+                Bx[i] = float(B.x); By[i] = float(B.y); Bz[i] = float(B.z);
+                Nx[i] = float(N.x); Ny[i] = float(N.y); Nz[i] = float(N.z);
+            }
 
-            float3 Li = 0;
+            float3 Li[GROUP_SIZE] = {};
             for (size_t sample = 0; sample < numSamples; sample++) {
                 const CacheEntry& e = cache[sample];
-                const double3 L(R * e.L);
+                float Lx[GROUP_SIZE], Ly[GROUP_SIZE], Lz[GROUP_SIZE];
+                for (size_t i=0 ; i<GROUP_SIZE ; i++) {
+                    Lx[i] = Tx[i] * e.L.x + Bx[i] * e.L.y + Nx[i] * e.L.z;
+                    Ly[i] = Ty[i] * e.L.x + By[i] * e.L.y + Ny[i] * e.L.z;
+                    Lz[i] = Tz[i] * e.L.x + Bz[i] * e.L.y + Nz[i] * e.L.z;
+                }
                 const Cubemap& cmBase = levels[e.l0];
                 const Cubemap& next = levels[e.l1];
-                const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
-                Li += c0 * e.brdf_NoL;
+                for (size_t i=0 ; i<count ; i++) {
+                    const double3 L(Lx[i], Ly[i], Lz[i]);
+                    const float3 c0 = Cubemap::trilinearFilterAt(cmBase, next, e.lerp, L);
+                    Li[i] += c0 * e.brdf_NoL;
+                }
+            }
+
+            for (size_t i=0 ; i<count ; i++, ++data) {
+                if (VALIDATE_FLOAT_ROTATION) {
+                    // the same integration, rotating the samples in double precision
+                    const double2 p(dst.center(x0 + i, y));
+                    const double3 N(dst.getDirectionFor(f, p.x, p.y));
+                    const double3 up = std::abs(N.z)<0.999 ? double3(0,0,1) : double3(1,0,0);
+                    mat3 R;
+                    R[0] = normalize(cross(up, N));
+                    R[1] = cross(N, R[0]);
+                    R[2] = N;
+                    float3 reference = 0;
+                    for (const CacheEntry& e : cache) {
+                        const double3 L(R * double3(e.L));
+                        reference += Cubemap::trilinearFilterAt(
+                                levels[e.l0], levels[e.l1], e.lerp, L) * e.brdf_NoL;
+                    }
+                    const float3 error = abs(Li[i] - reference);
+                    const float tolerance = 1e-3f * std::max(1.0f, max(reference));
+                    if (max(error) > tolerance) {
+                        std::cerr << "roughnessFilter: texel (" << x0 + i << ", " << y
+                                  << ") of face " << int(f) << " is off by " << max(error)
+                                  << std::endl;
+                    }
+                }
+                Cubemap::writeAt(data, Cubemap::Texel(Li[i]));
             }
-            Cubemap::writeAt(data, Cubemap::Texel(Li));
         }
     });
 
@@ -15,6 +15,7 @@
  */
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <fstream>
@@ -24,8 +25,10 @@
 #include <math/scalar.h>
 #include <math/vec4.h>
 
+#include <imageio/AsyncImageEncoder.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
+#include <imageio/KtxEncoder.h>
 
 #include <utils/Path.h>
 
@@ -46,6 +49,7 @@ enum class ShFile {
 };
 static image::ImageEncoder::Format g_format = image::ImageEncoder::Format::PNG;
 static std::string g_compression = "";
+static bool g_ktx = false;
 static bool g_extract_faces = false;
 static double g_extract_blur = 0.0;
 static utils::Path g_extract_dir;
@@ -77,8 +81,37 @@ static size_t g_num_samples = 1024;
 
 static bool g_mirror = false;
 
+static utils::Path g_manifest_filename;
+
+static size_t g_memory_budget = 0;
+
+// what was done for an input, written to the --manifest file
+struct InputReport {
+    std::string input;
+    bool succeeded = false;
+    std::vector<std::string> outputs;
+    // seconds spent in each step
+    std::vector<std::pair<std::string, double>> timings;
+};
+
+class Timer {
+public:
+    // returns the seconds elapsed since the previous call, or the construction
+    double lap() noexcept {
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - mStart;
+        mStart = now;
+        return elapsed.count();
+    }
+private:
+    std::chrono::steady_clock::time_point mStart = std::chrono::steady_clock::now();
+};
+
 // -----------------------------------------------------------------------------------------------
 
+static bool processInput(const utils::Path& iname, InputReport& report);
+static bool decodeEquirectangularBands(const utils::Path& iname, size_t budget, Image& dst);
+static void writeManifest(const utils::Path& filename, const std::vector<InputReport>& reports);
 static void generateMipmaps(std::vector<Cubemap>& levels, std::vector<Image>& images);
 static void sphericalHarmonics(const utils::Path& iname, const Cubemap& inputCubemap);
 static void iblRoughnessPrefilter(const utils::Path& iname, const std::vector<Cubemap>& levels,
@@ -87,6 +120,7 @@ static void iblMipmapPrefilter(const utils::Path& iname, const std::vector<Image
         const std::vector<Cubemap>& levels, const utils::Path& dir);
 static void iblLutDfg(const utils::Path& filename, size_t size = 128, bool multiscatter = false);
 static void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const utils::Path& dir);
+static void writeKtx(const utils::Path& filename, const std::vector<Cubemap const*>& levels);
 static void outputSh(std::ostream& out, const std::unique_ptr<math::double3[]>& sh, size_t numBands);
 static void outputSpectrum(std::ostream& out, const std::unique_ptr<math::double3[]>& sh,
         size_t numBands);
@@ -100,7 +134,7 @@ static void printUsage(char* name) {
     std::string usage(
             "CMGEN is a command-line tool for generating SH and mipmap levels from a cubemap\n"
             "Usages:\n"
-            "    CMGEN [options] <input-file>\n"
+            "    CMGEN [options] <input-file> [<input-file>...]\n"
             "    CMGEN [options] <uv[N]>\n"
             "\n"
             "Supported input formats:\n"
@@ -116,8 +150,9 @@ static void printUsage(char* name) {
             "       Print copyright and license information\n\n"
             "   --quiet, -q\n"
             "       Quiet mode. Suppress all non-error output\n\n"
-            "   --format=[exr|hdr|psd|rgbm|png|dds], -f [exr|hdr|psd|rgbm|png|dds]\n"
-            "       specify output file format\n\n"
+            "   --format=[exr|hdr|psd|rgbm|png|dds|ktx], -f [exr|hdr|psd|rgbm|png|dds|ktx]\n"
+            "       specify output file format, ktx writes a single RGB9_E5 cubemap per output\n"
+            "       with all its mipmaps, which can be used as an IndirectLight's reflections\n\n"
             "   --compression=COMPRESSION, -c COMPRESSION\n"
             "       format specific compression:\n"
             "           PNG: Ignored\n"
@@ -138,6 +173,14 @@ static void printUsage(char* name) {
             "       Mirrors generated cubemaps for reflections\n\n"
             "   --ibl-samples=numSamples\n"
             "       Number of samples tu use for IBL integrations (default 1024)\n\n"
+            "   --memory-budget=megabytes\n"
+            "       Decodes equirectangular Radiance inputs band by band, downsampled to fit\n"
+            "       in this budget, instead of decoding them entirely\n\n"
+            "   --manifest=filename.json\n"
+            "       Writes the outputs of each input, and the time spent in each step\n\n"
+            "   --quality=[low|medium|high|ultra]\n"
+            "       Picks the number of samples of the IBL integrations, doubled for each\n"
+            "       level after the first two: 128, 512, 1024 (high, default) or 4096\n\n"
             "\n"
             "Private use only:\n"
             "   --ibl-dfg=filename.[exr|hdr|psd|png|rgbm|dds|h|hpp|c|cpp|inc|txt]\n"
@@ -192,6 +235,9 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             { "ibl-dfg",              required_argument, 0, 'a' },
             { "ibl-dfg-multiscatter",       no_argument, 0, 'u' },
             { "ibl-samples",          required_argument, 0, 'k' },
+            { "quality",              required_argument, 0, 'g' },
+            { "manifest",             required_argument, 0, 'n' },
+            { "memory-budget",        required_argument, 0, 'w' },
             { "deploy",               required_argument, 0, 'x' },
             { "mirror",                     no_argument, 0, 'm' },
             { "debug",                      no_argument, 0, 'd' },
@@ -241,6 +287,10 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
                     g_format = ImageEncoder::Format::DDS_LINEAR;
                     format_specified = true;
                 }
+                if (arg == "ktx") {
+                    g_ktx = true;
+                    format_specified = true;
+                }
                 break;
             case 'c':
                 g_compression = arg;
@@ -309,6 +359,26 @@ static int handleCommandLineArgments(int argc, char* argv[]) {
             case 'k':
                 g_num_samples = (size_t)std::stoi(arg);
                 break;
+            case 'g':
+                if (arg == "low") {
+                    g_num_samples = 128;
+                } else if (arg == "medium") {
+                    g_num_samples = 512;
+                } else if (arg == "high") {
+                    g_num_samples = 1024;
+                } else if (arg == "ultra") {
+                    g_num_samples = 4096;
+                } else {
+                    std::cerr << "Unrecognized quality, must be low, medium, high or ultra"
+                              << std::endl;
+                }
+                break;
+            case 'n':
+                g_manifest_filename = arg;
+                break;
+            case 'w':
+                g_memory_budget = size_t(std::stoul(arg)) * 1024 * 1024;
+                break;
             case 'x':
                 g_deploy = true;
                 g_deploy_dir = arg;
@@ -349,8 +419,25 @@ int main(int argc, char* argv[]) {
         if (num_args < 1) return 0;
     }
 
-    std::string command(argv[option_index]);
-    utils::Path iname(command);
+    bool succeeded = true;
+    std::vector<InputReport> reports;
+    for (int i = option_index; i < argc; i++) {
+        InputReport report;
+        report.input = argv[i];
+        report.succeeded = processInput(utils::Path(argv[i]), report);
+        succeeded = succeeded && report.succeeded;
+        reports.push_back(std::move(report));
+    }
+
+    if (!g_manifest_filename.isEmpty()) {
+        writeManifest(g_manifest_filename, reports);
+    }
+
+    return succeeded ? 0 : 1;
+}
+
+bool processInput(const utils::Path& iname, InputReport& report) {
+    Timer timer;
 
     if (g_deploy) {
         utils::Path out_dir = g_deploy_dir + iname.getNameWithoutExtension();
@@ -385,7 +472,22 @@ int main(int argc, char* argv[]) {
     // Cubemaps are just views on Images
     std::vector<Cubemap> levels;
 
-    if (iname.exists()) {
+    Image equirect;
+    if (g_memory_budget && iname.exists() &&
+            decodeEquirectangularBands(iname, g_memory_budget, equirect)) {
+        CubemapUtils::clamp(equirect);
+        size_t dim = g_output_size ? g_output_size : 256;
+        if (!g_quiet) {
+            std::cout << "Converting equirectangular image... " << std::endl;
+        }
+        Image temp;
+        Cubemap cml = CubemapUtils::create(temp, dim);
+        CubemapUtils::equirectangularToCubemap(cml, equirect);
+        cml.makeSeamless();
+        images.push_back(std::move(temp));
+        levels.push_back(std::move(cml));
+        equirect = Image();
+    } else if (iname.exists()) {
         if (!g_quiet) {
             std::cout << "Decoding image..." << std::endl;
         }
@@ -393,7 +495,7 @@ int main(int argc, char* argv[]) {
         Image inputImage = ImageDecoder::decode(input_stream, iname.getPath());
         if (!inputImage.isValid()) {
             std::cerr << "Unsupported image format!" << std::endl;
-            exit(0);
+            return false;
         }
 
         CubemapUtils::clamp(inputImage);
@@ -431,7 +533,7 @@ int main(int argc, char* argv[]) {
             std::cerr << "  2:1, lat/long or equirectangular" << std::endl;
             std::cerr << "  3:4, vertical cross (width must be power of two)" << std::endl;
             std::cerr << "  4:3, horizontal cross (height must be power of two)" << std::endl;
-            exit(0);
+            return false;
         }
     } else {
         if (!g_quiet) {
@@ -458,6 +560,8 @@ int main(int argc, char* argv[]) {
         levels.push_back(std::move(cml));
     }
 
+    report.timings.emplace_back("decode", timer.lap());
+
     // Now generate all the mipmap levels
     generateMipmaps(levels, images);
 
@@ -483,12 +587,18 @@ int main(int argc, char* argv[]) {
         std::swap(images, mirrorImages);
     }
 
+    report.timings.emplace_back("mipmaps", timer.lap());
+
     if (g_sh_compute) {
         if (!g_quiet) {
             std::cout << "Spherical harmonics..." << std::endl;
         }
         Cubemap const& cm(levels[0]);
         sphericalHarmonics(iname, cm);
+        if (g_sh_file != ShFile::SH_NONE) {
+            report.outputs.push_back(g_sh_filename.getAbsolutePath());
+        }
+        report.timings.emplace_back("sh", timer.lap());
     }
 
     if (g_is_mipmap) {
@@ -496,6 +606,9 @@ int main(int argc, char* argv[]) {
             std::cout << "IBL mipmaps for prefiltered importance sampling..." << std::endl;
         }
         iblMipmapPrefilter(iname, images, levels, g_is_mipmap_dir);
+        report.outputs.push_back(
+                g_is_mipmap_dir.getAbsolutePath() + iname.getNameWithoutExtension());
+        report.timings.emplace_back("ibl-is-mipmap", timer.lap());
     }
 
     if (g_prefilter) {
@@ -503,6 +616,9 @@ int main(int argc, char* argv[]) {
             std::cout << "IBL prefiltering..." << std::endl;
         }
         iblRoughnessPrefilter(iname, levels, g_prefilter_dir);
+        report.outputs.push_back(
+                g_prefilter_dir.getAbsolutePath() + iname.getNameWithoutExtension());
+        report.timings.emplace_back("ibl-ld", timer.lap());
     }
 
     if (g_extract_faces) {
@@ -526,9 +642,105 @@ int main(int argc, char* argv[]) {
             }
             extractCubemapFaces(iname, cm, g_extract_dir);
         }
+        report.outputs.push_back(
+                g_extract_dir.getAbsolutePath() + iname.getNameWithoutExtension());
+        report.timings.emplace_back("extract", timer.lap());
     }
 
-    return 0;
+    return true;
+}
+
+// Decodes an equirectangular image band by band and box-filters it down, by a power of two,
+// until it fits in the budget, the whole image is never in memory.
+// Returns false if the image is not equirectangular, so it can be decoded the regular way.
+bool decodeEquirectangularBands(const utils::Path& iname, size_t budget, Image& dst) {
+    if (!g_quiet) {
+        std::cout << "Decoding image by bands..." << std::endl;
+    }
+    // a band of 16 rows of a 16k wide image is 3 MB
+    constexpr size_t BAND_HEIGHT = 16;
+
+    size_t scale = 1;
+    size_t width = 0;
+    std::ifstream input_stream(iname.getPath(), std::ios::binary);
+    bool decoded = ImageDecoder::decodeBands(input_stream, iname.getPath(), BAND_HEIGHT,
+            [&](const Image& band, size_t firstRow, size_t height) {
+        if (firstRow == 0) {
+            width = band.getWidth();
+            if (width != 2 * height) {
+                return false;
+            }
+            while (sq(height / scale) * 2 * sizeof(float3) > budget && height / scale > 1) {
+                scale *= 2;
+            }
+            const size_t w = (width + scale - 1) / scale;
+            const size_t h = (height + scale - 1) / scale;
+            std::unique_ptr<uint8_t[]> data(new uint8_t[w * h * sizeof(float3)]);
+            std::fill_n(reinterpret_cast<float3*>(data.get()), w * h, float3(0));
+            dst = Image(std::move(data), w, h, w * sizeof(float3), sizeof(float3));
+            dst.setFlags(band.getFlags());
+        }
+        for (size_t y = 0; y < band.getHeight(); y++) {
+            float3 const* src = static_cast<float3 const*>(band.getPixelRef(0, y));
+            float3* row = static_cast<float3*>(dst.getPixelRef(0, (firstRow + y) / scale));
+            for (size_t x = 0; x < width; x++) {
+                row[x / scale] += src[x];
+            }
+        }
+        return true;
+    });
+
+    if (!decoded || !dst.isValid()) {
+        dst = Image();
+        return false;
+    }
+
+    // the last row and column may have been accumulated from fewer texels
+    const size_t height = width / 2;
+    for (size_t y = 0; y < dst.getHeight(); y++) {
+        const size_t rows = std::min(scale, height - y * scale);
+        float3* row = static_cast<float3*>(dst.getPixelRef(0, y));
+        for (size_t x = 0; x < dst.getWidth(); x++) {
+            const size_t columns = std::min(scale, width - x * scale);
+            row[x] *= 1.0f / (rows * columns);
+        }
+    }
+    return true;
+}
+
+static std::string escapeJson(const std::string& str) {
+    std::string result;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            result.push_back('\\');
+        }
+        result.push_back(c);
+    }
+    return result;
+}
+
+void writeManifest(const utils::Path& filename, const std::vector<InputReport>& reports) {
+    std::ofstream out(filename, std::ios::trunc);
+    out << "{\n  \"inputs\": [";
+    for (size_t i = 0; i < reports.size(); i++) {
+        InputReport const& report = reports[i];
+        out << (i ? ",\n" : "\n") << "    {\n";
+        out << "      \"input\": \"" << escapeJson(report.input) << "\",\n";
+        out << "      \"succeeded\": " << (report.succeeded ? "true" : "false") << ",\n";
+        out << "      \"outputs\": [";
+        for (size_t j = 0; j < report.outputs.size(); j++) {
+            out << (j ? ", " : "") << "\"" << escapeJson(report.outputs[j]) << "\"";
+        }
+        out << "],\n";
+        out << "      \"timings\": {";
+        for (size_t j = 0; j < report.timings.size(); j++) {
+            out << (j ? ", " : "") << "\"" << report.timings[j].first << "\": "
+                << std::fixed << std::setprecision(3) << report.timings[j].second;
+        }
+        out << "}\n";
+        out << "    }";
+    }
+    out << "\n  ]\n}\n";
 }
 
 void generateMipmaps(std::vector<Cubemap>& levels, std::vector<Image>& images) {
@@ -657,6 +869,7 @@ void iblMipmapPrefilter(const utils::Path& iname,
         outputDir.mkdirRecursive();
     }
 
+    AsyncImageEncoder encoder(CubemapUtils::getJobSystem());
     const size_t numLevels = levels.size();
     for (size_t level=0 ; level<numLevels ; level++) {
         Cubemap const& dst(levels[level]);
@@ -672,16 +885,28 @@ void iblMipmapPrefilter(const utils::Path& iname,
                                  g_compression, filePath.getPath());
         }
 
+        if (g_ktx) {
+            continue;
+        }
+
         std::string ext = ImageEncoder::chooseExtension(g_format);
         for (size_t i = 0; i < 6; i++) {
             Cubemap::Face face = (Cubemap::Face)i;
             std::string filename = outputDir
                     + ("is_m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            std::ofstream outputStream(filename, std::ios::binary | std::ios::trunc);
-            ImageEncoder::encode(outputStream, g_format, dst.getImageForFace(face),
-                                 g_compression, filename);
+            encoder.encode(filename, g_format, dst.getImageForFace(face), g_compression);
         }
     }
+    if (g_ktx) {
+        std::vector<Cubemap const*> ktxLevels;
+        for (Cubemap const& cm : levels) {
+            ktxLevels.push_back(&cm);
+        }
+        writeKtx(outputDir + "is.ktx", ktxLevels);
+    }
+    if (!encoder.wait()) {
+        std::cerr << "Could not write all the files in " << outputDir << std::endl;
+    }
 }
 
 void iblRoughnessPrefilter(const utils::Path& iname,
@@ -699,6 +924,12 @@ void iblRoughnessPrefilter(const utils::Path& iname,
     const size_t baseExp = __builtin_ctz(g_output_size ? g_output_size : 256);
     size_t numSamples = g_num_samples;
     const size_t numLevels = baseExp + 1;
+
+    // the faces of a level are written while the next levels are filtered, so the levels are
+    // kept until they're all written
+    AsyncImageEncoder encoder(CubemapUtils::getJobSystem());
+    std::vector<Image> images;
+    std::vector<Cubemap> cubemaps;
     for (ssize_t i=baseExp ; i>=0 ; --i) {
         const size_t dim = 1U << (DEBUG_FULL_RESOLUTION ? baseExp : i);
         const size_t level = baseExp - i;
@@ -732,15 +963,30 @@ void iblRoughnessPrefilter(const utils::Path& iname,
                                  g_compression, filePath.getPath());
         }
 
+        if (g_ktx) {
+            images.push_back(std::move(image));
+            cubemaps.push_back(std::move(dst));
+            continue;
+        }
+
         std::string ext = ImageEncoder::chooseExtension(g_format);
         for (size_t j = 0; j < 6; j++) {
             Cubemap::Face face = (Cubemap::Face) j;
             std::string filename = outputDir
                     + ("m" + std::to_string(level) + "_" + CubemapUtils::getFaceName(face) + ext);
-            std::ofstream outputStream(filename, std::ios::binary | std::ios::trunc);
-            ImageEncoder::encode(outputStream, g_format, dst.getImageForFace(face),
-                                 g_compression, filename);
+            encoder.encode(filename, g_format, dst.getImageForFace(face), g_compression);
+        }
+        images.push_back(std::move(image));
+    }
+    if (g_ktx) {
+        std::vector<Cubemap const*> ktxLevels;
+        for (Cubemap const& cm : cubemaps) {
+            ktxLevels.push_back(&cm);
         }
+        writeKtx(outputDir + "specular.ktx", ktxLevels);
+    }
+    if (!encoder.wait()) {
+        std::cerr << "Could not write all the files in " << outputDir << std::endl;
     }
 }
 
@@ -804,12 +1050,36 @@ void extractCubemapFaces(const utils::Path& iname, const Cubemap& cm, const util
     if (!outputDir.exists()) {
         outputDir.mkdirRecursive();
     }
+    if (g_ktx) {
+        writeKtx(outputDir + "skybox.ktx", { &cm });
+        return;
+    }
+    AsyncImageEncoder encoder(CubemapUtils::getJobSystem());
     std::string ext = ImageEncoder::chooseExtension(g_format);
     for (size_t i=0 ; i<6 ; i++) {
         Cubemap::Face face = (Cubemap::Face)i;
         std::string filename(outputDir + (CubemapUtils::getFaceName(face) + ext));
-        std::ofstream outputStream(filename, std::ios::binary | std::ios::trunc);
-        ImageEncoder::encode(outputStream, g_format, cm.getImageForFace(face),
-                             g_compression, filename);
+        encoder.encode(filename, g_format, cm.getImageForFace(face), g_compression);
+    }
+    if (!encoder.wait()) {
+        std::cerr << "Could not write all the files in " << outputDir << std::endl;
+    }
+}
+
+void writeKtx(const utils::Path& filename, const std::vector<Cubemap const*>& levels) {
+    // KTX stores the faces in the +X, -X, +Y, -Y, +Z, -Z order
+    static constexpr Cubemap::Face faces[] = {
+            Cubemap::Face::PX, Cubemap::Face::NX,
+            Cubemap::Face::PY, Cubemap::Face::NY,
+            Cubemap::Face::PZ, Cubemap::Face::NZ };
+    std::vector<Image const*> images;
+    for (Cubemap const* cm : levels) {
+        for (Cubemap::Face face : faces) {
+            images.push_back(&cm->getImageForFace(face));
+        }
+    }
+    std::ofstream outputStream(filename, std::ios::binary | std::ios::trunc);
+    if (!KtxEncoder::encodeRGB9E5(outputStream, images.data(), levels.size(), 6)) {
+        std::cerr << "Could not write " << filename << std::endl;
     }
 }
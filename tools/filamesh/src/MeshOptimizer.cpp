@@ -0,0 +1,453 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MeshOptimizer.h"
+
+#include <math/vec2.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace math;
+
+// size of the FIFO cache the statistics and the overdraw clusters are computed with, a
+// conservative size for mobile GPUs
+static constexpr uint32_t FIFO_CACHE_SIZE = 16;
+
+// the LRU cache modeled by Forsyth's algorithm, it works well with FIFO caches of any size
+static constexpr int LRU_CACHE_SIZE = 32;
+
+// resolution of the views the overdraw is measured from
+static constexpr int OVERDRAW_VIEW_SIZE = 256;
+
+// Simulates a FIFO vertex cache, a vertex is in the cache if it was transformed less than
+// FIFO_CACHE_SIZE misses ago.
+class FifoCache {
+public:
+    explicit FifoCache(size_t vertexCount) : mTimestamps(vertexCount, 0) { }
+
+    // returns the number of misses of a triangle
+    uint32_t add(uint32_t const* triangle) noexcept {
+        uint32_t misses = 0;
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t& timestamp = mTimestamps[triangle[k]];
+            if (mTime - timestamp >= FIFO_CACHE_SIZE) {
+                timestamp = mTime++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    void clear() noexcept {
+        mTime += FIFO_CACHE_SIZE;
+    }
+
+private:
+    std::vector<uint32_t> mTimestamps;
+    uint32_t mTime = FIFO_CACHE_SIZE;
+};
+
+// ------------------------------------------------------------------------------------------------
+
+// see Tom Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static float vertexScore(int cachePosition, uint32_t remainingTriangles) noexcept {
+    if (remainingTriangles == 0) {
+        // no triangle needs this vertex
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // the vertices of the last triangle get a fixed score, to avoid strips
+            score = 0.75f;
+        } else {
+            const float scale = 1.0f / (LRU_CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, 1.5f);
+        }
+    }
+    // boost the vertices with few triangles left, so that they don't linger
+    score += 2.0f / std::sqrt(float(remainingTriangles));
+    return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(uint32_t* indices, size_t indexCount,
+        size_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // the triangles of each vertex
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < indexCount; i++) {
+        offsets[indices[i] + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> remaining(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        remaining[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indexCount);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indexCount; i++) {
+            adjacency[cursor[indices[i]]++] = uint32_t(i / 3);
+        }
+    }
+
+    std::vector<float> vertexScores(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        vertexScores[v] = vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScores(triangleCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        uint32_t const* triangle = indices + t * 3;
+        triangleScores[t] = vertexScores[triangle[0]] +
+                vertexScores[triangle[1]] + vertexScores[triangle[2]];
+    }
+
+    std::vector<bool> emitted(triangleCount, false);
+    std::vector<uint32_t> result;
+    result.reserve(indexCount);
+
+    uint32_t cache[LRU_CACHE_SIZE];
+    size_t cacheSize = 0;
+
+    // the next triangle, when none of the vertices in the cache has any left
+    size_t scanCursor = 0;
+    size_t best = 0;
+    for (size_t t = 1; t < triangleCount; t++) {
+        if (triangleScores[t] > triangleScores[best]) {
+            best = t;
+        }
+    }
+
+    while (result.size() < indexCount) {
+        uint32_t const* triangle = indices + best * 3;
+        emitted[best] = true;
+        result.insert(result.end(), triangle, triangle + 3);
+
+        // move the triangle's vertices to the front of the cache, with room for the ones
+        // that were not in it, before it is trimmed
+        uint32_t newCache[LRU_CACHE_SIZE + 3];
+        size_t newCacheSize = 0;
+        for (size_t k = 0; k < 3; k++) {
+            newCache[newCacheSize++] = triangle[k];
+        }
+        for (size_t i = 0; i < cacheSize; i++) {
+            uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                newCache[newCacheSize++] = v;
+            }
+        }
+
+        // the triangle no longer counts for its vertices
+        for (size_t k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            uint32_t* begin = adjacency.data() + offsets[v];
+            uint32_t* end = begin + remaining[v];
+            *std::find(begin, end, uint32_t(best)) = *(end - 1);
+            remaining[v]--;
+        }
+
+        // update the scores of the vertices in the cache and of the ones evicted from it
+        for (size_t i = 0; i < newCacheSize; i++) {
+            uint32_t v = newCache[i];
+            int position = i < LRU_CACHE_SIZE ? int(i) : -1;
+            vertexScores[v] = vertexScore(position, remaining[v]);
+        }
+
+        // update the scores of the triangles of those vertices, and pick the best one
+        float bestScore = -1.0f;
+        bool found = false;
+        for (size_t i = 0; i < newCacheSize; i++) {
+            uint32_t v = newCache[i];
+            for (size_t j = offsets[v], e = offsets[v] + remaining[v]; j < e; j++) {
+                uint32_t t = adjacency[j];
+                uint32_t const* other = indices + t * 3;
+                float score = vertexScores[other[0]] +
+                        vertexScores[other[1]] + vertexScores[other[2]];
+                triangleScores[t] = score;
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+
+        cacheSize = std::min(newCacheSize, size_t(LRU_CACHE_SIZE));
+        std::copy(newCache, newCache + cacheSize, cache);
+
+        if (!found && result.size() < indexCount) {
+            // nothing left around the cache, continue with the next triangle in input order
+            while (emitted[scanCursor]) {
+                scanCursor++;
+            }
+            best = scanCursor;
+        }
+    }
+
+    std::copy(result.begin(), result.end(), indices);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void MeshOptimizer::optimizeOverdraw(uint32_t* indices, size_t indexCount,
+        float3 const* positions, size_t vertexCount, float threshold) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Hard boundaries, where all the vertices of a triangle miss the cache: the triangles on
+    // either side can be reordered without any cost.
+    std::vector<uint32_t> hardClusters;
+    {
+        FifoCache cache(vertexCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            if (cache.add(indices + t * 3) == 3) {
+                hardClusters.push_back(uint32_t(t));
+            }
+        }
+    }
+
+    // Soft boundaries, where a cluster can end as long as its ACMR, starting from an empty
+    // cache, stays within the threshold of the one of its hard cluster.
+    std::vector<uint32_t> clusters;
+    {
+        FifoCache cache(vertexCount);
+        for (size_t c = 0; c < hardClusters.size(); c++) {
+            const size_t begin = hardClusters[c];
+            const size_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+
+            cache.clear();
+            uint32_t misses = 0;
+            for (size_t t = begin; t < end; t++) {
+                misses += cache.add(indices + t * 3);
+            }
+            const float acmr = float(misses) / (end - begin);
+
+            cache.clear();
+            clusters.push_back(uint32_t(begin));
+            misses = 0;
+            size_t start = begin;
+            for (size_t t = begin; t < end; t++) {
+                misses += cache.add(indices + t * 3);
+                const size_t count = t + 1 - start;
+                if (t + 1 < end && float(misses) / count <= acmr * threshold) {
+                    cache.clear();
+                    clusters.push_back(uint32_t(t + 1));
+                    misses = 0;
+                    start = t + 1;
+                }
+            }
+        }
+    }
+
+    // sort the clusters facing outwards first, they are the most likely to occlude the others
+    double3 meshCentroid = 0;
+    double meshArea = 0;
+    struct Cluster {
+        uint32_t begin;
+        uint32_t end;
+        double3 centroid;
+        double3 normal;     // area-weighted
+        double area;
+        float key;
+    };
+    std::vector<Cluster> sorted(clusters.size());
+    for (size_t c = 0; c < clusters.size(); c++) {
+        Cluster& cluster = sorted[c];
+        cluster.begin = clusters[c];
+        cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : uint32_t(triangleCount);
+        cluster.centroid = 0;
+        cluster.normal = 0;
+        cluster.area = 0;
+        for (size_t t = cluster.begin; t < cluster.end; t++) {
+            uint32_t const* triangle = indices + t * 3;
+            const double3 p0(positions[triangle[0]]);
+            const double3 p1(positions[triangle[1]]);
+            const double3 p2(positions[triangle[2]]);
+            const double3 normal = cross(p1 - p0, p2 - p0);
+            const double area = length(normal);
+            cluster.centroid += (p0 + p1 + p2) * (area / 3);
+            cluster.normal += normal;
+            cluster.area += area;
+        }
+        meshCentroid += cluster.centroid;
+        meshArea += cluster.area;
+        if (cluster.area > 0) {
+            cluster.centroid /= cluster.area;
+        }
+    }
+    if (meshArea > 0) {
+        meshCentroid /= meshArea;
+    }
+    for (Cluster& cluster : sorted) {
+        const double normalLength = length(cluster.normal);
+        cluster.key = normalLength > 0 ?
+                float(dot(cluster.centroid - meshCentroid, cluster.normal / normalLength)) :
+                -std::numeric_limits<float>::max();
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [](Cluster const& lhs, Cluster const& rhs) {
+        return lhs.key > rhs.key;
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(indexCount);
+    for (Cluster const& cluster : sorted) {
+        result.insert(result.end(), indices + cluster.begin * 3, indices + cluster.end * 3);
+    }
+    std::copy(result.begin(), result.end(), indices);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+std::vector<uint32_t> MeshOptimizer::optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+        size_t vertexCount) {
+    constexpr uint32_t UNUSED = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> remap(vertexCount, UNUSED);
+    std::vector<uint32_t> order;
+    order.reserve(vertexCount);
+    for (size_t i = 0; i < indexCount; i++) {
+        uint32_t& index = remap[indices[i]];
+        if (index == UNUSED) {
+            index = uint32_t(order.size());
+            order.push_back(indices[i]);
+        }
+        indices[i] = index;
+    }
+    for (size_t v = 0; v < vertexCount; v++) {
+        if (remap[v] == UNUSED) {
+            order.push_back(uint32_t(v));
+        }
+    }
+    return order;
+}
+
+// ------------------------------------------------------------------------------------------------
+
+// Draws the triangles, with back-face culling and a less depth test, looking down an axis.
+// Returns the number of shaded pixels and of covered pixels.
+static void rasterize(uint32_t const* indices, size_t indexCount, float3 const* positions,
+        size_t axis, bool flip, float3 const& bmin, float3 const& bmax,
+        size_t& shaded, size_t& covered) {
+    const size_t u = (axis + 1) % 3;
+    const size_t v = (axis + 2) % 3;
+    const float su = (OVERDRAW_VIEW_SIZE - 1) / std::max(bmax[u] - bmin[u], 1e-6f);
+    const float sv = (OVERDRAW_VIEW_SIZE - 1) / std::max(bmax[v] - bmin[v], 1e-6f);
+
+    std::vector<float> depth(OVERDRAW_VIEW_SIZE * OVERDRAW_VIEW_SIZE,
+            std::numeric_limits<float>::max());
+
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        float2 p[3];
+        float z[3];
+        for (size_t k = 0; k < 3; k++) {
+            float3 const& position = positions[indices[i + k]];
+            p[k] = { (position[u] - bmin[u]) * su, (position[v] - bmin[v]) * sv };
+            z[k] = flip ? -position[axis] : position[axis];
+        }
+
+        // the front faces wind counter-clockwise when looking down -axis, clockwise otherwise
+        float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) -
+                (p[2].x - p[0].x) * (p[1].y - p[0].y);
+        if (flip ? area <= 0 : area >= 0) {
+            // back-facing or degenerate
+            continue;
+        }
+        if (area < 0) {
+            std::swap(p[1], p[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        const int x0 = std::max(0, int(std::floor(std::min({ p[0].x, p[1].x, p[2].x }))));
+        const int x1 = std::min(OVERDRAW_VIEW_SIZE - 1,
+                int(std::ceil(std::max({ p[0].x, p[1].x, p[2].x }))));
+        const int y0 = std::max(0, int(std::floor(std::min({ p[0].y, p[1].y, p[2].y }))));
+        const int y1 = std::min(OVERDRAW_VIEW_SIZE - 1,
+                int(std::ceil(std::max({ p[0].y, p[1].y, p[2].y }))));
+
+        const float ia = 1.0f / area;
+        for (int y = y0; y <= y1; y++) {
+            for (int x = x0; x <= x1; x++) {
+                const float2 c(x + 0.5f, y + 0.5f);
+                const float w0 = (p[2].x - p[1].x) * (c.y - p[1].y) - (p[2].y - p[1].y) * (c.x - p[1].x);
+                const float w1 = (p[0].x - p[2].x) * (c.y - p[2].y) - (p[0].y - p[2].y) * (c.x - p[2].x);
+                const float w2 = (p[1].x - p[0].x) * (c.y - p[0].y) - (p[1].y - p[0].y) * (c.x - p[0].x);
+                if (w0 < 0 || w1 < 0 || w2 < 0) {
+                    continue;
+                }
+                const float d = (w0 * z[0] + w1 * z[1] + w2 * z[2]) * ia;
+                float& stored = depth[y * OVERDRAW_VIEW_SIZE + x];
+                if (d < stored) {
+                    covered += stored == std::numeric_limits<float>::max() ? 1 : 0;
+                    stored = d;
+                    shaded++;
+                }
+            }
+        }
+    }
+}
+
+MeshOptimizer::Statistics MeshOptimizer::analyze(uint32_t const* indices, size_t indexCount,
+        float3 const* positions, size_t vertexCount) {
+    Statistics stats;
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return stats;
+    }
+
+    FifoCache cache(vertexCount);
+    size_t misses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        misses += cache.add(indices + t * 3);
+    }
+    std::vector<bool> referenced(vertexCount, false);
+    size_t referencedCount = 0;
+    for (size_t i = 0; i < indexCount; i++) {
+        if (!referenced[indices[i]]) {
+            referenced[indices[i]] = true;
+            referencedCount++;
+        }
+    }
+    stats.acmr = float(misses) / triangleCount;
+    stats.atvr = float(misses) / referencedCount;
+
+    float3 bmin(std::numeric_limits<float>::max());
+    float3 bmax(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < indexCount; i++) {
+        bmin = min(bmin, positions[indices[i]]);
+        bmax = max(bmax, positions[indices[i]]);
+    }
+
+    size_t shaded = 0;
+    size_t covered = 0;
+    for (size_t axis = 0; axis < 3; axis++) {
+        rasterize(indices, indexCount, positions, axis, false, bmin, bmax, shaded, covered);
+        rasterize(indices, indexCount, positions, axis, true, bmin, bmax, shaded, covered);
+    }
+    stats.overdraw = covered ? float(shaded) / covered : 0.0f;
+
+    return stats;
+}
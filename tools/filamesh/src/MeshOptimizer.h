@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMESH_MESHOPTIMIZER_H
+#define TNT_FILAMESH_MESHOPTIMIZER_H
+
+#include <math/vec3.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/*
+ * Reorders the triangles and the vertices of a triangle list for the GPU:
+ *  - optimizeVertexCache() for the post-transform vertex cache (Tom Forsyth's algorithm),
+ *  - optimizeOverdraw() then sorts clusters of the result so the ones facing outwards are drawn
+ *    first (Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and Reduced
+ *    Overdraw"), without hurting the vertex cache,
+ *  - optimizeVertexFetch() finally orders the vertices by first use.
+ *
+ * The indices are local to the mesh, in [0, vertexCount).
+ */
+class MeshOptimizer {
+public:
+    struct Statistics {
+        float acmr = 0;         // average cache miss ratio: transformed vertices per triangle
+        float atvr = 0;         // average transform to vertex ratio: 1 is optimal
+        float overdraw = 0;     // shaded pixels per covered pixel, averaged over 6 axis views
+    };
+
+    static void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount);
+
+    static void optimizeOverdraw(uint32_t* indices, size_t indexCount,
+            math::float3 const* positions, size_t vertexCount, float threshold = 1.05f);
+
+    // Returns the old index of each new vertex, and remaps the indices. The vertices no
+    // triangle references are moved last.
+    static std::vector<uint32_t> optimizeVertexFetch(uint32_t* indices, size_t indexCount,
+            size_t vertexCount);
+
+    static Statistics analyze(uint32_t const* indices, size_t indexCount,
+            math::float3 const* positions, size_t vertexCount);
+};
+
+#endif // TNT_FILAMESH_MESHOPTIMIZER_H
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+using namespace math;
+
+// the squared distance to a plane, summed over planes, as a symmetric 4x4 matrix
+struct Quadric {
+    double a2 = 0, ab = 0, ac = 0, ad = 0;
+    double b2 = 0, bc = 0, bd = 0;
+    double c2 = 0, cd = 0;
+    double d2 = 0;
+
+    static Quadric fromPlane(double3 const& n, double d, double weight) noexcept {
+        Quadric q;
+        q.a2 = n.x * n.x * weight; q.ab = n.x * n.y * weight; q.ac = n.x * n.z * weight;
+        q.ad = n.x * d * weight;
+        q.b2 = n.y * n.y * weight; q.bc = n.y * n.z * weight; q.bd = n.y * d * weight;
+        q.c2 = n.z * n.z * weight; q.cd = n.z * d * weight;
+        q.d2 = d * d * weight;
+        return q;
+    }
+
+    Quadric& operator+=(Quadric const& q) noexcept {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+        b2 += q.b2; bc += q.bc; bd += q.bd;
+        c2 += q.c2; cd += q.cd;
+        d2 += q.d2;
+        return *this;
+    }
+
+    double evaluate(double3 const& p) const noexcept {
+        const double x = p.x, y = p.y, z = p.z;
+        const double r = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x +
+                b2 * y * y + 2 * bc * y * z + 2 * bd * y +
+                c2 * z * z + 2 * cd * z + d2;
+        return std::max(r, 0.0);
+    }
+};
+
+MeshSimplifier::Result MeshSimplifier::simplify(uint32_t const* indices, size_t indexCount,
+        float3 const* positions, float2 const* uvs, size_t vertexCount,
+        size_t targetIndexCount, float uvWeight) {
+    Result result;
+    result.indices.assign(indices, indices + indexCount);
+    if (indexCount <= targetIndexCount || vertexCount == 0) {
+        return result;
+    }
+
+    // work in a unit box, so that the errors are relative to the size of the mesh
+    float3 bmin(std::numeric_limits<float>::max());
+    float3 bmax(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < indexCount; i++) {
+        bmin = min(bmin, positions[indices[i]]);
+        bmax = max(bmax, positions[indices[i]]);
+    }
+    const float3 extent = bmax - bmin;
+    const double scale = 1.0 / std::max(std::max(extent.x, extent.y), std::max(extent.z, 1e-6f));
+    std::vector<double3> p(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) {
+        p[v] = (double3(positions[v]) - double3(bmin)) * scale;
+    }
+
+    // lock the seams, where several vertices share a position
+    std::vector<bool> locked(vertexCount, false);
+    {
+        std::vector<uint32_t> sorted(vertexCount);
+        std::iota(sorted.begin(), sorted.end(), 0);
+        auto less = [&positions](uint32_t lhs, uint32_t rhs) {
+            float3 const& a = positions[lhs];
+            float3 const& b = positions[rhs];
+            return a.x != b.x ? a.x < b.x : (a.y != b.y ? a.y < b.y : a.z < b.z);
+        };
+        std::sort(sorted.begin(), sorted.end(), less);
+        for (size_t i = 1; i < vertexCount; i++) {
+            if (!less(sorted[i - 1], sorted[i])) {
+                locked[sorted[i - 1]] = true;
+                locked[sorted[i]] = true;
+            }
+        }
+    }
+
+    // lock the borders, and the non-manifold edges
+    {
+        std::unordered_map<uint64_t, uint32_t> edges;
+        for (size_t i = 0; i < indexCount; i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                const uint64_t a = indices[i + k];
+                const uint64_t b = indices[i + (k + 1) % 3];
+                edges[a < b ? (a << 32u) | b : (b << 32u) | a]++;
+            }
+        }
+        for (auto const& edge : edges) {
+            if (edge.second != 2) {
+                locked[edge.first >> 32u] = true;
+                locked[edge.first & 0xFFFFFFFFu] = true;
+            }
+        }
+    }
+
+    // the quadric of each vertex, from the planes of its triangles weighted by their area
+    std::vector<Quadric> quadrics(vertexCount);
+    std::vector<double> areas(vertexCount, 0.0);
+    for (size_t i = 0; i < indexCount; i += 3) {
+        const double3 normal = cross(p[indices[i + 1]] - p[indices[i]],
+                p[indices[i + 2]] - p[indices[i]]);
+        const double area = length(normal);
+        if (area == 0) {
+            continue;
+        }
+        const double3 n = normal / area;
+        const Quadric q = Quadric::fromPlane(n, -dot(n, p[indices[i]]), area);
+        for (size_t k = 0; k < 3; k++) {
+            quadrics[indices[i + k]] += q;
+            areas[indices[i + k]] += area;
+        }
+    }
+
+    struct Collapse {
+        uint32_t from;
+        uint32_t to;
+        double cost;
+        double error;   // squared distance
+    };
+
+    std::vector<uint32_t>& current = result.indices;
+    double maxError = 0;
+    while (current.size() > targetIndexCount) {
+        const size_t triangleCount = current.size() / 3;
+
+        // the triangles of each vertex
+        std::vector<uint32_t> offsets(vertexCount + 1, 0);
+        for (uint32_t index : current) {
+            offsets[index + 1]++;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            offsets[v + 1] += offsets[v];
+        }
+        std::vector<uint32_t> adjacency(current.size());
+        {
+            std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < current.size(); i++) {
+                adjacency[cursor[current[i]]++] = uint32_t(i / 3);
+            }
+        }
+
+        std::vector<Collapse> collapses;
+        collapses.reserve(current.size() * 2);
+        for (size_t i = 0; i < current.size(); i += 3) {
+            for (size_t k = 0; k < 3; k++) {
+                const uint32_t a = current[i + k];
+                const uint32_t b = current[i + (k + 1) % 3];
+                for (int direction = 0; direction < 2; direction++) {
+                    const uint32_t from = direction ? b : a;
+                    const uint32_t to = direction ? a : b;
+                    if (locked[from] || areas[from] == 0) {
+                        continue;
+                    }
+                    const double error = quadrics[from].evaluate(p[to]);
+                    const double duv = uvs ? length2(double2(uvs[from]) - double2(uvs[to])) : 0;
+                    const double cost = error + uvWeight * areas[from] * duv;
+                    collapses.push_back({ from, to, cost, error / areas[from] });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](Collapse const& lhs, Collapse const& rhs) {
+            return lhs.cost < rhs.cost;
+        });
+
+        // each collapse changes the triangles around its vertex, they can't be involved in
+        // another collapse during this pass
+        std::vector<bool> touched(vertexCount, false);
+        std::vector<uint32_t> remap(vertexCount);
+        std::iota(remap.begin(), remap.end(), 0);
+
+        const size_t trianglesToRemove = (current.size() - targetIndexCount) / 3;
+        size_t removed = 0;
+        for (Collapse const& collapse : collapses) {
+            if (removed >= std::max(trianglesToRemove, size_t(1))) {
+                break;
+            }
+            const uint32_t from = collapse.from;
+            const uint32_t to = collapse.to;
+            if (touched[from] || touched[to]) {
+                continue;
+            }
+
+            // refuse the collapses that flip a triangle
+            bool flips = false;
+            size_t collapsed = 0;
+            for (size_t j = offsets[from]; j < offsets[from + 1] && !flips; j++) {
+                uint32_t const* triangle = current.data() + adjacency[j] * 3;
+                if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                    collapsed++;
+                    continue;
+                }
+                double3 q[3];
+                double3 moved[3];
+                for (size_t k = 0; k < 3; k++) {
+                    q[k] = p[triangle[k]];
+                    moved[k] = triangle[k] == from ? p[to] : q[k];
+                }
+                const double3 n0 = cross(q[1] - q[0], q[2] - q[0]);
+                const double3 n1 = cross(moved[1] - moved[0], moved[2] - moved[0]);
+                flips = dot(n0, n1) <= 0.0;
+            }
+            if (flips) {
+                continue;
+            }
+
+            for (size_t j = offsets[from]; j < offsets[from + 1]; j++) {
+                uint32_t const* triangle = current.data() + adjacency[j] * 3;
+                touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+            }
+            remap[from] = to;
+            quadrics[to] += quadrics[from];
+            areas[to] += areas[from];
+            maxError = std::max(maxError, collapse.error);
+            removed += collapsed;
+        }
+
+        if (removed == 0) {
+            // nothing can be collapsed anymore
+            break;
+        }
+
+        size_t count = 0;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const uint32_t a = remap[current[t * 3 + 0]];
+            const uint32_t b = remap[current[t * 3 + 1]];
+            const uint32_t c = remap[current[t * 3 + 2]];
+            if (a != b && b != c && c != a) {
+                current[count++] = a;
+                current[count++] = b;
+                current[count++] = c;
+            }
+        }
+        current.resize(count);
+    }
+
+    result.error = float(std::sqrt(maxError));
+    return result;
+}
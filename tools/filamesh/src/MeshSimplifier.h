@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_FILAMESH_MESHSIMPLIFIER_H
+#define TNT_FILAMESH_MESHSIMPLIFIER_H
+
+#include <math/vec2.h>
+#include <math/vec3.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/*
+ * Simplifies a triangle list by collapsing edges onto one of their vertices, picked with
+ * quadric error metrics (Garland and Heckbert 1997), so that the result uses the same vertex
+ * buffer as the source.
+ *
+ * The vertices on the borders of the mesh and on the seams of its attributes (the vertices
+ * sharing a position) are never moved. The error of moving a vertex also accounts for the
+ * distance between the texture coordinates, scaled by uvWeight.
+ */
+class MeshSimplifier {
+public:
+    struct Result {
+        std::vector<uint32_t> indices;
+        // the largest distance between the simplified and the source surfaces, relative to
+        // the largest extent of the mesh
+        float error = 0;
+    };
+
+    static Result simplify(uint32_t const* indices, size_t indexCount,
+            math::float3 const* positions, math::float2 const* uvs, size_t vertexCount,
+            size_t targetIndexCount, float uvWeight = 1.0f);
+};
+
+#endif // TNT_FILAMESH_MESHSIMPLIFIER_H
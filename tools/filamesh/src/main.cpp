@@ -15,20 +15,29 @@
  */
 
 
+#include <atomic>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <mutex>
+#include <numeric>
+#include <sstream>
 
 #include <math/half.h>
 #include <math/mat3.h>
 #include <math/norm.h>
 #include <math/quat.h>
+#include <math/vec2.h>
 #include <math/vec3.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
 
 #include "Box.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
 
 using namespace math;
 using namespace utils;
@@ -38,7 +47,11 @@ using namespace utils;
 #include <assimp/cimport.h>
 #include <assimp/scene.h>
 
-static const uint32_t VERSION = 1;
+static const uint32_t VERSION = 4;
+
+// the vertex and index data start at multiples of the page size in the file, so that a loader
+// can memory map it and hand it to the GPU without copying it
+static const uint32_t SECTION_ALIGNMENT = 4096;
 
 using Assimp::Importer;
 
@@ -62,9 +75,18 @@ struct Header {
     uint32_t indexType;
     uint32_t indexCount;
     uint32_t indexSize;
+    // version 2
+    uint32_t offsetVertexData;
+    uint32_t offsetIndexData;
+    // version 3
+    uint32_t lodCount;
+    // version 4
+    uint32_t packedTangents;
 };
 
 struct Vertex {
+    Vertex() = default;
+
     Vertex(const float3& position, const quatf& tangents, const float4& color, const float3& uv0):
             position(position, 1.0_h),
             tangents(packSnorm16(tangents.xyzw)),
@@ -78,6 +100,14 @@ struct Vertex {
     half2  uv0;
 };
 
+// the interleaved layout with packed tangent frames
+struct PackedVertex {
+    half4    position;
+    uint32_t tangents;
+    ubyte4   color;
+    half2    uv0;
+};
+
 struct Mesh {
     Mesh(uint32_t offset, uint32_t count, uint32_t minIndex, uint32_t maxIndex,
             uint32_t material, const Box& aabb):
@@ -97,19 +127,46 @@ struct Mesh {
     Box aabb;
 };
 
+// a part in a level of detail other than the first, it uses the same vertices
+struct LodPart {
+    uint32_t offset;
+    uint32_t count;
+    float error;    // relative to the largest extent of the part
+};
+
+// the simplified indices of a part in a level of detail, before they're added to data.indices
+struct LodIndices {
+    std::vector<uint32_t> indices;
+    float error;
+};
+
 // configuration
 bool g_interleaved = false;
-
-uint32_t g_vertexCount = 0;
-std::vector<uint32_t> g_indices;
-// interleaved
-std::vector<Vertex> g_vertices;
-// de-interleaved
-std::vector<decltype(Vertex::position)>  g_positions;
-std::vector<decltype(Vertex::tangents)>  g_tangents;
-std::vector<decltype(Vertex::color)>     g_colors;
-std::vector<decltype(Vertex::uv0)>       g_uv0;
-std::vector<decltype(Vertex::uv0)>       g_uv1;
+bool g_optimize = true;
+bool g_packedTangents = false;
+uint32_t g_lodCount = 1;
+float g_lodRatio = 0.5f;
+Path g_outputDir;
+Path g_manifest;
+
+// the meshes converted at the same time use different instances
+struct MeshData {
+    // for each part, its levels of detail after the first
+    std::vector<std::vector<LodIndices>> lods;
+
+    uint32_t vertexCount = 0;
+    std::vector<uint32_t> indices;
+    // interleaved
+    std::vector<Vertex> vertices;
+    // de-interleaved
+    std::vector<decltype(Vertex::position)>  positions;
+    std::vector<decltype(Vertex::tangents)>  tangents;
+    std::vector<decltype(Vertex::color)>     colors;
+    std::vector<decltype(Vertex::uv0)>       uv0;
+    std::vector<decltype(Vertex::uv0)>       uv1;
+    // the tangent frames of all the vertices, if they're packed
+    std::vector<uint32_t> packedTangents;
+};
 
 template<typename T>
 void write(std::ofstream& out, const T& value) {
@@ -121,6 +178,17 @@ void write(std::ofstream& out, const T* data, uint32_t count) {
     out.write((const char*) data, sizeof(T) * count);
 }
 
+static uint32_t align(uint32_t offset, uint32_t alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static void pad(std::ofstream& out, uint32_t alignment) {
+    const uint32_t offset = uint32_t(out.tellp());
+    for (uint32_t i = offset; i < align(offset, alignment); i++) {
+        write(out, char(0));
+    }
+}
+
 template<typename VECTOR, typename INDEX>
 static Box computeAABB(VECTOR const* positions, INDEX const* indices,
         size_t count, size_t stride) noexcept {
@@ -136,13 +204,127 @@ static Box computeAABB(VECTOR const* positions, INDEX const* indices,
     return Box().set(bmin, bmax);
 }
 
+// Reorders the triangles for the vertex cache and overdraw, and returns the order in which the
+// vertices must be written, which indices now refer to.
+static std::vector<uint32_t> optimizeMesh(std::vector<uint32_t>& indices,
+        const float3* positions, size_t vertexCount, std::ostream& log) {
+    const MeshOptimizer::Statistics before =
+            MeshOptimizer::analyze(indices.data(), indices.size(), positions, vertexCount);
+
+    MeshOptimizer::optimizeVertexCache(indices.data(), indices.size(), vertexCount);
+    MeshOptimizer::optimizeOverdraw(indices.data(), indices.size(), positions, vertexCount);
+    std::vector<uint32_t> order =
+            MeshOptimizer::optimizeVertexFetch(indices.data(), indices.size(), vertexCount);
+
+    std::vector<float3> reordered(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        reordered[i] = positions[order[i]];
+    }
+    const MeshOptimizer::Statistics after =
+            MeshOptimizer::analyze(indices.data(), indices.size(), reordered.data(), vertexCount);
+
+    log << std::fixed << std::setprecision(3)
+        << "Mesh with " << indices.size() / 3 << " triangles:"
+        << " ACMR " << before.acmr << " -> " << after.acmr << ","
+        << " ATVR " << before.atvr << " -> " << after.atvr << ","
+        << " overdraw " << before.overdraw << " -> " << after.overdraw << std::endl;
+
+    return order;
+}
+
+// Simplifies each level of detail from the previous one, with g_lodRatio times its triangles.
+static std::vector<LodIndices> generateLods(std::vector<uint32_t> const& indices,
+        const float3* positions, const float2* uvs, size_t vertexCount, uint32_t indicesOffset,
+        std::ostream& log) {
+    std::vector<LodIndices> lods;
+    std::vector<uint32_t> previous(indices);
+    size_t targetTriangles = indices.size() / 3;
+    for (size_t level = 1; level < g_lodCount; level++) {
+        targetTriangles = size_t(targetTriangles * g_lodRatio);
+        MeshSimplifier::Result simplified = MeshSimplifier::simplify(previous.data(),
+                previous.size(), positions, uvs, vertexCount, targetTriangles * 3);
+        if (g_optimize) {
+            MeshOptimizer::optimizeVertexCache(
+                    simplified.indices.data(), simplified.indices.size(), vertexCount);
+        }
+        previous = simplified.indices;
+
+        log << "  LOD " << level << ": " << simplified.indices.size() / 3
+            << " triangles, error " << std::setprecision(5) << simplified.error
+            << std::endl;
+
+        for (uint32_t& index : simplified.indices) {
+            index += indicesOffset;
+        }
+        // the errors of the levels add up
+        const float error = simplified.error + (lods.empty() ? 0.0f : lods.back().error);
+        lods.push_back({ std::move(simplified.indices), error });
+    }
+    return lods;
+}
+
+// Packs a tangent frame in the INT_2_10_10_10_REV decoded by getters.vs: an octahedral normal in x
+// (stored in [2..511]) and y, the tangent diamond encoded in z, in a basis derived from the
+// quantized normal, and the sign of the bitangent in w.
+static uint32_t packTangentFrame(float3 t, float3 b, float3 n) {
+    // the basis of the plane orthogonal to n, see "Building an Orthonormal Basis, Revisited"
+    auto basis = [](float3 n, float3& b1, float3& b2) {
+        const float s = n.z >= 0.0f ? 1.0f : -1.0f;
+        const float a = -1.0f / (s + n.z);
+        const float b = n.x * n.y * a;
+        b1 = float3(1.0f + s * n.x * n.x * a, s * b, -s * n.x);
+        b2 = float3(b, s + n.y * n.y * a, -n.y);
+    };
+    auto sign = [](float v) { return v >= 0.0f ? 1.0f : -1.0f; };
+    auto quantize = [](float v, int32_t min, int32_t max) {
+        return std::min(std::max(int32_t(std::round(v)), min), max);
+    };
+
+    n = normalize(n);
+    t = normalize(t - n * dot(n, t));
+    // the same sign as the w of mat3f::packTangentFrame(), so both encodings decode the same
+    const int32_t w = dot(cross(t, n), b) < 0.0f ? -1 : 1;
+
+    float2 p = n.xy / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (n.z < 0.0f) {
+        p = float2((1.0f - std::abs(p.y)) * sign(p.x), (1.0f - std::abs(p.x)) * sign(p.y));
+    }
+    const int32_t x = quantize(p.x * 254.5f + 256.5f, 2, 511);
+    const int32_t y = quantize(p.y * 511.0f, -511, 511);
+
+    // the shader builds the basis from the normal it decodes
+    float3 q(float(x - 256.5f) / 254.5f, float(y) / 511.0f, 0.0f);
+    q.z = 1.0f - std::abs(q.x) - std::abs(q.y);
+    const float f = std::max(-q.z, 0.0f);
+    q.x += q.x >= 0.0f ? -f : f;
+    q.y += q.y >= 0.0f ? -f : f;
+    float3 b1, b2;
+    basis(normalize(q), b1, b2);
+
+    float2 v(dot(t, b1), dot(t, b2));
+    const float l = std::abs(v.x) + std::abs(v.y);
+    v = l > 0.0f ? v / l : float2(1.0f, 0.0f);
+    const float d = (sign(v.y) * (1.0f - v.x) * 0.25f + 0.5f) * 2.0f - 1.0f;
+    const int32_t z = quantize(d * 511.0f, -511, 511);
+
+    return (uint32_t(x) & 0x3FFu) | ((uint32_t(y) & 0x3FFu) << 10u) |
+           ((uint32_t(z) & 0x3FFu) << 20u) | ((uint32_t(w) & 0x3u) << 30u);
+}
+
+static JobSystem& getJobSystem() {
+    static JobSystem js;
+    js.adopt();
+    return js;
+}
+
 template<bool INTERLEAVED>
-void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& meshes) {
+static bool processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& meshes,
+        MeshData& data, std::ostream& log) {
     for (size_t i = 0; i < node->mNumMeshes; ++i) {
         const aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
         if (!mesh->HasNormals() || !mesh->HasTextureCoords(0)) {
-            std::cerr << "The mesh must have texture coordinates" << std::endl;
-            exit(1);
+            log << "The mesh must have texture coordinates" << std::endl;
+            return false;
         }
 
         const float3* vertices = reinterpret_cast<const float3*>(mesh->mVertices);
@@ -160,60 +342,104 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
             uv1 = nullptr;
         }
 
-        float4 color = {};
-
         const size_t numVertices = mesh->mNumVertices;
         if (numVertices > 0) {
             const aiFace* faces = mesh->mFaces;
             const size_t numFaces = mesh->mNumFaces;
 
             if (numFaces > 0) {
-                size_t indicesOffset = g_vertexCount;
-                g_vertexCount += numVertices;
+                size_t indicesOffset = data.vertexCount;
+                data.vertexCount += numVertices;
                 if (INTERLEAVED) {
-                    g_vertices.reserve(g_vertexCount);
+                    data.vertices.resize(data.vertexCount);
                 } else {
-                    g_positions.reserve(g_vertexCount);
-                    g_tangents.reserve(g_vertexCount);
-                    g_uv0.reserve(g_vertexCount);
-                }
-
-                for (size_t j = 0; j < numVertices; j++) {
-                    quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
-
-                    color = colors ? colors[j] : float4(1.0f);
-                    if (INTERLEAVED) {
-                        g_vertices.emplace_back(vertices[j], q, color, uv0[j]);
-                    } else {
-                        // use the same conversions as in the interleaved case
-                        Vertex v(vertices[j], q, color, uv0[j]);
-                        g_positions.emplace_back(v.position);
-                        g_tangents.emplace_back(v.tangents);
-                        g_colors.emplace_back(v.color);
-                        g_uv0.emplace_back(v.uv0);
-                        if (uv1 != nullptr) {
-                            g_uv1.emplace_back(uv1[j].xy);
-                        }
+                    data.positions.resize(data.vertexCount);
+                    data.tangents.resize(data.vertexCount);
+                    data.colors.resize(data.vertexCount);
+                    data.uv0.resize(data.vertexCount);
+                    if (uv1 != nullptr) {
+                        data.uv1.resize(data.vertexCount);
                     }
                 }
+                if (g_packedTangents) {
+                    data.packedTangents.resize(data.vertexCount);
+                }
 
                 // all faces should be triangles since we configure assimp to triangulate faces
                 size_t indicesCount = numFaces * faces[0].mNumIndices;
-                size_t indexBufferOffset = g_indices.size();
-                g_indices.reserve(g_indices.size() + indicesCount);
-
+                std::vector<uint32_t> indices;
+                indices.reserve(indicesCount);
                 for (size_t j = 0; j < numFaces; ++j) {
                     const aiFace& face = faces[j];
                     for (size_t k = 0; k < face.mNumIndices; ++k) {
-                        g_indices.push_back(uint32_t(face.mIndices[k] + indicesOffset));
+                        indices.push_back(uint32_t(face.mIndices[k]));
                     }
                 }
 
+                // the order in which the vertices are written
+                std::vector<uint32_t> order;
+                if (g_optimize) {
+                    order = optimizeMesh(indices, vertices, numVertices, log);
+                } else {
+                    order.resize(numVertices);
+                    std::iota(order.begin(), order.end(), 0);
+                }
+
+                if (g_lodCount > 1) {
+                    std::vector<float3> positions(numVertices);
+                    std::vector<float2> uvs(numVertices);
+                    for (size_t j = 0; j < numVertices; j++) {
+                        positions[j] = vertices[order[j]];
+                        uvs[j] = uv0[order[j]].xy;
+                    }
+                    data.lods.push_back(generateLods(indices, positions.data(), uvs.data(),
+                            numVertices, uint32_t(indicesOffset), log));
+                }
+
+                // packing the tangent frames and converting to half floats dominates the
+                // conversion of large meshes, the vertices are independent
+                auto convert = [&](uint32_t start, uint32_t count) {
+                    for (uint32_t k = start; k < start + count; k++) {
+                        const uint32_t j = order[k];
+                        const size_t v = indicesOffset + k;
+                        quatf q = mat3f::packTangentFrame({tangents[j], bitangents[j], normals[j]});
+                        float4 color = colors ? colors[j] : float4(1.0f);
+                        if (g_packedTangents) {
+                            data.packedTangents[v] =
+                                    packTangentFrame(tangents[j], bitangents[j], normals[j]);
+                        }
+                        if (INTERLEAVED) {
+                            data.vertices[v] = Vertex(vertices[j], q, color, uv0[j]);
+                        } else {
+                            // use the same conversions as in the interleaved case
+                            Vertex vertex(vertices[j], q, color, uv0[j]);
+                            data.positions[v] = vertex.position;
+                            data.tangents[v] = vertex.tangents;
+                            data.colors[v] = vertex.color;
+                            data.uv0[v] = vertex.uv0;
+                            if (uv1 != nullptr) {
+                                data.uv1[v] = half2(uv1[j].xy);
+                            }
+                        }
+                    }
+                };
+                JobSystem& js = getJobSystem();
+                JobSystem::Job* job = jobs::parallel_for(js, nullptr, 0, uint32_t(numVertices),
+                        std::ref(convert), jobs::CountSplitter<4096, 8>());
+                js.runAndWait(job);
+                js.release(job);
+
+                size_t indexBufferOffset = data.indices.size();
+                data.indices.reserve(data.indices.size() + indicesCount);
+                for (uint32_t index : indices) {
+                    data.indices.push_back(uint32_t(index + indicesOffset));
+                }
+
                 size_t stride = INTERLEAVED ? sizeof(Vertex) : sizeof(Vertex::position);
                 const decltype(Vertex::position)* positions =
-                        INTERLEAVED ? &g_vertices.data()->position : g_positions.data();
+                        INTERLEAVED ? &data.vertices.data()->position : data.positions.data();
                 const Box aabb(computeAABB(positions,
-                        g_indices.data() + indexBufferOffset, indicesCount, stride));
+                        data.indices.data() + indexBufferOffset, indicesCount, stride));
 
                 meshes.emplace_back(indexBufferOffset, indicesCount, indicesOffset,
                         indicesOffset + indicesCount - 1, mesh->mMaterialIndex, aabb);
@@ -222,8 +448,11 @@ void processNode(const aiScene* scene, const aiNode* node, std::vector<Mesh>& me
     }
 
     for (size_t i=0 ; i<node->mNumChildren ; ++i) {
-        processNode<INTERLEAVED>(scene, node->mChildren[i], meshes);
+        if (!processNode<INTERLEAVED>(scene, node->mChildren[i], meshes, data, log)) {
+            return false;
+        }
     }
+    return true;
 }
 
 static void printUsage(const char* name) {
@@ -232,6 +461,8 @@ static void printUsage(const char* name) {
             "FILAMESH is a tool to convert meshes into an optimized binary format\n"
                     "Usage:\n"
                     "    FILAMESH [options] <source mesh> <destination file>\n"
+                    "    FILAMESH [options] --output-dir=dir <source mesh> [<source mesh> ...]\n"
+                    "    FILAMESH [options] --manifest=file\n"
                     "\n"
                     "Supported mesh formats:\n"
                     "    COLLADA, FBX, OBJ\n"
@@ -245,6 +476,22 @@ static void printUsage(const char* name) {
                     "       Print copyright and license information\n\n"
                     "   --interleaved, -i\n"
                     "       interleaves mesh attributes\n\n"
+                    "   --packed-tangents, -p\n"
+                    "       packs the tangent frames in 4 bytes instead of 8, as an octahedral\n"
+                    "       normal and a tangent, in an INT_2_10_10_10_REV attribute\n\n"
+                    "   --lods=count\n"
+                    "       generates this many levels of detail, 4 at most, 1 by default\n\n"
+                    "   --ratio=ratio\n"
+                    "       ratio of the triangles of a level of detail to the previous one,\n"
+                    "       0.5 by default\n\n"
+                    "   --no-optimize, -n\n"
+                    "       keeps the order of the triangles and vertices of the source mesh\n\n"
+                    "   --output-dir=dir, -d dir\n"
+                    "       converts all the source meshes into dir, as <name>.filamesh\n\n"
+                    "   --manifest=file, -m file\n"
+                    "       converts the meshes listed in file, one \"<source> <destination>\"\n"
+                    "       pair per line\n\n"
+                    "The meshes are converted concurrently.\n"
     );
 
     const std::string from("FILAMESH");
@@ -261,11 +508,17 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[]) {
-    static constexpr const char* OPTSTR = "hil";
+    static constexpr const char* OPTSTR = "hilpnd:m:";
     static const struct option OPTIONS[] = {
             { "help",        no_argument, 0, 'h' },
             { "license",     no_argument, 0, 'l' },
             { "interleaved", no_argument, 0, 'i' },
+            { "packed-tangents", no_argument, 0, 'p' },
+            { "no-optimize", no_argument, 0, 'n' },
+            { "lods",        required_argument, 0, 'o' },
+            { "ratio",       required_argument, 0, 'r' },
+            { "output-dir",  required_argument, 0, 'd' },
+            { "manifest",    required_argument, 0, 'm' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -273,7 +526,7 @@ static int handleArguments(int argc, char* argv[]) {
     int optionIndex = 0;
 
     while ((opt = getopt_long(argc, argv, OPTSTR, OPTIONS, &optionIndex)) >= 0) {
-        // std::string arg(optarg ? optarg : "");
+        std::string arg(optarg ? optarg : "");
         switch (opt) {
             default:
             case 'h':
@@ -287,25 +540,35 @@ static int handleArguments(int argc, char* argv[]) {
             case 'i':
                 g_interleaved = true;
                 break;
+            case 'p':
+                g_packedTangents = true;
+                break;
+            case 'n':
+                g_optimize = false;
+                break;
+            case 'o':
+                g_lodCount = uint32_t(std::min(std::max(std::stoi(arg), 1), 4));
+                break;
+            case 'r':
+                g_lodRatio = std::min(std::max(std::stof(arg), 0.01f), 1.0f);
+                break;
+            case 'd':
+                g_outputDir = arg;
+                break;
+            case 'm':
+                g_manifest = arg;
+                break;
         }
     }
 
     return optind;
 }
 
-int main(int argc, char* argv[]) {
-    int optionIndex = handleArguments(argc, argv);
-
-    int numArgs = argc - optionIndex;
-    if (numArgs < 2) {
-        printUsage(argv[0]);
-        return 1;
-    }
-
-    Path src(argv[optionIndex]);
+// Converts one mesh, each conversion has its own importer so that several can run at once.
+static bool convert(const Path& src, const Path& dst, std::ostream& log) {
     if (!src.exists()) {
-        std::cerr << "The source mesh " << src << " does not exist." << std::endl;
-        return 1;
+        log << "The source mesh " << src << " does not exist." << std::endl;
+        return false;
     }
 
     Importer importer;
@@ -322,38 +585,54 @@ int main(int argc, char* argv[]) {
             aiProcess_FindInstances |
             aiProcess_OptimizeMeshes |
             aiProcess_JoinIdenticalVertices |
-            // misc optimization
-            aiProcess_ImproveCacheLocality |
+            // misc optimization, the vertex cache is optimized by MeshOptimizer
+            (g_optimize ? 0 : aiProcess_ImproveCacheLocality) |
             aiProcess_PreTransformVertices |
             aiProcess_SortByPType |
             // we only support triangles
             aiProcess_Triangulate);
 
     if (!scene) {
-        std::cerr << "Unknown mesh format in " << src << std::endl;
-        return 1;
+        log << "Unknown mesh format in " << src << std::endl;
+        return false;
     }
 
+    MeshData data;
     std::vector<Mesh> meshes;
 
     const aiNode* node = scene->mRootNode;
 
-    if (g_interleaved) {
-        processNode<true>(scene, node, meshes);
-    } else {
-        processNode<false>(scene, node, meshes);
+    const bool processed = g_interleaved ?
+            processNode<true>(scene, node, meshes, data, log) :
+            processNode<false>(scene, node, meshes, data, log);
+    if (!processed) {
+        return false;
+    }
+    if (meshes.empty()) {
+        log << "No triangles in " << src << std::endl;
+        return false;
+    }
+
+    // the levels of detail follow the first one in the index buffer
+    std::vector<LodPart> lodParts;
+    for (size_t level = 1; level < g_lodCount; level++) {
+        for (size_t i = 0; i < data.lods.size(); i++) {
+            LodIndices const& lod = data.lods[i][level - 1];
+            lodParts.push_back({ uint32_t(data.indices.size()), uint32_t(lod.indices.size()),
+                    lod.error });
+            data.indices.insert(data.indices.end(), lod.indices.begin(), lod.indices.end());
+        }
     }
 
-    Path dst(argv[optionIndex + 1]);
     std::ofstream out(dst, std::ios::binary | std::ios::trunc);
     if (!out.good()) {
-        std::cerr << "Could not write to " << dst << std::endl;
+        log << "Could not write to " << dst << std::endl;
         out.close();
-        return 1;
+        return false;
     }
 
-    const bool hasIndex16 = g_vertexCount < std::numeric_limits<uint16_t>::max();
-    const bool hasUV1 = g_uv1.size() > 0;
+    const bool hasIndex16 = data.vertexCount < std::numeric_limits<uint16_t>::max();
+    const bool hasUV1 = data.uv1.size() > 0;
 
     Box aabb = meshes.at(0).aabb;
     for (size_t i = 1; i < meshes.size(); i++) {
@@ -367,22 +646,29 @@ int main(int argc, char* argv[]) {
     header.parts = uint32_t(meshes.size());
     header.aabb = aabb;
     header.interleaved = uint32_t(g_interleaved ? 1 : 0);
+    const uint32_t tangentsSize = g_packedTangents ?
+            sizeof(PackedVertex::tangents) : sizeof(Vertex::tangents);
+    const uint32_t vertexSize = g_packedTangents ? sizeof(PackedVertex) : sizeof(Vertex);
     if (g_interleaved) {
-        header.offsetPosition = offsetof(Vertex, position);
-        header.offsetTangents = offsetof(Vertex, tangents);
-        header.offsetColor    = offsetof(Vertex, color);
-        header.offsetUV0      = offsetof(Vertex, uv0);
+        header.offsetPosition = g_packedTangents ?
+                offsetof(PackedVertex, position) : offsetof(Vertex, position);
+        header.offsetTangents = g_packedTangents ?
+                offsetof(PackedVertex, tangents) : offsetof(Vertex, tangents);
+        header.offsetColor    = g_packedTangents ?
+                offsetof(PackedVertex, color) : offsetof(Vertex, color);
+        header.offsetUV0      = g_packedTangents ?
+                offsetof(PackedVertex, uv0) : offsetof(Vertex, uv0);
         header.offsetUV1      = std::numeric_limits<uint32_t>::max();
-        header.stridePosition = sizeof(Vertex);
-        header.strideTangents = sizeof(Vertex);
-        header.strideColor    = sizeof(Vertex);
-        header.strideUV0      = sizeof(Vertex);
+        header.stridePosition = vertexSize;
+        header.strideTangents = vertexSize;
+        header.strideColor    = vertexSize;
+        header.strideUV0      = vertexSize;
         header.strideUV1      = std::numeric_limits<uint32_t>::max();
     } else {
         header.offsetPosition = 0;
-        header.offsetTangents = g_vertexCount * sizeof(Vertex::position);
-        header.offsetColor    = header.offsetTangents + g_vertexCount * sizeof(Vertex::tangents);
-        header.offsetUV0      = header.offsetColor + g_vertexCount * sizeof(Vertex::color);
+        header.offsetTangents = data.vertexCount * sizeof(Vertex::position);
+        header.offsetColor    = header.offsetTangents + data.vertexCount * tangentsSize;
+        header.offsetUV0      = header.offsetColor + data.vertexCount * sizeof(Vertex::color);
         header.offsetUV1      = std::numeric_limits<uint32_t>::max();
         header.stridePosition = 0;
         header.strideTangents = 0;
@@ -391,41 +677,64 @@ int main(int argc, char* argv[]) {
         header.strideUV1      = std::numeric_limits<uint32_t>::max();
 
         if (hasUV1) {
-            header.offsetUV1  = header.offsetUV0 + g_vertexCount * sizeof(Vertex::uv0);
+            header.offsetUV1  = header.offsetUV0 + data.vertexCount * sizeof(Vertex::uv0);
             header.strideUV1  = 0;
         }
     }
-    header.vertexCount = g_vertexCount;
-    header.vertexSize = g_vertexCount * sizeof(Vertex);
+    header.vertexCount = data.vertexCount;
+    header.vertexSize = data.vertexCount * vertexSize;
+    if (!g_interleaved && hasUV1) {
+        header.vertexSize += data.vertexCount * sizeof(Vertex::uv0);
+    }
     header.indexType = uint32_t(hasIndex16 ? 1 : 0);
-    header.indexCount = g_indices.size();
-    header.indexSize = g_indices.size() * (hasIndex16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    header.indexCount = data.indices.size();
+    header.indexSize = data.indices.size() * (hasIndex16 ? sizeof(uint16_t) : sizeof(uint32_t));
+    header.offsetVertexData = align(8 * sizeof(char) + sizeof(Header), SECTION_ALIGNMENT);
+    header.offsetIndexData = align(header.offsetVertexData + header.vertexSize, SECTION_ALIGNMENT);
+    header.lodCount = g_lodCount;
+    header.packedTangents = uint32_t(g_packedTangents ? 1 : 0);
 
     write(out, header);
 
-    if (g_interleaved) {
-        write(out, g_vertices.data(), uint32_t(g_vertices.size()));
+    pad(out, SECTION_ALIGNMENT);
+
+    if (g_interleaved && g_packedTangents) {
+        std::vector<PackedVertex> vertices(data.vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++) {
+            Vertex const& vertex = data.vertices[i];
+            vertices[i] = { vertex.position, data.packedTangents[i], vertex.color, vertex.uv0 };
+        }
+        write(out, vertices.data(), uint32_t(vertices.size()));
+    } else if (g_interleaved) {
+        write(out, data.vertices.data(), uint32_t(data.vertices.size()));
     } else {
-        write(out, g_positions.data(), uint32_t(g_positions.size()));
-        write(out, g_tangents.data(),  uint32_t(g_tangents.size()));
-        write(out, g_colors.data(), uint32_t(g_colors.size()));
-        write(out, g_uv0.data(), uint32_t(g_uv0.size()));
+        write(out, data.positions.data(), uint32_t(data.positions.size()));
+        if (g_packedTangents) {
+            write(out, data.packedTangents.data(), uint32_t(data.packedTangents.size()));
+        } else {
+            write(out, data.tangents.data(), uint32_t(data.tangents.size()));
+        }
+        write(out, data.colors.data(), uint32_t(data.colors.size()));
+        write(out, data.uv0.data(), uint32_t(data.uv0.size()));
         if (hasUV1) {
-            write(out, g_uv1.data(), uint32_t(g_uv1.size()));
+            write(out, data.uv1.data(), uint32_t(data.uv1.size()));
         }
     }
 
+    pad(out, SECTION_ALIGNMENT);
+
     if (!hasIndex16) {
-        write(out, g_indices.data(), uint32_t(g_indices.size()));
+        write(out, data.indices.data(), uint32_t(data.indices.size()));
     } else {
         std::vector<uint16_t> smallIndices;
-        smallIndices.resize(g_indices.size());
-        for (size_t i = 0; i < g_indices.size(); i++) {
-            smallIndices[i] = static_cast<uint16_t>(g_indices[i]);
+        smallIndices.resize(data.indices.size());
+        for (size_t i = 0; i < data.indices.size(); i++) {
+            smallIndices[i] = static_cast<uint16_t>(data.indices[i]);
         }
         write(out, smallIndices.data(), uint32_t(smallIndices.size()));
     }
 
+    pad(out, sizeof(uint32_t));
     write(out, meshes.data(), header.parts);
 
     uint32_t materialCount = scene->mNumMaterials;
@@ -436,7 +745,7 @@ int main(int argc, char* argv[]) {
 
         aiString name;
         if (material->Get(AI_MATKEY_NAME, name) != AI_SUCCESS) {
-            std::cerr << "Unnamed material replaced with 'default'" << std::endl;
+            log << "Unnamed material replaced with 'default'" << std::endl;
             write(out, uint32_t(7));
             write(out, "default\0", uint32_t(8));
         } else {
@@ -446,8 +755,98 @@ int main(int argc, char* argv[]) {
         }
     }
 
+    write(out, lodParts.data(), uint32_t(lodParts.size()));
+
     out.flush();
     out.close();
 
+    return out.good();
+}
+
+struct Conversion {
+    Path src;
+    Path dst;
+};
+
+// each line of a manifest is a source mesh and its destination file, separated by whitespace
+static bool readManifest(const Path& manifest, std::vector<Conversion>& conversions) {
+    std::ifstream in(manifest);
+    if (!in.good()) {
+        std::cerr << "Could not read the manifest " << manifest << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        std::string src, dst;
+        if (!(fields >> src)) {
+            continue;
+        }
+        if (!(fields >> dst)) {
+            std::cerr << "No destination for " << src << " in " << manifest << std::endl;
+            return false;
+        }
+        conversions.push_back({ src, dst });
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int optionIndex = handleArguments(argc, argv);
+    int numArgs = argc - optionIndex;
+
+    std::vector<Conversion> conversions;
+    if (!g_manifest.isEmpty()) {
+        if (!readManifest(g_manifest, conversions)) {
+            return 1;
+        }
+    }
+    if (!g_outputDir.isEmpty()) {
+        if (!g_outputDir.exists()) {
+            g_outputDir.mkdirRecursive();
+        }
+        for (int i = optionIndex; i < argc; i++) {
+            Path src(argv[i]);
+            Path dst(g_outputDir + (src.getNameWithoutExtension() + ".filamesh"));
+            conversions.push_back({ src, dst });
+        }
+    } else if (numArgs == 2) {
+        conversions.push_back({ argv[optionIndex], argv[optionIndex + 1] });
+    } else if (numArgs != 0 || conversions.empty()) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    // a log per conversion, printed at once so the output of concurrent conversions doesn't mix
+    std::mutex lock;
+    std::atomic<uint32_t> failures = { 0 };
+    auto run = [&](uint32_t start, uint32_t count) {
+        for (uint32_t i = start; i < start + count; i++) {
+            Conversion const& conversion = conversions[i];
+            std::ostringstream log;
+            const bool success = convert(conversion.src, conversion.dst, log);
+            if (!success) {
+                failures++;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            std::ostream& out = success ? std::cout : std::cerr;
+            if (conversions.size() > 1) {
+                out << conversion.src << " -> " << conversion.dst << std::endl;
+            }
+            out << log.str();
+        }
+    };
+
+    JobSystem& js = getJobSystem();
+    JobSystem::Job* job = jobs::parallel_for(js, nullptr, 0, uint32_t(conversions.size()),
+            std::ref(run), jobs::CountSplitter<1, 64>());
+    js.runAndWait(job);
+    js.release(job);
+
+    if (failures > 0) {
+        std::cerr << failures << " of " << conversions.size() << " meshes failed to convert"
+                << std::endl;
+        return 1;
+    }
     return 0;
 }
@@ -61,8 +61,11 @@ static void usage(char* name) {
             "       Reflect the specified metadata as JSON: parameters\n\n"
             "   --variant-filter=<filter>, -v <filter>\n"
             "       Filter out specified comma-separated variants:\n"
-            "           directionalLighting, dynamicLighting, shadowReceiver, skinning\n"
+            "           directionalLighting, dynamicLighting, shadowReceiver, skinning, instancing,\n"
+            "           stereo\n"
             "       This variant filter is merged the filter from the material, if any\n\n"
+            "   --cache=<dir>, -c <dir>\n"
+            "       Reuse the optimized shaders of previous compilations, stored in <dir>\n\n"
             "Internal use only:\n"
             "   --output-format, -f\n"
             "       Specify output format: blob (default) or header\n\n"
@@ -91,7 +94,7 @@ CommandlineConfig::CommandlineConfig(int argc, char** argv) : Config(), mArgc(ar
 }
 
 bool CommandlineConfig::parse() {
-    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSEr:v:";
+    static constexpr const char* OPTSTR = "hxo:f:dm:a:p:OSEr:v:c:";
     static const struct option OPTIONS[] = {
             { "help",                    no_argument, nullptr, 'h' },
             { "license",                 no_argument, nullptr, 'l' },
@@ -108,6 +111,7 @@ bool CommandlineConfig::parse() {
             { "api",               required_argument, nullptr, 'a' },
             { "reflect",           required_argument, nullptr, 'r' },
             { "print",                   no_argument, nullptr, 't' },
+            { "cache",             required_argument, nullptr, 'c' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -196,6 +200,10 @@ bool CommandlineConfig::parse() {
                         variantFilter |= filament::Variant::SHADOW_RECEIVER;
                     } else if (item == "skinning") {
                         variantFilter |= filament::Variant::SKINNING;
+                    } else if (item == "instancing") {
+                        variantFilter |= filament::Variant::INSTANCING;
+                    } else if (item == "stereo") {
+                        variantFilter |= filament::Variant::STEREO;
                     }
                 }
                 mVariantFilter = variantFilter;
@@ -217,6 +225,9 @@ bool CommandlineConfig::parse() {
             case 't':
                 mPrintShaders = true;
                 break;
+            case 'c':
+                mCacheDirectory = arg;
+                break;
         }
     }
 
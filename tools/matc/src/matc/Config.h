@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <ostream>
+#include <string>
 
 #include <utils/compiler.h>
 
@@ -136,6 +137,11 @@ public:
         return mVariantFilter;
     }
 
+    // directory of the post-processed shaders cache, empty when caching is disabled
+    std::string const& getCacheDirectory() const noexcept {
+        return mCacheDirectory;
+    }
+
 protected:
     bool mDebug = false;
     bool mIsValid = true;
@@ -147,6 +153,7 @@ protected:
     OutputFormat mOutputFormat = OutputFormat::BLOB;
     TargetApi mTargetApi = TargetApi::OPENGL;
     uint8_t mVariantFilter = 0;
+    std::string mCacheDirectory;
 };
 
 }
@@ -75,6 +75,7 @@ std::unordered_map<std::string, SamplerType> Enums::mStringToSamplerType = {
         { "sampler2d",       SamplerType::SAMPLER_2D },
         { "samplerCubemap",  SamplerType::SAMPLER_CUBEMAP },
         { "samplerExternal", SamplerType::SAMPLER_EXTERNAL },
+        { "sampler2dArray",  SamplerType::SAMPLER_2D_ARRAY },
 };
 
 template <>
@@ -30,6 +30,7 @@
 #include "ParametersProcessor.h"
 #include "sca/GLSLTools.h"
 #include "sca/GLSLPostProcessor.h"
+#include "ShaderCache.h"
 
 using namespace utils;
 using namespace filamat;
@@ -302,12 +303,30 @@ bool MaterialCompiler::run(const Config& config) {
     }
 
     // Install postprocessor (to optimize/strip GLSL).
-    GLSLPostProcessor postProcessor(config);
+    GLSLPostProcessor postProcessor(config, builder.isPrecisionLoweringEnabled());
 
-    builder.postProcessor(std::bind(&GLSLPostProcessor::process, postProcessor, _1, _2, _3, _4, _5));
+    std::unique_ptr<ShaderCache> cache;
+    if (config.getCacheDirectory().empty()) {
+        builder.postProcessor(std::bind(&GLSLPostProcessor::process, std::ref(postProcessor),
+                _1, _2, _3, _4, _5));
+    } else {
+        cache.reset(new ShaderCache(config, config.getCacheDirectory()));
+        builder.postProcessor(std::bind(&ShaderCache::process, cache.get(),
+                std::ref(postProcessor), _1, _2, _3, _4, _5));
+    }
 
     // Write builder.build() to output.
     Package package = builder.build();
+    if (cache) {
+        cache->printStats(std::cout);
+    }
+    if (postProcessor.isPrecisionLoweringEnabled() &&
+            config.getPlatform() != Config::Platform::DESKTOP &&
+            (config.getOptimizationLevel() == Config::Optimization::SIZE ||
+             config.getOptimizationLevel() == Config::Optimization::PERFORMANCE)) {
+        std::cout << "Precision lowering: " << postProcessor.getLoweredCount()
+                << " values lowered to mediump" << std::endl;
+    }
     if (!package.isValid()) {
         return false;
     }
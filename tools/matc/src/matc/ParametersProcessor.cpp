@@ -47,6 +47,13 @@ static constexpr const char* PARAM_KEY_MASK_THRESHOLD    = "maskThreshold";
 static constexpr const char* PARAM_KEY_SHADOW_MULTIPLIER = "shadowMultiplier";
 static constexpr const char* PARAM_KEY_SHADING           = "shadingModel";
 static constexpr const char* PARAM_KEY_VARIANT_FILTER    = "variantFilter";
+static constexpr const char* PARAM_KEY_PRECISION_LOWERING = "precisionLowering";
+static constexpr const char* PARAM_KEY_FEATURES          = "features";
+
+// keys of the features object
+static constexpr const char* FEATURE_KEY_IBL             = "ibl";
+static constexpr const char* FEATURE_KEY_PUNCTUAL_LIGHTS = "punctualLights";
+static constexpr const char* FEATURE_KEY_SPECULAR_AO     = "specularAmbientOcclusion";
 
 ParametersProcessor::ParametersProcessor() {
     mConfigProcessor[PARAM_KEY_NAME]              = &ParametersProcessor::processName;
@@ -67,6 +74,8 @@ ParametersProcessor::ParametersProcessor() {
     mConfigProcessor[PARAM_KEY_SHADOW_MULTIPLIER] = &ParametersProcessor::processShadowMultiplier;
     mConfigProcessor[PARAM_KEY_SHADING]           = &ParametersProcessor::processShading;
     mConfigProcessor[PARAM_KEY_VARIANT_FILTER]    = &ParametersProcessor::processVariantFilter;
+    mConfigProcessor[PARAM_KEY_PRECISION_LOWERING] = &ParametersProcessor::processPrecisionLowering;
+    mConfigProcessor[PARAM_KEY_FEATURES]          = &ParametersProcessor::processFeatures;
 
     mRootAsserts[PARAM_KEY_NAME]              = JsonishValue::Type::STRING;
     mRootAsserts[PARAM_KEY_INTERPOLATION]     = JsonishValue::Type::STRING;
@@ -84,8 +93,10 @@ ParametersProcessor::ParametersProcessor() {
     mRootAsserts[PARAM_KEY_TRANSPARENCY_MODE] = JsonishValue::Type::STRING;
     mRootAsserts[PARAM_KEY_MASK_THRESHOLD]    = JsonishValue::Type::NUMBER;
     mRootAsserts[PARAM_KEY_SHADOW_MULTIPLIER] = JsonishValue::Type::BOOL;
+    mRootAsserts[PARAM_KEY_PRECISION_LOWERING] = JsonishValue::Type::BOOL;
     mRootAsserts[PARAM_KEY_SHADING]           = JsonishValue::Type::STRING;
     mRootAsserts[PARAM_KEY_VARIANT_FILTER]    = JsonishValue::Type::ARRAY;
+    mRootAsserts[PARAM_KEY_FEATURES]          = JsonishValue::Type::OBJECT;
 
     mStringToInterpolation["smooth"] = MaterialBuilder::Interpolation::SMOOTH;
     mStringToInterpolation["flat"] = MaterialBuilder::Interpolation::FLAT;
@@ -125,6 +136,12 @@ ParametersProcessor::ParametersProcessor() {
     mStringToVariant["dynamicLighting"] = filament::Variant::DYNAMIC_LIGHTING;
     mStringToVariant["shadowReceiver"] = filament::Variant::SHADOW_RECEIVER;
     mStringToVariant["skinning"] = filament::Variant::SKINNING;
+    mStringToVariant["instancing"] = filament::Variant::INSTANCING;
+    mStringToVariant["stereo"] = filament::Variant::STEREO;
+
+    mStringToIblMode["full"] = MaterialBuilder::IblMode::FULL;
+    mStringToIblMode["shOnly"] = MaterialBuilder::IblMode::SH_ONLY;
+    mStringToIblMode["none"] = MaterialBuilder::IblMode::NONE;
 }
 
 bool ParametersProcessor::process(filamat::MaterialBuilder& builder, const JsonishObject& jsonObject) {
@@ -482,6 +499,46 @@ bool ParametersProcessor::processVariantFilter(filamat::MaterialBuilder& builder
     return true;
 }
 
+bool ParametersProcessor::processPrecisionLowering(filamat::MaterialBuilder& builder,
+        const JsonishValue& value) {
+    builder.precisionLowering(value.toJsonBool()->getBool());
+    return true;
+}
+
+bool ParametersProcessor::processFeatures(filamat::MaterialBuilder& builder,
+        const JsonishValue& value) {
+    for (auto entry : value.toJsonObject()->getEntries()) {
+        const std::string& key = entry.first;
+        const JsonishValue* field = entry.second;
+        if (key == FEATURE_KEY_IBL) {
+            if (field->getType() != JsonishValue::Type::STRING) {
+                std::cerr << PARAM_KEY_FEATURES << ": " << key << " must be a STRING." << std::endl;
+                return false;
+            }
+            auto jsonString = field->toJsonString();
+            if (!isStringValidEnum(mStringToIblMode, jsonString->getString())) {
+                return logEnumIssue(key, *jsonString, mStringToIblMode);
+            }
+            builder.ibl(stringToEnum(mStringToIblMode, jsonString->getString()));
+        } else if (key == FEATURE_KEY_PUNCTUAL_LIGHTS || key == FEATURE_KEY_SPECULAR_AO) {
+            if (field->getType() != JsonishValue::Type::BOOL) {
+                std::cerr << PARAM_KEY_FEATURES << ": " << key << " must be a BOOL." << std::endl;
+                return false;
+            }
+            bool enable = field->toJsonBool()->getBool();
+            if (key == FEATURE_KEY_PUNCTUAL_LIGHTS) {
+                builder.punctualLights(enable);
+            } else {
+                builder.specularAmbientOcclusion(enable);
+            }
+        } else {
+            std::cerr << PARAM_KEY_FEATURES << ": unknown feature \"" << key << "\"" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
 filamat::MaterialBuilder::Variable ParametersProcessor::intToVariable(size_t i) const noexcept {
     switch (i) {
         case 0: return MaterialBuilder::Variable::CUSTOM0;
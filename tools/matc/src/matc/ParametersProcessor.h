@@ -52,8 +52,10 @@ private:
     bool processTransparencyMode(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processMaskThreshold(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processShadowMultiplier(filamat::MaterialBuilder &builder, const JsonishValue &value);
+    bool processPrecisionLowering(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processShading(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processVariantFilter(filamat::MaterialBuilder &builder, const JsonishValue &value);
+    bool processFeatures(filamat::MaterialBuilder &builder, const JsonishValue &value);
     bool processParameter(filamat::MaterialBuilder& builder, const JsonishObject& value) const
     noexcept;
 
@@ -100,6 +102,7 @@ private:
     std::unordered_map<std::string, filament::VertexAttribute> mStringToAttributeIndex;
     std::unordered_map<std::string, filamat::MaterialBuilder::Shading> mStringToShading;
     std::unordered_map<std::string, uint8_t> mStringToVariant;
+    std::unordered_map<std::string, filamat::MaterialBuilder::IblMode> mStringToIblMode;
 };
 
 } // namespace matc
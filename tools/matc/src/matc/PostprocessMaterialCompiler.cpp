@@ -42,7 +42,8 @@ bool PostprocessMaterialCompiler::run(const Config& config) {
 
     // Install postprocessor (to clean GLSL from comments and dead code).
     GLSLPostProcessor postProcessor(config);
-    builder.postProcessor(std::bind(&GLSLPostProcessor::process, postProcessor, _1, _2, _3, _4, _5));
+    builder.postProcessor(std::bind(&GLSLPostProcessor::process, std::ref(postProcessor),
+            _1, _2, _3, _4, _5));
 
     Package package = builder.build();
     if (!package.isValid()) {
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShaderCache.h"
+
+#include <utils/Hash.h>
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace utils;
+
+namespace matc {
+
+// Bump this when the post-processor's output changes for the same input. Entries written by
+// another build of matc are never reused either, since glslang or spirv-tools may have changed.
+static constexpr uint32_t CACHE_VERSION = 1;
+static constexpr const char MATC_BUILD[] = __DATE__ " " __TIME__;
+
+ShaderCache::ShaderCache(const Config& config, const Path& directory)
+        : mConfig(config), mDirectory(directory) {
+    if (!mDirectory.exists()) {
+        mDirectory.mkdirRecursive();
+    }
+    mIsWritable = mDirectory.isDirectory();
+    if (!mIsWritable) {
+        std::cerr << "Warning: cannot use shader cache directory '" << mDirectory
+                << "', shaders will not be cached." << std::endl;
+    }
+}
+
+ShaderCache::Key ShaderCache::computeKey(const std::string& inputShader,
+        filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+        bool glsl, bool spirv, bool lowerPrecision) const noexcept {
+    const uint32_t header[] = {
+            CACHE_VERSION,
+            uint32_t(mConfig.getOptimizationLevel()),
+            uint32_t(shaderType),
+            uint32_t(shaderModel),
+            uint32_t(glsl),
+            uint32_t(spirv),
+            uint32_t(lowerPrecision)
+    };
+    auto hash = [&](uint64_t seed) {
+        uint64_t h = hash::fnv1a(header, sizeof(header), seed);
+        h = hash::fnv1a(MATC_BUILD, sizeof(MATC_BUILD), h);
+        return hash::fnv1a(inputShader.data(), inputShader.size(), h);
+    };
+    return { hash(0xcbf29ce484222325ull), hash(0x84222325cbf29ce4ull) };
+}
+
+Path ShaderCache::getEntryPath(Key const& key) const {
+    std::stringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key.name << ".shader";
+    return mDirectory.concat(name.str());
+}
+
+// An entry is the check value, followed by the GLSL and the SPIR-V, each preceded by its size.
+bool ShaderCache::read(Key const& key, std::string* outputGlsl, SpirvBlob* outputSpirv) const {
+    std::ifstream in(getEntryPath(key).c_str(), std::ifstream::binary);
+    if (!in) {
+        return false;
+    }
+
+    uint64_t check = 0;
+    in.read(reinterpret_cast<char*>(&check), sizeof(check));
+    if (!in || check != key.check) {
+        return false;
+    }
+
+    uint32_t glslSize = 0;
+    in.read(reinterpret_cast<char*>(&glslSize), sizeof(glslSize));
+    std::string glsl(glslSize, '\0');
+    in.read(&glsl[0], glslSize);
+
+    uint32_t spirvCount = 0;
+    in.read(reinterpret_cast<char*>(&spirvCount), sizeof(spirvCount));
+    SpirvBlob spirv(spirvCount);
+    in.read(reinterpret_cast<char*>(spirv.data()), spirvCount * sizeof(uint32_t));
+    if (!in) {
+        return false;
+    }
+
+    if (outputGlsl) {
+        *outputGlsl = std::move(glsl);
+    }
+    if (outputSpirv) {
+        *outputSpirv = std::move(spirv);
+    }
+    return true;
+}
+
+void ShaderCache::write(Key const& key, std::string const* glsl, SpirvBlob const* spirv) const {
+    // Entries are written to a temporary file first, then renamed, so that a concurrent read,
+    // possibly from another matc process, never sees a partial entry.
+    const Path path = getEntryPath(key);
+    std::stringstream tmp;
+    tmp << path << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id());
+    const std::string tmpPath = tmp.str();
+
+    std::ofstream out(tmpPath.c_str(), std::ofstream::binary);
+    const uint32_t glslSize = glsl ? uint32_t(glsl->size()) : 0;
+    const uint32_t spirvCount = spirv ? uint32_t(spirv->size()) : 0;
+    out.write(reinterpret_cast<char const*>(&key.check), sizeof(key.check));
+    out.write(reinterpret_cast<char const*>(&glslSize), sizeof(glslSize));
+    if (glslSize) {
+        out.write(glsl->data(), glslSize);
+    }
+    out.write(reinterpret_cast<char const*>(&spirvCount), sizeof(spirvCount));
+    if (spirvCount) {
+        out.write(reinterpret_cast<char const*>(spirv->data()), spirvCount * sizeof(uint32_t));
+    }
+    out.close();
+
+    if (out.fail() || std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+    }
+}
+
+bool ShaderCache::process(GLSLPostProcessor& postProcessor, const std::string& inputShader,
+        filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+        std::string* outputGlsl, SpirvBlob* outputSpirv) {
+
+    // Without optimizations the OpenGL shaders are copied as is, there is nothing to save
+    if (!mIsWritable || (!outputSpirv &&
+            mConfig.getOptimizationLevel() == Config::Optimization::NONE)) {
+        return postProcessor.process(inputShader, shaderType, shaderModel,
+                outputGlsl, outputSpirv);
+    }
+
+    // the key must be computed first, the output can be the input
+    const Key key = computeKey(inputShader, shaderType, shaderModel,
+            outputGlsl != nullptr, outputSpirv != nullptr,
+            postProcessor.isPrecisionLoweringEnabled());
+
+    if (read(key, outputGlsl, outputSpirv)) {
+        mHitCount++;
+        if (outputGlsl && mConfig.printShaders()) {
+            std::cout << *outputGlsl << std::endl;
+        }
+        return true;
+    }
+
+    mMissCount++;
+    if (!postProcessor.process(inputShader, shaderType, shaderModel, outputGlsl, outputSpirv)) {
+        return false;
+    }
+    write(key, outputGlsl, outputSpirv);
+    return true;
+}
+
+void ShaderCache::printStats(std::ostream& out) const {
+    out << "Shader cache: " << getHitCount() << " hits, " << getMissCount() << " misses"
+            << std::endl;
+}
+
+} // namespace matc
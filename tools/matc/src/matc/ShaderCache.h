@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_SHADERCACHE_H
+#define TNT_SHADERCACHE_H
+
+#include "sca/GLSLPostProcessor.h"
+
+#include <matc/Config.h>
+
+#include <utils/Path.h>
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace matc {
+
+// On-disk cache of the post-processor's output. Each entry is addressed by a hash of the
+// generated shader and of everything else that changes the output: the optimization level,
+// the requested outputs, the shader type and model, precision lowering, and the version of matc.
+// process() can be called from several threads at once.
+class ShaderCache {
+public:
+    ShaderCache(const Config& config, const utils::Path& directory);
+
+    using SpirvBlob = GLSLPostProcessor::SpirvBlob;
+
+    // Same as GLSLPostProcessor::process(), but only calls postProcessor on a cache miss.
+    bool process(GLSLPostProcessor& postProcessor, const std::string& inputShader,
+            filament::driver::ShaderType shaderType, filament::driver::ShaderModel shaderModel,
+            std::string* outputGlsl, SpirvBlob* outputSpirv);
+
+    size_t getHitCount() const noexcept { return mHitCount; }
+    size_t getMissCount() const noexcept { return mMissCount; }
+
+    void printStats(std::ostream& out) const;
+
+private:
+    struct Key {
+        uint64_t name;  // name of the entry's file
+        uint64_t check; // stored in the entry, guards against collisions on the name
+    };
+
+    Key computeKey(const std::string& inputShader, filament::driver::ShaderType shaderType,
+            filament::driver::ShaderModel shaderModel, bool glsl, bool spirv,
+            bool lowerPrecision) const noexcept;
+    utils::Path getEntryPath(Key const& key) const;
+    bool read(Key const& key, std::string* outputGlsl, SpirvBlob* outputSpirv) const;
+    void write(Key const& key, std::string const* glsl, SpirvBlob const* spirv) const;
+
+    const Config& mConfig;
+    const utils::Path mDirectory;
+    bool mIsWritable;
+    std::atomic<size_t> mHitCount = { 0 };
+    std::atomic<size_t> mMissCount = { 0 };
+};
+
+} // namespace matc
+
+#endif //TNT_SHADERCACHE_H
@@ -18,8 +18,11 @@
 
 #include <iostream>
 #include <sstream>
+#include <string>
 #include <vector>
 
+#include <filament/EngineEnums.h>
+
 #include <GlslangToSpv.h>
 #include <SPVRemapper.h>
 #include <localintermediate.h>
@@ -28,6 +31,7 @@
 
 #include "builtinResource.h"
 #include "GLSLTools.h"
+#include "PrecisionLowering.h"
 
 using namespace glslang;
 using namespace spirv_cross;
@@ -35,7 +39,8 @@ using namespace spvtools;
 
 namespace matc {
 
-GLSLPostProcessor::GLSLPostProcessor(const Config& config): mConfig(config) {
+GLSLPostProcessor::GLSLPostProcessor(const Config& config, bool lowerPrecision)
+        : mConfig(config), mLowerPrecision(lowerPrecision) {
 }
 
 GLSLPostProcessor::~GLSLPostProcessor() {
@@ -140,16 +145,17 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
         return true;
     }
 
-    mGlslOutput = outputGlsl;
-    mSpirvOutput = outputSpirv;
+    InternalConfig internalConfig;
+    internalConfig.glslOutput = outputGlsl;
+    internalConfig.spirvOutput = outputSpirv;
 
     if (shaderType == filament::driver::VERTEX) {
-        mShLang = EShLangVertex;
+        internalConfig.shLang = EShLangVertex;
     } else {
-        mShLang = EShLangFragment;
+        internalConfig.shLang = EShLangFragment;
     }
 
-    TShader tShader(mShLang);
+    TShader tShader(internalConfig.shLang);
 
     // The cleaner must be declared after the TShader to prevent ASAN failures.
     GLSLangCleaner cleaner;
@@ -157,10 +163,11 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
     const char* shaderCString = inputShader.c_str();
     tShader.setStrings(&shaderCString, 1);
 
-    mLangVersion = GLSLTools::glslangVersionFromShaderModel(shaderModel);
-    GLSLTools::prepareShaderParser(tShader, mShLang, mLangVersion, mConfig.getOptimizationLevel());
+    internalConfig.langVersion = GLSLTools::glslangVersionFromShaderModel(shaderModel);
+    GLSLTools::prepareShaderParser(tShader, internalConfig.shLang, internalConfig.langVersion,
+            mConfig.getOptimizationLevel());
     EShMessages msg = GLSLTools::glslangFlagsFromTargetApi(targetApi);
-    bool ok = tShader.parse(&DefaultTBuiltInResource, mLangVersion, false, msg);
+    bool ok = tShader.parse(&DefaultTBuiltInResource, internalConfig.langVersion, false, msg);
     if (!ok) {
         std::cerr << tShader.getInfoLog() << std::endl;
         return false;
@@ -168,40 +175,41 @@ bool GLSLPostProcessor::process(const std::string& inputShader,
 
     switch (mConfig.getOptimizationLevel()) {
         case Config::Optimization::NONE:
-            if (mSpirvOutput) {
-                GlslangToSpv(*tShader.getIntermediate(), *mSpirvOutput);
+            if (internalConfig.spirvOutput) {
+                GlslangToSpv(*tShader.getIntermediate(), *internalConfig.spirvOutput);
             } else {
                 std::cerr << "GLSL post-processor invoked with optimization level NONE"
                         << std::endl;
             }
             break;
         case Config::Optimization::PREPROCESSOR:
-            preprocessOptimization(tShader, shaderModel);
+            preprocessOptimization(tShader, shaderModel, internalConfig);
             break;
         case Config::Optimization::SIZE:
         case Config::Optimization::PERFORMANCE:
-            fullOptimization(tShader, shaderModel);
+            fullOptimization(tShader, shaderModel, internalConfig);
             break;
     }
 
-    if (mGlslOutput) {
-        *mGlslOutput = shrinkString(*mGlslOutput);
+    if (internalConfig.glslOutput) {
+        *internalConfig.glslOutput = shrinkString(*internalConfig.glslOutput);
         if (mConfig.printShaders()) {
-            std::cout << *mGlslOutput << std::endl;
+            std::cout << *internalConfig.glslOutput << std::endl;
         }
     }
     return true;
 }
 
 void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
-        const filament::driver::ShaderModel shaderModel) const {
+        const filament::driver::ShaderModel shaderModel,
+        InternalConfig const& internalConfig) const {
     using TargetApi = Config::TargetApi;
 
     std::string glsl;
     TShader::ForbidIncluder forbidIncluder;
 
     int version = GLSLTools::glslangVersionFromShaderModel(shaderModel);
-    const TargetApi targetApi = mSpirvOutput ? TargetApi::VULKAN : TargetApi::OPENGL;
+    const TargetApi targetApi = internalConfig.spirvOutput ? TargetApi::VULKAN : TargetApi::OPENGL;
     EShMessages msg = GLSLTools::glslangFlagsFromTargetApi(targetApi);
     bool ok = tShader.preprocess(&DefaultTBuiltInResource, version, ENoProfile, false, false,
             msg, &glsl, forbidIncluder);
@@ -210,27 +218,28 @@ void GLSLPostProcessor::preprocessOptimization(glslang::TShader& tShader,
         std::cerr << tShader.getInfoLog() << std::endl;
     }
 
-    if (mSpirvOutput) {
-        TShader spirvShader(mShLang);
+    if (internalConfig.spirvOutput) {
+        TShader spirvShader(internalConfig.shLang);
         const char* shaderCString = glsl.c_str();
         spirvShader.setStrings(&shaderCString, 1);
-        GLSLTools::prepareShaderParser(spirvShader, mShLang, mLangVersion,
-                mConfig.getOptimizationLevel());
-        ok = spirvShader.parse(&DefaultTBuiltInResource, mLangVersion, false, msg);
+        GLSLTools::prepareShaderParser(spirvShader, internalConfig.shLang,
+                internalConfig.langVersion, mConfig.getOptimizationLevel());
+        ok = spirvShader.parse(&DefaultTBuiltInResource, internalConfig.langVersion, false, msg);
         if (!ok) {
             std::cerr << spirvShader.getInfoLog() << std::endl;
         } else {
-            GlslangToSpv(*spirvShader.getIntermediate(), *mSpirvOutput);
+            GlslangToSpv(*spirvShader.getIntermediate(), *internalConfig.spirvOutput);
         }
     }
 
-    if (mGlslOutput) {
-        *mGlslOutput = glsl;
+    if (internalConfig.glslOutput) {
+        *internalConfig.glslOutput = glsl;
     }
 }
 
 void GLSLPostProcessor::fullOptimization(const TShader& tShader,
-        const filament::driver::ShaderModel shaderModel) const {
+        const filament::driver::ShaderModel shaderModel,
+        InternalConfig const& internalConfig) const {
     SpirvBlob spirv;
 
     // Compile GLSL to to SPIR-V
@@ -255,17 +264,22 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         return;
     }
 
+    // mediump is only worth it on mobile GPUs
+    if (mLowerPrecision && shaderModel == filament::driver::ShaderModel::GL_ES_30) {
+        mLoweredCount += lowerPrecision(spirv);
+    }
+
     // Remove dead module-level objects: functions, types, vars
     spv::spirvbin_t remapper(0);
     remapper.registerErrorHandler(errorHandler);
     remapper.remap(spirv, spv::spirvbin_base_t::DCE_ALL);
 
-    if (mSpirvOutput) {
-        *mSpirvOutput = spirv;
+    if (internalConfig.spirvOutput) {
+        *internalConfig.spirvOutput = spirv;
     }
 
     // Transpile back to GLSL
-    if (mGlslOutput) {
+    if (internalConfig.glslOutput) {
         CompilerGLSL::Options glslOptions;
         glslOptions.es = shaderModel == filament::driver::ShaderModel::GL_ES_30;
         glslOptions.version = shaderVersionFromModel(shaderModel);
@@ -278,7 +292,18 @@ void GLSLPostProcessor::fullOptimization(const TShader& tShader,
         CompilerGLSL glslCompiler(move(spirv));
         glslCompiler.set_common_options(glslOptions);
 
-        *mGlslOutput = glslCompiler.compile();
+        *internalConfig.glslOutput = glslCompiler.compile();
+
+        // spirv-cross enables OVR_multiview2 for the view index but doesn't declare the number
+        // of views, which the vertex shaders of the stereo variants require
+        std::string& glsl = *internalConfig.glslOutput;
+        const std::string multiview("#extension GL_OVR_multiview2 : require\n");
+        size_t pos = glsl.find(multiview);
+        if (tShader.getStage() == EShLangVertex && pos != std::string::npos &&
+                glsl.find("num_views") == std::string::npos) {
+            glsl.insert(pos + multiview.size(), "layout(num_views = " +
+                    std::to_string(filament::CONFIG_STEREO_EYE_COUNT) + ") in;\n");
+        }
     }
 }
 
@@ -17,6 +17,7 @@
 #ifndef TNT_GLSLPOSTPROCESSOR_H
 #define TNT_GLSLPOSTPROCESSOR_H
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -32,7 +33,9 @@ namespace matc {
 
 class GLSLPostProcessor {
 public:
-    GLSLPostProcessor(const Config& config);
+    // When lowerPrecision is set, shaders for mobile (i.e. the ESSL shader model) that go through
+    // the SPIR-V optimizer have their eligible values demoted to mediump, see lowerPrecision().
+    explicit GLSLPostProcessor(const Config& config, bool lowerPrecision = false);
 
     ~GLSLPostProcessor();
 
@@ -42,20 +45,33 @@ public:
             filament::driver::ShaderModel shaderModel, std::string* outputGlsl,
             SpirvBlob* outputSpirv);
 
+    bool isPrecisionLoweringEnabled() const noexcept { return mLowerPrecision; }
+
+    // number of values demoted to mediump by all the process() calls so far
+    size_t getLoweredCount() const noexcept { return mLoweredCount; }
+
 private:
+    // the state of a single process() call, which can be called from several threads at once
+    struct InternalConfig {
+        std::string* glslOutput = nullptr;
+        SpirvBlob* spirvOutput = nullptr;
+        EShLanguage shLang = EShLangFragment;
+        int langVersion = 0;
+    };
+
     void fullOptimization(const glslang::TShader& tShader,
-            const filament::driver::ShaderModel shaderModel) const;
+            const filament::driver::ShaderModel shaderModel,
+            InternalConfig const& internalConfig) const;
     void preprocessOptimization(glslang::TShader& tShader,
-            const filament::driver::ShaderModel shaderModel) const;
+            const filament::driver::ShaderModel shaderModel,
+            InternalConfig const& internalConfig) const;
 
     void registerSizePasses(spvtools::Optimizer& optimizer) const;
     void registerPerformancePasses(spvtools::Optimizer& optimizer) const;
 
     const Config& mConfig;
-    std::string* mGlslOutput = nullptr;
-    SpirvBlob* mSpirvOutput = nullptr;
-    EShLanguage mShLang = EShLangFragment;
-    int mLangVersion = 0;
+    const bool mLowerPrecision;
+    mutable std::atomic<size_t> mLoweredCount = { 0 };
 };
 
 } // namespace matc
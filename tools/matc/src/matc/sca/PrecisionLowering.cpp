@@ -0,0 +1,440 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "PrecisionLowering.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <GLSL.std.450.h>
+#include <spirv.hpp>
+
+namespace matc {
+
+namespace {
+
+struct Instruction {
+    size_t offset;
+    uint32_t opcode;
+    uint32_t wordCount;
+};
+
+// Operations that never produce a value outside of the range of their operands, or just about
+// (additions and subtractions at most double it).
+bool isRangePreserving(uint32_t opcode) {
+    switch (opcode) {
+        case spv::OpFAdd:
+        case spv::OpFSub:
+        case spv::OpFNegate:
+        case spv::OpCopyObject:
+        case spv::OpCompositeConstruct:
+        case spv::OpCompositeExtract:
+        case spv::OpCompositeInsert:
+        case spv::OpVectorShuffle:
+        case spv::OpSelect:
+        case spv::OpPhi:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isRangePreservingExtInst(uint32_t inst) {
+    switch (inst) {
+        case GLSLstd450Round:
+        case GLSLstd450RoundEven:
+        case GLSLstd450Trunc:
+        case GLSLstd450FAbs:
+        case GLSLstd450FSign:
+        case GLSLstd450Floor:
+        case GLSLstd450Ceil:
+        case GLSLstd450Fract:
+        case GLSLstd450Sin:
+        case GLSLstd450Cos:
+        case GLSLstd450FMin:
+        case GLSLstd450FMax:
+        case GLSLstd450FClamp:
+        case GLSLstd450FMix:
+        case GLSLstd450Step:
+        case GLSLstd450SmoothStep:
+        case GLSLstd450NMin:
+        case GLSLstd450NMax:
+        case GLSLstd450NClamp:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The debug instructions and annotations, our decorations go right after them.
+bool isPreamble(uint32_t opcode) {
+    switch (opcode) {
+        case spv::OpNop:
+        case spv::OpSourceContinued:
+        case spv::OpSource:
+        case spv::OpSourceExtension:
+        case spv::OpName:
+        case spv::OpMemberName:
+        case spv::OpString:
+        case spv::OpLine:
+        case spv::OpNoLine:
+        case spv::OpModuleProcessed:
+        case spv::OpExtension:
+        case spv::OpExtInstImport:
+        case spv::OpMemoryModel:
+        case spv::OpEntryPoint:
+        case spv::OpExecutionMode:
+        case spv::OpCapability:
+        case spv::OpDecorate:
+        case spv::OpMemberDecorate:
+        case spv::OpDecorationGroup:
+        case spv::OpGroupDecorate:
+        case spv::OpGroupMemberDecorate:
+        case spv::OpDecorateId:
+        case spv::OpDecorateStringGOOGLE:
+        case spv::OpMemberDecorateStringGOOGLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+class PrecisionLowering {
+public:
+    explicit PrecisionLowering(std::vector<uint32_t>& spirv) : mSpirv(spirv) { }
+
+    size_t run() {
+        if (mSpirv.size() < 5 || mSpirv[0] != spv::MagicNumber) {
+            return 0;
+        }
+        const uint32_t bound = mSpirv[3];
+        mRelaxed.resize(bound);
+        mFloat.resize(bound);
+        mConstant.resize(bound);
+        mBuiltIn.resize(bound);
+        mTypeOf.resize(bound);
+        mPointee.resize(bound);
+        mStorageClass.resize(bound);
+        if (!parse()) {
+            return 0;
+        }
+
+        std::vector<uint32_t> lowered;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (Instruction const& c : mCandidates) {
+                const uint32_t result = word(c, 2);
+                if (!mRelaxed[result] && isComputedAtMediump(c)) {
+                    mRelaxed[result] = true;
+                    lowered.push_back(result);
+                    changed = true;
+                }
+            }
+            for (uint32_t input : mInputs) {
+                if (!mRelaxed[input] && isConsumedAtMediump(input)) {
+                    mRelaxed[input] = true;
+                    lowered.push_back(input);
+                    for (Instruction const& load : mLoads) {
+                        if (word(load, 3) == input && !mRelaxed[word(load, 2)]) {
+                            mRelaxed[word(load, 2)] = true;
+                            lowered.push_back(word(load, 2));
+                        }
+                    }
+                    changed = true;
+                }
+            }
+        }
+
+        if (!lowered.empty()) {
+            std::vector<uint32_t> decorations;
+            decorations.reserve(lowered.size() * 3);
+            for (uint32_t id : lowered) {
+                decorations.push_back((3u << spv::WordCountShift) | spv::OpDecorate);
+                decorations.push_back(id);
+                decorations.push_back(spv::DecorationRelaxedPrecision);
+            }
+            mSpirv.insert(mSpirv.begin() + mAnnotationsEnd,
+                    decorations.begin(), decorations.end());
+        }
+        return lowered.size();
+    }
+
+private:
+    uint32_t word(Instruction const& i, size_t index) const {
+        return mSpirv[i.offset + index];
+    }
+
+    bool isValid(uint32_t id) const {
+        return id < mRelaxed.size();
+    }
+
+    bool parse() {
+        const size_t size = mSpirv.size();
+        bool inFunction = false;
+        for (size_t offset = 5; offset < size; ) {
+            const uint32_t opcode = mSpirv[offset] & spv::OpCodeMask;
+            const uint32_t wordCount = mSpirv[offset] >> spv::WordCountShift;
+            if (wordCount == 0 || offset + wordCount > size) {
+                return false;
+            }
+            const Instruction i = { offset, opcode, wordCount };
+            offset += wordCount;
+
+            if (!mAnnotationsEnd && !isPreamble(opcode)) {
+                mAnnotationsEnd = i.offset;
+            }
+
+            // every id referenced below is checked against the bound of the module
+            auto id = [&](size_t index) -> uint32_t {
+                const uint32_t v = index < wordCount ? word(i, index) : 0;
+                return isValid(v) ? v : 0;
+            };
+
+            switch (opcode) {
+                case spv::OpEntryPoint:
+                    mIsFragment |= wordCount > 1 && word(i, 1) == spv::ExecutionModelFragment;
+                    break;
+                case spv::OpExtInstImport:
+                    if (wordCount > 2 && !strncmp("GLSL.std.450",
+                            reinterpret_cast<char const*>(&mSpirv[i.offset + 2]),
+                            (wordCount - 2) * sizeof(uint32_t))) {
+                        mGlslStd450 = id(1);
+                    }
+                    break;
+                case spv::OpDecorate:
+                    if (wordCount > 2) {
+                        if (word(i, 2) == spv::DecorationRelaxedPrecision) {
+                            mRelaxed[id(1)] = true;
+                        } else if (word(i, 2) == spv::DecorationBuiltIn) {
+                            mBuiltIn[id(1)] = true;
+                        }
+                    }
+                    break;
+                case spv::OpTypeFloat:
+                    mFloat[id(1)] = true;
+                    break;
+                case spv::OpTypeVector:
+                case spv::OpTypeMatrix:
+                    mFloat[id(1)] = mFloat[id(2)];
+                    break;
+                case spv::OpTypePointer:
+                    mPointee[id(1)] = id(3);
+                    break;
+                case spv::OpVariable:
+                    mTypeOf[id(2)] = id(1);
+                    mStorageClass[id(2)] = wordCount > 3 ? word(i, 3) : 0;
+                    if (!inFunction && mStorageClass[id(2)] == spv::StorageClassInput) {
+                        mInputs.push_back(id(2));
+                    }
+                    break;
+                case spv::OpUndef:
+                case spv::OpConstant:
+                case spv::OpConstantComposite:
+                case spv::OpConstantNull:
+                case spv::OpSpecConstant:
+                case spv::OpSpecConstantComposite:
+                case spv::OpSpecConstantOp:
+                    mTypeOf[id(2)] = id(1);
+                    mConstant[id(2)] = true;
+                    break;
+                case spv::OpFunction:
+                    inFunction = true;
+                    mTypeOf[id(2)] = id(1);
+                    break;
+                case spv::OpFunctionEnd:
+                    inFunction = false;
+                    break;
+                default:
+                    if (inFunction) {
+                        parseFunctionInstruction(i);
+                    }
+                    break;
+            }
+        }
+
+        // interpolants only make sense in fragment shaders, and built-ins (gl_FragCoord, ...)
+        // must keep their precision
+        std::vector<uint32_t> inputs;
+        if (mIsFragment) {
+            for (uint32_t input : mInputs) {
+                if (!mBuiltIn[input] && mFloat[mPointee[mTypeOf[input]]]) {
+                    inputs.push_back(input);
+                }
+            }
+        }
+        mInputs.swap(inputs);
+        return mAnnotationsEnd != 0;
+    }
+
+    void parseFunctionInstruction(Instruction const& i) {
+        // all the operations we care about have a result type and a result id
+        if (i.wordCount < 3 || !isValid(word(i, 1)) || !isValid(word(i, 2))) {
+            mInstructions.push_back(i);
+            return;
+        }
+        mInstructions.push_back(i);
+        if (hasResult(i.opcode)) {
+            mTypeOf[word(i, 2)] = word(i, 1);
+        }
+        if (i.opcode == spv::OpLoad && i.wordCount > 3 && isValid(word(i, 3))) {
+            mLoads.push_back(i);
+        }
+        if (mFloat[word(i, 1)] && isLowerable(i)) {
+            mCandidates.push_back(i);
+        }
+    }
+
+    // instructions with a result type and a result id that can appear in a function
+    static bool hasResult(uint32_t opcode) {
+        switch (opcode) {
+            case spv::OpStore:
+            case spv::OpCopyMemory:
+            case spv::OpCopyMemorySized:
+            case spv::OpLine:
+            case spv::OpNoLine:
+            case spv::OpNop:
+            case spv::OpLabel:
+            case spv::OpBranch:
+            case spv::OpBranchConditional:
+            case spv::OpSwitch:
+            case spv::OpReturn:
+            case spv::OpReturnValue:
+            case spv::OpKill:
+            case spv::OpUnreachable:
+            case spv::OpSelectionMerge:
+            case spv::OpLoopMerge:
+            case spv::OpImageWrite:
+            case spv::OpEmitVertex:
+            case spv::OpEndPrimitive:
+            case spv::OpControlBarrier:
+            case spv::OpMemoryBarrier:
+                return false;
+            default:
+                return true;
+        }
+    }
+
+    bool isLowerable(Instruction const& i) const {
+        if (i.opcode == spv::OpExtInst) {
+            return i.wordCount > 4 && mGlslStd450 && word(i, 3) == mGlslStd450 &&
+                    isRangePreservingExtInst(word(i, 4));
+        }
+        return isRangePreserving(i.opcode);
+    }
+
+    // The ids operands of a lowerable instruction, the other operands are literals or labels.
+    template<typename F>
+    void forEachOperand(Instruction const& i, F f) const {
+        size_t first = 3, last = i.wordCount, step = 1;
+        switch (i.opcode) {
+            case spv::OpCompositeExtract:   last = std::min<size_t>(last, 4); break;
+            case spv::OpCompositeInsert:    last = std::min<size_t>(last, 5); break;
+            case spv::OpVectorShuffle:      last = std::min<size_t>(last, 5); break;
+            case spv::OpPhi:                step = 2; break;
+            case spv::OpExtInst:            first = 5; break;
+            default: break;
+        }
+        for (size_t index = first; index < last; index += step) {
+            f(word(i, index));
+        }
+    }
+
+    // an operation is computed at mediump when all its floating point operands are mediump or
+    // constants (which adopt the precision of the other operands in GLSL)
+    bool isComputedAtMediump(Instruction const& i) const {
+        bool hasRelaxedOperand = false;
+        bool ok = true;
+        forEachOperand(i, [&](uint32_t operand) {
+            if (!isValid(operand)) {
+                ok = false;
+            } else if (mRelaxed[operand]) {
+                hasRelaxedOperand = true;
+            } else if (mFloat[mTypeOf[operand]] && !mConstant[operand]) {
+                ok = false;
+            }
+        });
+        return ok && hasRelaxedOperand;
+    }
+
+    // an input is consumed at mediump when it is only loaded, and the loaded values are only
+    // used by mediump operations or stored to mediump outputs
+    bool isConsumedAtMediump(uint32_t input) const {
+        for (Instruction const& i : mInstructions) {
+            const bool isLoadOfInput =
+                    i.opcode == spv::OpLoad && i.wordCount > 3 && word(i, 3) == input;
+            for (size_t index = 1; index < i.wordCount; index++) {
+                if (word(i, index) == input && !isLoadOfInput) {
+                    return false;
+                }
+            }
+            if (isLoadOfInput && !isUsedAtMediump(word(i, 2), i.offset)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool isUsedAtMediump(uint32_t value, size_t definition) const {
+        for (Instruction const& i : mInstructions) {
+            if (i.offset == definition) {
+                continue;
+            }
+            bool uses = false;
+            for (size_t index = 1; index < i.wordCount; index++) {
+                uses |= word(i, index) == value;
+            }
+            if (!uses) {
+                continue;
+            }
+            if (i.opcode == spv::OpStore) {
+                const uint32_t pointer = word(i, 1);
+                if (i.wordCount < 3 || word(i, 2) != value || pointer == value ||
+                        !isValid(pointer) || !mRelaxed[pointer] ||
+                        mStorageClass[pointer] != spv::StorageClassOutput) {
+                    return false;
+                }
+            } else if (!isLowerable(i) || !mRelaxed[word(i, 2)]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::vector<uint32_t>& mSpirv;
+    std::vector<bool> mRelaxed;
+    std::vector<bool> mFloat;
+    std::vector<bool> mConstant;
+    std::vector<bool> mBuiltIn;
+    std::vector<uint32_t> mTypeOf;
+    std::vector<uint32_t> mPointee;
+    std::vector<uint32_t> mStorageClass;
+    std::vector<uint32_t> mInputs;
+    std::vector<Instruction> mInstructions;
+    std::vector<Instruction> mLoads;
+    std::vector<Instruction> mCandidates;
+    size_t mAnnotationsEnd = 0;
+    uint32_t mGlslStd450 = 0;
+    bool mIsFragment = false;
+};
+
+} // anonymous namespace
+
+size_t lowerPrecision(std::vector<uint32_t>& spirv) {
+    return PrecisionLowering(spirv).run();
+}
+
+} // namespace matc
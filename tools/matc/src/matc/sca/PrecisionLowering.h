@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TNT_PRECISIONLOWERING_H
+#define TNT_PRECISIONLOWERING_H
+
+#include <vector>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace matc {
+
+// Decorates with RelaxedPrecision (i.e. mediump) the floating point values of an optimized
+// SPIR-V module that can't be more precise than mediump anyway:
+// - temporaries computed only from mediump values and constants, by operations that don't
+//   extend their range (additions, min/max/clamp/mix, swizzles, selects, phis, etc.). This
+//   recovers the precision of temporaries that were declared highp but that the optimizer turned
+//   into plain values.
+// - fragment shader inputs (interpolants) whose values are only consumed at mediump.
+// Multiplications, divisions, dot products and transcendental functions are never lowered: they
+// can overflow mediump's range even when their operands fit.
+// Returns the number of values lowered.
+size_t lowerPrecision(std::vector<uint32_t>& spirv);
+
+} // namespace matc
+
+#endif //TNT_PRECISIONLOWERING_H
@@ -14,12 +14,20 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include <gtest/gtest.h>
 
 #include "MockConfig.h"
 
 #include <matc/sca/ASTHelpers.h>
+#include <matc/sca/PrecisionLowering.h>
 #include <matc/MaterialLexer.h>
+#include <matc/ShaderCache.h>
+
+#include <private/filament/Variant.h>
+
+#include <utils/Path.h>
 
 using namespace matc::ASTUtils;
 
@@ -469,6 +477,139 @@ TEST_F(MaterialCompiler, EmptyName) {
     builder.name("");
     filamat::Package result = builder.build();
 }
+
+TEST_F(MaterialCompiler, FeatureStripping) {
+    std::string shaderCode(R"(
+        void material(inout MaterialInputs material) {
+            prepareMaterial(material);
+        }
+    )");
+
+    filamat::MaterialBuilder builder = makeBuilder(shaderCode);
+    filament::driver::ShaderModel model;
+    std::string fragment = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_NE(std::string::npos, fragment.find("#define MATERIAL_HAS_IBL_SPECULAR\n"));
+    EXPECT_NE(std::string::npos,
+            fragment.find("#define MATERIAL_HAS_SPECULAR_AMBIENT_OCCLUSION\n"));
+
+    builder.ibl(filamat::MaterialBuilder::IblMode::SH_ONLY)
+            .specularAmbientOcclusion(false)
+            .punctualLights(false);
+    fragment = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_NE(std::string::npos, fragment.find("#define MATERIAL_HAS_IBL\n"));
+    EXPECT_EQ(std::string::npos, fragment.find("#define MATERIAL_HAS_IBL_SPECULAR\n"));
+    EXPECT_EQ(std::string::npos,
+            fragment.find("#define MATERIAL_HAS_SPECULAR_AMBIENT_OCCLUSION\n"));
+
+    builder.ibl(filamat::MaterialBuilder::IblMode::NONE);
+    fragment = builder.peek(filament::driver::ShaderType::FRAGMENT, model);
+    EXPECT_EQ(std::string::npos, fragment.find("#define MATERIAL_HAS_IBL\n"));
+
+    // without punctual lights, the dynamic lighting variants map to the other variants
+    using filament::Variant;
+    const uint8_t dir = Variant::DIRECTIONAL_LIGHTING;
+    const uint8_t dyn = Variant::DYNAMIC_LIGHTING;
+    const uint8_t sre = Variant::SHADOW_RECEIVER;
+    EXPECT_EQ(dir | dyn, Variant::filterVariant(dir | dyn, true));
+    EXPECT_EQ(dir, Variant::filterVariant(dir | dyn, true, false));
+    EXPECT_EQ(dir | sre, Variant::filterVariant(dir | dyn | sre, true, false));
+    EXPECT_EQ(0, Variant::filterVariant(dyn | sre, true, false));
+    EXPECT_EQ(sre, Variant::filterVariant(Variant::DEPTH_VARIANT, true, false));
+}
+
+TEST_F(MaterialCompiler, ShaderCache) {
+    MockConfig config;
+    config.setOptimizationLevel(matc::Config::Optimization::PREPROCESSOR);
+    matc::GLSLPostProcessor postProcessor(config);
+
+    utils::Path directory("test_matc_shader_cache");
+    {
+        matc::ShaderCache cache(config, directory);
+        const std::string shader("#version 300 es\nvoid main() { }\n");
+        const auto type = filament::driver::ShaderType::FRAGMENT;
+        const auto model = filament::driver::ShaderModel::GL_ES_30;
+
+        std::string miss;
+        EXPECT_TRUE(cache.process(postProcessor, shader, type, model, &miss, nullptr));
+        std::string hit;
+        EXPECT_TRUE(cache.process(postProcessor, shader, type, model, &hit, nullptr));
+        EXPECT_EQ(miss, hit);
+
+        // any change to the source is a different entry
+        std::string other;
+        EXPECT_TRUE(cache.process(postProcessor, shader + "\n", type, model, &other, nullptr));
+
+        EXPECT_EQ(1, cache.getHitCount());
+        EXPECT_EQ(2, cache.getMissCount());
+    }
+    for (utils::Path entry : directory.listContents()) {
+        entry.unlinkFile();
+    }
+}
+
+TEST(PrecisionLowering, DemotesMediumpComputations) {
+    // in highp vec4 v; in mediump vec4 color; out mediump vec4 out;
+    // c = color + color; d = clamp(c, color, color); e = c * c; out = d; out = v;
+    enum : uint32_t {
+        GLSL = 1, MAIN, V, COLOR, OUT, VOID, FN, FLOAT, VEC4, PTR_IN, PTR_OUT, HALF, LABEL,
+        A, B, C, D, E, BOUND
+    };
+    auto op = [](uint32_t opcode, uint32_t wordCount) { return (wordCount << 16u) | opcode; };
+    std::vector<uint32_t> spirv = {
+            0x07230203, 0x00010000, 0, BOUND, 0,
+            op(17, 2), 1,                                           // OpCapability Shader
+            op(11, 6), GLSL, 0x4c534c47, 0x6474732e, 0x3035342e, 0, // OpExtInstImport
+            op(14, 3), 0, 1,                                        // OpMemoryModel
+            op(15, 7), 4, MAIN, 0x6e69616d, 0, V, OUT,              // OpEntryPoint Fragment
+            op(71, 3), COLOR, 0,                                    // OpDecorate RelaxedPrecision
+            op(71, 3), OUT, 0,
+            op(71, 3), A, 0,
+            op(19, 2), VOID,                                        // OpTypeVoid
+            op(33, 3), FN, VOID,                                    // OpTypeFunction
+            op(22, 3), FLOAT, 32,                                   // OpTypeFloat
+            op(23, 4), VEC4, FLOAT, 4,                              // OpTypeVector
+            op(32, 4), PTR_IN, 1, VEC4,                             // OpTypePointer Input
+            op(32, 4), PTR_OUT, 3, VEC4,                            // OpTypePointer Output
+            op(59, 4), PTR_IN, V, 1,                                // OpVariable
+            op(59, 4), PTR_IN, COLOR, 1,
+            op(59, 4), PTR_OUT, OUT, 3,
+            op(43, 4), FLOAT, HALF, 0x3f000000,                     // OpConstant
+            op(54, 5), VOID, MAIN, 0, FN,                           // OpFunction
+            op(248, 2), LABEL,                                      // OpLabel
+            op(61, 4), VEC4, A, COLOR,                              // OpLoad
+            op(61, 4), VEC4, B, V,
+            op(129, 5), VEC4, C, A, A,                              // OpFAdd
+            op(12, 8), VEC4, D, GLSL, 43, C, A, A,                  // OpExtInst FClamp
+            op(133, 5), VEC4, E, C, C,                              // OpFMul
+            op(62, 3), OUT, D,                                      // OpStore
+            op(62, 3), OUT, B,
+            op(253, 1),                                             // OpReturn
+            op(56, 1),                                              // OpFunctionEnd
+    };
+    const size_t originalSize = spirv.size();
+
+    EXPECT_EQ(4, matc::lowerPrecision(spirv));
+    ASSERT_EQ(originalSize + 4 * 3, spirv.size());
+
+    // the decorations are added after the existing ones, before the types
+    std::vector<uint32_t> lowered;
+    for (size_t i = 0; i < 4; i++) {
+        EXPECT_EQ(op(71, 3), spirv[32 + i * 3]);
+        EXPECT_EQ(0, spirv[34 + i * 3]);
+        lowered.push_back(spirv[33 + i * 3]);
+    }
+    EXPECT_EQ(op(19, 2), spirv[44]);
+    std::sort(lowered.begin(), lowered.end());
+    EXPECT_EQ(std::vector<uint32_t>({ V, B, C, D }), lowered);
+
+    // running again finds nothing new
+    EXPECT_EQ(0, matc::lowerPrecision(spirv));
+
+    // not a SPIR-V module
+    std::vector<uint32_t> garbage = { 1, 2, 3 };
+    EXPECT_EQ(0, matc::lowerPrecision(garbage));
+}
+
 int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
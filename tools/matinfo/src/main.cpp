@@ -33,9 +33,11 @@
 #include <spirv_glsl.hpp>
 #include <spirv-tools/libspirv.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <unordered_map>
 
 using namespace filaflat;
 using namespace utils;
@@ -47,6 +49,7 @@ struct Config {
     bool printSPIRV = false;
     bool transpile = false;
     bool binary = false;
+    bool printStats = false;
     uint64_t shaderIndex;
 };
 
@@ -75,6 +78,8 @@ static void printUsage(const char* name) {
                     "       Print the nth Vulkan shader transpiled into GLSL\n\n"
                     "   --dump-binary=[index], -b\n"
                     "       Dump binary SPIRV for the nth Vulkan shader to 'out.spv'\n\n"
+                    "   --stats, -c\n"
+                    "       Print the estimated cost of each Vulkan shader, as JSON\n\n"
                     "   --license\n"
                     "       Print copyright and license information\n\n"
     );
@@ -93,7 +98,7 @@ static void license() {
 }
 
 static int handleArguments(int argc, char* argv[], Config* config) {
-    static constexpr const char* OPTSTR = "hlg:s:v:b:";
+    static constexpr const char* OPTSTR = "hlcg:s:v:b:";
     static const struct option OPTIONS[] = {
             { "help",         no_argument,       0, 'h' },
             { "license",      no_argument,       0, 'l' },
@@ -101,6 +106,7 @@ static int handleArguments(int argc, char* argv[], Config* config) {
             { "print-spirv",  required_argument, 0, 's' },
             { "print-vkglsl", required_argument, 0, 'v' },
             { "dump-binary",  required_argument, 0, 'b' },
+            { "stats",        no_argument,       0, 'c' },
             { 0, 0, 0, 0 }  // termination of the option list
     };
 
@@ -135,6 +141,9 @@ static int handleArguments(int argc, char* argv[], Config* config) {
                 config->shaderIndex = static_cast<uint64_t>(std::stoi(arg));
                 config->binary = true;
                 break;
+            case 'c':
+                config->printStats = true;
+                break;
         }
     }
 
@@ -285,6 +294,7 @@ const char* toString(filament::SamplerInterfaceBlock::Type type) {
         case filament::driver::SamplerType::SAMPLER_2D: return "sampler2D";
         case filament::driver::SamplerType::SAMPLER_CUBEMAP: return "samplerCubemap";
         case filament::driver::SamplerType::SAMPLER_EXTERNAL: return "samplerExternal";
+        case filament::driver::SamplerType::SAMPLER_2D_ARRAY: return "sampler2DArray";
     }
 }
 
@@ -371,6 +381,7 @@ static bool printMaterial(const ChunkContainer& container) {
     printChunk<filament::Interpolation, uint8_t>(container, filamat::MaterialInterpolation,
             "Interpolation: ");
     printChunk<bool, bool>(container, filamat::MaterialShadowMultiplier, "Shadow multiply: ");
+    printChunk<bool, bool>(container, filamat::MaterialPunctualLights, "Punctual lights: ");
 
     std::cout << std::endl;
 
@@ -728,11 +739,205 @@ static void dumpSpirvBinary(const std::vector<uint32_t>& spirv, std::string file
     std::cout << "Binary SPIR-V dumped to " << filename << std::endl;
 }
 
+// Cost of a shader, estimated from its SPIR-V. This is meant to compare variants and catch cost
+// regressions, the count of instructions says little about the code the drivers generate.
+struct ShaderStats {
+    size_t instructions = 0;        // instructions in the functions' bodies
+    size_t textureFetches = 0;      // image sampling, fetch, gather and read instructions
+    size_t branches = 0;            // conditional branches and switches
+    size_t loops = 0;
+    size_t registerPressure = 0;    // scalar components live at once, see below
+    size_t uniformBytes = 0;        // size of the uniform blocks the shader uses
+    size_t samplers = 0;            // samplers the shader uses
+};
+
+struct SpirvAnalysis {
+    struct Instruction {
+        uint16_t opcode;
+        uint32_t resultId;
+        std::vector<uint32_t> uses;
+    };
+    std::unordered_map<uint32_t, uint32_t> componentCounts;   // scalar components of each type
+    std::unordered_map<uint32_t, uint32_t> resultTypes;       // type of each result
+    std::vector<std::vector<Instruction>> functions;
+    bool inFunction = false;
+};
+
+static spv_result_t analyzeInstruction(void* user, const spv_parsed_instruction_t* inst) {
+    SpirvAnalysis& analysis = *static_cast<SpirvAnalysis*>(user);
+    const uint32_t* words = inst->words;
+    switch (inst->opcode) {
+        case spv::OpTypeBool:
+        case spv::OpTypeInt:
+        case spv::OpTypeFloat:
+            analysis.componentCounts[inst->result_id] = 1;
+            break;
+        case spv::OpTypeVector:     // component type, count
+        case spv::OpTypeMatrix:     // column type, count
+            analysis.componentCounts[inst->result_id] =
+                    analysis.componentCounts[words[2]] * words[3];
+            break;
+        case spv::OpFunction:
+            analysis.functions.emplace_back();
+            analysis.inFunction = true;
+            break;
+        case spv::OpFunctionEnd:
+            analysis.inFunction = false;
+            break;
+        default:
+            if (analysis.inFunction) {
+                SpirvAnalysis::Instruction instruction{ inst->opcode, inst->result_id, {} };
+                for (uint16_t i = 0; i < inst->num_operands; i++) {
+                    spv_parsed_operand_t const& operand = inst->operands[i];
+                    if (operand.type == SPV_OPERAND_TYPE_ID) {
+                        instruction.uses.push_back(words[operand.offset]);
+                    }
+                }
+                analysis.functions.back().push_back(std::move(instruction));
+            }
+            break;
+    }
+    if (inst->result_id && inst->type_id) {
+        analysis.resultTypes[inst->result_id] = inst->type_id;
+    }
+    return SPV_SUCCESS;
+}
+
+static ShaderStats analyzeSpirv(const std::vector<uint32_t>& spirv) {
+    SpirvAnalysis analysis;
+    auto context = spvContextCreate(SPV_ENV_UNIVERSAL_1_1);
+    spvBinaryParse(context, &analysis, spirv.data(), spirv.size(), nullptr,
+            analyzeInstruction, nullptr);
+    spvContextDestroy(context);
+
+    ShaderStats stats;
+    for (auto const& function : analysis.functions) {
+        // The register pressure is estimated from the live ranges of the values in the order of
+        // the instructions, a value is live from its definition to its last use. This ignores
+        // the values carried by loops and the drivers' scheduling.
+        std::unordered_map<uint32_t, size_t> lastUse;
+        for (size_t i = 0; i < function.size(); i++) {
+            for (uint32_t id : function[i].uses) {
+                lastUse[id] = i;
+            }
+        }
+        std::vector<int64_t> delta(function.size() + 1, 0);
+        for (size_t i = 0; i < function.size(); i++) {
+            SpirvAnalysis::Instruction const& inst = function[i];
+            switch (inst.opcode) {
+                case spv::OpLabel:
+                case spv::OpFunctionParameter:
+                case spv::OpVariable:
+                case spv::OpLine:
+                case spv::OpNoLine:
+                case spv::OpSelectionMerge:
+                    break;
+                case spv::OpLoopMerge:
+                    stats.loops++;
+                    break;
+                case spv::OpBranchConditional:
+                case spv::OpSwitch:
+                    stats.branches++;
+                    stats.instructions++;
+                    break;
+                case spv::OpImageSampleImplicitLod:
+                case spv::OpImageSampleExplicitLod:
+                case spv::OpImageSampleDrefImplicitLod:
+                case spv::OpImageSampleDrefExplicitLod:
+                case spv::OpImageSampleProjImplicitLod:
+                case spv::OpImageSampleProjExplicitLod:
+                case spv::OpImageSampleProjDrefImplicitLod:
+                case spv::OpImageSampleProjDrefExplicitLod:
+                case spv::OpImageFetch:
+                case spv::OpImageGather:
+                case spv::OpImageDrefGather:
+                case spv::OpImageRead:
+                    stats.textureFetches++;
+                    stats.instructions++;
+                    break;
+                default:
+                    stats.instructions++;
+                    break;
+            }
+            auto type = analysis.resultTypes.find(inst.resultId);
+            auto last = lastUse.find(inst.resultId);
+            if (type != analysis.resultTypes.end() && last != lastUse.end() && last->second > i) {
+                auto components = analysis.componentCounts.find(type->second);
+                if (components != analysis.componentCounts.end()) {
+                    delta[i] += components->second;
+                    delta[last->second] -= components->second;
+                }
+            }
+        }
+        int64_t live = 0;
+        for (int64_t d : delta) {
+            live += d;
+            stats.registerPressure = std::max(stats.registerPressure, size_t(live));
+        }
+    }
+
+    spirv_cross::CompilerGLSL compiler(spirv);
+    auto resources = compiler.get_shader_resources(compiler.get_active_interface_variables());
+    for (auto const& ub : resources.uniform_buffers) {
+        stats.uniformBytes += compiler.get_declared_struct_size(compiler.get_type(ub.base_type_id));
+    }
+    stats.samplers = resources.sampled_images.size();
+    return stats;
+}
+
+static bool printShaderStats(const ChunkContainer& container, void* data, size_t size) {
+    MaterialParser parser(filament::driver::Backend::VULKAN, data, size);
+    if (!parser.parse() || (!parser.isShadingMaterial() && !parser.isPostProcessMaterial())) {
+        return false;
+    }
+
+    std::vector<ShaderInfo> info;
+    if (!getVkShaderInfo(container, &info)) {
+        std::cerr << "Failed to parse SPIRV chunk." << std::endl;
+        return false;
+    }
+
+    std::string name;
+    read(container, filamat::MaterialName, &name);
+
+    std::cout << "{" << std::endl;
+    std::cout << "  \"name\": \"" << name << "\"," << std::endl;
+    std::cout << "  \"shaders\": [" << std::endl;
+    filaflat::ShaderBuilder builder;
+    for (size_t i = 0; i < info.size(); ++i) {
+        const auto& item = info[i];
+        parser.getShader(item.shaderModel, item.variant, item.pipelineStage, builder);
+        uint32_t const* words = reinterpret_cast<uint32_t const*>(builder.getShader());
+        const std::vector<uint32_t> spirv(words, words + builder.size() / 4);
+        const ShaderStats stats = analyzeSpirv(spirv);
+
+        std::cout << "    { "
+                << "\"index\": " << i << ", "
+                << "\"shaderModel\": \"" << toString(item.shaderModel) << "\", "
+                << "\"stage\": \"" << toString(item.pipelineStage) << "\", "
+                << "\"variant\": " << int(item.variant) << ", "
+                << "\"instructions\": " << stats.instructions << ", "
+                << "\"textureFetches\": " << stats.textureFetches << ", "
+                << "\"branches\": " << stats.branches << ", "
+                << "\"loops\": " << stats.loops << ", "
+                << "\"registerPressure\": " << stats.registerPressure << ", "
+                << "\"uniformBytes\": " << stats.uniformBytes << ", "
+                << "\"samplers\": " << stats.samplers
+                << " }" << (i + 1 < info.size() ? "," : "") << std::endl;
+    }
+    std::cout << "  ]" << std::endl;
+    std::cout << "}" << std::endl;
+    return true;
+}
+
 static bool parseChunks(Config config, void* data, size_t size) {
     ChunkContainer container(data, size);
     if (!container.parse()) {
         return false;
     }
+    if (config.printStats) {
+        return printShaderStats(container, data, size);
+    }
     if (config.printGLSL || config.printSPIRV) {
         filaflat::ShaderBuilder builder;
         std::vector<ShaderInfo> info;
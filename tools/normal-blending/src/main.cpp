@@ -23,6 +23,7 @@
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
+#include <utils/JobSystem.h>
 #include <utils/Path.h>
 
 #include <getopt/getopt.h>
@@ -34,7 +35,7 @@ static image::ImageEncoder::Format g_format = image::ImageEncoder::Format::PNG;
 static bool g_formatSpecified = false;
 static std::string g_compression = "";
 
-static void blend(const Image& normal, const Image& detail, Image& output);
+static void blend(utils::JobSystem& js, const Image& normal, const Image& detail, Image& output);
 
 static void printUsage(const char* name) {
     std::string execName(utils::Path(name).getName());
@@ -193,7 +194,9 @@ int main(int argc, char* argv[]) {
     std::unique_ptr<uint8_t[]> buffer(new uint8_t[width * height * sizeof(float3)]);
     Image image(std::move(buffer), width, height, width * sizeof(float3), sizeof(float3));
 
-    blend(normalImage, detailImage, image);
+    utils::JobSystem js;
+    js.adopt();
+    blend(js, normalImage, detailImage, image);
 
     if (!g_formatSpecified) {
         g_format = ImageEncoder::chooseFormat(outputMap);
@@ -214,22 +217,31 @@ int main(int argc, char* argv[]) {
     }
 }
 
-void blend(const Image& normal, const Image& detail, Image& output) {
+void blend(utils::JobSystem& js, const Image& normal, const Image& detail, Image& output) {
+    using namespace utils;
+
     const size_t width = output.getWidth();
     const size_t height = output.getHeight();
 
-    for (size_t y = 0; y < height; y++) {
-        float3* normalRow = static_cast<float3*>(normal.getPixelRef(0, y));
-        float3* detailRow = static_cast<float3*>(detail.getPixelRef(0, y));
-        float3* outputRow = static_cast<float3*>(output.getPixelRef(0, y));
+    auto blendRows = [&normal, &detail, &output, width](size_t y0, size_t count) {
+        for (size_t y = y0; y < y0 + count; y++) {
+            float3* normalRow = static_cast<float3*>(normal.getPixelRef(0, y));
+            float3* detailRow = static_cast<float3*>(detail.getPixelRef(0, y));
+            float3* outputRow = static_cast<float3*>(output.getPixelRef(0, y));
 
-        for (size_t x = 0; x < width; x++, normalRow++, detailRow++, outputRow++) {
-            // Reoriented Normal Mapping
-            float3 t = *normalRow * float3( 2,  2, 2) + float3(-1, -1,  0);
-            float3 u = *detailRow * float3(-2, -2, 2) + float3( 1,  1, -1);
-            float3 r = normalize(t * dot(t, u) - u * t.z);
+            for (size_t x = 0; x < width; x++, normalRow++, detailRow++, outputRow++) {
+                // Reoriented Normal Mapping
+                float3 t = *normalRow * float3( 2,  2, 2) + float3(-1, -1,  0);
+                float3 u = *detailRow * float3(-2, -2, 2) + float3( 1,  1, -1);
+                float3 r = normalize(t * dot(t, u) - u * t.z);
 
-            *outputRow = r * 0.5 + 0.5;
+                *outputRow = r * 0.5 + 0.5;
+            }
         }
-    }
+    };
+
+    JobSystem::Job* job = jobs::parallel_for(js, nullptr, 0, uint32_t(height),
+            std::ref(blendRows), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+    js.release(job);
 }
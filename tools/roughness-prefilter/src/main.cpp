@@ -22,6 +22,7 @@
 
 #include <math/vec3.h>
 
+#include <imageio/AsyncImageEncoder.h>
 #include <imageio/ImageDecoder.h>
 #include <imageio/ImageEncoder.h>
 
@@ -175,75 +176,86 @@ inline bool isPOT(size_t x) {
     return !(x & (x - 1));
 }
 
-float solveVMF(const float2& pos, const size_t sampleCount, const float roughness,
-        const Image& normal) {
-
-    float3 averageNormal(0.0f);
-    float2 topLeft(-float(sampleCount) / 2.0f + 0.5f);
+// Runs work(y0, count) on bands of the rows [0, height) in parallel, and waits for them.
+template<typename F>
+static void forEachRow(JobSystem& js, size_t height, F work) {
+    JobSystem::Job* job = jobs::parallel_for(js, nullptr, 0, uint32_t(height),
+            std::ref(work), jobs::CountSplitter<1, 8>());
+    js.runAndWait(job);
+    js.release(job);
+}
 
-    for (size_t y = 0; y < sampleCount; y++) {
-        for (size_t x = 0; x < sampleCount; x++) {
-            float2 offset(topLeft + float2(x, y));
-            float2 samplePos(floor(pos + offset) + 0.5f);
-            float3 sampleNormal = *static_cast<float3*>(
-                    normal.getPixelRef(size_t(samplePos.x), size_t(samplePos.y)));
-            sampleNormal = sampleNormal * 2.0f - 1.0f;
+// See: Karis, 2018, "Normal map filtering using vMF (part 3)"
+// The original formulation in Neubelt et al. 2013,
+// "Crafting a Next-Gen Material Pipeline for The Order: 1886" contains an error
+// and defines alpha' = sqrt(alpha^2 + 1 / kappa)
+static inline float solveVMF(const float3& averageNormal, const float roughness) {
+    const float r = length(averageNormal);
+    // selected rather than branched on so that the loops calling this are vectorized
+    const float kappa = r < 1.0f ? (3.0f * r - r * r * r) / (1.0f - r * r) : 10000.0f;
+    return std::sqrt(roughness * roughness + (2.0f / kappa));
+}
 
-            averageNormal += normalize(sampleNormal);
+// Decodes and normalizes the normals of normal into dst. The decoded images can have an alpha
+// channel, so their texels are addressed with getPixelRef().
+static void normalizeNormals(JobSystem& js, const Image& normal, Image& dst) {
+    const size_t width = dst.getWidth();
+    forEachRow(js, dst.getHeight(), [&normal, &dst, width](size_t y0, size_t count) {
+        for (size_t y = y0; y < y0 + count; y++) {
+            auto* row = static_cast<float3*>(dst.getPixelRef(0, y));
+            for (size_t x = 0; x < width; x++) {
+                const float3 n = *static_cast<float3 const*>(normal.getPixelRef(x, y));
+                row[x] = normalize(n * 2.0f - 1.0f);
+            }
         }
-    }
-
-    averageNormal /= (sampleCount * sampleCount);
-
-    float r = length(averageNormal);
-    float kappa = 10000.0f;
-
-    if (r < 1.0f) {
-        kappa = (3.0f * r - r * r * r) / (1.0f - r * r);
-    }
-
-    // See: Karis, 2018, "Normal map filtering using vMF (part 3)"
-    // The original formulation in Neubelt et al. 2013,
-    // "Crafting a Next-Gen Material Pipeline for The Order: 1886" contains an error
-    // and defines alpha' = sqrt(alpha^2 + 1 / kappa)
-    return std::sqrt(roughness * roughness + (2.0f / kappa));
+    });
 }
 
-void prefilter(const Image& normal, const size_t mipLevel, Image& output) {
-    const size_t width = output.getWidth();
-    const size_t height = output.getHeight();
-    const size_t sampleCount = 1u << mipLevel;
-
-    for (size_t y = 0; y < height; y++) {
-        auto* outputRow = static_cast<float3*>(output.getPixelRef(0, y));
-        for (size_t x = 0; x < width; x++, outputRow++) {
-            const float2 uv = (float2(x, y) + 0.5f) / float2(width, height);
-            const float2 pos = uv * normal.getWidth();
-            const float roughness = g_roughness;
-            *outputRow = float3(solveVMF(pos, sampleCount, roughness, normal));
+// Each texel of dst is the average of the 2x2 texels of src it covers, dst is half the size.
+static void downsample(JobSystem& js, const Image& src, Image& dst) {
+    const size_t width = dst.getWidth();
+    forEachRow(js, dst.getHeight(), [&src, &dst, width](size_t y0, size_t count) {
+        for (size_t y = y0; y < y0 + count; y++) {
+            auto* row = static_cast<float3*>(dst.getPixelRef(0, y));
+            for (size_t x = 0; x < width; x++) {
+                float3 aa = *static_cast<float3 const*>(src.getPixelRef(x * 2,     y * 2));
+                float3 ba = *static_cast<float3 const*>(src.getPixelRef(x * 2 + 1, y * 2));
+                float3 ab = *static_cast<float3 const*>(src.getPixelRef(x * 2,     y * 2 + 1));
+                float3 bb = *static_cast<float3 const*>(src.getPixelRef(x * 2 + 1, y * 2 + 1));
+                row[x] = (aa + ba + ab + bb) * 0.25f;
+            }
         }
-    }
+    });
 }
 
-template<bool FIRST_MIP>
-void prefilter(const Image& normal, const Image& roughness, const size_t mipLevel, Image& output) {
+static Image createImage(size_t w, size_t h, size_t channels) {
+    std::unique_ptr<uint8_t[]> buffer(new uint8_t[w * h * sizeof(float3)]);
+    return Image(std::move(buffer), w, h, w * sizeof(float3), sizeof(float3), channels);
+}
+
+// averageNormal holds, for each texel of the output, the average of the normalized normals of
+// the normal map it covers, roughness is the roughness map of the same size if there is one.
+static void prefilter(JobSystem& js, const Image& averageNormal, const Image* roughness,
+        Image& output) {
     const size_t width = output.getWidth();
-    const size_t height = output.getHeight();
-    const size_t sampleCount = 1u << mipLevel;
-
-    for (size_t y = 0; y < height; y++) {
-        auto* outputRow = static_cast<float3*>(output.getPixelRef(0, y));
-        for (size_t x = 0; x < width; x++, outputRow++) {
-            const float3* data = static_cast<float3*>(roughness.getPixelRef(x, y));
-            if (FIRST_MIP) {
-                *outputRow = *data;
+    forEachRow(js, output.getHeight(),
+            [&averageNormal, roughness, &output, width](size_t y0, size_t count) {
+        for (size_t y = y0; y < y0 + count; y++) {
+            auto const* normals = static_cast<float3 const*>(averageNormal.getPixelRef(0, y));
+            auto* outputRow = static_cast<float3*>(output.getPixelRef(0, y));
+            if (roughness) {
+                auto const* data = static_cast<float3 const*>(roughness->getPixelRef(0, y));
+                for (size_t x = 0; x < width; x++) {
+                    outputRow[x] = float3(solveVMF(normals[x], data[x].r));
+                }
             } else {
-                const float2 uv = (float2(x, y) + 0.5f) / float2(width, height);
-                const float2 pos = uv * normal.getWidth();
-                *outputRow = float3(solveVMF(pos, sampleCount, data->r, normal));
+                const float r = g_roughness;
+                for (size_t x = 0; x < width; x++) {
+                    outputRow[x] = float3(solveVMF(normals[x], r));
+                }
             }
         }
-    }
+    });
 }
 
 int main(int argc, char* argv[]) {
@@ -342,84 +354,68 @@ int main(int argc, char* argv[]) {
             break;
     }
 
+    JobSystem js;
+    js.adopt();
+
     if (hasRoughnessMap) {
         mipImages.push_back(std::move(roughnessImage));
-        Image* prevMip = &mipImages.at(0);
-
-        for (size_t i = 1; i <= mipLevels; i++) {
-            const size_t w = width >> i;
-            const size_t h = height >> i;
-
-            const size_t size = w * h * sizeof(float3);
-            std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
-            Image image(std::move(buffer), w, h, w * sizeof(float3), sizeof(float3), channels);
-
-            for (size_t y = 0; y < h; y++) {
-                auto* dst = static_cast<float3*>(image.getPixelRef(0, y));
-                for (size_t x = 0; x < w; x++, dst++) {
-                    float3 aa = *static_cast<float3*>(prevMip->getPixelRef(x * 2,     y * 2));
-                    float3 ba = *static_cast<float3*>(prevMip->getPixelRef(x * 2 + 1, y * 2));
-                    float3 ab = *static_cast<float3*>(prevMip->getPixelRef(x * 2,     y * 2 + 1));
-                    float3 bb = *static_cast<float3*>(prevMip->getPixelRef(x * 2 + 1, y * 2 + 1));
-                    *dst = (aa + ba + ab + bb) / 4.0f;
-                }
-            }
-
+        for (size_t i = 1; i < mipLevels; i++) {
+            Image image(createImage(width >> i, height >> i, channels));
+            downsample(js, mipImages.at(i - 1), image);
             mipImages.push_back(std::move(image));
-            prevMip = &mipImages.at(i);
         }
     }
 
-    JobSystem js;
-    js.adopt();
+    // The texels of level i cover blocks of 2^i x 2^i normals, whose average is the average of
+    // the 4 averages of the level above: the averages are computed once per level rather than
+    // summing the 4^i normals of each texel.
+    std::vector<Image> averageNormals;
+    averageNormals.push_back(createImage(width, height, 3));
+    normalizeNormals(js, normalImage, averageNormals.at(0));
+    normalImage = Image();
+    for (size_t i = 1; i < mipLevels; i++) {
+        const Image& prev = averageNormals.at(i - 1);
+        Image image(createImage(prev.getWidth() / 2, prev.getHeight() / 2, 3));
+        downsample(js, prev, image);
+        averageNormals.push_back(std::move(image));
+    }
 
-    JobSystem::Job* parent = js.createJob();
+    // the levels are written while the next ones are computed
+    AsyncImageEncoder encoder(js);
+    std::vector<Image> outputImages;
     for (size_t i = 0; i < mipLevels; i++) {
-        JobSystem::Job* mip = jobs::createJob(js, parent,
-                [&normalImage, &mipImages, outputMap, i, width, height, channels, hasRoughnessMap]() {
-            const size_t w = width >> i;
-            const size_t h = height >> i;
-
-            const size_t size = w * h * sizeof(float3);
-            std::unique_ptr<uint8_t[]> buffer(new uint8_t[size]);
-            Image image(std::move(buffer), w, h, w * sizeof(float3), sizeof(float3), channels);
-
-            if (i == 0) {
-                if (hasRoughnessMap) {
-                    if (mipImages.at(0).getBytesPerRow() == image.getBytesPerRow()) {
-                        memcpy(image.getData(), mipImages.at(0).getData(), size);
-                    } else {
-                        prefilter<true>(normalImage, mipImages.at(0), 0, image);
+        const size_t w = width >> i;
+        const size_t h = height >> i;
+        Image image(createImage(w, h, channels));
+
+        if (i == 0) {
+            if (hasRoughnessMap) {
+                const Image& src = mipImages.at(0);
+                for (size_t y = 0; y < h; y++) {
+                    auto* dst = static_cast<float3*>(image.getPixelRef(0, y));
+                    for (size_t x = 0; x < w; x++) {
+                        dst[x] = *static_cast<float3 const*>(src.getPixelRef(x, y));
                     }
-                } else {
-                    std::fill_n(static_cast<float3*>(image.getData()), w * h, float3(g_roughness));
                 }
             } else {
-                if (hasRoughnessMap) {
-                    prefilter<false>(normalImage, mipImages.at(i), i, image);
-                } else {
-                    prefilter(normalImage, i, image);
-                }
+                std::fill_n(static_cast<float3*>(image.getData()), w * h, float3(g_roughness));
             }
+        } else {
+            prefilter(js, averageNormals.at(i), hasRoughnessMap ? &mipImages.at(i) : nullptr,
+                    image);
+        }
 
-            const std::string ext = outputMap.getExtension();
-            const std::string name = outputMap.getNameWithoutExtension();
-            Path out = Path(outputMap.getParent()).concat(
-                    name + "_" + std::to_string(i) + "." + ext); // NOLINT
+        const std::string ext = outputMap.getExtension();
+        const std::string name = outputMap.getNameWithoutExtension();
+        Path out = Path(outputMap.getParent()).concat(
+                name + "_" + std::to_string(i) + "." + ext); // NOLINT
 
-            std::ofstream outputStream(out, std::ios::binary | std::ios::trunc);
-            if (!outputStream.good()) {
-                std::cerr << "The output file cannot be opened: " << out << std::endl;
-            } else {
-                ImageEncoder::encode(outputStream, g_format, image, g_compression, out.getPath());
-                outputStream.close();
-                if (!outputStream.good()) {
-                    std::cerr << "An error occurred while writing the output file: " << out <<
-                            std::endl;
-                }
-            }
-        });
-        js.run(mip);
+        encoder.encode(out.getPath(), g_format, image, g_compression);
+        outputImages.push_back(std::move(image));
+    }
+
+    if (!encoder.wait()) {
+        std::cerr << "An error occurred while writing the output files: " << outputMap << std::endl;
+        exit(1);
     }
-    js.runAndWait(parent);
 }